@@ -19,6 +19,7 @@
 #include <haproxy/backend.h>
 #include <haproxy/cfgparse.h>
 #include <haproxy/check.h>
+#include <haproxy/counters.h>
 #include <haproxy/frontend.h>
 #include <haproxy/global.h>
 #include <haproxy/http.h>
@@ -78,10 +79,11 @@ enum {
 			     PROMEX_FL_SCOPE_LI | PROMEX_FL_SCOPE_BACK | \
 			     PROMEX_FL_SCOPE_SERVER | PROMEX_FL_SCOPE_STICKTABLE)
 
-/* Promtheus metric type (gauge or counter) */
+/* Promtheus metric type (gauge, counter or histogram) */
 enum promex_mt_type {
-	PROMEX_MT_GAUGE   = 1,
-	PROMEX_MT_COUNTER = 2,
+	PROMEX_MT_GAUGE     = 1,
+	PROMEX_MT_COUNTER   = 2,
+	PROMEX_MT_HISTOGRAM = 3,
 };
 
 /* The max length for metrics name. It is a hard limit but it should be
@@ -111,6 +113,18 @@ struct promex_label {
 	struct ist value;
 };
 
+/* Number of longs needed for a bitmap of all metrics of a dumper */
+#define PROMEX_METRIC_MAP_LONGS ((MAX(INF_TOTAL_FIELDS, ST_F_TOTAL_FIELDS) + LONGBITS - 1) / LONGBITS)
+
+/* Filters passed in the query-string (appctx->ctx.stats.filter). It is only
+ * allocated if at least one of them is set.
+ */
+struct promex_filter {
+	struct proxy *px;                     /* only dump this proxy, if not NULL */
+	int metrics;                          /* non-zero if metrics were selected */
+	long map[PROMEX_DUMPER_DONE][PROMEX_METRIC_MAP_LONGS]; /* selected metrics per dumper */
+};
+
 /* Global metrics  */
 const struct promex_metric promex_global_metrics[INF_TOTAL_FIELDS] = {
 	//[INF_NAME]                           ignored
@@ -288,6 +302,10 @@ const struct promex_metric promex_st_metrics[ST_F_TOTAL_FIELDS] = {
 	[ST_F_USED_CONN_CUR]  = { .n = IST("used_connections_current"),         .type = PROMEX_MT_GAUGE,    .flags = (                                                                       PROMEX_FL_SRV_METRIC) },
 	[ST_F_NEED_CONN_EST]  = { .n = IST("need_connections_current"),         .type = PROMEX_MT_GAUGE,    .flags = (                                                                       PROMEX_FL_SRV_METRIC) },
 	[ST_F_UWEIGHT]        = { .n = IST("uweight"),                          .type = PROMEX_MT_GAUGE,    .flags = (                                               PROMEX_FL_BACK_METRIC | PROMEX_FL_SRV_METRIC) },
+	[ST_F_QT_HIST]        = { .n = IST("queue_time_seconds"),               .type = PROMEX_MT_HISTOGRAM, .flags = (                                              PROMEX_FL_BACK_METRIC | PROMEX_FL_SRV_METRIC) },
+	[ST_F_CT_HIST]        = { .n = IST("connect_time_seconds"),             .type = PROMEX_MT_HISTOGRAM, .flags = (                                              PROMEX_FL_BACK_METRIC | PROMEX_FL_SRV_METRIC) },
+	[ST_F_RT_HIST]        = { .n = IST("response_time_seconds"),            .type = PROMEX_MT_HISTOGRAM, .flags = (                                              PROMEX_FL_BACK_METRIC | PROMEX_FL_SRV_METRIC) },
+	[ST_F_TT_HIST]        = { .n = IST("total_time_seconds"),               .type = PROMEX_MT_HISTOGRAM, .flags = (                                              PROMEX_FL_BACK_METRIC | PROMEX_FL_SRV_METRIC) },
 };
 
 /* Description of overridden stats fields */
@@ -304,6 +322,10 @@ const struct ist promex_st_metric_desc[ST_F_TOTAL_FIELDS] = {
 	[ST_F_CT_MAX]         = IST("Maximum observed time spent waiting for a connection to complete"),
 	[ST_F_RT_MAX]         = IST("Maximum observed time spent waiting for a server response"),
 	[ST_F_TT_MAX]         = IST("Maximum observed total request+response time (request+queue+connect+response+processing)"),
+	[ST_F_QT_HIST]        = IST("Distribution of the time spent in the queue."),
+	[ST_F_CT_HIST]        = IST("Distribution of the time spent waiting for a connection to complete."),
+	[ST_F_RT_HIST]        = IST("Distribution of the time spent waiting for a server response."),
+	[ST_F_TT_HIST]        = IST("Distribution of the total request+response time (request+queue+connect+response+processing)."),
 };
 
 /* stick table base fields */
@@ -421,6 +443,64 @@ static int promex_metric_to_str(struct buffer *out, struct field *f, size_t max)
 	return 1;
 }
 
+/* Returns the label set identifying the proxy <px>, or the server <sv> of this
+ * proxy if not NULL, pre-rendered in <*cache> (e.g. 'proxy="p",server="s"').
+ * It is built on first use and kept in the object. Proxies and servers cannot
+ * be renamed, and it is released with the object, so it never has to be
+ * invalidated. Concurrent dumps may race to build it, only the first one wins.
+ * IST_NULL is returned on error.
+ */
+static struct ist promex_obj_labels(char **cache, const struct proxy *px, const struct server *sv)
+{
+	char *labels, *old = NULL;
+
+	labels = HA_ATOMIC_LOAD(cache);
+	if (likely(labels))
+		return ist(labels);
+
+	/* names never contain characters which would need to be escaped */
+	if (sv)
+		memprintf(&labels, "proxy=\"%s\",server=\"%s\"", px->id, sv->id);
+	else
+		memprintf(&labels, "proxy=\"%s\"", px->id);
+	if (!labels)
+		return IST_NULL;
+
+	if (!HA_ATOMIC_CAS(cache, &old, labels)) {
+		free(labels);
+		labels = old;
+	}
+	return ist(labels);
+}
+
+/* Builds the name of <metric> in <name>, prefixed by <prefix>. */
+static inline void promex_metric_name(struct ist *name, const struct ist prefix, const struct promex_metric *metric)
+{
+	name->len = 0;
+	istcat(name, prefix, PROMEX_MAX_NAME_LEN);
+	istcat(name, metric->n, PROMEX_MAX_NAME_LEN);
+}
+
+/* Returns non-zero if the metric <field> of the current dumper must be skipped
+ * because it is not part of the ones selected with "metric" parameters, if any.
+ */
+static inline int promex_metric_filtered(const struct appctx *appctx, int field)
+{
+	const struct promex_filter *flt = appctx->ctx.stats.filter;
+
+	return flt && flt->metrics && !ha_bit_test(field, flt->map[appctx->st1]);
+}
+
+/* Returns non-zero if the proxy <px> must be skipped because it is not the one
+ * selected by the "proxy" parameter, if any.
+ */
+static inline int promex_px_filtered(const struct appctx *appctx, const struct proxy *px)
+{
+	const struct promex_filter *flt = appctx->ctx.stats.filter;
+
+	return flt && flt->px && flt->px != px;
+}
+
 /* Dump the header lines for <metric>. It is its #HELP and #TYPE strings. It
  * returns 1 on success. Otherwise, if <out> length exceeds <max>, it returns 0.
  */
@@ -435,6 +515,9 @@ static int promex_dump_metric_header(struct appctx *appctx, struct htx *htx,
 		case PROMEX_MT_COUNTER:
 			type = ist("counter");
 			break;
+		case PROMEX_MT_HISTOGRAM:
+			type = ist("histogram");
+			break;
 		default:
 			type = ist("gauge");
 	}
@@ -467,26 +550,23 @@ static int promex_dump_metric_header(struct appctx *appctx, struct htx *htx,
 	return 0;
 }
 
-/* Dump the line for <metric>. It starts by the metric name followed by its
- * labels (proxy name, server name...) between braces and finally its value. If
- * not already done, the header lines are dumped first. It returns 1 on
- * success. Otherwise if <out> length exceeds <max>, it returns 0.
+/* Dump the line for <metric>, whose name was already built in <name>. It is
+ * followed by its labels between braces, starting with the pre-rendered ones
+ * identifying the object (<obj_labels>, proxy name, server name...) then the
+ * extra ones in <labels>, and finally its value. If not already done, the
+ * header lines are dumped first. It returns 1 on success. Otherwise if <out>
+ * length exceeds <max>, it returns 0.
  */
-static int promex_dump_metric(struct appctx *appctx, struct htx *htx, struct ist prefix,
+static int promex_dump_metric(struct appctx *appctx, struct htx *htx, const struct ist name,
 			      const  struct promex_metric *metric, struct field *val,
-			      struct promex_label *labels, struct ist *out, size_t max)
+			      const struct ist obj_labels, struct promex_label *labels,
+			      struct ist *out, size_t max)
 {
-	struct ist name = { .ptr = (char[PROMEX_MAX_NAME_LEN]){ 0 }, .len = 0 };
 	size_t len = out->len;
 
 	if (out->len + PROMEX_MAX_METRIC_LENGTH > max)
 		return 0;
 
-	/* Fill the metric name */
-	istcat(&name, prefix, PROMEX_MAX_NAME_LEN);
-	istcat(&name, metric->n, PROMEX_MAX_NAME_LEN);
-
-
 	if ((appctx->ctx.stats.flags & PROMEX_FL_METRIC_HDR) &&
 	    !promex_dump_metric_header(appctx, htx, metric, name, out, max))
 		goto full;
@@ -494,22 +574,25 @@ static int promex_dump_metric(struct appctx *appctx, struct htx *htx, struct ist
 	if (istcat(out, name, max) == -1)
 		goto full;
 
-	if (isttest(labels[0].name)) {
+	if (istlen(obj_labels) || isttest(labels[0].name)) {
+		int sep = !!istlen(obj_labels);
 		int i;
 
-		if (istcat(out, ist("{"), max) == -1)
+		if (istcat(out, ist("{"), max) == -1 ||
+		    istcat(out, obj_labels, max) == -1)
 			goto full;
 
 		for (i = 0; isttest(labels[i].name); i++) {
 			if (!isttest(labels[i].value))
 				continue;
 
-			if ((i && istcat(out, ist(","), max) == -1) ||
+			if ((sep && istcat(out, ist(","), max) == -1) ||
 			    istcat(out, labels[i].name, max) == -1 ||
 			    istcat(out, ist("=\""), max) == -1 ||
 			    istcat(out, labels[i].value, max) == -1 ||
 			    istcat(out, ist("\""), max) == -1)
 				goto full;
+			sep = 1;
 		}
 
 		if (istcat(out, ist("}"), max) == -1)
@@ -534,12 +617,79 @@ static int promex_dump_metric(struct appctx *appctx, struct htx *htx, struct ist
 
 }
 
+/* Dump the histogram of timer <t> from <hist> for <metric>, whose name was
+ * already built in <name>: first its cumulative buckets ("_bucket" suffix, with
+ * the upper bound in seconds in the "le" label), then the sum of the values in
+ * seconds ("_sum") and their number ("_count"). Each line is a step of
+ * appctx->ctx.stats.st_code, which is reset once the histogram is complete. It
+ * returns 1 on success. Otherwise if <out> length exceeds <max>, it returns 0.
+ */
+static int promex_dump_histogram(struct appctx *appctx, struct htx *htx, const struct ist name,
+				 const struct promex_metric *metric, const struct time_hist *hist,
+				 enum time_hist_timer t, const struct ist obj_labels,
+				 struct ist *out, size_t max)
+{
+	struct ist lname = { .ptr = (char[PROMEX_MAX_NAME_LEN]){ 0 }, .len = 0 };
+	unsigned long long cnt[TIME_HIST_BUCKETS];
+	unsigned long long tot, sum, cum = 0;
+	struct field val;
+	char le[16];
+	size_t len = out->len;
+	int idx;
+
+	if (appctx->ctx.stats.flags & PROMEX_FL_METRIC_HDR) {
+		if (out->len + PROMEX_MAX_METRIC_LENGTH > max ||
+		    !promex_dump_metric_header(appctx, htx, metric, name, out, max)) {
+			out->len = len;
+			return 0;
+		}
+		appctx->ctx.stats.flags &= ~PROMEX_FL_METRIC_HDR;
+	}
+
+	tot = time_hist_read(hist, t, cnt, &sum);
+	for (idx = 0; idx < appctx->ctx.stats.st_code && idx < TIME_HIST_BUCKETS; idx++)
+		cum += cnt[idx];
+
+	for (; appctx->ctx.stats.st_code < TIME_HIST_BUCKETS + 2; appctx->ctx.stats.st_code++) {
+		struct promex_label labels[2] = {};
+
+		idx = appctx->ctx.stats.st_code;
+		lname.len = 0;
+		istcat(&lname, name, PROMEX_MAX_NAME_LEN);
+		if (idx < TIME_HIST_BUCKETS) {
+			istcat(&lname, ist("_bucket"), PROMEX_MAX_NAME_LEN);
+			labels[0].name = ist("le");
+			if (idx < TIME_HIST_BUCKETS - 1) {
+				snprintf(le, sizeof(le), "%g", time_hist_bound(idx) / 1000.0);
+				labels[0].value = ist(le);
+			}
+			else
+				labels[0].value = ist("+Inf");
+			cum += cnt[idx];
+			val = mkf_u64(FN_COUNTER, cum);
+		}
+		else if (idx == TIME_HIST_BUCKETS) {
+			istcat(&lname, ist("_sum"), PROMEX_MAX_NAME_LEN);
+			val = mkf_flt(FN_COUNTER, sum / 1000.0);
+		}
+		else {
+			istcat(&lname, ist("_count"), PROMEX_MAX_NAME_LEN);
+			val = mkf_u64(FN_COUNTER, tot);
+		}
+
+		if (!promex_dump_metric(appctx, htx, lname, metric, &val, obj_labels, labels, out, max))
+			return 0;
+	}
+	appctx->ctx.stats.st_code = 0;
+	return 1;
+}
 
 /* Dump global metrics (prefixed by "haproxy_process_"). It returns 1 on success,
  * 0 if <htx> is full and -1 in case of any error. */
 static int promex_dump_global_metrics(struct appctx *appctx, struct htx *htx)
 {
 	static struct ist prefix = IST("haproxy_process_");
+	struct ist name = { .ptr = (char[PROMEX_MAX_NAME_LEN]){ 0 }, .len = 0 };
 	struct field val;
 	struct channel *chn = si_ic(appctx->owner);
 	struct ist out = ist2(trash.area, 0);
@@ -552,9 +702,12 @@ static int promex_dump_global_metrics(struct appctx *appctx, struct htx *htx)
 	for (; appctx->st2 < INF_TOTAL_FIELDS; appctx->st2++) {
 		struct promex_label labels[PROMEX_MAX_LABELS-1] = {};
 
-		if (!(promex_global_metrics[appctx->st2].flags & appctx->ctx.stats.flags))
+		if (!(promex_global_metrics[appctx->st2].flags & appctx->ctx.stats.flags) ||
+		    promex_metric_filtered(appctx, appctx->st2))
 			continue;
 
+		promex_metric_name(&name, prefix, &promex_global_metrics[appctx->st2]);
+
 		switch (appctx->st2) {
 			case INF_BUILD_INFO:
 				labels[0].name  = ist("version");
@@ -566,8 +719,8 @@ static int promex_dump_global_metrics(struct appctx *appctx, struct htx *htx)
 				val = info[appctx->st2];
 		}
 
-		if (!promex_dump_metric(appctx, htx, prefix, &promex_global_metrics[appctx->st2],
-					&val, labels, &out, max))
+		if (!promex_dump_metric(appctx, htx, name, &promex_global_metrics[appctx->st2],
+					&val, IST_NULL, labels, &out, max))
 			goto full;
 
 		appctx->ctx.stats.flags |= PROMEX_FL_METRIC_HDR;
@@ -590,43 +743,50 @@ static int promex_dump_global_metrics(struct appctx *appctx, struct htx *htx)
 static int promex_dump_front_metrics(struct appctx *appctx, struct htx *htx)
 {
 	static struct ist prefix = IST("haproxy_frontend_");
+	struct ist name = { .ptr = (char[PROMEX_MAX_NAME_LEN]){ 0 }, .len = 0 };
 	struct proxy *px;
 	struct field val;
 	struct channel *chn = si_ic(appctx->owner);
 	struct ist out = ist2(trash.area, 0);
 	size_t max = htx_get_max_blksz(htx, channel_htx_recv_max(chn, htx));
 	struct field *stats = stat_l[STATS_DOMAIN_PROXY];
+	struct ist obj_labels;
 	int ret = 1;
 	enum promex_front_state state;
 
 	for (;appctx->st2 < ST_F_TOTAL_FIELDS; appctx->st2++) {
-		if (!(promex_st_metrics[appctx->st2].flags & appctx->ctx.stats.flags))
+		if (!(promex_st_metrics[appctx->st2].flags & appctx->ctx.stats.flags) ||
+		    promex_metric_filtered(appctx, appctx->st2))
 			continue;
 
+		promex_metric_name(&name, prefix, &promex_st_metrics[appctx->st2]);
+
 		while (appctx->ctx.stats.obj1) {
 			struct promex_label labels[PROMEX_MAX_LABELS-1] = {};
 
 			px = appctx->ctx.stats.obj1;
 
-			labels[0].name  = ist("proxy");
-			labels[0].value = ist2(px->id, strlen(px->id));
-
 			/* skip the disabled proxies, global frontend and non-networked ones */
 			if (px->disabled || px->uuid <= 0 || !(px->cap & PR_CAP_FE))
 				goto next_px;
 
-			if (!stats_fill_fe_stats(px, stats, ST_F_TOTAL_FIELDS, &(appctx->st2)))
+			if (promex_px_filtered(appctx, px) ||
+			    !stats_is_active(appctx, px->fe_counters.last_upd, px->last_change))
+				goto next_px;
+
+			obj_labels = promex_obj_labels(&px->promex_labels, px, NULL);
+			if (!isttest(obj_labels))
 				return -1;
 
 			switch (appctx->st2) {
 				case ST_F_STATUS:
 					state = !px->disabled;
 					for (; appctx->ctx.stats.st_code < PROMEX_FRONT_STATE_COUNT; appctx->ctx.stats.st_code++) {
-						labels[1].name = ist("state");
-						labels[1].value = promex_front_st[appctx->ctx.stats.st_code];
+						labels[0].name = ist("state");
+						labels[0].value = promex_front_st[appctx->ctx.stats.st_code];
 						val = mkf_u32(FO_STATUS, state == appctx->ctx.stats.st_code);
-						if (!promex_dump_metric(appctx, htx, prefix, &promex_st_metrics[appctx->st2],
-									&val, labels, &out, max))
+						if (!promex_dump_metric(appctx, htx, name, &promex_st_metrics[appctx->st2],
+									&val, obj_labels, labels, &out, max))
 							goto full;
 					}
 					appctx->ctx.stats.st_code = 0;
@@ -642,7 +802,6 @@ static int promex_dump_front_metrics(struct appctx *appctx, struct htx *htx)
 				case ST_F_COMP_RSP:
 					if (px->mode != PR_MODE_HTTP)
 						goto next_px;
-					val = stats[appctx->st2];
 					break;
 				case ST_F_HRSP_1XX:
 				case ST_F_HRSP_2XX:
@@ -654,17 +813,21 @@ static int promex_dump_front_metrics(struct appctx *appctx, struct htx *htx)
 						goto next_px;
 					if (appctx->st2 != ST_F_HRSP_1XX)
 						appctx->ctx.stats.flags &= ~PROMEX_FL_METRIC_HDR;
-					labels[1].name = ist("code");
-					labels[1].value = promex_hrsp_code[appctx->st2 - ST_F_HRSP_1XX];
-					val = stats[appctx->st2];
+					labels[0].name = ist("code");
+					labels[0].value = promex_hrsp_code[appctx->st2 - ST_F_HRSP_1XX];
 					break;
 
 				default:
-					val = stats[appctx->st2];
+					break;
 			}
 
-			if (!promex_dump_metric(appctx, htx, prefix, &promex_st_metrics[appctx->st2],
-						&val, labels, &out, max))
+			/* only fill the needed field, once we know it is dumped */
+			if (!stats_fill_fe_stats(px, stats, ST_F_TOTAL_FIELDS, &(appctx->st2)))
+				return -1;
+			val = stats[appctx->st2];
+
+			if (!promex_dump_metric(appctx, htx, name, &promex_st_metrics[appctx->st2],
+						&val, obj_labels, labels, &out, max))
 				goto full;
 		  next_px:
 			appctx->ctx.stats.obj1 = px->next;
@@ -690,6 +853,7 @@ static int promex_dump_front_metrics(struct appctx *appctx, struct htx *htx)
 static int promex_dump_listener_metrics(struct appctx *appctx, struct htx *htx)
 {
 	static struct ist prefix = IST("haproxy_listener_");
+	struct ist name = { .ptr = (char[PROMEX_MAX_NAME_LEN]){ 0 }, .len = 0 };
 	struct proxy *px;
 	struct field val;
 	struct channel *chn = si_ic(appctx->owner);
@@ -697,58 +861,70 @@ static int promex_dump_listener_metrics(struct appctx *appctx, struct htx *htx)
 	size_t max = htx_get_max_blksz(htx, channel_htx_recv_max(chn, htx));
 	struct field *stats = stat_l[STATS_DOMAIN_PROXY];
 	struct listener *li;
+	struct ist obj_labels;
 	int ret = 1;
 	enum li_status status;
 
 	for (;appctx->st2 < ST_F_TOTAL_FIELDS; appctx->st2++) {
-		if (!(promex_st_metrics[appctx->st2].flags & appctx->ctx.stats.flags))
+		if (!(promex_st_metrics[appctx->st2].flags & appctx->ctx.stats.flags) ||
+		    promex_metric_filtered(appctx, appctx->st2))
 			continue;
 
+		promex_metric_name(&name, prefix, &promex_st_metrics[appctx->st2]);
+
 		while (appctx->ctx.stats.obj1) {
 			struct promex_label labels[PROMEX_MAX_LABELS-1] = {};
 
 			px = appctx->ctx.stats.obj1;
 
-			labels[0].name  = ist("proxy");
-			labels[0].value = ist2(px->id, strlen(px->id));
-
 			/* skip the disabled proxies, global frontend and non-networked ones */
 			if (px->disabled || px->uuid <= 0 || !(px->cap & PR_CAP_FE))
 				goto next_px;
 
+			if (promex_px_filtered(appctx, px))
+				goto next_px;
+
+			obj_labels = promex_obj_labels(&px->promex_labels, px, NULL);
+			if (!isttest(obj_labels))
+				return -1;
+
 			li = appctx->ctx.stats.obj2;
 			list_for_each_entry_from(li, &px->conf.listeners, by_fe) {
 
 				if (!li->counters)
 					continue;
 
-				labels[1].name  = ist("listener");
-				labels[1].value = ist2(li->name, strlen(li->name));
+				if (!stats_is_active(appctx, li->counters->last_upd, 0))
+					continue;
 
-				if (!stats_fill_li_stats(px, li, 0, stats,
-							 ST_F_TOTAL_FIELDS, &(appctx->st2)))
-					return -1;
+				labels[0].name  = ist("listener");
+				labels[0].value = ist2(li->name, strlen(li->name));
 
 				switch (appctx->st2) {
 					case ST_F_STATUS:
 						status = get_li_status(li);
 						for (; appctx->ctx.stats.st_code < LI_STATE_COUNT; appctx->ctx.stats.st_code++) {
 							val = mkf_u32(FO_STATUS, status == appctx->ctx.stats.st_code);
-							labels[2].name = ist("state");
-							labels[2].value = ist(li_status_st[appctx->ctx.stats.st_code]);
-							if (!promex_dump_metric(appctx, htx, prefix, &promex_st_metrics[appctx->st2],
-										&val, labels, &out, max))
+							labels[1].name = ist("state");
+							labels[1].value = ist(li_status_st[appctx->ctx.stats.st_code]);
+							if (!promex_dump_metric(appctx, htx, name, &promex_st_metrics[appctx->st2],
+										&val, obj_labels, labels, &out, max))
 								goto full;
 						}
 						appctx->ctx.stats.st_code = 0;
 						continue;
 					default:
-						val = stats[appctx->st2];
+						break;
 				}
 
-				if (!promex_dump_metric(appctx, htx, prefix,
+				if (!stats_fill_li_stats(px, li, 0, stats,
+							 ST_F_TOTAL_FIELDS, &(appctx->st2)))
+					return -1;
+				val = stats[appctx->st2];
+
+				if (!promex_dump_metric(appctx, htx, name,
 							&promex_st_metrics[appctx->st2],
-							&val, labels, &out, max))
+							&val, obj_labels, labels, &out, max))
 					goto full;
 			}
 
@@ -780,44 +956,51 @@ static int promex_dump_listener_metrics(struct appctx *appctx, struct htx *htx)
 static int promex_dump_back_metrics(struct appctx *appctx, struct htx *htx)
 {
 	static struct ist prefix = IST("haproxy_backend_");
+	struct ist name = { .ptr = (char[PROMEX_MAX_NAME_LEN]){ 0 }, .len = 0 };
 	struct proxy *px;
 	struct field val;
 	struct channel *chn = si_ic(appctx->owner);
 	struct ist out = ist2(trash.area, 0);
 	size_t max = htx_get_max_blksz(htx, channel_htx_recv_max(chn, htx));
 	struct field *stats = stat_l[STATS_DOMAIN_PROXY];
+	struct ist obj_labels;
 	int ret = 1;
 	double secs;
 	enum promex_back_state state;
 
 	for (;appctx->st2 < ST_F_TOTAL_FIELDS; appctx->st2++) {
-		if (!(promex_st_metrics[appctx->st2].flags & appctx->ctx.stats.flags))
+		if (!(promex_st_metrics[appctx->st2].flags & appctx->ctx.stats.flags) ||
+		    promex_metric_filtered(appctx, appctx->st2))
 			continue;
 
+		promex_metric_name(&name, prefix, &promex_st_metrics[appctx->st2]);
+
 		while (appctx->ctx.stats.obj1) {
 			struct promex_label labels[PROMEX_MAX_LABELS-1] = {};
 
 			px = appctx->ctx.stats.obj1;
 
-			labels[0].name  = ist("proxy");
-			labels[0].value = ist2(px->id, strlen(px->id));
-
 			/* skip the disabled proxies, global frontend and non-networked ones */
 			if (px->disabled || px->uuid <= 0 || !(px->cap & PR_CAP_BE))
 				goto next_px;
 
-			if (!stats_fill_be_stats(px, 0, stats, ST_F_TOTAL_FIELDS, &(appctx->st2)))
+			if (promex_px_filtered(appctx, px) ||
+			    !stats_is_active(appctx, px->be_counters.last_upd, px->last_change))
+				goto next_px;
+
+			obj_labels = promex_obj_labels(&px->promex_labels, px, NULL);
+			if (!isttest(obj_labels))
 				return -1;
 
 			switch (appctx->st2) {
 				case ST_F_STATUS:
 					state = ((px->lbprm.tot_weight > 0 || !px->srv) ? 1 : 0);
 					for (; appctx->ctx.stats.st_code < PROMEX_BACK_STATE_COUNT; appctx->ctx.stats.st_code++) {
-						labels[1].name = ist("state");
-						labels[1].value = promex_back_st[appctx->ctx.stats.st_code];
+						labels[0].name = ist("state");
+						labels[0].value = promex_back_st[appctx->ctx.stats.st_code];
 						val = mkf_u32(FO_STATUS, state == appctx->ctx.stats.st_code);
-						if (!promex_dump_metric(appctx, htx, prefix, &promex_st_metrics[appctx->st2],
-									&val, labels, &out, max))
+						if (!promex_dump_metric(appctx, htx, name, &promex_st_metrics[appctx->st2],
+									&val, obj_labels, labels, &out, max))
 							goto full;
 					}
 					appctx->ctx.stats.st_code = 0;
@@ -825,35 +1008,45 @@ static int promex_dump_back_metrics(struct appctx *appctx, struct htx *htx)
 				case ST_F_QTIME:
 					secs = (double)swrate_avg(px->be_counters.q_time, TIME_STATS_SAMPLES) / 1000.0;
 					val = mkf_flt(FN_AVG, secs);
-					break;
+					goto dump;
 				case ST_F_CTIME:
 					secs = (double)swrate_avg(px->be_counters.c_time, TIME_STATS_SAMPLES) / 1000.0;
 					val = mkf_flt(FN_AVG, secs);
-					break;
+					goto dump;
 				case ST_F_RTIME:
 					secs = (double)swrate_avg(px->be_counters.d_time, TIME_STATS_SAMPLES) / 1000.0;
 					val = mkf_flt(FN_AVG, secs);
-					break;
+					goto dump;
 				case ST_F_TTIME:
 					secs = (double)swrate_avg(px->be_counters.t_time, TIME_STATS_SAMPLES) / 1000.0;
 					val = mkf_flt(FN_AVG, secs);
-					break;
+					goto dump;
 				case ST_F_QT_MAX:
 					secs = (double)px->be_counters.qtime_max / 1000.0;
 					val = mkf_flt(FN_MAX, secs);
-					break;
+					goto dump;
 				case ST_F_CT_MAX:
 					secs = (double)px->be_counters.ctime_max / 1000.0;
 					val = mkf_flt(FN_MAX, secs);
-					break;
+					goto dump;
 				case ST_F_RT_MAX:
 					secs = (double)px->be_counters.dtime_max / 1000.0;
 					val = mkf_flt(FN_MAX, secs);
-					break;
+					goto dump;
 				case ST_F_TT_MAX:
 					secs = (double)px->be_counters.ttime_max / 1000.0;
 					val = mkf_flt(FN_MAX, secs);
-					break;
+					goto dump;
+				case ST_F_QT_HIST:
+				case ST_F_CT_HIST:
+				case ST_F_RT_HIST:
+				case ST_F_TT_HIST:
+					/* these fields follow the order of the timers */
+					if (!promex_dump_histogram(appctx, htx, name, &promex_st_metrics[appctx->st2],
+								   px->be_counters.hist, appctx->st2 - ST_F_QT_HIST,
+								   obj_labels, &out, max))
+						goto full;
+					goto next_px;
 				case ST_F_REQ_TOT:
 				case ST_F_CACHE_LOOKUPS:
 				case ST_F_CACHE_HITS:
@@ -863,7 +1056,6 @@ static int promex_dump_back_metrics(struct appctx *appctx, struct htx *htx)
 				case ST_F_COMP_RSP:
 					if (px->mode != PR_MODE_HTTP)
 						goto next_px;
-					val = stats[appctx->st2];
 					break;
 				case ST_F_HRSP_1XX:
 				case ST_F_HRSP_2XX:
@@ -875,17 +1067,22 @@ static int promex_dump_back_metrics(struct appctx *appctx, struct htx *htx)
 						goto next_px;
 					if (appctx->st2 != ST_F_HRSP_1XX)
 						appctx->ctx.stats.flags &= ~PROMEX_FL_METRIC_HDR;
-					labels[1].name = ist("code");
-					labels[1].value = promex_hrsp_code[appctx->st2 - ST_F_HRSP_1XX];
-					val = stats[appctx->st2];
+					labels[0].name = ist("code");
+					labels[0].value = promex_hrsp_code[appctx->st2 - ST_F_HRSP_1XX];
 					break;
 
 				default:
-					val = stats[appctx->st2];
+					break;
 			}
 
-			if (!promex_dump_metric(appctx, htx, prefix, &promex_st_metrics[appctx->st2],
-						&val, labels, &out, max))
+			/* only fill the needed field, once we know it is dumped */
+			if (!stats_fill_be_stats(px, 0, stats, ST_F_TOTAL_FIELDS, &(appctx->st2)))
+				return -1;
+			val = stats[appctx->st2];
+
+		  dump:
+			if (!promex_dump_metric(appctx, htx, name, &promex_st_metrics[appctx->st2],
+						&val, obj_labels, labels, &out, max))
 				goto full;
 		  next_px:
 			appctx->ctx.stats.obj1 = px->next;
@@ -911,6 +1108,7 @@ static int promex_dump_back_metrics(struct appctx *appctx, struct htx *htx)
 static int promex_dump_srv_metrics(struct appctx *appctx, struct htx *htx)
 {
 	static struct ist prefix = IST("haproxy_server_");
+	struct ist name = { .ptr = (char[PROMEX_MAX_NAME_LEN]){ 0 }, .len = 0 };
 	struct proxy *px;
 	struct server *sv;
 	struct field val;
@@ -918,48 +1116,53 @@ static int promex_dump_srv_metrics(struct appctx *appctx, struct htx *htx)
 	struct ist out = ist2(trash.area, 0);
 	size_t max = htx_get_max_blksz(htx, channel_htx_recv_max(chn, htx));
 	struct field *stats = stat_l[STATS_DOMAIN_PROXY];
+	struct ist obj_labels;
 	int ret = 1;
 	double secs;
 	enum promex_srv_state state;
 	const char *check_state;
 
 	for (;appctx->st2 < ST_F_TOTAL_FIELDS; appctx->st2++) {
-		if (!(promex_st_metrics[appctx->st2].flags & appctx->ctx.stats.flags))
+		if (!(promex_st_metrics[appctx->st2].flags & appctx->ctx.stats.flags) ||
+		    promex_metric_filtered(appctx, appctx->st2))
 			continue;
 
+		promex_metric_name(&name, prefix, &promex_st_metrics[appctx->st2]);
+
 		while (appctx->ctx.stats.obj1) {
 			struct promex_label labels[PROMEX_MAX_LABELS-1] = {};
 
 			px = appctx->ctx.stats.obj1;
 
-			labels[0].name  = ist("proxy");
-			labels[0].value = ist2(px->id, strlen(px->id));
-
 			/* skip the disabled proxies, global frontend and non-networked ones */
 			if (px->disabled || px->uuid <= 0 || !(px->cap & PR_CAP_BE))
 				goto next_px;
 
+			if (promex_px_filtered(appctx, px))
+				goto next_px;
+
 			while (appctx->ctx.stats.obj2) {
 				sv = appctx->ctx.stats.obj2;
 
-				labels[1].name  = ist("server");
-				labels[1].value = ist2(sv->id, strlen(sv->id));
-
-				if (!stats_fill_sv_stats(px, sv, 0, stats, ST_F_TOTAL_FIELDS, &(appctx->st2)))
-					return -1;
+				if (!stats_is_active(appctx, sv->counters.last_upd, sv->last_change))
+					goto next_sv;
 
 				if ((appctx->ctx.stats.flags & PROMEX_FL_NO_MAINT_SRV) && (sv->cur_admin & SRV_ADMF_MAINT))
 					goto next_sv;
 
+				obj_labels = promex_obj_labels(&sv->promex_labels, px, sv);
+				if (!isttest(obj_labels))
+					return -1;
+
 				switch (appctx->st2) {
 					case ST_F_STATUS:
 						state = promex_srv_status(sv);
 						for (; appctx->ctx.stats.st_code < PROMEX_SRV_STATE_COUNT; appctx->ctx.stats.st_code++) {
 							val = mkf_u32(FO_STATUS, state == appctx->ctx.stats.st_code);
-							labels[2].name = ist("state");
-							labels[2].value = promex_srv_st[appctx->ctx.stats.st_code];
-							if (!promex_dump_metric(appctx, htx, prefix, &promex_st_metrics[appctx->st2],
-										&val, labels, &out, max))
+							labels[0].name = ist("state");
+							labels[0].value = promex_srv_st[appctx->ctx.stats.st_code];
+							if (!promex_dump_metric(appctx, htx, name, &promex_st_metrics[appctx->st2],
+										&val, obj_labels, labels, &out, max))
 								goto full;
 						}
 						appctx->ctx.stats.st_code = 0;
@@ -967,35 +1170,45 @@ static int promex_dump_srv_metrics(struct appctx *appctx, struct htx *htx)
 					case ST_F_QTIME:
 						secs = (double)swrate_avg(sv->counters.q_time, TIME_STATS_SAMPLES) / 1000.0;
 						val = mkf_flt(FN_AVG, secs);
-						break;
+						goto dump;
 					case ST_F_CTIME:
 						secs = (double)swrate_avg(sv->counters.c_time, TIME_STATS_SAMPLES) / 1000.0;
 						val = mkf_flt(FN_AVG, secs);
-						break;
+						goto dump;
 					case ST_F_RTIME:
 						secs = (double)swrate_avg(sv->counters.d_time, TIME_STATS_SAMPLES) / 1000.0;
 						val = mkf_flt(FN_AVG, secs);
-						break;
+						goto dump;
 					case ST_F_TTIME:
 						secs = (double)swrate_avg(sv->counters.t_time, TIME_STATS_SAMPLES) / 1000.0;
 						val = mkf_flt(FN_AVG, secs);
-						break;
+						goto dump;
 					case ST_F_QT_MAX:
 						secs = (double)sv->counters.qtime_max / 1000.0;
 						val = mkf_flt(FN_MAX, secs);
-						break;
+						goto dump;
 					case ST_F_CT_MAX:
 						secs = (double)sv->counters.ctime_max / 1000.0;
 						val = mkf_flt(FN_MAX, secs);
-						break;
+						goto dump;
 					case ST_F_RT_MAX:
 						secs = (double)sv->counters.dtime_max / 1000.0;
 						val = mkf_flt(FN_MAX, secs);
-						break;
+						goto dump;
 					case ST_F_TT_MAX:
 						secs = (double)sv->counters.ttime_max / 1000.0;
 						val = mkf_flt(FN_MAX, secs);
-						break;
+						goto dump;
+					case ST_F_QT_HIST:
+					case ST_F_CT_HIST:
+					case ST_F_RT_HIST:
+					case ST_F_TT_HIST:
+						/* these fields follow the order of the timers */
+						if (!promex_dump_histogram(appctx, htx, name, &promex_st_metrics[appctx->st2],
+									   sv->counters.hist, appctx->st2 - ST_F_QT_HIST,
+									   obj_labels, &out, max))
+							goto full;
+						goto next_sv;
 					case ST_F_CHECK_STATUS:
 						if ((sv->check.state & (CHK_ST_ENABLED|CHK_ST_PAUSED)) != CHK_ST_ENABLED)
 							goto next_sv;
@@ -1005,10 +1218,10 @@ static int promex_dump_srv_metrics(struct appctx *appctx, struct htx *htx)
 								continue;
 							val = mkf_u32(FO_STATUS, sv->check.status == appctx->ctx.stats.st_code);
 							check_state = get_check_status_info(appctx->ctx.stats.st_code);
-							labels[2].name = ist("state");
-							labels[2].value = ist2(check_state, strlen(check_state));
-							if (!promex_dump_metric(appctx, htx, prefix, &promex_st_metrics[appctx->st2],
-										&val, labels, &out, max))
+							labels[0].name = ist("state");
+							labels[0].value = ist2(check_state, strlen(check_state));
+							if (!promex_dump_metric(appctx, htx, name, &promex_st_metrics[appctx->st2],
+										&val, obj_labels, labels, &out, max))
 								goto full;
 						}
 						appctx->ctx.stats.st_code = 0;
@@ -1017,17 +1230,16 @@ static int promex_dump_srv_metrics(struct appctx *appctx, struct htx *htx)
 						if ((sv->check.state & (CHK_ST_ENABLED|CHK_ST_PAUSED)) != CHK_ST_ENABLED)
 							goto next_sv;
 						val = mkf_u32(FN_OUTPUT, (sv->check.status < HCHK_STATUS_L57DATA) ? 0 : sv->check.code);
-						break;
+						goto dump;
 					case ST_F_CHECK_DURATION:
 						if (sv->check.status < HCHK_STATUS_CHECKED)
 						    goto next_sv;
 						secs = (double)sv->check.duration / 1000.0;
 						val = mkf_flt(FN_DURATION, secs);
-						break;
+						goto dump;
 					case ST_F_REQ_TOT:
 						if (px->mode != PR_MODE_HTTP)
 							goto next_px;
-						val = stats[appctx->st2];
 						break;
 					case ST_F_HRSP_1XX:
 					case ST_F_HRSP_2XX:
@@ -1039,17 +1251,22 @@ static int promex_dump_srv_metrics(struct appctx *appctx, struct htx *htx)
 							goto next_px;
 						if (appctx->st2 != ST_F_HRSP_1XX)
 							appctx->ctx.stats.flags &= ~PROMEX_FL_METRIC_HDR;
-						labels[2].name = ist("code");
-						labels[2].value = promex_hrsp_code[appctx->st2 - ST_F_HRSP_1XX];
-						val = stats[appctx->st2];
+						labels[0].name = ist("code");
+						labels[0].value = promex_hrsp_code[appctx->st2 - ST_F_HRSP_1XX];
 						break;
 
 					default:
-						val = stats[appctx->st2];
+						break;
 				}
 
-				if (!promex_dump_metric(appctx, htx, prefix, &promex_st_metrics[appctx->st2],
-							&val, labels, &out, max))
+				/* only fill the needed field, once we know it is dumped */
+				if (!stats_fill_sv_stats(px, sv, 0, stats, ST_F_TOTAL_FIELDS, &(appctx->st2)))
+					return -1;
+				val = stats[appctx->st2];
+
+			  dump:
+				if (!promex_dump_metric(appctx, htx, name, &promex_st_metrics[appctx->st2],
+							&val, obj_labels, labels, &out, max))
 					goto full;
 			  next_sv:
 				appctx->ctx.stats.obj2 = sv->next;
@@ -1082,6 +1299,7 @@ static int promex_dump_srv_metrics(struct appctx *appctx, struct htx *htx)
 static int promex_dump_sticktable_metrics(struct appctx *appctx, struct htx *htx)
 {
 	static struct ist prefix = IST("haproxy_sticktable_");
+	struct ist name = { .ptr = (char[PROMEX_MAX_NAME_LEN]){ 0 }, .len = 0 };
 	struct field val;
 	struct channel *chn = si_ic(appctx->owner);
 	struct ist out = ist2(trash.area, 0);
@@ -1090,9 +1308,12 @@ static int promex_dump_sticktable_metrics(struct appctx *appctx, struct htx *htx
 	struct stktable *t;
 
 	for (; appctx->st2 < STICKTABLE_TOTAL_FIELDS; appctx->st2++) {
-		if (!(promex_sticktable_metrics[appctx->st2].flags & appctx->ctx.stats.flags))
+		if (!(promex_sticktable_metrics[appctx->st2].flags & appctx->ctx.stats.flags) ||
+		    promex_metric_filtered(appctx, appctx->st2))
 			continue;
 
+		promex_metric_name(&name, prefix, &promex_sticktable_metrics[appctx->st2]);
+
 		while (appctx->ctx.stats.obj1) {
 			struct promex_label labels[PROMEX_MAX_LABELS - 1] = {};
 
@@ -1115,9 +1336,9 @@ static int promex_dump_sticktable_metrics(struct appctx *appctx, struct htx *htx
 					goto next_px;
 			}
 
-			if (!promex_dump_metric(appctx, htx, prefix,
+			if (!promex_dump_metric(appctx, htx, name,
 						&promex_sticktable_metrics[appctx->st2],
-						&val, labels, &out, max))
+						&val, IST_NULL, labels, &out, max))
 				goto full;
 
 		  next_px:
@@ -1289,6 +1510,56 @@ static int promex_dump_metrics(struct appctx *appctx, struct stream_interface *s
 	return -1;
 }
 
+/* Returns the filters of <appctx>, allocating them on first use, or NULL if
+ * they cannot be allocated.
+ */
+static struct promex_filter *promex_get_filter(struct appctx *appctx)
+{
+	if (!appctx->ctx.stats.filter)
+		appctx->ctx.stats.filter = calloc(1, sizeof(struct promex_filter));
+	return appctx->ctx.stats.filter;
+}
+
+/* Selects the metric family whose full name is <name> (e.g.
+ * "haproxy_server_bytes_in_total") in the filter <flt>, so that only selected
+ * metrics are dumped. All fields sharing this name are selected. It returns 1
+ * on success or 0 if no such metric exists.
+ */
+static int promex_select_metric(struct promex_filter *flt, const char *name)
+{
+	static const struct {
+		struct ist prefix;
+		int dumper;
+		const struct promex_metric *metrics;
+		int count;
+		unsigned int flag;
+	} families[] = {
+		{ IST("haproxy_process_"),    PROMEX_DUMPER_GLOBAL,     promex_global_metrics,     INF_TOTAL_FIELDS,        PROMEX_FL_INFO_METRIC },
+		{ IST("haproxy_frontend_"),   PROMEX_DUMPER_FRONT,      promex_st_metrics,         ST_F_TOTAL_FIELDS,       PROMEX_FL_FRONT_METRIC },
+		{ IST("haproxy_listener_"),   PROMEX_DUMPER_LI,         promex_st_metrics,         ST_F_TOTAL_FIELDS,       PROMEX_FL_LI_METRIC },
+		{ IST("haproxy_backend_"),    PROMEX_DUMPER_BACK,       promex_st_metrics,         ST_F_TOTAL_FIELDS,       PROMEX_FL_BACK_METRIC },
+		{ IST("haproxy_server_"),     PROMEX_DUMPER_SRV,        promex_st_metrics,         ST_F_TOTAL_FIELDS,       PROMEX_FL_SRV_METRIC },
+		{ IST("haproxy_sticktable_"), PROMEX_DUMPER_STICKTABLE, promex_sticktable_metrics, STICKTABLE_TOTAL_FIELDS, PROMEX_FL_STICKTABLE_METRIC },
+	};
+	struct ist n = ist(name);
+	int i, f, found = 0;
+
+	for (i = 0; i < sizeof(families) / sizeof(*families); i++) {
+		if (!istmatch(n, families[i].prefix))
+			continue;
+
+		for (f = 0; f < families[i].count; f++) {
+			if ((families[i].metrics[f].flags & families[i].flag) &&
+			    isteq(istadv(n, istlen(families[i].prefix)), families[i].metrics[f].n)) {
+				ha_bit_set(f, flt->map[families[i].dumper]);
+				found = 1;
+			}
+		}
+	}
+	flt->metrics = 1;
+	return found;
+}
+
 /* Parse the query string of request URI to filter the metrics. It returns 1 on
  * success and -1 on error. */
 static int promex_parse_uri(struct appctx *appctx, struct stream_interface *si)
@@ -1300,6 +1571,7 @@ static int promex_parse_uri(struct appctx *appctx, struct stream_interface *si)
 	char *p, *key, *value;
 	const char *end;
 	struct buffer *err;
+	struct promex_filter *flt;
 	int default_scopes = PROMEX_FL_SCOPE_ALL;
 	int len;
 
@@ -1382,6 +1654,30 @@ static int promex_parse_uri(struct appctx *appctx, struct stream_interface *si)
 		}
 		else if (strcmp(key, "no-maint") == 0)
 			appctx->ctx.stats.flags |= PROMEX_FL_NO_MAINT_SRV;
+		else if (strcmp(key, "since") == 0) {
+			char *error;
+			unsigned long long epoch;
+
+			if (!value || !*value)
+				goto error;
+			epoch = strtoull(value, &error, 10);
+			if (*error)
+				goto error;
+			appctx->ctx.stats.since = stats_since_from_epoch(epoch);
+		}
+		else if (strcmp(key, "proxy") == 0) {
+			flt = promex_get_filter(appctx);
+			if (!flt || !value)
+				goto error;
+			flt->px = proxy_find_by_name(value, 0, 0);
+			if (!flt->px)
+				goto error;
+		}
+		else if (strcmp(key, "metric") == 0) {
+			flt = promex_get_filter(appctx);
+			if (!flt || !value || !promex_select_metric(flt, value))
+				goto error;
+		}
 	}
 
   end:
@@ -1436,6 +1732,12 @@ static int promex_appctx_init(struct appctx *appctx, struct proxy *px, struct st
 	return 1;
 }
 
+/* Releases the filters which may have been allocated for the applet */
+static void promex_appctx_release(struct appctx *appctx)
+{
+	ha_free(&appctx->ctx.stats.filter);
+}
+
 /* The main I/O handler for the promex applet. */
 static void promex_appctx_handle_io(struct appctx *appctx)
 {
@@ -1518,6 +1820,7 @@ struct applet promex_applet = {
 	.name = "<PROMEX>", /* used for logging */
 	.init = promex_appctx_init,
 	.fct = promex_appctx_handle_io,
+	.release = promex_appctx_release,
 };
 
 static enum act_parse_ret service_parse_prometheus_exporter(const char **args, int *cur_arg, struct proxy *px,
@@ -0,0 +1,532 @@
+/*
+ * Map compiler : converts a text map file to the compiled format which HAProxy
+ * memory-maps at startup instead of parsing and indexing it.
+ *
+ * The input uses the same syntax as the map files : one key per line followed
+ * by spaces or tabs and the value, leading and trailing blanks being stripped.
+ * Lines starting with a sharp ('#') and empty lines are ignored. With "-t str"
+ * (the default) keys are looked up as exact strings, like "map_str" does. With
+ * "-t ip", keys are IPv4 or IPv6 addresses or networks, like "map_ip" does, and
+ * nested networks are flattened so that the most specific one wins. In both
+ * cases, when a key appears multiple times, its first occurrence wins.
+ *
+ * Usage: mapc [-t str|ip] <input> <output>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ */
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <haproxy/map_bin-t.h>
+
+#define MAXLINE 65536
+
+typedef unsigned __int128 u128;
+
+/* a key as read from the input file */
+struct key {
+	uint32_t key_ofs, key_len;    /* string key in the blob (str) */
+	uint32_t val;                 /* offset of the value in the blob */
+	uint32_t val_len;
+	uint32_t rank;                /* line order, for stable sorting */
+	int family;                   /* 4 or 6 (ip) */
+	u128 from, to;                /* network (ip) */
+};
+
+/* an output range (ip) */
+struct range {
+	u128 from, to;
+	uint32_t val, val_len;
+};
+
+static char *blob;
+static size_t blob_len, blob_size;
+
+/* hash table of the values already stored in the blob */
+static uint32_t *vhash;
+static size_t vhash_size;
+
+static struct key *keys;
+static size_t nb_keys, keys_size;
+
+static const char *prog;
+
+static void die(const char *msg, const char *arg)
+{
+	fprintf(stderr, "%s: %s%s%s\n", prog, msg, arg ? " : " : "", arg ? arg : "");
+	exit(1);
+}
+
+static void usage(void)
+{
+	fprintf(stderr, "Usage: %s [-t str|ip] <input> <output>\n", prog);
+	exit(1);
+}
+
+/* appends <len> bytes from <str> followed by a zero to the blob, and returns
+ * their offset.
+ */
+static uint32_t blob_add(const char *str, size_t len)
+{
+	size_t ofs = blob_len;
+
+	if (blob_len + len + 1 > UINT32_MAX)
+		die("too much data for the output format", NULL);
+
+	if (blob_len + len + 1 > blob_size) {
+		blob_size = (blob_len + len + 1) * 2;
+		blob = realloc(blob, blob_size);
+		if (!blob)
+			die("out of memory", NULL);
+	}
+	memcpy(blob + blob_len, str, len);
+	blob[blob_len + len] = 0;
+	blob_len += len + 1;
+	return ofs;
+}
+
+static uint32_t hash_str(const char *str, size_t len)
+{
+	uint32_t h = 2166136261U;
+
+	while (len--)
+		h = (h ^ (unsigned char)*str++) * 16777619U;
+	return h;
+}
+
+/* stores value <str> of length <len> in the blob unless it is already there,
+ * and returns its offset. Values are deduplicated since most large maps only
+ * use a small set of them.
+ */
+static uint32_t value_add(const char *str, size_t len)
+{
+	static size_t nb_values;
+	size_t i;
+
+	if (nb_values * 2 >= vhash_size) {
+		uint32_t *old = vhash;
+		size_t old_size = vhash_size;
+
+		vhash_size = vhash_size ? vhash_size * 2 : 1024;
+		vhash = malloc(vhash_size * sizeof(*vhash));
+		if (!vhash)
+			die("out of memory", NULL);
+		memset(vhash, 0xff, vhash_size * sizeof(*vhash));
+
+		for (i = 0; i < old_size; i++) {
+			size_t j;
+
+			if (old[i] == UINT32_MAX)
+				continue;
+			j = hash_str(blob + old[i], strlen(blob + old[i])) & (vhash_size - 1);
+			while (vhash[j] != UINT32_MAX)
+				j = (j + 1) & (vhash_size - 1);
+			vhash[j] = old[i];
+		}
+		free(old);
+	}
+
+	i = hash_str(str, len) & (vhash_size - 1);
+	while (vhash[i] != UINT32_MAX) {
+		if (strlen(blob + vhash[i]) == len && memcmp(blob + vhash[i], str, len) == 0)
+			return vhash[i];
+		i = (i + 1) & (vhash_size - 1);
+	}
+
+	nb_values++;
+	vhash[i] = blob_add(str, len);
+	return vhash[i];
+}
+
+static struct key *key_add(void)
+{
+	if (nb_keys == keys_size) {
+		keys_size = keys_size ? keys_size * 2 : 1024;
+		keys = realloc(keys, keys_size * sizeof(*keys));
+		if (!keys)
+			die("out of memory", NULL);
+	}
+	memset(&keys[nb_keys], 0, sizeof(*keys));
+	keys[nb_keys].rank = nb_keys;
+	return &keys[nb_keys++];
+}
+
+/* parses network <str> as an IPv4 or IPv6 address, optionally followed by a
+ * mask length or by a dotted IPv4 mask, into <k>. Returns 4 or 6 depending on
+ * the family, or 0 if it is invalid.
+ */
+static int parse_net(char *str, struct key *k)
+{
+	char *slash = strchr(str, '/');
+	unsigned char addr[16];
+	int family, bits, max, i;
+	u128 a = 0, mask;
+
+	if (slash)
+		*slash++ = 0;
+
+	if (inet_pton(AF_INET, str, addr) == 1) {
+		family = 4;
+		max = 32;
+	}
+	else if (inet_pton(AF_INET6, str, addr) == 1) {
+		family = 6;
+		max = 128;
+	}
+	else
+		return 0;
+
+	for (i = 0; i < max / 8; i++)
+		a = (a << 8) | addr[i];
+
+	bits = max;
+	if (slash) {
+		unsigned char m[4];
+		char *end;
+
+		if (family == 4 && strchr(slash, '.')) {
+			uint32_t m32;
+
+			if (inet_pton(AF_INET, slash, m) != 1)
+				return 0;
+			m32 = ((uint32_t)m[0] << 24) | (m[1] << 16) | (m[2] << 8) | m[3];
+			for (bits = 0; bits < 32 && (m32 & (0x80000000U >> bits)); bits++)
+				;
+			if (bits < 32 && (m32 << bits))
+				return 0; /* non-contiguous mask */
+		}
+		else {
+			bits = strtol(slash, &end, 10);
+			if (end == slash || *end || bits < 0 || bits > max)
+				return 0;
+		}
+	}
+
+	mask = (bits == max) ? 0 : (((u128)1 << (max - bits)) - 1);
+	k->from = a & ~mask;
+	k->to = k->from | mask;
+	return family;
+}
+
+static int cmp_str(const void *a, const void *b)
+{
+	const struct key *ka = a, *kb = b;
+	uint32_t l = ka->key_len < kb->key_len ? ka->key_len : kb->key_len;
+	int ret = memcmp(blob + ka->key_ofs, blob + kb->key_ofs, l);
+
+	if (ret)
+		return ret;
+	if (ka->key_len != kb->key_len)
+		return ka->key_len < kb->key_len ? -1 : 1;
+	return ka->rank < kb->rank ? -1 : 1;
+}
+
+/* sorts networks by family, start, then the largest first, then by order of
+ * appearance.
+ */
+static int cmp_net(const void *a, const void *b)
+{
+	const struct key *ka = a, *kb = b;
+
+	if (ka->family != kb->family)
+		return ka->family < kb->family ? -1 : 1;
+	if (ka->from != kb->from)
+		return ka->from < kb->from ? -1 : 1;
+	if (ka->to != kb->to)
+		return ka->to > kb->to ? -1 : 1;
+	return ka->rank < kb->rank ? -1 : 1;
+}
+
+static struct range *ranges;
+static size_t nb_ranges, ranges_size;
+
+static void range_emit(u128 from, u128 to, const struct key *k)
+{
+	struct range *r = nb_ranges ? &ranges[nb_ranges - 1] : NULL;
+
+	/* merge with the previous one when they carry the same value */
+	if (r && r->val == k->val && r->to + 1 == from) {
+		r->to = to;
+		return;
+	}
+
+	if (nb_ranges == ranges_size) {
+		ranges_size = ranges_size ? ranges_size * 2 : 1024;
+		ranges = realloc(ranges, ranges_size * sizeof(*ranges));
+		if (!ranges)
+			die("out of memory", NULL);
+	}
+	r = &ranges[nb_ranges++];
+	r->from = from;
+	r->to = to;
+	r->val = k->val;
+	r->val_len = k->val_len;
+}
+
+/* turns the <nb> networks of <net> into non-overlapping ranges in <ranges>,
+ * where each address is associated with the value of the most specific
+ * network covering it. Networks are either disjoint or nested, so the ones
+ * enclosing the current one are kept on a stack.
+ */
+static void flatten(struct key *net, size_t nb)
+{
+	struct key *stack[129];
+	int sp = 0, done = 0;
+	u128 cur = 0;
+	size_t i;
+
+	nb_ranges = 0;
+	qsort(net, nb, sizeof(*net), cmp_net);
+
+	for (i = 0; i < nb; i++) {
+		/* close the networks which end before this one */
+		while (sp && stack[sp - 1]->to < net[i].from) {
+			struct key *top = stack[--sp];
+
+			if (cur <= top->to)
+				range_emit(cur, top->to, top);
+			cur = top->to + 1;
+		}
+
+		/* the first occurrence of a network wins */
+		if (sp && stack[sp - 1]->from == net[i].from && stack[sp - 1]->to == net[i].to)
+			continue;
+
+		if (sp && cur < net[i].from)
+			range_emit(cur, net[i].from - 1, stack[sp - 1]);
+		cur = net[i].from;
+		stack[sp++] = &net[i];
+	}
+
+	while (sp) {
+		struct key *top = stack[--sp];
+
+		if (!done && cur <= top->to)
+			range_emit(cur, top->to, top);
+		if (top->to == (u128)~(u128)0)
+			done = 1;
+		else
+			cur = top->to + 1;
+	}
+}
+
+static void write_all(FILE *out, const void *buf, size_t len)
+{
+	if (len && fwrite(buf, len, 1, out) != 1)
+		die("write error", strerror(errno));
+}
+
+/* pads the output to the next multiple of 8 bytes */
+static size_t write_pad(FILE *out, size_t pos)
+{
+	static const char zero[8];
+	size_t pad = (8 - (pos & 7)) & 7;
+
+	write_all(out, zero, pad);
+	return pos + pad;
+}
+
+int main(int argc, char **argv)
+{
+	struct map_bin_hdr hdr;
+	char *line, *c, *key_beg, *key_end, *val_beg, *val_end;
+	const char *in_name, *out_name;
+	char *tmp_name = NULL;
+	int type = MAP_BIN_T_STR;
+	size_t nb4 = 0, i, pos;
+	struct key *k;
+	FILE *in, *out;
+	int lineno = 0;
+
+	prog = argv[0];
+	argv++; argc--;
+
+	while (argc > 0 && **argv == '-') {
+		if (strcmp(*argv, "-t") == 0 && argc > 1) {
+			if (strcmp(argv[1], "str") == 0)
+				type = MAP_BIN_T_STR;
+			else if (strcmp(argv[1], "ip") == 0)
+				type = MAP_BIN_T_IP;
+			else
+				usage();
+			argv++; argc--;
+		}
+		else
+			usage();
+		argv++; argc--;
+	}
+
+	if (argc != 2)
+		usage();
+
+	in_name = argv[0];
+	out_name = argv[1];
+
+	in = fopen(in_name, "r");
+	if (!in)
+		die("cannot open input file", in_name);
+
+	line = malloc(MAXLINE);
+	if (!line)
+		die("out of memory", NULL);
+
+	while (fgets(line, MAXLINE, in) != NULL) {
+		lineno++;
+		c = line;
+
+		if (*c == '#')
+			continue;
+
+		while (*c == ' ' || *c == '\t')
+			c++;
+
+		if (*c == '\0' || *c == '\r' || *c == '\n')
+			continue;
+
+		key_beg = c;
+		while (*c && *c != ' ' && *c != '\t' && *c != '\n' && *c != '\r')
+			c++;
+		key_end = c;
+
+		while (*c == ' ' || *c == '\t')
+			c++;
+
+		val_beg = c;
+		while (*c && *c != '\n' && *c != '\r')
+			c++;
+		val_end = c;
+
+		while (val_end > val_beg && (val_end[-1] == ' ' || val_end[-1] == '\t'))
+			val_end--;
+
+		*key_end = 0;
+		*val_end = 0;
+
+		k = key_add();
+		k->val = value_add(val_beg, val_end - val_beg);
+		k->val_len = val_end - val_beg;
+
+		if (type == MAP_BIN_T_STR) {
+			k->key_len = key_end - key_beg;
+			k->key_ofs = blob_add(key_beg, k->key_len);
+		}
+		else {
+			k->family = parse_net(key_beg, k);
+			if (!k->family) {
+				fprintf(stderr, "%s: invalid network '%s' at line %d of '%s'\n",
+				        prog, key_beg, lineno, in_name);
+				exit(1);
+			}
+			if (k->family == 4)
+				nb4++;
+		}
+	}
+
+	if (ferror(in))
+		die("read error", strerror(errno));
+	fclose(in);
+
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, MAP_BIN_MAGIC, sizeof(hdr.magic));
+	hdr.bom = MAP_BIN_BOM;
+	hdr.type = type;
+
+	tmp_name = malloc(strlen(out_name) + 5);
+	if (!tmp_name)
+		die("out of memory", NULL);
+	sprintf(tmp_name, "%s.tmp", out_name);
+
+	out = fopen(tmp_name, "w");
+	if (!out)
+		die("cannot create output file", tmp_name);
+
+	/* the header is written again once complete */
+	write_all(out, &hdr, sizeof(hdr));
+	pos = write_pad(out, sizeof(hdr));
+
+	if (type == MAP_BIN_T_STR) {
+		struct map_bin_str e;
+
+		qsort(keys, nb_keys, sizeof(*keys), cmp_str);
+		hdr.str_ofs = pos;
+		for (i = 0; i < nb_keys; i++) {
+			if (i && keys[i].key_len == keys[i - 1].key_len &&
+			    memcmp(blob + keys[i].key_ofs, blob + keys[i - 1].key_ofs, keys[i].key_len) == 0)
+				continue;
+			e.key_ofs = keys[i].key_ofs;
+			e.key_len = keys[i].key_len;
+			e.val_ofs = keys[i].val;
+			e.val_len = keys[i].val_len;
+			write_all(out, &e, sizeof(e));
+			pos += sizeof(e);
+			hdr.nb_str++;
+		}
+	}
+	else {
+		struct map_bin_ip4 e4;
+		struct map_bin_ip6 e6;
+		int b;
+
+		/* IPv4 networks first */
+		qsort(keys, nb_keys, sizeof(*keys), cmp_net);
+
+		flatten(keys, nb4);
+		hdr.ip4_ofs = pos;
+		for (i = 0; i < nb_ranges; i++) {
+			e4.from = ranges[i].from;
+			e4.to = ranges[i].to;
+			e4.val_ofs = ranges[i].val;
+			e4.val_len = ranges[i].val_len;
+			write_all(out, &e4, sizeof(e4));
+			pos += sizeof(e4);
+		}
+		hdr.nb_ip4 = nb_ranges;
+		pos = write_pad(out, pos);
+
+		flatten(keys + nb4, nb_keys - nb4);
+		hdr.ip6_ofs = pos;
+		for (i = 0; i < nb_ranges; i++) {
+			for (b = 0; b < 16; b++) {
+				e6.from[b] = ranges[i].from >> (8 * (15 - b));
+				e6.to[b] = ranges[i].to >> (8 * (15 - b));
+			}
+			e6.val_ofs = ranges[i].val;
+			e6.val_len = ranges[i].val_len;
+			write_all(out, &e6, sizeof(e6));
+			pos += sizeof(e6);
+		}
+		hdr.nb_ip6 = nb_ranges;
+	}
+
+	pos = write_pad(out, pos);
+	hdr.blob_ofs = pos;
+	hdr.blob_len = blob_len;
+	write_all(out, blob, blob_len);
+
+	if (fseek(out, 0, SEEK_SET) != 0)
+		die("seek error", strerror(errno));
+	write_all(out, &hdr, sizeof(hdr));
+
+	if (fclose(out) != 0)
+		die("write error", strerror(errno));
+
+	/* replace the output atomically so that running processes which
+	 * mapped the previous file are not affected.
+	 */
+	if (rename(tmp_name, out_name) != 0)
+		die("cannot rename output file", strerror(errno));
+
+	fprintf(stderr, "%s: %zu entries, %u strings, %u IPv4 ranges, %u IPv6 ranges, %zu bytes of data\n",
+	        prog, nb_keys, hdr.nb_str, hdr.nb_ip4, hdr.nb_ip6, blob_len);
+	return 0;
+}
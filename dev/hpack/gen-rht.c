@@ -7,6 +7,9 @@
  * rht_bit11_4[256]    is indexed on bits 11..4 when 15..8 == 0xff
  * when 11..4 == 0xff, 3..2 provide the following mapping :
  *   00 => 0x0a, 01 => 0x0d, 10 => 0x16, 11 => EOS
+ *
+ * rht_bit31_21[2048]  is indexed on bits 31..21 and gives the one or two
+ *                     symbols fully contained in these 11 bits, if any.
  */
 
 #include <inttypes.h>
@@ -365,5 +368,37 @@ int main(int argc, char **argv)
 	}
 	printf("\t/* Note, when l==30, bits 3..2 give 00:0x0a, 01:0x0d, 10:0x16, 11:EOS */\n");
 	printf("};\n\n");
+
+	/* multi-symbol table: up to two symbols fully contained in the first
+	 * 11 bits, emitted 4 entries per line. n=0 when the first code is
+	 * longer than 11 bits.
+	 */
+	printf("static const struct rht2 rht_bit31_21[2048] = {\n");
+	for (j = 0; j < 2048; j++) {
+		uint32_t sym[2] = { 0, 0 };
+		uint32_t n, l, k;
+
+		for (n = l = 0; n < 2; n++) {
+			for (i = 0; i < 256; i++) {
+				if (ht[i].b > 11 - l)
+					continue;
+				c = ht[i].c << (32 - ht[i].b);
+				k = (j << (21 + l)) & -(1 << (32 - ht[i].b));
+				if (c == k)
+					break;
+			}
+			if (i == 256)
+				break;
+			sym[n] = i;
+			l += ht[i].b;
+		}
+
+		if (!(j & 3))
+			printf("\t/* 0x%03x */", j);
+		printf(" { { 0x%02x, 0x%02x }, %d, %2d },", sym[0], sym[1], n, l);
+		if ((j & 3) == 3)
+			printf("\n");
+	}
+	printf("};\n\n");
 	return 0;
 }
@@ -0,0 +1,200 @@
+/*
+ * HPACK Huffman decoder test and benchmark. It compares the output of
+ * huff_dec() with the one of a trivial bit-per-bit decoder, on all symbols,
+ * on random strings with random output sizes, and on random invalid inputs.
+ * With "-b", it measures the decoding speed of typical header values instead.
+ *
+ * Build like this :
+ *    make dev/hpack/test-huff
+ *
+ * Usage: test-huff [-b] [-n <loops>] [-s <seed>]
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../src/hpack-huff.c"
+
+#define MAX_LEN 1024
+
+/* typical header values used for the benchmark */
+static const char *bench_strings[] = {
+	"www.example.com",
+	"/api/v1/users/12345/profile?fields=name,email&lang=en",
+	"Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/91.0.4472.114 Safari/537.36",
+	"text/html,application/xhtml+xml,application/xml;q=0.9,image/webp,*/*;q=0.8",
+	"gzip, deflate, br",
+	"en-US,en;q=0.9,fr;q=0.8",
+	"sessionid=38afes7a8; csrftoken=u32t4o3tb3gg43; _ga=GA1.2.1234567890.1623456789",
+	"no-cache",
+	"Wed, 21 Oct 2015 07:28:00 GMT",
+	"application/json; charset=utf-8",
+};
+
+/* encodes <len> bytes from <in> into <out> with the RFC7541 code, and pads
+ * the last byte with ones. Returns the output length.
+ */
+static int encode(const uint8_t *in, int len, uint8_t *out)
+{
+	uint64_t acc = 0;
+	int bits = 0, olen = 0, i;
+
+	for (i = 0; i < len; i++) {
+		acc = (acc << ht[in[i]].b) | ht[in[i]].c;
+		bits += ht[in[i]].b;
+		while (bits >= 8) {
+			bits -= 8;
+			out[olen++] = acc >> bits;
+		}
+	}
+	if (bits)
+		out[olen++] = (acc << (8 - bits)) | (0xff >> bits);
+	return olen;
+}
+
+/* trivial decoder with the same contract as huff_dec(), matching the bits one
+ * at a time against the codes of table ht[].
+ */
+static int ref_dec(const uint8_t *huff, int hlen, char *out, int olen)
+{
+	uint32_t code = 0;
+	int len = 0, outlen = 0, bleft = hlen * 8, pos, i;
+
+	for (pos = 0; pos < hlen * 8 && outlen < olen; pos++) {
+		code = (code << 1) | ((huff[pos >> 3] >> (7 - (pos & 7))) & 1);
+		len++;
+		for (i = 0; i < 257; i++)
+			if (ht[i].b == len && ht[i].c == code)
+				break;
+		if (i == 256 || len > 30)
+			return -1;
+		if (i == 257)
+			continue;
+		out[outlen++] = i;
+		bleft -= len;
+		code = len = 0;
+	}
+
+	/* the remaining bits must be 7 or less ones */
+	if (bleft > 7)
+		return -1;
+	for (pos = hlen * 8 - bleft; pos < hlen * 8; pos++)
+		if (!((huff[pos >> 3] >> (7 - (pos & 7))) & 1))
+			return -1;
+	return outlen;
+}
+
+/* compares huff_dec() and ref_dec() on <huff>, returns 0 if they match */
+static int check(const uint8_t *huff, int hlen, int olen)
+{
+	char out1[MAX_LEN * 2], out2[MAX_LEN * 2];
+	int ret1, ret2;
+
+	ret1 = huff_dec(huff, hlen, out1, olen);
+	ret2 = ref_dec(huff, hlen, out2, olen);
+	if (ret1 == ret2 && (ret1 < 0 || memcmp(out1, out2, ret1) == 0))
+		return 0;
+
+	printf("mismatch: hlen=%d olen=%d huff_dec=%d ref=%d :", hlen, olen, ret1, ret2);
+	while (hlen--)
+		printf(" %02x", *huff++);
+	printf("\n");
+	return 1;
+}
+
+/* returns a random symbol, mostly printable ones */
+static uint8_t rnd_sym()
+{
+	return (rand() & 7) ? 0x20 + rand() % 95 : rand() & 0xff;
+}
+
+static int run_tests(int loops)
+{
+	uint8_t in[MAX_LEN], huff[MAX_LEN * 4];
+	int errors = 0;
+	int i, j, len, hlen;
+
+	/* all symbols, alone and in pairs */
+	for (i = 0; i < 256; i++) {
+		for (j = -1; j < 256; j++) {
+			in[0] = i;
+			in[1] = j;
+			hlen = encode(in, j < 0 ? 1 : 2, huff);
+			errors += check(huff, hlen, MAX_LEN);
+		}
+	}
+
+	/* random strings, with random output sizes */
+	for (i = 0; i < loops; i++) {
+		len = rand() % MAX_LEN;
+		for (j = 0; j < len; j++)
+			in[j] = rnd_sym();
+		hlen = encode(in, len, huff);
+		errors += check(huff, hlen, (rand() & 3) ? MAX_LEN : rand() % (len + 1));
+
+		/* random garbage, mostly invalid */
+		hlen = rand() % 64;
+		for (j = 0; j < hlen; j++)
+			huff[j] = (rand() & 1) ? 0xff : rand();
+		errors += check(huff, hlen, MAX_LEN);
+	}
+
+	printf("%d random tests, %d errors\n", loops, errors);
+	return !!errors;
+}
+
+static int run_bench(int loops)
+{
+	uint8_t huff[sizeof(bench_strings) / sizeof(*bench_strings)][MAX_LEN];
+	int hlen[sizeof(bench_strings) / sizeof(*bench_strings)];
+	int nbstr = sizeof(bench_strings) / sizeof(*bench_strings);
+	char out[MAX_LEN];
+	unsigned long long syms = 0, bytes = 0;
+	struct timespec start, stop;
+	double ns;
+	int i, j;
+
+	for (j = 0; j < nbstr; j++)
+		hlen[j] = encode((const uint8_t *)bench_strings[j], strlen(bench_strings[j]), huff[j]);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < loops; i++) {
+		for (j = 0; j < nbstr; j++) {
+			syms += huff_dec(huff[j], hlen[j], out, sizeof(out));
+			bytes += hlen[j];
+		}
+	}
+	clock_gettime(CLOCK_MONOTONIC, &stop);
+
+	ns = (stop.tv_sec - start.tv_sec) * 1e9 + (stop.tv_nsec - start.tv_nsec);
+	printf("%llu symbols from %llu bytes in %.0f ms: %.1f MB/s in, %.2f ns/symbol\n",
+	       syms, bytes, ns / 1e6, bytes * 1e3 / ns, ns / syms);
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	int bench = 0;
+	int loops = 0;
+	int opt;
+
+	srand(1);
+	while ((opt = getopt(argc, argv, "bn:s:")) != -1) {
+		switch (opt) {
+		case 'b': bench = 1; break;
+		case 'n': loops = atoi(optarg); break;
+		case 's': srand(atoi(optarg)); break;
+		default:
+			fprintf(stderr, "Usage: %s [-b] [-n <loops>] [-s <seed>]\n", argv[0]);
+			exit(1);
+		}
+	}
+
+	if (bench)
+		return run_bench(loops ? loops : 1000000);
+	return run_tests(loops ? loops : 100000);
+}
@@ -0,0 +1,45 @@
+#!/bin/sh
+#
+# Compares the rates reported by perf-run.sh in a baseline result file and a
+# new one. Prints one line per scenario present in both files, and returns a
+# non-zero status if any rate dropped by more than the threshold (percent).
+
+usage() {
+	echo "Usage: ${0##*/} [-T <percent>] <baseline> <results>" >&2
+	exit 1
+}
+
+THRESHOLD=5
+
+if [ "$1" = "-T" ]; then
+	THRESHOLD="$2"
+	shift 2
+fi
+
+[ $# -eq 2 ] || usage
+
+awk -v thr="$THRESHOLD" '
+	/^#/ { next }
+	{
+		delete v
+		for (i = 1; i <= NF; i++) {
+			split($i, f, "=")
+			v[f[1]] = f[2]
+		}
+		if (v["status"] != "ok" || v["rate"] == "")
+			next
+		if (FILENAME == ARGV[1]) {
+			base[v["scenario"]] = v["rate"]
+			next
+		}
+		s = v["scenario"]
+		if (!(s in base) || base[s] <= 0)
+			next
+		delta = (v["rate"] - base[s]) * 100.0 / base[s]
+		verdict = delta < -thr ? "regression" : delta > thr ? "improvement" : "same"
+		if (verdict == "regression")
+			bad++
+		printf "scenario=%s base=%s rate=%s unit=%s delta=%+.1f%% verdict=%s\n",
+		       s, base[s], v["rate"], v["unit"], delta, verdict
+	}
+	END { exit bad ? 1 : 0 }' "$1" "$2"
@@ -0,0 +1,236 @@
+#!/bin/sh
+#
+# Runs end-to-end performance scenarios against a haproxy binary, using
+# tcploop as the server and most of the time as the client, and reports one
+# line of "name=value" fields per scenario on stdout. See README for details.
+
+usage() {
+	cat >&2 <<EOF
+Usage: ${0##*/} [options] [scenario]*
+Options:
+  -b <haproxy>   haproxy binary to test (default: ./haproxy)
+  -c <conns>     number of concurrent client connections (default: 10)
+  -n <requests>  number of requests per connection (default: 10000)
+  -m <MB>        amount of data transferred by bulk scenarios (default: 1000)
+  -d <seconds>   duration of time-based scenarios (default: 5)
+  -p <port>      first TCP port to use, 10 are needed (default: 18400)
+  -o <file>      also store the results into this file
+  -B <file>      compare the results with this baseline file
+  -T <percent>   regression threshold when comparing (default: 5)
+Scenarios: ${ALL_SCENARIOS}
+EOF
+	exit 1
+}
+
+ALL_SCENARIOS="h1-ka-small h2-mux tls-hs tcp-splice-bulk cache-hit"
+
+DIR="$(cd "${0%/*}" && pwd)"
+TOP="${DIR%/dev/perf}"
+TCPLOOP="$TOP/dev/tcploop/tcploop"
+HAPROXY=./haproxy
+CONNS=10
+REQS=10000
+MBYTES=1000
+DURATION=5
+PORT=18400
+OUTPUT=
+BASELINE=
+THRESHOLD=5
+
+while [ -n "$1" -a -z "${1##-*}" ]; do
+	case "$1" in
+		-b) HAPROXY="$2"; shift;;
+		-c) CONNS="$2"; shift;;
+		-n) REQS="$2"; shift;;
+		-m) MBYTES="$2"; shift;;
+		-d) DURATION="$2"; shift;;
+		-p) PORT="$2"; shift;;
+		-o) OUTPUT="$2"; shift;;
+		-B) BASELINE="$2"; shift;;
+		-T) THRESHOLD="$2"; shift;;
+		--) shift; break;;
+		*)  usage;;
+	esac
+	shift
+done
+
+SCENARIOS="${*:-$ALL_SCENARIOS}"
+for s in $SCENARIOS; do
+	case " $ALL_SCENARIOS " in
+		*" $s "*) ;;
+		*) echo "Unknown scenario '$s'." >&2; usage;;
+	esac
+done
+
+[ -x "$HAPROXY" ] || { echo "Cannot execute haproxy binary '$HAPROXY'." >&2; exit 1; }
+
+if [ ! -x "$TCPLOOP" -o "$TCPLOOP" -ot "$TCPLOOP.c" ]; then
+	make -s -C "$TOP/dev/tcploop" tcploop >&2 || exit 1
+fi
+
+TMP="$(mktemp -d /tmp/perf-run.XXXXXX)" || exit 1
+PIDS=
+
+cleanup() {
+	[ -z "$PIDS" ] || kill $PIDS 2>/dev/null
+	wait 2>/dev/null
+	rm -rf "$TMP"
+}
+trap cleanup EXIT
+trap 'exit 1' INT TERM
+
+export PERF_H1=127.0.0.1:$((PORT))
+export PERF_H2=127.0.0.1:$((PORT+1))
+export PERF_TLS=127.0.0.1:$((PORT+2))
+export PERF_SPLICE=127.0.0.1:$((PORT+3))
+export PERF_CACHE=127.0.0.1:$((PORT+4))
+export PERF_SRV=127.0.0.1:$((PORT+8))
+export PERF_BULK=127.0.0.1:$((PORT+9))
+
+# the TLS scenario requires openssl to generate the certificate
+if command -v openssl >/dev/null 2>&1 &&
+   openssl req -x509 -newkey rsa:2048 -nodes -days 1 -subj /CN=perf \
+	   -keyout "$TMP/key.pem" -out "$TMP/crt.pem" >/dev/null 2>&1; then
+	cat "$TMP/crt.pem" "$TMP/key.pem" > "$TMP/perf.pem"
+	export PERF_CERT="$TMP/perf.pem"
+fi
+
+# waits for address $1 to accept connections
+wait_port() {
+	i=0
+	while ! "$TCPLOOP" "$1" C O K >/dev/null 2>&1; do
+		i=$((i+1))
+		[ $i -lt 50 ] || { echo "Nothing listening on $1." >&2; exit 1; }
+		sleep 0.1
+	done
+}
+
+# starts a background daemon whose pid is recorded for cleanup
+start() {
+	"$@" >/dev/null 2>>"$TMP/errors" &
+	PIDS="$PIDS $!"
+}
+
+start "$TCPLOOP" "$PERF_SRV" L1000 W N$((CONNS+10)) A R \
+      S:"HTTP/1.1 200 OK\r\nContent-Length: 16\r\nCache-Control: max-age=3600\r\n\r\n0123456789abcdef" J
+start "$TCPLOOP" "$PERF_BULK" L W N$((CONNS+10)) A S0
+start "$HAPROXY" -db -f "$TOP/tests/conf/perf-scenarios.cfg"
+wait_port "$PERF_SRV"
+wait_port "$PERF_BULK"
+wait_port "$PERF_H1"
+
+# runs $CONNS tcploop clients in parallel with the actions passed in arguments
+# and aggregates their statistics into a single line. The latency percentiles
+# are the ones of the worst client.
+run_clients() {
+	CLIENTS=
+	i=0
+	while [ $i -lt $CONNS ]; do
+		"$TCPLOOP" -s "$@" > "$TMP/client.$i" 2>>"$TMP/errors" &
+		CLIENTS="$CLIENTS $!"
+		i=$((i+1))
+	done
+	wait $CLIENTS
+	cat "$TMP"/client.* | awk '
+		{
+			for (i = 1; i <= NF; i++) {
+				split($i, f, "=")
+				v[f[1]] = f[2]
+			}
+			conns++
+			loops += v["loops"]; bin += v["bytes_in"]; bout += v["bytes_out"]
+			lat += v["lat_avg_us"] * v["loops"]
+			if (v["time_us"] > time) time = v["time_us"]
+			if (v["lat_p50_us"] > p50) p50 = v["lat_p50_us"]
+			if (v["lat_p99_us"] > p99) p99 = v["lat_p99_us"]
+			if (v["lat_max_us"] > max) max = v["lat_max_us"]
+		}
+		END {
+			printf "conns=%d reqs=%d bytes_in=%d bytes_out=%d time_ms=%d ",
+			       conns, loops, bin, bout, time / 1000
+			printf "rate=%.1f unit=req/s lat_avg_us=%d lat_p50_us=%d lat_p99_us=%d lat_max_us=%d\n",
+			       time ? loops * 1000000 / time : 0, loops ? lat / loops : 0, p50, p99, max
+		}'
+	rm -f "$TMP"/client.*
+}
+
+# every scenario prints its results on stdout, without the "scenario=" field
+run_h1_ka_small() {
+	run_clients "$PERF_H1" C T S:"GET / HTTP/1.1\r\nHost: perf\r\n\r\n" H J$((REQS-1))
+}
+
+run_cache_hit() {
+	run_clients "$PERF_CACHE" C T S:"GET / HTTP/1.1\r\nHost: perf\r\n\r\n" H J$((REQS-1))
+}
+
+run_h2_mux() {
+	if ! command -v h2load >/dev/null 2>&1; then
+		echo "status=skipped reason=no-h2load"
+		return
+	fi
+	h2load -n $((CONNS*REQS)) -c $CONNS -m 10 "http://$PERF_H2/" 2>>"$TMP/errors" | awk -v c=$CONNS '
+		/^finished in/ { time = $3 + 0; if ($3 ~ /ms,$/) time /= 1000; rate = $4 + 0 }
+		/^requests:/   { reqs = $8 }
+		/^time for request:/ { avg = $6; if (avg ~ /ms$/) avg *= 1000; else avg += 0 }
+		END {
+			printf "conns=%d reqs=%d time_ms=%d rate=%.1f unit=req/s lat_avg_us=%d\n",
+			       c, reqs, time * 1000, rate, avg
+		}'
+}
+
+run_tls_hs() {
+	if [ -z "$PERF_CERT" ]; then
+		echo "status=skipped reason=no-openssl"
+		return
+	fi
+	CLIENTS=
+	i=0
+	while [ $i -lt $CONNS ]; do
+		openssl s_time -connect "$PERF_TLS" -new -time $DURATION > "$TMP/client.$i" 2>>"$TMP/errors" &
+		CLIENTS="$CLIENTS $!"
+		i=$((i+1))
+	done
+	wait $CLIENTS
+	cat "$TMP"/client.* | awk -v c=$CONNS '
+		/connections in .* real seconds/ {
+			hs += $1
+			if ($4 > time) time = $4
+		}
+		END {
+			printf "conns=%d hs=%d time_ms=%d rate=%.1f unit=hs/s\n",
+			       c, hs, time * 1000, time ? hs / time : 0
+		}'
+	rm -f "$TMP"/client.*
+}
+
+run_tcp_splice_bulk() {
+	"$TCPLOOP" -s "$PERF_SPLICE" C R$((MBYTES*1000000)) 2>>"$TMP/errors" | awk '
+		{
+			for (i = 1; i <= NF; i++) {
+				split($i, f, "=")
+				v[f[1]] = f[2]
+			}
+		}
+		END {
+			printf "conns=1 bytes_in=%d time_ms=%d rate=%.1f unit=MB/s\n",
+			       v["bytes_in"], v["time_us"] / 1000,
+			       v["time_us"] ? v["bytes_in"] / v["time_us"] : 0
+		}'
+}
+
+{
+	echo "# version=$("$HAPROXY" -v | awk '/version/ { print $3; exit }')" \
+	     "date=$(date -u +%Y-%m-%dT%H:%M:%SZ) host=$(uname -n) cpus=$(getconf _NPROCESSORS_ONLN)"
+
+	for s in $SCENARIOS; do
+		printf "scenario=%s " "$s"
+		run_$(echo "$s" | tr '-' '_') | awk '{ print /status=/ ? $0 : "status=ok " $0 }'
+	done
+
+	if [ -s "$TMP/errors" ]; then
+		sed -e 's/^/# error: /' "$TMP/errors" | sort -u | head -n 10
+	fi
+} | tee "$TMP/results"
+
+[ -z "$OUTPUT" ] || cp "$TMP/results" "$OUTPUT"
+[ -z "$BASELINE" ] || "$DIR/perf-compare.sh" -T "$THRESHOLD" "$BASELINE" "$TMP/results"
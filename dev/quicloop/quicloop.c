@@ -0,0 +1,1560 @@
+/*
+ * QUIC client for load and performance tests
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * This is a minimal QUIC client opening connections at a controlled rate and
+ * optionally pushing bulk data on one stream of each of them, so that the
+ * performance of a QUIC server (typically haproxy) may be measured. It speaks
+ * the same draft version as haproxy and only implements what is needed for
+ * this purpose: in-order CRYPTO data, a fixed window of packets in flight
+ * instead of a congestion controller, and simple loss detection. It requires
+ * a TLS library with the QUIC API (quictls or BoringSSL), just like haproxy.
+ */
+
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <netinet/in.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <openssl/err.h>
+#include <openssl/evp.h>
+#include <openssl/hmac.h>
+#include <openssl/rand.h>
+#include <openssl/ssl.h>
+
+#define QUIC_VERSION       0xff00001d /* draft-29 */
+#define CID_LEN            8          /* length of our connection IDs */
+#define MIN_INITIAL_SZ     1200       /* minimum size of datagrams with Initial packets */
+#define MAX_DGRAM_SZ       1472       /* maximum datagram size */
+#define PN_LEN             4          /* we always send 4-byte packet numbers */
+#define TAG_LEN            16
+#define SENT_RING          4096       /* packets tracked for the bulk transfer (power of 2) */
+#define MAX_PTO            6          /* handshake probes before giving up */
+
+/* encryption levels, in the same order as enum ssl_encryption_level_t */
+enum { LVL_INITIAL = 0, LVL_EARLY, LVL_HANDSHAKE, LVL_APP, LVL_MAX };
+
+/* packet number spaces */
+enum { PNS_INITIAL = 0, PNS_HANDSHAKE, PNS_APP, PNS_MAX };
+
+/* long header packet types */
+enum { PKT_INITIAL = 0, PKT_0RTT, PKT_HANDSHAKE, PKT_RETRY };
+
+enum conn_state {
+	CS_HANDSHAKE = 0,  /* handshake in progress */
+	CS_BULK,           /* handshake complete, pushing data */
+	CS_DONE,           /* finished, to be released */
+	CS_FAILED,         /* failed, to be released */
+};
+
+struct keys {
+	EVP_CIPHER_CTX *ctx;   /* AEAD context, with its key set */
+	EVP_CIPHER_CTX *hp;    /* header protection (AES-ECB) context */
+	unsigned char iv[12];
+	int set;
+};
+
+struct pktns {
+	uint64_t next_pn;      /* next packet number to send */
+	int64_t rx_largest;    /* largest packet number received, -1 if none */
+	int64_t rx_contig;     /* smallest packet number of the run ending at rx_largest */
+	int ack_needed;        /* an ack-eliciting packet was received */
+};
+
+struct crypto_buf {
+	unsigned char *data;   /* CRYPTO stream data to send at this level */
+	size_t len, size;
+	size_t sent;           /* bytes already sent */
+	uint64_t rx_off;       /* next expected offset of the received CRYPTO data */
+};
+
+struct sent_pkt {
+	uint64_t pn;
+	uint64_t off;          /* STREAM data it carries */
+	uint32_t len;
+	int inflight;
+};
+
+struct range {
+	uint64_t off;
+	uint32_t len;
+};
+
+struct conn {
+	int fd;
+	SSL *ssl;
+	enum conn_state state;
+	unsigned char dcid[20], odcid[20], scid[CID_LEN];
+	int dcid_len, odcid_len;
+	unsigned char *token;       /* token received in a Retry packet */
+	size_t token_len;
+	int got_scid;               /* the DCID was set from the server SCID */
+	int retried;
+	int init_discarded;         /* no more Initial packets */
+	int hs_discarded;           /* no more Handshake packets */
+	struct keys rx[LVL_MAX], tx[LVL_MAX];
+	struct pktns pns[PNS_MAX];
+	struct crypto_buf crypto[LVL_MAX];
+	/* handshake */
+	uint64_t start, last_rx, pto_expire;
+	int pto_count;
+	/* bulk transfer on stream 0 */
+	uint64_t to_send;           /* total number of bytes to push */
+	uint64_t snd_off;           /* next new offset to send */
+	uint64_t acked;             /* number of bytes acknowledged */
+	struct sent_pkt *sent;      /* SENT_RING packets tracked */
+	uint64_t una;               /* smallest packet number possibly in flight */
+	int64_t largest_acked;
+	unsigned int inflight;      /* number of packets in flight */
+	uint64_t rto_expire;
+	struct range *lost;         /* ranges to send again */
+	int lost_nb;
+};
+
+/* settings */
+static unsigned int max_conns = 1;       /* -n: total connections, 0 = unlimited */
+static unsigned int concurrency = 1;     /* -c */
+static unsigned int rate;                /* -r: new connections per second limit */
+static uint64_t bulk_size;               /* -b: bytes pushed per connection */
+static unsigned int duration;            /* -d: seconds, 0 = until -n is reached */
+static unsigned int dgram_sz = MIN_INITIAL_SZ; /* -m */
+static unsigned int window = 64;         /* -w: packets in flight */
+static unsigned int report_itv = 1;      /* -i: seconds between reports */
+static int server_pid;                   /* -p: server pid for CPU accounting */
+static const char *alpn = "h3-29";       /* -a */
+static const char *sni;                  /* -s */
+static int verbose;                      /* -v */
+
+static struct sockaddr_storage srv_addr;
+static socklen_t srv_addr_len;
+static SSL_CTX *ssl_ctx;
+static int epfd;
+static struct conn **conns;
+static unsigned int nb_active;
+
+/* statistics */
+static uint64_t st_started, st_handshakes, st_failed, st_done, st_retries;
+static uint64_t st_bytes, st_dgrams_out, st_dgrams_in, st_lost;
+
+static unsigned char zeroes[MAX_DGRAM_SZ];
+
+/* draft-29 initial salt */
+static const unsigned char initial_salt[20] = {
+	0xaf, 0xbf, 0xec, 0x28, 0x99, 0x93, 0xd2, 0x4c,
+	0x9e, 0x97, 0x86, 0xf1, 0x9c, 0x61, 0x11, 0xe0,
+	0x43, 0x90, 0xa8, 0x99
+};
+
+/* display the message and exit with the code */
+__attribute__((noreturn)) void die(int code, const char *format, ...)
+{
+	va_list args;
+
+	if (format) {
+		va_start(args, format);
+		vfprintf(stderr, format, args);
+		va_end(args);
+	}
+	exit(code);
+}
+
+/* display the usage message and exit with the code */
+__attribute__((noreturn)) void usage(int code, const char *arg0)
+{
+	die(code,
+	    "Usage : %s [options]* <ip>:<port>\n"
+	    "\n"
+	    "options :\n"
+	    "  -n <conns>   : total number of connections (default 1, 0=unlimited)\n"
+	    "  -c <conns>   : number of concurrent connections (default 1)\n"
+	    "  -r <rate>    : maximum number of new connections per second (default none)\n"
+	    "  -b <size>    : bytes pushed on one stream of each connection (default 0)\n"
+	    "  -d <time>    : stop after this number of seconds (default none)\n"
+	    "  -m <size>    : size of the datagrams (default 1200)\n"
+	    "  -w <pkts>    : number of packets in flight per connection (default 64)\n"
+	    "  -i <time>    : seconds between two reports (default 1, 0=none)\n"
+	    "  -a <alpn>    : ALPN to announce (default \"h3-29\")\n"
+	    "  -s <name>    : SNI to send\n"
+	    "  -p <pid>     : server's pid, to report its CPU usage\n"
+	    "  -v           : verbose\n"
+	    "\n"
+	    "Sizes support the k, m and g suffixes. The server's CPU usage is read\n"
+	    "from /proc/<pid>/stat and includes all of its threads.\n"
+	    "\n"
+	    "Example measuring the handshake rate with 100 concurrent connections :\n"
+	    "   quicloop -n 0 -c 100 -d 10 127.0.0.1:4433\n"
+	    "\n"
+	    "Example measuring the bandwidth of 4 connections pushing 1 GB each :\n"
+	    "   quicloop -n 4 -c 4 -b 1g -p $(pidof haproxy) 127.0.0.1:4433\n"
+	    "", arg0);
+}
+
+void dolog(const char *format, ...)
+{
+	va_list args;
+
+	if (!verbose)
+		return;
+
+	va_start(args, format);
+	vfprintf(stderr, format, args);
+	va_end(args);
+}
+
+/* returns the current monotonic time in microseconds */
+static uint64_t now_us()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/* parses a size with an optional k/m/g suffix */
+static uint64_t parse_size(const char *str)
+{
+	char *end;
+	uint64_t val = strtoull(str, &end, 10);
+
+	switch (*end) {
+	case 'g': case 'G': val <<= 10; /* fall through */
+	case 'm': case 'M': val <<= 10; /* fall through */
+	case 'k': case 'K': val <<= 10;
+	}
+	return val;
+}
+
+/* returns the CPU time consumed by process <pid> in seconds, or by the current
+ * one if <pid> is zero, or a negative value if unknown.
+ */
+static double cpu_time(int pid)
+{
+	unsigned long utime, stime;
+	struct rusage ru;
+	char path[64], buf[1024], *p;
+	int fd, len;
+
+	if (!pid) {
+		getrusage(RUSAGE_SELF, &ru);
+		return ru.ru_utime.tv_sec + ru.ru_utime.tv_usec / 1e6 +
+		       ru.ru_stime.tv_sec + ru.ru_stime.tv_usec / 1e6;
+	}
+
+	snprintf(path, sizeof(path), "/proc/%d/stat", pid);
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return -1;
+	len = read(fd, buf, sizeof(buf) - 1);
+	close(fd);
+	if (len <= 0)
+		return -1;
+	buf[len] = 0;
+
+	/* the command name may contain spaces, fields are counted after it */
+	p = strrchr(buf, ')');
+	if (!p || sscanf(p + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu",
+	                 &utime, &stime) != 2)
+		return -1;
+	return (double)(utime + stime) / sysconf(_SC_CLK_TCK);
+}
+
+/*
+ * Variable-length integers
+ */
+
+static int varint_len(uint64_t v)
+{
+	return v < (1 << 6) ? 1 : v < (1 << 14) ? 2 : v < (1 << 30) ? 4 : 8;
+}
+
+static unsigned char *enc_varint(unsigned char *pos, uint64_t v)
+{
+	int len = varint_len(v);
+	int i;
+
+	for (i = len - 1; i >= 0; i--) {
+		pos[i] = v;
+		v >>= 8;
+	}
+	pos[0] |= (len == 1 ? 0x00 : len == 2 ? 0x40 : len == 4 ? 0x80 : 0xc0);
+	return pos + len;
+}
+
+static unsigned char *write_u32(unsigned char *pos, uint32_t v)
+{
+	pos[0] = v >> 24;
+	pos[1] = v >> 16;
+	pos[2] = v >> 8;
+	pos[3] = v;
+	return pos + 4;
+}
+
+/* decodes a varint at <*pos> without reading past <end>. Returns 0 on error. */
+static int dec_varint(uint64_t *v, const unsigned char **pos, const unsigned char *end)
+{
+	const unsigned char *p = *pos;
+	int len, i;
+
+	if (p >= end)
+		return 0;
+	len = 1 << (*p >> 6);
+	if (end - p < len)
+		return 0;
+	*v = *p & 0x3f;
+	for (i = 1; i < len; i++)
+		*v = (*v << 8) | p[i];
+	*pos = p + len;
+	return 1;
+}
+
+/*
+ * Keys derivation and packet protection
+ */
+
+/* HKDF-Expand-Label() from TLS 1.3 with an empty context */
+static int hkdf_expand_label(const EVP_MD *md, const unsigned char *secret, size_t secret_len,
+                             const char *label, unsigned char *out, size_t out_len)
+{
+	unsigned char info[2 + 1 + 255 + 1 + 1];
+	unsigned char t[EVP_MAX_MD_SIZE], in[EVP_MAX_MD_SIZE + sizeof(info)];
+	unsigned int t_len = 0, md_len = EVP_MD_size(md);
+	size_t info_len, done, in_len;
+	unsigned char i;
+
+	info_len = 0;
+	info[info_len++] = out_len >> 8;
+	info[info_len++] = out_len;
+	info[info_len++] = 6 + strlen(label);
+	memcpy(info + info_len, "tls13 ", 6);
+	info_len += 6;
+	memcpy(info + info_len, label, strlen(label));
+	info_len += strlen(label);
+	info[info_len++] = 0;
+
+	for (done = 0, i = 1; done < out_len; i++) {
+		/* T(i) = HMAC(secret, T(i-1) | info | i) */
+		memcpy(in, t, t_len);
+		memcpy(in + t_len, info, info_len);
+		in_len = t_len + info_len;
+		in[in_len++] = i;
+		if (!HMAC(md, secret, secret_len, in, in_len, t, &t_len))
+			return 0;
+		memcpy(out + done, t, out_len - done < md_len ? out_len - done : md_len);
+		done += md_len;
+	}
+	return 1;
+}
+
+static void keys_free(struct keys *k)
+{
+	EVP_CIPHER_CTX_free(k->ctx);
+	EVP_CIPHER_CTX_free(k->hp);
+	memset(k, 0, sizeof(*k));
+}
+
+/* derives the packet protection keys of <k> from <secret>, for encryption if
+ * <enc> is set or decryption otherwise. Returns 0 on error.
+ */
+static int keys_init(struct keys *k, const EVP_CIPHER *aead, const EVP_MD *md,
+                     const unsigned char *secret, size_t secret_len, int enc)
+{
+	unsigned char key[32], hp_key[32];
+	int key_len = EVP_CIPHER_key_length(aead);
+
+	keys_free(k);
+	if (!hkdf_expand_label(md, secret, secret_len, "quic key", key, key_len) ||
+	    !hkdf_expand_label(md, secret, secret_len, "quic iv", k->iv, sizeof(k->iv)) ||
+	    !hkdf_expand_label(md, secret, secret_len, "quic hp", hp_key, key_len))
+		return 0;
+
+	k->ctx = EVP_CIPHER_CTX_new();
+	k->hp = EVP_CIPHER_CTX_new();
+	if (!k->ctx || !k->hp ||
+	    !EVP_CipherInit_ex(k->ctx, aead, NULL, key, NULL, enc) ||
+	    !EVP_EncryptInit_ex(k->hp, key_len == 32 ? EVP_aes_256_ecb() : EVP_aes_128_ecb(),
+	                        NULL, hp_key, NULL)) {
+		keys_free(k);
+		return 0;
+	}
+	EVP_CIPHER_CTX_set_padding(k->hp, 0);
+	k->set = 1;
+	return 1;
+}
+
+/* derives the Initial keys of <c> from its current DCID */
+static int initial_keys_init(struct conn *c)
+{
+	const EVP_MD *md = EVP_sha256();
+	unsigned char initial[32], client[32], server[32];
+	unsigned int len;
+
+	if (!HMAC(md, initial_salt, sizeof(initial_salt), c->dcid, c->dcid_len, initial, &len) ||
+	    !hkdf_expand_label(md, initial, len, "client in", client, sizeof(client)) ||
+	    !hkdf_expand_label(md, initial, len, "server in", server, sizeof(server)))
+		return 0;
+
+	return keys_init(&c->tx[LVL_INITIAL], EVP_aes_128_gcm(), md, client, sizeof(client), 1) &&
+	       keys_init(&c->rx[LVL_INITIAL], EVP_aes_128_gcm(), md, server, sizeof(server), 0);
+}
+
+static void build_nonce(unsigned char *nonce, const struct keys *k, uint64_t pn)
+{
+	int i;
+
+	memcpy(nonce, k->iv, 12);
+	for (i = 0; i < 8; i++)
+		nonce[11 - i] ^= pn >> (8 * i);
+}
+
+/* encrypts in place the packet <pkt> of <len> bytes, <pn_off> being the offset
+ * of its PN_LEN bytes long packet number <pn>, and applies the header
+ * protection. TAG_LEN bytes must be available after the packet. Returns the
+ * length of the protected packet, or 0 on error.
+ */
+static size_t protect_pkt(const struct keys *k, unsigned char *pkt, size_t len,
+                          size_t pn_off, uint64_t pn)
+{
+	unsigned char nonce[12], mask[16];
+	size_t hdr_len = pn_off + PN_LEN;
+	int outlen, i;
+
+	build_nonce(nonce, k, pn);
+	if (!EVP_EncryptInit_ex(k->ctx, NULL, NULL, NULL, nonce) ||
+	    !EVP_EncryptUpdate(k->ctx, NULL, &outlen, pkt, hdr_len) ||
+	    !EVP_EncryptUpdate(k->ctx, pkt + hdr_len, &outlen, pkt + hdr_len, len - hdr_len) ||
+	    !EVP_EncryptFinal_ex(k->ctx, pkt + len, &outlen) ||
+	    !EVP_CIPHER_CTX_ctrl(k->ctx, EVP_CTRL_AEAD_GET_TAG, TAG_LEN, pkt + len))
+		return 0;
+	len += TAG_LEN;
+
+	/* the sample starts 4 bytes after the start of the packet number */
+	if (!EVP_EncryptUpdate(k->hp, mask, &outlen, pkt + pn_off + 4, sizeof(mask)))
+		return 0;
+	pkt[0] ^= mask[0] & ((pkt[0] & 0x80) ? 0x0f : 0x1f);
+	for (i = 0; i < PN_LEN; i++)
+		pkt[pn_off + i] ^= mask[1 + i];
+	return len;
+}
+
+/* removes the header protection of packet <pkt> ending at <end>, decodes its
+ * packet number into <pn> relative to <largest>, and decrypts its payload in
+ * place. Sets the offset of the payload into <poff> and returns its length, or -1
+ * on error.
+ */
+static ssize_t unprotect_pkt(const struct keys *k, unsigned char *pkt, const unsigned char *end,
+                             size_t pn_off, int64_t largest, uint64_t *pn, size_t *poff)
+{
+	unsigned char nonce[12], mask[16];
+	uint64_t truncated = 0, expected, win, hwin, cand;
+	size_t hdr_len, plen;
+	int outlen, pn_len, i;
+
+	if (end - pkt < pn_off + 4 + sizeof(mask))
+		return -1;
+	if (!EVP_EncryptUpdate(k->hp, mask, &outlen, pkt + pn_off + 4, sizeof(mask)))
+		return -1;
+	pkt[0] ^= mask[0] & ((pkt[0] & 0x80) ? 0x0f : 0x1f);
+	pn_len = (pkt[0] & 0x03) + 1;
+	for (i = 0; i < pn_len; i++) {
+		pkt[pn_off + i] ^= mask[1 + i];
+		truncated = (truncated << 8) | pkt[pn_off + i];
+	}
+
+	/* packet number decoding (RFC9000 A.3) */
+	expected = largest + 1;
+	win = 1ULL << (pn_len * 8);
+	hwin = win / 2;
+	cand = (expected & ~(win - 1)) | truncated;
+	if (cand + hwin <= expected && cand < (1ULL << 62) - win)
+		cand += win;
+	else if (cand > expected + hwin && cand >= win)
+		cand -= win;
+	*pn = cand;
+
+	hdr_len = pn_off + pn_len;
+	if (end - pkt < hdr_len + TAG_LEN)
+		return -1;
+	plen = end - pkt - hdr_len - TAG_LEN;
+
+	build_nonce(nonce, k, cand);
+	if (!EVP_DecryptInit_ex(k->ctx, NULL, NULL, NULL, nonce) ||
+	    !EVP_DecryptUpdate(k->ctx, NULL, &outlen, pkt, hdr_len) ||
+	    !EVP_DecryptUpdate(k->ctx, pkt + hdr_len, &outlen, pkt + hdr_len, plen) ||
+	    !EVP_CIPHER_CTX_ctrl(k->ctx, EVP_CTRL_AEAD_SET_TAG, TAG_LEN, (void *)(end - TAG_LEN)) ||
+	    !EVP_DecryptFinal_ex(k->ctx, pkt + hdr_len + outlen, &outlen))
+		return -1;
+
+	*poff = hdr_len;
+	return plen;
+}
+
+/*
+ * QUIC TLS callbacks
+ */
+
+static int tls_cipher(const SSL_CIPHER *cipher, const EVP_CIPHER **aead, const EVP_MD **md)
+{
+	switch (SSL_CIPHER_get_id(cipher)) {
+	case TLS1_3_CK_AES_128_GCM_SHA256:
+		*aead = EVP_aes_128_gcm();
+		*md = EVP_sha256();
+		return 1;
+	case TLS1_3_CK_AES_256_GCM_SHA384:
+		*aead = EVP_aes_256_gcm();
+		*md = EVP_sha384();
+		return 1;
+	}
+	return 0;
+}
+
+static int set_secret(SSL *ssl, int level, const SSL_CIPHER *cipher,
+                      const uint8_t *secret, size_t secret_len, int enc)
+{
+	struct conn *c = SSL_get_app_data(ssl);
+	const EVP_CIPHER *aead;
+	const EVP_MD *md;
+
+	if (!tls_cipher(cipher, &aead, &md))
+		return 0;
+	return keys_init(enc ? &c->tx[level] : &c->rx[level], aead, md, secret, secret_len, enc);
+}
+
+#ifdef OPENSSL_IS_BORINGSSL
+static int quic_set_read_secret(SSL *ssl, enum ssl_encryption_level_t level,
+                                const SSL_CIPHER *cipher, const uint8_t *secret,
+                                size_t secret_len)
+{
+	return set_secret(ssl, level, cipher, secret, secret_len, 0);
+}
+
+static int quic_set_write_secret(SSL *ssl, enum ssl_encryption_level_t level,
+                                 const SSL_CIPHER *cipher, const uint8_t *secret,
+                                 size_t secret_len)
+{
+	return set_secret(ssl, level, cipher, secret, secret_len, 1);
+}
+#else
+static int quic_set_encryption_secrets(SSL *ssl, enum ssl_encryption_level_t level,
+                                       const uint8_t *read_secret,
+                                       const uint8_t *write_secret, size_t secret_len)
+{
+	const SSL_CIPHER *cipher = SSL_get_current_cipher(ssl);
+
+	if (read_secret && !set_secret(ssl, level, cipher, read_secret, secret_len, 0))
+		return 0;
+	if (write_secret && !set_secret(ssl, level, cipher, write_secret, secret_len, 1))
+		return 0;
+	return 1;
+}
+#endif
+
+static int quic_add_handshake_data(SSL *ssl, enum ssl_encryption_level_t level,
+                                   const uint8_t *data, size_t len)
+{
+	struct conn *c = SSL_get_app_data(ssl);
+	struct crypto_buf *cb = &c->crypto[level];
+
+	if (cb->len + len > cb->size) {
+		size_t size = (cb->len + len) * 2;
+		unsigned char *area = realloc(cb->data, size);
+
+		if (!area)
+			return 0;
+		cb->data = area;
+		cb->size = size;
+	}
+	memcpy(cb->data + cb->len, data, len);
+	cb->len += len;
+	return 1;
+}
+
+static int quic_flush_flight(SSL *ssl)
+{
+	return 1;
+}
+
+static int quic_send_alert(SSL *ssl, enum ssl_encryption_level_t level, uint8_t alert)
+{
+	struct conn *c = SSL_get_app_data(ssl);
+
+	dolog("fd %d: TLS alert %d at level %d\n", c->fd, alert, level);
+	c->state = CS_FAILED;
+	return 1;
+}
+
+static SSL_QUIC_METHOD quic_method = {
+#ifdef OPENSSL_IS_BORINGSSL
+	.set_read_secret        = quic_set_read_secret,
+	.set_write_secret       = quic_set_write_secret,
+#else
+	.set_encryption_secrets = quic_set_encryption_secrets,
+#endif
+	.add_handshake_data     = quic_add_handshake_data,
+	.flush_flight           = quic_flush_flight,
+	.send_alert             = quic_send_alert,
+};
+
+/*
+ * Connections
+ */
+
+static int level_pns(int level)
+{
+	return level == LVL_INITIAL ? PNS_INITIAL : level == LVL_HANDSHAKE ? PNS_HANDSHAKE : PNS_APP;
+}
+
+/* encodes our transport parameters into <buf>, returns their length */
+static size_t encode_tps(struct conn *c, unsigned char *buf)
+{
+	unsigned char *pos = buf;
+
+	/* initial_source_connection_id */
+	pos = enc_varint(pos, 0x0f);
+	pos = enc_varint(pos, CID_LEN);
+	memcpy(pos, c->scid, CID_LEN);
+	pos += CID_LEN;
+	/* max_idle_timeout: 30s */
+	pos = enc_varint(pos, 0x01);
+	pos = enc_varint(pos, varint_len(30000));
+	pos = enc_varint(pos, 30000);
+	/* initial_max_data: the server is not expected to send data */
+	pos = enc_varint(pos, 0x04);
+	pos = enc_varint(pos, varint_len(1 << 20));
+	pos = enc_varint(pos, 1 << 20);
+	/* initial_max_stream_data_bidi_local */
+	pos = enc_varint(pos, 0x05);
+	pos = enc_varint(pos, varint_len(1 << 20));
+	pos = enc_varint(pos, 1 << 20);
+	return pos - buf;
+}
+
+static void conn_free(struct conn *c)
+{
+	int i;
+
+	if (c->fd >= 0)
+		close(c->fd);
+	SSL_free(c->ssl);
+	for (i = 0; i < LVL_MAX; i++) {
+		keys_free(&c->rx[i]);
+		keys_free(&c->tx[i]);
+		free(c->crypto[i].data);
+	}
+	free(c->token);
+	free(c->sent);
+	free(c->lost);
+	free(c);
+}
+
+static int conn_send(struct conn *c);
+
+/* creates a new connection and starts its handshake. Returns NULL on error. */
+static struct conn *conn_new()
+{
+	struct epoll_event ev;
+	unsigned char tps[64];
+	unsigned char alpn_buf[256];
+	struct conn *c;
+	int i, ret;
+
+	c = calloc(1, sizeof(*c));
+	if (!c)
+		return NULL;
+
+	c->fd = socket(srv_addr.ss_family, SOCK_DGRAM, 0);
+	if (c->fd < 0)
+		goto fail;
+	fcntl(c->fd, F_SETFL, O_NONBLOCK);
+	if (connect(c->fd, (struct sockaddr *)&srv_addr, srv_addr_len) < 0)
+		goto fail;
+
+	c->dcid_len = CID_LEN;
+	if (RAND_bytes(c->dcid, c->dcid_len) != 1 || RAND_bytes(c->scid, CID_LEN) != 1)
+		goto fail;
+	memcpy(c->odcid, c->dcid, c->dcid_len);
+	c->odcid_len = c->dcid_len;
+	if (!initial_keys_init(c))
+		goto fail;
+
+	for (i = 0; i < PNS_MAX; i++)
+		c->pns[i].rx_largest = c->pns[i].rx_contig = -1;
+	c->largest_acked = -1;
+	c->to_send = bulk_size;
+	if (bulk_size) {
+		c->sent = calloc(SENT_RING, sizeof(*c->sent));
+		c->lost = calloc(SENT_RING, sizeof(*c->lost));
+		if (!c->sent || !c->lost)
+			goto fail;
+	}
+
+	c->ssl = SSL_new(ssl_ctx);
+	if (!c->ssl)
+		goto fail;
+	SSL_set_app_data(c->ssl, c);
+	SSL_set_connect_state(c->ssl);
+	alpn_buf[0] = strlen(alpn);
+	memcpy(alpn_buf + 1, alpn, alpn_buf[0]);
+	if (SSL_set_alpn_protos(c->ssl, alpn_buf, alpn_buf[0] + 1) != 0 ||
+	    !SSL_set_quic_transport_params(c->ssl, tps, encode_tps(c, tps)))
+		goto fail;
+	if (sni)
+		SSL_set_tlsext_host_name(c->ssl, sni);
+
+	/* produces the ClientHello */
+	ret = SSL_do_handshake(c->ssl);
+	if (ret != 1 && SSL_get_error(c->ssl, ret) != SSL_ERROR_WANT_READ)
+		goto fail;
+
+	ev.events = EPOLLIN;
+	ev.data.ptr = c;
+	if (epoll_ctl(epfd, EPOLL_CTL_ADD, c->fd, &ev) < 0)
+		goto fail;
+
+	c->start = c->last_rx = now_us();
+	st_started++;
+	conn_send(c);
+	return c;
+
+ fail:
+	conn_free(c);
+	return NULL;
+}
+
+/* handles a Retry packet carrying <scid> and the <len> bytes long <token>
+ * followed by the integrity tag, which is not checked.
+ */
+static void conn_retry(struct conn *c, const unsigned char *scid, int scid_len,
+                       const unsigned char *token, size_t len)
+{
+	int i;
+
+	if (c->retried || c->got_scid || len <= TAG_LEN)
+		return;
+
+	len -= TAG_LEN;
+	c->token = malloc(len);
+	if (!c->token) {
+		c->state = CS_FAILED;
+		return;
+	}
+	memcpy(c->token, token, len);
+	c->token_len = len;
+	memcpy(c->dcid, scid, scid_len);
+	c->dcid_len = scid_len;
+	if (!initial_keys_init(c)) {
+		c->state = CS_FAILED;
+		return;
+	}
+	/* the ClientHello is sent again, the packet numbers go on */
+	for (i = 0; i < LVL_MAX; i++)
+		c->crypto[i].sent = 0;
+	c->retried = 1;
+	st_retries++;
+	dolog("fd %d: retry\n", c->fd);
+}
+
+/* marks in flight packet <pn> of the bulk transfer as acknowledged */
+static void bulk_ack(struct conn *c, uint64_t pn)
+{
+	struct sent_pkt *sp = &c->sent[pn & (SENT_RING - 1)];
+
+	if (!sp->inflight || sp->pn != pn)
+		return;
+	sp->inflight = 0;
+	c->inflight--;
+	c->acked += sp->len;
+	st_bytes += sp->len;
+}
+
+/* declares lost the packets in flight from <c->una> to <last> included */
+static void bulk_lose(struct conn *c, uint64_t last)
+{
+	uint64_t pn;
+
+	for (pn = c->una; pn <= last && pn < c->pns[PNS_APP].next_pn; pn++) {
+		struct sent_pkt *sp = &c->sent[pn & (SENT_RING - 1)];
+
+		if (!sp->inflight || sp->pn != pn)
+			continue;
+		sp->inflight = 0;
+		c->inflight--;
+		c->lost[c->lost_nb].off = sp->off;
+		c->lost[c->lost_nb].len = sp->len;
+		c->lost_nb++;
+		st_lost++;
+	}
+}
+
+/* moves <c->una> forward past the packets not in flight anymore */
+static void bulk_update_una(struct conn *c)
+{
+	while (c->una < c->pns[PNS_APP].next_pn) {
+		struct sent_pkt *sp = &c->sent[c->una & (SENT_RING - 1)];
+
+		if (sp->inflight && sp->pn == c->una)
+			break;
+		c->una++;
+	}
+}
+
+/* parses an ACK frame at <*pos> received at <level> */
+static int parse_ack(struct conn *c, int level, int ecn, const unsigned char **pos,
+                     const unsigned char *end)
+{
+	uint64_t largest, delay, count, first, gap, len, lo, hi, pn, i;
+
+	if (!dec_varint(&largest, pos, end) || !dec_varint(&delay, pos, end) ||
+	    !dec_varint(&count, pos, end) || !dec_varint(&first, pos, end) || first > largest)
+		return 0;
+
+	hi = largest;
+	lo = largest - first;
+	for (i = 0; ; i++) {
+		if (level == LVL_APP && c->sent) {
+			for (pn = lo > c->una ? lo : c->una; pn <= hi; pn++)
+				bulk_ack(c, pn);
+		}
+		if (i == count)
+			break;
+		if (!dec_varint(&gap, pos, end) || !dec_varint(&len, pos, end) ||
+		    gap + 2 + len > lo)
+			return 0;
+		hi = lo - gap - 2;
+		lo = hi - len;
+	}
+
+	if (ecn) {
+		for (i = 0; i < 3; i++)
+			if (!dec_varint(&gap, pos, end))
+				return 0;
+	}
+
+	if (level == LVL_APP && c->sent) {
+		if ((int64_t)largest > c->largest_acked) {
+			c->largest_acked = largest;
+			c->rto_expire = 0;
+		}
+		/* packet threshold loss detection */
+		if (c->largest_acked >= 3)
+			bulk_lose(c, c->largest_acked - 3);
+		bulk_update_una(c);
+	}
+	return 1;
+}
+
+/* handles CRYPTO data received at <level> */
+static int crypto_rx(struct conn *c, int level, uint64_t off, const unsigned char *data,
+                     uint64_t len)
+{
+	struct crypto_buf *cb = &c->crypto[level];
+	int ret;
+
+	/* only the data in order are processed, the server sends the other
+	 * ones again.
+	 */
+	if (off > cb->rx_off || off + len <= cb->rx_off)
+		return 1;
+
+	data += cb->rx_off - off;
+	len -= cb->rx_off - off;
+	if (SSL_provide_quic_data(c->ssl, level, data, len) != 1)
+		return 0;
+	cb->rx_off += len;
+
+	if (c->state != CS_HANDSHAKE)
+		return SSL_process_quic_post_handshake(c->ssl) == 1;
+
+	ret = SSL_do_handshake(c->ssl);
+	if (ret == 1) {
+		st_handshakes++;
+		c->state = c->to_send ? CS_BULK : CS_DONE;
+		c->pto_count = 0;
+		dolog("fd %d: handshake complete in %llu us\n", c->fd,
+		      (unsigned long long)(now_us() - c->start));
+		return 1;
+	}
+	ret = SSL_get_error(c->ssl, ret);
+	return ret == SSL_ERROR_WANT_READ || ret == SSL_ERROR_WANT_WRITE;
+}
+
+/* parses the <len> bytes of frames at <pos> received at <level>. Returns 1 if
+ * the packet is ack-eliciting, 0 if not, -1 on error.
+ */
+static int parse_frames(struct conn *c, int level, const unsigned char *pos, size_t len)
+{
+	const unsigned char *end = pos + len;
+	uint64_t type, a, b, l;
+	int eliciting = 0;
+
+	while (pos < end) {
+		if (!dec_varint(&type, &pos, end))
+			return -1;
+
+		if (type != 0x00 && type != 0x02 && type != 0x03 && type != 0x1c && type != 0x1d)
+			eliciting = 1;
+
+		switch (type) {
+		case 0x00: /* PADDING */
+		case 0x01: /* PING */
+		case 0x1e: /* HANDSHAKE_DONE */
+			if (type == 0x1e)
+				c->hs_discarded = 1;
+			break;
+		case 0x02: /* ACK */
+		case 0x03:
+			if (!parse_ack(c, level, type == 0x03, &pos, end))
+				return -1;
+			break;
+		case 0x06: /* CRYPTO */
+			if (!dec_varint(&a, &pos, end) || !dec_varint(&l, &pos, end) || end - pos < l)
+				return -1;
+			if (!crypto_rx(c, level, a, pos, l))
+				return -1;
+			pos += l;
+			break;
+		case 0x07: /* NEW_TOKEN */
+			if (!dec_varint(&l, &pos, end) || end - pos < l)
+				return -1;
+			pos += l;
+			break;
+		case 0x08 ... 0x0f: /* STREAM */
+			if (!dec_varint(&a, &pos, end) ||
+			    ((type & 0x04) && !dec_varint(&b, &pos, end)))
+				return -1;
+			if (type & 0x02) {
+				if (!dec_varint(&l, &pos, end) || end - pos < l)
+					return -1;
+			}
+			else
+				l = end - pos;
+			pos += l;
+			break;
+		case 0x04: /* RESET_STREAM */
+			if (!dec_varint(&a, &pos, end) || !dec_varint(&a, &pos, end))
+				return -1;
+			/* fall through */
+		case 0x05: /* STOP_SENDING */
+		case 0x11: /* MAX_STREAM_DATA */
+		case 0x15: /* STREAM_DATA_BLOCKED */
+			if (!dec_varint(&a, &pos, end))
+				return -1;
+			/* fall through */
+		case 0x10: /* MAX_DATA */
+		case 0x12: /* MAX_STREAMS */
+		case 0x13:
+		case 0x14: /* DATA_BLOCKED */
+		case 0x16: /* STREAMS_BLOCKED */
+		case 0x17:
+		case 0x19: /* RETIRE_CONNECTION_ID */
+			if (!dec_varint(&a, &pos, end))
+				return -1;
+			break;
+		case 0x18: /* NEW_CONNECTION_ID */
+			if (!dec_varint(&a, &pos, end) || !dec_varint(&b, &pos, end) ||
+			    pos >= end || end - pos < 1 + *pos + 16)
+				return -1;
+			pos += 1 + *pos + 16;
+			break;
+		case 0x1a: /* PATH_CHALLENGE */
+		case 0x1b: /* PATH_RESPONSE */
+			if (end - pos < 8)
+				return -1;
+			pos += 8;
+			break;
+		case 0x1c: /* CONNECTION_CLOSE */
+		case 0x1d:
+			if (!dec_varint(&a, &pos, end) ||
+			    (type == 0x1c && !dec_varint(&b, &pos, end)) ||
+			    !dec_varint(&l, &pos, end) || end - pos < l)
+				return -1;
+			dolog("fd %d: closed by the server with error 0x%llx\n", c->fd,
+			      (unsigned long long)a);
+			if (c->state != CS_DONE)
+				c->state = CS_FAILED;
+			return 0;
+		default:
+			return -1;
+		}
+	}
+	return eliciting;
+}
+
+/* processes the datagram of <len> bytes at <buf> */
+static void conn_rx_dgram(struct conn *c, unsigned char *buf, size_t len)
+{
+	unsigned char *pos = buf, *end = buf + len;
+
+	while (pos < end && c->state < CS_DONE) {
+		unsigned char *pkt = pos, *pkt_end;
+		struct pktns *pns;
+		size_t pn_off, poff;
+		uint64_t pn, l;
+		ssize_t plen;
+		int level, ret;
+
+		if (*pkt & 0x80) {
+			const unsigned char *p = pkt + 5;
+			const unsigned char *scid;
+			int type = (*pkt >> 4) & 0x03;
+			int scid_len;
+
+			if (end - pkt < 7 || !(pkt[1] | pkt[2] | pkt[3] | pkt[4])) {
+				/* version negotiation */
+				c->state = CS_FAILED;
+				return;
+			}
+			if (p[0] > 20 || end - p < 1 + p[0] + 1)
+				return;
+			p += 1 + p[0];
+			scid_len = *p++;
+			if (scid_len > 20 || end - p < scid_len)
+				return;
+			scid = p;
+			p += scid_len;
+
+			if (type == PKT_RETRY) {
+				conn_retry(c, scid, scid_len, p, end - p);
+				return;
+			}
+			if (type == PKT_INITIAL) {
+				if (!dec_varint(&l, &p, end) || end - p < l)
+					return;
+				p += l;
+			}
+			if (!dec_varint(&l, &p, end) || end - p < l)
+				return;
+			pn_off = p - pkt;
+			pkt_end = (unsigned char *)p + l;
+			level = type == PKT_INITIAL ? LVL_INITIAL : type == PKT_HANDSHAKE ? LVL_HANDSHAKE : -1;
+			if ((level == LVL_INITIAL && c->init_discarded) ||
+			    (level == LVL_HANDSHAKE && c->hs_discarded))
+				level = -1;
+
+			if (level == LVL_INITIAL && !c->got_scid) {
+				memcpy(c->dcid, scid, scid_len);
+				c->dcid_len = scid_len;
+				c->got_scid = 1;
+			}
+		}
+		else {
+			pn_off = 1 + CID_LEN;
+			pkt_end = end;
+			level = LVL_APP;
+		}
+
+		pos = pkt_end;
+		if (level < 0 || !c->rx[level].set)
+			continue;
+
+		pns = &c->pns[level_pns(level)];
+		plen = unprotect_pkt(&c->rx[level], pkt, pkt_end, pn_off, pns->rx_largest, &pn, &poff);
+		if (plen < 0)
+			continue;
+
+		ret = parse_frames(c, level, pkt + poff, plen);
+		if (ret < 0) {
+			dolog("fd %d: invalid frames at level %d\n", c->fd, level);
+			c->state = CS_FAILED;
+			return;
+		}
+
+		if ((int64_t)pn == pns->rx_largest + 1)
+			pns->rx_largest = pn;
+		else if ((int64_t)pn > pns->rx_largest)
+			pns->rx_largest = pns->rx_contig = pn;
+		if (pns->rx_contig < 0)
+			pns->rx_contig = pn;
+		if (ret > 0)
+			pns->ack_needed = 1;
+		c->last_rx = now_us();
+	}
+}
+
+/* builds a packet at <level> into <buf>, which has <room> bytes available,
+ * containing an ACK frame if needed, then CRYPTO then STREAM data, padded to
+ * <min> bytes. A PING is sent if <ping> is set and nothing else is. Returns
+ * the length of the protected packet, or 0 if there is nothing to send.
+ */
+static size_t build_pkt(struct conn *c, int level, unsigned char *buf, size_t room,
+                        size_t min, int ping)
+{
+	struct pktns *pns = &c->pns[level_pns(level)];
+	struct crypto_buf *cb = &c->crypto[level];
+	unsigned char *pos = buf, *end, *len_pos = NULL, *payload;
+	struct sent_pkt *sp = NULL;
+	size_t pn_off, len;
+	int eliciting = 0;
+
+	if (room < 64 + TAG_LEN)
+		return 0;
+	end = buf + room - TAG_LEN;
+
+	/* header */
+	if (level == LVL_APP) {
+		*pos++ = 0x40 | (PN_LEN - 1);
+		memcpy(pos, c->dcid, c->dcid_len);
+		pos += c->dcid_len;
+	}
+	else {
+		*pos++ = 0xc0 | ((level == LVL_INITIAL ? PKT_INITIAL : PKT_HANDSHAKE) << 4) | (PN_LEN - 1);
+		pos = write_u32(pos, QUIC_VERSION);
+		*pos++ = c->dcid_len;
+		memcpy(pos, c->dcid, c->dcid_len);
+		pos += c->dcid_len;
+		*pos++ = CID_LEN;
+		memcpy(pos, c->scid, CID_LEN);
+		pos += CID_LEN;
+		if (level == LVL_INITIAL) {
+			pos = enc_varint(pos, c->token_len);
+			memcpy(pos, c->token, c->token_len);
+			pos += c->token_len;
+		}
+		/* 2-byte length, set below */
+		len_pos = pos;
+		pos += 2;
+	}
+	pn_off = pos - buf;
+	pos = write_u32(pos, pns->next_pn);
+	payload = pos;
+
+	if (pns->ack_needed && pns->rx_largest >= 0) {
+		*pos++ = 0x02;
+		pos = enc_varint(pos, pns->rx_largest);
+		pos = enc_varint(pos, 0);
+		pos = enc_varint(pos, 0);
+		pos = enc_varint(pos, pns->rx_largest - pns->rx_contig);
+	}
+
+	if (cb->sent < cb->len && end - pos > 16) {
+		size_t max = end - pos - 1 - 8 - 2;
+
+		len = cb->len - cb->sent;
+		if (len > max)
+			len = max;
+		*pos++ = 0x06;
+		pos = enc_varint(pos, cb->sent);
+		pos = enc_varint(pos, len);
+		memcpy(pos, cb->data + cb->sent, len);
+		pos += len;
+		cb->sent += len;
+		eliciting = 1;
+	}
+
+	if (level == LVL_APP && c->state == CS_BULK && c->inflight < window &&
+	    c->lost_nb < SENT_RING && end - pos > 32) {
+		uint64_t off;
+		size_t max = end - pos - 1 - 1 - 8 - 2;
+
+		if (c->lost_nb) {
+			struct range *r = &c->lost[c->lost_nb - 1];
+
+			off = r->off;
+			len = r->len < max ? r->len : max;
+			r->off += len;
+			r->len -= len;
+			if (!r->len)
+				c->lost_nb--;
+		}
+		else {
+			off = c->snd_off;
+			len = c->to_send - off < max ? c->to_send - off : max;
+			c->snd_off += len;
+		}
+
+		if (len) {
+			*pos++ = 0x08 | 0x04 | 0x02 | (off + len == c->to_send ? 0x01 : 0);
+			pos = enc_varint(pos, 0);
+			pos = enc_varint(pos, off);
+			pos = enc_varint(pos, len);
+			memcpy(pos, zeroes, len);
+			pos += len;
+			sp = &c->sent[pns->next_pn & (SENT_RING - 1)];
+			if (sp->inflight) {
+				/* the ring is full, this one is considered lost */
+				c->una = sp->pn;
+				bulk_lose(c, sp->pn);
+			}
+			sp->pn = pns->next_pn;
+			sp->off = off;
+			sp->len = len;
+			sp->inflight = 1;
+			c->inflight++;
+			eliciting = 1;
+		}
+	}
+
+	if (!eliciting && ping) {
+		*pos++ = 0x01;
+		eliciting = 1;
+	}
+
+	if (pos == payload)
+		return 0;
+
+	/* the sample needs 4 bytes after the packet number field */
+	while (pos - payload < 4 || pos - buf + TAG_LEN < min)
+		*pos++ = 0x00;
+
+	if (len_pos) {
+		len = pos - buf - pn_off + TAG_LEN;
+		len_pos[0] = 0x40 | (len >> 8);
+		len_pos[1] = len;
+	}
+
+	if (pns->ack_needed)
+		pns->ack_needed = 0;
+	len = protect_pkt(&c->tx[level], buf, pos - buf, pn_off, pns->next_pn);
+	if (len)
+		pns->next_pn++;
+	return len;
+}
+
+/* sends the datagrams of connection <c> as long as there is something to send.
+ * Returns the number of datagrams sent.
+ */
+static int conn_send(struct conn *c)
+{
+	unsigned char buf[MAX_DGRAM_SZ + TAG_LEN];
+	int level, ret, nb = 0, ping;
+
+	while (c->state < CS_DONE) {
+		size_t len = 0, plen;
+
+		ping = c->pto_expire && now_us() >= c->pto_expire;
+		c->pto_expire = 0;
+		for (level = LVL_INITIAL; level < LVL_MAX; level++) {
+			if (level == LVL_EARLY || !c->tx[level].set ||
+			    (level == LVL_INITIAL && c->init_discarded) ||
+			    (level == LVL_HANDSHAKE && c->hs_discarded))
+				continue;
+
+			/* Initial packets are sent alone in padded datagrams */
+			if (level == LVL_INITIAL) {
+				len = build_pkt(c, level, buf, dgram_sz, MIN_INITIAL_SZ, ping);
+				if (len)
+					break;
+				continue;
+			}
+
+			plen = build_pkt(c, level, buf + len, dgram_sz - len, 0,
+			                 ping && level == (c->state == CS_HANDSHAKE ? LVL_HANDSHAKE : LVL_APP));
+			len += plen;
+			/* the client discards its Initial keys when it first
+			 * sends a Handshake packet.
+			 */
+			if (plen && level == LVL_HANDSHAKE)
+				c->init_discarded = 1;
+		}
+
+		if (!len)
+			break;
+
+		ret = send(c->fd, buf, len, 0);
+		if (ret < 0) {
+			/* the data will be sent again after a timeout */
+			break;
+		}
+		st_dgrams_out++;
+		nb++;
+		if (c->sent && c->inflight && !c->rto_expire)
+			c->rto_expire = now_us() + 200000;
+	}
+	return nb;
+}
+
+/* receives and processes all the datagrams pending on connection <c> */
+static void conn_recv(struct conn *c)
+{
+	unsigned char buf[65536];
+	ssize_t ret;
+
+	while (c->state < CS_DONE) {
+		ret = recv(c->fd, buf, sizeof(buf), 0);
+		if (ret <= 0)
+			break;
+		st_dgrams_in++;
+		conn_rx_dgram(c, buf, ret);
+	}
+}
+
+/* handles the timers of connection <c> at <now> */
+static void conn_timers(struct conn *c, uint64_t now)
+{
+	uint64_t pto = 300000ULL << c->pto_count;
+	int i;
+
+	if (c->state == CS_HANDSHAKE && now - c->last_rx >= pto) {
+		if (++c->pto_count > MAX_PTO) {
+			dolog("fd %d: handshake timeout\n", c->fd);
+			c->state = CS_FAILED;
+			return;
+		}
+		/* all the CRYPTO data are sent again */
+		for (i = 0; i < LVL_MAX; i++)
+			c->crypto[i].sent = 0;
+		c->last_rx = now;
+		c->pto_expire = now;
+	}
+
+	if (c->state == CS_BULK && c->rto_expire && now >= c->rto_expire) {
+		/* nothing was acknowledged for too long */
+		bulk_lose(c, c->pns[PNS_APP].next_pn - 1);
+		bulk_update_una(c);
+		c->rto_expire = 0;
+		c->pto_expire = now;
+	}
+
+	if (c->state == CS_BULK && c->acked >= c->to_send)
+		c->state = CS_DONE;
+}
+
+/* closes connection <c> with a CONNECTION_CLOSE frame if it is done */
+static void conn_close(struct conn *c)
+{
+	unsigned char buf[MAX_DGRAM_SZ + TAG_LEN], *pos = buf;
+	struct pktns *pns = &c->pns[PNS_APP];
+	size_t len;
+
+	if (c->state != CS_DONE || !c->tx[LVL_APP].set)
+		return;
+
+	*pos++ = 0x40 | (PN_LEN - 1);
+	memcpy(pos, c->dcid, c->dcid_len);
+	pos += c->dcid_len;
+	pos = write_u32(pos, pns->next_pn);
+	*pos++ = 0x1c;
+	*pos++ = 0x00; /* NO_ERROR */
+	*pos++ = 0x00;
+	*pos++ = 0x00;
+	len = protect_pkt(&c->tx[LVL_APP], buf, pos - buf, 1 + c->dcid_len, pns->next_pn);
+	if (len && send(c->fd, buf, len, 0) > 0)
+		st_dgrams_out++;
+}
+
+static void report(double elapsed, double prev_elapsed, uint64_t prev_hs, uint64_t prev_bytes)
+{
+	double itv = elapsed - prev_elapsed;
+
+	printf("%8.3f conns=%u hs=%llu hs/s=%.0f failed=%llu Gbps=%.3f lost=%llu\n",
+	       elapsed, nb_active, (unsigned long long)st_handshakes,
+	       itv > 0 ? (st_handshakes - prev_hs) / itv : 0,
+	       (unsigned long long)st_failed,
+	       itv > 0 ? (st_bytes - prev_bytes) * 8 / itv / 1e9 : 0,
+	       (unsigned long long)st_lost);
+	fflush(stdout);
+}
+
+int main(int argc, char **argv)
+{
+	struct epoll_event evs[256];
+	struct addrinfo hints, *res;
+	uint64_t start, now, next_report, next_timers;
+	double cpu_cli0, cpu_srv0, cpu_cli, cpu_srv, elapsed, gbytes, prev_elapsed = 0;
+	uint64_t prev_hs = 0, prev_bytes = 0;
+	char *host, *port;
+	int opt, nbev, i;
+	unsigned int j;
+
+	while ((opt = getopt(argc, argv, "n:c:r:b:d:m:w:i:a:s:p:vh")) != -1) {
+		switch (opt) {
+		case 'n': max_conns = atoi(optarg); break;
+		case 'c': concurrency = atoi(optarg); break;
+		case 'r': rate = atoi(optarg); break;
+		case 'b': bulk_size = parse_size(optarg); break;
+		case 'd': duration = atoi(optarg); break;
+		case 'm': dgram_sz = atoi(optarg); break;
+		case 'w': window = atoi(optarg); break;
+		case 'i': report_itv = atoi(optarg); break;
+		case 'a': alpn = optarg; break;
+		case 's': sni = optarg; break;
+		case 'p': server_pid = atoi(optarg); break;
+		case 'v': verbose++; break;
+		default: usage(opt == 'h' ? 0 : 1, argv[0]);
+		}
+	}
+
+	if (optind != argc - 1)
+		usage(1, argv[0]);
+	if (!concurrency || dgram_sz < MIN_INITIAL_SZ || dgram_sz > MAX_DGRAM_SZ ||
+	    !window || window > SENT_RING / 2 || strlen(alpn) > 255)
+		die(1, "invalid settings\n");
+
+	host = strdup(argv[optind]);
+	port = strrchr(host, ':');
+	if (!port)
+		usage(1, argv[0]);
+	*port++ = 0;
+	if (*host == '[' && host[strlen(host) - 1] == ']') {
+		host[strlen(host) - 1] = 0;
+		host++;
+	}
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_DGRAM;
+	if (getaddrinfo(host, port, &hints, &res) != 0)
+		die(1, "cannot resolve '%s'\n", argv[optind]);
+	memcpy(&srv_addr, res->ai_addr, res->ai_addrlen);
+	srv_addr_len = res->ai_addrlen;
+	freeaddrinfo(res);
+
+	ssl_ctx = SSL_CTX_new(TLS_client_method());
+	if (!ssl_ctx ||
+	    !SSL_CTX_set_min_proto_version(ssl_ctx, TLS1_3_VERSION) ||
+	    !SSL_CTX_set_max_proto_version(ssl_ctx, TLS1_3_VERSION) ||
+#ifndef OPENSSL_IS_BORINGSSL
+	    !SSL_CTX_set_ciphersuites(ssl_ctx, "TLS_AES_128_GCM_SHA256:TLS_AES_256_GCM_SHA384") ||
+#endif
+	    !SSL_CTX_set_quic_method(ssl_ctx, &quic_method))
+		die(1, "cannot initialize the TLS context\n");
+	SSL_CTX_set_verify(ssl_ctx, SSL_VERIFY_NONE, NULL);
+
+	epfd = epoll_create(1);
+	conns = calloc(concurrency, sizeof(*conns));
+	if (epfd < 0 || !conns)
+		die(1, "out of memory\n");
+
+	cpu_cli0 = cpu_time(0);
+	cpu_srv0 = server_pid ? cpu_time(server_pid) : -1;
+	start = now = now_us();
+	next_report = start + report_itv * 1000000ULL;
+	next_timers = start;
+
+	while (1) {
+		now = now_us();
+		elapsed = (now - start) / 1e6;
+		if (duration && elapsed >= duration)
+			break;
+		if (max_conns && st_done + st_failed >= max_conns && !nb_active)
+			break;
+
+		/* start the new connections within the rate limit */
+		while (nb_active < concurrency && (!max_conns || st_started < max_conns) &&
+		       (!rate || st_started < (uint64_t)(rate * elapsed) + 1)) {
+			struct conn *c = conn_new();
+
+			if (!c) {
+				st_started++;
+				st_failed++;
+				continue;
+			}
+			for (j = 0; conns[j]; j++)
+				;
+			conns[j] = c;
+			nb_active++;
+		}
+
+		nbev = epoll_wait(epfd, evs, sizeof(evs) / sizeof(evs[0]), 1);
+		for (i = 0; i < nbev; i++) {
+			struct conn *c = evs[i].data.ptr;
+
+			conn_recv(c);
+			conn_send(c);
+		}
+
+		now = now_us();
+		if (now >= next_timers) {
+			next_timers = now + 10000;
+			for (j = 0; j < concurrency; j++) {
+				struct conn *c = conns[j];
+
+				if (!c)
+					continue;
+				conn_timers(c, now);
+				conn_send(c);
+			}
+		}
+
+		/* release the finished connections */
+		for (j = 0; j < concurrency; j++) {
+			struct conn *c = conns[j];
+
+			if (!c || c->state < CS_DONE)
+				continue;
+			if (c->state == CS_DONE) {
+				conn_close(c);
+				st_done++;
+			}
+			else
+				st_failed++;
+			conn_free(c);
+			conns[j] = NULL;
+			nb_active--;
+		}
+
+		if (report_itv && now >= next_report) {
+			report(elapsed, prev_elapsed, prev_hs, prev_bytes);
+			prev_elapsed = elapsed;
+			prev_hs = st_handshakes;
+			prev_bytes = st_bytes;
+			next_report += report_itv * 1000000ULL;
+		}
+	}
+
+	elapsed = (now_us() - start) / 1e6;
+	cpu_cli = cpu_time(0) - cpu_cli0;
+	cpu_srv = cpu_srv0 >= 0 ? cpu_time(server_pid) - cpu_srv0 : -1;
+	gbytes = st_bytes / 1e9;
+
+	printf("\nconnections: %llu started, %llu done, %llu failed, %llu retried\n",
+	       (unsigned long long)st_started, (unsigned long long)st_done,
+	       (unsigned long long)st_failed, (unsigned long long)st_retries);
+	printf("handshakes: %llu in %.3f s: %.1f hs/s\n",
+	       (unsigned long long)st_handshakes, elapsed, st_handshakes / elapsed);
+	printf("stream data: %llu bytes acked: %.3f Gbps, %llu packets lost\n",
+	       (unsigned long long)st_bytes, st_bytes * 8 / elapsed / 1e9,
+	       (unsigned long long)st_lost);
+	printf("datagrams: %llu sent, %llu received\n",
+	       (unsigned long long)st_dgrams_out, (unsigned long long)st_dgrams_in);
+	printf("client CPU: %.3f s", cpu_cli);
+	if (gbytes > 0)
+		printf(" (%.3f s/GB)", cpu_cli / gbytes);
+	if (st_handshakes)
+		printf(" (%.1f us/hs)", cpu_cli * 1e6 / st_handshakes);
+	printf("\n");
+	if (cpu_srv >= 0) {
+		printf("server CPU: %.3f s", cpu_srv);
+		if (gbytes > 0)
+			printf(" (%.3f s/GB)", cpu_srv / gbytes);
+		if (st_handshakes)
+			printf(" (%.1f us/hs)", cpu_srv * 1e6 / st_handshakes);
+		printf("\n");
+	}
+
+	for (j = 0; j < concurrency; j++)
+		if (conns[j])
+			conn_free(conns[j]);
+	SSL_CTX_free(ssl_ctx);
+	return st_failed ? 2 : 0;
+}
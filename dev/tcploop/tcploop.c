@@ -47,6 +47,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 #include <time.h>
 #include <unistd.h>
 
@@ -73,6 +74,16 @@ static int showtime;
 static int verbose;
 static int pid;
 
+/* statistics reported on exit when "-s" is set */
+#define LAT_BUCKETS 256
+static int show_stats;
+static struct timespec stats_start;      /* process start date */
+static struct timespec loop_start;       /* start of the current loop */
+static unsigned long long bytes_in, bytes_out;
+static unsigned long long lat_sum, lat_min, lat_max; /* loop latencies in us */
+static unsigned int lat_hist[LAT_BUCKETS];
+static unsigned int loops;
+
 
 /* display the message and exit with the code */
 __attribute__((noreturn)) void die(int code, const char *format, ...)
@@ -96,6 +107,7 @@ __attribute__((noreturn)) void usage(int code, const char *arg0)
 	    "options :\n"
 	    "  -v           : verbose\n"
 	    "  -t|-tt|-ttt  : show time (msec / relative / absolute)\n"
+	    "  -s           : report statistics on stdout when leaving\n"
 	    "actions :\n"
 	    "  L[<backlog>] : Listens to ip:port and optionally sets backlog\n"
 	    "                 Note: fd=socket,bind(fd),listen(fd)\n"
@@ -104,7 +116,8 @@ __attribute__((noreturn)) void usage(int code, const char *arg0)
 	    "  D            : Disconnect (connect to AF_UNSPEC)\n"
 	    "  A[<count>]   : Accepts <count> incoming sockets and closes count-1\n"
 	    "                 Note: fd=accept(fd)\n"
-	    "  J            : Jump back to oldest post-fork/post-accept action\n"
+	    "  J[<count>]   : Jump back to oldest post-fork/post-accept action, at most\n"
+	    "                 <count> times if set. Each J ends a loop for the stats.\n"
 	    "  K            : kill the connection and go on with next operation\n"
 	    "  G            : disable lingering\n"
 	    "  T            : set TCP_NODELAY\n"
@@ -112,6 +125,7 @@ __attribute__((noreturn)) void usage(int code, const char *arg0)
 	    "  R[<size>]    : Read this amount of bytes. 0=infinite. unset=any amount.\n"
 	    "  S[<size>]    : Send this amount of bytes. 0=infinite. unset=any amount.\n"
 	    "  S:<string>   : Send this exact string. \\r, \\n, \\t, \\\\ supported.\n"
+	    "  H            : Read one HTTP/1 response (content-length or no body)\n"
 	    "  E[<size>]    : Echo this amount of bytes. 0=infinite. unset=any amount.\n"
 	    "  W[<time>]    : Wait for any event on the socket, maximum <time> ms\n"
 	    "  P[<time>]    : Pause for <time> ms (100 by default)\n"
@@ -139,6 +153,9 @@ __attribute__((noreturn)) void usage(int code, const char *arg0)
 	    "Example TCP client with pauses at each step :\n"
 	    "   tcploop 8001 C T W P100 S10 O P100 R S10 O R G K\n"
 	    "\n"
+	    "Example HTTP keep-alive client sending 1000 requests with statistics :\n"
+	    "   tcploop -s 8001 C T S:\"GET / HTTP/1.1\\r\\nHost: a\\r\\n\\r\\n\" H J999\n"
+	    "\n"
 	    "Simple chargen server :\n"
 	    "   tcploop 8001 L A Xo cat /dev/zero\n"
 	    "\n"
@@ -193,6 +210,85 @@ void dolog(const char *format, ...)
 	va_end(args);
 }
 
+/* returns the number of microseconds elapsed since <from> */
+static unsigned long long us_since(const struct timespec *from)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - from->tv_sec) * 1000000ULL + (now.tv_nsec - from->tv_nsec) / 1000;
+}
+
+/* returns the histogram bucket of latency <us>. Values below 16 have their
+ * own bucket, larger ones are spread over 8 buckets per power of two, which
+ * gives a precision better than 12.5%.
+ */
+static int lat_bucket(unsigned long long us)
+{
+	int e, b;
+
+	if (us < 16)
+		return us;
+	e = 63 - __builtin_clzll(us);
+	b = 16 + (e - 4) * 8 + ((us >> (e - 3)) & 7);
+	return b < LAT_BUCKETS ? b : LAT_BUCKETS - 1;
+}
+
+/* returns the highest latency accounted for in bucket <b> */
+static unsigned long long lat_bucket_max(int b)
+{
+	int e;
+
+	if (b < 16)
+		return b;
+	e = (b - 16) / 8 + 4;
+	return ((8ULL + (b - 16) % 8 + 1) << (e - 3)) - 1;
+}
+
+/* returns the lowest latency covering <pct> percent of the loops */
+static unsigned long long lat_percentile(int pct)
+{
+	unsigned long long want = ((unsigned long long)loops * pct + 99) / 100;
+	unsigned long long seen = 0;
+	int b;
+
+	for (b = 0; b < LAT_BUCKETS; b++) {
+		seen += lat_hist[b];
+		if (seen >= want)
+			break;
+	}
+	return b < LAT_BUCKETS ? lat_bucket_max(b) : lat_max;
+}
+
+/* ends the current loop, accounts for its latency and starts a new one */
+static void loop_done(void)
+{
+	unsigned long long lat = us_since(&loop_start);
+
+	clock_gettime(CLOCK_MONOTONIC, &loop_start);
+	if (!loops || lat < lat_min)
+		lat_min = lat;
+	if (lat > lat_max)
+		lat_max = lat;
+	lat_sum += lat;
+	lat_hist[lat_bucket(lat)]++;
+	loops++;
+}
+
+/* reports the statistics on stdout as a single line of "name=value" fields,
+ * which is meant to be easily parsed by scripts. Registered with atexit().
+ */
+static void dump_stats(void)
+{
+	printf("pid=%d loops=%u time_us=%llu bytes_in=%llu bytes_out=%llu "
+	       "lat_min_us=%llu lat_avg_us=%llu lat_p50_us=%llu lat_p99_us=%llu lat_max_us=%llu\n",
+	       pid, loops, us_since(&stats_start), bytes_in, bytes_out,
+	       lat_min, loops ? lat_sum / loops : 0,
+	       loops ? lat_percentile(50) : 0, loops ? lat_percentile(99) : 0,
+	       lat_max);
+	fflush(stdout);
+}
+
 /* convert '\n', '\t', '\r', '\\' to their respective characters */
 int unescape(char *out, int size, const char *in)
 {
@@ -487,6 +583,7 @@ int tcp_recv(int sock, const char *arg)
 		if (!ret)
 			break;
 
+		bytes_in += ret;
 		if (!count)
 			continue;
 		else if (count > 0)
@@ -537,6 +634,7 @@ int tcp_send(int sock, const char *arg)
 			continue;
 		}
 		dolog("send %d\n", ret);
+		bytes_out += ret;
 		if (!count)
 			continue;
 		else if (count > 0)
@@ -549,6 +647,81 @@ int tcp_send(int sock, const char *arg)
 	return 0;
 }
 
+/* receives one HTTP/1 response and returns 0 (or -1 in case of a recv error
+ * or premature close, or -2 if the headers do not fit into the trash). The
+ * body length is taken from the content-length header, and no body is
+ * expected if it is missing. Chunked encoding is not supported. This is meant
+ * to be used by clients which wait for the response before sending the next
+ * request, so no data is expected past the response.
+ */
+int tcp_recv_http(int sock, const char *arg)
+{
+	long long body = -1; // unknown until the headers are complete
+	char *p, *eoh;
+	int len = 0;
+	int ret;
+
+	while (1) {
+		ret = recv(sock, trash + len, sizeof(trash) - len, MSG_NOSIGNAL);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			if (errno != EAGAIN) {
+				dolog("recv %d\n", ret);
+				return -1;
+			}
+			while (!wait_on_fd(sock, POLLIN));
+			continue;
+		}
+		dolog("recv %d\n", ret);
+		if (!ret)
+			return -1;
+
+		bytes_in += ret;
+		if (body >= 0) {
+			/* headers already parsed, only count the body */
+			body -= ret;
+			if (body <= 0)
+				break;
+			continue;
+		}
+
+		/* look for the end of headers, possibly across two reads */
+		p = trash + (len > 3 ? len - 3 : 0);
+		len += ret;
+		for (eoh = NULL; p + 4 <= trash + len; p++) {
+			if (memcmp(p, "\r\n\r\n", 4) == 0) {
+				eoh = p + 4;
+				break;
+			}
+		}
+
+		if (!eoh) {
+			if (len == sizeof(trash))
+				return -2;
+			continue;
+		}
+
+		body = 0;
+		for (p = trash; p + 15 < eoh; p++) {
+			if ((p == trash || p[-1] == '\n') &&
+			    strncasecmp(p, "content-length:", 15) == 0) {
+				body = strtoll(p + 15, NULL, 10);
+				break;
+			}
+		}
+
+		body -= trash + len - eoh;
+		if (body <= 0)
+			break;
+
+		/* the body is drained using the whole trash */
+		len = 0;
+	}
+
+	return 0;
+}
+
 /* echoes N bytes to the socket and returns 0 (or -1 in case of error). If not
  * set, echoes only the first block. Zero means forward forever.
  */
@@ -740,6 +913,7 @@ int main(int argc, char **argv)
 	int ret;
 	int sock;
 	int errfd;
+	int jumps = -1;
 
 	arg0 = argv[0];
 
@@ -753,6 +927,8 @@ int main(int argc, char **argv)
 			showtime += 3;
 		else if (strcmp(argv[0], "-v") == 0)
 			verbose ++;
+		else if (strcmp(argv[0], "-s") == 0)
+			show_stats = 1;
 		else if (strcmp(argv[0], "--") == 0)
 			break;
 		else
@@ -769,6 +945,10 @@ int main(int argc, char **argv)
 		die(1, "%s\n", err.msg);
 
 	gettimeofday(&start_time, NULL);
+	clock_gettime(CLOCK_MONOTONIC, &stats_start);
+	loop_start = stats_start;
+	if (show_stats)
+		atexit(dump_stats);
 
 	sock = -1;
 	loop_arg = 2;
@@ -851,6 +1031,17 @@ int main(int argc, char **argv)
 			}
 			break;
 
+		case 'H':
+			if (sock < 0)
+				die(1, "Fatal: tcp_recv_http() on non-socket.\n");
+			ret = tcp_recv_http(sock, argv[arg]);
+			if (ret < 0) {
+				if (ret == -1) // usually ECONNRESET, silently exit
+					die(0, NULL);
+				die(1, "Fatal: tcp_recv_http() failed.\n");
+			}
+			break;
+
 		case 'E':
 			if (sock < 0)
 				die(1, "Fatal: tcp_echo() on non-socket.\n");
@@ -922,7 +1113,14 @@ int main(int argc, char **argv)
 			loop_arg = arg + 1;
 			break;
 
-		case 'J': // jump back to oldest post-fork action
+		case 'J': // jump back to oldest post-fork action, optionally <count> times
+			loop_done();
+			if (argv[arg][1]) {
+				if (jumps < 0)
+					jumps = atoi(argv[arg] + 1);
+				if (!jumps--)
+					break;
+			}
 			arg = loop_arg - 1;
 			continue;
 
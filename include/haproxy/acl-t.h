@@ -111,6 +111,7 @@ struct acl_expr {
 	struct pattern_head pat;      /* the pattern matching expression */
 	struct list list;             /* chaining */
 	const char *kw;               /* points to the ACL kw's name or fetch's name (must not free) */
+	unsigned int smp_id;          /* sample cache identifier, 0 if not cacheable */
 };
 
 /* The acl will be linked to from the proxy where it is declared */
@@ -145,6 +146,37 @@ struct acl_cond {
 	int line;                   /* line in the config file where the condition is declared */
 };
 
+/* Sizing of the per-stream sample cache used while evaluating a rule set */
+#define ACL_CACHE_ENTRIES   32      /* max number of cached expressions */
+#define ACL_CACHE_VALUES    64      /* max number of cached values */
+#define ACL_CACHE_STORAGE   4096    /* room for the strings of all values */
+
+/* One cached sample expression. Its sequence of values is made of <count>
+ * consecutive entries starting at <first> in the cache's values array.
+ */
+struct acl_cache_ent {
+	unsigned int id;            /* acl_expr's smp_id */
+	unsigned int dir;           /* SMP_OPT_DIR_* the values were fetched for */
+	unsigned short first;       /* index of the first value */
+	unsigned short count;       /* number of values (0 = fetch failed) */
+};
+
+/* Results of the side-effect free sample expressions evaluated so far by the
+ * ACLs of the rule set being processed. It is allocated when a rule set starts
+ * to be evaluated and released once it ends, and any executed action flushes
+ * it since it may have modified the message.
+ */
+struct acl_cache {
+	unsigned int nb_ent;        /* number of committed entries */
+	unsigned int nb_val;        /* number of committed values */
+	unsigned int used;          /* committed bytes in <area> */
+	unsigned int pend_val;      /* values recorded for the pending entry */
+	unsigned int pend_used;     /* bytes used by the pending entry */
+	struct acl_cache_ent ent[ACL_CACHE_ENTRIES];
+	struct sample_data val[ACL_CACHE_VALUES];
+	char area[ACL_CACHE_STORAGE];
+};
+
 #endif /* _HAPROXY_ACL_T_H */
 
 /*
@@ -146,6 +146,14 @@ void acl_unregister_keywords(struct acl_kw_list *kwl);
  */
 int init_acl();
 
+/* Prepares stream <s> for the evaluation of a new rule set, allocating its
+ * sample cache if enabled. acl_cache_flush() must be called after any action
+ * is executed and acl_cache_stop() when the rule set evaluation ends.
+ */
+void acl_cache_start(struct stream *s);
+void acl_cache_flush(struct stream *s);
+void acl_cache_stop(struct stream *s);
+
 void free_acl_cond(struct acl_cond *cond);
 
 #endif /* _HAPROXY_ACL_H */
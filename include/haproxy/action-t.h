@@ -169,6 +169,7 @@ struct act_rule {
 			struct sample_expr *expr;
 			const char *name;
 			enum vars_scope scope;
+			int slot;
 		} vars;
 		struct {
 			int sc;
@@ -179,6 +180,10 @@ struct act_rule {
 			struct sample_expr *expr;
 		} gpt;
 		struct track_ctr_prm trk_ctr;
+		struct {
+			unsigned int *list;       /* normalizers (enum act_normalize_uri) of merged rules */
+			unsigned int nb;          /* number of entries in <list>, 0 = only <action> */
+		} normalize_uri;
 		struct {
 			void *p[4];
 		} act;                         /* generic pointers to be used by custom actions */
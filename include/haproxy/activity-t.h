@@ -34,6 +34,21 @@
 
 #define HA_PROF_MEMORY      0x00000004     /* memory profiling */
 
+/* per-thread histograms of the polling loop, see ACT_HIST_BUCKETS */
+enum act_hist {
+	ACT_HIST_POLL_EV = 0,      // events reported per call to the poller
+	ACT_HIST_POLL_US,          // time spent in the poller, in microseconds
+	ACT_HIST_LOOP_US,          // processing time between two polls, in microseconds
+	ACT_HIST_LOOP_TASKS,       // tasks and tasklets run per loop
+	ACT_HIST_COUNT             // must be last
+};
+
+/* Number of buckets of the polling loop histograms. Bucket 0 counts the zero
+ * values, and bucket N>0 the values from 2^(N-1) to 2^N-1, except the last one
+ * which collects all values of 2^(N-1) and above.
+ */
+#define ACT_HIST_BUCKETS 16
+
 /* per-thread activity reports. It's important that it's aligned on cache lines
  * because some elements will be updated very often. Most counters are OK on
  * 32-bit since this will be used during debugging sessions for troubleshooting
@@ -66,6 +81,15 @@ struct activity {
 	unsigned int accq_full;    // accept queue connection not pushed because full
 	unsigned int pool_fail;    // failed a pool allocation
 	unsigned int buf_wait;     // waited on a buffer allocation
+	unsigned int buf_wait_us;  // total time spent in buffer wait queues (microseconds)
+	struct freq_ctr buf_queued;// buffer wait queue entries over last second
+	unsigned int tasks_given;  // tasks handed over to idle threads (work stealing)
+	unsigned int tasks_stolen; // tasks taken over from overloaded threads (work stealing)
+	unsigned int zc_sent;      // zero-copy send() calls
+	unsigned int zc_copied;    // zero-copy sends that the kernel had to copy
+	unsigned int htx_defrag;   // HTX messages defragmented
+	unsigned int htx_defrag_bytes; // payload bytes moved by HTX defragmentations
+	unsigned int hist[ACT_HIST_COUNT][ACT_HIST_BUCKETS]; // polling loop histograms
 #if defined(DEBUG_DEV)
 	/* keep these ones at the end */
 	unsigned int ctr0;         // general purposee debug counter
@@ -77,16 +101,31 @@ struct activity {
 };
 
 
+/* Number of buckets of the scheduler's latency and CPU time histograms. Each
+ * bucket covers durations 4 times as large as the previous one, the first one
+ * being below ~1 microsecond, and the last one collecting all those above ~1s.
+ */
+#define SCHED_HIST_BUCKETS 12
+
+/* size of the ring collecting the stall reports, and of the per-thread buffer
+ * holding the context captured by the stall sampler.
+ */
+#define STALL_RING_SIZE   262144
+#define STALL_SAMPLE_SIZE 8192
+
 /* global profiling stats from the scheduler: each entry corresponds to a
  * task or tasklet ->process function pointer, with a number of calls and
- * a total time. Each entry is unique, except entry 0 which is for colliding
- * hashes (i.e. others). All of these must be accessed atomically.
+ * a total time, as well as a log-scale distribution of the latency and CPU
+ * time. Each entry is unique, except entry 0 which is for colliding hashes
+ * (i.e. others). All of these must be accessed atomically.
  */
 struct sched_activity {
 	const void *func;
 	uint64_t calls;
 	uint64_t cpu_time;
 	uint64_t lat_time;
+	uint32_t lat_hist[SCHED_HIST_BUCKETS]; /* calls per latency range */
+	uint32_t cpu_hist[SCHED_HIST_BUCKETS]; /* calls per CPU time range */
 };
 
 #endif /* _HAPROXY_ACTIVITY_T_H */
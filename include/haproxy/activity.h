@@ -28,12 +28,48 @@
 #include <haproxy/freq_ctr.h>
 #include <haproxy/time.h>
 
+struct task;
+
 extern unsigned int profiling;
 extern unsigned long task_profiling_mask;
 extern struct activity activity[MAX_THREADS];
 extern struct sched_activity sched_activity[256];
+extern unsigned long long stall_threshold;
 
 void report_stolen_time(uint64_t stolen);
+void sched_sample_stall();
+void sched_report_stall(const struct task *t, const void *process, unsigned long long duration);
+void sched_update_stall_sampler();
+
+#if USE_MEMORY_PROFILING
+void memprof_get_totals(unsigned long long *calls, unsigned long long *bytes);
+#endif
+
+/* returns the bucket of the polling loop histograms value <v> belongs to */
+static inline unsigned int act_hist_bucket(unsigned int v)
+{
+	unsigned int b = v ? my_flsl(v) : 0;
+
+	return b < ACT_HIST_BUCKETS ? b : ACT_HIST_BUCKETS - 1;
+}
+
+/* accounts value <v> in the current thread's polling loop histogram <h> */
+static inline void activity_hist_add(enum act_hist h, unsigned int v)
+{
+	activity[tid].hist[h][act_hist_bucket(v)]++;
+}
+
+/* Accounts the <events> reported by the poller and the time spent in it. Must
+ * be called by the pollers right after tv_leaving_poll().
+ */
+static inline void activity_count_poll(int events)
+{
+	uint32_t poll_time;
+
+	poll_time = (after_poll.tv_sec - before_poll.tv_sec) * 1000000U + (after_poll.tv_usec - before_poll.tv_usec);
+	activity_hist_add(ACT_HIST_POLL_EV, events > 0 ? events : 0);
+	activity_hist_add(ACT_HIST_POLL_US, poll_time);
+}
 
 /* Collect date and time information before calling poll(). This will be used
  * to count the run time of the past loop and the sleep time of the next poll.
@@ -71,6 +107,7 @@ static inline void activity_count_runtime()
 	}
 
 	run_time = (before_poll.tv_sec - after_poll.tv_sec) * 1000000U + (before_poll.tv_usec - after_poll.tv_usec);
+	activity_hist_add(ACT_HIST_LOOP_US, run_time);
 	run_time = swrate_add(&activity[tid].avg_loop_us, TIME_STATS_SAMPLES, run_time);
 
 	/* In automatic mode, reaching the "up" threshold on average switches
@@ -116,6 +153,36 @@ static inline struct sched_activity *sched_activity_entry(struct sched_activity
 	return array;
 }
 
+/* returns the histogram bucket of duration <ns> expressed in nanoseconds */
+static inline unsigned int sched_hist_bucket(uint64_t ns)
+{
+	unsigned int b;
+
+	if (ns >= (1ULL << 30))
+		return SCHED_HIST_BUCKETS - 1;
+
+	ns >>= 10; // ~microseconds
+	if (!ns)
+		return 0;
+
+	b = (my_flsl(ns) + 1) / 2;
+	return b < SCHED_HIST_BUCKETS ? b : SCHED_HIST_BUCKETS - 1;
+}
+
+/* accounts latency <lat> (in ns) to scheduler activity entry <entry> */
+static inline void sched_activity_add_lat(struct sched_activity *entry, uint64_t lat)
+{
+	HA_ATOMIC_ADD(&entry->lat_time, lat);
+	HA_ATOMIC_INC(&entry->lat_hist[sched_hist_bucket(lat)]);
+}
+
+/* accounts CPU time <cpu> (in ns) to scheduler activity entry <entry> */
+static inline void sched_activity_add_cpu(struct sched_activity *entry, uint64_t cpu)
+{
+	HA_ATOMIC_ADD(&entry->cpu_time, cpu);
+	HA_ATOMIC_INC(&entry->cpu_hist[sched_hist_bucket(cpu)]);
+}
+
 #endif /* _HAPROXY_ACTIVITY_H */
 
 /*
@@ -114,9 +114,17 @@ struct appctx {
 			unsigned int rem_data;      /* Remaining bytes for the last data block (HTX only, 0 means process next block) */
 			unsigned int send_notmodified:1;   /* In case of conditional request, we might want to send a "304 Not Modified"
                                                             * response instead of the stored data. */
-			unsigned int unused:31;
+			unsigned int range:1;       /* Only a range of the payload is sent, in a "206 Partial Content" response. */
+			unsigned int unused:30;
+			unsigned int range_start;   /* First byte of the range in the payload. */
+			unsigned int range_len;     /* Length of the range, then remaining bytes once the headers are sent. */
 			struct shared_block *next;  /* The next block of data to be sent for this cache entry. */
 		} cache;
+		struct {
+			struct cache_entry *entry;  /* Entry being refreshed, kept in the hot list. */
+			unsigned int id;            /* Identifier of the refresh in the entry. */
+			int status;                 /* Status code of the response, 0 if none yet. */
+		} cache_refresh;
 		/* all entries below are used by various CLI commands, please
 		 * keep the grouped together and avoid adding new ones.
 		 */
@@ -130,6 +138,8 @@ struct appctx {
 			unsigned int flags;	/* STAT_* */
 			int iid, type, sid;	/* proxy id, type and service id if bounding of stats is enabled */
 			int st_code;		/* the status code returned by an action */
+			unsigned int since;	/* only dump objects active since this date (now.tv_sec), 0=all */
+			void *filter;		/* service-specific filters, owned by the service, or NULL */
 		} stats;
 		struct {
 			struct bref bref;	/* back-reference from the session being dumped */
@@ -151,10 +161,12 @@ struct appctx {
 			void *target;		/* table we want to dump, or NULL for all */
 			struct stktable *t;	/* table being currently dumped (first if NULL) */
 			struct stksess *entry;	/* last entry we were trying to dump (or first if NULL) */
+			unsigned int shard;	/* shard of the table holding <entry> */
 			long long value[STKTABLE_FILTER_LEN];	     /* value to compare against */
 			signed char data_type[STKTABLE_FILTER_LEN];  /* type of data to compare, or -1 if none */
 			signed char data_op[STKTABLE_FILTER_LEN];    /* operator (STD_OP_*) when data_type set */
 			char action;            /* action on the table : one of STK_CLI_ACT_* */
+			char binary;            /* non-zero to dump the entries in the snapshot format */
 		} table;
 		struct {
 			unsigned int display_flags;
@@ -27,6 +27,8 @@
 #include <haproxy/lb_fas-t.h>
 #include <haproxy/lb_fwlc-t.h>
 #include <haproxy/lb_fwrr-t.h>
+#include <haproxy/lb_local-t.h>
+#include <haproxy/lb_maglev-t.h>
 #include <haproxy/lb_map-t.h>
 #include <haproxy/server-t.h>
 #include <haproxy/thread-t.h>
@@ -53,6 +55,7 @@
 #define BE_LB_RR_DYN    0x00000  /* dynamic round robin (default) */
 #define BE_LB_RR_STATIC 0x00001  /* static round robin */
 #define BE_LB_RR_RANDOM 0x00002  /* random round robin */
+#define BE_LB_RR_EWMA   0x00003  /* random draws weighted by peak-EWMA latency */
 
 /* BE_LB_CB_* is used with BE_LB_KIND_CB */
 #define BE_LB_CB_LC     0x00000  /* least-connections */
@@ -81,6 +84,7 @@
 #define BE_LB_ALGO_NONE (BE_LB_KIND_NONE | BE_LB_NEED_NONE)    /* not defined */
 #define BE_LB_ALGO_RR   (BE_LB_KIND_RR | BE_LB_NEED_NONE)      /* round robin */
 #define BE_LB_ALGO_RND  (BE_LB_KIND_RR | BE_LB_NEED_NONE | BE_LB_RR_RANDOM) /* random value */
+#define BE_LB_ALGO_EWMA (BE_LB_KIND_RR | BE_LB_NEED_NONE | BE_LB_RR_EWMA)   /* peak-EWMA of response times */
 #define BE_LB_ALGO_LC   (BE_LB_KIND_CB | BE_LB_NEED_NONE | BE_LB_CB_LC)    /* least connections */
 #define BE_LB_ALGO_FAS  (BE_LB_KIND_CB | BE_LB_NEED_NONE | BE_LB_CB_FAS)   /* first available server */
 #define BE_LB_ALGO_SRR  (BE_LB_KIND_RR | BE_LB_NEED_NONE | BE_LB_RR_STATIC) /* static round robin */
@@ -101,15 +105,18 @@
 #define BE_LB_LKUP_LCTREE 0x30000  /* FWLC tree lookup */
 #define BE_LB_LKUP_CHTREE 0x40000  /* consistent hash  */
 #define BE_LB_LKUP_FSTREE 0x50000  /* FAS tree lookup */
+#define BE_LB_LKUP_MAGLEV 0x60000  /* Maglev table lookup */
 #define BE_LB_LKUP        0x70000  /* mask to get just the LKUP value */
 
 /* additional properties */
 #define BE_LB_PROP_DYN    0x80000 /* bit to indicate a dynamic algorithm */
+#define BE_LB_PROP_LOCAL  0x2000000 /* servers are picked from per-thread views (roundrobin, leastconn) */
 
 /* hash types */
 #define BE_LB_HASH_MAP    0x000000 /* map-based hash (default) */
 #define BE_LB_HASH_CONS   0x100000 /* consistent hashbit to indicate a dynamic algorithm */
-#define BE_LB_HASH_TYPE   0x100000 /* get/clear hash types */
+#define BE_LB_HASH_MAGLEV 0x1000000 /* Maglev consistent hashing */
+#define BE_LB_HASH_TYPE   0x1100000 /* get/clear hash types */
 
 /* additional modifier on top of the hash function (only avalanche right now) */
 #define BE_LB_HMOD_AVAL   0x200000  /* avalanche modifier */
@@ -143,7 +150,9 @@ struct lbprm {
 		struct lb_fwlc fwlc;
 		struct lb_chash chash;
 		struct lb_fas fas;
+		struct lb_maglev maglev;
 	};
+	struct lb_local local;		/* per-thread views when BE_LB_PROP_LOCAL is set */
 	int algo;			/* load balancing algorithm and variants: BE_LB_* */
 	int tot_wact, tot_wbck;		/* total effective weights of active and backup servers */
 	int tot_weight;			/* total effective weight of servers participating to LB */
@@ -30,6 +30,7 @@
 #include <haproxy/time.h>
 
 int assign_server(struct stream *s);
+struct server *assign_server_by_addr(struct proxy *px, const struct sockaddr_storage *src);
 int assign_server_address(struct stream *s);
 int assign_server_and_queue(struct stream *s);
 int connect_server(struct stream *s);
@@ -47,6 +48,7 @@ int tcp_persist_rdp_cookie(struct stream *s, struct channel *req, int an_bit);
 int be_downtime(struct proxy *px);
 void recount_servers(struct proxy *px);
 void update_backend_weight(struct proxy *px);
+void lb_ewma_update(struct server *srv, unsigned int msec);
 int be_lastsession(const struct proxy *be);
 
 /* Returns number of usable servers in backend */
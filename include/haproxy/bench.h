@@ -0,0 +1,42 @@
+/*
+ * include/haproxy/bench.h
+ * Micro-benchmarks of the core data structures - exported functions
+ *
+ * Copyright (C) 2021 HAProxy Technologies
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, version 2.1
+ * exclusively.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _HAPROXY_BENCH_H
+#define _HAPROXY_BENCH_H
+
+/* Minimum duration of each measurement, in nanoseconds */
+#ifndef BENCH_MIN_DURATION
+#define BENCH_MIN_DURATION 200000000ULL
+#endif
+
+/* Maximum number of threads used by the multi-threaded benchmarks */
+#define BENCH_MAX_THREADS 4
+
+int bench_run(const char *list);
+
+#endif /* _HAPROXY_BENCH_H */
+
+/*
+ * Local variables:
+ *  c-indent-level: 8
+ *  c-basic-offset: 8
+ * End:
+ */
@@ -0,0 +1,77 @@
+/*
+ * include/haproxy/bpt32-t.h
+ * This file contains types for the B+trees indexed on 32-bit keys.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, version 2.1
+ * exclusively.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _HAPROXY_BPT32_T_H
+#define _HAPROXY_BPT32_T_H
+
+#include <haproxy/api-t.h>
+
+/* Number of keys per leaf and of children per internal node. It is chosen so
+ * that a node is exactly 256 bytes (4 cache lines) on 64-bit platforms, with
+ * all the keys grouped in the first 80 bytes.
+ */
+#define BPT32_FANOUT    20
+
+/* Maximum depth of a tree. Since nodes are split in halves when full, it is
+ * not reachable with 32-bit keys, but it bounds the insertion path.
+ */
+#define BPT32_MAX_DEPTH 16
+
+/* A node is either a leaf or an internal node, as indicated by the depth in
+ * the root. Leaves hold <nb> sorted keys and their values, and are chained in
+ * key order. Internal nodes hold <nb> children and <nb>-1 separators, where
+ * keys[i] is lower than or equal to all keys under child[i+1] and strictly
+ * greater than all keys under child[i].
+ */
+struct bpt32_node {
+	uint32_t keys[BPT32_FANOUT];
+	unsigned int nb;
+	union {
+		void *val[BPT32_FANOUT];                  /* leaves */
+		struct bpt32_node *child[BPT32_FANOUT];   /* internal nodes */
+	};
+	struct bpt32_node *next;                          /* next leaf or NULL */
+};
+
+/* The root of a tree. It must be initialized with BPT32_ROOT. <depth> is the
+ * number of internal levels above the leaves.
+ */
+struct bpt32_root {
+	struct bpt32_node *node;
+	unsigned int depth;
+	unsigned int count;                               /* number of keys */
+};
+
+#define BPT32_ROOT { .node = NULL, .depth = 0, .count = 0 }
+
+/* A position in a tree, used to walk over it in key order */
+struct bpt32_pos {
+	struct bpt32_node *leaf;
+	unsigned int idx;
+	uint32_t key;                                     /* key at this position */
+};
+
+#endif /* _HAPROXY_BPT32_T_H */
+
+/*
+ * Local variables:
+ *  c-indent-level: 8
+ *  c-basic-offset: 8
+ * End:
+ */
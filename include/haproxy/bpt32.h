@@ -0,0 +1,102 @@
+/*
+ * include/haproxy/bpt32.h
+ * This file contains functions for the B+trees indexed on 32-bit keys.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, version 2.1
+ * exclusively.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _HAPROXY_BPT32_H
+#define _HAPROXY_BPT32_H
+
+#include <haproxy/api.h>
+#include <haproxy/bpt32-t.h>
+
+void *bpt32_insert(struct bpt32_root *root, uint32_t key, void *val);
+void *bpt32_delete(struct bpt32_root *root, uint32_t key);
+void *bpt32_lookup_ge(const struct bpt32_root *root, uint32_t key, struct bpt32_pos *pos);
+void *bpt32_first(const struct bpt32_root *root, struct bpt32_pos *pos);
+void bpt32_purge(struct bpt32_root *root);
+
+/* Returns the index of the child of internal node <node> which may contain
+ * <key>. The separators are all compared, which is branchless and usually
+ * faster than a binary search on such small arrays.
+ */
+static inline unsigned int bpt32_child_idx(const struct bpt32_node *node, uint32_t key)
+{
+	unsigned int i, idx = 0;
+
+	for (i = 0; i < node->nb - 1; i++)
+		idx += node->keys[i] <= key;
+	return idx;
+}
+
+/* Returns the leaf of tree <root> which may contain <key>, or NULL if the tree
+ * is empty.
+ */
+static inline struct bpt32_node *bpt32_find_leaf(const struct bpt32_root *root, uint32_t key)
+{
+	struct bpt32_node *node = root->node;
+	unsigned int depth;
+
+	if (!node)
+		return NULL;
+
+	for (depth = root->depth; depth; depth--)
+		node = node->child[bpt32_child_idx(node, key)];
+	return node;
+}
+
+/* Looks up <key> in tree <root> and returns the associated value, or NULL if
+ * the key is not there.
+ */
+static inline void *bpt32_lookup(const struct bpt32_root *root, uint32_t key)
+{
+	struct bpt32_node *leaf = bpt32_find_leaf(root, key);
+	unsigned int i;
+
+	if (!leaf)
+		return NULL;
+
+	for (i = 0; i < leaf->nb; i++) {
+		if (leaf->keys[i] == key)
+			return leaf->val[i];
+	}
+	return NULL;
+}
+
+/* Returns the value at the position following <pos> and updates <pos>, or
+ * NULL if <pos> was the last one. The tree must not have been modified since
+ * <pos> was set.
+ */
+static inline void *bpt32_next(struct bpt32_pos *pos)
+{
+	if (++pos->idx >= pos->leaf->nb) {
+		pos->leaf = pos->leaf->next;
+		pos->idx = 0;
+		if (!pos->leaf)
+			return NULL;
+	}
+	pos->key = pos->leaf->keys[pos->idx];
+	return pos->leaf->val[pos->idx];
+}
+
+#endif /* _HAPROXY_BPT32_H */
+
+/*
+ * Local variables:
+ *  c-indent-level: 8
+ *  c-basic-offset: 8
+ * End:
+ */
@@ -730,7 +730,7 @@ static inline void __b_put_varint(struct buffer *b, uint64_t v)
 		v = (v - 0xF0) >> 4;
 
 		while (1) {
-			if (tail++ == wrap)
+			if (++tail == wrap)
 				tail -= size;
 			data++;
 			if (v < 0x80)
@@ -765,7 +765,7 @@ static inline int b_put_varint(struct buffer *b, uint64_t v)
 		v = (v - 0xF0) >> 4;
 
 		while (1) {
-			if (tail++ == wrap)
+			if (++tail == wrap)
 				tail -= size;
 			data++;
 			if (data == size || v < 0x80)
@@ -804,7 +804,7 @@ static inline int b_get_varint(struct buffer *b, uint64_t *vptr)
 		v = *head;
 		bits += 4;
 		while (1) {
-			if (head++ == wrap)
+			if (++head == wrap)
 				head -= size;
 			data--;
 			if (!data || !(*head & 0x80))
@@ -846,7 +846,7 @@ static inline int b_peek_varint(struct buffer *b, size_t ofs, uint64_t *vptr)
 		v = *head;
 		bits += 4;
 		while (1) {
-			if (head++ == wrap)
+			if (++head == wrap)
 				head -= size;
 			data--;
 			if (!data || !(*head & 0x80))
@@ -919,6 +919,17 @@ static inline unsigned int br_size(const struct buffer *r)
 	return r->size;
 }
 
+/* Returns the number of buffers in use in the ring, tail included */
+static inline unsigned int br_count(const struct buffer *r)
+{
+	BUG_ON(r->area != BUF_RING.area);
+
+	if (r->data >= r->head)
+		return r->data - r->head + 1;
+	else
+		return r->data + r->size - r->head;
+}
+
 /* Returns true if no more buffers may be added */
 static inline unsigned int br_full(const struct buffer *r)
 {
@@ -1004,6 +1015,36 @@ static inline struct buffer *br_tail_add(struct buffer *r)
 	return b;
 }
 
+/* Inserts a new buffer right after the ring's head and returns it, or NULL if
+ * the ring is full. The buffers following the head are moved one place towards
+ * the tail, so that whatever is written to the new buffer comes before them.
+ * The head buffer itself, which may be partially consumed, is not touched. The
+ * new buffer is initialized to BUF_NULL.
+ */
+static inline struct buffer *br_insert_next(struct buffer *r)
+{
+	unsigned int idx, prev;
+
+	BUG_ON(r->area != BUF_RING.area);
+
+	if (br_full(r))
+		return NULL;
+
+	r->data++;
+	if (r->data >= r->size)
+		r->data = 1;
+
+	for (idx = r->data; ; idx = prev) {
+		prev = idx > 1 ? idx - 1 : r->size - 1;
+		if (prev == r->head)
+			break;
+		r[idx] = r[prev];
+	}
+
+	r[idx] = BUF_NULL;
+	return r + idx;
+}
+
 /* Extracts the ring's head buffer and returns it. The last buffer (tail) is
  * never removed but it is returned. This guarantees that we stop on BUF_WANTED
  * or BUF_EMPTY and that at the end a valid buffer remains present. This is
@@ -78,6 +78,7 @@ struct cfg_section {
 	char *section_name;
 	int (*section_parser)(const char *, int, char **, int);
 	int (*post_section_parser)();
+	uint64_t parse_time;    /* cumulated time spent parsing this section, in ns */
 };
 
 /* store post configuration parsing */
@@ -93,6 +94,7 @@ extern int cfg_maxconn;
 extern char *cfg_scope;
 extern struct cfg_kw_list cfg_keywords;
 extern char *cursection;
+extern struct list sections;
 
 int cfg_parse_global(const char *file, int linenum, char **args, int inv);
 int cfg_parse_listen(const char *file, int linenum, char **args, int inv);
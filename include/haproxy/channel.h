@@ -835,19 +835,32 @@ static inline int ci_space_for_replace(const struct channel *chn)
 	return end - ci_tail(chn);
 }
 
+/* Returns non-zero if channel <chn> blindly forwards raw data which fill its
+ * buffer at each read, in which case it may use a large buffer. Nothing may
+ * depend on the buffer's size there: no analyser, no HTX message.
+ */
+static inline int channel_is_bulk(const struct channel *chn)
+{
+	return (chn->flags & CF_STREAMER_FAST) && !chn->analysers &&
+	       chn->to_forward == CHN_INFINITE_FORWARD && !IS_HTX_STRM(chn_strm(chn));
+}
+
 /* Allocates a buffer for channel <chn>. Returns 0 in case of failure, non-zero
- * otherwise.
+ * otherwise. Bulk channels get a large buffer when possible.
  *
  * If no buffer are available, the requester, represented by <wait> pointer,
  * will be added in the list of objects waiting for an available buffer.
  */
 static inline int channel_alloc_buffer(struct channel *chn, struct buffer_wait *wait)
 {
+	if (!c_size(chn) && channel_is_bulk(chn) && b_alloc_large(&chn->buf) != NULL)
+		return 1;
+
 	if (b_alloc(&chn->buf) != NULL)
 		return 1;
 
 	if (!LIST_INLIST(&wait->list))
-		LIST_APPEND(&ti->buffer_wq, &wait->list);
+		b_queue((chn->flags & CF_ISRESP) ? DB_CRIT_RES : DB_CRIT_DEFAULT, wait);
 
 	return 0;
 }
@@ -43,6 +43,18 @@ enum chk_result {
 	CHK_RES_CONDPASS,               /* check reports the server doesn't want new sessions */
 };
 
+/* A check is not moved to a thread whose idle ratio is below this percentage */
+#define CHK_BUSY_IDLE_PCT       20
+
+/* Number of runs over which the CPU time of a check is averaged */
+#define CHK_COST_RUNS           8
+
+/* A check only moves to a less loaded thread if the difference between both
+ * threads' loads exceeds the current one's divided by this ratio, in addition
+ * to the check's own load.
+ */
+#define CHK_IMBALANCE_RATIO     8
+
 /* flags used by check->state */
 #define CHK_ST_INPROGRESS       0x0001  /* a check is currently running */
 #define CHK_ST_CONFIGURED       0x0002  /* this check is configured and may be enabled */
@@ -53,6 +65,8 @@ enum chk_result {
 #define CHK_ST_IN_ALLOC         0x0040  /* check blocked waiting for input buffer allocation */
 #define CHK_ST_OUT_ALLOC        0x0080  /* check blocked waiting for output buffer allocation */
 #define CHK_ST_CLOSE_CONN       0x0100  /* check is waiting that the connection gets closed */
+#define CHK_ST_KEEPALIVE        0x0200  /* the check's connection may be kept alive between runs */
+#define CHK_ST_RES_EOM          0x0400  /* the whole HTTP response was received */
 
 /* check status */
 enum healthcheck_status {
@@ -158,6 +172,7 @@ struct check {
 	char desc[HCHK_DESC_LEN];		/* health check description */
 	signed char use_ssl;			/* use SSL for health checks (1: on, 0: server mode, -1: off) */
 	int send_proxy;				/* send a PROXY protocol header with checks */
+	int keep_alive;				/* try to keep the connection alive between checks */
 	struct tcpcheck_rules *tcpcheck_rules;	/* tcp-check send / expect rules */
 	struct tcpcheck_rule *current_step;     /* current step when using tcpcheck */
 	int inter, fastinter, downinter;        /* checks: time in milliseconds */
@@ -179,6 +194,13 @@ struct check {
 	int alpn_len;                           /* ALPN string length */
 	const struct mux_proto_list *mux_proto; /* the mux to use for all outgoing connections (specified by the "proto" keyword) */
 	int via_socks4;                         /* check the connection via socks4 proxy */
+	struct stktable *share_table;           /* table used to share the results with the peers, or NULL */
+	char *share_key;                        /* key of the check's results in <share_table> */
+	unsigned int share_seq;                 /* sequence number of the last result published or applied */
+	int share_owner;                        /* non-zero if this process runs the check for its peers */
+	uint64_t run_cost;                      /* CPU time spent on the current run (ns) */
+	unsigned int load;                      /* averaged CPU time per second of interval (ns) */
+	int tid;                                /* thread the check is accounted on */
 };
 
 #endif /* _HAPROXY_CHECKS_T_H */
@@ -48,6 +48,8 @@ int chunk_strcasecmp(const struct buffer *chk, const char *str);
 struct buffer *get_trash_chunk(void);
 struct buffer *alloc_trash_chunk(void);
 int init_trash_buffers(int first);
+int alloc_trash_buffers_per_thread();
+void free_trash_buffers_per_thread();
 
 /*
  * free a trash chunk allocated by alloc_trash_chunk(). NOP on NULL.
@@ -130,6 +130,13 @@ typedef struct { } empty_t;
 #define MSG_TRUNC_CLEARS_INPUT
 #endif
 
+/* MSG_ZEROCOPY appeared in Linux 4.14. The kernel reports the release of the
+ * user buffers through the socket's error queue.
+ */
+#if defined(__linux__) && defined(MSG_ZEROCOPY) && defined(SO_ZEROCOPY)
+#define HA_HAVE_MSG_ZEROCOPY
+#endif
+
 /* Maximum path length, OS-dependant */
 #ifndef MAXPATHLEN
 #define MAXPATHLEN 128
@@ -163,6 +170,13 @@ typedef struct { } empty_t;
 #define TIMER_INVALID ((timer_t)(unsigned long)(0xfffffffful))
 #endif
 
+/* glibc supports SIGEV_THREAD_ID but does not name the field holding the
+ * thread ID.
+ */
+#if defined(SIGEV_THREAD_ID) && !defined(sigev_notify_thread_id)
+#define sigev_notify_thread_id _sigev_un._tid
+#endif
+
 #if defined(USE_TPROXY) && defined(USE_NETFILTER)
 #include <linux/types.h>
 #include <linux/netfilter_ipv6.h>
@@ -237,6 +251,13 @@ typedef struct { } empty_t;
 #define HA_HAVE_CRYPT_R
 #endif
 
+/* gethostbyname_r() with the GNU prototype is thread-safe and available in
+ * glibc, musl and on FreeBSD.
+ */
+#if defined(__linux__) || defined(__FreeBSD__)
+#define HA_HAVE_GETHOSTBYNAME_R
+#endif
+
 /* some backtrace() implementations are broken or incomplete, in this case we
  * can replace them. We must not do it all the time as some are more accurate
  * than ours.
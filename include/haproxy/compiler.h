@@ -196,6 +196,18 @@
 #endif
 
 
+/* Makes the build fail with message <msg> if the constant expression <expr> is
+ * false. It may be placed wherever a declaration is permitted, and is mostly
+ * used to make sure that structures keep their expected size or layout.
+ */
+#ifndef BUILD_ASSERT
+#if defined(__clang__) || (__GNUC__ > 4) || (__GNUC__ == 4 && __GNUC_MINOR__ >= 6)
+#define BUILD_ASSERT(expr, msg) _Static_assert(expr, msg)
+#else
+#define BUILD_ASSERT(expr, msg) extern char __build_assert_failed[(expr) ? 1 : -1]
+#endif
+#endif
+
 /* sets alignment for current field or variable */
 #ifndef ALIGNED
 #define ALIGNED(x) __attribute__((aligned(x)))
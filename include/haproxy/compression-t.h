@@ -32,6 +32,14 @@
 #include <zlib.h>
 #endif
 
+#if defined(USE_BROTLI)
+#include <brotli/encode.h>
+#endif
+
+#if defined(USE_ZSTD)
+#include <zstd.h>
+#endif
+
 #include <haproxy/buf-t.h>
 
 struct comp {
@@ -53,6 +61,12 @@ struct comp_ctx {
 	void *zlib_prev;
 	void *zlib_pending_buf;
 	void *zlib_head;
+#endif
+#if defined(USE_BROTLI)
+	BrotliEncoderState *brotli; /* brotli encoder, NULL if not used */
+#endif
+#if defined(USE_ZSTD)
+	ZSTD_CStream *zstd;         /* zstd encoder, NULL if not used */
 #endif
 	int cur_lvl;
 };
@@ -26,13 +26,14 @@
 #include <haproxy/compression-t.h>
 
 extern unsigned int compress_min_idle;
+extern const struct comp_algo comp_algos[];
 
 int comp_append_type(struct comp *comp, const char *type);
 int comp_append_algo(struct comp *comp, const char *algo);
 
-#ifdef USE_ZLIB
+#if defined(USE_ZLIB) || defined(USE_BROTLI) || defined(USE_ZSTD)
 extern long zlib_used_memory;
-#endif /* USE_ZLIB */
+#endif /* USE_ZLIB || USE_BROTLI || USE_ZSTD */
 
 #endif /* _HAPROXY_COMP_H */
 
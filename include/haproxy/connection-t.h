@@ -86,6 +86,9 @@ enum {
 	 * the stream-interface :
 	 */
 	CS_FL_NOT_FIRST     = 0x00100000,  /* this stream is not the first one */
+
+	/* following flag is set at allocation time and never cleared */
+	CS_FL_WITH_STREAM   = 0x00200000,  /* allocated with its stream by cs_new_with_stream() */
 };
 
 /* cs_shutr() modes */
@@ -281,6 +284,7 @@ enum {
 enum {
 	CO_SFL_MSG_MORE    = 0x0001,    /* More data to come afterwards */
 	CO_SFL_STREAMER    = 0x0002,    /* Producer is continuously streaming data */
+	CO_SFL_ZEROCOPY    = 0x0004,    /* buf is a pool buffer whose storage may be replaced */
 };
 
 /* known transport layers (for ease of lookup) */
@@ -289,6 +293,7 @@ enum {
 	XPRT_SSL = 1,
 	XPRT_HANDSHAKE = 2,
 	XPRT_QUIC = 3,
+	XPRT_SHM = 4,
 	XPRT_ENTRIES /* must be last one */
 };
 
@@ -299,6 +304,8 @@ enum {
 	MX_FL_HTX         = 0x00000002, /* set if it is an HTX multiplexer */
 	MX_FL_HOL_RISK    = 0x00000004, /* set if the protocol is subject the to head-of-line blocking on server */
 	MX_FL_NO_UPG      = 0x00000008, /* set if mux does not support any upgrade */
+	MX_FL_WARM_CONN   = 0x00000010, /* set if mux may be installed on an outgoing connection without a stream */
+	MX_FL_MULTIPLEX   = 0x00000020, /* set if the mux may carry several streams at once */
 };
 
 /* PROTO token registration */
@@ -392,6 +399,8 @@ struct xprt_ops {
 	int (*remove_xprt)(struct connection *conn, void *xprt_ctx, void *toremove_ctx, const struct xprt_ops *newops, void *newctx); /* Remove an xprt from the connection, used by temporary xprt such as the handshake one */
 	int (*add_xprt)(struct connection *conn, void *xprt_ctx, void *toadd_ctx, const struct xprt_ops *toadd_ops, void **oldxprt_ctx, const struct xprt_ops **oldxprt_ops); /* Add a new XPRT as the new xprt, and return the old one */
 	int (*show_fd)(struct buffer *, const struct connection *, const void *ctx); /* append some data about xprt for "show fd"; returns non-zero if suspicious */
+	int (*may_splice)(const struct connection *conn, const void *xprt_ctx, int dir); /* optional: non-zero if rcv_pipe (dir=0) or snd_pipe (dir=1) may currently be used */
+	size_t (*snd_iov)(struct connection *conn, void *xprt_ctx, const struct iovec *iov, int iovcnt, int flags); /* optional: send callback for <iovcnt> blocks at once */
 };
 
 /* mux_ops describes the mux operations, which are to be performed at the
@@ -434,6 +443,12 @@ struct mux_stopping_data {
 	struct task *task; /* task woken up on soft-stop */
 };
 
+/* per-thread list of idle frontend connections offered to other threads */
+struct conn_migrate_data {
+	struct list list; /* offered connections, protected by the idle_conns_lock */
+	struct tasklet *tasklet; /* tasklet taking over connections from other threads */
+};
+
 /* data_cb describes the data layer's recv and send callbacks which are called
  * when I/O activity was detected after the transport layer is ready. These
  * callbacks are supposed to make use of the xprt_ops above to exchange data
@@ -479,6 +494,7 @@ struct conn_stream {
 	void *data;                          /* pointer to upper layer's entity (eg: stream interface) */
 	const struct data_cb *data_cb;       /* data layer callbacks. Must be set before xprt->init() */
 	void *ctx;                           /* mux-specific context */
+	uint64_t conn_cpu;                   /* conn->cpu_time when attached to its upper layer */
 };
 
 /* Hash header flag reflecting the input parameters present
@@ -538,7 +554,7 @@ struct connection {
 	struct mt_list toremove_list; /* list for connection to clean up */
 	union {
 		struct list session_list;  /* used by backend conns, list of attached connections to a session */
-		struct list stopping_list; /* used by frontend conns, attach point in mux stopping list */
+		struct list stopping_list; /* used by frontend conns, attach point in mux stopping or migration list */
 	};
 	union conn_handle handle;     /* connection handle at the socket layer */
 	const struct netns_entry *proxy_netns;
@@ -550,6 +566,8 @@ struct connection {
 	struct ist proxy_authority;   /* Value of the authority TLV received via PROXYv2 */
 	struct ist proxy_unique_id;   /* Value of the unique ID TLV received via PROXYv2 */
 	struct quic_conn *qc;         /* Only present if this connection is a QUIC one */
+	struct sock_zc *zc;           /* buffers held by zero-copy sends, or NULL */
+	uint64_t cpu_time;            /* CPU time spent in the mux/xprt tasklets, in ns (profiling only) */
 
 	/* used to identify a backend connection for http-reuse,
 	 * thus only present if conn.target is of type OBJ_TYPE_SERVER
@@ -24,6 +24,7 @@
 
 #include <import/ist.h>
 
+#include <haproxy/activity.h>
 #include <haproxy/api.h>
 #include <haproxy/buf.h>
 #include <haproxy/connection-t.h>
@@ -35,6 +36,7 @@
 #include <haproxy/session.h>
 #include <haproxy/task-t.h>
 #include <haproxy/tcpcheck-t.h>
+#include <haproxy/usdt.h>
 
 
 extern struct pool_head *pool_head_connection;
@@ -45,6 +47,7 @@ extern struct pool_head *pool_head_authority;
 extern struct xprt_ops *registered_xprt[XPRT_ENTRIES];
 extern struct mux_proto_list mux_proto_list;
 extern struct mux_stopping_data mux_stopping_data[MAX_THREADS];
+extern struct conn_migrate_data conn_migrate_data[MAX_THREADS];
 
 #define IS_HTX_CONN(conn) ((conn)->mux && ((conn)->mux->flags & MX_FL_HTX))
 #define IS_HTX_CS(cs)     (IS_HTX_CONN((cs)->conn))
@@ -76,6 +79,14 @@ int conn_recv_socks4_proxy_response(struct connection *conn);
 /* If we delayed the mux creation because we were waiting for the handshake, do it now */
 int conn_create_mux(struct connection *conn);
 
+/* moves idle frontend connections between threads */
+void conn_migrate_offer(struct connection *conn, int thr);
+void conn_migrate_cancel(struct connection *conn);
+
+/* conn_streams allocated in the same area as their stream, see stream.c */
+struct conn_stream *cs_new_with_stream(struct connection *conn);
+void cs_free_with_stream(struct conn_stream *cs);
+
 extern struct idle_conns idle_conns[MAX_THREADS];
 
 /* returns true if the transport layer is ready */
@@ -90,6 +101,25 @@ static inline int conn_ctrl_ready(const struct connection *conn)
 	return (conn->flags & CO_FL_CTRL_READY);
 }
 
+/* returns true if the transport layer of <conn> is able to receive data into
+ * a pipe right now. Some transports (e.g. SSL) may only do it under certain
+ * conditions, which they report via their may_splice() callback.
+ */
+static inline int conn_xprt_may_rcv_pipe(const struct connection *conn)
+{
+	return conn->xprt && conn->xprt->rcv_pipe &&
+	       (!conn->xprt->may_splice || conn->xprt->may_splice(conn, conn->xprt_ctx, 0));
+}
+
+/* returns true if the transport layer of <conn> is able to send data from a
+ * pipe right now. See conn_xprt_may_rcv_pipe() above.
+ */
+static inline int conn_xprt_may_snd_pipe(const struct connection *conn)
+{
+	return conn->xprt && conn->xprt->snd_pipe &&
+	       (!conn->xprt->may_splice || conn->xprt->may_splice(conn, conn->xprt_ctx, 1));
+}
+
 /*
  * Calls the start() function of the transport layer, if needed.
  * Returns < 0 in case of error.
@@ -287,7 +317,7 @@ static inline void cs_close(struct conn_stream *cs)
 {
 	cs_shutw(cs, CS_SHW_SILENT);
 	cs_shutr(cs, CS_SHR_RESET);
-	cs->flags = CS_FL_NONE;
+	cs->flags &= CS_FL_WITH_STREAM;
 }
 
 /* completely close a conn_stream after draining possibly pending data (but do not detach it) */
@@ -295,7 +325,7 @@ static inline void cs_drain_and_close(struct conn_stream *cs)
 {
 	cs_shutw(cs, CS_SHW_SILENT);
 	cs_shutr(cs, CS_SHR_DRAIN);
-	cs->flags = CS_FL_NONE;
+	cs->flags &= CS_FL_WITH_STREAM;
 }
 
 /* sets CS_FL_ERROR or CS_FL_ERR_PENDING on the cs */
@@ -384,10 +414,29 @@ static inline void conn_init(struct connection *conn, void *target)
 	conn->proxy_authority = IST_NULL;
 	conn->proxy_unique_id = IST_NULL;
 	conn->qc = NULL;
+	conn->zc = NULL;
+	conn->cpu_time = 0;
 	conn->hash_node = NULL;
 	conn->xprt = NULL;
 }
 
+/* Returns the date to pass to conn_cpu_account() at the end of a mux or xprt
+ * tasklet, or zero when task profiling is not enabled on the current thread.
+ */
+static inline uint64_t conn_cpu_start(void)
+{
+	return unlikely(task_profiling_mask & tid_bit) ? now_mono_time() : 0;
+}
+
+/* Accounts the CPU time spent since <start> as returned by conn_cpu_start()
+ * to connection <conn>, which must still be valid.
+ */
+static inline void conn_cpu_account(struct connection *conn, uint64_t start)
+{
+	if (unlikely(start))
+		conn->cpu_time += now_mono_time() - start;
+}
+
 static inline struct conn_hash_node *conn_alloc_hash_node(struct connection *conn)
 {
 	struct conn_hash_node *hash_node = NULL;
@@ -486,12 +535,15 @@ static inline struct connection *conn_new(void *target)
 	return conn;
 }
 
-/* Releases a conn_stream previously allocated by cs_new(), as well as any
- * buffer it would still hold.
+/* Releases a conn_stream previously allocated by cs_new() or
+ * cs_new_with_stream(), as well as any buffer it would still hold.
  */
 static inline void cs_free(struct conn_stream *cs)
 {
-
+	if (unlikely(cs && (cs->flags & CS_FL_WITH_STREAM))) {
+		cs_free_with_stream(cs);
+		return;
+	}
 	pool_free(pool_head_connstream, cs);
 }
 
@@ -549,6 +601,8 @@ static inline void conn_force_unsubscribe(struct connection *conn)
 /* Releases a connection previously allocated by conn_new() */
 static inline void conn_free(struct connection *conn)
 {
+	HA_USDT(conn_close, conn, conn_is_back(conn), conn->cpu_time);
+
 	/* If the connection is owned by the session, remove it from its list
 	 */
 	if (conn_is_back(conn) && LIST_INLIST(&conn->session_list)) {
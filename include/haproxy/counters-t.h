@@ -23,17 +23,59 @@
 #ifndef _HAPROXY_COUNTERS_T_H
 #define _HAPROXY_COUNTERS_T_H
 
+#include <haproxy/api-t.h>
+
+/* Counters updated by every request or every data transfer. Each thread
+ * updates its own copy of them, which saves the cache line from bouncing
+ * between threads, and they are only summed when read (see counters.h).
+ */
+enum thr_counter {
+	THR_CTR_BYTES_IN = 0,                   /* bytes_in */
+	THR_CTR_BYTES_OUT,                      /* bytes_out */
+	THR_CTR_CUM_REQ,                        /* p.http.cum_req */
+	THR_CTR_COUNT                           /* must be last */
+};
+
+/* one thread's copy of the counters above, alone in its cache line */
+struct thr_counters {
+	long long v[THR_CTR_COUNT];
+} THREAD_ALIGNED(64);
+
+/* Timers whose distribution is kept in histograms for backends and servers */
+enum time_hist_timer {
+	TIME_HIST_QUEUE = 0,                    /* time spent in the queue */
+	TIME_HIST_CONNECT,                      /* time spent establishing the connection */
+	TIME_HIST_RESPONSE,                     /* time spent waiting for the response */
+	TIME_HIST_TOTAL,                        /* total time of the stream */
+	TIME_HIST_TIMERS                        /* must be last */
+};
+
+/* Number of buckets of the time histograms. They are log-linear, with two
+ * buckets per power of two, their upper bounds being 1, 2, 3, 4, 6, 8, 12, 16
+ * ... 49152, 65536 milliseconds, plus a last one for larger values (see
+ * time_hist_bound()).
+ */
+#define TIME_HIST_BUCKETS 33
+
+/* one thread's copy of the time histograms, alone in its cache lines */
+struct time_hist {
+	unsigned int cnt[TIME_HIST_TIMERS][TIME_HIST_BUCKETS]; /* number of values per bucket */
+	unsigned long long sum[TIME_HIST_TIMERS];               /* sum of the values, in milliseconds */
+} THREAD_ALIGNED(64);
+
 /* counters used by listeners and frontends */
 struct fe_counters {
 	unsigned int conn_max;                  /* max # of active sessions */
+	unsigned int last_upd;                  /* date of the last activity on these counters (now.tv_sec) */
+	struct thr_counters *shards;            /* per-thread part of some counters, or NULL */
 	long long    cum_conn;                  /* cumulated number of received connections */
 	long long    cum_sess;                  /* cumulated number of accepted connections */
 
 	unsigned int cps_max;                   /* maximum of new connections received per second */
 	unsigned int sps_max;                   /* maximum of new connections accepted per second (sessions) */
 
-	long long bytes_in;                     /* number of bytes transferred from the client to the server */
-	long long bytes_out;                    /* number of bytes transferred from the server to the client */
+	long long bytes_in;                     /* number of bytes transferred from the client to the server (+shards) */
+	long long bytes_out;                    /* number of bytes transferred from the server to the client (+shards) */
 
 	long long comp_in;                      /* input bytes fed to the compressor */
 	long long comp_out;                     /* output bytes emitted by the compressor */
@@ -53,7 +95,7 @@ struct fe_counters {
 
 	union {
 		struct {
-			long long cum_req;      /* cumulated number of processed HTTP requests */
+			long long cum_req;      /* cumulated number of processed HTTP requests (+shards) */
 			long long comp_rsp;     /* number of compressed responses */
 			unsigned int rps_max;   /* maximum of new HTTP requests second observed */
 			long long rsp[6];       /* http response codes */
@@ -66,6 +108,8 @@ struct fe_counters {
 /* counters used by servers and backends */
 struct be_counters {
 	unsigned int conn_max;                  /* max # of active sessions */
+	unsigned int last_upd;                  /* date of the last activity on these counters (now.tv_sec) */
+	struct thr_counters *shards;            /* per-thread part of some counters, or NULL */
 	long long    cum_conn;                  /* cumulated number of received connections */
 	long long    cum_sess;                  /* cumulated number of accepted connections */
 	long long  cum_lbconn;                  /* cumulated number of sessions processed by load balancing (BE only) */
@@ -76,8 +120,8 @@ struct be_counters {
 	unsigned int nbpend_max;                /* max number of pending connections with no server assigned yet */
 	unsigned int cur_sess_max;		/* max number of currently active sessions */
 
-	long long bytes_in;                     /* number of bytes transferred from the client to the server */
-	long long bytes_out;                    /* number of bytes transferred from the server to the client */
+	long long bytes_in;                     /* number of bytes transferred from the client to the server (+shards) */
+	long long bytes_out;                    /* number of bytes transferred from the server to the client (+shards) */
 
 	long long comp_in;                      /* input bytes fed to the compressor */
 	long long comp_out;                     /* output bytes emitted by the compressor */
@@ -100,12 +144,16 @@ struct be_counters {
 	long long failed_checks, failed_hana;	/* failed health checks and health analyses for servers */
 	long long down_trans;			/* up->down transitions */
 
+	unsigned long long cpu_time;            /* CPU time spent processing the streams, in ns (see stream_cpu_time()) */
+	unsigned long long cpu_calls;           /* number of calls accounted in cpu_time */
+
+	struct time_hist *hist;                 /* per-thread histograms of the times below, or NULL */
 	unsigned int q_time, c_time, d_time, t_time; /* sums of conn_time, queue_time, data_time, total_time */
 	unsigned int qtime_max, ctime_max, dtime_max, ttime_max; /* maximum of conn_time, queue_time, data_time, total_time observed */
 
 	union {
 		struct {
-			long long cum_req;      /* cumulated number of processed HTTP requests */
+			long long cum_req;      /* cumulated number of processed HTTP requests (+shards) */
 			long long comp_rsp;     /* number of compressed responses */
 			unsigned int rps_max;   /* maximum of new HTTP requests second observed */
 			long long rsp[6];       /* http response codes */
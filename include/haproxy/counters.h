@@ -0,0 +1,211 @@
+/*
+ * include/haproxy/counters.h
+ * This file contains functions to update and read the statistics counters
+ * and time histograms which are split per thread.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, version 2.1
+ * exclusively.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _HAPROXY_COUNTERS_H
+#define _HAPROXY_COUNTERS_H
+
+#include <limits.h>
+#include <string.h>
+#include <haproxy/api.h>
+#include <haproxy/counters-t.h>
+#include <haproxy/global.h>
+#include <haproxy/intops.h>
+#include <haproxy/thread.h>
+
+/* Adds <val> to the counter <idx>, whose shared part is <shared> and whose
+ * per-thread parts are <shards>. Only the current thread's part is updated if
+ * the counters are split, otherwise the shared one is atomically updated.
+ */
+static inline void counters_add(struct thr_counters *shards, enum thr_counter idx,
+                                long long *shared, long long val)
+{
+	if (likely(shards))
+		shards[tid].v[idx] += val;
+	else
+		_HA_ATOMIC_ADD(shared, val);
+}
+
+/* Returns the value of the counter <idx>, that is the sum of its shared part
+ * <shared> and of its per-thread parts <shards> if any. It is meant to be used
+ * by readers only as it visits every thread's cache line.
+ */
+static inline long long counters_get(const struct thr_counters *shards, enum thr_counter idx,
+                                     const long long *shared)
+{
+	long long ret = HA_ATOMIC_LOAD(shared);
+	int thr;
+
+	if (shards) {
+		for (thr = 0; thr < global.nbthread; thr++)
+			ret += HA_ATOMIC_LOAD(&shards[thr].v[idx]);
+	}
+	return ret;
+}
+
+/* Returns non-zero if the counter <idx> (see counters_get()) is above <limit>.
+ * The shared part and the current thread's one are checked first so that the
+ * other threads' cache lines are only read until the limit is reached, which
+ * makes it cheap enough to be used on the data path.
+ */
+static inline int counters_above(const struct thr_counters *shards, enum thr_counter idx,
+                                 const long long *shared, long long limit)
+{
+	long long ret = HA_ATOMIC_LOAD(shared);
+	int thr;
+
+	if (!shards || ret > limit)
+		return ret > limit;
+
+	ret += shards[tid].v[idx];
+	for (thr = 0; ret <= limit && thr < global.nbthread; thr++) {
+		if (thr != tid)
+			ret += HA_ATOMIC_LOAD(&shards[thr].v[idx]);
+	}
+	return ret > limit;
+}
+
+/* Returns the index of the bucket of the time histograms <ms> belongs to */
+static inline unsigned int time_hist_bucket(unsigned int ms)
+{
+	unsigned int o;
+
+	if (ms <= 2)
+		return ms ? ms - 1 : 0;
+
+	/* ms is in ]2^o, 2^(o+1)], which is split at 3*2^(o-1) */
+	o = my_flsl(ms - 1) - 1;
+	return MIN(2 * o + (ms > (3U << (o - 1))), TIME_HIST_BUCKETS - 1);
+}
+
+/* Returns the upper bound in milliseconds of bucket <idx> of the time
+ * histograms, or UINT_MAX for the last one.
+ */
+static inline unsigned int time_hist_bound(unsigned int idx)
+{
+	if (idx >= TIME_HIST_BUCKETS - 1)
+		return UINT_MAX;
+	if (idx == 0)
+		return 1;
+	return (idx & 1) ? 2U << (idx / 2) : 3U << (idx / 2 - 1);
+}
+
+/* Accounts <ms> milliseconds for timer <t> in the histograms <hist>, if any.
+ * Only the current thread's part is updated. Negative values are ignored.
+ */
+static inline void time_hist_add(struct time_hist *hist, enum time_hist_timer t, int ms)
+{
+	if (!hist || ms < 0)
+		return;
+	hist[tid].cnt[t][time_hist_bucket(ms)]++;
+	hist[tid].sum[t] += ms;
+}
+
+/* Sums all threads' parts of the histogram of timer <t> from <hist> into
+ * <cnt>, which must have TIME_HIST_BUCKETS entries, and the sum of the values
+ * into <sum> if not NULL. Returns the total number of values.
+ */
+static inline unsigned long long time_hist_read(const struct time_hist *hist, enum time_hist_timer t,
+                                                unsigned long long *cnt, unsigned long long *sum)
+{
+	unsigned long long tot = 0;
+	int thr, idx;
+
+	memset(cnt, 0, TIME_HIST_BUCKETS * sizeof(*cnt));
+	if (sum)
+		*sum = 0;
+	if (!hist)
+		return 0;
+
+	for (thr = 0; thr < global.nbthread; thr++) {
+		for (idx = 0; idx < TIME_HIST_BUCKETS; idx++)
+			cnt[idx] += HA_ATOMIC_LOAD(&hist[thr].cnt[t][idx]);
+		if (sum)
+			*sum += HA_ATOMIC_LOAD(&hist[thr].sum[t]);
+	}
+
+	for (idx = 0; idx < TIME_HIST_BUCKETS; idx++)
+		tot += cnt[idx];
+	return tot;
+}
+
+/* Returns an estimate in milliseconds of the <pct> percentile (0..100) of
+ * timer <t> from the histograms <hist>, interpolated within its bucket. Values
+ * in the last bucket are reported as its lower bound. Returns 0 if no value
+ * was recorded.
+ */
+static inline unsigned int time_hist_pct(const struct time_hist *hist, enum time_hist_timer t,
+                                         unsigned int pct)
+{
+	unsigned long long cnt[TIME_HIST_BUCKETS];
+	unsigned long long tot, rank, cum = 0;
+	unsigned int idx, low = 0, high;
+
+	tot = time_hist_read(hist, t, cnt, NULL);
+	if (!tot)
+		return 0;
+
+	rank = (tot * MIN(pct, 100) + 99) / 100;
+	if (!rank)
+		rank = 1;
+
+	for (idx = 0; idx < TIME_HIST_BUCKETS - 1; idx++) {
+		high = time_hist_bound(idx);
+		if (cum + cnt[idx] >= rank)
+			return low + (unsigned long long)(high - low) * (rank - cum) / cnt[idx];
+		cum += cnt[idx];
+		low = high;
+	}
+	return low;
+}
+
+/* Resets all the counters of <ctr>, including their per-thread parts */
+static inline void fe_counters_clear(struct fe_counters *ctr)
+{
+	struct thr_counters *shards = ctr->shards;
+
+	memset(ctr, 0, sizeof(*ctr));
+	if (shards)
+		memset(shards, 0, global.nbthread * sizeof(*shards));
+	ctr->shards = shards;
+}
+
+/* Resets all the counters of <ctr>, including their per-thread parts */
+static inline void be_counters_clear(struct be_counters *ctr)
+{
+	struct thr_counters *shards = ctr->shards;
+	struct time_hist *hist = ctr->hist;
+
+	memset(ctr, 0, sizeof(*ctr));
+	if (shards)
+		memset(shards, 0, global.nbthread * sizeof(*shards));
+	if (hist)
+		memset(hist, 0, global.nbthread * sizeof(*hist));
+	ctr->shards = shards;
+	ctr->hist = hist;
+}
+
+#endif /* _HAPROXY_COUNTERS_H */
+
+/*
+ * Local variables:
+ *  c-indent-level: 8
+ *  c-basic-offset: 8
+ * End:
+ */
@@ -19,6 +19,10 @@ int ha_cpuset_set(struct hap_cpuset *set, int cpu);
  */
 int ha_cpuset_clr(struct hap_cpuset *set, int cpu);
 
+/* Returns non-zero if <cpu> index is set in <set>, otherwise zero.
+ */
+int ha_cpuset_isset(const struct hap_cpuset *set, int cpu);
+
 /* Bitwise and equivalent operation between <src> and <dst> stored in <dst>.
  */
 void ha_cpuset_and(struct hap_cpuset *dst, const struct hap_cpuset *src);
@@ -41,4 +45,31 @@ void ha_cpuset_assign(struct hap_cpuset *dst, const struct hap_cpuset *src);
  */
 int ha_cpuset_size();
 
+/* Returns the number of NUMA nodes detected on the system, which is at least
+ * one and at most HA_MAX_NODES.
+ */
+int ha_numa_nodes();
+
+/* Returns the NUMA node all CPUs of <set> belong to, or -1 if the set is empty
+ * or spans over multiple nodes.
+ */
+int ha_cpuset_node(const struct hap_cpuset *set);
+
+/* Returns the first CPU of the level 3 cache domain all CPUs of <set> belong
+ * to, or -1 if the set is empty, spans over multiple domains or if the cache
+ * topology is unknown.
+ */
+int ha_cpuset_l3(const struct hap_cpuset *set);
+
+/* Binds each of the <nbthread> first entries of <map> to a single CPU among
+ * those the process may run on (also considering cpu_map.proc), based on the
+ * system's topology: one thread of
+ * each core is used before their SMT siblings, and threads running on the
+ * same NUMA node and sharing the same L3 cache get contiguous numbers. When
+ * there are more threads than CPUs, contiguous threads share the same CPU.
+ * Returns the number of CPUs used, or zero if the topology could not be
+ * retrieved, in which case <map> is left untouched.
+ */
+int ha_cpuset_auto_map(struct hap_cpuset *map, int nbthread);
+
 #endif /* _HAPROXY_CPUSET_H */
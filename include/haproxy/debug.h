@@ -32,5 +32,6 @@ void ha_dump_backtrace(struct buffer *buf, const char *prefix, int dump);
 void ha_backtrace_to_stderr();
 void ha_thread_dump_all_to_trash();
 void ha_panic();
+int wdt_set_stall_period(unsigned long long ns);
 
 #endif /* _HAPROXY_DEBUG_H */
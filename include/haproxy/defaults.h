@@ -39,6 +39,15 @@
 #define MAX_THREADS_MASK (~0UL >> (LONGBITS - MAX_THREADS))
 #endif
 
+/* MAX_TGROUPS defines the highest limit for the global thread-groups value.
+ * It may never be larger than MAX_THREADS.
+ */
+#ifndef USE_THREAD
+#define MAX_TGROUPS 1
+#elif !defined(MAX_TGROUPS)
+#define MAX_TGROUPS 16
+#endif
+
 /*
  * BUFSIZE defines the size of a read and write buffer. It is the maximum
  * amount of bytes which can be stored by the proxy for each stream. However,
@@ -52,6 +61,27 @@
 #define BUFSIZE	        16384
 #endif
 
+/* BUFSIZE_SMALL is the size of the small buffers some muxes start with when
+ * receiving data on an idle connection, before switching to a regular buffer
+ * once it doesn't fit anymore. Most requests and many responses fit there.
+ * Zero disables small buffers.
+ */
+#ifndef BUFSIZE_SMALL
+#define BUFSIZE_SMALL   1024
+#endif
+
+/* BUFSIZE_LARGE is the size of the large buffers that channels forwarding bulk
+ * data may switch to, and LARGE_BUFS_LIMIT the maximum number of such buffers
+ * for the whole process. Zero disables large buffers.
+ */
+#ifndef BUFSIZE_LARGE
+#define BUFSIZE_LARGE   0
+#endif
+
+#ifndef LARGE_BUFS_LIMIT
+#define LARGE_BUFS_LIMIT 64
+#endif
+
 /* certain buffers may only be allocated for responses in order to avoid
  * deadlocks caused by request queuing. 2 buffers is the absolute minimum
  * acceptable to ensure that a request gaining access to a server can get
@@ -135,6 +165,32 @@
 #define STKTABLE_FILTER_LEN 4
 #endif
 
+// max # of expired stick-table entries visited by one run of the expiration
+// task before it yields, so that a burst of expirations does not stall the
+// thread nor hold a shard's lock for too long.
+#ifndef STKTABLE_EXPIRE_BATCH
+#define STKTABLE_EXPIRE_BATCH 256
+#endif
+
+// max # of key size classes of string stick-tables, each allocating its
+// entries from its own pool, and size of the smallest one. Each class is
+// twice as large as the previous one, the largest one being the table's key
+// size, so that short keys do not reserve the room of the longest ones.
+#ifndef STKTABLE_KEY_CLASSES
+#define STKTABLE_KEY_CLASSES 4
+#endif
+
+#ifndef STKTABLE_KEY_CLASS_MIN
+#define STKTABLE_KEY_CLASS_MIN 16
+#endif
+
+// number of entries of the per-thread cache of dictionary lookups, which
+// must be a power of two. Each cached entry holds a reference, so at most
+// this number of unused entries per thread may linger in a dictionary.
+#ifndef DICT_CACHE_SIZE
+#define DICT_CACHE_SIZE 64
+#endif
+
 // max # of loops we can perform around a read() which succeeds.
 // It's very frequent that the system returns a few TCP segments at a time.
 #ifndef MAX_READ_POLL_LOOPS
@@ -248,6 +304,13 @@
 #define SRV_CHK_INTER_THRES 1000
 #endif
 
+/* Default number of peers running the checks whose results are shared with
+ * "check-share".
+ */
+#ifndef CHK_SHARE_OWNERS
+#define CHK_SHARE_OWNERS 2
+#endif
+
 /* Specifies the string used to report the version and release date on the
  * statistics page. May be defined to the empty string ("") to permanently
  * disable the feature.
@@ -336,10 +399,44 @@
 #define SSL_HANDSHAKE_MAX_COST (76*1024)  // measured
 #endif
 
+/* number of TLS sessions to each server which are shared by all threads, so
+ * that a thread which never connected to the server may still resume one.
+ */
+#ifndef SSL_SRV_SHARED_SESS
+#define SSL_SRV_SHARED_SESS 8
+#endif
+
 #ifndef DEFAULT_SSL_CTX_CACHE
 #define DEFAULT_SSL_CTX_CACHE 1000
 #endif
 
+/* max number of shards of the shared SSL session cache */
+#ifndef MAX_SSL_CACHE_SHARDS
+#define MAX_SSL_CACHE_SHARDS 256
+#endif
+
+/* max number of SSL contexts of lazily loaded certificates kept in memory */
+#ifndef SSL_LAZY_CACHE_SIZE
+#define SSL_LAZY_CACHE_SIZE 10000
+#endif
+
+/* number of threads reading the lazily loaded certificates */
+#ifndef SSL_LAZY_LOADERS
+#define SSL_LAZY_LOADERS 2
+#endif
+
+/* delay in milliseconds before retrying to load a lazy certificate which failed */
+#ifndef SSL_LAZY_RETRY_DELAY
+#define SSL_LAZY_RETRY_DELAY 10000
+#endif
+
+/* max number of times a handshake waits for a lazy certificate evicted before
+ * it could be used.
+ */
+#ifndef SSL_LAZY_MAX_PARK
+#define SSL_LAZY_MAX_PARK 3
+#endif
+
 /* approximate stream size (for maxconn estimate) */
 #ifndef STREAM_MAX_COST
 #define STREAM_MAX_COST (sizeof(struct stream) + \
@@ -354,11 +451,23 @@
 #define MEM_USABLE_RATIO 0.97
 #endif
 
+/* maximum number of NUMA nodes which are considered. Pools keep one shared
+ * free list per node.
+ */
+#ifndef HA_MAX_NODES
+#define HA_MAX_NODES 8
+#endif
+
 /* default per-thread pool cache size when enabled */
 #ifndef CONFIG_HAP_POOL_CACHE_SIZE
 #define CONFIG_HAP_POOL_CACHE_SIZE 1048576
 #endif
 
+/* interval between two checks of the RSS against tune.pool-rss-target, in ms */
+#ifndef POOL_TRIM_INTERVAL
+#define POOL_TRIM_INTERVAL 1000
+#endif
+
 /* Number of samples used to compute the times reported in stats. A power of
  * two is highly recommended, and this value multiplied by the largest response
  * time must not overflow and unsigned int. See freq_ctr.h for more information.
@@ -370,6 +479,43 @@
 #define TIME_STATS_SAMPLES 512
 #endif
 
+/* Decay time in milliseconds of the peak-EWMA of the servers' response times
+ * used by "balance ewma". A measure taken this long ago weighs as much as all
+ * the ones taken since.
+ */
+#ifndef LB_EWMA_DECAY
+#define LB_EWMA_DECAY 10000
+#endif
+
+/* Number of shards of the servers' and proxies' queues of pending connections.
+ * Threads enqueue into the shard matching their ID modulo this value, and the
+ * dequeuing thread merges the shards' heads by priority.
+ */
+#ifndef QUEUE_SHARDS
+#define QUEUE_SHARDS 4
+#endif
+
+/* Default time in milliseconds the queueing delay must remain above the
+ * "queue-codel" target before the queues start to shed load.
+ */
+#ifndef QUEUE_CODEL_INTERVAL
+#define QUEUE_CODEL_INTERVAL 100
+#endif
+
+/* Maximum number of available connections to the same destination compared
+ * by the "pack" and "spread" policies of "http-reuse" before picking one.
+ */
+#ifndef REUSE_POLICY_MAX_LOOKUPS
+#define REUSE_POLICY_MAX_LOOKUPS 16
+#endif
+
+/* Maximum number of threads resolving the servers' host names in parallel
+ * using the libc when applying their initial address at boot.
+ */
+#ifndef INIT_ADDR_WORKERS
+#define INIT_ADDR_WORKERS 16
+#endif
+
 /* max ocsp cert id asn1 encoded length */
 #ifndef OCSP_MAX_CERTID_ASN1_LENGTH
 #define OCSP_MAX_CERTID_ASN1_LENGTH 128
@@ -384,6 +530,13 @@
 #define TLS_TICKETS_NO 3
 #endif
 
+/* default rotation period of the TLS ticket keys synchronized through peers,
+ * in seconds.
+ */
+#ifndef TLS_TICKETS_ROTATE
+#define TLS_TICKETS_ROTATE 3600
+#endif
+
 /* pattern lookup default cache size, in number of entries :
  * 10k entries at 10k req/s mean 1% risk of a collision after 60 years, that's
  * already much less than the memory's reliability in most machines and more
@@ -394,6 +547,30 @@
 #define DEFAULT_PAT_LRU_SIZE 10000
 #endif
 
+/* Each expression periodically measures the cost of its lookups without, then
+ * with the pattern cache, over PAT_LRU_PROBE lookups each time, and uses the
+ * cheapest method for the rest of the PAT_LRU_PERIOD lookups (power of 2).
+ */
+#ifndef PAT_LRU_PROBE
+#define PAT_LRU_PROBE  256
+#endif
+
+#ifndef PAT_LRU_PERIOD
+#define PAT_LRU_PERIOD 16384
+#endif
+
+/* maximum number of sources held in the XDP drop list, the least recently
+ * used ones being evicted first.
+ */
+#ifndef XDP_DROP_MAX_ENTRIES
+#define XDP_DROP_MAX_ENTRIES 65536
+#endif
+
+/* default duration of the "xdp-drop" action, in milliseconds */
+#ifndef XDP_DROP_DEFAULT_TIME
+#define XDP_DROP_DEFAULT_TIME 10000
+#endif
+
 /* maximum number of pollers that may be registered */
 #ifndef MAX_POLLERS
 #define MAX_POLLERS	10
@@ -407,6 +584,8 @@
 #endif
 
 /* system sysfs directory */
+#ifndef NUMA_DETECT_SYSTEM_SYSFS_PATH
 #define NUMA_DETECT_SYSTEM_SYSFS_PATH "/sys/devices/system"
+#endif
 
 #endif /* _HAPROXY_DEFAULTS_H */
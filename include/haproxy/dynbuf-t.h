@@ -22,13 +22,30 @@
 #ifndef _HAPROXY_DYNBUF_T_H
 #define _HAPROXY_DYNBUF_T_H
 
+#include <haproxy/api-t.h>
+#include <haproxy/list-t.h>
 
-/* an element of the <buffer_wq> list. It represents an object that need to
+/* Criticality of a buffer allocation, which decides in what buffer wait queue
+ * the requester waits. Queues are served from the most critical to the least
+ * critical one. Waiters which will help release buffers soon, typically by
+ * delivering a response, are served first, and those which would only start
+ * new work are served last, so that a few bulk transfers cannot starve the
+ * other streams when buffers run short.
+ */
+enum dynbuf_crit {
+	DB_CRIT_RES = 0,   /* response path, will release buffers soon */
+	DB_CRIT_DEFAULT,   /* any other use */
+	DB_CRIT_NEW,       /* input of an idle connection, starts new work */
+	DB_CRIT_COUNT      /* must be last */
+};
+
+/* an element of the <buffer_wq> lists. It represents an object that need to
  * acquire a buffer to continue its process. */
 struct buffer_wait {
 	void *target;              /* The waiting object that should be woken up */
 	int (*wakeup_cb)(void *);  /* The function used to wake up the <target>, passed as argument */
 	struct list list;          /* Next element in the <buffer_wq> list */
+	uint64_t since;            /* date the object was queued (ns), see b_queue() */
 };
 
 #endif /* _HAPROXY_DYNBUF_T_H */
@@ -35,8 +35,12 @@
 #include <haproxy/pool.h>
 
 extern struct pool_head *pool_head_buffer;
+extern struct pool_head *pool_head_small_buffer;
+extern struct pool_head *pool_head_large_buffer;
+extern unsigned int idle_conn_bufs;
 
 int init_buffer();
+void b_queue(enum dynbuf_crit crit, struct buffer_wait *wait);
 void buffer_dump(FILE *o, struct buffer *b, int from, int to);
 
 /*****************************************************************/
@@ -79,19 +83,146 @@ static inline struct buffer *b_alloc(struct buffer *buf)
 	return buf;
 }
 
+/* Returns non-zero if <buf> is allocated from the small buffers pool. */
+static inline int b_is_small(const struct buffer *buf)
+{
+	return pool_head_small_buffer && buf->size == pool_head_small_buffer->size;
+}
+
+/* Tries to allocate a small buffer into <buf> if it is not allocated yet.
+ * Contrary to b_alloc(), nothing is allocated and NULL is returned if small
+ * buffers are disabled, in which case the caller is expected to fall back to
+ * b_alloc(). NULL is also returned if no memory is available. Otherwise the
+ * buffer is returned. Small buffers must never be exchanged with regular
+ * ones, and must be grown using b_grow() before they can be passed to a
+ * function expecting a regular buffer.
+ */
+static inline struct buffer *b_alloc_small(struct buffer *buf)
+{
+	char *area;
+
+	if (buf->size)
+		return buf;
+
+	if (!pool_head_small_buffer)
+		return NULL;
+
+	area = __pool_alloc(pool_head_small_buffer, POOL_F_NO_POISON);
+	if (unlikely(!area))
+		return NULL;
+
+	buf->area = area;
+	buf->size = pool_head_small_buffer->size;
+	return buf;
+}
+
+/* Ensures that <buf> is a regular buffer, either by allocating it if it is
+ * not allocated yet, or by moving its contents from a small buffer to a
+ * regular one. The head offset is preserved. If no memory is available, NULL
+ * is returned and <buf> is left unmodified. Otherwise the buffer is returned.
+ */
+static inline struct buffer *b_grow(struct buffer *buf)
+{
+	struct buffer tmp;
+	char *area;
+
+	if (!b_is_small(buf))
+		return b_alloc(buf);
+
+	area = __pool_alloc(pool_head_buffer, POOL_F_NO_POISON);
+	if (unlikely(!area)) {
+		activity[tid].buf_wait++;
+		return NULL;
+	}
+
+	tmp = b_make(area, pool_head_buffer->size, b_head_ofs(buf), 0);
+	__b_putblk(&tmp, b_head(buf), b_contig_data(buf, 0));
+	__b_putblk(&tmp, b_orig(buf), b_data(buf) - b_contig_data(buf, 0));
+
+	area = buf->area;
+	*buf = tmp;
+	__ha_barrier_store();
+	pool_free(pool_head_small_buffer, area);
+	return buf;
+}
+
+/* Returns non-zero if <buf> is allocated from the large buffers pool. */
+static inline int b_is_large(const struct buffer *buf)
+{
+	return pool_head_large_buffer && buf->size == pool_head_large_buffer->size;
+}
+
+/* Tries to allocate a large buffer into <buf> if it is not allocated yet.
+ * NULL is returned if large buffers are disabled, if their limit was reached
+ * or if no memory is available, in which case the caller is expected to fall
+ * back to b_alloc(). Otherwise the buffer is returned. Large buffers must only
+ * be used where nothing depends on the buffers' size.
+ */
+static inline struct buffer *b_alloc_large(struct buffer *buf)
+{
+	char *area;
+
+	if (buf->size)
+		return buf;
+
+	if (!pool_head_large_buffer)
+		return NULL;
+
+	area = __pool_alloc(pool_head_large_buffer, POOL_F_NO_POISON);
+	if (unlikely(!area))
+		return NULL;
+
+	buf->area = area;
+	buf->size = pool_head_large_buffer->size;
+	return buf;
+}
+
+/* Moves the contents of regular buffer <buf> to a large buffer, preserving the
+ * head offset. Nothing is done and NULL is returned if <buf> is not a regular
+ * buffer or if no large buffer is available, otherwise the buffer is returned.
+ */
+static inline struct buffer *b_grow_large(struct buffer *buf)
+{
+	struct buffer tmp;
+	char *area;
+
+	if (!pool_head_large_buffer || buf->size != pool_head_buffer->size)
+		return NULL;
+
+	area = __pool_alloc(pool_head_large_buffer, POOL_F_NO_POISON);
+	if (unlikely(!area))
+		return NULL;
+
+	tmp = b_make(area, pool_head_large_buffer->size, b_head_ofs(buf), 0);
+	__b_putblk(&tmp, b_head(buf), b_contig_data(buf, 0));
+	__b_putblk(&tmp, b_orig(buf), b_data(buf) - b_contig_data(buf, 0));
+
+	area = buf->area;
+	*buf = tmp;
+	__ha_barrier_store();
+	pool_free(pool_head_buffer, area);
+	return buf;
+}
+
 /* Releases buffer <buf> (no check of emptiness). The buffer's head is marked
  * empty.
  */
 static inline void __b_free(struct buffer *buf)
 {
+	struct pool_head *pool = pool_head_buffer;
 	char *area = buf->area;
 
+	if (b_is_small(buf))
+		pool = pool_head_small_buffer;
+	else if (b_is_large(buf))
+		pool = pool_head_large_buffer;
+
 	/* let's first clear the area to save an occasional "show sess all"
 	 * glancing over our shoulder from getting a dangling pointer.
 	 */
 	*buf = BUF_NULL;
 	__ha_barrier_store();
-	pool_free(pool_head_buffer, area);
+	pool_free(pool, area);
 }
 
 /* Releases buffer <buf> if allocated, and marks it empty. */
@@ -106,13 +237,16 @@ static inline void b_free(struct buffer *buf)
  * to avoid passing a buffer to oneself in case of failed allocations (e.g.
  * need two buffers, get one, fail, release it and wake up self again). In case
  * of normal buffer release where it is expected that the caller is not waiting
- * for a buffer, NULL is fine. It will wake waiters on the current thread only.
+ * for a buffer, NULL is fine. It will wake waiters on the current thread only,
+ * the most critical ones first.
  */
 void __offer_buffers(void *from, unsigned int count);
 
 static inline void offer_buffers(void *from, unsigned int count)
 {
-	if (!LIST_ISEMPTY(&ti->buffer_wq))
+	if (!LIST_ISEMPTY(&ti->buffer_wq[DB_CRIT_RES]) ||
+	    !LIST_ISEMPTY(&ti->buffer_wq[DB_CRIT_DEFAULT]) ||
+	    !LIST_ISEMPTY(&ti->buffer_wq[DB_CRIT_NEW]))
 		__offer_buffers(from, count);
 }
 
@@ -30,6 +30,7 @@
 struct task *process_chk_proc(struct task *t, void *context, unsigned int state);
 int prepare_external_check(struct check *check);
 int init_pid_list(void);
+int init_extcheck_runners(struct proxy *px);
 
 int proxy_parse_extcheck(char **args, int section, struct proxy *curpx,
                          struct proxy *defpx, const char *file, int line,
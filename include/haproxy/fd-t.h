@@ -142,8 +142,14 @@ struct fdlist {
 	int last;
 } ALIGNED(8);
 
-/* info about one given fd. Note: only align on cache lines when using threads;
- * 32-bit small archs can put everything in 32-bytes when threads are disabled.
+/* info about one given fd. This is the part that the pollers and the I/O
+ * paths touch for every event, so it is kept dense instead of being aligned
+ * on cache lines: with 48 bytes per entry, 4 FDs fit in 3 cache lines instead
+ * of 4, and the pollers prefetch the next reported FD while processing the
+ * current one. The update tracking which is only touched when changing the
+ * polling status lives in a separate array (fdupd). The entry must remain
+ * 16-aligned so that the double-word CAS on running_mask+thread_mask never
+ * crosses its natural alignment.
  *
  * NOTE: DO NOT REORDER THIS STRUCT AT ALL! Some code parts rely on exact field
  * ordering, for example fd_takeover() and fd_set_running() want running_mask
@@ -152,15 +158,19 @@ struct fdlist {
 struct fdtab {
 	unsigned long running_mask;          /* mask of thread IDs currently using the fd */
 	unsigned long thread_mask;           /* mask of thread IDs authorized to process the fd */
-	unsigned long update_mask;           /* mask of thread IDs having an update for fd */
-	struct fdlist_entry update;          /* Entry in the global update list */
 	void (*iocb)(int fd);                /* I/O handler */
 	void *owner;                         /* the connection or listener associated with this fd, NULL if closed */
 	unsigned int state;                  /* FD state for read and write directions (FD_EV_*) + FD_POLL_* */
 #ifdef DEBUG_FD
 	unsigned int event_count;            /* number of events reported */
 #endif
-} THREAD_ALIGNED(64);
+} ALIGNED(16);
+
+/* polling updates pending for one given fd, indexed like fdtab */
+struct fdupd {
+	unsigned long update_mask;           /* mask of thread IDs having an update for fd */
+	struct fdlist_entry update;          /* Entry in the global update list */
+};
 
 /* polled mask, one bit per thread and per direction for each FD */
 struct polled_mask {
@@ -42,6 +42,7 @@ extern int nbpollers;
 extern struct poller pollers[MAX_POLLERS];   /* all registered pollers */
 extern struct fdtab *fdtab;             /* array of all the file descriptors */
 extern struct fdinfo *fdinfo;           /* less-often used infos for file descriptors */
+extern struct fdupd *fdupd;             /* pending polling updates for file descriptors */
 extern int totalconn;                   /* total # of terminated sessions */
 extern int actconn;                     /* # of active sessions */
 
@@ -126,17 +127,17 @@ static inline void done_update_polling(int fd)
 {
 	unsigned long update_mask;
 
-	update_mask = _HA_ATOMIC_AND_FETCH(&fdtab[fd].update_mask, ~tid_bit);
+	update_mask = _HA_ATOMIC_AND_FETCH(&fdupd[fd].update_mask, ~tid_bit);
 	while ((update_mask & all_threads_mask)== 0) {
 		/* If we were the last one that had to update that entry, remove it from the list */
-		fd_rm_from_fd_list(&update_list, fd, offsetof(struct fdtab, update));
-		update_mask = (volatile unsigned long)fdtab[fd].update_mask;
+		fd_rm_from_fd_list(&update_list, fd, offsetof(struct fdupd, update));
+		update_mask = (volatile unsigned long)fdupd[fd].update_mask;
 		if ((update_mask & all_threads_mask) != 0) {
 			/* Maybe it's been re-updated in the meanwhile, and we
 			 * wrongly removed it from the list, if so, re-add it
 			 */
-			fd_add_to_fd_list(&update_list, fd, offsetof(struct fdtab, update));
-			update_mask = (volatile unsigned long)(fdtab[fd].update_mask);
+			fd_add_to_fd_list(&update_list, fd, offsetof(struct fdupd, update));
+			update_mask = (volatile unsigned long)(fdupd[fd].update_mask);
 			/* And then check again, just in case after all it
 			 * should be removed, even if it's very unlikely, given
 			 * the current thread wouldn't have been able to take
@@ -147,6 +148,16 @@ static inline void done_update_polling(int fd)
 	}
 }
 
+/* Called by the pollers while processing an event to start fetching the
+ * fdtab entry of the next reported FD <fd>, which will be written to. Invalid
+ * values (e.g. internal events) are silently ignored.
+ */
+static inline void fd_prefetch(int fd)
+{
+	if ((unsigned int)fd < (unsigned int)global.maxsock)
+		__builtin_prefetch(&fdtab[fd], 1);
+}
+
 /*
  * returns true if the FD is active for recv
  */
@@ -415,10 +426,10 @@ static inline void fd_update_events(int fd, uint evts)
 	/* we had to stop this FD and it still must be stopped after the I/O
 	 * cb's changes, so let's program an update for this.
 	 */
-	if (must_stop && !(fdtab[fd].update_mask & tid_bit)) {
+	if (must_stop && !(fdupd[fd].update_mask & tid_bit)) {
 		if (((must_stop & FD_POLL_IN)  && !fd_recv_active(fd)) ||
 		    ((must_stop & FD_POLL_OUT) && !fd_send_active(fd)))
-			if (!HA_ATOMIC_BTS(&fdtab[fd].update_mask, tid))
+			if (!HA_ATOMIC_BTS(&fdupd[fd].update_mask, tid))
 				fd_updt[fd_nbupdt++] = fd;
 	}
 
@@ -70,6 +70,11 @@
 #define GTUNE_FD_ET              (1<<18)
 #define GTUNE_SCHED_LOW_LATENCY  (1<<19)
 #define GTUNE_IDLE_POOL_SHARED   (1<<20)
+#define GTUNE_USE_URING          (1<<21)
+#define GTUNE_SCHED_WORK_STEALING (1<<22)
+#define GTUNE_ACL_SAMPLE_CACHE   (1<<23)
+#define GTUNE_ACL_REORDER        (1<<24)
+#define GTUNE_IDLE_POOL_INHERIT  (1<<25)
 
 /* SSL server verify mode */
 enum {
@@ -77,6 +82,12 @@ enum {
 	SSL_SERVER_VERIFY_REQUIRED = 1,
 };
 
+/* thread placement policy ("cpu-policy") */
+enum {
+	CPU_POLICY_NONE = 0,    /* only "cpu-map" binds threads */
+	CPU_POLICY_AUTO = 1,    /* threads are bound based on the CPU topology */
+};
+
 /* bit values to go with "warned" above */
 #define WARN_ANY                    0x00000001 /* any warning was emitted */
 #define WARN_FORCECLOSE_DEPRECATED  0x00000002
@@ -91,6 +102,7 @@ struct global {
 	int gid;
 	int external_check;
 	int nbthread;
+	int nbtgroups;                  /* number of thread groups, 0 until set */
 	int mode;
 	unsigned int hard_stop_after;	/* maximum time allowed to perform a soft-stop */
 	int maxconn, hardmaxconn;
@@ -128,6 +140,9 @@ struct global {
 		int runqueue_depth;/* max number of tasks to run at once */
 		int recv_enough;   /* how many input bytes at once are "enough" */
 		int bufsize;       /* buffer size in bytes, defaults to BUFSIZE */
+		int bufsize_small; /* small buffer size in bytes, 0 = disabled */
+		int bufsize_large; /* large buffer size in bytes, 0 = disabled */
+		int large_buf_limit; /* max number of large buffers */
 		int maxrewrite;    /* buffer max rewrite size in bytes, defaults to MAXREWRITE */
 		int reserved_bufs; /* how many buffers can only be allocated for response */
 		int buf_limit;     /* if not null, how many total buffers may only be allocated */
@@ -136,6 +151,7 @@ struct global {
 		int server_sndbuf; /* set server sndbuf to this value if not null */
 		int server_rcvbuf; /* set server rcvbuf to this value if not null */
 		int pipesize;      /* pipe size in bytes, system defaults if zero */
+		int zerocopy_send; /* min send size to use MSG_ZEROCOPY, disabled if zero */
 		int max_http_hdr;  /* max number of HTTP headers, use MAX_HTTP_HDR if zero */
 		int requri_len;    /* max len of request URI, use REQURI_LEN if zero */
 		int cookie_len;    /* max length of cookie captures */
@@ -147,6 +163,7 @@ struct global {
 		int pool_low_count;   /* max number of opened fd before we stop using new idle connections */
 		int pool_high_count;  /* max number of opened fd before we start killing idle connections when creating new connections */
 		unsigned short idle_timer; /* how long before an empty buffer is considered idle (ms) */
+		unsigned int listener_rebalance; /* percent of extra conns on a thread before moving idle ones, 0=off */
 	} tune;
 	struct {
 		char *prefix;           /* path prefix of unix bind socket */
@@ -158,6 +175,7 @@ struct global {
 	} unix_bind;
 	struct proxy *cli_fe;           /* the frontend holding the stats settings */
 	int numa_cpu_mapping;
+	int cpu_policy;                 /* CPU_POLICY_*, how threads are bound to CPUs */
 	int cfg_curr_line;              /* line number currently being parsed */
 	const char *cfg_curr_file;      /* config file currently being parsed or NULL */
 	char *cfg_curr_section;         /* config section name currently being parsed or NULL */
@@ -63,6 +63,11 @@ int delete_oldpid(int pid);
 void hap_register_build_opts(const char *str, int must_free);
 int split_version(const char *version, unsigned int *value);
 int compare_current_version(const char *version);
+int startup_timing_start(const char *fmt, ...)
+	__attribute__ ((format(printf, 1, 2)));
+void startup_timing_stop(int idx);
+void startup_timing_add(uint64_t ns, const char *fmt, ...)
+	__attribute__ ((format(printf, 2, 3)));
 
 void mworker_accept_wrapper(int fd);
 void mworker_reload();
@@ -80,7 +80,10 @@ enum h2_ft {
 	H2_FT_GOAWAY          = 0x07,     // RFC7540 #6.8
 	H2_FT_WINDOW_UPDATE   = 0x08,     // RFC7540 #6.9
 	H2_FT_CONTINUATION    = 0x09,     // RFC7540 #6.10
-	H2_FT_ENTRIES /* must be last */
+	H2_FT_ENTRIES, /* must be last of the RFC7540 frames */
+
+	/* extension frames, not covered by h2_frame_definition[] */
+	H2_FT_PRIORITY_UPDATE = 0x10,     // RFC9218 #7.1
 } __attribute__((packed));
 
 /* frame types, turned to bits or bit fields */
@@ -236,6 +239,7 @@ static inline const char *h2_ft_str(int type)
 	case H2_FT_PING          : return "PING";
 	case H2_FT_GOAWAY        : return "GOAWAY";
 	case H2_FT_WINDOW_UPDATE : return "WINDOW_UPDATE";
+	case H2_FT_PRIORITY_UPDATE : return "PRIORITY_UPDATE";
 	default                  : return "_UNKNOWN_";
 	}
 }
@@ -66,6 +66,22 @@ struct stream;
 
 #define HLUA_CONCAT_BLOCSZ 2048
 
+/* Max sizes of the keys (including the trailing zero) and of the string values
+ * of core.shm.
+ */
+#define HLUA_SHM_KEY_LEN 64
+#define HLUA_SHM_VAL_LEN 192
+
+/* max number of entries of core.shm (tune.lua.shm-size) */
+#define HLUA_SHM_MAX_ENTRIES (1 << 20)
+
+enum hlua_shm_type {
+	HLUA_SHM_NIL = 0,  /* no value, or deleted */
+	HLUA_SHM_INT,      /* integer in <num> */
+	HLUA_SHM_BOOL,     /* boolean in <num> */
+	HLUA_SHM_STR,      /* string of <vlen> bytes in <str> */
+};
+
 enum hlua_exec {
 	HLUA_E_OK = 0,
 	HLUA_E_AGAIN,  /* LUA yield, must resume the stack execution later, when
@@ -98,6 +114,23 @@ struct hlua {
 	int gc_count;  /* number of items which need a GC */
 };
 
+/* A slot of core.shm, shared by all the Lua states. A slot is assigned to a
+ * key forever, its value becoming nil when deleted. <seq> is zero while the
+ * slot is free, odd while it is being written, and is incremented twice by
+ * each write, so that readers never lock but retry when a write happened
+ * while they were reading.
+ */
+struct hlua_shm_slot {
+	unsigned int seq;          /* sequence number, see above */
+	unsigned int hash;         /* hash of the key */
+	unsigned char klen;        /* length of the key */
+	unsigned char type;        /* enum hlua_shm_type */
+	unsigned short vlen;       /* length of the string value */
+	long long num;             /* integer or boolean value */
+	char key[HLUA_SHM_KEY_LEN];
+	char str[HLUA_SHM_VAL_LEN];
+};
+
 /* This is a part of the list containing references to functions
  * called at the initialisation time.
  */
@@ -33,9 +33,13 @@
 #include <haproxy/api.h>
 #include <haproxy/buf-t.h>
 #include <haproxy/http-t.h>
+#include <haproxy/hpack-tbl-t.h>
 
 int hpack_encode_header(struct buffer *out, const struct ist n,
 			const struct ist v);
+int hpack_encode_header_dht(struct buffer *out, struct hpack_dht *dht,
+			    const struct ist n, const struct ist v);
+int hpack_encode_dht_size_update(struct buffer *out, uint32_t size);
 
 /* Returns the number of bytes required to encode the string length <len>. The
  * number of usable bits is an integral multiple of 7 plus 6 for the last byte.
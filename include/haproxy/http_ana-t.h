@@ -183,9 +183,11 @@ struct http_txn {
 	/* 1 unused byte here */
 	short status;                   /* HTTP status from the server, negative if from proxy */
 	struct http_reply *http_reply;  /* The HTTP reply to use as reply */
+	struct buffer *req_body;        /* part of the request body being inspected by a filter, or NULL */
 
 	char cache_hash[20];               /* Store the cache hash  */
 	char cache_secondary_hash[HTTP_CACHE_SEC_KEY_LEN]; /* Optional cache secondary key. */
+	const char *cache_name;         /* name of the cache the response was directly built from, or NULL */
 	char *uri;                      /* first line if log needed, NULL otherwise */
 	char *cli_cookie;               /* cookie presented by the client, in capture mode */
 	char *srv_cookie;               /* cookie presented by the server, in capture mode */
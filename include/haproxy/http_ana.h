@@ -54,6 +54,7 @@ void http_server_error(struct stream *s, struct stream_interface *si, int err, i
 void http_reply_and_close(struct stream *s, short status, struct http_reply *msg);
 void http_return_srv_error(struct stream *s, struct stream_interface *si);
 struct http_reply *http_error_message(struct stream *s);
+struct http_reply *http_error_reply(struct stream *s, int status);
 int http_reply_to_htx(struct stream *s, struct htx *htx, struct http_reply *reply);
 int http_reply_message(struct stream *s, struct http_reply *reply);
 int http_forward_proxy_resp(struct stream *s, int final);
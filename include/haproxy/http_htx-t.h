@@ -68,6 +68,7 @@ struct http_reply {
 		char *http_errors;            /* The http-errors section to use (type = HTTP_REPLY_ERRFILES).
 					       * Should be resolved during post-check */
 	} body;
+	struct buffer tmpl;                   /* pre-built HTX message for constant replies, or BUF_NULL */
 	struct list list;  /* next http_reply in the global list.
 			    * Only used for replies defined in a proxy section */
 };
@@ -63,6 +63,7 @@ int http_str_to_htx(struct buffer *buf, struct ist raw, char **errmsg);
 
 void release_http_reply(struct http_reply *http_reply);
 int http_check_http_reply(struct http_reply *reply, struct proxy*px, char **errmsg);
+void http_reply_prebuild(struct http_reply *reply);
 struct http_reply *http_parse_http_reply(const char **args, int *orig_arg, struct proxy *px,
 					 int default_status, char **errmsg);
 
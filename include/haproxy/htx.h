@@ -53,6 +53,7 @@ struct htx_blk *htx_replace_header(struct htx *htx, struct htx_blk *blk,
 struct htx_ret htx_reserve_max_data(struct htx *htx);
 struct htx_blk *htx_add_data_atonce(struct htx *htx, struct ist data);
 size_t htx_add_data(struct htx *htx, const struct ist data);
+size_t htx_xfer_raw_data(struct buffer *buf, struct buffer *raw, size_t ofs, size_t len);
 struct htx_blk *htx_add_last_data(struct htx *htx, struct ist data);
 void htx_move_blk_before(struct htx *htx, struct htx_blk **blk, struct htx_blk **ref);
 int htx_append_msg(struct htx *dst, const struct htx *src);
@@ -721,9 +722,21 @@ static inline int htx_expect_more(const struct htx *htx)
  */
 static inline int htx_copy_msg(struct htx *htx, const struct buffer *msg)
 {
-	/* The destination HTX message is empty, we can do a raw copy */
+	const struct htx *src = htxbuf(msg);
+
+	/* The destination HTX message is empty, we can do a raw copy. When the
+	 * payloads do not wrap, the free space between them and the blocks
+	 * table is skipped.
+	 */
 	if (htx_is_empty(htx)) {
-		memcpy(htx, msg->area, msg->size);
+		if (!src->head_addr && src->tail >= 0) {
+			uint32_t tbl = htx_pos_to_addr(src, src->tail);
+
+			memcpy(htx, src, sizeof(*src) + src->tail_addr);
+			memcpy(htx->blocks + tbl, src->blocks + tbl, src->size - tbl);
+		}
+		else
+			memcpy(htx, msg->area, msg->size);
 		return 1;
 	}
 
@@ -0,0 +1,53 @@
+/*
+ * include/haproxy/lb_local-t.h
+ * Types for the per-thread approximate load-balancing mode.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, version 2.1
+ * exclusively.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _HAPROXY_LB_LOCAL_T_H
+#define _HAPROXY_LB_LOCAL_T_H
+
+#include <haproxy/api-t.h>
+#include <haproxy/server-t.h>
+#include <haproxy/thread-t.h>
+
+/* one server as seen by a thread */
+struct lb_local_srv {
+	struct server *srv;
+	int weight;		/* server's effective weight when the view was built */
+	int cw;			/* current weight for the smooth weighted round robin */
+};
+
+/* a thread's view of the usable servers of a backend */
+struct lb_local_thr {
+	struct lb_local_srv *srv; /* usable servers, <size> entries allocated */
+	unsigned int nb;	/* number of servers in the view */
+	unsigned int size;	/* number of entries allocated */
+	unsigned int gen;	/* generation of the servers' states the view was built from */
+	unsigned int next;	/* leastconn: first server to consider on next pick */
+} THREAD_ALIGNED(64);
+
+struct lb_local {
+	struct lb_local_thr *thr; /* per-thread views, indexed by tid */
+	unsigned int gen;	/* bumped on each server state or weight change */
+
+	/* callbacks of the underlying algorithm, still maintained */
+	void (*update_server_eweight)(struct server *);
+	void (*set_server_status_up)(struct server *);
+	void (*set_server_status_down)(struct server *);
+};
+
+#endif /* _HAPROXY_LB_LOCAL_T_H */
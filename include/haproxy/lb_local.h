@@ -0,0 +1,32 @@
+/*
+ * include/haproxy/lb_local.h
+ * Per-thread approximate load-balancing mode.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, version 2.1
+ * exclusively.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _HAPROXY_LB_LOCAL_H
+#define _HAPROXY_LB_LOCAL_H
+
+#include <haproxy/api.h>
+#include <haproxy/lb_local-t.h>
+#include <haproxy/proxy-t.h>
+#include <haproxy/server-t.h>
+
+int lb_local_init(struct proxy *p);
+void lb_local_deinit(struct proxy *p);
+struct server *lb_local_get_next_server(struct proxy *p, struct server *srvtoavoid);
+
+#endif /* _HAPROXY_LB_LOCAL_H */
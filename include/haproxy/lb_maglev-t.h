@@ -0,0 +1,35 @@
+/*
+ * include/haproxy/lb_maglev-t.h
+ * Types for Maglev consistent hashing load-balancing.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, version 2.1
+ * exclusively.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _HAPROXY_LB_MAGLEV_T_H
+#define _HAPROXY_LB_MAGLEV_T_H
+
+#include <haproxy/api-t.h>
+#include <haproxy/server-t.h>
+#include <haproxy/thread-t.h>
+
+struct lb_maglev {
+	struct server **table;	/* lookup table of <size> entries, indexed by the hash */
+	struct server **spare;	/* table being rebuilt, swapped with <table> once done */
+	unsigned int size;	/* number of entries of the tables, a prime number */
+	unsigned int rr_idx;	/* next entry to be elected in round robin mode */
+	__decl_thread(HA_SPINLOCK_T lock); /* serializes the rebuilds */
+};
+
+#endif /* _HAPROXY_LB_MAGLEV_T_H */
@@ -94,6 +94,9 @@ enum li_status {
 };
 
 /* listener socket options */
+/* special value of bind_conf->nb_shards: one shard per L3 cache domain */
+#define BC_SHARDS_BY_CACHE      (~0U)
+
 #define LI_O_NONE               0x0000
 #define LI_O_NOLINGER           0x0001  /* disable linger on this socket */
 /* unused                       0x0002  */
@@ -120,6 +123,7 @@ enum li_status {
 #define BC_SSL_O_NONE           0x0000
 #define BC_SSL_O_NO_TLS_TICKETS 0x0100	/* disable session resumption tickets */
 #define BC_SSL_O_PREF_CLIE_CIPH 0x0200  /* prefer client ciphers */
+#define BC_SSL_O_KTLS           0x0400  /* offload records encryption to the kernel */
 #endif
 
 struct tls_version_filter {
@@ -179,6 +183,7 @@ struct bind_conf {
 #endif
 #ifdef USE_QUIC
 	struct quic_transport_params quic_params; /* QUIC transport parameters. */
+	struct quic_cc_algo *quic_cc_algo; /* QUIC congestion control algorithm, NULL for the default one */
 #endif
 	struct proxy *frontend;    /* the frontend all these listeners belong to, or NULL */
 	const struct mux_proto_list *mux_proto; /* the mux to use for all incoming connections (specified by the "proto" keyword) */
@@ -193,6 +198,7 @@ struct bind_conf {
 	char *arg;                 /* argument passed to "bind" for better error reporting */
 	char *file;                /* file where the section appears */
 	int line;                  /* line where the section appears */
+	unsigned int nb_shards;    /* number of listeners per address, one per thread at most (0/1 = one), or BC_SHARDS_BY_CACHE */
 	__decl_thread(HA_RWLOCK_T sni_lock); /* lock the SNI trees during add/del operations */
 	struct rx_settings settings; /* all the settings needed for the listening socket */
 };
@@ -98,6 +98,13 @@ void unbind_listener(struct listener *listener);
 int create_listeners(struct bind_conf *bc, const struct sockaddr_storage *ss,
                      int portl, int porth, int fd, struct protocol *proto, char **err);
 
+/* Splits each listener of bind_conf <bc> into as many listeners as requested
+ * by its "shards" setting, each bound to its own socket and to a part of the
+ * bind_conf's threads. Returns non-zero on success, zero on error with the
+ * error message set in <err>.
+ */
+int bind_conf_create_shards(struct bind_conf *bc, char **err);
+
 /* Delete a listener from its protocol's list of listeners. The listener's
  * state is automatically updated from LI_ASSIGNED to LI_INIT. The protocol's
  * number of listeners is updated. Note that the listener must have previously
@@ -118,6 +125,12 @@ void listener_accept(struct listener *l);
  */
 int listener_backlog(const struct listener *l);
 
+/* Returns the thread which runs the fewest connections of listener <l> if the
+ * current thread runs too many more of them according to the global setting
+ * "tune.listener.rebalance", otherwise -1.
+ */
+int listener_lighter_thread(const struct listener *l);
+
 /* Notify the listener that a connection initiated from it was released. This
  * is used to keep the connection count consistent and to possibly re-open
  * listening when it was limited.
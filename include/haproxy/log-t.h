@@ -27,6 +27,7 @@
 #include <netinet/in.h>
 
 #include <haproxy/api-t.h>
+#include <haproxy/freq_ctr-t.h>
 #include <haproxy/ring-t.h>
 #include <haproxy/thread-t.h>
 
@@ -46,6 +47,7 @@
 #define LOG_OPT_HTTP            0x00000020
 #define LOG_OPT_ESC             0x00000040
 #define LOG_OPT_MERGE_SPACES    0x00000080
+#define LOG_OPT_TXT_SEP         0x00000100 /* internal: the text ends with a merged separator */
 
 
 /* Fields that need to be extracted from the incoming connection or request for
@@ -82,6 +84,7 @@ enum log_fmt {
 	LOG_FORMAT_TIMED,
 	LOG_FORMAT_ISO,
 	LOG_FORMAT_RAW,
+	LOG_FORMAT_CBOR,
 	LOG_FORMATS           /* number of supported log formats, must always be last */
 };
 
@@ -198,6 +201,7 @@ struct logformat_node {
 	int type;      // LOG_FMT_*
 	int options;   // LOG_OPT_*
 	char *arg;     // text for LOG_FMT_TEXT, arg for others
+	size_t arg_len; // length of <arg> for LOG_FMT_TEXT
 	void *expr;    // for use with LOG_FMT_EXPR
 };
 
@@ -224,10 +228,21 @@ struct smp_info {
 	                            */
 };
 
+/* Adaptive log sampling: lines which are not errors nor slow are randomly
+ * dropped so that the target receives about <rate> lines per second.
+ */
+struct smp_budget {
+	unsigned int rate;         /* target number of lines per second, 0=disabled */
+	unsigned int slow;         /* lines slower than this (ms) are always kept, 0=none */
+	struct freq_ctr forced;    /* lines always kept (errors, slow) */
+	struct freq_ctr cand;      /* lines subject to sampling */
+};
+
 struct logsrv {
 	struct list list;
 	struct sockaddr_storage addr;
 	struct smp_info lb;
+	struct smp_budget budget;
 	struct sink *sink;
 	char *ring_name;
 	enum log_tgt type;
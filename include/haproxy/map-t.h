@@ -22,6 +22,7 @@
 #ifndef _HAPROXY_MAP_T_H
 #define _HAPROXY_MAP_T_H
 
+#include <haproxy/map_bin-t.h>
 #include <haproxy/pattern-t.h>
 #include <haproxy/sample-t.h>
 
@@ -29,6 +30,7 @@ struct map_descriptor {
 	struct sample_conv *conv;      /* original converter descriptor */
 	struct pattern_head pat;       /* the pattern matching associated to the map */
 	int do_free;                   /* set if <pat> is the original pat and must be freed */
+	struct map_bin *bin;           /* compiled map used instead of <pat>, or NULL */
 };
 
 #endif /* _HAPROXY_MAP_T_H */
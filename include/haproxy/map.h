@@ -22,6 +22,7 @@
 #ifndef _HAPROXY_MAP_H
 #define _HAPROXY_MAP_H
 
+#include <import/ist.h>
 #include <haproxy/map-t.h>
 #include <haproxy/sample-t.h>
 
@@ -35,5 +36,6 @@ struct map_reference *map_get_reference(const char *reference);
 
 int sample_load_map(struct arg *arg, struct sample_conv *conv,
                     const char *file, int line, char **err);
+int map_bin_lookup(const struct map_bin *bin, const struct sample *smp, struct ist *val);
 
 #endif /* _HAPROXY_MAP_H */
@@ -0,0 +1,85 @@
+/*
+ * include/haproxy/map_bin-t.h
+ * This file provides the on-disk format of compiled maps, which are produced
+ * from text maps by admin/mapc and memory-mapped by the map converters.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, version 2.1
+ * exclusively.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _HAPROXY_MAP_BIN_T_H
+#define _HAPROXY_MAP_BIN_T_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* A compiled map starts with a header, followed by arrays of fixed-size
+ * entries sorted by key, and by a blob holding the strings. All integers are
+ * in the host's byte order, which is checked using <bom>, so that a file must
+ * be compiled on a machine of the same endianness. Offsets in the header are
+ * relative to the beginning of the file and are aligned to 8 bytes. String
+ * offsets in the entries are relative to the blob. Values are always followed
+ * by a zero, which is not counted in their length.
+ */
+#define MAP_BIN_MAGIC    "HAPMAPB1"
+#define MAP_BIN_BOM      0x01020304U
+
+/* types of keys */
+#define MAP_BIN_T_STR    1           /* exact strings, sorted by memcmp() then length */
+#define MAP_BIN_T_IP     2           /* IPv4 and IPv6 ranges, not overlapping */
+
+struct map_bin_hdr {
+	char magic[8];                /* MAP_BIN_MAGIC, without the trailing zero */
+	uint32_t bom;                 /* MAP_BIN_BOM */
+	uint32_t type;                /* MAP_BIN_T_* */
+	uint32_t nb_str;              /* number of string entries */
+	uint32_t nb_ip4;              /* number of IPv4 ranges */
+	uint32_t nb_ip6;              /* number of IPv6 ranges */
+	uint32_t reserved;
+	uint64_t str_ofs;             /* offset of the struct map_bin_str array */
+	uint64_t ip4_ofs;             /* offset of the struct map_bin_ip4 array */
+	uint64_t ip6_ofs;             /* offset of the struct map_bin_ip6 array */
+	uint64_t blob_ofs;            /* offset of the strings */
+	uint64_t blob_len;            /* length of the strings */
+};
+
+struct map_bin_str {
+	uint32_t key_ofs, key_len;    /* key */
+	uint32_t val_ofs, val_len;    /* associated value */
+};
+
+/* IPv4 range from <from> to <to> inclusive, in host byte order */
+struct map_bin_ip4 {
+	uint32_t from, to;
+	uint32_t val_ofs, val_len;
+};
+
+/* IPv6 range from <from> to <to> inclusive, in network byte order */
+struct map_bin_ip6 {
+	uint8_t from[16], to[16];
+	uint32_t val_ofs, val_len;
+};
+
+/* A compiled map as mapped in memory */
+struct map_bin {
+	const char *area;             /* the mapped file */
+	size_t size;                  /* its size */
+	const struct map_bin_hdr *hdr;
+	const struct map_bin_str *str;
+	const struct map_bin_ip4 *ip4;
+	const struct map_bin_ip6 *ip6;
+	const char *blob;
+};
+
+#endif /* _HAPROXY_MAP_BIN_T_H */
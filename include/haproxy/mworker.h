@@ -43,4 +43,10 @@ void mworker_kill_max_reloads(int sig);
 
 void mworker_free_child(struct mworker_proc *);
 
+void mworker_stats_init();
+void mworker_stats_to_env();
+void mworker_stats_assign(int pid);
+void mworker_stats_release(int pid);
+void mworker_stats_attach();
+
 #endif /* _HAPROXY_MWORKER_H_ */
@@ -55,6 +55,7 @@ static inline const char *obj_type_name(const enum obj_type *t)
 	case OBJ_TYPE_CS:       return "CS";
 	case OBJ_TYPE_STREAM:   return "STREAM";
 	case OBJ_TYPE_CHECK:    return "CHECK";
+	case OBJ_TYPE_RESOLV_CACHE: return "RESOLV_CACHE";
 	default:                return "!INVAL!";
 	}
 }
@@ -186,6 +187,18 @@ static inline struct check *objt_check(enum obj_type *t)
 	return __objt_check(t);
 }
 
+static inline struct resolv_cache_entry *__objt_resolv_cache(enum obj_type *t)
+{
+	return container_of(t, struct resolv_cache_entry, obj_type);
+}
+
+static inline struct resolv_cache_entry *objt_resolv_cache(enum obj_type *t)
+{
+	if (!t || *t != OBJ_TYPE_RESOLV_CACHE)
+		return NULL;
+	return __objt_resolv_cache(t);
+}
+
 static inline void *obj_base_ptr(enum obj_type *t)
 {
 	switch (obj_type(t)) {
@@ -200,6 +213,7 @@ static inline void *obj_base_ptr(enum obj_type *t)
 	case OBJ_TYPE_CS:       return __objt_cs(t);
 	case OBJ_TYPE_STREAM:   return __objt_stream(t);
 	case OBJ_TYPE_CHECK:    return __objt_check(t);
+	case OBJ_TYPE_RESOLV_CACHE: return __objt_resolv_cache(t);
 	default:                return t; // exact pointer for invalid case
 	}
 }
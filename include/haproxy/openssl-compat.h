@@ -79,6 +79,19 @@
 #define HAVE_SSL_KEYLOG
 #endif
 
+/* kernel TLS offload, only supported on Linux with OpenSSL 3.0 and above */
+#if defined(__linux__) && defined(SSL_OP_ENABLE_KTLS) && !defined(OPENSSL_NO_KTLS)
+#define HAVE_SSL_KTLS
+#endif
+
+/* private key operations run by worker threads in async mode, which relies on
+ * the RSA and EC_KEY methods and on eventfd.
+ */
+#if defined(__linux__) && defined(USE_THREAD) && defined(SSL_MODE_ASYNC) && \
+    (HA_OPENSSL_VERSION_NUMBER >= 0x10100000L) && !defined(LIBRESSL_VERSION_NUMBER) && !defined(OPENSSL_IS_BORINGSSL)
+#define HAVE_SSL_ASYNC_WORKERS
+#endif
+
 #if (HA_OPENSSL_VERSION_NUMBER < 0x0090800fL)
 /* Functions present in OpenSSL 0.9.8, older not tested */
 static inline const unsigned char *SSL_SESSION_get_id(const SSL_SESSION *sess, unsigned int *sid_length)
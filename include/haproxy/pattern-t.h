@@ -95,6 +95,7 @@ enum {
 #define PAT_REF_MAP 0x1 /* Set if the reference is used by at least one map. */
 #define PAT_REF_ACL 0x2 /* Set if the reference is used by at least one acl. */
 #define PAT_REF_SMP 0x4 /* Flag used if the reference contains a sample. */
+#define PAT_REF_INDEXED 0x8 /* Set if an external index was built from the patterns (see pat_ref_indexed_rev). */
 
 /* This struct contain a list of reference strings for dunamically
  * updatable patterns.
@@ -183,6 +184,10 @@ struct pattern_list {
 	struct pattern pat;
 };
 
+struct pat_acm;
+struct pat_regset;
+struct pat_ipidx;
+
 /* Description of a pattern expression.
  * It contains pointers to the parse and match functions, and a list or tree of
  * patterns to test against. The structure is organized so that the hot parts
@@ -200,6 +205,16 @@ struct pattern_expr {
 	struct eb_root pattern_tree;  /* may be used for lookup in large datasets */
 	struct eb_root pattern_tree_2;  /* may be used for different types */
 	int mflags;                     /* flags relative to the parsing or matching method. */
+	struct pat_acm *acm;            /* automaton over the list's strings for beg/sub/end, or NULL */
+	struct pat_regset *regset;      /* combined regex over the list's regex for reg, or NULL */
+	struct pat_ipidx *ipidx;        /* flat index of the trees for ip, or NULL */
+	unsigned int cidx_busy;         /* non-zero while an index is being built or failed to */
+	unsigned int cidx_date;         /* date in seconds of the last change to the patterns */
+	unsigned int lru_off;           /* non-zero when lookups bypass the pattern cache */
+	unsigned long long lru_calls;   /* lookups which could use the pattern cache */
+	unsigned long long lru_hits;    /* lookups answered by the pattern cache */
+	unsigned long long lru_misses;  /* lookups not found in the pattern cache */
+	unsigned long long lru_cost[2]; /* cycles spent in probes without/with the cache */
 	__decl_thread(HA_RWLOCK_T lock);               /* lock used to protect patterns */
 };
 
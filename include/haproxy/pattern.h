@@ -39,6 +39,7 @@ extern struct pattern *(*const pat_match_fcts[PAT_MATCH_NUM])(struct sample *, s
 
 /* This is the root of the list of all pattern_ref avalaibles. */
 extern struct list pattern_reference;
+extern unsigned int pat_ref_indexed_rev;
 
 int pattern_finalize_config(void);
 
@@ -74,6 +75,8 @@ int pat_idx_list_regm(struct pattern_expr *expr, struct pattern *pat, char **err
 int pat_idx_tree_ip(struct pattern_expr *expr, struct pattern *pat, char **err);
 int pat_idx_tree_str(struct pattern_expr *expr, struct pattern *pat, char **err);
 int pat_idx_tree_pfx(struct pattern_expr *expr, struct pattern *pat, char **err);
+int pat_idx_tree_sfx(struct pattern_expr *expr, struct pattern *pat, char **err);
+int pat_idx_tree_dom(struct pattern_expr *expr, struct pattern *pat, char **err);
 
 /*
  *
@@ -178,6 +181,9 @@ struct pattern *pat_match_regm(struct sample *smp, struct pattern_expr *expr, in
  */
 struct pat_ref *pat_ref_lookup(const char *reference);
 struct pat_ref *pat_ref_lookupid(int unique_id);
+unsigned long long pat_ref_mem_usage(struct pat_ref *ref, unsigned int *elts);
+void pat_ref_lru_stats(struct pat_ref *ref, unsigned long long *hits,
+                       unsigned long long *misses, unsigned long long *bypassed);
 struct pat_ref *pat_ref_new(const char *reference, const char *display, unsigned int flags);
 struct pat_ref *pat_ref_newid(int unique_id, const char *display, unsigned int flags);
 struct pat_ref_elt *pat_ref_find_elt(struct pat_ref *ref, const char *key);
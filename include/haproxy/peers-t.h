@@ -50,6 +50,8 @@ struct shared_table {
 
 struct peer {
 	int local;                    /* proxy state */
+	int hub;                      /* non-zero if this peer relays the updates of the others */
+	unsigned int relay_id;        /* non-zero identifier of this peer in its section */
 	__decl_thread(HA_SPINLOCK_T lock); /* lock used to handle this peer section */
 	char *id;
 	struct {
@@ -62,6 +64,7 @@ struct peer {
 	struct xprt_ops *xprt;        /* peer socket operations at transport layer */
 	void *sock_init_arg;          /* socket operations's opaque init argument if needed */
 	unsigned int flags;           /* peer session flags */
+	unsigned int dwngrd;          /* number of minor versions to step down when announcing the protocol version */
 	unsigned int statuscode;      /* current/last session status code */
 	unsigned int reconnect;       /* next connect timer */
 	unsigned int heartbeat;       /* next heartbeat timer */
@@ -99,6 +102,7 @@ struct peers {
 	unsigned int flags;             /* current peers section resync state */
 	unsigned int resync_timeout;    /* resync timeout timer */
 	int count;                      /* total of peers */
+	int nb_hubs;                    /* number of hubs, 0 for a full mesh */
 	int disabled;                   /* peers proxy disabled if >0 */
 };
 
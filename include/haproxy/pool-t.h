@@ -45,6 +45,7 @@
 
 #define MEM_F_SHARED	0x1
 #define MEM_F_EXACT	0x2
+#define MEM_F_NUMA	0x4	/* objects are tagged with their NUMA node */
 
 /* By default, free objects are linked by a pointer stored at the beginning of
  * the memory area. When DEBUG_MEMORY_POOLS is set, the allocated area is
@@ -61,6 +62,15 @@
 #define POOL_LINK(pool, item) ((void **)(item))
 #endif
 
+/* On NUMA systems, a byte is appended after the objects (and after the link
+ * above if any) to store the node of the thread which allocated them from the
+ * OS, or POOL_NODE_ANY when not known. Objects released by a thread running
+ * on another node are returned to their node's free list instead of being
+ * kept in the releasing thread's local cache.
+ */
+#define POOL_NODE_ANY 0xff
+#define POOL_NODE(pool, item) (((unsigned char *)(item)) + ((pool)->size) + POOL_EXTRA)
+
 /* A special pointer for the pool's free_list that indicates someone is
  * currently manipulating it. Serves as a short-lived lock.
  */
@@ -68,6 +78,12 @@
 
 #define POOL_AVG_SAMPLES 1024
 
+/* When tune.pool-hugepages is set, pools of objects at least this large are
+ * carved from a dedicated area backed by huge pages of this size.
+ */
+#define POOL_HUGE_PAGE_SIZE  (2UL * 1024 * 1024)
+#define POOL_HUGE_MIN_SIZE   128
+
 /* possible flags for __pool_alloc() */
 #define POOL_F_NO_POISON    0x00000001  // do not poison the area
 #define POOL_F_MUST_ZERO    0x00000002  // zero the returned area
@@ -79,6 +95,11 @@ struct pool_cache_head {
 	unsigned int count;  /* number of objects in this pool */
 } THREAD_ALIGNED(64);
 
+/* per-NUMA node list of free objects */
+struct pool_node_head {
+	void **free_list;    /* free objects belonging to this node */
+} THREAD_ALIGNED(64);
+
 struct pool_cache_item {
 	struct list by_pool; /* link to objects in this pool */
 	struct list by_lru;  /* link to objects by LRU order */
@@ -96,9 +117,14 @@ struct pool_head {
 	unsigned int users;	/* number of pools sharing this zone */
 	unsigned int failed;	/* failed allocations */
 	/* 32-bit hole here */
+	char *huge_area;	/* huge-page backed area, NULL if unused yet, MAP_FAILED if unusable */
+	size_t huge_size;	/* size of the huge area in bytes */
+	size_t huge_next;	/* offset of the first never allocated object in the huge area */
+	void **huge_free;	/* free objects returned to the huge area */
 	struct list list;	/* list of all known pools */
 	char name[12];		/* name of the pool */
 #ifdef CONFIG_HAP_POOLS
+	struct pool_node_head nodes[HA_MAX_NODES]; /* per-node free lists (MEM_F_NUMA) */
 	struct pool_cache_head cache[MAX_THREADS]; /* pool caches */
 #endif
 } __attribute__((aligned(64)));
@@ -76,6 +76,8 @@ extern THREAD_LOCAL size_t pool_cache_count;   /* #cache objects   */
 void pool_evict_from_local_cache(struct pool_head *pool);
 void pool_evict_from_local_caches();
 void pool_put_to_cache(struct pool_head *pool, void *ptr);
+void *pool_get_from_node(struct pool_head *pool, int node);
+void pool_put_to_node(struct pool_head *pool, void *ptr, int node);
 
 /* returns true if the pool is considered to have too many free objects */
 static inline int pool_is_crowded(const struct pool_head *pool)
@@ -188,8 +190,16 @@ static inline void *pool_get_from_cache(struct pool_head *pool)
 	struct pool_cache_head *ph;
 
 	ph = &pool->cache[tid];
-	if (LIST_ISEMPTY(&ph->list))
+	if (LIST_ISEMPTY(&ph->list)) {
+		/* on NUMA systems, prefer objects from the local node */
+		if (unlikely(pool->flags & MEM_F_NUMA) && ti->numa_node >= 0) {
+			void *ret = pool_get_from_node(pool, ti->numa_node);
+
+			if (ret)
+				return ret;
+		}
 		return pool_get_from_shared_cache(pool);
+	}
 
 	item = LIST_NEXT(&ph->list, typeof(item), by_pool);
 	ph->count--;
@@ -290,6 +300,17 @@ static inline void pool_free(struct pool_head *pool, void *ptr)
 		if (unlikely(mem_poison_byte >= 0))
 			memset(ptr, mem_poison_byte, pool->size);
 
+#ifdef CONFIG_HAP_POOLS
+		/* objects coming from another NUMA node go back there */
+		if (unlikely(pool->flags & MEM_F_NUMA) && ti->numa_node >= 0) {
+			int node = *POOL_NODE(pool, ptr);
+
+			if (node != POOL_NODE_ANY && node != ti->numa_node) {
+				pool_put_to_node(pool, ptr, node);
+				return;
+			}
+		}
+#endif
 		pool_put_to_cache(pool, ptr);
 	}
 }
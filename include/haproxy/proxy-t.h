@@ -28,6 +28,7 @@
 #include <arpa/inet.h>
 
 #include <import/eb32tree.h>
+#include <import/ebmbtree.h>
 #include <import/ebpttree.h>
 
 #include <haproxy/api-t.h>
@@ -37,6 +38,8 @@
 #include <haproxy/counters-t.h>
 #include <haproxy/freq_ctr-t.h>
 #include <haproxy/obj_type-t.h>
+#include <haproxy/queue-t.h>
+#include <haproxy/rmtree-t.h>
 #include <haproxy/server-t.h>
 #include <haproxy/stats-t.h>
 #include <haproxy/tcpcheck-t.h>
@@ -51,6 +54,7 @@ enum pr_mode {
 	PR_MODE_CLI,
 	PR_MODE_SYSLOG,
 	PR_MODE_PEERS,
+	PR_MODE_UDP,
 	PR_MODES
 } __attribute__((packed));
 
@@ -143,7 +147,14 @@ enum PR_SRV_STATE_FILE {
 #define PR_O2_SRC_ADDR	0x00100000	/* get the source ip and port for logs */
 
 #define PR_O2_FAKE_KA   0x00200000      /* pretend we do keep-alive with server even though we close */
-/* unused : 0x00400000..0x80000000 */
+
+#define PR_O2_REUSE_FIRST  0x00000000   /* reuse the first available connection found (default) */
+#define PR_O2_REUSE_PACK   0x00400000   /* reuse the available connection with the fewest free streams */
+#define PR_O2_REUSE_SPREAD 0x00800000   /* reuse the available connection with the most free streams */
+#define PR_O2_REUSE_POL    0x00C00000   /* mask to retrieve the reuse policy */
+#define PR_O2_SOCKMAP      0x01000000   /* let the kernel forward TCP data once nothing inspects them */
+#define PR_O2_UDP_STLS     0x02000000   /* mode udp: pick a server for each datagram, without flows */
+/* unused : 0x04000000..0x08000000 */
 
 /* server health checks */
 #define PR_O2_CHK_NONE  0x00000000      /* no L7 health checks configured (TCP by default) */
@@ -200,6 +211,7 @@ enum PR_SRV_STATE_FILE {
 #define PR_RE_EARLY_ERROR         0x00010000 /* Retry if we failed at sending early data */
 #define PR_RE_JUNK_REQUEST        0x00020000 /* We received an incomplete or garbage response */
 struct stream;
+struct udp_fwd;
 
 struct http_snapshot {
 	unsigned int sid;		/* ID of the faulty stream */
@@ -328,14 +340,22 @@ struct proxy {
 		int tunnel;                     /* I/O timeout to use in tunnel mode (in ticks) */
 		int clientfin;                  /* timeout to apply to client half-closed connections */
 		int serverfin;                  /* timeout to apply to server half-closed connections */
+		int hedge;                      /* delay before retrying an idempotent request on a slow server */
 	} timeout;
 	__decl_thread(HA_RWLOCK_T lock);        /* may be taken under the server's lock */
 
 	char *id, *desc;			/* proxy id (name) and description */
-	struct eb_root pendconns;		/* pending connections with no server assigned yet */
+	char *promex_labels;			/* pre-rendered prometheus labels identifying the proxy, or NULL */
+	struct queue queues[QUEUE_SHARDS];	/* pending connections with no server assigned yet */
 	int nbpend;				/* number of pending connections with no server assigned yet */
 	int totpend;				/* total number of pending connections on this instance (for stats) */
 	unsigned int queue_idx;			/* number of pending connections which have been de-queued */
+	struct {
+		unsigned int target;		/* target queueing delay in ms, 0 if disabled */
+		unsigned int interval;		/* time above target before shedding, in ms */
+		unsigned int lifo;		/* serve the newest requests first while shedding */
+		unsigned int ok_date;		/* last date the queues were below target (now_ms) */
+	} codel;				/* controlled delay policy of the queues ("queue-codel") */
 	unsigned int feconn, beconn;		/* # of active frontend and backends streams */
 	struct freq_ctr fe_req_per_sec;		/* HTTP requests per second on the frontend */
 	struct freq_ctr fe_conn_per_sec;	/* received connections per second on the frontend */
@@ -382,11 +402,14 @@ struct proxy {
 
 	struct mt_list listener_queue;		/* list of the temporarily limited listeners because of lack of a proxy resource */
 	struct stktable *table;			/* table for storing sticking streams */
+	struct udp_fwd *udp_fwd;		/* forwarding context of "mode udp" frontends, NULL otherwise */
 
 	struct task *task;			/* the associated task, mandatory to manage rate limiting, stopping and resource shortage, NULL if disabled */
 	struct tcpcheck_rules tcpcheck_rules;   /* tcp-check send / expect rules */
 	char *check_command;			/* Command to use for external agent checks */
 	char *check_path;			/* PATH environment to use for external agent checks */
+	unsigned int check_nb_runners;		/* number of long-lived runners for external checks, 0 to fork each check */
+	struct extchk_runner *check_runners;	/* the runners for external checks, if any */
 	struct http_reply *replies[HTTP_ERR_SIZE]; /* HTTP replies for known errors */
 	unsigned int log_count;			/* number of logs produced by the frontend */
 	int uuid;				/* universally unique proxy ID, used for SNMP */
@@ -395,6 +418,12 @@ struct proxy {
 	unsigned int li_paused;                 /* total number of listeners paused (LI_PAUSED) */
 	unsigned int li_bound;                  /* total number of listeners ready (LI_LISTEN)  */
 	unsigned int li_ready;                  /* total number of listeners ready (>=LI_READY) */
+	struct {
+		unsigned int streams;           /* streams attached to this proxy */
+		unsigned int bufs;              /* buffers held by these streams */
+		unsigned long long strm_bytes;  /* memory used by these streams */
+		unsigned long long buf_bytes;   /* memory used by these buffers */
+	} mem;                                  /* memory usage, only refreshed by proxy_update_mem_usage() */
 
 	/* warning: these structs are huge, keep them at the bottom */
 	struct sockaddr_storage dispatch_addr;	/* the default address to connect to */
@@ -426,7 +455,7 @@ struct proxy {
 		char *lfsd_file;		/* file name where the structured-data logformat string for RFC5424 appears (strdup) */
 		int  lfsd_line;			/* file name where the structured-data logformat string for RFC5424 appears */
 	} conf;					/* config information */
-	struct eb_root used_server_addr;        /* list of server addresses in use */
+	struct rmtree used_server_addr;         /* servers indexed by address, read without lock */
 	void *parent;				/* parent of the proxy when applicable */
 	struct comp *comp;			/* http compression */
 
@@ -457,6 +486,30 @@ struct proxy {
 	EXTRA_COUNTERS(extra_counters_be);
 };
 
+/* Minimum number of host names for a run of switching rules to be indexed */
+#define SWITCHING_IDX_MIN_KEYS  8
+
+/* Number of entries of the per-thread cache of backends resolved by dynamic
+ * switching rules. Must be a power of two.
+ */
+#define SWITCHING_BE_CACHE_SIZE 1024
+
+/* An index of the host names matched by a run of consecutive switching rules
+ * whose only condition is an exact, case-insensitive match on the Host header.
+ * It is attached to the first rule of the run.
+ */
+struct switching_idx {
+	struct eb_root hosts;			/* switching_host nodes, indexed on lower case names */
+	struct sample_expr *smp;		/* expression fetching the Host header values */
+	struct switching_rule *last;		/* last rule of the run */
+	unsigned int rev;			/* pat_ref_indexed_rev the index was built for */
+};
+
+struct switching_host {
+	struct switching_rule *rule;		/* first rule matching this name */
+	struct ebmb_node node;			/* indexed on the name, which follows */
+};
+
 struct switching_rule {
 	struct list list;			/* list linked to from the proxy */
 	struct acl_cond *cond;			/* acl condition to meet */
@@ -466,6 +519,8 @@ struct switching_rule {
 		char *name;			/* target backend name during config parsing */
 		struct list expr;		/* logformat expression to use for dynamic rules */
 	} be;
+	struct switching_idx *idx;		/* index of the run of rules starting here, or NULL */
+	unsigned int rank;			/* position of the rule in the run it belongs to */
 	char *file;
 	int line;
 };
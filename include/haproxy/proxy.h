@@ -24,6 +24,7 @@
 
 #include <haproxy/api.h>
 #include <haproxy/applet-t.h>
+#include <haproxy/counters.h>
 #include <haproxy/freq_ctr.h>
 #include <haproxy/list.h>
 #include <haproxy/listener-t.h>
@@ -78,6 +79,7 @@ void proxy_capture_error(struct proxy *proxy, int is_back,
 			 const union error_snapshot_ctx *ctx,
 			 void (*show)(struct buffer *, const struct error_snapshot *));
 void proxy_adjust_all_maxconn();
+void proxy_update_mem_usage(int force);
 struct proxy *cli_find_frontend(struct appctx *appctx, const char *arg);
 struct proxy *cli_find_frontend(struct appctx *appctx, const char *arg);
 
@@ -117,14 +119,30 @@ static inline void proxy_reset_timeouts(struct proxy *proxy)
 	proxy->timeout.httpreq = TICK_ETERNITY;
 	proxy->timeout.check = TICK_ETERNITY;
 	proxy->timeout.tunnel = TICK_ETERNITY;
+	proxy->timeout.hedge = TICK_ETERNITY;
+}
+
+/* records in <last_upd> that the counters it belongs to were just updated. It
+ * is only written once per second so that readers of the stats may know what
+ * changed without dirtying the cache line on every update.
+ */
+static inline void counters_touch(unsigned int *last_upd)
+{
+	unsigned int sec = now.tv_sec;
+
+	if (HA_ATOMIC_LOAD(last_upd) != sec)
+		HA_ATOMIC_STORE(last_upd, sec);
 }
 
 /* increase the number of cumulated connections received on the designated frontend */
 static inline void proxy_inc_fe_conn_ctr(struct listener *l, struct proxy *fe)
 {
 	_HA_ATOMIC_INC(&fe->fe_counters.cum_conn);
-	if (l && l->counters)
+	counters_touch(&fe->fe_counters.last_upd);
+	if (l && l->counters) {
 		_HA_ATOMIC_INC(&l->counters->cum_conn);
+		counters_touch(&l->counters->last_upd);
+	}
 	HA_ATOMIC_UPDATE_MAX(&fe->fe_counters.cps_max,
 			     update_freq_ctr(&fe->fe_conn_per_sec, 1));
 }
@@ -151,9 +169,9 @@ static inline void proxy_inc_be_ctr(struct proxy *be)
 /* increase the number of cumulated requests on the designated frontend */
 static inline void proxy_inc_fe_req_ctr(struct listener *l, struct proxy *fe)
 {
-	_HA_ATOMIC_INC(&fe->fe_counters.p.http.cum_req);
+	counters_add(fe->fe_counters.shards, THR_CTR_CUM_REQ, &fe->fe_counters.p.http.cum_req, 1);
 	if (l && l->counters)
-		_HA_ATOMIC_INC(&l->counters->p.http.cum_req);
+		counters_add(l->counters->shards, THR_CTR_CUM_REQ, &l->counters->p.http.cum_req, 1);
 	HA_ATOMIC_UPDATE_MAX(&fe->fe_counters.p.http.rps_max,
 			     update_freq_ctr(&fe->fe_req_per_sec, 1));
 }
@@ -0,0 +1,45 @@
+/*
+ * QPACK decompressor (RFC 9204)
+ *
+ * Copyright 2021 HAProxy Technologies
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+#ifndef _HAPROXY_QPACK_DEC_H
+#define _HAPROXY_QPACK_DEC_H
+
+#include <inttypes.h>
+#include <haproxy/buf-t.h>
+#include <haproxy/http-hdr-t.h>
+#include <haproxy/qpack-t.h>
+
+int qpack_dec_init(struct qpack_dec *dec);
+void qpack_dec_release(struct qpack_dec *dec);
+int qpack_decode_enc(struct qpack_dec *dec, const unsigned char *raw, uint64_t len,
+                     struct buffer *tmp, struct buffer *out);
+int qpack_decode_fs(struct qpack_dec *dec, uint64_t stream_id, int *blocked,
+                    const unsigned char *raw, uint64_t len,
+                    struct http_hdr *list, int list_size,
+                    struct buffer *tmp, struct buffer *out);
+int qpack_dec_cancel_stream(struct qpack_dec *dec, uint64_t stream_id, int *blocked,
+                            struct buffer *out);
+
+#endif /* _HAPROXY_QPACK_DEC_H */
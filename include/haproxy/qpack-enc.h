@@ -0,0 +1,40 @@
+/*
+ * QPACK compressor (RFC 9204)
+ *
+ * Copyright 2021 HAProxy Technologies
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+#ifndef _HAPROXY_QPACK_ENC_H
+#define _HAPROXY_QPACK_ENC_H
+
+#include <inttypes.h>
+#include <haproxy/buf-t.h>
+#include <haproxy/http-hdr-t.h>
+#include <haproxy/qpack-t.h>
+
+int qpack_enc_init(struct qpack_enc *enc, uint64_t max_cap, uint64_t max_blocked);
+void qpack_enc_release(struct qpack_enc *enc);
+int qpack_encode_fs(struct qpack_enc *enc, uint64_t stream_id, const struct http_hdr *list,
+                    struct buffer *out, struct buffer *ins);
+int qpack_decode_dec(struct qpack_enc *enc, const unsigned char *raw, uint64_t len);
+
+#endif /* _HAPROXY_QPACK_ENC_H */
@@ -0,0 +1,75 @@
+/*
+ * include/haproxy/qpack-t.h
+ * This file contains types for the QPACK encoder and decoder (RFC 9204).
+ *
+ * Copyright 2021 HAProxy Technologies
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, version 2.1
+ * exclusively.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+ */
+
+#ifndef _HAPROXY_QPACK_T_H
+#define _HAPROXY_QPACK_T_H
+
+#include <inttypes.h>
+#include <haproxy/qpack-tbl-t.h>
+
+/* HTTP/3 error codes for the QPACK errors (RFC 9204 6) */
+#define QPACK_DECOMPRESSION_FAILED 0x200
+#define QPACK_ENCODER_STREAM_ERROR 0x201
+#define QPACK_DECODER_STREAM_ERROR 0x202
+
+/* Maximum number of streams which may be blocked on our decoder, advertised
+ * to the peer's encoder (SETTINGS_QPACK_BLOCKED_STREAMS).
+ */
+#define QPACK_DEC_MAX_BLOCKED 16
+
+/* Maximum number of field sections the encoder may keep unacknowledged while
+ * they reference dynamic table entries.
+ */
+#define QPACK_ENC_MAX_SECT 16
+
+/* QPACK decoder: it is fed by the peer's encoder stream and emits
+ * instructions on our decoder stream.
+ */
+struct qpack_dec {
+	struct qpack_dht *dht; /* dynamic table, QPACK_DHT_SIZE bytes */
+	uint32_t krc;          /* insert count the encoder knows we received */
+	uint32_t nb_blocked;   /* number of streams currently blocked */
+	uint32_t max_blocked;  /* maximum number of blocked streams */
+};
+
+/* one field section which references dynamic table entries and was not
+ * acknowledged yet.
+ */
+struct qpack_enc_sect {
+	uint64_t stream_id;  /* stream the section was sent on */
+	uint32_t ric;        /* Required Insert Count of the section */
+	uint32_t min_ref;    /* lowest absolute index referenced */
+};
+
+/* QPACK encoder: it is fed by the peer's decoder stream and emits
+ * instructions on our encoder stream.
+ */
+struct qpack_enc {
+	struct qpack_dht *dht;  /* dynamic table, NULL if the peer has none */
+	uint32_t max_cap;       /* peer's SETTINGS_QPACK_MAX_TABLE_CAPACITY */
+	uint32_t max_blocked;   /* peer's SETTINGS_QPACK_BLOCKED_STREAMS */
+	uint32_t krc;           /* Known Received Count */
+	uint32_t cap_sent;      /* non-zero once the capacity was announced */
+	uint32_t nb_sect;       /* number of entries in <sect> */
+	struct qpack_enc_sect sect[QPACK_ENC_MAX_SECT]; /* oldest first */
+};
+
+#endif /* _HAPROXY_QPACK_T_H */
@@ -26,6 +26,72 @@
 #ifndef _HAPROXY_QPACK_TBL_T_H
 #define _HAPROXY_QPACK_TBL_T_H
 
+#include <inttypes.h>
+
+/* The QPACK dynamic table is stored exactly like the HPACK one (see
+ * hpack-tbl-t.h for the details): a contiguous area with the entry descriptors
+ * at the beginning and the contents at the end. The differences are that the
+ * entries are designated by their absolute index (the number of insertions
+ * which preceded them), and that the encoder may set a capacity lower than the
+ * allocated size, so the eviction is based on <cap> instead of <size>.
+ */
+
+/*
+ * Gcc before 3.0 needs [0] to declare a variable-size array
+ */
+#ifndef VAR_ARRAY
+#if defined(__GNUC__) && (__GNUC__ < 3)
+#define VAR_ARRAY	0
+#else
+#define VAR_ARRAY
+#endif
+#endif
+
+/* Size of the dynamic tables, which is also the maximum capacity advertised
+ * to the peer's encoder (SETTINGS_QPACK_MAX_TABLE_CAPACITY).
+ */
+#define QPACK_DHT_SIZE 4096
+
+/* One dynamic table entry descriptor */
+struct qpack_dte {
+	uint32_t addr;  /* storage address, relative to the dte address */
+	uint16_t nlen;  /* header name length */
+	uint16_t vlen;  /* header value length */
+};
+
+/* Note: the table's head plus a struct qpack_dte must be smaller than or equal
+ * to 32 bytes so that a single large header can always fit. Here that's 24
+ * bytes for the header, plus 8 bytes per slot.
+ * Note that when <used> == 0, front, head, and wrap are undefined.
+ */
+struct qpack_dht {
+	uint32_t size;    /* allocated table size in bytes */
+	uint32_t total;   /* sum of nlen + vlen in bytes */
+	uint32_t cap;     /* capacity set by the encoder, <= size */
+	uint32_t ins_cnt; /* number of insertions, absolute index of the next entry */
+	uint16_t front;   /* slot number of the first node after the idx table */
+	uint16_t wrap;    /* number of allocated slots, wraps here */
+	uint16_t head;    /* last inserted slot number */
+	uint16_t used;    /* number of slots in use */
+	struct qpack_dte dte[VAR_ARRAY]; /* dynamic table entries */
+};
+
+/* supported qpack encoding/decoding errors */
+enum {
+	QPACK_ERR_NONE = 0,           /* no error */
+	QPACK_ERR_TRUNCATED,          /* truncated field section */
+	QPACK_ERR_HUFFMAN,            /* huffman decoding error */
+	QPACK_ERR_TOO_LARGE,          /* decoded section or output too large */
+	QPACK_ERR_INVALID_IDX,        /* reference to a missing table entry */
+	QPACK_ERR_INVALID_RIC,        /* invalid Required Insert Count */
+	QPACK_ERR_INVALID_CAP,        /* dynamic table capacity too large */
+	QPACK_ERR_DHT_INSERT_FAIL,    /* entry does not fit in the dynamic table */
+	QPACK_ERR_BLOCKED,            /* section needs entries not received yet */
+	QPACK_ERR_TOO_MANY_BLOCKED,   /* too many blocked streams */
+	QPACK_ERR_UNKNOWN_STREAM,     /* acknowledgment for an unknown section */
+	QPACK_ERR_INVALID_INC,        /* invalid Insert Count Increment */
+};
+
 /* static header table as in draft-ietf-quic-qpack-20 Appendix A. [0] unused. */
 #define QPACK_SHT_SIZE 99
 
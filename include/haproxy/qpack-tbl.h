@@ -0,0 +1,225 @@
+/*
+ * QPACK header table management (RFC 9204) - prototypes
+ *
+ * Copyright 2021 HAProxy Technologies
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+#ifndef _HAPROXY_QPACK_TBL_H
+#define _HAPROXY_QPACK_TBL_H
+
+#include <import/ist.h>
+#include <haproxy/api.h>
+#include <haproxy/buf-t.h>
+#include <haproxy/http-hdr-t.h>
+#include <haproxy/qpack-tbl-t.h>
+
+/* when built outside of haproxy, QPACK_STANDALONE must be defined, and
+ * pool_head_qpack_tbl->size must be set to the DHT size.
+ */
+#ifndef QPACK_STANDALONE
+#include <haproxy/pool.h>
+#define qpack_alloc(pool)      pool_alloc(pool)
+#define qpack_free(pool, ptr)  pool_free(pool, ptr)
+#else
+#include <stdlib.h>
+#include <haproxy/pool-t.h>
+#define qpack_alloc(pool)      malloc(pool->size)
+#define qpack_free(pool, ptr)  free(ptr)
+#endif
+
+extern const struct http_hdr qpack_sht[QPACK_SHT_SIZE];
+extern struct pool_head *pool_head_qpack_tbl;
+
+int __qpack_dht_evict(struct qpack_dht *dht, unsigned int room);
+int qpack_dht_insert(struct qpack_dht *dht, struct ist name, struct ist value);
+int qpack_find_static(const struct ist n, const struct ist v, int *name_idx);
+
+/* return a pointer to the entry of absolute index <abs> or NULL if this entry
+ * was not inserted yet or was already evicted.
+ */
+static inline const struct qpack_dte *qpack_get_dte(const struct qpack_dht *dht, uint32_t abs)
+{
+	uint32_t idx;
+
+	if (abs >= dht->ins_cnt || dht->ins_cnt - abs > dht->used)
+		return NULL;
+
+	/* 0 is the most recent entry */
+	idx = dht->ins_cnt - 1 - abs;
+	if (idx <= dht->head)
+		idx = dht->head - idx;
+	else
+		idx = dht->head - idx + dht->wrap;
+
+	return &dht->dte[idx];
+}
+
+/* returns the absolute index of the oldest entry of <dht>, which is equal to
+ * dht->ins_cnt if the table is empty.
+ */
+static inline uint32_t qpack_dht_first_abs(const struct qpack_dht *dht)
+{
+	return dht->ins_cnt - dht->used;
+}
+
+/* return a pointer to the header name for entry <dte>. */
+static inline struct ist qpack_get_name(const struct qpack_dht *dht, const struct qpack_dte *dte)
+{
+	return ist2((void *)dht + dte->addr, dte->nlen);
+}
+
+/* return a pointer to the header value for entry <dte>. */
+static inline struct ist qpack_get_value(const struct qpack_dht *dht, const struct qpack_dte *dte)
+{
+	return ist2((void *)dht + dte->addr + dte->nlen, dte->vlen);
+}
+
+/* returns the slot number of the oldest entry (tail). Must not be used on an
+ * empty table.
+ */
+static inline unsigned int qpack_dht_get_tail(const struct qpack_dht *dht)
+{
+	return ((dht->head + 1U < dht->used) ? dht->wrap : 0) + dht->head + 1U - dht->used;
+}
+
+/* Purges table dht until a header field of <needed> bytes fits according to
+ * the protocol (adding 32 bytes overhead). Returns non-zero on success, zero
+ * on failure (ie: table empty but still not sufficient).
+ */
+static inline int qpack_dht_make_room(struct qpack_dht *dht, unsigned int needed)
+{
+	if (dht->used * 32 + dht->total + needed + 32 <= dht->cap)
+		return 1;
+	else if (!dht->used)
+		return 0;
+
+	return __qpack_dht_evict(dht, needed + 32);
+}
+
+/* Sets the capacity of table <dht> to <cap> bytes, evicting the oldest
+ * entries which do not fit anymore. The caller is responsible for ensuring
+ * that <cap> does not exceed dht->size.
+ */
+static inline void qpack_dht_set_cap(struct qpack_dht *dht, uint32_t cap)
+{
+	dht->cap = cap;
+	if (dht->used && dht->used * 32 + dht->total > cap)
+		__qpack_dht_evict(dht, 0);
+}
+
+/* initialize a dynamic headers table of <size> bytes with a null capacity */
+static inline void qpack_dht_init(struct qpack_dht *dht, uint32_t size)
+{
+	dht->size = size;
+	dht->total = 0;
+	dht->cap = 0;
+	dht->ins_cnt = 0;
+	dht->used = 0;
+}
+
+/* allocate a dynamic headers table from the pool and return it initialized */
+static inline struct qpack_dht *qpack_dht_alloc()
+{
+	struct qpack_dht *dht;
+
+	if (unlikely(!pool_head_qpack_tbl))
+		return NULL;
+
+	dht = qpack_alloc(pool_head_qpack_tbl);
+	if (dht)
+		qpack_dht_init(dht, pool_head_qpack_tbl->size);
+	return dht;
+}
+
+/* free a dynamic headers table */
+static inline void qpack_dht_free(struct qpack_dht *dht)
+{
+	qpack_free(pool_head_qpack_tbl, dht);
+}
+
+/* Reads a prefixed integer (RFC 9204 4.1.1) from the <b> lowest bits of the
+ * first byte of <*raw> and the following ones, with <*len> bytes available.
+ * Returns 1 on success after storing the value into <*val> and advancing
+ * <*raw> and <*len>, 0 if more bytes are needed, or -QPACK_ERR_TOO_LARGE if
+ * the value does not fit in 62 bits.
+ */
+static inline int qpack_get_int(const unsigned char **raw, uint64_t *len, int b, uint64_t *val)
+{
+	const unsigned char *pos = *raw;
+	const unsigned char *end = pos + *len;
+	uint64_t ret;
+	int shift = 0;
+
+	if (pos >= end)
+		return 0;
+
+	ret = *pos++ & ((1 << b) - 1);
+	if (ret == (1 << b) - 1) {
+		do {
+			if (pos >= end)
+				return 0;
+			if (shift > 55)
+				return -QPACK_ERR_TOO_LARGE;
+			ret += (uint64_t)(*pos & 127) << shift;
+			shift += 7;
+		} while (*pos++ & 128);
+	}
+
+	*len -= pos - *raw;
+	*raw = pos;
+	*val = ret;
+	return 1;
+}
+
+/* Appends integer <v> using a <b>-bit prefix (RFC 9204 4.1.1) to buffer
+ * <out>, with the upper bits of the first byte set to <flags>. The buffer
+ * must not wrap. Returns non-zero on success, 0 if it is full.
+ */
+static inline int qpack_put_int(struct buffer *out, unsigned char flags, int b, uint64_t v)
+{
+	uint64_t max = (1U << b) - 1;
+	size_t len = out->data;
+
+	if (len >= out->size)
+		return 0;
+
+	if (v < max) {
+		out->area[len++] = flags | v;
+		goto end;
+	}
+
+	out->area[len++] = flags | max;
+	for (v -= max; v >= 128; v >>= 7) {
+		if (len >= out->size)
+			return 0;
+		out->area[len++] = (v & 127) | 128;
+	}
+
+	if (len >= out->size)
+		return 0;
+	out->area[len++] = v;
+ end:
+	out->data = len;
+	return 1;
+}
+
+#endif /* _HAPROXY_QPACK_TBL_H */
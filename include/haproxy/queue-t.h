@@ -24,6 +24,7 @@
 
 #include <import/eb32tree.h>
 #include <haproxy/api-t.h>
+#include <haproxy/thread-t.h>
 
 struct proxy;
 struct server;
@@ -32,13 +33,25 @@ struct stream;
 struct pendconn {
 	int            strm_flags; /* stream flags */
 	unsigned int   queue_idx;  /* value of proxy/server queue_idx at time of enqueue */
+	unsigned int   date;       /* date of enqueue (now_ms), to measure the queueing delay */
+	int            rejected;   /* set when unlinked to be rejected ("queue-codel") */
 	struct stream *strm;
 	struct proxy  *px;
 	struct server *srv;        /* the server we are waiting for, may be NULL if don't care */
 	struct server *target;     /* the server that was assigned, = srv except if srv==NULL */
+	struct queue  *queue;      /* the queue shard the pendconn was added to */
 	struct eb32_node node;
 };
 
+/* One shard of a server's or proxy's queue. Each of them has QUEUE_SHARDS of
+ * these, and threads enqueue into the one matching their thread ID so that
+ * they do not all compete for the same lock.
+ */
+struct queue {
+	struct eb_root head;                /* pendconns sorted by class then time offset */
+	__decl_thread(HA_SPINLOCK_T lock);  /* protects the tree */
+} THREAD_ALIGNED(64);
+
 #endif /* _HAPROXY_QUEUE_T_H */
 
 /*
@@ -29,6 +29,8 @@
 #include <haproxy/queue-t.h>
 #include <haproxy/server-t.h>
 #include <haproxy/stream-t.h>
+#include <haproxy/ticks.h>
+#include <haproxy/time.h>
 
 extern struct pool_head *pool_head_pendconn;
 
@@ -51,6 +53,31 @@ void pendconn_unlink(struct pendconn *p);
  * finishes before we return in case it would have grabbed this pendconn. See
  * github bugs #880 and #908, and the commit log for this fix for more details.
  */
+/* initializes the QUEUE_SHARDS shards of queue <q> */
+static inline void queue_init(struct queue *q)
+{
+	int i;
+
+	for (i = 0; i < QUEUE_SHARDS; i++) {
+		q[i].head = EB_ROOT;
+		HA_SPIN_INIT(&q[i].lock);
+	}
+}
+
+/* returns non-zero if no shard of queue <q> holds any pendconn. This is only a
+ * hint unless all the shards' locks are held.
+ */
+static inline int queue_is_empty(const struct queue *q)
+{
+	int i;
+
+	for (i = 0; i < QUEUE_SHARDS; i++) {
+		if (!eb_is_empty(&q[i].head))
+			return 0;
+	}
+	return 1;
+}
+
 static inline void pendconn_cond_unlink(struct pendconn *p)
 {
 	if (p)
@@ -91,6 +118,28 @@ static inline int may_dequeue_tasks(const struct server *s, const struct proxy *
 		(!s->maxconn || s->cur_sess < srv_dynamic_maxconn(s)));
 }
 
+/* Returns non-zero if the queues of backend <px> are shedding load, which is
+ * when they have not been seen below the "queue-codel" target for at least
+ * its interval.
+ */
+static inline int queue_codel_shedding(const struct proxy *px)
+{
+	return px->codel.target && px->totpend &&
+	       (int)(now_ms - HA_ATOMIC_LOAD(&px->codel.ok_date) - px->codel.interval) >= 0;
+}
+
+/* Returns the queue timeout in ticks to apply to a stream being queued in
+ * backend <px>. While the queues are shedding load, it is reduced to the
+ * "queue-codel" target so that the excess requests are rejected early.
+ */
+static inline int pendconn_timeout(const struct proxy *px)
+{
+	if (unlikely(queue_codel_shedding(px)) &&
+	    (!px->timeout.queue || MS_TO_TICKS(px->codel.target) < px->timeout.queue))
+		return MS_TO_TICKS(px->codel.target);
+	return px->timeout.queue;
+}
+
 static inline int queue_limit_class(int class)
 {
 	if (class < -0x7ff)
@@ -34,6 +34,7 @@
 #define QUIC_CC_INFINITE_SSTHESH ((uint64_t)-1)
 
 extern struct quic_cc_algo quic_cc_algo_nr;
+extern struct quic_cc_algo quic_cc_algo_cubic;
 extern struct quic_cc_algo *default_quic_cc_algo;
 
 enum quic_cc_algo_state_type {
@@ -71,6 +72,7 @@ struct quic_cc_event {
 
 enum quic_cc_algo_type {
 	QUIC_CC_ALGO_TP_NEWRENO,
+	QUIC_CC_ALGO_TP_CUBIC,
 };
 
 union quic_cc_algo_state {
@@ -81,6 +83,18 @@ union quic_cc_algo_state {
 		uint64_t ssthresh;
 		uint64_t recovery_start_time;
 	} nr;
+	/* CUBIC */
+	struct cubic {
+		enum quic_cc_algo_state_type state;
+		uint64_t cwnd;
+		uint64_t ssthresh;
+		uint64_t recovery_start_time;
+		uint64_t last_w_max;   /* window before the last reduction (bytes) */
+		uint64_t origin;       /* window at the plateau of the cubic curve (bytes) */
+		uint64_t tcp_wnd;      /* estimation of an equivalent Reno window (bytes) */
+		unsigned int epoch_start; /* start of the current congestion avoidance epoch (ms), 0 if none */
+		unsigned int K;        /* delay to reach <origin> from the start of the epoch (ms) */
+	} cu;
 };
 
 struct quic_cc {
@@ -92,6 +106,7 @@ struct quic_cc {
 
 struct quic_cc_algo {
 	enum quic_cc_algo_type type;
+	const char *name;
 	int (*init)(struct quic_cc *cc);
 	void (*event)(struct quic_cc *cc, struct quic_cc_event *ev);
 	void (*state_trace)(struct buffer *buf, const struct quic_cc *cc);
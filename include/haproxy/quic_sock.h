@@ -32,10 +32,16 @@
 #include <haproxy/api.h>
 #include <haproxy/connection-t.h>
 #include <haproxy/listener-t.h>
+#include <haproxy/xprt_quic-t.h>
 
 int quic_sock_accepting_conn(const struct receiver *rx);
 struct connection *quic_sock_accept_conn(struct listener *l, int *status);
 void quic_sock_fd_iocb(int fd);
+int quic_sock_recv_dgrams(int fd, void *owner, qdgram_read_func *func);
+int quic_sock_send_dgrams(int fd, struct sockaddr_storage *dst,
+                          struct iovec *iov, int count);
+void quic_sock_enable_gro(int fd);
+void quic_sock_enable_gso(int fd);
 
 #endif /* USE_QUIC */
 #endif /* _HAPROXY_QUIC_SOCK_H */
@@ -77,6 +77,8 @@ enum quic_tls_pktns {
 
 /* The ciphersuites for AEAD QUIC-TLS have 16-bytes authentication tag */
 #define QUIC_TLS_TAG_LEN             16
+/* Length of the samples of the packets used for the header protection */
+#define QUIC_TLS_HP_SAMPLE_LEN       16
 
 extern unsigned char initial_salt[20];
 
@@ -97,6 +99,11 @@ struct quic_tls_secrets {
 	* the packet protection.
 	*/
 	unsigned char hp_key[32];
+	/* Cipher contexts initialized with the keys above, reused for all the
+	 * packets.
+	 */
+	EVP_CIPHER_CTX *ctx;
+	EVP_CIPHER_CTX *hp_ctx;
 	char flags;
 };
 
@@ -44,13 +44,20 @@ int quic_tls_derive_initial_secrets(const EVP_MD *md,
 
 int quic_tls_encrypt(unsigned char *buf, size_t len,
                      const unsigned char *aad, size_t aad_len,
-                     const EVP_CIPHER *aead,
-                     const unsigned char *key, const unsigned char *iv);
+                     EVP_CIPHER_CTX *ctx, const unsigned char *iv);
 
 int quic_tls_decrypt(unsigned char *buf, size_t len,
                      unsigned char *aad, size_t aad_len,
-                     const EVP_CIPHER *aead,
-                     const unsigned char *key, const unsigned char *iv);
+                     EVP_CIPHER_CTX *ctx, const unsigned char *iv);
+
+int quic_tls_secrets_ctx_init(struct quic_tls_secrets *secs, int enc);
+void quic_tls_secrets_ctx_free(struct quic_tls_secrets *secs);
+
+int quic_tls_hp_masks(EVP_CIPHER_CTX *hp_ctx, const unsigned char *samples,
+                      unsigned char *masks, int n);
+
+int quic_tls_generate_retry_integrity_tag(const struct quic_cid *odcid,
+                                          unsigned char *pkt, size_t len);
 
 int quic_tls_derive_keys(const EVP_CIPHER *aead, const EVP_CIPHER *hp,
                          const EVP_MD *md,
@@ -415,7 +422,8 @@ static inline int qc_new_isecs(struct connection *conn,
 	                          rx_ctx->key, sizeof rx_ctx->key,
 	                          rx_ctx->iv, sizeof rx_ctx->iv,
 	                          rx_ctx->hp_key, sizeof rx_ctx->hp_key,
-	                          rx_init_sec, sizeof rx_init_sec))
+	                          rx_init_sec, sizeof rx_init_sec) ||
+	    !quic_tls_secrets_ctx_init(rx_ctx, 0))
 		goto err;
 
 	rx_ctx->flags |= QUIC_FL_TLS_SECRETS_SET;
@@ -423,7 +431,8 @@ static inline int qc_new_isecs(struct connection *conn,
 	                          tx_ctx->key, sizeof tx_ctx->key,
 	                          tx_ctx->iv, sizeof tx_ctx->iv,
 	                          tx_ctx->hp_key, sizeof tx_ctx->hp_key,
-	                          tx_init_sec, sizeof tx_init_sec))
+	                          tx_init_sec, sizeof tx_init_sec) ||
+	    !quic_tls_secrets_ctx_init(tx_ctx, 1))
 		goto err;
 
 	tx_ctx->flags |= QUIC_FL_TLS_SECRETS_SET;
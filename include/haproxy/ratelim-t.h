@@ -0,0 +1,70 @@
+/*
+ * include/haproxy/ratelim-t.h
+ * This file contains types for the rate limiters based on token buckets.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, version 2.1
+ * exclusively.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _HAPROXY_RATELIM_T_H
+#define _HAPROXY_RATELIM_T_H
+
+#include <haproxy/api-t.h>
+#include <haproxy/thread-t.h>
+
+/* Maximum interval between two refills of the buckets, in milliseconds */
+#define RATELIM_MAX_TICK    100
+
+/* Share of the tokens of a refill which is distributed to the threads'
+ * buckets, in 1/1024. The rest is left in the limiter's shared bucket to
+ * serve the threads which run out of tokens before the next refill.
+ */
+#define RATELIM_LOCAL_SHARE 768
+
+/* A thread's token bucket. It is only touched by its own thread, except
+ * during refills, hence the alignment.
+ */
+struct ratelim_bucket {
+	int tokens;                        /* events this thread may still accept */
+	unsigned int hits;                 /* events seen since the last refill */
+} THREAD_ALIGNED(64);
+
+/* A rate limiter allows <rate> events per <period> milliseconds, globally
+ * for all threads, and optionally for all the connected peers of a section.
+ * The threads consume tokens from their own bucket, then from the shared
+ * one, and a task periodically refills them depending on their demand.
+ */
+struct ratelim {
+	struct ratelim_bucket buckets[MAX_THREADS];
+	int spare;                         /* tokens in the shared bucket */
+	unsigned int rate;                 /* events allowed per period */
+	unsigned int period;               /* period in milliseconds */
+	unsigned int burst;                /* max number of tokens kept */
+	unsigned int tick;                 /* refill interval in milliseconds */
+	unsigned int last;                 /* date of last refill (now_ms) */
+	unsigned long long credit;         /* sub-token credit, in events*ms */
+	unsigned int deny_status;          /* status code of denied requests */
+	struct peers *peers;               /* peers sharing the rate, or NULL */
+	char *peers_id;                    /* name of the peers section, until resolved */
+	struct task *task;                 /* refill task */
+};
+
+#endif /* _HAPROXY_RATELIM_T_H */
+
+/*
+ * Local variables:
+ *  c-indent-level: 8
+ *  c-basic-offset: 8
+ * End:
+ */
@@ -33,6 +33,7 @@
 #define RX_F_BOUND              0x00000001  /* receiver already bound */
 #define RX_F_INHERITED          0x00000002  /* inherited FD from the parent process (fd@) */
 #define RX_F_MWORKER            0x00000004  /* keep the FD open in the master but close it in the children */
+#define RX_F_LOCAL_ACCEPT       0x00000008  /* connections must be accepted by the thread which received them */
 
 /* Bit values for rx_settings->options */
 #define RX_O_FOREIGN            0x00000001  /* receives on foreign addresses */
@@ -52,6 +53,17 @@ struct rx_settings {
 	unsigned int options;             /* receiver options (RX_O_*) */
 };
 
+#ifdef USE_QUIC
+/* Per-thread part of a QUIC receiver. A QUIC connection is only handled by the
+ * thread encoded in its connection IDs, which is the only one to use this part.
+ */
+struct quic_rx_thr {
+	struct list qpkts;               /* QUIC Initial packets to accept new connections */
+	struct eb_root odcids;           /* QUIC original destination connection IDs. */
+	struct eb_root cids;             /* QUIC connection IDs. */
+};
+#endif
+
 /* This describes a receiver with all its characteristics (address, options, etc) */
 struct receiver {
 	int fd;                          /* handle we receive from (fd only for now) */
@@ -62,9 +74,7 @@ struct receiver {
 	struct rx_settings *settings;    /* points to the settings used by this receiver */
 	struct list proto_list;          /* list in the protocol header */
 #ifdef USE_QUIC
-	struct list qpkts;               /* QUIC Initial packets to accept new connections */
-	struct eb_root odcids;           /* QUIC original destination connection IDs. */
-	struct eb_root cids;             /* QUIC connection IDs. */
+	struct quic_rx_thr *quic_thr;    /* QUIC per-thread parts, indexed by thread ID */
 #endif
 	/* warning: this struct is huge, keep it at the bottom */
 	struct sockaddr_storage addr;    /* the address the socket is bound to */
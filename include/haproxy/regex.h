@@ -47,6 +47,9 @@ int regex_exec_match(const struct my_regex *preg, const char *subject,
                      size_t nmatch, regmatch_t pmatch[], int flags);
 int regex_exec_match2(const struct my_regex *preg, char *subject, int length,
                       size_t nmatch, regmatch_t pmatch[], int flags);
+int regex_set_compatible(const char *str);
+struct my_regex *regex_comp_set(const char **strs, int nb, int cs, char **err);
+int regex_exec_set(const struct my_regex *preg, const char *subject, int length);
 
 
 /* If the function doesn't match, it returns false, else it returns true.
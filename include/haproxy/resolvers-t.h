@@ -23,6 +23,7 @@
 #define _HAPROXY_RESOLVERS_T_H
 
 #include <import/eb32tree.h>
+#include <import/eb64tree.h>
 
 #include <haproxy/connection-t.h>
 #include <haproxy/dns-t.h>
@@ -117,12 +118,16 @@ struct resolv_answer_item {
 	struct resolv_answer_item *ar_item;          /* pointer to a RRset from the additional section, if exists */
 	struct list	attached_servers;            /* attached server head */
 	struct list     list;
+	struct eb32_node node;                       /* indexed by its type and data in the response's answer_tree */
+	struct eb32_node target_node;                /* SRV only, indexed by target in the response's target_tree */
 };
 
 struct resolv_response {
 	struct dns_header header;
 	struct list       query_list;
 	struct list       answer_list;
+	struct eb_root    answer_tree;               /* answer_list's items, by resolv_answer_item_hash() */
+	struct eb_root    target_tree;               /* answer_list's SRV items, by resolv_target_hash() */
 	/* authority ignored for now */
 };
 
@@ -155,6 +160,17 @@ struct resolvers {
 	struct eb_root query_ids;           /* tree to quickly lookup/retrieve query ids currently in use
                                              * used by each nameserver, but stored in resolvers since there must
                                              * be a unique relation between an eb_root and an eb_node (resolution) */
+	struct {                            /* answers of the do-resolve actions */
+		struct eb_root entries;     /* entries indexed by the hash of their name and options */
+		struct list lru;            /* entries, the most recently used first */
+		struct list refreshed;      /* entries to detach from their completed refresh */
+		unsigned int size;          /* maximum number of entries, 0 if disabled */
+		unsigned int used;          /* current number of entries */
+		int prefetch;               /* time before the expiration of a valid answer to refresh it, 0 if disabled */
+		unsigned long long hits;    /* lookups answered from the cache */
+		unsigned long long misses;  /* lookups which required a resolution */
+		unsigned long long prefetches; /* refreshes started before the expiration */
+	} cache;
 	struct list list;                   /* resolvers list */
 	struct list  nameservers;           /* dns server list */
 	struct proxy *px;                   /* px to handle connections to DNS servers */
@@ -184,6 +200,31 @@ struct resolv_options {
 	int ignore_weight; /* flag to indicate whether to ignore the weight within the record */
 };
 
+/* Answer of a do-resolve action kept in the cache of its resolvers section.
+ * Failures are also kept, for the hold period matching their status. A valid
+ * answer may be refreshed before it expires, by a resolution the entry is the
+ * requester of.
+ */
+struct resolv_cache_entry {
+	enum obj_type obj_type;             /* object type == OBJ_TYPE_RESOLV_CACHE */
+	struct eb64_node node;              /* indexed by the hash of the name and the options */
+	struct list list;                   /* position in the LRU list of the resolvers section */
+	struct list refreshed;              /* element of the list of entries whose refresh completed */
+	struct resolvers *resolvers;        /* resolvers section the entry belongs to */
+	struct resolv_requester *requester; /* requester of the refresh in progress, or NULL */
+	const struct resolv_options *opts;  /* options of the rule the answer was selected for */
+	char *hostname_dn;                  /* name in domain name format, lower case */
+	int hostname_dn_len;                /* length of hostname_dn */
+	int status;                         /* RSLV_STATUS_* of the resolution */
+	int family;                         /* AF_INET or AF_INET6, 0 if no address was selected */
+	union {
+		struct in_addr  in4;
+		struct in6_addr in6;
+	} addr;                             /* selected address */
+	int expire;                         /* date the entry expires (ticks) */
+	int refresh;                        /* date a valid answer may be refreshed (ticks) */
+};
+
 /* Resolution structure associated to single server and used to manage name
  * resolution for this server.
  * The only link between the resolution and a nameserver is through the
@@ -48,6 +48,7 @@ int resolv_link_resolution(void *requester, int requester_type, int requester_lo
 void resolv_unlink_resolution(struct resolv_requester *requester, int safe);
 void resolv_detach_from_resolution_answer_items(struct resolv_resolution *res,  struct resolv_requester *req, int safe);
 void resolv_trigger_resolution(struct resolv_requester *requester);
+void resolv_cache_store(struct stream *s, struct resolv_resolution *res, int error);
 enum act_parse_ret resolv_parse_do_resolve(const char **args, int *orig_arg, struct proxy *px, struct act_rule *rule, char **err);
 int check_action_do_resolve(struct act_rule *rule, struct proxy *px, char **err);
 
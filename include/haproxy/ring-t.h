@@ -26,7 +26,7 @@
 #include <haproxy/buf-t.h>
 #include <haproxy/thread.h>
 
-/* The code below handles circular buffers with single-producer and multiple
+/* The code below handles circular buffers with multiple producers and multiple
  * readers (up to 255). The buffer storage area must remain always allocated.
  * It's made of series of payload blocks followed by a readers count (RC).
  * There is always a readers count at the beginning of the buffer as well. Each
@@ -43,15 +43,22 @@
  * long as the initial count is non-null. As such these readers count are
  * effective barriers against data recycling.
  *
- * Only the writer is allowed to update the buffer's tail/head. This ensures
+ * Only the writers are allowed to update the buffer's tail/head. This ensures
  * that events can remain as long as possible so that late readers can get the
  * maximum history available. It also helps dealing with multi-thread accesses
- * using a simple RW lock during the buffer head's manipulation. The writer
+ * using a simple RW lock during the buffer head's manipulation. A writer
  * will have to delete some old records starting at the head until the new
  * message can fit or a non-null readers count is encountered. If a message
  * cannot fit due to insufficient room, the message is lost and the drop
  * counted must be incremented.
  *
+ * Writers first reserve their room by atomically moving the tail under the
+ * read lock (the write lock is only needed to delete old records), then copy
+ * their message without holding the lock, and finally commit it by moving the
+ * <committed> offset past it, in reservation order. Readers never look past
+ * <committed> and the head is never moved past it, so that a message which is
+ * being written is neither visible nor deleted.
+ *
  * Like any buffer, this buffer naturally wraps at the end and continues at the
  * beginning. The creation process consists in immediately adding a null
  * readers count byte into the buffer. The write process consists in always
@@ -95,6 +102,7 @@
 struct ring {
 	struct buffer buf;   // storage area
 	size_t ofs;          // absolute offset in history of the buffer's head
+	size_t committed;    // absolute offset of the end of the committed messages
 	struct list waiters; // list of waiters, for now, CLI "show event"
 	__decl_thread(HA_RWLOCK_T lock);
 	int readers_count;
@@ -24,6 +24,7 @@
 
 #include <stdlib.h>
 #include <import/ist.h>
+#include <haproxy/api.h>
 #include <haproxy/ring-t.h>
 
 struct ring *ring_new(size_t size);
@@ -37,6 +38,15 @@ int ring_attach_cli(struct ring *ring, struct appctx *appctx);
 int cli_io_handler_show_ring(struct appctx *appctx);
 void cli_io_release_show_ring(struct appctx *appctx);
 
+/* Returns the amount of data readers may consume in ring <ring>, starting at
+ * the head. It excludes the messages which are still being written. Must be
+ * called with the ring's read lock held so that the head doesn't move.
+ */
+static inline size_t ring_data(const struct ring *ring)
+{
+	return HA_ATOMIC_LOAD(&ring->committed) - ring->ofs;
+}
+
 #endif /* _HAPROXY_RING_H */
 
 /*
@@ -0,0 +1,58 @@
+/*
+ * include/haproxy/rmtree-t.h
+ * This file contains types for the read-mostly string trees.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, version 2.1
+ * exclusively.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _HAPROXY_RMTREE_T_H
+#define _HAPROXY_RMTREE_T_H
+
+#include <import/ebpttree.h>
+#include <haproxy/api-t.h>
+#include <haproxy/thread-t.h>
+
+/* an entry of a snapshot, indexed on a copy of its key */
+struct rmtree_node {
+	struct ebpt_node node;
+	void *obj;                         /* the object it designates */
+};
+
+/* An immutable version of a tree. The key strings are stored after the
+ * nodes, in the same allocation.
+ */
+struct rmtree_snap {
+	struct eb_root root;
+	unsigned int count;                /* number of nodes */
+	struct rmtree_node nodes[VAR_ARRAY];
+};
+
+/* A read-mostly tree maps strings to objects. Readers access the current
+ * snapshot without any lock, while writers build a new snapshot, publish it
+ * and retire the previous one using thread_retire().
+ */
+struct rmtree {
+	struct rmtree_snap *snap;          /* current snapshot, NULL if empty */
+	__decl_thread(HA_SPINLOCK_T lock); /* serializes the writers */
+};
+
+#endif /* _HAPROXY_RMTREE_T_H */
+
+/*
+ * Local variables:
+ *  c-indent-level: 8
+ *  c-basic-offset: 8
+ * End:
+ */
@@ -0,0 +1,61 @@
+/*
+ * include/haproxy/rmtree.h
+ * This file contains functions for the read-mostly string trees.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, version 2.1
+ * exclusively.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _HAPROXY_RMTREE_H
+#define _HAPROXY_RMTREE_H
+
+#include <import/ebistree.h>
+#include <haproxy/api.h>
+#include <haproxy/rmtree-t.h>
+#include <haproxy/thread.h>
+
+int rmtree_set(struct rmtree *t, void *obj, const char *key);
+void rmtree_destroy(struct rmtree *t);
+
+/* initializes an empty tree */
+static inline void rmtree_init(struct rmtree *t)
+{
+	t->snap = NULL;
+	HA_SPIN_INIT(&t->lock);
+}
+
+/* Returns the first object inserted with key <key> in tree <t>, or NULL if
+ * none. No lock is needed, but the caller must not keep a reference to the
+ * tree's internals across a polling loop.
+ */
+static inline void *rmtree_lookup(const struct rmtree *t, const char *key)
+{
+	struct rmtree_snap *snap = HA_ATOMIC_LOAD(&t->snap);
+	struct ebpt_node *node;
+
+	if (!snap)
+		return NULL;
+
+	node = ebis_lookup(&snap->root, key);
+	return node ? container_of(node, struct rmtree_node, node)->obj : NULL;
+}
+
+#endif /* _HAPROXY_RMTREE_H */
+
+/*
+ * Local variables:
+ *  c-indent-level: 8
+ *  c-basic-offset: 8
+ * End:
+ */
@@ -36,6 +36,7 @@
 #include <haproxy/listener-t.h>
 #include <haproxy/obj_type-t.h>
 #include <haproxy/openssl-compat.h>
+#include <haproxy/queue-t.h>
 #include <haproxy/resolvers-t.h>
 #include <haproxy/ssl_sock-t.h>
 #include <haproxy/stats-t.h>
@@ -136,6 +137,18 @@ enum srv_initaddr {
 #define SRV_STATE_FILE_MAX_FIELDS_VERSION_1 25
 #define SRV_STATE_LINE_MAXLEN 512
 
+/* Binary server-state file. It starts with the magic below followed by the
+ * format version as a 32-bit network-order integer. Then each record is made
+ * of its length (excluding this field), the backend and server ids, all three
+ * as 32-bit network-order integers, the number of fields on one byte, and the
+ * fields of the text format in the same order, each terminated by a zero.
+ */
+#define SRV_STATE_BIN_MAGIC       "\0HASTATE"  /* cannot start a text file */
+#define SRV_STATE_BIN_MAGIC_LEN   8
+#define SRV_STATE_BIN_VERSION     1
+#define SRV_STATE_BIN_HDR_LEN     (SRV_STATE_BIN_MAGIC_LEN + 4)
+#define SRV_STATE_BIN_REC_HDR_LEN 13
+
 /* server flags -- 32 bits */
 #define SRV_F_BACKUP       0x0001        /* this server is a backup server */
 #define SRV_F_MAPPORTS     0x0002        /* this server uses mapped ports */
@@ -175,11 +188,27 @@ enum srv_initaddr {
 #define SRV_EWGHT_RANGE (SRV_UWGHT_RANGE * BE_WEIGHT_SCALE)
 #define SRV_EWGHT_MAX   (SRV_UWGHT_MAX   * BE_WEIGHT_SCALE)
 
+/* A few recent TLS sessions to a server, as ASN.1 DER, which any thread may
+ * resume when it does not have its own one. The TLS 1.3 ones are removed
+ * once taken, since tickets should not be used more than once.
+ */
+struct srv_ssl_shared_sess {
+	__decl_thread(HA_SPINLOCK_T lock);
+	unsigned int next;                 /* next slot to fill */
+	struct {
+		unsigned char *ptr;
+		int size;
+		int allocated_size;
+		int single_use;            /* TLS 1.3 ticket */
+	} sess[SSL_SRV_SHARED_SESS];
+};
+
 /* server ssl options */
 #define SRV_SSL_O_NONE           0x0000
 #define SRV_SSL_O_NO_TLS_TICKETS 0x0100 /* disable session resumption tickets */
 #define SRV_SSL_O_NO_REUSE       0x200  /* disable session reuse */
 #define SRV_SSL_O_EARLY_DATA     0x400  /* Allow using early data */
+#define SRV_SSL_O_KTLS           0x800  /* offload records encryption to the kernel */
 
 /* log servers ring's protocols options */
 enum srv_log_proto {
@@ -187,12 +216,32 @@ enum srv_log_proto {
         SRV_LOG_PROTO_OCTET_COUNTING, // TCP frames: MSGLEN SP MSG
 };
 
+struct extchk_runner;
+
 struct pid_list {
 	struct list list;
 	pid_t pid;
 	struct task *t;
 	int status;
 	int exited;
+	struct extchk_runner *runner;   /* runner handling the request, NULL for a forked process */
+	unsigned int req_id;            /* ID of the request sent to the runner, if any */
+};
+
+/* A long-lived process running the external checks of a proxy. The requests
+ * are written to its standard input and the results are read from its standard
+ * output. Pending requests are linked as pid_list entries in <pending>.
+ */
+#define EXTCHK_RUNNER_LINE 256
+
+struct extchk_runner {
+	pid_t pid;                      /* process ID, or -1 if not running */
+	int fd_req;                     /* pipe to the runner's standard input */
+	int fd_rsp;                     /* pipe from the runner's standard output */
+	unsigned int nb_pending;        /* number of entries in <pending> */
+	struct list pending;            /* requests waiting for a result */
+	unsigned int len;               /* length of the partial line in <line> */
+	char line[EXTCHK_RUNNER_LINE];  /* partial response line */
 };
 
 /* A tree occurrence is a descriptor of a place in a tree, with a pointer back
@@ -212,6 +261,7 @@ struct srv_per_thread {
 	struct eb_root avail_conns;             /* Connections in use, but with still new streams available */
 };
 
+struct comp_algo;
 struct proxy;
 struct server {
 	/* mostly config or admin stuff, doesn't change often */
@@ -237,6 +287,8 @@ struct server {
 	unsigned int pool_purge_delay;          /* Delay before starting to purge the idle conns pool */
 	unsigned int low_idle_conns;            /* min idle connection count to start picking from other threads */
 	unsigned int max_idle_conns;            /* Max number of connection allowed in the orphan connections list */
+	unsigned int warm_conns;                /* Min number of connections to keep established, opened ahead of time */
+	struct task *warm_conn_task;            /* the task dedicated to opening warm connections */
 	int max_reuse;                          /* Max number of requests on a same connection */
 	struct task *warmup;                    /* the task dedicated to the warmup when slowstart is set */
 
@@ -244,6 +296,8 @@ struct server {
 	struct server *trackers;                /* the list of servers tracking us, if any */
 	struct server *tracknext;               /* next server tracking <track> in <track>'s trackers list */
 	char *trackit;				/* temporary variable to make assignment deferrable */
+	char *check_share;			/* name of the table used to share the checks' results, temporary */
+	int check_share_owners;			/* number of peers running the checks shared through <check_share> */
 	int consecutive_errors_limit;		/* number of consecutive errors that triggers an event */
 	short observe, onerror;			/* observing mode: one of HANA_OBS_*; what to do on error: on of ANA_ONERR_* */
 	short onmarkeddown;			/* what to do when marked down: one of HANA_ONMARKEDDOWN_* */
@@ -251,6 +305,7 @@ struct server {
 	int slowstart;				/* slowstart time in seconds (ms in the conf) */
 
 	char *id;				/* just for identification */
+	char *promex_labels;			/* pre-rendered prometheus labels identifying the server, or NULL */
 	unsigned iweight,uweight, cur_eweight;	/* initial weight, user-specified weight, and effective weight */
 	unsigned wscore;			/* weight score, used during srv map computation */
 	unsigned next_eweight;			/* next pending eweight to commit */
@@ -271,7 +326,7 @@ struct server {
 	unsigned int est_need_conns;            /* Estimate on the number of needed connections (max of curr and previous max_used) */
 	unsigned int next_takeover;             /* thread ID to try to steal connections from next time */
 
-	struct eb_root pendconns;		/* pending connections */
+	struct queue queues[QUEUE_SHARDS];	/* pending connections */
 
 	/* Element below are usd by LB algorithms and must be doable in
 	 * parallel to other threads reusing connections above.
@@ -290,6 +345,8 @@ struct server {
 	int consecutive_errors;			/* current number of consecutive errors */
 	struct freq_ctr sess_per_sec;		/* sessions per second on this server */
 	unsigned int queue_idx;			/* count of pending connections which have been de-queued */
+	unsigned int lb_ewma;			/* peak-EWMA of response times in 1/16 ms ("balance ewma") */
+	unsigned int lb_ewma_date;		/* date of the last update of lb_ewma (ticks) */
 	struct be_counters counters;		/* statistics counters */
 
 	/* Below are some relatively stable settings, only changed under the lock */
@@ -325,6 +382,7 @@ struct server {
 	struct sockaddr_storage init_addr;	/* plain IP address specified on the init-addr line */
 	unsigned int init_addr_methods;		/* initial address setting, 3-bit per method, ends at 0, enough to store 10 entries */
 	enum srv_log_proto log_proto;		/* used proto to emit messages on server lines from ring section */
+	const struct comp_algo *log_comp;	/* compression of the messages forwarded from a ring section, or NULL */
 
 #ifdef USE_OPENSSL
 	char *sni_expr;             /* Temporary variable to store a sample expression for SNI */
@@ -335,6 +393,7 @@ struct server {
 			int size;
 			int allocated_size;
 		} * reused_sess;
+		struct srv_ssl_shared_sess *shared_sess; /* sessions resumable by any thread */
 
 		struct ckch_inst *inst; /* Instance of the ckch_store in which the certificate was loaded (might be null if server has no certificate) */
 		__decl_thread(HA_RWLOCK_T lock); /* lock the cache and SSL_CTX during commit operations */
@@ -374,7 +433,7 @@ struct server {
 		struct ebpt_node name;		/* place in the tree of used names */
 		int line;			/* line where the section appears */
 	} conf;					/* config information */
-	struct ebpt_node addr_node;             /* Node for string representation of address for the server (including port number) */
+	struct ebpt_node addr_node;             /* only the key is used: string representation of the address (including port number) */
 	/* Template information used only for server objects which
 	 * serve as template filled at parsing time and used during
 	 * server allocations from server templates.
@@ -54,6 +54,7 @@ struct server *server_find_by_id(struct proxy *bk, int id);
 struct server *server_find_by_name(struct proxy *bk, const char *name);
 struct server *server_find_best_match(struct proxy *bk, char *name, int id, int *diff);
 void apply_server_state(void);
+int srv_state_bin_encode(struct buffer *buf, int be_id, int srv_id);
 void srv_compute_all_admin_states(struct proxy *px);
 int srv_set_addr_via_libc(struct server *srv, int *err_code);
 int srv_init_addr(void);
@@ -73,6 +74,11 @@ int snr_resolution_error_cb(struct resolv_requester *requester, int error_code);
 struct server *snr_check_ip_callback(struct server *srv, void *ip, unsigned char *ip_family);
 struct task *srv_cleanup_idle_conns(struct task *task, void *ctx, unsigned int state);
 struct task *srv_cleanup_toremove_conns(struct task *task, void *context, unsigned int state);
+struct task *srv_warm_conns_task(struct task *task, void *context, unsigned int state);
+const char *srv_warm_conn_unsupported(const struct server *srv);
+int srv_export_idle_conns(struct server *srv, int *fds, int max);
+int srv_inherit_idle_conn(const char *pname, const char *sname, int fd);
+int srv_inherit_ssl_session(const char *pname, const char *sname, const unsigned char *der, int len);
 
 /*
  * Registers the server keyword list <kwl> as a list of valid keywords for next
@@ -292,6 +298,12 @@ static inline void srv_release_conn(struct server *srv, struct connection *conn)
 	HA_SPIN_LOCK(IDLE_CONNS_LOCK, &idle_conns[tid].idle_conns_lock);
 	conn_delete_from_tree(&conn->hash_node->node);
 	HA_SPIN_UNLOCK(IDLE_CONNS_LOCK, &idle_conns[tid].idle_conns_lock);
+
+	/* let the server replace this connection if it keeps some warm ones,
+	 * unless it failed, in which case the next periodic run will do it.
+	 */
+	if (srv->warm_conn_task && !stopping && !(conn->flags & CO_FL_ERROR))
+		task_wakeup(srv->warm_conn_task, TASK_WOKEN_OTHER);
 }
 
 /* This adds an idle connection to the server's list if the connection is
@@ -303,7 +315,8 @@ static inline int srv_add_to_idle_list(struct server *srv, struct connection *co
 	 * if we don't have too many FD in use, and if the number of
 	 * idle+current conns is lower than what was observed before
 	 * last purge, or if we already don't have idle conns for the
-	 * current thread and we don't exceed last count by global.nbthread.
+	 * current thread and we don't exceed last count by global.nbthread, or
+	 * if we don't have the number of warm connections to keep yet.
 	 */
 	if (!(conn->flags & CO_FL_PRIVATE) &&
 	    srv && srv->pool_purge_delay > 0 &&
@@ -314,7 +327,8 @@ static inline int srv_add_to_idle_list(struct server *srv, struct connection *co
 	      (is_safe || eb_is_empty(&srv->per_thr[tid].idle_conns))) ||
 	     (ha_used_fds < global.tune.pool_low_count &&
 	      (srv->curr_used_conns + srv->curr_idle_conns <=
-	       MAX(srv->curr_used_conns, srv->est_need_conns) + srv->low_idle_conns))) &&
+	       MAX(srv->curr_used_conns, srv->est_need_conns) + srv->low_idle_conns)) ||
+	     (srv->curr_used_conns + srv->curr_idle_conns <= srv->warm_conns)) &&
 	    !conn->mux->used_streams(conn) && conn->mux->avail_streams(conn)) {
 		int retadd;
 
@@ -58,12 +58,7 @@ static inline void session_store_counters(struct session *sess)
 
 		ptr = stktable_data_ptr(stkctr->table, ts, STKTABLE_DT_CONN_CUR);
 		if (ptr) {
-			HA_RWLOCK_WRLOCK(STK_SESS_LOCK, &ts->lock);
-
-			if (stktable_data_cast(ptr, conn_cur) > 0)
-				stktable_data_cast(ptr, conn_cur)--;
-
-			HA_RWLOCK_WRUNLOCK(STK_SESS_LOCK, &ts->lock);
+			stktable_conn_cur_dec(ptr);
 
 			/* If data was modified, we need to touch to re-schedule sync */
 			stktable_touch_local(stkctr->table, ts, 0);
@@ -40,13 +40,13 @@ struct shared_block {
 	unsigned int len;          /* data length for the row */
 	unsigned int block_count;  /* number of blocks */
 	unsigned int refcount;
-	struct shared_block *last_reserved;
+	struct shared_block *last_reserved; /* last block of the row (NULL means the block itself) */
 	struct shared_block *last_append;
 	unsigned char data[VAR_ARRAY];
 };
 
 struct shared_context {
-	__decl_thread(HA_SPINLOCK_T lock);
+	__decl_thread(HA_RWLOCK_T lock);
 	struct list avail;  /* list for active and free blocks */
 	struct list hot;     /* list for locked blocks */
 	unsigned int nbav;  /* number of available blocks */
@@ -19,6 +19,9 @@
 #include <haproxy/shctx-t.h>
 #include <haproxy/thread.h>
 
+size_t shctx_area_size(int maxblocks, int blocksize, int extra);
+int shctx_init_area(struct shared_context *shctx, int maxblocks, int blocksize,
+                    unsigned int maxobjsz, int extra);
 int shctx_init(struct shared_context **orig_shctx,
                int maxblocks, int blocksize, unsigned int maxobjsz,
                int extra, int shared);
@@ -37,8 +40,14 @@ int shctx_row_data_get(struct shared_context *shctx, struct shared_block *first,
 
 extern int use_shared_mem;
 
-#define shctx_lock(shctx)   if (use_shared_mem) HA_SPIN_LOCK(SHCTX_LOCK, &shctx->lock)
-#define shctx_unlock(shctx) if (use_shared_mem) HA_SPIN_UNLOCK(SHCTX_LOCK, &shctx->lock)
+#define shctx_lock(shctx)   if (use_shared_mem) HA_RWLOCK_WRLOCK(SHCTX_LOCK, &shctx->lock)
+#define shctx_unlock(shctx) if (use_shared_mem) HA_RWLOCK_WRUNLOCK(SHCTX_LOCK, &shctx->lock)
+
+/* read-only accesses (lookups, data retrieval), which must neither reserve
+ * nor move rows.
+ */
+#define shctx_rdlock(shctx)   if (use_shared_mem) HA_RWLOCK_RDLOCK(SHCTX_LOCK, &shctx->lock)
+#define shctx_rdunlock(shctx) if (use_shared_mem) HA_RWLOCK_RDUNLOCK(SHCTX_LOCK, &shctx->lock)
 
 
 /* List Macros */
@@ -64,12 +73,26 @@ static inline void shctx_block_set_hot(struct shared_context *shctx,
 	LIST_APPEND(&shctx->hot, &s->list);
 }
 
-static inline void shctx_block_set_avail(struct shared_context *shctx,
-				      struct shared_block *s)
+/*
+ * Move the whole row starting at <first> to the tail of the list <head>. The
+ * blocks of a row are always contiguous, so this is done in constant time
+ * whatever the row's size.
+ */
+static inline void shctx_row_move(struct list *head, struct shared_block *first)
 {
-	shctx->nbav++;
-	LIST_DELETE(&s->list);
-	LIST_APPEND(&shctx->avail, &s->list);
+	struct shared_block *last = first->last_reserved ? first->last_reserved : first;
+	struct list *prev = first->list.p;
+	struct list *next = last->list.n;
+
+	/* detach the row */
+	prev->n = next;
+	next->p = prev;
+
+	/* and append it */
+	first->list.p = head->p;
+	last->list.n = head;
+	head->p->n = &first->list;
+	head->p = &last->list;
 }
 
 #endif /* __HAPROXY_SHCTX_H */
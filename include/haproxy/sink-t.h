@@ -40,6 +40,7 @@ struct sink_forward_target {
 	struct server *srv;    // used server
 	struct appctx *appctx; // appctx of current session
 	size_t ofs;            // ring buffer reader offset
+	int flush_exp;         // date at which the pending batch must be sent
 	struct sink_forward_target *next;
 	__decl_thread(HA_SPINLOCK_T lock); // lock to protect current struct
 };
@@ -52,6 +53,7 @@ struct sink {
 	enum log_fmt fmt;          // format expected by the sink
 	enum sink_type type;       // type of storage
 	uint32_t maxlen;           // max message length (truncated above)
+	unsigned int flush_delay;  // max time to wait for more messages to forward (ms)
 	struct proxy* forward_px;  // proxy used to forward
 	struct sink_forward_target *sft; // sink forward targets
 	struct task *forward_task; // task to handle forward targets conns
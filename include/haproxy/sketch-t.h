@@ -0,0 +1,80 @@
+/*
+ * include/haproxy/sketch-t.h
+ * This file contains types for probabilistic sketches (count-min, HyperLogLog).
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, version 2.1
+ * exclusively.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _HAPROXY_SKETCH_T_H
+#define _HAPROXY_SKETCH_T_H
+
+#include <haproxy/api-t.h>
+#include <haproxy/freq_ctr-t.h>
+#include <haproxy/list-t.h>
+
+/* sketch types */
+enum sketch_type {
+	SKETCH_T_NONE = 0,   /* referenced but not declared yet */
+	SKETCH_T_CMS,        /* count-min sketch of per-key event rates */
+	SKETCH_T_HLL,        /* HyperLogLog counting distinct keys */
+};
+
+/* default sizes */
+#define SKETCH_CMS_WIDTH     16384
+#define SKETCH_CMS_DEPTH     4
+#define SKETCH_CMS_MAX_DEPTH 16
+#define SKETCH_HLL_PRECISION 14
+#define SKETCH_HLL_MIN_PREC  4
+#define SKETCH_HLL_MAX_PREC  18
+
+/* A sketch is a fixed-size structure summarizing a stream of keys, whose
+ * memory usage does not depend on the number of distinct keys. All updates
+ * are lockless.
+ */
+struct sketch {
+	struct list list;            /* chaining of all sketches */
+	char *id;                    /* sketch name */
+	enum sketch_type type;       /* SKETCH_T_* */
+	union {
+		struct {
+			unsigned int width;      /* counters per row, a power of two */
+			unsigned int depth;      /* number of rows */
+			unsigned int period;     /* period of the rates (ticks) */
+			struct freq_ctr *cells;  /* <depth> rows of <width> counters */
+		} cms;
+		struct {
+			unsigned int precision;  /* log2 of the number of registers */
+			unsigned char *regs;     /* 1 << <precision> registers */
+		} hll;
+	};
+	struct {
+		const char *file;        /* file where the sketch is declared */
+		int line;                /* line where the sketch is declared */
+	} conf;
+	struct {
+		enum sketch_type type;   /* type expected by the references */
+		const char *file;        /* file of the first reference */
+		int line;                /* line of the first reference */
+	} ref;
+};
+
+#endif /* _HAPROXY_SKETCH_T_H */
+
+/*
+ * Local variables:
+ *  c-indent-level: 8
+ *  c-basic-offset: 8
+ * End:
+ */
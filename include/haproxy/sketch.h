@@ -0,0 +1,42 @@
+/*
+ * include/haproxy/sketch.h
+ * This file contains definitions for probabilistic sketches.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, version 2.1
+ * exclusively.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _HAPROXY_SKETCH_H
+#define _HAPROXY_SKETCH_H
+
+#include <haproxy/sketch-t.h>
+
+extern struct list sketches;
+
+struct sketch *sketch_find(const char *name);
+struct sketch *sketch_get_ref(const char *name, enum sketch_type type,
+                              const char *file, int line, char **err);
+void sketch_add(struct sketch *sk, const char *key, size_t len);
+unsigned int sketch_cms_rate(struct sketch *sk, const char *key, size_t len);
+unsigned long long sketch_hll_count(const struct sketch *sk);
+void sketch_clear(struct sketch *sk);
+
+#endif /* _HAPROXY_SKETCH_H */
+
+/*
+ * Local variables:
+ *  c-indent-level: 8
+ *  c-basic-offset: 8
+ * End:
+ */
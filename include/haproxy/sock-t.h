@@ -26,6 +26,7 @@
 #include <sys/types.h>
 
 #include <haproxy/api-t.h>
+#include <haproxy/list-t.h>
 
 #define SOCK_XFER_OPT_FOREIGN 0x000000001
 #define SOCK_XFER_OPT_V6ONLY  0x000000002
@@ -44,6 +45,33 @@ struct xfer_sock_list {
 	struct sockaddr_storage addr;
 };
 
+/* Zero-copy sends (MSG_ZEROCOPY) leave the buffer's storage to the kernel until
+ * it notifies its release through the error queue. Meanwhile the storage is
+ * held in a sock_zc_buf attached to the connection, and the sender gets a new
+ * one. Storage still held when the connection is closed is kept a bit longer
+ * since the kernel may still need it to retransmit, and no more notification
+ * may be retrieved once the socket is closed.
+ */
+#define SOCK_ZC_MAX_HELD        4  /* max buffers held per connection */
+#define SOCK_ZC_ORPHAN_DELAY 2000  /* ms to keep buffers still held after close */
+
+#define SOCK_ZC_F_DISABLED   0x01  /* don't use zero-copy anymore on this socket */
+
+struct sock_zc_buf {
+	struct list list;            /* attach point in sock_zc->held or in the orphans */
+	char *area;                  /* buffer storage lent to the kernel */
+	uint32_t lo, hi;             /* range of notification IDs covering this area */
+	uint32_t pending;            /* number of notifications not received yet */
+	unsigned int expire;         /* orphans only: date when it may be released */
+};
+
+struct sock_zc {
+	struct list held;            /* sock_zc_buf held for the kernel */
+	uint32_t next_id;            /* next notification ID the kernel will assign */
+	uint16_t nheld;              /* number of entries in <held> */
+	uint16_t flags;              /* SOCK_ZC_F_* */
+};
+
 #endif /* _HAPROXY_SOCK_T_H */
 
 /*
@@ -27,11 +27,15 @@
 
 #include <haproxy/api.h>
 #include <haproxy/connection-t.h>
+#include <haproxy/fd.h>
 #include <haproxy/listener-t.h>
 #include <haproxy/sock-t.h>
 
 extern struct xfer_sock_list *xfer_sock_list;
 
+/* first word sent by the "_getidleconns" CLI command */
+#define SOCK_IDLE_CONNS_MAGIC  0x49444c43
+
 int sock_create_server_socket(struct connection *conn);
 void sock_enable(struct receiver *rx);
 void sock_disable(struct receiver *rx);
@@ -39,6 +43,7 @@ void sock_unbind(struct receiver *rx);
 int sock_get_src(int fd, struct sockaddr *sa, socklen_t salen, int dir);
 int sock_get_dst(int fd, struct sockaddr *sa, socklen_t salen, int dir);
 int sock_get_old_sockets(const char *unixsocket);
+int sock_get_old_idle_conns(const char *unixsocket);
 int sock_find_compatible_fd(const struct receiver *rx);
 int sock_accepting_conn(const struct receiver *rx);
 struct connection *sock_accept_conn(struct listener *l, int *status);
@@ -51,6 +56,28 @@ int sock_drain(struct connection *conn);
 int sock_check_events(struct connection *conn, int event_type);
 void sock_ignore_events(struct connection *conn, int event_type);
 
+#ifdef HA_HAVE_MSG_ZEROCOPY
+struct sock_zc_buf *sock_zc_prepare(struct connection *conn);
+void sock_zc_hold(struct connection *conn, struct sock_zc_buf *zb, char *area, uint ids);
+void sock_zc_cancel(struct sock_zc_buf *zb);
+void sock_zc_reap(struct connection *conn);
+void sock_zc_release(struct connection *conn);
+
+/* Zero-copy completions are reported as socket errors by the poller. This
+ * processes them if some zero-copy sends are pending on <conn> and an error is
+ * reported on its FD, so that the error flag only remains if it is real.
+ */
+static inline void sock_zc_check_err(struct connection *conn)
+{
+	if (unlikely(conn->zc) && (fdtab[conn->handle.fd].state & FD_POLL_ERR))
+		sock_zc_reap(conn);
+}
+#else
+static inline void sock_zc_check_err(struct connection *conn)
+{
+}
+#endif
+
 
 #endif /* _HAPROXY_SOCK_H */
 
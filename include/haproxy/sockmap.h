@@ -0,0 +1,67 @@
+/*
+ * include/haproxy/sockmap.h
+ * In-kernel redirection of TCP traffic between two sockets - exported functions
+ *
+ * Copyright (C) 2021 HAProxy Technologies
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, version 2.1
+ * exclusively.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _HAPROXY_SOCKMAP_H
+#define _HAPROXY_SOCKMAP_H
+
+#include <haproxy/api.h>
+
+#ifdef USE_SOCKMAP
+
+extern int sockmap_ready;   /* non-zero once the redirection is usable */
+
+/* Sets up the BPF maps and programs if any proxy uses "option sockmap". It
+ * must be called once global.maxsock is known and before dropping privileges.
+ * Failures are only reported as warnings and leave the feature disabled.
+ */
+void sockmap_init();
+
+/* Makes the kernel directly forward all data received on TCP socket <fd1> to
+ * TCP socket <fd2> and conversely. Both sockets must be connected and the
+ * caller must not have any pending data for either of them. Returns 0 on
+ * success or -1 if the sockets could not be linked, in which case nothing was
+ * changed.
+ */
+int sockmap_link(int fd1, int fd2);
+
+/* Returns the number of bytes that socket <fd> received and that the kernel
+ * redirected since the previous call or since it was linked, or -1 on error.
+ * These bytes are then accounted as in flight towards the peer.
+ */
+long long sockmap_take_rcvd(int fd);
+
+/* Returns the number of bytes reported by sockmap_take_rcvd() on the peer of
+ * socket <fd> which were not yet written to <fd>, or -1 on error. The end of
+ * the redirected stream must not be forwarded to <fd> before this drops to
+ * zero, and the peer's last bytes must have been taken before it is closed.
+ */
+long long sockmap_pending(int fd);
+
+#endif /* USE_SOCKMAP */
+
+#endif /* _HAPROXY_SOCKMAP_H */
+
+/*
+ * Local variables:
+ *  c-indent-level: 8
+ *  c-basic-offset: 8
+ * End:
+ */
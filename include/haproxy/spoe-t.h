@@ -24,6 +24,8 @@
 
 #include <sys/time.h>
 
+#include <import/eb64tree.h>
+
 #include <haproxy/buf-t.h>
 #include <haproxy/dynbuf-t.h>
 #include <haproxy/filters-t.h>
@@ -45,6 +47,14 @@
 #define SPOE_FL_SND_FRAGMENTATION 0x00000008 /* Set when SPOE agent supports sending fragmented payload */
 #define SPOE_FL_RCV_FRAGMENTATION 0x00000010 /* Set when SPOE agent supports receiving fragmented payload */
 #define SPOE_FL_FORCE_SET_VAR     0x00000020 /* Set when SPOE agent will set all variables from agent (and not only known variables) */
+#define SPOE_FL_SHM_TRANSPORT     0x00000040 /* Set when SPOE agent is reached through shared memory rings */
+
+/* Number of samples of the sliding average of the frames round-trip times */
+#define SPOE_RTT_SAMPLES 16
+
+/* Default size and block size of the cache of the agents responses */
+#define SPOE_CACHE_DEF_SIZE  (1024 * 1024)
+#define SPOE_CACHE_BLOCKSIZE 128
 
 /* Flags set on the SPOE context */
 #define SPOE_CTX_FL_CLI_CONNECTED 0x00000001 /* Set after that on-client-session event was processed */
@@ -242,6 +252,7 @@ struct spoe_message {
 	struct list         acls;   /* ACL declared on this message */
 	struct acl_cond    *cond;   /* acl condition to meet */
 	enum spoe_event     event;  /* SPOE_EV_* */
+	unsigned int        cache_ttl; /* lifetime of the cached responses (ms), 0 if not cached */
 };
 
 /* Describe a group of messages that will be sent in a NOTIFY frame. A group has
@@ -289,6 +300,8 @@ struct spoe_agent {
 	unsigned int          eps_max;        /* Maximum # of errors per second */
 	unsigned int          max_frame_size; /* Maximum frame size for this agent, before any negotiation */
 	unsigned int          max_fpa;        /* Maximum # of frames handled per applet at once */
+	unsigned int          cache_size;     /* Size in bytes of the responses cache, if used */
+	struct shared_context *cache;         /* Cache of the responses, NULL if no message is cached */
 
 	struct list events[SPOE_EV_EVENTS];   /* List of SPOE messages that will be sent
 					       * for each supported events */
@@ -306,6 +319,8 @@ struct spoe_agent {
 
 		struct freq_ctr conn_per_sec;   /* connections per second */
 		struct freq_ctr err_per_sec;    /* connection errors per second */
+		unsigned int    rtt;            /* sliding sum of the frames round-trip times in microseconds */
+		unsigned int    nb_applets;     /* number of SPOE applets of this thread */
 
 		struct eb_root  idle_applets;   /* idle SPOE applets available to process data */
 		struct list     applets;        /* all SPOE applets for this agent */
@@ -353,6 +368,8 @@ struct spoe_context {
 	unsigned int        stream_id;    /* stream_id and frame_id are used */
 	unsigned int        frame_id;     /* to map NOTIFY and ACK frames */
 	unsigned int        process_exp;  /* expiration date to process an event */
+	unsigned int        cache_ttl;    /* lifetime of the response to the current frame if it may be cached, or 0 */
+	uint64_t            cache_key[2]; /* hash of the current frame, valid if <cache_ttl> is set */
 
 	struct spoe_appctx *spoe_appctx; /* SPOE appctx sending the current frame */
 	struct {
@@ -378,6 +395,15 @@ struct spoe_context {
 	} stats; /* Stats for this stream */
 };
 
+/* A response cached in the shared context of an agent. It is stored at the
+ * beginning of the first block of a row, followed by the encoded actions. The
+ * node's key holds the lower half of the hash of the NOTIFY frame payload. */
+struct spoe_cache_entry {
+	struct eb64_node node;      /* entry in the tree of the agent's cache */
+	uint64_t         key_hi;    /* upper half of the hash of the payload */
+	unsigned int     expire;    /* expiration date (ticks) */
+};
+
 /* SPOE context inside a appctx */
 struct spoe_appctx {
 	struct appctx      *owner;          /* the owner */
@@ -0,0 +1,37 @@
+/*
+ * include/haproxy/ssl_async.h
+ * Private key operations offloaded to worker threads in SSL async mode.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, version 2.1
+ * exclusively.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _HAPROXY_SSL_ASYNC_H
+#define _HAPROXY_SSL_ASYNC_H
+
+#ifdef USE_OPENSSL
+
+#include <haproxy/openssl-compat.h>
+
+#ifdef HAVE_SSL_ASYNC_WORKERS
+EVP_PKEY *ssl_async_wrap_key(EVP_PKEY *pkey);
+#else
+static inline EVP_PKEY *ssl_async_wrap_key(EVP_PKEY *pkey)
+{
+	return NULL;
+}
+#endif
+
+#endif /* USE_OPENSSL */
+#endif /* _HAPROXY_SSL_ASYNC_H */
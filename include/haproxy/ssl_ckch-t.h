@@ -67,6 +67,7 @@ struct ckch_store {
 	struct cert_key_and_chain *ckch;
 	struct list ckch_inst; /* list of ckch_inst which uses this ckch_node */
 	struct list crtlist_entry; /* list of entries which use this store */
+	int lazy; /* the certificate is only loaded on first use by the crt-list entries with SNI filters */
 	struct ebmb_node node;
 	char path[VAR_ARRAY];
 };
@@ -74,6 +75,12 @@ struct ckch_store {
 /* forward declarations for ckch_inst */
 struct ssl_bind_conf;
 struct crtlist_entry;
+struct ssl_lazy_req;
+
+/* states of a lazy ckch_inst */
+#define SSL_LAZY_ST_IDLE     0 /* loaded or not, depending on its SSL context */
+#define SSL_LAZY_ST_PENDING  1 /* being loaded */
+#define SSL_LAZY_ST_FAILED   2 /* the last load failed */
 
 
 /* Used to keep a list of all the instances using a specific cafile_entry.
@@ -106,11 +113,18 @@ struct ckch_inst {
 	SSL_CTX *ctx; /* pointer to the SSL context used by this instance */
 	unsigned int is_default:1;      /* This instance is used as the default ctx for this bind_conf */
 	unsigned int is_server_instance:1; /* This instance is used by a backend server */
+	unsigned int lazy:1;            /* The SSL context is only built on first use, see ssl_lazy.c */
 	/* space for more flag there */
 	struct list sni_ctx; /* list of sni_ctx using this ckch_inst */
 	struct list by_ckchs; /* chained in ckch_store's list of ckch_inst */
 	struct list by_crtlist_entry; /* chained in crtlist_entry list of inst */
 	struct list cafile_link_refs; /* list of ckch_inst_link pointing to this instance */
+	/* lazy instances only, protected by the ckch_lock */
+	struct list lazy_lru; /* element in the list of loaded lazy instances */
+	struct ssl_lazy_req *lazy_req; /* pending load request, or NULL */
+	unsigned int lazy_used; /* set when used since the last eviction pass */
+	int lazy_state; /* SSL_LAZY_ST_* */
+	unsigned int lazy_retry; /* date after which a failed load may be retried */
 };
 
 
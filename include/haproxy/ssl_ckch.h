@@ -28,6 +28,7 @@
 /* cert_key_and_chain functions */
 
 int ssl_sock_load_files_into_ckch(const char *path, struct cert_key_and_chain *ckch, char **err);
+int ssl_sock_load_buf_files_into_ckch(const char *path, char *buf, struct cert_key_and_chain *ckch, char **err);
 int ssl_sock_load_pem_into_ckch(const char *path, char *buf, struct cert_key_and_chain *ckch , char **err);
 void ssl_sock_free_cert_key_and_chain_contents(struct cert_key_and_chain *ckch);
 
@@ -42,6 +43,7 @@ struct ckch_store *ckchs_lookup(char *path);
 struct ckch_store *ckchs_dup(const struct ckch_store *src);
 struct ckch_store *ckch_store_new(const char *filename);
 void ckch_store_free(struct ckch_store *store);
+void ckchs_preload(char **paths, int count);
 
 
 /* ckch_inst functions */
@@ -0,0 +1,39 @@
+/*
+ * include/haproxy/ssl_lazy.h
+ * On-demand loading of the certificates of crt-list entries.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, version 2.1
+ * exclusively.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _HAPROXY_SSL_LAZY_H
+#define _HAPROXY_SSL_LAZY_H
+#ifdef USE_OPENSSL
+
+#include <haproxy/connection-t.h>
+#include <haproxy/openssl-compat.h>
+#include <haproxy/ssl_ckch-t.h>
+
+/* handshakes may be parked while the certificate is loaded by other threads */
+#if defined(USE_THREAD) && defined(HAVE_SSL_CLIENT_HELLO_CB) && !defined(OPENSSL_IS_BORINGSSL)
+#define HAVE_SSL_LAZY_ASYNC
+#endif
+
+int ssl_lazy_filters(char **sni_filter, int fcount);
+int ssl_lazy_request(struct connection *conn, struct ckch_inst *inst);
+void ssl_lazy_load_locked(struct ckch_inst *inst);
+void ssl_lazy_release_inst(struct ckch_inst *inst);
+
+#endif /* USE_OPENSSL */
+#endif /* _HAPROXY_SSL_LAZY_H */
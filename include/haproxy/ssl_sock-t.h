@@ -51,6 +51,8 @@
 #define SSL_SOCK_ST_FL_16K_WBFSIZE  0x00000002
 #define SSL_SOCK_SEND_UNLIMITED     0x00000004
 #define SSL_SOCK_RECV_HEARTBEAT     0x00000008
+#define SSL_SOCK_ST_FL_KTLS_TX      0x00000010 /* records are encrypted by the kernel */
+#define SSL_SOCK_ST_FL_KTLS_RX      0x00000020 /* records are decrypted by the kernel */
 
 /* bits 0xFFFF0000 are reserved to store verify errors */
 
@@ -166,6 +168,9 @@ struct tls_keys_ref {
 	union tls_sess_key *tlskeys;
 	int tls_ticket_enc_index;
 	int key_size_bits;
+	int sync;      /* the keys are synchronized through the table named <filename> */
+	struct stktable *table; /* table the keys are synchronized through, once resolved */
+	struct task *task;      /* task generating and installing the synchronized keys */
 	__decl_thread(HA_RWLOCK_T lock); /* lock used to protect the ref */
 };
 
@@ -237,7 +242,10 @@ struct ssl_sock_ctx {
 	int xprt_st;                  /* transport layer state, initialized to zero */
 	struct buffer early_buf;      /* buffer to store the early data received */
 	int sent_early_data;          /* Amount of early data we sent so far */
-
+	int ktls_ctrl_type;           /* kTLS: record type of the next control message, or 0 */
+	int lazy_parked;              /* number of times the handshake was parked for a lazy certificate */
+	struct list lazy_list;        /* element in the thread's list of handshakes waiting for a lazy certificate */
+	uint64_t hsk_cpu;             /* CPU time spent in the handshake, in nanoseconds */
 };
 
 struct global_ssl {
@@ -247,6 +255,8 @@ struct global_ssl {
 	int  skip_self_issued_ca;
 
 	int  async;                 /* whether we use ssl async mode */
+	int  async_workers;         /* number of threads running the private key operations in async mode */
+	int  load_threads;          /* number of threads loading the certificate files of a crt-list or directory */
 
 	char *listen_default_ciphers;
 	char *connect_default_ciphers;
@@ -267,10 +277,14 @@ struct global_ssl {
 	unsigned int max_record; /* SSL max record size */
 	unsigned int default_dh_param; /* SSL maximum DH parameter size */
 	int ctx_cache; /* max number of entries in the ssl_ctx cache. */
+	int cache_shards; /* number of shards of the shared session cache */
+	unsigned int ticket_rotate; /* rotation period of the synchronized TLS ticket keys, in seconds */
 	int capture_cipherlist; /* Size of the cipherlist buffer. */
 	int keylog; /* activate keylog  */
 	int extra_files; /* which files not defined in the configuration file are we looking for */
 	int extra_files_noext; /* whether we remove the extension when looking up a extra file */
+	int lazy_load; /* load the certificates of filtered crt-list entries on first use */
+	int lazy_cache_size; /* max number of lazily loaded SSL contexts kept in memory, 0 for no limit */
 };
 
 /* The order here matters for picking a default context,
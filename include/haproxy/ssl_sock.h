@@ -54,6 +54,7 @@ extern struct pool_head *pool_head_ssl_keylog_str;
 
 int ssl_sock_prep_ctx_and_inst(struct bind_conf *bind_conf, struct ssl_bind_conf *ssl_conf,
 			       SSL_CTX *ctx, struct ckch_inst *ckch_inst, char **err);
+int ssl_sock_put_ckch_into_ctx(const char *path, const struct cert_key_and_chain *ckch, SSL_CTX *ctx, char **err);
 int ssl_sock_prep_srv_ctx_and_inst(const struct server *srv, SSL_CTX *ctx,
 				   struct ckch_inst *ckch_inst);
 int ssl_sock_prepare_all_ctx(struct bind_conf *bind_conf);
@@ -74,6 +75,9 @@ int ssl_sock_parse_alpn(char *arg, char **alpn_str, int *alpn_len, char **err);
 void ssl_sock_set_alpn(struct connection *conn, const unsigned char *, int);
 void ssl_sock_set_servername(struct connection *conn, const char *hostname);
 void ssl_sock_set_srv(struct server *s, signed char use_ssl);
+int ssl_sock_srv_dump_session(struct server *srv, unsigned char **der);
+int ssl_sock_srv_load_session(struct server *srv, const unsigned char *der, int len);
+void ssl_sock_srv_flush_sessions(struct server *srv);
 
 int ssl_sock_get_cert_used_sess(struct connection *conn);
 int ssl_sock_get_cert_used_conn(struct connection *conn);
@@ -131,10 +135,10 @@ int ssl_ocsp_response_print(struct buffer *ocsp_response, struct buffer *out);
 
 #define sh_ssl_sess_tree_delete(s)     ebmb_delete(&(s)->key);
 
-#define sh_ssl_sess_tree_insert(s)     (struct sh_ssl_sess_hdr *)ebmb_insert(sh_ssl_sess_tree, \
+#define sh_ssl_sess_tree_insert(r, s)  (struct sh_ssl_sess_hdr *)ebmb_insert((r), \
                                                                     &(s)->key, SSL_MAX_SSL_SESSION_ID_LENGTH);
 
-#define sh_ssl_sess_tree_lookup(k)     (struct sh_ssl_sess_hdr *)ebmb_lookup(sh_ssl_sess_tree, \
+#define sh_ssl_sess_tree_lookup(r, k)  (struct sh_ssl_sess_hdr *)ebmb_lookup((r), \
                                                                     (k), SSL_MAX_SSL_SESSION_ID_LENGTH);
 
 /* Registers the function <func> in order to be called on SSL/TLS protocol
@@ -443,6 +443,19 @@ enum stat_field {
 	ST_F_USED_CONN_CUR,
 	ST_F_NEED_CONN_EST,
 	ST_F_UWEIGHT,
+	ST_F_QT_P99,
+	ST_F_CT_P99,
+	ST_F_RT_P99,
+	ST_F_TT_P99,
+	ST_F_QT_HIST,
+	ST_F_CT_HIST,
+	ST_F_RT_HIST,
+	ST_F_TT_HIST,
+	ST_F_CPU_TOT,
+	ST_F_CPU_CALLS,
+	ST_F_MEM_STRM,
+	ST_F_MEM_BUF,
+	ST_F_MEM_TBL,
 
 	/* must always be the last one */
 	ST_F_TOTAL_FIELDS
@@ -56,6 +56,7 @@ int stats_fill_be_stats(struct proxy *px, int flags, struct field *stats, int le
 			enum stat_field *selected_field);
 
 void stats_io_handler(struct stream_interface *si);
+unsigned int stats_since_from_epoch(unsigned long long epoch);
 int stats_emit_raw_data_field(struct buffer *out, const struct field *f);
 int stats_emit_typed_data_field(struct buffer *out, const struct field *f);
 int stats_emit_field_tags(struct buffer *out, const struct field *f,
@@ -126,9 +127,22 @@ static inline struct field mkf_flt(uint32_t type, double value)
 #define MK_STATS_PROXY_DOMAIN(px_cap) \
 	((px_cap) << STATS_PX_CAP | STATS_DOMAIN_PROXY)
 
+/* Returns non-zero if an object whose counters were last updated at <upd> and
+ * whose state last changed at <chg> has to be dumped by <appctx>, which is
+ * always the case unless a "since" date was set there.
+ */
+static inline int stats_is_active(const struct appctx *appctx, unsigned int upd, unsigned int chg)
+{
+	unsigned int since = appctx->ctx.stats.since;
+
+	return !since || (int)(upd - since) >= 0 || (int)(chg - since) >= 0;
+}
+
 int stats_allocate_proxy_counters_internal(struct extra_counters **counters,
                                            int type, int px_cap);
 int stats_allocate_proxy_counters(struct proxy *px);
+int stats_allocate_counters_shards(struct thr_counters **shards);
+int stats_allocate_time_hist(struct time_hist **hist);
 
 void stats_register_module(struct stats_module *m);
 
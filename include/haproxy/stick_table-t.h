@@ -165,7 +165,10 @@ struct stktable_type {
  */
 struct stksess {
 	unsigned int expire;      /* session expiration date */
-	unsigned int ref_cnt;     /* reference count, can only purge when zero */
+	unsigned int ref_cnt;     /* reference count, can only purge when zero (atomic) */
+	unsigned short shard;     /* index of the table shard holding this entry */
+	unsigned short key_class; /* index of the key size class the entry was allocated from */
+	unsigned int relay_src;   /* relay_id of the peer a pending relayed update came from, 0 if local */
 	__decl_thread(HA_RWLOCK_T lock); /* lock related to the table entry */
 	struct eb32_node exp;     /* ebtree node used to hold the session in expiration tree */
 	struct eb32_node upd;     /* ebtree node used to hold the update sequence tree */
@@ -174,6 +177,16 @@ struct stksess {
 };
 
 
+/* One shard of a stick table. Entries are spread over the shards of their
+ * table depending on a hash of their key, and each shard's lock protects its
+ * key and expiration trees as well as the entries attached to them.
+ */
+struct stktable_shard {
+	struct eb_root keys;      /* head of sticky session tree */
+	struct eb_root exps;      /* head of sticky session expiration tree */
+	__decl_thread(HA_SPINLOCK_T lock); /* lock protecting the trees above */
+} THREAD_ALIGNED(64);
+
 /* stick table */
 struct stktable {
 	char *id;		  /* local table id name. */
@@ -182,10 +195,15 @@ struct stktable {
 	                           * the same configuration section.
 	                           */
 	struct ebpt_node name;    /* Stick-table are lookup by name here. */
-	struct eb_root keys;      /* head of sticky session tree */
-	struct eb_root exps;      /* head of sticky session expiration tree */
+	struct stktable_shard *shards; /* <nb_shards> shards holding the entries */
+	unsigned int nb_shards;   /* number of shards, 0 means 1 before init */
 	struct eb_root updates;   /* head of sticky updates sequence tree */
-	struct pool_head *pool;   /* pool used to allocate sticky sessions */
+	struct {
+		struct pool_head *pool;   /* pool used to allocate the sticky sessions of this class */
+		unsigned int size;        /* room reserved for their key */
+		unsigned int used;        /* entries currently allocated in this class (atomic) */
+	} key_classes[STKTABLE_KEY_CLASSES]; /* from the smallest to the largest key size */
+	unsigned int nb_key_classes; /* number of key size classes, at least one once initialized */
 	struct task *exp_task;    /* expiration task */
 	struct task *sync_task;   /* sync task */
 	unsigned int update;
@@ -203,9 +221,16 @@ struct stktable {
 	unsigned int server_key_type; /* What type of key is used to identify servers */
 	size_t key_size;          /* size of a key, maximum size in case of string */
 	unsigned int size;        /* maximum number of sticky sessions in table */
-	unsigned int current;     /* number of sticky sessions currently in table */
+	unsigned int current;     /* number of sticky sessions currently in table (atomic) */
 	int nopurge;              /* if non-zero, don't purge sticky sessions when full */
 	int exp_next;             /* next expiration date (ticks) */
+	unsigned int exp_shard;   /* shard the expiration task resumes from */
+	struct {
+		unsigned int last;     /* entries expired during the last run */
+		unsigned long long total; /* entries expired since the start */
+		unsigned int lock_last;/* longest shard lock hold of the last run (us) */
+		unsigned int lock_max; /* longest shard lock hold since the start (us) */
+	} exp_stats;              /* expiration task statistics */
 	int expire;               /* time to live for sticky sessions (milliseconds) */
 	int data_size;            /* the size of the data that is prepended *before* stksess */
 	int data_ofs[STKTABLE_DATA_TYPES]; /* negative offsets of present data types, or 0 if absent */
@@ -214,13 +239,18 @@ struct stktable {
 		unsigned int u;
 		void *p;
 	} data_arg[STKTABLE_DATA_TYPES]; /* optional argument of each data type */
+	struct {
+		char *file;           /* file the entries are saved to and restored from, or NULL */
+		unsigned int interval;/* delay between two dumps (milliseconds) */
+		struct task *task;    /* task periodically dumping the entries */
+	} snapshot;
 	struct proxy *proxy;      /* The proxy this stick-table is attached to, if any.*/
 	struct proxy *proxies_list; /* The list of proxies which reference this stick-table. */
 	struct {
 		const char *file;     /* The file where the stick-table is declared. */
 		int line;             /* The line in this <file> the stick-table is declared. */
 	} conf;
-	__decl_thread(HA_SPINLOCK_T lock); /* spin lock related to the table */
+	__decl_thread(HA_SPINLOCK_T lock); /* protects the updates tree and counters */
 };
 
 extern struct stktable_data_type stktable_data_types[STKTABLE_DATA_TYPES];
@@ -46,6 +46,8 @@ void stksess_free(struct stktable *t, struct stksess *ts);
 int stksess_kill(struct stktable *t, struct stksess *ts, int decrefcount);
 
 int stktable_init(struct stktable *t);
+unsigned long long stktable_mem_usage(const struct stktable *t);
+int stktable_snapshot_dump(struct stktable *t);
 int stktable_parse_type(char **args, int *idx, unsigned long *type, size_t *key_size);
 int parse_stick_table(const char *file, int linenum, char **args,
                       struct stktable *t, char *id, char *nid, struct peers *peers);
@@ -54,6 +56,7 @@ struct stksess *stktable_set_entry(struct stktable *table, struct stksess *nts);
 void stktable_touch_with_exp(struct stktable *t, struct stksess *ts, int decrefcount, int expire);
 void stktable_touch_remote(struct stktable *t, struct stksess *ts, int decrefcnt);
 void stktable_touch_local(struct stktable *t, struct stksess *ts, int decrefccount);
+void stktable_touch_relay(struct stktable *t, struct stksess *ts, unsigned int src, int decrefcnt);
 struct stksess *stktable_lookup(struct stktable *t, struct stksess *ts);
 struct stksess *stktable_lookup_key(struct stktable *t, struct stktable_key *key);
 struct stksess *stktable_update_key(struct stktable *table, struct stktable_key *key);
@@ -163,7 +166,9 @@ static inline void *stktable_data_ptr(struct stktable *t, struct stksess *ts, in
 	return __stktable_data_ptr(t, ts, type);
 }
 
-/* kill an entry if it's expired and its ref_cnt is zero */
+/* kill an entry if it's expired and its ref_cnt is zero. The lock of the
+ * entry's shard must be held.
+ */
 static inline int __stksess_kill_if_expired(struct stktable *t, struct stksess *ts)
 {
 	if (t->expire != TICK_ETERNITY && tick_is_expired(ts->expire, now_ms))
@@ -174,15 +179,17 @@ static inline int __stksess_kill_if_expired(struct stktable *t, struct stksess *
 
 static inline void stksess_kill_if_expired(struct stktable *t, struct stksess *ts, int decrefcnt)
 {
-	HA_SPIN_LOCK(STK_TABLE_LOCK, &t->lock);
+	struct stktable_shard *shard = &t->shards[ts->shard];
+
+	HA_SPIN_LOCK(STK_TABLE_LOCK, &shard->lock);
 
 	if (decrefcnt)
-		ts->ref_cnt--;
+		HA_ATOMIC_DEC(&ts->ref_cnt);
 
 	if (t->expire != TICK_ETERNITY && tick_is_expired(ts->expire, now_ms))
 		__stksess_kill_if_expired(t, ts);
 
-	HA_SPIN_UNLOCK(STK_TABLE_LOCK, &t->lock);
+	HA_SPIN_UNLOCK(STK_TABLE_LOCK, &shard->lock);
 }
 
 /* sets the stick counter's entry pointer */
@@ -215,6 +222,20 @@ static inline void stkctr_clr_flags(struct stkctr *stkctr, unsigned int flags)
 	stkctr->entry = caddr_clr_flags(stkctr->entry, flags);
 }
 
+/* Decrease the number of concurrent connections stored at <ptr>, which must
+ * point to a conn_cur data type, unless it is already zero. Like the other
+ * arithmetic data types, it is updated using atomic operations only so that
+ * the entry's lock is not needed.
+ */
+static inline void stktable_conn_cur_dec(void *ptr)
+{
+	unsigned int *cur = &stktable_data_cast(ptr, conn_cur);
+	unsigned int val = HA_ATOMIC_LOAD(cur);
+
+	while (val && !HA_ATOMIC_CAS(cur, &val, val - 1))
+		__ha_cpu_relax();
+}
+
 /* Increase the number of cumulated HTTP requests in the tracked counter
  * <stkctr>. It returns 0 if the entry pointer does not exist and nothing is
  * performed. Otherwise it returns 1.
@@ -228,19 +249,15 @@ static inline int stkctr_inc_http_req_ctr(struct stkctr *stkctr)
 	if (!ts)
 		return 0;
 
-	HA_RWLOCK_WRLOCK(STK_SESS_LOCK, &ts->lock);
-
 	ptr1 = stktable_data_ptr(stkctr->table, ts, STKTABLE_DT_HTTP_REQ_CNT);
 	if (ptr1)
-		stktable_data_cast(ptr1, http_req_cnt)++;
+		HA_ATOMIC_INC(&stktable_data_cast(ptr1, http_req_cnt));
 
 	ptr2 = stktable_data_ptr(stkctr->table, ts, STKTABLE_DT_HTTP_REQ_RATE);
 	if (ptr2)
 		update_freq_ctr_period(&stktable_data_cast(ptr2, http_req_rate),
 				       stkctr->table->data_arg[STKTABLE_DT_HTTP_REQ_RATE].u, 1);
 
-	HA_RWLOCK_WRUNLOCK(STK_SESS_LOCK, &ts->lock);
-
 	/* If data was modified, we need to touch to re-schedule sync */
 	if (ptr1 || ptr2)
 		stktable_touch_local(stkctr->table, ts, 0);
@@ -260,19 +277,15 @@ static inline int stkctr_inc_http_err_ctr(struct stkctr *stkctr)
 	if (!ts)
 		return 0;
 
-	HA_RWLOCK_WRLOCK(STK_SESS_LOCK, &ts->lock);
-
 	ptr1 = stktable_data_ptr(stkctr->table, ts, STKTABLE_DT_HTTP_ERR_CNT);
 	if (ptr1)
-		stktable_data_cast(ptr1, http_err_cnt)++;
+		HA_ATOMIC_INC(&stktable_data_cast(ptr1, http_err_cnt));
 
 	ptr2 = stktable_data_ptr(stkctr->table, ts, STKTABLE_DT_HTTP_ERR_RATE);
 	if (ptr2)
 		update_freq_ctr_period(&stktable_data_cast(ptr2, http_err_rate),
 				       stkctr->table->data_arg[STKTABLE_DT_HTTP_ERR_RATE].u, 1);
 
-	HA_RWLOCK_WRUNLOCK(STK_SESS_LOCK, &ts->lock);
-
 	/* If data was modified, we need to touch to re-schedule sync */
 	if (ptr1 || ptr2)
 		stktable_touch_local(stkctr->table, ts, 0);
@@ -292,19 +305,15 @@ static inline int stkctr_inc_http_fail_ctr(struct stkctr *stkctr)
 	if (!ts)
 		return 0;
 
-	HA_RWLOCK_WRLOCK(STK_SESS_LOCK, &ts->lock);
-
 	ptr1 = stktable_data_ptr(stkctr->table, ts, STKTABLE_DT_HTTP_FAIL_CNT);
 	if (ptr1)
-		stktable_data_cast(ptr1, http_fail_cnt)++;
+		HA_ATOMIC_INC(&stktable_data_cast(ptr1, http_fail_cnt));
 
 	ptr2 = stktable_data_ptr(stkctr->table, ts, STKTABLE_DT_HTTP_FAIL_RATE);
 	if (ptr2)
 		update_freq_ctr_period(&stktable_data_cast(ptr2, http_fail_rate),
 				       stkctr->table->data_arg[STKTABLE_DT_HTTP_FAIL_RATE].u, 1);
 
-	HA_RWLOCK_WRUNLOCK(STK_SESS_LOCK, &ts->lock);
-
 	/* If data was modified, we need to touch to re-schedule sync */
 	if (ptr1 || ptr2)
 		stktable_touch_local(stkctr->table, ts, 0);
@@ -324,17 +333,14 @@ static inline int stkctr_inc_bytes_in_ctr(struct stkctr *stkctr, unsigned long l
 	if (!ts)
 		return 0;
 
-	HA_RWLOCK_WRLOCK(STK_SESS_LOCK, &ts->lock);
 	ptr1 = stktable_data_ptr(stkctr->table, ts, STKTABLE_DT_BYTES_IN_CNT);
 	if (ptr1)
-		stktable_data_cast(ptr1, bytes_in_cnt) += bytes;
+		HA_ATOMIC_ADD(&stktable_data_cast(ptr1, bytes_in_cnt), bytes);
 
 	ptr2 = stktable_data_ptr(stkctr->table, ts, STKTABLE_DT_BYTES_IN_RATE);
 	if (ptr2)
 		update_freq_ctr_period(&stktable_data_cast(ptr2, bytes_in_rate),
 				       stkctr->table->data_arg[STKTABLE_DT_BYTES_IN_RATE].u, bytes);
-	HA_RWLOCK_WRUNLOCK(STK_SESS_LOCK, &ts->lock);
-
 
 	/* If data was modified, we need to touch to re-schedule sync */
 	if (ptr1 || ptr2)
@@ -355,17 +361,14 @@ static inline int stkctr_inc_bytes_out_ctr(struct stkctr *stkctr, unsigned long
 	if (!ts)
 		return 0;
 
-	HA_RWLOCK_WRLOCK(STK_SESS_LOCK, &ts->lock);
 	ptr1 = stktable_data_ptr(stkctr->table, ts, STKTABLE_DT_BYTES_OUT_CNT);
 	if (ptr1)
-		stktable_data_cast(ptr1, bytes_out_cnt) += bytes;
+		HA_ATOMIC_ADD(&stktable_data_cast(ptr1, bytes_out_cnt), bytes);
 
 	ptr2 = stktable_data_ptr(stkctr->table, ts, STKTABLE_DT_BYTES_OUT_RATE);
 	if (ptr2)
 		update_freq_ctr_period(&stktable_data_cast(ptr2, bytes_out_rate),
 				       stkctr->table->data_arg[STKTABLE_DT_BYTES_OUT_RATE].u, bytes);
-	HA_RWLOCK_WRUNLOCK(STK_SESS_LOCK, &ts->lock);
-
 
 	/* If data was modified, we need to touch to re-schedule sync */
 	if (ptr1 || ptr2)
@@ -88,6 +88,8 @@
 #define SF_IGNORE_PRST	0x00080000	/* ignore persistence */
 
 #define SF_SRV_REUSED   0x00100000	/* the server-side connection was reused */
+#define SF_WITH_CS      0x00200000	/* allocated with its front conn_stream by cs_new_with_stream() */
+#define SF_SOCKMAP      0x00400000	/* the kernel forwards the data between both connections */
 
 
 /* flags for the proxy of the master CLI */
@@ -115,27 +117,55 @@ struct strm_logs {
 	long long bytes_out;            /* number of bytes transferred from the server to the client */
 };
 
+/* number of sticking rules entries which may be stored per stream */
+#define STRM_MAX_STORE  8
+
+/* a sticking rule entry waiting to be stored at the end of the stream */
+struct strm_store {
+	struct stksess *ts;
+	struct stktable *table;
+};
+
+/* The stream is split in two parts. The first one contains the fields used
+ * each time the stream is woken up or one of its stream interfaces processes
+ * an I/O event, and must fit in STRM_HOT_SIZE bytes. The second one, starting
+ * on a new cache line, contains the fields only used by some rules, logs, or
+ * stream management. Rarely used large areas are allocated on demand. Both
+ * constraints are verified at build time in stream.c.
+ */
+#define STRM_HOT_SIZE   (8 * 64)
+#define STRM_MAX_SIZE   (16 * 64)
+
 struct stream {
+	/* hot part */
 	int flags;                      /* some flags describing the stream */
 	unsigned int uniq_id;           /* unique ID used for the traces */
 	enum obj_type *target;          /* target to use for this stream */
-
-	struct channel req;             /* request channel */
-	struct channel res;             /* response channel */
+	struct task *task;              /* the task associated with this stream */
+	unsigned int pending_events;	/* the pending events not yet processed by the stream.
+					 * This is a bit field of TASK_WOKEN_* */
+	enum obj_type obj_type;         /* object type == OBJ_TYPE_STREAM */
+	/* 3 unused bytes here */
 
 	struct proxy *be;               /* the proxy this stream depends on for the server side */
-
 	struct session *sess;           /* the session this stream is attached to */
-
+	struct http_txn *txn;           /* current HTTP transaction being processed. Should become a list. */
 	struct server *srv_conn;        /* stream already has a slot on a server and is not in queue */
+
+	struct channel req;             /* request channel */
+	struct channel res;             /* response channel */
+	struct stream_interface si[2];  /* client and server stream interfaces */
+	struct strm_flt strm_flt;       /* current state of filters active on this stream */
+
 	struct pendconn *pend_pos;      /* if not NULL, points to the pending position in the pending queue */
+	struct freq_ctr call_rate;      /* stream task call rate */
+	int tunnel_timeout;             /* timeout used once in tunnel mode, in ticks */
 
-	struct http_txn *txn;           /* current HTTP transaction being processed. Should become a list. */
+	/* cold part */
+	ALWAYS_ALIGN(64);
 
-	struct task *task;              /* the task associated with this stream */
-	unsigned int pending_events;	/* the pending events not yet processed by the stream.
-					 * This is a bit field of TASK_WOKEN_* */
 	int16_t priority_class;         /* priority class of the stream for the pending queue */
+	short store_count;              /* number of entries in <store> */
 	int32_t priority_offset;        /* priority offset of the stream for the pending queue */
 
 	struct list list;               /* position in the thread's streams list */
@@ -143,28 +173,16 @@ struct stream {
 	struct list back_refs;          /* list of users tracking this stream */
 	struct buffer_wait buffer_wait; /* position in the list of objects waiting for a buffer */
 
-	struct freq_ctr call_rate;      /* stream task call rate */
-
-	short store_count;
-	enum obj_type obj_type;         /* object type == OBJ_TYPE_STREAM */
-	/* 1 unused bytes here */
-
-	struct {
-		struct stksess *ts;
-		struct stktable *table;
-	} store[8];                     /* tracked stickiness values to store */
+	struct strm_store *store;       /* STRM_MAX_STORE tracked stickiness values to store, allocated on demand */
 
 	struct sockaddr_storage *target_addr;   /* the address to join if not null */
 	struct stkctr stkctr[MAX_SESS_STKCTR];  /* content-aware stick counters */
 
-	struct strm_flt strm_flt;               /* current state of filters active on this stream */
-
 	char **req_cap;                         /* array of captures from the request (may be NULL) */
 	char **res_cap;                         /* array of captures from the response (may be NULL) */
 	struct vars vars_txn;                   /* list of variables for the txn scope. */
 	struct vars vars_reqres;                /* list of variables for the request and resp scope. */
 
-	struct stream_interface si[2];          /* client and server stream interfaces */
 	struct strm_logs logs;                  /* logs for this stream */
 
 	void (*do_log)(struct stream *s);       /* the function to call in order to log (or NULL) */
@@ -180,8 +198,9 @@ struct stream {
 	struct list *current_rule_list;         /* this is used to store the current executed rule list. */
 	void *current_rule;                     /* this is used to store the current rule to be resumed. */
 	int rules_exp;                          /* expiration date for current rules execution */
-
 	unsigned int stream_epoch;              /* copy of stream_epoch when the stream was created */
+	struct acl_cache *acl_cache;            /* sample cache of the rule set being evaluated, or NULL */
+
 	struct hlua *hlua;                      /* lua runtime context */
 
 	/* Context */
@@ -193,7 +212,7 @@ struct stream {
 		struct act_rule *parent;        /* rule which requested this resolution */
 	} resolv_ctx;                           /* context information for DNS resolution */
 
-	int tunnel_timeout;
+	uint64_t cpu_time;                      /* CPU time spent in I/O callbacks and connection layers, in ns */
 };
 
 #endif /* _HAPROXY_STREAM_T_H */
@@ -76,9 +76,14 @@ void default_srv_error(struct stream *s, struct stream_interface *si);
 
 /* Update the stream's backend and server time stats */
 void stream_update_time_stats(struct stream *s);
+uint64_t stream_cpu_time(struct stream *s, unsigned int *calls);
 void stream_release_buffers(struct stream *s);
 int stream_buf_available(void *arg);
 
+#ifdef USE_SOCKMAP
+void stream_sockmap_sync(struct stream *s);
+#endif
+
 /* returns the session this stream belongs to */
 static inline struct session *strm_sess(const struct stream *strm)
 {
@@ -124,12 +129,7 @@ static inline void stream_store_counters(struct stream *s)
 
 		ptr = stktable_data_ptr(s->stkctr[i].table, ts, STKTABLE_DT_CONN_CUR);
 		if (ptr) {
-			HA_RWLOCK_WRLOCK(STK_SESS_LOCK, &ts->lock);
-
-			if (stktable_data_cast(ptr, conn_cur) > 0)
-				stktable_data_cast(ptr, conn_cur)--;
-
-			HA_RWLOCK_WRUNLOCK(STK_SESS_LOCK, &ts->lock);
+			stktable_conn_cur_dec(ptr);
 
 			/* If data was modified, we need to touch to re-schedule sync */
 			stktable_touch_local(s->stkctr[i].table, ts, 0);
@@ -163,12 +163,7 @@ static inline void stream_stop_content_counters(struct stream *s)
 
 		ptr = stktable_data_ptr(s->stkctr[i].table, ts, STKTABLE_DT_CONN_CUR);
 		if (ptr) {
-			HA_RWLOCK_WRLOCK(STK_SESS_LOCK, &ts->lock);
-
-			if (stktable_data_cast(ptr, conn_cur) > 0)
-				stktable_data_cast(ptr, conn_cur)--;
-
-			HA_RWLOCK_WRUNLOCK(STK_SESS_LOCK, &ts->lock);
+			stktable_conn_cur_dec(ptr);
 
 			/* If data was modified, we need to touch to re-schedule sync */
 			stktable_touch_local(s->stkctr[i].table, ts, 0);
@@ -186,26 +181,22 @@ static inline void stream_start_counters(struct stktable *t, struct stksess *ts)
 {
 	void *ptr;
 
-	HA_RWLOCK_WRLOCK(STK_SESS_LOCK, &ts->lock);
-
 	ptr = stktable_data_ptr(t, ts, STKTABLE_DT_CONN_CUR);
 	if (ptr)
-		stktable_data_cast(ptr, conn_cur)++;
+		HA_ATOMIC_INC(&stktable_data_cast(ptr, conn_cur));
 
 	ptr = stktable_data_ptr(t, ts, STKTABLE_DT_CONN_CNT);
 	if (ptr)
-		stktable_data_cast(ptr, conn_cnt)++;
+		HA_ATOMIC_INC(&stktable_data_cast(ptr, conn_cnt));
 
 	ptr = stktable_data_ptr(t, ts, STKTABLE_DT_CONN_RATE);
 	if (ptr)
 		update_freq_ctr_period(&stktable_data_cast(ptr, conn_rate),
 				       t->data_arg[STKTABLE_DT_CONN_RATE].u, 1);
-	if (tick_isset(t->expire))
-		ts->expire = tick_add(now_ms, MS_TO_TICKS(t->expire));
 
-	HA_RWLOCK_WRUNLOCK(STK_SESS_LOCK, &ts->lock);
-
-	/* If data was modified, we need to touch to re-schedule sync */
+	/* If data was modified, we need to touch to re-schedule sync. This
+	 * also refreshes the entry's expiration date.
+	 */
 	stktable_touch_local(t, ts, 0);
 }
 
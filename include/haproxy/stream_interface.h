@@ -164,6 +164,22 @@ static inline enum obj_type *si_detach_endpoint(struct stream_interface *si)
 	return prev;
 }
 
+/* Returns the CPU time in nanoseconds spent in the mux and transport layers
+ * of the connection attached to <si> since it was attached. Nothing is
+ * reported for multiplexed connections since their time cannot be attributed
+ * to a single stream.
+ */
+static inline uint64_t si_conn_cpu(const struct stream_interface *si)
+{
+	const struct conn_stream *cs = objt_cs(si->end);
+	const struct connection *conn = cs_conn(cs);
+
+	if (!conn || (conn->mux && (conn->mux->flags & MX_FL_MULTIPLEX)))
+		return 0;
+
+	return conn->cpu_time - cs->conn_cpu;
+}
+
 /* Release the endpoint if it's a connection or an applet, then nullify it.
  * Note: released connections are closed then freed.
  */
@@ -176,6 +192,7 @@ static inline void si_release_endpoint(struct stream_interface *si)
 		return;
 
 	if ((cs = objt_cs(si->end))) {
+		si_strm(si)->cpu_time += si_conn_cpu(si);
 		if (si->wait_event.events != 0)
 			cs->conn->mux->unsubscribe(cs, si->wait_event.events,
 			    &si->wait_event);
@@ -197,6 +214,7 @@ static inline void si_attach_cs(struct stream_interface *si, struct conn_stream
 {
 	si->ops = &si_conn_ops;
 	si->end = &cs->obj_type;
+	cs->conn_cpu = cs->conn->cpu_time;
 	cs_attach(cs, si, &si_conn_cb);
 }
 
@@ -68,6 +68,16 @@ enum {
 	TL_CLASSES       /* must be last */
 };
 
+/* Task classes, grouping the work by cost so that the expensive one may run on
+ * dedicated threads configured with the global "task-class" directive.
+ */
+enum task_class {
+	TASK_CLASS_IO = 0, /* latency-sensitive forwarding (frontends' listeners) */
+	TASK_CLASS_BULK,   /* background work: CLI, Lua tasks, stick-table dumps */
+	TASK_CLASS_CRYPTO, /* certificate loading and TLS keys management */
+	TASK_CLASSES       /* must be last */
+};
+
 struct notification {
 	struct list purge_me; /* Part of the list of signals to be purged in the
 	                         case of the LUA execution stack crash. */
@@ -77,6 +87,35 @@ struct notification {
 	__decl_thread(HA_SPINLOCK_T lock);
 };
 
+#ifdef USE_TIMER_WHEEL
+/* The thread-local wait queues are hierarchical timer wheels. Each level has
+ * one slot per bit of a long, and each slot of level <l> covers a period of
+ * 2^(l * TW_SLOT_BITS) ms. Enough levels are needed to cover 32-bit ticks.
+ */
+#define TW_SLOT_BITS     ((LONGBITS == 64) ? 6 : 5)
+#define TW_SLOTS         (1 << TW_SLOT_BITS)
+#define TW_LEVELS        ((32 + TW_SLOT_BITS - 1) / TW_SLOT_BITS)
+
+struct timer_wheel {
+	unsigned int date;                      /* date the wheel was last advanced to */
+	unsigned long used[TW_LEVELS];          /* slots which may hold tasks, per level */
+	struct list slot[TW_LEVELS][TW_SLOTS];  /* tasks by expiration slot */
+};
+#endif
+
+/* Per thread group scheduler context. The tasks which may run on multiple
+ * threads are queued in the run queue of one of the groups their threads
+ * belong to, so that the threads of distinct groups never compete for the
+ * same lock nor share the same cache lines.
+ */
+struct task_per_tgroup {
+	struct eb_root rqueue;          /* tree constituting the group's shared run queue */
+	unsigned long tasks_mask;       /* mask of the threads with tasks in <rqueue> */
+	unsigned int rqueue_ticks;      /* insertion counter for <rqueue> */
+	__decl_thread(HA_SPINLOCK_T rq_lock); /* protects the fields above */
+	ALWAYS_ALIGN(64);
+};
+
 /* force to split per-thread stuff into separate cache lines */
 struct task_per_thread {
 	// first and second cache lines on 64 bits: thread-local operations only.
@@ -97,6 +136,10 @@ struct task_per_thread {
 	struct mt_list shared_tasklet_list; /* Tasklet to be run, woken up by other threads */
 	unsigned int rq_total;  /* total size of the run queue, prio_tree + tasklets */
 	int tasks_in_list;      /* Number of tasks in the per-thread tasklets list */
+#ifdef USE_TIMER_WHEEL
+	ALWAYS_ALIGN(64);
+	struct timer_wheel wheel; /* thread-local wait queue, replaces <timers> */
+#endif
 	ALWAYS_ALIGN(128);
 };
 
@@ -135,9 +178,12 @@ struct task {
 	TASK_COMMON;			/* must be at the beginning! */
 	struct eb32sc_node rq;		/* ebtree node used to hold the task in the run queue */
 	struct eb32_node wq;		/* ebtree node used to hold the task in the wait queue */
+#ifdef USE_TIMER_WHEEL
+	struct list wl;			/* element of a timer wheel slot, the key being in wq.key */
+#endif
 	int expire;			/* next expiration date for this task, in ticks */
 	short nice;                     /* task prio from -1024 to +1024 */
-	/* 16-bit hole here */
+	unsigned short rq_tgrp;         /* thread group whose run queue holds the task when TASK_GLOBAL */
 	unsigned long thread_mask;	/* mask of thread IDs authorized to process the task */
 	uint64_t call_date;		/* date of the last task wakeup or call */
 	uint64_t lat_time;		/* total latency time experienced */
@@ -148,9 +194,7 @@ struct task {
 struct tasklet {
 	TASK_COMMON;			/* must be at the beginning! */
 	struct list list;
-#ifdef DEBUG_TASK
 	uint64_t call_date;		/* date of the last tasklet wakeup or call */
-#endif
 	int tid;                        /* TID of the tasklet owner, <0 if local */
 };
 
@@ -87,7 +87,6 @@
 
 
 /* a few exported variables */
-extern volatile unsigned long global_tasks_mask; /* Mask of threads with tasks in the global runqueue */
 extern unsigned int grq_total;    /* total number of entries in the global run queue, atomic */
 extern unsigned int niced_tasks;  /* number of niced tasks in the run queue */
 extern struct pool_head *pool_head_task;
@@ -97,12 +96,14 @@ extern THREAD_LOCAL struct task_per_thread *sched; /* current's thread scheduler
 
 #ifdef USE_THREAD
 extern struct eb_root timers;      /* sorted timers tree, global */
-extern struct eb_root rqueue;      /* tree constituting the run queue */
 #endif
 
 extern struct task_per_thread task_per_thread[MAX_THREADS];
+extern struct task_per_tgroup task_per_tgroup[MAX_TGROUPS];
+
+extern unsigned long task_class_mask[TASK_CLASSES]; /* threads of each class, 0=all */
+extern const char *task_class_names[TASK_CLASSES];
 
-__decl_thread(extern HA_SPINLOCK_T rq_lock);  /* spin lock related to run queue */
 __decl_thread(extern HA_RWLOCK_T wq_lock);    /* RW lock related to the wait queue */
 
 void __tasklet_wakeup_on(struct tasklet *tl, int thr);
@@ -159,6 +160,15 @@ static inline int total_run_queues()
 	return ret;
 }
 
+/* Returns the mask of the threads a task of class <cls> may run on, which is
+ * suitable for task_new(). Unless the class was configured with "task-class",
+ * it may run on any thread.
+ */
+static inline unsigned long task_class_threads(enum task_class cls)
+{
+	return task_class_mask[cls] ? task_class_mask[cls] : MAX_THREADS_MASK;
+}
+
 /* returns the number of allocated tasks across all threads. Note that this
  * *is* racy since some threads might be updating their counts while we're
  * looking, but this is only for statistics reporting.
@@ -184,13 +194,32 @@ static inline int task_in_rq(struct task *t)
 /* return 0 if task is in wait queue, otherwise non-zero */
 static inline int task_in_wq(struct task *t)
 {
+#ifdef USE_TIMER_WHEEL
+	if (LIST_INLIST(&t->wl))
+		return 1;
+#endif
 	return t->wq.node.leaf_p != NULL;
 }
 
+/* returns true if thread-local wait queue <tt> may contain some tasks */
+static inline int thread_has_timers(const struct task_per_thread *tt)
+{
+#ifdef USE_TIMER_WHEEL
+	int lvl;
+
+	for (lvl = 0; lvl < TW_LEVELS; lvl++)
+		if (tt->wheel.used[lvl])
+			return 1;
+	return 0;
+#else
+	return !eb_is_empty(&tt->timers);
+#endif
+}
+
 /* returns true if the current thread has some work to do */
 static inline int thread_has_tasks(void)
 {
-	return (!!(global_tasks_mask & tid_bit) |
+	return (!!(task_per_tgroup[ti->tgrp].tasks_mask & tid_bit) |
 		!eb_is_empty(&sched->rqueue) |
 	        !!sched->tl_class_mask |
 		!MT_LIST_ISEMPTY(&sched->shared_tasklet_list));
@@ -231,6 +260,12 @@ static inline void _task_wakeup(struct task *t, unsigned int f, const char *file
  */
 static inline struct task *__task_unlink_wq(struct task *t)
 {
+#ifdef USE_TIMER_WHEEL
+	if (LIST_INLIST(&t->wl)) {
+		LIST_DEL_INIT(&t->wl);
+		return t;
+	}
+#endif
 	eb32_delete(&t->wq);
 	return t;
 }
@@ -320,7 +355,7 @@ static inline struct task *task_unlink_rq(struct task *t)
 	int done = 0;
 
 	if (is_global)
-		HA_SPIN_LOCK(TASK_RQ_LOCK, &rq_lock);
+		HA_SPIN_LOCK(TASK_RQ_LOCK, &task_per_tgroup[t->rq_tgrp].rq_lock);
 
 	if (likely(task_in_rq(t))) {
 		eb32sc_delete(&t->rq);
@@ -328,7 +363,7 @@ static inline struct task *task_unlink_rq(struct task *t)
 	}
 
 	if (is_global)
-		HA_SPIN_UNLOCK(TASK_RQ_LOCK, &rq_lock);
+		HA_SPIN_UNLOCK(TASK_RQ_LOCK, &task_per_tgroup[t->rq_tgrp].rq_lock);
 
 	if (done) {
 		if (is_global) {
@@ -368,9 +403,9 @@ static inline void _tasklet_wakeup_on(struct tasklet *tl, int thr, const char *f
 	tl->debug.caller_idx = !tl->debug.caller_idx;
 	tl->debug.caller_file[tl->debug.caller_idx] = file;
 	tl->debug.caller_line[tl->debug.caller_idx] = line;
-	if (task_profiling_mask & tid_bit)
-		tl->call_date = now_mono_time();
 #endif
+	if (unlikely(task_profiling_mask & tid_bit))
+		tl->call_date = now_mono_time();
 	__tasklet_wakeup_on(tl, thr);
 }
 
@@ -418,6 +453,9 @@ static inline void tasklet_remove_from_tasklet_list(struct tasklet *t)
 static inline struct task *task_init(struct task *t, unsigned long thread_mask)
 {
 	t->wq.node.leaf_p = NULL;
+#ifdef USE_TIMER_WHEEL
+	LIST_INIT(&t->wl);
+#endif
 	t->rq.node.leaf_p = NULL;
 	t->state = TASK_SLEEPING;
 	t->thread_mask = thread_mask;
@@ -444,6 +482,7 @@ static inline void tasklet_init(struct tasklet *t)
 	t->calls = 0;
 	t->state = TASK_F_TASKLET;
 	t->process = NULL;
+	t->call_date = 0;
 	t->tid = -1;
 #ifdef DEBUG_TASK
 	t->debug.caller_idx = 0;
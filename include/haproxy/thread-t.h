@@ -107,6 +107,42 @@
 #define HA_SPINLOCK_T        __HA_SPINLOCK_T
 #define HA_RWLOCK_T          __HA_RWLOCK_T
 
+/* Production lock profiling ("set profiling locks on"). Wait times are only
+ * measured when the lock was found contended, and hold times are measured for
+ * one acquisition in LOCK_PROF_SAMPLING, with at most LOCK_PROF_HELD sampled
+ * locks held at once per thread.
+ */
+#define LOCK_PROF_SAMPLING   16
+#define LOCK_PROF_HELD        8
+#define LOCK_PROF_CALLERS   256  /* entries in the per-caller hash table */
+
+/* lock operations reported to the lock profiler */
+enum lock_prof_op {
+	LOCK_PROF_S = 0,             /* spinlock or seek lock */
+	LOCK_PROF_W,                 /* write lock */
+	LOCK_PROF_R,                 /* read lock */
+};
+
+/* per-thread and per-label statistics, only updated by their thread */
+struct lock_prof_stat {
+	uint64_t calls;              /* number of acquisitions */
+	uint64_t contended;          /* number of acquisitions which had to wait */
+	uint64_t wait_time;          /* total wait time in ns */
+	uint64_t max_wait;           /* longest wait in ns */
+	uint64_t hold_samples;       /* number of hold times measured */
+	uint64_t hold_time;          /* total sampled hold time in ns */
+} THREAD_ALIGNED(64);
+
+/* per-caller statistics, shared between threads and hashed by caller address */
+struct lock_prof_caller {
+	const void *caller;          /* return address of the locking function */
+	unsigned int label;          /* first lock label seen from this place */
+	uint64_t contended;          /* number of acquisitions which had to wait */
+	uint64_t wait_time;          /* total wait time in ns */
+	uint64_t hold_samples;       /* number of hold times measured */
+	uint64_t hold_time;          /* total sampled hold time in ns */
+};
+
 #else /* !DEBUG_THREAD */
 
 #define HA_SPINLOCK_T       struct ha_spinlock
@@ -46,7 +46,13 @@
 
 /* Generic exports */
 int parse_nbthread(const char *arg, char **err);
+int parse_nbtgroups(const char *arg, char **err);
+void thread_map_to_groups();
 int thread_get_default_count();
+int startup_work_add(int (*fct)(void *arg), void *arg);
+int startup_work_run(unsigned int *jobs, int *threads);
+void thread_retire(void *ptr, void (*release)(void *));
+void thread_quiescent(void);
 extern int thread_cpus_enabled_at_boot;
 
 
@@ -282,89 +288,6 @@ static inline unsigned long thread_isolated()
  */
 int thread_cpu_mask_forced();
 
-#if !defined(DEBUG_THREAD) && !defined(DEBUG_FULL)
-
-/* Thread debugging is DISABLED, these are the regular locking functions */
-
-#define HA_SPIN_INIT(l)            ({ (*l) = 0; })
-#define HA_SPIN_DESTROY(l)         ({ (*l) = 0; })
-#define HA_SPIN_LOCK(lbl, l)       pl_take_s(l)
-#define HA_SPIN_TRYLOCK(lbl, l)    (!pl_try_s(l))
-#define HA_SPIN_UNLOCK(lbl, l)     pl_drop_s(l)
-
-#define HA_RWLOCK_INIT(l)          ({ (*l) = 0; })
-#define HA_RWLOCK_DESTROY(l)       ({ (*l) = 0; })
-#define HA_RWLOCK_WRLOCK(lbl,l)    pl_take_w(l)
-#define HA_RWLOCK_TRYWRLOCK(lbl,l) (!pl_try_w(l))
-#define HA_RWLOCK_WRUNLOCK(lbl,l)  pl_drop_w(l)
-#define HA_RWLOCK_RDLOCK(lbl,l)    pl_take_r(l)
-#define HA_RWLOCK_TRYRDLOCK(lbl,l) (!pl_try_r(l))
-#define HA_RWLOCK_RDUNLOCK(lbl,l)  pl_drop_r(l)
-
-/* rwlock upgrades via seek locks */
-#define HA_RWLOCK_SKLOCK(lbl,l)         pl_take_s(l)      /* N --> S */
-#define HA_RWLOCK_SKTOWR(lbl,l)         pl_stow(l)        /* S --> W */
-#define HA_RWLOCK_WRTOSK(lbl,l)         pl_wtos(l)        /* W --> S */
-#define HA_RWLOCK_SKTORD(lbl,l)         pl_stor(l)        /* S --> R */
-#define HA_RWLOCK_WRTORD(lbl,l)         pl_wtor(l)        /* W --> R */
-#define HA_RWLOCK_SKUNLOCK(lbl,l)       pl_drop_s(l)      /* S --> N */
-#define HA_RWLOCK_TRYSKLOCK(lbl,l)      (!pl_try_s(l))    /* N -?> S */
-#define HA_RWLOCK_TRYRDTOSK(lbl,l)      (!pl_try_rtos(l)) /* R -?> S */
-
-#else /* !defined(DEBUG_THREAD) && !defined(DEBUG_FULL) */
-
-/* Thread debugging is ENABLED, these are the instrumented functions */
-
-#define __SPIN_INIT(l)             ({ (*l) = 0; })
-#define __SPIN_DESTROY(l)          ({ (*l) = 0; })
-#define __SPIN_LOCK(l)             pl_take_s(l)
-#define __SPIN_TRYLOCK(l)          (!pl_try_s(l))
-#define __SPIN_UNLOCK(l)           pl_drop_s(l)
-
-#define __RWLOCK_INIT(l)           ({ (*l) = 0; })
-#define __RWLOCK_DESTROY(l)        ({ (*l) = 0; })
-#define __RWLOCK_WRLOCK(l)         pl_take_w(l)
-#define __RWLOCK_TRYWRLOCK(l)      (!pl_try_w(l))
-#define __RWLOCK_WRUNLOCK(l)       pl_drop_w(l)
-#define __RWLOCK_RDLOCK(l)         pl_take_r(l)
-#define __RWLOCK_TRYRDLOCK(l)      (!pl_try_r(l))
-#define __RWLOCK_RDUNLOCK(l)       pl_drop_r(l)
-
-/* rwlock upgrades via seek locks */
-#define __RWLOCK_SKLOCK(l)         pl_take_s(l)      /* N --> S */
-#define __RWLOCK_SKTOWR(l)         pl_stow(l)        /* S --> W */
-#define __RWLOCK_WRTOSK(l)         pl_wtos(l)        /* W --> S */
-#define __RWLOCK_SKTORD(l)         pl_stor(l)        /* S --> R */
-#define __RWLOCK_WRTORD(l)         pl_wtor(l)        /* W --> R */
-#define __RWLOCK_SKUNLOCK(l)       pl_drop_s(l)      /* S --> N */
-#define __RWLOCK_TRYSKLOCK(l)      (!pl_try_s(l))    /* N -?> S */
-#define __RWLOCK_TRYRDTOSK(l)      (!pl_try_rtos(l)) /* R -?> S */
-
-#define HA_SPIN_INIT(l)            __spin_init(l)
-#define HA_SPIN_DESTROY(l)         __spin_destroy(l)
-
-#define HA_SPIN_LOCK(lbl, l)       __spin_lock(lbl, l, __func__, __FILE__, __LINE__)
-#define HA_SPIN_TRYLOCK(lbl, l)    __spin_trylock(lbl, l, __func__, __FILE__, __LINE__)
-#define HA_SPIN_UNLOCK(lbl, l)     __spin_unlock(lbl, l, __func__, __FILE__, __LINE__)
-
-#define HA_RWLOCK_INIT(l)          __ha_rwlock_init((l))
-#define HA_RWLOCK_DESTROY(l)       __ha_rwlock_destroy((l))
-#define HA_RWLOCK_WRLOCK(lbl,l)    __ha_rwlock_wrlock(lbl, l, __func__, __FILE__, __LINE__)
-#define HA_RWLOCK_TRYWRLOCK(lbl,l) __ha_rwlock_trywrlock(lbl, l, __func__, __FILE__, __LINE__)
-#define HA_RWLOCK_WRUNLOCK(lbl,l)  __ha_rwlock_wrunlock(lbl, l, __func__, __FILE__, __LINE__)
-#define HA_RWLOCK_RDLOCK(lbl,l)    __ha_rwlock_rdlock(lbl, l)
-#define HA_RWLOCK_TRYRDLOCK(lbl,l) __ha_rwlock_tryrdlock(lbl, l)
-#define HA_RWLOCK_RDUNLOCK(lbl,l)  __ha_rwlock_rdunlock(lbl, l)
-
-#define HA_RWLOCK_SKLOCK(lbl,l)    __ha_rwlock_sklock(lbl, l, __func__, __FILE__, __LINE__)
-#define HA_RWLOCK_SKTOWR(lbl,l)    __ha_rwlock_sktowr(lbl, l, __func__, __FILE__, __LINE__)
-#define HA_RWLOCK_WRTOSK(lbl,l)    __ha_rwlock_wrtosk(lbl, l, __func__, __FILE__, __LINE__)
-#define HA_RWLOCK_SKTORD(lbl,l)    __ha_rwlock_sktord(lbl, l, __func__, __FILE__, __LINE__)
-#define HA_RWLOCK_WRTORD(lbl,l)    __ha_rwlock_wrtord(lbl, l, __func__, __FILE__, __LINE__)
-#define HA_RWLOCK_SKUNLOCK(lbl,l)  __ha_rwlock_skunlock(lbl, l, __func__, __FILE__, __LINE__)
-#define HA_RWLOCK_TRYSKLOCK(lbl,l) __ha_rwlock_trysklock(lbl, l, __func__, __FILE__, __LINE__)
-#define HA_RWLOCK_TRYRDTOSK(lbl,l) __ha_rwlock_tryrdtosk(lbl, l, __func__, __FILE__, __LINE__)
-
 /* WARNING!!! if you update this enum, please also keep lock_label() up to date
  * below.
  */
@@ -375,6 +298,7 @@ enum lock_label {
 	PROXY_LOCK,
 	SERVER_LOCK,
 	LBPRM_LOCK,
+	QUEUE_LOCK,
 	SIGNALS_LOCK,
 	STK_TABLE_LOCK,
 	STK_SESS_LOCK,
@@ -404,6 +328,8 @@ enum lock_label {
 	SSL_SERVER_LOCK,
 	SFT_LOCK, /* sink forward target */
 	IDLE_CONNS_LOCK,
+	POLLER_LOCK,
+	UDP_FWD_LOCK,
 	OTHER_LOCK,
 	/* WT: make sure never to use these ones outside of development,
 	 * we need them for lock profiling!
@@ -416,8 +342,6 @@ enum lock_label {
 	LOCK_LABELS
 };
 
-extern struct lock_stat lock_stats[LOCK_LABELS];
-
 static inline const char *lock_label(enum lock_label label)
 {
 	switch (label) {
@@ -427,6 +351,7 @@ static inline const char *lock_label(enum lock_label label)
 	case PROXY_LOCK:           return "PROXY";
 	case SERVER_LOCK:          return "SERVER";
 	case LBPRM_LOCK:           return "LBPRM";
+	case QUEUE_LOCK:           return "QUEUE";
 	case SIGNALS_LOCK:         return "SIGNALS";
 	case STK_TABLE_LOCK:       return "STK_TABLE";
 	case STK_SESS_LOCK:        return "STK_SESS";
@@ -456,6 +381,8 @@ static inline const char *lock_label(enum lock_label label)
 	case SSL_SERVER_LOCK:      return "SSL_SERVER";
 	case SFT_LOCK:             return "SFT";
 	case IDLE_CONNS_LOCK:      return "IDLE_CONNS";
+	case POLLER_LOCK:          return "POLLER";
+	case UDP_FWD_LOCK:         return "UDP_FWD";
 	case OTHER_LOCK:           return "OTHER";
 	case DEBUG1_LOCK:          return "DEBUG1";
 	case DEBUG2_LOCK:          return "DEBUG2";
@@ -468,6 +395,103 @@ static inline const char *lock_label(enum lock_label label)
 	abort();
 }
 
+#if !defined(DEBUG_THREAD) && !defined(DEBUG_FULL)
+
+/* Thread debugging is DISABLED, these are the regular locking functions */
+
+/* lock profiling, enabled at run time using "set profiling locks on" */
+extern int lock_profiling;
+extern struct lock_prof_stat lock_prof_stats[MAX_THREADS][LOCK_LABELS];
+extern struct lock_prof_caller lock_prof_callers[LOCK_PROF_CALLERS];
+
+void __lock_prof_take(enum lock_label lbl, unsigned long *l, enum lock_prof_op op);
+int __lock_prof_try(enum lock_label lbl, unsigned long *l, enum lock_prof_op op);
+void __lock_prof_drop(unsigned long *l, enum lock_prof_op op);
+void lock_prof_reset();
+
+#define HA_SPIN_INIT(l)            ({ (*l) = 0; })
+#define HA_SPIN_DESTROY(l)         ({ (*l) = 0; })
+#define HA_SPIN_LOCK(lbl, l)       ({ if (unlikely(lock_profiling)) __lock_prof_take(lbl, l, LOCK_PROF_S); else pl_take_s(l); })
+#define HA_SPIN_TRYLOCK(lbl, l)    (unlikely(lock_profiling) ? __lock_prof_try(lbl, l, LOCK_PROF_S) : !pl_try_s(l))
+#define HA_SPIN_UNLOCK(lbl, l)     ({ if (unlikely(lock_profiling)) __lock_prof_drop(l, LOCK_PROF_S); else pl_drop_s(l); })
+
+#define HA_RWLOCK_INIT(l)          ({ (*l) = 0; })
+#define HA_RWLOCK_DESTROY(l)       ({ (*l) = 0; })
+#define HA_RWLOCK_WRLOCK(lbl,l)    ({ if (unlikely(lock_profiling)) __lock_prof_take(lbl, l, LOCK_PROF_W); else pl_take_w(l); })
+#define HA_RWLOCK_TRYWRLOCK(lbl,l) (unlikely(lock_profiling) ? __lock_prof_try(lbl, l, LOCK_PROF_W) : !pl_try_w(l))
+#define HA_RWLOCK_WRUNLOCK(lbl,l)  ({ if (unlikely(lock_profiling)) __lock_prof_drop(l, LOCK_PROF_W); else pl_drop_w(l); })
+#define HA_RWLOCK_RDLOCK(lbl,l)    ({ if (unlikely(lock_profiling)) __lock_prof_take(lbl, l, LOCK_PROF_R); else pl_take_r(l); })
+#define HA_RWLOCK_TRYRDLOCK(lbl,l) (unlikely(lock_profiling) ? __lock_prof_try(lbl, l, LOCK_PROF_R) : !pl_try_r(l))
+#define HA_RWLOCK_RDUNLOCK(lbl,l)  ({ if (unlikely(lock_profiling)) __lock_prof_drop(l, LOCK_PROF_R); else pl_drop_r(l); })
+
+/* rwlock upgrades via seek locks. Only the transitions from and to the
+ * unlocked state are accounted for by the lock profiler.
+ */
+#define HA_RWLOCK_SKLOCK(lbl,l)         ({ if (unlikely(lock_profiling)) __lock_prof_take(lbl, l, LOCK_PROF_S); else pl_take_s(l); })  /* N --> S */
+#define HA_RWLOCK_SKTOWR(lbl,l)         pl_stow(l)        /* S --> W */
+#define HA_RWLOCK_WRTOSK(lbl,l)         pl_wtos(l)        /* W --> S */
+#define HA_RWLOCK_SKTORD(lbl,l)         pl_stor(l)        /* S --> R */
+#define HA_RWLOCK_WRTORD(lbl,l)         pl_wtor(l)        /* W --> R */
+#define HA_RWLOCK_SKUNLOCK(lbl,l)       ({ if (unlikely(lock_profiling)) __lock_prof_drop(l, LOCK_PROF_S); else pl_drop_s(l); })  /* S --> N */
+#define HA_RWLOCK_TRYSKLOCK(lbl,l)      (unlikely(lock_profiling) ? __lock_prof_try(lbl, l, LOCK_PROF_S) : !pl_try_s(l))    /* N -?> S */
+#define HA_RWLOCK_TRYRDTOSK(lbl,l)      (!pl_try_rtos(l)) /* R -?> S */
+
+#else /* !defined(DEBUG_THREAD) && !defined(DEBUG_FULL) */
+
+/* Thread debugging is ENABLED, these are the instrumented functions */
+
+#define __SPIN_INIT(l)             ({ (*l) = 0; })
+#define __SPIN_DESTROY(l)          ({ (*l) = 0; })
+#define __SPIN_LOCK(l)             pl_take_s(l)
+#define __SPIN_TRYLOCK(l)          (!pl_try_s(l))
+#define __SPIN_UNLOCK(l)           pl_drop_s(l)
+
+#define __RWLOCK_INIT(l)           ({ (*l) = 0; })
+#define __RWLOCK_DESTROY(l)        ({ (*l) = 0; })
+#define __RWLOCK_WRLOCK(l)         pl_take_w(l)
+#define __RWLOCK_TRYWRLOCK(l)      (!pl_try_w(l))
+#define __RWLOCK_WRUNLOCK(l)       pl_drop_w(l)
+#define __RWLOCK_RDLOCK(l)         pl_take_r(l)
+#define __RWLOCK_TRYRDLOCK(l)      (!pl_try_r(l))
+#define __RWLOCK_RDUNLOCK(l)       pl_drop_r(l)
+
+/* rwlock upgrades via seek locks */
+#define __RWLOCK_SKLOCK(l)         pl_take_s(l)      /* N --> S */
+#define __RWLOCK_SKTOWR(l)         pl_stow(l)        /* S --> W */
+#define __RWLOCK_WRTOSK(l)         pl_wtos(l)        /* W --> S */
+#define __RWLOCK_SKTORD(l)         pl_stor(l)        /* S --> R */
+#define __RWLOCK_WRTORD(l)         pl_wtor(l)        /* W --> R */
+#define __RWLOCK_SKUNLOCK(l)       pl_drop_s(l)      /* S --> N */
+#define __RWLOCK_TRYSKLOCK(l)      (!pl_try_s(l))    /* N -?> S */
+#define __RWLOCK_TRYRDTOSK(l)      (!pl_try_rtos(l)) /* R -?> S */
+
+#define HA_SPIN_INIT(l)            __spin_init(l)
+#define HA_SPIN_DESTROY(l)         __spin_destroy(l)
+
+#define HA_SPIN_LOCK(lbl, l)       __spin_lock(lbl, l, __func__, __FILE__, __LINE__)
+#define HA_SPIN_TRYLOCK(lbl, l)    __spin_trylock(lbl, l, __func__, __FILE__, __LINE__)
+#define HA_SPIN_UNLOCK(lbl, l)     __spin_unlock(lbl, l, __func__, __FILE__, __LINE__)
+
+#define HA_RWLOCK_INIT(l)          __ha_rwlock_init((l))
+#define HA_RWLOCK_DESTROY(l)       __ha_rwlock_destroy((l))
+#define HA_RWLOCK_WRLOCK(lbl,l)    __ha_rwlock_wrlock(lbl, l, __func__, __FILE__, __LINE__)
+#define HA_RWLOCK_TRYWRLOCK(lbl,l) __ha_rwlock_trywrlock(lbl, l, __func__, __FILE__, __LINE__)
+#define HA_RWLOCK_WRUNLOCK(lbl,l)  __ha_rwlock_wrunlock(lbl, l, __func__, __FILE__, __LINE__)
+#define HA_RWLOCK_RDLOCK(lbl,l)    __ha_rwlock_rdlock(lbl, l)
+#define HA_RWLOCK_TRYRDLOCK(lbl,l) __ha_rwlock_tryrdlock(lbl, l)
+#define HA_RWLOCK_RDUNLOCK(lbl,l)  __ha_rwlock_rdunlock(lbl, l)
+
+#define HA_RWLOCK_SKLOCK(lbl,l)    __ha_rwlock_sklock(lbl, l, __func__, __FILE__, __LINE__)
+#define HA_RWLOCK_SKTOWR(lbl,l)    __ha_rwlock_sktowr(lbl, l, __func__, __FILE__, __LINE__)
+#define HA_RWLOCK_WRTOSK(lbl,l)    __ha_rwlock_wrtosk(lbl, l, __func__, __FILE__, __LINE__)
+#define HA_RWLOCK_SKTORD(lbl,l)    __ha_rwlock_sktord(lbl, l, __func__, __FILE__, __LINE__)
+#define HA_RWLOCK_WRTORD(lbl,l)    __ha_rwlock_wrtord(lbl, l, __func__, __FILE__, __LINE__)
+#define HA_RWLOCK_SKUNLOCK(lbl,l)  __ha_rwlock_skunlock(lbl, l, __func__, __FILE__, __LINE__)
+#define HA_RWLOCK_TRYSKLOCK(lbl,l) __ha_rwlock_trysklock(lbl, l, __func__, __FILE__, __LINE__)
+#define HA_RWLOCK_TRYRDTOSK(lbl,l) __ha_rwlock_tryrdtosk(lbl, l, __func__, __FILE__, __LINE__)
+
+extern struct lock_stat lock_stats[LOCK_LABELS];
+
 static inline void show_lock_stats()
 {
 	int lbl;
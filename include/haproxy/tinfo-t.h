@@ -24,11 +24,26 @@
 
 #include <time.h>
 #include <haproxy/api-t.h>
+#include <haproxy/dynbuf-t.h>
 #include <haproxy/pool-t.h>
 
 /* thread info flags, for ha_thread_info[].flags */
 #define TI_FL_STUCK             0x00000001
 
+/* This structure describes a group of threads. Threads of a same group have
+ * contiguous IDs and share the structures which are local to the group, such
+ * as the run queue of the tasks which may run on several of them.
+ */
+struct tgroup_info {
+	unsigned long threads_mask; /* mask of the threads belonging to this group */
+	unsigned int base;          /* first thread ID of the group */
+	unsigned int count;         /* number of threads in the group */
+
+	/* pad to cache line (64B) */
+	char __pad[0];            /* unused except to check remaining room */
+	char __end[0] __attribute__((aligned(64)));
+};
+
 /* This structure describes all the per-thread info we need. When threads are
  * disabled, it contains the same info for the single running thread (except
  * the pthread identifier which does not exist).
@@ -37,15 +52,19 @@ struct thread_info {
 	__decl_thread(pthread_t pthread);
 	clockid_t clock_id;
 	timer_t wd_timer;          /* valid timer or TIMER_INVALID if not set */
+	timer_t stall_timer;       /* stall sampling timer or TIMER_INVALID if not set */
+	uint64_t stall_period;     /* stall sampling period applied to <stall_timer>, in ns */
 	uint64_t prev_cpu_time;    /* previous per thread CPU time */
 	uint64_t prev_mono_time;   /* previous system wide monotonic time  */
 	unsigned int idle_pct;     /* idle to total ratio over last sample (percent) */
 	unsigned int flags;        /* thread info flags, TI_FL_* */
+	int numa_node;             /* NUMA node the thread is bound to, or -1 */
+	unsigned int tgrp;         /* index of the thread's group in ha_tgroup_info[] */
 
 #ifdef CONFIG_HAP_POOLS
 	struct list pool_lru_head;                         /* oldest objects   */
 #endif
-	struct list buffer_wq;     /* buffer waiters */
+	struct list buffer_wq[DB_CRIT_COUNT]; /* buffer waiters, by criticality */
 	struct list streams;       /* list of streams attached to this thread */
 
 	/* pad to cache line (64B) */
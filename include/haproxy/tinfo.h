@@ -25,7 +25,8 @@
 #include <haproxy/api.h>
 #include <haproxy/tinfo-t.h>
 
-/* the struct is in thread.c */
+/* the structs are in thread.c */
+extern struct tgroup_info ha_tgroup_info[MAX_TGROUPS];
 extern struct thread_info ha_thread_info[MAX_THREADS];
 extern THREAD_LOCAL struct thread_info *ti; /* thread_info for the current thread */
 
@@ -22,6 +22,8 @@
 #ifndef _HAPROXY_TOOLS_T_H
 #define _HAPROXY_TOOLS_T_H
 
+#include <time.h>
+
 /* size used for max length of decimal representation of long long int. */
 #define NB_LLMAX_STR (sizeof("-9223372036854775807")-1)
 
@@ -157,4 +159,10 @@ struct net_addr {
 	} addr;
 };
 
+/* last conversion of a time_t to a struct tm, see get_localtime() */
+struct tm_cache {
+	time_t t;
+	struct tm tm;         /* tm_mday is 0 as long as it was never set */
+};
+
 #endif /* _HAPROXY_TOOLS_T_H */
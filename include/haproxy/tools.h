@@ -74,6 +74,7 @@ extern char *ultoa_r(unsigned long n, char *buffer, int size);
 extern char *lltoa_r(long long int n, char *buffer, int size);
 extern char *sltoa_r(long n, char *buffer, int size);
 extern const char *ulltoh_r(unsigned long long n, char *buffer, int size);
+extern const char dec_pairs[200];
 size_t flt_trim(char *buffer, size_t num_start, size_t len);
 char *ftoa_r(double n, char *buffer, int size);
 static inline const char *ultoa(unsigned long n)
@@ -362,6 +363,12 @@ int url2sa(const char *url, int ulen, struct sockaddr_storage *addr, struct spli
  */
 int addr_to_str(const struct sockaddr_storage *addr, char *str, int size);
 
+/* Writes the dotted form of IPv4 address <addr> (in network byte order) to
+ * <dst>, which must have room for INET_ADDRSTRLEN (16) chars, and returns a
+ * pointer to the trailing zero.
+ */
+char *ipv4_to_str(const void *addr, char *dst);
+
 /* Tries to convert a sockaddr_storage port to text form. Upon success, the
  * address family is returned so that it's easy for the caller to adapt to the
  * output format. Zero is returned if the address family is not supported. -1
@@ -522,6 +529,9 @@ static inline char *alltrim(char *s, char c) {
 	return ltrim(s, c);
 }
 
+extern THREAD_LOCAL struct tm_cache localtime_cache;
+extern THREAD_LOCAL struct tm_cache gmtime_cache;
+
 /* This function converts the time_t value <now> into a broken out struct tm
  * which must be allocated by the caller. It is highly recommended to use this
  * function instead of localtime() because that one requires a time_t* which
@@ -529,7 +539,17 @@ static inline char *alltrim(char *s, char c) {
  */
 static inline void get_localtime(const time_t now, struct tm *tm)
 {
+	/* localtime_r() is expensive and takes a lock in some libcs, while
+	 * most callers (e.g. logs) convert the same date many times per
+	 * second, so the last result is kept per thread.
+	 */
+	if (likely(now == localtime_cache.t && localtime_cache.tm.tm_mday)) {
+		*tm = localtime_cache.tm;
+		return;
+	}
 	localtime_r(&now, tm);
+	localtime_cache.t = now;
+	localtime_cache.tm = *tm;
 }
 
 /* This function converts the time_t value <now> into a broken out struct tm
@@ -539,7 +559,13 @@ static inline void get_localtime(const time_t now, struct tm *tm)
  */
 static inline void get_gmtime(const time_t now, struct tm *tm)
 {
+	if (likely(now == gmtime_cache.t && gmtime_cache.tm.tm_mday)) {
+		*tm = gmtime_cache.tm;
+		return;
+	}
 	gmtime_r(&now, tm);
+	gmtime_cache.t = now;
+	gmtime_cache.tm = *tm;
 }
 
 /* Counts a number of elapsed days since 01/01/0000 based solely on elapsed
@@ -74,6 +74,13 @@
 #define TRC_ARGS_STRM (TRC_ARG_STRM * 0x01010101U)
 #define TRC_ARGS_CHK  (TRC_ARG_CHK  * 0x01010101U)
 
+/* Number of events kept per thread by the "record" pseudo-sink. Must be a
+ * power of two.
+ */
+#ifndef TRACE_RECORDS
+#define TRACE_RECORDS 1024
+#endif
+
 
 enum trace_state {
 	TRACE_STATE_STOPPED = 0,  // completely disabled
@@ -150,11 +157,38 @@ struct trace_source {
 	enum trace_level level;  // report traces up to this level of info
 	unsigned int verbosity;  // decoder's level of detail among <decoding> (0=no cb)
 	struct sink *sink;       // where to send the trace
+	int record;              // non-zero when events are stored in the per-thread records
 	/* trace state part below */
 	enum trace_state state;
 	const void *lockon_ptr;  // what to lockon when lockon is set
 };
 
+/* An event stored raw by the "record" pseudo-sink. Nothing is formatted nor
+ * dereferenced at emission time, this is only done when dumping. The location,
+ * function and message are always string literals so they remain valid. The
+ * arguments however may point to released objects by the time they're dumped,
+ * so only their values are reported.
+ */
+struct trace_record {
+	uint64_t date;           // now_mono_time() at emission time
+	uint64_t mask;           // event mask
+	const struct trace_source *src;
+	const char *where;       // "file:line" of the caller
+	const char *func;        // caller's function name or NULL
+	struct ist msg;          // message
+	const void *args[4];     // the 4 source-specific arguments
+	enum trace_level level;
+};
+
+/* per-thread buffer of trace records. Only the owning thread writes to it,
+ * other threads may only read it, and check <head> after reading an entry to
+ * detect if it was overwritten in the mean time.
+ */
+struct trace_recorder {
+	struct trace_record *rec; // TRACE_RECORDS entries, allocated on first use
+	unsigned int head;        // number of records ever written
+} THREAD_ALIGNED(64);
+
 #endif /* _HAPROXY_TRACE_T_H */
 
 /*
@@ -154,6 +154,7 @@ static inline void trace_register_source(struct trace_source *source)
 	source->level = TRACE_LEVEL_USER;
 	source->verbosity = 1;
 	source->sink = NULL;
+	source->record = 0;
 	source->state = TRACE_STATE_STOPPED;
 	source->lockon_ptr = NULL;
 	LIST_APPEND(&trace_sources, &source->source_link);
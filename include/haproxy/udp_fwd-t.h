@@ -0,0 +1,79 @@
+/*
+ * include/haproxy/udp_fwd-t.h
+ * Types for the forwarding of UDP datagrams by "mode udp" proxies
+ *
+ * Copyright (C) 2021 HAProxy Technologies
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, version 2.1
+ * exclusively.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _HAPROXY_UDP_FWD_T_H
+#define _HAPROXY_UDP_FWD_T_H
+
+#include <sys/socket.h>
+
+#include <import/ebmbtree.h>
+#include <haproxy/api-t.h>
+#include <haproxy/thread-t.h>
+
+/* Maximum number of datagrams received or sent at once. It is also limited
+ * by the listener's maxaccept.
+ */
+#define UDP_FWD_BATCH   32
+
+/* default idle timeout of a flow when no "timeout client" is set */
+#define UDP_FWD_DEF_TIMEOUT 30000
+
+/* key of a flow: the listener the client talks to and the client's address */
+struct udp_flow_key {
+	struct listener *li;
+	uint16_t port;                 /* client's port, network order */
+	uint8_t addr[16];              /* client's address, IPv4 in the first 4 bytes */
+};
+
+/* A flow between a client and a server, created upon the first datagram from
+ * this client. It owns a socket connected to the server, which is polled by
+ * the thread which created the flow. This thread also owns the flow's task,
+ * which is the only one allowed to release it.
+ */
+struct udp_flow {
+	struct udp_fwd *fwd;           /* the frontend's forwarding context */
+	struct server *srv;            /* the server the flow was assigned to */
+	struct task *task;             /* expires the flow */
+	struct sockaddr_storage cli;   /* client's address */
+	unsigned int last;             /* date of last activity, in ticks */
+	unsigned int dead;             /* removed from the tree, must be released */
+	int fd;                        /* socket connected to the server */
+	struct ebmb_node node;         /* node in the flow tree, keyed by <key> */
+	struct udp_flow_key key;       /* MUST be last */
+};
+
+/* forwarding context of a "mode udp" frontend */
+struct udp_fwd {
+	struct proxy *fe;              /* the frontend */
+	struct proxy *be;              /* the backend holding the servers */
+	struct eb_root flows;          /* flows indexed by client */
+	unsigned int timeout;          /* idle timeout of flows, in ms */
+	__decl_thread(HA_RWLOCK_T lock); /* protects <flows> */
+};
+
+#endif /* _HAPROXY_UDP_FWD_T_H */
+
+/*
+ * Local variables:
+ *  c-indent-level: 8
+ *  c-basic-offset: 8
+ * End:
+ */
@@ -0,0 +1,38 @@
+/*
+ * include/haproxy/udp_fwd.h
+ * Forwarding of UDP datagrams by "mode udp" proxies - exported functions
+ *
+ * Copyright (C) 2021 HAProxy Technologies
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, version 2.1
+ * exclusively.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _HAPROXY_UDP_FWD_H
+#define _HAPROXY_UDP_FWD_H
+
+#include <haproxy/api.h>
+#include <haproxy/udp_fwd-t.h>
+
+/* I/O callback of the listeners of "mode udp" frontends */
+void udp_fwd_fd_handler(int fd);
+
+#endif /* _HAPROXY_UDP_FWD_H */
+
+/*
+ * Local variables:
+ *  c-indent-level: 8
+ *  c-basic-offset: 8
+ * End:
+ */
@@ -0,0 +1,40 @@
+/*
+ * include/haproxy/usdt.h
+ * Static tracing points (USDT) placed on a few hot paths.
+ *
+ * Copyright (C) 2000-2021 Willy Tarreau - w@1wt.eu
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, version 2.1
+ * exclusively.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _HAPROXY_USDT_H
+#define _HAPROXY_USDT_H
+
+/* When built with USE_USDT, HA_USDT(name, args...) places a "haproxy:name"
+ * probe at the calling location, which tools like bpftrace, perf or systemtap
+ * may attach to. A probe is only a nop instruction plus an ELF note describing
+ * where its arguments are, so it costs nothing as long as nobody attaches to
+ * it. The arguments must be integers or pointers, at most 12 of them. They are
+ * listed in the management doc, and must remain stable once published. Without
+ * USE_USDT the macro does not even evaluate its arguments.
+ */
+#ifdef USE_USDT
+#include <sys/sdt.h>
+#define HA_USDT(name, ...) STAP_PROBEV(haproxy, name, ##__VA_ARGS__)
+#else
+#define HA_USDT(name, ...) do { } while (0)
+#endif
+
+#endif /* _HAPROXY_USDT_H */
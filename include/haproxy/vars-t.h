@@ -36,6 +36,7 @@ enum vars_scope {
 
 struct vars {
 	struct list head;
+	struct var *slots; /* slots of the variables known at boot, or NULL */
 	enum vars_scope scope;
 	unsigned int size;
 	__decl_thread(HA_RWLOCK_T rwlock);
@@ -45,11 +46,13 @@ struct vars {
 struct var_desc {
 	const char *name; /* Contains the normalized variable name. */
 	enum vars_scope scope;
+	int slot; /* Index of its slot in its scope, or -1. */
 };
 
 struct var {
 	struct list l; /* Used for chaining vars. */
-	const char *name; /* Contains the variable name. */
+	const char *name; /* Contains the variable name, NULL for an unused slot. */
+	int slot; /* Index in the slots of its vars, or -1 if allocated alone. */
 	struct sample_data data; /* data storage. */
 };
 
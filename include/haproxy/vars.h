@@ -23,6 +23,7 @@
 #define _HAPROXY_VARS_H
 
 #include <haproxy/api-t.h>
+#include <haproxy/list.h>
 #include <haproxy/session-t.h>
 #include <haproxy/stream-t.h>
 #include <haproxy/vars-t.h>
@@ -41,4 +42,10 @@ int vars_unset_by_name_ifexist(const char *name, size_t len, struct sample *smp)
 int vars_get_by_desc(const struct var_desc *var_desc, struct sample *smp);
 int vars_check_arg(struct arg *arg, char **err);
 
+/* Returns non-zero if <vars> holds no variable nor storage to be released */
+static inline int vars_is_empty(const struct vars *vars)
+{
+	return LIST_ISEMPTY(&vars->head) && !vars->slots;
+}
+
 #endif
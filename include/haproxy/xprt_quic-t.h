@@ -48,6 +48,14 @@
 /* Maximum packet length during handshake */
 #define QUIC_PACKET_MAXLEN     QUIC_INITIAL_IPV4_MTU
 
+/* Maximum number of datagrams sent in a burst by the connections with pacing,
+ * which are otherwise sent at a rate of 5/4 of the congestion window per RTT.
+ */
+#define QUIC_PACING_BURST          10
+
+/* Maximum number of packets whose header protection is removed at once */
+#define QUIC_HP_BATCH              16
+
 /* The minimum length of Initial packets. */
 #define QUIC_INITIAL_PACKET_MINLEN 1200
 
@@ -226,6 +234,8 @@ enum quic_pkt_type {
 
 extern struct trace_source trace_quic;
 extern struct pool_head *pool_head_quic_rx_packet;
+extern struct pool_head *pool_head_quic_rxbuf;
+extern struct pool_head *pool_head_quic_tx_dgram;
 extern struct pool_head *pool_head_quic_tx_packet;
 extern struct pool_head *pool_head_quic_tx_frm;
 
@@ -278,6 +288,7 @@ struct preferred_address {
 #define QUIC_TP_PREFERRED_ADDRESS                   13
 #define QUIC_TP_ACTIVE_CONNECTION_ID_LIMIT          14
 #define QUIC_TP_INITIAL_SOURCE_CONNECTION_ID        15
+#define QUIC_TP_RETRY_SOURCE_CONNECTION_ID          16
 
 /*
  * These defines are not for transport parameter type, but the maximum accepted value for
@@ -311,6 +322,7 @@ struct quic_transport_params {
 	uint8_t with_preferred_address;
 	uint8_t original_destination_connection_id_present;
 	uint8_t initial_source_connection_id_present;
+	uint8_t retry_source_connection_id_present;
 
 	uint8_t stateless_reset_token[QUIC_STATELESS_RESET_TOKEN_LEN]; /* Forbidden for clients */
 	/*
@@ -320,6 +332,7 @@ struct quic_transport_params {
 	struct quic_cid original_destination_connection_id;            /* Forbidden for clients */
 	/* MUST be present both for servers and clients. */
 	struct quic_cid initial_source_connection_id;
+	struct quic_cid retry_source_connection_id;                    /* Forbidden for clients */
 	struct preferred_address preferred_address;                    /* Forbidden for clients */
 };
 
@@ -329,19 +342,20 @@ struct quic_arng {
 	int64_t last;
 };
 
-/* Structure to hold a range of ACKs to be store as a node in a tree of
- * ACK ranges.
+/* Maximum number of ACK ranges tracked for a packet number space (power of 2).
+ * Beyond this, the oldest ranges are forgotten.
  */
-struct quic_arng_node {
-	struct eb64_node first;
-	uint64_t last;
-};
+#define QUIC_MAX_ACK_RANGES  32
 
-/* Structure to maintain a set of ACK ranges to be used to build ACK frames. */
+/* Structure to maintain a set of ACK ranges to be used to build ACK frames.
+ * The ranges are stored in a ring in descending order: the range at index 0
+ * (see quic_arng_at()) is the one with the largest packet numbers.
+ */
 struct quic_arngs {
-	/* ebtree of ACK ranges organized by their first value. */
-	struct eb_root root;
-	/* The number of ACK ranges is this tree */
+	struct quic_arng ranges[QUIC_MAX_ACK_RANGES];
+	/* The position in <ranges> of the range with the largest packet numbers */
+	unsigned int head;
+	/* The number of ACK ranges is this ring */
 	size_t sz;
 	/* The number of bytes required to encode this ACK ranges lists. */
 	size_t enc_sz;
@@ -392,6 +406,23 @@ extern struct quic_transport_params quic_dflt_transport_params;
 
 /* Flag a received packet as being an ack-eliciting packet. */
 #define QUIC_FL_RX_PACKET_ACK_ELICITING (1UL << 0)
+/* Flag a received Initial packet as carrying a valid Retry token. */
+#define QUIC_FL_RX_PACKET_VALIDATED     (1UL << 1)
+
+/* Size of the buffers receiving the UDP datagrams. It must be large enough to
+ * receive the aggregation of GRO segments, which is limited to 64kB.
+ */
+#define QUIC_RXBUF_SZ    65535
+
+/* Buffer receiving UDP datagrams. The packets found in these datagrams are
+ * decrypted in place and keep a reference to it until they are released, so
+ * that their frames may be consumed without being copied. The reader owns
+ * one reference and only reuses the buffer when it is the last user.
+ */
+struct quic_rxbuf {
+	unsigned int refcnt;            /* number of users, atomically updated */
+	unsigned char data[QUIC_RXBUF_SZ];
+};
 
 struct quic_rx_packet {
 	struct list list;
@@ -409,11 +440,15 @@ struct quic_rx_packet {
 	/* Packet number length */
 	uint32_t pnl;
 	uint64_t token_len;
+	/* Original destination connection ID found in a valid Retry token. */
+	struct quic_cid token_odcid;
 	/* Packet length */
 	uint64_t len;
 	/* Additional authenticated data length */
 	size_t aad_len;
-	unsigned char data[QUIC_PACKET_MAXLEN];
+	/* The packet, decrypted in place in its receive buffer. */
+	unsigned char *data;
+	struct quic_rxbuf *rxbuf;
 	struct eb64_node pn_node;
 	volatile unsigned int refcnt;
 	/* Source address of this packet. */
@@ -430,6 +465,18 @@ struct quic_dgram_ctx {
 	void *owner;
 };
 
+/* UDP datagram received by a thread which does not own its connection, and
+ * handed to the owner thread.
+ */
+struct quic_dgram {
+	struct mt_list list;          /* attach point to the owner thread's list */
+	void *owner;                  /* the listener which received it */
+	struct sockaddr_storage saddr;/* its source address */
+	struct quic_rxbuf *rxbuf;     /* the buffer it was received in */
+	unsigned char *buf;           /* its contents, in <rxbuf> */
+	size_t len;                   /* its length */
+};
+
 /* QUIC packet reader. */
 typedef ssize_t qpkt_read_func(unsigned char **buf,
                                const unsigned char *end,
@@ -437,6 +484,11 @@ typedef ssize_t qpkt_read_func(unsigned char **buf,
                                struct quic_dgram_ctx *dgram_ctx,
                                struct sockaddr_storage *saddr);
 
+/* QUIC datagram reader, called for each UDP datagram received. */
+typedef ssize_t qdgram_read_func(char *buf, size_t len, void *owner,
+                                 struct sockaddr_storage *saddr,
+                                 struct quic_rxbuf *rxbuf);
+
 /* Structure to store enough information about the RX CRYPTO frames. */
 struct quic_rx_crypto_frm {
 	struct eb64_node offset_node;
@@ -501,9 +553,12 @@ struct quic_crypto_buf {
 	size_t sz;
 };
 
-/* QUIC buffer structure used to build outgoing packets. */
+/* QUIC buffer structure used to build outgoing packets. Its storage is taken
+ * from the pool_head_quic_tx_dgram pool only while it contains datagrams to
+ * be sent.
+ */
 struct q_buf {
-	/* Points to the data in this buffer. */
+	/* Points to the data in this buffer, NULL if not allocated. */
 	unsigned char *area;
 	/* Points to the current position to write into this buffer. */
 	unsigned char *pos;
@@ -568,8 +623,45 @@ struct quic_path {
 #define QUIC_CONN_TX_BUFS_NB 8
 #define QUIC_CONN_TX_BUF_SZ  QUIC_PACKET_MAXLEN
 
+/* Retry tokens are made of a format byte, a timestamp (s), the client ODCID
+ * length and value, and a truncated HMAC-SHA256 of all of them, the client
+ * address and the Retry SCID.
+ */
+#define QUIC_TOKEN_FMT_RETRY       0x9c
+#define QUIC_RETRY_TOKEN_MAC_LEN     16
+#define QUIC_RETRY_TOKEN_MAXLEN    (1 + 4 + 1 + QUIC_CID_MAXLEN + QUIC_RETRY_TOKEN_MAC_LEN)
+/* Delay during which a Retry token is accepted (s). */
+#define QUIC_RETRY_TOKEN_LIFETIME    10
+/* Default number of half-open connections above which Retry packets are sent. */
+#define QUIC_DFLT_RETRY_THRESHOLD   100
+
+/* Delay during which the ClientHellos whose early data were accepted are
+ * remembered to reject their replays (s). This is the ticket age tolerance of
+ * the TLS stack, which rejects the early data of older ClientHellos.
+ */
+#define QUIC_0RTT_REPLAY_WINDOW      10
+/* Default number of entries of the 0-RTT anti-replay cache. */
+#define QUIC_DFLT_0RTT_CACHE_SIZE 20000
+
+/* Entry of the 0-RTT anti-replay cache, keyed by the ClientHello random. */
+struct quic_0rtt_entry {
+	unsigned int date;            /* date the ClientHello was received (s) */
+	struct ebmb_node node;
+	unsigned char key[32];
+};
+
+/* Extra area of the shared context of the 0-RTT anti-replay cache. */
+struct quic_0rtt_cache {
+	struct eb_root tree;          /* tree of quic_0rtt_entry */
+	unsigned int evicted;         /* most recent date of the evicted entries (s) */
+};
+
+/* Flag a QUIC connection whose handshake is not complete yet. */
+#define QUIC_FL_CONN_HALF_OPEN      (1U << 0)
+
 struct quic_conn {
 	uint32_t version;
+	unsigned int flags; /* QUIC_FL_CONN_* */
 
 	/* Transport parameters. */
 	struct quic_transport_params params;
@@ -596,20 +688,12 @@ struct quic_conn {
 
 	/* Used only to reach the tasklet for the I/O handler from this quic_conn object. */
 	struct connection *conn;
-	/* Output buffer used during the handshakes. */
-	struct {
-		unsigned char data[QUIC_PACKET_MAXLEN];
-		unsigned char *pos;
-	} obuf;
-
 	struct {
 		/* The remaining frames to send. */
 		struct list frms_to_send;
 
-		/* Array of buffers. */
-		struct q_buf **bufs;
-		/* The size of the previous array. */
-		size_t nb_buf;
+		/* Ring of buffers. */
+		struct q_buf bufs[QUIC_CONN_TX_BUFS_NB];
 		/* Writer index. */
 		int wbuf;
 		/* Reader index. */
@@ -620,6 +704,10 @@ struct quic_conn {
 		 * when sending probe packets.
 		 */
 		int nb_pto_dgrams;
+		/* Number of bytes which may be sent now with pacing. */
+		size_t pacing_credit;
+		/* Last time the pacing credit was updated (ms). */
+		unsigned int pacing_ts;
 	} tx;
 	struct {
 		/* Number of received bytes. */
@@ -631,6 +719,8 @@ struct quic_conn {
 
 	struct task *timer_task;
 	unsigned int timer;
+	/* Task which resumes the emission of the paced datagrams. */
+	struct task *pacing_task;
 };
 
 #endif /* USE_QUIC */
@@ -30,6 +30,7 @@
 
 #include <haproxy/buf.h>
 #include <haproxy/chunk.h>
+#include <haproxy/global.h>
 #include <haproxy/net_helper.h>
 #include <haproxy/openssl-compat.h>
 #include <haproxy/ticks.h>
@@ -147,6 +148,26 @@ static inline void quic_connection_id_to_frm_cpy(struct quic_frame *dst,
  * ebtree.
  * Returns the new CID if succeeded, NULL if not.
  */
+/* Returns the ID of the thread owning the connection with <cid> as one of our
+ * connection IDs, which is encoded in its first byte.
+ */
+static inline unsigned int quic_get_cid_tid(const unsigned char *cid)
+{
+	return *cid % global.nbthread;
+}
+
+/* Modifies the first byte of <cid> connection ID so that it designates <tid>
+ * as the owner thread of its connection.
+ */
+static inline void quic_pin_cid_to_tid(unsigned char *cid, unsigned int tid)
+{
+	unsigned int base = *cid - *cid % global.nbthread;
+
+	if (base + tid > 0xff)
+		base -= global.nbthread;
+	*cid = base + tid;
+}
+
 static inline struct quic_connection_id *new_quic_cid(struct eb_root *root,
                                                       int seq_num)
 {
@@ -164,6 +185,9 @@ static inline struct quic_connection_id *new_quic_cid(struct eb_root *root,
 		goto err;
 	}
 
+	/* the datagrams of this connection must be handled by this thread */
+	quic_pin_cid_to_tid(cid->cid.data, tid);
+
 	cid->seq_num.key = seq_num;
 	cid->retire_prior_to = 0;
 	eb64_insert(root, &cid->seq_num);
@@ -285,6 +309,14 @@ static inline size_t quic_incint_size_diff(uint64_t val)
 	}
 }
 
+/* Returns the <i>th range of <arngs> in descending order, the first one being
+ * the range with the largest packet numbers.
+ */
+static inline struct quic_arng *quic_arng_at(struct quic_arngs *arngs, size_t i)
+{
+	return &arngs->ranges[(arngs->head + i) & (QUIC_MAX_ACK_RANGES - 1)];
+}
+
 /* Return the difference between the encoded length of <val> and the encoded
  * length of <val-1>.
  */
@@ -649,6 +681,16 @@ static inline int quic_transport_param_decode(struct quic_transport_params *p,
 		*buf += len;
 		p->initial_source_connection_id_present = 1;
 		break;
+	case QUIC_TP_RETRY_SOURCE_CONNECTION_ID:
+		if (!server || len >= sizeof p->retry_source_connection_id.data)
+			return 0;
+
+		if (len)
+			memcpy(p->retry_source_connection_id.data, *buf, len);
+		p->retry_source_connection_id.len = len;
+		*buf += len;
+		p->retry_source_connection_id_present = 1;
+		break;
 	case QUIC_TP_STATELESS_RESET_TOKEN:
 		if (!server || len != sizeof p->stateless_reset_token)
 			return 0;
@@ -825,6 +867,11 @@ static inline int quic_transport_params_encode(unsigned char *buf,
 		                                  p->original_destination_connection_id.data,
 		                                  p->original_destination_connection_id.len))
 			return 0;
+		if (p->retry_source_connection_id_present &&
+			!quic_transport_param_enc_mem(&pos, end, QUIC_TP_RETRY_SOURCE_CONNECTION_ID,
+			                              p->retry_source_connection_id.data,
+			                              p->retry_source_connection_id.len))
+			return 0;
 		if (p->with_stateless_reset_token &&
 			!quic_transport_param_enc_mem(&pos, end, QUIC_TP_STATELESS_RESET_TOKEN,
 			                              p->stateless_reset_token,
@@ -982,7 +1029,7 @@ static inline void quic_pktns_init(struct quic_pktns *pktns)
 
 	pktns->rx.largest_pn = -1;
 	pktns->rx.nb_ack_eliciting = 0;
-	pktns->rx.arngs.root = EB_ROOT_UNIQUE;
+	pktns->rx.arngs.head = 0;
 	pktns->rx.arngs.sz = 0;
 	pktns->rx.arngs.enc_sz = 0;
 
@@ -1100,12 +1147,12 @@ static inline int c_buf_consumed(struct quic_enc_level *qel)
 /* Returns the current buffer which may be used to build outgoing packets. */
 static inline struct q_buf *q_wbuf(struct quic_conn *qc)
 {
-	return qc->tx.bufs[qc->tx.wbuf];
+	return &qc->tx.bufs[qc->tx.wbuf];
 }
 
 static inline struct q_buf *q_rbuf(struct quic_conn *qc)
 {
-	return qc->tx.bufs[qc->tx.rbuf];
+	return &qc->tx.bufs[qc->tx.rbuf];
 }
 
 /* Returns the next buffer to be used to send packets from. */
@@ -1152,10 +1199,30 @@ static inline ssize_t q_buf_room(struct q_buf *buf)
 	return q_buf_end(buf) - q_buf_getpos(buf);
 }
 
-/* Reset (or empty) <buf> buffer to prepare it for the next writing. */
-static inline void q_buf_reset(struct q_buf *buf)
+/* Allocate the storage of <buf> buffer if not already done.
+ * Returns 1 if succeeded, 0 if not.
+ */
+static inline int q_buf_alloc(struct q_buf *buf)
 {
+	if (buf->area)
+		return 1;
+
+	buf->area = pool_alloc(pool_head_quic_tx_dgram);
+	if (!buf->area)
+		return 0;
+
 	buf->pos = buf->area;
+	buf->end = buf->area + QUIC_CONN_TX_BUF_SZ;
+	buf->data = 0;
+	return 1;
+}
+
+/* Empty <buf> buffer and release its storage. */
+static inline void q_buf_release(struct q_buf *buf)
+{
+	pool_free(pool_head_quic_tx_dgram, buf->area);
+	buf->area = buf->pos = NULL;
+	buf->end = NULL;
 	buf->data = 0;
 }
 
@@ -1171,17 +1238,35 @@ static inline int qc_pkt_long(const struct quic_rx_packet *pkt)
 	return pkt->type != QUIC_PACKET_TYPE_SHORT;
 }
 
+/* Increment the reference counter of <rxbuf> receive buffer */
+static inline void quic_rxbuf_refinc(struct quic_rxbuf *rxbuf)
+{
+	HA_ATOMIC_INC(&rxbuf->refcnt);
+}
+
+/* Decrement the reference counter of <rxbuf> receive buffer */
+static inline void quic_rxbuf_refdec(struct quic_rxbuf *rxbuf)
+{
+	if (!HA_ATOMIC_SUB_FETCH(&rxbuf->refcnt, 1))
+		pool_free(pool_head_quic_rxbuf, rxbuf);
+}
+
 /* Increment the reference counter of <pkt> */
 static inline void quic_rx_packet_refinc(struct quic_rx_packet *pkt)
 {
 	pkt->refcnt++;
 }
 
-/* Decrement the reference counter of <pkt> */
+/* Decrement the reference counter of <pkt>, releasing its receive buffer
+ * with it.
+ */
 static inline void quic_rx_packet_refdec(struct quic_rx_packet *pkt)
 {
-	if (!--pkt->refcnt)
+	if (!--pkt->refcnt) {
+		if (pkt->rxbuf)
+			quic_rxbuf_refdec(pkt->rxbuf);
 		pool_free(pool_head_quic_rx_packet, pkt);
+	}
 }
 
 /* Add <pkt> RX packet to <list>, incrementing its reference counter. */
@@ -1226,8 +1311,8 @@ int qc_new_conn_init(struct quic_conn *conn, int ipv4,
                      unsigned char *dcid, size_t dcid_len,
                      unsigned char *scid, size_t scid_len);
 ssize_t quic_lstnr_dgram_read(char *buf, size_t len, void *owner,
-                              struct sockaddr_storage *saddr);
+                              struct sockaddr_storage *saddr, struct quic_rxbuf *rxbuf);
 ssize_t quic_srv_dgram_read(char *buf, size_t len, void *owner,
-                            struct sockaddr_storage *saddr);
+                            struct sockaddr_storage *saddr, struct quic_rxbuf *rxbuf);
 #endif /* USE_QUIC */
 #endif /* _HAPROXY_XPRT_QUIC_H */
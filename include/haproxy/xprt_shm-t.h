@@ -0,0 +1,66 @@
+/*
+ * include/haproxy/xprt_shm-t.h
+ * This file provides the layout of the shared memory area used by the
+ * shared-memory transport layer to exchange data with local agents.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, version 2.1
+ * exclusively.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _HAPROXY_XPRT_SHM_T_H
+#define _HAPROXY_XPRT_SHM_T_H
+
+#include <stdint.h>
+#include <haproxy/compiler.h>
+
+/* Once the UNIX socket is connected, HAProxy sends a struct xprt_shm_hello on
+ * it, with three file descriptors attached in an SCM_RIGHTS message, in this
+ * order: the memory area, the eventfd HAProxy writes to in order to wake the
+ * agent up, and the eventfd the agent writes to in order to wake HAProxy up.
+ * From this point, the data only flow through the two rings of the area, and
+ * the socket is only used to report the closing of each side.
+ */
+#define XPRT_SHM_MAGIC   "SPOESHM1"
+
+struct xprt_shm_hello {
+	char     magic[8];     /* XPRT_SHM_MAGIC, without the trailing zero */
+	uint32_t size;         /* size of each ring, always a power of two */
+	uint32_t reserved;     /* zero */
+};
+
+/* The state of each side lives in its own cache line and is only written by
+ * this side. Positions are free-running byte counters, the offset in a ring
+ * being the position modulo the ring's size. A side sets <sleeping> before
+ * waiting for its eventfd, and checks the rings again after that. The other
+ * side writes to the eventfd when <sleeping> is set after having produced or
+ * consumed data.
+ */
+struct xprt_shm_side {
+	uint32_t head;         /* bytes written so far into the outgoing ring */
+	uint32_t tail;         /* bytes read so far from the incoming ring */
+	uint32_t sleeping;     /* non-zero when waiting for the eventfd */
+	uint32_t reserved;
+} ALIGNED(64);
+
+/* The area starts with the state of both sides, followed by the ring HAProxy
+ * writes to, and by the ring the agent writes to, <size> bytes each. Integers
+ * are in the host's byte order.
+ */
+struct xprt_shm_area {
+	struct xprt_shm_side hap;     /* written by HAProxy */
+	struct xprt_shm_side agent;   /* written by the agent */
+	char rings[0];
+};
+
+#endif /* _HAPROXY_XPRT_SHM_T_H */
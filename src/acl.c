@@ -20,13 +20,16 @@
 #include <haproxy/api.h>
 #include <haproxy/arg.h>
 #include <haproxy/auth.h>
+#include <haproxy/cfgparse.h>
 #include <haproxy/errors.h>
 #include <haproxy/global.h>
 #include <haproxy/list.h>
 #include <haproxy/pattern.h>
+#include <haproxy/pool.h>
 #include <haproxy/proxy-t.h>
 #include <haproxy/sample.h>
 #include <haproxy/stick_table.h>
+#include <haproxy/stream-t.h>
 #include <haproxy/tools.h>
 
 /* List head of all known ACL keywords */
@@ -34,6 +37,21 @@ static struct acl_kw_list acl_keywords = {
 	.list = LIST_HEAD_INIT(acl_keywords.list)
 };
 
+DECLARE_STATIC_POOL(pool_head_acl_cache, "acl_cache", sizeof(struct acl_cache));
+
+/* Identifiers of the sample expressions whose results may be cached while
+ * evaluating a rule set, indexed by the expression's text. Expressions spelled
+ * the same way share the same identifier, which is fine since the cache never
+ * outlives a rule set, whose conditions all belong to the same proxy.
+ */
+struct acl_smp_key {
+	unsigned int id;
+	struct ebmb_node node;      /* must be last, followed by the key */
+};
+
+static struct eb_root acl_smp_keys = EB_ROOT_UNIQUE;
+static unsigned int acl_smp_last_id;
+
 /* input values are 0 or 3, output is the same */
 static inline enum acl_test_res pat2acl(struct pattern *pat)
 {
@@ -98,6 +116,62 @@ struct acl_keyword *find_acl_kw(const char *kw)
 	return NULL;
 }
 
+/* Returns non-zero if evaluating sample expression <smp> may have a side
+ * effect, which is the case of Lua fetches and converters, of the fetches
+ * updating the tracked counters (e.g. "sc0_inc_gpc0") and of the "debug",
+ * "set-var" and "unset-var" converters.
+ */
+static int acl_smp_has_side_effects(const struct sample_expr *smp)
+{
+	static const char *const unsafe_convs[] = { "debug", "set-var", "unset-var", NULL };
+	const struct sample_conv_expr *conv_expr;
+	const char *kw = smp->fetch->kw;
+	int i;
+
+	if (strncmp(kw, "lua.", 4) == 0 ||
+	    strstr(kw, "_inc_") || strstr(kw, "_clr_") || strstr(kw, "_updt_"))
+		return 1;
+
+	list_for_each_entry(conv_expr, &smp->conv_exprs, list) {
+		if (strncmp(conv_expr->conv->kw, "lua.", 4) == 0)
+			return 1;
+		for (i = 0; unsafe_convs[i]; i++)
+			if (strcmp(conv_expr->conv->kw, unsafe_convs[i]) == 0)
+				return 1;
+	}
+	return 0;
+}
+
+/* Returns the sample cache identifier to use for sample expression <smp>
+ * whose configuration text is <text>, or 0 if its result must not be cached.
+ * Only the fetches which extract information from the HTTP messages or the
+ * client connection are considered, as long as they have no side effect.
+ */
+static unsigned int acl_smp_cache_id(const struct sample_expr *smp, const char *text)
+{
+	struct acl_smp_key *key;
+	struct ebmb_node *node;
+	size_t len;
+
+	if (!smp->fetch->use ||
+	    (smp->fetch->use & ~(SMP_USE_HTTP_ANY | SMP_USE_L4CLI | SMP_USE_L5CLI)) ||
+	    acl_smp_has_side_effects(smp))
+		return 0;
+
+	node = ebst_lookup(&acl_smp_keys, text);
+	if (node)
+		return container_of(node, struct acl_smp_key, node)->id;
+
+	len = strlen(text);
+	key = calloc(1, sizeof(*key) + len + 1);
+	if (!key)
+		return 0;
+	memcpy(key->node.key, text, len + 1);
+	key->id = ++acl_smp_last_id;
+	ebst_insert(&acl_smp_keys, &key->node);
+	return key->id;
+}
+
 static struct acl_expr *prune_acl_expr(struct acl_expr *expr)
 {
 	struct arg *arg;
@@ -332,6 +406,7 @@ struct acl_expr *parse_acl_expr(const char **args, char **err, struct arg_list *
 	expr->pat.expect_type = cur_type;
 	expr->smp             = smp;
 	expr->kw              = smp->fetch->kw;
+	expr->smp_id          = acl_smp_cache_id(smp, args[0]);
 	smp = NULL; /* don't free it anymore */
 
 	if (aclkw && !acl_conv_found) {
@@ -854,6 +929,106 @@ struct acl_cond *prune_acl_cond(struct acl_cond *cond)
 	return cond;
 }
 
+/* Returns an estimate of the cost of evaluating ACL term <term>, or -1 if it
+ * may have a side effect and must not be moved. The estimate only relies on
+ * the fetch's dependencies, on the converters and on the match method: the
+ * internal and connection-level fetches are cheap, the HTTP headers cost more,
+ * the contents and bodies even more, and the regex and map lookups are
+ * considered expensive.
+ */
+static int acl_term_cost(const struct acl_term *term)
+{
+	const struct sample_conv_expr *conv_expr;
+	const struct acl_expr *expr;
+	const char *kw;
+	int cost = 0;
+
+	list_for_each_entry(expr, &term->acl->expr, list) {
+		unsigned int use = expr->smp->fetch->use;
+		int (*parse)(const char *, struct pattern *, int, char **) = expr->pat.parse;
+		struct pattern *(*match)(struct sample *, struct pattern_expr *, int) = expr->pat.match;
+
+		if (acl_smp_has_side_effects(expr->smp))
+			return -1;
+
+		/* body fetches are declared as depending on the headers */
+		if ((use & (SMP_USE_HRQBO | SMP_USE_HRSBO)) || strstr(expr->smp->fetch->kw, "body"))
+			cost += 50;
+		else if (use & (SMP_USE_L6REQ | SMP_USE_L6RES))
+			cost += 10;
+		else if (use & (SMP_USE_HRQHV | SMP_USE_HRQHP | SMP_USE_HRSHV | SMP_USE_HRSHP))
+			cost += 5;
+		else
+			cost += 1;
+
+		list_for_each_entry(conv_expr, &expr->smp->conv_exprs, list) {
+			kw = conv_expr->conv->kw;
+			if (strncmp(kw, "map", 3) == 0 || strncmp(kw, "regsub", 6) == 0)
+				cost += 20;
+			else
+				cost += 2;
+		}
+
+		if (match == pat_match_reg || match == pat_match_regm || parse == pat_parse_reg)
+			cost += 20;
+		else if (match == pat_match_beg || match == pat_match_end || match == pat_match_sub ||
+		         match == pat_match_dir || match == pat_match_dom || match == pat_match_bin)
+			cost += 5;
+	}
+	return cost;
+}
+
+/* Reorders the terms of each suite of condition <cond> by increasing cost so
+ * that the cheapest ones are evaluated first. Terms which may have a side
+ * effect are never moved and no term is moved across them. Terms of equal
+ * costs keep their relative order. Since all terms of a suite must match, the
+ * result of the condition is not affected, though a suite which would have
+ * waited for more data may now fail earlier. The suites which cannot be
+ * reordered by lack of memory are left untouched.
+ */
+static void acl_cond_reorder(struct acl_cond *cond)
+{
+	struct acl_term_suite *suite;
+	struct acl_term *term, **terms;
+	int *costs;
+	int nb, i, j, k, cost;
+
+	list_for_each_entry(suite, &cond->suites, list) {
+		nb = 0;
+		list_for_each_entry(term, &suite->terms, list)
+			nb++;
+		if (nb < 2)
+			continue;
+
+		terms = calloc(nb, sizeof(*terms));
+		costs = calloc(nb, sizeof(*costs));
+		if (!terms || !costs)
+			goto next;
+
+		/* stable insertion sort between the immovable terms */
+		i = j = 0;
+		list_for_each_entry(term, &suite->terms, list) {
+			cost = acl_term_cost(term);
+			if (cost < 0)
+				j = i + 1;
+			for (k = i; cost >= 0 && k > j && costs[k - 1] > cost; k--) {
+				terms[k] = terms[k - 1];
+				costs[k] = costs[k - 1];
+			}
+			terms[k] = term;
+			costs[k] = cost;
+			i++;
+		}
+
+		LIST_INIT(&suite->terms);
+		for (i = 0; i < nb; i++)
+			LIST_APPEND(&suite->terms, &terms[i]->list);
+	  next:
+		free(terms);
+		free(costs);
+	}
+}
+
 /* Parse an ACL condition starting at <args>[0], relying on a list of already
  * known ACLs passed in <known_acl>. The new condition is returned (or NULL in
  * case of low memory). Supports multiple conditions separated by "or". If
@@ -997,6 +1172,8 @@ struct acl_cond *parse_acl_cond(const char **args, struct list *known_acl,
 	}
 
 	cond->val |= suite_val;
+	if (global.tune.options & GTUNE_ACL_REORDER)
+		acl_cond_reorder(cond);
 	return cond;
 
  out_free_term:
@@ -1051,6 +1228,143 @@ struct acl_cond *build_acl_cond(const char *file, int line, struct list *known_a
 	return cond;
 }
 
+/* Prepares stream <s> for the evaluation of a rule set by allocating an empty
+ * sample cache when "tune.acl.sample-cache" is enabled. On allocation failure
+ * the rules are simply evaluated without the cache.
+ */
+void acl_cache_start(struct stream *s)
+{
+	if (!(global.tune.options & GTUNE_ACL_SAMPLE_CACHE))
+		return;
+
+	if (!s->acl_cache) {
+		s->acl_cache = pool_alloc(pool_head_acl_cache);
+		if (!s->acl_cache)
+			return;
+	}
+	acl_cache_flush(s);
+}
+
+/* Drops all the samples cached for stream <s>. This must be called each time
+ * an action is about to be executed since it may modify the message or the
+ * information the cached samples were extracted from.
+ */
+void acl_cache_flush(struct stream *s)
+{
+	struct acl_cache *cache = s->acl_cache;
+
+	if (cache)
+		cache->nb_ent = cache->nb_val = cache->used = 0;
+}
+
+/* Releases the sample cache of stream <s> once its rule set is evaluated */
+void acl_cache_stop(struct stream *s)
+{
+	pool_free(pool_head_acl_cache, s->acl_cache);
+	s->acl_cache = NULL;
+}
+
+/* Looks up the values of the sample expression identified by <id> fetched for
+ * direction <dir> in cache <cache>. Returns the entry or NULL if not found.
+ */
+static struct acl_cache_ent *acl_cache_lookup(struct acl_cache *cache, unsigned int id, unsigned int dir)
+{
+	unsigned int i;
+
+	for (i = 0; i < cache->nb_ent; i++) {
+		if (cache->ent[i].id == id && cache->ent[i].dir == dir)
+			return &cache->ent[i];
+	}
+	return NULL;
+}
+
+/* Starts recording a new entry in cache <cache>. Returns 0 if the cache is
+ * full, otherwise non-zero.
+ */
+static int acl_cache_open(struct acl_cache *cache)
+{
+	if (cache->nb_ent >= ACL_CACHE_ENTRIES)
+		return 0;
+	cache->pend_val = cache->pend_used = 0;
+	return 1;
+}
+
+/* Appends a copy of the value of sample <smp> to the entry being recorded in
+ * cache <cache>. Returns 0 if the value cannot be cached, in which case the
+ * entry must be abandoned, otherwise non-zero.
+ */
+static int acl_cache_add(struct acl_cache *cache, const struct sample *smp)
+{
+	struct sample_data *data;
+	struct buffer *str = NULL;
+
+	if (smp->flags & (SMP_F_VOL_TEST | SMP_F_MAY_CHANGE))
+		return 0;
+
+	if (cache->nb_val + cache->pend_val >= ACL_CACHE_VALUES)
+		return 0;
+
+	data = &cache->val[cache->nb_val + cache->pend_val];
+	*data = smp->data;
+
+	if (data->type == SMP_T_STR || data->type == SMP_T_BIN)
+		str = &data->u.str;
+	else if (data->type == SMP_T_METH && data->u.meth.meth == HTTP_METH_OTHER)
+		str = &data->u.meth.str;
+
+	if (str) {
+		/* the sample may point to a trash chunk or to the message */
+		char *area = cache->area + cache->used + cache->pend_used;
+
+		if (str->data > ACL_CACHE_STORAGE - cache->used - cache->pend_used)
+			return 0;
+		memcpy(area, str->area, str->data);
+		str->area = area;
+		str->size = str->data;
+		str->head = 0;
+		cache->pend_used += str->data;
+	}
+	cache->pend_val++;
+	return 1;
+}
+
+/* Commits the entry being recorded in cache <cache> for the sample expression
+ * identified by <id> and direction <dir>.
+ */
+static void acl_cache_commit(struct acl_cache *cache, unsigned int id, unsigned int dir)
+{
+	struct acl_cache_ent *ent = &cache->ent[cache->nb_ent++];
+
+	ent->id    = id;
+	ent->dir   = dir;
+	ent->first = cache->nb_val;
+	ent->count = cache->pend_val;
+	cache->nb_val += cache->pend_val;
+	cache->used   += cache->pend_used;
+}
+
+/* Matches the values of cache entry <ent> against the patterns of ACL
+ * expression <expr> the same way acl_exec_cond() would do it with freshly
+ * fetched samples. Returns ACL_TEST_PASS or ACL_TEST_FAIL.
+ */
+static enum acl_test_res acl_cache_match(const struct acl_cache *cache, const struct acl_cache_ent *ent,
+                                         struct acl_expr *expr, struct proxy *px, struct session *sess,
+                                         struct stream *strm, unsigned int opt)
+{
+	struct sample smp;
+	unsigned int i;
+
+	for (i = 0; i < ent->count; i++) {
+		memset(&smp, 0, sizeof(smp));
+		smp_set_owner(&smp, px, sess, strm, opt);
+		smp.flags = SMP_F_CONST;
+		smp.data = cache->val[ent->first + i];
+		if (pattern_exec_match(&expr->pat, &smp, 0))
+			return ACL_TEST_PASS;
+	}
+	return ACL_TEST_FAIL;
+}
+
 /* Execute condition <cond> and return either ACL_TEST_FAIL, ACL_TEST_MISS or
  * ACL_TEST_PASS depending on the test results. ACL_TEST_MISS may only be
  * returned if <opt> does not contain SMP_OPT_FINAL, indicating that incomplete
@@ -1071,6 +1385,7 @@ enum acl_test_res acl_exec_cond(struct acl_cond *cond, struct proxy *px, struct
 	struct acl_term *term;
 	struct acl_expr *expr;
 	struct acl *acl;
+	struct acl_cache *cache = strm ? strm->acl_cache : NULL;
 	struct sample smp;
 	enum acl_test_res acl_res, suite_res, cond_res;
 
@@ -1096,15 +1411,29 @@ enum acl_test_res acl_exec_cond(struct acl_cond *cond, struct proxy *px, struct
 		list_for_each_entry(term, &suite->terms, list) {
 			acl = term->acl;
 
-			/* FIXME: use cache !
-			 * check acl->cache_idx for this.
-			 */
-
-			/* ACL result not cached. Let's scan all the expressions
-			 * and use the first one to match.
+			/* Let's scan all the expressions and use the first one to
+			 * match. The sample values of the expressions already
+			 * evaluated by this rule set are taken from the cache when
+			 * available, otherwise they are recorded there once all of
+			 * them were fetched.
 			 */
 			acl_res = ACL_TEST_FAIL;
 			list_for_each_entry(expr, &acl->expr, list) {
+				int record = 0;
+
+				if (cache && expr->smp_id) {
+					struct acl_cache_ent *ent;
+
+					ent = acl_cache_lookup(cache, expr->smp_id, opt & SMP_OPT_DIR);
+					if (ent) {
+						acl_res |= acl_cache_match(cache, ent, expr, px, sess, strm, opt);
+						if (acl_res == ACL_TEST_PASS)
+							break;
+						continue;
+					}
+					record = acl_cache_open(cache);
+				}
+
 				/* we need to reset context and flags */
 				memset(&smp, 0, sizeof(smp));
 			fetch_next:
@@ -1112,19 +1441,18 @@ enum acl_test_res acl_exec_cond(struct acl_cond *cond, struct proxy *px, struct
 					/* maybe we could not fetch because of missing data */
 					if (smp.flags & SMP_F_MAY_CHANGE && !(opt & SMP_OPT_FINAL))
 						acl_res |= ACL_TEST_MISS;
+					else if (record && !(smp.flags & (SMP_F_VOL_TEST | SMP_F_MAY_CHANGE)))
+						acl_cache_commit(cache, expr->smp_id, opt & SMP_OPT_DIR);
 					continue;
 				}
 
+				if (record)
+					record = acl_cache_add(cache, &smp);
+
 				acl_res |= pat2acl(pattern_exec_match(&expr->pat, &smp, 0));
 				/*
 				 * OK now acl_res holds the result of this expression
 				 * as one of ACL_TEST_FAIL, ACL_TEST_MISS or ACL_TEST_PASS.
-				 *
-				 * Then if (!MISS) we can cache the result, and put
-				 * (smp.flags & SMP_F_VOLATILE) in the cache flags.
-				 *
-				 * FIXME: implement cache.
-				 *
 				 */
 
 				/* we're ORing these terms, so a single PASS is enough */
@@ -1140,6 +1468,8 @@ enum acl_test_res acl_exec_cond(struct acl_cond *cond, struct proxy *px, struct
 				 */
 				if (smp.flags & SMP_F_MAY_CHANGE && !(opt & SMP_OPT_FINAL))
 					acl_res |= ACL_TEST_MISS;
+				else if (record)
+					acl_cache_commit(cache, expr->smp_id, opt & SMP_OPT_DIR);
 			}
 			/*
 			 * Here we have the result of an ACL (cached or not).
@@ -1323,6 +1653,71 @@ void free_acl_cond(struct acl_cond *cond)
 	free(cond);
 }
 
+/* Releases the sample cache identifiers */
+static void acl_smp_keys_deinit(void)
+{
+	struct ebmb_node *node, *next;
+	struct acl_smp_key *key;
+
+	node = ebmb_first(&acl_smp_keys);
+	while (node) {
+		next = ebmb_next(node);
+		ebmb_delete(node);
+		key = container_of(node, struct acl_smp_key, node);
+		free(key);
+		node = next;
+	}
+}
+
+REGISTER_POST_DEINIT(acl_smp_keys_deinit);
+
+/* config parser for global "tune.acl.sample-cache", accepts "on" or "off" */
+static int cfg_parse_tune_acl_sample_cache(char **args, int section_type, struct proxy *curpx,
+                                           const struct proxy *defpx, const char *file, int line,
+                                           char **err)
+{
+	if (too_many_args(1, args, err, NULL))
+		return -1;
+
+	if (strcmp(args[1], "on") == 0)
+		global.tune.options |= GTUNE_ACL_SAMPLE_CACHE;
+	else if (strcmp(args[1], "off") == 0)
+		global.tune.options &= ~GTUNE_ACL_SAMPLE_CACHE;
+	else {
+		memprintf(err, "'%s' expects either 'on' or 'off' but got '%s'.", args[0], args[1]);
+		return -1;
+	}
+	return 0;
+}
+
+/* config parser for global "tune.acl.reorder", accepts "on" or "off" */
+static int cfg_parse_tune_acl_reorder(char **args, int section_type, struct proxy *curpx,
+                                      const struct proxy *defpx, const char *file, int line,
+                                      char **err)
+{
+	if (too_many_args(1, args, err, NULL))
+		return -1;
+
+	if (strcmp(args[1], "on") == 0)
+		global.tune.options |= GTUNE_ACL_REORDER;
+	else if (strcmp(args[1], "off") == 0)
+		global.tune.options &= ~GTUNE_ACL_REORDER;
+	else {
+		memprintf(err, "'%s' expects either 'on' or 'off' but got '%s'.", args[0], args[1]);
+		return -1;
+	}
+	return 0;
+}
+
+/* config keyword parsers */
+static struct cfg_kw_list cfg_kws = {ILH, {
+	{ CFG_GLOBAL, "tune.acl.reorder",      cfg_parse_tune_acl_reorder },
+	{ CFG_GLOBAL, "tune.acl.sample-cache", cfg_parse_tune_acl_sample_cache },
+	{ 0, NULL, NULL }
+}};
+
+INITCALL1(STG_REGISTER, cfg_register_keywords, &cfg_kws);
+
 /************************************************************************/
 /*      All supported sample and ACL keywords must be declared here.    */
 /************************************************************************/
@@ -19,6 +19,7 @@
 #include <haproxy/obj_type.h>
 #include <haproxy/pool.h>
 #include <haproxy/proxy.h>
+#include <haproxy/resolvers.h>
 #include <haproxy/stick_table.h>
 #include <haproxy/task.h>
 #include <haproxy/tools.h>
@@ -147,6 +148,7 @@ int act_resolution_cb(struct resolv_requester *requester, struct dns_counters *c
 	if (stream == NULL)
 		return 0;
 
+	resolv_cache_store(stream, requester->resolution, 0);
 	task_wakeup(stream->task, TASK_WOKEN_MSG);
 
 	return 0;
@@ -169,6 +171,7 @@ int act_resolution_error_cb(struct resolv_requester *requester, int error_code)
 	if (stream == NULL)
 		return 0;
 
+	resolv_cache_store(stream, requester->resolution, 1);
 	task_wakeup(stream->task, TASK_WOKEN_MSG);
 
 	return 0;
@@ -15,10 +15,20 @@
 #include <haproxy/cfgparse.h>
 #include <haproxy/channel.h>
 #include <haproxy/cli.h>
+#include <haproxy/debug.h>
 #include <haproxy/freq_ctr.h>
+#include <haproxy/log.h>
+#include <haproxy/ring.h>
 #include <haproxy/stream_interface.h>
+#include <haproxy/task.h>
+#include <haproxy/thread.h>
 #include <haproxy/tools.h>
 
+/* the lock profiler is only available on threaded builds without DEBUG_THREAD */
+#if defined(USE_THREAD) && !defined(DEBUG_THREAD) && !defined(DEBUG_FULL)
+#define HA_HAVE_LOCK_PROFILING
+#endif
+
 #if defined(DEBUG_MEM_STATS)
 /* these ones are macros in bug.h when DEBUG_MEM_STATS is set, and will
  * prevent the new ones from being redefined.
@@ -38,6 +48,20 @@ struct activity activity[MAX_THREADS] __attribute__((aligned(64))) = { };
 /* One struct per function pointer hash entry (256 values, 0=collision) */
 struct sched_activity sched_activity[256] __attribute__((aligned(64))) = { };
 
+/* calls to task and tasklet handlers lasting longer than this are reported
+ * into <stall_ring>, in nanoseconds, 0 = disabled.
+ */
+unsigned long long stall_threshold __read_mostly = 0;
+static struct ring *stall_ring = NULL;
+
+/* what the stall sampler captured on the current thread during a long call */
+static THREAD_LOCAL struct {
+	volatile unsigned int ctxsw;    /* activity[tid].ctxsw seen at the last sample */
+	volatile unsigned int captured; /* ctxsw of the call captured into <buf> */
+	volatile int valid;             /* <buf> holds a capture for <captured> */
+	struct buffer buf;              /* handler, context and call trace */
+} stall_sample;
+
 
 #if USE_MEMORY_PROFILING
 /* determine the number of buckets to store stats */
@@ -335,6 +359,20 @@ void free(void *ptr)
 	_HA_ATOMIC_ADD(&bin->free_tot, size_before);
 }
 
+/* retrieves the total number of allocation calls and allocated bytes accounted
+ * by the memory profiler so far, for all callers.
+ */
+void memprof_get_totals(unsigned long long *calls, unsigned long long *bytes)
+{
+	int i;
+
+	*calls = *bytes = 0;
+	for (i = 0; i < MEMPROF_HASH_BUCKETS + 1; i++) {
+		*calls += HA_ATOMIC_LOAD(&memprof_stats[i].alloc_calls);
+		*bytes += HA_ATOMIC_LOAD(&memprof_stats[i].alloc_tot);
+	}
+}
+
 #endif // USE_MEMORY_PROFILING
 
 /* Updates the current thread's statistics about stolen CPU time. The unit for
@@ -389,6 +427,143 @@ static int cfg_parse_prof_tasks(char **args, int section_type, struct proxy *cur
 	return 0;
 }
 
+/* Called from the stall sampling timer's signal handler on the thread it
+ * samples, every stall_threshold of CPU time. If the same handler call is
+ * still running since the previous sample, it has been running for at least
+ * the threshold, so its task, its context and the call trace are captured
+ * while they are still there, for sched_report_stall() to report them once
+ * the call returns.
+ */
+void sched_sample_stall()
+{
+	unsigned int ctxsw = activity[tid].ctxsw;
+
+	if (sched->current && ctxsw == stall_sample.ctxsw && stall_sample.buf.size &&
+	    !(stall_sample.valid && stall_sample.captured == ctxsw)) {
+		stall_sample.valid = 0;
+		chunk_reset(&stall_sample.buf);
+		chunk_appendf(&stall_sample.buf, "  task: ");
+		ha_task_dump(&stall_sample.buf, sched->current, "    ");
+		ha_dump_backtrace(&stall_sample.buf, "  ", 0);
+		stall_sample.captured = ctxsw;
+		stall_sample.valid = 1;
+	}
+	stall_sample.ctxsw = ctxsw;
+}
+
+/* Reports into the stall ring that the current call to handler <process>
+ * lasted <duration> nanoseconds. The context captured by the sampler during
+ * this call is reported if any. Otherwise the task <t> is dumped if not NULL,
+ * which means that it is still valid after the call.
+ */
+void sched_report_stall(const struct task *t, const void *process, unsigned long long duration)
+{
+	struct buffer *buf = get_trash_chunk();
+	struct ring *ring = HA_ATOMIC_LOAD(&stall_ring);
+	struct ist msg;
+	struct tm tm;
+
+	if (!ring)
+		return;
+
+	get_localtime(date.tv_sec, &tm);
+	chunk_printf(buf, "%04d-%02d-%02dT%02d:%02d:%02d.%06d thread %d stalled for %llu us in ",
+	             tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday, tm.tm_hour, tm.tm_min, tm.tm_sec,
+	             (int)date.tv_usec, tid + 1, duration / 1000);
+	resolve_sym_name(buf, NULL, process);
+	chunk_appendf(buf, "\n");
+
+	if (stall_sample.valid && stall_sample.captured == activity[tid].ctxsw)
+		chunk_memcat(buf, stall_sample.buf.area, stall_sample.buf.data);
+	else if (t) {
+		chunk_appendf(buf, "  task: ");
+		ha_task_dump(buf, t, "    ");
+	}
+	stall_sample.valid = 0;
+
+	msg = ist2(buf->area, buf->data);
+	ring_write(ring, ~0, NULL, 0, &msg, 1);
+}
+
+/* Applies the stall detection threshold to the current thread's sampler, and
+ * allocates the sampler's buffer upon first use.
+ */
+void sched_update_stall_sampler()
+{
+	unsigned long long ns = HA_ATOMIC_LOAD(&stall_threshold);
+
+	ti->stall_period = ns;
+	if (ns && !stall_sample.buf.size) {
+		char *area = malloc(STALL_SAMPLE_SIZE);
+
+		if (area)
+			stall_sample.buf = b_make(area, STALL_SAMPLE_SIZE, 0, 0);
+	}
+	stall_sample.ctxsw = activity[tid].ctxsw;
+	wdt_set_stall_period(ns);
+}
+
+/* Sets the stall detection threshold to <ns> nanoseconds, or disables the
+ * detection if zero. The ring is allocated upon first use. Returns non-zero on
+ * success, or zero if the ring could not be allocated.
+ */
+static int stall_set_threshold(unsigned long long ns)
+{
+	if (ns && !stall_ring) {
+		struct ring *old = NULL;
+		struct ring *ring = ring_new(STALL_RING_SIZE);
+
+		if (!ring)
+			return 0;
+		if (!HA_ATOMIC_CAS(&stall_ring, &old, ring))
+			ring_free(ring);
+	}
+	HA_ATOMIC_STORE(&stall_threshold, ns);
+	return 1;
+}
+
+/* config parser for global "profiling.stalls", accepts "off" or a time */
+static int cfg_parse_prof_stalls(char **args, int section_type, struct proxy *curpx,
+                                 const struct proxy *defpx, const char *file, int line,
+                                 char **err)
+{
+	const char *res;
+	unsigned int ms;
+
+	if (too_many_args(1, args, err, NULL))
+		return -1;
+
+	if (strcmp(args[1], "off") == 0)
+		ms = 0;
+	else {
+		res = parse_time_err(args[1], &ms, TIME_UNIT_MS);
+		if (res || !*args[1] || !ms) {
+			memprintf(err, "'%s' expects either 'off' or a non-null time but got '%s'.", args[0], args[1]);
+			return -1;
+		}
+	}
+
+	if (!stall_set_threshold(ms * 1000000ULL)) {
+		memprintf(err, "'%s' : out of memory.", args[0]);
+		return -1;
+	}
+	return 0;
+}
+
+/* parse a "show stalls" command */
+static int cli_parse_show_stalls(char **args, char *payload, struct appctx *appctx, void *private)
+{
+	struct ring *ring = HA_ATOMIC_LOAD(&stall_ring);
+
+	if (!cli_has_level(appctx, ACCESS_LVL_OPER))
+		return 1;
+
+	if (!ring)
+		return cli_msg(appctx, LOG_INFO, "\n"); // never enabled
+
+	return ring_attach_cli(ring, appctx);
+}
+
 /* parse a "set profiling" command. It always returns 1. */
 static int cli_parse_set_profiling(char **args, char *payload, struct appctx *appctx, void *private)
 {
@@ -427,12 +602,47 @@ static int cli_parse_set_profiling(char **args, char *payload, struct appctx *ap
 #endif
 	}
 
+	if (strcmp(args[2], "locks") == 0) {
+#ifdef HA_HAVE_LOCK_PROFILING
+		if (strcmp(args[3], "on") == 0) {
+			if (!HA_ATOMIC_LOAD(&lock_profiling)) {
+				/* flush current profiling stats first */
+				thread_isolate();
+				lock_prof_reset();
+				HA_ATOMIC_STORE(&lock_profiling, 1);
+				thread_release();
+			}
+		}
+		else if (strcmp(args[3], "off") == 0)
+			HA_ATOMIC_STORE(&lock_profiling, 0);
+		else
+			return cli_err(appctx, "Expects either 'on' or 'off'.\n");
+		return 1;
+#else
+		return cli_err(appctx, "Lock profiling requires threads and is not compatible with DEBUG_THREAD.\n");
+#endif
+	}
+
+	if (strcmp(args[2], "stalls") == 0) {
+		const char *res;
+		unsigned int ms = 0;
+
+		if (strcmp(args[3], "off") != 0) {
+			res = parse_time_err(args[3], &ms, TIME_UNIT_MS);
+			if (res || !*args[3] || !ms)
+				return cli_err(appctx, "Expects either 'off' or a non-null time.\n");
+		}
+		if (!stall_set_threshold(ms * 1000000ULL))
+			return cli_err(appctx, "Out of memory.\n");
+		return 1;
+	}
+
 	if (strcmp(args[2], "tasks") != 0)
-		return cli_err(appctx, "Expects either 'tasks' or 'memory'.\n");
+		return cli_err(appctx, "Expects either 'tasks', 'memory', 'locks' or 'stalls'.\n");
 
 	if (strcmp(args[3], "on") == 0) {
 		unsigned int old = profiling;
-		int i;
+		int i, b;
 
 		while (!_HA_ATOMIC_CAS(&profiling, &old, (old & ~HA_PROF_TASKS_MASK) | HA_PROF_TASKS_ON))
 			;
@@ -441,6 +651,10 @@ static int cli_parse_set_profiling(char **args, char *payload, struct appctx *ap
 			HA_ATOMIC_STORE(&sched_activity[i].calls, 0);
 			HA_ATOMIC_STORE(&sched_activity[i].cpu_time, 0);
 			HA_ATOMIC_STORE(&sched_activity[i].lat_time, 0);
+			for (b = 0; b < SCHED_HIST_BUCKETS; b++) {
+				HA_ATOMIC_STORE(&sched_activity[i].lat_hist[b], 0);
+				HA_ATOMIC_STORE(&sched_activity[i].cpu_hist[b], 0);
+			}
 			HA_ATOMIC_STORE(&sched_activity[i].func, NULL);
 		}
 	}
@@ -466,6 +680,30 @@ static int cli_parse_set_profiling(char **args, char *payload, struct appctx *ap
 	return 1;
 }
 
+/* names of the ranges covered by the scheduler's histogram buckets */
+static const char *sched_hist_names[SCHED_HIST_BUCKETS] = {
+	"<1us", "<4us", "<16us", "<65us", "<262us", "<1ms",
+	"<4ms", "<16ms", "<67ms", "<268ms", "<1s", ">1s",
+};
+
+/* appends to <buf> the histogram <hist> after prefix <pfx>, unless it's empty */
+static void dump_sched_hist(struct buffer *buf, const char *pfx, const uint32_t *hist)
+{
+	int b;
+
+	for (b = 0; b < SCHED_HIST_BUCKETS; b++)
+		if (hist[b])
+			break;
+
+	if (b == SCHED_HIST_BUCKETS)
+		return;
+
+	chunk_appendf(buf, "%s", pfx);
+	for (b = 0; b < SCHED_HIST_BUCKETS; b++)
+		chunk_appendf(buf, "%7u", hist[b]);
+	chunk_appendf(buf, "\n");
+}
+
 static int cmp_sched_activity_calls(const void *a, const void *b)
 {
 	const struct sched_activity *l = (const struct sched_activity *)a;
@@ -492,6 +730,39 @@ static int cmp_sched_activity_addr(const void *a, const void *b)
 		return 0;
 }
 
+#ifdef HA_HAVE_LOCK_PROFILING
+/* used by qsort below */
+static int cmp_lock_prof_wait(const void *a, const void *b)
+{
+	const struct lock_prof_caller *l = (const struct lock_prof_caller *)a;
+	const struct lock_prof_caller *r = (const struct lock_prof_caller *)b;
+
+	if (l->wait_time > r->wait_time)
+		return -1;
+	else if (l->wait_time < r->wait_time)
+		return 1;
+	else if (l->hold_time > r->hold_time)
+		return -1;
+	else if (l->hold_time < r->hold_time)
+		return 1;
+	else
+		return 0;
+}
+
+static int cmp_lock_prof_addr(const void *a, const void *b)
+{
+	const struct lock_prof_caller *l = (const struct lock_prof_caller *)a;
+	const struct lock_prof_caller *r = (const struct lock_prof_caller *)b;
+
+	if (l->caller > r->caller)
+		return -1;
+	else if (l->caller < r->caller)
+		return 1;
+	else
+		return 0;
+}
+#endif // HA_HAVE_LOCK_PROFILING
+
 #if USE_MEMORY_PROFILING
 /* used by qsort below */
 static int cmp_memprof_stats(const void *a, const void *b)
@@ -527,9 +798,11 @@ static int cmp_memprof_addr(const void *a, const void *b)
  *    ctx.cli.i0:
  *       0, 4: dump status, then jump to 1 if 0
  *       1, 5: dump tasks, then jump to 2 if 1
- *       2, 6: dump memory, then stop
+ *       2, 6: dump memory, then jump to 3 if 2
+ *       3, 7: dump locks, then stop
  *    ctx.cli.i1:
- *       restart line for each step (starts at zero)
+ *       restart line for each step (starts at zero). For locks, lines
+ *       below LOCK_LABELS are per-label, the next ones are per-caller.
  *    ctx.cli.o0:
  *       may contain a configured max line count for each step (0=not set)
  *    ctx.cli.o1:
@@ -543,10 +816,16 @@ static int cli_io_handler_show_profiling(struct appctx *appctx)
 	struct memprof_stats tmp_memstats[MEMPROF_HASH_BUCKETS + 1];
 	unsigned long long tot_alloc_calls, tot_free_calls;
 	unsigned long long tot_alloc_bytes, tot_free_bytes;
+#endif
+#ifdef HA_HAVE_LOCK_PROFILING
+	struct lock_prof_caller tmp_lockcallers[LOCK_PROF_CALLERS];
+	struct lock_prof_stat lstat;
+	int thr;
 #endif
 	struct stream_interface *si = appctx->owner;
 	struct buffer *name_buffer = get_trash_chunk();
 	const char *str;
+	char stalls[24];
 	int max_lines;
 	int i, max;
 
@@ -565,10 +844,23 @@ static int cli_io_handler_show_profiling(struct appctx *appctx)
 	if ((appctx->ctx.cli.i0 & 3) != 0)
 		goto skip_status;
 
+	if (stall_threshold)
+		snprintf(stalls, sizeof(stalls), "%llums", stall_threshold / 1000000ULL);
+	else
+		strcpy(stalls, "off");
+
 	chunk_printf(&trash,
 	             "Per-task CPU profiling              : %-8s      # set profiling tasks {on|auto|off}\n"
-	             "Memory usage profiling              : %-8s      # set profiling memory {on|off}\n",
-	             str, (profiling & HA_PROF_MEMORY) ? "on" : "off");
+	             "Memory usage profiling              : %-8s      # set profiling memory {on|off}\n"
+	             "Lock contention profiling           : %-8s      # set profiling locks {on|off}\n"
+	             "Stall detection threshold           : %-8s      # set profiling stalls {<time>|off}\n",
+	             str, (profiling & HA_PROF_MEMORY) ? "on" : "off",
+#ifdef HA_HAVE_LOCK_PROFILING
+	             HA_ATOMIC_LOAD(&lock_profiling) ? "on" : "off",
+#else
+	             "n/a",
+#endif
+	             stalls);
 
 	if (ci_putchk(si_ic(si), &trash) == -1) {
 		/* failed, try again */
@@ -590,9 +882,14 @@ static int cli_io_handler_show_profiling(struct appctx *appctx)
 	else
 		qsort(tmp_activity, 256, sizeof(tmp_activity[0]), cmp_sched_activity_calls);
 
-	if (!appctx->ctx.cli.i1)
+	if (!appctx->ctx.cli.i1) {
 		chunk_appendf(&trash, "Tasks activity:\n"
-		                      "  function                      calls   cpu_tot   cpu_avg   lat_tot   lat_avg\n");
+		                      "  function                      calls   cpu_tot   cpu_avg   lat_tot   lat_avg\n"
+		                      "    distribution:");
+		for (i = 0; i < SCHED_HIST_BUCKETS; i++)
+			chunk_appendf(&trash, "%7s", sched_hist_names[i]);
+		chunk_appendf(&trash, "\n");
+	}
 
 	max_lines = appctx->ctx.cli.o0;
 	if (!max_lines)
@@ -619,6 +916,8 @@ static int cli_io_handler_show_profiling(struct appctx *appctx)
 		print_time_short(&trash, "   ", tmp_activity[i].cpu_time / tmp_activity[i].calls, "");
 		print_time_short(&trash, "   ", tmp_activity[i].lat_time, "");
 		print_time_short(&trash, "   ", tmp_activity[i].lat_time / tmp_activity[i].calls, "\n");
+		dump_sched_hist(&trash, "    cpu:         ", tmp_activity[i].cpu_hist);
+		dump_sched_hist(&trash, "    lat:         ", tmp_activity[i].lat_hist);
 
 		if (ci_putchk(si_ic(si), &trash) == -1) {
 			/* failed, try again */
@@ -715,13 +1014,112 @@ static int cli_io_handler_show_profiling(struct appctx *appctx)
 		appctx->ctx.cli.i0++; // next step
 
  skip_mem:
+#else
+	if ((appctx->ctx.cli.i0 & 7) == 2)
+		appctx->ctx.cli.i0++; // no memory step, go to locks
 #endif // USE_MEMORY_PROFILING
 
+#ifdef HA_HAVE_LOCK_PROFILING
+	if ((appctx->ctx.cli.i0 & 3) != 3)
+		goto skip_locks;
+
+	if (!appctx->ctx.cli.i1)
+		chunk_appendf(&trash,
+		              "Locks activity (hold times sampled on 1/%d acquisitions):\n"
+		              "  label                   calls  contended   wait_tot   wait_avg   wait_max   hold_avg\n",
+		              LOCK_PROF_SAMPLING);
+
+	for (i = appctx->ctx.cli.i1; i < LOCK_LABELS; i++) {
+		appctx->ctx.cli.i1 = i;
+		memset(&lstat, 0, sizeof(lstat));
+		for (thr = 0; thr < global.nbthread && thr < MAX_THREADS; thr++) {
+			const struct lock_prof_stat *st = &lock_prof_stats[thr][i];
+
+			lstat.calls        += st->calls;
+			lstat.contended    += st->contended;
+			lstat.wait_time    += st->wait_time;
+			lstat.hold_samples += st->hold_samples;
+			lstat.hold_time    += st->hold_time;
+			if (st->max_wait > lstat.max_wait)
+				lstat.max_wait = st->max_wait;
+		}
+
+		if (!lstat.calls)
+			continue;
+
+		chunk_appendf(&trash, "  %-16s %12llu %10llu", lock_label(i),
+		              (unsigned long long)lstat.calls, (unsigned long long)lstat.contended);
+		print_time_short(&trash, "   ", lstat.wait_time, "");
+		print_time_short(&trash, "   ", lstat.contended ? lstat.wait_time / lstat.contended : 0, "");
+		print_time_short(&trash, "   ", lstat.max_wait, "");
+		print_time_short(&trash, "   ", lstat.hold_samples ? lstat.hold_time / lstat.hold_samples : 0, "\n");
+
+		if (ci_putchk(si_ic(si), &trash) == -1) {
+			si_rx_room_blk(si);
+			return 0;
+		}
+	}
+
+	memcpy(tmp_lockcallers, lock_prof_callers, sizeof(tmp_lockcallers));
+	if (appctx->ctx.cli.o1)
+		qsort(tmp_lockcallers, LOCK_PROF_CALLERS, sizeof(tmp_lockcallers[0]), cmp_lock_prof_addr);
+	else
+		qsort(tmp_lockcallers, LOCK_PROF_CALLERS, sizeof(tmp_lockcallers[0]), cmp_lock_prof_wait);
+
+	if (appctx->ctx.cli.i1 <= LOCK_LABELS)
+		chunk_appendf(&trash,
+		              "Locks contention by call place:\n"
+		              "   contended   wait_tot   wait_avg   hold_avg  label            caller\n");
+
+	max_lines = appctx->ctx.cli.o0;
+	if (!max_lines || max_lines > LOCK_PROF_CALLERS)
+		max_lines = LOCK_PROF_CALLERS;
+
+	if (appctx->ctx.cli.i1 < LOCK_LABELS)
+		appctx->ctx.cli.i1 = LOCK_LABELS;
+
+	for (i = appctx->ctx.cli.i1 - LOCK_LABELS; i < max_lines; i++) {
+		struct lock_prof_caller *entry = &tmp_lockcallers[i];
+
+		appctx->ctx.cli.i1 = i + LOCK_LABELS;
+		if (!entry->contended && !entry->hold_samples)
+			continue;
+
+		chunk_appendf(&trash, "  %10llu", (unsigned long long)entry->contended);
+		print_time_short(&trash, "   ", entry->wait_time, "");
+		print_time_short(&trash, "   ", entry->contended ? entry->wait_time / entry->contended : 0, "");
+		print_time_short(&trash, "   ", entry->hold_samples ? entry->hold_time / entry->hold_samples : 0, "");
+		chunk_appendf(&trash, "  %-16s ", entry->label < LOCK_LABELS ? lock_label(entry->label) : "?");
+
+		if (entry->caller)
+			resolve_sym_name(&trash, NULL, entry->caller);
+		else
+			chunk_appendf(&trash, "[other]");
+		chunk_appendf(&trash, "\n");
+
+		if (ci_putchk(si_ic(si), &trash) == -1) {
+			si_rx_room_blk(si);
+			return 0;
+		}
+	}
+
+	if (ci_putchk(si_ic(si), &trash) == -1) {
+		si_rx_room_blk(si);
+		return 0;
+	}
+
+	appctx->ctx.cli.i1 = 0; // reset first line to dump
+	if ((appctx->ctx.cli.i0 & 4) == 0)
+		appctx->ctx.cli.i0++; // next step
+
+ skip_locks:
+#endif // HA_HAVE_LOCK_PROFILING
+
 	return 1;
 }
 
 /* parse a "show profiling" command. It returns 1 on failure, 0 if it starts to dump.
- *  - cli.i0 is set to the first state (0=all, 4=status, 5=tasks, 6=memory)
+ *  - cli.i0 is set to the first state (0=all, 4=status, 5=tasks, 6=memory, 7=locks)
  *  - cli.o1 is set to 1 if the output must be sorted by addr instead of usage
  *  - cli.o0 is set to the number of lines of output
  */
@@ -745,6 +1143,9 @@ static int cli_parse_show_profiling(char **args, char *payload, struct appctx *a
 		else if (strcmp(args[arg], "memory") == 0) {
 			appctx->ctx.cli.i0 = 6; // will visit memory only
 		}
+		else if (strcmp(args[arg], "locks") == 0) {
+			appctx->ctx.cli.i0 = 7; // will visit locks only
+		}
 		else if (strcmp(args[arg], "byaddr") == 0) {
 			appctx->ctx.cli.o1 = 1; // sort output by address instead of usage
 		}
@@ -752,7 +1153,7 @@ static int cli_parse_show_profiling(char **args, char *payload, struct appctx *a
 			appctx->ctx.cli.o0 = atoi(args[arg]); // number of entries to dump
 		}
 		else
-			return cli_err(appctx, "Expects either 'all', 'status', 'tasks', 'memory', 'byaddr' or a max number of output lines.\n");
+			return cli_err(appctx, "Expects either 'all', 'status', 'tasks', 'memory', 'locks', 'byaddr' or a max number of output lines.\n");
 	}
 	return 0;
 }
@@ -795,20 +1196,22 @@ static int cli_io_handler_show_tasks(struct appctx *appctx)
 
 	thread_isolate();
 
-	/* 1. global run queue */
+	/* 1. thread groups' run queues */
 
 #ifdef USE_THREAD
-	rqnode = eb32sc_first(&rqueue, ~0UL);
-	while (rqnode) {
-		t = eb32sc_entry(rqnode, struct task, rq);
-		entry = sched_activity_entry(tmp_activity, t->process);
-		if (t->call_date) {
-			lat = now_ns - t->call_date;
-			if ((int64_t)lat > 0)
-				entry->lat_time += lat;
+	for (thr = 0; thr < global.nbtgroups; thr++) {
+		rqnode = eb32sc_first(&task_per_tgroup[thr].rqueue, ~0UL);
+		while (rqnode) {
+			t = eb32sc_entry(rqnode, struct task, rq);
+			entry = sched_activity_entry(tmp_activity, t->process);
+			if (t->call_date) {
+				lat = now_ns - t->call_date;
+				if ((int64_t)lat > 0)
+					entry->lat_time += lat;
+			}
+			entry->calls++;
+			rqnode = eb32sc_next(rqnode, ~0UL);
 		}
-		entry->calls++;
-		rqnode = eb32sc_next(rqnode, ~0UL);
 	}
 #endif
 	/* 2. all threads's local run queues */
@@ -904,6 +1307,7 @@ static struct cfg_kw_list cfg_kws = {ILH, {
 #ifdef USE_MEMORY_PROFILING
 	{ CFG_GLOBAL, "profiling.memory",     cfg_parse_prof_memory     },
 #endif
+	{ CFG_GLOBAL, "profiling.stalls",     cfg_parse_prof_stalls     },
 	{ CFG_GLOBAL, "profiling.tasks",      cfg_parse_prof_tasks      },
 	{ 0, NULL, NULL }
 }};
@@ -912,10 +1316,25 @@ INITCALL1(STG_REGISTER, cfg_register_keywords, &cfg_kws);
 
 /* register cli keywords */
 static struct cli_kw_list cli_kws = {{ },{
-	{ { "set",  "profiling", NULL }, "set profiling <what> {auto|on|off}      : enable/disable resource profiling (tasks,memory)", cli_parse_set_profiling,  NULL },
-	{ { "show", "profiling", NULL }, "show profiling [<what>|<#lines>|byaddr]*: show profiling state (all,status,tasks,memory)",   cli_parse_show_profiling, cli_io_handler_show_profiling, NULL },
+	{ { "set",  "profiling", NULL }, "set profiling <what> {auto|on|off}      : enable/disable resource profiling (tasks,memory,locks,stalls)", cli_parse_set_profiling,  NULL },
+	{ { "show", "profiling", NULL }, "show profiling [<what>|<#lines>|byaddr]*: show profiling state (all,status,tasks,memory,locks)",   cli_parse_show_profiling, cli_io_handler_show_profiling, NULL },
+	{ { "show", "stalls", NULL },    "show stalls                             : show the handler calls which exceeded the stall threshold", cli_parse_show_stalls, NULL, NULL },
 	{ { "show", "tasks", NULL },     "show tasks                              : show running tasks",                               NULL, cli_io_handler_show_tasks,     NULL },
 	{{},}
 }};
 
 INITCALL1(STG_REGISTER, cli_register_kw, &cli_kws);
+
+static void deinit_stall_sampler()
+{
+	ha_free(&stall_sample.buf.area);
+	stall_sample.buf = BUF_NULL;
+}
+
+static void deinit_stall_ring()
+{
+	ring_free(_HA_ATOMIC_XCHG(&stall_ring, NULL));
+}
+
+REGISTER_PER_THREAD_FREE(deinit_stall_sampler);
+REGISTER_POST_DEINIT(deinit_stall_ring);
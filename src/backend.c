@@ -25,6 +25,7 @@
 #include <haproxy/backend.h>
 #include <haproxy/channel.h>
 #include <haproxy/check.h>
+#include <haproxy/counters.h>
 #include <haproxy/frontend.h>
 #include <haproxy/global.h>
 #include <haproxy/hash.h>
@@ -36,6 +37,8 @@
 #include <haproxy/lb_fas.h>
 #include <haproxy/lb_fwlc.h>
 #include <haproxy/lb_fwrr.h>
+#include <haproxy/lb_local.h>
+#include <haproxy/lb_maglev.h>
 #include <haproxy/lb_map.h>
 #include <haproxy/log.h>
 #include <haproxy/namespace.h>
@@ -55,6 +58,7 @@
 #include <haproxy/ticks.h>
 #include <haproxy/time.h>
 #include <haproxy/trace.h>
+#include <haproxy/usdt.h>
 
 #define TRACE_SOURCE &trace_strm
 
@@ -155,6 +159,23 @@ void update_backend_weight(struct proxy *px)
 	}
 }
 
+/*
+ * This function returns the server designated by <hash> for the proxy <px>,
+ * using the lookup method of its hash type, while trying to avoid <avoid> with
+ * the methods supporting it.
+ */
+static inline struct server *get_server_hash(struct proxy *px, unsigned int hash, const struct server *avoid)
+{
+	switch (px->lbprm.algo & BE_LB_LKUP) {
+	case BE_LB_LKUP_CHTREE:
+		return chash_get_server_hash(px, hash, avoid);
+	case BE_LB_LKUP_MAGLEV:
+		return maglev_get_server_hash(px, hash, avoid);
+	default:
+		return map_get_server_hash(px, hash);
+	}
+}
+
 /*
  * This function tries to find a running server for the proxy <px> following
  * the source hash method. Depending on the number of active/backup servers,
@@ -182,10 +203,7 @@ static struct server *get_server_sh(struct proxy *px, const char *addr, int len,
 	if ((px->lbprm.algo & BE_LB_HASH_MOD) == BE_LB_HMOD_AVAL)
 		h = full_hash(h);
  hash_done:
-	if ((px->lbprm.algo & BE_LB_LKUP) == BE_LB_LKUP_CHTREE)
-		return chash_get_server_hash(px, h, avoid);
-	else
-		return map_get_server_hash(px, h);
+	return get_server_hash(px, h, avoid);
 }
 
 /*
@@ -237,10 +255,7 @@ static struct server *get_server_uh(struct proxy *px, char *uri, int uri_len, co
 	if ((px->lbprm.algo & BE_LB_HASH_MOD) == BE_LB_HMOD_AVAL)
 		hash = full_hash(hash);
  hash_done:
-	if ((px->lbprm.algo & BE_LB_LKUP) == BE_LB_LKUP_CHTREE)
-		return chash_get_server_hash(px, hash, avoid);
-	else
-		return map_get_server_hash(px, hash);
+	return get_server_hash(px, hash, avoid);
 }
 
 /*
@@ -294,10 +309,7 @@ static struct server *get_server_ph(struct proxy *px, const char *uri, int uri_l
 				if ((px->lbprm.algo & BE_LB_HASH_MOD) == BE_LB_HMOD_AVAL)
 					hash = full_hash(hash);
 
-				if ((px->lbprm.algo & BE_LB_LKUP) == BE_LB_LKUP_CHTREE)
-					return chash_get_server_hash(px, hash, avoid);
-				else
-					return map_get_server_hash(px, hash);
+				return get_server_hash(px, hash, avoid);
 			}
 		}
 		/* skip to next parameter */
@@ -374,10 +386,7 @@ static struct server *get_server_ph_post(struct stream *s, const struct server *
 				if ((px->lbprm.algo & BE_LB_HASH_MOD) == BE_LB_HMOD_AVAL)
 					hash = full_hash(hash);
 
-				if ((px->lbprm.algo & BE_LB_LKUP) == BE_LB_LKUP_CHTREE)
-					return chash_get_server_hash(px, hash, avoid);
-				else
-					return map_get_server_hash(px, hash);
+				return get_server_hash(px, hash, avoid);
 			}
 		}
 		/* skip to next parameter */
@@ -469,10 +478,7 @@ static struct server *get_server_hh(struct stream *s, const struct server *avoid
 	if ((px->lbprm.algo & BE_LB_HASH_MOD) == BE_LB_HMOD_AVAL)
 		hash = full_hash(hash);
  hash_done:
-	if ((px->lbprm.algo & BE_LB_LKUP) == BE_LB_LKUP_CHTREE)
-		return chash_get_server_hash(px, hash, avoid);
-	else
-		return map_get_server_hash(px, hash);
+	return get_server_hash(px, hash, avoid);
 }
 
 /* RDP Cookie HASH.  */
@@ -514,17 +520,58 @@ static struct server *get_server_rch(struct stream *s, const struct server *avoi
 	if ((px->lbprm.algo & BE_LB_HASH_MOD) == BE_LB_HMOD_AVAL)
 		hash = full_hash(hash);
  hash_done:
-	if ((px->lbprm.algo & BE_LB_LKUP) == BE_LB_LKUP_CHTREE)
-		return chash_get_server_hash(px, hash, avoid);
-	else
-		return map_get_server_hash(px, hash);
+	return get_server_hash(px, hash, avoid);
+}
+
+/* Returns the peak-EWMA of server <srv>'s response times in 1/16 ms, decayed by
+ * the time elapsed since the last measure so that a server which was slow a
+ * long time ago gets a chance to be tried again.
+ */
+static inline unsigned int srv_ewma_get(const struct server *srv)
+{
+	unsigned int ewma = HA_ATOMIC_LOAD(&srv->lb_ewma);
+	int elapsed = now_ms - HA_ATOMIC_LOAD(&srv->lb_ewma_date);
+
+	if (!ewma || elapsed <= 0)
+		return ewma;
+	return (unsigned long long)ewma * LB_EWMA_DECAY / (LB_EWMA_DECAY + (unsigned int)elapsed);
+}
+
+/* Returns the expected cost of sending a new request to server <srv>, which is
+ * its peak-EWMA latency times the number of requests it already serves. The
+ * latency is floored to 1ms so that servers responding in less than that are
+ * compared on their load only.
+ */
+static inline unsigned long long srv_ewma_cost(const struct server *srv)
+{
+	return (unsigned long long)(srv_ewma_get(srv) + 16) * (srv->served + 1);
+}
+
+/* Feeds the time in milliseconds it took server <srv> to respond to a request
+ * into its peak-EWMA. Higher values are immediately retained while lower ones
+ * are averaged over LB_EWMA_DECAY, so that a slowing down server is avoided
+ * at once but only progressively recovers its share of the traffic.
+ */
+void lb_ewma_update(struct server *srv, unsigned int msec)
+{
+	unsigned int sample, ewma, new;
+	unsigned long long elapsed;
+
+	sample = (msec > 0x0FFFFFFF) ? 0xFFFFFFF0 : msec << 4;
+	elapsed = (unsigned int)(now_ms - HA_ATOMIC_XCHG(&srv->lb_ewma_date, now_ms));
+	ewma = HA_ATOMIC_LOAD(&srv->lb_ewma);
+	do {
+		if (sample >= ewma)
+			new = sample;
+		else
+			new = ((unsigned long long)ewma * LB_EWMA_DECAY + sample * elapsed) / (LB_EWMA_DECAY + elapsed);
+	} while (!HA_ATOMIC_CAS(&srv->lb_ewma, &ewma, new) && __ha_cpu_relax());
 }
 
 /* random value  */
-static struct server *get_server_rnd(struct stream *s, const struct server *avoid)
+static struct server *get_server_rnd(struct proxy *px, const struct server *avoid)
 {
 	unsigned int hash = 0;
-	struct proxy  *px = s->be;
 	struct server *prev, *curr;
 	int draws = px->lbprm.arg_opt1; // number of draws
 
@@ -541,10 +588,17 @@ static struct server *get_server_rnd(struct stream *s, const struct server *avoi
 			break;
 
 		/* compare the new server to the previous best choice and pick
-		 * the one with the least currently served requests.
+		 * the one with the least currently served requests, or with
+		 * the lowest expected latency for "balance ewma".
 		 */
-		if (prev && prev != curr &&
-		    curr->served * prev->cur_eweight > prev->served * curr->cur_eweight)
+		if (!prev || prev == curr)
+			continue;
+
+		if ((px->lbprm.algo & BE_LB_PARM) == BE_LB_RR_EWMA) {
+			if (srv_ewma_cost(curr) * prev->cur_eweight > srv_ewma_cost(prev) * curr->cur_eweight)
+				curr = prev;
+		}
+		else if (curr->served * prev->cur_eweight > prev->served * curr->cur_eweight)
 			curr = prev;
 	} while (--draws > 0);
 
@@ -558,6 +612,80 @@ static struct server *get_server_rnd(struct stream *s, const struct server *avoi
 	return curr;
 }
 
+/* Applies the load-balancing algorithm of backend <px> for a client whose
+ * address is <src>, for users which do not have any stream, such as datagram
+ * flows. Only the source address is known, so the hash-based algorithms which
+ * need other information fall back to round robin like when their hashing
+ * parameter is missing. Returns the selected server, or NULL if none is
+ * available or all are full.
+ */
+struct server *assign_server_by_addr(struct proxy *px, const struct sockaddr_storage *src)
+{
+	struct server *srv = NULL;
+
+	if (!(px->lbprm.algo & BE_LB_KIND) || !px->lbprm.tot_weight)
+		return NULL;
+
+	switch (px->lbprm.algo & BE_LB_LKUP) {
+	case BE_LB_LKUP_RRTREE:
+		if (px->lbprm.algo & BE_LB_PROP_LOCAL)
+			srv = lb_local_get_next_server(px, NULL);
+		else
+			srv = fwrr_get_next_server(px, NULL);
+		break;
+
+	case BE_LB_LKUP_FSTREE:
+		srv = fas_get_next_server(px, NULL);
+		break;
+
+	case BE_LB_LKUP_LCTREE:
+		if (px->lbprm.algo & BE_LB_PROP_LOCAL)
+			srv = lb_local_get_next_server(px, NULL);
+		else
+			srv = fwlc_get_next_server(px, NULL);
+		break;
+
+	case BE_LB_LKUP_CHTREE:
+	case BE_LB_LKUP_MAGLEV:
+	case BE_LB_LKUP_MAP:
+		if ((px->lbprm.algo & BE_LB_KIND) == BE_LB_KIND_RR) {
+			if ((px->lbprm.algo & BE_LB_PARM) == BE_LB_RR_RANDOM ||
+			    (px->lbprm.algo & BE_LB_PARM) == BE_LB_RR_EWMA)
+				srv = get_server_rnd(px, NULL);
+			else if ((px->lbprm.algo & BE_LB_LKUP) == BE_LB_LKUP_CHTREE)
+				srv = chash_get_next_server(px, NULL);
+			else
+				srv = map_get_server_rr(px, NULL);
+			break;
+		}
+		else if ((px->lbprm.algo & BE_LB_KIND) != BE_LB_KIND_HI)
+			break;
+
+		if ((px->lbprm.algo & BE_LB_PARM) == BE_LB_HASH_SRC) {
+			if (src->ss_family == AF_INET)
+				srv = get_server_sh(px, (void *)&((struct sockaddr_in *)src)->sin_addr, 4, NULL);
+			else if (src->ss_family == AF_INET6)
+				srv = get_server_sh(px, (void *)&((struct sockaddr_in6 *)src)->sin6_addr, 16, NULL);
+		}
+
+		if (!srv) {
+			if ((px->lbprm.algo & BE_LB_LKUP) == BE_LB_LKUP_CHTREE)
+				srv = chash_get_next_server(px, NULL);
+			else if ((px->lbprm.algo & BE_LB_LKUP) == BE_LB_LKUP_MAGLEV)
+				srv = maglev_get_next_server(px, NULL);
+			else
+				srv = map_get_server_rr(px, NULL);
+		}
+		break;
+	}
+
+	if (srv) {
+		_HA_ATOMIC_INC(&px->be_counters.cum_lbconn);
+		_HA_ATOMIC_INC(&srv->counters.cum_lbconn);
+	}
+	return srv;
+}
+
 /*
  * This function applies the load-balancing algorithm to the stream, as
  * defined by the backend it is assigned to. The stream is then marked as
@@ -665,7 +793,10 @@ int assign_server(struct stream *s)
 		 */
 		switch (s->be->lbprm.algo & BE_LB_LKUP) {
 		case BE_LB_LKUP_RRTREE:
-			srv = fwrr_get_next_server(s->be, prev_srv);
+			if (s->be->lbprm.algo & BE_LB_PROP_LOCAL)
+				srv = lb_local_get_next_server(s->be, prev_srv);
+			else
+				srv = fwrr_get_next_server(s->be, prev_srv);
 			break;
 
 		case BE_LB_LKUP_FSTREE:
@@ -673,14 +804,19 @@ int assign_server(struct stream *s)
 			break;
 
 		case BE_LB_LKUP_LCTREE:
-			srv = fwlc_get_next_server(s->be, prev_srv);
+			if (s->be->lbprm.algo & BE_LB_PROP_LOCAL)
+				srv = lb_local_get_next_server(s->be, prev_srv);
+			else
+				srv = fwlc_get_next_server(s->be, prev_srv);
 			break;
 
 		case BE_LB_LKUP_CHTREE:
+		case BE_LB_LKUP_MAGLEV:
 		case BE_LB_LKUP_MAP:
 			if ((s->be->lbprm.algo & BE_LB_KIND) == BE_LB_KIND_RR) {
-				if ((s->be->lbprm.algo & BE_LB_PARM) == BE_LB_RR_RANDOM)
-					srv = get_server_rnd(s, prev_srv);
+				if ((s->be->lbprm.algo & BE_LB_PARM) == BE_LB_RR_RANDOM ||
+				    (s->be->lbprm.algo & BE_LB_PARM) == BE_LB_RR_EWMA)
+					srv = get_server_rnd(s->be, prev_srv);
 				else if ((s->be->lbprm.algo & BE_LB_LKUP) == BE_LB_LKUP_CHTREE)
 					srv = chash_get_next_server(s->be, prev_srv);
 				else
@@ -764,6 +900,8 @@ int assign_server(struct stream *s)
 			if (!srv) {
 				if ((s->be->lbprm.algo & BE_LB_LKUP) == BE_LB_LKUP_CHTREE)
 					srv = chash_get_next_server(s->be, prev_srv);
+				else if ((s->be->lbprm.algo & BE_LB_LKUP) == BE_LB_LKUP_MAGLEV)
+					srv = maglev_get_next_server(s->be, prev_srv);
 				else
 					srv = map_get_server_rr(s->be, prev_srv);
 			}
@@ -1242,6 +1380,45 @@ static struct connection *conn_backend_get(struct stream *s, struct server *srv,
 	return conn;
 }
 
+/* Returns an available connection matching <hash> in the tree <tree> of the
+ * current thread, according to the reuse policy of backend <be>. By default the
+ * first one is returned. With "pack", the one with the fewest streams left is
+ * preferred so that the other ones may be released, and with "spread" the one
+ * with the most streams left so that the load is shared. Only the first
+ * REUSE_POLICY_MAX_LOOKUPS connections are compared. Returns NULL if none is
+ * found.
+ */
+static struct connection *conn_backend_get_avail(struct proxy *be, struct eb_root *tree, int64_t hash)
+{
+	struct connection *conn, *best = NULL;
+	int policy = be->options2 & PR_O2_REUSE_POL;
+	int avail, best_avail = 0;
+	int loops;
+
+	conn = srv_lookup_conn(tree, hash);
+	if (!conn || policy == PR_O2_REUSE_FIRST)
+		return conn;
+
+	for (loops = 0; conn && loops < REUSE_POLICY_MAX_LOOKUPS; conn = srv_lookup_conn_next(conn), loops++) {
+		if (!conn->mux)
+			continue;
+
+		avail = conn->mux->avail_streams(conn);
+		if (avail < 1)
+			continue;
+
+		if (!best ||
+		    (policy == PR_O2_REUSE_PACK   && avail < best_avail) ||
+		    (policy == PR_O2_REUSE_SPREAD && avail > best_avail)) {
+			best = conn;
+			best_avail = avail;
+			if (policy == PR_O2_REUSE_PACK && avail == 1)
+				break;
+		}
+	}
+	return best;
+}
+
 /*
  * This function initiates a connection to the server assigned to this stream
  * (s->target, s->si[1].addr.to). It will assign a server if none
@@ -1362,8 +1539,14 @@ int connect_server(struct stream *s)
 		 * Idle conns are necessarily looked up on the same thread so
 		 * that there is no concurrency issues.
 		 */
-		if (!eb_is_empty(&srv->per_thr[tid].avail_conns)) {
-			srv_conn = srv_lookup_conn(&srv->per_thr[tid].avail_conns, hash);
+		const int spread = (s->be->options2 & PR_O2_REUSE_POL) == PR_O2_REUSE_SPREAD;
+
+		/* with the "spread" policy, idle connections have more free
+		 * streams than any available one, so they are tried first.
+		 */
+		if (!eb_is_empty(&srv->per_thr[tid].avail_conns) &&
+		    !(spread && srv->curr_idle_conns > 0)) {
+			srv_conn = conn_backend_get_avail(s->be, &srv->per_thr[tid].avail_conns, hash);
 			if (srv_conn)
 				reuse = 1;
 		}
@@ -1399,6 +1582,12 @@ int connect_server(struct stream *s)
 			if (srv_conn)
 				reuse = 1;
 		}
+
+		if (!srv_conn && spread && !eb_is_empty(&srv->per_thr[tid].avail_conns)) {
+			srv_conn = conn_backend_get_avail(s->be, &srv->per_thr[tid].avail_conns, hash);
+			if (srv_conn)
+				reuse = 1;
+		}
 	}
 
 
@@ -1621,6 +1810,8 @@ int connect_server(struct stream *s)
 			_HA_ATOMIC_INC(&srv->counters.connect);
 	}
 
+	HA_USDT(connect_server, s->uniq_id, s, srv ? srv->puid : 0, s->be->uuid,
+	        !!(s->flags & SF_SRV_REUSED));
 	err = si_connect(&s->si[1], srv_conn);
 	if (err != SF_ERR_NONE)
 		return err;
@@ -1809,7 +2000,7 @@ int srv_redispatch_connect(struct stream *s)
 		return 1;
 
 	case SRV_STATUS_QUEUED:
-		s->si[1].exp = tick_add_ifset(now_ms, s->be->timeout.queue);
+		s->si[1].exp = tick_add_ifset(now_ms, pendconn_timeout(s->be));
 		s->si[1].state = SI_ST_QUE;
 		/* do nothing else and do not wake any other stream up */
 		return 1;
@@ -1939,7 +2130,9 @@ void back_try_conn_req(struct stream *s)
 	}
 	else if (si->state == SI_ST_QUE) {
 		/* connection request was queued, check for any update */
-		if (!pendconn_dequeue(s)) {
+		int ret = pendconn_dequeue(s);
+
+		if (!ret) {
 			/* The connection is not in the queue anymore. Either
 			 * we have a server connection slot available and we
 			 * go directly to the assigned state, or we need to
@@ -1957,8 +2150,8 @@ void back_try_conn_req(struct stream *s)
 		}
 
 		/* Connection request still in queue... */
-		if (si->flags & SI_FL_EXP) {
-			/* ... and timeout expired */
+		if ((si->flags & SI_FL_EXP) || ret < 0) {
+			/* ... and timeout expired, or rejected by queue-codel */
 			si->exp = TICK_ETERNITY;
 			si->flags &= ~SI_FL_EXP;
 			s->logs.t_queue = tv_ms_elapsed(&s->logs.tv_accept, &now);
@@ -2462,6 +2655,8 @@ const char *backend_lb_algo_str(int algo) {
 		return "first";
 	else if (algo == BE_LB_ALGO_LC)
 		return "leastconn";
+	else if (algo == BE_LB_ALGO_EWMA)
+		return "ewma";
 	else if (algo == BE_LB_ALGO_SH)
 		return "source";
 	else if (algo == BE_LB_ALGO_UH)
@@ -2494,9 +2689,13 @@ int backend_parse_balance(const char **args, char **err, struct proxy *curproxy)
 		return 0;
 	}
 
+	curproxy->lbprm.algo &= ~BE_LB_PROP_LOCAL;
+
 	if (strcmp(args[0], "roundrobin") == 0) {
 		curproxy->lbprm.algo &= ~BE_LB_ALGO;
 		curproxy->lbprm.algo |= BE_LB_ALGO_RR;
+		if (strcmp(args[1], "local") == 0)
+			curproxy->lbprm.algo |= BE_LB_PROP_LOCAL;
 	}
 	else if (strcmp(args[0], "static-rr") == 0) {
 		curproxy->lbprm.algo &= ~BE_LB_ALGO;
@@ -2509,29 +2708,34 @@ int backend_parse_balance(const char **args, char **err, struct proxy *curproxy)
 	else if (strcmp(args[0], "leastconn") == 0) {
 		curproxy->lbprm.algo &= ~BE_LB_ALGO;
 		curproxy->lbprm.algo |= BE_LB_ALGO_LC;
+		if (strcmp(args[1], "local") == 0)
+			curproxy->lbprm.algo |= BE_LB_PROP_LOCAL;
 	}
-	else if (!strncmp(args[0], "random", 6)) {
+	else if (!strncmp(args[0], "random", 6) || !strncmp(args[0], "ewma", 4)) {
+		const char *name = (*args[0] == 'r') ? "random" : "ewma";
+		size_t len = strlen(name);
+
 		curproxy->lbprm.algo &= ~BE_LB_ALGO;
-		curproxy->lbprm.algo |= BE_LB_ALGO_RND;
+		curproxy->lbprm.algo |= (*args[0] == 'r') ? BE_LB_ALGO_RND : BE_LB_ALGO_EWMA;
 		curproxy->lbprm.arg_opt1 = 2;
 
-		if (*(args[0] + 6) == '(' && *(args[0] + 7) != ')') { /* number of draws */
+		if (*(args[0] + len) == '(' && *(args[0] + len + 1) != ')') { /* number of draws */
 			const char *beg;
 			char *end;
 
-			beg = args[0] + 7;
+			beg = args[0] + len + 1;
 			curproxy->lbprm.arg_opt1 = strtol(beg, &end, 0);
 
 			if (*end != ')') {
 				if (!*end)
-					memprintf(err, "random : missing closing parenthesis.");
+					memprintf(err, "%s : missing closing parenthesis.", name);
 				else
-					memprintf(err, "random : unexpected character '%c' after argument.", *end);
+					memprintf(err, "%s : unexpected character '%c' after argument.", name, *end);
 				return -1;
 			}
 
 			if (curproxy->lbprm.arg_opt1 < 1) {
-				memprintf(err, "random : number of draws must be at least 1.");
+				memprintf(err, "%s : number of draws must be at least 1.", name);
 				return -1;
 			}
 		}
@@ -2658,7 +2862,7 @@ int backend_parse_balance(const char **args, char **err, struct proxy *curproxy)
 		}
 	}
 	else {
-		memprintf(err, "only supports 'roundrobin', 'static-rr', 'leastconn', 'source', 'uri', 'url_param', 'hdr(name)' and 'rdp-cookie(name)' options.");
+		memprintf(err, "only supports 'roundrobin', 'static-rr', 'leastconn', 'random', 'ewma', 'source', 'uri', 'url_param', 'hdr(name)' and 'rdp-cookie(name)' options.");
 		return -1;
 	}
 	return 0;
@@ -3037,6 +3241,69 @@ smp_fetch_srv_uweight(const struct arg *args, struct sample *smp, const char *kw
 	return 1;
 }
 
+/* returns the timer of the time histograms designated by the first letter
+ * preceding "time_pct" in keyword <kw>: q(ueue), c(onnect), r(esponse) or
+ * t(otal).
+ */
+static enum time_hist_timer smp_time_pct_timer(const char *kw)
+{
+	switch (*(strstr(kw, "time_pct") - 1)) {
+	case 'q': return TIME_HIST_QUEUE;
+	case 'c': return TIME_HIST_CONNECT;
+	case 'r': return TIME_HIST_RESPONSE;
+	default:  return TIME_HIST_TOTAL;
+	}
+}
+
+/* checks that the percentile passed as first argument is between 0 and 100 */
+static int val_time_pct(struct arg *args, char **err)
+{
+	if (args[0].data.sint < 0 || args[0].data.sint > 100) {
+		memprintf(err, "percentile must be between 0 and 100 (got %lld)", args[0].data.sint);
+		return 0;
+	}
+	return 1;
+}
+
+/* set temp integer to the percentile passed as first argument of the queue,
+ * connect, response or total time (depending on the keyword) measured on the
+ * backend passed as optional second argument, or on the stream's backend. The
+ * value is in milliseconds, and is estimated from the backend's histograms.
+ */
+static int
+smp_fetch_be_time_pct(const struct arg *args, struct sample *smp, const char *kw, void *private)
+{
+	struct proxy *px;
+
+	if (args[1].type == ARGT_BE)
+		px = args[1].data.prx;
+	else if (smp->strm)
+		px = smp->strm->be;
+	else if (smp->px->cap & PR_CAP_BE)
+		px = smp->px;
+	else
+		return 0;
+
+	smp->flags = SMP_F_VOL_TEST;
+	smp->data.type = SMP_T_SINT;
+	smp->data.u.sint = time_hist_pct(px->be_counters.hist, smp_time_pct_timer(kw), args[0].data.sint);
+	return 1;
+}
+
+/* set temp integer to the percentile passed as first argument of the queue,
+ * connect, response or total time (depending on the keyword) measured on the
+ * server passed as second argument. The value is in milliseconds, and is
+ * estimated from the server's histograms.
+ */
+static int
+smp_fetch_srv_time_pct(const struct arg *args, struct sample *smp, const char *kw, void *private)
+{
+	smp->flags = SMP_F_VOL_TEST;
+	smp->data.type = SMP_T_SINT;
+	smp->data.u.sint = time_hist_pct(args[1].data.srv->counters.hist, smp_time_pct_timer(kw), args[0].data.sint);
+	return 1;
+}
+
 static int
 smp_fetch_be_server_timeout(const struct arg *args, struct sample *smp, const char *km, void *private)
 {
@@ -3131,21 +3398,29 @@ static struct sample_fetch_kw_list smp_kws = {ILH, {
 	{ "avg_queue",         smp_fetch_avg_queue_size,    ARG1(1,BE),  NULL, SMP_T_SINT, SMP_USE_INTRN, },
 	{ "be_conn",           smp_fetch_be_conn,           ARG1(1,BE),  NULL, SMP_T_SINT, SMP_USE_INTRN, },
 	{ "be_conn_free",      smp_fetch_be_conn_free,      ARG1(1,BE),  NULL, SMP_T_SINT, SMP_USE_INTRN, },
+	{ "be_ctime_pct",      smp_fetch_be_time_pct,       ARG2(1,SINT,BE), val_time_pct, SMP_T_SINT, SMP_USE_INTRN, },
 	{ "be_id",             smp_fetch_be_id,             0,           NULL, SMP_T_SINT, SMP_USE_BKEND, },
 	{ "be_name",           smp_fetch_be_name,           0,           NULL, SMP_T_STR,  SMP_USE_BKEND, },
+	{ "be_qtime_pct",      smp_fetch_be_time_pct,       ARG2(1,SINT,BE), val_time_pct, SMP_T_SINT, SMP_USE_INTRN, },
+	{ "be_rtime_pct",      smp_fetch_be_time_pct,       ARG2(1,SINT,BE), val_time_pct, SMP_T_SINT, SMP_USE_INTRN, },
 	{ "be_server_timeout", smp_fetch_be_server_timeout, 0,           NULL, SMP_T_SINT, SMP_USE_BKEND, },
 	{ "be_sess_rate",      smp_fetch_be_sess_rate,      ARG1(1,BE),  NULL, SMP_T_SINT, SMP_USE_INTRN, },
+	{ "be_ttime_pct",      smp_fetch_be_time_pct,       ARG2(1,SINT,BE), val_time_pct, SMP_T_SINT, SMP_USE_INTRN, },
 	{ "be_tunnel_timeout", smp_fetch_be_tunnel_timeout, 0,           NULL, SMP_T_SINT, SMP_USE_BKEND, },
 	{ "connslots",         smp_fetch_connslots,         ARG1(1,BE),  NULL, SMP_T_SINT, SMP_USE_INTRN, },
 	{ "nbsrv",             smp_fetch_nbsrv,             ARG1(1,BE),  NULL, SMP_T_SINT, SMP_USE_INTRN, },
 	{ "queue",             smp_fetch_queue_size,        ARG1(1,BE),  NULL, SMP_T_SINT, SMP_USE_INTRN, },
 	{ "srv_conn",          smp_fetch_srv_conn,          ARG1(1,SRV), NULL, SMP_T_SINT, SMP_USE_INTRN, },
 	{ "srv_conn_free",     smp_fetch_srv_conn_free,     ARG1(1,SRV), NULL, SMP_T_SINT, SMP_USE_INTRN, },
+	{ "srv_ctime_pct",     smp_fetch_srv_time_pct,      ARG2(2,SINT,SRV), val_time_pct, SMP_T_SINT, SMP_USE_INTRN, },
 	{ "srv_id",            smp_fetch_srv_id,            0,           NULL, SMP_T_SINT, SMP_USE_SERVR, },
 	{ "srv_is_up",         smp_fetch_srv_is_up,         ARG1(1,SRV), NULL, SMP_T_BOOL, SMP_USE_INTRN, },
 	{ "srv_name",          smp_fetch_srv_name,          0,           NULL, SMP_T_STR,  SMP_USE_SERVR, },
+	{ "srv_qtime_pct",     smp_fetch_srv_time_pct,      ARG2(2,SINT,SRV), val_time_pct, SMP_T_SINT, SMP_USE_INTRN, },
 	{ "srv_queue",         smp_fetch_srv_queue,         ARG1(1,SRV), NULL, SMP_T_SINT, SMP_USE_INTRN, },
+	{ "srv_rtime_pct",     smp_fetch_srv_time_pct,      ARG2(2,SINT,SRV), val_time_pct, SMP_T_SINT, SMP_USE_INTRN, },
 	{ "srv_sess_rate",     smp_fetch_srv_sess_rate,     ARG1(1,SRV), NULL, SMP_T_SINT, SMP_USE_INTRN, },
+	{ "srv_ttime_pct",     smp_fetch_srv_time_pct,      ARG2(2,SINT,SRV), val_time_pct, SMP_T_SINT, SMP_USE_INTRN, },
 	{ "srv_weight",        smp_fetch_srv_weight,        ARG1(1,SRV), NULL, SMP_T_SINT, SMP_USE_INTRN, },
 	{ "srv_iweight",       smp_fetch_srv_iweight,       ARG1(1,SRV), NULL, SMP_T_SINT, SMP_USE_INTRN, },
 	{ "srv_uweight",       smp_fetch_srv_uweight,       ARG1(1,SRV), NULL, SMP_T_SINT, SMP_USE_INTRN, },
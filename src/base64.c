@@ -16,6 +16,7 @@
 
 #include <haproxy/api.h>
 #include <haproxy/base64.h>
+#include <haproxy/initcall.h>
 
 #define B64BASE	'#'		/* arbitrary chosen base value */
 #define B64CMIN	'+'
@@ -28,6 +29,61 @@ const char base64rev[]="b###cXYZ[\\]^_`a###d###$%&'()*+,-./0123456789:;<=######>
 const char ubase64tab[65]="ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_";
 const char ubase64rev[]="b##XYZ[\\]^_`a###c###$%&'()*+,-./0123456789:;<=####c#>?@ABCDEFGHIJKLMNOPQRSTUVW";
 
+/* Tables built at boot from the ones above to process the input by larger
+ * units: the encoding ones give the two chars matching each 12-bit value and
+ * the decoding ones give the 6-bit value of each char, B64PADV for the
+ * padding or -1 for invalid chars.
+ */
+static char base64enc2[4096][2];
+static char ubase64enc2[4096][2];
+static signed char base64dec1[256];
+static signed char ubase64dec1[256];
+
+/* Encodes the complete 3-byte groups of <ilen> bytes from <in> to <out> using
+ * the 12-bit table <tab2>. Returns the number of bytes consumed, which is a
+ * multiple of 3, 4 chars being written for each group.
+ */
+static inline size_t base64enc_groups(const char *in, size_t ilen, char *out, char (*tab2)[2])
+{
+	const unsigned char *p = (const unsigned char *)in;
+	size_t done;
+	unsigned int v;
+
+	for (done = 0; done + 3 <= ilen; done += 3) {
+		v = (p[0] << 16) + (p[1] << 8) + p[2];
+		memcpy(out, tab2[v >> 12], 2);
+		memcpy(out + 2, tab2[v & 0xfff], 2);
+		out += 4;
+		p += 3;
+	}
+	return done;
+}
+
+/* Decodes the complete 4-char groups of <ilen> chars from <in> to <out> using
+ * the table <tab1>, until a group contains a padding or an invalid char.
+ * Returns the number of chars consumed, which is a multiple of 4, 3 bytes being
+ * written for each group.
+ */
+static inline size_t base64dec_groups(const char *in, size_t ilen, char *out, const signed char *tab1)
+{
+	const unsigned char *p = (const unsigned char *)in;
+	size_t done;
+	int a, b, c, d;
+
+	for (done = 0; done + 4 <= ilen; done += 4) {
+		a = tab1[p[0]]; b = tab1[p[1]];
+		c = tab1[p[2]]; d = tab1[p[3]];
+		if ((a | b | c | d) & 0xC0)
+			break;
+		out[0] = (a << 2) + (b >> 4);
+		out[1] = (b << 4) + (c >> 2);
+		out[2] = (c << 6) + d;
+		out += 3;
+		p += 4;
+	}
+	return done;
+}
+
 /* Encodes <ilen> bytes from <in> to <out> for at most <olen> chars (including
  * the trailing zero). Returns the number of bytes written. No check is made
  * for <in> or <out> to be NULL. Returns negative value if <olen> is too short
@@ -35,7 +91,7 @@ const char ubase64rev[]="b##XYZ[\\]^_`a###c###$%&'()*+,-./0123456789:;<=####c#>?
  */
 int a2base64(char *in, int ilen, char *out, int olen)
 {
-	int convlen;
+	int convlen, done;
 
 	convlen = ((ilen + 2) / 3) * 4;
 
@@ -43,15 +99,11 @@ int a2base64(char *in, int ilen, char *out, int olen)
 		return -1;
 
 	/* we don't need to check olen anymore */
-	while (ilen >= 3) {
-		out[0] = base64tab[(((unsigned char)in[0]) >> 2)];
-		out[1] = base64tab[(((unsigned char)in[0] & 0x03) << 4) | (((unsigned char)in[1]) >> 4)];
-		out[2] = base64tab[(((unsigned char)in[1] & 0x0F) << 2) | (((unsigned char)in[2]) >> 6)];
-		out[3] = base64tab[(((unsigned char)in[2] & 0x3F))];
-		out += 4;
-		in += 3; ilen -= 3;
-	}
-	
+	done = base64enc_groups(in, ilen, out, base64enc2);
+	out += done / 3 * 4;
+	in += done;
+	ilen -= done;
+
 	if (!ilen) {
 		out[0] = '\0';
 	} else {
@@ -74,6 +126,7 @@ int a2base64(char *in, int ilen, char *out, int olen)
 /* url variant of a2base64 */
 int a2base64url(const char *in, size_t ilen, char *out, size_t olen)
 {
+	size_t done;
 	int convlen;
 
 	convlen = ((ilen + 2) / 3) * 4;
@@ -82,15 +135,10 @@ int a2base64url(const char *in, size_t ilen, char *out, size_t olen)
 		return -1;
 
 	/* we don't need to check olen anymore */
-	while (ilen >= 3) {
-		out[0] = ubase64tab[(((unsigned char)in[0]) >> 2)];
-		out[1] = ubase64tab[(((unsigned char)in[0] & 0x03) << 4) | (((unsigned char)in[1]) >> 4)];
-		out[2] = ubase64tab[(((unsigned char)in[1] & 0x0F) << 2) | (((unsigned char)in[2]) >> 6)];
-		out[3] = ubase64tab[(((unsigned char)in[2] & 0x3F))];
-		out += 4;
-		in += 3;
-		ilen -= 3;
-	}
+	done = base64enc_groups(in, ilen, out, ubase64enc2);
+	out += done / 3 * 4;
+	in += done;
+	ilen -= done;
 
 	if (!ilen) {
 		out[0] = '\0';
@@ -124,6 +172,7 @@ int base64dec(const char *in, size_t ilen, char *out, size_t olen) {
 	unsigned char t[4];
 	signed char b;
 	int convlen = 0, i = 0, pad = 0;
+	size_t done;
 
 	if (ilen % 4)
 		return -1;
@@ -133,6 +182,14 @@ int base64dec(const char *in, size_t ilen, char *out, size_t olen) {
 	            - (in[ilen-2] == '=' ? 1 : 0)))
 		return -2;
 
+	/* decode the groups without padding at once, the remaining ones are
+	 * checked one char at a time below.
+	 */
+	done = base64dec_groups(in, ilen, out, base64dec1);
+	convlen = done / 4 * 3;
+	in += done;
+	ilen -= done;
+
 	while (ilen) {
 
 		/* if (*p < B64CMIN || *p > B64CMAX) */
@@ -190,6 +247,7 @@ int base64urldec(const char *in, size_t ilen, char *out, size_t olen)
 	unsigned char t[4];
 	signed char b;
 	int convlen = 0, i = 0, pad = 0, padlen = 0;
+	size_t done;
 
 	if (olen < ((ilen / 4 * 3)))
 		return -2;
@@ -207,6 +265,12 @@ int base64urldec(const char *in, size_t ilen, char *out, size_t olen)
 			return -1;
 	}
 
+	/* the complete groups are decoded at once */
+	done = base64dec_groups(in, ilen, out, ubase64dec1);
+	convlen = done / 4 * 3;
+	in += done;
+	ilen -= done;
+
 	while (ilen + pad) {
 		if (ilen) {
 			/* if (*p < UB64CMIN || *p > B64CMAX) */
@@ -295,3 +359,28 @@ int b64tos30(const char *in)
 	}
 	return out;
 }
+
+/* builds the tables used to encode and decode base64 by larger units */
+static void base64_init(void)
+{
+	int i, c;
+
+	for (i = 0; i < 4096; i++) {
+		base64enc2[i][0] = base64tab[i >> 6];
+		base64enc2[i][1] = base64tab[i & 0x3F];
+		ubase64enc2[i][0] = ubase64tab[i >> 6];
+		ubase64enc2[i][1] = ubase64tab[i & 0x3F];
+	}
+
+	for (c = 0; c < 256; c++) {
+		base64dec1[c] = -1;
+		if (c >= B64CMIN && c <= B64CMAX)
+			base64dec1[c] = base64rev[c - B64CMIN] - B64BASE - 1;
+
+		ubase64dec1[c] = -1;
+		if (c >= UB64CMIN && c <= B64CMAX)
+			ubase64dec1[c] = ubase64rev[c - UB64CMIN] - B64BASE - 1;
+	}
+}
+
+INITCALL0(STG_PREPARE, base64_init);
@@ -0,0 +1,840 @@
+/*
+ * Micro-benchmarks of the core data structures
+ *
+ * Copyright (C) 2021 HAProxy Technologies
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ *
+ * These benchmarks are only built with USE_BENCH=1, and are run using
+ * "haproxy -dB[<list>]" or "make bench", before any configuration is loaded.
+ * Each measurement is calibrated to last at least BENCH_MIN_DURATION, and
+ * reports the average wall-clock time per operation. When built with
+ * USE_MEMORY_PROFILING, the number of allocations and allocated bytes per
+ * operation are reported as well. The goal is to compare the effect of a
+ * patch on a given primitive, not to provide absolute numbers.
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <import/eb32tree.h>
+#include <import/ist.h>
+#include <haproxy/activity.h>
+#include <haproxy/api.h>
+#include <haproxy/applet-t.h>
+#include <haproxy/bench.h>
+#include <haproxy/bpt32.h>
+#include <haproxy/buf.h>
+#include <haproxy/chunk.h>
+#include <haproxy/global.h>
+#include <haproxy/h1.h>
+#include <haproxy/hpack-dec.h>
+#include <haproxy/hpack-enc.h>
+#include <haproxy/hpack-tbl.h>
+#include <haproxy/http-hdr-t.h>
+#include <haproxy/htx.h>
+#include <haproxy/pattern.h>
+#include <haproxy/pool.h>
+#include <haproxy/ring.h>
+#include <haproxy/sample-t.h>
+#include <haproxy/thread.h>
+#include <haproxy/time.h>
+#include <haproxy/tools.h>
+
+/* a benchmark, running one or several measurements */
+struct bench {
+	const char *name;
+	const char *desc;
+	int (*run)(void);  /* returns 0 on success, non-zero on failure */
+};
+
+/* a few request headers used by the HTX, HPACK and H1 benchmarks */
+static const struct {
+	struct ist n, v;
+} bench_hdrs[] = {
+	{ IST("host"),            IST("www.example.com")                                                  },
+	{ IST("user-agent"),      IST("Mozilla/5.0 (X11; Linux x86_64; rv:91.0) Gecko/20100101 Firefox/91.0") },
+	{ IST("accept"),          IST("text/html,application/xhtml+xml,application/xml;q=0.9,*/*;q=0.8") },
+	{ IST("accept-language"), IST("en-US,en;q=0.5")                                                   },
+	{ IST("accept-encoding"), IST("gzip, deflate, br")                                                },
+	{ IST("referer"),         IST("https://www.example.com/index.html")                               },
+	{ IST("cookie"),          IST("SRVID=s1; session=0123456789abcdef0123456789abcdef")              },
+	{ IST("cache-control"),   IST("max-age=0")                                                        },
+	{ IST("x-forwarded-for"), IST("192.168.1.1")                                                      },
+	{ IST("x-request-id"),    IST("5f2b9c1e-6a1d-4c3b-8e2f-0d9a7b6c5e4f")                             },
+};
+
+#define BENCH_HDRS (sizeof(bench_hdrs) / sizeof(*bench_hdrs))
+
+/* runs <fct>(<ctx>, <loops>) with an increasing number of loops until a run
+ * lasts long enough, then measures a run lasting at least BENCH_MIN_DURATION
+ * and reports the cost per operation under name <name>. <fct> must perform
+ * exactly <loops> operations.
+ */
+static void bench_measure(const char *name, void (*fct)(void *ctx, uint loops), void *ctx)
+{
+	unsigned long long calls = 0, bytes = 0;
+	uint64_t start, duration;
+	uint64_t loops = 1;
+#if USE_MEMORY_PROFILING
+	unsigned long long calls0, bytes0;
+	unsigned int prof;
+#endif
+
+	/* calibration */
+	while (1) {
+		start = now_mono_time();
+		fct(ctx, loops);
+		duration = now_mono_time() - start;
+		if (duration >= BENCH_MIN_DURATION / 10 || loops >= (1U << 30))
+			break;
+		loops *= 2;
+	}
+
+	loops = loops * BENCH_MIN_DURATION / (duration ? duration : 1);
+	if (loops > (1U << 31))
+		loops = 1U << 31;
+	if (!loops)
+		loops = 1;
+
+#if USE_MEMORY_PROFILING
+	prof = profiling;
+	profiling |= HA_PROF_MEMORY;
+	memprof_get_totals(&calls0, &bytes0);
+#endif
+	start = now_mono_time();
+	fct(ctx, loops);
+	duration = now_mono_time() - start;
+#if USE_MEMORY_PROFILING
+	memprof_get_totals(&calls, &bytes);
+	calls -= calls0;
+	bytes -= bytes0;
+	profiling = prof;
+#endif
+
+	printf("%-20s %12llu %10.1f", name, (ullong)loops, (double)duration / loops);
+#if USE_MEMORY_PROFILING
+	printf(" %10.3f %10.1f\n", (double)calls / loops, (double)bytes / loops);
+#else
+	printf(" %10s %10s\n", "-", "-");
+	(void)calls; (void)bytes;
+#endif
+	fflush(stdout);
+}
+
+/******** ebtree ********/
+
+#define BENCH_EB_NODES 100000
+
+struct bench_eb_ctx {
+	struct eb_root root;
+	struct eb32_node *nodes;
+	uint pos;
+};
+
+/* inserts <loops> random keys, restarting from an empty tree every
+ * BENCH_EB_NODES keys.
+ */
+static void bench_eb32_insert(void *arg, uint loops)
+{
+	struct bench_eb_ctx *ctx = arg;
+
+	while (loops--) {
+		if (ctx->pos == BENCH_EB_NODES) {
+			ctx->root = EB_ROOT;
+			ctx->pos = 0;
+		}
+		eb32_insert(&ctx->root, &ctx->nodes[ctx->pos++]);
+	}
+}
+
+/* looks up <loops> existing keys in a tree of BENCH_EB_NODES keys */
+static void bench_eb32_lookup(void *arg, uint loops)
+{
+	struct bench_eb_ctx *ctx = arg;
+
+	while (loops--) {
+		if (ctx->pos == BENCH_EB_NODES)
+			ctx->pos = 0;
+		if (!eb32_lookup(&ctx->root, ctx->nodes[ctx->pos++].key))
+			abort();
+	}
+}
+
+static int bench_ebtree(void)
+{
+	struct bench_eb_ctx ctx = { .root = EB_ROOT };
+	uint i;
+
+	ctx.nodes = calloc(BENCH_EB_NODES, sizeof(*ctx.nodes));
+	if (!ctx.nodes)
+		return 1;
+
+	for (i = 0; i < BENCH_EB_NODES; i++)
+		ctx.nodes[i].key = ha_random32();
+
+	bench_measure("eb32.insert", bench_eb32_insert, &ctx);
+
+	/* the last calibrated run might have left a partial tree */
+	ctx.root = EB_ROOT;
+	for (i = 0; i < BENCH_EB_NODES; i++)
+		eb32_insert(&ctx.root, &ctx.nodes[i]);
+	ctx.pos = 0;
+	bench_measure("eb32.lookup", bench_eb32_lookup, &ctx);
+
+	free(ctx.nodes);
+	return 0;
+}
+
+/******** B+tree vs ebtree ********/
+
+#define BENCH_BPT_KEYS 1000000
+
+struct bench_bpt_ctx {
+	struct eb_root eb_root;
+	struct bpt32_root bpt_root;
+	struct eb32_node *nodes;     /* keys, and nodes for the eb32 tree */
+	uint pos;
+};
+
+/* inserts <loops> random keys into the eb32 tree, restarting from an empty
+ * tree every BENCH_BPT_KEYS keys.
+ */
+static void bench_bpt_eb32_insert(void *arg, uint loops)
+{
+	struct bench_bpt_ctx *ctx = arg;
+
+	while (loops--) {
+		if (ctx->pos == BENCH_BPT_KEYS) {
+			ctx->eb_root = EB_ROOT;
+			ctx->pos = 0;
+		}
+		eb32_insert(&ctx->eb_root, &ctx->nodes[ctx->pos++]);
+	}
+}
+
+/* same with the B+tree */
+static void bench_bpt_bpt32_insert(void *arg, uint loops)
+{
+	struct bench_bpt_ctx *ctx = arg;
+
+	while (loops--) {
+		if (ctx->pos == BENCH_BPT_KEYS) {
+			bpt32_purge(&ctx->bpt_root);
+			ctx->pos = 0;
+		}
+		if (!bpt32_insert(&ctx->bpt_root, ctx->nodes[ctx->pos].key, &ctx->nodes[ctx->pos]))
+			abort();
+		ctx->pos++;
+	}
+}
+
+/* looks up <loops> existing keys in the eb32 tree, in random order */
+static void bench_bpt_eb32_lookup(void *arg, uint loops)
+{
+	struct bench_bpt_ctx *ctx = arg;
+
+	while (loops--) {
+		if (ctx->pos == BENCH_BPT_KEYS)
+			ctx->pos = 0;
+		if (!eb32_lookup(&ctx->eb_root, ctx->nodes[ctx->pos++].key))
+			abort();
+	}
+}
+
+/* same with the B+tree */
+static void bench_bpt_bpt32_lookup(void *arg, uint loops)
+{
+	struct bench_bpt_ctx *ctx = arg;
+
+	while (loops--) {
+		if (ctx->pos == BENCH_BPT_KEYS)
+			ctx->pos = 0;
+		if (!bpt32_lookup(&ctx->bpt_root, ctx->nodes[ctx->pos++].key))
+			abort();
+	}
+}
+
+/* checks that the B+tree contains exactly the keys of the eb32 tree, in the
+ * same order, then deletes them all. Returns 0 if OK.
+ */
+static int bench_bpt_check(struct bench_bpt_ctx *ctx)
+{
+	struct eb32_node *eb;
+	struct bpt32_pos pos;
+	void *val;
+	uint i;
+
+	eb = eb32_first(&ctx->eb_root);
+	for (val = bpt32_first(&ctx->bpt_root, &pos); val; val = bpt32_next(&pos)) {
+		/* skip duplicates, the B+tree only stores the first one */
+		while (eb && eb->key != pos.key)
+			eb = eb32_next(eb);
+		if (!eb)
+			return 1;
+		eb = eb32_next(eb);
+	}
+
+	for (i = 0; i < BENCH_BPT_KEYS; i++) {
+		val = bpt32_delete(&ctx->bpt_root, ctx->nodes[i].key);
+		if (val && ((struct eb32_node *)val)->key != ctx->nodes[i].key)
+			return 1;
+		if (bpt32_lookup(&ctx->bpt_root, ctx->nodes[i].key))
+			return 1;
+	}
+	return ctx->bpt_root.count || ctx->bpt_root.node;
+}
+
+static int bench_bptree(void)
+{
+	struct bench_bpt_ctx ctx = { .eb_root = EB_ROOT, .bpt_root = BPT32_ROOT };
+	uint i;
+	int err;
+
+	ctx.nodes = calloc(BENCH_BPT_KEYS, sizeof(*ctx.nodes));
+	if (!ctx.nodes)
+		return 1;
+
+	for (i = 0; i < BENCH_BPT_KEYS; i++)
+		ctx.nodes[i].key = ha_random32();
+
+	bench_measure("eb32.insert(1M)", bench_bpt_eb32_insert, &ctx);
+	ctx.pos = 0;
+	bench_measure("bpt32.insert(1M)", bench_bpt_bpt32_insert, &ctx);
+
+	/* the last calibrated runs might have left partial trees */
+	ctx.eb_root = EB_ROOT;
+	bpt32_purge(&ctx.bpt_root);
+	for (i = 0; i < BENCH_BPT_KEYS; i++) {
+		eb32_insert(&ctx.eb_root, &ctx.nodes[i]);
+		if (!bpt32_insert(&ctx.bpt_root, ctx.nodes[i].key, &ctx.nodes[i]))
+			abort();
+	}
+
+	ctx.pos = 0;
+	bench_measure("eb32.lookup(1M)", bench_bpt_eb32_lookup, &ctx);
+	ctx.pos = 0;
+	bench_measure("bpt32.lookup(1M)", bench_bpt_bpt32_lookup, &ctx);
+
+	err = bench_bpt_check(&ctx);
+	if (err)
+		fprintf(stderr, "bpt32: tree contents differ from eb32\n");
+
+	bpt32_purge(&ctx.bpt_root);
+	free(ctx.nodes);
+	return err;
+}
+
+/******** pools ********/
+
+#define BENCH_POOL_BATCH 64
+
+/* objects handed over by a thread to the next one */
+struct bench_mbox {
+	void *obj[BENCH_POOL_BATCH];
+	int full;
+} THREAD_ALIGNED(64);
+
+struct bench_pool_ctx {
+	struct pool_head *pool;
+	int threads;                 /* number of threads for the MT test */
+	uint loops;                  /* loops per thread for the MT test */
+	int started;                 /* number of threads started */
+	int running;                 /* number of threads not done with the run */
+	int idle;                    /* number of threads waiting for a run */
+	int gen;                     /* incremented to start a run */
+	int stop;                    /* set to stop the threads */
+	struct bench_mbox mbox[BENCH_MAX_THREADS];
+};
+
+/* allocates then releases <loops> objects from the current thread, by batches
+ * of BENCH_POOL_BATCH objects.
+ */
+static void bench_pools_local(void *arg, uint loops)
+{
+	struct bench_pool_ctx *ctx = arg;
+	void *obj[BENCH_POOL_BATCH];
+	uint i, batch;
+
+	while (loops) {
+		batch = MIN(loops, BENCH_POOL_BATCH);
+		for (i = 0; i < batch; i++)
+			obj[i] = pool_alloc(ctx->pool);
+		for (i = 0; i < batch; i++)
+			pool_free(ctx->pool, obj[i]);
+		loops -= batch;
+	}
+}
+
+#ifdef USE_THREAD
+/* releases the objects handed over to the current thread, if any */
+static void bench_pools_drain(struct bench_pool_ctx *ctx, struct bench_mbox *mbox)
+{
+	int i;
+
+	if (!HA_ATOMIC_LOAD(&mbox->full))
+		return;
+
+	__ha_barrier_load();
+	for (i = 0; i < BENCH_POOL_BATCH; i++)
+		pool_free(ctx->pool, mbox->obj[i]);
+	HA_ATOMIC_STORE(&mbox->full, 0);
+}
+
+/* Worker thread for the cross-thread test. It allocates objects by batches
+ * and hands them over to the next thread which releases them, so that objects
+ * are always released by a different thread than the one which allocated them.
+ * Workers are started once for all runs, because the pools' per-thread caches
+ * are accounted in thread-local variables, and they use thread numbers 1 and
+ * above so as not to share the main thread's caches.
+ */
+static void *bench_pools_thread(void *arg)
+{
+	struct bench_pool_ctx *ctx = arg;
+	struct bench_mbox *mine, *next;
+	void *obj[BENCH_POOL_BATCH];
+	uint done;
+	int thr, gen, i;
+
+	thr = HA_ATOMIC_FETCH_ADD(&ctx->started, 1);
+	ha_set_tid(thr + 1);
+	mine = &ctx->mbox[thr];
+	next = &ctx->mbox[(thr + 1) % ctx->threads];
+	gen = 0;
+
+	while (1) {
+		/* wait for the next run */
+		while (HA_ATOMIC_LOAD(&ctx->gen) == gen)
+			ha_thread_relax();
+		gen = HA_ATOMIC_LOAD(&ctx->gen);
+		if (HA_ATOMIC_LOAD(&ctx->stop))
+			break;
+
+		for (done = 0; done < ctx->loops; done += BENCH_POOL_BATCH) {
+			for (i = 0; i < BENCH_POOL_BATCH; i++)
+				obj[i] = pool_alloc(ctx->pool);
+
+			while (HA_ATOMIC_LOAD(&next->full)) {
+				bench_pools_drain(ctx, mine);
+				ha_thread_relax();
+			}
+			memcpy(next->obj, obj, sizeof(obj));
+			__ha_barrier_store();
+			HA_ATOMIC_STORE(&next->full, 1);
+			bench_pools_drain(ctx, mine);
+		}
+
+		/* the previous thread may still hand us some objects */
+		HA_ATOMIC_SUB(&ctx->running, 1);
+		while (HA_ATOMIC_LOAD(&ctx->running) || HA_ATOMIC_LOAD(&mine->full)) {
+			bench_pools_drain(ctx, mine);
+			ha_thread_relax();
+		}
+		HA_ATOMIC_ADD(&ctx->idle, 1);
+	}
+	return NULL;
+}
+
+/* performs <loops> cross-thread allocations and releases spread over all
+ * worker threads.
+ */
+static void bench_pools_shared(void *arg, uint loops)
+{
+	struct bench_pool_ctx *ctx = arg;
+
+	ctx->loops = (loops + ctx->threads - 1) / ctx->threads;
+	ctx->running = ctx->threads;
+	ctx->idle = 0;
+	HA_ATOMIC_ADD(&ctx->gen, 1);
+	while (HA_ATOMIC_LOAD(&ctx->idle) < ctx->threads)
+		ha_thread_relax();
+}
+#endif
+
+static int bench_pools(void)
+{
+#ifdef USE_THREAD
+	pthread_t threads[BENCH_MAX_THREADS];
+	char name[32];
+	int thr;
+#endif
+	struct bench_pool_ctx *ctx;
+	int err = 0;
+
+	ctx = calloc(1, sizeof(*ctx));
+	if (!ctx)
+		return 1;
+
+	ctx->pool = create_pool("bench", 64, MEM_F_SHARED);
+	if (!ctx->pool) {
+		free(ctx);
+		return 1;
+	}
+
+	bench_measure("pool.local", bench_pools_local, ctx);
+
+#ifdef USE_THREAD
+	ctx->threads = sysconf(_SC_NPROCESSORS_ONLN);
+	ctx->threads = MAX(ctx->threads, 2);
+	ctx->threads = MIN(ctx->threads, MIN(BENCH_MAX_THREADS, MAX_THREADS - 1));
+	for (thr = 0; thr < ctx->threads; thr++) {
+		if (pthread_create(&threads[thr], NULL, bench_pools_thread, ctx) != 0)
+			break;
+	}
+
+	if (thr == ctx->threads) {
+		snprintf(name, sizeof(name), "pool.cross(%d)", ctx->threads);
+		bench_measure(name, bench_pools_shared, ctx);
+	}
+	else
+		err = 1;
+
+	HA_ATOMIC_STORE(&ctx->stop, 1);
+	HA_ATOMIC_ADD(&ctx->gen, 1);
+	while (thr--)
+		pthread_join(threads[thr], NULL);
+#endif
+	free(ctx);
+	return err;
+}
+
+/******** HTX ********/
+
+struct bench_htx_ctx {
+	struct htx *src, *dst;
+};
+
+/* builds a request made of a start line, BENCH_HDRS headers and an
+ * end-of-headers, then transfers it to another HTX message.
+ */
+static void bench_htx_build_xfer(void *arg, uint loops)
+{
+	struct bench_htx_ctx *ctx = arg;
+	struct htx_ret ret;
+	uint i;
+
+	while (loops--) {
+		htx_reset(ctx->src);
+		htx_reset(ctx->dst);
+		if (!htx_add_stline(ctx->src, HTX_BLK_REQ_SL, HTX_SL_F_VER_11,
+		                    ist("GET"), ist("/path/to/resource?arg=value"), ist("HTTP/1.1")))
+			abort();
+		for (i = 0; i < BENCH_HDRS; i++) {
+			if (!htx_add_header(ctx->src, bench_hdrs[i].n, bench_hdrs[i].v))
+				abort();
+		}
+		if (!htx_add_endof(ctx->src, HTX_BLK_EOH))
+			abort();
+		ret = htx_xfer_blks(ctx->dst, ctx->src, htx_used_space(ctx->src), HTX_BLK_UNUSED);
+		if (!ret.ret)
+			abort();
+	}
+}
+
+static int bench_htx(void)
+{
+	struct bench_htx_ctx ctx;
+	struct buffer src, dst;
+
+	src = b_make(malloc(global.tune.bufsize), global.tune.bufsize, 0, 0);
+	dst = b_make(malloc(global.tune.bufsize), global.tune.bufsize, 0, 0);
+	if (!src.area || !dst.area) {
+		free(src.area);
+		free(dst.area);
+		return 1;
+	}
+
+	ctx.src = htx_from_buf(&src);
+	ctx.dst = htx_from_buf(&dst);
+	bench_measure("htx.add+xfer", bench_htx_build_xfer, &ctx);
+
+	free(src.area);
+	free(dst.area);
+	return 0;
+}
+
+/******** HPACK ********/
+
+struct bench_hpack_ctx {
+	struct buffer out;           /* encoded headers block */
+	struct hpack_dht *dht;       /* decoder's dynamic headers table */
+	struct http_hdr list[MAX_HTTP_HDR];
+};
+
+/* encodes BENCH_HDRS headers into a headers block, <loops> times */
+static void bench_hpack_encode(void *arg, uint loops)
+{
+	struct bench_hpack_ctx *ctx = arg;
+	uint i;
+
+	while (loops--) {
+		b_reset(&ctx->out);
+		for (i = 0; i < BENCH_HDRS; i++) {
+			if (!hpack_encode_header(&ctx->out, bench_hdrs[i].n, bench_hdrs[i].v))
+				abort();
+		}
+	}
+}
+
+/* decodes the headers block built by the encoder, <loops> times */
+static void bench_hpack_decode(void *arg, uint loops)
+{
+	struct bench_hpack_ctx *ctx = arg;
+	struct buffer *tmp;
+
+	while (loops--) {
+		tmp = get_trash_chunk();
+		if (hpack_decode_frame(ctx->dht, (const uint8_t *)b_head(&ctx->out), b_data(&ctx->out),
+		                       ctx->list, sizeof(ctx->list) / sizeof(ctx->list[0]), tmp) <= 0)
+			abort();
+	}
+}
+
+static int bench_hpack(void)
+{
+	struct bench_hpack_ctx ctx;
+
+	ctx.out = b_make(malloc(global.tune.bufsize), global.tune.bufsize, 0, 0);
+	ctx.dht = malloc(4096);
+	if (!ctx.out.area || !ctx.dht) {
+		free(ctx.out.area);
+		free(ctx.dht);
+		return 1;
+	}
+	hpack_dht_init(ctx.dht, 4096);
+
+	bench_measure("hpack.encode", bench_hpack_encode, &ctx);
+	bench_measure("hpack.decode", bench_hpack_decode, &ctx);
+
+	free(ctx.out.area);
+	free(ctx.dht);
+	return 0;
+}
+
+/******** H1 ********/
+
+struct bench_h1_ctx {
+	struct buffer req;
+	struct http_hdr list[MAX_HTTP_HDR];
+};
+
+/* parses an HTTP/1 request made of BENCH_HDRS headers, <loops> times */
+static void bench_h1_parse(void *arg, uint loops)
+{
+	struct bench_h1_ctx *ctx = arg;
+	union h1_sl sl;
+	struct h1m h1m;
+
+	while (loops--) {
+		h1m_init_req(&h1m);
+		if (h1_headers_to_hdr_list(b_head(&ctx->req), b_tail(&ctx->req),
+		                           ctx->list, sizeof(ctx->list) / sizeof(ctx->list[0]),
+		                           &h1m, &sl) <= 0)
+			abort();
+	}
+}
+
+static int bench_h1(void)
+{
+	struct bench_h1_ctx ctx;
+	uint i;
+
+	chunk_init(&ctx.req, malloc(global.tune.bufsize), global.tune.bufsize);
+	if (!ctx.req.area)
+		return 1;
+
+	chunk_strcat(&ctx.req, "GET /path/to/resource?arg=value HTTP/1.1\r\n");
+	for (i = 0; i < BENCH_HDRS; i++)
+		chunk_appendf(&ctx.req, "%.*s: %.*s\r\n",
+		              (int)bench_hdrs[i].n.len, bench_hdrs[i].n.ptr,
+		              (int)bench_hdrs[i].v.len, bench_hdrs[i].v.ptr);
+	chunk_strcat(&ctx.req, "\r\n");
+
+	bench_measure("h1.parse", bench_h1_parse, &ctx);
+
+	free(ctx.req.area);
+	return 0;
+}
+
+/******** patterns ********/
+
+#define BENCH_PAT_ENTRIES 10000
+
+struct bench_pat_ctx {
+	struct pattern_head head;
+	char str[64];                /* sample's storage */
+	uint len;
+	int expect_match;
+};
+
+/* matches the sample against the patterns, <loops> times */
+static void bench_pattern_match(void *arg, uint loops)
+{
+	struct bench_pat_ctx *ctx = arg;
+	struct sample smp;
+
+	while (loops--) {
+		memset(&smp, 0, sizeof(smp));
+		smp.data.type = SMP_T_STR;
+		smp.data.u.str.area = ctx->str;
+		smp.data.u.str.data = ctx->len;
+		smp.data.u.str.size = sizeof(ctx->str);
+		if (!pattern_exec_match(&ctx->head, &smp, 0) != !ctx->expect_match)
+			abort();
+	}
+}
+
+/* loads BENCH_PAT_ENTRIES patterns using the match method <match> into a new
+ * pattern head, and measures the lookup of <str>.
+ */
+static int bench_pattern_one(const char *name, int match, const char *str, int expect_match)
+{
+	struct bench_pat_ctx *ctx;
+	struct pat_ref *ref;
+	char *err = NULL;
+	char pat[64];
+	uint i;
+
+	ctx = calloc(1, sizeof(*ctx));
+	if (!ctx)
+		return 1;
+
+	pattern_init_head(&ctx->head);
+	ctx->head.parse       = pat_parse_fcts[match];
+	ctx->head.index       = pat_index_fcts[match];
+	ctx->head.match       = pat_match_fcts[match];
+	ctx->head.prune       = pat_prune_fcts[match];
+	ctx->head.expect_type = pat_match_types[match];
+
+	ref = pat_ref_new(name, NULL, PAT_REF_ACL);
+	if (!ref || !pattern_new_expr(&ctx->head, ref, 0, &err, NULL))
+		goto fail;
+
+	for (i = 0; i < BENCH_PAT_ENTRIES; i++) {
+		snprintf(pat, sizeof(pat), "/static/img/%08x/%u.png", ha_random32(), i);
+		if (!pat_ref_add(ref, pat, NULL, &err))
+			goto fail;
+	}
+
+	ctx->len = snprintf(ctx->str, sizeof(ctx->str), "%s", str);
+	ctx->expect_match = expect_match;
+	bench_measure(name, bench_pattern_match, ctx);
+	free(ctx);
+	return 0;
+ fail:
+	fprintf(stderr, "%s: %s\n", name, err ? err : "out of memory");
+	free(err);
+	free(ctx);
+	return 1;
+}
+
+static int bench_pattern(void)
+{
+	/* exact match, indexed in a tree */
+	if (bench_pattern_one("pattern.str", PAT_MATCH_STR, "/static/img/00000000/unknown/path/to/image.png", 0))
+		return 1;
+
+	/* substring match against the whole list */
+	if (bench_pattern_one("pattern.sub", PAT_MATCH_SUB, "/static/img/00000000/unknown/path/to/image.png", 0))
+		return 1;
+	return 0;
+}
+
+/******** rings ********/
+
+/* writes a 100-byte message into a ring, <loops> times */
+static void bench_ring_write(void *arg, uint loops)
+{
+	static const char msg[100] = "<134>Sep 12 10:00:00 haproxy[1234]: 127.0.0.1:12345 fe be/srv 0/0/0/1/1 200 1234";
+	struct ring *ring = arg;
+	struct ist ist = ist2(msg, sizeof(msg));
+
+	while (loops--) {
+		if (ring_write(ring, ~0, NULL, 0, &ist, 1) <= 0)
+			abort();
+	}
+}
+
+static int bench_ring(void)
+{
+	struct ring *ring;
+
+	ring = ring_new(1024 * 1024);
+	if (!ring)
+		return 1;
+
+	bench_measure("ring.write", bench_ring_write, ring);
+	ring_free(ring);
+	return 0;
+}
+
+static const struct bench benchs[] = {
+	{ "ebtree",  "eb32 tree insertion and lookup of random keys",            bench_ebtree  },
+	{ "bptree",  "B+tree vs eb32 tree insertion and lookup of 1M random keys", bench_bptree },
+	{ "pools",   "pool allocations and releases, local and across threads",  bench_pools   },
+	{ "htx",     "HTX request building and transfer between messages",       bench_htx     },
+	{ "hpack",   "HPACK encoding and decoding of a request's headers",       bench_hpack   },
+	{ "h1",      "HTTP/1 request headers parsing",                           bench_h1      },
+	{ "pattern", "pattern matching against large lists",                     bench_pattern },
+	{ "ring",    "message writes into a ring",                               bench_ring    },
+	{ NULL }
+};
+
+/* runs the benchmarks from the comma-delimited list <list>, or all of them if
+ * <list> is empty or "all". Returns the process' exit status.
+ */
+int bench_run(const char *list)
+{
+	const struct bench *b;
+	const char *p;
+	size_t len;
+	int err = 0;
+
+	if (*list && strcmp(list, "all") != 0) {
+		/* check the names first */
+		for (p = list; *p; p += len + !!p[len]) {
+			len = strcspn(p, ",");
+			for (b = benchs; b->name; b++)
+				if (strlen(b->name) == len && strncmp(b->name, p, len) == 0)
+					break;
+			if (!b->name) {
+				fprintf(stderr, "Unknown benchmark '%.*s'. Supported benchmarks:\n", (int)len, p);
+				for (b = benchs; b->name; b++)
+					fprintf(stderr, "  %-8s : %s\n", b->name, b->desc);
+				return 1;
+			}
+		}
+	}
+
+	printf("%-20s %12s %10s %10s %10s\n", "# test", "loops", "ns/op", "allocs/op", "bytes/op");
+	for (b = benchs; b->name; b++) {
+		if (*list && strcmp(list, "all") != 0) {
+			for (p = list; *p; p += len + !!p[len]) {
+				len = strcspn(p, ",");
+				if (strlen(b->name) == len && strncmp(b->name, p, len) == 0)
+					break;
+			}
+			if (!*p)
+				continue;
+		}
+
+		if (b->run() != 0) {
+			fprintf(stderr, "Benchmark '%s' failed.\n", b->name);
+			err = 1;
+		}
+	}
+	return err;
+}
+
+/*
+ * Local variables:
+ *  c-indent-level: 8
+ *  c-basic-offset: 8
+ * End:
+ */
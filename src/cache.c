@@ -10,11 +10,19 @@
  * 2 of the License, or (at your option) any later version.
  */
 
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
 #include <import/eb32tree.h>
 #include <import/sha1.h>
 
 #include <haproxy/action-t.h>
 #include <haproxy/api.h>
+#include <haproxy/applet.h>
+#include <haproxy/backend.h>
 #include <haproxy/cfgparse.h>
 #include <haproxy/channel.h>
 #include <haproxy/cli.h>
@@ -29,10 +37,13 @@
 #include <haproxy/net_helper.h>
 #include <haproxy/proxy.h>
 #include <haproxy/sample.h>
+#include <haproxy/session.h>
 #include <haproxy/shctx.h>
 #include <haproxy/stream.h>
 #include <haproxy/stream_interface.h>
 #include <haproxy/tools.h>
+#include <haproxy/usdt.h>
+#include <haproxy/version.h>
 
 #define CACHE_FLT_F_IMPLICIT_DECL  0x00000001 /* The cache filtre was implicitly declared (ie without
 					       * the filter keyword) */
@@ -41,20 +52,46 @@
 const char *cache_store_flt_id = "cache store filter";
 
 extern struct applet http_cache_applet;
+extern struct applet http_cache_refresh_applet;
 
 struct flt_ops cache_ops;
 
 struct cache {
 	struct list list;        /* cache linked list */
-	struct eb_root entries;  /* head of cache entries based on keys */
 	unsigned int maxage;     /* max-age */
 	unsigned int maxblocks;
 	unsigned int maxobjsz;   /* max-object-size (in bytes) */
 	unsigned int max_secondary_entries;  /* maximum number of secondary entries with the same primary hash */
 	uint8_t vary_processing_enabled;     /* boolean : manage Vary header (disabled by default) */
+	uint8_t direct_hits;                 /* boolean : deliver hits without the applet when possible (disabled by default) */
+	unsigned int collapse_timeout;       /* collapse-timeout (in ms), 0 if disabled */
+	unsigned int refresh_ahead;          /* refresh-ahead (in seconds), 0 if disabled */
+	unsigned int inflight_seq;           /* last identifier given to a placeholder or a refresh */
+	unsigned int nb_shards;  /* number of shards the cache is split into */
+	struct cache_shard **shards;         /* shards, indexed by cache_shard_idx() */
+	char *file_path;         /* file-store path, NULL if not set */
+	unsigned long long file_size;        /* size of the file store (in bytes) */
+	unsigned int file_minobjsz;          /* file-min-object-size (in bytes) */
+	unsigned int file_maxobjsz;          /* largest payload stored in the file (in bytes) */
+	char *persist_path;      /* persist-file path, NULL if not set */
 	char id[33];             /* cache name */
 };
 
+/* A cache is split into shards which each own a part of the blocks, with its
+ * own shctx (hence its own LRU and lock) and its own tree of entries. An entry
+ * always lives in the shard designated by its hash, so that accesses to
+ * different objects do not contend on the same lock. The shard is stored in
+ * the extra area of its shctx, and owns an equal slice of the file store.
+ */
+struct cache_shard {
+	struct eb_root entries;  /* head of cache entries based on keys */
+	struct list waiters;     /* cache_st of the streams waiting for an object in flight */
+	struct cache *cache;     /* the cache this shard belongs to */
+	char *file_area;         /* slice of the file store mapping, NULL if not used */
+	unsigned long long file_size;        /* size of the slice (in bytes) */
+	unsigned long long file_head;        /* absolute write position in the slice */
+};
+
 /* cache config for filters */
 struct cache_flt_conf {
 	union {
@@ -129,6 +166,14 @@ const struct vary_hashing_information vary_information[] = {
  */
 struct cache_st {
 	struct shared_block *first_block;
+	struct cache_shard *shard; /* shard of the entry being stored or waited for */
+	unsigned int file_written; /* payload bytes already copied to the file store */
+	struct list wait_el;       /* element in the shard's waiters list */
+	struct task *wait_task;    /* task to wake up once the object is stored */
+	unsigned int wait_key;     /* primary key of the object waited for */
+	int wait_exp;              /* date after which we stop waiting, TICK_ETERNITY if we never waited */
+	unsigned int inflight;     /* identifier of the placeholder owned by the stream, 0 if none */
+	char inflight_hash[20];    /* primary hash of this placeholder */
 };
 
 #define DEFAULT_MAX_SECONDARY_ENTRY 10
@@ -158,6 +203,20 @@ struct cache_entry {
 			       * be used in case of an "If-Modified-Since"-based
 			       * conditional request. */
 
+	unsigned long long file_pos; /* absolute position of the payload in the file store */
+	unsigned int file_len;    /* payload length in the file store, 0 if the payload is in the shctx */
+
+	unsigned int inflight;    /* Non-zero for the placeholder of an object being fetched, which is
+				   * never complete: it only makes other requests wait for the object. */
+
+	unsigned int stale_revalidate; /* seconds after expiration during which the object may be
+					* delivered while it is refreshed (stale-while-revalidate) */
+	unsigned int stale_error; /* seconds after expiration during which the object may be delivered
+				   * if the server fails (stale-if-error) */
+	unsigned int refresh;     /* identifier of the background refresh in progress, 0 if none */
+	unsigned int refresh_failed; /* date of the last server error for this object, 0 if none */
+	unsigned int body_len;    /* length of the payload, used to deliver byte ranges */
+
 	unsigned char data[0];
 };
 
@@ -170,15 +229,84 @@ static struct cache *tmp_cache_config = NULL;
 
 DECLARE_STATIC_POOL(pool_head_cache_st, "cache_st", sizeof(struct cache_st));
 
-static struct eb32_node *insert_entry(struct cache *cache, struct cache_entry *new_entry);
+static struct eb32_node *insert_entry(struct cache_shard *shard, struct cache_entry *new_entry);
 static void delete_entry(struct cache_entry *del_entry);
 
-struct cache_entry *entry_exist(struct cache *cache, char *hash)
+/* Returns the shard of <cache> holding the entries of primary hash <hash>. The
+ * bytes used as the tree key are not used here, so that the keys remain well
+ * distributed in each tree.
+ */
+static inline struct cache_shard *cache_shard_ptr(struct cache *cache, const char *hash)
+{
+	return cache->shards[read_u32(hash + 4) % cache->nb_shards];
+}
+
+static inline struct shared_context *shctx_ptr(struct cache_shard *shard)
+{
+	return (struct shared_context *)((unsigned char *)shard - ((struct shared_context *)NULL)->data);
+}
+
+static inline struct shared_block *block_ptr(struct cache_entry *entry)
+{
+	return (struct shared_block *)((unsigned char *)entry - ((struct shared_block *)NULL)->data);
+}
+
+/* Reserves <len> contiguous bytes in the file store of <shard> and returns the
+ * absolute position of the area. An area never wraps at the end of the file,
+ * the remaining room is skipped instead. The data of older entries located in
+ * this area are lost, which cache_file_entry_valid() will report. Must be
+ * called with the shctx lock held.
+ */
+static unsigned long long cache_file_reserve(struct cache_shard *shard, unsigned int len)
+{
+	unsigned long long pos = shard->file_head;
+
+	if (pos % shard->file_size + len > shard->file_size)
+		pos += shard->file_size - pos % shard->file_size;
+	HA_ATOMIC_STORE(&shard->file_head, pos + len);
+	/* the new head must be visible before we start to overwrite the area */
+	__ha_barrier_store();
+	return pos;
+}
+
+/* Returns non-zero if the payload of <entry> stored in the file store of
+ * <shard> was not overwritten yet. Readers must check it after having copied
+ * the data, as the area may be reused at any time once the lock is released.
+ */
+static inline int cache_file_entry_valid(struct cache_shard *shard, const struct cache_entry *entry)
+{
+	return HA_ATOMIC_LOAD(&shard->file_head) <= entry->file_pos + shard->file_size;
+}
+
+/* Returns the date after which entry <entry> may not be delivered anymore, even
+ * stale, hence when it may be removed.
+ */
+static inline unsigned int cache_entry_end(const struct cache_entry *entry)
+{
+	return entry->expire + MAX(entry->stale_revalidate, entry->stale_error);
+}
+
+/* Wakes up the streams waiting for an object of primary key <key> in <shard>.
+ * They will look it up again. Must be called with the shctx lock held.
+ */
+static void cache_wakeup_waiters(struct cache_shard *shard, unsigned int key)
+{
+	struct cache_st *st, *back;
+
+	list_for_each_entry_safe(st, back, &shard->waiters, wait_el) {
+		if (st->wait_key != key)
+			continue;
+		LIST_DEL_INIT(&st->wait_el);
+		task_wakeup(st->wait_task, TASK_WOKEN_MSG);
+	}
+}
+
+struct cache_entry *entry_exist(struct cache_shard *shard, char *hash)
 {
 	struct eb32_node *node;
 	struct cache_entry *entry;
 
-	node = eb32_lookup(&cache->entries, read_u32(hash));
+	node = eb32_lookup(&shard->entries, read_u32(hash));
 	if (!node)
 		return NULL;
 
@@ -188,7 +316,8 @@ struct cache_entry *entry_exist(struct cache *cache, char *hash)
 	if (memcmp(entry->hash, hash, sizeof(entry->hash)))
 		return NULL;
 
-	if (entry->expire > now.tv_sec) {
+	if (cache_entry_end(entry) > now.tv_sec &&
+	    (!entry->file_len || cache_file_entry_valid(shard, entry))) {
 		return entry;
 	} else {
 		delete_entry(entry);
@@ -198,6 +327,21 @@ struct cache_entry *entry_exist(struct cache *cache, char *hash)
 
 }
 
+/* Removes the placeholder of primary hash <hash> from <shard> if any, and wakes
+ * up the streams waiting for it. If <id> is not null, the placeholder is only
+ * removed if it has this identifier. Must be called with the shctx lock held.
+ */
+static void cache_drop_inflight(struct cache_shard *shard, char *hash, unsigned int id)
+{
+	struct cache_entry *entry = entry_exist(shard, hash);
+
+	if (!entry || !entry->inflight || (id && entry->inflight != id))
+		return;
+	delete_entry(entry);
+	entry->eb.key = 0;
+	cache_wakeup_waiters(shard, read_u32(hash));
+}
+
 
 /*
  * Compare a newly built secondary key to the one found in a cache_entry.
@@ -234,7 +378,7 @@ static int secondary_key_cmp(const char *ref_key, const char *new_key)
  * until it finds the right one.
  * Returns the cache_entry in case of success, NULL otherwise.
  */
-struct cache_entry *secondary_entry_exist(struct cache *cache, struct cache_entry *entry,
+struct cache_entry *secondary_entry_exist(struct cache_shard *shard, struct cache_entry *entry,
 					  const char *secondary_key)
 {
 	struct eb32_node *node = &entry->eb;
@@ -249,7 +393,7 @@ struct cache_entry *secondary_entry_exist(struct cache *cache, struct cache_entr
 		 * when we find them. Calling delete_entry would be too costly
 		 * so we simply call eb32_delete. The secondary_entry count will
 		 * be updated when we try to insert a new entry to this list. */
-		if (entry->expire <= now.tv_sec) {
+		if (cache_entry_end(entry) <= now.tv_sec) {
 			eb32_delete(&entry->eb);
 			entry->eb.key = 0;
 		}
@@ -257,8 +401,9 @@ struct cache_entry *secondary_entry_exist(struct cache *cache, struct cache_entr
 		entry = node ? eb32_entry(node, struct cache_entry, eb) : NULL;
 	}
 
-	/* Expired entry */
-	if (entry && entry->expire <= now.tv_sec) {
+	/* Expired entry or overwritten payload */
+	if (entry && (cache_entry_end(entry) <= now.tv_sec ||
+		      (entry->file_len && !cache_file_entry_valid(shard, entry)))) {
 		eb32_delete(&entry->eb);
 		entry->eb.key = 0;
 		entry = NULL;
@@ -283,7 +428,7 @@ static unsigned int clear_expired_duplicates(struct eb32_node **dup_tail)
 	while (prev) {
 		entry = container_of(prev, struct cache_entry, eb);
 		prev = eb32_prev_dup(prev);
-		if (entry->expire <= now.tv_sec) {
+		if (cache_entry_end(entry) <= now.tv_sec) {
 			eb32_delete(&entry->eb);
 			entry->eb.key = 0;
 		}
@@ -310,14 +455,15 @@ static unsigned int clear_expired_duplicates(struct eb32_node **dup_tail)
  * insertion+max_sec_entries time checks and entry deletion.
  * Returns the newly inserted node in case of success, NULL otherwise.
  */
-static struct eb32_node *insert_entry(struct cache *cache, struct cache_entry *new_entry)
+static struct eb32_node *insert_entry(struct cache_shard *shard, struct cache_entry *new_entry)
 {
+	struct cache *cache = shard->cache;
 	struct eb32_node *prev = NULL;
 	struct cache_entry *entry = NULL;
 	unsigned int entry_count = 0;
 	unsigned int last_clear_ts = now.tv_sec;
 
-	struct eb32_node *node = eb32_insert(&cache->entries, &new_entry->eb);
+	struct eb32_node *node = eb32_insert(&shard->entries, &new_entry->eb);
 
 	/* We should not have multiple entries with the same primary key unless
 	 * the entry has a non null vary signature. */
@@ -404,17 +550,6 @@ static void delete_entry(struct cache_entry *del_entry)
 }
 
 
-static inline struct shared_context *shctx_ptr(struct cache *cache)
-{
-	return (struct shared_context *)((unsigned char *)cache - ((struct shared_context *)NULL)->data);
-}
-
-static inline struct shared_block *block_ptr(struct cache_entry *entry)
-{
-	return (struct shared_block *)((unsigned char *)entry - ((struct shared_block *)NULL)->data);
-}
-
-
 
 static int
 cache_store_init(struct proxy *px, struct flt_conf *fconf)
@@ -498,29 +633,57 @@ cache_store_strm_init(struct stream *s, struct filter *filter)
 	if (st == NULL)
 		return -1;
 
-	st->first_block = NULL;
-	filter->ctx     = st;
+	st->first_block  = NULL;
+	st->shard        = NULL;
+	st->file_written = 0;
+	LIST_INIT(&st->wait_el);
+	st->wait_task    = NULL;
+	st->wait_exp     = TICK_ETERNITY;
+	st->inflight     = 0;
+	filter->ctx      = st;
 
 	/* Register post-analyzer on AN_RES_WAIT_HTTP */
 	filter->post_analyzers |= AN_RES_WAIT_HTTP;
 	return 1;
 }
 
+/* Stops waiting for an object in flight, and releases the placeholder of the
+ * object fetched by the stream if it is still there. This must be done before
+ * releasing <st>.
+ */
+static void cache_st_forget_inflight(struct cache_st *st)
+{
+	struct shared_context *shctx;
+
+	if (!st->shard || (!st->inflight && !LIST_INLIST(&st->wait_el)))
+		return;
+
+	shctx = shctx_ptr(st->shard);
+	shctx_lock(shctx);
+	LIST_DEL_INIT(&st->wait_el);
+	if (st->inflight)
+		cache_drop_inflight(st->shard, st->inflight_hash, st->inflight);
+	st->inflight = 0;
+	shctx_unlock(shctx);
+}
+
 static void
 cache_store_strm_deinit(struct stream *s, struct filter *filter)
 {
 	struct cache_st *st = filter->ctx;
-	struct cache_flt_conf *cconf = FLT_CONF(filter);
-	struct cache *cache = cconf->c.cache;
-	struct shared_context *shctx = shctx_ptr(cache);
 
 	/* Everything should be released in the http_end filter, but we need to do it
 	 * there too, in case of errors */
 	if (st && st->first_block) {
+		struct shared_context *shctx = shctx_ptr(st->shard);
+
 		shctx_lock(shctx);
 		shctx_row_dec_hot(shctx, st->first_block);
+		cache_wakeup_waiters(st->shard, read_u32(((struct cache_entry *)st->first_block->data)->hash));
 		shctx_unlock(shctx);
 	}
+	if (st)
+		cache_st_forget_inflight(st);
 	if (st) {
 		pool_free(pool_head_cache_st, st);
 		filter->ctx = NULL;
@@ -545,6 +708,7 @@ cache_store_post_analyze(struct stream *s, struct filter *filter, struct channel
 	 * such cases, the cache is disabled.
 	 */
 	if (st && (msg->flags & HTTP_MSGF_COMPRESSING)) {
+		cache_st_forget_inflight(st);
 		pool_free(pool_head_cache_st, st);
 		filter->ctx = NULL;
 	}
@@ -577,16 +741,59 @@ static inline void disable_cache_entry(struct cache_st *st,
 	shctx_row_dec_hot(shctx, st->first_block);
 	eb32_delete(&object->eb);
 	object->eb.key = 0;
+	cache_wakeup_waiters(st->shard, read_u32(object->hash));
 	shctx_unlock(shctx);
+	cache_st_forget_inflight(st);
 	pool_free(pool_head_cache_st, st);
 }
 
+/* Copies up to <len> bytes of the payload found at <offset> in <htx> to the
+ * file store area reserved for the entry being stored in <st>. Only DATA blocks
+ * are expected, and no more than the announced length. Returns the number of
+ * bytes to forward, or -1 if the object cannot be cached.
+ */
+static int cache_store_file_payload(struct cache_st *st, struct htx *htx,
+				    unsigned int offset, unsigned int len)
+{
+	struct cache_entry *object = (struct cache_entry *)st->first_block->data;
+	char *area = st->shard->file_area + object->file_pos % st->shard->file_size;
+	struct htx_blk *blk;
+	struct htx_ret htxret;
+	unsigned int to_forward = 0;
+
+	htxret = htx_find_offset(htx, offset);
+	blk = htxret.blk;
+	offset = htxret.ret;
+	for (; blk && len; blk = htx_get_next_blk(htx, blk)) {
+		enum htx_blk_type type = htx_get_blk_type(blk);
+		struct ist v;
+
+		if (type == HTX_BLK_UNUSED)
+			continue;
+		if (type != HTX_BLK_DATA)
+			return -1;
+
+		v = htx_get_blk_value(htx, blk);
+		v = istadv(v, offset);
+		if (v.len > len)
+			v.len = len;
+		if (v.len > object->file_len - st->file_written)
+			return -1;
+
+		memcpy(area + st->file_written, v.ptr, v.len);
+		st->file_written += v.len;
+		to_forward += v.len;
+		len -= v.len;
+		offset = 0;
+	}
+	return to_forward;
+}
+
 static int
 cache_store_http_payload(struct stream *s, struct filter *filter, struct http_msg *msg,
 			 unsigned int offset, unsigned int len)
 {
-	struct cache_flt_conf *cconf = FLT_CONF(filter);
-	struct shared_context *shctx = shctx_ptr(cconf->c.cache);
+	struct shared_context *shctx;
 	struct cache_st *st = filter->ctx;
 	struct htx *htx = htxbuf(&msg->chn->buf);
 	struct htx_blk *blk;
@@ -603,8 +810,16 @@ cache_store_http_payload(struct stream *s, struct filter *filter, struct http_ms
 		return len;
 	}
 
-	chunk_reset(&trash);
+	shctx = shctx_ptr(st->shard);
 	orig_len = len;
+	if (((struct cache_entry *)st->first_block->data)->file_len) {
+		ret = cache_store_file_payload(st, htx, offset, len);
+		if (ret < 0)
+			goto no_cache;
+		return ret;
+	}
+
+	chunk_reset(&trash);
 	to_forward = 0;
 
 	htxret = htx_find_offset(htx, offset);
@@ -628,6 +843,7 @@ cache_store_http_payload(struct stream *s, struct filter *filter, struct http_ms
 				info = (type << 28) + v.len;
 				chunk_memcat(&trash, (char *)&info, sizeof(info));
 				chunk_memcat(&trash, v.ptr, v.len);
+				((struct cache_entry *)st->first_block->data)->body_len += v.len;
 				to_forward += v.len;
 				len -= v.len;
 				break;
@@ -677,9 +893,7 @@ cache_store_http_end(struct stream *s, struct filter *filter,
                      struct http_msg *msg)
 {
 	struct cache_st *st = filter->ctx;
-	struct cache_flt_conf *cconf = FLT_CONF(filter);
-	struct cache *cache = cconf->c.cache;
-	struct shared_context *shctx = shctx_ptr(cache);
+	struct shared_context *shctx;
 	struct cache_entry *object;
 
 	if (!(msg->chn->flags & CF_ISRESP))
@@ -688,16 +902,29 @@ cache_store_http_end(struct stream *s, struct filter *filter,
 	if (st && st->first_block) {
 
 		object = (struct cache_entry *)st->first_block->data;
+		shctx = shctx_ptr(st->shard);
 
 		shctx_lock(shctx);
-		/* The whole payload was cached, the entry can now be used. */
-		object->complete = 1;
+		/* The whole payload was cached, the entry can now be used. A
+		 * payload stored in the file must be complete and must not have
+		 * been overwritten in the mean time.
+		 */
+		if (!object->file_len ||
+		    (st->file_written == object->file_len && cache_file_entry_valid(st->shard, object)))
+			object->complete = 1;
+		else if (object->eb.key) {
+			delete_entry(object);
+			object->eb.key = 0;
+		}
+		/* the waiting streams may now use it, or go to the server */
+		cache_wakeup_waiters(st->shard, read_u32(object->hash));
 		/* remove from the hotlist */
 		shctx_row_dec_hot(shctx, st->first_block);
 		shctx_unlock(shctx);
 
 	}
 	if (st) {
+		cache_st_forget_inflight(st);
 		pool_free(pool_head_cache_st, st);
 		filter->ctx = NULL;
 	}
@@ -847,6 +1074,45 @@ int http_calc_maxage(struct stream *s, struct cache *cache, int *true_maxage)
 
 }
 
+/*
+ * Look for the stale-while-revalidate and stale-if-error Cache-Control
+ * directives of an HTTP response (see RFC5861) and set <revalidate> and <error>
+ * to their value in seconds, or 0 if they are absent or invalid. Just like for
+ * the max-age, they are limited to the max-age of the cache.
+ */
+static void http_calc_stale(struct stream *s, struct cache *cache,
+                            unsigned int *revalidate, unsigned int *error)
+{
+	struct htx *htx = htxbuf(&s->res.buf);
+	struct http_hdr_ctx ctx = { .blk = NULL };
+	char *endptr = NULL;
+	long val;
+
+	*revalidate = *error = 0;
+	while (http_find_header(htx, ist("cache-control"), &ctx, 0)) {
+		unsigned int *res = revalidate;
+		struct buffer *chk;
+		char *value;
+		int len = 22;
+
+		value = directive_value(ctx.value.ptr, ctx.value.len, "stale-while-revalidate", 22);
+		if (!value) {
+			res = error;
+			len = 14;
+			value = directive_value(ctx.value.ptr, ctx.value.len, "stale-if-error", 14);
+		}
+		if (!value)
+			continue;
+
+		chk = get_trash_chunk();
+		chunk_strncat(chk, value, ctx.value.len - len + 1);
+		chunk_strncat(chk, "", 1);
+		val = strtol(chk->area + ((*chk->area == '"') ? 1 : 0), &endptr, 10);
+		if (val > 0 && endptr != chk->area)
+			*res = MIN(val, cache->maxage);
+	}
+}
+
 
 static void cache_free_blocks(struct shared_block *first, struct shared_block *block)
 {
@@ -984,7 +1250,8 @@ enum act_return http_action_store_cache(struct act_rule *rule, struct proxy *px,
 	struct shared_block *first = NULL;
 	struct cache_flt_conf *cconf = rule->arg.act.p[0];
 	struct cache *cache = cconf->c.cache;
-	struct shared_context *shctx = shctx_ptr(cache);
+	struct cache_shard *shard = cache_shard_ptr(cache, txn->cache_hash);
+	struct shared_context *shctx = shctx_ptr(shard);
 	struct cache_st *cache_ctx = NULL;
 	struct cache_entry *object, *old;
 	unsigned int key = read_u32(txn->cache_hash);
@@ -993,6 +1260,7 @@ enum act_return http_action_store_cache(struct act_rule *rule, struct proxy *px,
 	size_t hdrs_len = 0;
 	int32_t pos;
 	unsigned int vary_signature = 0;
+	unsigned int file_len = 0;
 
 	/* Don't cache if the response came from a cache */
 	if ((obj_type(s->target) == OBJ_TYPE_APPLET) &&
@@ -1023,10 +1291,11 @@ enum act_return http_action_store_cache(struct act_rule *rule, struct proxy *px,
 				 * unsafe request (such as PUT, POST or DELETE). */
 				shctx_lock(shctx);
 
-				old = entry_exist(cconf->c.cache, txn->cache_hash);
+				old = entry_exist(shard, txn->cache_hash);
 				if (old) {
 					eb32_delete(&old->eb);
 					old->eb.key = 0;
+					cache_wakeup_waiters(shard, key);
 				}
 				shctx_unlock(shctx);
 			}
@@ -1038,6 +1307,18 @@ enum act_return http_action_store_cache(struct act_rule *rule, struct proxy *px,
 	if (!key)
 		goto out;
 
+	/* A server error allows the stored version of the object to be delivered
+	 * during its stale-if-error period.
+	 */
+	if (txn->status >= 500) {
+		shctx_lock(shctx);
+		old = entry_exist(shard, txn->cache_hash);
+		if (old && old->complete && old->stale_error)
+			old->refresh_failed = now.tv_sec;
+		shctx_unlock(shctx);
+		goto out;
+	}
+
 	/* cache only 200 status code */
 	if (txn->status != 200)
 		goto out;
@@ -1056,10 +1337,21 @@ enum act_return http_action_store_cache(struct act_rule *rule, struct proxy *px,
 	/* from there, cache_ctx is always defined */
 	htx = htxbuf(&s->res.buf);
 
-	/* Do not cache too big objects. */
-	if ((msg->flags & HTTP_MSGF_CNT_LEN) && shctx->max_obj_size > 0 &&
-	    htx->data + htx->extra > shctx->max_obj_size)
-		goto out;
+	/* Objects announcing a large enough payload go to the file store when
+	 * there is one, only their headers are kept in the shctx. Otherwise do
+	 * not cache too big objects.
+	 */
+	if (msg->flags & HTTP_MSGF_CNT_LEN) {
+		long long body_len;
+
+		ctx.blk = NULL;
+		if (shard->file_area && http_find_header(htx, ist("Content-Length"), &ctx, 1) &&
+		    !strl2llrc(ctx.value.ptr, ctx.value.len, &body_len) &&
+		    body_len >= cache->file_minobjsz && body_len <= cache->file_maxobjsz)
+			file_len = body_len;
+		else if (shctx->max_obj_size > 0 && htx->data + htx->extra > shctx->max_obj_size)
+			goto out;
+	}
 
 	/* Only a subset of headers are supported in our Vary implementation. If
 	 * any other header is present in the Vary header value, we won't be
@@ -1087,10 +1379,18 @@ enum act_return http_action_store_cache(struct act_rule *rule, struct proxy *px,
 		goto out;
 
 	shctx_lock(shctx);
-	old = entry_exist(cache, txn->cache_hash);
+	old = entry_exist(shard, txn->cache_hash);
+	if (old && old->inflight) {
+		/* This is the placeholder of a request for this object, the
+		 * requests waiting for it will now wait for this entry.
+		 */
+		delete_entry(old);
+		old->eb.key = 0;
+		old = NULL;
+	}
 	if (old) {
 		if (vary_signature)
-			old = secondary_entry_exist(cconf->c.cache, old,
+			old = secondary_entry_exist(shard, old,
 						    txn->cache_secondary_hash);
 		if (old) {
 			if (!old->complete) {
@@ -1127,7 +1427,7 @@ enum act_return http_action_store_cache(struct act_rule *rule, struct proxy *px,
 		memcpy(object->secondary_key, txn->cache_secondary_hash, HTTP_CACHE_SEC_KEY_LEN);
 
 	/* Insert the entry in the tree even if the payload is not cached yet. */
-	if (insert_entry(cache, object) != &object->eb) {
+	if (insert_entry(shard, object) != &object->eb) {
 		object->eb.key = 0;
 		shctx_unlock(shctx);
 		goto out;
@@ -1142,6 +1442,7 @@ enum act_return http_action_store_cache(struct act_rule *rule, struct proxy *px,
 	 * configuration) as well as the response's explicit max age (extracted
 	 * from cache-control directives or the expires header). */
 	effective_maxage = http_calc_maxage(s, cconf->c.cache, &true_maxage);
+	http_calc_stale(s, cconf->c.cache, &object->stale_revalidate, &object->stale_error);
 
 	ctx.blk = NULL;
 	if (http_find_header(htx, ist("Age"), &ctx, 0)) {
@@ -1208,6 +1509,11 @@ enum act_return http_action_store_cache(struct act_rule *rule, struct proxy *px,
 		shctx_unlock(shctx);
 		goto out;
 	}
+	if (file_len) {
+		object->file_pos = cache_file_reserve(shard, file_len);
+		object->file_len = file_len;
+		object->body_len = file_len;
+	}
 	shctx_unlock(shctx);
 
 	/* cache the headers in a http action because it allows to chose what
@@ -1223,6 +1529,7 @@ enum act_return http_action_store_cache(struct act_rule *rule, struct proxy *px,
 	/* register the buffer in the filter ctx for filling it with data*/
 	if (cache_ctx) {
 		cache_ctx->first_block = first;
+		cache_ctx->shard = shard;
 		/* store latest value and expiration time */
 		object->latest_validation = now.tv_sec;
 		object->expire = now.tv_sec + effective_maxage;
@@ -1237,9 +1544,16 @@ enum act_return http_action_store_cache(struct act_rule *rule, struct proxy *px,
 		if (object->eb.key)
 			delete_entry(object);
 		object->eb.key = 0;
+		cache_wakeup_waiters(shard, key);
 		shctx_row_dec_hot(shctx, first);
 		shctx_unlock(shctx);
 	}
+	else if (key && cache->collapse_timeout) {
+		/* the requests waiting for this object must not wait anymore */
+		shctx_lock(shctx);
+		cache_drop_inflight(shard, txn->cache_hash, 0);
+		shctx_unlock(shctx);
+	}
 
 	return ACT_RET_CONT;
 }
@@ -1254,20 +1568,26 @@ static void http_cache_applet_release(struct appctx *appctx)
 {
 	struct cache_flt_conf *cconf = appctx->rule->arg.act.p[0];
 	struct cache_entry *cache_ptr = appctx->ctx.cache.entry;
-	struct cache *cache = cconf->c.cache;
+	struct shared_context *shctx = shctx_ptr(cache_shard_ptr(cconf->c.cache, cache_ptr->hash));
 	struct shared_block *first = block_ptr(cache_ptr);
 
-	shctx_lock(shctx_ptr(cache));
-	shctx_row_dec_hot(shctx_ptr(cache), first);
-	shctx_unlock(shctx_ptr(cache));
+	shctx_lock(shctx);
+	shctx_row_dec_hot(shctx, first);
+	shctx_unlock(shctx);
 }
 
 
+/* Tells whether the whole range requested from <appctx> was delivered, if any */
+static inline int htx_cache_range_done(const struct appctx *appctx)
+{
+	return appctx->ctx.cache.range && !appctx->ctx.cache.range_len;
+}
+
 static unsigned int htx_cache_dump_blk(struct appctx *appctx, struct htx *htx, enum htx_blk_type type,
 				       uint32_t info, struct shared_block *shblk, unsigned int offset)
 {
 	struct cache_flt_conf *cconf = appctx->rule->arg.act.p[0];
-	struct shared_context *shctx = shctx_ptr(cconf->c.cache);
+	struct shared_context *shctx = shctx_ptr(cache_shard_ptr(cconf->c.cache, appctx->ctx.cache.entry->hash));
 	struct htx_blk *blk;
 	char *ptr;
 	unsigned int max, total;
@@ -1307,14 +1627,25 @@ static unsigned int htx_cache_dump_blk(struct appctx *appctx, struct htx *htx, e
 	return total;
 }
 
+/* Dumps the payload of a DATA block stored in the row at <offset> of <shblk>,
+ * or its remaining part if a previous dump was interrupted. The payload is
+ * copied block by block from the shctx right into the largest DATA block which
+ * can be reserved at the tail of <htx>, so that all the payload dumped into an
+ * empty buffer ends in a single DATA block. This is the condition for the muxes
+ * to directly use the buffer as their output buffer, so the cached payload is
+ * only copied once on its way to the client. Returns the number of bytes
+ * consumed from the row, or 0 if nothing could be added.
+ */
 static unsigned int htx_cache_dump_data_blk(struct appctx *appctx, struct htx *htx,
 					    uint32_t info, struct shared_block *shblk, unsigned int offset)
 {
 
 	struct cache_flt_conf *cconf = appctx->rule->arg.act.p[0];
-	struct shared_context *shctx = shctx_ptr(cconf->c.cache);
-	unsigned int max, total, rem_data;
-	uint32_t blksz;
+	struct shared_context *shctx = shctx_ptr(cache_shard_ptr(cconf->c.cache, appctx->ctx.cache.entry->hash));
+	struct htx_ret htxret;
+	unsigned int max, total, rem_data, room;
+	uint32_t blksz, copied;
+	char *ptr;
 
 	max = htx_get_max_blksz(htx, channel_htx_recv_max(si_ic(appctx->owner), htx));
 	if (!max)
@@ -1329,31 +1660,53 @@ static unsigned int htx_cache_dump_data_blk(struct appctx *appctx, struct htx *h
 		blksz = (info & 0xfffffff);
 		total = 4;
 	}
+	if (appctx->ctx.cache.range && blksz > appctx->ctx.cache.range_len)
+		blksz = appctx->ctx.cache.range_len;
 	if (blksz > max) {
 		rem_data = blksz - max;
 		blksz = max;
 	}
 
-	while (blksz) {
-		size_t sz;
+	htxret = htx_reserve_max_data(htx);
+	if (!htxret.blk)
+		return 0;
+
+	room = htx_get_blksz(htxret.blk) - htxret.ret;
+	if (blksz > room) {
+		rem_data += blksz - room;
+		blksz = room;
+	}
 
+	ptr = htx_get_blk_ptr(htx, htxret.blk) + htxret.ret;
+	copied = blksz;
+	while (blksz) {
 		max = MIN(blksz, shctx->block_size - offset);
-		sz  = htx_add_data(htx, ist2(shblk->data + offset, max));
-		offset += sz;
-		blksz  -= sz;
-		total  += sz;
-		if (sz < max)
-			break;
+		memcpy(ptr, (const char *)shblk->data + offset, max);
+		offset += max;
+		blksz  -= max;
+		ptr    += max;
 		if (blksz || offset == shctx->block_size) {
 			shblk = LIST_NEXT(&shblk->list, typeof(shblk), list);
 			offset = 0;
 		}
 	}
 
+	/* Adjust the reserved block, or remove it if it is empty (empty DATA
+	 * blocks are not supported).
+	 */
+	if (!htxret.ret && !copied)
+		htx_remove_blk(htx, htxret.blk);
+	else
+		htx_change_blk_value_len(htx, htxret.blk, htxret.ret + copied);
+
+	total += copied;
+	if (appctx->ctx.cache.range)
+		appctx->ctx.cache.range_len -= copied;
+
 	appctx->ctx.cache.offset   = offset;
 	appctx->ctx.cache.next     = shblk;
 	appctx->ctx.cache.sent    += total;
-	appctx->ctx.cache.rem_data = rem_data + blksz;
+	appctx->ctx.cache.rem_data = rem_data;
 	return total;
 }
 
@@ -1361,12 +1714,12 @@ static size_t htx_cache_dump_msg(struct appctx *appctx, struct htx *htx, unsigne
 				 enum htx_blk_type mark)
 {
 	struct cache_flt_conf *cconf = appctx->rule->arg.act.p[0];
-	struct shared_context *shctx = shctx_ptr(cconf->c.cache);
+	struct shared_context *shctx = shctx_ptr(cache_shard_ptr(cconf->c.cache, appctx->ctx.cache.entry->hash));
 	struct shared_block   *shblk;
 	unsigned int offset, sz;
 	unsigned int ret, total = 0;
 
-	while (len) {
+	while (len && !htx_cache_range_done(appctx)) {
 		enum htx_blk_type type;
 		uint32_t info;
 
@@ -1409,9 +1762,43 @@ static size_t htx_cache_dump_msg(struct appctx *appctx, struct htx *htx, unsigne
 	return total;
 }
 
-static int htx_cache_add_age_hdr(struct appctx *appctx, struct htx *htx)
+/* Dumps the next part of the payload stored in the file store to <htx>, right
+ * from the mapping. The position in the payload is deduced from the amount of
+ * data already sent, which includes the headers stored in the shctx. Returns
+ * the number of bytes added, or -1 if the payload was overwritten, in which
+ * case nothing is added.
+ */
+static int htx_cache_dump_file(struct appctx *appctx, struct htx *htx)
 {
+	struct cache_flt_conf *cconf = appctx->rule->arg.act.p[0];
 	struct cache_entry *cache_ptr = appctx->ctx.cache.entry;
+	struct cache_shard *shard = cache_shard_ptr(cconf->c.cache, cache_ptr->hash);
+	unsigned int done = appctx->ctx.cache.sent - (block_ptr(cache_ptr)->len - sizeof(*cache_ptr));
+	const char *src = shard->file_area + cache_ptr->file_pos % shard->file_size + done;
+	uint32_t data = htx->data;
+	unsigned int max;
+	size_t sz;
+
+	max = htx_get_max_blksz(htx, channel_htx_recv_max(si_ic(appctx->owner), htx));
+	max = MIN(max, cache_ptr->file_len - done);
+	if (appctx->ctx.cache.range)
+		max = MIN(max, appctx->ctx.cache.range_len);
+	sz = htx_add_data(htx, ist2(src, max));
+
+	/* the area may have been reused while we were copying it */
+	__ha_barrier_load();
+	if (!cache_file_entry_valid(shard, cache_ptr)) {
+		htx_truncate(htx, data);
+		return -1;
+	}
+	appctx->ctx.cache.sent += sz;
+	if (appctx->ctx.cache.range)
+		appctx->ctx.cache.range_len -= sz;
+	return sz;
+}
+
+static int htx_cache_add_age_hdr(struct cache_entry *cache_ptr, struct htx *htx)
+{
 	unsigned int age;
 	char *end;
 
@@ -1426,8 +1813,166 @@ static int htx_cache_add_age_hdr(struct appctx *appctx, struct htx *htx)
 	return 1;
 }
 
+/* Looks in the request <htx> for a Range header with a single byte range which
+ * applies to the complete entry <entry>, checking the If-Range header if any.
+ * On success, the first byte of the range and its length are set in <start> and
+ * <len>, and 1 is returned. Otherwise 0 is returned and the whole object must
+ * be delivered, which is always allowed (see RFC7233#3.1).
+ */
+static int http_cache_get_range(struct cache *cache, struct htx *htx, struct cache_entry *entry,
+                                unsigned int *start, unsigned int *len)
+{
+	struct http_hdr_ctx ctx = { .blk = NULL };
+	unsigned long long first, last;
+	const char *p, *end, *num;
+
+	if (!entry->body_len)
+		return 0;
+
+	if (!http_find_header(htx, ist("range"), &ctx, 1))
+		return 0;
+	p = ctx.value.ptr;
+	end = istend(ctx.value);
+
+	/* several Range headers or ranges are not supported */
+	if (http_find_header(htx, ist("range"), &ctx, 1))
+		return 0;
+	if (end - p < 6 || strncasecmp(p, "bytes=", 6) != 0)
+		return 0;
+	p += 6;
+
+	if (p < end && *p == '-') {
+		/* suffix range: the last bytes */
+		num = ++p;
+		last = read_uint64(&p, end);
+		if (p == num || p != end || !last)
+			return 0;
+		first = (last < entry->body_len) ? entry->body_len - last : 0;
+		last = entry->body_len - 1;
+	}
+	else {
+		num = p;
+		first = read_uint64(&p, end);
+		if (p == num || p == end || *p != '-')
+			return 0;
+		num = ++p;
+		last = read_uint64(&p, end);
+		if (p != end)
+			return 0;
+		if (p == num || last >= entry->body_len)
+			last = entry->body_len - 1;
+		if (first > last)
+			return 0;
+	}
+
+	/* The range only applies to this version of the object, as designated
+	 * by a strong ETag or by its exact last modification date. */
+	ctx.blk = NULL;
+	if (http_find_header(htx, ist("if-range"), &ctx, 1)) {
+		struct tm tm = {};
+
+		if (*ctx.value.ptr == '"') {
+			struct buffer *etag = get_trash_chunk();
+
+			if (istlen(ctx.value) != entry->etag_length ||
+			    shctx_row_data_get(shctx_ptr(cache_shard_ptr(cache, entry->hash)), block_ptr(entry),
+			                       (unsigned char *)b_orig(etag), entry->etag_offset, entry->etag_length) != 0 ||
+			    memcmp(b_orig(etag), ctx.value.ptr, entry->etag_length) != 0)
+				return 0;
+		}
+		else if (!parse_http_date(istptr(ctx.value), istlen(ctx.value), &tm) ||
+		         my_timegm(&tm) != entry->last_modified)
+			return 0;
+	}
+
+	*start = first;
+	*len = last - first + 1;
+	return 1;
+}
+
+/* Skips the first <skip> bytes of the payload of the entry delivered by
+ * <appctx>, whose headers were just sent. The data blocks are walked over in
+ * the row, it is then resumed from the new position.
+ */
+static void htx_cache_skip_data(struct appctx *appctx, unsigned int skip)
+{
+	struct cache_flt_conf *cconf = appctx->rule->arg.act.p[0];
+	struct cache_entry *cache_ptr = appctx->ctx.cache.entry;
+	struct shared_context *shctx = shctx_ptr(cache_shard_ptr(cconf->c.cache, cache_ptr->hash));
+	struct shared_block *shblk = block_ptr(cache_ptr);
+	unsigned int end = shblk->len - sizeof(*cache_ptr);
+	unsigned int pos;
+
+	/* the payload is contiguous in the file store */
+	if (cache_ptr->file_len) {
+		appctx->ctx.cache.sent += skip;
+		return;
+	}
+
+	while (skip && appctx->ctx.cache.sent + 4 <= end) {
+		uint32_t info, sz;
+
+		shctx_row_data_get(shctx, shblk, (unsigned char *)&info,
+		                   sizeof(*cache_ptr) + appctx->ctx.cache.sent, sizeof(info));
+		if ((info >> 28) != HTX_BLK_DATA)
+			break;
+		sz = info & 0xfffffff;
+		if (sz > skip) {
+			/* resume in the middle of this block */
+			appctx->ctx.cache.sent += 4 + skip;
+			appctx->ctx.cache.rem_data = sz - skip;
+			break;
+		}
+		appctx->ctx.cache.sent += 4 + sz;
+		skip -= sz;
+	}
+
+	pos = sizeof(*cache_ptr) + appctx->ctx.cache.sent;
+	while (pos >= shctx->block_size) {
+		shblk = LIST_NEXT(&shblk->list, typeof(shblk), list);
+		pos -= shctx->block_size;
+	}
+	appctx->ctx.cache.next = shblk;
+	appctx->ctx.cache.offset = pos;
+}
+
+/* Turns the response headers dumped in <htx> into a "206 Partial Content"
+ * response for the range of <appctx>. Returns 1 on success, 0 on failure.
+ */
+static int htx_cache_set_range_hdrs(struct appctx *appctx, struct htx *htx)
+{
+	struct cache_entry *cache_ptr = appctx->ctx.cache.entry;
+	struct http_hdr_ctx ctx = { .blk = NULL };
+	struct htx_sl *sl;
+	char *end;
+
+	if (!http_replace_res_status(htx, ist("206"), ist("Partial Content")))
+		return 0;
+
+	while (http_find_header(htx, ist("transfer-encoding"), &ctx, 1))
+		http_remove_header(htx, &ctx);
+	ctx.blk = NULL;
+	while (http_find_header(htx, ist("content-length"), &ctx, 1))
+		http_remove_header(htx, &ctx);
+
+	end = ultoa_o(appctx->ctx.cache.range_len, trash.area, trash.size);
+	if (!http_add_header(htx, ist("Content-Length"), ist2(trash.area, end - trash.area)))
+		return 0;
+
+	chunk_printf(&trash, "bytes %u-%u/%u", appctx->ctx.cache.range_start,
+	             appctx->ctx.cache.range_start + appctx->ctx.cache.range_len - 1, cache_ptr->body_len);
+	if (!http_add_header(htx, ist("Content-Range"), ist2(b_orig(&trash), b_data(&trash))))
+		return 0;
+
+	sl = http_get_stline(htx);
+	sl->flags &= ~HTX_SL_F_CHNK;
+	sl->flags |= HTX_SL_F_XFER_LEN | HTX_SL_F_CLEN;
+	return 1;
+}
+
 static void http_cache_io_handler(struct appctx *appctx)
 {
+	struct cache_flt_conf *cconf = appctx->rule->arg.act.p[0];
 	struct cache_entry *cache_ptr = appctx->ctx.cache.entry;
 	struct shared_block *first = block_ptr(cache_ptr);
 	struct stream_interface *si = appctx->owner;
@@ -1466,7 +2011,7 @@ static void http_cache_io_handler(struct appctx *appctx)
 		len = first->len - sizeof(*cache_ptr) - appctx->ctx.cache.sent;
 		ret = htx_cache_dump_msg(appctx, res_htx, len, HTX_BLK_EOH);
 		if (!ret || (htx_get_tail_type(res_htx) != HTX_BLK_EOH) ||
-		    !htx_cache_add_age_hdr(appctx, res_htx))
+		    !htx_cache_add_age_hdr(cache_ptr, res_htx))
 			goto error;
 
 		/* In case of a conditional request, we might want to send a
@@ -1478,6 +2023,12 @@ static void http_cache_io_handler(struct appctx *appctx)
 			}
 		}
 
+		if (appctx->ctx.cache.range && !appctx->ctx.cache.send_notmodified) {
+			if (!htx_cache_set_range_hdrs(appctx, res_htx))
+				goto error;
+			htx_cache_skip_data(appctx, appctx->ctx.cache.range_start);
+		}
+
 		/* Skip response body for HEAD requests or in case of "304 Not
 		 * Modified" response. */
 		if (si_strm(si)->txn->meth == HTTP_METH_HEAD || appctx->ctx.cache.send_notmodified)
@@ -1487,10 +2038,34 @@ static void http_cache_io_handler(struct appctx *appctx)
 	}
 
 	if (appctx->st0 == HTX_CACHE_DATA) {
-		len = first->len - sizeof(*cache_ptr) - appctx->ctx.cache.sent;
-		if (len) {
+		/* the payload of an entry using the file store is not in the shctx */
+		len = cache_ptr->file_len ? 0 : first->len - sizeof(*cache_ptr) - appctx->ctx.cache.sent;
+		if (len && !htx_cache_range_done(appctx)) {
 			ret = htx_cache_dump_msg(appctx, res_htx, len, HTX_BLK_UNUSED);
-			if (ret < len) {
+			if (ret < len && !htx_cache_range_done(appctx)) {
+				si_rx_room_blk(si);
+				goto out;
+			}
+		}
+		while (cache_ptr->file_len && !htx_cache_range_done(appctx) &&
+		       appctx->ctx.cache.sent < first->len - sizeof(*cache_ptr) + cache_ptr->file_len) {
+			int sz = htx_cache_dump_file(appctx, res_htx);
+
+			if (sz < 0) {
+				/* The headers were already sent, the response
+				 * can only be truncated.
+				 */
+				struct shared_context *shctx = shctx_ptr(cache_shard_ptr(cconf->c.cache, cache_ptr->hash));
+
+				shctx_lock(shctx);
+				if (cache_ptr->eb.key)
+					delete_entry(cache_ptr);
+				cache_ptr->eb.key = 0;
+				shctx_unlock(shctx);
+				appctx->st0 = HTX_CACHE_END;
+				goto end;
+			}
+			if (!sz) {
 				si_rx_room_blk(si);
 				goto out;
 			}
@@ -1538,18 +2113,204 @@ static void http_cache_io_handler(struct appctx *appctx)
 }
 
 
-static int parse_cache_rule(struct proxy *proxy, const char *name, struct act_rule *rule, char **err)
+/* Builds in <buf> a copy of the request of stream <s> to refresh the object it
+ * is looking for: an HTTP/1.1 GET request with the same URI and headers, except
+ * the conditional and payload ones. Returns 1 on success, 0 on failure.
+ */
+static int cache_refresh_build_req(struct stream *s, struct buffer *buf)
 {
-	struct flt_conf *fconf;
-	struct cache_flt_conf *cconf = NULL;
+	struct htx *req_htx = htxbuf(&s->req.buf);
+	struct htx_sl *sl = http_get_stline(req_htx);
+	struct htx *htx;
+	unsigned int flags;
+	int32_t pos;
 
-	if (!*name || strcmp(name, "if") == 0 || strcmp(name, "unless") == 0) {
-		memprintf(err, "expects a cache name");
-		goto err;
-	}
+	if (!sl || !b_alloc(buf))
+		return 0;
 
-	/* check if a cache filter was already registered with this cache
-	 * name, if that's the case, must use it. */
+	htx = htx_from_buf(buf);
+	flags = (sl->flags & ~(HTX_SL_F_CLEN|HTX_SL_F_CHNK)) | HTX_SL_F_VER_11 | HTX_SL_F_XFER_LEN | HTX_SL_F_BODYLESS;
+	sl = htx_add_stline(htx, HTX_BLK_REQ_SL, flags, ist("GET"), htx_sl_req_uri(sl), ist("HTTP/1.1"));
+	if (!sl)
+		goto fail;
+	sl->info.req.meth = HTTP_METH_GET;
+
+	for (pos = htx_get_first(req_htx); pos != -1; pos = htx_get_next(req_htx, pos)) {
+		struct htx_blk *blk = htx_get_blk(req_htx, pos);
+		enum htx_blk_type type = htx_get_blk_type(blk);
+		struct ist n;
+
+		if (type == HTX_BLK_EOH)
+			break;
+		if (type != HTX_BLK_HDR)
+			continue;
+
+		n = htx_get_blk_name(req_htx, blk);
+		if (isteq(n, ist("content-length")) || isteq(n, ist("transfer-encoding")) ||
+		    isteq(n, ist("expect")) || istmatch(n, ist("if-")))
+			continue;
+		if (!htx_add_header(htx, n, htx_get_blk_value(req_htx, blk)))
+			goto fail;
+	}
+
+	if (!htx_add_endof(htx, HTX_BLK_EOH))
+		goto fail;
+	htx->flags |= HTX_FL_EOM;
+	htx_to_buf(htx, buf);
+	return 1;
+
+  fail:
+	b_free(buf);
+	return 0;
+}
+
+/* Starts a background refresh of entry <entry>, found by the cache-use rule
+ * <rule> of proxy <px> for stream <s>, and identified by <id> in the entry. A
+ * copy of the request is processed by an internal stream from the applet
+ * http_cache_refresh_applet, either from the frontend if the rule is there, or
+ * directly from the backend, so that the cache-store rule stores the response.
+ * The entry is kept in the hot list until the refresh ends. Returns 1 on
+ * success, 0 on failure.
+ */
+static int cache_refresh_start(struct act_rule *rule, struct proxy *px, struct stream *s,
+                               struct cache_entry *entry, unsigned int id)
+{
+	struct cache_flt_conf *cconf = rule->arg.act.p[0];
+	struct shared_context *shctx = shctx_ptr(cache_shard_ptr(cconf->c.cache, entry->hash));
+	struct proxy *fe = strm_fe(s);
+	struct buffer buf = BUF_NULL;
+	struct appctx *appctx;
+	struct session *sess;
+	struct stream *strm;
+
+	/* the request must be parsed as HTTP by the internal stream */
+	if (fe->mode != PR_MODE_HTTP)
+		goto out_error;
+
+	if (!cache_refresh_build_req(s, &buf))
+		goto out_error;
+
+	if ((appctx = appctx_new(&http_cache_refresh_applet, tid_bit)) == NULL)
+		goto out_free_buf;
+
+	appctx->rule = rule;
+	appctx->ctx.cache_refresh.entry = entry;
+	appctx->ctx.cache_refresh.id = id;
+	appctx->ctx.cache_refresh.status = 0;
+
+	sess = session_new(fe, NULL, &appctx->obj_type);
+	if (!sess)
+		goto out_free_appctx;
+
+	if ((strm = stream_new(sess, &appctx->obj_type, &buf)) == NULL)
+		goto out_free_sess;
+
+	shctx_lock(shctx);
+	shctx_row_inc_hot(shctx, block_ptr(entry));
+	shctx_unlock(shctx);
+
+	if (px == fe)
+		strm->req.analysers |= fe->fe_req_ana;
+	else {
+		/* The frontend rules were already applied to the request */
+		strm->req.analysers &= ~AN_REQ_HTTP_PROCESS_FE;
+		strm->req.analysers |= fe->fe_req_ana & (AN_REQ_FLT_START_FE|AN_REQ_FLT_XFER_DATA|AN_REQ_FLT_END);
+		if (!stream_set_backend(strm, px)) {
+			strm->req.analysers = 0;
+			channel_abort(&strm->req);
+			channel_abort(&strm->res);
+		}
+	}
+
+	/* the applet waits for the response */
+	si_cant_get(&strm->si[0]);
+	appctx_wakeup(appctx);
+
+	strm->do_log = NULL;
+	strm->res.flags |= CF_READ_DONTWAIT;
+
+	task_wakeup(strm->task, TASK_WOKEN_INIT);
+	return 1;
+
+	/* Error unrolling */
+ out_free_sess:
+	session_free(sess);
+ out_free_appctx:
+	appctx_free(appctx);
+ out_free_buf:
+	b_free(&buf);
+ out_error:
+	return 0;
+}
+
+/* The I/O handler of a background refresh: the response is only needed by the
+ * cache-store rule, so it is drained here, only its status is kept.
+ */
+static void http_cache_refresh_io_handler(struct appctx *appctx)
+{
+	struct stream_interface *si = appctx->owner;
+	struct channel *res = si_oc(si);
+	struct htx *htx;
+
+	if (unlikely(si->state == SI_ST_DIS || si->state == SI_ST_CLO))
+		return;
+
+	if (co_data(res)) {
+		htx = htxbuf(&res->buf);
+		if (!appctx->ctx.cache_refresh.status && htx_get_first_type(htx) == HTX_BLK_RES_SL)
+			appctx->ctx.cache_refresh.status = http_get_stline(htx)->info.res.status;
+		if ((htx->flags & HTX_FL_EOM) && co_data(res) == htx->data)
+			appctx->st0 = 1;
+		co_htx_skip(res, htx, co_data(res));
+		htx_to_buf(htx, &res->buf);
+	}
+
+	if (appctx->st0 || (res->flags & (CF_SHUTW|CF_SHUTW_NOW))) {
+		si_shutw(si);
+		si_shutr(si);
+		si_ic(si)->flags |= CF_READ_NULL;
+	}
+}
+
+/* Releases a background refresh. If the entry was not replaced by a new version
+ * of the object, either the server failed and the entry is kept for its
+ * stale-if-error period, or the object cannot be cached anymore and it is
+ * removed.
+ */
+static void http_cache_refresh_release(struct appctx *appctx)
+{
+	struct cache_flt_conf *cconf = appctx->rule->arg.act.p[0];
+	struct cache_entry *entry = appctx->ctx.cache_refresh.entry;
+	struct shared_context *shctx = shctx_ptr(cache_shard_ptr(cconf->c.cache, entry->hash));
+	int status = appctx->ctx.cache_refresh.status;
+
+	shctx_lock(shctx);
+	if (entry->eb.key && entry->refresh == appctx->ctx.cache_refresh.id) {
+		entry->refresh = 0;
+		if (!status || status >= 500)
+			entry->refresh_failed = now.tv_sec;
+		else {
+			delete_entry(entry);
+			entry->eb.key = 0;
+		}
+	}
+	shctx_row_dec_hot(shctx, block_ptr(entry));
+	shctx_unlock(shctx);
+}
+
+
+static int parse_cache_rule(struct proxy *proxy, const char *name, struct act_rule *rule, char **err)
+{
+	struct flt_conf *fconf;
+	struct cache_flt_conf *cconf = NULL;
+
+	if (!*name || strcmp(name, "if") == 0 || strcmp(name, "unless") == 0) {
+		memprintf(err, "expects a cache name");
+		goto err;
+	}
+
+	/* check if a cache filter was already registered with this cache
+	 * name, if that's the case, must use it. */
 	list_for_each_entry(fconf, &proxy->filter_configs, list) {
 		if (fconf->id == cache_store_flt_id) {
 			cconf = fconf->conf;
@@ -1702,7 +2463,7 @@ static int should_send_notmodified_response(struct cache *cache, struct htx *htx
 		if (etag_buffer == NULL) {
 			etag_buffer = get_trash_chunk();
 
-			if (shctx_row_data_get(shctx_ptr(cache), block_ptr(entry),
+			if (shctx_row_data_get(shctx_ptr(cache_shard_ptr(cache, entry->hash)), block_ptr(entry),
 					       (unsigned char*)b_orig(etag_buffer),
 					       entry->etag_offset, entry->etag_length) == 0) {
 				cache_entry_etag = ist2(b_orig(etag_buffer), entry->etag_length);
@@ -1739,6 +2500,129 @@ static int should_send_notmodified_response(struct cache *cache, struct htx *htx
 	return retval;
 }
 
+/* Tells whether the complete entry <entry> found by the cache-use rule of proxy
+ * <px> may be delivered. A stale entry may be delivered during its
+ * stale-while-revalidate period, or during its stale-if-error period once the
+ * server failed or when the backend has no usable server. When it should be
+ * refreshed in background (when stale, or for a fresh entry about to expire
+ * with "refresh-ahead"), and no refresh is in progress, a new refresh
+ * identifier is set in the entry and returned in <refresh>, otherwise this one
+ * is set to 0. Must be called with the shctx lock held.
+ */
+static int cache_entry_deliverable(struct cache *cache, struct cache_entry *entry,
+                                   struct proxy *px, unsigned int *refresh)
+{
+	*refresh = 0;
+	if (entry->expire > now.tv_sec) {
+		if (entry->expire - now.tv_sec > cache->refresh_ahead)
+			return 1;
+	}
+	else if (now.tv_sec >= entry->expire + entry->stale_revalidate) {
+		if (now.tv_sec >= entry->expire + entry->stale_error)
+			return 0;
+		if (!entry->refresh_failed && (!(px->cap & PR_CAP_BE) || be_usable_srv(px)))
+			return 0;
+		/* do not try to refresh a failing object more than once per second */
+		if (entry->refresh_failed == now.tv_sec)
+			return 1;
+	}
+
+	if (!entry->refresh) {
+		while (!(entry->refresh = _HA_ATOMIC_ADD_FETCH(&cache->inflight_seq, 1)))
+			;
+		*refresh = entry->refresh;
+	}
+	return 1;
+}
+
+/* Copies the next <len> bytes of a row, found at <offset> of <shblk>, into
+ * <dst>. <shblk> and <offset> are updated to designate the following bytes.
+ */
+static void cache_row_read(struct shared_context *shctx, struct shared_block **shblk,
+                           unsigned int *offset, char *dst, unsigned int len)
+{
+	unsigned int max;
+
+	while (len) {
+		max = MIN(len, shctx->block_size - *offset);
+		memcpy(dst, (const char *)(*shblk)->data + *offset, max);
+		*offset += max;
+		dst     += max;
+		len     -= max;
+		if (*offset == shctx->block_size) {
+			*shblk = LIST_NEXT(&(*shblk)->list, typeof(*shblk), list);
+			*offset = 0;
+		}
+	}
+}
+
+/* Builds at once in the response channel of stream <s> the response stored in
+ * <entry>, limited to its headers for a HEAD request or when <notmodified> is
+ * set, in which case a "304 Not Modified" response is built. This is only
+ * possible when the payload is not in the file store and when the whole
+ * message fits in the buffer. The entry must be in the hot list. Returns 1 on
+ * success, otherwise 0 is returned and the response channel is left empty.
+ */
+static int http_cache_build_direct(struct cache *cache, struct stream *s,
+                                   struct cache_entry *entry, int notmodified)
+{
+	struct shared_context *shctx = shctx_ptr(cache_shard_ptr(cache, entry->hash));
+	struct shared_block *shblk = block_ptr(entry);
+	struct channel *res = &s->res;
+	struct htx *htx = htx_from_buf(&res->buf);
+	unsigned int offset = sizeof(*entry);
+	unsigned int len = shblk->len - sizeof(*entry);
+	enum htx_blk_type type;
+	struct htx_blk *blk;
+	struct htx_sl *sl;
+	uint32_t info, sz;
+	int eoh = 0;
+
+	if (entry->file_len || !htx_is_empty(htx) || len > channel_htx_recv_max(res, htx))
+		goto fail;
+
+	while (len >= sizeof(info)) {
+		cache_row_read(shctx, &shblk, &offset, (char *)&info, sizeof(info));
+		len -= sizeof(info);
+		type = (info >> 28);
+		sz = ((type == HTX_BLK_HDR || type == HTX_BLK_TLR)
+		      ? (info & 0xff) + ((info >> 8) & 0xfffff)
+		      : info & 0xfffffff);
+		if (sz > len)
+			goto fail;
+
+		blk = htx_add_blk(htx, type, sz);
+		if (!blk)
+			goto fail;
+		blk->info = info;
+		cache_row_read(shctx, &shblk, &offset, htx_get_blk_ptr(htx, blk), sz);
+		len -= sz;
+
+		if (type == HTX_BLK_EOH) {
+			eoh = 1;
+			if (!htx_cache_add_age_hdr(entry, htx))
+				goto fail;
+			if (notmodified && !http_replace_res_status(htx, ist("304"), ist("Not Modified")))
+				goto fail;
+			if (notmodified || s->txn->meth == HTTP_METH_HEAD)
+				break;
+		}
+	}
+
+	sl = http_get_stline(htx);
+	if (!eoh || !sl)
+		goto fail;
+
+	s->txn->status = sl->info.res.status;
+	htx->flags |= HTX_FL_EOM;
+	htx_to_buf(htx, &res->buf);
+	return 1;
+
+  fail:
+	channel_htx_truncate(res, htx);
+	return 0;
+}
+
 enum act_return http_action_req_cache_use(struct act_rule *rule, struct proxy *px,
                                          struct session *sess, struct stream *s, int flags)
 {
@@ -1747,8 +2631,14 @@ enum act_return http_action_req_cache_use(struct act_rule *rule, struct proxy *p
 	struct cache_entry *res, *sec_entry = NULL;
 	struct cache_flt_conf *cconf = rule->arg.act.p[0];
 	struct cache *cache = cconf->c.cache;
+	struct cache_shard *shard;
+	struct shared_context *shctx;
 	struct shared_block *entry_block;
-
+	struct cache_st *st = NULL;
+	struct filter *filter;
+	unsigned int refresh;
+	unsigned int range_start = 0, range_len = 0;
+	int notmodified, range;
 
 	/* Ignore cache for HTTP/1.0 requests and for requests other than GET
 	 * and HEAD */
@@ -1768,36 +2658,59 @@ enum act_return http_action_req_cache_use(struct act_rule *rule, struct proxy *p
 	if (s->txn->flags & TX_CACHE_IGNORE)
 		return ACT_RET_CONT;
 
-	if (px == strm_fe(s))
-		_HA_ATOMIC_INC(&px->fe_counters.p.http.cache_lookups);
-	else
-		_HA_ATOMIC_INC(&px->be_counters.p.http.cache_lookups);
+	/* A background refresh must reach the server */
+	if (objt_appctx(s->si[0].end) &&
+	    __objt_appctx(s->si[0].end)->applet == &http_cache_refresh_applet)
+		return ACT_RET_CONT;
+
+	if (flags & ACT_OPT_FIRST) {
+		if (px == strm_fe(s))
+			_HA_ATOMIC_INC(&px->fe_counters.p.http.cache_lookups);
+		else
+			_HA_ATOMIC_INC(&px->be_counters.p.http.cache_lookups);
+	}
 
-	shctx_lock(shctx_ptr(cache));
-	res = entry_exist(cache, s->txn->cache_hash);
+	/* The filter instance holds the state used to wait for an object in
+	 * flight or to make the other requests wait for it.
+	 */
+	if (cache->collapse_timeout) {
+		list_for_each_entry(filter, &s->strm_flt.filters, list) {
+			if (FLT_ID(filter) == cache_store_flt_id && FLT_CONF(filter) == cconf) {
+				st = filter->ctx;
+				break;
+			}
+		}
+	}
+
+	shard = cache_shard_ptr(cache, s->txn->cache_hash);
+	shctx = shctx_ptr(shard);
+	shctx_lock(shctx);
+	if (st)
+		LIST_DEL_INIT(&st->wait_el);
+	res = entry_exist(shard, s->txn->cache_hash);
 	/* We must not use an entry that is not complete. */
 	if (res && res->complete) {
 		struct appctx *appctx;
 		entry_block = block_ptr(res);
-		shctx_row_inc_hot(shctx_ptr(cache), entry_block);
-		shctx_unlock(shctx_ptr(cache));
+		shctx_row_inc_hot(shctx, entry_block);
+		shctx_unlock(shctx);
 
 		/* In case of Vary, we could have multiple entries with the same
 		 * primary hash. We need to calculate the secondary hash in order
 		 * to find the actual entry we want (if it exists). */
 		if (res->secondary_key_signature) {
 			if (!http_request_build_secondary_key(s, res->secondary_key_signature)) {
-				shctx_lock(shctx_ptr(cache));
-				sec_entry = secondary_entry_exist(cache, res,
+				shctx_lock(shctx);
+				sec_entry = secondary_entry_exist(shard, res,
 								 s->txn->cache_secondary_hash);
 				if (sec_entry && sec_entry != res) {
 					/* The wrong row was added to the hot list. */
-					shctx_row_dec_hot(shctx_ptr(cache), entry_block);
+					shctx_row_dec_hot(shctx, entry_block);
 					entry_block = block_ptr(sec_entry);
-					shctx_row_inc_hot(shctx_ptr(cache), entry_block);
+					shctx_row_inc_hot(shctx, entry_block);
 				}
 				res = sec_entry;
-				shctx_unlock(shctx_ptr(cache));
+				shctx_unlock(shctx);
 			}
 			else
 				res = NULL;
@@ -1806,35 +2719,140 @@ enum act_return http_action_req_cache_use(struct act_rule *rule, struct proxy *p
 		/* We looked for a valid secondary entry and could not find one,
 		 * the request must be forwarded to the server. */
 		if (!res) {
-			shctx_lock(shctx_ptr(cache));
-			shctx_row_dec_hot(shctx_ptr(cache), entry_block);
-			shctx_unlock(shctx_ptr(cache));
+			shctx_lock(shctx);
+			shctx_row_dec_hot(shctx, entry_block);
+			shctx_unlock(shctx);
+			HA_USDT(cache_miss, s->uniq_id, s, px->uuid, read_u32(s->txn->cache_hash));
 			return ACT_RET_CONT;
 		}
 
+		/* A stale entry may still be delivered under some conditions,
+		 * otherwise the request is forwarded to the server. */
+		shctx_lock(shctx);
+		if (!cache_entry_deliverable(cache, res, px, &refresh)) {
+			shctx_row_dec_hot(shctx, entry_block);
+			shctx_unlock(shctx);
+			HA_USDT(cache_miss, s->uniq_id, s, px->uuid, read_u32(s->txn->cache_hash));
+			return ACT_RET_CONT;
+		}
+		shctx_unlock(shctx);
+
+		if (refresh && !cache_refresh_start(rule, px, s, res, refresh)) {
+			shctx_lock(shctx);
+			if (res->refresh == refresh)
+				res->refresh = 0;
+			shctx_unlock(shctx);
+		}
+
+		notmodified = should_send_notmodified_response(cache, htxbuf(&s->req.buf), res);
+		range = 0;
+		if (txn->meth == HTTP_METH_GET && !notmodified)
+			range = http_cache_get_range(cache, htxbuf(&s->req.buf), res, &range_start, &range_len);
+
 		s->target = &http_cache_applet.obj_type;
+
+		/* A complete response which fits in the buffer is directly
+		 * produced on the frontend side, sparing the applet, its task
+		 * and the backend stream interface. The stream then ends as
+		 * with an "http-request return" rule.
+		 */
+		if (cache->direct_hits && !range && http_cache_build_direct(cache, s, res, notmodified)) {
+			shctx_lock(shctx);
+			shctx_row_dec_hot(shctx, entry_block);
+			shctx_unlock(shctx);
+
+			txn->cache_name = cache->id;
+			if (px == strm_fe(s))
+				_HA_ATOMIC_INC(&px->fe_counters.p.http.cache_hits);
+			else
+				_HA_ATOMIC_INC(&px->be_counters.p.http.cache_hits);
+			HA_USDT(cache_hit, s->uniq_id, s, px->uuid, read_u32(s->txn->cache_hash));
+
+			if (!http_forward_proxy_resp(s, 1)) {
+				channel_htx_truncate(&s->res, htxbuf(&s->res.buf));
+				s->target = NULL;
+				txn->cache_name = NULL;
+				return ACT_RET_ERR;
+			}
+
+			s->logs.tv_request = now;
+			s->req.analysers &= AN_REQ_FLT_END;
+			if (!(s->flags & SF_ERR_MASK))
+				s->flags |= SF_ERR_LOCAL;
+			if (!(s->flags & SF_FINST_MASK))
+				s->flags |= SF_FINST_R;
+			return ACT_RET_ABRT;
+		}
+
 		if ((appctx = si_register_handler(&s->si[1], objt_applet(s->target)))) {
 			appctx->st0 = HTX_CACHE_INIT;
 			appctx->rule = rule;
 			appctx->ctx.cache.entry = res;
 			appctx->ctx.cache.next = NULL;
 			appctx->ctx.cache.sent = 0;
-			appctx->ctx.cache.send_notmodified =
-                                should_send_notmodified_response(cache, htxbuf(&s->req.buf), res);
+			appctx->ctx.cache.send_notmodified = notmodified;
+			appctx->ctx.cache.range = range;
+			appctx->ctx.cache.range_start = range_start;
+			appctx->ctx.cache.range_len = range_len;
 
 			if (px == strm_fe(s))
 				_HA_ATOMIC_INC(&px->fe_counters.p.http.cache_hits);
 			else
 				_HA_ATOMIC_INC(&px->be_counters.p.http.cache_hits);
+			HA_USDT(cache_hit, s->uniq_id, s, px->uuid, read_u32(s->txn->cache_hash));
 			return ACT_RET_CONT;
 		} else {
-			shctx_lock(shctx_ptr(cache));
-			shctx_row_dec_hot(shctx_ptr(cache), entry_block);
-			shctx_unlock(shctx_ptr(cache));
+			shctx_lock(shctx);
+			shctx_row_dec_hot(shctx, entry_block);
+			shctx_unlock(shctx);
 			return ACT_RET_YIELD;
 		}
 	}
-	shctx_unlock(shctx_ptr(cache));
+
+	if (st && res && !(flags & ACT_OPT_FINAL) &&
+	    (!tick_isset(st->wait_exp) || !tick_is_expired(st->wait_exp, now_ms))) {
+		/* The object is being fetched by another request, wait for it
+		 * to be stored, but not longer than the collapse-timeout.
+		 */
+		if (!tick_isset(st->wait_exp))
+			st->wait_exp = tick_add(now_ms, cache->collapse_timeout);
+		st->shard = shard;
+		st->wait_key = read_u32(s->txn->cache_hash);
+		st->wait_task = s->task;
+		LIST_APPEND(&shard->waiters, &st->wait_el);
+		shctx_unlock(shctx);
+		s->req.analyse_exp = st->wait_exp;
+		return ACT_RET_YIELD;
+	}
+
+	if (st && !res && !tick_isset(st->wait_exp) && !st->inflight && txn->meth == HTTP_METH_GET) {
+		/* Nobody is fetching this object, insert a placeholder to let
+		 * the next requests wait for our response. Once it is inserted,
+		 * it does not need to stay in the hot list: it can be evicted.
+		 */
+		entry_block = shctx_row_reserve_hot(shctx, NULL, sizeof(struct cache_entry));
+		if (entry_block) {
+			res = (struct cache_entry *)entry_block->data;
+			memset(res, 0, sizeof(*res));
+			res->eb.key = read_u32(s->txn->cache_hash);
+			memcpy(res->hash, s->txn->cache_hash, sizeof(res->hash));
+			res->expire = now.tv_sec + (cache->collapse_timeout + 999) / 1000;
+			while (!(res->inflight = _HA_ATOMIC_ADD_FETCH(&cache->inflight_seq, 1)))
+				;
+			entry_block->len = sizeof(struct cache_entry);
+			entry_block->last_append = NULL;
+			if (insert_entry(shard, res) == &res->eb) {
+				st->shard = shard;
+				st->inflight = res->inflight;
+				memcpy(st->inflight_hash, s->txn->cache_hash, sizeof(st->inflight_hash));
+			}
+			else
+				res->eb.key = 0;
+			shctx_row_dec_hot(shctx, entry_block);
+			res = NULL;
+		}
+	}
+	shctx_unlock(shctx);
 
 	/* Shared context does not need to be locked while we calculate the
 	 * secondary hash. */
@@ -1843,6 +2861,7 @@ enum act_return http_action_req_cache_use(struct act_rule *rule, struct proxy *p
 		 * tells us which fields should be kept (if any). */
 		http_request_prebuild_full_secondary_key(s);
 	}
+	HA_USDT(cache_miss, s->uniq_id, s, px->uuid, read_u32(s->txn->cache_hash));
 	return ACT_RET_CONT;
 }
 
@@ -1908,6 +2927,7 @@ int cfg_parse_cache(const char *file, int linenum, char **args, int kwm)
 			tmp_cache_config->maxblocks = 0;
 			tmp_cache_config->maxobjsz = 0;
 			tmp_cache_config->max_secondary_entries = DEFAULT_MAX_SECONDARY_ENTRY;
+			tmp_cache_config->nb_shards = 1;
 		}
 	} else if (strcmp(args[0], "total-max-size") == 0) {
 		unsigned long int maxsize;
@@ -1992,6 +3012,22 @@ int cfg_parse_cache(const char *file, int linenum, char **args, int kwm)
 				   file, linenum, args[0]);
 			err_code |= ERR_WARN;
 		}
+	} else if (strcmp(args[0], "direct-hits") == 0) {
+		if (alertif_too_many_args(1, file, linenum, args, &err_code)) {
+			err_code |= ERR_ABORT;
+			goto out;
+		}
+
+		if (strcmp(args[1], "on") == 0)
+			tmp_cache_config->direct_hits = 1;
+		else if (strcmp(args[1], "off") == 0)
+			tmp_cache_config->direct_hits = 0;
+		else {
+			ha_alert("parsing [%s:%d]: '%s' expects \"on\" or \"off\".\n",
+			         file, linenum, args[0]);
+			err_code |= ERR_ALERT | ERR_ABORT;
+			goto out;
+		}
 	} else if (strcmp(args[0], "max-secondary-entries") == 0) {
 		unsigned int max_sec_entries;
 		char *err;
@@ -2015,6 +3051,165 @@ int cfg_parse_cache(const char *file, int linenum, char **args, int kwm)
 			goto out;
 		}
 		tmp_cache_config->max_secondary_entries = max_sec_entries;
+	} else if (strcmp(args[0], "collapse-timeout") == 0) {
+		unsigned int timeout;
+		const char *res;
+
+		if (alertif_too_many_args(1, file, linenum, args, &err_code)) {
+			err_code |= ERR_ABORT;
+			goto out;
+		}
+
+		if (!*args[1]) {
+			ha_alert("parsing [%s:%d]: '%s' expects a time argument.\n",
+			         file, linenum, args[0]);
+			err_code |= ERR_ALERT | ERR_ABORT;
+			goto out;
+		}
+
+		res = parse_time_err(args[1], &timeout, TIME_UNIT_MS);
+		if (res == PARSE_TIME_OVER) {
+			ha_alert("parsing [%s:%d]: timer overflow in argument '%s' to '%s' (maximum value is 2147483647 ms or ~24.8 days)\n",
+			         file, linenum, args[1], args[0]);
+			err_code |= ERR_ALERT | ERR_ABORT;
+			goto out;
+		}
+		else if (res == PARSE_TIME_UNDER) {
+			ha_alert("parsing [%s:%d]: timer underflow in argument '%s' to '%s' (minimum non-null value is 1 ms)\n",
+			         file, linenum, args[1], args[0]);
+			err_code |= ERR_ALERT | ERR_ABORT;
+			goto out;
+		}
+		else if (res) {
+			ha_alert("parsing [%s:%d]: unexpected character '%c' in argument to '%s'.\n",
+			         file, linenum, *res, args[0]);
+			err_code |= ERR_ALERT | ERR_ABORT;
+			goto out;
+		}
+		tmp_cache_config->collapse_timeout = timeout;
+	} else if (strcmp(args[0], "refresh-ahead") == 0) {
+		unsigned int delay;
+		const char *res;
+
+		if (alertif_too_many_args(1, file, linenum, args, &err_code)) {
+			err_code |= ERR_ABORT;
+			goto out;
+		}
+
+		if (!*args[1]) {
+			ha_alert("parsing [%s:%d]: '%s' expects a time argument.\n",
+			         file, linenum, args[0]);
+			err_code |= ERR_ALERT | ERR_ABORT;
+			goto out;
+		}
+
+		res = parse_time_err(args[1], &delay, TIME_UNIT_S);
+		if (res == PARSE_TIME_OVER) {
+			ha_alert("parsing [%s:%d]: timer overflow in argument '%s' to '%s' (maximum value is 2147483647 s or ~68 years)\n",
+			         file, linenum, args[1], args[0]);
+			err_code |= ERR_ALERT | ERR_ABORT;
+			goto out;
+		}
+		else if (res == PARSE_TIME_UNDER) {
+			ha_alert("parsing [%s:%d]: timer underflow in argument '%s' to '%s' (minimum non-null value is 1 s)\n",
+			         file, linenum, args[1], args[0]);
+			err_code |= ERR_ALERT | ERR_ABORT;
+			goto out;
+		}
+		else if (res) {
+			ha_alert("parsing [%s:%d]: unexpected character '%c' in argument to '%s'.\n",
+			         file, linenum, *res, args[0]);
+			err_code |= ERR_ALERT | ERR_ABORT;
+			goto out;
+		}
+		tmp_cache_config->refresh_ahead = delay;
+	} else if (strcmp(args[0], "shards") == 0) {
+		unsigned int nb_shards;
+		char *err;
+
+		if (alertif_too_many_args(1, file, linenum, args, &err_code)) {
+			err_code |= ERR_ABORT;
+			goto out;
+		}
+
+		nb_shards = strtoul(args[1], &err, 10);
+		if (err == args[1] || *err != '\0' || nb_shards == 0) {
+			ha_alert("parsing [%s:%d]: '%s' expects a strictly positive number, got '%s'.\n",
+			         file, linenum, args[0], args[1]);
+			err_code |= ERR_ALERT | ERR_ABORT;
+			goto out;
+		}
+		tmp_cache_config->nb_shards = nb_shards;
+	} else if (strcmp(args[0], "file-store") == 0) {
+		unsigned long int maxsize;
+		char *err;
+
+		if (alertif_too_many_args(2, file, linenum, args, &err_code)) {
+			err_code |= ERR_ABORT;
+			goto out;
+		}
+
+		if (!*args[1] || !*args[2]) {
+			ha_alert("parsing [%s:%d]: '%s' expects a <path> and a <megabytes> argument.\n",
+			         file, linenum, args[0]);
+			err_code |= ERR_ALERT | ERR_ABORT;
+			goto out;
+		}
+
+		maxsize = strtoul(args[2], &err, 10);
+		if (err == args[2] || *err != '\0' || !maxsize) {
+			ha_alert("parsing [%s:%d]: file-store wrong size value '%s'\n",
+			         file, linenum, args[2]);
+			err_code |= ERR_ALERT | ERR_ABORT;
+			goto out;
+		}
+
+		free(tmp_cache_config->file_path);
+		tmp_cache_config->file_path = strdup(args[1]);
+		if (!tmp_cache_config->file_path) {
+			ha_alert("parsing [%s:%d]: out of memory.\n", file, linenum);
+			err_code |= ERR_ALERT | ERR_ABORT;
+			goto out;
+		}
+		/* size in megabytes */
+		tmp_cache_config->file_size = (unsigned long long)maxsize << 20;
+	} else if (strcmp(args[0], "file-min-object-size") == 0) {
+		unsigned int minobjsz;
+		char *err;
+
+		if (alertif_too_many_args(1, file, linenum, args, &err_code)) {
+			err_code |= ERR_ABORT;
+			goto out;
+		}
+
+		minobjsz = strtoul(args[1], &err, 10);
+		if (err == args[1] || *err != '\0' || !minobjsz) {
+			ha_alert("parsing [%s:%d]: file-min-object-size wrong value '%s'\n",
+			         file, linenum, args[1]);
+			err_code |= ERR_ALERT | ERR_ABORT;
+			goto out;
+		}
+		tmp_cache_config->file_minobjsz = minobjsz;
+	} else if (strcmp(args[0], "persist-file") == 0) {
+		if (alertif_too_many_args(1, file, linenum, args, &err_code)) {
+			err_code |= ERR_ABORT;
+			goto out;
+		}
+
+		if (!*args[1]) {
+			ha_alert("parsing [%s:%d]: '%s' expects a <path> argument.\n",
+			         file, linenum, args[0]);
+			err_code |= ERR_ALERT | ERR_ABORT;
+			goto out;
+		}
+
+		free(tmp_cache_config->persist_path);
+		tmp_cache_config->persist_path = strdup(args[1]);
+		if (!tmp_cache_config->persist_path) {
+			ha_alert("parsing [%s:%d]: out of memory.\n", file, linenum);
+			err_code |= ERR_ALERT | ERR_ABORT;
+			goto out;
+		}
 	}
 	else if (*args[0] != 0) {
 		ha_alert("parsing [%s:%d] : unknown keyword '%s' in 'cache' section\n", file, linenum, args[0]);
@@ -2029,6 +3224,7 @@ int cfg_parse_cache(const char *file, int linenum, char **args, int kwm)
 
 int cfg_post_parse_section_cache()
 {
+	unsigned int shard_size;
 	int err_code = 0;
 
 	if (tmp_cache_config) {
@@ -2039,17 +3235,64 @@ int cfg_post_parse_section_cache()
 			goto out;
 		}
 
+		if (tmp_cache_config->nb_shards > tmp_cache_config->maxblocks) {
+			ha_alert("\"shards\" is limited to the number of blocks of cache '%s' => %u\n",
+			         tmp_cache_config->id, tmp_cache_config->maxblocks);
+			err_code |= ERR_FATAL | ERR_ALERT;
+			goto out;
+		}
+		shard_size = tmp_cache_config->maxblocks / tmp_cache_config->nb_shards * CACHE_BLOCKSIZE;
+
 		if (!tmp_cache_config->maxobjsz) {
-			/* Default max. file size is a 256th of the cache size. */
+			/* Default max. file size is a 256th of the cache size,
+			 * and must fit in a shard.
+			 */
 			tmp_cache_config->maxobjsz =
-				(tmp_cache_config->maxblocks * CACHE_BLOCKSIZE) >> 8;
+				MIN((tmp_cache_config->maxblocks * CACHE_BLOCKSIZE) >> 8, shard_size / 2);
 		}
-		else if (tmp_cache_config->maxobjsz > tmp_cache_config->maxblocks * CACHE_BLOCKSIZE / 2) {
-			ha_alert("\"max-object-size\" is limited to an half of \"total-max-size\" => %u\n", tmp_cache_config->maxblocks * CACHE_BLOCKSIZE / 2);
+		else if (tmp_cache_config->maxobjsz > shard_size / 2) {
+			if (tmp_cache_config->nb_shards > 1)
+				ha_alert("\"max-object-size\" is limited to an half of \"total-max-size\" divided by \"shards\" => %u\n", shard_size / 2);
+			else
+				ha_alert("\"max-object-size\" is limited to an half of \"total-max-size\" => %u\n", shard_size / 2);
 			err_code |= ERR_FATAL | ERR_ALERT;
 			goto out;
 		}
 
+		if (tmp_cache_config->file_path) {
+			/* Objects too large for the shctx go to the file by
+			 * default. An object may use at most an half of the file.
+			 */
+			if (!tmp_cache_config->file_minobjsz)
+				tmp_cache_config->file_minobjsz = tmp_cache_config->maxobjsz + 1;
+			tmp_cache_config->file_maxobjsz =
+				MIN(tmp_cache_config->file_size / tmp_cache_config->nb_shards / 2, UINT_MAX);
+			if (tmp_cache_config->file_minobjsz > tmp_cache_config->file_maxobjsz) {
+				ha_alert("\"file-min-object-size\" is limited to an half of the \"file-store\" size per shard => %u\n",
+				         tmp_cache_config->file_maxobjsz);
+				err_code |= ERR_FATAL | ERR_ALERT;
+				goto out;
+			}
+		}
+		else if (tmp_cache_config->file_minobjsz) {
+			ha_warning("\"file-min-object-size\" ignored for cache '%s' which has no \"file-store\".\n",
+			           tmp_cache_config->id);
+			err_code |= ERR_WARN;
+		}
+
+		if (tmp_cache_config->persist_path) {
+			struct cache *other;
+
+			list_for_each_entry(other, &caches_config, list) {
+				if (other->persist_path && strcmp(other->persist_path, tmp_cache_config->persist_path) == 0) {
+					ha_alert("cache '%s' uses the same \"persist-file\" as cache '%s'.\n",
+					         tmp_cache_config->id, other->id);
+					err_code |= ERR_FATAL | ERR_ALERT;
+					goto out;
+				}
+			}
+		}
+
 		/* add to the list of cache to init and reinit tmp_cache_config
 		 * for next cache section, if any.
 		 */
@@ -2058,43 +3301,454 @@ int cfg_post_parse_section_cache()
 		return err_code;
 	}
 out:
+	if (tmp_cache_config) {
+		ha_free(&tmp_cache_config->file_path);
+		ha_free(&tmp_cache_config->persist_path);
+	}
 	ha_free(&tmp_cache_config);
 	return err_code;
 
 }
 
+/* Creates the file store of <cache>, maps it and gives each shard its slice.
+ * Its previous contents, if any, are not reused. Returns 0 on success,
+ * otherwise non-zero after having emitted an alert.
+ */
+static int cache_file_init(struct cache *cache)
+{
+	char *area;
+	unsigned int i;
+	int fd;
+
+	fd = open(cache->file_path, O_RDWR | O_CREAT, 0600);
+	if (fd < 0) {
+		ha_alert("cache '%s': cannot open file store '%s' (%s).\n",
+		         cache->id, cache->file_path, strerror(errno));
+		return 1;
+	}
+
+	if (ftruncate(fd, cache->file_size) < 0) {
+		ha_alert("cache '%s': cannot resize file store '%s' (%s).\n",
+		         cache->id, cache->file_path, strerror(errno));
+		close(fd);
+		return 1;
+	}
+
+	area = mmap(NULL, cache->file_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (area == MAP_FAILED) {
+		ha_alert("cache '%s': cannot map file store '%s' (%s).\n",
+		         cache->id, cache->file_path, strerror(errno));
+		return 1;
+	}
+
+	for (i = 0; i < cache->nb_shards; i++) {
+		struct cache_shard *shard = cache->shards[i];
+
+		shard->file_size = cache->file_size / cache->nb_shards;
+		shard->file_area = area + i * shard->file_size;
+		shard->file_head = 0;
+	}
+	return 0;
+}
+
+/* Header of a persist-file. It is followed by the shctx of each shard, each
+ * one starting on a CACHE_PERSIST_ALIGN boundary. The pointers stored in the
+ * file are those of the process which created it, which mapped the header at
+ * <base>. The contents of a file are only reused by the same version, and as
+ * long as the layout of the stored structures did not change.
+ */
+#define CACHE_PERSIST_MAGIC 0x48434846 /* "HCHF" */
+#define CACHE_PERSIST_ALIGN 64
+
+struct cache_persist_hdr {
+	unsigned int magic;          /* CACHE_PERSIST_MAGIC */
+	char version[32];            /* haproxy_version of the creator, maybe truncated */
+	unsigned short entry_size;   /* sizeof(struct cache_entry) */
+	unsigned short block_size;   /* sizeof(struct shared_block) */
+	unsigned short shctx_size;   /* sizeof(struct shared_context) */
+	unsigned short extra_size;   /* sizeof(struct cache_shard) */
+	unsigned int blocksize;      /* CACHE_BLOCKSIZE */
+	unsigned int nb_shards;      /* number of shards */
+	unsigned int maxblocks;      /* number of blocks per shard */
+	unsigned long long area_size;    /* distance between two shards */
+	unsigned long long size;     /* size of the whole file */
+	char *base;                  /* address of the header in its creator */
+};
+
+/* Description of the shard of a previous persist-file being restored */
+struct cache_persist_src {
+	char *map;                   /* our own mapping of the file */
+	char *base;                  /* address of the same mapping in its creator */
+	size_t first;                /* offset of the first block of the shard */
+	size_t end;                  /* offset past the last block of the shard */
+	size_t stride;               /* distance between two blocks */
+	unsigned int blocksize;      /* usable size of a block */
+};
+
+/* Returns the header size of a persist-file */
+static inline size_t cache_persist_hdr_len()
+{
+	return (sizeof(struct cache_persist_hdr) + CACHE_PERSIST_ALIGN - 1) & -CACHE_PERSIST_ALIGN;
+}
+
+/* Fills the header <hdr> of a persist-file mapped at this address, for shards
+ * of <maxblocks> blocks.
+ */
+static void cache_persist_fill_hdr(struct cache_persist_hdr *hdr, struct cache *cache, unsigned int maxblocks)
+{
+	hdr->magic = CACHE_PERSIST_MAGIC;
+	strlcpy2(hdr->version, haproxy_version, sizeof(hdr->version));
+	hdr->entry_size = sizeof(struct cache_entry);
+	hdr->block_size = sizeof(struct shared_block);
+	hdr->shctx_size = sizeof(struct shared_context);
+	hdr->extra_size = sizeof(struct cache_shard);
+	hdr->blocksize = CACHE_BLOCKSIZE;
+	hdr->nb_shards = cache->nb_shards;
+	hdr->maxblocks = maxblocks;
+	hdr->area_size = (shctx_area_size(maxblocks, CACHE_BLOCKSIZE, sizeof(struct cache_shard)) +
+	                  CACHE_PERSIST_ALIGN - 1) & -CACHE_PERSIST_ALIGN;
+	hdr->size = cache_persist_hdr_len() + cache->nb_shards * hdr->area_size;
+	hdr->base = (char *)hdr;
+}
+
+/* Returns the block of the shard described by <src> designated by <ptr>, a
+ * pointer of the creator of the file, or NULL if <ptr> does not designate
+ * such a block, which means that the file is corrupted.
+ */
+static struct shared_block *cache_persist_block(const struct cache_persist_src *src, const struct list *ptr)
+{
+	size_t off = (uintptr_t)ptr - (uintptr_t)src->base;
+
+	if (off < src->first || off >= src->end || (off - src->first) % src->stride)
+		return NULL;
+	return (struct shared_block *)(src->map + off);
+}
+
+/* Copies into <cache> the object stored in the row of <count> blocks starting
+ * at <first> in the shard described by <src>, if it is complete, is still
+ * usable and does not have its payload in the file store. Placeholders and
+ * objects being stored are ignored. <restored> is incremented if the object
+ * was copied. Returns the pointer following the row in its list, or NULL if
+ * the row is corrupted.
+ */
+static struct list *cache_persist_copy_row(struct cache *cache, const struct cache_persist_src *src,
+                                           struct shared_block *first, unsigned int count,
+                                           unsigned int *restored)
+{
+	struct cache_entry *object = (struct cache_entry *)first->data;
+	struct shared_context *shctx = NULL;
+	struct cache_shard *shard = NULL;
+	struct shared_block *block = first;
+	struct shared_block *new = NULL;
+	struct list *next = NULL;
+	unsigned int len = first->len;
+	unsigned int i, n;
+
+	if (len >= sizeof(*object) && len <= count * src->blocksize &&
+	    object->complete && !object->inflight && !object->file_len && object->eb.key &&
+	    cache_entry_end(object) > now.tv_sec) {
+		shard = cache_shard_ptr(cache, object->hash);
+		shctx = shctx_ptr(shard);
+		new = shctx_row_reserve_hot(shctx, NULL, len);
+	}
+
+	for (i = 0; i < count; i++) {
+		if (i) {
+			block = cache_persist_block(src, next);
+			if (!block)
+				break;
+		}
+
+		n = MIN(len, src->blocksize);
+		if (new && n)
+			shctx_row_data_append(shctx, new, i ? new->last_append : NULL, block->data, n);
+		len -= n;
+		next = block->list.n;
+	}
+
+	if (new) {
+		object = (struct cache_entry *)new->data;
+		if (i < count || len) {
+			/* corrupted row */
+			new->len = 0;
+			object->eb.key = 0;
+		}
+		else {
+			/* the refresh belonged to the previous process */
+			object->refresh = 0;
+			if (insert_entry(shard, object))
+				(*restored)++;
+			else
+				new->len = 0;
+		}
+		shctx_row_dec_hot(shctx, new);
+	}
+	return i < count ? NULL : next;
+}
+
+/* Copies into <cache> the objects of the shard of a previous persist-file
+ * whose shctx is <old> and which is described by <src>. The rows are visited
+ * from the least recently used one, so that their order is preserved. Must be
+ * called with the lock of <old> held. Returns the number of objects copied.
+ */
+static unsigned int cache_persist_restore_shard(struct cache *cache, const struct cache_persist_src *src,
+                                                struct shared_context *old)
+{
+	struct list *heads[2] = { &old->avail, &old->hot };
+	unsigned int budget = (src->end - src->first) / src->stride;
+	unsigned int restored = 0;
+	unsigned int count;
+	struct shared_block *first;
+	struct list *next;
+	int l;
+
+	for (l = 0; l < 2; l++) {
+		/* the list head, as seen by the creator of the file */
+		char *head = src->base + ((char *)heads[l] - src->map);
+
+		next = heads[l]->n;
+		while ((char *)next != head) {
+			first = cache_persist_block(src, next);
+			if (!first)
+				return restored;
+
+			count = first->block_count;
+			if (!count || count > budget)
+				return restored;
+			budget -= count;
+
+			next = cache_persist_copy_row(cache, src, first, count, &restored);
+			if (!next)
+				return restored;
+		}
+	}
+	return restored;
+}
+
+/* Copies into <cache> the objects found in its persist-file, which may still
+ * be used by the previous process. Each shard of the file is locked while it
+ * is copied, so that we get a consistent view of it. Files produced by another
+ * version are ignored. <ref> is the header of our own file. Returns the number
+ * of objects copied.
+ */
+static unsigned int cache_persist_load(struct cache *cache, const struct cache_persist_hdr *ref)
+{
+	struct cache_persist_hdr *hdr;
+	struct cache_persist_src src;
+	struct shared_context *old;
+	struct stat st;
+	unsigned int restored = 0;
+	unsigned int i, tries;
+	size_t extra;
+	int fd;
+
+	fd = open(cache->persist_path, O_RDWR);
+	if (fd < 0) {
+		if (errno != ENOENT)
+			ha_warning("cache '%s': cannot open persist-file '%s' (%s), starting empty.\n",
+			           cache->id, cache->persist_path, strerror(errno));
+		return 0;
+	}
+
+	if (fstat(fd, &st) < 0 || st.st_size < sizeof(*hdr)) {
+		close(fd);
+		return 0;
+	}
+
+	hdr = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (hdr == MAP_FAILED)
+		return 0;
+
+	if (hdr->magic != ref->magic || strncmp(hdr->version, ref->version, sizeof(hdr->version)) != 0 ||
+	    hdr->entry_size != ref->entry_size || hdr->block_size != ref->block_size ||
+	    hdr->shctx_size != ref->shctx_size || hdr->extra_size != ref->extra_size ||
+	    hdr->blocksize != ref->blocksize || hdr->size != st.st_size || !hdr->nb_shards ||
+	    hdr->area_size < shctx_area_size(hdr->maxblocks, hdr->blocksize, hdr->extra_size) ||
+	    cache_persist_hdr_len() + hdr->nb_shards * hdr->area_size > hdr->size) {
+		ha_warning("cache '%s': ignoring the contents of persist-file '%s' which was produced by another version.\n",
+		           cache->id, cache->persist_path);
+		goto end;
+	}
+
+	extra = (sizeof(struct cache_shard) + sizeof(void *) - 1) & -sizeof(void *);
+	src.map = (char *)hdr;
+	src.base = hdr->base;
+	src.blocksize = shctx_ptr(cache->shards[0])->block_size;
+	src.stride = sizeof(struct shared_block) + src.blocksize;
+
+	for (i = 0; i < hdr->nb_shards; i++) {
+		old = (struct shared_context *)(src.map + cache_persist_hdr_len() + i * hdr->area_size);
+		if (old->block_size != src.blocksize)
+			break;
+
+		src.first = (char *)old + sizeof(struct shared_context) + extra - src.map;
+		src.end = src.first + (size_t)hdr->maxblocks * src.stride;
+
+		/* the previous process may still be using this shard. We do
+		 * not wait forever since it may also have died with the lock
+		 * held.
+		 */
+		for (tries = 0; tries < 1000; tries++) {
+			if (HA_RWLOCK_TRYWRLOCK(SHCTX_LOCK, &old->lock) == 0)
+				break;
+			usleep(1000);
+		}
+		if (tries == 1000) {
+			ha_warning("cache '%s': shard %u of persist-file '%s' is locked, its objects are not reused.\n",
+			           cache->id, i, cache->persist_path);
+			continue;
+		}
+		restored += cache_persist_restore_shard(cache, &src, old);
+		HA_RWLOCK_WRUNLOCK(SHCTX_LOCK, &old->lock);
+	}
+ end:
+	munmap(hdr, st.st_size);
+	return restored;
+}
+
+/* Initializes the shard of index <idx> of <cache>, stored in <shctx> */
+static void cache_init_shard(struct cache *cache, struct shared_context *shctx, unsigned int idx)
+{
+	struct cache_shard *shard = (struct cache_shard *)shctx->data;
+
+	shctx->free_block = cache_free_blocks;
+	shard->entries = EB_ROOT;
+	LIST_INIT(&shard->waiters);
+	shard->cache = cache;
+	cache->shards[idx] = shard;
+}
+
+/* Creates the shards of <cache> in a new persist-file, fills them with the
+ * objects of the previous file if any, then replaces it. The previous process
+ * keeps on using its own file which is not visible anymore, so the objects it
+ * stores from now on are lost. Returns 0 on success, otherwise non-zero after
+ * having emitted an alert.
+ */
+static int cache_persist_init(struct cache *cache)
+{
+	unsigned int maxblocks = cache->maxblocks / cache->nb_shards;
+	struct cache_persist_hdr ref;
+	struct cache_persist_hdr *hdr;
+	struct shared_context *shctx;
+	char *tmp_path = NULL;
+	unsigned int restored;
+	unsigned int i;
+	char *area;
+	int fd;
+
+	/* the size depends on the configuration, not on the address */
+	cache_persist_fill_hdr(&ref, cache, maxblocks);
+
+	memprintf(&tmp_path, "%s.%d.tmp", cache->persist_path, (int)getpid());
+	if (!tmp_path) {
+		ha_alert("cache '%s': out of memory.\n", cache->id);
+		return 1;
+	}
+
+	fd = open(tmp_path, O_RDWR | O_CREAT | O_TRUNC, 0600);
+	if (fd < 0) {
+		ha_alert("cache '%s': cannot create persist-file '%s' (%s).\n",
+		         cache->id, tmp_path, strerror(errno));
+		goto fail;
+	}
+
+	if (ftruncate(fd, ref.size) < 0) {
+		ha_alert("cache '%s': cannot resize persist-file '%s' (%s).\n",
+		         cache->id, tmp_path, strerror(errno));
+		close(fd);
+		goto fail_unlink;
+	}
+
+	area = mmap(NULL, ref.size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (area == MAP_FAILED) {
+		ha_alert("cache '%s': cannot map persist-file '%s' (%s).\n",
+		         cache->id, tmp_path, strerror(errno));
+		goto fail_unlink;
+	}
+
+	use_shared_mem = 1;
+	hdr = (struct cache_persist_hdr *)area;
+	cache_persist_fill_hdr(hdr, cache, maxblocks);
+	for (i = 0; i < cache->nb_shards; i++) {
+		shctx = (struct shared_context *)(area + cache_persist_hdr_len() + i * hdr->area_size);
+		shctx_init_area(shctx, maxblocks, CACHE_BLOCKSIZE, cache->maxobjsz, sizeof(struct cache_shard));
+		cache_init_shard(cache, shctx, i);
+	}
+
+	restored = cache_persist_load(cache, hdr);
+
+	if (rename(tmp_path, cache->persist_path) < 0) {
+		ha_alert("cache '%s': cannot rename '%s' to '%s' (%s).\n",
+		         cache->id, tmp_path, cache->persist_path, strerror(errno));
+		goto fail_unlink;
+	}
+
+	if (restored)
+		ha_notice("cache '%s': %u objects reused from persist-file '%s'.\n",
+		          cache->id, restored, cache->persist_path);
+	free(tmp_path);
+	return 0;
+
+ fail_unlink:
+	unlink(tmp_path);
+ fail:
+	free(tmp_path);
+	return 1;
+}
+
 int post_check_cache()
 {
 	struct proxy *px;
-	struct cache *back, *cache_config, *cache;
+	struct cache *back, *cache;
 	struct shared_context *shctx;
+	unsigned int i;
 	int ret_shctx;
 	int err_code = ERR_NONE;
 
-	list_for_each_entry_safe(cache_config, back, &caches_config, list) {
+	list_for_each_entry_safe(cache, back, &caches_config, list) {
+
+		/* the cache is moved to the caches list, each of its shards
+		 * is stored in its own shctx.
+		 */
+		LIST_DELETE(&cache->list);
+		LIST_APPEND(&caches, &cache->list);
+
+		cache->shards = calloc(cache->nb_shards, sizeof(*cache->shards));
+		if (!cache->shards) {
+			ha_alert("Unable to allocate cache.\n");
+			err_code |= ERR_FATAL | ERR_ALERT;
+			goto out;
+		}
 
-		ret_shctx = shctx_init(&shctx, cache_config->maxblocks, CACHE_BLOCKSIZE,
-		                       cache_config->maxobjsz, sizeof(struct cache), 1);
+		/* a persist-file holds all the shards */
+		if (cache->persist_path && cache_persist_init(cache)) {
+			err_code |= ERR_FATAL | ERR_ALERT;
+			goto out;
+		}
 
-		if (ret_shctx <= 0) {
-			if (ret_shctx == SHCTX_E_INIT_LOCK)
-				ha_alert("Unable to initialize the lock for the cache.\n");
-			else
-				ha_alert("Unable to allocate cache.\n");
+		for (i = 0; !cache->persist_path && i < cache->nb_shards; i++) {
+			ret_shctx = shctx_init(&shctx, cache->maxblocks / cache->nb_shards, CACHE_BLOCKSIZE,
+			                       cache->maxobjsz, sizeof(struct cache_shard), 1);
+
+			if (ret_shctx <= 0) {
+				if (ret_shctx == SHCTX_E_INIT_LOCK)
+					ha_alert("Unable to initialize the lock for the cache.\n");
+				else
+					ha_alert("Unable to allocate cache.\n");
+
+				err_code |= ERR_FATAL | ERR_ALERT;
+				goto out;
+			}
+			cache_init_shard(cache, shctx, i);
+		}
 
+		if (cache->file_path && cache_file_init(cache)) {
 			err_code |= ERR_FATAL | ERR_ALERT;
 			goto out;
 		}
-		shctx->free_block = cache_free_blocks;
-		/* the cache structure is stored in the shctx and added to the
-		 * caches list, we can remove the entry from the caches_config
-		 * list */
-		memcpy(shctx->data, cache_config, sizeof(struct cache));
-		cache = (struct cache *)shctx->data;
-		cache->entries = EB_ROOT;
-		LIST_APPEND(&caches, &cache->list);
-		LIST_DELETE(&cache_config->list);
-		free(cache_config);
 
 		/* Find all references for this cache in the existing filters
 		 * (over all proxies) and reference it in matching filters.
@@ -2563,11 +4217,22 @@ static int cli_io_handler_show_cache(struct appctx *appctx)
 		struct eb32_node *node = NULL;
 		unsigned int next_key;
 		struct cache_entry *entry;
+		struct cache_shard *shard;
 		unsigned int i;
 
 		next_key = appctx->ctx.cli.i0;
-		if (!next_key) {
-			chunk_printf(&trash, "%p: %s (shctx:%p, available blocks:%d)\n", cache, cache->id, shctx_ptr(cache), shctx_ptr(cache)->nbav);
+		if (!next_key && !appctx->ctx.cli.i1) {
+			int nbav = 0;
+
+			for (i = 0; i < cache->nb_shards; i++)
+				nbav += shctx_ptr(cache->shards[i])->nbav;
+			chunk_printf(&trash, "%p: %s (shctx:%p, available blocks:%d", cache, cache->id, shctx_ptr(cache->shards[0]), nbav);
+			if (cache->nb_shards > 1)
+				chunk_appendf(&trash, ", shards:%u", cache->nb_shards);
+			chunk_appendf(&trash, ")\n");
+			if (cache->shards[0]->file_area)
+				chunk_appendf(&trash, "%p: %s (file:%s, size:%llu)\n", cache, cache->id,
+				              cache->file_path, cache->file_size);
 			if (ci_putchk(si_ic(si), &trash) == -1) {
 				si_rx_room_blk(si);
 				return 0;
@@ -2576,34 +4241,48 @@ static int cli_io_handler_show_cache(struct appctx *appctx)
 
 		appctx->ctx.cli.p0 = cache;
 
-		while (1) {
+		while (appctx->ctx.cli.i1 < cache->nb_shards) {
+			shard = cache->shards[appctx->ctx.cli.i1];
 
-			shctx_lock(shctx_ptr(cache));
+			if (!next_key && cache->nb_shards > 1) {
+				chunk_printf(&trash, "  shard %d (shctx:%p, available blocks:%d)\n",
+				             appctx->ctx.cli.i1, shctx_ptr(shard), shctx_ptr(shard)->nbav);
+				if (ci_putchk(si_ic(si), &trash) == -1) {
+					si_rx_room_blk(si);
+					return 0;
+				}
+			}
+
+			shctx_rdlock(shctx_ptr(shard));
 			if (!node || (node = eb32_next_dup(node)) == NULL)
-				node = eb32_lookup_ge(&cache->entries, next_key);
+				node = eb32_lookup_ge(&shard->entries, next_key);
 			if (!node) {
-				shctx_unlock(shctx_ptr(cache));
-				appctx->ctx.cli.i0 = 0;
-				break;
+				shctx_rdunlock(shctx_ptr(shard));
+				appctx->ctx.cli.i0 = next_key = 0;
+				appctx->ctx.cli.i1++;
+				continue;
 			}
 
 			entry = container_of(node, struct cache_entry, eb);
 			chunk_printf(&trash, "%p hash:%u vary:0x", entry, read_u32(entry->hash));
 			for (i = 0; i < HTTP_CACHE_SEC_KEY_LEN; ++i)
 				chunk_appendf(&trash, "%02x", (unsigned char)entry->secondary_key[i]);
-			chunk_appendf(&trash, " size:%u (%u blocks), refcount:%u, expire:%d\n", block_ptr(entry)->len, block_ptr(entry)->block_count, block_ptr(entry)->refcount, entry->expire - (int)now.tv_sec);
+			chunk_appendf(&trash, " size:%u (%u blocks), refcount:%u, expire:%d", block_ptr(entry)->len, block_ptr(entry)->block_count, block_ptr(entry)->refcount, entry->expire - (int)now.tv_sec);
+			if (entry->file_len)
+				chunk_appendf(&trash, ", file:%u@%llu", entry->file_len, entry->file_pos % shard->file_size);
+			chunk_appendf(&trash, "\n");
 
 			next_key = node->key + 1;
 			appctx->ctx.cli.i0 = next_key;
 
-			shctx_unlock(shctx_ptr(cache));
+			shctx_rdunlock(shctx_ptr(shard));
 
 			if (ci_putchk(si_ic(si), &trash) == -1) {
 				si_rx_room_blk(si);
 				return 0;
 			}
 		}
-
+		appctx->ctx.cli.i1 = 0;
 	}
 
 	return 1;
@@ -2639,6 +4318,15 @@ smp_fetch_res_cache_name(const struct arg *args, struct sample *smp,
 	if (!smp->strm || smp->strm->target != &http_cache_applet.obj_type)
 		return 0;
 
+	/* The response was directly built from the cache */
+	if (smp->strm->txn && smp->strm->txn->cache_name) {
+		smp->data.type = SMP_T_STR;
+		smp->flags = SMP_F_CONST;
+		smp->data.u.str.area = (char *)smp->strm->txn->cache_name;
+		smp->data.u.str.data = strlen(smp->strm->txn->cache_name);
+		return 1;
+	}
+
 	/* Get appctx from the stream_interface. */
 	appctx = si_appctx(&smp->strm->si[1]);
 	if (appctx && appctx->rule) {
@@ -2698,6 +4386,13 @@ struct applet http_cache_applet = {
 	.release = http_cache_applet_release,
 };
 
+struct applet http_cache_refresh_applet = {
+	.obj_type = OBJ_TYPE_APPLET,
+	.name = "<CACHEREFRESH>", /* used for logging */
+	.fct = http_cache_refresh_io_handler,
+	.release = http_cache_refresh_release,
+};
+
 /* config parsers for this section */
 REGISTER_CONFIG_SECTION("cache", cfg_parse_cache, cfg_post_parse_section_cache);
 REGISTER_POST_CHECK(post_check_cache);
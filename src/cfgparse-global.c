@@ -21,6 +21,7 @@
 #include <haproxy/global.h>
 #include <haproxy/log.h>
 #include <haproxy/peers.h>
+#include <haproxy/task.h>
 #include <haproxy/tools.h>
 
 /* some keywords that are still being parsed using strcmp() and are not
@@ -28,22 +29,26 @@
  */
 static const char *common_kw_list[] = {
 	"global", "daemon", "master-worker", "noepoll", "nokqueue",
-	"noevports", "nopoll", "busy-polling", "set-dumpable",
+	"noevports", "nopoll", "nouring", "busy-polling", "set-dumpable",
 	"insecure-fork-wanted", "insecure-setuid-wanted", "nosplice",
 	"nogetaddrinfo", "noreuseport", "quiet", "zero-warning",
 	"tune.runqueue-depth", "tune.maxpollevents", "tune.maxaccept",
 	"tune.recv_enough", "tune.buffers.limit",
-	"tune.buffers.reserve", "tune.bufsize", "tune.maxrewrite",
+	"tune.buffers.reserve", "tune.buffers.large-limit", "tune.bufsize",
+	"tune.bufsize.small", "tune.bufsize.large",
+	"tune.maxrewrite",
 	"tune.idletimer", "tune.rcvbuf.client", "tune.rcvbuf.server",
 	"tune.sndbuf.client", "tune.sndbuf.server", "tune.pipesize",
 	"tune.http.cookielen", "tune.http.logurilen", "tune.http.maxhdr",
 	"tune.comp.maxlevel", "tune.pattern.cache-size", "uid", "gid",
-	"external-check", "user", "group", "nbproc", "nbthread", "maxconn",
+	"external-check", "user", "group", "nbproc", "nbthread", "thread-groups",
+	"task-class", "maxconn",
 	"ssl-server-verify", "maxconnrate", "maxsessrate", "maxsslrate",
 	"maxcomprate", "maxpipes", "maxzlibmem", "maxcompcpuusage", "ulimit-n",
 	"chroot", "description", "node", "pidfile", "unix-bind", "log",
 	"log-send-hostname", "server-state-base", "server-state-file",
-	"log-tag", "spread-checks", "max-spread-checks", "cpu-map", "setenv",
+	"log-tag", "spread-checks", "max-spread-checks", "cpu-map", "cpu-policy",
+	"setenv",
 	"presetenv", "unsetenv", "resetenv", "strict-limits", "localpeer",
 	"numa-cpu-mapping", "defaults", "listen", "frontend", "backend",
 	"peers", "resolvers",
@@ -97,6 +102,11 @@ int cfg_parse_global(const char *file, int linenum, char **args, int kwm)
 			goto out;
 		global.tune.options &= ~GTUNE_USE_EPOLL;
 	}
+	else if (strcmp(args[0], "nouring") == 0) {
+		if (alertif_too_many_args(0, file, linenum, args, &err_code))
+			goto out;
+		global.tune.options &= ~GTUNE_USE_URING;
+	}
 	else if (strcmp(args[0], "nokqueue") == 0) {
 		if (alertif_too_many_args(0, file, linenum, args, &err_code))
 			goto out;
@@ -285,6 +295,55 @@ int cfg_parse_global(const char *file, int linenum, char **args, int kwm)
 			goto out;
 		}
 	}
+	else if (strcmp(args[0], "tune.bufsize.small") == 0) {
+		if (alertif_too_many_args(1, file, linenum, args, &err_code))
+			goto out;
+		if (*(args[1]) == 0) {
+			ha_alert("parsing [%s:%d] : '%s' expects an integer argument.\n", file, linenum, args[0]);
+			err_code |= ERR_ALERT | ERR_FATAL;
+			goto out;
+		}
+		global.tune.bufsize_small = atol(args[1]);
+		/* same alignment constraints as for regular buffers */
+		global.tune.bufsize_small = (global.tune.bufsize_small + 2 * sizeof(void *) - 1) & -(2 * sizeof(void *));
+		if (global.tune.bufsize_small < 0) {
+			ha_alert("parsing [%s:%d] : '%s' expects a positive integer argument or zero.\n", file, linenum, args[0]);
+			err_code |= ERR_ALERT | ERR_FATAL;
+			goto out;
+		}
+	}
+	else if (strcmp(args[0], "tune.bufsize.large") == 0) {
+		if (alertif_too_many_args(1, file, linenum, args, &err_code))
+			goto out;
+		if (*(args[1]) == 0) {
+			ha_alert("parsing [%s:%d] : '%s' expects an integer argument.\n", file, linenum, args[0]);
+			err_code |= ERR_ALERT | ERR_FATAL;
+			goto out;
+		}
+		global.tune.bufsize_large = atol(args[1]);
+		/* same alignment constraints as for regular buffers */
+		global.tune.bufsize_large = (global.tune.bufsize_large + 2 * sizeof(void *) - 1) & -(2 * sizeof(void *));
+		if (global.tune.bufsize_large < 0) {
+			ha_alert("parsing [%s:%d] : '%s' expects a positive integer argument or zero.\n", file, linenum, args[0]);
+			err_code |= ERR_ALERT | ERR_FATAL;
+			goto out;
+		}
+	}
+	else if (strcmp(args[0], "tune.buffers.large-limit") == 0) {
+		if (alertif_too_many_args(1, file, linenum, args, &err_code))
+			goto out;
+		if (*(args[1]) == 0) {
+			ha_alert("parsing [%s:%d] : '%s' expects an integer argument.\n", file, linenum, args[0]);
+			err_code |= ERR_ALERT | ERR_FATAL;
+			goto out;
+		}
+		global.tune.large_buf_limit = atol(args[1]);
+		if (global.tune.large_buf_limit <= 0) {
+			ha_alert("parsing [%s:%d] : '%s' expects a strictly positive integer argument.\n", file, linenum, args[0]);
+			err_code |= ERR_ALERT | ERR_FATAL;
+			goto out;
+		}
+	}
 	else if (strcmp(args[0], "tune.maxrewrite") == 0) {
 		if (alertif_too_many_args(1, file, linenum, args, &err_code))
 			goto out;
@@ -589,6 +648,48 @@ int cfg_parse_global(const char *file, int linenum, char **args, int kwm)
 			goto out;
 		}
 	}
+	else if (strcmp(args[0], "thread-groups") == 0) {
+		if (alertif_too_many_args(1, file, linenum, args, &err_code))
+			goto out;
+		if (*(args[1]) == 0) {
+			ha_alert("parsing [%s:%d] : '%s' expects an integer argument.\n", file, linenum, args[0]);
+			err_code |= ERR_ALERT | ERR_FATAL;
+			goto out;
+		}
+
+		global.nbtgroups = parse_nbtgroups(args[1], &errmsg);
+		if (!global.nbtgroups) {
+			ha_alert("parsing [%s:%d] : '%s' %s.\n",
+				 file, linenum, args[0], errmsg);
+			err_code |= ERR_ALERT | ERR_FATAL;
+			goto out;
+		}
+	}
+	else if (strcmp(args[0], "task-class") == 0) {
+		unsigned long thread = 0;
+		int cls, arg;
+
+		for (cls = 0; cls < TASK_CLASSES; cls++) {
+			if (strcmp(args[1], task_class_names[cls]) == 0)
+				break;
+		}
+		if (cls == TASK_CLASSES || !*args[2]) {
+			ha_alert("parsing [%s:%d] : '%s' expects a class among 'io', 'bulk' and 'crypto', followed by a set of threads.\n",
+				 file, linenum, args[0]);
+			err_code |= ERR_ALERT | ERR_FATAL;
+			goto out;
+		}
+
+		for (arg = 2; *args[arg]; arg++) {
+			if (parse_process_number(args[arg], &thread, MAX_THREADS, NULL, &errmsg)) {
+				ha_alert("parsing [%s:%d] : '%s %s' : %s.\n",
+					 file, linenum, args[0], args[1], errmsg);
+				err_code |= ERR_ALERT | ERR_FATAL;
+				goto out;
+			}
+		}
+		task_class_mask[cls] = thread;
+	}
 	else if (strcmp(args[0], "maxconn") == 0) {
 		if (alertif_too_many_args(1, file, linenum, args, &err_code))
 			goto out;
@@ -1124,6 +1225,27 @@ int cfg_parse_global(const char *file, int linenum, char **args, int kwm)
 			 file, linenum, args[0]);
 		err_code |= ERR_ALERT | ERR_FATAL;
 		goto out;
+#endif /* ! USE_CPU_AFFINITY */
+	}
+	else if (strcmp(args[0], "cpu-policy") == 0) {
+		if (alertif_too_many_args(1, file, linenum, args, &err_code))
+			goto out;
+#ifdef USE_CPU_AFFINITY
+		if (strcmp(args[1], "none") == 0)
+			global.cpu_policy = CPU_POLICY_NONE;
+		else if (strcmp(args[1], "auto") == 0)
+			global.cpu_policy = CPU_POLICY_AUTO;
+		else {
+			ha_alert("parsing [%s:%d] : '%s' expects 'none' or 'auto'.\n",
+				 file, linenum, args[0]);
+			err_code |= ERR_ALERT | ERR_FATAL;
+			goto out;
+		}
+#else
+		ha_alert("parsing [%s:%d] : '%s' is not enabled, please check build options for USE_CPU_AFFINITY.\n",
+			 file, linenum, args[0]);
+		err_code |= ERR_ALERT | ERR_FATAL;
+		goto out;
 #endif /* ! USE_CPU_AFFINITY */
 	}
 	else if (strcmp(args[0], "setenv") == 0 || strcmp(args[0], "presetenv") == 0) {
@@ -398,8 +398,11 @@ int cfg_parse_listen(const char *file, int linenum, char **args, int kwm)
 		/* NOTE: the following line might create several listeners if there
 		 * are comma-separated IPs or port ranges. So all further processing
 		 * will have to be applied to all listeners created after last_listen.
+		 * Proxies in UDP mode receive datagrams instead of connections.
 		 */
-		if (!str2listener(args[1], curproxy, bind_conf, file, linenum, &errmsg)) {
+		if (!(curproxy->mode == PR_MODE_UDP ?
+		      str2receiver(args[1], curproxy, bind_conf, file, linenum, &errmsg) :
+		      str2listener(args[1], curproxy, bind_conf, file, linenum, &errmsg))) {
 			if (errmsg && *errmsg) {
 				indent_msg(&errmsg, 2);
 				ha_alert("parsing [%s:%d] : '%s' : %s\n", file, linenum, args[0], errmsg);
@@ -507,6 +510,7 @@ int cfg_parse_listen(const char *file, int linenum, char **args, int kwm)
 
 		if (strcmp(args[1], "http") == 0) curproxy->mode = PR_MODE_HTTP;
 		else if (strcmp(args[1], "tcp") == 0) curproxy->mode = PR_MODE_TCP;
+		else if (strcmp(args[1], "udp") == 0) curproxy->mode = PR_MODE_UDP;
 		else if (strcmp(args[1], "health") == 0) {
 			ha_alert("parsing [%s:%d] : 'mode health' doesn't exist anymore. Please use 'http-request return status 200' instead.\n", file, linenum);
 			err_code |= ERR_ALERT | ERR_FATAL;
@@ -2354,27 +2358,27 @@ int cfg_parse_listen(const char *file, int linenum, char **args, int kwm)
 			/* enable a graceful server shutdown on an HTTP 404 response */
 			curproxy->options &= ~PR_O_REUSE_MASK;
 			curproxy->options |= PR_O_REUSE_NEVR;
-			if (alertif_too_many_args_idx(0, 1, file, linenum, args, &err_code))
+			if (alertif_too_many_args_idx(1, 1, file, linenum, args, &err_code))
 				goto out;
 		}
 		else if (strcmp(args[1], "safe") == 0) {
 			/* enable a graceful server shutdown on an HTTP 404 response */
 			curproxy->options &= ~PR_O_REUSE_MASK;
 			curproxy->options |= PR_O_REUSE_SAFE;
-			if (alertif_too_many_args_idx(0, 1, file, linenum, args, &err_code))
+			if (alertif_too_many_args_idx(1, 1, file, linenum, args, &err_code))
 				goto out;
 		}
 		else if (strcmp(args[1], "aggressive") == 0) {
 			curproxy->options &= ~PR_O_REUSE_MASK;
 			curproxy->options |= PR_O_REUSE_AGGR;
-			if (alertif_too_many_args_idx(0, 1, file, linenum, args, &err_code))
+			if (alertif_too_many_args_idx(1, 1, file, linenum, args, &err_code))
 				goto out;
 		}
 		else if (strcmp(args[1], "always") == 0) {
 			/* enable a graceful server shutdown on an HTTP 404 response */
 			curproxy->options &= ~PR_O_REUSE_MASK;
 			curproxy->options |= PR_O_REUSE_ALWS;
-			if (alertif_too_many_args_idx(0, 1, file, linenum, args, &err_code))
+			if (alertif_too_many_args_idx(1, 1, file, linenum, args, &err_code))
 				goto out;
 		}
 		else {
@@ -2382,6 +2386,19 @@ int cfg_parse_listen(const char *file, int linenum, char **args, int kwm)
 			err_code |= ERR_ALERT | ERR_FATAL;
 			goto out;
 		}
+
+		curproxy->options2 &= ~PR_O2_REUSE_POL;
+		if (!*args[2])
+			curproxy->options2 |= PR_O2_REUSE_FIRST;
+		else if (strcmp(args[2], "pack") == 0)
+			curproxy->options2 |= PR_O2_REUSE_PACK;
+		else if (strcmp(args[2], "spread") == 0)
+			curproxy->options2 |= PR_O2_REUSE_SPREAD;
+		else {
+			ha_alert("parsing [%s:%d] : '%s %s' only supports 'pack' and 'spread' as policy.\n", file, linenum, args[0], args[1]);
+			err_code |= ERR_ALERT | ERR_FATAL;
+			goto out;
+		}
 	}
 	else if (strcmp(args[0], "monitor") == 0) {
 		if (curproxy->cap & PR_CAP_DEF) {
@@ -2510,9 +2527,10 @@ int cfg_parse_listen(const char *file, int linenum, char **args, int kwm)
 	else if (strcmp(args[0], "hash-type") == 0) { /* set hashing method */
 		/**
 		 * The syntax for hash-type config element is
-		 * hash-type {map-based|consistent} [[<algo>] avalanche]
+		 * hash-type {map-based|consistent|maglev} [[<algo>] avalanche]
 		 *
-		 * The default hash function is sdbm for map-based and sdbm+avalanche for consistent.
+		 * The default hash function is sdbm for map-based and sdbm+avalanche for consistent
+		 * and maglev.
 		 */
 		curproxy->lbprm.algo &= ~(BE_LB_HASH_TYPE | BE_LB_HASH_FUNC | BE_LB_HASH_MOD);
 
@@ -2525,13 +2543,16 @@ int cfg_parse_listen(const char *file, int linenum, char **args, int kwm)
 		else if (strcmp(args[1], "map-based") == 0) {	/* use map-based hashing */
 			curproxy->lbprm.algo |= BE_LB_HASH_MAP;
 		}
+		else if (strcmp(args[1], "maglev") == 0) {	/* use a Maglev lookup table */
+			curproxy->lbprm.algo |= BE_LB_HASH_MAGLEV;
+		}
 		else if (strcmp(args[1], "avalanche") == 0) {
 			ha_alert("parsing [%s:%d] : experimental feature '%s %s' is not supported anymore, please use '%s map-based sdbm avalanche' instead.\n", file, linenum, args[0], args[1], args[0]);
 			err_code |= ERR_ALERT | ERR_FATAL;
 			goto out;
 		}
 		else {
-			ha_alert("parsing [%s:%d] : '%s' only supports 'consistent' and 'map-based'.\n", file, linenum, args[0]);
+			ha_alert("parsing [%s:%d] : '%s' only supports 'consistent', 'map-based' and 'maglev'.\n", file, linenum, args[0]);
 			err_code |= ERR_ALERT | ERR_FATAL;
 			goto out;
 		}
@@ -2541,8 +2562,8 @@ int cfg_parse_listen(const char *file, int linenum, char **args, int kwm)
 			/* the default algo is sdbm */
 			curproxy->lbprm.algo |= BE_LB_HFCN_SDBM;
 
-			/* if consistent with no argument, then avalanche modifier is also applied */
-			if ((curproxy->lbprm.algo & BE_LB_HASH_TYPE) == BE_LB_HASH_CONS)
+			/* if consistent or maglev with no argument, then avalanche modifier is also applied */
+			if ((curproxy->lbprm.algo & BE_LB_HASH_TYPE) != BE_LB_HASH_MAP)
 				curproxy->lbprm.algo |= BE_LB_HMOD_AVAL;
 		} else {
 			/* set the hash function */
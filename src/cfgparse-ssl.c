@@ -136,6 +136,66 @@ static int ssl_parse_global_ssl_async(char **args, int section_type, struct prox
 #endif
 }
 
+/* parse the "tune.ssl.async-workers" keyword in global section.
+ * Returns <0 on alert, >0 on warning, 0 on success.
+ */
+static int ssl_parse_global_async_workers(char **args, int section_type, struct proxy *curpx,
+                                          const struct proxy *defpx, const char *file, int line,
+                                          char **err)
+{
+#ifdef HAVE_SSL_ASYNC_WORKERS
+	if (too_many_args(1, args, err, NULL))
+		return -1;
+
+	if (*(args[1]) == 0) {
+		memprintf(err, "'%s' expects a number of threads between 0 and %d.", args[0], MAX_THREADS);
+		return -1;
+	}
+
+	global_ssl.async_workers = atoi(args[1]);
+	if (global_ssl.async_workers < 0 || global_ssl.async_workers > MAX_THREADS) {
+		memprintf(err, "'%s' expects a number of threads between 0 and %d.", args[0], MAX_THREADS);
+		return -1;
+	}
+
+	/* the workers rely on the async mode */
+	if (global_ssl.async_workers)
+		global_ssl.async = 1;
+	return 0;
+#else
+	memprintf(err, "'%s': not supported by this build (requires threads and an openssl library supporting async mode).", args[0]);
+	return -1;
+#endif
+}
+
+/* parse the "tune.ssl.load-threads" keyword in global section.
+ * Returns <0 on alert, >0 on warning, 0 on success.
+ */
+static int ssl_parse_global_load_threads(char **args, int section_type, struct proxy *curpx,
+                                         const struct proxy *defpx, const char *file, int line,
+                                         char **err)
+{
+#ifdef USE_THREAD
+	if (too_many_args(1, args, err, NULL))
+		return -1;
+
+	if (*(args[1]) == 0) {
+		memprintf(err, "'%s' expects a number of threads between 1 and %d.", args[0], MAX_THREADS);
+		return -1;
+	}
+
+	global_ssl.load_threads = atoi(args[1]);
+	if (global_ssl.load_threads < 1 || global_ssl.load_threads > MAX_THREADS) {
+		memprintf(err, "'%s' expects a number of threads between 1 and %d.", args[0], MAX_THREADS);
+		return -1;
+	}
+	return 0;
+#else
+	memprintf(err, "'%s': not supported by this build (requires threads).", args[0]);
+	return -1;
+#endif
+}
+
 #ifndef OPENSSL_NO_ENGINE
 /* parse the "ssl-engine" keyword in global section.
  * Returns <0 on alert, >0 on warning, 0 on success.
@@ -255,6 +315,29 @@ static int ssl_parse_global_curves(char **args, int section_type, struct proxy *
 	return 0;
 }
 #endif
+/* parse the "tune.ssl.cache-shards" keyword in global section.
+ * Returns <0 on alert, >0 on warning, 0 on success.
+ */
+static int ssl_parse_global_cache_shards(char **args, int section_type, struct proxy *curpx,
+                                         const struct proxy *defpx, const char *file, int line,
+                                         char **err)
+{
+	if (too_many_args(1, args, err, NULL))
+		return -1;
+
+	if (*(args[1]) == 0) {
+		memprintf(err, "'%s' expects a number of shards between 1 and %d.", args[0], MAX_SSL_CACHE_SHARDS);
+		return -1;
+	}
+
+	global_ssl.cache_shards = atoi(args[1]);
+	if (global_ssl.cache_shards < 1 || global_ssl.cache_shards > MAX_SSL_CACHE_SHARDS) {
+		memprintf(err, "'%s' expects a number of shards between 1 and %d.", args[0], MAX_SSL_CACHE_SHARDS);
+		return -1;
+	}
+	return 0;
+}
+
 /* parse various global tune.ssl settings consisting in positive integers.
  * Returns <0 on alert, >0 on warning, 0 on success.
  */
@@ -274,6 +357,8 @@ static int ssl_parse_global_int(char **args, int section_type, struct proxy *cur
 		target = &global.maxsslconn;
 	else if (strcmp(args[0], "tune.ssl.capture-cipherlist-size") == 0)
 		target = &global_ssl.capture_cipherlist;
+	else if (strcmp(args[0], "tune.ssl.lazy-cache-size") == 0)
+		target = &global_ssl.lazy_cache_size;
 	else {
 		memprintf(err, "'%s' keyword not unhandled (please report this bug).", args[0]);
 		return -1;
@@ -893,6 +978,18 @@ static int bind_parse_no_tls_tickets(char **args, int cur_arg, struct proxy *px,
 	return 0;
 }
 
+/* parse the "ktls" bind keyword */
+static int bind_parse_ktls(char **args, int cur_arg, struct proxy *px, struct bind_conf *conf, char **err)
+{
+#ifdef HAVE_SSL_KTLS
+	conf->ssl_options |= BC_SSL_O_KTLS;
+	return 0;
+#else
+	memprintf(err, "'%s' : library does not support kernel TLS offload", args[cur_arg]);
+	return ERR_ALERT | ERR_FATAL;
+#endif
+}
+
 /* parse the "allow-0rtt" bind keyword */
 static int ssl_bind_parse_allow_0rtt(char **args, int cur_arg, struct proxy *px, struct ssl_bind_conf *conf, int from_cli, char **err)
 {
@@ -1114,8 +1211,18 @@ static int bind_parse_tls_ticket_keys(char **args, int cur_arg, struct proxy *px
 		goto fail;
 	}
 
+	if (conf->keys_ref) {
+		memprintf(err, "'%s' : TLS ticket keys already set on this bind line", args[cur_arg]);
+		goto fail;
+	}
+
 	keys_ref = tlskeys_ref_lookup(args[cur_arg + 1]);
 	if (keys_ref) {
+		if (keys_ref->sync) {
+			memprintf(err, "'%s' : '%s' is already used as a TLS ticket keys table", args[cur_arg], args[cur_arg+1]);
+			keys_ref = NULL;
+			goto fail;
+		}
 		keys_ref->refcount++;
 		conf->keys_ref = keys_ref;
 		return 0;
@@ -1211,6 +1318,71 @@ static int bind_parse_tls_ticket_keys(char **args, int cur_arg, struct proxy *px
 #endif /* SSL_CTRL_SET_TLSEXT_TICKET_KEY_CB */
 }
 
+/* parse the "tls-ticket-keys-table" bind keyword */
+static int bind_parse_tls_ticket_keys_table(char **args, int cur_arg, struct proxy *px, struct bind_conf *conf, char **err)
+{
+#if (defined SSL_CTRL_SET_TLSEXT_TICKET_KEY_CB && TLS_TICKETS_NO > 0)
+	struct tls_keys_ref *keys_ref = NULL;
+
+	if (!*args[cur_arg + 1]) {
+		memprintf(err, "'%s' : missing table name", args[cur_arg]);
+		goto fail;
+	}
+
+	if (conf->keys_ref) {
+		memprintf(err, "'%s' : TLS ticket keys already set on this bind line", args[cur_arg]);
+		goto fail;
+	}
+
+	keys_ref = tlskeys_ref_lookup(args[cur_arg + 1]);
+	if (keys_ref) {
+		if (!keys_ref->sync) {
+			memprintf(err, "'%s' : '%s' is already used as a TLS ticket keys file", args[cur_arg], args[cur_arg+1]);
+			keys_ref = NULL;
+			goto fail;
+		}
+		keys_ref->refcount++;
+		conf->keys_ref = keys_ref;
+		return 0;
+	}
+
+	keys_ref = calloc(1, sizeof(*keys_ref));
+	if (!keys_ref) {
+		memprintf(err, "'%s' : allocation error", args[cur_arg+1]);
+		goto fail;
+	}
+
+	keys_ref->tlskeys = calloc(TLS_TICKETS_NO, sizeof(union tls_sess_key));
+	keys_ref->filename = strdup(args[cur_arg + 1]);
+	if (!keys_ref->tlskeys || !keys_ref->filename) {
+		memprintf(err, "'%s' : allocation error", args[cur_arg+1]);
+		goto fail;
+	}
+
+	/* the keys and their size are set once the table is resolved */
+	keys_ref->sync = 1;
+	keys_ref->unique_id = -1;
+	keys_ref->refcount = 1;
+	HA_RWLOCK_INIT(&keys_ref->lock);
+	conf->keys_ref = keys_ref;
+
+	LIST_INSERT(&tlskeys_reference, &keys_ref->list);
+
+	return 0;
+
+  fail:
+	if (keys_ref) {
+		free(keys_ref->filename);
+		free(keys_ref->tlskeys);
+		free(keys_ref);
+	}
+	return ERR_ALERT | ERR_FATAL;
+#else
+	memprintf(err, "'%s' : TLS ticket callback extension not supported", args[cur_arg]);
+	return ERR_ALERT | ERR_FATAL;
+#endif /* SSL_CTRL_SET_TLSEXT_TICKET_KEY_CB */
+}
+
 /* parse the "verify" bind keyword */
 static int ssl_bind_parse_verify(char **args, int cur_arg, struct proxy *px, struct ssl_bind_conf *conf, int from_cli, char **err)
 {
@@ -1531,6 +1703,19 @@ static int srv_parse_no_tls_tickets(char **args, int *cur_arg, struct proxy *px,
 	newsrv->ssl_ctx.options |= SRV_SSL_O_NO_TLS_TICKETS;
 	return 0;
 }
+
+/* parse the "ktls" server keyword */
+static int srv_parse_ktls(char **args, int *cur_arg, struct proxy *px, struct server *newsrv, char **err)
+{
+#ifdef HAVE_SSL_KTLS
+	newsrv->ssl_ctx.options |= SRV_SSL_O_KTLS;
+	return 0;
+#else
+	memprintf(err, "'%s' : library does not support kernel TLS offload", args[*cur_arg]);
+	return ERR_ALERT | ERR_FATAL;
+#endif
+}
+
 /* parse the "send-proxy-v2-ssl" server keyword */
 static int srv_parse_send_proxy_ssl(char **args, int *cur_arg, struct proxy *px, struct server *newsrv, char **err)
 {
@@ -1730,6 +1915,53 @@ static int ssl_parse_skip_self_issued_ca(char **args, int section_type, struct p
 #endif
 }
 
+/* parse the "tune.ssl.ticket-rotate" keyword in global section.
+ * Returns <0 on alert, >0 on warning, 0 on success.
+ */
+static int ssl_parse_global_ticket_rotate(char **args, int section_type, struct proxy *curpx,
+                                          const struct proxy *defpx, const char *file, int line,
+                                          char **err)
+{
+	const char *res;
+
+	if (too_many_args(1, args, err, NULL))
+		return -1;
+
+	if (*(args[1]) == 0) {
+		memprintf(err, "'%s' expects a rotation period in seconds as argument.", args[0]);
+		return -1;
+	}
+
+	res = parse_time_err(args[1], &global_ssl.ticket_rotate, TIME_UNIT_S);
+	if (res == PARSE_TIME_OVER) {
+		memprintf(err, "timer overflow in argument '%s' to <%s> (maximum value is 2147483647 s or ~68 years).",
+			  args[1], args[0]);
+		return -1;
+	}
+	else if (res == PARSE_TIME_UNDER || (!res && !global_ssl.ticket_rotate)) {
+		memprintf(err, "timer underflow in argument '%s' to <%s> (minimum value is 1 s).",
+			  args[1], args[0]);
+		return -1;
+	}
+	else if (res) {
+		memprintf(err, "unexpected character '%c' in argument to <%s>.", *res, args[0]);
+		return -1;
+	}
+	return 0;
+}
+
+/* parse the "ssl-lazy-load" keyword in global section.  */
+static int ssl_parse_global_lazy_load(char **args, int section_type, struct proxy *curpx,
+				      const struct proxy *defpx, const char *file, int line,
+				      char **err)
+{
+	if (too_many_args(0, args, err, NULL))
+		return -1;
+
+	global_ssl.lazy_load = 1;
+	return 0;
+}
+
 
 
 
@@ -1790,6 +2022,7 @@ static struct bind_kw_list bind_kws = { "SSL", { }, {
 	{ "force-tlsv12",          bind_parse_tls_method_options, 0 }, /* force TLSv12 */
 	{ "force-tlsv13",          bind_parse_tls_method_options, 0 }, /* force TLSv13 */
 	{ "generate-certificates", bind_parse_generate_certs,     0 }, /* enable the server certificates generation */
+	{ "ktls",                  bind_parse_ktls,               0 }, /* let the kernel handle the crypto after the handshake */
 	{ "no-ca-names",           bind_parse_no_ca_names,        0 }, /* do not send ca names to clients (ca_file related) */
 	{ "no-sslv3",              bind_parse_tls_method_options, 0 }, /* disable SSLv3 */
 	{ "no-tlsv10",             bind_parse_tls_method_options, 0 }, /* disable TLSv10 */
@@ -1802,6 +2035,7 @@ static struct bind_kw_list bind_kws = { "SSL", { }, {
 	{ "ssl-max-ver",           bind_parse_tls_method_minmax,  1 }, /* maximum version */
 	{ "strict-sni",            bind_parse_strict_sni,         0 }, /* refuse negotiation if sni doesn't match a certificate */
 	{ "tls-ticket-keys",       bind_parse_tls_ticket_keys,    1 }, /* set file to load TLS ticket keys from */
+	{ "tls-ticket-keys-table", bind_parse_tls_ticket_keys_table, 1 }, /* set table to synchronize TLS ticket keys through */
 	{ "verify",                bind_parse_verify,             1 }, /* set SSL verify method */
 	{ "npn",                   bind_parse_npn,                1 }, /* set NPN supported protocols */
 	{ "prefer-client-ciphers", bind_parse_pcc,                0 }, /* prefer client ciphers */
@@ -1835,6 +2069,7 @@ static struct srv_kw_list srv_kws = { "SSL", { }, {
 	{ "force-tlsv11",            srv_parse_tls_method_options, 0, 1, 0 }, /* force TLSv11 */
 	{ "force-tlsv12",            srv_parse_tls_method_options, 0, 1, 0 }, /* force TLSv12 */
 	{ "force-tlsv13",            srv_parse_tls_method_options, 0, 1, 0 }, /* force TLSv13 */
+	{ "ktls",                    srv_parse_ktls,               0, 1, 0 }, /* let the kernel handle the crypto after the handshake */
 	{ "no-check-ssl",            srv_parse_no_check_ssl,       0, 1, 0 }, /* disable SSL for health checks */
 	{ "no-send-proxy-v2-ssl",    srv_parse_no_send_proxy_ssl,  0, 1, 0 }, /* do not send PROXY protocol header v2 with SSL info */
 	{ "no-send-proxy-v2-ssl-cn", srv_parse_no_send_proxy_cn,   0, 1, 0 }, /* do not send PROXY protocol header v2 with CN */
@@ -1872,19 +2107,25 @@ static struct cfg_kw_list cfg_kws = {ILH, {
 #ifndef OPENSSL_NO_DH
 	{ CFG_GLOBAL, "ssl-dh-param-file", ssl_parse_global_dh_param_file },
 #endif
+	{ CFG_GLOBAL, "ssl-lazy-load", ssl_parse_global_lazy_load },
 	{ CFG_GLOBAL, "ssl-mode-async",  ssl_parse_global_ssl_async },
 #ifndef OPENSSL_NO_ENGINE
 	{ CFG_GLOBAL, "ssl-engine",  ssl_parse_global_ssl_engine },
 #endif
 	{ CFG_GLOBAL, "ssl-skip-self-issued-ca", ssl_parse_skip_self_issued_ca },
+	{ CFG_GLOBAL, "tune.ssl.async-workers", ssl_parse_global_async_workers },
+	{ CFG_GLOBAL, "tune.ssl.cache-shards", ssl_parse_global_cache_shards },
 	{ CFG_GLOBAL, "tune.ssl.cachesize", ssl_parse_global_int },
 #ifndef OPENSSL_NO_DH
 	{ CFG_GLOBAL, "tune.ssl.default-dh-param", ssl_parse_global_default_dh },
 #endif
 	{ CFG_GLOBAL, "tune.ssl.force-private-cache",  ssl_parse_global_private_cache },
+	{ CFG_GLOBAL, "tune.ssl.lazy-cache-size", ssl_parse_global_int },
 	{ CFG_GLOBAL, "tune.ssl.lifetime", ssl_parse_global_lifetime },
+	{ CFG_GLOBAL, "tune.ssl.load-threads", ssl_parse_global_load_threads },
 	{ CFG_GLOBAL, "tune.ssl.maxrecord", ssl_parse_global_int },
 	{ CFG_GLOBAL, "tune.ssl.ssl-ctx-cache-size", ssl_parse_global_int },
+	{ CFG_GLOBAL, "tune.ssl.ticket-rotate", ssl_parse_global_ticket_rotate },
 	{ CFG_GLOBAL, "tune.ssl.capture-cipherlist-size", ssl_parse_global_capture_cipherlist },
 	{ CFG_GLOBAL, "tune.ssl.keylog", ssl_parse_global_keylog },
 	{ CFG_GLOBAL, "ssl-default-bind-ciphers", ssl_parse_global_ciphers },
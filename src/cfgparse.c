@@ -59,6 +59,8 @@
 #include <haproxy/lb_fas.h>
 #include <haproxy/lb_fwlc.h>
 #include <haproxy/lb_fwrr.h>
+#include <haproxy/lb_local.h>
+#include <haproxy/lb_maglev.h>
 #include <haproxy/lb_map.h>
 #include <haproxy/listener.h>
 #include <haproxy/log.h>
@@ -693,6 +695,7 @@ static struct peer *cfg_peers_add_peer(struct peers *peers,
 
 	/* the peers are linked backwards first */
 	peers->count++;
+	p->relay_id = peers->count;
 	p->next = peers->remote;
 	peers->remote = p;
 	p->conf.file = strdup(file);
@@ -1067,6 +1070,33 @@ int cfg_parse_peers(const char *file, int linenum, char **args, int kwm)
 	else if (strcmp(args[0], "enabled") == 0) {  /* enables this peers section (used to revert a disabled default) */
 		curpeers->disabled = 0;
 	}
+	else if (strcmp(args[0], "hub") == 0) { /* peers relaying the updates of the others */
+		struct peer *p;
+		int cur_arg;
+
+		if (!*args[1]) {
+			ha_alert("parsing [%s:%d] : '%s' expects at least one peer name.\n", file, linenum, args[0]);
+			err_code |= ERR_ALERT | ERR_FATAL;
+			goto out;
+		}
+
+		for (cur_arg = 1; *args[cur_arg]; cur_arg++) {
+			for (p = curpeers->remote; p; p = p->next) {
+				if (p->id && strcmp(p->id, args[cur_arg]) == 0)
+					break;
+			}
+			if (!p) {
+				ha_alert("parsing [%s:%d] : '%s' : unknown peer '%s', it must be declared first.\n",
+				         file, linenum, args[0], args[cur_arg]);
+				err_code |= ERR_ALERT | ERR_FATAL;
+				goto out;
+			}
+			if (!p->hub) {
+				p->hub = 1;
+				curpeers->nb_hubs++;
+			}
+		}
+	}
 	else if (*args[0] != 0) {
 		ha_alert("parsing [%s:%d] : unknown keyword '%s' in '%s' section\n", file, linenum, args[0], cursection);
 		err_code |= ERR_ALERT | ERR_FATAL;
@@ -2318,9 +2348,11 @@ int readcfgfile(const char *file)
 		}
 
 		if (pcs && pcs->post_section_parser) {
+			uint64_t start = now_mono_time();
 			int status;
 
 			status = pcs->post_section_parser();
+			pcs->parse_time += now_mono_time() - start;
 			err_code |= status;
 			if (status & ERR_FATAL)
 				fatal++;
@@ -2335,9 +2367,11 @@ int readcfgfile(const char *file)
 			err_code |= ERR_ALERT | ERR_FATAL;
 			fatal++;
 		} else {
+			uint64_t start = now_mono_time();
 			int status;
 
 			status = cs->section_parser(file, linenum, args, kwm);
+			cs->parse_time += now_mono_time() - start;
 			err_code |= status;
 			if (status & ERR_FATAL)
 				fatal++;
@@ -2354,8 +2388,12 @@ int readcfgfile(const char *file)
 	}
 
 	ha_free(&global.cfg_curr_section);
-	if (cs && cs->post_section_parser)
+	if (cs && cs->post_section_parser) {
+		uint64_t start = now_mono_time();
+
 		err_code |= cs->post_section_parser();
+		cs->parse_time += now_mono_time() - start;
+	}
 
 	if (nested_cond_lvl) {
 		ha_alert("parsing [%s:%d]: non-terminated '.if' block.\n", file, linenum);
@@ -2605,6 +2643,47 @@ int check_config_validity()
 #endif
 	}
 
+#if defined(USE_THREAD) && defined(USE_CPU_AFFINITY)
+	if (global.cpu_policy == CPU_POLICY_AUTO) {
+		int thr, cpus;
+
+		for (thr = 0; thr < MAX_THREADS; thr++)
+			if (ha_cpuset_count(&cpu_map.thread[thr]))
+				break;
+
+		if (thr < MAX_THREADS)
+			ha_warning("'cpu-policy auto' ignored because some threads are already bound by 'cpu-map'.\n");
+		else if (!(cpus = ha_cpuset_auto_map(cpu_map.thread, global.nbthread)))
+			ha_warning("'cpu-policy auto' ignored because the CPU topology could not be retrieved.\n");
+		else
+			ha_diag_warning("cpu-policy auto: %d thread(s) automatically bound to %d CPU(s)\n", global.nbthread, cpus);
+	}
+#endif
+
+	/* the threads are known now, they may be split into groups */
+	thread_map_to_groups();
+
+	/* the task classes may only use existing threads. Unless it is set,
+	 * the "io" class gets the threads which are not dedicated to another
+	 * class, if any.
+	 */
+	for (i = 0; i < TASK_CLASSES; i++) {
+		if (task_class_mask[i] & ~all_threads_mask) {
+			ha_alert("'task-class %s' refers to threads out of the range defined by the global 'nbthread' directive (%d).\n",
+				 task_class_names[i], global.nbthread);
+			cfgerr++;
+		}
+	}
+
+	if (!task_class_mask[TASK_CLASS_IO]) {
+		unsigned long mask = all_threads_mask;
+
+		for (i = TASK_CLASS_IO + 1; i < TASK_CLASSES; i++)
+			mask &= ~task_class_mask[i];
+		if (mask != all_threads_mask)
+			task_class_mask[TASK_CLASS_IO] = mask;
+	}
+
 	pool_head_requri = create_pool("requri", global.tune.requri_len , MEM_F_SHARED);
 
 	pool_head_capture = create_pool("capture", global.tune.cookie_len, MEM_F_SHARED);
@@ -2685,6 +2764,13 @@ int check_config_validity()
 			} /* HTTP && bufsize < 16384 */
 #endif
 
+			/* listeners without explicit threads run on those of
+			 * their class, the CLI being background work.
+			 */
+			if (!bind_conf->settings.bind_thread)
+				bind_conf->settings.bind_thread =
+					task_class_mask[curproxy == global.cli_fe ? TASK_CLASS_BULK : TASK_CLASS_IO];
+
 			/* detect and address thread affinity inconsistencies */
 			mask = thread_mask(bind_conf->settings.bind_thread);
 			if (!(mask & all_threads_mask)) {
@@ -2699,6 +2785,14 @@ int check_config_validity()
 				ha_warning("Proxy '%s': the thread range specified on the 'process' directive of 'bind %s' at [%s:%d] only refers to thread numbers out of the range defined by the global 'nbthread' directive. The thread numbers were remapped to existing threads instead (mask 0x%lx).\n",
 					   curproxy->id, bind_conf->arg, bind_conf->file, bind_conf->line, new_mask);
 			}
+
+			/* split the listeners into shards once their threads are known */
+			if (bind_conf->nb_shards > 1 && !bind_conf_create_shards(bind_conf, &err)) {
+				ha_alert("Proxy '%s': %s for 'bind %s' at [%s:%d].\n",
+					 curproxy->id, err, bind_conf->arg, bind_conf->file, bind_conf->line);
+				ha_free(&err);
+				cfgerr++;
+			}
 		}
 
 		switch (curproxy->mode) {
@@ -2713,6 +2807,11 @@ int check_config_validity()
 		case PR_MODE_CLI:
 			cfgerr += proxy_cfg_ensure_no_http(curproxy);
 			break;
+
+		case PR_MODE_UDP:
+			cfgerr += proxy_cfg_ensure_no_http(curproxy);
+			break;
+
 		case PR_MODE_SYSLOG:
 		case PR_MODE_PEERS:
 		case PR_MODES:
@@ -3370,12 +3469,15 @@ int check_config_validity()
 		 */
 		for (newsrv = curproxy->srv; newsrv; newsrv = newsrv->next) {
 			struct server *other_srv;
+			struct ebpt_node *node;
 
-			if (newsrv->puid)
-				continue;
-
-			for (other_srv = curproxy->srv; other_srv && other_srv != newsrv; other_srv = other_srv->next) {
-				if (!other_srv->puid && strcmp(other_srv->id, newsrv->id) == 0) {
+			/* the servers are indexed by name in their declaration
+			 * order, so the previous ones are already there.
+			 */
+			for (node = newsrv->puid ? NULL : ebis_lookup(&curproxy->conf.used_server_name, newsrv->id);
+			     node; node = ebpt_next_dup(node)) {
+				other_srv = container_of(node, struct server, conf.name);
+				if (!other_srv->puid) {
 					ha_alert("parsing [%s:%d] : %s '%s', another server named '%s' was already defined at line %d, please use distinct names.\n",
 						   newsrv->conf.file, newsrv->conf.line,
 						   proxy_type_str(curproxy), curproxy->id,
@@ -3384,6 +3486,9 @@ int check_config_validity()
 					break;
 				}
 			}
+
+			newsrv->conf.name.key = newsrv->id;
+			ebis_insert(&curproxy->conf.used_server_name, &newsrv->conf.name);
 		}
 
 		/* assign automatic UIDs to servers which don't have one yet */
@@ -3398,8 +3503,6 @@ int check_config_validity()
 				newsrv->conf.id.key = newsrv->puid = next_id;
 				eb32_insert(&curproxy->conf.used_server_id, &newsrv->conf.id);
 			}
-			newsrv->conf.name.key = newsrv->id;
-			ebis_insert(&curproxy->conf.used_server_name, &newsrv->conf.name);
 
 			next_id++;
 			newsrv = newsrv->next;
@@ -3543,7 +3646,8 @@ int check_config_validity()
 			if ((curproxy->lbprm.algo & BE_LB_PARM) == BE_LB_RR_STATIC) {
 				curproxy->lbprm.algo |= BE_LB_LKUP_MAP;
 				init_server_map(curproxy);
-			} else if ((curproxy->lbprm.algo & BE_LB_PARM) == BE_LB_RR_RANDOM) {
+			} else if ((curproxy->lbprm.algo & BE_LB_PARM) == BE_LB_RR_RANDOM ||
+			           (curproxy->lbprm.algo & BE_LB_PARM) == BE_LB_RR_EWMA) {
 				curproxy->lbprm.algo |= BE_LB_LKUP_CHTREE | BE_LB_PROP_DYN;
 				if (chash_init_server_tree(curproxy) < 0) {
 					cfgerr++;
@@ -3551,6 +3655,8 @@ int check_config_validity()
 			} else {
 				curproxy->lbprm.algo |= BE_LB_LKUP_RRTREE | BE_LB_PROP_DYN;
 				fwrr_init_server_groups(curproxy);
+				if ((curproxy->lbprm.algo & BE_LB_PROP_LOCAL) && lb_local_init(curproxy) < 0)
+					cfgerr++;
 			}
 			break;
 
@@ -3558,6 +3664,8 @@ int check_config_validity()
 			if ((curproxy->lbprm.algo & BE_LB_PARM) == BE_LB_CB_LC) {
 				curproxy->lbprm.algo |= BE_LB_LKUP_LCTREE | BE_LB_PROP_DYN;
 				fwlc_init_server_tree(curproxy);
+				if ((curproxy->lbprm.algo & BE_LB_PROP_LOCAL) && lb_local_init(curproxy) < 0)
+					cfgerr++;
 			} else {
 				curproxy->lbprm.algo |= BE_LB_LKUP_FSTREE | BE_LB_PROP_DYN;
 				fas_init_server_tree(curproxy);
@@ -3570,6 +3678,11 @@ int check_config_validity()
 				if (chash_init_server_tree(curproxy) < 0) {
 					cfgerr++;
 				}
+			} else if ((curproxy->lbprm.algo & BE_LB_HASH_TYPE) == BE_LB_HASH_MAGLEV) {
+				curproxy->lbprm.algo |= BE_LB_LKUP_MAGLEV | BE_LB_PROP_DYN;
+				if (maglev_init_server_table(curproxy) < 0) {
+					cfgerr++;
+				}
 			} else {
 				curproxy->lbprm.algo |= BE_LB_LKUP_MAP;
 				init_server_map(curproxy);
@@ -3857,6 +3970,29 @@ int check_config_validity()
 			}
 
 		}
+
+		if (newsrv->warm_conns) {
+			const char *reason = srv_warm_conn_unsupported(newsrv);
+
+			if (reason) {
+				ha_warning("parsing [%s:%d] : 'pool-warm-conn' ignored for server '%s/%s' because %s.\n",
+				           newsrv->conf.file, newsrv->conf.line, newsrv->proxy->id, newsrv->id, reason);
+				err_code |= ERR_WARN;
+				newsrv->warm_conns = 0;
+				continue;
+			}
+
+			newsrv->warm_conn_task = task_new(MAX_THREADS_MASK);
+			if (!newsrv->warm_conn_task) {
+				ha_alert("parsing [%s:%d] : failed to allocate warm connection task for server '%s'.\n",
+				         newsrv->conf.file, newsrv->conf.line, newsrv->id);
+				cfgerr++;
+				continue;
+			}
+			newsrv->warm_conn_task->process = srv_warm_conns_task;
+			newsrv->warm_conn_task->context = newsrv;
+			task_wakeup(newsrv->warm_conn_task, TASK_WOKEN_INIT);
+		}
 	}
 
 	idle_conn_task = task_new(MAX_THREADS_MASK);
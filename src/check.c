@@ -29,6 +29,8 @@
 #include <netinet/tcp.h>
 #include <arpa/inet.h>
 
+#include <import/xxhash.h>
+
 #include <haproxy/action.h>
 #include <haproxy/api.h>
 #include <haproxy/arg.h>
@@ -48,6 +50,7 @@
 #include <haproxy/list.h>
 #include <haproxy/log.h>
 #include <haproxy/mailers.h>
+#include <haproxy/peers-t.h>
 #include <haproxy/port_range.h>
 #include <haproxy/proto_tcp.h>
 #include <haproxy/protocol.h>
@@ -59,6 +62,7 @@
 #include <haproxy/server.h>
 #include <haproxy/ssl_sock.h>
 #include <haproxy/stats-t.h>
+#include <haproxy/stick_table.h>
 #include <haproxy/stream_interface.h>
 #include <haproxy/task.h>
 #include <haproxy/tcpcheck.h>
@@ -152,6 +156,9 @@ struct data_cb check_conn_cb = {
 /* Dummy frontend used to create all checks sessions. */
 struct proxy checks_fe;
 
+/* CPU time per second spent by the checks accounted on each thread (ns) */
+static uint64_t check_thread_load[MAX_THREADS];
+
 
 static inline void check_trace_buf(const struct buffer *buf, size_t ofs, size_t len)
 {
@@ -1019,6 +1026,7 @@ static int wake_srv_chk(struct conn_stream *cs)
 	struct connection *conn = cs->conn;
 	struct check *check = cs->data;
 	struct email_alertq *q = container_of(check, typeof(*q), check);
+	uint64_t start = now_mono_time();
 	int ret = 0;
 
 	TRACE_ENTER(CHK_EV_HCHK_WAKE, check);
@@ -1063,6 +1071,8 @@ static int wake_srv_chk(struct conn_stream *cs)
 		task_wakeup(check->task, TASK_WOKEN_IO);
 	}
 
+	check->run_cost += now_mono_time() - start;
+
 	if (check->server)
 		HA_SPIN_UNLOCK(SERVER_LOCK, &check->server->lock);
 	else
@@ -1082,6 +1092,192 @@ struct task *event_srv_chk_io(struct task *t, void *ctx, unsigned int state)
 	return NULL;
 }
 
+/* The results of the checks shared with "check-share" are stored in the gpt0
+ * of the check's entry, as the check status in the lowest 8 bits, the server's
+ * user weight for agent checks in the next 9 bits with a flag indicating its
+ * presence, and a sequence number in the highest 8 bits which is incremented
+ * for each new result and never zero.
+ */
+#define CHK_SHARE_STATUS(v)     ((v) & 0xff)
+#define CHK_SHARE_WEIGHT(v)     (((v) >> 8) & 0x1ff)
+#define CHK_SHARE_F_WEIGHT      0x00020000
+#define CHK_SHARE_SEQ(v)        ((v) >> 24)
+
+/* Looks up the result published by a peer for check <check> and applies it
+ * as if the check had been run locally. The server's lock must be held.
+ * Returns 1 if a valid result was found, even if it was already applied, or 0
+ * if there is none, in which case the check has to be run locally.
+ */
+static int check_share_apply(struct check *check)
+{
+	struct stktable *t = check->share_table;
+	struct server *s = check->server;
+	struct stktable_key key;
+	struct stksess *ts;
+	unsigned int value = 0;
+	void *ptr;
+
+	key.key = check->share_key;
+	key.key_len = strlen(check->share_key);
+	ts = stktable_lookup_key(t, &key);
+	if (!ts)
+		return 0;
+
+	if (!tick_is_expired(ts->expire, now_ms)) {
+		HA_RWLOCK_RDLOCK(STK_SESS_LOCK, &ts->lock);
+		ptr = stktable_data_ptr(t, ts, STKTABLE_DT_GPT0);
+		if (ptr)
+			value = stktable_data_cast(ptr, gpt0);
+		HA_RWLOCK_RDUNLOCK(STK_SESS_LOCK, &ts->lock);
+	}
+	HA_ATOMIC_DEC(&ts->ref_cnt);
+
+	if (!CHK_SHARE_SEQ(value) || CHK_SHARE_STATUS(value) >= HCHK_STATUS_SIZE ||
+	    !check_statuses[CHK_SHARE_STATUS(value)].result)
+		return 0;
+
+	if (CHK_SHARE_SEQ(value) == check->share_seq)
+		return 1;
+	check->share_seq = CHK_SHARE_SEQ(value);
+
+	TRACE_STATE("apply shared health-check result", CHK_EV_TASK_WAKE|CHK_EV_HCHK_END, check);
+	if ((check->state & CHK_ST_AGENT) && (value & CHK_SHARE_F_WEIGHT) &&
+	    CHK_SHARE_WEIGHT(value) != s->uweight) {
+		chunk_printf(&trash, "%u", CHK_SHARE_WEIGHT(value));
+		server_parse_weight_change_request(s, trash.area);
+	}
+
+	set_server_check_status(check, HCHK_STATUS_START, NULL);
+	set_server_check_status(check, CHK_SHARE_STATUS(value), "shared by a peer");
+
+	if (check->result == CHK_RES_FAILED)
+		check_notify_failure(check);
+	else if (check->result == CHK_RES_CONDPASS)
+		check_notify_stopping(check);
+	else if (check->result == CHK_RES_PASSED)
+		check_notify_success(check);
+	return 1;
+}
+
+/* Publishes the result of check <check> which was just run, so that the peers
+ * which do not run it can apply it. The sequence number follows the one of the
+ * entry so that the results of several owners are all seen as new ones. The
+ * server's lock must be held.
+ */
+static void check_share_publish(struct check *check)
+{
+	struct stktable *t = check->share_table;
+	struct stktable_key key;
+	struct stksess *ts;
+	unsigned int value, seq;
+	void *ptr;
+
+	if (check->result == CHK_RES_UNKNOWN || check->result == CHK_RES_NEUTRAL)
+		return;
+
+	key.key = check->share_key;
+	key.key_len = strlen(check->share_key);
+	ts = stktable_get_entry(t, &key);
+	if (!ts)
+		return;
+
+	value = check->status;
+	if (check->state & CHK_ST_AGENT)
+		value |= CHK_SHARE_F_WEIGHT | (check->server->uweight << 8);
+
+	HA_RWLOCK_WRLOCK(STK_SESS_LOCK, &ts->lock);
+	ptr = stktable_data_ptr(t, ts, STKTABLE_DT_GPT0);
+	if (ptr) {
+		seq = (CHK_SHARE_SEQ(stktable_data_cast(ptr, gpt0)) + 1) & 0xff;
+		if (!seq)
+			seq = 1;
+		stktable_data_cast(ptr, gpt0) = value | (seq << 24);
+		check->share_seq = seq;
+	}
+	HA_RWLOCK_WRUNLOCK(STK_SESS_LOCK, &ts->lock);
+	stktable_touch_local(t, ts, 1);
+}
+
+/* Releases the session kept by check <check> between two runs, if any, and
+ * with it the connection it may still keep alive. Must not be called while a
+ * check is running.
+ */
+static void check_release_kept_sess(struct check *check)
+{
+	if (!check->sess)
+		return;
+
+	session_free(check->sess);
+	check->sess = NULL;
+}
+
+/* Accounts the CPU time spent on the last run of check <check> to its average
+ * load and to the load of its thread.
+ */
+static void check_update_load(struct check *check)
+{
+	uint64_t load;
+
+	load = check->run_cost * 1000 / MAX(srv_getinter(check), 1);
+	load = (load + (uint64_t)check->load * (CHK_COST_RUNS - 1)) / CHK_COST_RUNS;
+	if (load > UINT_MAX)
+		load = UINT_MAX;
+
+	HA_ATOMIC_ADD(&check_thread_load[check->tid], load);
+	HA_ATOMIC_SUB(&check_thread_load[check->tid], check->load);
+	check->load = load;
+	check->run_cost = 0;
+}
+
+/* Looks for the best thread to run check <check> on, which is running on the
+ * current thread: the one spending the least CPU time on checks among those
+ * which are not busy. The check moves there if this significantly reduces the
+ * imbalance between both threads, or if the current thread is busy. The check's task is
+ * then bound to this thread and non-zero is returned. Otherwise zero is
+ * returned.
+ */
+static int check_balance(struct check *check)
+{
+	uint64_t best_load = ~0ULL, load, cur;
+	int thr, best = -1;
+	int busy;
+
+	if (check->tid != tid) {
+		/* the task was started on another thread */
+		HA_ATOMIC_SUB(&check_thread_load[check->tid], check->load);
+		HA_ATOMIC_ADD(&check_thread_load[tid], check->load);
+		check->tid = tid;
+	}
+
+	if (global.nbthread == 1)
+		return 0;
+
+	for (thr = 0; thr < global.nbthread; thr++) {
+		if (thr == tid || ha_thread_info[thr].idle_pct < CHK_BUSY_IDLE_PCT)
+			continue;
+		load = HA_ATOMIC_LOAD(&check_thread_load[thr]);
+		if (load < best_load) {
+			best_load = load;
+			best = thr;
+		}
+	}
+
+	/* the measures are noisy, so let's not move the check unless the
+	 * imbalance is significant.
+	 */
+	busy = ti->idle_pct < CHK_BUSY_IDLE_PCT;
+	cur = HA_ATOMIC_LOAD(&check_thread_load[tid]);
+	if (best < 0 ||
+	    (!busy && best_load + check->load + cur / CHK_IMBALANCE_RATIO >= cur))
+		return 0;
+
+	HA_ATOMIC_SUB(&check_thread_load[tid], check->load);
+	HA_ATOMIC_ADD(&check_thread_load[best], check->load);
+	check->tid = best;
+	task_set_affinity(check->task, 1UL << best);
+	return 1;
+}
+
 /* manages a server health-check that uses a connection. Returns
  * the time the task accepts to wait, or TIME_ETERNITY for infinity.
  *
@@ -1094,7 +1290,8 @@ struct task *process_chk_conn(struct task *t, void *context, unsigned int state)
 	struct proxy *proxy = check->proxy;
 	struct conn_stream *cs;
 	struct connection *conn;
-	int rv;
+	uint64_t start = now_mono_time();
+	int rv, keep;
 	int expired = tick_is_expired(t->expire, now_ms);
 
 	TRACE_ENTER(CHK_EV_TASK_WAKE, check);
@@ -1116,9 +1313,32 @@ struct task *process_chk_conn(struct task *t, void *context, unsigned int state)
 		if (((check->state & (CHK_ST_ENABLED | CHK_ST_PAUSED)) != CHK_ST_ENABLED) ||
 		    proxy->disabled) {
 			TRACE_STATE("health-check paused or disabled", CHK_EV_TASK_WAKE, check);
+			check_release_kept_sess(check);
+			goto reschedule;
+		}
+
+		/* the peers owning a shared check run it for us, and an old
+		 * process being stopped leaves this to the new one.
+		 */
+		if (check->share_table && (!check->share_owner || stopping) &&
+		    check_share_apply(check)) {
+			check_release_kept_sess(check);
+			t->expire = tick_add(now_ms, MS_TO_TICKS(srv_getinter(check)));
 			goto reschedule;
 		}
 
+		/* account the previous run, and leave this one to a better
+		 * thread if needed, unless a connection was kept alive on
+		 * this one.
+		 */
+		if (check->server) {
+			check_update_load(check);
+			if (!check->sess && check_balance(check)) {
+				TRACE_STATE("health-check moved to another thread", CHK_EV_TASK_WAKE, check);
+				goto out_unlock;
+			}
+		}
+
 		/* we'll initiate a new check */
 		set_server_check_status(check, HCHK_STATUS_START, NULL);
 
@@ -1169,7 +1389,19 @@ struct task *process_chk_conn(struct task *t, void *context, unsigned int state)
 
 	check->current_step = NULL;
 
-	if (conn && conn->xprt) {
+	/* The connection of a successful HTTP check may be kept alive for the
+	 * next run if the whole response was received. The mux then parks it
+	 * in the check's session, which is kept as well.
+	 */
+	keep = ((check->state & CHK_ST_KEEPALIVE) && !stopping &&
+		(check->result == CHK_RES_PASSED || check->result == CHK_RES_CONDPASS) &&
+		conn && conn->mux && IS_HTX_CS(cs) &&
+		!(conn->flags & (CO_FL_ERROR|CO_FL_SOCK_RD_SH|CO_FL_SOCK_WR_SH)) &&
+		!(cs->flags & (CS_FL_ERROR|CS_FL_EOS)) &&
+		(check->state & CHK_ST_RES_EOM));
+	check->state &= ~CHK_ST_RES_EOM;
+
+	if (conn && conn->xprt && !keep) {
 		/* The check was aborted and the connection was not yet closed.
 		 * This can happen upon timeout, or when an external event such
 		 * as a failed response coupled with "observe layer7" caused the
@@ -1193,8 +1425,10 @@ struct task *process_chk_conn(struct task *t, void *context, unsigned int state)
 
 	if (check->sess != NULL) {
 		vars_prune(&check->vars, check->sess, NULL);
-		session_free(check->sess);
-		check->sess = NULL;
+		if (!keep) {
+			session_free(check->sess);
+			check->sess = NULL;
+		}
 	}
 
 	if (check->server) {
@@ -1213,8 +1447,15 @@ struct task *process_chk_conn(struct task *t, void *context, unsigned int state)
 			TRACE_DEVEL("report success", CHK_EV_TASK_WAKE|CHK_EV_HCHK_END|CHK_EV_HCHK_SUCC, check);
 			check_notify_success(check);
 		}
+
+		if (check->share_table && check->share_owner && !stopping)
+			check_share_publish(check);
 	}
-	task_set_affinity(t, MAX_THREADS_MASK);
+	/* server checks stay on their thread until the next run picks one,
+	 * and a kept connection may only be used by its own thread.
+	 */
+	if (!check->server && !check->sess)
+		task_set_affinity(t, MAX_THREADS_MASK);
 	check_release_buf(check, &check->bi);
 	check_release_buf(check, &check->bo);
 	check->state &= ~(CHK_ST_INPROGRESS|CHK_ST_IN_ALLOC|CHK_ST_OUT_ALLOC);
@@ -1232,6 +1473,8 @@ struct task *process_chk_conn(struct task *t, void *context, unsigned int state)
 	while (tick_is_expired(t->expire, now_ms))
 		t->expire = tick_add(t->expire, MS_TO_TICKS(check->inter));
  out_unlock:
+	check->run_cost += now_mono_time() - start;
+
 	if (check->server)
 		HA_SPIN_UNLOCK(SERVER_LOCK, &check->server->lock);
 
@@ -1280,7 +1523,7 @@ struct buffer *check_get_buf(struct check *check, struct buffer *bptr)
 	    unlikely((buf = b_alloc(bptr)) == NULL)) {
 		check->buf_wait.target = check;
 		check->buf_wait.wakeup_cb = check_buf_available;
-		LIST_APPEND(&ti->buffer_wq, &check->buf_wait.list);
+		b_queue(DB_CRIT_DEFAULT, &check->buf_wait);
 	}
 	return buf;
 }
@@ -1317,6 +1560,7 @@ const char *init_check(struct check *check, int type)
 void free_check(struct check *check)
 {
 	task_destroy(check->task);
+	ha_free(&check->share_key);
 	if (check->wait_list.tasklet)
 		tasklet_free(check->wait_list.tasklet);
 
@@ -1327,6 +1571,10 @@ void free_check(struct check *check)
 		cs_free(check->cs);
 		check->cs = NULL;
 	}
+	if (check->sess) {
+		session_free(check->sess);
+		check->sess = NULL;
+	}
 }
 
 /* manages a server health-check. Returns the time the task accepts to wait, or
@@ -1363,6 +1611,14 @@ static int start_check_task(struct check *check, int mininter,
 	t->process = process_chk;
 	t->context = check;
 
+	/* checks are initially spread over all threads, then they move
+	 * depending on their measured cost (see check_balance()).
+	 */
+	if (check->type != PR_O2_EXT_CHK) {
+		check->tid = srvpos % global.nbthread;
+		task_set_affinity(t, 1UL << check->tid);
+	}
+
 	if (mininter < srv_getinter(check))
 		mininter = srv_getinter(check);
 
@@ -1413,6 +1669,103 @@ struct task *server_warmup(struct task *t, void *context, unsigned int state)
  * Start health-check.
  * Returns 0 if OK, ERR_FATAL on error, and prints the error in this case.
  */
+/* Sets up the sharing of the results of check <check> of server <srv> through
+ * table <t>. The check is owned by the <srv>->check_share_owners peers of the
+ * table's peers section for which a hash of the check's key and of the peer's
+ * name is the highest, so that all the peers agree on the owners and that the
+ * checks are evenly spread over them. Returns an ERR_* code.
+ */
+static int init_check_share(struct server *srv, struct check *check, struct stktable *t)
+{
+	struct peer *peer;
+	unsigned int own, hash, rank = 0;
+	size_t len;
+
+	if (check->type == PR_O2_EXT_CHK) {
+		ha_warning("config: %s '%s': server '%s': 'check-share' is ignored for external checks.\n",
+		           proxy_type_str(srv->proxy), srv->proxy->id, srv->id);
+		return ERR_WARN;
+	}
+
+	memprintf(&check->share_key, "%s/%s%s", srv->proxy->id, srv->id,
+	          (check->state & CHK_ST_AGENT) ? "/agent" : "");
+	if (!check->share_key) {
+		ha_alert("config: %s '%s': server '%s': out of memory.\n",
+		         proxy_type_str(srv->proxy), srv->proxy->id, srv->id);
+		return ERR_ALERT | ERR_FATAL;
+	}
+
+	len = strlen(check->share_key);
+	if (len >= t->key_size) {
+		ha_alert("config: %s '%s': server '%s': 'check-share' key '%s' does not fit in the keys of table '%s'.\n",
+		         proxy_type_str(srv->proxy), srv->proxy->id, srv->id, check->share_key, t->id);
+		return ERR_ALERT | ERR_FATAL;
+	}
+
+	own = XXH32(check->share_key, len, XXH32(t->peers.p->local->id, strlen(t->peers.p->local->id), 0));
+	for (peer = t->peers.p->remote; peer; peer = peer->next) {
+		if (peer->local)
+			continue;
+		hash = XXH32(check->share_key, len, XXH32(peer->id, strlen(peer->id), 0));
+		if (hash > own || (hash == own && strcmp(peer->id, t->peers.p->local->id) > 0))
+			rank++;
+	}
+
+	check->share_table = t;
+	check->share_owner = rank < (srv->check_share_owners ? srv->check_share_owners : CHK_SHARE_OWNERS);
+	return ERR_NONE;
+}
+
+/* Resolves the table used to share the results of the checks of server <srv>
+ * and sets up the health and agent checks accordingly. Returns an ERR_* code.
+ */
+static int init_srv_check_share(struct server *srv)
+{
+	struct stktable *t;
+	int ret = ERR_NONE;
+
+	if (!srv->check_share)
+		goto out;
+
+	if (!(srv->check.state & CHK_ST_CONFIGURED) && !(srv->agent.state & CHK_ST_CONFIGURED)) {
+		ha_warning("config: %s '%s': server '%s': 'check-share' is ignored as no check is enabled.\n",
+		           proxy_type_str(srv->proxy), srv->proxy->id, srv->id);
+		ret |= ERR_WARN;
+		goto out;
+	}
+
+	t = stktable_find_by_name(srv->check_share);
+	if (!t) {
+		ha_alert("config: %s '%s': server '%s': 'check-share' refers to unknown table '%s'.\n",
+		         proxy_type_str(srv->proxy), srv->proxy->id, srv->id, srv->check_share);
+		ret |= ERR_ALERT | ERR_FATAL;
+		goto out;
+	}
+
+	if (t->type != SMP_T_STR || !t->data_ofs[STKTABLE_DT_GPT0]) {
+		ha_alert("config: %s '%s': server '%s': 'check-share' table '%s' must be of type 'string' and store 'gpt0'.\n",
+		         proxy_type_str(srv->proxy), srv->proxy->id, srv->id, t->id);
+		ret |= ERR_ALERT | ERR_FATAL;
+		goto out;
+	}
+
+	if (!t->peers.p || !t->peers.p->local) {
+		ha_alert("config: %s '%s': server '%s': 'check-share' table '%s' is not synchronized with peers.\n",
+		         proxy_type_str(srv->proxy), srv->proxy->id, srv->id, t->id);
+		ret |= ERR_ALERT | ERR_FATAL;
+		goto out;
+	}
+
+	if (srv->check.state & CHK_ST_CONFIGURED)
+		ret |= init_check_share(srv, &srv->check, t);
+	if (!(ret & ERR_CODE) && (srv->agent.state & CHK_ST_CONFIGURED))
+		ret |= init_check_share(srv, &srv->agent, t);
+
+  out:
+	ha_free(&srv->check_share);
+	return ret;
+}
+
 static int start_checks()
 {
 
@@ -1420,6 +1773,7 @@ static int start_checks()
 	struct server *s;
 	struct task *t;
 	int nbcheck=0, mininter=0, srvpos=0;
+	int err_code = ERR_NONE;
 
 	/* 0- init the dummy frontend used to create all checks sessions */
 	init_new_proxy(&checks_fe);
@@ -1430,6 +1784,7 @@ static int start_checks()
 	checks_fe.conn_retries = CONN_RETRIES;
 	checks_fe.options2 |= PR_O2_INDEPSTR | PR_O2_SMARTCON | PR_O2_SMARTACC;
 	checks_fe.timeout.client = TICK_ETERNITY;
+	checks_fe.max_out_conns = 1; /* the connection kept alive by a check */
 
 	/* 1- count the checkers to run simultaneously.
 	 * We also determine the minimum interval among all of those which
@@ -1440,6 +1795,10 @@ static int start_checks()
 	 */
 	for (px = proxies_list; px; px = px->next) {
 		for (s = px->srv; s; s = s->next) {
+			err_code |= init_srv_check_share(s);
+			if (err_code & ERR_CODE)
+				return err_code;
+
 			if (s->slowstart) {
 				if ((t = task_new(MAX_THREADS_MASK)) == NULL) {
 					ha_alert("Starting [%s:%s] check: out of memory.\n", px->id, s->id);
@@ -1473,7 +1832,7 @@ static int start_checks()
 	}
 
 	if (!nbcheck)
-		return ERR_NONE;
+		return err_code;
 
 	srand((unsigned)time(NULL));
 
@@ -1484,7 +1843,7 @@ static int start_checks()
 	 */
 	for (px = proxies_list; px; px = px->next) {
 		if ((px->options2 & PR_O2_CHK_ANY) == PR_O2_EXT_CHK) {
-			if (init_pid_list()) {
+			if (init_pid_list() || init_extcheck_runners(px)) {
 				ha_alert("Starting [%s] check: out of memory.\n", px->id);
 				return ERR_ALERT | ERR_FATAL;
 			}
@@ -1511,7 +1870,7 @@ static int start_checks()
 			}
 		}
 	}
-	return ERR_NONE;
+	return err_code;
 }
 
 
@@ -1673,6 +2032,30 @@ static int init_srv_check(struct server *srv)
 	srv->check.state |= CHK_ST_CONFIGURED | CHK_ST_ENABLED;
 	global.maxsock++;
 
+	/* connections may only be kept alive for HTTP checks relying on a
+	 * single connect rule, which must be the first one.
+	 */
+	if (srv->check.keep_alive) {
+		struct tcpcheck_rules *rules = &srv->proxy->tcpcheck_rules;
+		int nbconn = 0;
+
+		list_for_each_entry(r, rules->list, list) {
+			if (r->action == TCPCHK_ACT_CONNECT)
+				nbconn++;
+		}
+
+		r = get_first_tcpcheck_rule(rules);
+		if ((rules->flags & TCPCHK_RULES_PROTO_CHK) != TCPCHK_RULES_HTTP_CHK ||
+		    nbconn > 1 || (nbconn && r->action != TCPCHK_ACT_CONNECT)) {
+			ha_warning("config: %s '%s': server '%s': 'check-keep-alive' is ignored as it only applies "
+				   "to HTTP checks using a single connection.\n",
+				   proxy_type_str(srv->proxy), srv->proxy->id, srv->id);
+			ret |= ERR_WARN;
+		}
+		else
+			srv->check.state |= CHK_ST_KEEPALIVE;
+	}
+
   out:
 	return ret;
 }
@@ -2071,6 +2454,14 @@ static int srv_parse_check(char **args, int *cur_arg, struct proxy *curpx, struc
 	return 0;
 }
 
+/* Parse the "check-keep-alive" server keyword */
+static int srv_parse_check_keep_alive(char **args, int *cur_arg, struct proxy *curpx, struct server *srv,
+				      char **errmsg)
+{
+	srv->check.keep_alive = 1;
+	return 0;
+}
+
 /* Parse the "check-send-proxy" server keyword */
 static int srv_parse_check_send_proxy(char **args, int *cur_arg, struct proxy *curpx, struct server *srv,
 				      char **errmsg)
@@ -2095,6 +2486,14 @@ static int srv_parse_no_check(char **args, int *cur_arg, struct proxy *curpx, st
 	return 0;
 }
 
+/* Parse the "no-check-keep-alive" server keyword */
+static int srv_parse_no_check_keep_alive(char **args, int *cur_arg, struct proxy *curpx, struct server *srv,
+					 char **errmsg)
+{
+	srv->check.keep_alive = 0;
+	return 0;
+}
+
 /* Parse the "no-check-send-proxy" server keyword */
 static int srv_parse_no_check_send_proxy(char **args, int *cur_arg, struct proxy *curpx, struct server *srv,
 					 char **errmsg)
@@ -2128,6 +2527,41 @@ static int srv_parse_check_proto(char **args, int *cur_arg,
 }
 
 
+/* Parse the "check-share" server keyword */
+static int srv_parse_check_share(char **args, int *cur_arg, struct proxy *curpx, struct server *srv,
+				 char **errmsg)
+{
+	if (!*args[*cur_arg + 1]) {
+		memprintf(errmsg, "'%s' expects a table name as argument.", args[*cur_arg]);
+		return ERR_ALERT | ERR_FATAL;
+	}
+
+	free(srv->check_share);
+	srv->check_share = strdup(args[*cur_arg + 1]);
+	if (!srv->check_share) {
+		memprintf(errmsg, "out of memory.");
+		return ERR_ALERT | ERR_FATAL;
+	}
+	return 0;
+}
+
+/* Parse the "check-share-owners" server keyword */
+static int srv_parse_check_share_owners(char **args, int *cur_arg, struct proxy *curpx, struct server *srv,
+					char **errmsg)
+{
+	if (!*args[*cur_arg + 1]) {
+		memprintf(errmsg, "'%s' expects an integer argument.", args[*cur_arg]);
+		return ERR_ALERT | ERR_FATAL;
+	}
+
+	srv->check_share_owners = atol(args[*cur_arg + 1]);
+	if (srv->check_share_owners <= 0) {
+		memprintf(errmsg, "'%s' has to be > 0.", args[*cur_arg]);
+		return ERR_ALERT | ERR_FATAL;
+	}
+	return 0;
+}
+
 /* Parse the "rise" server keyword */
 static int srv_parse_check_rise(char **args, int *cur_arg, struct proxy *curpx, struct server *srv,
 				char **errmsg)
@@ -2352,11 +2786,15 @@ static struct srv_kw_list srv_kws = { "CHK", { }, {
 	{ "agent-port",          srv_parse_agent_port,          1,  1,  0 }, /* Set the TCP port used for agent checks. */
 	{ "agent-send",          srv_parse_agent_send,          1,  1,  0 }, /* Set string to send to agent. */
 	{ "check",               srv_parse_check,               0,  1,  0 }, /* Enable health checks */
+	{ "check-keep-alive",    srv_parse_check_keep_alive,    0,  1,  0 }, /* Keep the health checks' connections alive */
 	{ "check-proto",         srv_parse_check_proto,         1,  1,  0 }, /* Set the mux protocol for health checks  */
 	{ "check-send-proxy",    srv_parse_check_send_proxy,    0,  1,  0 }, /* Enable PROXY protocol for health checks */
+	{ "check-share",         srv_parse_check_share,         1,  1,  0 }, /* Share the checks' results with the table's peers */
+	{ "check-share-owners",  srv_parse_check_share_owners,  1,  1,  0 }, /* Set the number of peers running the shared checks */
 	{ "check-via-socks4",    srv_parse_check_via_socks4,    0,  1,  0 }, /* Enable socks4 proxy for health checks */
 	{ "no-agent-check",      srv_parse_no_agent_check,      0,  1,  0 }, /* Do not enable any auxiliary agent check */
 	{ "no-check",            srv_parse_no_check,            0,  1,  0 }, /* Disable health checks */
+	{ "no-check-keep-alive", srv_parse_no_check_keep_alive, 0,  1,  0 }, /* Close the health checks' connections after each check */
 	{ "no-check-send-proxy", srv_parse_no_check_send_proxy, 0,  1,  0 }, /* Disable PROXY protocol for health checks */
 	{ "rise",                srv_parse_check_rise,          1,  1,  0 }, /* Set rise value for health checks */
 	{ "fall",                srv_parse_check_fall,          1,  1,  0 }, /* Set fall value for health checks */
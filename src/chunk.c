@@ -74,12 +74,16 @@ static int alloc_trash_buffers(int bufsize)
 	return trash.area && trash_buf1 && trash_buf2;
 }
 
-static int alloc_trash_buffers_per_thread()
+/* allocates the current thread's trash buffers. It is also used by the
+ * threads started outside of the thread pool. Returns 0 in case of failure.
+ */
+int alloc_trash_buffers_per_thread()
 {
 	return alloc_trash_buffers(global.tune.bufsize);
 }
 
-static void free_trash_buffers_per_thread()
+/* releases the current thread's trash buffers */
+void free_trash_buffers_per_thread()
 {
 	chunk_destroy(&trash);
 	free(trash_buf2);
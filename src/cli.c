@@ -54,6 +54,7 @@
 #include <haproxy/server.h>
 #include <haproxy/session.h>
 #include <haproxy/sock.h>
+#include <haproxy/ssl_sock.h>
 #include <haproxy/stats-t.h>
 #include <haproxy/stream.h>
 #include <haproxy/stream_interface.h>
@@ -1240,7 +1241,7 @@ static int cli_io_handler_show_fd(struct appctx *appctx)
 			     (fdt.state & FD_EV_SHUT_R) ? 'S' : 's',
 			     (fdt.state & FD_EV_READY_R)  ? 'R' : 'r',
 			     (fdt.state & FD_EV_ACTIVE_R) ? 'A' : 'a',
-			     fdt.thread_mask, fdt.update_mask,
+			     fdt.thread_mask, fdupd[fd].update_mask,
 			     fdt.owner,
 			     fdt.iocb);
 		resolve_sym_name(&trash, NULL, fdt.iocb);
@@ -1350,11 +1351,38 @@ static int cli_io_handler_show_fd(struct appctx *appctx)
 	return ret;
 }
 
+/* Appends to <out> the non-empty buckets of the polling loop histogram <h> of
+ * thread <thr>, or of all threads summed if <thr> is negative, as a series of
+ * " <range>:<count>" fields where the range of bucket N>0 is [2^(N-1)..2^N-1].
+ */
+static void cli_append_act_hist(struct buffer *out, enum act_hist h, int thr)
+{
+	unsigned int cnt;
+	int b, t;
+
+	for (b = 0; b < ACT_HIST_BUCKETS; b++) {
+		cnt = 0;
+		for (t = 0; t < global.nbthread; t++)
+			if (thr < 0 || t == thr)
+				cnt += activity[t].hist[h][b];
+		if (!cnt)
+			continue;
+
+		if (b <= 1)
+			chunk_appendf(out, " %d:%u", b, cnt);
+		else if (b == ACT_HIST_BUCKETS - 1)
+			chunk_appendf(out, " %u+:%u", 1U << (b - 1), cnt);
+		else
+			chunk_appendf(out, " %u-%u:%u", 1U << (b - 1), (1U << b) - 1, cnt);
+	}
+	chunk_appendf(out, "\n");
+}
+
 /* This function dumps some activity counters used by developers and support to
  * rule out some hypothesis during bug reports. It returns 0 if the output
  * buffer is full and it needs to be called again, otherwise non-zero. It dumps
- * everything at once in the buffer and is not designed to do it in multiple
- * passes.
+ * all counters at once in the buffer, followed by the polling loop histograms
+ * which are dumped one thread at a time in multiple passes if needed.
  */
 static int cli_io_handler_show_activity(struct appctx *appctx)
 {
@@ -1364,6 +1392,13 @@ static int cli_io_handler_show_activity(struct appctx *appctx)
 	if (unlikely(si_ic(si)->flags & (CF_WRITE_ERROR|CF_SHUTW)))
 		return 1;
 
+	/* the counters are dumped at once in st2 0, then the histograms are
+	 * dumped summed over all threads in st2 1, then for each thread in
+	 * st2 2 and above.
+	 */
+	if (appctx->st2)
+		goto dump_hist;
+
 	chunk_reset(&trash);
 
 #undef SHOW_TOT
@@ -1420,6 +1455,9 @@ static int cli_io_handler_show_activity(struct appctx *appctx)
 	chunk_appendf(&trash, "stream_calls:"); SHOW_TOT(thr, activity[thr].stream_calls);
 	chunk_appendf(&trash, "pool_fail:");    SHOW_TOT(thr, activity[thr].pool_fail);
 	chunk_appendf(&trash, "buf_wait:");     SHOW_TOT(thr, activity[thr].buf_wait);
+	chunk_appendf(&trash, "buf_wait_us:");  SHOW_TOT(thr, activity[thr].buf_wait_us);
+	chunk_appendf(&trash, "buf_queued_1s:");SHOW_TOT(thr, read_freq_ctr(&activity[thr].buf_queued));
+	chunk_appendf(&trash, "idle_conn_bufs: %u\n", HA_ATOMIC_LOAD(&idle_conn_bufs));
 	chunk_appendf(&trash, "cpust_ms_tot:"); SHOW_TOT(thr, activity[thr].cpust_total / 2);
 	chunk_appendf(&trash, "cpust_ms_1s:");  SHOW_TOT(thr, read_freq_ctr(&activity[thr].cpust_1s) / 2);
 	chunk_appendf(&trash, "cpust_ms_15s:"); SHOW_TOT(thr, read_freq_ctr_period(&activity[thr].cpust_15s, 15000) / 2);
@@ -1430,7 +1468,13 @@ static int cli_io_handler_show_activity(struct appctx *appctx)
 #ifdef USE_THREAD
 	chunk_appendf(&trash, "accq_ring:");    SHOW_TOT(thr, (accept_queue_rings[thr].tail - accept_queue_rings[thr].head + ACCEPT_QUEUE_SIZE) % ACCEPT_QUEUE_SIZE);
 	chunk_appendf(&trash, "fd_takeover:");  SHOW_TOT(thr, activity[thr].fd_takeover);
+	chunk_appendf(&trash, "tasks_given:");  SHOW_TOT(thr, activity[thr].tasks_given);
+	chunk_appendf(&trash, "tasks_stolen:"); SHOW_TOT(thr, activity[thr].tasks_stolen);
 #endif
+	chunk_appendf(&trash, "zc_sent:");      SHOW_TOT(thr, activity[thr].zc_sent);
+	chunk_appendf(&trash, "zc_copied:");    SHOW_TOT(thr, activity[thr].zc_copied);
+	chunk_appendf(&trash, "htx_defrag:");   SHOW_TOT(thr, activity[thr].htx_defrag);
+	chunk_appendf(&trash, "htx_defrag_bytes:"); SHOW_TOT(thr, activity[thr].htx_defrag_bytes);
 
 #if defined(DEBUG_DEV)
 	/* keep these ones at the end */
@@ -1443,10 +1487,45 @@ static int cli_io_handler_show_activity(struct appctx *appctx)
 		chunk_reset(&trash);
 		chunk_printf(&trash, "[output too large, cannot dump]\n");
 		si_rx_room_blk(si);
+		return 1;
 	}
+	appctx->st2 = 1;
 
 #undef SHOW_AVG
 #undef SHOW_TOT
+
+ dump_hist:
+	while (appctx->st2 <= global.nbthread + 1) {
+		/* per-thread histograms are not needed with a single thread */
+		if (appctx->st2 > 1 && global.nbthread == 1)
+			break;
+
+		thr = (int)appctx->st2 - 2;
+		chunk_reset(&trash);
+
+#undef SHOW_HIST
+#define SHOW_HIST(name, h)						\
+	do {								\
+		if (thr < 0)						\
+			chunk_appendf(&trash, "%s:", name);		\
+		else							\
+			chunk_appendf(&trash, "%s[%d]:", name, thr + 1); \
+		cli_append_act_hist(&trash, h, thr);			\
+	} while (0)
+
+		SHOW_HIST("hist_poll_events", ACT_HIST_POLL_EV);
+		SHOW_HIST("hist_poll_us",     ACT_HIST_POLL_US);
+		SHOW_HIST("hist_loop_us",     ACT_HIST_LOOP_US);
+		SHOW_HIST("hist_loop_tasks",  ACT_HIST_LOOP_TASKS);
+#undef SHOW_HIST
+
+		if (ci_putchk(si_ic(si), &trash) == -1) {
+			si_rx_room_blk(si);
+			return 0;
+		}
+		appctx->st2++;
+	}
+
 	/* dump complete */
 	return 1;
 }
@@ -2045,6 +2124,225 @@ static int _getsocks(char **args, char *payload, struct appctx *appctx, void *pr
 	return 1;
 }
 
+/* Appends to <blk> at offset <*ofs> the names of server <srv> and of its proxy,
+ * each preceded by its length as an unsigned char.
+ */
+static void cli_put_srv_names(unsigned char *blk, int *ofs, const struct server *srv)
+{
+	int len;
+
+	len = strlen(srv->proxy->id);
+	blk[(*ofs)++] = len;
+	memcpy(blk + *ofs, srv->proxy->id, len);
+	*ofs += len;
+
+	len = strlen(srv->id);
+	blk[(*ofs)++] = len;
+	memcpy(blk + *ofs, srv->id, len);
+	*ofs += len;
+}
+
+/* Hands the idle backend connections and the cached TLS sessions of all servers
+ * over to the new process, then releases these connections. Always returns 1.
+ * The following is sent:
+ *  - 4 ints: SOCK_IDLE_CONNS_MAGIC, the number of FDs, the length of their
+ *    description and the length of the TLS sessions block ;
+ *  - the FDs, MAX_SEND_FD per MAX_SEND_FD, each one described by its
+ *    <px_name_len> <px_name> <srv_name_len> <srv_name>, an ack being
+ *    expected after each batch ;
+ *  - for each TLS session, <px_name_len> <px_name> <srv_name_len> <srv_name>
+ *    <32-bit session length> <ASN.1 DER session>.
+ */
+static int _getidleconns(char **args, char *payload, struct appctx *appctx, void *private)
+{
+	char *cmsgbuf = NULL;
+	unsigned char *meta = NULL, *sess = NULL;
+	struct cmsghdr *cmsg;
+	struct stream_interface *si = appctx->owner;
+	struct stream *s = si_strm(si);
+	struct connection *remote = cs_conn(objt_cs(si_opposite(si)->end));
+	struct msghdr msghdr;
+	struct iovec iov;
+	struct timeval tv = { .tv_sec = 1, .tv_usec = 0 };
+	struct proxy *px;
+	struct server *srv;
+	int hdr[4] = { SOCK_IDLE_CONNS_MAGIC, 0, 0, 0 };
+	int *fds = NULL;
+	int max_fd = 0, nb_fd = 0;
+	int meta_len = 0, meta_ofs, sess_len = 0;
+	int cur_fd, nb_queued;
+	int fd = -1;
+	int old_fcntl = -1;
+	int ret;
+
+	if (!remote) {
+		ha_warning("Only works on real connections\n");
+		goto out;
+	}
+
+	if (!(strm_li(s)->bind_conf->level & ACCESS_FD_LISTENERS))
+		goto out;
+
+	/* first count what may have to be sent, names are limited to 255 chars */
+	for (px = proxies_list; px; px = px->next) {
+		if (!(px->cap & PR_CAP_BE) || strlen(px->id) > 255)
+			continue;
+		for (srv = px->srv; srv; srv = srv->next) {
+			if (strlen(srv->id) > 255)
+				continue;
+			max_fd += srv->curr_idle_conns;
+			meta_len += srv->curr_idle_conns * (2 + strlen(px->id) + strlen(srv->id));
+#ifdef USE_OPENSSL
+			sess_len += 2 + strlen(px->id) + strlen(srv->id) + sizeof(uint32_t);
+#endif
+		}
+	}
+
+	fds = malloc((max_fd + 1) * sizeof(*fds));
+	meta = malloc(meta_len + 1);
+	cmsgbuf = malloc(CMSG_SPACE(sizeof(int) * MAX_SEND_FD));
+	if (!fds || !meta || !cmsgbuf) {
+		ha_warning("Failed to allocate memory to transfer idle connections\n");
+		goto out;
+	}
+
+	/* now detach the connections from their servers */
+	meta_ofs = 0;
+	for (px = proxies_list; px && nb_fd < max_fd; px = px->next) {
+		if (!(px->cap & PR_CAP_BE) || strlen(px->id) > 255)
+			continue;
+		for (srv = px->srv; srv && nb_fd < max_fd; srv = srv->next) {
+			int rec_len = 2 + strlen(px->id) + strlen(srv->id);
+			int nb;
+
+			if (strlen(srv->id) > 255)
+				continue;
+			nb = srv_export_idle_conns(srv, fds + nb_fd, MIN(max_fd - nb_fd, (meta_len - meta_ofs) / rec_len));
+			nb_fd += nb;
+			while (nb--)
+				cli_put_srv_names(meta, &meta_ofs, srv);
+		}
+	}
+	hdr[1] = nb_fd;
+	hdr[2] = meta_ofs;
+
+#ifdef USE_OPENSSL
+	/* and the TLS sessions, which the new process will try to resume */
+	if (sess_len) {
+		int ofs = 0;
+
+		sess = malloc(sess_len);
+		for (px = proxies_list; sess && px; px = px->next) {
+			if (!(px->cap & PR_CAP_BE) || strlen(px->id) > 255)
+				continue;
+			for (srv = px->srv; srv; srv = srv->next) {
+				unsigned char *der, *new;
+				uint32_t len;
+
+				if (srv->use_ssl != 1 || strlen(srv->id) > 255)
+					continue;
+
+				len = ssl_sock_srv_dump_session(srv, &der);
+				if (!len)
+					continue;
+
+				new = realloc(sess, ofs + 2 + strlen(px->id) + strlen(srv->id) + sizeof(len) + len);
+				if (!new) {
+					free(der);
+					break;
+				}
+				sess = new;
+				cli_put_srv_names(sess, &ofs, srv);
+				memcpy(sess + ofs, &len, sizeof(len));
+				ofs += sizeof(len);
+				memcpy(sess + ofs, der, len);
+				ofs += len;
+				free(der);
+			}
+		}
+		hdr[3] = sess ? ofs : 0;
+	}
+#endif
+
+	fd = remote->handle.fd;
+
+	/* Temporary set the FD in blocking mode, that will make our life easier */
+	old_fcntl = fcntl(fd, F_GETFL);
+	if (old_fcntl < 0) {
+		ha_warning("Couldn't get the flags for the unix socket\n");
+		goto out;
+	}
+	if (fcntl(fd, F_SETFL, old_fcntl &~ O_NONBLOCK) == -1) {
+		ha_warning("Cannot make the unix socket blocking\n");
+		goto out;
+	}
+	setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, (void *)&tv, sizeof(tv));
+
+	if (send(fd, hdr, sizeof(hdr), 0) != sizeof(hdr)) {
+		ha_warning("Failed to send the number of idle connections to send\n");
+		goto out;
+	}
+
+	/* Now send the FDs with their description */
+	memset(&msghdr, 0, sizeof(msghdr));
+	msghdr.msg_iov = &iov;
+	msghdr.msg_iovlen = 1;
+	msghdr.msg_control = cmsgbuf;
+	msghdr.msg_controllen = CMSG_SPACE(sizeof(int) * MAX_SEND_FD);
+	cmsg = CMSG_FIRSTHDR(&msghdr);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+
+	meta_ofs = 0;
+	for (cur_fd = 0; cur_fd < nb_fd; cur_fd += nb_queued) {
+		int batch_len = 0;
+		int i;
+
+		nb_queued = MIN(nb_fd - cur_fd, MAX_SEND_FD);
+		for (i = 0; i < nb_queued; i++) {
+			batch_len += 1 + meta[meta_ofs + batch_len];
+			batch_len += 1 + meta[meta_ofs + batch_len];
+		}
+
+		memcpy(CMSG_DATA(cmsg), fds + cur_fd, nb_queued * sizeof(int));
+		cmsg->cmsg_len = CMSG_LEN(nb_queued * sizeof(int));
+		msghdr.msg_controllen = CMSG_SPACE(nb_queued * sizeof(int));
+		iov.iov_base = meta + meta_ofs;
+		iov.iov_len = batch_len;
+		if (sendmsg(fd, &msghdr, 0) != batch_len) {
+			ha_warning("Failed to transfer idle connections\n");
+			goto out;
+		}
+		meta_ofs += batch_len;
+
+		/* Wait for an ack */
+		do {
+			ret = recv(fd, &i, sizeof(i), 0);
+		} while (ret == -1 && errno == EINTR);
+
+		if (ret <= 0) {
+			ha_warning("Unexpected error while transferring idle connections\n");
+			goto out;
+		}
+	}
+
+	if (hdr[3] && send(fd, sess, hdr[3], 0) != hdr[3])
+		ha_warning("Failed to transfer TLS sessions\n");
+
+out:
+	if (fd >= 0 && old_fcntl >= 0 && fcntl(fd, F_SETFL, old_fcntl) == -1)
+		ha_warning("Cannot make the unix socket non-blocking\n");
+	/* our duplicates are not needed anymore, sent or not */
+	while (nb_fd > 0)
+		close(fds[--nb_fd]);
+	appctx->st0 = CLI_ST_END;
+	free(fds);
+	free(meta);
+	free(sess);
+	free(cmsgbuf);
+	return 1;
+}
+
 static int cli_parse_simple(char **args, char *payload, struct appctx *appctx, void *private)
 {
 	if (*args[0] == 'h')
@@ -2956,6 +3254,7 @@ static struct cli_kw_list cli_kws = {{ },{
 	{ { "prompt", NULL },                    NULL,                                                                                                cli_parse_simple, NULL, NULL, NULL, ACCESS_MASTER },
 	{ { "quit", NULL },                      NULL,                                                                                                cli_parse_simple, NULL, NULL, NULL, ACCESS_MASTER },
 	{ { "_getsocks", NULL },                 NULL,                                                                                                _getsocks, NULL },
+	{ { "_getidleconns", NULL },             NULL,                                                                                                _getidleconns, NULL },
 	{ { "expert-mode", NULL },               NULL,                                                                                                cli_parse_expert_experimental_mode, NULL }, // not listed
 	{ { "experimental-mode", NULL },         NULL,                                                                                                cli_parse_expert_experimental_mode, NULL }, // not listed
 	{ { "set", "maxconn", "global",  NULL }, "set maxconn global <value>              : change the per-process maxconn setting",                  cli_parse_set_maxconn_global, NULL },
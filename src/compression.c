@@ -24,6 +24,12 @@
 #undef free_func
 #endif /* USE_ZLIB */
 
+#if defined(USE_ZSTD)
+/* the custom allocators are only exposed in the advanced API */
+#define ZSTD_STATIC_LINKING_ONLY
+#include <zstd.h>
+#endif /* USE_ZSTD */
+
 #include <haproxy/api.h>
 #include <haproxy/cfgparse.h>
 #include <haproxy/compression-t.h>
@@ -60,6 +66,25 @@ static int global_tune_zlibwindowsize = MAX_WBITS;  /* zlib window size */
 
 #endif
 
+#if defined(USE_BROTLI) || defined(USE_ZSTD)
+
+static void *alloc_comp_lib(void *opaque, size_t size);
+static void free_comp_lib(void *opaque, void *ptr);
+
+#ifndef USE_ZLIB
+long zlib_used_memory = 0;
+#endif
+
+#endif
+
+#ifdef USE_BROTLI
+static int global_tune_brotliwindowsize = 18;       /* brotli window size (log2) */
+#endif
+
+#ifdef USE_ZSTD
+static int global_tune_zstdwindowsize = 15;         /* zstd window size (log2) */
+#endif
+
 unsigned int compress_min_idle = 0;
 
 static int identity_init(struct comp_ctx **comp_ctx, int level);
@@ -90,6 +115,26 @@ static int deflate_end(struct comp_ctx **comp_ctx);
 
 #endif /* USE_ZLIB */
 
+#if defined(USE_BROTLI)
+
+static int brotli_init(struct comp_ctx **comp_ctx, int level);
+static int brotli_add_data(struct comp_ctx *comp_ctx, const char *in_data, int in_len, struct buffer *out);
+static int brotli_flush(struct comp_ctx *comp_ctx, struct buffer *out);
+static int brotli_finish(struct comp_ctx *comp_ctx, struct buffer *out);
+static int brotli_end(struct comp_ctx **comp_ctx);
+
+#endif /* USE_BROTLI */
+
+#if defined(USE_ZSTD)
+
+static int zstd_init(struct comp_ctx **comp_ctx, int level);
+static int zstd_add_data(struct comp_ctx *comp_ctx, const char *in_data, int in_len, struct buffer *out);
+static int zstd_flush(struct comp_ctx *comp_ctx, struct buffer *out);
+static int zstd_finish(struct comp_ctx *comp_ctx, struct buffer *out);
+static int zstd_end(struct comp_ctx **comp_ctx);
+
+#endif /* USE_ZSTD */
+
 
 const struct comp_algo comp_algos[] =
 {
@@ -103,6 +148,12 @@ const struct comp_algo comp_algos[] =
 	{ "raw-deflate", 11, "deflate",  7, raw_def_init,  deflate_add_data,  deflate_flush,  deflate_finish,  deflate_end },
 	{ "gzip",         4, "gzip",     4, gzip_init,     deflate_add_data,  deflate_flush,  deflate_finish,  deflate_end },
 #endif /* USE_ZLIB */
+#if defined(USE_BROTLI)
+	{ "br",           2, "br",       2, brotli_init,   brotli_add_data,   brotli_flush,   brotli_finish,   brotli_end },
+#endif /* USE_BROTLI */
+#if defined(USE_ZSTD)
+	{ "zstd",         4, "zstd",     4, zstd_init,     zstd_add_data,     zstd_flush,     zstd_finish,     zstd_end },
+#endif /* USE_ZSTD */
 	{ NULL,       0, NULL,          0, NULL ,         NULL,              NULL,           NULL,           NULL }
 };
 
@@ -148,7 +199,7 @@ int comp_append_algo(struct comp *comp, const char *algo)
 	return -1;
 }
 
-#if defined(USE_ZLIB) || defined(USE_SLZ)
+#if defined(USE_ZLIB) || defined(USE_SLZ) || defined(USE_BROTLI) || defined(USE_ZSTD)
 DECLARE_STATIC_POOL(pool_comp_ctx, "comp_ctx", sizeof(struct comp_ctx));
 
 /*
@@ -178,6 +229,12 @@ static inline int init_comp_ctx(struct comp_ctx **comp_ctx)
 	strm->zalloc = alloc_zlib;
 	strm->zfree = free_zlib;
 	strm->opaque = *comp_ctx;
+#endif
+#if defined(USE_BROTLI)
+	(*comp_ctx)->brotli = NULL;
+#endif
+#if defined(USE_ZSTD)
+	(*comp_ctx)->zstd = NULL;
 #endif
 	return 0;
 }
@@ -701,12 +758,327 @@ static int zlib_parse_global_windowsize(char **args, int section_type, struct pr
 
 #endif /* USE_ZLIB */
 
+#if defined(USE_BROTLI) || defined(USE_ZSTD)
+
+/* Size of the header placed in front of the areas allocated for the brotli and
+ * zstd encoders. It stores the area's size and preserves malloc()'s alignment.
+ */
+#define COMP_LIB_HDR_SIZE 16
+
+/* Allocation function passed to the brotli and zstd encoders. Their memory is
+ * accounted in zlib_used_memory so that all algorithms share the limit set by
+ * global.maxzlibmem. Contrary to zlib, these encoders may allocate memory
+ * after the first data were emitted, and a failure there would truncate the
+ * response. Thus the limit is only enforced by the init functions, and this
+ * function only fails when the system is out of memory.
+ */
+static void *alloc_comp_lib(void *opaque, size_t size)
+{
+	char *area;
+
+	size += COMP_LIB_HDR_SIZE;
+	area = malloc(size);
+	if (!area)
+		return NULL;
+
+	*(size_t *)area = size;
+	_HA_ATOMIC_ADD(&zlib_used_memory, size);
+	__ha_barrier_atomic_store();
+	return area + COMP_LIB_HDR_SIZE;
+}
+
+static void free_comp_lib(void *opaque, void *ptr)
+{
+	char *area;
+
+	if (!ptr)
+		return;
+
+	area = (char *)ptr - COMP_LIB_HDR_SIZE;
+	_HA_ATOMIC_SUB(&zlib_used_memory, *(size_t *)area);
+	__ha_barrier_atomic_store();
+	free(area);
+}
+
+/* Returns non-zero if <size> more bytes may be used by the compression */
+static inline int comp_lib_mem_avail(size_t size)
+{
+	return global.maxzlibmem <= 0 || (global.maxzlibmem - zlib_used_memory) >= (long)size;
+}
+
+#endif /* USE_BROTLI || USE_ZSTD */
+
+#if defined(USE_BROTLI)
+
+/**************************
+****  brotli algorithm ****
+***************************/
+
+/* Brotli does not allow to change the quality once the stream was started, so
+ * <level> is used for the whole stream. It allocates its memory progressively,
+ * so twice the window size is required to be available to start a stream.
+ * Returns < 0 on error.
+ */
+static int brotli_init(struct comp_ctx **comp_ctx, int level)
+{
+	BrotliEncoderState *state;
+
+	if (!comp_lib_mem_avail((size_t)2 << global_tune_brotliwindowsize))
+		return -1;
+
+	if (init_comp_ctx(comp_ctx) < 0)
+		return -1;
+
+	state = BrotliEncoderCreateInstance(alloc_comp_lib, free_comp_lib, NULL);
+	if (!state)
+		goto fail;
+
+	if (!BrotliEncoderSetParameter(state, BROTLI_PARAM_QUALITY, level) ||
+	    !BrotliEncoderSetParameter(state, BROTLI_PARAM_LGWIN, global_tune_brotliwindowsize)) {
+		BrotliEncoderDestroyInstance(state);
+		goto fail;
+	}
+
+	(*comp_ctx)->brotli = state;
+	(*comp_ctx)->cur_lvl = level;
+	return 0;
+
+  fail:
+	deinit_comp_ctx(comp_ctx);
+	return -1;
+}
+
+/* Return the size of consumed data or -1 */
+static int brotli_add_data(struct comp_ctx *comp_ctx, const char *in_data, int in_len, struct buffer *out)
+{
+	const uint8_t *next_in = (const uint8_t *)in_data;
+	uint8_t *next_out = (uint8_t *)b_tail(out);
+	size_t avail_in = in_len;
+	size_t avail_out = b_room(out);
+
+	if (in_len <= 0)
+		return 0;
+
+	while (avail_in && avail_out) {
+		if (!BrotliEncoderCompressStream(comp_ctx->brotli, BROTLI_OPERATION_PROCESS,
+						 &avail_in, &next_in, &avail_out, &next_out, NULL))
+			return -1;
+	}
+
+	b_add(out, b_room(out) - avail_out);
+	return in_len - avail_in;
+}
+
+static int brotli_flush_or_finish(struct comp_ctx *comp_ctx, struct buffer *out, BrotliEncoderOperation op)
+{
+	BrotliEncoderState *state = comp_ctx->brotli;
+	const uint8_t *next_in = NULL;
+	uint8_t *next_out = (uint8_t *)b_tail(out);
+	size_t avail_in = 0;
+	size_t avail_out = b_room(out);
+	int out_len;
+
+	do {
+		if (!BrotliEncoderCompressStream(state, op, &avail_in, &next_in, &avail_out, &next_out, NULL))
+			return -1;
+	} while (avail_out && BrotliEncoderHasMoreOutput(state));
+
+	/* the whole trailer must fit, otherwise the stream is truncated */
+	if (op == BROTLI_OPERATION_FINISH && !BrotliEncoderIsFinished(state))
+		return -1;
+
+	out_len = b_room(out) - avail_out;
+	b_add(out, out_len);
+	return out_len;
+}
+
+static int brotli_flush(struct comp_ctx *comp_ctx, struct buffer *out)
+{
+	return brotli_flush_or_finish(comp_ctx, out, BROTLI_OPERATION_FLUSH);
+}
+
+static int brotli_finish(struct comp_ctx *comp_ctx, struct buffer *out)
+{
+	return brotli_flush_or_finish(comp_ctx, out, BROTLI_OPERATION_FINISH);
+}
+
+static int brotli_end(struct comp_ctx **comp_ctx)
+{
+	BrotliEncoderDestroyInstance((*comp_ctx)->brotli);
+	deinit_comp_ctx(comp_ctx);
+	return 0;
+}
+
+/* config parser for global "tune.brotli.windowsize" */
+static int brotli_parse_global_windowsize(char **args, int section_type, struct proxy *curpx,
+                                          const struct proxy *defpx, const char *file, int line,
+                                          char **err)
+{
+	if (too_many_args(1, args, err, NULL))
+		return -1;
+
+	global_tune_brotliwindowsize = atoi(args[1]);
+	if (global_tune_brotliwindowsize < BROTLI_MIN_WINDOW_BITS ||
+	    global_tune_brotliwindowsize > BROTLI_MAX_WINDOW_BITS) {
+		memprintf(err, "'%s' expects a numeric value between %d and %d.",
+			  args[0], BROTLI_MIN_WINDOW_BITS, BROTLI_MAX_WINDOW_BITS);
+		return -1;
+	}
+	return 0;
+}
+
+#endif /* USE_BROTLI */
+
+#if defined(USE_ZSTD)
+
+/**************************
+****   zstd algorithm  ****
+***************************/
+
+/* zstd's level 0 designates its default level, and negative levels trade the
+ * ratio for speed, so our level 0 is mapped to the fastest regular level.
+ */
+static inline int zstd_level(int level)
+{
+	return level > 0 ? level : 1;
+}
+
+/* The encoder is started on an empty input so that it allocates its memory
+ * here, which is then checked against the limit. Returns < 0 on error.
+ */
+static int zstd_init(struct comp_ctx **comp_ctx, int level)
+{
+	ZSTD_customMem mem = { alloc_comp_lib, free_comp_lib, NULL };
+	ZSTD_inBuffer in = { NULL, 0, 0 };
+	ZSTD_outBuffer out = { NULL, 0, 0 };
+	ZSTD_CStream *zstd;
+
+	if (init_comp_ctx(comp_ctx) < 0)
+		return -1;
+
+	zstd = ZSTD_createCCtx_advanced(mem);
+	if (!zstd)
+		goto fail;
+
+	if (ZSTD_isError(ZSTD_CCtx_setParameter(zstd, ZSTD_c_compressionLevel, zstd_level(level))) ||
+	    ZSTD_isError(ZSTD_CCtx_setParameter(zstd, ZSTD_c_windowLog, global_tune_zstdwindowsize)) ||
+	    ZSTD_isError(ZSTD_compressStream2(zstd, &out, &in, ZSTD_e_continue)) ||
+	    !comp_lib_mem_avail(0)) {
+		ZSTD_freeCCtx(zstd);
+		goto fail;
+	}
+
+	(*comp_ctx)->zstd = zstd;
+	(*comp_ctx)->cur_lvl = level;
+	return 0;
+
+  fail:
+	deinit_comp_ctx(comp_ctx);
+	return -1;
+}
+
+/* Return the size of consumed data or -1 */
+static int zstd_add_data(struct comp_ctx *comp_ctx, const char *in_data, int in_len, struct buffer *out)
+{
+	ZSTD_inBuffer in = { in_data, in_len, 0 };
+	ZSTD_outBuffer zout = { b_tail(out), b_room(out), 0 };
+
+	if (in_len <= 0)
+		return 0;
+
+	while (in.pos < in.size && zout.pos < zout.size) {
+		if (ZSTD_isError(ZSTD_compressStream2(comp_ctx->zstd, &zout, &in, ZSTD_e_continue)))
+			return -1;
+	}
+
+	b_add(out, zout.pos);
+	return in.pos;
+}
+
+static int zstd_flush_or_finish(struct comp_ctx *comp_ctx, struct buffer *out, ZSTD_EndDirective mode)
+{
+	ZSTD_inBuffer in = { NULL, 0, 0 };
+	ZSTD_outBuffer zout = { b_tail(out), b_room(out), 0 };
+	size_t ret;
+
+	do {
+		ret = ZSTD_compressStream2(comp_ctx->zstd, &zout, &in, mode);
+		if (ZSTD_isError(ret))
+			return -1;
+	} while (ret && zout.pos < zout.size);
+
+	/* the whole epilogue must fit, otherwise the frame is truncated */
+	if (mode == ZSTD_e_end && ret)
+		return -1;
+
+	b_add(out, zout.pos);
+
+	/* compression limit, the new level applies to the next blocks */
+	if ((global.comp_rate_lim > 0 && (read_freq_ctr(&global.comp_bps_out) > global.comp_rate_lim)) ||    /* rate */
+	   (ti->idle_pct < compress_min_idle)) {                                                                     /* idle */
+		/* decrease level */
+		if (comp_ctx->cur_lvl > 0) {
+			comp_ctx->cur_lvl--;
+			ZSTD_CCtx_setParameter(comp_ctx->zstd, ZSTD_c_compressionLevel, zstd_level(comp_ctx->cur_lvl));
+		}
+
+	} else if (comp_ctx->cur_lvl < global.tune.comp_maxlevel) {
+		/* increase level */
+		comp_ctx->cur_lvl++ ;
+		ZSTD_CCtx_setParameter(comp_ctx->zstd, ZSTD_c_compressionLevel, zstd_level(comp_ctx->cur_lvl));
+	}
+
+	return zout.pos;
+}
+
+static int zstd_flush(struct comp_ctx *comp_ctx, struct buffer *out)
+{
+	return zstd_flush_or_finish(comp_ctx, out, ZSTD_e_flush);
+}
+
+static int zstd_finish(struct comp_ctx *comp_ctx, struct buffer *out)
+{
+	return zstd_flush_or_finish(comp_ctx, out, ZSTD_e_end);
+}
+
+static int zstd_end(struct comp_ctx **comp_ctx)
+{
+	ZSTD_freeCCtx((*comp_ctx)->zstd);
+	deinit_comp_ctx(comp_ctx);
+	return 0;
+}
+
+/* config parser for global "tune.zstd.windowsize" */
+static int zstd_parse_global_windowsize(char **args, int section_type, struct proxy *curpx,
+                                        const struct proxy *defpx, const char *file, int line,
+                                        char **err)
+{
+	if (too_many_args(1, args, err, NULL))
+		return -1;
+
+	global_tune_zstdwindowsize = atoi(args[1]);
+	if (global_tune_zstdwindowsize < ZSTD_WINDOWLOG_MIN || global_tune_zstdwindowsize > 24) {
+		memprintf(err, "'%s' expects a numeric value between %d and 24.",
+			  args[0], ZSTD_WINDOWLOG_MIN);
+		return -1;
+	}
+	return 0;
+}
+
+#endif /* USE_ZSTD */
+
 
 /* config keyword parsers */
 static struct cfg_kw_list cfg_kws = {ILH, {
 #ifdef USE_ZLIB
 	{ CFG_GLOBAL, "tune.zlib.memlevel",   zlib_parse_global_memlevel },
 	{ CFG_GLOBAL, "tune.zlib.windowsize", zlib_parse_global_windowsize },
+#endif
+#ifdef USE_BROTLI
+	{ CFG_GLOBAL, "tune.brotli.windowsize", brotli_parse_global_windowsize },
+#endif
+#ifdef USE_ZSTD
+	{ CFG_GLOBAL, "tune.zstd.windowsize", zstd_parse_global_windowsize },
 #endif
 	{ 0, NULL, NULL }
 }};
@@ -716,7 +1088,7 @@ INITCALL1(STG_REGISTER, cfg_register_keywords, &cfg_kws);
 __attribute__((constructor))
 static void __comp_fetch_init(void)
 {
-#if defined(USE_ZLIB) && defined(DEFAULT_MAXZLIBMEM)
+#if (defined(USE_ZLIB) || defined(USE_BROTLI) || defined(USE_ZSTD)) && defined(DEFAULT_MAXZLIBMEM)
 	global.maxzlibmem = DEFAULT_MAXZLIBMEM * 1024U * 1024U;
 #endif
 }
@@ -733,6 +1105,14 @@ static void comp_register_build_opts(void)
 	memprintf(&ptr, "Built with libslz for stateless compression.");
 #else
 	memprintf(&ptr, "Built without compression support (neither USE_ZLIB nor USE_SLZ are set).");
+#endif
+#ifdef USE_BROTLI
+	memprintf(&ptr, "%s\nRunning on brotli encoder version : %d.%d.%d", ptr,
+		  BrotliEncoderVersion() >> 24, (BrotliEncoderVersion() >> 12) & 0xfff, BrotliEncoderVersion() & 0xfff);
+#endif
+#ifdef USE_ZSTD
+	memprintf(&ptr, "%s\nBuilt with zstd version : " ZSTD_VERSION_STRING, ptr);
+	memprintf(&ptr, "%s\nRunning on zstd version : %s", ptr, ZSTD_versionString());
 #endif
 	memprintf(&ptr, "%s\nCompression algorithms supported :", ptr);
 
@@ -18,6 +18,7 @@
 #include <haproxy/fd.h>
 #include <haproxy/frontend.h>
 #include <haproxy/hash.h>
+#include <haproxy/listener.h>
 #include <haproxy/log-t.h>
 #include <haproxy/namespace.h>
 #include <haproxy/net_helper.h>
@@ -34,6 +35,14 @@ DECLARE_POOL(pool_head_conn_hash_node, "conn_hash_node", sizeof(struct conn_hash
 DECLARE_POOL(pool_head_sockaddr,       "sockaddr",       sizeof(struct sockaddr_storage));
 DECLARE_POOL(pool_head_authority,      "authority",      PP2_AUTHORITY_MAX);
 
+/* make sure the fields used on each I/O event remain in the first two cache
+ * lines of the connection, see connection-t.h.
+ */
+BUILD_ASSERT(offsetof(struct connection, target) + sizeof(void *) <= 64,
+	     "the first cache line of struct connection overflows");
+BUILD_ASSERT(offsetof(struct connection, destroy_cb) <= 2 * 64,
+	     "the second cache line of struct connection overflows");
+
 struct idle_conns idle_conns[MAX_THREADS] = { };
 struct xprt_ops *registered_xprt[XPRT_ENTRIES] = { NULL, };
 
@@ -43,6 +52,7 @@ struct mux_proto_list mux_proto_list = {
 };
 
 struct mux_stopping_data mux_stopping_data[MAX_THREADS];
+struct conn_migrate_data conn_migrate_data[MAX_THREADS];
 
 /* disables sending of proxy-protocol-v2's LOCAL command */
 static int pp2_never_send_local;
@@ -88,6 +98,93 @@ int conn_create_mux(struct connection *conn)
 
 }
 
+/* Offers the idle frontend connection <conn> owned by the current thread to
+ * the other threads, and wakes up thread <thr> so that it takes it over. The
+ * connection moves from the thread's stopping list to its migration list. The
+ * mux must be ready to see the connection taken over at any time before calling
+ * this function, and must check under the thread's idle_conns_lock that it was
+ * not stolen before using it again (see conn_migrate_cancel()).
+ */
+void conn_migrate_offer(struct connection *conn, int thr)
+{
+	HA_SPIN_LOCK(IDLE_CONNS_LOCK, &idle_conns[tid].idle_conns_lock);
+	LIST_DEL_INIT(&conn->stopping_list);
+	LIST_APPEND(&conn_migrate_data[tid].list, &conn->stopping_list);
+	HA_SPIN_UNLOCK(IDLE_CONNS_LOCK, &idle_conns[tid].idle_conns_lock);
+
+	if (conn_migrate_data[thr].tasklet)
+		tasklet_wakeup(conn_migrate_data[thr].tasklet);
+}
+
+/* Withdraws the frontend connection <conn> previously offered by the current
+ * thread and puts it back into the thread's stopping list. Must be called with
+ * the thread's idle_conns_lock held.
+ */
+void conn_migrate_cancel(struct connection *conn)
+{
+	LIST_DEL_INIT(&conn->stopping_list);
+	LIST_APPEND(&mux_stopping_data[tid].list, &conn->stopping_list);
+}
+
+/* Takes over the frontend connections offered by the other threads as long as
+ * they run more connections than the current one on the same listener. The
+ * mux's takeover() function removes the connection from the migration list,
+ * then it's attached to the current thread's stopping list and accounted for
+ * in its listener's per-thread connection counts.
+ */
+static struct task *conn_migrate_io_cb(struct task *t, void *context, unsigned int state)
+{
+	struct connection *conn;
+	struct listener *l;
+	int thr;
+
+	for (thr = 0; thr < global.nbthread; thr++) {
+		if (thr == tid || LIST_ISEMPTY(&conn_migrate_data[thr].list))
+			continue;
+
+		HA_SPIN_LOCK(IDLE_CONNS_LOCK, &idle_conns[thr].idle_conns_lock);
+		while (!LIST_ISEMPTY(&conn_migrate_data[thr].list)) {
+			conn = LIST_ELEM(conn_migrate_data[thr].list.n, struct connection *, stopping_list);
+			l = objt_listener(conn->target);
+			if (!l || !(thread_mask(l->rx.settings->bind_thread) & tid_bit) ||
+			    l->thr_conn[thr] < l->thr_conn[tid] + 2)
+				break;
+
+			if (!conn->mux->takeover || conn->mux->takeover(conn, thr) != 0)
+				break;
+
+			LIST_APPEND(&mux_stopping_data[tid].list, &conn->stopping_list);
+			_HA_ATOMIC_DEC(&l->thr_conn[thr]);
+			_HA_ATOMIC_INC(&l->thr_conn[tid]);
+		}
+		HA_SPIN_UNLOCK(IDLE_CONNS_LOCK, &idle_conns[thr].idle_conns_lock);
+	}
+	return t;
+}
+
+/* allocates the current thread's migration tasklet */
+static int conn_migrate_alloc_per_thread()
+{
+	LIST_INIT(&conn_migrate_data[tid].list);
+	conn_migrate_data[tid].tasklet = tasklet_new();
+	if (!conn_migrate_data[tid].tasklet)
+		return 0;
+	conn_migrate_data[tid].tasklet->process = conn_migrate_io_cb;
+	conn_migrate_data[tid].tasklet->tid = tid;
+	return 1;
+}
+
+/* releases the current thread's migration tasklet */
+static void conn_migrate_free_per_thread()
+{
+	if (conn_migrate_data[tid].tasklet)
+		tasklet_free(conn_migrate_data[tid].tasklet);
+	conn_migrate_data[tid].tasklet = NULL;
+}
+
+REGISTER_PER_THREAD_ALLOC(conn_migrate_alloc_per_thread);
+REGISTER_PER_THREAD_FREE(conn_migrate_free_per_thread);
+
 /* Send a message over an established connection. It makes use of send() and
  * returns the same return code and errno. If the socket layer is not ready yet
  * then -1 is returned and ENOTSOCK is set into errno. If the fd is not marked
@@ -1027,6 +1124,8 @@ void list_mux_proto(FILE *out)
 			chunk_appendf(chk, "%sHOL_RISK", (b_data(chk) ? "|": ""));
 		if (item->mux->flags & MX_FL_NO_UPG)
 			chunk_appendf(chk, "%sNO_UPG", (b_data(chk) ? "|": ""));
+		if (item->mux->flags & MX_FL_WARM_CONN)
+			chunk_appendf(chk, "%sWARM_CONN", (b_data(chk) ? "|": ""));
 
 		fprintf(out, " %15s : mode=%-10s side=%-8s  mux=%-8s flags=%.*s\n",
 			(proto.len ? proto.ptr : "<default>"), mode, side, item->mux->name,
@@ -1,8 +1,11 @@
 #define _GNU_SOURCE
 #include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
 
 #include <haproxy/compat.h>
 #include <haproxy/cpuset.h>
+#include <haproxy/defaults.h>
 #include <haproxy/intops.h>
 
 struct cpu_map cpu_map;
@@ -47,6 +50,19 @@ int ha_cpuset_clr(struct hap_cpuset *set, int cpu)
 #endif
 }
 
+int ha_cpuset_isset(const struct hap_cpuset *set, int cpu)
+{
+	if (cpu >= ha_cpuset_size())
+		return 0;
+
+#if defined(CPUSET_USE_CPUSET) || defined(CPUSET_USE_FREEBSD_CPUSET)
+	return CPU_ISSET(cpu, &set->cpuset);
+
+#elif defined(CPUSET_USE_ULONG)
+	return !!(set->cpuset & (0x1 << cpu));
+#endif
+}
+
 void ha_cpuset_and(struct hap_cpuset *dst, const struct hap_cpuset *src)
 {
 #if defined(CPUSET_USE_CPUSET)
@@ -121,3 +137,239 @@ int ha_cpuset_size()
 
 #endif
 }
+
+/* CPUs of each NUMA node, and number of nodes, -1 when not yet detected */
+static struct hap_cpuset numa_cpus[HA_MAX_NODES];
+static int numa_nodes = -1;
+
+/* Parses a sysfs cpu list such as "0-3,8-11" from <str> into <set>. */
+static void ha_cpuset_parse_list(struct hap_cpuset *set, const char *str)
+{
+	char *end;
+	long lo, hi;
+
+	ha_cpuset_zero(set);
+	while (*str >= '0' && *str <= '9') {
+		lo = hi = strtol(str, &end, 10);
+		if (*end == '-')
+			hi = strtol(end + 1, &end, 10);
+		for (; lo <= hi; lo++)
+			ha_cpuset_set(set, lo);
+		if (*end != ',')
+			break;
+		str = end + 1;
+	}
+}
+
+/* Detects the NUMA nodes and their CPUs. Only Linux is supported, other
+ * systems always report a single node.
+ */
+static void ha_numa_detect()
+{
+	numa_nodes = 0;
+#if defined(__linux__)
+	for (; numa_nodes < HA_MAX_NODES; numa_nodes++) {
+		char path[64], line[1024];
+		FILE *f;
+
+		snprintf(path, sizeof(path), "%s/node/node%d/cpulist", NUMA_DETECT_SYSTEM_SYSFS_PATH, numa_nodes);
+		f = fopen(path, "r");
+		if (!f)
+			break;
+		if (!fgets(line, sizeof(line), f))
+			line[0] = 0;
+		fclose(f);
+		ha_cpuset_parse_list(&numa_cpus[numa_nodes], line);
+	}
+#endif
+	if (!numa_nodes)
+		numa_nodes = 1;
+}
+
+int ha_numa_nodes()
+{
+	if (numa_nodes < 0)
+		ha_numa_detect();
+	return numa_nodes;
+}
+
+int ha_cpuset_node(const struct hap_cpuset *set)
+{
+	struct hap_cpuset tmp;
+	int node, count;
+
+	count = ha_cpuset_count(set);
+	if (!count || ha_numa_nodes() < 2)
+		return -1;
+
+	for (node = 0; node < numa_nodes; node++) {
+		ha_cpuset_assign(&tmp, set);
+		ha_cpuset_and(&tmp, &numa_cpus[node]);
+		if (ha_cpuset_count(&tmp) == count)
+			return node;
+	}
+	return -1;
+}
+
+#if defined(__linux__)
+/* Reads the sysfs CPU list <file> of CPU <cpu> into <set>. Returns non-zero if
+ * the list could be read and is not empty, otherwise zero.
+ */
+static int ha_cpu_read_list(int cpu, const char *file, struct hap_cpuset *set)
+{
+	char path[128], line[1024];
+	FILE *f;
+
+	ha_cpuset_zero(set);
+	snprintf(path, sizeof(path), "%s/cpu/cpu%d/%s", NUMA_DETECT_SYSTEM_SYSFS_PATH, cpu, file);
+	f = fopen(path, "r");
+	if (!f)
+		return 0;
+	if (!fgets(line, sizeof(line), f))
+		line[0] = 0;
+	fclose(f);
+	ha_cpuset_parse_list(set, line);
+	return ha_cpuset_count(set) > 0;
+}
+
+/* Fills <set> with the CPUs sharing their level 3 cache with <cpu>. Returns
+ * non-zero on success, or zero if it is unknown.
+ */
+static int ha_cpu_l3(int cpu, struct hap_cpuset *set)
+{
+	char file[64];
+	int idx;
+
+	for (idx = 0; idx < 8; idx++) {
+		snprintf(file, sizeof(file), "cache/index%d/level", idx);
+		if (!ha_cpu_read_list(cpu, file, set))
+			return 0;
+		if (ha_cpuset_ffs(set) - 1 != 3)
+			continue;
+		snprintf(file, sizeof(file), "cache/index%d/shared_cpu_list", idx);
+		return ha_cpu_read_list(cpu, file, set);
+	}
+	return 0;
+}
+
+/* CPU topology, only used to sort the CPUs in ha_cpuset_auto_map() */
+struct ha_cpu_topo {
+	int cpu;    /* CPU number */
+	int node;   /* NUMA node */
+	int l3;     /* first CPU sharing the same L3 cache, or -1 if unknown */
+	int core;   /* first usable CPU of the same core */
+	int smt;    /* rank of the CPU among the usable ones of its core */
+};
+
+/* sorts the CPUs to pick the first threads of all cores first */
+static int ha_cpu_topo_cmp_pick(const void *a, const void *b)
+{
+	const struct ha_cpu_topo *l = a, *r = b;
+
+	if (l->smt != r->smt)
+		return l->smt - r->smt;
+	if (l->node != r->node)
+		return l->node - r->node;
+	if (l->l3 != r->l3)
+		return l->l3 - r->l3;
+	return l->cpu - r->cpu;
+}
+
+/* sorts the CPUs so that those sharing a node, a cache or a core are adjacent */
+static int ha_cpu_topo_cmp_order(const void *a, const void *b)
+{
+	const struct ha_cpu_topo *l = a, *r = b;
+
+	if (l->node != r->node)
+		return l->node - r->node;
+	if (l->l3 != r->l3)
+		return l->l3 - r->l3;
+	if (l->core != r->core)
+		return l->core - r->core;
+	return l->cpu - r->cpu;
+}
+#endif /* __linux__ */
+
+int ha_cpuset_l3(const struct hap_cpuset *set)
+{
+#if defined(__linux__)
+	struct hap_cpuset l3, tmp;
+	int count = ha_cpuset_count(set);
+
+	if (!count || !ha_cpu_l3(ha_cpuset_ffs(set) - 1, &l3))
+		return -1;
+
+	ha_cpuset_assign(&tmp, set);
+	ha_cpuset_and(&tmp, &l3);
+	if (ha_cpuset_count(&tmp) == count)
+		return ha_cpuset_ffs(&l3) - 1;
+#endif
+	return -1;
+}
+
+int ha_cpuset_auto_map(struct hap_cpuset *map, int nbthread)
+{
+#if defined(__linux__)
+	struct hap_cpuset avail, set;
+	struct ha_cpu_topo *topo, *t;
+	int cpu, sib, ncpu, nused, node, thr;
+
+	if (nbthread <= 0 || sched_getaffinity(0, sizeof(avail.cpuset), &avail.cpuset) == -1)
+		return 0;
+
+	/* the process' own mapping will be applied later */
+	if (ha_cpuset_count(&cpu_map.proc))
+		ha_cpuset_and(&avail, &cpu_map.proc);
+
+	ncpu = ha_cpuset_count(&avail);
+	topo = ncpu ? calloc(ncpu, sizeof(*topo)) : NULL;
+	if (!topo)
+		return 0;
+
+	ncpu = 0;
+	for (cpu = 0; cpu < ha_cpuset_size(); cpu++) {
+		if (!ha_cpuset_isset(&avail, cpu))
+			continue;
+
+		t = &topo[ncpu++];
+		t->cpu = cpu;
+		t->l3 = ha_cpu_l3(cpu, &set) ? ha_cpuset_ffs(&set) - 1 : -1;
+		t->core = cpu;
+
+		for (node = 0; node < ha_numa_nodes(); node++) {
+			if (ha_cpuset_isset(&numa_cpus[node], cpu)) {
+				t->node = node;
+				break;
+			}
+		}
+
+		/* only the siblings we may run on count to rank this CPU */
+		if (ha_cpu_read_list(cpu, "topology/thread_siblings_list", &set)) {
+			ha_cpuset_and(&set, &avail);
+			for (sib = 0; sib < cpu; sib++) {
+				if (!ha_cpuset_isset(&set, sib))
+					continue;
+				if (!t->smt++)
+					t->core = sib;
+			}
+		}
+	}
+
+	/* use one thread of each core before using their siblings, then number
+	 * the selected CPUs so that threads sharing a cache are contiguous.
+	 */
+	nused = MIN(ncpu, nbthread);
+	qsort(topo, ncpu, sizeof(*topo), ha_cpu_topo_cmp_pick);
+	qsort(topo, nused, sizeof(*topo), ha_cpu_topo_cmp_order);
+
+	for (thr = 0; thr < nbthread; thr++) {
+		ha_cpuset_zero(&map[thr]);
+		ha_cpuset_set(&map[thr], topo[(long)thr * nused / nbthread].cpu);
+	}
+
+	free(topo);
+	return nused;
+#else
+	return 0;
+#endif
+}
@@ -157,8 +157,8 @@ void ha_thread_dump(struct buffer *buf, int thr, int calling_tid)
 	              (thr == calling_tid) ? '*' : ' ', stuck ? '>' : ' ', thr + 1,
 		      ha_get_pthread_id(thr),
 		      thread_has_tasks(),
-	              !!(global_tasks_mask & thr_bit),
-	              !eb_is_empty(&task_per_thread[thr].timers),
+	              !!(task_per_tgroup[ha_thread_info[thr].tgrp].tasks_mask & thr_bit),
+	              thread_has_timers(&task_per_thread[thr]),
 	              !eb_is_empty(&task_per_thread[thr].rqueue),
 	              !(LIST_ISEMPTY(&task_per_thread[thr].tasklets[TL_URGENT]) &&
 			LIST_ISEMPTY(&task_per_thread[thr].tasklets[TL_NORMAL]) &&
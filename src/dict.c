@@ -3,8 +3,19 @@
 #include <import/eb32tree.h>
 #include <import/ebistree.h>
 #include <haproxy/dict.h>
+#include <haproxy/hash.h>
+#include <haproxy/init.h>
 #include <haproxy/thread.h>
 
+/* Per-thread cache of the last entries returned by dict_insert(), indexed by
+ * a hash of their value. Each cached entry holds a reference so that it may
+ * be returned without looking the dictionary up nor taking its lock.
+ */
+static THREAD_LOCAL struct {
+	struct dict *d;
+	struct dict_entry *de;
+} dict_cache[DICT_CACHE_SIZE];
+
 struct dict *new_dict(const char *name)
 {
 	struct dict *dict;
@@ -75,20 +86,23 @@ static struct dict_entry *__dict_lookup(struct dict *d, const char *s)
 }
 
 /*
- * Insert an entry in <d> dictionary with <s> as value. *
+ * Looks up or inserts an entry in <d> dictionary with <s> as value, and
+ * returns it with a reference held, or NULL if it could not be allocated.
+ * The reference is taken under the lock so that the entry cannot be released
+ * in the mean time.
  */
-struct dict_entry *dict_insert(struct dict *d, char *s)
+static struct dict_entry *__dict_insert(struct dict *d, char *s)
 {
 	struct dict_entry *de;
 	struct ebpt_node *n;
 
 	HA_RWLOCK_RDLOCK(DICT_LOCK, &d->rwlock);
 	de = __dict_lookup(d, s);
-	HA_RWLOCK_RDUNLOCK(DICT_LOCK, &d->rwlock);
-	if (de) {
+	if (de)
 		HA_ATOMIC_INC(&de->refcount);
+	HA_RWLOCK_RDUNLOCK(DICT_LOCK, &d->rwlock);
+	if (de)
 		return de;
-	}
 
 	de = new_dict_entry(s);
 	if (!de)
@@ -96,6 +110,8 @@ struct dict_entry *dict_insert(struct dict *d, char *s)
 
 	HA_RWLOCK_WRLOCK(DICT_LOCK, &d->rwlock);
 	n = ebis_insert(&d->values, &de->value);
+	if (n != &de->value)
+		HA_ATOMIC_INC(&container_of(n, struct dict_entry, value)->refcount);
 	HA_RWLOCK_WRUNLOCK(DICT_LOCK, &d->rwlock);
 	if (n != &de->value) {
 		free_dict_entry(de);
@@ -105,6 +121,40 @@ struct dict_entry *dict_insert(struct dict *d, char *s)
 	return de;
 }
 
+/*
+ * Insert an entry in <d> dictionary with <s> as value, or return the existing
+ * one, with a reference held in both cases. The entries recently returned to
+ * the current thread are found in its cache without taking the dictionary's
+ * lock.
+ */
+struct dict_entry *dict_insert(struct dict *d, char *s)
+{
+	struct dict_entry *de, *old;
+	size_t len = strlen(s);
+	unsigned int slot;
+
+	slot = hash_djb2(s, len) & (DICT_CACHE_SIZE - 1);
+	de = dict_cache[slot].de;
+	if (de && dict_cache[slot].d == d && de->len == len && memcmp(de->value.key, s, len) == 0) {
+		HA_ATOMIC_INC(&de->refcount);
+		return de;
+	}
+
+	de = __dict_insert(d, s);
+	if (!de)
+		return NULL;
+
+	/* replace the cached entry by this one, with its own reference */
+	HA_ATOMIC_INC(&de->refcount);
+	old = dict_cache[slot].de;
+	if (old)
+		dict_entry_unref(dict_cache[slot].d, old);
+	dict_cache[slot].d = d;
+	dict_cache[slot].de = de;
+
+	return de;
+}
+
 
 /*
  * Unreference a dict entry previously acquired with <dict_insert>.
@@ -113,15 +163,43 @@ struct dict_entry *dict_insert(struct dict *d, char *s)
  */
 void dict_entry_unref(struct dict *d, struct dict_entry *de)
 {
+	unsigned int refcount;
+
 	if (!de)
 		return;
 
-	if (HA_ATOMIC_SUB_FETCH(&de->refcount, 1) != 0)
-		return;
+	/* only the last reference may be released under the lock, so that no
+	 * lookup may find the entry and reference it again meanwhile.
+	 */
+	refcount = HA_ATOMIC_LOAD(&de->refcount);
+	while (refcount > 1) {
+		if (HA_ATOMIC_CAS(&de->refcount, &refcount, refcount - 1))
+			return;
+		__ha_cpu_relax();
+	}
 
 	HA_RWLOCK_WRLOCK(DICT_LOCK, &d->rwlock);
+	if (HA_ATOMIC_SUB_FETCH(&de->refcount, 1) != 0) {
+		HA_RWLOCK_WRUNLOCK(DICT_LOCK, &d->rwlock);
+		return;
+	}
 	ebpt_delete(&de->value);
 	HA_RWLOCK_WRUNLOCK(DICT_LOCK, &d->rwlock);
 
 	free_dict_entry(de);
 }
+
+/* releases the entries held by the current thread's cache */
+static void dict_cache_free(void)
+{
+	int i;
+
+	for (i = 0; i < DICT_CACHE_SIZE; i++) {
+		if (dict_cache[i].de)
+			dict_entry_unref(dict_cache[i].d, dict_cache[i].de);
+		dict_cache[i].d = NULL;
+		dict_cache[i].de = NULL;
+	}
+}
+
+REGISTER_PER_THREAD_FREE(dict_cache_free);
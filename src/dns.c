@@ -310,7 +310,7 @@ static void dns_resolve_send(struct dgram_conn *dgram)
 	BUG_ON(ofs >= buf->size);
 	HA_ATOMIC_DEC(b_peek(buf, ofs));
 
-	while (ofs + 1 < b_data(buf)) {
+	while (ofs + 1 < ring_data(ring)) {
 		int ret;
 
 		cnt = 1;
@@ -318,7 +318,7 @@ static void dns_resolve_send(struct dgram_conn *dgram)
 		if (!len)
 			break;
 		cnt += len;
-		BUG_ON(msg_len + ofs + cnt + 1 > b_data(buf));
+		BUG_ON(msg_len + ofs + cnt + 1 > ring_data(ring));
 		if (unlikely(msg_len > DNS_TCP_MSG_MAX_SIZE)) {
 			/* too large a message to ever fit, let's skip it */
 			ofs += cnt + msg_len;
@@ -482,7 +482,7 @@ static void dns_session_io_handler(struct appctx *appctx)
 		HA_ATOMIC_DEC(b_peek(buf, ofs));
 
 		ret = 1;
-		while (ofs + 1 < b_data(buf)) {
+		while (ofs + 1 < ring_data(ring)) {
 			struct dns_query *query;
 			uint16_t original_qid;
 			uint16_t new_qid;
@@ -492,7 +492,7 @@ static void dns_session_io_handler(struct appctx *appctx)
 			if (!len)
 				break;
 			cnt += len;
-			BUG_ON(msg_len + ofs + cnt + 1 > b_data(buf));
+			BUG_ON(msg_len + ofs + cnt + 1 > ring_data(ring));
 
 			/* retrieve available room on output channel */
 			available_room = channel_recv_max(si_ic(si));
@@ -1096,7 +1096,7 @@ static struct task *dns_process_req(struct task *t, void *context, unsigned int
 	BUG_ON(ofs >= buf->size);
 	HA_ATOMIC_DEC(b_peek(buf, ofs));
 
-	while (ofs + 1 < b_data(buf)) {
+	while (ofs + 1 < ring_data(ring)) {
 		struct ist myist;
 
 		cnt = 1;
@@ -1104,7 +1104,7 @@ static struct task *dns_process_req(struct task *t, void *context, unsigned int
 		if (!len)
 			break;
 		cnt += len;
-		BUG_ON(msg_len + ofs + cnt + 1 > b_data(buf));
+		BUG_ON(msg_len + ofs + cnt + 1 > ring_data(ring));
 		if (unlikely(msg_len > DNS_TCP_MSG_MAX_SIZE)) {
 			/* too large a message to ever fit, let's skip it */
 			ofs += cnt + msg_len;
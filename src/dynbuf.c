@@ -16,11 +16,48 @@
 
 #include <haproxy/api.h>
 #include <haproxy/dynbuf.h>
+#include <haproxy/freq_ctr.h>
 #include <haproxy/global.h>
 #include <haproxy/list.h>
 #include <haproxy/pool.h>
+#include <haproxy/task.h>
+#include <haproxy/time.h>
 
 struct pool_head *pool_head_buffer __read_mostly;
+struct pool_head *pool_head_small_buffer __read_mostly;
+struct pool_head *pool_head_large_buffer __read_mostly;
+
+/* number of idle frontend connections still holding some buffers */
+unsigned int idle_conn_bufs = 0;
+
+/* task adjusting the buffers reserve to the demand, see dynbuf_adjust_reserve() */
+static struct task *dynbuf_reserve_task;
+
+/* Adjusts the number of buffers the pool keeps available for the waiters,
+ * which is at least the static reserve set by "tune.buffers.reserve". Each
+ * thread adds as many buffers as it had to queue requesters over the last
+ * second, so that a thread experiencing a shortage keeps the buffers it
+ * releases instead of giving them back to the system. The task reschedules
+ * itself every second as long as some demand remains, in order to let the
+ * reserve shrink back to its static size once the shortage is over.
+ */
+static struct task *dynbuf_adjust_reserve(struct task *t, void *context, unsigned int state)
+{
+	unsigned int reserve = MAX(global.tune.reserved_bufs, 3);
+	unsigned int demand = 0;
+	int thr;
+
+	for (thr = 0; thr < global.nbthread; thr++)
+		demand += read_freq_ctr(&activity[thr].buf_queued);
+
+	reserve += demand;
+	if (global.tune.buf_limit && reserve >= global.tune.buf_limit)
+		reserve = global.tune.buf_limit - 1;
+
+	HA_ATOMIC_STORE(&pool_head_buffer->minavail, reserve);
+	t->expire = demand ? tick_add(now_ms, MS_TO_TICKS(1000)) : TICK_ETERNITY;
+	return t;
+}
 
 /* perform minimal intializations, report 0 in case of error, 1 if OK. */
 int init_buffer()
@@ -33,8 +70,36 @@ int init_buffer()
 	if (!pool_head_buffer)
 		return 0;
 
-	for (thr = 0; thr < MAX_THREADS; thr++)
-		LIST_INIT(&ha_thread_info[thr].buffer_wq);
+	/* small buffers are only worth it when they're really smaller. They're
+	 * not shared so that "show pools" reports their usage on its own line.
+	 */
+	if (global.tune.bufsize_small > 0 && global.tune.bufsize_small < global.tune.bufsize) {
+		pool_head_small_buffer = create_pool("small_buf", global.tune.bufsize_small, MEM_F_EXACT);
+		if (!pool_head_small_buffer)
+			return 0;
+	}
+
+	/* large buffers are optional and their number is capped since they're
+	 * only a speedup for the channels which can take them.
+	 */
+	if (global.tune.bufsize_large > global.tune.bufsize) {
+		pool_head_large_buffer = create_pool("large_buf", global.tune.bufsize_large, MEM_F_EXACT);
+		if (!pool_head_large_buffer)
+			return 0;
+		pool_head_large_buffer->limit = global.tune.large_buf_limit;
+	}
+
+	for (thr = 0; thr < MAX_THREADS; thr++) {
+		int crit;
+
+		for (crit = 0; crit < DB_CRIT_COUNT; crit++)
+			LIST_INIT(&ha_thread_info[thr].buffer_wq[crit]);
+	}
+
+	dynbuf_reserve_task = task_new(MAX_THREADS_MASK);
+	if (!dynbuf_reserve_task)
+		return 0;
+	dynbuf_reserve_task->process = dynbuf_adjust_reserve;
 
 
 	/* The reserved buffer is what we leave behind us. Thus we always need
@@ -98,26 +163,47 @@ void buffer_dump(FILE *o, struct buffer *b, int from, int to)
 	fflush(o);
 }
 
+/* Appends <wait> to the current thread's buffer wait queue matching the
+ * criticality <crit> of the allocation, and accounts for it in the buffers
+ * demand used to size the reserve. The object must not already be queued.
+ */
+void b_queue(enum dynbuf_crit crit, struct buffer_wait *wait)
+{
+	wait->since = now_mono_time();
+	LIST_APPEND(&ti->buffer_wq[crit], &wait->list);
+	update_freq_ctr(&activity[tid].buf_queued, 1);
+
+	/* let the reserve follow the demand if it doesn't already */
+	if (!tick_isset(dynbuf_reserve_task->expire))
+		task_wakeup(dynbuf_reserve_task, TASK_WOKEN_OTHER);
+}
+
 /* see offer_buffers() for details */
 void __offer_buffers(void *from, unsigned int count)
 {
 	struct buffer_wait *wait, *wait_back;
+	uint64_t now_ns = now_mono_time();
+	int crit;
 
 	/* For now, we consider that all objects need 1 buffer, so we can stop
 	 * waking up them once we have enough of them to eat all the available
 	 * buffers. Note that we don't really know if they are streams or just
 	 * other tasks, but that's a rough estimate. Similarly, for each cached
-	 * event we'll need 1 buffer.
+	 * event we'll need 1 buffer. The most critical queues are visited
+	 * first.
 	 */
-	list_for_each_entry_safe(wait, wait_back, &ti->buffer_wq, list) {
-		if (!count)
-			break;
+	for (crit = 0; count && crit < DB_CRIT_COUNT; crit++) {
+		list_for_each_entry_safe(wait, wait_back, &ti->buffer_wq[crit], list) {
+			if (!count)
+				break;
 
-		if (wait->target == from || !wait->wakeup_cb(wait->target))
-			continue;
+			if (wait->target == from || !wait->wakeup_cb(wait->target))
+				continue;
 
-		LIST_DEL_INIT(&wait->list);
-		count--;
+			LIST_DEL_INIT(&wait->list);
+			activity[tid].buf_wait_us += (now_ns - wait->since) / 1000;
+			count--;
+		}
 	}
 }
 
@@ -155,7 +155,7 @@ static void _do_poll(struct poller *p, int exp, int wake)
 	for (updt_idx = 0; updt_idx < fd_nbupdt; updt_idx++) {
 		fd = fd_updt[updt_idx];
 
-		_HA_ATOMIC_AND(&fdtab[fd].update_mask, ~tid_bit);
+		_HA_ATOMIC_AND(&fdupd[fd].update_mask, ~tid_bit);
 		if (!fdtab[fd].owner) {
 			activity[tid].poll_drop_fd++;
 			continue;
@@ -165,7 +165,7 @@ static void _do_poll(struct poller *p, int exp, int wake)
 	}
 	fd_nbupdt = 0;
 	/* Scan the global update list */
-	for (old_fd = fd = update_list.first; fd != -1; fd = fdtab[fd].update.next) {
+	for (old_fd = fd = update_list.first; fd != -1; fd = fdupd[fd].update.next) {
 		if (fd == -2) {
 			fd = old_fd;
 			continue;
@@ -174,7 +174,7 @@ static void _do_poll(struct poller *p, int exp, int wake)
 			fd = -fd -4;
 		if (fd == -1)
 			break;
-		if (fdtab[fd].update_mask & tid_bit)
+		if (fdupd[fd].update_mask & tid_bit)
 			done_update_polling(fd);
 		else
 			continue;
@@ -208,6 +208,7 @@ static void _do_poll(struct poller *p, int exp, int wake)
 	} while (1);
 
 	tv_leaving_poll(wait_time, status);
+	activity_count_poll(status);
 
 	thread_harmless_end();
 	if (sleeping_thread_mask & tid_bit)
@@ -222,6 +223,9 @@ static void _do_poll(struct poller *p, int exp, int wake)
 		e = epoll_events[count].events;
 		fd = epoll_events[count].data.fd;
 
+		if (count + 1 < status)
+			fd_prefetch(epoll_events[count + 1].data.fd);
+
 #ifdef DEBUG_FD
 		_HA_ATOMIC_INC(&fdtab[fd].event_count);
 #endif
@@ -123,7 +123,7 @@ static void _do_poll(struct poller *p, int exp, int wake)
 	for (i = 0; i < fd_nbupdt; i++) {
 		fd = fd_updt[i];
 
-		_HA_ATOMIC_AND(&fdtab[fd].update_mask, ~tid_bit);
+		_HA_ATOMIC_AND(&fdupd[fd].update_mask, ~tid_bit);
 		if (fdtab[fd].owner == NULL) {
 			activity[tid].poll_drop_fd++;
 			continue;
@@ -133,7 +133,7 @@ static void _do_poll(struct poller *p, int exp, int wake)
 	}
 	fd_nbupdt = 0;
 	/* Scan the global update list */
-	for (old_fd = fd = update_list.first; fd != -1; fd = fdtab[fd].update.next) {
+	for (old_fd = fd = update_list.first; fd != -1; fd = fdupd[fd].update.next) {
 		if (fd == -2) {
 			fd = old_fd;
 			continue;
@@ -142,7 +142,7 @@ static void _do_poll(struct poller *p, int exp, int wake)
 			fd = -fd -4;
 		if (fd == -1)
 			break;
-		if (fdtab[fd].update_mask & tid_bit)
+		if (fdupd[fd].update_mask & tid_bit)
 			done_update_polling(fd);
 		else
 			continue;
@@ -204,6 +204,7 @@ static void _do_poll(struct poller *p, int exp, int wake)
 	} while(1);
 
 	tv_leaving_poll(wait_time, nevlist);
+	activity_count_poll(nevlist);
 
 	thread_harmless_end();
 
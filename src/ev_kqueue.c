@@ -99,7 +99,7 @@ static void _do_poll(struct poller *p, int exp, int wake)
 	for (updt_idx = 0; updt_idx < fd_nbupdt; updt_idx++) {
 		fd = fd_updt[updt_idx];
 
-		_HA_ATOMIC_AND(&fdtab[fd].update_mask, ~tid_bit);
+		_HA_ATOMIC_AND(&fdupd[fd].update_mask, ~tid_bit);
 		if (!fdtab[fd].owner) {
 			activity[tid].poll_drop_fd++;
 			continue;
@@ -107,7 +107,7 @@ static void _do_poll(struct poller *p, int exp, int wake)
 		changes = _update_fd(fd, changes);
 	}
 	/* Scan the global update list */
-	for (old_fd = fd = update_list.first; fd != -1; fd = fdtab[fd].update.next) {
+	for (old_fd = fd = update_list.first; fd != -1; fd = fdupd[fd].update.next) {
 		if (fd == -2) {
 			fd = old_fd;
 			continue;
@@ -116,7 +116,7 @@ static void _do_poll(struct poller *p, int exp, int wake)
 			fd = -fd -4;
 		if (fd == -1)
 			break;
-		if (fdtab[fd].update_mask & tid_bit)
+		if (fdupd[fd].update_mask & tid_bit)
 			done_update_polling(fd);
 		else
 			continue;
@@ -174,6 +174,7 @@ static void _do_poll(struct poller *p, int exp, int wake)
 	} while (1);
 
 	tv_leaving_poll(wait_time, status);
+	activity_count_poll(status);
 
 	thread_harmless_end();
 	if (sleeping_thread_mask & tid_bit)
@@ -183,6 +184,9 @@ static void _do_poll(struct poller *p, int exp, int wake)
 		unsigned int n = 0;
 		fd = kev[count].ident;
 
+		if (count + 1 < status)
+			fd_prefetch(kev[count + 1].ident);
+
 #ifdef DEBUG_FD
 		_HA_ATOMIC_INC(&fdtab[fd].event_count);
 #endif
@@ -112,7 +112,7 @@ static void _do_poll(struct poller *p, int exp, int wake)
 	for (updt_idx = 0; updt_idx < fd_nbupdt; updt_idx++) {
 		fd = fd_updt[updt_idx];
 
-		_HA_ATOMIC_AND(&fdtab[fd].update_mask, ~tid_bit);
+		_HA_ATOMIC_AND(&fdupd[fd].update_mask, ~tid_bit);
 		if (!fdtab[fd].owner) {
 			activity[tid].poll_drop_fd++;
 			continue;
@@ -121,7 +121,7 @@ static void _do_poll(struct poller *p, int exp, int wake)
 	}
 
 	/* Now scan the global update list */
-	for (old_fd = fd = update_list.first; fd != -1; fd = fdtab[fd].update.next) {
+	for (old_fd = fd = update_list.first; fd != -1; fd = fdupd[fd].update.next) {
 		if (fd == -2) {
 			fd = old_fd;
 			continue;
@@ -130,12 +130,12 @@ static void _do_poll(struct poller *p, int exp, int wake)
 			fd = -fd -4;
 		if (fd == -1)
 			break;
-		if (fdtab[fd].update_mask & tid_bit) {
+		if (fdupd[fd].update_mask & tid_bit) {
 			/* Cheat a bit, as the state is global to all pollers
 			 * we don't need every thread to take care of the
 			 * update.
 			 */
-			_HA_ATOMIC_AND(&fdtab[fd].update_mask, ~all_threads_mask);
+			_HA_ATOMIC_AND(&fdupd[fd].update_mask, ~all_threads_mask);
 			done_update_polling(fd);
 		} else
 			continue;
@@ -208,6 +208,7 @@ static void _do_poll(struct poller *p, int exp, int wake)
 	status = poll(poll_events, nbfd, wait_time);
 	tv_update_date(wait_time, status);
 	tv_leaving_poll(wait_time, status);
+	activity_count_poll(status);
 
 	thread_harmless_end();
 
@@ -219,6 +220,9 @@ static void _do_poll(struct poller *p, int exp, int wake)
 		int e = poll_events[count].revents;
 		fd = poll_events[count].fd;
 
+		if (count + 1 < nbfd)
+			fd_prefetch(poll_events[count + 1].fd);
+
 #ifdef DEBUG_FD
 		_HA_ATOMIC_INC(&fdtab[fd].event_count);
 #endif
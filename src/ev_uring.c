@@ -0,0 +1,695 @@
+/*
+ * FD polling functions for Linux io_uring
+ *
+ * Copyright 2021 HAProxy Technologies
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ *
+ * This poller only relies on the kernel's uapi header and talks to the ring
+ * using the raw syscalls, so that no external library is needed. Polling is
+ * performed using one-shot IORING_OP_POLL_ADD requests, which are re-armed
+ * after each event as long as the FD remains active. All (re-)arming and
+ * removal requests are queued into the submission ring and flushed together
+ * with the wait for events in a single io_uring_enter() call, so that an
+ * event loop iteration costs one syscall regardless of the number of updates.
+ *
+ * In order not to pay a removal request each time a direction is stopped,
+ * directions are dropped lazily: a poll request remains armed until it fires
+ * and is only re-armed for the directions that are still active. Only the
+ * addition of a direction requires to replace an armed request. Each request
+ * carries the FD and a per-FD generation number in its user_data so that
+ * completions of requests which were replaced or removed are ignored.
+ */
+
+#define _GNU_SOURCE  // for POLLRDHUP on Linux
+
+#include <errno.h>
+#include <poll.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <linux/io_uring.h>
+
+#include <haproxy/activity.h>
+#include <haproxy/api.h>
+#include <haproxy/fd.h>
+#include <haproxy/global.h>
+#include <haproxy/signal.h>
+#include <haproxy/ticks.h>
+#include <haproxy/thread.h>
+#include <haproxy/time.h>
+#include <haproxy/tools.h>
+
+#ifndef POLLRDHUP
+/* POLLRDHUP was defined late in libc, and it appeared in kernel 2.6.17 */
+#define POLLRDHUP 0x2000
+#endif
+
+#ifndef __NR_io_uring_setup
+#define __NR_io_uring_setup 425
+#endif
+
+#ifndef __NR_io_uring_enter
+#define __NR_io_uring_enter 426
+#endif
+
+/* user_data values with this bit set are internal requests (timeouts and
+ * removals) whose completion must be ignored.
+ */
+#define URING_UD_INTERNAL   (1ULL << 63)
+#define URING_UD_TIMEOUT    (URING_UD_INTERNAL | 1)
+#define URING_UD_REMOVE     (URING_UD_INTERNAL | 2)
+
+/* one ring per thread */
+struct uring {
+	int fd;                        /* ring's fd, -1 if not allocated */
+	unsigned int sq_entries;       /* number of entries in the SQ */
+	unsigned int cq_entries;       /* number of entries in the CQ */
+	unsigned int *sq_head;         /* SQ head, updated by the kernel */
+	unsigned int *sq_tail;         /* SQ tail, updated by us */
+	unsigned int *sq_mask;
+	unsigned int *sq_array;
+	unsigned int sq_local_tail;    /* tail not yet published */
+	struct io_uring_sqe *sqes;
+	unsigned int *cq_head;         /* CQ head, updated by us */
+	unsigned int *cq_tail;         /* CQ tail, updated by the kernel */
+	unsigned int *cq_mask;
+	struct io_uring_cqe *cqes;
+	void *sq_ptr, *cq_ptr;         /* mmapped areas */
+	size_t sq_size, cq_size, sqes_size;
+	unsigned char *armed;          /* per-fd POLLIN/POLLOUT currently armed */
+	unsigned int *gen;             /* per-fd generation of the armed request */
+	int *rearm;                    /* fds to re-arm after events processing (cq_entries) */
+	struct __kernel_timespec ts;   /* timeout passed to IORING_OP_TIMEOUT */
+	__decl_thread(HA_SPINLOCK_T lock); /* protects the SQ from foreign threads */
+};
+
+/* private data */
+static struct uring urings[MAX_THREADS] __read_mostly;
+
+static inline int sys_io_uring_setup(unsigned int entries, struct io_uring_params *p)
+{
+	return syscall(__NR_io_uring_setup, entries, p);
+}
+
+static inline int sys_io_uring_enter(int fd, unsigned int to_submit, unsigned int min_complete, unsigned int flags)
+{
+	return syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+/* Releases ring <r>'s resources (the per-fd arrays are kept). */
+static void uring_release(struct uring *r)
+{
+	if (r->sqes)
+		munmap(r->sqes, r->sqes_size);
+	if (r->cq_ptr && r->cq_ptr != r->sq_ptr)
+		munmap(r->cq_ptr, r->cq_size);
+	if (r->sq_ptr)
+		munmap(r->sq_ptr, r->sq_size);
+	if (r->fd >= 0)
+		close(r->fd);
+	r->sqes = NULL;
+	r->sq_ptr = r->cq_ptr = NULL;
+	r->fd = -1;
+}
+
+/* Sets up ring <r> with room for <entries> submissions. Returns non-zero on
+ * success, or 0 on failure in which case nothing remains allocated.
+ */
+static int uring_setup(struct uring *r, unsigned int entries)
+{
+	struct io_uring_params p;
+
+	memset(&p, 0, sizeof(p));
+	p.flags = IORING_SETUP_CQSIZE;
+	p.cq_entries = entries * 4;
+
+	r->fd = sys_io_uring_setup(entries, &p);
+	if (r->fd < 0)
+		return 0;
+
+	r->sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+	r->cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		if (r->cq_size > r->sq_size)
+			r->sq_size = r->cq_size;
+		r->cq_size = r->sq_size;
+	}
+
+	r->sq_ptr = mmap(NULL, r->sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQ_RING);
+	if (r->sq_ptr == MAP_FAILED) {
+		r->sq_ptr = NULL;
+		goto fail;
+	}
+
+	if (p.features & IORING_FEAT_SINGLE_MMAP)
+		r->cq_ptr = r->sq_ptr;
+	else {
+		r->cq_ptr = mmap(NULL, r->cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_CQ_RING);
+		if (r->cq_ptr == MAP_FAILED) {
+			r->cq_ptr = NULL;
+			goto fail;
+		}
+	}
+
+	r->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+	r->sqes = mmap(NULL, r->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQES);
+	if (r->sqes == MAP_FAILED) {
+		r->sqes = NULL;
+		goto fail;
+	}
+
+	r->sq_entries    = p.sq_entries;
+	r->sq_head       = (unsigned int *)((char *)r->sq_ptr + p.sq_off.head);
+	r->sq_tail       = (unsigned int *)((char *)r->sq_ptr + p.sq_off.tail);
+	r->sq_mask       = (unsigned int *)((char *)r->sq_ptr + p.sq_off.ring_mask);
+	r->sq_array      = (unsigned int *)((char *)r->sq_ptr + p.sq_off.array);
+	r->sq_local_tail = *r->sq_tail;
+	r->cq_head       = (unsigned int *)((char *)r->cq_ptr + p.cq_off.head);
+	r->cq_tail       = (unsigned int *)((char *)r->cq_ptr + p.cq_off.tail);
+	r->cq_mask       = (unsigned int *)((char *)r->cq_ptr + p.cq_off.ring_mask);
+	r->cqes          = (struct io_uring_cqe *)((char *)r->cq_ptr + p.cq_off.cqes);
+	r->cq_entries    = p.cq_entries;
+	return 1;
+
+ fail:
+	uring_release(r);
+	return 0;
+}
+
+/* Publishes the pending SQEs of ring <r> and returns the number of entries the
+ * kernel still has to consume. Must be called with the ring's lock held.
+ */
+static inline unsigned int uring_publish(struct uring *r)
+{
+	__atomic_store_n(r->sq_tail, r->sq_local_tail, __ATOMIC_RELEASE);
+	return r->sq_local_tail - __atomic_load_n(r->sq_head, __ATOMIC_ACQUIRE);
+}
+
+/* Returns a cleared SQE from ring <r>, flushing the ring to the kernel if it
+ * is full. Returns NULL if no entry could be obtained. Must be called with the
+ * ring's lock held.
+ */
+static struct io_uring_sqe *uring_get_sqe(struct uring *r)
+{
+	struct io_uring_sqe *sqe;
+	unsigned int idx;
+
+	if (r->sq_local_tail - __atomic_load_n(r->sq_head, __ATOMIC_ACQUIRE) >= r->sq_entries) {
+		if (sys_io_uring_enter(r->fd, uring_publish(r), 0, 0) < 0 ||
+		    r->sq_local_tail - __atomic_load_n(r->sq_head, __ATOMIC_ACQUIRE) >= r->sq_entries)
+			return NULL;
+	}
+
+	idx = r->sq_local_tail & *r->sq_mask;
+	sqe = &r->sqes[idx];
+	memset(sqe, 0, sizeof(*sqe));
+	r->sq_array[idx] = idx;
+	r->sq_local_tail++;
+	return sqe;
+}
+
+/* Queues the removal of the request armed for <fd> on ring <r> and invalidates
+ * its generation so that its completion will be ignored. Must be called with
+ * the ring's lock held.
+ */
+static void uring_disarm(struct uring *r, int fd)
+{
+	struct io_uring_sqe *sqe;
+
+	if (!r->armed[fd])
+		return;
+
+	sqe = uring_get_sqe(r);
+	if (sqe) {
+		sqe->opcode = IORING_OP_POLL_REMOVE;
+		sqe->fd = -1;
+		sqe->addr = (unsigned int)fd | ((__u64)r->gen[fd] << 32);
+		sqe->user_data = URING_UD_REMOVE;
+	}
+	r->gen[fd]++;
+	r->armed[fd] = 0;
+}
+
+/* Queues a poll request for events <events> on <fd> into ring <r>. Must be
+ * called with the ring's lock held.
+ */
+static void uring_arm(struct uring *r, int fd, unsigned int events)
+{
+	struct io_uring_sqe *sqe;
+
+	sqe = uring_get_sqe(r);
+	if (!sqe)
+		return;
+
+	sqe->opcode = IORING_OP_POLL_ADD;
+	sqe->fd = fd;
+#ifdef IORING_FEAT_POLL_32BITS
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	events = (events << 16) | (events >> 16);
+#endif
+	sqe->poll32_events = events;
+#else
+	sqe->poll_events = events;
+#endif
+	sqe->user_data = (unsigned int)fd | ((__u64)r->gen[fd] << 32);
+	r->armed[fd] = events & (POLLIN | POLLOUT);
+}
+
+/*
+ * Immediately remove file descriptor from all rings upon close. Since io_uring
+ * holds a reference to the file for the duration of the poll request, simply
+ * closing the FD would keep the socket alive until the request fires.
+ */
+static void __fd_clo(int fd)
+{
+	int i;
+
+	for (i = global.nbthread - 1; i >= 0; i--) {
+		struct uring *r = &urings[i];
+		unsigned int pending;
+
+		if (r->fd < 0 || !r->armed || !r->armed[fd])
+			continue;
+
+		HA_SPIN_LOCK(POLLER_LOCK, &r->lock);
+		if (!r->armed[fd]) {
+			HA_SPIN_UNLOCK(POLLER_LOCK, &r->lock);
+			continue;
+		}
+		uring_disarm(r, fd);
+		pending = (i != tid) ? uring_publish(r) : 0;
+		HA_SPIN_UNLOCK(POLLER_LOCK, &r->lock);
+
+		/* another thread's ring may be idle for a while */
+		if (pending)
+			sys_io_uring_enter(r->fd, pending, 0, 0);
+	}
+}
+
+/* Updates the poll request for <fd> on the current thread's ring according to
+ * the FD's state. Must be called with the ring's lock held.
+ */
+static void _update_fd(struct uring *r, int fd)
+{
+	unsigned int en = fdtab[fd].state;
+	unsigned int want = 0;
+
+	if (fdtab[fd].owner && (fdtab[fd].thread_mask & tid_bit)) {
+		if (en & FD_EV_ACTIVE_R)
+			want |= POLLIN;
+		if (en & FD_EV_ACTIVE_W)
+			want |= POLLOUT;
+	}
+
+	/* directions which are not wanted anymore are dropped lazily */
+	if (!(want & ~r->armed[fd]))
+		return;
+
+	want |= r->armed[fd];
+	uring_disarm(r, fd);
+	uring_arm(r, fd, want | ((want & POLLIN) ? POLLRDHUP : 0));
+
+	if (want & POLLIN)
+		_HA_ATOMIC_OR(&polled_mask[fd].poll_recv, tid_bit);
+	if (want & POLLOUT)
+		_HA_ATOMIC_OR(&polled_mask[fd].poll_send, tid_bit);
+}
+
+/*
+ * Linux io_uring() poller
+ */
+static void _do_poll(struct poller *p, int exp, int wake)
+{
+	struct uring *r = &urings[tid];
+	struct io_uring_sqe *sqe;
+	unsigned int head, tail, pending;
+	int status;
+	int fd;
+	int count, nbrearm;
+	int updt_idx;
+	int wait_time, timeout;
+	int old_fd;
+
+	HA_SPIN_LOCK(POLLER_LOCK, &r->lock);
+
+	/* first, scan the update list to find polling changes */
+	for (updt_idx = 0; updt_idx < fd_nbupdt; updt_idx++) {
+		fd = fd_updt[updt_idx];
+
+		_HA_ATOMIC_AND(&fdupd[fd].update_mask, ~tid_bit);
+		if (!fdtab[fd].owner) {
+			activity[tid].poll_drop_fd++;
+			continue;
+		}
+
+		_update_fd(r, fd);
+	}
+	fd_nbupdt = 0;
+	/* Scan the global update list */
+	for (old_fd = fd = update_list.first; fd != -1; fd = fdupd[fd].update.next) {
+		if (fd == -2) {
+			fd = old_fd;
+			continue;
+		}
+		else if (fd <= -3)
+			fd = -fd -4;
+		if (fd == -1)
+			break;
+		if (fdupd[fd].update_mask & tid_bit)
+			done_update_polling(fd);
+		else
+			continue;
+		if (!fdtab[fd].owner)
+			continue;
+		_update_fd(r, fd);
+	}
+
+	thread_harmless_now();
+
+	/* now let's wait for polled events */
+	wait_time = wake ? 0 : compute_poll_timeout(exp);
+	timeout = (global.tune.options & GTUNE_BUSY_POLLING) ? 0 : wait_time;
+
+	if (timeout) {
+		/* the timeout also completes as soon as any other event is
+		 * reported, so that it never lingers in the ring.
+		 */
+		sqe = uring_get_sqe(r);
+		if (sqe) {
+			r->ts.tv_sec  = wait_time / 1000;
+			r->ts.tv_nsec = (wait_time % 1000) * 1000000LL;
+			sqe->opcode = IORING_OP_TIMEOUT;
+			sqe->fd = -1;
+			sqe->addr = (unsigned long)&r->ts;
+			sqe->len = 1;
+			sqe->off = 1;
+			sqe->user_data = URING_UD_TIMEOUT;
+		}
+		else
+			timeout = 0;
+	}
+	pending = uring_publish(r);
+	HA_SPIN_UNLOCK(POLLER_LOCK, &r->lock);
+
+	tv_entering_poll();
+	activity_count_runtime();
+	head = *r->cq_head;
+	do {
+		sys_io_uring_enter(r->fd, pending, timeout ? 1 : 0, timeout ? IORING_ENTER_GETEVENTS : 0);
+		pending = 0;
+
+		/* count the events that were reported */
+		tail = __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE);
+		status = 0;
+		for (count = head; count != tail; count++) {
+			if (!(r->cqes[count & *r->cq_mask].user_data & URING_UD_INTERNAL))
+				status++;
+		}
+		tv_update_date(timeout, status);
+
+		if (status) {
+			activity[tid].poll_io++;
+			break;
+		}
+		if (timeout || !wait_time)
+			break;
+		if (signal_queue_len || wake)
+			break;
+		if (tick_isset(exp) && tick_is_expired(exp, now_ms))
+			break;
+	} while (1);
+
+	tv_leaving_poll(wait_time, status);
+	activity_count_poll(status);
+
+	thread_harmless_end();
+	if (sleeping_thread_mask & tid_bit)
+		_HA_ATOMIC_AND(&sleeping_thread_mask, ~tid_bit);
+
+	/* process polled events */
+	nbrearm = 0;
+	for (; head != tail; head++) {
+		struct io_uring_cqe *cqe = &r->cqes[head & *r->cq_mask];
+		__u64 ud = cqe->user_data;
+		int res = cqe->res;
+		unsigned int n, e;
+
+		if (head + 1 != tail) {
+			__u64 next_ud = r->cqes[(head + 1) & *r->cq_mask].user_data;
+
+			if (!(next_ud & URING_UD_INTERNAL))
+				fd_prefetch((unsigned int)next_ud);
+		}
+
+		if (ud & URING_UD_INTERNAL)
+			continue;
+
+		fd = (unsigned int)ud;
+		if ((unsigned int)(ud >> 32) != r->gen[fd]) {
+			/* completion of a replaced or removed request */
+			continue;
+		}
+
+		/* the request is consumed now */
+		r->armed[fd] = 0;
+		r->gen[fd]++;
+		_HA_ATOMIC_AND(&polled_mask[fd].poll_recv, ~tid_bit);
+		_HA_ATOMIC_AND(&polled_mask[fd].poll_send, ~tid_bit);
+
+#ifdef DEBUG_FD
+		_HA_ATOMIC_INC(&fdtab[fd].event_count);
+#endif
+		if (!fdtab[fd].owner) {
+			activity[tid].poll_dead_fd++;
+			continue;
+		}
+
+		if (!(fdtab[fd].thread_mask & tid_bit)) {
+			/* FD has been migrated */
+			activity[tid].poll_skip_fd++;
+			continue;
+		}
+
+		r->rearm[nbrearm++] = fd;
+		if (res == -ECANCELED || res == -EAGAIN || res == -EINTR)
+			continue;
+
+		if (res < 0) {
+			/* the FD cannot be polled, report it as failed */
+			n = FD_EV_ERR_RW;
+		}
+		else {
+			e = res;
+			n = ((e & POLLIN)    ? FD_EV_READY_R : 0) |
+			    ((e & POLLOUT)   ? FD_EV_READY_W : 0) |
+			    ((e & POLLRDHUP) ? FD_EV_SHUT_R  : 0) |
+			    ((e & POLLHUP)   ? FD_EV_SHUT_RW : 0) |
+			    ((e & POLLERR)   ? FD_EV_ERR_RW  : 0);
+		}
+
+		if ((n & FD_EV_SHUT_R) && !(cur_poller.flags & HAP_POLL_F_RDHUP))
+			_HA_ATOMIC_OR(&cur_poller.flags, HAP_POLL_F_RDHUP);
+
+		fd_update_events(fd, n);
+	}
+	__atomic_store_n(r->cq_head, tail, __ATOMIC_RELEASE);
+
+	/* re-arm the FDs that are still active after their I/O callbacks. The
+	 * requests will be submitted with the next wait.
+	 */
+	if (nbrearm) {
+		HA_SPIN_LOCK(POLLER_LOCK, &r->lock);
+		for (count = 0; count < nbrearm; count++) {
+			fd = r->rearm[count];
+			if (fdtab[fd].owner)
+				_update_fd(r, fd);
+		}
+		HA_SPIN_UNLOCK(POLLER_LOCK, &r->lock);
+	}
+	/* the caller will take care of cached events */
+}
+
+/* Releases ring <r> and its per-fd arrays */
+static void uring_free(struct uring *r)
+{
+	uring_release(r);
+	ha_free(&r->armed);
+	ha_free(&r->gen);
+	ha_free(&r->rearm);
+}
+
+/* Allocates the ring and per-fd arrays of ring <r>. Returns non-zero on
+ * success, otherwise 0 with nothing left allocated.
+ */
+static int uring_alloc(struct uring *r)
+{
+	unsigned int entries = 256;
+
+	while (entries < global.tune.maxpollevents && entries < 32768)
+		entries <<= 1;
+
+	if (!uring_setup(r, entries))
+		return 0;
+
+	r->armed = calloc(global.maxsock, sizeof(*r->armed));
+	r->gen   = calloc(global.maxsock, sizeof(*r->gen));
+	r->rearm = calloc(r->cq_entries, sizeof(*r->rearm));
+	if (!r->armed || !r->gen || !r->rearm)
+		goto fail;
+
+	HA_SPIN_INIT(&r->lock);
+	return 1;
+
+ fail:
+	uring_free(r);
+	return 0;
+}
+
+static int init_uring_per_thread()
+{
+	int fd;
+
+	if (MAX_THREADS > 1 && tid) {
+		if (!uring_alloc(&urings[tid]))
+			return 0;
+	}
+
+	/* register all known FDs on this thread's ring, the poller will do
+	 * the rest.
+	 */
+	for (fd = 0; fd < global.maxsock; fd++)
+		updt_fd_polling(fd);
+
+	return 1;
+}
+
+static void deinit_uring_per_thread()
+{
+	if (MAX_THREADS > 1 && tid)
+		uring_free(&urings[tid]);
+}
+
+/*
+ * Initialization of the io_uring() poller.
+ * Returns 0 in case of failure, non-zero in case of success. If it fails, it
+ * disables the poller by setting its pref to 0.
+ */
+static int _do_init(struct poller *p)
+{
+	p->private = NULL;
+
+	if (!uring_alloc(&urings[tid]))
+		goto fail;
+
+	hap_register_per_thread_init(init_uring_per_thread);
+	hap_register_per_thread_deinit(deinit_uring_per_thread);
+
+	return 1;
+
+ fail:
+	p->pref = 0;
+	return 0;
+}
+
+/*
+ * Termination of the io_uring() poller.
+ * Memory is released and the poller is marked as unselectable.
+ */
+static void _do_term(struct poller *p)
+{
+	uring_free(&urings[tid]);
+
+	p->private = NULL;
+	p->pref = 0;
+}
+
+/*
+ * Check that the poller works. The kernel must support the non-dropping CQ
+ * ring (5.5 and above), which also guarantees that the poll and timeout
+ * operations are supported.
+ * Returns 1 if OK, otherwise 0.
+ */
+static int _do_test(struct poller *p)
+{
+	struct io_uring_params params;
+	int fd;
+
+	memset(&params, 0, sizeof(params));
+	fd = sys_io_uring_setup(4, &params);
+	if (fd < 0)
+		return 0;
+	close(fd);
+	return !!(params.features & IORING_FEAT_NODROP);
+}
+
+/*
+ * Recreate the ring after a fork(). Returns 1 if OK, otherwise 0. The rings
+ * must not be shared between processes, and all requests armed by the parent
+ * are lost. The FDs will be registered again by init_uring_per_thread(), as
+ * fork() always happens before the threads are started (and fd_updt[] is
+ * not allocated yet), so we only have to forget the previous state here.
+ */
+static int _do_fork(struct poller *p)
+{
+	struct uring *r = &urings[tid];
+	int fd;
+
+	uring_release(r);
+	if (!uring_setup(r, r->sq_entries))
+		return 0;
+
+	for (fd = 0; fd < global.maxsock; fd++) {
+		r->armed[fd] = 0;
+		polled_mask[fd].poll_recv = polled_mask[fd].poll_send = 0;
+		HA_ATOMIC_AND(&fdupd[fd].update_mask, ~tid_bit);
+	}
+	return 1;
+}
+
+/*
+ * It is a constructor, which means that it will automatically be called before
+ * main(). This is GCC-specific but it works at least since 2.95.
+ * Special care must be taken so that it does not need any uninitialized data.
+ */
+__attribute__((constructor))
+static void _do_register(void)
+{
+	struct poller *p;
+	int i;
+
+	if (nbpollers >= MAX_POLLERS)
+		return;
+
+	for (i = 0; i < MAX_THREADS; i++)
+		urings[i].fd = -1;
+
+	p = &pollers[nbpollers++];
+
+	p->name = "uring";
+	p->pref = 350;
+	p->flags = HAP_POLL_F_ERRHUP; // note: RDHUP might be dynamically added
+	p->private = NULL;
+
+	p->clo  = __fd_clo;
+	p->test = _do_test;
+	p->init = _do_init;
+	p->term = _do_term;
+	p->poll = _do_poll;
+	p->fork = _do_fork;
+}
+
+
+/*
+ * Local variables:
+ *  c-indent-level: 8
+ *  c-basic-offset: 8
+ * End:
+ */
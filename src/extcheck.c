@@ -28,9 +28,12 @@
 #include <unistd.h>
 
 #include <haproxy/api.h>
+#include <haproxy/buf.h>
 #include <haproxy/cfgparse.h>
 #include <haproxy/check.h>
+#include <haproxy/chunk.h>
 #include <haproxy/errors.h>
+#include <haproxy/fd.h>
 #include <haproxy/global.h>
 #include <haproxy/list.h>
 #include <haproxy/proxy.h>
@@ -120,6 +123,8 @@ static struct pid_list *pid_list_add(pid_t pid, struct task *t)
 	elem->pid = pid;
 	elem->t = t;
 	elem->exited = 0;
+	elem->runner = NULL;
+	elem->req_id = 0;
 	check->curpid = elem;
 	LIST_INIT(&elem->list);
 
@@ -139,9 +144,11 @@ static void pid_list_del(struct pid_list *elem)
 
 	HA_SPIN_LOCK(PID_LIST_LOCK, &pid_list_lock);
 	LIST_DELETE(&elem->list);
+	if (elem->runner)
+		elem->runner->nb_pending--;
 	HA_SPIN_UNLOCK(PID_LIST_LOCK, &pid_list_lock);
 
-	if (!elem->exited)
+	if (!elem->exited && !elem->runner)
 		kill(elem->pid, SIGTERM);
 
 	check = elem->t->context;
@@ -369,6 +376,307 @@ int prepare_external_check(struct check *check)
 	return 0;
 }
 
+/* Allocates the runners of the external checks of proxy <px>, if any are
+ * configured. They are only started when the first check is sent to them.
+ * Returns 0 on success, 1 on failure.
+ */
+int init_extcheck_runners(struct proxy *px)
+{
+	unsigned int i;
+
+	if (!px->check_nb_runners || px->check_runners)
+		return 0;
+
+	px->check_runners = calloc(px->check_nb_runners, sizeof(*px->check_runners));
+	if (!px->check_runners)
+		return 1;
+
+	for (i = 0; i < px->check_nb_runners; i++) {
+		px->check_runners[i].pid = -1;
+		px->check_runners[i].fd_req = -1;
+		px->check_runners[i].fd_rsp = -1;
+		LIST_INIT(&px->check_runners[i].pending);
+	}
+	return 0;
+}
+
+/* Stops the runner <runner> after its output was closed or failed. All its
+ * pending requests are reported as killed. Must be called with pid_list_lock
+ * held, from the runner's I/O handler.
+ */
+static void extchk_runner_stop(struct extchk_runner *runner)
+{
+	struct pid_list *elem;
+
+	fd_delete(runner->fd_rsp);
+	close(runner->fd_req);
+	kill(runner->pid, SIGTERM);
+	runner->pid = -1;
+	runner->fd_req = runner->fd_rsp = -1;
+	runner->len = 0;
+
+	list_for_each_entry(elem, &runner->pending, list) {
+		if (elem->exited)
+			continue;
+		elem->t->expire = now_ms;
+		elem->status = SIGTERM;
+		elem->exited = 1;
+		task_wakeup(elem->t, TASK_WOKEN_IO);
+	}
+}
+
+/* Processes the response <line> received from runner <runner>. It is made of
+ * the request's ID and of the exit code of the check, separated by a space.
+ * Anything after the code is ignored, as well as invalid lines and responses
+ * to requests which are not pending anymore. Must be called with pid_list_lock
+ * held.
+ */
+static void extchk_runner_result(struct extchk_runner *runner, const char *line)
+{
+	struct pid_list *elem;
+	unsigned int id;
+	char *end;
+	long code;
+
+	id = strtoul(line, &end, 10);
+	if (end == line || *end != ' ')
+		return;
+	line = end + 1;
+	code = strtol(line, &end, 10);
+	if (end == line)
+		return;
+
+	list_for_each_entry(elem, &runner->pending, list) {
+		if (elem->req_id != id || elem->exited)
+			continue;
+		elem->t->expire = now_ms;
+		elem->status = (code & 0xff) << 8; /* as reported by waitpid() on exit() */
+		elem->exited = 1;
+		task_wakeup(elem->t, TASK_WOKEN_IO);
+		break;
+	}
+}
+
+/* I/O handler of the output of a runner, processing the responses */
+static void extchk_runner_io_cb(int fd)
+{
+	struct extchk_runner *runner = fdtab[fd].owner;
+	char *line, *end, *nl;
+	ssize_t ret;
+
+	HA_SPIN_LOCK(PID_LIST_LOCK, &pid_list_lock);
+	while (1) {
+		ret = read(fd, runner->line + runner->len, sizeof(runner->line) - runner->len);
+		if (ret < 0 && errno == EINTR)
+			continue;
+		if (ret < 0 && errno == EAGAIN) {
+			fd_cant_recv(fd);
+			break;
+		}
+		if (ret <= 0) {
+			extchk_runner_stop(runner);
+			break;
+		}
+
+		line = runner->line;
+		end = line + runner->len + ret;
+		while ((nl = memchr(line, '\n', end - line)) != NULL) {
+			*nl = 0;
+			extchk_runner_result(runner, line);
+			line = nl + 1;
+		}
+
+		/* keep the partial line, or drop it if it is too long */
+		runner->len = end - line;
+		if (runner->len == sizeof(runner->line))
+			runner->len = 0;
+		else if (line != runner->line)
+			memmove(runner->line, line, runner->len);
+	}
+	HA_SPIN_UNLOCK(PID_LIST_LOCK, &pid_list_lock);
+}
+
+/* Starts the runner <runner> for the external checks of proxy <px>. The
+ * command is executed with only the PATH environment variable and without
+ * argument, its standard input and output being connected to pipes. Must be
+ * called with pid_list_lock held and SIGCHLD blocked. Returns 0 on success,
+ * otherwise -1 with errno set.
+ */
+static int extchk_runner_start(struct extchk_runner *runner, struct proxy *px)
+{
+	struct buffer *path = get_trash_chunk();
+	char *argv[2] = { px->check_command, NULL };
+	char *envp[2] = { path->area, NULL };
+	int req[2], rsp[2];
+	pid_t pid;
+
+	chunk_printf(path, "PATH=%s", px->check_path ? px->check_path : DEF_CHECK_PATH);
+
+	if (pipe(req) < 0)
+		return -1;
+	if (pipe(rsp) < 0)
+		goto fail_rsp;
+	if (req[1] >= global.maxsock || rsp[0] >= global.maxsock) {
+		errno = EMFILE;
+		goto fail;
+	}
+
+	pid = fork();
+	if (pid < 0)
+		goto fail;
+	if (pid == 0) {
+		/* Child */
+		extern char **environ;
+		struct rlimit limit;
+
+		dup2(req[0], 0);
+		dup2(rsp[1], 1);
+
+		/* close all other FDs. Keep stderr in verbose mode */
+		my_closefrom((global.mode & (MODE_QUIET|MODE_VERBOSE)) == MODE_QUIET ? 2 : 3);
+
+		/* restore the initial FD limits */
+		limit.rlim_cur = rlim_fd_cur_at_boot;
+		limit.rlim_max = rlim_fd_max_at_boot;
+		setrlimit(RLIMIT_NOFILE, &limit);
+
+		environ = envp;
+		haproxy_unblock_signals();
+		execvp(px->check_command, argv);
+		ha_alert("Failed to exec runner for external health checks: %s. Aborting.\n",
+			 strerror(errno));
+		exit(-1);
+	}
+
+	/* Parent */
+	close(req[0]);
+	close(rsp[1]);
+	fcntl(req[1], F_SETFL, O_NONBLOCK);
+	fcntl(rsp[0], F_SETFL, O_NONBLOCK);
+	fcntl(req[1], F_SETFD, FD_CLOEXEC);
+	fcntl(rsp[0], F_SETFD, FD_CLOEXEC);
+
+	runner->pid = pid;
+	runner->fd_req = req[1];
+	runner->fd_rsp = rsp[0];
+	runner->len = 0;
+	fd_insert(runner->fd_rsp, runner, extchk_runner_io_cb, tid_bit);
+	fd_want_recv(runner->fd_rsp);
+	return 0;
+
+ fail:
+	close(rsp[0]);
+	close(rsp[1]);
+ fail_rsp:
+	close(req[0]);
+	close(req[1]);
+	return -1;
+}
+
+/* Appends <str> as a new field of the request being built in <out>. The tabs
+ * and line feeds it may contain are replaced with '?' so that they do not
+ * break the request.
+ */
+static void extchk_add_field(struct buffer *out, const char *str)
+{
+	if (b_room(out) < 1)
+		return;
+	out->area[out->data++] = '\t';
+	for (; *str && b_room(out) > 1; str++)
+		out->area[out->data++] = (*str == '\t' || *str == '\n') ? '?' : *str;
+}
+
+/* Sends the check of task <t> to the least loaded runner of its proxy, which
+ * is started if needed. The request is a single line made of its ID, followed
+ * by the 4 arguments and by the environment variables otherwise passed to the
+ * command, except PATH, all separated by tabs. Returns SF_ERR_NONE on success,
+ * otherwise SF_ERR_RESOURCE with the check status set. SIGCHLD must be blocked.
+ */
+static int extchk_runner_send(struct task *t)
+{
+	static unsigned int req_id;
+	char buf[256];
+	struct check *check = t->context;
+	struct server *s = check->server;
+	struct proxy *px = s->proxy;
+	struct extchk_runner *runner = px->check_runners;
+	struct buffer *req = get_trash_chunk();
+	struct pid_list *elem;
+	const char *err = NULL;
+	unsigned int i;
+	ssize_t ret;
+
+	/* Update the variables set in the child for forked checks */
+	*check->argv[4] = 0;
+	addr_to_str(&s->addr, check->argv[3], EXTCHK_SIZE_ADDR);
+	if (s->addr.ss_family == AF_INET || s->addr.ss_family == AF_INET6)
+		snprintf(check->argv[4], EXTCHK_SIZE_UINT, "%u", s->svc_port);
+	if (extchk_setenv(check, EXTCHK_HAPROXY_SERVER_CURCONN, ultoa_r(s->cur_sess, buf, sizeof(buf))) ||
+	    extchk_setenv(check, EXTCHK_HAPROXY_SERVER_ADDR, check->argv[3]) ||
+	    extchk_setenv(check, EXTCHK_HAPROXY_SERVER_PORT, check->argv[4])) {
+		set_server_check_status(check, HCHK_STATUS_SOCKERR, "out of memory");
+		return SF_ERR_RESOURCE;
+	}
+
+	elem = pool_alloc(pool_head_pid_list);
+	if (!elem) {
+		set_server_check_status(check, HCHK_STATUS_SOCKERR, "out of memory");
+		return SF_ERR_RESOURCE;
+	}
+
+	HA_SPIN_LOCK(PID_LIST_LOCK, &pid_list_lock);
+	for (i = 1; i < px->check_nb_runners; i++) {
+		if (px->check_runners[i].nb_pending < runner->nb_pending)
+			runner = &px->check_runners[i];
+	}
+
+	if (runner->pid < 0 && extchk_runner_start(runner, px) < 0) {
+		err = strerror(errno);
+		ha_alert("Failed to start runner for external health checks%s: %s.\n",
+			 (global.tune.options & GTUNE_INSECURE_FORK) ?
+			 "" : " (likely caused by missing 'insecure-fork-wanted')", err);
+		goto fail;
+	}
+
+	elem->req_id = ++req_id;
+	chunk_printf(req, "%u", elem->req_id);
+	for (i = 1; i < 5; i++)
+		extchk_add_field(req, check->argv[i]);
+	for (i = EXTCHK_PATH + 1; i < EXTCHK_SIZE; i++)
+		extchk_add_field(req, check->envp[i]);
+	chunk_memcat(req, "\n", 1);
+
+	/* requests are small enough to always be written at once */
+	ret = write(runner->fd_req, b_orig(req), b_data(req));
+	if (ret != b_data(req)) {
+		if (ret < 0 && errno == EAGAIN) {
+			err = "runner busy";
+			goto fail;
+		}
+		/* the runner is unusable, its output will be closed */
+		err = (ret < 0) ? strerror(errno) : "truncated request";
+		kill(runner->pid, SIGTERM);
+		goto fail;
+	}
+
+	elem->pid = runner->pid;
+	elem->t = t;
+	elem->status = 0;
+	elem->exited = 0;
+	elem->runner = runner;
+	LIST_APPEND(&runner->pending, &elem->list);
+	runner->nb_pending++;
+	check->curpid = elem;
+	HA_SPIN_UNLOCK(PID_LIST_LOCK, &pid_list_lock);
+	return SF_ERR_NONE;
+
+ fail:
+	HA_SPIN_UNLOCK(PID_LIST_LOCK, &pid_list_lock);
+	pool_free(pool_head_pid_list, elem);
+	set_server_check_status(check, HCHK_STATUS_SOCKERR, err);
+	return SF_ERR_RESOURCE;
+}
+
 /*
  * establish a server health-check that makes use of a process.
  *
@@ -392,6 +700,11 @@ static int connect_proc_chk(struct task *t)
 
 	block_sigchld();
 
+	if (px->check_nb_runners) {
+		status = extchk_runner_send(t);
+		goto out;
+	}
+
 	pid = fork();
 	if (pid < 0) {
 		ha_alert("Failed to fork process for external health check%s: %s. Aborting.\n",
@@ -560,8 +873,10 @@ struct task *process_chk_proc(struct task *t, void *context, unsigned int state)
 					status = HCHK_STATUS_PROCOK;
 			} else if (expired) {
 				status = HCHK_STATUS_PROCTOUT;
-				ha_warning("kill %d\n", (int)elem->pid);
-				kill(elem->pid, SIGTERM);
+				if (!elem->runner) {
+					ha_warning("kill %d\n", (int)elem->pid);
+					kill(elem->pid, SIGTERM);
+				}
 			}
 			set_server_check_status(check, status, NULL);
 		}
@@ -633,8 +948,21 @@ int proxy_parse_extcheck(char **args, int section, struct proxy *curpx,
 		free(curpx->check_path);
 		curpx->check_path = strdup(args[cur_arg+1]);
 	}
+	else if (strcmp(args[cur_arg], "runners") == 0) {
+		char *end;
+		long nb;
+
+		if (too_many_args(2, args, errmsg, NULL))
+			goto error;
+		nb = strtol(args[cur_arg+1], &end, 10);
+		if (!*(args[cur_arg+1]) || *end || nb < 0 || nb > 1024) {
+			memprintf(errmsg, "'%s' expects a number of runners between 0 and 1024.", args[cur_arg]);
+			goto error;
+		}
+		curpx->check_nb_runners = nb;
+	}
 	else {
-		memprintf(errmsg, "'%s' only supports 'command' and 'path'. but got '%s'.",
+		memprintf(errmsg, "'%s' only supports 'command', 'path' and 'runners'. but got '%s'.",
 			  args[0], args[1]);
 		goto error;
 	}
@@ -99,6 +99,7 @@
 struct fdtab *fdtab             __read_mostly = NULL;  /* array of all the file descriptors */
 struct polled_mask *polled_mask __read_mostly = NULL;  /* Array for the polled_mask of each fd */
 struct fdinfo *fdinfo           __read_mostly = NULL;  /* less-often used infos for file descriptors */
+struct fdupd *fdupd             __read_mostly = NULL;  /* pending polling updates for file descriptors */
 int totalconn;                  /* total # of terminated sessions */
 int actconn;                    /* # of active sessions */
 
@@ -115,8 +116,8 @@ int poller_wr_pipe[MAX_THREADS] __read_mostly; // Pipe to wake the threads
 
 volatile int ha_used_fds = 0; // Number of FD we're currently using
 
-#define _GET_NEXT(fd, off) ((volatile struct fdlist_entry *)(void *)((char *)(&fdtab[fd]) + off))->next
-#define _GET_PREV(fd, off) ((volatile struct fdlist_entry *)(void *)((char *)(&fdtab[fd]) + off))->prev
+#define _GET_NEXT(fd, off) ((volatile struct fdlist_entry *)(void *)((char *)(&fdupd[fd]) + off))->next
+#define _GET_PREV(fd, off) ((volatile struct fdlist_entry *)(void *)((char *)(&fdupd[fd]) + off))->prev
 /* adds fd <fd> to fd list <list> if it was not yet in it */
 void fd_add_to_fd_list(volatile struct fdlist *list, int fd, int off)
 {
@@ -420,18 +421,18 @@ int fd_takeover(int fd, void *expected_owner)
 void updt_fd_polling(const int fd)
 {
 	if (all_threads_mask == 1UL || (fdtab[fd].thread_mask & all_threads_mask) == tid_bit) {
-		if (HA_ATOMIC_BTS(&fdtab[fd].update_mask, tid))
+		if (HA_ATOMIC_BTS(&fdupd[fd].update_mask, tid))
 			return;
 
 		fd_updt[fd_nbupdt++] = fd;
 	} else {
-		unsigned long update_mask = fdtab[fd].update_mask;
+		unsigned long update_mask = fdupd[fd].update_mask;
 		do {
 			if (update_mask == fdtab[fd].thread_mask)
 				return;
-		} while (!_HA_ATOMIC_CAS(&fdtab[fd].update_mask, &update_mask, fdtab[fd].thread_mask));
+		} while (!_HA_ATOMIC_CAS(&fdupd[fd].update_mask, &update_mask, fdtab[fd].thread_mask));
 
-		fd_add_to_fd_list(&update_list, fd, offsetof(struct fdtab, update));
+		fd_add_to_fd_list(&update_list, fd, offsetof(struct fdupd, update));
 
 		if (fd_active(fd) &&
 		    !(fdtab[fd].thread_mask & tid_bit) &&
@@ -700,11 +701,16 @@ int init_pollers()
 		goto fail_info;
 	}
 
+	if ((fdupd = calloc(global.maxsock, sizeof(*fdupd))) == NULL) {
+		ha_alert("Not enough memory to allocate %d entries for fdupd!\n", global.maxsock);
+		goto fail_upd;
+	}
+
 	update_list.first = update_list.last = -1;
 
 	for (p = 0; p < global.maxsock; p++) {
 		/* Mark the fd as out of the fd cache */
-		fdtab[p].update.next = -3;
+		fdupd[p].update.next = -3;
 	}
 
 	do {
@@ -722,6 +728,8 @@ int init_pollers()
 		}
 	} while (!bp || bp->pref == 0);
 
+	free(fdupd);
+ fail_upd:
 	free(fdinfo);
  fail_info:
 	free(polled_mask);
@@ -746,6 +754,7 @@ void deinit_pollers() {
 			bp->term(bp);
 	}
 
+	ha_free(&fdupd);
 	ha_free(&fdinfo);
 	ha_free(&fdtab);
 	ha_free(&polled_mask);
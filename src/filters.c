@@ -994,6 +994,16 @@ flt_xfer_data(struct stream *s, struct channel *chn, unsigned int an_bit)
 		goto end;
 	c_adv(chn, ret);
 
+	/* The last "data" filters may have unregistered themselves. The
+	 * remaining data are forwarded and the analyzer is stopped, so that
+	 * the channel may switch back to fast forwarding and splicing.
+	 */
+	if (!HAS_DATA_FILTERS(s, chn)) {
+		c_adv(chn, len - co_data(chn));
+		ret = 1;
+		goto end;
+	}
+
 	/* Stop waiting data if the input in closed and no data is pending or if
 	 * the output is closed. */
 	if (chn->flags & CF_SHUTW) {
@@ -0,0 +1,332 @@
+/*
+ * Streaming inspection of the request body.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ *
+ */
+
+#include <haproxy/acl.h>
+#include <haproxy/api.h>
+#include <haproxy/cfgparse.h>
+#include <haproxy/dynbuf.h>
+#include <haproxy/filters.h>
+#include <haproxy/global.h>
+#include <haproxy/http.h>
+#include <haproxy/http_ana.h>
+#include <haproxy/htx.h>
+#include <haproxy/pool.h>
+#include <haproxy/proxy.h>
+#include <haproxy/sample.h>
+#include <haproxy/stream.h>
+#include <haproxy/tools.h>
+
+/* The request body is inspected as it is received, then forwarded. The data
+ * are copied into a window which is evaluated by the condition each time it is
+ * full and at the end of each received chunk. The last <overlap> bytes of a
+ * window are kept at the beginning of the next one so that a pattern spread
+ * over two chunks is still found. Thus nothing is buffered beyond what the
+ * channel already holds.
+ */
+
+#define BODY_INSPECT_DEF_OVERLAP 256
+
+const char *body_inspect_flt_id = "body inspection filter";
+
+struct flt_ops body_inspect_ops;
+
+struct body_inspect_conf {
+	struct proxy     *proxy;      /* proxy the filter is declared in */
+	struct acl_cond  *cond;       /* condition rejecting the request */
+	unsigned int      overlap;    /* bytes of a window kept in the next one */
+	int               deny_status; /* status of the reply once rejected */
+};
+
+struct body_inspect_ctx {
+	struct buffer     window;     /* data being inspected, starting with the previous overlap */
+	unsigned int      pending;    /* bytes of the window not yet inspected */
+};
+
+DECLARE_STATIC_POOL(pool_head_body_inspect, "body_inspect", sizeof(struct body_inspect_ctx));
+
+/***************************************************************************
+ * Hooks that manage the filter lifecycle (init/check/deinit)
+ **************************************************************************/
+static int
+body_inspect_init(struct proxy *px, struct flt_conf *fconf)
+{
+	fconf->flags |= FLT_CFG_FL_HTX;
+	return 0;
+}
+
+static void
+body_inspect_deinit(struct proxy *px, struct flt_conf *fconf)
+{
+	struct body_inspect_conf *conf = fconf->conf;
+
+	if (conf) {
+		free_acl_cond(conf->cond);
+		free(conf);
+	}
+	fconf->conf = NULL;
+}
+
+/* Returns 1 on error, else 0 */
+static int
+body_inspect_check(struct proxy *px, struct flt_conf *fconf)
+{
+	struct body_inspect_conf *conf = fconf->conf;
+
+	if (px->mode != PR_MODE_HTTP) {
+		ha_alert("config: %s '%s': body-inspect filter requires HTTP mode.\n",
+			 proxy_type_str(px), px->id);
+		return 1;
+	}
+	if (conf->overlap >= global.tune.bufsize / 2) {
+		ha_alert("config: %s '%s': body-inspect overlap must be lower than half of tune.bufsize (%d).\n",
+			 proxy_type_str(px), px->id, global.tune.bufsize / 2);
+		return 1;
+	}
+	warnif_cond_conflicts(conf->cond,
+	                      (px->cap & PR_CAP_FE) ? SMP_VAL_FE_HRQ_BDY : SMP_VAL_BE_HRQ_BDY,
+	                      conf->cond->file, conf->cond->line);
+	return 0;
+}
+
+/**************************************************************************
+ * Hooks to handle start/stop of streams
+ *************************************************************************/
+static int
+body_inspect_strm_init(struct stream *s, struct filter *filter)
+{
+	struct body_inspect_ctx *ctx;
+
+	ctx = pool_alloc(pool_head_body_inspect);
+	if (!ctx)
+		return -1;
+	ctx->window = BUF_NULL;
+	ctx->pending = 0;
+	filter->ctx = ctx;
+	return 1;
+}
+
+static void
+body_inspect_release(struct body_inspect_ctx *ctx)
+{
+	if (b_size(&ctx->window)) {
+		b_free(&ctx->window);
+		offer_buffers(NULL, 1);
+	}
+}
+
+static void
+body_inspect_strm_deinit(struct stream *s, struct filter *filter)
+{
+	struct body_inspect_ctx *ctx = filter->ctx;
+
+	if (!ctx)
+		return;
+	body_inspect_release(ctx);
+	pool_free(pool_head_body_inspect, ctx);
+	filter->ctx = NULL;
+}
+
+/**************************************************************************
+ * Hooks to filter HTTP messages
+ *************************************************************************/
+static int
+body_inspect_http_headers(struct stream *s, struct filter *filter, struct http_msg *msg)
+{
+	if (!(msg->chn->flags & CF_ISRESP) && !(msg->flags & HTTP_MSGF_BODYLESS))
+		register_data_filter(s, msg->chn, filter);
+	return 1;
+}
+
+/* Evaluates the condition on the current window, then only keeps its overlap.
+ * Returns non-zero if the request must be rejected.
+ */
+static int
+body_inspect_eval(struct stream *s, struct body_inspect_conf *conf, struct body_inspect_ctx *ctx)
+{
+	int ret;
+
+	s->txn->req_body = &ctx->window;
+	ret = acl_exec_cond(conf->cond, conf->proxy, s->sess, s, SMP_OPT_DIR_REQ|SMP_OPT_FINAL);
+	s->txn->req_body = NULL;
+
+	ret = acl_pass(ret);
+	if (conf->cond->pol == ACL_COND_UNLESS)
+		ret = !ret;
+
+	if (b_data(&ctx->window) > conf->overlap) {
+		memmove(b_orig(&ctx->window), b_tail(&ctx->window) - conf->overlap, conf->overlap);
+		ctx->window.data = conf->overlap;
+	}
+	ctx->pending = 0;
+	return ret;
+}
+
+static int
+body_inspect_http_payload(struct stream *s, struct filter *filter, struct http_msg *msg,
+			  unsigned int offset, unsigned int len)
+{
+	struct body_inspect_conf *conf = FLT_CONF(filter);
+	struct body_inspect_ctx *ctx = filter->ctx;
+	struct htx *htx = htxbuf(&msg->chn->buf);
+	struct htx_ret htxret = htx_find_offset(htx, offset);
+	struct htx_blk *blk;
+	unsigned int left = len;
+	size_t n;
+
+	if (!b_size(&ctx->window) && !b_alloc(&ctx->window))
+		return -1;
+
+	offset = htxret.ret;
+	for (blk = htxret.blk; blk && left; blk = htx_get_next_blk(htx, blk)) {
+		enum htx_blk_type type = htx_get_blk_type(blk);
+		struct ist v;
+
+		if (type == HTX_BLK_UNUSED)
+			continue;
+
+		v = htx_get_blk_value(htx, blk);
+		v = istadv(v, offset);
+		offset = 0;
+		if (v.len > left)
+			v.len = left;
+		left -= v.len;
+
+		if (type != HTX_BLK_DATA)
+			continue;
+
+		while (v.len) {
+			n = b_putblk(&ctx->window, v.ptr, v.len);
+			v = istadv(v, n);
+			ctx->pending += n;
+			if (!b_room(&ctx->window) && body_inspect_eval(s, conf, ctx))
+				goto deny;
+		}
+	}
+
+	if (ctx->pending && body_inspect_eval(s, conf, ctx))
+		goto deny;
+	return len;
+
+  deny:
+	_HA_ATOMIC_INC(&strm_fe(s)->fe_counters.denied_req);
+	if (s->flags & SF_BE_ASSIGNED)
+		_HA_ATOMIC_INC(&s->be->be_counters.denied_req);
+	if (strm_sess(s)->listener && strm_sess(s)->listener->counters)
+		_HA_ATOMIC_INC(&strm_sess(s)->listener->counters->denied_req);
+	s->txn->http_reply = http_error_reply(s, conf->deny_status);
+	return -1;
+}
+
+static int
+body_inspect_http_end(struct stream *s, struct filter *filter, struct http_msg *msg)
+{
+	if (!(msg->chn->flags & CF_ISRESP))
+		body_inspect_release(filter->ctx);
+	return 1;
+}
+
+struct flt_ops body_inspect_ops = {
+	.init   = body_inspect_init,
+	.deinit = body_inspect_deinit,
+	.check  = body_inspect_check,
+
+	.attach = body_inspect_strm_init,
+	.detach = body_inspect_strm_deinit,
+
+	.http_headers = body_inspect_http_headers,
+	.http_payload = body_inspect_http_payload,
+	.http_end     = body_inspect_http_end,
+};
+
+/* Parses the "body-inspect" filter. Returns -1 on error, else 0. */
+static int
+parse_body_inspect_flt(char **args, int *cur_arg, struct proxy *px,
+                       struct flt_conf *fconf, char **err, void *private)
+{
+	struct body_inspect_conf *conf;
+	int pos = *cur_arg + 1;
+
+	conf = calloc(1, sizeof(*conf));
+	if (!conf) {
+		memprintf(err, "%s: out of memory", args[*cur_arg]);
+		return -1;
+	}
+	conf->proxy = px;
+	conf->overlap = BODY_INSPECT_DEF_OVERLAP;
+	conf->deny_status = 403;
+
+	while (*args[pos]) {
+		if (strcmp(args[pos], "overlap") == 0) {
+			const char *res;
+			unsigned int overlap;
+
+			if (!*args[pos + 1]) {
+				memprintf(err, "'%s' : '%s' expects a size", args[*cur_arg], args[pos]);
+				goto error;
+			}
+			res = parse_size_err(args[pos + 1], &overlap);
+			if (res) {
+				memprintf(err, "'%s' : unexpected character '%c' in '%s'",
+				          args[*cur_arg], *res, args[pos]);
+				goto error;
+			}
+			conf->overlap = overlap;
+			pos += 2;
+		}
+		else if (strcmp(args[pos], "deny_status") == 0) {
+			if (!*args[pos + 1]) {
+				memprintf(err, "'%s' : '%s' expects a status code", args[*cur_arg], args[pos]);
+				goto error;
+			}
+			conf->deny_status = atol(args[pos + 1]);
+			if (http_get_status_idx(conf->deny_status) == HTTP_ERR_500 && conf->deny_status != 500) {
+				memprintf(err, "'%s' : status code %d not handled", args[*cur_arg], conf->deny_status);
+				goto error;
+			}
+			pos += 2;
+		}
+		else
+			break;
+	}
+
+	if (strcmp(args[pos], "if") != 0 && strcmp(args[pos], "unless") != 0) {
+		memprintf(err, "'%s' : expects an 'if' or 'unless' condition", args[*cur_arg]);
+		goto error;
+	}
+
+	px->conf.args.ctx = ARGC_HRQ;
+	conf->cond = build_acl_cond(px->conf.args.file, px->conf.args.line, &px->acl, px,
+	                            (const char **)args + pos, err);
+	if (!conf->cond)
+		goto error;
+
+	/* the condition consumes all the remaining words */
+	while (*args[pos])
+		pos++;
+	*cur_arg = pos;
+
+	fconf->id   = body_inspect_flt_id;
+	fconf->conf = conf;
+	fconf->ops  = &body_inspect_ops;
+	return 0;
+
+ error:
+	free(conf);
+	return -1;
+}
+
+/* Declare the filter parser for "body-inspect" keyword */
+static struct flt_kw_list flt_kws = { "BODY-INSPECT", { }, {
+		{ "body-inspect", parse_body_inspect_flt, NULL },
+		{ NULL, NULL, NULL },
+	}
+};
+
+INITCALL1(STG_REGISTER, flt_register_keywords, &flt_kws);
@@ -10,11 +10,18 @@
  *
  */
 
+#ifdef USE_THREAD
+#include <pthread.h>
+#include <signal.h>
+#endif
+
 #include <haproxy/api.h>
 #include <haproxy/cfgparse.h>
 #include <haproxy/compression.h>
 #include <haproxy/dynbuf.h>
+#include <haproxy/errors.h>
 #include <haproxy/filters.h>
+#include <haproxy/global.h>
 #include <haproxy/http.h>
 #include <haproxy/http_ana-t.h>
 #include <haproxy/http_htx.h>
@@ -23,22 +30,64 @@
 #include <haproxy/proxy.h>
 #include <haproxy/sample.h>
 #include <haproxy/stream.h>
+#include <haproxy/task.h>
 #include <haproxy/tools.h>
 
 #define COMP_STATE_PROCESSING 0x01
 
+#define COMP_JOB_DONE         0x01  /* the job was processed and returned */
+
 const char *http_comp_flt_id = "compression filter";
 
 struct flt_ops comp_ops;
 
+/* A DATA block handed to the compression workers. It is compressed then
+ * flushed or finished by a worker, and given back to its owner thread through
+ * a tasklet. Apart from <ret> and <out> while it is being processed, the job
+ * is only manipulated by its owner thread.
+ */
+struct comp_job {
+	struct list       queue;      /* element in the jobs queue */
+	struct mt_list    list;       /* element in the owner thread's done list */
+	struct comp_ctx  *comp_ctx;   /* compression context, not usable by the stream while in flight */
+	struct comp_algo *comp_algo;  /* compression algorithm */
+	struct task      *task;       /* stream task to wake up, NULL once the stream is gone */
+	struct buffer     in;         /* copy of the data to compress */
+	struct buffer     out;        /* compressed data */
+	int               last;       /* non-zero if the compression must be finished */
+	int               ret;        /* number of bytes consumed, or <0 on error */
+	unsigned int      tid;        /* owner thread */
+	unsigned int      flags;      /* COMP_JOB_* */
+};
+
 struct comp_state {
 	struct comp_ctx  *comp_ctx;   /* compression context */
 	struct comp_algo *comp_algo;  /* compression algorithm if not NULL */
+	struct comp_job  *comp_job;   /* job being processed by the workers if not NULL */
 	unsigned int      flags;      /* COMP_STATE_* */
 };
 
-/* Pools used to allocate comp_state structs */
+/* Pools used to allocate comp_state and comp_job structs */
 DECLARE_STATIC_POOL(pool_head_comp_state, "comp_state", sizeof(struct comp_state));
+DECLARE_STATIC_POOL(pool_head_comp_job, "comp_job", sizeof(struct comp_job));
+
+static int comp_workers = 0;                        /* tune.comp.workers */
+static unsigned int comp_max_inflight = 1048576;    /* tune.comp.max-inflight */
+static unsigned int comp_inflight = 0;              /* bytes currently handed to the workers */
+
+#ifdef USE_THREAD
+static struct {
+	struct mt_list list;          /* jobs returned by the workers */
+	struct tasklet *tasklet;      /* tasklet processing the list above */
+} comp_done[MAX_THREADS];
+
+static struct list comp_jobs = LIST_HEAD_INIT(comp_jobs);
+static pthread_mutex_t comp_jobs_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t comp_jobs_cond = PTHREAD_COND_INITIALIZER;
+static pthread_t *comp_workers_thr = NULL;
+static int comp_workers_started = 0;
+static int comp_workers_stop = 0;
+#endif
 
 static THREAD_LOCAL struct buffer tmpbuf;
 static THREAD_LOCAL struct buffer zbuf;
@@ -58,6 +107,9 @@ static int htx_compression_buffer_add_data(struct comp_state *st, const char *da
 					    struct buffer *out);
 static int htx_compression_buffer_end(struct comp_state *st, struct buffer *out, int end);
 
+static int comp_job_submit(struct stream *s, struct comp_state *st, struct ist v, int last);
+static void comp_job_free(struct comp_job *job);
+
 /***********************************************************************/
 static int
 comp_flt_init(struct proxy *px, struct flt_conf *fconf)
@@ -96,6 +148,7 @@ comp_strm_init(struct stream *s, struct filter *filter)
 
 	st->comp_algo = NULL;
 	st->comp_ctx  = NULL;
+	st->comp_job  = NULL;
 	st->flags     = 0;
 	filter->ctx   = st;
 
@@ -115,8 +168,21 @@ comp_strm_deinit(struct stream *s, struct filter *filter)
 	if (!st)
 		return;
 
+	if (st->comp_job) {
+		if (st->comp_job->flags & COMP_JOB_DONE)
+			comp_job_free(st->comp_job);
+		else {
+			/* still in flight, the job now owns the compression
+			 * context and will be released once returned.
+			 */
+			st->comp_job->task = NULL;
+			st->comp_ctx = NULL;
+		}
+		st->comp_job = NULL;
+	}
+
 	/* release any possible compression context */
-	if (st->comp_algo)
+	if (st->comp_algo && st->comp_ctx)
 		st->comp_algo->end(&st->comp_ctx);
 	pool_free(pool_head_comp_state, st);
 	filter->ctx = NULL;
@@ -207,10 +273,32 @@ comp_http_payload(struct stream *s, struct filter *filter, struct http_msg *msg,
 					v.len = len;
 				}
 
-				ret = htx_compression_buffer_add_data(st, v.ptr, v.len, &trash);
-				if (ret < 0 || htx_compression_buffer_end(st, &trash, last) < 0)
-					goto error;
-				BUG_ON(v.len != ret);
+				if (st->comp_job) {
+					struct comp_job *job = st->comp_job;
+
+					/* this block was handed to the workers */
+					if (!(job->flags & COMP_JOB_DONE))
+						goto end;
+					ret = job->ret;
+					if (ret >= 0) {
+						BUG_ON(v.len < ret);
+						v.len = ret;
+						last = job->last;
+						b_putblk(&trash, b_head(&job->out), b_data(&job->out));
+					}
+					st->comp_job = NULL;
+					comp_job_free(job);
+					if (ret < 0)
+						goto error;
+				}
+				else if (comp_job_submit(s, st, v, last))
+					goto end;
+				else {
+					ret = htx_compression_buffer_add_data(st, v.ptr, v.len, &trash);
+					if (ret < 0 || htx_compression_buffer_end(st, &trash, last) < 0)
+						goto error;
+					BUG_ON(v.len != ret);
+				}
 
 				if (ret == sz && !b_data(&trash))
 					next = htx_remove_blk(htx, blk);
@@ -261,7 +349,8 @@ comp_http_payload(struct stream *s, struct filter *filter, struct http_msg *msg,
 	if (to_forward != consumed)
 		flt_update_offsets(filter, msg->chn, to_forward - consumed);
 
-	if (st->comp_ctx && st->comp_ctx->cur_lvl > 0) {
+	/* jobs are only handed to the workers when compressing */
+	if (st->comp_ctx && (st->comp_job || st->comp_ctx->cur_lvl > 0)) {
 		update_freq_ctr(&global.comp_bps_in, consumed);
 		_HA_ATOMIC_ADD(&strm_fe(s)->fe_counters.comp_in, consumed);
 		_HA_ATOMIC_ADD(&s->be->be_counters.comp_in, consumed);
@@ -609,6 +698,221 @@ htx_compression_buffer_end(struct comp_state *st, struct buffer *out, int end)
 }
 
 
+/***********************************************************************/
+/* Releases a job and its buffers. The compression context is not released. */
+static void
+comp_job_free(struct comp_job *job)
+{
+	b_free(&job->in);
+	b_free(&job->out);
+	pool_free(pool_head_comp_job, job);
+}
+
+#ifdef USE_THREAD
+
+/* Compresses the job's input and flushes or finishes the stream. This is the
+ * only part running in the workers, it must not rely on thread-local data.
+ */
+static void
+comp_job_process(struct comp_job *job)
+{
+	int ret;
+
+	ret = job->comp_algo->add_data(job->comp_ctx, b_head(&job->in), b_data(&job->in), &job->out);
+	if (ret >= 0) {
+		if (job->last && job->comp_algo->finish(job->comp_ctx, &job->out) < 0)
+			ret = -1;
+		else if (!job->last && job->comp_algo->flush(job->comp_ctx, &job->out) < 0)
+			ret = -1;
+	}
+	job->ret = ret;
+}
+
+/* Main loop of a compression worker */
+static void *
+comp_worker_run(void *arg)
+{
+	struct comp_job *job;
+	unsigned int thr;
+
+	pthread_mutex_lock(&comp_jobs_lock);
+	while (1) {
+		while (LIST_ISEMPTY(&comp_jobs) && !comp_workers_stop)
+			pthread_cond_wait(&comp_jobs_cond, &comp_jobs_lock);
+		if (comp_workers_stop)
+			break;
+		job = LIST_NEXT(&comp_jobs, struct comp_job *, queue);
+		LIST_DELETE(&job->queue);
+		pthread_mutex_unlock(&comp_jobs_lock);
+
+		comp_job_process(job);
+
+		/* the job may be released as soon as it is in the list */
+		thr = job->tid;
+		MT_LIST_APPEND(&comp_done[thr].list, &job->list);
+		tasklet_wakeup(comp_done[thr].tasklet);
+
+		pthread_mutex_lock(&comp_jobs_lock);
+	}
+	pthread_mutex_unlock(&comp_jobs_lock);
+	return NULL;
+}
+
+/* Tasklet processing the jobs returned by the workers to the current thread.
+ * Their stream is woken up, or they are released if it is already gone.
+ */
+static struct task *
+comp_jobs_done(struct task *t, void *context, unsigned int state)
+{
+	struct mt_list *list = context;
+	struct comp_job *job;
+
+	while ((job = MT_LIST_POP(list, struct comp_job *, list))) {
+		_HA_ATOMIC_SUB(&comp_inflight, b_data(&job->in));
+		if (!job->task) {
+			job->comp_algo->end(&job->comp_ctx);
+			comp_job_free(job);
+			continue;
+		}
+		job->flags |= COMP_JOB_DONE;
+		task_wakeup(job->task, TASK_WOKEN_MSG);
+	}
+	return t;
+}
+
+/* Tries to hand the compression of <v> to the workers, <last> indicating if
+ * the compression must be finished. It is only done for compression levels
+ * above 1, as long as the in-flight data remain below tune.comp.max-inflight.
+ * Returns 1 if the job was queued, otherwise 0 and the data must be compressed
+ * by the caller.
+ */
+static int
+comp_job_submit(struct stream *s, struct comp_state *st, struct ist v, int last)
+{
+	struct comp_job *job;
+	unsigned int inflight;
+
+	if (!comp_workers_started || !v.len || st->comp_ctx->cur_lvl < 2)
+		return 0;
+
+	inflight = _HA_ATOMIC_ADD_FETCH(&comp_inflight, v.len);
+	if (inflight > comp_max_inflight)
+		goto fail;
+
+	job = pool_alloc(pool_head_comp_job);
+	if (!job)
+		goto fail;
+
+	job->in = job->out = BUF_NULL;
+	if (!b_alloc(&job->in) || !b_alloc(&job->out)) {
+		comp_job_free(job);
+		goto fail;
+	}
+
+	LIST_INIT(&job->queue);
+	MT_LIST_INIT(&job->list);
+	job->comp_ctx  = st->comp_ctx;
+	job->comp_algo = st->comp_algo;
+	job->task      = s->task;
+	job->last      = last;
+	job->ret       = -1;
+	job->tid       = tid;
+	job->flags     = 0;
+	b_putblk(&job->in, v.ptr, v.len);
+	st->comp_job = job;
+
+	pthread_mutex_lock(&comp_jobs_lock);
+	LIST_APPEND(&comp_jobs, &job->queue);
+	pthread_cond_signal(&comp_jobs_cond);
+	pthread_mutex_unlock(&comp_jobs_lock);
+	return 1;
+
+  fail:
+	_HA_ATOMIC_SUB(&comp_inflight, v.len);
+	return 0;
+}
+
+/* Allocates the tasklet receiving the compressed jobs for the current thread,
+ * and starts the workers from the first thread.
+ */
+static int
+comp_workers_init_per_thread()
+{
+	struct tasklet *tl;
+	sigset_t blocked_sig, old_sig;
+	int i;
+
+	if (!comp_workers || master)
+		return 1;
+
+	tl = tasklet_new();
+	if (!tl)
+		return 0;
+	tl->process = comp_jobs_done;
+	tl->context = &comp_done[tid].list;
+	tl->tid     = tid;
+	MT_LIST_INIT(&comp_done[tid].list);
+	comp_done[tid].tasklet = tl;
+
+	if (tid != 0)
+		return 1;
+
+	comp_workers_thr = calloc(comp_workers, sizeof(*comp_workers_thr));
+	if (!comp_workers_thr)
+		return 0;
+
+	/* the workers must never catch signals */
+	sigfillset(&blocked_sig);
+	pthread_sigmask(SIG_SETMASK, &blocked_sig, &old_sig);
+	for (i = 0; i < comp_workers; i++) {
+		if (pthread_create(&comp_workers_thr[i], NULL, comp_worker_run, NULL) != 0) {
+			ha_alert("failed to start compression worker %d.\n", i);
+			break;
+		}
+	}
+	pthread_sigmask(SIG_SETMASK, &old_sig, NULL);
+
+	if (i < comp_workers) {
+		comp_workers = i;
+		return 0;
+	}
+	comp_workers_started = 1;
+	return 1;
+}
+
+/* Stops the workers */
+static void
+comp_workers_deinit()
+{
+	int i;
+
+	if (!comp_workers_thr)
+		return;
+
+	pthread_mutex_lock(&comp_jobs_lock);
+	comp_workers_stop = 1;
+	pthread_cond_broadcast(&comp_jobs_cond);
+	pthread_mutex_unlock(&comp_jobs_lock);
+
+	for (i = 0; i < comp_workers; i++)
+		pthread_join(comp_workers_thr[i], NULL);
+	ha_free(&comp_workers_thr);
+}
+
+REGISTER_PER_THREAD_INIT(comp_workers_init_per_thread);
+REGISTER_POST_DEINIT(comp_workers_deinit);
+
+#else /* !USE_THREAD */
+
+static int
+comp_job_submit(struct stream *s, struct comp_state *st, struct ist v, int last)
+{
+	return 0;
+}
+
+#endif /* USE_THREAD */
+
+
 /***********************************************************************/
 struct flt_ops comp_ops = {
 	.init              = comp_flt_init,
@@ -660,7 +964,7 @@ parse_compression_options(char **args, int section, struct proxy *proxy,
 				return -1;
 			}
 
-			if (proxy->comp->algos->init(&ctx, 9) == 0)
+			if (proxy->comp->algos->init(&ctx, global.tune.comp_maxlevel) == 0)
 				proxy->comp->algos->end(&ctx);
 			else {
 				memprintf(err, "'%s' : Can't init '%s' algorithm.\n",
@@ -820,8 +1124,60 @@ smp_fetch_res_comp_algo(const struct arg *args, struct sample *smp,
 	return 0;
 }
 
-/* Declare the config parser for "compression" keyword */
+/* config parser for global "tune.comp.workers" */
+static int
+comp_parse_global_workers(char **args, int section_type, struct proxy *curpx,
+			  const struct proxy *defpx, const char *file, int line,
+			  char **err)
+{
+	if (too_many_args(1, args, err, NULL))
+		return -1;
+
+#ifndef USE_THREAD
+	memprintf(err, "'%s' is not supported without threads support.", args[0]);
+	return -1;
+#endif
+	if (*(args[1]) == 0) {
+		memprintf(err, "'%s' expects a number of threads between 0 and %d.", args[0], MAX_THREADS);
+		return -1;
+	}
+
+	comp_workers = atoi(args[1]);
+	if (comp_workers < 0 || comp_workers > MAX_THREADS) {
+		memprintf(err, "'%s' expects a number of threads between 0 and %d.", args[0], MAX_THREADS);
+		return -1;
+	}
+	return 0;
+}
+
+/* config parser for global "tune.comp.max-inflight" */
+static int
+comp_parse_global_max_inflight(char **args, int section_type, struct proxy *curpx,
+			       const struct proxy *defpx, const char *file, int line,
+			       char **err)
+{
+	const char *res;
+
+	if (too_many_args(1, args, err, NULL))
+		return -1;
+
+	if (*(args[1]) == 0) {
+		memprintf(err, "'%s' expects a size.", args[0]);
+		return -1;
+	}
+
+	res = parse_size_err(args[1], &comp_max_inflight);
+	if (res) {
+		memprintf(err, "unexpected '%s' after size passed to '%s'", res, args[0]);
+		return -1;
+	}
+	return 0;
+}
+
+/* Declare the config parsers for "compression" and the global tuning keywords */
 static struct cfg_kw_list cfg_kws = {ILH, {
+		{ CFG_GLOBAL, "tune.comp.max-inflight", comp_parse_global_max_inflight },
+		{ CFG_GLOBAL, "tune.comp.workers", comp_parse_global_workers },
 		{ CFG_LISTEN, "compression", parse_compression_options },
 		{ 0, NULL, NULL },
 	}
@@ -12,6 +12,8 @@
 #include <ctype.h>
 #include <errno.h>
 
+#include <import/xxhash.h>
+
 #include <haproxy/acl.h>
 #include <haproxy/action-t.h>
 #include <haproxy/api.h>
@@ -27,6 +29,7 @@
 #include <haproxy/proxy.h>
 #include <haproxy/sample.h>
 #include <haproxy/session.h>
+#include <haproxy/shctx.h>
 #include <haproxy/signal.h>
 #include <haproxy/sink.h>
 #include <haproxy/spoe.h>
@@ -266,6 +269,47 @@ spoe_update_stat_time(struct timeval *tv, long *t)
 	tv_zero(tv);
 }
 
+/* Accounts the round-trip time of a frame sent at <tv> and acknowledged now
+ * in the sliding average of agent <agent> for the current thread.
+ */
+static inline void
+spoe_update_rtt(struct spoe_agent *agent, const struct timeval *tv)
+{
+	long long us;
+
+	if (!tv_isset(tv))
+		return;
+	us = (now.tv_sec - tv->tv_sec) * 1000000LL + (now.tv_usec - tv->tv_usec);
+	if (us < 0)
+		us = 0;
+	else if (us > 10000000)
+		us = 10000000;
+	swrate_add(&agent->rt[tid].rtt, SPOE_RTT_SAMPLES, us);
+}
+
+/* Returns non-zero if the SPOE applets of agent <agent> on the current thread
+ * are too few to absorb the current load. By Little's law, the number of
+ * frames waiting for an acknowledgement is the rate of the frames multiplied
+ * by their round-trip time, and each applet may only have one of them, or up
+ * to max-waiting-frames when the pipelined or asynchronous exchanges are
+ * enabled.
+ */
+static inline int
+spoe_need_more_applets(struct spoe_agent *agent)
+{
+	unsigned long long inflight;
+	unsigned int rtt, fpa;
+
+	rtt = swrate_avg(agent->rt[tid].rtt, SPOE_RTT_SAMPLES);
+	if (!rtt)
+		return 0;
+
+	inflight = (unsigned long long)read_freq_ctr(&agent->rt[tid].processing_per_sec) * rtt;
+	inflight = (inflight + 999999) / 1000000;
+	fpa = (agent->flags & (SPOE_FL_PIPELINING|SPOE_FL_ASYNC)) ? agent->max_fpa : 1;
+	return inflight > (unsigned long long)agent->rt[tid].nb_applets * fpa;
+}
+
 /********************************************************************
  * Functions that encode/decode SPOE frames
  ********************************************************************/
@@ -1236,6 +1280,7 @@ spoe_release_appctx(struct appctx *appctx)
 	if (!LIST_ISEMPTY(&spoe_appctx->list)) {
 		LIST_DELETE(&spoe_appctx->list);
 		LIST_INIT(&spoe_appctx->list);
+		agent->rt[tid].nb_applets--;
 	}
 	HA_SPIN_UNLOCK(SPOE_APPLET_LOCK, &agent->rt[tid].lock);
 
@@ -1615,6 +1660,7 @@ spoe_handle_receiving_frame_appctx(struct appctx *appctx, int *skip)
 			LIST_DELETE(&ctx->list);
 			LIST_INIT(&ctx->list);
 			_HA_ATOMIC_DEC(&agent->counters.nb_waiting);
+			spoe_update_rtt(agent, &ctx->stats.tv_wait);
 			spoe_update_stat_time(&ctx->stats.tv_wait, &ctx->stats.t_waiting);
 			ctx->stats.tv_response = now;
 			if (ctx->spoe_appctx) {
@@ -2010,6 +2056,7 @@ spoe_create_appctx(struct spoe_config *conf)
 
 	HA_SPIN_LOCK(SPOE_APPLET_LOCK, &conf->agent->rt[tid].lock);
 	LIST_APPEND(&conf->agent->rt[tid].applets, &SPOE_APPCTX(appctx)->list);
+	conf->agent->rt[tid].nb_applets++;
 	HA_SPIN_UNLOCK(SPOE_APPLET_LOCK, &conf->agent->rt[tid].lock);
 	_HA_ATOMIC_INC(&conf->agent->counters.applets);
 
@@ -2038,9 +2085,15 @@ spoe_queue_context(struct spoe_context *ctx)
 	struct appctx      *appctx;
 	struct spoe_appctx *spoe_appctx;
 
-	/* Check if we need to create a new SPOE applet or not. */
+	/* Check if we need to create a new SPOE applet or not. Even when some
+	 * applets are idle, a new one is created in advance if the measured
+	 * round-trip time of the frames shows that the current ones will not
+	 * be enough to handle the load.
+	 */
 	if (!eb_is_empty(&agent->rt[tid].idle_applets) &&
-	    (agent->rt[tid].processing == 1 || agent->rt[tid].processing < read_freq_ctr(&agent->rt[tid].processing_per_sec)))
+	    (agent->rt[tid].processing == 1 ||
+	     (agent->rt[tid].processing < read_freq_ctr(&agent->rt[tid].processing_per_sec) &&
+	      !spoe_need_more_applets(agent))))
 		goto end;
 
 	SPOE_PRINTF(stderr, "%d.%06d [SPOE/%-15s] %s: stream=%p"
@@ -2153,6 +2206,11 @@ spoe_encode_message(struct stream *s, struct spoe_context *ctx,
 			goto next;
 	}
 
+	/* The response may only be cached if all encoded messages allow it,
+	 * and for the shortest of their lifetimes. */
+	if (!msg->cache_ttl || msg->cache_ttl < ctx->cache_ttl)
+		ctx->cache_ttl = msg->cache_ttl;
+
 		/* Resume encoding of a SPOE argument */
 	if (ctx->frag_ctx.curarg != NULL) {
 		arg = ctx->frag_ctx.curarg;
@@ -2495,6 +2553,119 @@ spoe_process_actions(struct stream *s, struct spoe_context *ctx, int dir)
 	return 0;
 }
 
+/***************************************************************************
+ * Functions that manage the cache of the agents responses
+ **************************************************************************/
+/* Returns the tree of the responses cached in the shared context <shctx> */
+static inline struct eb_root *
+spoe_cache_tree(struct shared_context *shctx)
+{
+	return (struct eb_root *)shctx->data;
+}
+
+/* Called when the blocks of a row are reused, to remove the response they hold
+ * from the tree. */
+static void
+spoe_cache_free_blocks(struct shared_block *first, struct shared_block *block)
+{
+	struct spoe_cache_entry *entry = (struct spoe_cache_entry *)first->data;
+
+	if (first == block && first->len > 0)
+		eb64_delete(&entry->node);
+}
+
+/* Looks up the response to the NOTIFY frame encoded in the SPOE context <ctx>
+ * in the cache of the agent <agent>. It must only be called if all messages of
+ * the frame may be cached, which is reported by a non-null <ctx->cache_ttl>,
+ * and the frame is not fragmented. The hash of the frame is saved in <ctx> to
+ * store the response later. On success, the encoded actions replace the frame
+ * in <ctx->buffer>, <ctx->cache_ttl> is reset so that they are not stored
+ * again, and 1 is returned. Otherwise 0 is returned.
+ */
+static int
+spoe_cache_lookup(struct spoe_agent *agent, struct spoe_context *ctx)
+{
+	struct shared_context   *shctx = agent->cache;
+	struct spoe_cache_entry *entry;
+	struct shared_block     *first;
+	struct eb64_node        *node;
+	XXH128_hash_t            hash;
+	int                      len, ret = 0;
+
+	if (!ctx->cache_ttl)
+		return 0;
+
+	if (ctx->flags & SPOE_CTX_FL_FRAGMENTED) {
+		ctx->cache_ttl = 0;
+		return 0;
+	}
+
+	hash = XXH3_128bits(b_head(&ctx->buffer), b_data(&ctx->buffer));
+	ctx->cache_key[0] = hash.low64;
+	ctx->cache_key[1] = hash.high64;
+
+	shctx_rdlock(shctx);
+	node = eb64_lookup(spoe_cache_tree(shctx), ctx->cache_key[0]);
+	if (!node)
+		goto end;
+
+	entry = eb64_entry(node, struct spoe_cache_entry, node);
+	if (entry->key_hi != ctx->cache_key[1] || tick_is_expired(entry->expire, now_ms))
+		goto end;
+
+	first = (struct shared_block *)((unsigned char *)entry - ((struct shared_block *)NULL)->data);
+	len = first->len - sizeof(*entry);
+	if (len > b_size(&ctx->buffer))
+		goto end;
+
+	shctx_row_data_get(shctx, first, (unsigned char *)b_head(&ctx->buffer), sizeof(*entry), len);
+	b_set_data(&ctx->buffer, len);
+	ctx->cache_ttl = 0;
+	ret = 1;
+
+  end:
+	shctx_rdunlock(shctx);
+	return ret;
+}
+
+/* Stores the actions found in <ctx->buffer> in the cache of the agent <agent>,
+ * as the response to the frame whose hash was saved in <ctx> by
+ * spoe_cache_lookup(). A previous response for the same frame is replaced. The
+ * response is silently not cached if there is not enough room for it.
+ */
+static void
+spoe_cache_store(struct spoe_agent *agent, struct spoe_context *ctx)
+{
+	struct shared_context   *shctx = agent->cache;
+	struct spoe_cache_entry *entry;
+	struct shared_block     *first;
+	struct eb64_node        *node;
+
+	shctx_lock(shctx);
+	first = shctx_row_reserve_hot(shctx, NULL, sizeof(*entry) + b_data(&ctx->buffer));
+	if (!first)
+		goto end;
+
+	entry = (struct spoe_cache_entry *)first->data;
+	entry->node.key = ctx->cache_key[0];
+	entry->key_hi   = ctx->cache_key[1];
+	entry->expire   = tick_add(now_ms, ctx->cache_ttl);
+	first->len = sizeof(*entry);
+
+	node = eb64_insert(spoe_cache_tree(shctx), &entry->node);
+	if (node != &entry->node) {
+		/* the row of the previous response will be reused later */
+		eb64_delete(node);
+		eb64_insert(spoe_cache_tree(shctx), &entry->node);
+	}
+
+	shctx_row_data_append(shctx, first, NULL, (unsigned char *)b_head(&ctx->buffer), b_data(&ctx->buffer));
+	shctx_row_dec_hot(shctx, first);
+
+  end:
+	shctx_unlock(shctx);
+}
+
 /***************************************************************************
  * Functions that process SPOE events
  **************************************************************************/
@@ -2675,6 +2846,7 @@ spoe_process_messages(struct stream *s, struct spoe_context *ctx,
 		if (!ret)
 			goto out;
 
+		ctx->cache_ttl = (agent->cache ? UINT_MAX : 0);
 		ctx->state = SPOE_CTX_ST_ENCODING_MSGS;
 		/* fall through */
 	}
@@ -2689,9 +2861,17 @@ spoe_process_messages(struct stream *s, struct spoe_context *ctx,
 			goto end;
 		if (!ret)
 			goto skip;
-		if (spoe_queue_context(ctx) < 0)
-			goto end;
-		ctx->state = SPOE_CTX_ST_SENDING_MSGS;
+		if (spoe_cache_lookup(agent, ctx)) {
+			/* the actions are processed without contacting the agent */
+			spoe_update_stat_time(&ctx->stats.tv_request, &ctx->stats.t_request);
+			ctx->stats.tv_response = now;
+			ctx->state = SPOE_CTX_ST_DONE;
+		}
+		else {
+			if (spoe_queue_context(ctx) < 0)
+				goto end;
+			ctx->state = SPOE_CTX_ST_SENDING_MSGS;
+		}
 	}
 
 	if (ctx->state == SPOE_CTX_ST_SENDING_MSGS) {
@@ -2707,6 +2887,8 @@ spoe_process_messages(struct stream *s, struct spoe_context *ctx,
 	}
 
 	if (ctx->state == SPOE_CTX_ST_DONE) {
+		if (ctx->cache_ttl)
+			spoe_cache_store(agent, ctx);
 		spoe_process_actions(s, ctx, dir);
 		ret = 1;
 		ctx->frame_id++;
@@ -2840,7 +3022,7 @@ spoe_acquire_buffer(struct buffer *buf, struct buffer_wait *buffer_wait)
 	if (b_alloc(buf))
 		return 1;
 
-	LIST_APPEND(&ti->buffer_wq, &buffer_wait->list);
+	b_queue(DB_CRIT_DEFAULT, buffer_wait);
 	return 0;
 }
 
@@ -3034,6 +3216,7 @@ spoe_check(struct proxy *px, struct flt_conf *fconf)
 	struct spoe_config *conf = fconf->conf;
 	struct proxy       *target;
 	struct logsrv      *logsrv;
+	struct spoe_message *msg;
 	int i;
 
 	/* Check all SPOE filters for proxy <px> to be sure all SPOE agent names
@@ -3072,6 +3255,27 @@ spoe_check(struct proxy *px, struct flt_conf *fconf)
 		return 1;
 	}
 
+	if (conf->agent->flags & SPOE_FL_SHM_TRANSPORT) {
+		struct server *srv;
+
+		if (!xprt_get(XPRT_SHM)) {
+			ha_alert("Proxy %s : SPOE agent '%s' declared at %s:%d uses the shared-memory"
+				 " transport, which is not supported on this platform.\n",
+				 px->id, conf->agent->id, conf->agent->conf.file, conf->agent->conf.line);
+			return 1;
+		}
+		for (srv = target->srv; srv; srv = srv->next) {
+			if (srv->addr.ss_family != AF_UNIX || srv->use_ssl == 1) {
+				ha_alert("Proxy %s : server '%s' of backend '%s' used by SPOE agent '%s' declared"
+					 " at %s:%d must be a UNIX socket without SSL to use the shared-memory transport.\n",
+					 px->id, srv->id, target->id, conf->agent->id,
+					 conf->agent->conf.file, conf->agent->conf.line);
+				return 1;
+			}
+			srv->xprt = xprt_get(XPRT_SHM);
+		}
+	}
+
 	if ((conf->agent->rt = calloc(global.nbthread, sizeof(*conf->agent->rt))) == NULL) {
 		ha_alert("Proxy %s : out of memory initializing SPOE agent '%s' declared at %s:%d.\n",
 			 px->id, conf->agent->id, conf->agent->conf.file, conf->agent->conf.line);
@@ -3081,12 +3285,30 @@ spoe_check(struct proxy *px, struct flt_conf *fconf)
 		conf->agent->rt[i].engine_id    = NULL;
 		conf->agent->rt[i].frame_size   = conf->agent->max_frame_size;
 		conf->agent->rt[i].processing   = 0;
+		conf->agent->rt[i].rtt          = 0;
+		conf->agent->rt[i].nb_applets   = 0;
 		LIST_INIT(&conf->agent->rt[i].applets);
 		LIST_INIT(&conf->agent->rt[i].sending_queue);
 		LIST_INIT(&conf->agent->rt[i].waiting_queue);
 		HA_SPIN_INIT(&conf->agent->rt[i].lock);
 	}
 
+	list_for_each_entry(msg, &conf->agent->messages, list) {
+		if (!msg->cache_ttl)
+			continue;
+
+		if (shctx_init(&conf->agent->cache,
+			       (conf->agent->cache_size + SPOE_CACHE_BLOCKSIZE - 1) / SPOE_CACHE_BLOCKSIZE,
+			       SPOE_CACHE_BLOCKSIZE, -1, sizeof(struct eb_root), 1) <= 0) {
+			ha_alert("Proxy %s : unable to allocate the cache of SPOE agent '%s' declared at %s:%d.\n",
+				 px->id, conf->agent->id, conf->agent->conf.file, conf->agent->conf.line);
+			return 1;
+		}
+		conf->agent->cache->free_block = spoe_cache_free_blocks;
+		*spoe_cache_tree(conf->agent->cache) = EB_ROOT_UNIQUE;
+		break;
+	}
+
 	list_for_each_entry(logsrv, &conf->agent_fe.logsrvs, list) {
 		if (logsrv->type == LOG_TARGET_BUFFER) {
 			struct sink *sink = sink_find(logsrv->ring_name);
@@ -3394,6 +3616,8 @@ cfg_parse_spoe_agent(const char *file, int linenum, char **args, int kwm)
 		curagent->eps_max        = 0;
 		curagent->max_frame_size = MAX_FRAME_SIZE;
 		curagent->max_fpa        = 20;
+		curagent->cache_size     = SPOE_CACHE_DEF_SIZE;
+		curagent->cache          = NULL;
 
 		for (i = 0; i < SPOE_EV_EVENTS; ++i)
 			LIST_INIT(&curagent->events[i]);
@@ -3599,6 +3823,11 @@ cfg_parse_spoe_agent(const char *file, int linenum, char **args, int kwm)
 				goto out;
 			curagent->flags |= SPOE_FL_CONT_ON_ERR;
 		}
+		else if (strcmp(args[1], "shm-transport") == 0) {
+			if (alertif_too_many_args(1, file, linenum, args, &err_code))
+				goto out;
+			curagent->flags |= SPOE_FL_SHM_TRANSPORT;
+		}
 		else if (strcmp(args[1], "set-on-error") == 0) {
 			char *tmp;
 
@@ -3735,6 +3964,25 @@ cfg_parse_spoe_agent(const char *file, int linenum, char **args, int kwm)
 			goto out;
 		}
 	}
+	else if (strcmp(args[0], "cache-size") == 0) {
+		const char *res;
+
+		if (!*args[1]) {
+			ha_alert("parsing [%s:%d] : '%s' expects a size argument.\n",
+				 file, linenum, args[0]);
+			err_code |= ERR_ALERT | ERR_FATAL;
+			goto out;
+		}
+		if (alertif_too_many_args(1, file, linenum, args, &err_code))
+			goto out;
+		res = parse_size_err(args[1], &curagent->cache_size);
+		if (res || curagent->cache_size < SPOE_CACHE_BLOCKSIZE) {
+			ha_alert("parsing [%s:%d] : '%s' expects a size of at least %d bytes.\n",
+				 file, linenum, args[0], SPOE_CACHE_BLOCKSIZE);
+			err_code |= ERR_ALERT | ERR_FATAL;
+			goto out;
+		}
+	}
 	else if (strcmp(args[0], "register-var-names") == 0) {
 		int   cur_arg;
 
@@ -4054,6 +4302,39 @@ cfg_parse_spoe_message(const char *file, int linenum, char **args, int kwm)
 			goto out;
 		}
 	}
+	else if (strcmp(args[0], "cache-ttl") == 0) {
+		const char *res;
+		unsigned    ttl;
+
+		if (!*args[1]) {
+			ha_alert("parsing [%s:%d] : '%s' expects a time value (in milliseconds).\n",
+				 file, linenum, args[0]);
+			err_code |= ERR_ALERT | ERR_FATAL;
+			goto out;
+		}
+		if (alertif_too_many_args(1, file, linenum, args, &err_code))
+			goto out;
+		res = parse_time_err(args[1], &ttl, TIME_UNIT_MS);
+		if (res == PARSE_TIME_OVER) {
+			ha_alert("parsing [%s:%d]: timer overflow in argument <%s> to <%s>, maximum value is 2147483647 ms (~24.8 days).\n",
+				 file, linenum, args[1], args[0]);
+			err_code |= ERR_ALERT | ERR_FATAL;
+			goto out;
+		}
+		else if (res == PARSE_TIME_UNDER) {
+			ha_alert("parsing [%s:%d]: timer underflow in argument <%s> to <%s>, minimum non-null value is 1 ms.\n",
+				 file, linenum, args[1], args[0]);
+			err_code |= ERR_ALERT | ERR_FATAL;
+			goto out;
+		}
+		else if (res) {
+			ha_alert("parsing [%s:%d] : unexpected character '%c' in '%s'.\n",
+				 file, linenum, *res, args[0]);
+			err_code |= ERR_ALERT | ERR_FATAL;
+			goto out;
+		}
+		curmsg->cache_ttl = ttl;
+	}
 	else if (!*args[0]) {
 		ha_alert("parsing [%s:%d] : unknown keyword '%s' in spoe-message section.\n",
 			 file, linenum, args[0]);
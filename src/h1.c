@@ -20,6 +20,17 @@
 #include <haproxy/http-hdr.h>
 #include <haproxy/tools.h>
 
+/* SSE2 and NEON are always present on x86_64 and aarch64 respectively, so
+ * there is no need for runtime detection to scan 16 bytes at once there.
+ */
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define H1_HAVE_SIMD
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#define H1_HAVE_SIMD
+#endif
+
 /* Parse the Content-Length header field of an HTTP/1 request. The function
  * checks all possible occurrences of a comma-delimited value, and verifies
  * if any of them doesn't match a previous value. It returns <0 if a value
@@ -252,6 +263,132 @@ void h1_parse_upgrade_header(struct h1m *h1m, struct ist value)
 		}                                                         \
 	} while (0)
 
+#ifdef H1_HAVE_SIMD
+
+#if !defined(__SSE2__)
+/* returns the position of the first non-zero byte of <bad>, or -1 if none */
+static inline int h1_neon_first(uint8x16_t bad)
+{
+	uint64_t m;
+
+	m = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(bad), 4)), 0);
+	return m ? __builtin_ctzll(m) >> 2 : -1;
+}
+#endif
+
+/* The functions below skip as many 16-byte blocks as possible starting at
+ * <ptr> and not going beyond <end>, and return a pointer to the first byte
+ * which does not belong to the expected class, or to the first byte of the
+ * last incomplete block. The caller then continues with the regular parser
+ * from there.
+ */
+
+/* skips bytes 0x0e to 0x7f, which cannot end a header value */
+static inline char *h1_simd_skip_hdr_val(char *ptr, const char *end)
+{
+#if defined(__SSE2__)
+	const __m128i lim = _mm_set1_epi8(0x0e);
+	int mask;
+
+	/* signed comparison: bytes >= 0x80 are also reported */
+	while (ptr <= end - 16) {
+		mask = _mm_movemask_epi8(_mm_cmplt_epi8(_mm_loadu_si128((const __m128i *)ptr), lim));
+		if (mask)
+			return ptr + __builtin_ctz(mask);
+		ptr += 16;
+	}
+#else
+	const uint8x16_t lo = vdupq_n_u8(0x0e);
+	const uint8x16_t hi = vdupq_n_u8(0x80);
+	uint8x16_t v;
+	int pos;
+
+	while (ptr <= end - 16) {
+		v = vld1q_u8((const uint8_t *)ptr);
+		pos = h1_neon_first(vorrq_u8(vcltq_u8(v, lo), vcgeq_u8(v, hi)));
+		if (pos >= 0)
+			return ptr + pos;
+		ptr += 16;
+	}
+#endif
+	return ptr;
+}
+
+/* skips bytes 0x21 to 0x7e, which are valid in a URI */
+static inline char *h1_simd_skip_uri(char *ptr, const char *end)
+{
+#if defined(__SSE2__)
+	const __m128i lo = _mm_set1_epi8(0x20);
+	const __m128i hi = _mm_set1_epi8(0x7f);
+	__m128i v;
+	int mask;
+
+	while (ptr <= end - 16) {
+		v = _mm_loadu_si128((const __m128i *)ptr);
+		mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpgt_epi8(v, lo), _mm_cmplt_epi8(v, hi)));
+		if (mask != 0xffff)
+			return ptr + __builtin_ctz(~mask);
+		ptr += 16;
+	}
+#else
+	const uint8x16_t lo = vdupq_n_u8(0x21);
+	const uint8x16_t hi = vdupq_n_u8(0x7e);
+	uint8x16_t v;
+	int pos;
+
+	while (ptr <= end - 16) {
+		v = vld1q_u8((const uint8_t *)ptr);
+		pos = h1_neon_first(vmvnq_u8(vandq_u8(vcgeq_u8(v, lo), vcleq_u8(v, hi))));
+		if (pos >= 0)
+			return ptr + pos;
+		ptr += 16;
+	}
+#endif
+	return ptr;
+}
+
+/* skips lower case letters, digits and dashes, which make most header names
+ * and do not need to be turned to lower case.
+ */
+static inline char *h1_simd_skip_hdr_name(char *ptr, const char *end)
+{
+#if defined(__SSE2__)
+	const __m128i a = _mm_set1_epi8('a' - 1), z = _mm_set1_epi8('z' + 1);
+	const __m128i d0 = _mm_set1_epi8('0' - 1), d9 = _mm_set1_epi8('9' + 1);
+	const __m128i dash = _mm_set1_epi8('-');
+	__m128i v, ok;
+	int mask;
+
+	while (ptr <= end - 16) {
+		v  = _mm_loadu_si128((const __m128i *)ptr);
+		ok = _mm_and_si128(_mm_cmpgt_epi8(v, a), _mm_cmplt_epi8(v, z));
+		ok = _mm_or_si128(ok, _mm_and_si128(_mm_cmpgt_epi8(v, d0), _mm_cmplt_epi8(v, d9)));
+		ok = _mm_or_si128(ok, _mm_cmpeq_epi8(v, dash));
+		mask = _mm_movemask_epi8(ok);
+		if (mask != 0xffff)
+			return ptr + __builtin_ctz(~mask);
+		ptr += 16;
+	}
+#else
+	uint8x16_t v, ok;
+	int pos;
+
+	while (ptr <= end - 16) {
+		v  = vld1q_u8((const uint8_t *)ptr);
+		ok = vandq_u8(vcgeq_u8(v, vdupq_n_u8('a')), vcleq_u8(v, vdupq_n_u8('z')));
+		ok = vorrq_u8(ok, vandq_u8(vcgeq_u8(v, vdupq_n_u8('0')), vcleq_u8(v, vdupq_n_u8('9'))));
+		ok = vorrq_u8(ok, vceqq_u8(v, vdupq_n_u8('-')));
+		pos = h1_neon_first(vmvnq_u8(ok));
+		if (pos >= 0)
+			return ptr + pos;
+		ptr += 16;
+	}
+#endif
+	return ptr;
+}
+
+#endif /* H1_HAVE_SIMD */
+
 /* This function parses a contiguous HTTP/1 headers block starting at <start>
  * and ending before <stop>, at once, and converts it a list of (name,value)
  * pairs representing header fields into the array <hdr> of size <hdr_num>,
@@ -421,6 +558,9 @@ int h1_headers_to_hdr_list(char *start, const char *stop,
 
 	case H1_MSG_RQURI:
 	http_msg_rquri:
+#ifdef H1_HAVE_SIMD
+		ptr = h1_simd_skip_uri(ptr, end);
+#endif
 #ifdef HA_UNALIGNED_LE
 		/* speedup: skip bytes not between 0x21 and 0x7e inclusive */
 		while (ptr <= end - sizeof(int)) {
@@ -428,8 +568,9 @@ int h1_headers_to_hdr_list(char *start, const char *stop,
 			if (x & 0x80808080)
 				break;
 
+			/* all bytes must be below 0x7f */
 			x -= 0x5e5e5e5e;
-			if (!(x & 0x80808080))
+			if ((x & 0x80808080) != 0x80808080)
 				break;
 
 			ptr += sizeof(int);
@@ -695,6 +836,13 @@ int h1_headers_to_hdr_list(char *start, const char *stop,
 	case H1_MSG_HDR_NAME:
 	http_msg_hdr_name:
 		/* assumes sol points to the first char */
+#ifdef H1_HAVE_SIMD
+		ptr = h1_simd_skip_hdr_name(ptr, end);
+		if (ptr >= end) {
+			state = H1_MSG_HDR_NAME;
+			goto http_msg_ood;
+		}
+#endif
 		if (likely(HTTP_IS_TOKEN(*ptr))) {
 			if (!skip_update) {
 				/* turn it to lower case if needed */
@@ -767,6 +915,9 @@ int h1_headers_to_hdr_list(char *start, const char *stop,
 		 * also remove the sign bit test so that bytes 0x8e..0x0d break the
 		 * loop, but we don't care since they're very rare in header values.
 		 */
+#ifdef H1_HAVE_SIMD
+		ptr = h1_simd_skip_hdr_val(ptr, end);
+#endif
 #ifdef HA_UNALIGNED_LE64
 		while (ptr <= end - sizeof(long)) {
 			if ((*(long *)ptr - 0x0e0e0e0e0e0e0e0eULL) & 0x8080808080808080ULL)
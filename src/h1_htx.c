@@ -396,32 +396,18 @@ static size_t h1_copy_msg_data(struct htx **dsthtx, struct buffer *srcbuf, size_
 
 	/* very often with large files we'll face the following
 	 * situation :
-	 *   - htx is empty and points to <htxbuf>
-	 *   - count == srcbuf->data
-	 *   - srcbuf->head == sizeof(struct htx)
+	 *   - htx is empty (or holds little data) and points to <htxbuf>
+	 *   - count ends srcbuf's data
+	 *   - srcbuf->head was pre-aligned after room for an htx header
 	 *   => we can swap the buffers and place an htx header into
 	 *      the target buffer instead
 	 */
-	if (unlikely(htx_is_empty(tmp_htx) && count == b_data(srcbuf) &&
-		     !ofs && b_head_ofs(srcbuf) == sizeof(struct htx))) {
-		void *raw_area = srcbuf->area;
-		void *htx_area = htxbuf->area;
-		struct htx_blk *blk;
-
-		srcbuf->area = htx_area;
-		htxbuf->area = raw_area;
-		tmp_htx = (struct htx *)htxbuf->area;
-		tmp_htx->size = htxbuf->size - sizeof(*tmp_htx);
-		htx_reset(tmp_htx);
-		b_set_data(htxbuf, b_size(htxbuf));
-
-		blk = htx_add_blk(tmp_htx, HTX_BLK_DATA, count);
-		blk->info += count;
-
-		*dsthtx = tmp_htx;
+	if (count == b_data(srcbuf) - ofs &&
+	    htx_xfer_raw_data(htxbuf, srcbuf, ofs, count)) {
 		/* nothing else to do, the old buffer now contains an
-		 * empty pre-initialized HTX header
+		 * unused HTX message
 		 */
+		*dsthtx = htx_from_buf(htxbuf);
 		return count;
 	}
 
@@ -86,6 +86,7 @@
 #include <haproxy/arg.h>
 #include <haproxy/auth.h>
 #include <haproxy/base64.h>
+#include <haproxy/bench.h>
 #include <haproxy/capture-t.h>
 #include <haproxy/cfgdiag.h>
 #include <haproxy/cfgparse.h>
@@ -123,9 +124,11 @@
 #include <haproxy/signal.h>
 #include <haproxy/sock.h>
 #include <haproxy/sock_inet.h>
+#include <haproxy/sockmap.h>
 #include <haproxy/ssl_sock.h>
 #include <haproxy/stats-t.h>
 #include <haproxy/stream.h>
+#include <haproxy/stream_interface.h>
 #include <haproxy/task.h>
 #include <haproxy/thread.h>
 #include <haproxy/time.h>
@@ -181,6 +184,9 @@ struct global global = {
 	.tune = {
 		.options = GTUNE_LISTENER_MQ,
 		.bufsize = (BUFSIZE + 2*sizeof(void *) - 1) & -(2*sizeof(void *)),
+		.bufsize_small = BUFSIZE_SMALL,
+		.bufsize_large = BUFSIZE_LARGE,
+		.large_buf_limit = LARGE_BUFS_LIMIT,
 		.maxrewrite = MAXREWRITE,
 		.reserved_bufs = RESERVED_BUFS,
 		.pattern_cache = DEFAULT_PAT_LRU_SIZE,
@@ -309,6 +315,124 @@ void hap_register_build_opts(const char *str, int must_free)
 	LIST_APPEND(&build_opts_list, &b->list);
 }
 
+/* timings of the startup phases, reported by "show startup-timings" */
+struct startup_timing {
+	char *name;
+	uint64_t start;         /* monotonic date of the beginning of the phase, in ns */
+	uint64_t ns;            /* duration of the phase, in ns */
+	int level;              /* 0 for a phase, 1 for a detail of the previous phase */
+};
+
+#define STARTUP_TIMINGS_MAX 256
+static struct startup_timing startup_timings[STARTUP_TIMINGS_MAX];
+static int startup_timings_nb = 0;
+
+/* Appends an entry of level <level> named after <fmt> to the startup timings,
+ * with a duration of <ns> nanoseconds. Returns the entry's index or -1 if the
+ * table is full. Must only be called from the startup thread.
+ */
+static int startup_timing_vadd(int level, uint64_t ns, const char *fmt, va_list argp)
+{
+	struct startup_timing *st;
+
+	if (startup_timings_nb >= STARTUP_TIMINGS_MAX)
+		return -1;
+
+	st = &startup_timings[startup_timings_nb];
+	st->name = NULL;
+	if (!memvprintf(&st->name, fmt, argp))
+		return -1;
+	st->level = level;
+	st->ns = ns;
+	st->start = now_mono_time();
+	return startup_timings_nb++;
+}
+
+/* Appends a detail line of <ns> nanoseconds to the startup timings. */
+void startup_timing_add(uint64_t ns, const char *fmt, ...)
+{
+	va_list argp;
+
+	va_start(argp, fmt);
+	startup_timing_vadd(1, ns, fmt, argp);
+	va_end(argp);
+}
+
+/* Starts timing a new startup phase, which ends with startup_timing_stop() on
+ * the returned index. Details added in between are attached to this phase.
+ */
+int startup_timing_start(const char *fmt, ...)
+{
+	va_list argp;
+	int idx;
+
+	va_start(argp, fmt);
+	idx = startup_timing_vadd(0, 0, fmt, argp);
+	va_end(argp);
+	return idx;
+}
+
+/* Stops timing the startup phase <idx> returned by startup_timing_start(). */
+void startup_timing_stop(int idx)
+{
+	if (idx >= 0)
+		startup_timings[idx].ns = now_mono_time() - startup_timings[idx].start;
+}
+
+/* parse the "show startup-timings" command */
+static int cli_parse_show_startup_timings(char **args, char *payload, struct appctx *appctx, void *private)
+{
+	if (!cli_has_level(appctx, ACCESS_LVL_OPER))
+		return 1;
+
+	appctx->ctx.cli.i0 = 0;
+	return 0;
+}
+
+/* dumps the startup timings, one line per phase followed by its details */
+static int cli_io_handler_show_startup_timings(struct appctx *appctx)
+{
+	struct stream_interface *si = appctx->owner;
+
+	if (unlikely(si_ic(si)->flags & (CF_WRITE_ERROR|CF_SHUTW)))
+		return 1;
+
+	chunk_reset(&trash);
+	if (!appctx->ctx.cli.i0)
+		chunk_appendf(&trash, "# phase: time_ms\n");
+
+	while (appctx->ctx.cli.i0 < startup_timings_nb) {
+		const struct startup_timing *st = &startup_timings[appctx->ctx.cli.i0];
+
+		chunk_appendf(&trash, "%s%s: %llu.%03llu\n", st->level ? "  " : "", st->name,
+		              (ullong)(st->ns / 1000000), (ullong)(st->ns / 1000 % 1000));
+
+		if (ci_putchk(si_ic(si), &trash) == -1) {
+			si_rx_room_blk(si);
+			return 0;
+		}
+		chunk_reset(&trash);
+		appctx->ctx.cli.i0++;
+	}
+	return 1;
+}
+
+static void startup_timings_free()
+{
+	while (startup_timings_nb)
+		ha_free(&startup_timings[--startup_timings_nb].name);
+}
+
+REGISTER_POST_DEINIT(startup_timings_free);
+
+/* register cli keywords */
+static struct cli_kw_list cli_kws = {{ },{
+	{ { "show", "startup-timings",  NULL }, "show startup-timings                    : report the time spent in each startup phase", cli_parse_show_startup_timings, cli_io_handler_show_startup_timings, NULL },
+	{{},}
+}};
+
+INITCALL1(STG_REGISTER, cli_register_kw, &cli_kws);
+
 #define VERSION_MAX_ELTS  7
 
 /* This function splits an haproxy version string into an array of integers.
@@ -558,6 +682,9 @@ static void usage(char *name)
 		"        -v displays version ; -vv shows known build options.\n"
 		"        -d enters debug mode ; -db only disables background mode.\n"
 		"        -dM[<byte>] poisons memory with <byte> (defaults to 0x50)\n"
+#if defined(USE_BENCH)
+		"        -dB[<list>] runs the micro-benchmarks from <list> (default: all) and exits\n"
+#endif
 		"        -V enters verbose mode (disables quiet mode)\n"
 		"        -D goes daemon ; -C changes to <dir> before loading files.\n"
 		"        -W master-worker mode.\n"
@@ -575,6 +702,9 @@ static void usage(char *name)
 #if defined(USE_EPOLL)
 		"        -de disables epoll() usage even when available\n"
 #endif
+#if defined(USE_URING)
+		"        -du disables io_uring() usage even when available\n"
+#endif
 #if defined(USE_KQUEUE)
 		"        -dk disables kqueue() usage even when available\n"
 #endif
@@ -1459,6 +1589,10 @@ static void init(int argc, char **argv)
 	struct post_check_fct *pcf;
 	int ideal_maxconn;
 	char *check_condition = NULL;
+	struct cfg_section *cs;
+	unsigned int jobs_nb;
+	int thr_nb;
+	int timing;
 
 	global.mode = MODE_STARTING;
 	old_argv = copy_argv(argc, argv);
@@ -1523,6 +1657,9 @@ static void init(int argc, char **argv)
 #if defined(USE_EPOLL)
 	global.tune.options |= GTUNE_USE_EPOLL;
 #endif
+#if defined(USE_URING)
+	global.tune.options |= GTUNE_USE_URING;
+#endif
 #if defined(USE_KQUEUE)
 	global.tune.options |= GTUNE_USE_KQUEUE;
 #endif
@@ -1574,6 +1711,10 @@ static void init(int argc, char **argv)
 			else if (*flag == 'd' && flag[1] == 'e')
 				global.tune.options &= ~GTUNE_USE_EPOLL;
 #endif
+#if defined(USE_URING)
+			else if (*flag == 'd' && flag[1] == 'u')
+				global.tune.options &= ~GTUNE_USE_URING;
+#endif
 #if defined(USE_POLL)
 			else if (*flag == 'd' && flag[1] == 'p')
 				global.tune.options &= ~GTUNE_USE_POLL;
@@ -1612,6 +1753,10 @@ static void init(int argc, char **argv)
 				mem_poison_byte = flag[2] ? strtol(flag + 2, NULL, 0) : 'P';
 			else if (*flag == 'd' && flag[1] == 'r')
 				global.tune.options |= GTUNE_RESOLVE_DONTFAIL;
+#if defined(USE_BENCH)
+			else if (*flag == 'd' && flag[1] == 'B')
+				exit(bench_run(flag + 2));
+#endif
 			else if (*flag == 'd')
 				arg_mode |= MODE_DEBUG;
 			else if (*flag == 'c' && flag[1] == 'c') {
@@ -1850,7 +1995,9 @@ static void init(int argc, char **argv)
 			usage(progname);
 
 
+		timing = startup_timing_start("config parsing");
 		list_for_each_entry(wl, &cfg_cfgfiles, list) {
+			uint64_t start = now_mono_time();
 			int ret;
 
 			if (env_err == 0) {
@@ -1869,6 +2016,7 @@ static void init(int argc, char **argv)
 			}
 			if (ret & (ERR_ABORT|ERR_FATAL))
 				ha_alert("Error(s) found in configuration file : %s\n", wl->s);
+			startup_timing_add(now_mono_time() - start, "file '%s'", wl->s);
 			err_code |= ret;
 			if (err_code & ERR_ABORT) {
 				free(env_cfgfiles);
@@ -1876,6 +2024,12 @@ static void init(int argc, char **argv)
 			}
 		}
 
+		list_for_each_entry(cs, &sections, list) {
+			if (cs->parse_time)
+				startup_timing_add(cs->parse_time, "section '%s'", cs->section_name);
+		}
+		startup_timing_stop(timing);
+
 		/* do not try to resolve arguments nor to spot inconsistencies when
 		 * the configuration contains fatal errors caused by files not found
 		 * or failed memory allocations.
@@ -1944,6 +2098,9 @@ static void init(int argc, char **argv)
 			exit(EXIT_FAILURE);
 		}
 
+		/* area where the workers publish their counters */
+		mworker_stats_init();
+
 		if (!LIST_ISEMPTY(&mworker_cli_conf)) {
 
 			if (mworker_cli_proxy_create() < 0) {
@@ -1971,7 +2128,11 @@ static void init(int argc, char **argv)
 	/* defaults sections are not needed anymore */
 	proxy_destroy_all_defaults();
 
+	timing = startup_timing_start("config check");
 	err_code |= check_config_validity();
+	startup_timing_stop(timing);
+
+	timing = startup_timing_start("post proxy/server checks");
 	for (px = proxies_list; px; px = px->next) {
 		struct server *srv;
 		struct post_proxy_check_fct *ppcf;
@@ -1987,12 +2148,26 @@ static void init(int argc, char **argv)
 		list_for_each_entry(ppcf, &post_proxy_check_list, list)
 			err_code |= ppcf->fct(px);
 	}
+	startup_timing_stop(timing);
+
+	/* run the independent jobs queued while checking the config, such as
+	 * the servers' SSL contexts setup, in parallel on all threads.
+	 */
+	timing = startup_timing_start("parallel post-parse work");
+	if (startup_work_run(&jobs_nb, &thr_nb))
+		err_code |= ERR_ALERT | ERR_FATAL;
+	startup_timing_stop(timing);
+	if (timing >= 0)
+		startup_timing_add(startup_timings[timing].ns, "%u jobs on %d threads", jobs_nb, thr_nb);
+
 	if (err_code & (ERR_ABORT|ERR_FATAL)) {
 		ha_alert("Fatal errors found in configuration.\n");
 		exit(1);
 	}
 
+	timing = startup_timing_start("pattern finalization");
 	err_code |= pattern_finalize_config();
+	startup_timing_stop(timing);
 	if (err_code & (ERR_ABORT|ERR_FATAL)) {
 		ha_alert("Failed to finalize pattern config.\n");
 		exit(1);
@@ -2007,13 +2182,17 @@ static void init(int argc, char **argv)
 #endif
 
 	/* Apply server states */
+	timing = startup_timing_start("server states");
 	apply_server_state();
 
 	for (px = proxies_list; px; px = px->next)
 		srv_compute_all_admin_states(px);
+	startup_timing_stop(timing);
 
 	/* Apply servers' configured address */
+	timing = startup_timing_start("server addresses resolution");
 	err_code |= srv_init_addr();
+	startup_timing_stop(timing);
 	if (err_code & (ERR_ABORT|ERR_FATAL)) {
 		ha_alert("Failed to initialize server(s) addr.\n");
 		exit(1);
@@ -2055,11 +2234,19 @@ static void init(int argc, char **argv)
 	/* now we know the buffer size, we can initialize the channels and buffers */
 	init_buffer();
 
+	timing = startup_timing_start("post-check callbacks");
 	list_for_each_entry(pcf, &post_check_list, list) {
+		uint64_t start = now_mono_time();
+
 		err_code |= pcf->fct();
 		if (err_code & (ERR_ABORT|ERR_FATAL))
 			exit(1);
+
+		chunk_reset(&trash);
+		resolve_sym_name(&trash, NULL, pcf->fct);
+		startup_timing_add(now_mono_time() - start, "%s", trash.area);
 	}
+	startup_timing_stop(timing);
 
 	if (cfg_maxconn > 0)
 		global.maxconn = cfg_maxconn;
@@ -2330,6 +2517,9 @@ static void init(int argc, char **argv)
 	if (!(global.tune.options & GTUNE_USE_EVPORTS))
 		disable_poller("evports");
 
+	if (!(global.tune.options & GTUNE_USE_URING))
+		disable_poller("uring");
+
 	if (!(global.tune.options & GTUNE_USE_EPOLL))
 		disable_poller("epoll");
 
@@ -2364,6 +2554,10 @@ static void init(int argc, char **argv)
 		printf("Using %s() as the polling mechanism.\n", cur_poller.name);
 	}
 
+#ifdef USE_SOCKMAP
+	sockmap_init();
+#endif
+
 	if (!global.node)
 		global.node = strdup(hostname);
 
@@ -2597,6 +2791,7 @@ struct task *mux_stopping_process(struct task *t, void *ctx, unsigned int state)
 /* Runs the polling loop */
 void run_poll_loop()
 {
+	unsigned int ctxsw;
 	int next, wake;
 
 	/* allocates the thread bound mux_stopping_data task */
@@ -2616,7 +2811,9 @@ void run_poll_loop()
 		}
 
 		/* Process a few tasks */
+		ctxsw = activity[tid].ctxsw;
 		process_runnable_tasks();
+		activity_hist_add(ACT_HIST_LOOP_TASKS, activity[tid].ctxsw - ctxsw);
 
 		/* also stop  if we failed to cleanly stop all tasks */
 		if (killed > 1)
@@ -2665,6 +2862,9 @@ void run_poll_loop()
 			}
 		}
 
+		/* no task runs anymore, retired objects may be released */
+		thread_quiescent();
+
 		/* If we have to sleep, measure how long */
 		next = wake ? TICK_ETERNITY : next_timer_expiry();
 
@@ -2832,6 +3032,7 @@ int main(int argc, char **argv)
 	int err, retry;
 	struct rlimit limit;
 	int pidfd = -1;
+	int timing;
 
 	setvbuf(stdout, NULL, _IONBF, 0);
 
@@ -2920,13 +3121,19 @@ int main(int argc, char **argv)
 	}
 
 	if (old_unixsocket) {
+		timing = startup_timing_start("old sockets retrieval");
 		if (strcmp("/dev/null", old_unixsocket) != 0) {
 			if (sock_get_old_sockets(old_unixsocket) != 0) {
 				ha_alert("Failed to get the sockets from the old process!\n");
 				if (!(global.mode & MODE_MWORKER))
 					exit(1);
 			}
+			/* idle backend connections are optional, no failure is fatal */
+			if ((global.tune.options & GTUNE_IDLE_POOL_INHERIT) &&
+			    sock_get_old_idle_conns(old_unixsocket) != 0)
+				ha_warning("Failed to get the idle connections from the old process.\n");
 		}
+		startup_timing_stop(timing);
 	}
 	get_cur_unixsocket();
 
@@ -2934,6 +3141,7 @@ int main(int argc, char **argv)
 	 * That's at most 1 second. We only send a signal to old pids
 	 * if we cannot grab at least one port.
 	 */
+	timing = startup_timing_start("listeners binding");
 	retry = MAX_START_RETRIES;
 	err = ERR_NONE;
 	while (retry >= 0) {
@@ -2960,6 +3168,7 @@ int main(int argc, char **argv)
 		select(0, NULL, NULL, NULL, &w);
 		retry--;
 	}
+	startup_timing_stop(timing);
 
 	/* Note: protocol_bind_all() sends an alert when it fails. */
 	if ((err & ~ERR_WARN) != ERR_NONE) {
@@ -3149,6 +3358,7 @@ int main(int argc, char **argv)
 							child->timestamp = now.tv_sec;
 							child->pid = ret;
 							child->version = strdup(haproxy_version);
+							mworker_stats_assign(ret);
 							break;
 						}
 					}
@@ -3170,6 +3380,7 @@ int main(int argc, char **argv)
 			struct hap_cpuset *set = &cpu_map.proc;
 			sched_setaffinity(0, sizeof(set->cpuset), &set->cpuset);
 #endif
+			ha_thread_info[0].numa_node = ha_cpuset_node(&cpu_map.proc);
 		}
 #endif
 		/* close the pidfile both in children and father */
@@ -3232,6 +3443,9 @@ int main(int argc, char **argv)
 				mworker_free_child(child);
 				child = NULL;
 			}
+
+			/* publish our counters to the master */
+			mworker_stats_attach();
 		}
 
 		if (!(global.mode & MODE_QUIET) || (global.mode & MODE_VERBOSE)) {
@@ -3385,7 +3599,10 @@ int main(int argc, char **argv)
 				pthread_setaffinity_np(ha_thread_info[i].pthread,
 				                       sizeof(set->cpuset), &set->cpuset);
 #endif
+				ha_thread_info[i].numa_node = ha_cpuset_node(&cpu_map.thread[i]);
 			}
+			else if (ha_cpuset_count(&cpu_map.proc))
+				ha_thread_info[i].numa_node = ha_cpuset_node(&cpu_map.proc);
 		}
 #endif /* !USE_CPU_AFFINITY */
 
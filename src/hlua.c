@@ -24,6 +24,7 @@
 #endif
 
 #include <import/ebpttree.h>
+#include <import/xxhash.h>
 
 #include <haproxy/api.h>
 #include <haproxy/applet.h>
@@ -195,6 +196,22 @@ lua_State *hlua_init_state(int thread_id);
  */
 static lua_State *hlua_states[MAX_THREADS + 1];
 
+/* Coroutines which completed their execution without error are kept for
+ * reuse by the next contexts of the same state, so that the usual actions
+ * and fetches do not have to create and collect a new Lua thread each time.
+ * The coroutines remain referenced in the state's registry while they are
+ * idle. The pools are protected by the same lock as their state.
+ */
+#define HLUA_THR_POOL_SIZE 32
+
+struct hlua_thr_pool {
+	int nb;                              /* number of idle coroutines */
+	lua_State *T[HLUA_THR_POOL_SIZE];    /* idle coroutines */
+	int Tref[HLUA_THR_POOL_SIZE];        /* their reference in the registry */
+};
+
+static struct hlua_thr_pool hlua_thr_pools[MAX_THREADS + 1];
+
 /* This is the memory pool containing struct lua for applets
  * (including cli).
  */
@@ -1094,6 +1111,18 @@ int hlua_ctx_init(struct hlua *lua, int state_id, struct task *task, int already
 			return 0;
 		}
 	}
+	if (hlua_thr_pools[state_id].nb) {
+		struct hlua_thr_pool *thr_pool = &hlua_thr_pools[state_id];
+
+		thr_pool->nb--;
+		lua->T = thr_pool->T[thr_pool->nb];
+		lua->Tref = thr_pool->Tref[thr_pool->nb];
+		hlua_sethlua(lua);
+		lua->task = task;
+		if (!already_safe)
+			RESET_SAFE_LJMP_PARENT(lua);
+		return 1;
+	}
 	lua->T = lua_newthread(hlua_states[state_id]);
 	if (!lua->T) {
 		lua->Tref = LUA_REFNIL;
@@ -1131,7 +1160,20 @@ void hlua_ctx_destroy(struct hlua *lua)
 
 	if (!SET_SAFE_LJMP_PARENT(lua))
 		return;
-	luaL_unref(hlua_states[lua->state_id], LUA_REGISTRYINDEX, lua->Tref);
+	/* A coroutine which is neither yielded nor in error may be reused
+	 * once its stack is emptied.
+	 */
+	if (lua_status(lua->T) == LUA_OK &&
+	    hlua_thr_pools[lua->state_id].nb < HLUA_THR_POOL_SIZE) {
+		struct hlua_thr_pool *thr_pool = &hlua_thr_pools[lua->state_id];
+
+		lua_settop(lua->T, 0);
+		thr_pool->T[thr_pool->nb] = lua->T;
+		thr_pool->Tref[thr_pool->nb] = lua->Tref;
+		thr_pool->nb++;
+	}
+	else
+		luaL_unref(hlua_states[lua->state_id], LUA_REGISTRYINDEX, lua->Tref);
 	RESET_SAFE_LJMP_PARENT(lua);
 	/* Forces a garbage collecting process. If the Lua program is finished
 	 * without error, we run the GC on the thread pointer. Its freed all
@@ -1543,6 +1585,267 @@ static int hlua_set_map(lua_State *L)
 	return 0;
 }
 
+/* The slots of core.shm, shared by all the Lua states. Their number is a power
+ * of two, and <hlua_shm_mask> is this number minus one.
+ */
+static struct hlua_shm_slot *hlua_shm = NULL;
+static unsigned int hlua_shm_mask = 0;
+
+/* Waits for slot <slot> not to be written anymore, and returns its sequence
+ * number.
+ */
+static inline unsigned int hlua_shm_wait(struct hlua_shm_slot *slot)
+{
+	unsigned int seq;
+
+	while ((seq = HA_ATOMIC_LOAD(&slot->seq)) & 1)
+		__ha_cpu_relax();
+	return seq;
+}
+
+/* Waits for slot <slot> not to be written anymore and marks it as being
+ * written, which serializes the writers of this slot.
+ */
+static inline void hlua_shm_lock(struct hlua_shm_slot *slot)
+{
+	unsigned int seq;
+
+	do {
+		seq = hlua_shm_wait(slot);
+	} while (!HA_ATOMIC_CAS(&slot->seq, &seq, seq + 1));
+	__ha_barrier_atomic_store();
+}
+
+/* Publishes the changes made to slot <slot>, locked by hlua_shm_lock(). */
+static inline void hlua_shm_unlock(struct hlua_shm_slot *slot)
+{
+	__ha_barrier_store();
+	HA_ATOMIC_INC(&slot->seq);
+}
+
+/* Returns the slot of key <key> of <len> bytes in core.shm, or NULL if it is
+ * not there. If <create> is set, the slot is returned locked, and a free one
+ * is assigned to the key if it is not there, in which case NULL is only
+ * returned if core.shm is full. The slots are probed linearly from the key's
+ * hash, and since they are never released, the first free slot ends the
+ * search.
+ */
+static struct hlua_shm_slot *hlua_shm_lookup(const char *key, size_t len, int create)
+{
+	struct hlua_shm_slot *slot;
+	unsigned int hash = XXH32(key, len, 0);
+	unsigned int seq, i;
+
+	for (i = 0; i <= hlua_shm_mask; i++) {
+		slot = &hlua_shm[(hash + i) & hlua_shm_mask];
+	  retry:
+		/* only wait for a slot whose key is being written */
+		while ((seq = HA_ATOMIC_LOAD(&slot->seq)) == 1)
+			__ha_cpu_relax();
+		__ha_barrier_load();
+
+		if (!seq) {
+			if (!create)
+				return NULL;
+			/* claim this free slot, it is then locked */
+			if (!HA_ATOMIC_CAS(&slot->seq, &seq, 1))
+				goto retry;
+			__ha_barrier_atomic_store();
+			slot->hash = hash;
+			slot->klen = len;
+			memcpy(slot->key, key, len);
+			slot->type = HLUA_SHM_NIL;
+			return slot;
+		}
+
+		/* the key of an assigned slot does not change anymore */
+		if (slot->hash == hash && slot->klen == len && memcmp(slot->key, key, len) == 0) {
+			if (create)
+				hlua_shm_lock(slot);
+			return slot;
+		}
+	}
+	return NULL;
+}
+
+/* Returns the key passed as first argument to core.shm function <fcn>, and
+ * sets its length into <len>. Raises an error if core.shm is not enabled or
+ * if the key is too long.
+ */
+__LJMP static const char *hlua_shm_check_key(lua_State *L, const char *fcn, size_t *len)
+{
+	const char *key;
+
+	if (!hlua_shm)
+		WILL_LJMP(luaL_error(L, "'%s': core.shm is not enabled, see 'tune.lua.shm-size'", fcn));
+
+	key = MAY_LJMP(luaL_checklstring(L, 1, len));
+	if (*len >= HLUA_SHM_KEY_LEN)
+		WILL_LJMP(luaL_error(L, "'%s': key too long (max %d bytes)", fcn, HLUA_SHM_KEY_LEN - 1));
+	return key;
+}
+
+/* This function is an LUA binding. It returns the value associated with a key
+ * in core.shm, or nil. It never locks.
+ */
+__LJMP static int hlua_shm_get(lua_State *L)
+{
+	struct hlua_shm_slot *slot;
+	char str[HLUA_SHM_VAL_LEN];
+	const char *key;
+	size_t len, vlen;
+	unsigned int seq;
+	long long num;
+	int type;
+
+	MAY_LJMP(check_args(L, 1, "get"));
+	key = MAY_LJMP(hlua_shm_check_key(L, "get", &len));
+
+	slot = hlua_shm_lookup(key, len, 0);
+	if (!slot) {
+		lua_pushnil(L);
+		return 1;
+	}
+
+	do {
+		seq = hlua_shm_wait(slot);
+		__ha_barrier_load();
+		type = slot->type;
+		num = slot->num;
+		vlen = MIN(slot->vlen, HLUA_SHM_VAL_LEN);
+		if (type == HLUA_SHM_STR)
+			memcpy(str, slot->str, vlen);
+		__ha_barrier_load();
+	} while (HA_ATOMIC_LOAD(&slot->seq) != seq);
+
+	switch (type) {
+	case HLUA_SHM_INT:
+		lua_pushinteger(L, num);
+		break;
+	case HLUA_SHM_BOOL:
+		lua_pushboolean(L, num);
+		break;
+	case HLUA_SHM_STR:
+		lua_pushlstring(L, str, vlen);
+		break;
+	default:
+		lua_pushnil(L);
+	}
+	return 1;
+}
+
+/* This function is an LUA binding. It associates an integer, a boolean, a
+ * string or nil with a key in core.shm. Setting nil deletes the value.
+ */
+__LJMP static int hlua_shm_set(lua_State *L)
+{
+	struct hlua_shm_slot *slot;
+	const char *key, *str = NULL;
+	size_t len, vlen = 0;
+	long long num = 0;
+	int type;
+
+	MAY_LJMP(check_args(L, 2, "set"));
+	key = MAY_LJMP(hlua_shm_check_key(L, "set", &len));
+
+	switch (lua_type(L, 2)) {
+	case LUA_TNIL:
+		type = HLUA_SHM_NIL;
+		break;
+	case LUA_TBOOLEAN:
+		type = HLUA_SHM_BOOL;
+		num = lua_toboolean(L, 2);
+		break;
+	case LUA_TNUMBER:
+		if (!lua_isinteger(L, 2))
+			WILL_LJMP(luaL_error(L, "'set': only integer numbers are supported"));
+		type = HLUA_SHM_INT;
+		num = lua_tointeger(L, 2);
+		break;
+	case LUA_TSTRING:
+		type = HLUA_SHM_STR;
+		str = lua_tolstring(L, 2, &vlen);
+		if (vlen > HLUA_SHM_VAL_LEN)
+			WILL_LJMP(luaL_error(L, "'set': value too long (max %d bytes)", HLUA_SHM_VAL_LEN));
+		break;
+	default:
+		WILL_LJMP(luaL_error(L, "'set': expects an integer, a boolean, a string or nil as value"));
+	}
+
+	slot = hlua_shm_lookup(key, len, type != HLUA_SHM_NIL);
+	if (!slot) {
+		if (type == HLUA_SHM_NIL)
+			return 0;
+		WILL_LJMP(luaL_error(L, "'set': core.shm is full"));
+	}
+
+	if (type == HLUA_SHM_NIL)
+		hlua_shm_lock(slot);
+	slot->type = type;
+	slot->num = num;
+	slot->vlen = vlen;
+	if (vlen)
+		memcpy(slot->str, str, vlen);
+	hlua_shm_unlock(slot);
+	return 0;
+}
+
+/* This function is an LUA binding. It atomically adds an integer, 1 by
+ * default, to the integer associated with a key in core.shm, which starts
+ * from zero if the key has no value. It returns the new value.
+ */
+__LJMP static int hlua_shm_incr(lua_State *L)
+{
+	struct hlua_shm_slot *slot;
+	const char *key;
+	long long delta = 1;
+	size_t len;
+
+	if (lua_gettop(L) != 1 && lua_gettop(L) != 2)
+		WILL_LJMP(luaL_error(L, "'incr' needs 1 or 2 arguments"));
+	key = MAY_LJMP(hlua_shm_check_key(L, "incr", &len));
+	if (lua_gettop(L) == 2)
+		delta = MAY_LJMP(luaL_checkinteger(L, 2));
+
+	slot = hlua_shm_lookup(key, len, 1);
+	if (!slot)
+		WILL_LJMP(luaL_error(L, "'incr': core.shm is full"));
+
+	if (slot->type == HLUA_SHM_NIL) {
+		slot->type = HLUA_SHM_INT;
+		slot->num = 0;
+	}
+	else if (slot->type != HLUA_SHM_INT) {
+		hlua_shm_unlock(slot);
+		WILL_LJMP(luaL_error(L, "'incr': the value is not an integer"));
+	}
+	slot->num += delta;
+	lua_pushinteger(L, slot->num);
+	hlua_shm_unlock(slot);
+	return 1;
+}
+
+/* This function is an LUA binding. It deletes the value associated with a
+ * key in core.shm.
+ */
+__LJMP static int hlua_shm_del(lua_State *L)
+{
+	struct hlua_shm_slot *slot;
+	const char *key;
+	size_t len;
+
+	MAY_LJMP(check_args(L, 1, "del"));
+	key = MAY_LJMP(hlua_shm_check_key(L, "del", &len));
+
+	slot = hlua_shm_lookup(key, len, 0);
+	if (slot) {
+		hlua_shm_lock(slot);
+		slot->type = HLUA_SHM_NIL;
+		hlua_shm_unlock(slot);
+	}
+	return 0;
+}
+
 /* A class is a lot of memory that contain data. This data can be a table,
  * an integer or user data. This data is associated with a metatable. This
  * metatable have an original version registered in the global context with
@@ -1759,6 +2062,18 @@ __LJMP static inline int _hlua_map_lookup(struct lua_State *L, int str)
 		smp.data.u.str.size = smp.data.u.str.data + 1;
 	}
 
+	if (desc->bin) {
+		struct ist val;
+
+		if (map_bin_lookup(desc->bin, &smp, &val))
+			lua_pushlstring(L, val.ptr, val.len);
+		else if (str)
+			lua_pushstring(L, "");
+		else
+			lua_pushnil(L);
+		return 1;
+	}
+
 	pat = pattern_exec_match(&desc->pat, &smp, 1);
 	if (!pat || !pat->data) {
 		if (str)
@@ -5056,6 +5371,151 @@ __LJMP static int hlua_http_res_get_headers(lua_State *L)
 	return hlua_http_get_headers(L, &htxn->s->txn->rsp);
 }
 
+/* This function pushes the value of occurrence <occ> (3rd argument, the first
+ * one by default, negative values counting from the last one) of the header
+ * whose name is the 2nd argument, or nil if it is not found. Only this value
+ * is copied. It is used as wrapper with the 2 following functions.
+ */
+__LJMP static int hlua_http_get_header(lua_State *L, struct http_msg *msg, char *fcn)
+{
+	size_t name_len, vlen;
+	const char *name;
+	struct htx *htx;
+	char *vptr;
+	int occ;
+
+	if (lua_gettop(L) < 2 || lua_gettop(L) > 3)
+		WILL_LJMP(luaL_error(L, "'%s' needs 2 or 3 arguments", fcn));
+
+	name = MAY_LJMP(luaL_checklstring(L, 2, &name_len));
+	occ = MAY_LJMP(luaL_optinteger(L, 3, 1));
+	if (occ < -MAX_HDR_HISTORY)
+		WILL_LJMP(luaL_argerror(L, 3, "occurrence out of range"));
+
+	htx = htxbuf(&msg->chn->buf);
+	if (http_get_htx_fhdr(htx, ist2(name, name_len), occ, NULL, &vptr, &vlen))
+		lua_pushlstring(L, vptr, vlen);
+	else
+		lua_pushnil(L);
+	return 1;
+}
+
+__LJMP static int hlua_http_req_get_header(lua_State *L)
+{
+	struct hlua_txn *htxn;
+
+	htxn = MAY_LJMP(hlua_checkhttp(L, 1));
+
+	if (htxn->dir != SMP_OPT_DIR_REQ || !IS_HTX_STRM(htxn->s))
+		WILL_LJMP(lua_error(L));
+
+	return MAY_LJMP(hlua_http_get_header(L, &htxn->s->txn->req, "req_get_header"));
+}
+
+__LJMP static int hlua_http_res_get_header(lua_State *L)
+{
+	struct hlua_txn *htxn;
+
+	htxn = MAY_LJMP(hlua_checkhttp(L, 1));
+
+	if (htxn->dir != SMP_OPT_DIR_RES || !IS_HTX_STRM(htxn->s))
+		WILL_LJMP(lua_error(L));
+
+	return MAY_LJMP(hlua_http_get_header(L, &htxn->s->txn->rsp, "res_get_header"));
+}
+
+/* Iterator returned by the "req_headers" and "res_headers" functions. Its
+ * upvalues are the HTTP object and the position of the last header returned,
+ * or -1 before the first call. It pushes the name and the value of the next
+ * header, read from the HTX message, or nil after the last one. Since only a
+ * position is kept between two calls, the headers may be modified during the
+ * iteration, at the risk of skipping or repeating some of them.
+ */
+__LJMP static int hlua_http_hdr_next(lua_State *L)
+{
+	struct hlua_txn *htxn;
+	struct http_msg *msg;
+	struct htx *htx;
+	struct htx_blk *blk;
+	int32_t pos;
+
+	htxn = MAY_LJMP(hlua_checkhttp(L, lua_upvalueindex(1)));
+	pos = lua_tointeger(L, lua_upvalueindex(2));
+	msg = (htxn->dir == SMP_OPT_DIR_REQ) ? &htxn->s->txn->req : &htxn->s->txn->rsp;
+	htx = htxbuf(&msg->chn->buf);
+
+	if (pos < 0)
+		pos = htx_get_first(htx);
+	else if (htx->head == -1 || pos < htx->head || pos > htx->tail)
+		pos = -1;
+	else
+		pos = htx_get_next(htx, pos);
+
+	for (; pos != -1; pos = htx_get_next(htx, pos)) {
+		enum htx_blk_type type;
+		struct ist n, v;
+
+		blk = htx_get_blk(htx, pos);
+		type = htx_get_blk_type(blk);
+		if (type == HTX_BLK_EOH)
+			break;
+		if (type != HTX_BLK_HDR)
+			continue;
+
+		n = htx_get_blk_name(htx, blk);
+		v = htx_get_blk_value(htx, blk);
+
+		lua_pushinteger(L, pos);
+		lua_replace(L, lua_upvalueindex(2));
+		lua_pushlstring(L, n.ptr, n.len);
+		lua_pushlstring(L, v.ptr, v.len);
+		return 2;
+	}
+
+	lua_pushinteger(L, htx->tail + 1);
+	lua_replace(L, lua_upvalueindex(2));
+	lua_pushnil(L);
+	return 1;
+}
+
+/* This function pushes an iterator over the headers, to be used in a generic
+ * "for" loop. The headers are read one at a time without building a table. It
+ * is used as wrapper with the 2 following functions.
+ */
+__LJMP static int hlua_http_headers(lua_State *L)
+{
+	lua_pushvalue(L, 1);
+	lua_pushinteger(L, -1);
+	lua_pushcclosure(L, hlua_http_hdr_next, 2);
+	return 1;
+}
+
+__LJMP static int hlua_http_req_headers(lua_State *L)
+{
+	struct hlua_txn *htxn;
+
+	MAY_LJMP(check_args(L, 1, "req_headers"));
+	htxn = MAY_LJMP(hlua_checkhttp(L, 1));
+
+	if (htxn->dir != SMP_OPT_DIR_REQ || !IS_HTX_STRM(htxn->s))
+		WILL_LJMP(lua_error(L));
+
+	return hlua_http_headers(L);
+}
+
+__LJMP static int hlua_http_res_headers(lua_State *L)
+{
+	struct hlua_txn *htxn;
+
+	MAY_LJMP(check_args(L, 1, "res_headers"));
+	htxn = MAY_LJMP(hlua_checkhttp(L, 1));
+
+	if (htxn->dir != SMP_OPT_DIR_RES || !IS_HTX_STRM(htxn->s))
+		WILL_LJMP(lua_error(L));
+
+	return hlua_http_headers(L);
+}
+
 /* This function replace full header, or just a value in
  * the request or in the response. It is a wrapper fir the
  * 4 following functions.
@@ -6432,11 +6892,11 @@ static int hlua_register_task(lua_State *L)
 		goto alloc_error;
 	HLUA_INIT(hlua);
 
-	/* We are in the common lua state, execute the task anywhere,
-	 * otherwise, inherit the current thread identifier
+	/* We are in the common lua state, execute the task on any thread of
+	 * the "bulk" class, otherwise, inherit the current thread identifier
 	 */
 	if (state_id == 0)
-		task = task_new(MAX_THREADS_MASK);
+		task = task_new(task_class_threads(TASK_CLASS_BULK));
 	else
 		task = task_new(tid_bit);
 	if (!task)
@@ -8304,6 +8764,42 @@ static int hlua_parse_maxmem(char **args, int section_type, struct proxy *curpx,
 }
 
 
+static int hlua_parse_shm_size(char **args, int section_type, struct proxy *curpx,
+                               const struct proxy *defpx, const char *file, int line,
+                               char **err)
+{
+	unsigned int entries, slots;
+	char *error;
+
+	if (*(args[1]) == 0) {
+		memprintf(err, "'%s' expects an integer argument (number of entries).\n", args[0]);
+		return -1;
+	}
+	entries = strtoul(args[1], &error, 10);
+	if (*error != '\0' || !entries || entries > HLUA_SHM_MAX_ENTRIES) {
+		memprintf(err, "%s: expects a number of entries between 1 and %d, got '%s'",
+		          args[0], HLUA_SHM_MAX_ENTRIES, args[1]);
+		return -1;
+	}
+
+	if (hlua_shm) {
+		memprintf(err, "%s: already specified", args[0]);
+		return -1;
+	}
+
+	/* keep the load factor below 50% to shorten the probing */
+	for (slots = 1; slots < entries * 2; slots <<= 1)
+		;
+
+	hlua_shm = calloc(slots, sizeof(*hlua_shm));
+	if (!hlua_shm) {
+		memprintf(err, "%s: out of memory", args[0]);
+		return -1;
+	}
+	hlua_shm_mask = slots - 1;
+	return 0;
+}
+
 /* This function is called by the main configuration key "lua-load". It loads and
  * execute an lua file during the parsing of the HAProxy configuration file. It is
  * the main lua entry point.
@@ -8501,6 +8997,7 @@ static struct cfg_kw_list cfg_kws = {{ },{
 	{ CFG_GLOBAL, "tune.lua.service-timeout", hlua_applet_timeout },
 	{ CFG_GLOBAL, "tune.lua.forced-yield",    hlua_forced_yield },
 	{ CFG_GLOBAL, "tune.lua.maxmem",          hlua_parse_maxmem },
+	{ CFG_GLOBAL, "tune.lua.shm-size",        hlua_parse_shm_size },
 	{ 0, NULL, NULL },
 }};
 
@@ -8849,6 +9346,15 @@ lua_State *hlua_init_state(int thread_num)
 	hlua_class_function(L, "done", hlua_done);
 	hlua_fcn_reg_core_fcn(L);
 
+	/* Create the "shm" sub-object. */
+	lua_pushstring(L, "shm");
+	lua_newtable(L);
+	hlua_class_function(L, "get", hlua_shm_get);
+	hlua_class_function(L, "set", hlua_shm_set);
+	hlua_class_function(L, "incr", hlua_shm_incr);
+	hlua_class_function(L, "del", hlua_shm_del);
+	lua_rawset(L, -3);
+
 	lua_setglobal(L, "core");
 
 	/*
@@ -9044,6 +9550,8 @@ lua_State *hlua_init_state(int thread_num)
 
 	/* Register Lua functions. */
 	hlua_class_function(L, "req_get_headers",hlua_http_req_get_headers);
+	hlua_class_function(L, "req_get_header", hlua_http_req_get_header);
+	hlua_class_function(L, "req_headers",    hlua_http_req_headers);
 	hlua_class_function(L, "req_del_header", hlua_http_req_del_hdr);
 	hlua_class_function(L, "req_rep_header", hlua_http_req_rep_hdr);
 	hlua_class_function(L, "req_rep_value",  hlua_http_req_rep_val);
@@ -9055,6 +9563,8 @@ lua_State *hlua_init_state(int thread_num)
 	hlua_class_function(L, "req_set_uri",    hlua_http_req_set_uri);
 
 	hlua_class_function(L, "res_get_headers",hlua_http_res_get_headers);
+	hlua_class_function(L, "res_get_header", hlua_http_res_get_header);
+	hlua_class_function(L, "res_headers",    hlua_http_res_headers);
 	hlua_class_function(L, "res_del_header", hlua_http_res_del_hdr);
 	hlua_class_function(L, "res_rep_header", hlua_http_res_rep_hdr);
 	hlua_class_function(L, "res_rep_value",  hlua_http_res_rep_val);
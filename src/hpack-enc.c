@@ -32,6 +32,7 @@
 
 #include <import/ist.h>
 #include <haproxy/hpack-enc.h>
+#include <haproxy/hpack-tbl.h>
 #include <haproxy/http-hdr-t.h>
 
 /*
@@ -138,6 +139,63 @@ const signed short hpack_pos_len[32] = {
          /*   24: */   -1,  609,   -1,  636,   -1,   -1,   -1,   -1,
 };
 
+/* Returns the lowest index of header field name <n> in the static table, or
+ * zero if not found.
+ */
+static inline int hpack_find_static_name(const struct ist n)
+{
+	int pos;
+
+	if (n.len >= sizeof(hpack_pos_len) / sizeof(hpack_pos_len[0]))
+		return 0;
+
+	pos = hpack_pos_len[n.len];
+	if (pos < 0)
+		return 0;
+
+	/* At least one header field of this length exist */
+	do {
+		int idx;
+
+		pos++;
+		idx = hpack_enc_stream[pos++];
+		pos += n.len;
+		if (isteq(ist2(&hpack_enc_stream[pos - n.len], n.len), n))
+			return idx;
+	} while ((unsigned char)hpack_enc_stream[pos] == n.len);
+
+	return 0;
+}
+
+/* Encodes integer <v> using an <n>-bit prefix (7541#5.1) into <out>+<pos>, with
+ * the upper bits of the first byte set to <flags>. Returns the new position,
+ * or -1 if it would go past <size>.
+ */
+static inline int hpack_encode_int(char *out, int pos, int size, unsigned char flags, int n, uint32_t v)
+{
+	uint32_t max = (1U << n) - 1;
+
+	if (pos >= size)
+		return -1;
+
+	if (v < max) {
+		out[pos++] = flags | v;
+		return pos;
+	}
+
+	out[pos++] = flags | max;
+	for (v -= max; v >= 128; v >>= 7) {
+		if (pos >= size)
+			return -1;
+		out[pos++] = (v & 127) | 128;
+	}
+
+	if (pos >= size)
+		return -1;
+	out[pos++] = v;
+	return pos;
+}
+
 /* Tries to encode header whose name is <n> and value <v> into the chunk <out>.
  * Returns non-zero on success, 0 on failure (buffer full).
  */
@@ -146,35 +204,22 @@ int hpack_encode_header(struct buffer *out, const struct ist n,
 {
 	int len = out->data;
 	int size = out->size;
-	int pos;
+	int idx;
 
 	if (len >= size)
 		return 0;
 
 	/* look for the header field <n> in the static table */
-	if (n.len >= sizeof(hpack_pos_len) / sizeof(hpack_pos_len[0]))
-		goto make_literal;
-
-	pos = hpack_pos_len[n.len];
-	if (pos >= 0) {
-		/* At least one header field of this length exist */
-		do {
-			char idx;
-
-			pos++;
-			idx = hpack_enc_stream[pos++];
-			pos += n.len;
-			if (isteq(ist2(&hpack_enc_stream[pos - n.len], n.len), n)) {
-				/* emit literal with indexing (7541#6.2.1) :
-				 * [ 0 | 1 | Index (6+) ]
-				 */
-				out->area[len++] = idx | 0x40;
-				goto emit_value;
-			}
-		} while ((unsigned char)hpack_enc_stream[pos] == n.len);
+	idx = hpack_find_static_name(n);
+	if (idx) {
+		/* emit literal with indexing (7541#6.2.1) :
+		 * [ 0 | 1 | Index (6+) ]
+		 */
+		out->area[len++] = idx | 0x40;
+		goto emit_value;
 	}
 
- make_literal:
+	/* make_literal: */
 	if (likely(n.len < 127 && len + 2 + n.len <= size)) {
 		out->area[len++] = 0x00;      /* literal without indexing -- new name */
 		out->area[len++] = n.len;     /* single-byte length encoding */
@@ -208,3 +253,123 @@ int hpack_encode_header(struct buffer *out, const struct ist n,
 	out->data = len;
 	return 1;
 }
+
+/* Returns the way header field <n>:<v> may be added to the dynamic table <dht>
+ * of the encoder: 0x40 for incremental indexing, 0x00 for not indexing it,
+ * or 0x10 for a field which must never be indexed (7541#7.1.3) because it
+ * usually conveys secrets.
+ */
+static inline unsigned char hpack_dht_policy(const struct hpack_dht *dht, const struct ist n, const struct ist v)
+{
+	if (isteq(n, ist("cookie")) || isteq(n, ist("set-cookie")) ||
+	    isteq(n, ist("authorization")) || isteq(n, ist("proxy-authorization")))
+		return 0x10;
+
+	/* fields whose values change with almost every message would only
+	 * evict useful entries.
+	 */
+	if (isteq(n, ist("content-length")) || isteq(n, ist("content-range")) ||
+	    isteq(n, ist("etag")) || isteq(n, ist("last-modified")) ||
+	    isteq(n, ist("age")) || isteq(n, ist(":path")))
+		return 0x00;
+
+	/* keep room for several entries */
+	if ((n.len + v.len + 32) * 4 > dht->size)
+		return 0x00;
+
+	return 0x40;
+}
+
+/* Tries to encode header whose name is <n> and value <v> into the chunk <out>,
+ * using and updating the encoder's dynamic table <dht>, which must always
+ * remain in sync with the peer's decoder. Fields found in the static or the
+ * dynamic table are emitted as a single index, otherwise they are emitted as
+ * literals, and added to the table depending on hpack_dht_policy(). Returns
+ * non-zero on success, 0 on failure (buffer full, or table allocation
+ * failure during a defragmentation). In case of failure, the table must be
+ * considered altered and the caller must restore it if the header block is
+ * not sent.
+ */
+int hpack_encode_header_dht(struct buffer *out, struct hpack_dht *dht,
+			    const struct ist n, const struct ist v)
+{
+	const struct hpack_dte *dte;
+	int len = out->data;
+	int size = out->size;
+	uint32_t name_idx;
+	unsigned char mode;
+	int idx, pos;
+
+	/* look for the whole field, then only the name, in the static table */
+	idx = name_idx = hpack_find_static_name(n);
+	for (; idx && idx < HPACK_SHT_SIZE && isteq(hpack_sht[idx].n, n); idx++) {
+		if (isteq(hpack_sht[idx].v, v))
+			goto emit_indexed;
+	}
+
+	/* then in the dynamic table, most recent entries first */
+	for (pos = 1; (dte = hpack_get_dte(dht, pos)) != NULL; pos++) {
+		if (dte->nlen != n.len || !isteq(hpack_get_name(dht, dte), n))
+			continue;
+
+		if (dte->vlen == v.len && isteq(hpack_get_value(dht, dte), v)) {
+			idx = HPACK_SHT_SIZE - 1 + pos;
+			goto emit_indexed;
+		}
+
+		if (!name_idx)
+			name_idx = HPACK_SHT_SIZE - 1 + pos;
+	}
+
+	/* emit a literal with either a 6-bit (indexing) or a 4-bit name
+	 * index prefix (7541#6.2), or 0 for a literal name.
+	 */
+	mode = hpack_dht_policy(dht, n, v);
+	len = hpack_encode_int(out->area, len, size, mode, (mode == 0x40) ? 6 : 4, name_idx);
+	if (len < 0)
+		return 0;
+
+	if (!name_idx) {
+		if (!hpack_len_to_bytes(n.len) ||
+		    len + hpack_len_to_bytes(n.len) + n.len > size)
+			return 0;
+		len = hpack_encode_len(out->area, len, n.len);
+		ist2bin(out->area + len, n);
+		len += n.len;
+	}
+
+	if (!hpack_len_to_bytes(v.len) ||
+	    len + hpack_len_to_bytes(v.len) + v.len > size)
+		return 0;
+
+	len = hpack_encode_len(out->area, len, v.len);
+	memcpy(out->area + len, v.ptr, v.len);
+	len += v.len;
+
+	if (mode == 0x40 && hpack_dht_insert(dht, n, v) < 0)
+		return 0;
+
+	out->data = len;
+	return 1;
+
+ emit_indexed:
+	/* indexed header field (7541#6.1) : [ 1 | Index (7+) ] */
+	len = hpack_encode_int(out->area, len, size, 0x80, 7, idx);
+	if (len < 0)
+		return 0;
+	out->data = len;
+	return 1;
+}
+
+/* Tries to emit a dynamic table size update to <size> (7541#6.3) into the
+ * chunk <out>. Returns non-zero on success, 0 on failure (buffer full).
+ */
+int hpack_encode_dht_size_update(struct buffer *out, uint32_t size)
+{
+	int len = hpack_encode_int(out->area, out->data, out->size, 0x20, 5, size);
+
+	if (len < 0)
+		return 0;
+	out->data = len;
+	return 1;
+}
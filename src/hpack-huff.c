@@ -31,6 +31,7 @@
 
 #include <haproxy/api.h>
 #include <haproxy/hpack-huff.h>
+#include <haproxy/net_helper.h>
 
 struct huff {
 	uint32_t c; /* code point */
@@ -42,6 +43,13 @@ struct rht {
 	uint8_t l; // length in bits
 };
 
+/* multi-symbol reverse huffman table entry */
+struct rht2 {
+	uint8_t c[2]; // up to two symbols
+	uint8_t n;    // number of symbols in c[], 0 if the first code is too long
+	uint8_t l;    // total length of these symbols in bits
+};
+
 /* huffman table as per RFC7541 appendix B */
 static const struct huff ht[257] = {
 	[  0] = { .c = 0x00001ff8, .b = 13 },
@@ -1386,6 +1394,527 @@ struct rht rht_bit11_4[256] = {
 	/* Note, when l==30, bits 2..3 give 00:0x0a, 01:0x0d, 10:0x16, 11:EOS */
 };
 
+/* Indexed on bits 31..21 of the code. Since the shortest codes are 5 bits long,
+ * up to two symbols may be decoded at once when they are short enough, which is
+ * the common case for header names and values. The entries whose first code is
+ * longer than 11 bits are empty and the hierarchical tables above must be used.
+ * Generated by dev/hpack/gen-rht.
+ */
+static const struct rht2 rht_bit31_21[2048] = {
+	/* 0x000 */ { { 0x30, 0x30 }, 2, 10 }, { { 0x30, 0x30 }, 2, 10 }, { { 0x30, 0x31 }, 2, 10 }, { { 0x30, 0x31 }, 2, 10 },
+	/* 0x004 */ { { 0x30, 0x32 }, 2, 10 }, { { 0x30, 0x32 }, 2, 10 }, { { 0x30, 0x61 }, 2, 10 }, { { 0x30, 0x61 }, 2, 10 },
+	/* 0x008 */ { { 0x30, 0x63 }, 2, 10 }, { { 0x30, 0x63 }, 2, 10 }, { { 0x30, 0x65 }, 2, 10 }, { { 0x30, 0x65 }, 2, 10 },
+	/* 0x00c */ { { 0x30, 0x69 }, 2, 10 }, { { 0x30, 0x69 }, 2, 10 }, { { 0x30, 0x6f }, 2, 10 }, { { 0x30, 0x6f }, 2, 10 },
+	/* 0x010 */ { { 0x30, 0x73 }, 2, 10 }, { { 0x30, 0x73 }, 2, 10 }, { { 0x30, 0x74 }, 2, 10 }, { { 0x30, 0x74 }, 2, 10 },
+	/* 0x014 */ { { 0x30, 0x20 }, 2, 11 }, { { 0x30, 0x25 }, 2, 11 }, { { 0x30, 0x2d }, 2, 11 }, { { 0x30, 0x2e }, 2, 11 },
+	/* 0x018 */ { { 0x30, 0x2f }, 2, 11 }, { { 0x30, 0x33 }, 2, 11 }, { { 0x30, 0x34 }, 2, 11 }, { { 0x30, 0x35 }, 2, 11 },
+	/* 0x01c */ { { 0x30, 0x36 }, 2, 11 }, { { 0x30, 0x37 }, 2, 11 }, { { 0x30, 0x38 }, 2, 11 }, { { 0x30, 0x39 }, 2, 11 },
+	/* 0x020 */ { { 0x30, 0x3d }, 2, 11 }, { { 0x30, 0x41 }, 2, 11 }, { { 0x30, 0x5f }, 2, 11 }, { { 0x30, 0x62 }, 2, 11 },
+	/* 0x024 */ { { 0x30, 0x64 }, 2, 11 }, { { 0x30, 0x66 }, 2, 11 }, { { 0x30, 0x67 }, 2, 11 }, { { 0x30, 0x68 }, 2, 11 },
+	/* 0x028 */ { { 0x30, 0x6c }, 2, 11 }, { { 0x30, 0x6d }, 2, 11 }, { { 0x30, 0x6e }, 2, 11 }, { { 0x30, 0x70 }, 2, 11 },
+	/* 0x02c */ { { 0x30, 0x72 }, 2, 11 }, { { 0x30, 0x75 }, 2, 11 }, { { 0x30, 0x00 }, 1,  5 }, { { 0x30, 0x00 }, 1,  5 },
+	/* 0x030 */ { { 0x30, 0x00 }, 1,  5 }, { { 0x30, 0x00 }, 1,  5 }, { { 0x30, 0x00 }, 1,  5 }, { { 0x30, 0x00 }, 1,  5 },
+	/* 0x034 */ { { 0x30, 0x00 }, 1,  5 }, { { 0x30, 0x00 }, 1,  5 }, { { 0x30, 0x00 }, 1,  5 }, { { 0x30, 0x00 }, 1,  5 },
+	/* 0x038 */ { { 0x30, 0x00 }, 1,  5 }, { { 0x30, 0x00 }, 1,  5 }, { { 0x30, 0x00 }, 1,  5 }, { { 0x30, 0x00 }, 1,  5 },
+	/* 0x03c */ { { 0x30, 0x00 }, 1,  5 }, { { 0x30, 0x00 }, 1,  5 }, { { 0x30, 0x00 }, 1,  5 }, { { 0x30, 0x00 }, 1,  5 },
+	/* 0x040 */ { { 0x31, 0x30 }, 2, 10 }, { { 0x31, 0x30 }, 2, 10 }, { { 0x31, 0x31 }, 2, 10 }, { { 0x31, 0x31 }, 2, 10 },
+	/* 0x044 */ { { 0x31, 0x32 }, 2, 10 }, { { 0x31, 0x32 }, 2, 10 }, { { 0x31, 0x61 }, 2, 10 }, { { 0x31, 0x61 }, 2, 10 },
+	/* 0x048 */ { { 0x31, 0x63 }, 2, 10 }, { { 0x31, 0x63 }, 2, 10 }, { { 0x31, 0x65 }, 2, 10 }, { { 0x31, 0x65 }, 2, 10 },
+	/* 0x04c */ { { 0x31, 0x69 }, 2, 10 }, { { 0x31, 0x69 }, 2, 10 }, { { 0x31, 0x6f }, 2, 10 }, { { 0x31, 0x6f }, 2, 10 },
+	/* 0x050 */ { { 0x31, 0x73 }, 2, 10 }, { { 0x31, 0x73 }, 2, 10 }, { { 0x31, 0x74 }, 2, 10 }, { { 0x31, 0x74 }, 2, 10 },
+	/* 0x054 */ { { 0x31, 0x20 }, 2, 11 }, { { 0x31, 0x25 }, 2, 11 }, { { 0x31, 0x2d }, 2, 11 }, { { 0x31, 0x2e }, 2, 11 },
+	/* 0x058 */ { { 0x31, 0x2f }, 2, 11 }, { { 0x31, 0x33 }, 2, 11 }, { { 0x31, 0x34 }, 2, 11 }, { { 0x31, 0x35 }, 2, 11 },
+	/* 0x05c */ { { 0x31, 0x36 }, 2, 11 }, { { 0x31, 0x37 }, 2, 11 }, { { 0x31, 0x38 }, 2, 11 }, { { 0x31, 0x39 }, 2, 11 },
+	/* 0x060 */ { { 0x31, 0x3d }, 2, 11 }, { { 0x31, 0x41 }, 2, 11 }, { { 0x31, 0x5f }, 2, 11 }, { { 0x31, 0x62 }, 2, 11 },
+	/* 0x064 */ { { 0x31, 0x64 }, 2, 11 }, { { 0x31, 0x66 }, 2, 11 }, { { 0x31, 0x67 }, 2, 11 }, { { 0x31, 0x68 }, 2, 11 },
+	/* 0x068 */ { { 0x31, 0x6c }, 2, 11 }, { { 0x31, 0x6d }, 2, 11 }, { { 0x31, 0x6e }, 2, 11 }, { { 0x31, 0x70 }, 2, 11 },
+	/* 0x06c */ { { 0x31, 0x72 }, 2, 11 }, { { 0x31, 0x75 }, 2, 11 }, { { 0x31, 0x00 }, 1,  5 }, { { 0x31, 0x00 }, 1,  5 },
+	/* 0x070 */ { { 0x31, 0x00 }, 1,  5 }, { { 0x31, 0x00 }, 1,  5 }, { { 0x31, 0x00 }, 1,  5 }, { { 0x31, 0x00 }, 1,  5 },
+	/* 0x074 */ { { 0x31, 0x00 }, 1,  5 }, { { 0x31, 0x00 }, 1,  5 }, { { 0x31, 0x00 }, 1,  5 }, { { 0x31, 0x00 }, 1,  5 },
+	/* 0x078 */ { { 0x31, 0x00 }, 1,  5 }, { { 0x31, 0x00 }, 1,  5 }, { { 0x31, 0x00 }, 1,  5 }, { { 0x31, 0x00 }, 1,  5 },
+	/* 0x07c */ { { 0x31, 0x00 }, 1,  5 }, { { 0x31, 0x00 }, 1,  5 }, { { 0x31, 0x00 }, 1,  5 }, { { 0x31, 0x00 }, 1,  5 },
+	/* 0x080 */ { { 0x32, 0x30 }, 2, 10 }, { { 0x32, 0x30 }, 2, 10 }, { { 0x32, 0x31 }, 2, 10 }, { { 0x32, 0x31 }, 2, 10 },
+	/* 0x084 */ { { 0x32, 0x32 }, 2, 10 }, { { 0x32, 0x32 }, 2, 10 }, { { 0x32, 0x61 }, 2, 10 }, { { 0x32, 0x61 }, 2, 10 },
+	/* 0x088 */ { { 0x32, 0x63 }, 2, 10 }, { { 0x32, 0x63 }, 2, 10 }, { { 0x32, 0x65 }, 2, 10 }, { { 0x32, 0x65 }, 2, 10 },
+	/* 0x08c */ { { 0x32, 0x69 }, 2, 10 }, { { 0x32, 0x69 }, 2, 10 }, { { 0x32, 0x6f }, 2, 10 }, { { 0x32, 0x6f }, 2, 10 },
+	/* 0x090 */ { { 0x32, 0x73 }, 2, 10 }, { { 0x32, 0x73 }, 2, 10 }, { { 0x32, 0x74 }, 2, 10 }, { { 0x32, 0x74 }, 2, 10 },
+	/* 0x094 */ { { 0x32, 0x20 }, 2, 11 }, { { 0x32, 0x25 }, 2, 11 }, { { 0x32, 0x2d }, 2, 11 }, { { 0x32, 0x2e }, 2, 11 },
+	/* 0x098 */ { { 0x32, 0x2f }, 2, 11 }, { { 0x32, 0x33 }, 2, 11 }, { { 0x32, 0x34 }, 2, 11 }, { { 0x32, 0x35 }, 2, 11 },
+	/* 0x09c */ { { 0x32, 0x36 }, 2, 11 }, { { 0x32, 0x37 }, 2, 11 }, { { 0x32, 0x38 }, 2, 11 }, { { 0x32, 0x39 }, 2, 11 },
+	/* 0x0a0 */ { { 0x32, 0x3d }, 2, 11 }, { { 0x32, 0x41 }, 2, 11 }, { { 0x32, 0x5f }, 2, 11 }, { { 0x32, 0x62 }, 2, 11 },
+	/* 0x0a4 */ { { 0x32, 0x64 }, 2, 11 }, { { 0x32, 0x66 }, 2, 11 }, { { 0x32, 0x67 }, 2, 11 }, { { 0x32, 0x68 }, 2, 11 },
+	/* 0x0a8 */ { { 0x32, 0x6c }, 2, 11 }, { { 0x32, 0x6d }, 2, 11 }, { { 0x32, 0x6e }, 2, 11 }, { { 0x32, 0x70 }, 2, 11 },
+	/* 0x0ac */ { { 0x32, 0x72 }, 2, 11 }, { { 0x32, 0x75 }, 2, 11 }, { { 0x32, 0x00 }, 1,  5 }, { { 0x32, 0x00 }, 1,  5 },
+	/* 0x0b0 */ { { 0x32, 0x00 }, 1,  5 }, { { 0x32, 0x00 }, 1,  5 }, { { 0x32, 0x00 }, 1,  5 }, { { 0x32, 0x00 }, 1,  5 },
+	/* 0x0b4 */ { { 0x32, 0x00 }, 1,  5 }, { { 0x32, 0x00 }, 1,  5 }, { { 0x32, 0x00 }, 1,  5 }, { { 0x32, 0x00 }, 1,  5 },
+	/* 0x0b8 */ { { 0x32, 0x00 }, 1,  5 }, { { 0x32, 0x00 }, 1,  5 }, { { 0x32, 0x00 }, 1,  5 }, { { 0x32, 0x00 }, 1,  5 },
+	/* 0x0bc */ { { 0x32, 0x00 }, 1,  5 }, { { 0x32, 0x00 }, 1,  5 }, { { 0x32, 0x00 }, 1,  5 }, { { 0x32, 0x00 }, 1,  5 },
+	/* 0x0c0 */ { { 0x61, 0x30 }, 2, 10 }, { { 0x61, 0x30 }, 2, 10 }, { { 0x61, 0x31 }, 2, 10 }, { { 0x61, 0x31 }, 2, 10 },
+	/* 0x0c4 */ { { 0x61, 0x32 }, 2, 10 }, { { 0x61, 0x32 }, 2, 10 }, { { 0x61, 0x61 }, 2, 10 }, { { 0x61, 0x61 }, 2, 10 },
+	/* 0x0c8 */ { { 0x61, 0x63 }, 2, 10 }, { { 0x61, 0x63 }, 2, 10 }, { { 0x61, 0x65 }, 2, 10 }, { { 0x61, 0x65 }, 2, 10 },
+	/* 0x0cc */ { { 0x61, 0x69 }, 2, 10 }, { { 0x61, 0x69 }, 2, 10 }, { { 0x61, 0x6f }, 2, 10 }, { { 0x61, 0x6f }, 2, 10 },
+	/* 0x0d0 */ { { 0x61, 0x73 }, 2, 10 }, { { 0x61, 0x73 }, 2, 10 }, { { 0x61, 0x74 }, 2, 10 }, { { 0x61, 0x74 }, 2, 10 },
+	/* 0x0d4 */ { { 0x61, 0x20 }, 2, 11 }, { { 0x61, 0x25 }, 2, 11 }, { { 0x61, 0x2d }, 2, 11 }, { { 0x61, 0x2e }, 2, 11 },
+	/* 0x0d8 */ { { 0x61, 0x2f }, 2, 11 }, { { 0x61, 0x33 }, 2, 11 }, { { 0x61, 0x34 }, 2, 11 }, { { 0x61, 0x35 }, 2, 11 },
+	/* 0x0dc */ { { 0x61, 0x36 }, 2, 11 }, { { 0x61, 0x37 }, 2, 11 }, { { 0x61, 0x38 }, 2, 11 }, { { 0x61, 0x39 }, 2, 11 },
+	/* 0x0e0 */ { { 0x61, 0x3d }, 2, 11 }, { { 0x61, 0x41 }, 2, 11 }, { { 0x61, 0x5f }, 2, 11 }, { { 0x61, 0x62 }, 2, 11 },
+	/* 0x0e4 */ { { 0x61, 0x64 }, 2, 11 }, { { 0x61, 0x66 }, 2, 11 }, { { 0x61, 0x67 }, 2, 11 }, { { 0x61, 0x68 }, 2, 11 },
+	/* 0x0e8 */ { { 0x61, 0x6c }, 2, 11 }, { { 0x61, 0x6d }, 2, 11 }, { { 0x61, 0x6e }, 2, 11 }, { { 0x61, 0x70 }, 2, 11 },
+	/* 0x0ec */ { { 0x61, 0x72 }, 2, 11 }, { { 0x61, 0x75 }, 2, 11 }, { { 0x61, 0x00 }, 1,  5 }, { { 0x61, 0x00 }, 1,  5 },
+	/* 0x0f0 */ { { 0x61, 0x00 }, 1,  5 }, { { 0x61, 0x00 }, 1,  5 }, { { 0x61, 0x00 }, 1,  5 }, { { 0x61, 0x00 }, 1,  5 },
+	/* 0x0f4 */ { { 0x61, 0x00 }, 1,  5 }, { { 0x61, 0x00 }, 1,  5 }, { { 0x61, 0x00 }, 1,  5 }, { { 0x61, 0x00 }, 1,  5 },
+	/* 0x0f8 */ { { 0x61, 0x00 }, 1,  5 }, { { 0x61, 0x00 }, 1,  5 }, { { 0x61, 0x00 }, 1,  5 }, { { 0x61, 0x00 }, 1,  5 },
+	/* 0x0fc */ { { 0x61, 0x00 }, 1,  5 }, { { 0x61, 0x00 }, 1,  5 }, { { 0x61, 0x00 }, 1,  5 }, { { 0x61, 0x00 }, 1,  5 },
+	/* 0x100 */ { { 0x63, 0x30 }, 2, 10 }, { { 0x63, 0x30 }, 2, 10 }, { { 0x63, 0x31 }, 2, 10 }, { { 0x63, 0x31 }, 2, 10 },
+	/* 0x104 */ { { 0x63, 0x32 }, 2, 10 }, { { 0x63, 0x32 }, 2, 10 }, { { 0x63, 0x61 }, 2, 10 }, { { 0x63, 0x61 }, 2, 10 },
+	/* 0x108 */ { { 0x63, 0x63 }, 2, 10 }, { { 0x63, 0x63 }, 2, 10 }, { { 0x63, 0x65 }, 2, 10 }, { { 0x63, 0x65 }, 2, 10 },
+	/* 0x10c */ { { 0x63, 0x69 }, 2, 10 }, { { 0x63, 0x69 }, 2, 10 }, { { 0x63, 0x6f }, 2, 10 }, { { 0x63, 0x6f }, 2, 10 },
+	/* 0x110 */ { { 0x63, 0x73 }, 2, 10 }, { { 0x63, 0x73 }, 2, 10 }, { { 0x63, 0x74 }, 2, 10 }, { { 0x63, 0x74 }, 2, 10 },
+	/* 0x114 */ { { 0x63, 0x20 }, 2, 11 }, { { 0x63, 0x25 }, 2, 11 }, { { 0x63, 0x2d }, 2, 11 }, { { 0x63, 0x2e }, 2, 11 },
+	/* 0x118 */ { { 0x63, 0x2f }, 2, 11 }, { { 0x63, 0x33 }, 2, 11 }, { { 0x63, 0x34 }, 2, 11 }, { { 0x63, 0x35 }, 2, 11 },
+	/* 0x11c */ { { 0x63, 0x36 }, 2, 11 }, { { 0x63, 0x37 }, 2, 11 }, { { 0x63, 0x38 }, 2, 11 }, { { 0x63, 0x39 }, 2, 11 },
+	/* 0x120 */ { { 0x63, 0x3d }, 2, 11 }, { { 0x63, 0x41 }, 2, 11 }, { { 0x63, 0x5f }, 2, 11 }, { { 0x63, 0x62 }, 2, 11 },
+	/* 0x124 */ { { 0x63, 0x64 }, 2, 11 }, { { 0x63, 0x66 }, 2, 11 }, { { 0x63, 0x67 }, 2, 11 }, { { 0x63, 0x68 }, 2, 11 },
+	/* 0x128 */ { { 0x63, 0x6c }, 2, 11 }, { { 0x63, 0x6d }, 2, 11 }, { { 0x63, 0x6e }, 2, 11 }, { { 0x63, 0x70 }, 2, 11 },
+	/* 0x12c */ { { 0x63, 0x72 }, 2, 11 }, { { 0x63, 0x75 }, 2, 11 }, { { 0x63, 0x00 }, 1,  5 }, { { 0x63, 0x00 }, 1,  5 },
+	/* 0x130 */ { { 0x63, 0x00 }, 1,  5 }, { { 0x63, 0x00 }, 1,  5 }, { { 0x63, 0x00 }, 1,  5 }, { { 0x63, 0x00 }, 1,  5 },
+	/* 0x134 */ { { 0x63, 0x00 }, 1,  5 }, { { 0x63, 0x00 }, 1,  5 }, { { 0x63, 0x00 }, 1,  5 }, { { 0x63, 0x00 }, 1,  5 },
+	/* 0x138 */ { { 0x63, 0x00 }, 1,  5 }, { { 0x63, 0x00 }, 1,  5 }, { { 0x63, 0x00 }, 1,  5 }, { { 0x63, 0x00 }, 1,  5 },
+	/* 0x13c */ { { 0x63, 0x00 }, 1,  5 }, { { 0x63, 0x00 }, 1,  5 }, { { 0x63, 0x00 }, 1,  5 }, { { 0x63, 0x00 }, 1,  5 },
+	/* 0x140 */ { { 0x65, 0x30 }, 2, 10 }, { { 0x65, 0x30 }, 2, 10 }, { { 0x65, 0x31 }, 2, 10 }, { { 0x65, 0x31 }, 2, 10 },
+	/* 0x144 */ { { 0x65, 0x32 }, 2, 10 }, { { 0x65, 0x32 }, 2, 10 }, { { 0x65, 0x61 }, 2, 10 }, { { 0x65, 0x61 }, 2, 10 },
+	/* 0x148 */ { { 0x65, 0x63 }, 2, 10 }, { { 0x65, 0x63 }, 2, 10 }, { { 0x65, 0x65 }, 2, 10 }, { { 0x65, 0x65 }, 2, 10 },
+	/* 0x14c */ { { 0x65, 0x69 }, 2, 10 }, { { 0x65, 0x69 }, 2, 10 }, { { 0x65, 0x6f }, 2, 10 }, { { 0x65, 0x6f }, 2, 10 },
+	/* 0x150 */ { { 0x65, 0x73 }, 2, 10 }, { { 0x65, 0x73 }, 2, 10 }, { { 0x65, 0x74 }, 2, 10 }, { { 0x65, 0x74 }, 2, 10 },
+	/* 0x154 */ { { 0x65, 0x20 }, 2, 11 }, { { 0x65, 0x25 }, 2, 11 }, { { 0x65, 0x2d }, 2, 11 }, { { 0x65, 0x2e }, 2, 11 },
+	/* 0x158 */ { { 0x65, 0x2f }, 2, 11 }, { { 0x65, 0x33 }, 2, 11 }, { { 0x65, 0x34 }, 2, 11 }, { { 0x65, 0x35 }, 2, 11 },
+	/* 0x15c */ { { 0x65, 0x36 }, 2, 11 }, { { 0x65, 0x37 }, 2, 11 }, { { 0x65, 0x38 }, 2, 11 }, { { 0x65, 0x39 }, 2, 11 },
+	/* 0x160 */ { { 0x65, 0x3d }, 2, 11 }, { { 0x65, 0x41 }, 2, 11 }, { { 0x65, 0x5f }, 2, 11 }, { { 0x65, 0x62 }, 2, 11 },
+	/* 0x164 */ { { 0x65, 0x64 }, 2, 11 }, { { 0x65, 0x66 }, 2, 11 }, { { 0x65, 0x67 }, 2, 11 }, { { 0x65, 0x68 }, 2, 11 },
+	/* 0x168 */ { { 0x65, 0x6c }, 2, 11 }, { { 0x65, 0x6d }, 2, 11 }, { { 0x65, 0x6e }, 2, 11 }, { { 0x65, 0x70 }, 2, 11 },
+	/* 0x16c */ { { 0x65, 0x72 }, 2, 11 }, { { 0x65, 0x75 }, 2, 11 }, { { 0x65, 0x00 }, 1,  5 }, { { 0x65, 0x00 }, 1,  5 },
+	/* 0x170 */ { { 0x65, 0x00 }, 1,  5 }, { { 0x65, 0x00 }, 1,  5 }, { { 0x65, 0x00 }, 1,  5 }, { { 0x65, 0x00 }, 1,  5 },
+	/* 0x174 */ { { 0x65, 0x00 }, 1,  5 }, { { 0x65, 0x00 }, 1,  5 }, { { 0x65, 0x00 }, 1,  5 }, { { 0x65, 0x00 }, 1,  5 },
+	/* 0x178 */ { { 0x65, 0x00 }, 1,  5 }, { { 0x65, 0x00 }, 1,  5 }, { { 0x65, 0x00 }, 1,  5 }, { { 0x65, 0x00 }, 1,  5 },
+	/* 0x17c */ { { 0x65, 0x00 }, 1,  5 }, { { 0x65, 0x00 }, 1,  5 }, { { 0x65, 0x00 }, 1,  5 }, { { 0x65, 0x00 }, 1,  5 },
+	/* 0x180 */ { { 0x69, 0x30 }, 2, 10 }, { { 0x69, 0x30 }, 2, 10 }, { { 0x69, 0x31 }, 2, 10 }, { { 0x69, 0x31 }, 2, 10 },
+	/* 0x184 */ { { 0x69, 0x32 }, 2, 10 }, { { 0x69, 0x32 }, 2, 10 }, { { 0x69, 0x61 }, 2, 10 }, { { 0x69, 0x61 }, 2, 10 },
+	/* 0x188 */ { { 0x69, 0x63 }, 2, 10 }, { { 0x69, 0x63 }, 2, 10 }, { { 0x69, 0x65 }, 2, 10 }, { { 0x69, 0x65 }, 2, 10 },
+	/* 0x18c */ { { 0x69, 0x69 }, 2, 10 }, { { 0x69, 0x69 }, 2, 10 }, { { 0x69, 0x6f }, 2, 10 }, { { 0x69, 0x6f }, 2, 10 },
+	/* 0x190 */ { { 0x69, 0x73 }, 2, 10 }, { { 0x69, 0x73 }, 2, 10 }, { { 0x69, 0x74 }, 2, 10 }, { { 0x69, 0x74 }, 2, 10 },
+	/* 0x194 */ { { 0x69, 0x20 }, 2, 11 }, { { 0x69, 0x25 }, 2, 11 }, { { 0x69, 0x2d }, 2, 11 }, { { 0x69, 0x2e }, 2, 11 },
+	/* 0x198 */ { { 0x69, 0x2f }, 2, 11 }, { { 0x69, 0x33 }, 2, 11 }, { { 0x69, 0x34 }, 2, 11 }, { { 0x69, 0x35 }, 2, 11 },
+	/* 0x19c */ { { 0x69, 0x36 }, 2, 11 }, { { 0x69, 0x37 }, 2, 11 }, { { 0x69, 0x38 }, 2, 11 }, { { 0x69, 0x39 }, 2, 11 },
+	/* 0x1a0 */ { { 0x69, 0x3d }, 2, 11 }, { { 0x69, 0x41 }, 2, 11 }, { { 0x69, 0x5f }, 2, 11 }, { { 0x69, 0x62 }, 2, 11 },
+	/* 0x1a4 */ { { 0x69, 0x64 }, 2, 11 }, { { 0x69, 0x66 }, 2, 11 }, { { 0x69, 0x67 }, 2, 11 }, { { 0x69, 0x68 }, 2, 11 },
+	/* 0x1a8 */ { { 0x69, 0x6c }, 2, 11 }, { { 0x69, 0x6d }, 2, 11 }, { { 0x69, 0x6e }, 2, 11 }, { { 0x69, 0x70 }, 2, 11 },
+	/* 0x1ac */ { { 0x69, 0x72 }, 2, 11 }, { { 0x69, 0x75 }, 2, 11 }, { { 0x69, 0x00 }, 1,  5 }, { { 0x69, 0x00 }, 1,  5 },
+	/* 0x1b0 */ { { 0x69, 0x00 }, 1,  5 }, { { 0x69, 0x00 }, 1,  5 }, { { 0x69, 0x00 }, 1,  5 }, { { 0x69, 0x00 }, 1,  5 },
+	/* 0x1b4 */ { { 0x69, 0x00 }, 1,  5 }, { { 0x69, 0x00 }, 1,  5 }, { { 0x69, 0x00 }, 1,  5 }, { { 0x69, 0x00 }, 1,  5 },
+	/* 0x1b8 */ { { 0x69, 0x00 }, 1,  5 }, { { 0x69, 0x00 }, 1,  5 }, { { 0x69, 0x00 }, 1,  5 }, { { 0x69, 0x00 }, 1,  5 },
+	/* 0x1bc */ { { 0x69, 0x00 }, 1,  5 }, { { 0x69, 0x00 }, 1,  5 }, { { 0x69, 0x00 }, 1,  5 }, { { 0x69, 0x00 }, 1,  5 },
+	/* 0x1c0 */ { { 0x6f, 0x30 }, 2, 10 }, { { 0x6f, 0x30 }, 2, 10 }, { { 0x6f, 0x31 }, 2, 10 }, { { 0x6f, 0x31 }, 2, 10 },
+	/* 0x1c4 */ { { 0x6f, 0x32 }, 2, 10 }, { { 0x6f, 0x32 }, 2, 10 }, { { 0x6f, 0x61 }, 2, 10 }, { { 0x6f, 0x61 }, 2, 10 },
+	/* 0x1c8 */ { { 0x6f, 0x63 }, 2, 10 }, { { 0x6f, 0x63 }, 2, 10 }, { { 0x6f, 0x65 }, 2, 10 }, { { 0x6f, 0x65 }, 2, 10 },
+	/* 0x1cc */ { { 0x6f, 0x69 }, 2, 10 }, { { 0x6f, 0x69 }, 2, 10 }, { { 0x6f, 0x6f }, 2, 10 }, { { 0x6f, 0x6f }, 2, 10 },
+	/* 0x1d0 */ { { 0x6f, 0x73 }, 2, 10 }, { { 0x6f, 0x73 }, 2, 10 }, { { 0x6f, 0x74 }, 2, 10 }, { { 0x6f, 0x74 }, 2, 10 },
+	/* 0x1d4 */ { { 0x6f, 0x20 }, 2, 11 }, { { 0x6f, 0x25 }, 2, 11 }, { { 0x6f, 0x2d }, 2, 11 }, { { 0x6f, 0x2e }, 2, 11 },
+	/* 0x1d8 */ { { 0x6f, 0x2f }, 2, 11 }, { { 0x6f, 0x33 }, 2, 11 }, { { 0x6f, 0x34 }, 2, 11 }, { { 0x6f, 0x35 }, 2, 11 },
+	/* 0x1dc */ { { 0x6f, 0x36 }, 2, 11 }, { { 0x6f, 0x37 }, 2, 11 }, { { 0x6f, 0x38 }, 2, 11 }, { { 0x6f, 0x39 }, 2, 11 },
+	/* 0x1e0 */ { { 0x6f, 0x3d }, 2, 11 }, { { 0x6f, 0x41 }, 2, 11 }, { { 0x6f, 0x5f }, 2, 11 }, { { 0x6f, 0x62 }, 2, 11 },
+	/* 0x1e4 */ { { 0x6f, 0x64 }, 2, 11 }, { { 0x6f, 0x66 }, 2, 11 }, { { 0x6f, 0x67 }, 2, 11 }, { { 0x6f, 0x68 }, 2, 11 },
+	/* 0x1e8 */ { { 0x6f, 0x6c }, 2, 11 }, { { 0x6f, 0x6d }, 2, 11 }, { { 0x6f, 0x6e }, 2, 11 }, { { 0x6f, 0x70 }, 2, 11 },
+	/* 0x1ec */ { { 0x6f, 0x72 }, 2, 11 }, { { 0x6f, 0x75 }, 2, 11 }, { { 0x6f, 0x00 }, 1,  5 }, { { 0x6f, 0x00 }, 1,  5 },
+	/* 0x1f0 */ { { 0x6f, 0x00 }, 1,  5 }, { { 0x6f, 0x00 }, 1,  5 }, { { 0x6f, 0x00 }, 1,  5 }, { { 0x6f, 0x00 }, 1,  5 },
+	/* 0x1f4 */ { { 0x6f, 0x00 }, 1,  5 }, { { 0x6f, 0x00 }, 1,  5 }, { { 0x6f, 0x00 }, 1,  5 }, { { 0x6f, 0x00 }, 1,  5 },
+	/* 0x1f8 */ { { 0x6f, 0x00 }, 1,  5 }, { { 0x6f, 0x00 }, 1,  5 }, { { 0x6f, 0x00 }, 1,  5 }, { { 0x6f, 0x00 }, 1,  5 },
+	/* 0x1fc */ { { 0x6f, 0x00 }, 1,  5 }, { { 0x6f, 0x00 }, 1,  5 }, { { 0x6f, 0x00 }, 1,  5 }, { { 0x6f, 0x00 }, 1,  5 },
+	/* 0x200 */ { { 0x73, 0x30 }, 2, 10 }, { { 0x73, 0x30 }, 2, 10 }, { { 0x73, 0x31 }, 2, 10 }, { { 0x73, 0x31 }, 2, 10 },
+	/* 0x204 */ { { 0x73, 0x32 }, 2, 10 }, { { 0x73, 0x32 }, 2, 10 }, { { 0x73, 0x61 }, 2, 10 }, { { 0x73, 0x61 }, 2, 10 },
+	/* 0x208 */ { { 0x73, 0x63 }, 2, 10 }, { { 0x73, 0x63 }, 2, 10 }, { { 0x73, 0x65 }, 2, 10 }, { { 0x73, 0x65 }, 2, 10 },
+	/* 0x20c */ { { 0x73, 0x69 }, 2, 10 }, { { 0x73, 0x69 }, 2, 10 }, { { 0x73, 0x6f }, 2, 10 }, { { 0x73, 0x6f }, 2, 10 },
+	/* 0x210 */ { { 0x73, 0x73 }, 2, 10 }, { { 0x73, 0x73 }, 2, 10 }, { { 0x73, 0x74 }, 2, 10 }, { { 0x73, 0x74 }, 2, 10 },
+	/* 0x214 */ { { 0x73, 0x20 }, 2, 11 }, { { 0x73, 0x25 }, 2, 11 }, { { 0x73, 0x2d }, 2, 11 }, { { 0x73, 0x2e }, 2, 11 },
+	/* 0x218 */ { { 0x73, 0x2f }, 2, 11 }, { { 0x73, 0x33 }, 2, 11 }, { { 0x73, 0x34 }, 2, 11 }, { { 0x73, 0x35 }, 2, 11 },
+	/* 0x21c */ { { 0x73, 0x36 }, 2, 11 }, { { 0x73, 0x37 }, 2, 11 }, { { 0x73, 0x38 }, 2, 11 }, { { 0x73, 0x39 }, 2, 11 },
+	/* 0x220 */ { { 0x73, 0x3d }, 2, 11 }, { { 0x73, 0x41 }, 2, 11 }, { { 0x73, 0x5f }, 2, 11 }, { { 0x73, 0x62 }, 2, 11 },
+	/* 0x224 */ { { 0x73, 0x64 }, 2, 11 }, { { 0x73, 0x66 }, 2, 11 }, { { 0x73, 0x67 }, 2, 11 }, { { 0x73, 0x68 }, 2, 11 },
+	/* 0x228 */ { { 0x73, 0x6c }, 2, 11 }, { { 0x73, 0x6d }, 2, 11 }, { { 0x73, 0x6e }, 2, 11 }, { { 0x73, 0x70 }, 2, 11 },
+	/* 0x22c */ { { 0x73, 0x72 }, 2, 11 }, { { 0x73, 0x75 }, 2, 11 }, { { 0x73, 0x00 }, 1,  5 }, { { 0x73, 0x00 }, 1,  5 },
+	/* 0x230 */ { { 0x73, 0x00 }, 1,  5 }, { { 0x73, 0x00 }, 1,  5 }, { { 0x73, 0x00 }, 1,  5 }, { { 0x73, 0x00 }, 1,  5 },
+	/* 0x234 */ { { 0x73, 0x00 }, 1,  5 }, { { 0x73, 0x00 }, 1,  5 }, { { 0x73, 0x00 }, 1,  5 }, { { 0x73, 0x00 }, 1,  5 },
+	/* 0x238 */ { { 0x73, 0x00 }, 1,  5 }, { { 0x73, 0x00 }, 1,  5 }, { { 0x73, 0x00 }, 1,  5 }, { { 0x73, 0x00 }, 1,  5 },
+	/* 0x23c */ { { 0x73, 0x00 }, 1,  5 }, { { 0x73, 0x00 }, 1,  5 }, { { 0x73, 0x00 }, 1,  5 }, { { 0x73, 0x00 }, 1,  5 },
+	/* 0x240 */ { { 0x74, 0x30 }, 2, 10 }, { { 0x74, 0x30 }, 2, 10 }, { { 0x74, 0x31 }, 2, 10 }, { { 0x74, 0x31 }, 2, 10 },
+	/* 0x244 */ { { 0x74, 0x32 }, 2, 10 }, { { 0x74, 0x32 }, 2, 10 }, { { 0x74, 0x61 }, 2, 10 }, { { 0x74, 0x61 }, 2, 10 },
+	/* 0x248 */ { { 0x74, 0x63 }, 2, 10 }, { { 0x74, 0x63 }, 2, 10 }, { { 0x74, 0x65 }, 2, 10 }, { { 0x74, 0x65 }, 2, 10 },
+	/* 0x24c */ { { 0x74, 0x69 }, 2, 10 }, { { 0x74, 0x69 }, 2, 10 }, { { 0x74, 0x6f }, 2, 10 }, { { 0x74, 0x6f }, 2, 10 },
+	/* 0x250 */ { { 0x74, 0x73 }, 2, 10 }, { { 0x74, 0x73 }, 2, 10 }, { { 0x74, 0x74 }, 2, 10 }, { { 0x74, 0x74 }, 2, 10 },
+	/* 0x254 */ { { 0x74, 0x20 }, 2, 11 }, { { 0x74, 0x25 }, 2, 11 }, { { 0x74, 0x2d }, 2, 11 }, { { 0x74, 0x2e }, 2, 11 },
+	/* 0x258 */ { { 0x74, 0x2f }, 2, 11 }, { { 0x74, 0x33 }, 2, 11 }, { { 0x74, 0x34 }, 2, 11 }, { { 0x74, 0x35 }, 2, 11 },
+	/* 0x25c */ { { 0x74, 0x36 }, 2, 11 }, { { 0x74, 0x37 }, 2, 11 }, { { 0x74, 0x38 }, 2, 11 }, { { 0x74, 0x39 }, 2, 11 },
+	/* 0x260 */ { { 0x74, 0x3d }, 2, 11 }, { { 0x74, 0x41 }, 2, 11 }, { { 0x74, 0x5f }, 2, 11 }, { { 0x74, 0x62 }, 2, 11 },
+	/* 0x264 */ { { 0x74, 0x64 }, 2, 11 }, { { 0x74, 0x66 }, 2, 11 }, { { 0x74, 0x67 }, 2, 11 }, { { 0x74, 0x68 }, 2, 11 },
+	/* 0x268 */ { { 0x74, 0x6c }, 2, 11 }, { { 0x74, 0x6d }, 2, 11 }, { { 0x74, 0x6e }, 2, 11 }, { { 0x74, 0x70 }, 2, 11 },
+	/* 0x26c */ { { 0x74, 0x72 }, 2, 11 }, { { 0x74, 0x75 }, 2, 11 }, { { 0x74, 0x00 }, 1,  5 }, { { 0x74, 0x00 }, 1,  5 },
+	/* 0x270 */ { { 0x74, 0x00 }, 1,  5 }, { { 0x74, 0x00 }, 1,  5 }, { { 0x74, 0x00 }, 1,  5 }, { { 0x74, 0x00 }, 1,  5 },
+	/* 0x274 */ { { 0x74, 0x00 }, 1,  5 }, { { 0x74, 0x00 }, 1,  5 }, { { 0x74, 0x00 }, 1,  5 }, { { 0x74, 0x00 }, 1,  5 },
+	/* 0x278 */ { { 0x74, 0x00 }, 1,  5 }, { { 0x74, 0x00 }, 1,  5 }, { { 0x74, 0x00 }, 1,  5 }, { { 0x74, 0x00 }, 1,  5 },
+	/* 0x27c */ { { 0x74, 0x00 }, 1,  5 }, { { 0x74, 0x00 }, 1,  5 }, { { 0x74, 0x00 }, 1,  5 }, { { 0x74, 0x00 }, 1,  5 },
+	/* 0x280 */ { { 0x20, 0x30 }, 2, 11 }, { { 0x20, 0x31 }, 2, 11 }, { { 0x20, 0x32 }, 2, 11 }, { { 0x20, 0x61 }, 2, 11 },
+	/* 0x284 */ { { 0x20, 0x63 }, 2, 11 }, { { 0x20, 0x65 }, 2, 11 }, { { 0x20, 0x69 }, 2, 11 }, { { 0x20, 0x6f }, 2, 11 },
+	/* 0x288 */ { { 0x20, 0x73 }, 2, 11 }, { { 0x20, 0x74 }, 2, 11 }, { { 0x20, 0x00 }, 1,  6 }, { { 0x20, 0x00 }, 1,  6 },
+	/* 0x28c */ { { 0x20, 0x00 }, 1,  6 }, { { 0x20, 0x00 }, 1,  6 }, { { 0x20, 0x00 }, 1,  6 }, { { 0x20, 0x00 }, 1,  6 },
+	/* 0x290 */ { { 0x20, 0x00 }, 1,  6 }, { { 0x20, 0x00 }, 1,  6 }, { { 0x20, 0x00 }, 1,  6 }, { { 0x20, 0x00 }, 1,  6 },
+	/* 0x294 */ { { 0x20, 0x00 }, 1,  6 }, { { 0x20, 0x00 }, 1,  6 }, { { 0x20, 0x00 }, 1,  6 }, { { 0x20, 0x00 }, 1,  6 },
+	/* 0x298 */ { { 0x20, 0x00 }, 1,  6 }, { { 0x20, 0x00 }, 1,  6 }, { { 0x20, 0x00 }, 1,  6 }, { { 0x20, 0x00 }, 1,  6 },
+	/* 0x29c */ { { 0x20, 0x00 }, 1,  6 }, { { 0x20, 0x00 }, 1,  6 }, { { 0x20, 0x00 }, 1,  6 }, { { 0x20, 0x00 }, 1,  6 },
+	/* 0x2a0 */ { { 0x25, 0x30 }, 2, 11 }, { { 0x25, 0x31 }, 2, 11 }, { { 0x25, 0x32 }, 2, 11 }, { { 0x25, 0x61 }, 2, 11 },
+	/* 0x2a4 */ { { 0x25, 0x63 }, 2, 11 }, { { 0x25, 0x65 }, 2, 11 }, { { 0x25, 0x69 }, 2, 11 }, { { 0x25, 0x6f }, 2, 11 },
+	/* 0x2a8 */ { { 0x25, 0x73 }, 2, 11 }, { { 0x25, 0x74 }, 2, 11 }, { { 0x25, 0x00 }, 1,  6 }, { { 0x25, 0x00 }, 1,  6 },
+	/* 0x2ac */ { { 0x25, 0x00 }, 1,  6 }, { { 0x25, 0x00 }, 1,  6 }, { { 0x25, 0x00 }, 1,  6 }, { { 0x25, 0x00 }, 1,  6 },
+	/* 0x2b0 */ { { 0x25, 0x00 }, 1,  6 }, { { 0x25, 0x00 }, 1,  6 }, { { 0x25, 0x00 }, 1,  6 }, { { 0x25, 0x00 }, 1,  6 },
+	/* 0x2b4 */ { { 0x25, 0x00 }, 1,  6 }, { { 0x25, 0x00 }, 1,  6 }, { { 0x25, 0x00 }, 1,  6 }, { { 0x25, 0x00 }, 1,  6 },
+	/* 0x2b8 */ { { 0x25, 0x00 }, 1,  6 }, { { 0x25, 0x00 }, 1,  6 }, { { 0x25, 0x00 }, 1,  6 }, { { 0x25, 0x00 }, 1,  6 },
+	/* 0x2bc */ { { 0x25, 0x00 }, 1,  6 }, { { 0x25, 0x00 }, 1,  6 }, { { 0x25, 0x00 }, 1,  6 }, { { 0x25, 0x00 }, 1,  6 },
+	/* 0x2c0 */ { { 0x2d, 0x30 }, 2, 11 }, { { 0x2d, 0x31 }, 2, 11 }, { { 0x2d, 0x32 }, 2, 11 }, { { 0x2d, 0x61 }, 2, 11 },
+	/* 0x2c4 */ { { 0x2d, 0x63 }, 2, 11 }, { { 0x2d, 0x65 }, 2, 11 }, { { 0x2d, 0x69 }, 2, 11 }, { { 0x2d, 0x6f }, 2, 11 },
+	/* 0x2c8 */ { { 0x2d, 0x73 }, 2, 11 }, { { 0x2d, 0x74 }, 2, 11 }, { { 0x2d, 0x00 }, 1,  6 }, { { 0x2d, 0x00 }, 1,  6 },
+	/* 0x2cc */ { { 0x2d, 0x00 }, 1,  6 }, { { 0x2d, 0x00 }, 1,  6 }, { { 0x2d, 0x00 }, 1,  6 }, { { 0x2d, 0x00 }, 1,  6 },
+	/* 0x2d0 */ { { 0x2d, 0x00 }, 1,  6 }, { { 0x2d, 0x00 }, 1,  6 }, { { 0x2d, 0x00 }, 1,  6 }, { { 0x2d, 0x00 }, 1,  6 },
+	/* 0x2d4 */ { { 0x2d, 0x00 }, 1,  6 }, { { 0x2d, 0x00 }, 1,  6 }, { { 0x2d, 0x00 }, 1,  6 }, { { 0x2d, 0x00 }, 1,  6 },
+	/* 0x2d8 */ { { 0x2d, 0x00 }, 1,  6 }, { { 0x2d, 0x00 }, 1,  6 }, { { 0x2d, 0x00 }, 1,  6 }, { { 0x2d, 0x00 }, 1,  6 },
+	/* 0x2dc */ { { 0x2d, 0x00 }, 1,  6 }, { { 0x2d, 0x00 }, 1,  6 }, { { 0x2d, 0x00 }, 1,  6 }, { { 0x2d, 0x00 }, 1,  6 },
+	/* 0x2e0 */ { { 0x2e, 0x30 }, 2, 11 }, { { 0x2e, 0x31 }, 2, 11 }, { { 0x2e, 0x32 }, 2, 11 }, { { 0x2e, 0x61 }, 2, 11 },
+	/* 0x2e4 */ { { 0x2e, 0x63 }, 2, 11 }, { { 0x2e, 0x65 }, 2, 11 }, { { 0x2e, 0x69 }, 2, 11 }, { { 0x2e, 0x6f }, 2, 11 },
+	/* 0x2e8 */ { { 0x2e, 0x73 }, 2, 11 }, { { 0x2e, 0x74 }, 2, 11 }, { { 0x2e, 0x00 }, 1,  6 }, { { 0x2e, 0x00 }, 1,  6 },
+	/* 0x2ec */ { { 0x2e, 0x00 }, 1,  6 }, { { 0x2e, 0x00 }, 1,  6 }, { { 0x2e, 0x00 }, 1,  6 }, { { 0x2e, 0x00 }, 1,  6 },
+	/* 0x2f0 */ { { 0x2e, 0x00 }, 1,  6 }, { { 0x2e, 0x00 }, 1,  6 }, { { 0x2e, 0x00 }, 1,  6 }, { { 0x2e, 0x00 }, 1,  6 },
+	/* 0x2f4 */ { { 0x2e, 0x00 }, 1,  6 }, { { 0x2e, 0x00 }, 1,  6 }, { { 0x2e, 0x00 }, 1,  6 }, { { 0x2e, 0x00 }, 1,  6 },
+	/* 0x2f8 */ { { 0x2e, 0x00 }, 1,  6 }, { { 0x2e, 0x00 }, 1,  6 }, { { 0x2e, 0x00 }, 1,  6 }, { { 0x2e, 0x00 }, 1,  6 },
+	/* 0x2fc */ { { 0x2e, 0x00 }, 1,  6 }, { { 0x2e, 0x00 }, 1,  6 }, { { 0x2e, 0x00 }, 1,  6 }, { { 0x2e, 0x00 }, 1,  6 },
+	/* 0x300 */ { { 0x2f, 0x30 }, 2, 11 }, { { 0x2f, 0x31 }, 2, 11 }, { { 0x2f, 0x32 }, 2, 11 }, { { 0x2f, 0x61 }, 2, 11 },
+	/* 0x304 */ { { 0x2f, 0x63 }, 2, 11 }, { { 0x2f, 0x65 }, 2, 11 }, { { 0x2f, 0x69 }, 2, 11 }, { { 0x2f, 0x6f }, 2, 11 },
+	/* 0x308 */ { { 0x2f, 0x73 }, 2, 11 }, { { 0x2f, 0x74 }, 2, 11 }, { { 0x2f, 0x00 }, 1,  6 }, { { 0x2f, 0x00 }, 1,  6 },
+	/* 0x30c */ { { 0x2f, 0x00 }, 1,  6 }, { { 0x2f, 0x00 }, 1,  6 }, { { 0x2f, 0x00 }, 1,  6 }, { { 0x2f, 0x00 }, 1,  6 },
+	/* 0x310 */ { { 0x2f, 0x00 }, 1,  6 }, { { 0x2f, 0x00 }, 1,  6 }, { { 0x2f, 0x00 }, 1,  6 }, { { 0x2f, 0x00 }, 1,  6 },
+	/* 0x314 */ { { 0x2f, 0x00 }, 1,  6 }, { { 0x2f, 0x00 }, 1,  6 }, { { 0x2f, 0x00 }, 1,  6 }, { { 0x2f, 0x00 }, 1,  6 },
+	/* 0x318 */ { { 0x2f, 0x00 }, 1,  6 }, { { 0x2f, 0x00 }, 1,  6 }, { { 0x2f, 0x00 }, 1,  6 }, { { 0x2f, 0x00 }, 1,  6 },
+	/* 0x31c */ { { 0x2f, 0x00 }, 1,  6 }, { { 0x2f, 0x00 }, 1,  6 }, { { 0x2f, 0x00 }, 1,  6 }, { { 0x2f, 0x00 }, 1,  6 },
+	/* 0x320 */ { { 0x33, 0x30 }, 2, 11 }, { { 0x33, 0x31 }, 2, 11 }, { { 0x33, 0x32 }, 2, 11 }, { { 0x33, 0x61 }, 2, 11 },
+	/* 0x324 */ { { 0x33, 0x63 }, 2, 11 }, { { 0x33, 0x65 }, 2, 11 }, { { 0x33, 0x69 }, 2, 11 }, { { 0x33, 0x6f }, 2, 11 },
+	/* 0x328 */ { { 0x33, 0x73 }, 2, 11 }, { { 0x33, 0x74 }, 2, 11 }, { { 0x33, 0x00 }, 1,  6 }, { { 0x33, 0x00 }, 1,  6 },
+	/* 0x32c */ { { 0x33, 0x00 }, 1,  6 }, { { 0x33, 0x00 }, 1,  6 }, { { 0x33, 0x00 }, 1,  6 }, { { 0x33, 0x00 }, 1,  6 },
+	/* 0x330 */ { { 0x33, 0x00 }, 1,  6 }, { { 0x33, 0x00 }, 1,  6 }, { { 0x33, 0x00 }, 1,  6 }, { { 0x33, 0x00 }, 1,  6 },
+	/* 0x334 */ { { 0x33, 0x00 }, 1,  6 }, { { 0x33, 0x00 }, 1,  6 }, { { 0x33, 0x00 }, 1,  6 }, { { 0x33, 0x00 }, 1,  6 },
+	/* 0x338 */ { { 0x33, 0x00 }, 1,  6 }, { { 0x33, 0x00 }, 1,  6 }, { { 0x33, 0x00 }, 1,  6 }, { { 0x33, 0x00 }, 1,  6 },
+	/* 0x33c */ { { 0x33, 0x00 }, 1,  6 }, { { 0x33, 0x00 }, 1,  6 }, { { 0x33, 0x00 }, 1,  6 }, { { 0x33, 0x00 }, 1,  6 },
+	/* 0x340 */ { { 0x34, 0x30 }, 2, 11 }, { { 0x34, 0x31 }, 2, 11 }, { { 0x34, 0x32 }, 2, 11 }, { { 0x34, 0x61 }, 2, 11 },
+	/* 0x344 */ { { 0x34, 0x63 }, 2, 11 }, { { 0x34, 0x65 }, 2, 11 }, { { 0x34, 0x69 }, 2, 11 }, { { 0x34, 0x6f }, 2, 11 },
+	/* 0x348 */ { { 0x34, 0x73 }, 2, 11 }, { { 0x34, 0x74 }, 2, 11 }, { { 0x34, 0x00 }, 1,  6 }, { { 0x34, 0x00 }, 1,  6 },
+	/* 0x34c */ { { 0x34, 0x00 }, 1,  6 }, { { 0x34, 0x00 }, 1,  6 }, { { 0x34, 0x00 }, 1,  6 }, { { 0x34, 0x00 }, 1,  6 },
+	/* 0x350 */ { { 0x34, 0x00 }, 1,  6 }, { { 0x34, 0x00 }, 1,  6 }, { { 0x34, 0x00 }, 1,  6 }, { { 0x34, 0x00 }, 1,  6 },
+	/* 0x354 */ { { 0x34, 0x00 }, 1,  6 }, { { 0x34, 0x00 }, 1,  6 }, { { 0x34, 0x00 }, 1,  6 }, { { 0x34, 0x00 }, 1,  6 },
+	/* 0x358 */ { { 0x34, 0x00 }, 1,  6 }, { { 0x34, 0x00 }, 1,  6 }, { { 0x34, 0x00 }, 1,  6 }, { { 0x34, 0x00 }, 1,  6 },
+	/* 0x35c */ { { 0x34, 0x00 }, 1,  6 }, { { 0x34, 0x00 }, 1,  6 }, { { 0x34, 0x00 }, 1,  6 }, { { 0x34, 0x00 }, 1,  6 },
+	/* 0x360 */ { { 0x35, 0x30 }, 2, 11 }, { { 0x35, 0x31 }, 2, 11 }, { { 0x35, 0x32 }, 2, 11 }, { { 0x35, 0x61 }, 2, 11 },
+	/* 0x364 */ { { 0x35, 0x63 }, 2, 11 }, { { 0x35, 0x65 }, 2, 11 }, { { 0x35, 0x69 }, 2, 11 }, { { 0x35, 0x6f }, 2, 11 },
+	/* 0x368 */ { { 0x35, 0x73 }, 2, 11 }, { { 0x35, 0x74 }, 2, 11 }, { { 0x35, 0x00 }, 1,  6 }, { { 0x35, 0x00 }, 1,  6 },
+	/* 0x36c */ { { 0x35, 0x00 }, 1,  6 }, { { 0x35, 0x00 }, 1,  6 }, { { 0x35, 0x00 }, 1,  6 }, { { 0x35, 0x00 }, 1,  6 },
+	/* 0x370 */ { { 0x35, 0x00 }, 1,  6 }, { { 0x35, 0x00 }, 1,  6 }, { { 0x35, 0x00 }, 1,  6 }, { { 0x35, 0x00 }, 1,  6 },
+	/* 0x374 */ { { 0x35, 0x00 }, 1,  6 }, { { 0x35, 0x00 }, 1,  6 }, { { 0x35, 0x00 }, 1,  6 }, { { 0x35, 0x00 }, 1,  6 },
+	/* 0x378 */ { { 0x35, 0x00 }, 1,  6 }, { { 0x35, 0x00 }, 1,  6 }, { { 0x35, 0x00 }, 1,  6 }, { { 0x35, 0x00 }, 1,  6 },
+	/* 0x37c */ { { 0x35, 0x00 }, 1,  6 }, { { 0x35, 0x00 }, 1,  6 }, { { 0x35, 0x00 }, 1,  6 }, { { 0x35, 0x00 }, 1,  6 },
+	/* 0x380 */ { { 0x36, 0x30 }, 2, 11 }, { { 0x36, 0x31 }, 2, 11 }, { { 0x36, 0x32 }, 2, 11 }, { { 0x36, 0x61 }, 2, 11 },
+	/* 0x384 */ { { 0x36, 0x63 }, 2, 11 }, { { 0x36, 0x65 }, 2, 11 }, { { 0x36, 0x69 }, 2, 11 }, { { 0x36, 0x6f }, 2, 11 },
+	/* 0x388 */ { { 0x36, 0x73 }, 2, 11 }, { { 0x36, 0x74 }, 2, 11 }, { { 0x36, 0x00 }, 1,  6 }, { { 0x36, 0x00 }, 1,  6 },
+	/* 0x38c */ { { 0x36, 0x00 }, 1,  6 }, { { 0x36, 0x00 }, 1,  6 }, { { 0x36, 0x00 }, 1,  6 }, { { 0x36, 0x00 }, 1,  6 },
+	/* 0x390 */ { { 0x36, 0x00 }, 1,  6 }, { { 0x36, 0x00 }, 1,  6 }, { { 0x36, 0x00 }, 1,  6 }, { { 0x36, 0x00 }, 1,  6 },
+	/* 0x394 */ { { 0x36, 0x00 }, 1,  6 }, { { 0x36, 0x00 }, 1,  6 }, { { 0x36, 0x00 }, 1,  6 }, { { 0x36, 0x00 }, 1,  6 },
+	/* 0x398 */ { { 0x36, 0x00 }, 1,  6 }, { { 0x36, 0x00 }, 1,  6 }, { { 0x36, 0x00 }, 1,  6 }, { { 0x36, 0x00 }, 1,  6 },
+	/* 0x39c */ { { 0x36, 0x00 }, 1,  6 }, { { 0x36, 0x00 }, 1,  6 }, { { 0x36, 0x00 }, 1,  6 }, { { 0x36, 0x00 }, 1,  6 },
+	/* 0x3a0 */ { { 0x37, 0x30 }, 2, 11 }, { { 0x37, 0x31 }, 2, 11 }, { { 0x37, 0x32 }, 2, 11 }, { { 0x37, 0x61 }, 2, 11 },
+	/* 0x3a4 */ { { 0x37, 0x63 }, 2, 11 }, { { 0x37, 0x65 }, 2, 11 }, { { 0x37, 0x69 }, 2, 11 }, { { 0x37, 0x6f }, 2, 11 },
+	/* 0x3a8 */ { { 0x37, 0x73 }, 2, 11 }, { { 0x37, 0x74 }, 2, 11 }, { { 0x37, 0x00 }, 1,  6 }, { { 0x37, 0x00 }, 1,  6 },
+	/* 0x3ac */ { { 0x37, 0x00 }, 1,  6 }, { { 0x37, 0x00 }, 1,  6 }, { { 0x37, 0x00 }, 1,  6 }, { { 0x37, 0x00 }, 1,  6 },
+	/* 0x3b0 */ { { 0x37, 0x00 }, 1,  6 }, { { 0x37, 0x00 }, 1,  6 }, { { 0x37, 0x00 }, 1,  6 }, { { 0x37, 0x00 }, 1,  6 },
+	/* 0x3b4 */ { { 0x37, 0x00 }, 1,  6 }, { { 0x37, 0x00 }, 1,  6 }, { { 0x37, 0x00 }, 1,  6 }, { { 0x37, 0x00 }, 1,  6 },
+	/* 0x3b8 */ { { 0x37, 0x00 }, 1,  6 }, { { 0x37, 0x00 }, 1,  6 }, { { 0x37, 0x00 }, 1,  6 }, { { 0x37, 0x00 }, 1,  6 },
+	/* 0x3bc */ { { 0x37, 0x00 }, 1,  6 }, { { 0x37, 0x00 }, 1,  6 }, { { 0x37, 0x00 }, 1,  6 }, { { 0x37, 0x00 }, 1,  6 },
+	/* 0x3c0 */ { { 0x38, 0x30 }, 2, 11 }, { { 0x38, 0x31 }, 2, 11 }, { { 0x38, 0x32 }, 2, 11 }, { { 0x38, 0x61 }, 2, 11 },
+	/* 0x3c4 */ { { 0x38, 0x63 }, 2, 11 }, { { 0x38, 0x65 }, 2, 11 }, { { 0x38, 0x69 }, 2, 11 }, { { 0x38, 0x6f }, 2, 11 },
+	/* 0x3c8 */ { { 0x38, 0x73 }, 2, 11 }, { { 0x38, 0x74 }, 2, 11 }, { { 0x38, 0x00 }, 1,  6 }, { { 0x38, 0x00 }, 1,  6 },
+	/* 0x3cc */ { { 0x38, 0x00 }, 1,  6 }, { { 0x38, 0x00 }, 1,  6 }, { { 0x38, 0x00 }, 1,  6 }, { { 0x38, 0x00 }, 1,  6 },
+	/* 0x3d0 */ { { 0x38, 0x00 }, 1,  6 }, { { 0x38, 0x00 }, 1,  6 }, { { 0x38, 0x00 }, 1,  6 }, { { 0x38, 0x00 }, 1,  6 },
+	/* 0x3d4 */ { { 0x38, 0x00 }, 1,  6 }, { { 0x38, 0x00 }, 1,  6 }, { { 0x38, 0x00 }, 1,  6 }, { { 0x38, 0x00 }, 1,  6 },
+	/* 0x3d8 */ { { 0x38, 0x00 }, 1,  6 }, { { 0x38, 0x00 }, 1,  6 }, { { 0x38, 0x00 }, 1,  6 }, { { 0x38, 0x00 }, 1,  6 },
+	/* 0x3dc */ { { 0x38, 0x00 }, 1,  6 }, { { 0x38, 0x00 }, 1,  6 }, { { 0x38, 0x00 }, 1,  6 }, { { 0x38, 0x00 }, 1,  6 },
+	/* 0x3e0 */ { { 0x39, 0x30 }, 2, 11 }, { { 0x39, 0x31 }, 2, 11 }, { { 0x39, 0x32 }, 2, 11 }, { { 0x39, 0x61 }, 2, 11 },
+	/* 0x3e4 */ { { 0x39, 0x63 }, 2, 11 }, { { 0x39, 0x65 }, 2, 11 }, { { 0x39, 0x69 }, 2, 11 }, { { 0x39, 0x6f }, 2, 11 },
+	/* 0x3e8 */ { { 0x39, 0x73 }, 2, 11 }, { { 0x39, 0x74 }, 2, 11 }, { { 0x39, 0x00 }, 1,  6 }, { { 0x39, 0x00 }, 1,  6 },
+	/* 0x3ec */ { { 0x39, 0x00 }, 1,  6 }, { { 0x39, 0x00 }, 1,  6 }, { { 0x39, 0x00 }, 1,  6 }, { { 0x39, 0x00 }, 1,  6 },
+	/* 0x3f0 */ { { 0x39, 0x00 }, 1,  6 }, { { 0x39, 0x00 }, 1,  6 }, { { 0x39, 0x00 }, 1,  6 }, { { 0x39, 0x00 }, 1,  6 },
+	/* 0x3f4 */ { { 0x39, 0x00 }, 1,  6 }, { { 0x39, 0x00 }, 1,  6 }, { { 0x39, 0x00 }, 1,  6 }, { { 0x39, 0x00 }, 1,  6 },
+	/* 0x3f8 */ { { 0x39, 0x00 }, 1,  6 }, { { 0x39, 0x00 }, 1,  6 }, { { 0x39, 0x00 }, 1,  6 }, { { 0x39, 0x00 }, 1,  6 },
+	/* 0x3fc */ { { 0x39, 0x00 }, 1,  6 }, { { 0x39, 0x00 }, 1,  6 }, { { 0x39, 0x00 }, 1,  6 }, { { 0x39, 0x00 }, 1,  6 },
+	/* 0x400 */ { { 0x3d, 0x30 }, 2, 11 }, { { 0x3d, 0x31 }, 2, 11 }, { { 0x3d, 0x32 }, 2, 11 }, { { 0x3d, 0x61 }, 2, 11 },
+	/* 0x404 */ { { 0x3d, 0x63 }, 2, 11 }, { { 0x3d, 0x65 }, 2, 11 }, { { 0x3d, 0x69 }, 2, 11 }, { { 0x3d, 0x6f }, 2, 11 },
+	/* 0x408 */ { { 0x3d, 0x73 }, 2, 11 }, { { 0x3d, 0x74 }, 2, 11 }, { { 0x3d, 0x00 }, 1,  6 }, { { 0x3d, 0x00 }, 1,  6 },
+	/* 0x40c */ { { 0x3d, 0x00 }, 1,  6 }, { { 0x3d, 0x00 }, 1,  6 }, { { 0x3d, 0x00 }, 1,  6 }, { { 0x3d, 0x00 }, 1,  6 },
+	/* 0x410 */ { { 0x3d, 0x00 }, 1,  6 }, { { 0x3d, 0x00 }, 1,  6 }, { { 0x3d, 0x00 }, 1,  6 }, { { 0x3d, 0x00 }, 1,  6 },
+	/* 0x414 */ { { 0x3d, 0x00 }, 1,  6 }, { { 0x3d, 0x00 }, 1,  6 }, { { 0x3d, 0x00 }, 1,  6 }, { { 0x3d, 0x00 }, 1,  6 },
+	/* 0x418 */ { { 0x3d, 0x00 }, 1,  6 }, { { 0x3d, 0x00 }, 1,  6 }, { { 0x3d, 0x00 }, 1,  6 }, { { 0x3d, 0x00 }, 1,  6 },
+	/* 0x41c */ { { 0x3d, 0x00 }, 1,  6 }, { { 0x3d, 0x00 }, 1,  6 }, { { 0x3d, 0x00 }, 1,  6 }, { { 0x3d, 0x00 }, 1,  6 },
+	/* 0x420 */ { { 0x41, 0x30 }, 2, 11 }, { { 0x41, 0x31 }, 2, 11 }, { { 0x41, 0x32 }, 2, 11 }, { { 0x41, 0x61 }, 2, 11 },
+	/* 0x424 */ { { 0x41, 0x63 }, 2, 11 }, { { 0x41, 0x65 }, 2, 11 }, { { 0x41, 0x69 }, 2, 11 }, { { 0x41, 0x6f }, 2, 11 },
+	/* 0x428 */ { { 0x41, 0x73 }, 2, 11 }, { { 0x41, 0x74 }, 2, 11 }, { { 0x41, 0x00 }, 1,  6 }, { { 0x41, 0x00 }, 1,  6 },
+	/* 0x42c */ { { 0x41, 0x00 }, 1,  6 }, { { 0x41, 0x00 }, 1,  6 }, { { 0x41, 0x00 }, 1,  6 }, { { 0x41, 0x00 }, 1,  6 },
+	/* 0x430 */ { { 0x41, 0x00 }, 1,  6 }, { { 0x41, 0x00 }, 1,  6 }, { { 0x41, 0x00 }, 1,  6 }, { { 0x41, 0x00 }, 1,  6 },
+	/* 0x434 */ { { 0x41, 0x00 }, 1,  6 }, { { 0x41, 0x00 }, 1,  6 }, { { 0x41, 0x00 }, 1,  6 }, { { 0x41, 0x00 }, 1,  6 },
+	/* 0x438 */ { { 0x41, 0x00 }, 1,  6 }, { { 0x41, 0x00 }, 1,  6 }, { { 0x41, 0x00 }, 1,  6 }, { { 0x41, 0x00 }, 1,  6 },
+	/* 0x43c */ { { 0x41, 0x00 }, 1,  6 }, { { 0x41, 0x00 }, 1,  6 }, { { 0x41, 0x00 }, 1,  6 }, { { 0x41, 0x00 }, 1,  6 },
+	/* 0x440 */ { { 0x5f, 0x30 }, 2, 11 }, { { 0x5f, 0x31 }, 2, 11 }, { { 0x5f, 0x32 }, 2, 11 }, { { 0x5f, 0x61 }, 2, 11 },
+	/* 0x444 */ { { 0x5f, 0x63 }, 2, 11 }, { { 0x5f, 0x65 }, 2, 11 }, { { 0x5f, 0x69 }, 2, 11 }, { { 0x5f, 0x6f }, 2, 11 },
+	/* 0x448 */ { { 0x5f, 0x73 }, 2, 11 }, { { 0x5f, 0x74 }, 2, 11 }, { { 0x5f, 0x00 }, 1,  6 }, { { 0x5f, 0x00 }, 1,  6 },
+	/* 0x44c */ { { 0x5f, 0x00 }, 1,  6 }, { { 0x5f, 0x00 }, 1,  6 }, { { 0x5f, 0x00 }, 1,  6 }, { { 0x5f, 0x00 }, 1,  6 },
+	/* 0x450 */ { { 0x5f, 0x00 }, 1,  6 }, { { 0x5f, 0x00 }, 1,  6 }, { { 0x5f, 0x00 }, 1,  6 }, { { 0x5f, 0x00 }, 1,  6 },
+	/* 0x454 */ { { 0x5f, 0x00 }, 1,  6 }, { { 0x5f, 0x00 }, 1,  6 }, { { 0x5f, 0x00 }, 1,  6 }, { { 0x5f, 0x00 }, 1,  6 },
+	/* 0x458 */ { { 0x5f, 0x00 }, 1,  6 }, { { 0x5f, 0x00 }, 1,  6 }, { { 0x5f, 0x00 }, 1,  6 }, { { 0x5f, 0x00 }, 1,  6 },
+	/* 0x45c */ { { 0x5f, 0x00 }, 1,  6 }, { { 0x5f, 0x00 }, 1,  6 }, { { 0x5f, 0x00 }, 1,  6 }, { { 0x5f, 0x00 }, 1,  6 },
+	/* 0x460 */ { { 0x62, 0x30 }, 2, 11 }, { { 0x62, 0x31 }, 2, 11 }, { { 0x62, 0x32 }, 2, 11 }, { { 0x62, 0x61 }, 2, 11 },
+	/* 0x464 */ { { 0x62, 0x63 }, 2, 11 }, { { 0x62, 0x65 }, 2, 11 }, { { 0x62, 0x69 }, 2, 11 }, { { 0x62, 0x6f }, 2, 11 },
+	/* 0x468 */ { { 0x62, 0x73 }, 2, 11 }, { { 0x62, 0x74 }, 2, 11 }, { { 0x62, 0x00 }, 1,  6 }, { { 0x62, 0x00 }, 1,  6 },
+	/* 0x46c */ { { 0x62, 0x00 }, 1,  6 }, { { 0x62, 0x00 }, 1,  6 }, { { 0x62, 0x00 }, 1,  6 }, { { 0x62, 0x00 }, 1,  6 },
+	/* 0x470 */ { { 0x62, 0x00 }, 1,  6 }, { { 0x62, 0x00 }, 1,  6 }, { { 0x62, 0x00 }, 1,  6 }, { { 0x62, 0x00 }, 1,  6 },
+	/* 0x474 */ { { 0x62, 0x00 }, 1,  6 }, { { 0x62, 0x00 }, 1,  6 }, { { 0x62, 0x00 }, 1,  6 }, { { 0x62, 0x00 }, 1,  6 },
+	/* 0x478 */ { { 0x62, 0x00 }, 1,  6 }, { { 0x62, 0x00 }, 1,  6 }, { { 0x62, 0x00 }, 1,  6 }, { { 0x62, 0x00 }, 1,  6 },
+	/* 0x47c */ { { 0x62, 0x00 }, 1,  6 }, { { 0x62, 0x00 }, 1,  6 }, { { 0x62, 0x00 }, 1,  6 }, { { 0x62, 0x00 }, 1,  6 },
+	/* 0x480 */ { { 0x64, 0x30 }, 2, 11 }, { { 0x64, 0x31 }, 2, 11 }, { { 0x64, 0x32 }, 2, 11 }, { { 0x64, 0x61 }, 2, 11 },
+	/* 0x484 */ { { 0x64, 0x63 }, 2, 11 }, { { 0x64, 0x65 }, 2, 11 }, { { 0x64, 0x69 }, 2, 11 }, { { 0x64, 0x6f }, 2, 11 },
+	/* 0x488 */ { { 0x64, 0x73 }, 2, 11 }, { { 0x64, 0x74 }, 2, 11 }, { { 0x64, 0x00 }, 1,  6 }, { { 0x64, 0x00 }, 1,  6 },
+	/* 0x48c */ { { 0x64, 0x00 }, 1,  6 }, { { 0x64, 0x00 }, 1,  6 }, { { 0x64, 0x00 }, 1,  6 }, { { 0x64, 0x00 }, 1,  6 },
+	/* 0x490 */ { { 0x64, 0x00 }, 1,  6 }, { { 0x64, 0x00 }, 1,  6 }, { { 0x64, 0x00 }, 1,  6 }, { { 0x64, 0x00 }, 1,  6 },
+	/* 0x494 */ { { 0x64, 0x00 }, 1,  6 }, { { 0x64, 0x00 }, 1,  6 }, { { 0x64, 0x00 }, 1,  6 }, { { 0x64, 0x00 }, 1,  6 },
+	/* 0x498 */ { { 0x64, 0x00 }, 1,  6 }, { { 0x64, 0x00 }, 1,  6 }, { { 0x64, 0x00 }, 1,  6 }, { { 0x64, 0x00 }, 1,  6 },
+	/* 0x49c */ { { 0x64, 0x00 }, 1,  6 }, { { 0x64, 0x00 }, 1,  6 }, { { 0x64, 0x00 }, 1,  6 }, { { 0x64, 0x00 }, 1,  6 },
+	/* 0x4a0 */ { { 0x66, 0x30 }, 2, 11 }, { { 0x66, 0x31 }, 2, 11 }, { { 0x66, 0x32 }, 2, 11 }, { { 0x66, 0x61 }, 2, 11 },
+	/* 0x4a4 */ { { 0x66, 0x63 }, 2, 11 }, { { 0x66, 0x65 }, 2, 11 }, { { 0x66, 0x69 }, 2, 11 }, { { 0x66, 0x6f }, 2, 11 },
+	/* 0x4a8 */ { { 0x66, 0x73 }, 2, 11 }, { { 0x66, 0x74 }, 2, 11 }, { { 0x66, 0x00 }, 1,  6 }, { { 0x66, 0x00 }, 1,  6 },
+	/* 0x4ac */ { { 0x66, 0x00 }, 1,  6 }, { { 0x66, 0x00 }, 1,  6 }, { { 0x66, 0x00 }, 1,  6 }, { { 0x66, 0x00 }, 1,  6 },
+	/* 0x4b0 */ { { 0x66, 0x00 }, 1,  6 }, { { 0x66, 0x00 }, 1,  6 }, { { 0x66, 0x00 }, 1,  6 }, { { 0x66, 0x00 }, 1,  6 },
+	/* 0x4b4 */ { { 0x66, 0x00 }, 1,  6 }, { { 0x66, 0x00 }, 1,  6 }, { { 0x66, 0x00 }, 1,  6 }, { { 0x66, 0x00 }, 1,  6 },
+	/* 0x4b8 */ { { 0x66, 0x00 }, 1,  6 }, { { 0x66, 0x00 }, 1,  6 }, { { 0x66, 0x00 }, 1,  6 }, { { 0x66, 0x00 }, 1,  6 },
+	/* 0x4bc */ { { 0x66, 0x00 }, 1,  6 }, { { 0x66, 0x00 }, 1,  6 }, { { 0x66, 0x00 }, 1,  6 }, { { 0x66, 0x00 }, 1,  6 },
+	/* 0x4c0 */ { { 0x67, 0x30 }, 2, 11 }, { { 0x67, 0x31 }, 2, 11 }, { { 0x67, 0x32 }, 2, 11 }, { { 0x67, 0x61 }, 2, 11 },
+	/* 0x4c4 */ { { 0x67, 0x63 }, 2, 11 }, { { 0x67, 0x65 }, 2, 11 }, { { 0x67, 0x69 }, 2, 11 }, { { 0x67, 0x6f }, 2, 11 },
+	/* 0x4c8 */ { { 0x67, 0x73 }, 2, 11 }, { { 0x67, 0x74 }, 2, 11 }, { { 0x67, 0x00 }, 1,  6 }, { { 0x67, 0x00 }, 1,  6 },
+	/* 0x4cc */ { { 0x67, 0x00 }, 1,  6 }, { { 0x67, 0x00 }, 1,  6 }, { { 0x67, 0x00 }, 1,  6 }, { { 0x67, 0x00 }, 1,  6 },
+	/* 0x4d0 */ { { 0x67, 0x00 }, 1,  6 }, { { 0x67, 0x00 }, 1,  6 }, { { 0x67, 0x00 }, 1,  6 }, { { 0x67, 0x00 }, 1,  6 },
+	/* 0x4d4 */ { { 0x67, 0x00 }, 1,  6 }, { { 0x67, 0x00 }, 1,  6 }, { { 0x67, 0x00 }, 1,  6 }, { { 0x67, 0x00 }, 1,  6 },
+	/* 0x4d8 */ { { 0x67, 0x00 }, 1,  6 }, { { 0x67, 0x00 }, 1,  6 }, { { 0x67, 0x00 }, 1,  6 }, { { 0x67, 0x00 }, 1,  6 },
+	/* 0x4dc */ { { 0x67, 0x00 }, 1,  6 }, { { 0x67, 0x00 }, 1,  6 }, { { 0x67, 0x00 }, 1,  6 }, { { 0x67, 0x00 }, 1,  6 },
+	/* 0x4e0 */ { { 0x68, 0x30 }, 2, 11 }, { { 0x68, 0x31 }, 2, 11 }, { { 0x68, 0x32 }, 2, 11 }, { { 0x68, 0x61 }, 2, 11 },
+	/* 0x4e4 */ { { 0x68, 0x63 }, 2, 11 }, { { 0x68, 0x65 }, 2, 11 }, { { 0x68, 0x69 }, 2, 11 }, { { 0x68, 0x6f }, 2, 11 },
+	/* 0x4e8 */ { { 0x68, 0x73 }, 2, 11 }, { { 0x68, 0x74 }, 2, 11 }, { { 0x68, 0x00 }, 1,  6 }, { { 0x68, 0x00 }, 1,  6 },
+	/* 0x4ec */ { { 0x68, 0x00 }, 1,  6 }, { { 0x68, 0x00 }, 1,  6 }, { { 0x68, 0x00 }, 1,  6 }, { { 0x68, 0x00 }, 1,  6 },
+	/* 0x4f0 */ { { 0x68, 0x00 }, 1,  6 }, { { 0x68, 0x00 }, 1,  6 }, { { 0x68, 0x00 }, 1,  6 }, { { 0x68, 0x00 }, 1,  6 },
+	/* 0x4f4 */ { { 0x68, 0x00 }, 1,  6 }, { { 0x68, 0x00 }, 1,  6 }, { { 0x68, 0x00 }, 1,  6 }, { { 0x68, 0x00 }, 1,  6 },
+	/* 0x4f8 */ { { 0x68, 0x00 }, 1,  6 }, { { 0x68, 0x00 }, 1,  6 }, { { 0x68, 0x00 }, 1,  6 }, { { 0x68, 0x00 }, 1,  6 },
+	/* 0x4fc */ { { 0x68, 0x00 }, 1,  6 }, { { 0x68, 0x00 }, 1,  6 }, { { 0x68, 0x00 }, 1,  6 }, { { 0x68, 0x00 }, 1,  6 },
+	/* 0x500 */ { { 0x6c, 0x30 }, 2, 11 }, { { 0x6c, 0x31 }, 2, 11 }, { { 0x6c, 0x32 }, 2, 11 }, { { 0x6c, 0x61 }, 2, 11 },
+	/* 0x504 */ { { 0x6c, 0x63 }, 2, 11 }, { { 0x6c, 0x65 }, 2, 11 }, { { 0x6c, 0x69 }, 2, 11 }, { { 0x6c, 0x6f }, 2, 11 },
+	/* 0x508 */ { { 0x6c, 0x73 }, 2, 11 }, { { 0x6c, 0x74 }, 2, 11 }, { { 0x6c, 0x00 }, 1,  6 }, { { 0x6c, 0x00 }, 1,  6 },
+	/* 0x50c */ { { 0x6c, 0x00 }, 1,  6 }, { { 0x6c, 0x00 }, 1,  6 }, { { 0x6c, 0x00 }, 1,  6 }, { { 0x6c, 0x00 }, 1,  6 },
+	/* 0x510 */ { { 0x6c, 0x00 }, 1,  6 }, { { 0x6c, 0x00 }, 1,  6 }, { { 0x6c, 0x00 }, 1,  6 }, { { 0x6c, 0x00 }, 1,  6 },
+	/* 0x514 */ { { 0x6c, 0x00 }, 1,  6 }, { { 0x6c, 0x00 }, 1,  6 }, { { 0x6c, 0x00 }, 1,  6 }, { { 0x6c, 0x00 }, 1,  6 },
+	/* 0x518 */ { { 0x6c, 0x00 }, 1,  6 }, { { 0x6c, 0x00 }, 1,  6 }, { { 0x6c, 0x00 }, 1,  6 }, { { 0x6c, 0x00 }, 1,  6 },
+	/* 0x51c */ { { 0x6c, 0x00 }, 1,  6 }, { { 0x6c, 0x00 }, 1,  6 }, { { 0x6c, 0x00 }, 1,  6 }, { { 0x6c, 0x00 }, 1,  6 },
+	/* 0x520 */ { { 0x6d, 0x30 }, 2, 11 }, { { 0x6d, 0x31 }, 2, 11 }, { { 0x6d, 0x32 }, 2, 11 }, { { 0x6d, 0x61 }, 2, 11 },
+	/* 0x524 */ { { 0x6d, 0x63 }, 2, 11 }, { { 0x6d, 0x65 }, 2, 11 }, { { 0x6d, 0x69 }, 2, 11 }, { { 0x6d, 0x6f }, 2, 11 },
+	/* 0x528 */ { { 0x6d, 0x73 }, 2, 11 }, { { 0x6d, 0x74 }, 2, 11 }, { { 0x6d, 0x00 }, 1,  6 }, { { 0x6d, 0x00 }, 1,  6 },
+	/* 0x52c */ { { 0x6d, 0x00 }, 1,  6 }, { { 0x6d, 0x00 }, 1,  6 }, { { 0x6d, 0x00 }, 1,  6 }, { { 0x6d, 0x00 }, 1,  6 },
+	/* 0x530 */ { { 0x6d, 0x00 }, 1,  6 }, { { 0x6d, 0x00 }, 1,  6 }, { { 0x6d, 0x00 }, 1,  6 }, { { 0x6d, 0x00 }, 1,  6 },
+	/* 0x534 */ { { 0x6d, 0x00 }, 1,  6 }, { { 0x6d, 0x00 }, 1,  6 }, { { 0x6d, 0x00 }, 1,  6 }, { { 0x6d, 0x00 }, 1,  6 },
+	/* 0x538 */ { { 0x6d, 0x00 }, 1,  6 }, { { 0x6d, 0x00 }, 1,  6 }, { { 0x6d, 0x00 }, 1,  6 }, { { 0x6d, 0x00 }, 1,  6 },
+	/* 0x53c */ { { 0x6d, 0x00 }, 1,  6 }, { { 0x6d, 0x00 }, 1,  6 }, { { 0x6d, 0x00 }, 1,  6 }, { { 0x6d, 0x00 }, 1,  6 },
+	/* 0x540 */ { { 0x6e, 0x30 }, 2, 11 }, { { 0x6e, 0x31 }, 2, 11 }, { { 0x6e, 0x32 }, 2, 11 }, { { 0x6e, 0x61 }, 2, 11 },
+	/* 0x544 */ { { 0x6e, 0x63 }, 2, 11 }, { { 0x6e, 0x65 }, 2, 11 }, { { 0x6e, 0x69 }, 2, 11 }, { { 0x6e, 0x6f }, 2, 11 },
+	/* 0x548 */ { { 0x6e, 0x73 }, 2, 11 }, { { 0x6e, 0x74 }, 2, 11 }, { { 0x6e, 0x00 }, 1,  6 }, { { 0x6e, 0x00 }, 1,  6 },
+	/* 0x54c */ { { 0x6e, 0x00 }, 1,  6 }, { { 0x6e, 0x00 }, 1,  6 }, { { 0x6e, 0x00 }, 1,  6 }, { { 0x6e, 0x00 }, 1,  6 },
+	/* 0x550 */ { { 0x6e, 0x00 }, 1,  6 }, { { 0x6e, 0x00 }, 1,  6 }, { { 0x6e, 0x00 }, 1,  6 }, { { 0x6e, 0x00 }, 1,  6 },
+	/* 0x554 */ { { 0x6e, 0x00 }, 1,  6 }, { { 0x6e, 0x00 }, 1,  6 }, { { 0x6e, 0x00 }, 1,  6 }, { { 0x6e, 0x00 }, 1,  6 },
+	/* 0x558 */ { { 0x6e, 0x00 }, 1,  6 }, { { 0x6e, 0x00 }, 1,  6 }, { { 0x6e, 0x00 }, 1,  6 }, { { 0x6e, 0x00 }, 1,  6 },
+	/* 0x55c */ { { 0x6e, 0x00 }, 1,  6 }, { { 0x6e, 0x00 }, 1,  6 }, { { 0x6e, 0x00 }, 1,  6 }, { { 0x6e, 0x00 }, 1,  6 },
+	/* 0x560 */ { { 0x70, 0x30 }, 2, 11 }, { { 0x70, 0x31 }, 2, 11 }, { { 0x70, 0x32 }, 2, 11 }, { { 0x70, 0x61 }, 2, 11 },
+	/* 0x564 */ { { 0x70, 0x63 }, 2, 11 }, { { 0x70, 0x65 }, 2, 11 }, { { 0x70, 0x69 }, 2, 11 }, { { 0x70, 0x6f }, 2, 11 },
+	/* 0x568 */ { { 0x70, 0x73 }, 2, 11 }, { { 0x70, 0x74 }, 2, 11 }, { { 0x70, 0x00 }, 1,  6 }, { { 0x70, 0x00 }, 1,  6 },
+	/* 0x56c */ { { 0x70, 0x00 }, 1,  6 }, { { 0x70, 0x00 }, 1,  6 }, { { 0x70, 0x00 }, 1,  6 }, { { 0x70, 0x00 }, 1,  6 },
+	/* 0x570 */ { { 0x70, 0x00 }, 1,  6 }, { { 0x70, 0x00 }, 1,  6 }, { { 0x70, 0x00 }, 1,  6 }, { { 0x70, 0x00 }, 1,  6 },
+	/* 0x574 */ { { 0x70, 0x00 }, 1,  6 }, { { 0x70, 0x00 }, 1,  6 }, { { 0x70, 0x00 }, 1,  6 }, { { 0x70, 0x00 }, 1,  6 },
+	/* 0x578 */ { { 0x70, 0x00 }, 1,  6 }, { { 0x70, 0x00 }, 1,  6 }, { { 0x70, 0x00 }, 1,  6 }, { { 0x70, 0x00 }, 1,  6 },
+	/* 0x57c */ { { 0x70, 0x00 }, 1,  6 }, { { 0x70, 0x00 }, 1,  6 }, { { 0x70, 0x00 }, 1,  6 }, { { 0x70, 0x00 }, 1,  6 },
+	/* 0x580 */ { { 0x72, 0x30 }, 2, 11 }, { { 0x72, 0x31 }, 2, 11 }, { { 0x72, 0x32 }, 2, 11 }, { { 0x72, 0x61 }, 2, 11 },
+	/* 0x584 */ { { 0x72, 0x63 }, 2, 11 }, { { 0x72, 0x65 }, 2, 11 }, { { 0x72, 0x69 }, 2, 11 }, { { 0x72, 0x6f }, 2, 11 },
+	/* 0x588 */ { { 0x72, 0x73 }, 2, 11 }, { { 0x72, 0x74 }, 2, 11 }, { { 0x72, 0x00 }, 1,  6 }, { { 0x72, 0x00 }, 1,  6 },
+	/* 0x58c */ { { 0x72, 0x00 }, 1,  6 }, { { 0x72, 0x00 }, 1,  6 }, { { 0x72, 0x00 }, 1,  6 }, { { 0x72, 0x00 }, 1,  6 },
+	/* 0x590 */ { { 0x72, 0x00 }, 1,  6 }, { { 0x72, 0x00 }, 1,  6 }, { { 0x72, 0x00 }, 1,  6 }, { { 0x72, 0x00 }, 1,  6 },
+	/* 0x594 */ { { 0x72, 0x00 }, 1,  6 }, { { 0x72, 0x00 }, 1,  6 }, { { 0x72, 0x00 }, 1,  6 }, { { 0x72, 0x00 }, 1,  6 },
+	/* 0x598 */ { { 0x72, 0x00 }, 1,  6 }, { { 0x72, 0x00 }, 1,  6 }, { { 0x72, 0x00 }, 1,  6 }, { { 0x72, 0x00 }, 1,  6 },
+	/* 0x59c */ { { 0x72, 0x00 }, 1,  6 }, { { 0x72, 0x00 }, 1,  6 }, { { 0x72, 0x00 }, 1,  6 }, { { 0x72, 0x00 }, 1,  6 },
+	/* 0x5a0 */ { { 0x75, 0x30 }, 2, 11 }, { { 0x75, 0x31 }, 2, 11 }, { { 0x75, 0x32 }, 2, 11 }, { { 0x75, 0x61 }, 2, 11 },
+	/* 0x5a4 */ { { 0x75, 0x63 }, 2, 11 }, { { 0x75, 0x65 }, 2, 11 }, { { 0x75, 0x69 }, 2, 11 }, { { 0x75, 0x6f }, 2, 11 },
+	/* 0x5a8 */ { { 0x75, 0x73 }, 2, 11 }, { { 0x75, 0x74 }, 2, 11 }, { { 0x75, 0x00 }, 1,  6 }, { { 0x75, 0x00 }, 1,  6 },
+	/* 0x5ac */ { { 0x75, 0x00 }, 1,  6 }, { { 0x75, 0x00 }, 1,  6 }, { { 0x75, 0x00 }, 1,  6 }, { { 0x75, 0x00 }, 1,  6 },
+	/* 0x5b0 */ { { 0x75, 0x00 }, 1,  6 }, { { 0x75, 0x00 }, 1,  6 }, { { 0x75, 0x00 }, 1,  6 }, { { 0x75, 0x00 }, 1,  6 },
+	/* 0x5b4 */ { { 0x75, 0x00 }, 1,  6 }, { { 0x75, 0x00 }, 1,  6 }, { { 0x75, 0x00 }, 1,  6 }, { { 0x75, 0x00 }, 1,  6 },
+	/* 0x5b8 */ { { 0x75, 0x00 }, 1,  6 }, { { 0x75, 0x00 }, 1,  6 }, { { 0x75, 0x00 }, 1,  6 }, { { 0x75, 0x00 }, 1,  6 },
+	/* 0x5bc */ { { 0x75, 0x00 }, 1,  6 }, { { 0x75, 0x00 }, 1,  6 }, { { 0x75, 0x00 }, 1,  6 }, { { 0x75, 0x00 }, 1,  6 },
+	/* 0x5c0 */ { { 0x3a, 0x00 }, 1,  7 }, { { 0x3a, 0x00 }, 1,  7 }, { { 0x3a, 0x00 }, 1,  7 }, { { 0x3a, 0x00 }, 1,  7 },
+	/* 0x5c4 */ { { 0x3a, 0x00 }, 1,  7 }, { { 0x3a, 0x00 }, 1,  7 }, { { 0x3a, 0x00 }, 1,  7 }, { { 0x3a, 0x00 }, 1,  7 },
+	/* 0x5c8 */ { { 0x3a, 0x00 }, 1,  7 }, { { 0x3a, 0x00 }, 1,  7 }, { { 0x3a, 0x00 }, 1,  7 }, { { 0x3a, 0x00 }, 1,  7 },
+	/* 0x5cc */ { { 0x3a, 0x00 }, 1,  7 }, { { 0x3a, 0x00 }, 1,  7 }, { { 0x3a, 0x00 }, 1,  7 }, { { 0x3a, 0x00 }, 1,  7 },
+	/* 0x5d0 */ { { 0x42, 0x00 }, 1,  7 }, { { 0x42, 0x00 }, 1,  7 }, { { 0x42, 0x00 }, 1,  7 }, { { 0x42, 0x00 }, 1,  7 },
+	/* 0x5d4 */ { { 0x42, 0x00 }, 1,  7 }, { { 0x42, 0x00 }, 1,  7 }, { { 0x42, 0x00 }, 1,  7 }, { { 0x42, 0x00 }, 1,  7 },
+	/* 0x5d8 */ { { 0x42, 0x00 }, 1,  7 }, { { 0x42, 0x00 }, 1,  7 }, { { 0x42, 0x00 }, 1,  7 }, { { 0x42, 0x00 }, 1,  7 },
+	/* 0x5dc */ { { 0x42, 0x00 }, 1,  7 }, { { 0x42, 0x00 }, 1,  7 }, { { 0x42, 0x00 }, 1,  7 }, { { 0x42, 0x00 }, 1,  7 },
+	/* 0x5e0 */ { { 0x43, 0x00 }, 1,  7 }, { { 0x43, 0x00 }, 1,  7 }, { { 0x43, 0x00 }, 1,  7 }, { { 0x43, 0x00 }, 1,  7 },
+	/* 0x5e4 */ { { 0x43, 0x00 }, 1,  7 }, { { 0x43, 0x00 }, 1,  7 }, { { 0x43, 0x00 }, 1,  7 }, { { 0x43, 0x00 }, 1,  7 },
+	/* 0x5e8 */ { { 0x43, 0x00 }, 1,  7 }, { { 0x43, 0x00 }, 1,  7 }, { { 0x43, 0x00 }, 1,  7 }, { { 0x43, 0x00 }, 1,  7 },
+	/* 0x5ec */ { { 0x43, 0x00 }, 1,  7 }, { { 0x43, 0x00 }, 1,  7 }, { { 0x43, 0x00 }, 1,  7 }, { { 0x43, 0x00 }, 1,  7 },
+	/* 0x5f0 */ { { 0x44, 0x00 }, 1,  7 }, { { 0x44, 0x00 }, 1,  7 }, { { 0x44, 0x00 }, 1,  7 }, { { 0x44, 0x00 }, 1,  7 },
+	/* 0x5f4 */ { { 0x44, 0x00 }, 1,  7 }, { { 0x44, 0x00 }, 1,  7 }, { { 0x44, 0x00 }, 1,  7 }, { { 0x44, 0x00 }, 1,  7 },
+	/* 0x5f8 */ { { 0x44, 0x00 }, 1,  7 }, { { 0x44, 0x00 }, 1,  7 }, { { 0x44, 0x00 }, 1,  7 }, { { 0x44, 0x00 }, 1,  7 },
+	/* 0x5fc */ { { 0x44, 0x00 }, 1,  7 }, { { 0x44, 0x00 }, 1,  7 }, { { 0x44, 0x00 }, 1,  7 }, { { 0x44, 0x00 }, 1,  7 },
+	/* 0x600 */ { { 0x45, 0x00 }, 1,  7 }, { { 0x45, 0x00 }, 1,  7 }, { { 0x45, 0x00 }, 1,  7 }, { { 0x45, 0x00 }, 1,  7 },
+	/* 0x604 */ { { 0x45, 0x00 }, 1,  7 }, { { 0x45, 0x00 }, 1,  7 }, { { 0x45, 0x00 }, 1,  7 }, { { 0x45, 0x00 }, 1,  7 },
+	/* 0x608 */ { { 0x45, 0x00 }, 1,  7 }, { { 0x45, 0x00 }, 1,  7 }, { { 0x45, 0x00 }, 1,  7 }, { { 0x45, 0x00 }, 1,  7 },
+	/* 0x60c */ { { 0x45, 0x00 }, 1,  7 }, { { 0x45, 0x00 }, 1,  7 }, { { 0x45, 0x00 }, 1,  7 }, { { 0x45, 0x00 }, 1,  7 },
+	/* 0x610 */ { { 0x46, 0x00 }, 1,  7 }, { { 0x46, 0x00 }, 1,  7 }, { { 0x46, 0x00 }, 1,  7 }, { { 0x46, 0x00 }, 1,  7 },
+	/* 0x614 */ { { 0x46, 0x00 }, 1,  7 }, { { 0x46, 0x00 }, 1,  7 }, { { 0x46, 0x00 }, 1,  7 }, { { 0x46, 0x00 }, 1,  7 },
+	/* 0x618 */ { { 0x46, 0x00 }, 1,  7 }, { { 0x46, 0x00 }, 1,  7 }, { { 0x46, 0x00 }, 1,  7 }, { { 0x46, 0x00 }, 1,  7 },
+	/* 0x61c */ { { 0x46, 0x00 }, 1,  7 }, { { 0x46, 0x00 }, 1,  7 }, { { 0x46, 0x00 }, 1,  7 }, { { 0x46, 0x00 }, 1,  7 },
+	/* 0x620 */ { { 0x47, 0x00 }, 1,  7 }, { { 0x47, 0x00 }, 1,  7 }, { { 0x47, 0x00 }, 1,  7 }, { { 0x47, 0x00 }, 1,  7 },
+	/* 0x624 */ { { 0x47, 0x00 }, 1,  7 }, { { 0x47, 0x00 }, 1,  7 }, { { 0x47, 0x00 }, 1,  7 }, { { 0x47, 0x00 }, 1,  7 },
+	/* 0x628 */ { { 0x47, 0x00 }, 1,  7 }, { { 0x47, 0x00 }, 1,  7 }, { { 0x47, 0x00 }, 1,  7 }, { { 0x47, 0x00 }, 1,  7 },
+	/* 0x62c */ { { 0x47, 0x00 }, 1,  7 }, { { 0x47, 0x00 }, 1,  7 }, { { 0x47, 0x00 }, 1,  7 }, { { 0x47, 0x00 }, 1,  7 },
+	/* 0x630 */ { { 0x48, 0x00 }, 1,  7 }, { { 0x48, 0x00 }, 1,  7 }, { { 0x48, 0x00 }, 1,  7 }, { { 0x48, 0x00 }, 1,  7 },
+	/* 0x634 */ { { 0x48, 0x00 }, 1,  7 }, { { 0x48, 0x00 }, 1,  7 }, { { 0x48, 0x00 }, 1,  7 }, { { 0x48, 0x00 }, 1,  7 },
+	/* 0x638 */ { { 0x48, 0x00 }, 1,  7 }, { { 0x48, 0x00 }, 1,  7 }, { { 0x48, 0x00 }, 1,  7 }, { { 0x48, 0x00 }, 1,  7 },
+	/* 0x63c */ { { 0x48, 0x00 }, 1,  7 }, { { 0x48, 0x00 }, 1,  7 }, { { 0x48, 0x00 }, 1,  7 }, { { 0x48, 0x00 }, 1,  7 },
+	/* 0x640 */ { { 0x49, 0x00 }, 1,  7 }, { { 0x49, 0x00 }, 1,  7 }, { { 0x49, 0x00 }, 1,  7 }, { { 0x49, 0x00 }, 1,  7 },
+	/* 0x644 */ { { 0x49, 0x00 }, 1,  7 }, { { 0x49, 0x00 }, 1,  7 }, { { 0x49, 0x00 }, 1,  7 }, { { 0x49, 0x00 }, 1,  7 },
+	/* 0x648 */ { { 0x49, 0x00 }, 1,  7 }, { { 0x49, 0x00 }, 1,  7 }, { { 0x49, 0x00 }, 1,  7 }, { { 0x49, 0x00 }, 1,  7 },
+	/* 0x64c */ { { 0x49, 0x00 }, 1,  7 }, { { 0x49, 0x00 }, 1,  7 }, { { 0x49, 0x00 }, 1,  7 }, { { 0x49, 0x00 }, 1,  7 },
+	/* 0x650 */ { { 0x4a, 0x00 }, 1,  7 }, { { 0x4a, 0x00 }, 1,  7 }, { { 0x4a, 0x00 }, 1,  7 }, { { 0x4a, 0x00 }, 1,  7 },
+	/* 0x654 */ { { 0x4a, 0x00 }, 1,  7 }, { { 0x4a, 0x00 }, 1,  7 }, { { 0x4a, 0x00 }, 1,  7 }, { { 0x4a, 0x00 }, 1,  7 },
+	/* 0x658 */ { { 0x4a, 0x00 }, 1,  7 }, { { 0x4a, 0x00 }, 1,  7 }, { { 0x4a, 0x00 }, 1,  7 }, { { 0x4a, 0x00 }, 1,  7 },
+	/* 0x65c */ { { 0x4a, 0x00 }, 1,  7 }, { { 0x4a, 0x00 }, 1,  7 }, { { 0x4a, 0x00 }, 1,  7 }, { { 0x4a, 0x00 }, 1,  7 },
+	/* 0x660 */ { { 0x4b, 0x00 }, 1,  7 }, { { 0x4b, 0x00 }, 1,  7 }, { { 0x4b, 0x00 }, 1,  7 }, { { 0x4b, 0x00 }, 1,  7 },
+	/* 0x664 */ { { 0x4b, 0x00 }, 1,  7 }, { { 0x4b, 0x00 }, 1,  7 }, { { 0x4b, 0x00 }, 1,  7 }, { { 0x4b, 0x00 }, 1,  7 },
+	/* 0x668 */ { { 0x4b, 0x00 }, 1,  7 }, { { 0x4b, 0x00 }, 1,  7 }, { { 0x4b, 0x00 }, 1,  7 }, { { 0x4b, 0x00 }, 1,  7 },
+	/* 0x66c */ { { 0x4b, 0x00 }, 1,  7 }, { { 0x4b, 0x00 }, 1,  7 }, { { 0x4b, 0x00 }, 1,  7 }, { { 0x4b, 0x00 }, 1,  7 },
+	/* 0x670 */ { { 0x4c, 0x00 }, 1,  7 }, { { 0x4c, 0x00 }, 1,  7 }, { { 0x4c, 0x00 }, 1,  7 }, { { 0x4c, 0x00 }, 1,  7 },
+	/* 0x674 */ { { 0x4c, 0x00 }, 1,  7 }, { { 0x4c, 0x00 }, 1,  7 }, { { 0x4c, 0x00 }, 1,  7 }, { { 0x4c, 0x00 }, 1,  7 },
+	/* 0x678 */ { { 0x4c, 0x00 }, 1,  7 }, { { 0x4c, 0x00 }, 1,  7 }, { { 0x4c, 0x00 }, 1,  7 }, { { 0x4c, 0x00 }, 1,  7 },
+	/* 0x67c */ { { 0x4c, 0x00 }, 1,  7 }, { { 0x4c, 0x00 }, 1,  7 }, { { 0x4c, 0x00 }, 1,  7 }, { { 0x4c, 0x00 }, 1,  7 },
+	/* 0x680 */ { { 0x4d, 0x00 }, 1,  7 }, { { 0x4d, 0x00 }, 1,  7 }, { { 0x4d, 0x00 }, 1,  7 }, { { 0x4d, 0x00 }, 1,  7 },
+	/* 0x684 */ { { 0x4d, 0x00 }, 1,  7 }, { { 0x4d, 0x00 }, 1,  7 }, { { 0x4d, 0x00 }, 1,  7 }, { { 0x4d, 0x00 }, 1,  7 },
+	/* 0x688 */ { { 0x4d, 0x00 }, 1,  7 }, { { 0x4d, 0x00 }, 1,  7 }, { { 0x4d, 0x00 }, 1,  7 }, { { 0x4d, 0x00 }, 1,  7 },
+	/* 0x68c */ { { 0x4d, 0x00 }, 1,  7 }, { { 0x4d, 0x00 }, 1,  7 }, { { 0x4d, 0x00 }, 1,  7 }, { { 0x4d, 0x00 }, 1,  7 },
+	/* 0x690 */ { { 0x4e, 0x00 }, 1,  7 }, { { 0x4e, 0x00 }, 1,  7 }, { { 0x4e, 0x00 }, 1,  7 }, { { 0x4e, 0x00 }, 1,  7 },
+	/* 0x694 */ { { 0x4e, 0x00 }, 1,  7 }, { { 0x4e, 0x00 }, 1,  7 }, { { 0x4e, 0x00 }, 1,  7 }, { { 0x4e, 0x00 }, 1,  7 },
+	/* 0x698 */ { { 0x4e, 0x00 }, 1,  7 }, { { 0x4e, 0x00 }, 1,  7 }, { { 0x4e, 0x00 }, 1,  7 }, { { 0x4e, 0x00 }, 1,  7 },
+	/* 0x69c */ { { 0x4e, 0x00 }, 1,  7 }, { { 0x4e, 0x00 }, 1,  7 }, { { 0x4e, 0x00 }, 1,  7 }, { { 0x4e, 0x00 }, 1,  7 },
+	/* 0x6a0 */ { { 0x4f, 0x00 }, 1,  7 }, { { 0x4f, 0x00 }, 1,  7 }, { { 0x4f, 0x00 }, 1,  7 }, { { 0x4f, 0x00 }, 1,  7 },
+	/* 0x6a4 */ { { 0x4f, 0x00 }, 1,  7 }, { { 0x4f, 0x00 }, 1,  7 }, { { 0x4f, 0x00 }, 1,  7 }, { { 0x4f, 0x00 }, 1,  7 },
+	/* 0x6a8 */ { { 0x4f, 0x00 }, 1,  7 }, { { 0x4f, 0x00 }, 1,  7 }, { { 0x4f, 0x00 }, 1,  7 }, { { 0x4f, 0x00 }, 1,  7 },
+	/* 0x6ac */ { { 0x4f, 0x00 }, 1,  7 }, { { 0x4f, 0x00 }, 1,  7 }, { { 0x4f, 0x00 }, 1,  7 }, { { 0x4f, 0x00 }, 1,  7 },
+	/* 0x6b0 */ { { 0x50, 0x00 }, 1,  7 }, { { 0x50, 0x00 }, 1,  7 }, { { 0x50, 0x00 }, 1,  7 }, { { 0x50, 0x00 }, 1,  7 },
+	/* 0x6b4 */ { { 0x50, 0x00 }, 1,  7 }, { { 0x50, 0x00 }, 1,  7 }, { { 0x50, 0x00 }, 1,  7 }, { { 0x50, 0x00 }, 1,  7 },
+	/* 0x6b8 */ { { 0x50, 0x00 }, 1,  7 }, { { 0x50, 0x00 }, 1,  7 }, { { 0x50, 0x00 }, 1,  7 }, { { 0x50, 0x00 }, 1,  7 },
+	/* 0x6bc */ { { 0x50, 0x00 }, 1,  7 }, { { 0x50, 0x00 }, 1,  7 }, { { 0x50, 0x00 }, 1,  7 }, { { 0x50, 0x00 }, 1,  7 },
+	/* 0x6c0 */ { { 0x51, 0x00 }, 1,  7 }, { { 0x51, 0x00 }, 1,  7 }, { { 0x51, 0x00 }, 1,  7 }, { { 0x51, 0x00 }, 1,  7 },
+	/* 0x6c4 */ { { 0x51, 0x00 }, 1,  7 }, { { 0x51, 0x00 }, 1,  7 }, { { 0x51, 0x00 }, 1,  7 }, { { 0x51, 0x00 }, 1,  7 },
+	/* 0x6c8 */ { { 0x51, 0x00 }, 1,  7 }, { { 0x51, 0x00 }, 1,  7 }, { { 0x51, 0x00 }, 1,  7 }, { { 0x51, 0x00 }, 1,  7 },
+	/* 0x6cc */ { { 0x51, 0x00 }, 1,  7 }, { { 0x51, 0x00 }, 1,  7 }, { { 0x51, 0x00 }, 1,  7 }, { { 0x51, 0x00 }, 1,  7 },
+	/* 0x6d0 */ { { 0x52, 0x00 }, 1,  7 }, { { 0x52, 0x00 }, 1,  7 }, { { 0x52, 0x00 }, 1,  7 }, { { 0x52, 0x00 }, 1,  7 },
+	/* 0x6d4 */ { { 0x52, 0x00 }, 1,  7 }, { { 0x52, 0x00 }, 1,  7 }, { { 0x52, 0x00 }, 1,  7 }, { { 0x52, 0x00 }, 1,  7 },
+	/* 0x6d8 */ { { 0x52, 0x00 }, 1,  7 }, { { 0x52, 0x00 }, 1,  7 }, { { 0x52, 0x00 }, 1,  7 }, { { 0x52, 0x00 }, 1,  7 },
+	/* 0x6dc */ { { 0x52, 0x00 }, 1,  7 }, { { 0x52, 0x00 }, 1,  7 }, { { 0x52, 0x00 }, 1,  7 }, { { 0x52, 0x00 }, 1,  7 },
+	/* 0x6e0 */ { { 0x53, 0x00 }, 1,  7 }, { { 0x53, 0x00 }, 1,  7 }, { { 0x53, 0x00 }, 1,  7 }, { { 0x53, 0x00 }, 1,  7 },
+	/* 0x6e4 */ { { 0x53, 0x00 }, 1,  7 }, { { 0x53, 0x00 }, 1,  7 }, { { 0x53, 0x00 }, 1,  7 }, { { 0x53, 0x00 }, 1,  7 },
+	/* 0x6e8 */ { { 0x53, 0x00 }, 1,  7 }, { { 0x53, 0x00 }, 1,  7 }, { { 0x53, 0x00 }, 1,  7 }, { { 0x53, 0x00 }, 1,  7 },
+	/* 0x6ec */ { { 0x53, 0x00 }, 1,  7 }, { { 0x53, 0x00 }, 1,  7 }, { { 0x53, 0x00 }, 1,  7 }, { { 0x53, 0x00 }, 1,  7 },
+	/* 0x6f0 */ { { 0x54, 0x00 }, 1,  7 }, { { 0x54, 0x00 }, 1,  7 }, { { 0x54, 0x00 }, 1,  7 }, { { 0x54, 0x00 }, 1,  7 },
+	/* 0x6f4 */ { { 0x54, 0x00 }, 1,  7 }, { { 0x54, 0x00 }, 1,  7 }, { { 0x54, 0x00 }, 1,  7 }, { { 0x54, 0x00 }, 1,  7 },
+	/* 0x6f8 */ { { 0x54, 0x00 }, 1,  7 }, { { 0x54, 0x00 }, 1,  7 }, { { 0x54, 0x00 }, 1,  7 }, { { 0x54, 0x00 }, 1,  7 },
+	/* 0x6fc */ { { 0x54, 0x00 }, 1,  7 }, { { 0x54, 0x00 }, 1,  7 }, { { 0x54, 0x00 }, 1,  7 }, { { 0x54, 0x00 }, 1,  7 },
+	/* 0x700 */ { { 0x55, 0x00 }, 1,  7 }, { { 0x55, 0x00 }, 1,  7 }, { { 0x55, 0x00 }, 1,  7 }, { { 0x55, 0x00 }, 1,  7 },
+	/* 0x704 */ { { 0x55, 0x00 }, 1,  7 }, { { 0x55, 0x00 }, 1,  7 }, { { 0x55, 0x00 }, 1,  7 }, { { 0x55, 0x00 }, 1,  7 },
+	/* 0x708 */ { { 0x55, 0x00 }, 1,  7 }, { { 0x55, 0x00 }, 1,  7 }, { { 0x55, 0x00 }, 1,  7 }, { { 0x55, 0x00 }, 1,  7 },
+	/* 0x70c */ { { 0x55, 0x00 }, 1,  7 }, { { 0x55, 0x00 }, 1,  7 }, { { 0x55, 0x00 }, 1,  7 }, { { 0x55, 0x00 }, 1,  7 },
+	/* 0x710 */ { { 0x56, 0x00 }, 1,  7 }, { { 0x56, 0x00 }, 1,  7 }, { { 0x56, 0x00 }, 1,  7 }, { { 0x56, 0x00 }, 1,  7 },
+	/* 0x714 */ { { 0x56, 0x00 }, 1,  7 }, { { 0x56, 0x00 }, 1,  7 }, { { 0x56, 0x00 }, 1,  7 }, { { 0x56, 0x00 }, 1,  7 },
+	/* 0x718 */ { { 0x56, 0x00 }, 1,  7 }, { { 0x56, 0x00 }, 1,  7 }, { { 0x56, 0x00 }, 1,  7 }, { { 0x56, 0x00 }, 1,  7 },
+	/* 0x71c */ { { 0x56, 0x00 }, 1,  7 }, { { 0x56, 0x00 }, 1,  7 }, { { 0x56, 0x00 }, 1,  7 }, { { 0x56, 0x00 }, 1,  7 },
+	/* 0x720 */ { { 0x57, 0x00 }, 1,  7 }, { { 0x57, 0x00 }, 1,  7 }, { { 0x57, 0x00 }, 1,  7 }, { { 0x57, 0x00 }, 1,  7 },
+	/* 0x724 */ { { 0x57, 0x00 }, 1,  7 }, { { 0x57, 0x00 }, 1,  7 }, { { 0x57, 0x00 }, 1,  7 }, { { 0x57, 0x00 }, 1,  7 },
+	/* 0x728 */ { { 0x57, 0x00 }, 1,  7 }, { { 0x57, 0x00 }, 1,  7 }, { { 0x57, 0x00 }, 1,  7 }, { { 0x57, 0x00 }, 1,  7 },
+	/* 0x72c */ { { 0x57, 0x00 }, 1,  7 }, { { 0x57, 0x00 }, 1,  7 }, { { 0x57, 0x00 }, 1,  7 }, { { 0x57, 0x00 }, 1,  7 },
+	/* 0x730 */ { { 0x59, 0x00 }, 1,  7 }, { { 0x59, 0x00 }, 1,  7 }, { { 0x59, 0x00 }, 1,  7 }, { { 0x59, 0x00 }, 1,  7 },
+	/* 0x734 */ { { 0x59, 0x00 }, 1,  7 }, { { 0x59, 0x00 }, 1,  7 }, { { 0x59, 0x00 }, 1,  7 }, { { 0x59, 0x00 }, 1,  7 },
+	/* 0x738 */ { { 0x59, 0x00 }, 1,  7 }, { { 0x59, 0x00 }, 1,  7 }, { { 0x59, 0x00 }, 1,  7 }, { { 0x59, 0x00 }, 1,  7 },
+	/* 0x73c */ { { 0x59, 0x00 }, 1,  7 }, { { 0x59, 0x00 }, 1,  7 }, { { 0x59, 0x00 }, 1,  7 }, { { 0x59, 0x00 }, 1,  7 },
+	/* 0x740 */ { { 0x6a, 0x00 }, 1,  7 }, { { 0x6a, 0x00 }, 1,  7 }, { { 0x6a, 0x00 }, 1,  7 }, { { 0x6a, 0x00 }, 1,  7 },
+	/* 0x744 */ { { 0x6a, 0x00 }, 1,  7 }, { { 0x6a, 0x00 }, 1,  7 }, { { 0x6a, 0x00 }, 1,  7 }, { { 0x6a, 0x00 }, 1,  7 },
+	/* 0x748 */ { { 0x6a, 0x00 }, 1,  7 }, { { 0x6a, 0x00 }, 1,  7 }, { { 0x6a, 0x00 }, 1,  7 }, { { 0x6a, 0x00 }, 1,  7 },
+	/* 0x74c */ { { 0x6a, 0x00 }, 1,  7 }, { { 0x6a, 0x00 }, 1,  7 }, { { 0x6a, 0x00 }, 1,  7 }, { { 0x6a, 0x00 }, 1,  7 },
+	/* 0x750 */ { { 0x6b, 0x00 }, 1,  7 }, { { 0x6b, 0x00 }, 1,  7 }, { { 0x6b, 0x00 }, 1,  7 }, { { 0x6b, 0x00 }, 1,  7 },
+	/* 0x754 */ { { 0x6b, 0x00 }, 1,  7 }, { { 0x6b, 0x00 }, 1,  7 }, { { 0x6b, 0x00 }, 1,  7 }, { { 0x6b, 0x00 }, 1,  7 },
+	/* 0x758 */ { { 0x6b, 0x00 }, 1,  7 }, { { 0x6b, 0x00 }, 1,  7 }, { { 0x6b, 0x00 }, 1,  7 }, { { 0x6b, 0x00 }, 1,  7 },
+	/* 0x75c */ { { 0x6b, 0x00 }, 1,  7 }, { { 0x6b, 0x00 }, 1,  7 }, { { 0x6b, 0x00 }, 1,  7 }, { { 0x6b, 0x00 }, 1,  7 },
+	/* 0x760 */ { { 0x71, 0x00 }, 1,  7 }, { { 0x71, 0x00 }, 1,  7 }, { { 0x71, 0x00 }, 1,  7 }, { { 0x71, 0x00 }, 1,  7 },
+	/* 0x764 */ { { 0x71, 0x00 }, 1,  7 }, { { 0x71, 0x00 }, 1,  7 }, { { 0x71, 0x00 }, 1,  7 }, { { 0x71, 0x00 }, 1,  7 },
+	/* 0x768 */ { { 0x71, 0x00 }, 1,  7 }, { { 0x71, 0x00 }, 1,  7 }, { { 0x71, 0x00 }, 1,  7 }, { { 0x71, 0x00 }, 1,  7 },
+	/* 0x76c */ { { 0x71, 0x00 }, 1,  7 }, { { 0x71, 0x00 }, 1,  7 }, { { 0x71, 0x00 }, 1,  7 }, { { 0x71, 0x00 }, 1,  7 },
+	/* 0x770 */ { { 0x76, 0x00 }, 1,  7 }, { { 0x76, 0x00 }, 1,  7 }, { { 0x76, 0x00 }, 1,  7 }, { { 0x76, 0x00 }, 1,  7 },
+	/* 0x774 */ { { 0x76, 0x00 }, 1,  7 }, { { 0x76, 0x00 }, 1,  7 }, { { 0x76, 0x00 }, 1,  7 }, { { 0x76, 0x00 }, 1,  7 },
+	/* 0x778 */ { { 0x76, 0x00 }, 1,  7 }, { { 0x76, 0x00 }, 1,  7 }, { { 0x76, 0x00 }, 1,  7 }, { { 0x76, 0x00 }, 1,  7 },
+	/* 0x77c */ { { 0x76, 0x00 }, 1,  7 }, { { 0x76, 0x00 }, 1,  7 }, { { 0x76, 0x00 }, 1,  7 }, { { 0x76, 0x00 }, 1,  7 },
+	/* 0x780 */ { { 0x77, 0x00 }, 1,  7 }, { { 0x77, 0x00 }, 1,  7 }, { { 0x77, 0x00 }, 1,  7 }, { { 0x77, 0x00 }, 1,  7 },
+	/* 0x784 */ { { 0x77, 0x00 }, 1,  7 }, { { 0x77, 0x00 }, 1,  7 }, { { 0x77, 0x00 }, 1,  7 }, { { 0x77, 0x00 }, 1,  7 },
+	/* 0x788 */ { { 0x77, 0x00 }, 1,  7 }, { { 0x77, 0x00 }, 1,  7 }, { { 0x77, 0x00 }, 1,  7 }, { { 0x77, 0x00 }, 1,  7 },
+	/* 0x78c */ { { 0x77, 0x00 }, 1,  7 }, { { 0x77, 0x00 }, 1,  7 }, { { 0x77, 0x00 }, 1,  7 }, { { 0x77, 0x00 }, 1,  7 },
+	/* 0x790 */ { { 0x78, 0x00 }, 1,  7 }, { { 0x78, 0x00 }, 1,  7 }, { { 0x78, 0x00 }, 1,  7 }, { { 0x78, 0x00 }, 1,  7 },
+	/* 0x794 */ { { 0x78, 0x00 }, 1,  7 }, { { 0x78, 0x00 }, 1,  7 }, { { 0x78, 0x00 }, 1,  7 }, { { 0x78, 0x00 }, 1,  7 },
+	/* 0x798 */ { { 0x78, 0x00 }, 1,  7 }, { { 0x78, 0x00 }, 1,  7 }, { { 0x78, 0x00 }, 1,  7 }, { { 0x78, 0x00 }, 1,  7 },
+	/* 0x79c */ { { 0x78, 0x00 }, 1,  7 }, { { 0x78, 0x00 }, 1,  7 }, { { 0x78, 0x00 }, 1,  7 }, { { 0x78, 0x00 }, 1,  7 },
+	/* 0x7a0 */ { { 0x79, 0x00 }, 1,  7 }, { { 0x79, 0x00 }, 1,  7 }, { { 0x79, 0x00 }, 1,  7 }, { { 0x79, 0x00 }, 1,  7 },
+	/* 0x7a4 */ { { 0x79, 0x00 }, 1,  7 }, { { 0x79, 0x00 }, 1,  7 }, { { 0x79, 0x00 }, 1,  7 }, { { 0x79, 0x00 }, 1,  7 },
+	/* 0x7a8 */ { { 0x79, 0x00 }, 1,  7 }, { { 0x79, 0x00 }, 1,  7 }, { { 0x79, 0x00 }, 1,  7 }, { { 0x79, 0x00 }, 1,  7 },
+	/* 0x7ac */ { { 0x79, 0x00 }, 1,  7 }, { { 0x79, 0x00 }, 1,  7 }, { { 0x79, 0x00 }, 1,  7 }, { { 0x79, 0x00 }, 1,  7 },
+	/* 0x7b0 */ { { 0x7a, 0x00 }, 1,  7 }, { { 0x7a, 0x00 }, 1,  7 }, { { 0x7a, 0x00 }, 1,  7 }, { { 0x7a, 0x00 }, 1,  7 },
+	/* 0x7b4 */ { { 0x7a, 0x00 }, 1,  7 }, { { 0x7a, 0x00 }, 1,  7 }, { { 0x7a, 0x00 }, 1,  7 }, { { 0x7a, 0x00 }, 1,  7 },
+	/* 0x7b8 */ { { 0x7a, 0x00 }, 1,  7 }, { { 0x7a, 0x00 }, 1,  7 }, { { 0x7a, 0x00 }, 1,  7 }, { { 0x7a, 0x00 }, 1,  7 },
+	/* 0x7bc */ { { 0x7a, 0x00 }, 1,  7 }, { { 0x7a, 0x00 }, 1,  7 }, { { 0x7a, 0x00 }, 1,  7 }, { { 0x7a, 0x00 }, 1,  7 },
+	/* 0x7c0 */ { { 0x26, 0x00 }, 1,  8 }, { { 0x26, 0x00 }, 1,  8 }, { { 0x26, 0x00 }, 1,  8 }, { { 0x26, 0x00 }, 1,  8 },
+	/* 0x7c4 */ { { 0x26, 0x00 }, 1,  8 }, { { 0x26, 0x00 }, 1,  8 }, { { 0x26, 0x00 }, 1,  8 }, { { 0x26, 0x00 }, 1,  8 },
+	/* 0x7c8 */ { { 0x2a, 0x00 }, 1,  8 }, { { 0x2a, 0x00 }, 1,  8 }, { { 0x2a, 0x00 }, 1,  8 }, { { 0x2a, 0x00 }, 1,  8 },
+	/* 0x7cc */ { { 0x2a, 0x00 }, 1,  8 }, { { 0x2a, 0x00 }, 1,  8 }, { { 0x2a, 0x00 }, 1,  8 }, { { 0x2a, 0x00 }, 1,  8 },
+	/* 0x7d0 */ { { 0x2c, 0x00 }, 1,  8 }, { { 0x2c, 0x00 }, 1,  8 }, { { 0x2c, 0x00 }, 1,  8 }, { { 0x2c, 0x00 }, 1,  8 },
+	/* 0x7d4 */ { { 0x2c, 0x00 }, 1,  8 }, { { 0x2c, 0x00 }, 1,  8 }, { { 0x2c, 0x00 }, 1,  8 }, { { 0x2c, 0x00 }, 1,  8 },
+	/* 0x7d8 */ { { 0x3b, 0x00 }, 1,  8 }, { { 0x3b, 0x00 }, 1,  8 }, { { 0x3b, 0x00 }, 1,  8 }, { { 0x3b, 0x00 }, 1,  8 },
+	/* 0x7dc */ { { 0x3b, 0x00 }, 1,  8 }, { { 0x3b, 0x00 }, 1,  8 }, { { 0x3b, 0x00 }, 1,  8 }, { { 0x3b, 0x00 }, 1,  8 },
+	/* 0x7e0 */ { { 0x58, 0x00 }, 1,  8 }, { { 0x58, 0x00 }, 1,  8 }, { { 0x58, 0x00 }, 1,  8 }, { { 0x58, 0x00 }, 1,  8 },
+	/* 0x7e4 */ { { 0x58, 0x00 }, 1,  8 }, { { 0x58, 0x00 }, 1,  8 }, { { 0x58, 0x00 }, 1,  8 }, { { 0x58, 0x00 }, 1,  8 },
+	/* 0x7e8 */ { { 0x5a, 0x00 }, 1,  8 }, { { 0x5a, 0x00 }, 1,  8 }, { { 0x5a, 0x00 }, 1,  8 }, { { 0x5a, 0x00 }, 1,  8 },
+	/* 0x7ec */ { { 0x5a, 0x00 }, 1,  8 }, { { 0x5a, 0x00 }, 1,  8 }, { { 0x5a, 0x00 }, 1,  8 }, { { 0x5a, 0x00 }, 1,  8 },
+	/* 0x7f0 */ { { 0x21, 0x00 }, 1, 10 }, { { 0x21, 0x00 }, 1, 10 }, { { 0x22, 0x00 }, 1, 10 }, { { 0x22, 0x00 }, 1, 10 },
+	/* 0x7f4 */ { { 0x28, 0x00 }, 1, 10 }, { { 0x28, 0x00 }, 1, 10 }, { { 0x29, 0x00 }, 1, 10 }, { { 0x29, 0x00 }, 1, 10 },
+	/* 0x7f8 */ { { 0x3f, 0x00 }, 1, 10 }, { { 0x3f, 0x00 }, 1, 10 }, { { 0x27, 0x00 }, 1, 11 }, { { 0x2b, 0x00 }, 1, 11 },
+	/* 0x7fc */ { { 0x7c, 0x00 }, 1, 11 }, { { 0x00, 0x00 }, 0,  0 }, { { 0x00, 0x00 }, 0,  0 }, { { 0x00, 0x00 }, 0,  0 },
+};
+
 /* huffman-encode string <s> into the huff_tmp buffer and returns the amount
  * of output bytes. The caller must ensure the output is large enough (ie at
  * least 4 times as long as s).
@@ -1407,124 +1936,136 @@ int huff_enc(const char *s, char *out)
 	return bits / 8;
 }
 
+/* Looks up the single symbol starting at the top of the 32-bit MSB-aligned
+ * <code> in the hierarchical tables, stores it into <sym> and returns its length
+ * in bits, or 0 if it is EOS or invalid.
+ */
+static inline int huff_dec_one(uint32_t code, uint8_t *sym)
+{
+	int l;
+
+	if ((code >> 24) < 0xfe) {
+		/* single byte */
+		l = rht_bit31_24[code >> 24].l;
+		*sym = rht_bit31_24[code >> 24].c;
+	}
+	else if (((code >> 17) & 0xff) < 0xff) {
+		/* two bytes, 0xfe + 2 bits or 0xff + 2..7 bits */
+		l = rht_bit24_17[(code >> 17) & 0xff].l;
+		*sym = rht_bit24_17[(code >> 17) & 0xff].c;
+	}
+	else if (((code >> 16) & 0xff) < 0xff) { /* 3..5 bits */
+		/* 0xff + 0xfe + 3..5 bits or
+		 * 0xff + 0xff + 5..8 bits for values till 0xf5
+		 */
+		l = rht_bit15_11_fe[(code >> 11) & 0x1f].l;
+		*sym = rht_bit15_11_fe[(code >> 11) & 0x1f].c;
+	}
+	else if (((code >> 8) & 0xff) < 0xf6) { /* 5..8 bits */
+		/* that's 0xff + 0xff */
+		l = rht_bit15_8[(code >> 8) & 0xff].l;
+		*sym = rht_bit15_8[(code >> 8) & 0xff].c;
+	}
+	else {
+		/* 0xff 0xff 0xf6..0xff */
+		l = rht_bit11_4[(code >> 4) & 0xff].l;
+		if (l < 30)
+			*sym = rht_bit11_4[(code >> 4) & 0xff].c;
+		else if ((code & 0xc) == 0x0) // bits 1..0 belong to the next code
+			*sym = 10;
+		else if ((code & 0xc) == 0x4)
+			*sym = 13;
+		else if ((code & 0xc) == 0x8)
+			*sym = 22;
+		else // 0xc : EOS
+			l = 0;
+	}
+	return l;
+}
+
 /* pass a huffman string, it will decode it and return the new output size or
  * -1 in case of error.
  *
- * The principle of the decoder is to lookup full bytes in reverse-huffman
- * tables. Since we may need up to 30 bits and the word positions are not
- * always multiples of 8, we build the code word by shifting the "current"
- * 32-bit word and the "next" one of the appropriate amount of bits. Once
- * the shift goes beyond 32, words are swapped and the "next" one is refilled
- * with new bytes. Shift operations are cheap when done a single time like this.
- * On 64-bit platforms it is possible to further improve this by storing both
- * of them in a single word.
+ * The code is accumulated MSB-aligned into a 64-bit word, which is refilled
+ * with a single unaligned 64-bit big endian read whenever at least 8 input
+ * bytes remain, and byte per byte near the end. In the fast path, the top 11
+ * bits are looked up in the multi-symbol table which delivers up to two short
+ * symbols at once, and as long as at least 11 bits are present, no further
+ * check is needed. Longer codes, and the last ones, are looked up one at a
+ * time in the hierarchical tables.
  */
 int huff_dec(const uint8_t *huff, int hlen, char *out, int olen)
 {
 	char *out_start = out;
 	char *out_end = out + olen;
 	const uint8_t *huff_end = huff + hlen;
-	uint32_t curr = 0;
-	uint32_t next = 0;
-	uint32_t shift;
-	uint32_t code; /* The 30-bit code being looked up, MSB-aligned */
+	const struct rht2 *e;
+	uint64_t code; /* the pending code, MSB-aligned */
+	int bits;      /* number of valid bits in <code> */
 	uint8_t sym;
-	int bleft; /* bits left */
 	int l;
 
 	code = 0;
-	shift = 64; // start with an empty buffer
-	bleft = hlen << 3;
-	while (bleft > 0 && out != out_end) {
-		while (shift >= 32) {
-			curr = next;
-
-			/* read up to 4 bytes into next. FIXME: this should
-			 * later be optimized to perform a single 32-bit big
-			 * endian read when unaligned accesses are possible.
+	bits = 0;
+	while (1) {
+		if (huff + 8 <= huff_end) {
+			/* the bits past the valid ones are either zero or the
+			 * ones that will be read again, so they can be merged.
 			 */
-			next = 0;
-
-			if (huff + 4 <= huff_end) {
-				next = (huff[0] << 24) + (huff[1] << 16) + (huff[2] <<  8) + huff[3];
-				huff += 4;
-			}
-			else {
-				/* note: we append 0 and not 0xff so that we can
-				 * distinguish shifted bits from a really inserted
-				 * EOS.
-				 */
-				next =  (((huff + 0 < huff_end) ? huff[0] : 0x00) << 24) +
-					(((huff + 1 < huff_end) ? huff[1] : 0x00) << 16) +
-					(((huff + 2 < huff_end) ? huff[2] : 0x00) <<  8) +
-					((huff + 3 < huff_end) ? huff[3] : 0x00);
-				huff = huff_end;
-			}
-
-			shift -= 32;
+			code |= read_n64(huff) >> bits;
+			huff += (63 - bits) >> 3;
+			bits |= 56;
 		}
-
-		/* curr:next contain 64 bit of huffman code */
-		code = curr;
-		if (shift)
-			code = (code << shift) + (next >> (32 - shift));
-
-		/* now we necessarily have 32 bits available */
-		if ((code >> 24) < 0xfe) {
-			/* single byte */
-			l = rht_bit31_24[code >> 24].l;
-			sym = rht_bit31_24[code >> 24].c;
-		}
-		else if (((code >> 17) & 0xff) < 0xff) {
-			/* two bytes, 0xfe + 2 bits or 0xff + 2..7 bits */
-			l = rht_bit24_17[(code >> 17) & 0xff].l;
-			sym = rht_bit24_17[(code >> 17) & 0xff].c;
-		}
-		else if (((code >> 16) & 0xff) < 0xff) { /* 3..5 bits */
-			/* 0xff + 0xfe + 3..5 bits or
-			 * 0xff + 0xff + 5..8 bits for values till 0xf5
+		else {
+			/* note: we append 0 and not 1 so that we can
+			 * distinguish shifted bits from a really inserted
+			 * EOS.
 			 */
-			l = rht_bit15_11_fe[(code >> 11) & 0x1f].l;
-			sym = rht_bit15_11_fe[(code >> 11) & 0x1f].c;
-		}
-		else if (((code >> 8) & 0xff) < 0xf6) { /* 5..8 bits */
-			/* that's 0xff + 0xff */
-			l = rht_bit15_8[(code >> 8) & 0xff].l;
-			sym = rht_bit15_8[(code >> 8) & 0xff].c;
+			while (bits <= 56 && huff < huff_end) {
+				code |= (uint64_t)*huff++ << (56 - bits);
+				bits += 8;
+			}
 		}
-		else {
-			/* 0xff 0xff 0xf6..0xff */
-			l = rht_bit11_4[(code >> 4) & 0xff].l;
-			if (l < 30)
-				sym = rht_bit11_4[(code >> 4) & 0xff].c;
-			else if ((code & 0xff) == 0xf0)
-				sym = 10;
-			else if ((code & 0xff) == 0xf4)
-				sym = 13;
-			else if ((code & 0xff) == 0xf8)
-				sym = 22;
-			else { // 0xfc : EOS
+
+		while (bits >= 11 && out_end - out >= 2) {
+			e = &rht_bit31_21[code >> 53];
+			if (!e->n)
 				break;
-			}
+			out[0] = e->c[0];
+			out[1] = e->c[1];
+			out += e->n;
+			code <<= e->l;
+			bits -= e->l;
 		}
 
-		if (!l || bleft - l < 0)
+		if (out == out_end)
+			break;
+
+		/* long codes need up to 30 bits, refill first if possible */
+		if (bits < 32 && huff < huff_end)
+			continue;
+
+		if (!bits)
+			break;
+
+		l = huff_dec_one(code >> 32, &sym);
+		if (!l || l > bits)
 			break;
 
-		bleft -= l;
-		shift += l;
+		bits -= l;
+		code <<= l;
 		*out++ = sym;
 	}
 
-	if (bleft > 0) {
+	if (bits > 0 || huff < huff_end) {
 		/* some bits were not consumed after the last code, they must
 		 * match EOS (ie: all ones) and there must be 7 bits or less.
 		 * (7541#5.2).
 		 */
-		if (bleft > 7)
+		if (bits > 7 || huff < huff_end)
 			return -1;
 
-		if ((code & -(1 << (32 - bleft))) != (uint32_t)-(1 << (32 - bleft)))
+		if ((code >> (64 - bits)) != (1ULL << bits) - 1)
 			return -1;
 	}
 
@@ -169,6 +169,8 @@ static struct hpack_dht *hpack_dht_defrag(struct hpack_dht *dht)
 	if (!alt_dht)
 		return NULL;
 
+	/* the table may be smaller than the pool's objects (e.g. encoder) */
+	alt_dht->size = dht->size;
 	alt_dht->total = dht->total;
 	alt_dht->used = dht->used;
 	alt_dht->wrap = dht->used;
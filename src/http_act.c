@@ -195,167 +195,136 @@ static enum act_parse_ret parse_set_req_line(const char **args, int *orig_arg, s
 	return ACT_RET_PRS_OK;
 }
 
-/* This function executes the http-request normalize-uri action.
- * `rule->action` is expected to be a value from `enum act_normalize_uri`.
- *
- * On success, it returns ACT_RET_CONT. If an error
- * occurs while soft rewrites are enabled, the action is canceled, but the rule
- * processing continue. Otherwsize ACT_RET_ERR is returned.
+/* Applies the normalizer <norm> to <uri>, which holds the path, the query
+ * string and the fragment of a request URI. The result is built in <dst>,
+ * which must not hold <uri>, though it may also end up pointing into <uri>'s
+ * area when the normalizer only has to shorten it. On success <uri> is updated
+ * and URI_NORMALIZER_ERR_NONE is returned, otherwise it is left untouched.
  */
-static enum act_return http_action_normalize_uri(struct act_rule *rule, struct proxy *px,
-                                                 struct session *sess, struct stream *s, int flags)
+static enum uri_normalizer_err http_normalize_uri(unsigned int norm, struct ist *uri, struct buffer *dst)
 {
-	enum act_return ret = ACT_RET_CONT;
-	struct htx *htx = htxbuf(&s->req.buf);
-	const struct ist uri = htx_sl_req_uri(http_get_stline(htx));
-	struct buffer *replace = alloc_trash_chunk();
+	struct ist out = ist2(dst->area, dst->size);
 	enum uri_normalizer_err err = URI_NORMALIZER_ERR_INTERNAL_ERROR;
 
-	if (!replace)
-		goto fail_alloc;
-
-	switch ((enum act_normalize_uri) rule->action) {
-		case ACT_NORMALIZE_URI_PATH_MERGE_SLASHES: {
-			const struct ist path = http_get_path(uri);
-			struct ist newpath = ist2(replace->area, replace->size);
-
-			if (!isttest(path))
-				goto leave;
-
-			err = uri_normalizer_path_merge_slashes(iststop(path, '?'), &newpath);
-
-			if (err != URI_NORMALIZER_ERR_NONE)
-				break;
-
-			if (!http_replace_req_path(htx, newpath, 0))
-				goto fail_rewrite;
-
-			break;
-		}
-		case ACT_NORMALIZE_URI_PATH_STRIP_DOT: {
-			const struct ist path = http_get_path(uri);
-			struct ist newpath = ist2(replace->area, replace->size);
-
-			if (!isttest(path))
-				goto leave;
-
-			err = uri_normalizer_path_dot(iststop(path, '?'), &newpath);
-
-			if (err != URI_NORMALIZER_ERR_NONE)
-				break;
-
-			if (!http_replace_req_path(htx, newpath, 0))
-				goto fail_rewrite;
-
-			break;
-		}
+	switch ((enum act_normalize_uri)norm) {
+		case ACT_NORMALIZE_URI_PATH_MERGE_SLASHES:
+		case ACT_NORMALIZE_URI_PATH_STRIP_DOT:
 		case ACT_NORMALIZE_URI_PATH_STRIP_DOTDOT:
 		case ACT_NORMALIZE_URI_PATH_STRIP_DOTDOT_FULL: {
-			const struct ist path = http_get_path(uri);
-			struct ist newpath = ist2(replace->area, replace->size);
-
-			if (!isttest(path))
-				goto leave;
-
-			err = uri_normalizer_path_dotdot(iststop(path, '?'), rule->action == ACT_NORMALIZE_URI_PATH_STRIP_DOTDOT_FULL, &newpath);
+			/* only the path is normalized, the query-string is
+			 * appended to it unmodified.
+			 */
+			const struct ist path = iststop(*uri, '?');
+			const struct ist qs = istadv(*uri, istlen(path));
+
+			if (istlen(qs) > istlen(out))
+				return URI_NORMALIZER_ERR_ALLOC;
+			out.len -= istlen(qs);
+
+			if (norm == ACT_NORMALIZE_URI_PATH_MERGE_SLASHES)
+				err = uri_normalizer_path_merge_slashes(path, &out);
+			else if (norm == ACT_NORMALIZE_URI_PATH_STRIP_DOT)
+				err = uri_normalizer_path_dot(path, &out);
+			else
+				err = uri_normalizer_path_dotdot(path, norm == ACT_NORMALIZE_URI_PATH_STRIP_DOTDOT_FULL, &out);
 
 			if (err != URI_NORMALIZER_ERR_NONE)
-				break;
-
-			if (!http_replace_req_path(htx, newpath, 0))
-				goto fail_rewrite;
+				return err;
 
+			memcpy(istend(out), istptr(qs), istlen(qs));
+			out.len += istlen(qs);
 			break;
 		}
 		case ACT_NORMALIZE_URI_QUERY_SORT_BY_NAME: {
-			const struct ist path = http_get_path(uri);
-			struct ist newquery = ist2(replace->area, replace->size);
+			const struct ist query = istfind(*uri, '?');
+			const size_t plen = istlen(*uri) - istlen(query);
 
-			if (!isttest(path))
-				goto leave;
+			if (!istlen(query))
+				return URI_NORMALIZER_ERR_NONE;
 
-			err = uri_normalizer_query_sort(istfind(path, '?'), '&', &newquery);
+			if (plen > istlen(out))
+				return URI_NORMALIZER_ERR_ALLOC;
 
+			/* the path is copied first, followed by the sorted query */
+			memcpy(istptr(out), istptr(*uri), plen);
+			out = istadv(out, plen);
+			err = uri_normalizer_query_sort(query, '&', &out);
 			if (err != URI_NORMALIZER_ERR_NONE)
-				break;
-
-			if (!http_replace_req_query(htx, newquery))
-				goto fail_rewrite;
+				return err;
 
+			out = ist2(dst->area, plen + istlen(out));
 			break;
 		}
 		case ACT_NORMALIZE_URI_PERCENT_TO_UPPERCASE:
-		case ACT_NORMALIZE_URI_PERCENT_TO_UPPERCASE_STRICT: {
-			const struct ist path = http_get_path(uri);
-			struct ist newpath = ist2(replace->area, replace->size);
-
-			if (!isttest(path))
-				goto leave;
-
-			err = uri_normalizer_percent_upper(path, rule->action == ACT_NORMALIZE_URI_PERCENT_TO_UPPERCASE_STRICT, &newpath);
-
-			if (err != URI_NORMALIZER_ERR_NONE)
-				break;
-
-			if (!http_replace_req_path(htx, newpath, 1))
-				goto fail_rewrite;
-
+		case ACT_NORMALIZE_URI_PERCENT_TO_UPPERCASE_STRICT:
+			err = uri_normalizer_percent_upper(*uri, norm == ACT_NORMALIZE_URI_PERCENT_TO_UPPERCASE_STRICT, &out);
 			break;
-		}
 		case ACT_NORMALIZE_URI_PERCENT_DECODE_UNRESERVED:
-		case ACT_NORMALIZE_URI_PERCENT_DECODE_UNRESERVED_STRICT: {
-			const struct ist path = http_get_path(uri);
-			struct ist newpath = ist2(replace->area, replace->size);
-
-			if (!isttest(path))
-				goto leave;
-
-			err = uri_normalizer_percent_decode_unreserved(path, rule->action == ACT_NORMALIZE_URI_PERCENT_DECODE_UNRESERVED_STRICT, &newpath);
-
-			if (err != URI_NORMALIZER_ERR_NONE)
-				break;
-
-			if (!http_replace_req_path(htx, newpath, 1))
-				goto fail_rewrite;
-
+		case ACT_NORMALIZE_URI_PERCENT_DECODE_UNRESERVED_STRICT:
+			err = uri_normalizer_percent_decode_unreserved(*uri, norm == ACT_NORMALIZE_URI_PERCENT_DECODE_UNRESERVED_STRICT, &out);
 			break;
-		}
-		case ACT_NORMALIZE_URI_FRAGMENT_STRIP: {
-			const struct ist path = http_get_path(uri);
-			struct ist newpath = ist2(replace->area, replace->size);
-
-			if (!isttest(path))
-				goto leave;
-
-			err = uri_normalizer_fragment_strip(path, &newpath);
-
-			if (err != URI_NORMALIZER_ERR_NONE)
-				break;
-
-			if (!http_replace_req_path(htx, newpath, 1))
-				goto fail_rewrite;
-
+		case ACT_NORMALIZE_URI_FRAGMENT_STRIP:
+			err = uri_normalizer_fragment_strip(*uri, &out);
 			break;
-		}
-		case ACT_NORMALIZE_URI_FRAGMENT_ENCODE: {
-			const struct ist path = http_get_path(uri);
-			struct ist newpath = ist2(replace->area, replace->size);
+		case ACT_NORMALIZE_URI_FRAGMENT_ENCODE:
+			err = uri_normalizer_fragment_encode(*uri, &out);
+			break;
+	}
 
-			if (!isttest(path))
-				goto leave;
+	if (err == URI_NORMALIZER_ERR_NONE)
+		*uri = out;
+	return err;
+}
 
-			err = uri_normalizer_fragment_encode(path, &newpath);
+/* This function executes the http-request normalize-uri action.
+ * `rule->action` is expected to be a value from `enum act_normalize_uri`,
+ * unless consecutive rules were merged into this one, in which case all the
+ * normalizers are listed in `rule->arg.normalize_uri`. They are applied one
+ * after the other, alternating between two chunks, and the request URI is
+ * rewritten only once at the end if it was changed.
+ *
+ * On success, it returns ACT_RET_CONT. If an error
+ * occurs while soft rewrites are enabled, the action is canceled, but the rule
+ * processing continue. Otherwsize ACT_RET_ERR is returned.
+ */
+static enum act_return http_action_normalize_uri(struct act_rule *rule, struct proxy *px,
+                                                 struct session *sess, struct stream *s, int flags)
+{
+	enum act_return ret = ACT_RET_CONT;
+	struct htx *htx = htxbuf(&s->req.buf);
+	const struct ist uri = htx_sl_req_uri(http_get_stline(htx));
+	const struct ist path = http_get_path(uri);
+	const unsigned int *norms = rule->arg.normalize_uri.nb ? rule->arg.normalize_uri.list : &rule->action;
+	const unsigned int nb = rule->arg.normalize_uri.nb ? rule->arg.normalize_uri.nb : 1;
+	struct buffer *chunks[2] = { NULL, NULL };
+	enum uri_normalizer_err err = URI_NORMALIZER_ERR_NONE;
+	struct ist newpath = path;
+	unsigned int i;
+
+	if (!isttest(path))
+		goto leave;
 
-			if (err != URI_NORMALIZER_ERR_NONE)
-				break;
+	for (i = 0; i < nb; i++) {
+		/* write into the chunk not holding the current path */
+		int idx = (chunks[0] &&
+		           istptr(newpath) >= b_orig(chunks[0]) &&
+		           istptr(newpath) <= b_orig(chunks[0]) + b_size(chunks[0]));
 
-			if (!http_replace_req_path(htx, newpath, 1))
-				goto fail_rewrite;
+		if (!chunks[idx]) {
+			chunks[idx] = alloc_trash_chunk();
+			if (!chunks[idx])
+				goto fail_alloc;
+		}
 
+		err = http_normalize_uri(norms[i], &newpath, chunks[idx]);
+		if (err != URI_NORMALIZER_ERR_NONE)
 			break;
-		}
 	}
 
+	/* the normalizations performed before a failure are still applied */
+	if (!isteq(newpath, path) && !http_replace_req_path(htx, newpath, 1))
+		goto fail_rewrite;
+
 	switch (err) {
 	case URI_NORMALIZER_ERR_NONE:
 		break;
@@ -370,7 +339,8 @@ static enum act_return http_action_normalize_uri(struct act_rule *rule, struct p
 	}
 
   leave:
-	free_trash_chunk(replace);
+	free_trash_chunk(chunks[0]);
+	free_trash_chunk(chunks[1]);
 	return ret;
 
   fail_alloc:
@@ -396,6 +366,54 @@ static enum act_return http_action_normalize_uri(struct act_rule *rule, struct p
 	goto leave;
 }
 
+/* Release the normalizers list of merged http-request normalize-uri rules */
+static void release_http_normalize_uri(struct act_rule *rule)
+{
+	free(rule->arg.normalize_uri.list);
+}
+
+/* Check function for the http-request normalize-uri action. Unconditional
+ * normalize-uri rules immediately following this one, if also unconditional,
+ * are merged into it so that all their normalizers are applied in a single
+ * pass with a single rewrite of the request URI. The merged rules are removed
+ * from the list. It returns 1 on success, otherwise 0 with <err> filled.
+ */
+static int check_http_normalize_uri(struct act_rule *rule, struct proxy *px, char **err)
+{
+	struct act_rule *next;
+	unsigned int nb = 1;
+	unsigned int i;
+
+	if (rule->cond)
+		return 1;
+
+	for (next = LIST_NEXT(&rule->list, struct act_rule *, list);
+	     &next->list != &px->http_req_rules &&
+	     next->action_ptr == http_action_normalize_uri && !next->cond;
+	     next = LIST_NEXT(&next->list, struct act_rule *, list))
+		nb++;
+
+	if (nb == 1)
+		return 1;
+
+	rule->arg.normalize_uri.list = calloc(nb, sizeof(*rule->arg.normalize_uri.list));
+	if (!rule->arg.normalize_uri.list) {
+		memprintf(err, "out of memory while merging normalize-uri rules");
+		return 0;
+	}
+
+	rule->arg.normalize_uri.list[0] = rule->action;
+	for (i = 1; i < nb; i++) {
+		next = LIST_NEXT(&rule->list, struct act_rule *, list);
+		rule->arg.normalize_uri.list[i] = next->action;
+		LIST_DELETE(&next->list);
+		free(next);
+	}
+	rule->arg.normalize_uri.nb = nb;
+	rule->release_ptr = release_http_normalize_uri;
+	return 1;
+}
+
 /* Parses the http-request normalize-uri action. It expects a single <normalizer>
  * argument, corresponding too a value in `enum act_normalize_uri`.
  *
@@ -407,7 +425,10 @@ static enum act_parse_ret parse_http_normalize_uri(const char **args, int *orig_
 	int cur_arg = *orig_arg;
 
 	rule->action_ptr = http_action_normalize_uri;
+	rule->check_ptr = check_http_normalize_uri;
 	rule->release_ptr = NULL;
+	rule->arg.normalize_uri.list = NULL;
+	rule->arg.normalize_uri.nb = 0;
 
 	if (!*args[cur_arg]) {
 		memprintf(err, "missing argument <normalizer>");
@@ -2125,26 +2146,22 @@ static enum act_return http_action_track_sc(struct act_rule *rule, struct proxy
 	}
 
 	if (ptr1 || ptr2 || ptr3 || ptr4 || ptr5 || ptr6) {
-		HA_RWLOCK_WRLOCK(STK_SESS_LOCK, &ts->lock);
-
 		if (ptr1)
-			stktable_data_cast(ptr1, http_req_cnt)++;
+			HA_ATOMIC_INC(&stktable_data_cast(ptr1, http_req_cnt));
 		if (ptr2)
 			update_freq_ctr_period(&stktable_data_cast(ptr2, http_req_rate),
 					       t->data_arg[STKTABLE_DT_HTTP_REQ_RATE].u, 1);
 		if (ptr3)
-			stktable_data_cast(ptr3, http_err_cnt)++;
+			HA_ATOMIC_INC(&stktable_data_cast(ptr3, http_err_cnt));
 		if (ptr4)
 			update_freq_ctr_period(&stktable_data_cast(ptr4, http_err_rate),
 					       t->data_arg[STKTABLE_DT_HTTP_ERR_RATE].u, 1);
 		if (ptr5)
-			stktable_data_cast(ptr5, http_fail_cnt)++;
+			HA_ATOMIC_INC(&stktable_data_cast(ptr5, http_fail_cnt));
 		if (ptr6)
 			update_freq_ctr_period(&stktable_data_cast(ptr6, http_fail_rate),
 					       t->data_arg[STKTABLE_DT_HTTP_FAIL_RATE].u, 1);
 
-		HA_RWLOCK_WRUNLOCK(STK_SESS_LOCK, &ts->lock);
-
 		/* If data was modified, we need to touch to re-schedule sync */
 		stktable_touch_local(t, ts, 0);
 	}
@@ -1076,11 +1076,22 @@ int http_request_forward_body(struct stream *s, struct channel *req, int an_bit)
 	 */
 	if (HAS_REQ_DATA_FILTERS(s)) {
 		ret  = flt_http_payload(s, msg, htx->data);
-		if (ret < 0)
+		if (ret < 0) {
+			/* a filter rejecting the request may provide the reply */
+			if (txn->http_reply && txn->status <= 0) {
+				status = txn->http_reply->status;
+				goto return_prx_cond;
+			}
 			goto return_bad_req;
+		}
 		c_adv(req, ret);
 	}
-	else {
+
+	/* There may be no more data filters if the last ones unregistered
+	 * during the call above. In this case, the data are forwarded right
+	 * now so that the channel may be spliced or zero-copy forwarded.
+	 */
+	if (!HAS_REQ_DATA_FILTERS(s)) {
 		c_adv(req, htx->data - co_data(req));
 		if (msg->flags & HTTP_MSGF_XFER_LEN)
 			channel_htx_forward_forever(req, htx);
@@ -1312,6 +1323,18 @@ static __inline int do_l7_retry(struct stream *s, struct stream_interface *si)
 	return 0;
 }
 
+/* Returns non-zero if the request of stream <s> may be sent again to another
+ * server when no response arrives within the "timeout hedge" delay. Only GET
+ * and HEAD requests are concerned, and the request must have been kept for L7
+ * retries.
+ */
+static inline int http_may_hedge(const struct stream *s)
+{
+	return tick_isset(s->be->timeout.hedge) &&
+	       (s->si[1].flags & SI_FL_L7_RETRY) &&
+	       (s->txn->meth == HTTP_METH_GET || s->txn->meth == HTTP_METH_HEAD);
+}
+
 /* This stream analyser waits for a complete HTTP response. It returns 1 if the
  * processing can continue on next analysers, or zero if it either needs more
  * data or wants to immediately abort the response (eg: timeout, error, ...). It
@@ -1519,6 +1542,24 @@ int http_wait_for_response(struct stream *s, struct channel *rep, int an_bit)
 			return 0;
 		}
 
+		/* 6: no response yet, the request may be sent to another
+		 * server once the hedging delay is elapsed.
+		 */
+		else if (http_may_hedge(s)) {
+			if (!tick_isset(rep->analyse_exp))
+				rep->analyse_exp = tick_add(now_ms, s->be->timeout.hedge);
+			else if (tick_is_expired(rep->analyse_exp, now_ms) && !co_data(rep)) {
+				if (do_l7_retry(s, si_b) == 0) {
+					DBG_TRACE_DEVEL("leaving on L7 retry (hedge)",
+							STRM_EV_STRM_ANA|STRM_EV_HTTP_ANA, s, txn);
+					return 0;
+				}
+				/* no more retries, wait for this server */
+				si_b->flags &= ~SI_FL_L7_RETRY;
+				rep->analyse_exp = TICK_ETERNITY;
+			}
+		}
+
 		channel_dont_close(rep);
 		rep->flags |= CF_READ_DONTWAIT; /* try to get back here ASAP */
 		DBG_TRACE_DEVEL("waiting for more data",
@@ -1543,6 +1584,8 @@ int http_wait_for_response(struct stream *s, struct channel *rep, int an_bit)
 
 	/* Now, L7 buffer is useless, it can be released */
 	b_free(&s->si[1].l7_buffer);
+	if (tick_isset(s->be->timeout.hedge))
+		rep->analyse_exp = TICK_ETERNITY;
 
 	msg->msg_state = HTTP_MSG_BODY;
 
@@ -1602,7 +1645,8 @@ int http_wait_for_response(struct stream *s, struct channel *rep, int an_bit)
 
 	if (objt_server(s->target)) {
 		_HA_ATOMIC_INC(&__objt_server(s->target)->counters.p.http.rsp[n]);
-		_HA_ATOMIC_INC(&__objt_server(s->target)->counters.p.http.cum_req);
+		counters_add(__objt_server(s->target)->counters.shards, THR_CTR_CUM_REQ,
+			     &__objt_server(s->target)->counters.p.http.cum_req, 1);
 	}
 
 	/* Adjust server's health based on status code. Note: status codes 501
@@ -2205,7 +2249,12 @@ int http_response_forward_body(struct stream *s, struct channel *res, int an_bit
 			goto return_bad_res;
 		c_adv(res, ret);
 	}
-	else {
+
+	/* There may be no more data filters if the last ones unregistered
+	 * during the call above. In this case, the data are forwarded right
+	 * now so that the channel may be spliced or zero-copy forwarded.
+	 */
+	if (!HAS_RSP_DATA_FILTERS(s)) {
 		c_adv(res, htx->data - co_data(res));
 		if (msg->flags & HTTP_MSGF_XFER_LEN)
 			channel_htx_forward_forever(res, htx);
@@ -2732,6 +2781,9 @@ static enum rule_result http_req_get_intercept_rule(struct proxy *px, struct lis
 	enum rule_result rule_ret = HTTP_RULE_RES_CONT;
 	int act_opts = 0;
 
+	/* samples fetched by the conditions may be reused until an action runs */
+	acl_cache_start(s);
+
 	/* If "the current_rule_list" match the executed rule list, we are in
 	 * resume condition. If a resume is needed it is always in the action
 	 * and never in the ACL or converters. In this case, we initialise the
@@ -2765,6 +2817,7 @@ static enum rule_result http_req_get_intercept_rule(struct proxy *px, struct lis
 
 		act_opts |= ACT_OPT_FIRST;
   resume_execution:
+		acl_cache_flush(s);
 		if (rule->kw->flags & KWF_EXPERIMENTAL)
 			mark_tainted(TAINTED_ACTION_EXP_EXECUTED);
 
@@ -2803,6 +2856,8 @@ static enum rule_result http_req_get_intercept_rule(struct proxy *px, struct lis
 					rule_ret = HTTP_RULE_RES_BADREQ;
 					goto end;
 			}
+			/* the action may have evaluated conditions on its own */
+			acl_cache_flush(s);
 			continue; /* eval the next rule */
 		}
 
@@ -2858,6 +2913,8 @@ static enum rule_result http_req_get_intercept_rule(struct proxy *px, struct lis
 	if (rule_ret != HTTP_RULE_RES_YIELD)
 		txn->req.flags &= ~HTTP_MSGF_SOFT_RW;
 
+	acl_cache_stop(s);
+
 	/* we reached the end of the rules, nothing to report */
 	return rule_ret;
 }
@@ -2880,6 +2937,9 @@ static enum rule_result http_res_get_intercept_rule(struct proxy *px, struct lis
 	enum rule_result rule_ret = HTTP_RULE_RES_CONT;
 	int act_opts = 0;
 
+	/* samples fetched by the conditions may be reused until an action runs */
+	acl_cache_start(s);
+
 	/* If "the current_rule_list" match the executed rule list, we are in
 	 * resume condition. If a resume is needed it is always in the action
 	 * and never in the ACL or converters. In this case, we initialise the
@@ -2913,6 +2973,7 @@ static enum rule_result http_res_get_intercept_rule(struct proxy *px, struct lis
 
 		act_opts |= ACT_OPT_FIRST;
 resume_execution:
+		acl_cache_flush(s);
 		if (rule->kw->flags & KWF_EXPERIMENTAL)
 			mark_tainted(TAINTED_ACTION_EXP_EXECUTED);
 
@@ -2951,6 +3012,8 @@ static enum rule_result http_res_get_intercept_rule(struct proxy *px, struct lis
 					rule_ret = HTTP_RULE_RES_BADREQ;
 					goto end;
 			}
+			/* the action may have evaluated conditions on its own */
+			acl_cache_flush(s);
 			continue; /* eval the next rule */
 		}
 
@@ -2999,6 +3062,8 @@ static enum rule_result http_res_get_intercept_rule(struct proxy *px, struct lis
 	if (rule_ret != HTTP_RULE_RES_YIELD)
 		txn->rsp.flags &= ~HTTP_MSGF_SOFT_RW;
 
+	acl_cache_stop(s);
+
 	/* we reached the end of the rules, nothing to report */
 	return rule_ret;
 }
@@ -3019,7 +3084,7 @@ int http_eval_after_res_rules(struct stream *s)
 
 	/* prune the request variables if not already done and swap to the response variables. */
 	if (s->vars_reqres.scope != SCOPE_RES) {
-		if (!LIST_ISEMPTY(&s->vars_reqres.head))
+		if (!vars_is_empty(&s->vars_reqres))
 			vars_prune(&s->vars_reqres, s->sess, s);
 		vars_init(&s->vars_reqres, SCOPE_RES);
 	}
@@ -3948,6 +4013,17 @@ static int http_handle_stats(struct stream *s, struct channel *req)
 		}
 	}
 
+	for (h = lookup; h <= end - 7; h++) {
+		if (memcmp(h, ";since=", 7) == 0) {
+			unsigned long long epoch = 0;
+
+			for (h += 7; h < end && isdigit((unsigned char)*h); h++)
+				epoch = epoch * 10 + *h - '0';
+			appctx->ctx.stats.since = stats_since_from_epoch(epoch);
+			break;
+		}
+	}
+
 	if (uri_auth->refresh) {
 		for (h = lookup; h <= end - 10; h++) {
 			if (memcmp(h, ";norefresh", 10) == 0) {
@@ -4625,11 +4701,19 @@ void http_reply_and_close(struct stream *s, short status, struct http_reply *msg
 
 struct http_reply *http_error_message(struct stream *s)
 {
-	const int msgnum = http_get_status_idx(s->txn->status);
-
 	if (s->txn->http_reply)
 		return s->txn->http_reply;
-	else if (s->be->replies[msgnum])
+	return http_error_reply(s, s->txn->status);
+}
+
+/* Returns the error reply of stream <s> for status <status>, looked up in the
+ * backend then in the frontend before falling back to the default one.
+ */
+struct http_reply *http_error_reply(struct stream *s, int status)
+{
+	const int msgnum = http_get_status_idx(status);
+
+	if (s->be->replies[msgnum])
 		return s->be->replies[msgnum];
 	else if (strm_fe(s)->replies[msgnum])
 		return strm_fe(s)->replies[msgnum];
@@ -4674,7 +4758,12 @@ int http_reply_to_htx(struct stream *s, struct htx *htx, struct http_reply *repl
 		}
 	}
 
-	if (reply->type == HTTP_REPLY_ERRMSG) {
+	if (!b_is_null(&reply->tmpl)) {
+		/* constant reply, built once for all */
+		if (!htx_copy_msg(htx, &reply->tmpl))
+			goto fail;
+	}
+	else if (reply->type == HTTP_REPLY_ERRMSG) {
 		/* implicit or explicit error message*/
 		errmsg = reply->body.errmsg;
 		if (errmsg && !b_is_null(errmsg)) {
@@ -5128,7 +5217,9 @@ struct http_txn *http_create_txn(struct stream *s)
 	txn->flags = ((cs && cs->flags & CS_FL_NOT_FIRST) ? TX_NOT_FIRST : 0);
 	txn->status = -1;
 	txn->http_reply = NULL;
+	txn->req_body = NULL;
 	write_u32(txn->cache_hash, 0);
+	txn->cache_name = NULL;
 
 	txn->cookie_first_date = 0;
 	txn->cookie_last_date = 0;
@@ -5167,9 +5258,9 @@ void http_destroy_txn(struct stream *s)
 	txn->srv_cookie = NULL;
 	txn->cli_cookie = NULL;
 
-	if (!LIST_ISEMPTY(&s->vars_txn.head))
+	if (!vars_is_empty(&s->vars_txn))
 		vars_prune(&s->vars_txn, s->sess, s);
-	if (!LIST_ISEMPTY(&s->vars_reqres.head))
+	if (!vars_is_empty(&s->vars_reqres))
 		vars_prune(&s->vars_reqres, s->sess, s);
 
 	pool_free(pool_head_http_txn, txn);
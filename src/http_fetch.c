@@ -579,11 +579,22 @@ static int smp_fetch_body(const struct arg *args, struct sample *smp, const char
 	/* possible keywords: req.body, res.body */
 	struct channel *chn = ((kw[2] == 'q') ? SMP_REQ_CHN(smp) : SMP_RES_CHN(smp));
 	struct check *check = ((kw[2] == 's') ? objt_check(smp->sess->origin) : NULL);
-	struct htx *htx = smp_prefetch_htx(smp, chn, check, 1);
+	struct htx *htx;
 	struct buffer *temp;
 	int32_t pos;
 	int finished = 0;
 
+	/* the body-inspect filter provides the part it is inspecting, the
+	 * start-line being already forwarded.
+	 */
+	if (kw[2] == 'q' && smp->strm && smp->strm->txn && smp->strm->txn->req_body) {
+		smp->data.type = SMP_T_BIN;
+		smp->data.u.str = *smp->strm->txn->req_body;
+		smp->flags = SMP_F_VOL_TEST | SMP_F_CONST;
+		return 1;
+	}
+
+	htx = smp_prefetch_htx(smp, chn, check, 1);
 	if (!htx)
 		return 0;
 
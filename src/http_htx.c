@@ -1034,9 +1034,104 @@ void release_http_reply(struct http_reply *http_reply)
 			free(lf);
 		}
 	}
+	chunk_destroy(&http_reply->tmpl);
 	free(http_reply);
 }
 
+/* Appends to <out> the string built from log-format list <fmt> if it only
+ * contains text and separators, the same way build_logline() would do it.
+ * Returns 1 on success, or 0 if the list references any sample or if <out>
+ * is too small.
+ */
+static int http_reply_const_fmt(const struct list *fmt, struct buffer *out)
+{
+	const struct logformat_node *lf;
+	int last_isspace = 1;
+
+	list_for_each_entry(lf, fmt, list) {
+		if (lf->type == LOG_FMT_SEPARATOR) {
+			if (!last_isspace && !chunk_memcat(out, " ", 1))
+				return 0;
+			last_isspace = 1;
+		}
+		else if (lf->type == LOG_FMT_TEXT) {
+			if (!chunk_memcat(out, lf->arg, strlen(lf->arg)))
+				return 0;
+			last_isspace = !!(lf->options & LOG_OPT_TXT_SEP);
+		}
+		else
+			return 0;
+	}
+	return 1;
+}
+
+/* Pre-builds the HTX message of reply <reply> when it does not depend on the
+ * stream, i.e. when it has no payload or a raw one, and no header value built
+ * from a sample. http_reply_to_htx() then copies it at once instead of
+ * building it on each use. Nothing is done on failure, the message is then
+ * built on each use.
+ */
+void http_reply_prebuild(struct http_reply *reply)
+{
+	struct http_reply_hdr *hdr;
+	struct buffer *value = NULL;
+	struct buffer *body = NULL;
+	struct buffer buf = BUF_NULL;
+	struct htx *htx;
+	struct htx_sl *sl;
+	const char *clen;
+	unsigned int flags;
+
+	if (!b_is_null(&reply->tmpl))
+		return;
+
+	if (reply->type == HTTP_REPLY_RAW)
+		body = &reply->body.obj;
+	else if (reply->type != HTTP_REPLY_EMPTY)
+		return;
+
+	value = alloc_trash_chunk();
+	buf.area = malloc(global.tune.bufsize);
+	if (!value || !buf.area)
+		goto fail;
+	buf.size = global.tune.bufsize;
+	htx = htx_from_buf(&buf);
+
+	flags = (HTX_SL_F_IS_RESP|HTX_SL_F_VER_11|HTX_SL_F_XFER_LEN|HTX_SL_F_CLEN);
+	if (!body || !b_data(body))
+		flags |= HTX_SL_F_BODYLESS;
+	sl = htx_add_stline(htx, HTX_BLK_RES_SL, flags, ist("HTTP/1.1"),
+			    ist(ultoa(reply->status)), ist(http_get_reason(reply->status)));
+	if (!sl)
+		goto fail;
+	sl->info.res.status = reply->status;
+
+	list_for_each_entry(hdr, &reply->hdrs, list) {
+		chunk_reset(value);
+		if (!http_reply_const_fmt(&hdr->value, value))
+			goto fail;
+		if (b_data(value) && !htx_add_header(htx, hdr->name, ist2(b_head(value), b_data(value))))
+			goto fail;
+	}
+
+	clen = (body ? ultoa(b_data(body)) : "0");
+	if (!htx_add_header(htx, ist("content-length"), ist(clen)) ||
+	    (body && b_data(body) && reply->ctype && !htx_add_header(htx, ist("content-type"), ist(reply->ctype))) ||
+	    !htx_add_endof(htx, HTX_BLK_EOH) ||
+	    (body && b_data(body) && !htx_add_data_atonce(htx, ist2(b_head(body), b_data(body)))))
+		goto fail;
+
+	htx->flags |= HTX_FL_EOM;
+	htx_to_buf(htx, &buf);
+	reply->tmpl = buf;
+	free_trash_chunk(value);
+	return;
+
+  fail:
+	free(buf.area);
+	free_trash_chunk(value);
+}
+
 static int http_htx_init(void)
 {
 	struct buffer chk;
@@ -1357,6 +1452,8 @@ int http_check_http_reply(struct http_reply *reply, struct proxy *px, char **err
 	}
 
   end:
+	if (ret)
+		http_reply_prebuild(reply);
 	return ret;
 }
 
@@ -2050,9 +2147,14 @@ static int post_check_errors()
 {
 	struct ebpt_node *node;
 	struct http_error_msg *http_errmsg;
+	struct http_reply *reply;
 	struct htx *htx;
 	int err_code = ERR_NONE;
 
+	/* replies declared with "http-error" */
+	list_for_each_entry(reply, &http_replies_list, list)
+		http_reply_prebuild(reply);
+
 	node = ebpt_first(&http_error_messages);
 	while (node) {
 		http_errmsg = container_of(node, typeof(*http_errmsg), node);
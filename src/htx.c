@@ -10,76 +10,151 @@
  *
  */
 
+#include <haproxy/activity.h>
 #include <haproxy/chunk.h>
 #include <haproxy/htx.h>
 
 struct htx htx_empty = { .size = 0, .data = 0, .head  = -1, .tail = -1, .first = -1 };
 
 /* Defragments an HTX message. It removes unused blocks and unwraps the payloads
- * part. A temporary buffer is used to do so. This function never fails. Most of
- * time, we need keep a ref on a specific HTX block. Thus is <blk> is set, the
- * pointer on its new position, after defrag, is returned. In addition, if the
- * size of the block must be altered, <blkinfo> info must be provided (!=
- * 0). But in this case, it remains the caller responsibility to update the
- * block content.
+ * part. This function never fails. Most of time, we need keep a ref on a
+ * specific HTX block. Thus is <blk> is set, the pointer on its new position,
+ * after defrag, is returned. In addition, if the size of the block must be
+ * altered, <blkinfo> info must be provided (!= 0). But in this case, it remains
+ * the caller responsibility to update the block content.
+ *
+ * The payloads are packed in the blocks order, in place. Those which are
+ * already at the right address are not touched, and the other ones are moved
+ * directly as long as this does not overwrite a payload which was not moved
+ * yet. Only when this happens, the remaining payloads are moved through the
+ * trash. This way, only the part of the message after the first hole is
+ * moved, and it is only copied twice in the worst case. The amount of moved
+ * bytes is reported in the "htx_defrag_bytes" activity counter.
  */
 /* TODO: merge data blocks into one */
 struct htx_blk *htx_defrag(struct htx *htx, struct htx_blk *blk, uint32_t blkinfo)
 {
 	struct buffer *chunk = get_trash_chunk();
-	struct htx *tmp = htxbuf(chunk);
-	struct htx_blk *newblk, *oldblk;
-	uint32_t new, old, blkpos;
-	uint32_t addr, blksz;
-	int32_t first = -1;
+	uint32_t *lowest = (uint32_t *)chunk->area;
+	struct htx_blk *posblk, *newblk;
+	uint32_t addr, sz, newsz, blksz, low, moved;
+	int32_t pos, new, first, blkpos;
+	char *ptr;
 
 	if (htx->head == -1)
 		return NULL;
 
-	blkpos = -1;
-
-	new  = 0;
-	addr = 0;
-	tmp->size = htx->size;
-	tmp->data = 0;
-
-	/* start from the head */
-	for (old = htx_get_head(htx); old != -1; old = htx_get_next(htx, old)) {
-		oldblk = htx_get_blk(htx, old);
-		if (htx_get_blk_type(oldblk) == HTX_BLK_UNUSED)
+	/* First, remove the unused blocks from the blocks table, exactly like
+	 * htx_defrag_blks() does, but keeping track of <blk>.
+	 */
+	first = blkpos = -1;
+	new = 0;
+	for (pos = htx_get_head(htx); pos != -1; pos = htx_get_next(htx, pos)) {
+		posblk = htx_get_blk(htx, pos);
+		if (htx_get_blk_type(posblk) == HTX_BLK_UNUSED)
 			continue;
 
-		blksz = htx_get_blksz(oldblk);
-		memcpy((void *)tmp->blocks + addr, htx_get_blk_ptr(htx, oldblk), blksz);
-
-		/* update the start-line position */
-		if (htx->first == old)
+		if (htx->first == pos)
 			first = new;
-
-		newblk = htx_get_blk(tmp, new);
-		newblk->addr = addr;
-		newblk->info = oldblk->info;
-
-		/* if <blk> is defined, save its new position */
-		if (blk != NULL && blk == oldblk) {
-			if (blkinfo)
-				newblk->info = blkinfo;
+		if (posblk == blk)
 			blkpos = new;
-		}
 
-		blksz = htx_get_blksz(newblk);
-		addr += blksz;
-		tmp->data += blksz;
+		newblk = htx_get_blk(htx, new);
+		newblk->info = posblk->info;
+		newblk->addr = posblk->addr;
 		new++;
 	}
 
-	htx->data = tmp->data;
+	if (!new) {
+		uint32_t flags = htx->flags;
+
+		htx_reset(htx);
+		htx->flags = flags;
+		return NULL;
+	}
+
 	htx->first = first;
 	htx->head = 0;
 	htx->tail = new - 1;
+
+	/* For each position, find the lowest payload address among the
+	 * following blocks. It is the limit below which a payload may be moved
+	 * without overwriting one which was not moved yet. These limits never
+	 * use more room in the trash than the blocks do in the message.
+	 */
+	low = htx_pos_to_addr(htx, htx->tail);
+	for (pos = new; pos-- > 0; ) {
+		lowest[pos] = low;
+		posblk = htx_get_blk(htx, pos);
+		if (htx_get_blksz(posblk) && posblk->addr < low)
+			low = posblk->addr;
+	}
+
+	/* the new size of <blk>, if it changes */
+	blksz = 0;
+	if (blkpos != -1 && blkinfo) {
+		struct htx_blk tmpblk = { .info = blkinfo };
+
+		blksz = htx_get_blksz(&tmpblk);
+	}
+
+	addr = moved = 0;
+	for (pos = 0; pos < new; pos++) {
+		posblk = htx_get_blk(htx, pos);
+		sz = newsz = htx_get_blksz(posblk);
+		if (pos == blkpos && blkinfo)
+			newsz = blksz;
+
+		if (posblk->addr != addr || newsz > sz) {
+			if (addr + newsz > lowest[pos])
+				break;
+			if (posblk->addr != addr) {
+				memmove(htx->blocks + addr, htx->blocks + posblk->addr, MIN(sz, newsz));
+				posblk->addr = addr;
+				moved += sz;
+			}
+		}
+		if (pos == blkpos && blkinfo)
+			posblk->info = blkinfo;
+		addr += newsz;
+	}
+
+	if (pos < new) {
+		/* Some payloads are in the way. Save all the remaining ones
+		 * after the limits, then copy them back in order.
+		 */
+		int32_t start = pos;
+
+		ptr = (char *)&lowest[new];
+		for (pos = start; pos < new; pos++) {
+			posblk = htx_get_blk(htx, pos);
+			sz = htx_get_blksz(posblk);
+			memcpy(ptr, htx->blocks + posblk->addr, sz);
+			ptr += sz;
+		}
+
+		ptr = (char *)&lowest[new];
+		for (pos = start; pos < new; pos++) {
+			posblk = htx_get_blk(htx, pos);
+			sz = newsz = htx_get_blksz(posblk);
+			if (pos == blkpos && blkinfo) {
+				newsz = blksz;
+				posblk->info = blkinfo;
+			}
+			memcpy(htx->blocks + addr, ptr, MIN(sz, newsz));
+			posblk->addr = addr;
+			ptr += sz;
+			addr += newsz;
+			moved += sz;
+		}
+	}
+
+	htx->data = addr;
 	htx->head_addr = htx->end_addr = 0;
 	htx->tail_addr = addr;
-	memcpy((void *)htx->blocks, (void *)tmp->blocks, htx->size);
+
+	activity[tid].htx_defrag++;
+	activity[tid].htx_defrag_bytes += moved;
 
 	return ((blkpos == -1) ? NULL : htx_get_blk(htx, blkpos));
 }
@@ -996,6 +1071,69 @@ size_t htx_add_data(struct htx *htx, const struct ist data)
 	return len;
 }
 
+/* Tries to move the <len> bytes of payload found at offset <ofs> in the raw
+ * buffer <raw> into the HTX message stored in <buf> without copying them,
+ * by exchanging both buffers' storage. This is only possible when the payload
+ * ends the buffer's contents, is contiguous and starts past the room needed
+ * for an HTX header, and when the HTX message is either empty or only made of
+ * a single DATA block small enough to be moved just before the payload. This
+ * is what happens all the time with large transfers on buffers pre-aligned
+ * for this purpose. The caller must then consume the data from <raw> as if
+ * they had been copied; <raw> now uses the former HTX storage. Returns the
+ * number of bytes moved, or zero if nothing could be done.
+ */
+size_t htx_xfer_raw_data(struct buffer *buf, struct buffer *raw, size_t ofs, size_t len)
+{
+	struct htx *htx = htxbuf(buf);
+	struct htx_blk *blk;
+	struct ist prev = IST_NULL;
+	size_t start, gap;
+	uint32_t flags;
+	uint64_t extra;
+	char *area;
+
+	start = b_head_ofs(raw) + ofs;
+	if (!len || ofs + len != b_data(raw) || b_size(raw) != b_size(buf) ||
+	    start < sizeof(struct htx) || start + len + sizeof(struct htx_blk) > b_size(raw))
+		return 0;
+
+	/* <gap> is the room available before the payload once aliased */
+	gap = start - sizeof(struct htx);
+	if (!htx_is_empty(htx)) {
+		blk = htx_get_head_blk(htx);
+		if (htx_nbblks(htx) != 1 || htx_get_blk_type(blk) != HTX_BLK_DATA)
+			return 0;
+		prev = htx_get_blk_value(htx, blk);
+		if (prev.len > gap)
+			return 0;
+	}
+
+	flags = htx->flags;
+	extra = htx->extra;
+
+	/* build the new message in place, then exchange the storage */
+	htx = (struct htx *)b_orig(raw);
+	htx->size = b_size(raw) - sizeof(*htx);
+	htx_reset(htx);
+	htx->flags = flags;
+	htx->extra = extra;
+
+	/* map a DATA block over the whole area then skip the unused part */
+	blk = htx_add_blk(htx, HTX_BLK_DATA, gap + len);
+	if (!blk)
+		return 0;
+	blk->info += gap + len;
+	htx_cut_data_blk(htx, blk, gap - prev.len);
+	if (prev.len)
+		memcpy(htx_get_blk_ptr(htx, blk), prev.ptr, prev.len);
+
+	area = raw->area;
+	raw->area = buf->area;
+	buf->area = area;
+	b_set_data(buf, b_size(buf));
+	return len;
+}
+
 
 /* Adds an HTX block of type DATA in <htx> just after all other DATA
  * blocks. Because it relies on htx_add_data_atonce(), It may be happened to a
@@ -0,0 +1,261 @@
+/*
+ * Per-thread approximate load-balancing mode for roundrobin and leastconn
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ *
+ * In this mode, each thread picks servers from its own view of the backend's
+ * usable servers without taking any lock. The views are rebuilt by each thread
+ * when it notices that a server's state or weight changed since its view was
+ * built. Round robin is done per thread using the smooth weighted round robin
+ * method, so the servers' weights are respected by each thread but the threads
+ * do not coordinate. Leastconn compares the servers' current number of served
+ * connections which is shared by all threads, but several threads may pick the
+ * same server at the same time. The underlying algorithm's structures are still
+ * maintained and are used if a view cannot be allocated.
+ *
+ */
+
+#include <haproxy/api.h>
+#include <haproxy/backend.h>
+#include <haproxy/errors.h>
+#include <haproxy/global.h>
+#include <haproxy/lb_fwlc.h>
+#include <haproxy/lb_fwrr.h>
+#include <haproxy/lb_local.h>
+#include <haproxy/proxy.h>
+#include <haproxy/queue.h>
+#include <haproxy/server-t.h>
+
+/* These wrappers call the underlying algorithm's callbacks then invalidate the
+ * threads' views. The server's lock must be held.
+ */
+static void lb_local_update_server_eweight(struct server *srv)
+{
+	struct proxy *p = srv->proxy;
+
+	p->lbprm.local.update_server_eweight(srv);
+	HA_ATOMIC_INC(&p->lbprm.local.gen);
+}
+
+static void lb_local_set_server_status_up(struct server *srv)
+{
+	struct proxy *p = srv->proxy;
+
+	p->lbprm.local.set_server_status_up(srv);
+	HA_ATOMIC_INC(&p->lbprm.local.gen);
+}
+
+static void lb_local_set_server_status_down(struct server *srv)
+{
+	struct proxy *p = srv->proxy;
+
+	p->lbprm.local.set_server_status_down(srv);
+	HA_ATOMIC_INC(&p->lbprm.local.gen);
+}
+
+/* Rebuilds the view <thr> of the current thread from the servers of proxy <p>.
+ * Only the active servers are used when there are some, otherwise the backup
+ * ones. The first server to consider depends on the thread number so that the
+ * threads do not all start with the same one. Returns 0 on success or -1 if
+ * the view could not be allocated.
+ */
+static int lb_local_rebuild(struct proxy *p, struct lb_local_thr *thr)
+{
+	struct lb_local_srv *view;
+	struct server *srv;
+	unsigned int gen, nb;
+	int flag;
+
+	/* the generation is read first so that any change happening during
+	 * the rebuild causes another one.
+	 */
+	gen = HA_ATOMIC_LOAD(&p->lbprm.local.gen);
+	__ha_barrier_load();
+
+	for (srv = p->srv, nb = 0; srv; srv = srv->next)
+		nb++;
+
+	if (nb > thr->size) {
+		view = realloc(thr->srv, nb * sizeof(*view));
+		if (!view)
+			return -1;
+		thr->srv = view;
+		thr->size = nb;
+	}
+
+	flag = p->srv_act ? 0 : SRV_F_BACKUP;
+	for (srv = p->srv, nb = 0; srv && nb < thr->size; srv = srv->next) {
+		if ((srv->flags & SRV_F_BACKUP) != flag || !srv_currently_usable(srv))
+			continue;
+		thr->srv[nb].srv    = srv;
+		thr->srv[nb].weight = srv->cur_eweight;
+		thr->srv[nb].cw     = 0;
+		nb++;
+	}
+
+	thr->nb = nb;
+	thr->next = nb ? tid % nb : 0;
+	thr->gen = gen;
+	return 0;
+}
+
+/* Picks the next server of view <thr> using the smooth weighted round robin
+ * method. Ties are broken by the order of the servers starting at the thread's
+ * first one. Saturated servers are skipped, and <srvtoavoid> is only returned
+ * if no other server is available. Returns NULL if no server is available.
+ */
+static struct server *lb_local_get_rr(struct lb_local_thr *thr, struct server *srvtoavoid)
+{
+	struct lb_local_srv *best = NULL, *avoided = NULL;
+	unsigned int i, n;
+	int total = 0;
+
+	for (n = 0, i = thr->next; n < thr->nb; n++, i++) {
+		struct lb_local_srv *e;
+		struct server *s;
+
+		if (i >= thr->nb)
+			i = 0;
+		e = &thr->srv[i];
+		s = e->srv;
+
+		if (s->maxconn && (s->nbpend || s->served >= srv_dynamic_maxconn(s)))
+			continue;
+
+		e->cw += e->weight;
+		total += e->weight;
+		if (s == srvtoavoid)
+			avoided = e;
+		else if (!best || e->cw > best->cw)
+			best = e;
+	}
+
+	if (!best)
+		best = avoided;
+	if (!best)
+		return NULL;
+
+	best->cw -= total;
+	return best->srv;
+}
+
+/* Picks the server of view <thr> with the lowest number of connections
+ * relative to its weight. The search starts after the last picked server so
+ * that ties are broken in turn. Saturated servers are skipped, and <srvtoavoid>
+ * is only returned if no other server is available. Returns NULL if no server
+ * is available.
+ */
+static struct server *lb_local_get_lc(struct lb_local_thr *thr, struct server *srvtoavoid)
+{
+	struct server *best = NULL, *avoided = NULL;
+	unsigned long long key, best_key = 0;
+	unsigned int i, n, best_idx = 0;
+
+	for (n = 0, i = thr->next; n < thr->nb; n++, i++) {
+		struct lb_local_srv *e;
+		struct server *s;
+
+		if (i >= thr->nb)
+			i = 0;
+		e = &thr->srv[i];
+		s = e->srv;
+
+		if (s->maxconn && s->served + s->nbpend >= srv_dynamic_maxconn(s) + s->maxqueue)
+			continue;
+
+		if (s == srvtoavoid) {
+			avoided = s;
+			continue;
+		}
+
+		key = (unsigned long long)SRV_EWGHT_MAX * (s->served + s->nbpend) / e->weight;
+		if (!best || key < best_key) {
+			best = s;
+			best_key = key;
+			best_idx = i;
+		}
+	}
+
+	if (!best)
+		return avoided;
+
+	thr->next = best_idx + 1;
+	return best;
+}
+
+/* Returns the next server of backend <p> according to the current thread's
+ * view, or NULL if no server is available. The view is rebuilt first if any
+ * server's state changed. If it cannot be rebuilt, the underlying algorithm is
+ * used instead. No lock is used.
+ */
+struct server *lb_local_get_next_server(struct proxy *p, struct server *srvtoavoid)
+{
+	struct lb_local_thr *thr = &p->lbprm.local.thr[tid];
+	int lc = (p->lbprm.algo & BE_LB_KIND) == BE_LB_KIND_CB;
+
+	if (!p->srv_act && p->lbprm.fbck)
+		return p->lbprm.fbck;
+
+	if (thr->gen != HA_ATOMIC_LOAD(&p->lbprm.local.gen) && lb_local_rebuild(p, thr) < 0)
+		return lc ? fwlc_get_next_server(p, srvtoavoid) : fwrr_get_next_server(p, srvtoavoid);
+
+	return lc ? lb_local_get_lc(thr, srvtoavoid) : lb_local_get_rr(thr, srvtoavoid);
+}
+
+/* Allocates the threads' views of proxy <p> and installs the callbacks which
+ * invalidate them, on top of the ones of the underlying algorithm which must
+ * already be initialized. The connection callbacks of leastconn are removed as
+ * the servers' number of connections is directly used. It should be called
+ * only once per proxy, at config time. Returns 0 on success, -1 on allocation
+ * failure.
+ */
+int lb_local_init(struct proxy *p)
+{
+	p->lbprm.local.thr = calloc(global.nbthread, sizeof(*p->lbprm.local.thr));
+	if (!p->lbprm.local.thr) {
+		ha_alert("failed to allocate the per-thread load balancing state of %s '%s'.\n",
+		         proxy_type_str(p), p->id);
+		return -1;
+	}
+
+	/* views start at generation zero, forcing a first build */
+	p->lbprm.local.gen = 1;
+
+	p->lbprm.local.update_server_eweight  = p->lbprm.update_server_eweight;
+	p->lbprm.local.set_server_status_up   = p->lbprm.set_server_status_up;
+	p->lbprm.local.set_server_status_down = p->lbprm.set_server_status_down;
+
+	p->lbprm.update_server_eweight  = lb_local_update_server_eweight;
+	p->lbprm.set_server_status_up   = lb_local_set_server_status_up;
+	p->lbprm.set_server_status_down = lb_local_set_server_status_down;
+
+	if ((p->lbprm.algo & BE_LB_KIND) == BE_LB_KIND_CB) {
+		p->lbprm.server_take_conn = NULL;
+		p->lbprm.server_drop_conn = NULL;
+	}
+	return 0;
+}
+
+/* Releases the threads' views of proxy <p>. */
+void lb_local_deinit(struct proxy *p)
+{
+	int i;
+
+	if (!p->lbprm.local.thr)
+		return;
+
+	for (i = 0; i < global.nbthread; i++)
+		free(p->lbprm.local.thr[i].srv);
+	ha_free(&p->lbprm.local.thr);
+}
+
+
+/*
+ * Local variables:
+ *  c-indent-level: 8
+ *  c-basic-offset: 8
+ * End:
+ */
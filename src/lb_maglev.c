@@ -0,0 +1,277 @@
+/*
+ * Maglev consistent hashing load-balancing
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ *
+ * This implements the lookup table of "Maglev: A Fast and Reliable Software
+ * Network Load Balancer" (Eisenbud et al., NSDI 2016). Each server walks its
+ * own permutation of the table's entries and the servers take turns claiming
+ * their next free entry, the number of turns being proportional to their
+ * weight. Servers are then picked by indexing the table with the hash, and a
+ * change of the servers' states only moves the entries of the servers which
+ * changed, plus a few others.
+ *
+ */
+
+#include <haproxy/api.h>
+#include <haproxy/backend.h>
+#include <haproxy/errors.h>
+#include <haproxy/lb_maglev.h>
+#include <haproxy/proxy.h>
+#include <haproxy/queue.h>
+#include <haproxy/server-t.h>
+#include <haproxy/tools.h>
+
+/* prime table sizes, the smallest one holding at least MAGLEV_ENTRIES_PER_SRV
+ * entries per server is used, so that the servers' shares differ by about
+ * one percent at most.
+ */
+#define MAGLEV_ENTRIES_PER_SRV 100
+static const unsigned int maglev_sizes[] = {
+	509, 1021, 2039, 4093, 8191, 16381, 32749, 65521, 131071, 262139, 524287, 1048573,
+};
+
+/* per-server state used while rebuilding the table */
+struct maglev_perm {
+	struct server *srv;
+	unsigned int pos;	/* next entry of the server's permutation */
+	unsigned int skip;	/* distance between two entries of the permutation */
+	unsigned int credit;	/* accumulated weight giving turns to claim entries */
+};
+
+/* Rebuilds the lookup table of proxy <p> from the next state of its servers,
+ * and updates the proxy's weights. The spare table is filled, then swapped
+ * with the current one under the lbprm's lock, so that lookups are only held
+ * during the swap. If the memory needed for the rebuild cannot be allocated,
+ * the previous table is kept.
+ *
+ * The lbprm's lock will be used.
+ */
+static void maglev_rebuild(struct proxy *p)
+{
+	struct lb_maglev *mgl = &p->lbprm.maglev;
+	struct maglev_perm *perm = NULL;
+	struct server *srv, **table;
+	unsigned int nb = 0, max = 0, filled = 0, i;
+	int flag = 0;
+
+	HA_SPIN_LOCK(LBPRM_LOCK, &mgl->lock);
+
+	/* only the active servers are used when there are some, otherwise the
+	 * first backup one or all of them, as for the other algorithms.
+	 */
+	for (srv = p->srv; srv; srv = srv->next) {
+		if (!(srv->flags & SRV_F_BACKUP) && srv_willbe_usable(srv))
+			nb++;
+	}
+
+	if (!nb) {
+		flag = SRV_F_BACKUP;
+		for (srv = p->srv; srv; srv = srv->next) {
+			if ((srv->flags & SRV_F_BACKUP) && srv_willbe_usable(srv))
+				nb++;
+		}
+		if (nb > 1 && !(p->options & PR_O_USE_ALL_BK))
+			nb = 1;
+	}
+
+	perm = calloc(nb ? nb : 1, sizeof(*perm));
+	if (!perm)
+		goto update;
+
+	i = 0;
+	for (srv = p->srv; srv && i < nb; srv = srv->next) {
+		if ((srv->flags & SRV_F_BACKUP) != flag || !srv_willbe_usable(srv))
+			continue;
+
+		perm[i].srv  = srv;
+		perm[i].pos  = full_hash(srv->puid) % mgl->size;
+		perm[i].skip = full_hash(~srv->puid) % (mgl->size - 1) + 1;
+		if (srv->next_eweight > max)
+			max = srv->next_eweight;
+		i++;
+	}
+
+	table = mgl->spare;
+	memset(table, 0, mgl->size * sizeof(*table));
+
+	/* the size being prime, each permutation visits all the entries. Each
+	 * round gives one turn to the heaviest servers and proportionally less
+	 * to the other ones.
+	 */
+	while (nb && filled < mgl->size) {
+		for (i = 0; i < nb && filled < mgl->size; i++) {
+			perm[i].credit += perm[i].srv->next_eweight;
+			while (perm[i].credit >= max && filled < mgl->size) {
+				perm[i].credit -= max;
+				while (table[perm[i].pos])
+					perm[i].pos = (perm[i].pos + perm[i].skip) % mgl->size;
+				table[perm[i].pos] = perm[i].srv;
+				perm[i].pos = (perm[i].pos + perm[i].skip) % mgl->size;
+				filled++;
+			}
+		}
+	}
+
+ update:
+	HA_RWLOCK_WRLOCK(LBPRM_LOCK, &p->lbprm.lock);
+	recount_servers(p);
+	update_backend_weight(p);
+	if (perm) {
+		mgl->spare = mgl->table;
+		mgl->table = table;
+	}
+	HA_RWLOCK_WRUNLOCK(LBPRM_LOCK, &p->lbprm.lock);
+
+	HA_SPIN_UNLOCK(LBPRM_LOCK, &mgl->lock);
+	free(perm);
+}
+
+/* This function updates the table according to server <srv>'s new state or
+ * weight. It is used for all the state changes since the whole table has to
+ * be rebuilt anyway.
+ *
+ * The server's lock must be held. The lbprm's lock will be used.
+ */
+static void maglev_update_server(struct server *srv)
+{
+	if (!srv_lb_status_changed(srv))
+		return;
+
+	maglev_rebuild(srv->proxy);
+	srv_lb_commit_status(srv);
+}
+
+/* This function is responsible for allocating the lookup tables of proxy <p>
+ * and building the first one. The tables are sized after the number of servers
+ * declared at this time. It should be called only once per proxy, at config
+ * time. Returns 0 on success, -1 on allocation failure.
+ */
+int maglev_init_server_table(struct proxy *p)
+{
+	struct server *srv;
+	unsigned int nb = 0;
+	int i;
+
+	p->lbprm.set_server_status_up   = maglev_update_server;
+	p->lbprm.set_server_status_down = maglev_update_server;
+	p->lbprm.update_server_eweight  = maglev_update_server;
+	p->lbprm.server_take_conn = NULL;
+	p->lbprm.server_drop_conn = NULL;
+
+	p->lbprm.wdiv = BE_WEIGHT_SCALE;
+	for (srv = p->srv; srv; srv = srv->next) {
+		srv->next_eweight = (srv->uweight * p->lbprm.wdiv + p->lbprm.wmult - 1) / p->lbprm.wmult;
+		srv_lb_commit_status(srv);
+		nb++;
+	}
+
+	for (i = 0; i < sizeof(maglev_sizes) / sizeof(*maglev_sizes) - 1; i++) {
+		if (maglev_sizes[i] >= nb * MAGLEV_ENTRIES_PER_SRV)
+			break;
+	}
+	p->lbprm.maglev.size = maglev_sizes[i];
+	p->lbprm.maglev.rr_idx = 0;
+	HA_SPIN_INIT(&p->lbprm.maglev.lock);
+
+	p->lbprm.maglev.table = calloc(p->lbprm.maglev.size, sizeof(*p->lbprm.maglev.table));
+	p->lbprm.maglev.spare = calloc(p->lbprm.maglev.size, sizeof(*p->lbprm.maglev.spare));
+	if (!p->lbprm.maglev.table || !p->lbprm.maglev.spare) {
+		ha_alert("failed to allocate the maglev table of %s '%s'.\n", proxy_type_str(p), p->id);
+		return -1;
+	}
+
+	maglev_rebuild(p);
+	return 0;
+}
+
+/*
+ * This function tries to find a running server with free connection slots for
+ * the proxy <p> following the round-robin method over the table's entries,
+ * which respects the servers' weights. If any server is found, it will be
+ * returned and the round robin index will be updated to point to the next
+ * entry. If no valid server is found, NULL is returned.
+ *
+ * The lbprm's lock will be used.
+ */
+struct server *maglev_get_next_server(struct proxy *p, struct server *srvtoavoid)
+{
+	struct lb_maglev *mgl = &p->lbprm.maglev;
+	unsigned int newidx, avoididx;
+	struct server *srv, *avoided;
+
+	HA_RWLOCK_SKLOCK(LBPRM_LOCK, &p->lbprm.lock);
+	avoided = NULL;
+	if (p->lbprm.tot_weight == 0)
+		goto out;
+
+	if (mgl->rr_idx >= mgl->size)
+		mgl->rr_idx = 0;
+	newidx = mgl->rr_idx;
+
+	avoididx = 0; /* shut a gcc warning */
+	do {
+		srv = mgl->table[newidx++];
+		if (newidx == mgl->size)
+			newidx = 0;
+
+		if (srv && (!srv->maxconn || (!srv->nbpend && srv->served < srv_dynamic_maxconn(srv)))) {
+			/* make sure it is not the server we are trying to exclude... */
+			/* ...but remember that is was selected yet avoided */
+			avoided = srv;
+			avoididx = newidx;
+			if (srv != srvtoavoid) {
+				mgl->rr_idx = newidx;
+				goto out;
+			}
+		}
+	} while (newidx != mgl->rr_idx);
+
+	if (avoided)
+		mgl->rr_idx = avoididx;
+
+  out:
+	HA_RWLOCK_SKUNLOCK(LBPRM_LOCK, &p->lbprm.lock);
+	/* return NULL or srvtoavoid if found */
+	return avoided;
+}
+
+/*
+ * This function returns the server designated by <hash> in the lookup table of
+ * proxy <p>. If this server is <avoid> and other ones are available, the next
+ * entries of the table designate the server to use instead, so that all the
+ * keys of a failing server are not redispatched to the same one. If no valid
+ * server is found, NULL is returned.
+ *
+ * The lbprm's lock will be used.
+ */
+struct server *maglev_get_server_hash(struct proxy *p, unsigned int hash, const struct server *avoid)
+{
+	struct lb_maglev *mgl = &p->lbprm.maglev;
+	struct server *srv = NULL;
+	unsigned int idx, loops;
+
+	HA_RWLOCK_RDLOCK(LBPRM_LOCK, &p->lbprm.lock);
+	if (p->lbprm.tot_weight) {
+		idx = hash % mgl->size;
+		srv = mgl->table[idx];
+		for (loops = 0; avoid && srv == avoid && p->lbprm.tot_used > 1 && loops < mgl->size; loops++) {
+			if (++idx == mgl->size)
+				idx = 0;
+			srv = mgl->table[idx];
+		}
+	}
+	HA_RWLOCK_RDUNLOCK(LBPRM_LOCK, &p->lbprm.lock);
+	return srv;
+}
+
+
+/*
+ * Local variables:
+ *  c-indent-level: 8
+ *  c-basic-offset: 8
+ * End:
+ */
@@ -21,6 +21,7 @@
 #include <haproxy/api.h>
 #include <haproxy/cfgparse.h>
 #include <haproxy/connection.h>
+#include <haproxy/cpuset.h>
 #include <haproxy/errors.h>
 #include <haproxy/fd.h>
 #include <haproxy/freq_ctr.h>
@@ -661,6 +662,121 @@ int create_listeners(struct bind_conf *bc, const struct sockaddr_storage *ss,
 	return 1;
 }
 
+/* Splits each listener of bind_conf <bc> into as many listeners as requested
+ * by its "shards" setting, each bound to its own socket and to a part of the
+ * bind_conf's threads. The connections are then spread over the sockets by the
+ * kernel thanks to SO_REUSEPORT, and are never passed from a thread to another
+ * one. Each listener gets its own copy of the receiver settings to store its
+ * thread mask. Must be called once the bind_conf's threads are known. Returns
+ * non-zero on success, zero on error with the error message set in <err>.
+ */
+int bind_conf_create_shards(struct bind_conf *bc, char **err)
+{
+	struct listener *l, *last, *new;
+	unsigned long mask, thr_mask[MAX_THREADS];
+	unsigned int nbthr, shards, shard, thr, rank;
+
+	mask = thread_mask(bc->settings.bind_thread) & all_threads_mask;
+	nbthr = my_popcountl(mask);
+	memset(thr_mask, 0, sizeof(thr_mask));
+
+	if (bc->nb_shards == BC_SHARDS_BY_CACHE) {
+#ifdef USE_CPU_AFFINITY
+		/* the threads are grouped by the L3 cache their CPUs share */
+		int dom[MAX_THREADS], d;
+
+		for (thr = shards = 0; thr < MAX_THREADS; thr++) {
+			if (!(mask & (1UL << thr)))
+				continue;
+			d = ha_cpuset_l3(&cpu_map.thread[thr]);
+			for (shard = 0; shard < shards && dom[shard] != d; shard++)
+				;
+			if (shard == shards)
+				dom[shards++] = d;
+			thr_mask[shard] |= 1UL << thr;
+		}
+#else
+		shards = 1;
+#endif
+	}
+	else {
+		/* the threads are split into contiguous ranges, one per shard */
+		shards = MIN(bc->nb_shards, nbthr);
+		for (thr = rank = 0; thr < MAX_THREADS; thr++) {
+			if (!(mask & (1UL << thr)))
+				continue;
+			thr_mask[rank * shards / nbthr] |= 1UL << thr;
+			rank++;
+		}
+	}
+
+	if (shards <= 1 || LIST_ISEMPTY(&bc->listeners))
+		return 1;
+
+	if (!(global.tune.options & GTUNE_USE_REUSEPORT)) {
+		memprintf(err, "'shards' requires SO_REUSEPORT, which is disabled");
+		return 0;
+	}
+
+	last = LIST_PREV(&bc->listeners, struct listener *, by_bind);
+	list_for_each_entry(l, &bc->listeners, by_bind) {
+		if (l->rx.fd != -1 || l->rx.proto->sock_type != SOCK_STREAM ||
+		    (l->rx.addr.ss_family != AF_INET && l->rx.addr.ss_family != AF_INET6)) {
+			memprintf(err, "'shards' is only supported on TCP addresses");
+			return 0;
+		}
+
+		for (shard = 0; shard < shards; shard++) {
+			if (shard) {
+				new = malloc(sizeof(*new));
+				if (!new)
+					goto oom;
+				memcpy(new, l, sizeof(*new));
+				new->state = LI_INIT;
+				new->luid = 0;
+				memset(&new->conf, 0, sizeof(new->conf));
+				new->counters = NULL;
+				new->extra_counters = NULL;
+				new->nbconn = 0;
+				new->thr_idx = 0;
+				memset(new->thr_conn, 0, sizeof(new->thr_conn));
+				new->name = l->name ? strdup(l->name) : NULL;
+				if (l->name && !new->name) {
+					free(new);
+					goto oom;
+				}
+				MT_LIST_INIT(&new->wait_queue);
+				new->rx.owner = new;
+				new->rx.settings = &bc->settings;
+				LIST_APPEND(&bc->frontend->conf.listeners, &new->by_fe);
+				LIST_APPEND(&bc->listeners, &new->by_bind);
+				new->rx.proto->add(new->rx.proto, new);
+				HA_SPIN_INIT(&new->lock);
+				_HA_ATOMIC_INC(&jobs);
+				_HA_ATOMIC_INC(&listeners);
+			}
+			else
+				new = l;
+
+			new->rx.settings = malloc(sizeof(*new->rx.settings));
+			if (!new->rx.settings) {
+				new->rx.settings = &bc->settings;
+				goto oom;
+			}
+			memcpy(new->rx.settings, &bc->settings, sizeof(*new->rx.settings));
+			new->rx.settings->bind_thread = thr_mask[shard];
+		}
+
+		if (l == last)
+			break;
+	}
+	return 1;
+
+ oom:
+	memprintf(err, "out of memory");
+	return 0;
+}
+
 /* Delete a listener from its protocol's list of listeners. The listener's
  * state is automatically updated from LI_ASSIGNED to LI_INIT. The protocol's
  * number of listeners is updated, as well as the global number of listeners
@@ -713,6 +829,35 @@ int listener_backlog(const struct listener *l)
 	return 1024;
 }
 
+/* Returns the thread bound to listener <l> which runs the fewest of its
+ * connections if the current thread runs at least two more of them, and more
+ * than "tune.listener.rebalance" percent more of them, otherwise -1. This is
+ * used to decide whether an idle connection should move to another thread.
+ */
+int listener_lighter_thread(const struct listener *l)
+{
+	unsigned long mask;
+	unsigned int cur, min = UINT_MAX;
+	int thr, best = -1;
+
+	if (!global.tune.listener_rebalance)
+		return -1;
+
+	mask = thread_mask(l->rx.settings->bind_thread) & all_threads_mask & ~tid_bit;
+	for (thr = 0; mask; thr++, mask >>= 1) {
+		if ((mask & 1UL) && l->thr_conn[thr] < min) {
+			min = l->thr_conn[thr];
+			best = thr;
+		}
+	}
+
+	cur = l->thr_conn[tid];
+	if (best < 0 || cur < min + 2 ||
+	    (ullong)cur * 100 <= (ullong)min * (100 + global.tune.listener_rebalance))
+		return -1;
+	return best;
+}
+
 /* This function is called on a read event from a listening socket, corresponding
  * to an accept. It tries to accept as many connections as possible, and for each
  * calls the listener's accept handler (generally the frontend's accept handler).
@@ -905,7 +1050,8 @@ void listener_accept(struct listener *l)
 
 #if defined(USE_THREAD)
 		mask = thread_mask(l->rx.settings->bind_thread) & all_threads_mask;
-		if (atleast2(mask) && (global.tune.options & GTUNE_LISTENER_MQ) && !stopping) {
+		if (atleast2(mask) && (global.tune.options & GTUNE_LISTENER_MQ) &&
+		    !(l->rx.flags & RX_F_LOCAL_ACCEPT) && !stopping) {
 			struct accept_queue_ring *ring;
 			unsigned int t, t0, t1, t2;
 
@@ -1507,6 +1653,40 @@ static int bind_parse_process(char **args, int cur_arg, struct proxy *px, struct
 	return 0;
 }
 
+/* parse the "shards" bind keyword */
+static int bind_parse_shards(char **args, int cur_arg, struct proxy *px, struct bind_conf *conf, char **err)
+{
+	char *end;
+	long val;
+
+	if (!*args[cur_arg + 1]) {
+		memprintf(err, "'%s' : missing value", args[cur_arg]);
+		return ERR_ALERT | ERR_FATAL;
+	}
+
+	if (strcmp(args[cur_arg + 1], "by-thread") == 0) {
+		conf->nb_shards = MAX_THREADS;
+		return 0;
+	}
+
+#ifdef USE_CPU_AFFINITY
+	if (strcmp(args[cur_arg + 1], "by-cache") == 0) {
+		conf->nb_shards = BC_SHARDS_BY_CACHE;
+		return 0;
+	}
+#endif
+
+	val = strtol(args[cur_arg + 1], &end, 10);
+	if (*end || val < 1 || val > MAX_THREADS) {
+		memprintf(err, "'%s' : expects 'by-thread', 'by-cache' or a number between 1 and %d, found '%s'",
+		          args[cur_arg], MAX_THREADS, args[cur_arg + 1]);
+		return ERR_ALERT | ERR_FATAL;
+	}
+
+	conf->nb_shards = val;
+	return 0;
+}
+
 /* parse the "proto" bind keyword */
 static int bind_parse_proto(char **args, int cur_arg, struct proxy *px, struct bind_conf *conf, char **err)
 {
@@ -1545,6 +1725,26 @@ static int cfg_parse_tune_listener_mq(char **args, int section_type, struct prox
 	return 0;
 }
 
+/* config parser for global "tune.listener.rebalance", accepts a percentage */
+static int cfg_parse_tune_listener_rebalance(char **args, int section_type, struct proxy *curpx,
+                                             const struct proxy *defpx, const char *file, int line,
+                                             char **err)
+{
+	char *end;
+	long val;
+
+	if (too_many_args(1, args, err, NULL))
+		return -1;
+
+	val = strtol(args[1], &end, 10);
+	if (!*args[1] || *end || val < 0 || val > 10000) {
+		memprintf(err, "'%s' expects a percentage between 0 and 10000 but got '%s'.", args[0], args[1]);
+		return -1;
+	}
+	global.tune.listener_rebalance = val;
+	return 0;
+}
+
 /* Note: must not be declared <const> as its list will be overwritten.
  * Please take care of keeping this list alphabetically sorted.
  */
@@ -1583,6 +1783,7 @@ static struct bind_kw_list bind_kws = { "ALL", { }, {
 	{ "nice",         bind_parse_nice,         1 }, /* set nice of listening socket */
 	{ "process",      bind_parse_process,      1 }, /* set list of allowed process for this socket */
 	{ "proto",        bind_parse_proto,        1 }, /* set the proto to use for all incoming connections */
+	{ "shards",       bind_parse_shards,       1 }, /* set the number of sockets per address, at most one per thread */
 	{ /* END */ },
 }};
 
@@ -1591,6 +1792,7 @@ INITCALL1(STG_REGISTER, bind_register_keywords, &bind_kws);
 /* config keyword parsers */
 static struct cfg_kw_list cfg_kws = {ILH, {
 	{ CFG_GLOBAL, "tune.listener.multi-queue",      cfg_parse_tune_listener_mq      },
+	{ CFG_GLOBAL, "tune.listener.rebalance",        cfg_parse_tune_listener_rebalance },
 	{ 0, NULL, NULL }
 }};
 
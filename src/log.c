@@ -10,6 +10,7 @@
  *
  */
 
+#define _GNU_SOURCE  /* for sendmmsg() */
 #include <ctype.h>
 #include <fcntl.h>
 #include <stdarg.h>
@@ -27,7 +28,9 @@
 #include <haproxy/api.h>
 #include <haproxy/applet-t.h>
 #include <haproxy/cfgparse.h>
+#include <haproxy/chunk.h>
 #include <haproxy/fd.h>
+#include <haproxy/freq_ctr.h>
 #include <haproxy/frontend.h>
 #include <haproxy/global.h>
 #include <haproxy/http.h>
@@ -39,6 +42,7 @@
 #include <haproxy/ssl_sock.h>
 #include <haproxy/stream.h>
 #include <haproxy/stream_interface.h>
+#include <haproxy/task.h>
 #include <haproxy/time.h>
 #include <haproxy/tools.h>
 
@@ -77,6 +81,9 @@ static const struct log_fmt_st log_formats[LOG_FORMATS] = {
 	[LOG_FORMAT_RAW] = {
 		.name = "raw",
 	},
+	[LOG_FORMAT_CBOR] = {
+		.name = "cbor",
+	},
 };
 
 /*
@@ -205,6 +212,36 @@ char default_rfc5424_sd_log_format[] = "- ";
 /* total number of dropped logs */
 unsigned int dropped_logs = 0;
 
+/* Maximum number of datagrams a thread may queue for each log socket before
+ * sending them at once. It may be lowered with "tune.log.batch".
+ */
+#define LOG_BATCH_MAX 64
+
+/* one log datagram waiting to be sent, flattened in its batch's area */
+struct log_dgram {
+	struct iovec iov;
+	struct logsrv *logsrv;  /* destination */
+	int nblogger;           /* logger number, for error reports */
+};
+
+/* per-thread batch of log datagrams waiting to be sent on a same socket */
+struct log_batch {
+	unsigned int count;                     /* number of queued datagrams */
+	size_t data;                            /* bytes used in <area> */
+	char *area;                             /* global.tune.bufsize bytes */
+	struct log_dgram dgram[LOG_BATCH_MAX];
+};
+
+static unsigned int log_batch_max = LOG_BATCH_MAX;
+
+static THREAD_LOCAL int logfdunix = -1;	/* syslog to AF_UNIX socket */
+static THREAD_LOCAL int logfdinet = -1;	/* syslog to AF_INET socket */
+
+/* datagrams for logfdinet then logfdunix, sent by log_batch_tl */
+static THREAD_LOCAL struct log_batch log_batch[2];
+static THREAD_LOCAL struct tasklet *log_batch_tl = NULL;
+static THREAD_LOCAL int log_batch_on = 0; /* only set while the scheduler runs */
+
 /* This is a global syslog message buffer, common to all outgoing
  * messages. It contains only the data part.
  */
@@ -380,6 +417,7 @@ int add_to_logformat_list(char *start, char *end, int type, struct list *list_fo
 		strncpy(str, start, end - start);
 		str[end - start] = '\0';
 		node->arg = str;
+		node->arg_len = end - start;
 		node->type = LOG_FMT_TEXT; // type string
 		LIST_APPEND(list_format, &node->list);
 	} else if (type == LF_SEPARATOR) {
@@ -394,6 +432,58 @@ int add_to_logformat_list(char *start, char *end, int type, struct list *list_fo
 	return 1;
 }
 
+/* Merges the adjacent text nodes of <list_format> so that constant parts of a
+ * format are emitted with a single copy. A separator following a text node is
+ * folded into it as a trailing space, which is flagged with LOG_OPT_TXT_SEP so
+ * that the build function still knows a space was emitted last. Separators
+ * which could never emit anything (at the beginning or after another one) are
+ * dropped. Failing to allocate only leaves the nodes unmerged.
+ */
+static void merge_logformat_text(struct list *list_format)
+{
+	struct logformat_node *node, *back, *prev = NULL;
+	char *str;
+
+	list_for_each_entry_safe(node, back, list_format, list) {
+		if (node->type == LOG_FMT_SEPARATOR &&
+		    (!prev || prev->type == LOG_FMT_SEPARATOR ||
+		     (prev->type == LOG_FMT_TEXT && prev->options & LOG_OPT_TXT_SEP)))
+			goto drop;
+
+		if (!prev || prev->type != LOG_FMT_TEXT ||
+		    (node->type != LOG_FMT_TEXT && node->type != LOG_FMT_SEPARATOR)) {
+			prev = node;
+			continue;
+		}
+
+		if (node->type == LOG_FMT_SEPARATOR) {
+			str = realloc(prev->arg, prev->arg_len + 2);
+			if (!str) {
+				prev = node;
+				continue;
+			}
+			str[prev->arg_len++] = ' ';
+			str[prev->arg_len] = 0;
+			prev->options |= LOG_OPT_TXT_SEP;
+		}
+		else {
+			str = realloc(prev->arg, prev->arg_len + node->arg_len + 1);
+			if (!str) {
+				prev = node;
+				continue;
+			}
+			memcpy(str + prev->arg_len, node->arg, node->arg_len + 1);
+			prev->arg_len += node->arg_len;
+			prev->options &= ~LOG_OPT_TXT_SEP;
+		}
+		prev->arg = str;
+	  drop:
+		LIST_DELETE(&node->list);
+		free(node->arg);
+		free(node);
+	}
+}
+
 /*
  * Parse the sample fetch expression <text> and add a node to <list_format> upon
  * success. At the moment, sample converters are not yet supported but fetch arguments
@@ -648,6 +738,7 @@ int parse_logformat_string(const char *fmt, struct proxy *curproxy, struct list
 		memprintf(err, "truncated line after '%s'", var ? var : arg ? arg : "%");
 		goto fail;
 	}
+	merge_logformat_text(list_format);
 	free(backfmt);
 
 	return 1;
@@ -923,6 +1014,34 @@ int parse_logsrv(char **args, struct list *logsrvs, int do_del, const char *file
 
 		cur_arg += 2;
 	}
+
+	/* an adaptive sampling budget may follow, in lines per second */
+	if (strcmp(args[cur_arg], "budget") == 0) {
+		const char *res, *beg;
+		char *slow;
+		unsigned int rate;
+
+		slow = strchr(args[cur_arg+1], ':');
+		if (slow)
+			*slow++ = '\0';
+
+		beg = args[cur_arg+1];
+		rate = read_uint(&beg, beg + strlen(beg));
+		if (!rate || *beg) {
+			memprintf(err, "'budget' expects a positive number of lines per second, optionally followed by ':<slow time>'");
+			goto error;
+		}
+		logsrv->budget.rate = rate;
+
+		if (slow) {
+			res = parse_time_err(slow, &logsrv->budget.slow, TIME_UNIT_MS);
+			if (res == PARSE_TIME_OVER || res == PARSE_TIME_UNDER || res) {
+				memprintf(err, "invalid slow time '%s' for 'budget'", slow);
+				goto error;
+			}
+		}
+		cur_arg += 2;
+	}
 	HA_SPIN_INIT(&logsrv->lock);
 	/* parse the facility */
 	logsrv->facility = get_log_facility(args[cur_arg]);
@@ -962,6 +1081,11 @@ int parse_logsrv(char **args, struct list *logsrvs, int do_del, const char *file
 
 	/* now, back to the address */
 	logsrv->type = LOG_TARGET_DGRAM;
+	if (logsrv->format == LOG_FORMAT_CBOR && strncmp(args[1], "ring@", 5) == 0) {
+		memprintf(err, "format 'cbor' is only supported on datagram log targets");
+		goto error;
+	}
+
 	if (strncmp(args[1], "ring@", 5) == 0) {
 		logsrv->addr.ss_family = AF_UNSPEC;
 		logsrv->type = LOG_TARGET_BUFFER;
@@ -980,6 +1104,12 @@ int parse_logsrv(char **args, struct list *logsrvs, int do_del, const char *file
 		logsrv->type = LOG_TARGET_FD;
 	logsrv->addr = *sk;
 
+	if (logsrv->format == LOG_FORMAT_CBOR &&
+	    (fd != -1 || (proto && proto->ctrl_type == SOCK_STREAM))) {
+		memprintf(err, "format 'cbor' is only supported on datagram log targets");
+		goto error;
+	}
+
 	if (sk->ss_family == AF_INET || sk->ss_family == AF_INET6) {
 		if (!port1)
 			set_host_port(&logsrv->addr, SYSLOG_PORT);
@@ -1213,28 +1343,38 @@ static inline char *lf_text(char *dst, const char *src, size_t size, const struc
 char *lf_ip(char *dst, const struct sockaddr *sockaddr, size_t size, const struct logformat_node *node)
 {
 	char *ret = dst;
-	int iret;
 	char pn[INET6_ADDRSTRLEN];
 
 	if (node->options & LOG_OPT_HEXA) {
-		unsigned char *addr = NULL;
+		const unsigned char *addr;
+		int i, len;
+
 		switch (sockaddr->sa_family) {
 		case AF_INET:
 			addr = (unsigned char *)&((struct sockaddr_in *)sockaddr)->sin_addr.s_addr;
-			iret = snprintf(dst, size, "%02X%02X%02X%02X", addr[0], addr[1], addr[2], addr[3]);
+			len = 4;
 			break;
 		case AF_INET6:
 			addr = (unsigned char *)&((struct sockaddr_in6 *)sockaddr)->sin6_addr.s6_addr;
-			iret = snprintf(dst, size, "%02X%02X%02X%02X%02X%02X%02X%02X%02X%02X%02X%02X%02X%02X%02X%02X",
-			                addr[0], addr[1], addr[2], addr[3], addr[4], addr[5], addr[6], addr[7],
-			                addr[8], addr[9], addr[10], addr[11], addr[12], addr[13], addr[14], addr[15]);
+			len = 16;
 			break;
 		default:
 			return NULL;
 		}
-		if (iret < 0 || iret > size)
+		if (size < 2 * len + 1)
+			return NULL;
+		for (i = 0; i < len; i++) {
+			*ret++ = hextab[addr[i] >> 4];
+			*ret++ = hextab[addr[i] & 15];
+		}
+		*ret = '\0';
+	} else if (sockaddr->sa_family == AF_INET) {
+		/* fast path avoiding inet_ntop() and strlen() for IPv4 */
+		char *p = ipv4_to_str(&((struct sockaddr_in *)sockaddr)->sin_addr, pn);
+
+		ret = lf_text_len(dst, pn, p - pn, size, node);
+		if (ret == NULL)
 			return NULL;
-		ret += iret;
 	} else {
 		addr_to_str((struct sockaddr_storage *)sockaddr, pn, sizeof(pn));
 		ret = lf_text(dst, pn, size, node);
@@ -1289,6 +1429,141 @@ void send_log(struct proxy *p, int level, const char *format, ...)
 	__send_log((p ? &p->logsrvs : NULL), (p ? &p->log_tag : NULL), level,
 		   logline, data_len, default_rfc5424_sd_log_format, 2);
 }
+/* Appends the CBOR (RFC 8949) head of major type <major> with argument <v> to
+ * <p> and returns the new end. At most 9 bytes are written.
+ */
+static inline char *cbor_put_head(char *p, uint8_t major, uint64_t v)
+{
+	int bytes, i;
+
+	major <<= 5;
+	if (v < 24) {
+		*p++ = major | v;
+		return p;
+	}
+	else if (v <= 0xff) {
+		*p++ = major | 24;
+		bytes = 1;
+	}
+	else if (v <= 0xffff) {
+		*p++ = major | 25;
+		bytes = 2;
+	}
+	else if (v <= 0xffffffff) {
+		*p++ = major | 26;
+		bytes = 4;
+	}
+	else {
+		*p++ = major | 27;
+		bytes = 8;
+	}
+
+	for (i = bytes - 1; i >= 0; i--)
+		*p++ = v >> (8 * i);
+	return p;
+}
+
+/* Appends the CBOR text string <str> to <p> and returns the new end */
+static inline char *cbor_put_text(char *p, const char *str)
+{
+	size_t len = strlen(str);
+
+	p = cbor_put_head(p, 3, len);
+	memcpy(p, str, len);
+	return p + len;
+}
+
+/* Builds the header of a log message in the "cbor" format: the whole message
+ * is a single CBOR map made of the syslog header fields followed by the
+ * message itself under the "msg" key. The message is encoded as a text string
+ * whose length is left as a 32-bit placeholder at the end of the last element,
+ * which the sender must fill using cbor_log_set_msg_len() once the message is
+ * truncated. The metadata strings are referenced and not copied. The elements
+ * are returned in the same way as for build_log_header().
+ */
+static struct ist *build_cbor_log_header(int level, int facility, struct ist *metadata, size_t *nbelem)
+{
+	static THREAD_LOCAL struct {
+		struct ist ist_vector[NB_LOG_HDR_MAX_ELEMENTS];
+		char buf[128];
+	} cbor_ctx;
+	static const struct {
+		const char *key;
+		enum log_meta meta;
+	} fields[] = {
+		{ "host",  LOG_META_HOST   },
+		{ "tag",   LOG_META_TAG    },
+		{ "pid",   LOG_META_PID    },
+		{ "msgid", LOG_META_MSGID  },
+		{ "sd",    LOG_META_STDATA },
+	};
+	char *p = cbor_ctx.buf;
+	char *start = p;
+	int entries = 3; /* pri, time and msg */
+	int has_time = metadata && metadata[LOG_META_TIME].len;
+	int i;
+
+	*nbelem = 0;
+
+	if (!has_time)
+		entries++; /* usec */
+
+	for (i = 0; metadata && i < sizeof(fields) / sizeof(*fields); i++)
+		if (metadata[fields[i].meta].len)
+			entries++;
+
+	p = cbor_put_head(p, 5, entries);
+
+	p = cbor_put_text(p, "pri");
+	p = cbor_put_head(p, 0, (facility << 3) + level);
+
+	p = cbor_put_text(p, "time");
+	if (has_time) {
+		/* forwarded message, keep its timestamp as is */
+		p = cbor_put_head(p, 3, metadata[LOG_META_TIME].len);
+		cbor_ctx.ist_vector[(*nbelem)++] = ist2(start, p - start);
+		cbor_ctx.ist_vector[(*nbelem)++] = metadata[LOG_META_TIME];
+		start = p;
+	}
+	else {
+		/* tag 1: epoch-based date/time */
+		p = cbor_put_head(p, 6, 1);
+		p = cbor_put_head(p, 0, date.tv_sec);
+		p = cbor_put_text(p, "usec");
+		p = cbor_put_head(p, 0, date.tv_usec);
+	}
+
+	for (i = 0; metadata && i < sizeof(fields) / sizeof(*fields); i++) {
+		if (!metadata[fields[i].meta].len)
+			continue;
+		p = cbor_put_text(p, fields[i].key);
+		p = cbor_put_head(p, 3, metadata[fields[i].meta].len);
+		cbor_ctx.ist_vector[(*nbelem)++] = ist2(start, p - start);
+		cbor_ctx.ist_vector[(*nbelem)++] = metadata[fields[i].meta];
+		start = p;
+	}
+
+	p = cbor_put_text(p, "msg");
+	*p++ = (3 << 5) | 26; /* 32-bit length, set by cbor_log_set_msg_len() */
+	p += 4;
+	cbor_ctx.ist_vector[(*nbelem)++] = ist2(start, p - start);
+
+	return cbor_ctx.ist_vector;
+}
+
+/* Sets to <len> the message length of the "cbor" log header made of the
+ * <nbelem> elements of <hdr>, as returned by build_cbor_log_header().
+ */
+static inline void cbor_log_set_msg_len(struct ist *hdr, size_t nbelem, uint32_t len)
+{
+	unsigned char *p = (unsigned char *)hdr[nbelem - 1].ptr + hdr[nbelem - 1].len - 4;
+
+	p[0] = len >> 24;
+	p[1] = len >> 16;
+	p[2] = len >> 8;
+	p[3] = len;
+}
+
 /*
  * This function builds a log header of given format using given
  * metadata, if format is set to LOF_FORMAT_UNSPEC, it tries
@@ -1354,6 +1629,9 @@ struct ist *build_log_header(enum log_fmt format, int level, int facility,
 		}
 	}
 
+	if (format == LOG_FORMAT_CBOR)
+		return build_cbor_log_header(level, facility, metadata, nbelem);
+
 	/* prepare priority, stored into 1 single elem */
 	switch (format) {
 		case LOG_FORMAT_LOCAL:
@@ -1379,6 +1657,7 @@ struct ist *build_log_header(enum log_fmt format, int level, int facility,
 		case LOG_FORMAT_RAW:
 			break;
 		case LOG_FORMAT_UNSPEC:
+		case LOG_FORMAT_CBOR:
 		case LOG_FORMATS:
 			ABORT_NOW();
 	}
@@ -1516,6 +1795,7 @@ struct ist *build_log_header(enum log_fmt format, int level, int facility,
 		case LOG_FORMAT_RAW:
 			break;
 		case LOG_FORMAT_UNSPEC:
+		case LOG_FORMAT_CBOR:
 		case LOG_FORMATS:
 			ABORT_NOW();
 	}
@@ -1585,6 +1865,7 @@ struct ist *build_log_header(enum log_fmt format, int level, int facility,
 		case LOG_FORMAT_RAW:
 			break;
 		case LOG_FORMAT_UNSPEC:
+		case LOG_FORMAT_CBOR:
 		case LOG_FORMATS:
 			ABORT_NOW();
 	}
@@ -1592,6 +1873,133 @@ struct ist *build_log_header(enum log_fmt format, int level, int facility,
 	return hdr_ctx.ist_vector;
 }
 
+/* Sends the datagrams queued in batch <b> on socket <fd>, using a single
+ * syscall when possible. As with the direct sending of logs, the datagrams
+ * which cannot be sent because the socket buffer is full are accounted as
+ * dropped logs, and the other errors are reported once.
+ */
+static void log_batch_flush(struct log_batch *b, int fd)
+{
+#if defined(__linux__)
+	struct mmsghdr msgs[LOG_BATCH_MAX];
+#else
+	struct msghdr msghdr;
+#endif
+	struct log_dgram *d;
+	unsigned int sent = 0;
+	int ret, i;
+
+	while (sent < b->count) {
+#if defined(__linux__)
+		for (i = 0; sent + i < b->count; i++) {
+			d = &b->dgram[sent + i];
+			memset(&msgs[i], 0, sizeof(msgs[i]));
+			msgs[i].msg_hdr.msg_name    = &d->logsrv->addr;
+			msgs[i].msg_hdr.msg_namelen = get_addr_len(&d->logsrv->addr);
+			msgs[i].msg_hdr.msg_iov     = &d->iov;
+			msgs[i].msg_hdr.msg_iovlen  = 1;
+		}
+		ret = sendmmsg(fd, msgs, i, MSG_DONTWAIT | MSG_NOSIGNAL);
+#else
+		d = &b->dgram[sent];
+		memset(&msghdr, 0, sizeof(msghdr));
+		msghdr.msg_name    = &d->logsrv->addr;
+		msghdr.msg_namelen = get_addr_len(&d->logsrv->addr);
+		msghdr.msg_iov     = &d->iov;
+		msghdr.msg_iovlen  = 1;
+		ret = sendmsg(fd, &msghdr, MSG_DONTWAIT | MSG_NOSIGNAL);
+		if (ret >= 0)
+			ret = 1;
+#endif
+		if (ret > 0) {
+			sent += ret;
+			continue;
+		}
+
+		if (errno == EAGAIN) {
+			/* the next ones would fail as well */
+			_HA_ATOMIC_ADD(&dropped_logs, b->count - sent);
+			break;
+		}
+		else {
+			static char once;
+
+			if (!once) {
+				once = 1; /* note: no need for atomic ops here */
+				ha_alert("sendmsg()/writev() failed in logger #%d: %s (errno=%d)\n",
+					 b->dgram[sent].nblogger, strerror(errno), errno);
+			}
+			/* the error may only concern this destination */
+			sent++;
+		}
+	}
+
+	b->count = 0;
+	b->data  = 0;
+}
+
+/* Queues the log datagram made of the <nbiov> elements of <iov> for logger
+ * <logsrv> in batch <b> of the current thread, which is sent on socket <fd>.
+ * The batch is sent at the latest by the thread's log tasklet, or as soon as
+ * it is full. Returns non-zero if the datagram was queued, or zero if it must
+ * be sent directly because it is too large, in which case the previous ones
+ * were sent first so that the ordering is preserved.
+ */
+static int log_batch_queue(struct log_batch *b, int fd, struct logsrv *logsrv, int nblogger,
+                           const struct iovec *iov, int nbiov)
+{
+	struct log_dgram *d;
+	size_t len = 0;
+	int i;
+
+	for (i = 0; i < nbiov; i++)
+		len += iov[i].iov_len;
+
+	if (b->count && b->data + len > global.tune.bufsize)
+		log_batch_flush(b, fd);
+
+	if (len > global.tune.bufsize)
+		return 0;
+
+	d = &b->dgram[b->count++];
+	d->iov.iov_base = b->area + b->data;
+	d->iov.iov_len  = len;
+	d->logsrv       = logsrv;
+	d->nblogger     = nblogger;
+
+	for (i = 0; i < nbiov; i++) {
+		memcpy(b->area + b->data, iov[i].iov_base, iov[i].iov_len);
+		b->data += iov[i].iov_len;
+	}
+
+	if (b->count >= log_batch_max)
+		log_batch_flush(b, fd);
+	else if (b->count == 1)
+		tasklet_wakeup(log_batch_tl);
+	return 1;
+}
+
+/* Sends the log datagrams queued by the current thread. This runs in the bulk
+ * tasklet class so that logging does not delay the other processing.
+ */
+static struct task *log_batch_io_cb(struct task *t, void *context, unsigned int state)
+{
+	if (log_batch[0].count)
+		log_batch_flush(&log_batch[0], logfdinet);
+	if (log_batch[1].count)
+		log_batch_flush(&log_batch[1], logfdunix);
+	return t;
+}
+
+/* Set by strm_log() and sess_log() for the adaptive log sampling while the
+ * line is being sent: <err> indicates that it reports an error, and <duration>
+ * is the total time spent on the stream in milliseconds, or -1 if unknown.
+ */
+static THREAD_LOCAL struct {
+	int err;
+	int duration;
+} log_smp_hint = { .err = 0, .duration = -1 };
+
 /*
  * This function sends a syslog message to <logsrv>.
  * The argument <metadata> MUST be an array of size
@@ -1606,8 +2014,6 @@ static inline void __do_send_log(struct logsrv *logsrv, int nblogger, int level,
 		//.msg_iov = iovec,
 		.msg_iovlen = NB_LOG_HDR_MAX_ELEMENTS+2
 	};
-	static THREAD_LOCAL int logfdunix = -1;	/* syslog to AF_UNIX socket */
-	static THREAD_LOCAL int logfdinet = -1;	/* syslog to AF_INET socket */
 	int *plogfd;
 	int sent;
 	size_t nbelem;
@@ -1679,6 +2085,19 @@ static inline void __do_send_log(struct logsrv *logsrv, int nblogger, int level,
 		int i = 0;
 		int totlen = logsrv->maxlen;
 
+		if (logsrv->format == LOG_FORMAT_CBOR) {
+			/* the map is only valid if the whole header fits, and it
+			 * must announce the length of the truncated message.
+			 */
+			int hdrlen = 0;
+
+			for (i = 0; i < nbelem; i++)
+				hdrlen += msg_header[i].len;
+			if (hdrlen > totlen)
+				return;
+			cbor_log_set_msg_len(msg_header, nbelem, MIN(size, totlen - hdrlen));
+		}
+
 		for (i = 0 ; i < nbelem ; i++ ) {
 			iovec[i].iov_base = msg_header[i].ptr;
 			iovec[i].iov_len  = msg_header[i].len;
@@ -1696,9 +2115,16 @@ static inline void __do_send_log(struct logsrv *logsrv, int nblogger, int level,
 				iovec[i].iov_len = totlen;
 			i++;
 		}
-		iovec[i].iov_base = "\n"; /* insert a \n at the end of the message */
-		iovec[i].iov_len = 1;
-		i++;
+		if (logsrv->format != LOG_FORMAT_CBOR) {
+			iovec[i].iov_base = "\n"; /* insert a \n at the end of the message */
+			iovec[i].iov_len = 1;
+			i++;
+		}
+
+		if (log_batch_on && log_batch_max > 1 &&
+		    log_batch_queue(&log_batch[plogfd == &logfdunix], *plogfd,
+		                    logsrv, nblogger, iovec, i))
+			return;
 
 		msghdr.msg_iovlen = i;
 		msghdr.msg_name = (struct sockaddr *)&logsrv->addr;
@@ -1720,6 +2146,35 @@ static inline void __do_send_log(struct logsrv *logsrv, int nblogger, int level,
 	}
 }
 
+/* Applies the adaptive sampling budget of <logsrv> to a line of level <level>.
+ * Errors and lines slower than the configured limit are always kept, other
+ * ones are kept with a probability matching the share of the budget left to
+ * them over the last second. Returns 0 if the line must be dropped, otherwise
+ * the number of lines it stands for, which is the inverse of the probability
+ * it had to be kept.
+ */
+static inline uint log_budget_sample(struct logsrv *logsrv, int level)
+{
+	struct smp_budget *budget = &logsrv->budget;
+	uint forced, cand, avail, inv;
+
+	if (level <= LOG_ERR || log_smp_hint.err ||
+	    (budget->slow && log_smp_hint.duration >= (int)budget->slow)) {
+		update_freq_ctr(&budget->forced, 1);
+		return 1;
+	}
+
+	update_freq_ctr(&budget->cand, 1);
+	forced = read_freq_ctr(&budget->forced);
+	cand   = read_freq_ctr(&budget->cand);
+	avail  = (budget->rate > forced) ? budget->rate - forced : 1;
+	if (cand <= avail)
+		return 1;
+
+	inv = (cand + avail - 1) / avail;
+	return statistical_prng_range(inv) ? 0 : inv;
+}
+
 /*
  * This function sends a syslog message.
  * It doesn't care about errors nor does it report them.
@@ -1759,10 +2214,35 @@ void process_send_log(struct list *logsrvs, int level, int facility,
 			logsrv->lb.curr_idx = (logsrv->lb.curr_idx + 1) % logsrv->lb.smp_sz;
 			HA_SPIN_UNLOCK(LOGSRV_LOCK, &logsrv->lock);
 		}
-		if (in_range)
-			__do_send_log(logsrv, ++nblogger,  MAX(level, logsrv->minlvl),
-			              (facility == -1) ? logsrv->facility : facility,
-			              metadata, message, size);
+		if (!in_range)
+			continue;
+
+		if (logsrv->budget.rate) {
+			struct buffer *buf;
+			size_t len = size;
+			uint weight;
+
+			weight = log_budget_sample(logsrv, level);
+			if (!weight)
+				continue;
+
+			/* report the effective sampling rate at the end of the line */
+			while (len && (message[len-1] == '\n' || message[len-1] == 0))
+				len--;
+
+			buf = get_trash_chunk();
+			if (chunk_memcpy(buf, message, len) &&
+			    chunk_appendf(buf, " sample_rate=%u", weight)) {
+				__do_send_log(logsrv, ++nblogger,  MAX(level, logsrv->minlvl),
+				              (facility == -1) ? logsrv->facility : facility,
+				              metadata, buf->area, buf->data);
+				continue;
+			}
+		}
+
+		__do_send_log(logsrv, ++nblogger,  MAX(level, logsrv->minlvl),
+		              (facility == -1) ? logsrv->facility : facility,
+		              metadata, message, size);
 	}
 }
 
@@ -1928,6 +2408,53 @@ void deinit_log_buffers()
 	logline_rfc5424   = NULL;
 }
 
+/* Allocates the current thread's log batches and the tasklet sending them */
+static int alloc_log_batches()
+{
+	int i;
+
+	for (i = 0; i < 2; i++) {
+		log_batch[i].count = log_batch[i].data = 0;
+		log_batch[i].area = malloc(global.tune.bufsize);
+		if (!log_batch[i].area)
+			return 0;
+	}
+
+	log_batch_tl = tasklet_new();
+	if (!log_batch_tl)
+		return 0;
+
+	log_batch_tl->process = log_batch_io_cb;
+	log_batch_tl->context = NULL;
+	log_batch_tl->state  |= TASK_SELF_WAKING; /* always in the bulk class */
+	return 1;
+}
+
+/* Log datagrams are only queued while the thread's scheduler runs */
+static int start_log_batches()
+{
+	log_batch_on = 1;
+	return 1;
+}
+
+/* Sends the log datagrams left when the scheduler stops */
+static void stop_log_batches()
+{
+	log_batch_on = 0;
+	if (log_batch[0].count)
+		log_batch_flush(&log_batch[0], logfdinet);
+	if (log_batch[1].count)
+		log_batch_flush(&log_batch[1], logfdunix);
+}
+
+static void free_log_batches()
+{
+	ha_free(&log_batch[0].area);
+	ha_free(&log_batch[1].area);
+	tasklet_free(log_batch_tl);
+	log_batch_tl = NULL;
+}
+
 /* Builds a log line in <dst> based on <list_format>, and stops before reaching
  * <maxsize> characters. Returns the size of the output string in characters,
  * not counting the trailing zero which is always added if the resulting size
@@ -2061,12 +2588,17 @@ int sess_build_logline(struct session *sess, struct stream *s, char *dst, size_t
 				break;
 
 			case LOG_FMT_TEXT: // text
-				src = tmp->arg;
-				iret = strlcpy2(tmplog, src, dst + maxsize - tmplog);
-				if (iret == 0)
-					goto out;
-				tmplog += iret;
-				last_isspace = 0;
+				if (likely(tmp->arg_len < dst + maxsize - tmplog)) {
+					memcpy(tmplog, tmp->arg, tmp->arg_len + 1);
+					tmplog += tmp->arg_len;
+				}
+				else {
+					iret = strlcpy2(tmplog, tmp->arg, dst + maxsize - tmplog);
+					if (iret == 0)
+						goto out;
+					tmplog += iret;
+				}
+				last_isspace = !!(tmp->options & LOG_OPT_TXT_SEP);
 				break;
 
 			case LOG_FMT_EXPR: // sample expression, may be request or response
@@ -3087,8 +3619,13 @@ void strm_log(struct stream *s)
 	size = build_logline(s, logline, global.max_syslog_len, &sess->fe->logformat);
 	if (size > 0) {
 		_HA_ATOMIC_INC(&sess->fe->log_count);
+		log_smp_hint.err = err;
+		log_smp_hint.duration = (s->logs.t_close > 0) ? s->logs.t_close :
+			tv_ms_elapsed(&s->logs.tv_accept, &now);
 		__send_log(&sess->fe->logsrvs, &sess->fe->log_tag, level,
 			   logline, size + 1, logline_rfc5424, sd_size);
+		log_smp_hint.err = 0;
+		log_smp_hint.duration = -1;
 		s->logs.logwait = 0;
 	}
 }
@@ -3126,8 +3663,11 @@ void sess_log(struct session *sess)
 	size = sess_build_logline(sess, NULL, logline, global.max_syslog_len, &sess->fe->logformat);
 	if (size > 0) {
 		_HA_ATOMIC_INC(&sess->fe->log_count);
+		/* only anomalies are reported here */
+		log_smp_hint.err = 1;
 		__send_log(&sess->fe->logsrvs, &sess->fe->log_tag, level,
 			   logline, size + 1, logline_rfc5424, sd_size);
+		log_smp_hint.err = 0;
 	}
 }
 
@@ -3951,8 +4491,39 @@ int cfg_parse_log_forward(const char *file, int linenum, char **args, int kwm)
 /* config parsers for this section */
 REGISTER_CONFIG_SECTION("log-forward", cfg_parse_log_forward, NULL);
 
+/* config parser for global "tune.log.batch" */
+static int cfg_parse_tune_log_batch(char **args, int section_type, struct proxy *curpx,
+                                    const struct proxy *defpx, const char *file, int line,
+                                    char **err)
+{
+	int val;
+
+	if (too_many_args(1, args, err, NULL))
+		return -1;
+
+	val = atoi(args[1]);
+	if (val < 1 || val > LOG_BATCH_MAX) {
+		memprintf(err, "'%s' expects a number of datagrams between 1 and %d.", args[0], LOG_BATCH_MAX);
+		return -1;
+	}
+	log_batch_max = val;
+	return 0;
+}
+
+/* config keyword parsers */
+static struct cfg_kw_list cfg_kws = {ILH, {
+	{ CFG_GLOBAL, "tune.log.batch", cfg_parse_tune_log_batch },
+	{ 0, NULL, NULL }
+}};
+
+INITCALL1(STG_REGISTER, cfg_register_keywords, &cfg_kws);
+
 REGISTER_PER_THREAD_ALLOC(init_log_buffers);
 REGISTER_PER_THREAD_FREE(deinit_log_buffers);
+REGISTER_PER_THREAD_ALLOC(alloc_log_batches);
+REGISTER_PER_THREAD_INIT(start_log_batches);
+REGISTER_PER_THREAD_DEINIT(stop_log_batches);
+REGISTER_PER_THREAD_FREE(free_log_batches);
 
 /*
  * Local variables:
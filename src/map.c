@@ -10,8 +10,13 @@
  *
  */
 
+#include <errno.h>
+#include <fcntl.h>
 #include <stdio.h>
 #include <syslog.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include <haproxy/api.h>
 #include <haproxy/applet-t.h>
@@ -88,6 +93,199 @@ static struct map_descriptor *map_create_descriptor(struct sample_conv *conv)
 	return desc;
 }
 
+/* Opens map file <path> and maps it into memory if it is a compiled map, in
+ * which case <bin> is set to it. Otherwise <bin> is set to NULL so that it is
+ * parsed as a text map. Returns 0 with <err> filled if the file is a compiled
+ * map which cannot be used, otherwise 1.
+ */
+static int map_bin_open(const char *path, struct map_bin **bin, char **err)
+{
+	const struct map_bin_hdr *hdr;
+	char magic[sizeof(hdr->magic)];
+	struct map_bin *map = NULL;
+	struct stat st;
+	void *area;
+	int fd;
+
+	*bin = NULL;
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return 1; /* reported by the text parser */
+
+	if (fstat(fd, &st) != 0 || st.st_size < sizeof(*hdr) ||
+	    pread(fd, magic, sizeof(magic), 0) != sizeof(magic) ||
+	    memcmp(magic, MAP_BIN_MAGIC, sizeof(magic)) != 0) {
+		close(fd);
+		return 1;
+	}
+
+	area = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (area == MAP_FAILED) {
+		memprintf(err, "cannot map compiled map <%s> : %s", path, strerror(errno));
+		return 0;
+	}
+
+	hdr = area;
+	if (hdr->bom != MAP_BIN_BOM) {
+		memprintf(err, "compiled map <%s> was built on a machine of another endianness", path);
+		goto fail;
+	}
+
+	/* the arrays and the blob must fit in the file */
+	if ((hdr->str_ofs | hdr->ip4_ofs | hdr->ip6_ofs | hdr->blob_ofs) & 7 ||
+	    hdr->str_ofs > st.st_size || (st.st_size - hdr->str_ofs) / sizeof(struct map_bin_str) < hdr->nb_str ||
+	    hdr->ip4_ofs > st.st_size || (st.st_size - hdr->ip4_ofs) / sizeof(struct map_bin_ip4) < hdr->nb_ip4 ||
+	    hdr->ip6_ofs > st.st_size || (st.st_size - hdr->ip6_ofs) / sizeof(struct map_bin_ip6) < hdr->nb_ip6 ||
+	    hdr->blob_ofs > st.st_size || st.st_size - hdr->blob_ofs < hdr->blob_len) {
+		memprintf(err, "compiled map <%s> is truncated or corrupted", path);
+		goto fail;
+	}
+
+	map = calloc(1, sizeof(*map));
+	if (!map) {
+		memprintf(err, "out of memory");
+		goto fail;
+	}
+
+	map->area = area;
+	map->size = st.st_size;
+	map->hdr  = hdr;
+	map->str  = (const void *)(map->area + hdr->str_ofs);
+	map->ip4  = (const void *)(map->area + hdr->ip4_ofs);
+	map->ip6  = (const void *)(map->area + hdr->ip6_ofs);
+	map->blob = map->area + hdr->blob_ofs;
+	*bin = map;
+	return 1;
+
+ fail:
+	munmap(area, st.st_size);
+	return 0;
+}
+
+/* Returns in <val> the value at offset <ofs> of length <len> of compiled map
+ * <bin>, which is followed by a zero. Returns 0 if it lies out of the map.
+ */
+static inline int map_bin_value(const struct map_bin *bin, uint32_t ofs, uint32_t len, struct ist *val)
+{
+	if ((uint64_t)ofs + len >= bin->hdr->blob_len || bin->blob[ofs + len])
+		return 0;
+	*val = ist2(bin->blob + ofs, len);
+	return 1;
+}
+
+/* Looks up IPv4 address <addr> (host order) in compiled map <bin> */
+static int map_bin_lookup_ip4(const struct map_bin *bin, uint32_t addr, struct ist *val)
+{
+	const struct map_bin_ip4 *e;
+	uint32_t l = 0, r = bin->hdr->nb_ip4;
+
+	/* find the last range starting at or before <addr> */
+	while (l < r) {
+		uint32_t m = l + (r - l) / 2;
+
+		if (bin->ip4[m].from <= addr)
+			l = m + 1;
+		else
+			r = m;
+	}
+
+	if (!l)
+		return 0;
+	e = &bin->ip4[l - 1];
+	if (addr > e->to)
+		return 0;
+	return map_bin_value(bin, e->val_ofs, e->val_len, val);
+}
+
+/* Looks up IPv6 address <addr> in compiled map <bin> */
+static int map_bin_lookup_ip6(const struct map_bin *bin, const struct in6_addr *addr, struct ist *val)
+{
+	const struct map_bin_ip6 *e;
+	uint32_t l = 0, r = bin->hdr->nb_ip6;
+
+	while (l < r) {
+		uint32_t m = l + (r - l) / 2;
+
+		if (memcmp(bin->ip6[m].from, addr, 16) <= 0)
+			l = m + 1;
+		else
+			r = m;
+	}
+
+	if (!l)
+		return 0;
+	e = &bin->ip6[l - 1];
+	if (memcmp(addr, e->to, 16) > 0)
+		return 0;
+	return map_bin_value(bin, e->val_ofs, e->val_len, val);
+}
+
+/* Looks up sample <smp> in compiled map <bin>. String maps expect a string
+ * and IP maps an IPv4 or IPv6 address. As for indexed IP maps, IPv4 addresses
+ * are also looked up as IPv4-mapped IPv6 ones and conversely. Returns 1 with
+ * the associated value in <val>, or 0 if not found.
+ */
+int map_bin_lookup(const struct map_bin *bin, const struct sample *smp, struct ist *val)
+{
+	struct in6_addr tmp6;
+	struct in_addr tmp4;
+
+	if (bin->hdr->type == MAP_BIN_T_STR) {
+		const struct map_bin_str *e;
+		uint32_t l = 0, r = bin->hdr->nb_str;
+		size_t len = smp->data.u.str.data;
+
+		if (smp->data.type != SMP_T_STR && smp->data.type != SMP_T_BIN)
+			return 0;
+
+		while (l < r) {
+			uint32_t m = l + (r - l) / 2;
+			int cmp;
+
+			e = &bin->str[m];
+			if ((uint64_t)e->key_ofs + e->key_len > bin->hdr->blob_len)
+				return 0;
+
+			cmp = memcmp(bin->blob + e->key_ofs, smp->data.u.str.area, MIN(e->key_len, len));
+			if (!cmp)
+				cmp = (e->key_len > len) - (e->key_len < len);
+			if (!cmp)
+				return map_bin_value(bin, e->val_ofs, e->val_len, val);
+			if (cmp < 0)
+				l = m + 1;
+			else
+				r = m;
+		}
+		return 0;
+	}
+
+	if (smp->data.type == SMP_T_IPV4)
+		tmp4 = smp->data.u.ipv4;
+	else if (smp->data.type == SMP_T_IPV6)
+		tmp6 = smp->data.u.ipv6;
+	else if (smp->data.type == SMP_T_STR && buf2ip(smp->data.u.str.area, smp->data.u.str.data, &tmp4))
+		; /* e.g. from Lua */
+	else if (smp->data.type == SMP_T_STR && buf2ip6(smp->data.u.str.area, smp->data.u.str.data, &tmp6))
+		goto ipv6;
+	else
+		return 0;
+
+	if (smp->data.type == SMP_T_IPV4 || smp->data.type == SMP_T_STR) {
+		if (map_bin_lookup_ip4(bin, ntohl(tmp4.s_addr), val))
+			return 1;
+		v4tov6(&tmp6, &tmp4);
+		return map_bin_lookup_ip6(bin, &tmp6, val);
+	}
+
+ ipv6:
+	if (map_bin_lookup_ip6(bin, &tmp6, val))
+		return 1;
+	if (v6tov4(&tmp4, &tmp6))
+		return map_bin_lookup_ip4(bin, ntohl(tmp4.s_addr), val);
+	return 0;
+}
+
 /* This function load the map file according with data type declared into
  * the "struct sample_conv".
  *
@@ -136,9 +334,23 @@ int sample_load_map(struct arg *arg, struct sample_conv *conv,
 		return 0;
 	}
 
+	/* Compiled maps are used as-is */
+	if (!map_bin_open(arg[0].data.str.area, &desc->bin, err))
+		return 0;
+
+	if (desc->bin) {
+		int type = (long)conv->private == PAT_MATCH_STR ? MAP_BIN_T_STR :
+		           (long)conv->private == PAT_MATCH_IP  ? MAP_BIN_T_IP : 0;
+
+		if (desc->bin->hdr->type != type) {
+			memprintf(err, "map: compiled map <%s> does not support this match type, only 'str' and 'ip' are supported, depending on the map's key type",
+			          arg[0].data.str.area);
+			return 0;
+		}
+	}
 	/* Load map. */
-	if (!pattern_read_from_file(&desc->pat, PAT_REF_MAP, arg[0].data.str.area, PAT_MF_NO_DNS,
-	                            1, err, file, line))
+	else if (!pattern_read_from_file(&desc->pat, PAT_REF_MAP, arg[0].data.str.area, PAT_MF_NO_DNS,
+	                                 1, err, file, line))
 		return 0;
 
 	/* the maps of type IP support a string as default value. This
@@ -178,6 +390,31 @@ static int sample_conv_map(const struct arg *arg_p, struct sample *smp, void *pr
 	/* get config */
 	desc = arg_p[0].data.map;
 
+	if (desc->bin) {
+		struct ist val;
+
+		if (!map_bin_lookup(desc->bin, smp, &val))
+			goto use_default;
+
+		/* values are zero-terminated */
+		switch (desc->conv->out_type) {
+		case SMP_T_STR:
+			if (!map_parse_str(val.ptr, &smp->data))
+				goto use_default;
+			smp->flags |= SMP_F_CONST;
+			return 1;
+		case SMP_T_SINT:
+			if (!map_parse_int(val.ptr, &smp->data))
+				goto use_default;
+			return 1;
+		case SMP_T_ADDR:
+			if (!map_parse_ip(val.ptr, &smp->data))
+				goto use_default;
+			return 1;
+		}
+		goto use_default;
+	}
+
 	/* Execute the match function. */
 	pat = pattern_exec_match(&desc->pat, smp, 1);
 
@@ -228,6 +465,7 @@ static int sample_conv_map(const struct arg *arg_p, struct sample *smp, void *pr
 		return 1;
 	}
 
+ use_default:
 	/* If no default value available, the converter fails. */
 	if (arg_p[1].type == ARGT_STOP)
 		return 0;
@@ -434,15 +672,20 @@ static int cli_io_handler_pats_list(struct appctx *appctx)
 
 	case STAT_ST_LIST:
 		while (appctx->ctx.map.ref) {
+			unsigned long long hits, misses, bypassed;
+
 			chunk_reset(&trash);
+			pat_ref_lru_stats(appctx->ctx.map.ref, &hits, &misses, &bypassed);
 
 			/* Build messages. If the reference is used by another category than
 			 * the listed categories, display the information in the message.
 			 */
-			chunk_appendf(&trash, "%d (%s) %s. curr_ver=%u next_ver=%u entry_cnt=%llu\n", appctx->ctx.map.ref->unique_id,
+			chunk_appendf(&trash, "%d (%s) %s. curr_ver=%u next_ver=%u entry_cnt=%llu"
+			              " cache_hits=%llu cache_misses=%llu cache_bypassed=%llu\n",
+			              appctx->ctx.map.ref->unique_id,
 			              appctx->ctx.map.ref->reference ? appctx->ctx.map.ref->reference : "",
 			              appctx->ctx.map.ref->display, appctx->ctx.map.ref->curr_gen, appctx->ctx.map.ref->next_gen,
-			              appctx->ctx.map.ref->entry_cnt);
+			              appctx->ctx.map.ref->entry_cnt, hits, misses, bypassed);
 
 			if (ci_putchk(si_ic(si), &trash) == -1) {
 				/* let's try again later from this stream. We add ourselves into
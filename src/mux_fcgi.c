@@ -63,6 +63,7 @@
 #define FCGI_CF_WAIT_FOR_HS     0x00000800  /* We did check that at least a stream was waiting for handshake */
 #define FCGI_CF_KEEP_CONN       0x00001000  /* HAProxy is responsible to close the connection */
 #define FCGI_CF_GET_VALUES      0x00002000  /* retrieve settings */
+#define FCGI_CF_WARMING         0x00004000  /* stream-less connection waiting to join its server's idle list */
 
 /* FCGI connection state (fcgi_conn->state) */
 enum fcgi_conn_st {
@@ -611,7 +612,8 @@ static inline struct buffer *fcgi_get_buf(struct fcgi_conn *fconn, struct buffer
 	    unlikely((buf = b_alloc(bptr)) == NULL)) {
 		fconn->buf_wait.target = fconn;
 		fconn->buf_wait.wakeup_cb = fcgi_buf_available;
-		LIST_APPEND(&ti->buffer_wq, &fconn->buf_wait.list);
+		/* the demux buffer carries the response */
+		b_queue((bptr == &fconn->dbuf) ? DB_CRIT_RES : DB_CRIT_DEFAULT, &fconn->buf_wait);
 	}
 	return buf;
 }
@@ -773,6 +775,17 @@ static int fcgi_init(struct connection *conn, struct proxy *px, struct session *
 
 	conn->ctx = fconn;
 
+	/* A connection installed without any upper context is a warm
+	 * connection opened ahead of time for the server's idle list (see
+	 * "pool-warm-conn"). It only has to be established within the connect
+	 * timeout, then it will wait for a stream to attach to it.
+	 */
+	if (!conn_ctx) {
+		fconn->flags |= FCGI_CF_WARMING;
+		if (t && tick_isset(px->timeout.connect))
+			t->expire = tick_add(now_ms, px->timeout.connect);
+	}
+
 	if (t)
 		task_queue(t);
 
@@ -781,9 +794,11 @@ static int fcgi_init(struct connection *conn, struct proxy *px, struct session *
 	 * caller calls ->attach(). For now the outgoing cs is stored as
 	 * conn->ctx by the caller and saved in conn_ctx.
 	 */
-	fstrm = fcgi_conn_stream_new(fconn, conn_ctx, sess);
-	if (!fstrm)
-		goto fail;
+	if (conn_ctx) {
+		fstrm = fcgi_conn_stream_new(fconn, conn_ctx, sess);
+		if (!fstrm)
+			goto fail;
+	}
 
 
 	/* Repare to read something */
@@ -881,6 +896,45 @@ static void fcgi_release(struct fcgi_conn *fconn)
 	}
 }
 
+/* Moves the warm connection <fconn> to its server's idle list once it is
+ * established and the GET_VALUES exchange, if any, is over. Connections which
+ * already got a GET_VALUES_RESULT record from the application go to the safe
+ * list. Returns 1 if the connection was moved, 0 if it must still wait, or -1
+ * if it was released.
+ */
+static int fcgi_conn_warm_done(struct fcgi_conn *fconn)
+{
+	struct connection *conn = fconn->conn;
+	struct server *srv = objt_server(conn->target);
+
+	/* errors are left to fcgi_process() or the timeout task */
+	if ((conn->flags & (CO_FL_ERROR|CO_FL_WAIT_XPRT)) ||
+	    fconn->state < FCGI_CS_RECORD_H || fconn->state == FCGI_CS_CLOSED)
+		return 0;
+
+	fconn->flags &= ~FCGI_CF_WARMING;
+
+	if (fconn->task) {
+		fconn->task->expire = tick_add(now_ms, fconn->timeout);
+		task_queue(fconn->task);
+	}
+
+	/* mark that the tasklet may lose its context to another thread and
+	 * that the handler needs to check it under the idle conns lock.
+	 */
+	HA_ATOMIC_OR(&fconn->wait_event.tasklet->state, TASK_F_USR1);
+	xprt_set_idle(conn, conn->xprt, conn->xprt_ctx);
+
+	if (!srv_add_to_idle_list(srv, conn, !!(fconn->flags & FCGI_CF_GET_VALUES))) {
+		/* The server doesn't want it, let's kill the connection right away */
+		TRACE_DEVEL("warm connection killed", FCGI_EV_FCONN_END, conn);
+		fcgi_release(fconn);
+		return -1;
+	}
+	TRACE_DEVEL("warm connection now idle", FCGI_EV_FCONN_WAKE, conn);
+	return 1;
+}
+
 /* Detect a pending read0 for a FCGI connection. It happens if a read0 is
  * pending on the connection AND if there is no more data in the demux
  * buffer. The function returns 1 to report a read0 or 0 otherwise.
@@ -3042,6 +3096,12 @@ struct task *fcgi_io_cb(struct task *t, void *ctx, unsigned int state)
 	 */
 	if (ret < 0)
 		t = NULL;
+	else if ((fconn->flags & FCGI_CF_WARMING) && (ret = fcgi_conn_warm_done(fconn)) != 0) {
+		/* the connection was either released or moved to the idle
+		 * list where it may already have been taken by another thread.
+		 */
+		return (ret < 0) ? NULL : t;
+	}
 
 	if (!ret && conn_in_list) {
 		struct server *srv = objt_server(conn->target);
@@ -3109,6 +3169,19 @@ static int fcgi_process(struct fcgi_conn *fconn)
 		}
 	}
 
+	if ((fconn->flags & FCGI_CF_WARMING) &&
+	    !(conn->flags & CO_FL_ERROR) && !fcgi_conn_read0_pending(fconn) &&
+	    fconn->state != FCGI_CS_CLOSED) {
+		/* A warm connection has no stream yet. Once ready, it is
+		 * moved to the idle list from the I/O callback so that nobody
+		 * touches it anymore past this point. Its connect timeout is
+		 * left untouched.
+		 */
+		if (!(conn->flags & CO_FL_WAIT_XPRT) && fconn->state >= FCGI_CS_RECORD_H)
+			tasklet_wakeup(fconn->wait_event.tasklet);
+		return 0;
+	}
+
 	if ((conn->flags & CO_FL_ERROR) || fcgi_conn_read0_pending(fconn) ||
 	    fconn->state == FCGI_CS_CLOSED || (fconn->flags & FCGI_CF_ABRTS_FAILED) ||
 	    eb_is_empty(&fconn->streams_by_id)) {
@@ -4256,7 +4329,7 @@ static const struct mux_ops mux_fcgi_ops = {
 	.ctl           = fcgi_ctl,
 	.show_fd       = fcgi_show_fd,
 	.takeover      = fcgi_takeover,
-	.flags         = MX_FL_HTX|MX_FL_HOL_RISK|MX_FL_NO_UPG,
+	.flags         = MX_FL_HTX|MX_FL_HOL_RISK|MX_FL_NO_UPG|MX_FL_MULTIPLEX|MX_FL_WARM_CONN,
 	.name          = "FCGI",
 };
 
@@ -36,7 +36,8 @@
 /* Flags indicating why writing output data are blocked */
 #define H1C_F_OUT_ALLOC      0x00000001 /* mux is blocked on lack of output buffer */
 #define H1C_F_OUT_FULL       0x00000002 /* mux is blocked on output buffer full */
-/* 0x00000004 - 0x00000008 unused */
+#define H1C_F_IDLE_BUFS      0x00000004 /* idle frontend connection accounted in idle_conn_bufs */
+/* 0x00000008 unused */
 
 /* Flags indicating why reading input data are blocked. */
 #define H1C_F_IN_ALLOC       0x00000010 /* mux is blocked on lack of input buffer */
@@ -62,8 +63,9 @@
 #define H1C_F_UPG_H2C        0x00080000 /* set if an upgrade to h2 should be done */
 #define H1C_F_CO_MSG_MORE    0x00100000 /* set if CO_SFL_MSG_MORE must be set when calling xprt->snd_buf() */
 #define H1C_F_CO_STREAMER    0x00200000 /* set if CO_SFL_STREAMER must be set when calling xprt->snd_buf() */
+#define H1C_F_WARMING        0x00400000 /* stream-less backend connection waiting to join its server's idle list */
 
-/* 0x00400000 - 0x40000000 unusued*/
+/* 0x00800000 - 0x40000000 unusued*/
 #define H1C_F_IS_BACK        0x80000000 /* Set on outgoing connection */
 
 /*
@@ -91,6 +93,11 @@
 #define H1S_F_HAVE_SRV_NAME  0x00002000 /* Set during output process if the server name header was added to the request */
 #define H1S_F_HAVE_O_CONN    0x00004000 /* Set during output process to know connection mode was processed */
 
+/* Minimum size of a DATA block for it to be sent directly from the HTX message
+ * by h1_send_data_iov() instead of being copied into the output buffer.
+ */
+#define H1_IOV_MIN_DATA      4096
+
 /* H1 connection descriptor */
 struct h1c {
 	struct connection *conn;
@@ -411,7 +418,7 @@ static int h1_buf_available(void *target)
 {
 	struct h1c *h1c = target;
 
-	if ((h1c->flags & H1C_F_IN_ALLOC) && b_alloc(&h1c->ibuf)) {
+	if ((h1c->flags & H1C_F_IN_ALLOC) && b_grow(&h1c->ibuf)) {
 		TRACE_STATE("unblocking h1c, ibuf allocated", H1_EV_H1C_RECV|H1_EV_H1C_BLK|H1_EV_H1C_WAKE, h1c->conn);
 		h1c->flags &= ~H1C_F_IN_ALLOC;
 		if (h1_recv_allowed(h1c))
@@ -437,6 +444,20 @@ static int h1_buf_available(void *target)
 	return 0;
 }
 
+/*
+ * Returns the criticality of the allocation of buffer <bptr> for <h1c>. The
+ * buffer carrying the response is the most critical one, and the input buffer
+ * of an idle frontend connection is the least critical one.
+ */
+static inline enum dynbuf_crit h1_buf_crit(const struct h1c *h1c, const struct buffer *bptr)
+{
+	if (!(h1c->flags & H1C_F_IS_BACK) == (bptr == &h1c->obuf))
+		return DB_CRIT_RES;
+	if (bptr == &h1c->ibuf && (h1c->flags & (H1C_F_IS_BACK|H1C_F_ST_IDLE)) == H1C_F_ST_IDLE)
+		return DB_CRIT_NEW;
+	return DB_CRIT_DEFAULT;
+}
+
 /*
  * Allocate a buffer. If if fails, it adds the mux in buffer wait queue.
  */
@@ -448,11 +469,43 @@ static inline struct buffer *h1_get_buf(struct h1c *h1c, struct buffer *bptr)
 	    unlikely((buf = b_alloc(bptr)) == NULL)) {
 		h1c->buf_wait.target = h1c;
 		h1c->buf_wait.wakeup_cb = h1_buf_available;
-		LIST_APPEND(&ti->buffer_wq, &h1c->buf_wait.list);
+		b_queue(h1_buf_crit(h1c, bptr), &h1c->buf_wait);
 	}
 	return buf;
 }
 
+/*
+ * Allocate the input buffer, preferably a small one, as most messages fit
+ * there. It falls back to h1_get_buf() if small buffers are not available.
+ */
+static inline struct buffer *h1_get_ibuf(struct h1c *h1c)
+{
+	if (likely(!LIST_INLIST(&h1c->buf_wait.list)) && b_alloc_small(&h1c->ibuf))
+		return &h1c->ibuf;
+	return h1_get_buf(h1c, &h1c->ibuf);
+}
+
+/*
+ * Replace a small input buffer by a regular one. If it fails, the mux is added
+ * in the buffer wait queue with H1C_F_IN_ALLOC set, so that h1_buf_available()
+ * grows it later. Returns 1 on success, 0 otherwise.
+ */
+static int h1_grow_ibuf(struct h1c *h1c)
+{
+	if (likely(!LIST_INLIST(&h1c->buf_wait.list))) {
+		if (b_grow(&h1c->ibuf)) {
+			TRACE_STATE("h1c ibuf grown", H1_EV_H1C_RECV, h1c->conn);
+			return 1;
+		}
+		h1c->buf_wait.target = h1c;
+		h1c->buf_wait.wakeup_cb = h1_buf_available;
+		b_queue(h1_buf_crit(h1c, &h1c->ibuf), &h1c->buf_wait);
+	}
+	h1c->flags |= H1C_F_IN_ALLOC;
+	TRACE_STATE("waiting for h1c ibuf growth", H1_EV_H1C_RECV|H1_EV_H1C_BLK, h1c->conn);
+	return 0;
+}
+
 /*
  * Release a buffer, if any, and try to wake up entities waiting in the buffer
  * wait queue.
@@ -465,6 +518,28 @@ static inline void h1_release_buf(struct h1c *h1c, struct buffer *bptr)
 	}
 }
 
+/*
+ * Updates the accounting of idle frontend connection <h1c> in idle_conn_bufs.
+ * A connection waiting for its next request is expected to have released its
+ * buffers, unless some data remain to be sent or to be parsed. If <gone> is
+ * non-zero, the connection is about to be released and leaves the gauge.
+ */
+static inline void h1_update_idle_bufs(struct h1c *h1c, int gone)
+{
+	int holds = !gone &&
+		(h1c->flags & (H1C_F_IS_BACK|H1C_F_ST_IDLE)) == H1C_F_ST_IDLE &&
+		(b_size(&h1c->ibuf) || b_size(&h1c->obuf));
+
+	if (holds && !(h1c->flags & H1C_F_IDLE_BUFS)) {
+		h1c->flags |= H1C_F_IDLE_BUFS;
+		_HA_ATOMIC_INC(&idle_conn_bufs);
+	}
+	else if (!holds && (h1c->flags & H1C_F_IDLE_BUFS)) {
+		h1c->flags &= ~H1C_F_IDLE_BUFS;
+		_HA_ATOMIC_DEC(&idle_conn_bufs);
+	}
+}
+
 /* returns the number of streams in use on a connection to figure if it's idle
  * or not. We rely on H1C_F_ST_IDLE to know if the connection is in-use or
  * not. This flag is only set when no H1S is attached and when the previous
@@ -576,7 +651,7 @@ static struct conn_stream *h1s_new_cs(struct h1s *h1s, struct buffer *input)
 	struct conn_stream *cs;
 
 	TRACE_ENTER(H1_EV_STRM_NEW, h1s->h1c->conn, h1s);
-	cs = cs_new(h1s->h1c->conn, h1s->h1c->conn->target);
+	cs = cs_new_with_stream(h1s->h1c->conn);
 	if (!cs) {
 		TRACE_ERROR("CS allocation failure", H1_EV_STRM_NEW|H1_EV_STRM_END|H1_EV_STRM_ERR, h1s->h1c->conn, h1s);
 		goto err;
@@ -823,7 +898,18 @@ static int h1_init(struct connection *conn, struct proxy *proxy, struct session
 
 	conn->ctx = h1c;
 
-	if (h1c->flags & H1C_F_IS_BACK) {
+	if ((h1c->flags & H1C_F_IS_BACK) && !conn_ctx) {
+		/* A backend connection installed without any upper context is
+		 * a warm connection opened ahead of time for the server's idle
+		 * list (see "pool-warm-conn"). It only has to be established
+		 * within the connect timeout, then it will wait for a stream to
+		 * attach to it.
+		 */
+		h1c->flags |= H1C_F_WARMING;
+		if (t && tick_isset(proxy->timeout.connect))
+			t->expire = tick_add(now_ms, proxy->timeout.connect);
+	}
+	else if (h1c->flags & H1C_F_IS_BACK) {
 		/* Create a new H1S now for backend connection only */
 		if (!h1c_bck_stream_new(h1c, conn_ctx, sess))
 			goto fail;
@@ -881,6 +967,8 @@ static void h1_release(struct h1c *h1c)
 	TRACE_POINT(H1_EV_H1C_END);
 
 	if (h1c) {
+		h1_update_idle_bufs(h1c, 1);
+
 		/* The connection must be aattached to this mux to be released */
 		if (h1c->conn && h1c->conn->ctx == h1c)
 			conn = h1c->conn;
@@ -893,7 +981,9 @@ static void h1_release(struct h1c *h1c)
 			if (h1c->wait_event.events)
 				conn->xprt->unsubscribe(conn, conn->xprt_ctx,
 				    h1c->wait_event.events, &h1c->wait_event);
-			if (conn_upgrade_mux_fe(conn, NULL, &h1c->ibuf, ist("h2"), PROTO_MODE_HTTP) != -1) {
+			/* the H2 mux needs a regular buffer */
+			if (b_grow(&h1c->ibuf) &&
+			    conn_upgrade_mux_fe(conn, NULL, &h1c->ibuf, ist("h2"), PROTO_MODE_HTTP) != -1) {
 				/* connection successfully upgraded to H2, this
 				 * mux was already released */
 				return;
@@ -941,6 +1031,42 @@ static void h1_release(struct h1c *h1c)
 	}
 }
 
+/* Moves the warm connection <h1c> to its server's idle list once it is
+ * established, including the SSL handshake if any. Returns 1 if the
+ * connection was moved, 0 if it must still wait, or -1 if it was released.
+ */
+static int h1c_warm_done(struct h1c *h1c)
+{
+	struct connection *conn = h1c->conn;
+
+	/* errors are left to h1_process() or the timeout task */
+	if ((conn->flags & (CO_FL_ERROR|CO_FL_WAIT_XPRT)) || !(h1c->flags & H1C_F_ST_IDLE))
+		return 0;
+
+	h1c->flags &= ~H1C_F_WARMING;
+
+	if (h1c->task) {
+		h1c->task->expire = tick_add(now_ms, h1c->timeout);
+		task_queue(h1c->task);
+	}
+
+	/* mark that the tasklet may lose its context to another thread and
+	 * that the handler needs to check it under the idle conns lock.
+	 */
+	HA_ATOMIC_OR(&h1c->wait_event.tasklet->state, TASK_F_USR1);
+	conn->xprt->subscribe(conn, conn->xprt_ctx, SUB_RETRY_RECV, &h1c->wait_event);
+	xprt_set_idle(conn, conn->xprt, conn->xprt_ctx);
+
+	if (!srv_add_to_idle_list(objt_server(conn->target), conn, 0)) {
+		/* The server doesn't want it, let's kill the connection right away */
+		TRACE_DEVEL("warm connection killed", H1_EV_H1C_END, conn);
+		h1_release(h1c);
+		return -1;
+	}
+	TRACE_DEVEL("warm connection now idle", H1_EV_H1C_WAKE, conn);
+	return 1;
+}
+
 /******************************************************/
 /* functions below are for the H1 protocol processing */
 /******************************************************/
@@ -1718,6 +1844,75 @@ static size_t h1_process_demux(struct h1c *h1c, struct buffer *buf, size_t count
 	return 0;
 }
 
+/* Sends the contents of DATA block <v> directly from the HTX message, preceded
+ * by the pending output data of <h1c> and by the data formatted so far in
+ * <tmp>, using the transport layer's snd_iov() callback. The chunk envelope is
+ * added if <chunked> is set, as well as the last chunk if <last> is also set.
+ * This saves the copy of the payload into the output buffer, except for what
+ * the transport layer did not accept, which is appended to the output buffer.
+ * The caller must have made sure that everything fits there. <tmp> is then
+ * reset to be used for the next blocks.
+ */
+static void h1_send_data_iov(struct h1c *h1c, struct buffer *tmp, const struct ist v, int chunked, int last, int flags)
+{
+	struct connection *conn = h1c->conn;
+	struct iovec iov[5];
+	struct ist parts[3];
+	char chk[10], *beg;
+	uint32_t chksz = v.len;
+	size_t sent, len;
+	int cnt = 0, i;
+
+	/* first put everything that was formatted so far into the output buffer */
+	if (tmp->area == h1c->obuf.area + h1c->obuf.head)
+		h1c->obuf.data = tmp->data;
+	else
+		b_putblk(&h1c->obuf, tmp->area, tmp->data);
+
+	beg = chk + sizeof(chk);
+	if (chunked) {
+		*--beg = '\n';
+		*--beg = '\r';
+		do {
+			*--beg = hextab[chksz & 0xF];
+		} while (chksz >>= 4);
+	}
+	parts[0] = ist2(beg, chk + sizeof(chk) - beg);
+	parts[1] = v;
+	parts[2] = !chunked ? IST_NULL : last ? ist("\r\n0\r\n\r\n") : ist("\r\n");
+
+	for (len = 0; len < b_data(&h1c->obuf); len += iov[cnt++].iov_len) {
+		iov[cnt].iov_base = b_peek(&h1c->obuf, len);
+		iov[cnt].iov_len  = b_contig_data(&h1c->obuf, len);
+	}
+	for (i = 0; i < 3; i++) {
+		if (!parts[i].len)
+			continue;
+		iov[cnt].iov_base = parts[i].ptr;
+		iov[cnt].iov_len  = parts[i].len;
+		cnt++;
+	}
+
+	sent = conn->xprt->snd_iov(conn, conn->xprt_ctx, iov, cnt, flags);
+	TRACE_DATA("data sent from HTX", H1_EV_H1C_SEND, conn, 0, 0, (size_t[]){sent});
+
+	len = MIN(sent, b_data(&h1c->obuf));
+	b_del(&h1c->obuf, len);
+	b_realign_if_empty(&h1c->obuf);
+	sent -= len;
+
+	/* keep what was not sent */
+	for (i = 0; i < 3; i++) {
+		len = MIN(sent, parts[i].len);
+		sent -= len;
+		b_putblk(&h1c->obuf, parts[i].ptr + len, parts[i].len - len);
+	}
+
+	tmp->area = b_data(&h1c->obuf) ? trash.area : h1c->obuf.area + h1c->obuf.head;
+	tmp->data = 0;
+	tmp->size = b_room(&h1c->obuf);
+}
+
 /*
  * Process outgoing data. It parses data and transfer them from the channel buffer into
  * h1c->obuf. It returns the number of bytes parsed and transferred if > 0, or
@@ -2140,6 +2335,17 @@ static size_t h1_process_mux(struct h1c *h1c, struct buffer *buf, size_t count)
 				}
 				v = htx_get_blk_value(chn_htx, blk);
 				v.len = vlen;
+
+				/* large blocks are sent directly from the HTX
+				 * message when the transport layer permits it.
+				 */
+				if (vlen >= H1_IOV_MIN_DATA && h1c->conn->xprt->snd_iov &&
+				    !(h1c->wait_event.events & SUB_RETRY_SEND)) {
+					h1_send_data_iov(h1c, &tmp, v, !!(h1m->flags & H1_MF_CHNK), last_data,
+							 ((h1c->flags & H1C_F_CO_MSG_MORE) || count > vlen) ? CO_SFL_MSG_MORE : 0);
+					goto data_xferred;
+				}
+
 				if (!h1_format_htx_data(v, &tmp, !!(h1m->flags & H1_MF_CHNK)))
 					goto full;
 
@@ -2147,6 +2353,7 @@ static size_t h1_process_mux(struct h1c *h1c, struct buffer *buf, size_t count)
 				if ((h1m->flags & H1_MF_CHNK) && last_data && !chunk_memcat(&tmp, "0\r\n\r\n", 5))
 					goto error;
 
+			  data_xferred:
 				if (h1m->state == H1_MSG_DATA)
 					TRACE_PROTO((!(h1m->flags & H1_MF_RESP) ? "H1 request payload data xferred" : "H1 response payload data xferred"),
 						    H1_EV_TX_DATA|H1_EV_TX_BODY, h1c->conn, h1s, 0, (size_t[]){v.len});
@@ -2507,7 +2714,7 @@ static int h1_recv(struct h1c *h1c)
 		return 1;
 	}
 
-	if (!h1_get_buf(h1c, &h1c->ibuf)) {
+	if (!h1_get_ibuf(h1c)) {
 		h1c->flags |= H1C_F_IN_ALLOC;
 		TRACE_STATE("waiting for h1c ibuf allocation", H1_EV_H1C_RECV|H1_EV_H1C_BLK, h1c->conn);
 		return 0;
@@ -2527,6 +2734,13 @@ static int h1_recv(struct h1c *h1c)
 		flags |= CO_RFL_READ_ONCE;
 
 	max = buf_room_for_htx_data(&h1c->ibuf);
+
+	/* Never completely fill a small buffer, otherwise the parser could
+	 * consider that the message is too large while waiting for it to grow.
+	 */
+	if (max && b_is_small(&h1c->ibuf))
+		max--;
+
 	if (max) {
 		if (h1c->flags & H1C_F_IN_FULL) {
 			h1c->flags &= ~H1C_F_IN_FULL;
@@ -2552,6 +2766,10 @@ static int h1_recv(struct h1c *h1c)
 
 	if (!b_data(&h1c->ibuf))
 		h1_release_buf(h1c, &h1c->ibuf);
+	else if (b_is_small(&h1c->ibuf)) {
+		if (buf_room_for_htx_data(&h1c->ibuf) <= 1)
+			h1_grow_ibuf(h1c);
+	}
 	else if (!buf_room_for_htx_data(&h1c->ibuf)) {
 		h1c->flags |= H1C_F_IN_FULL;
 		TRACE_STATE("h1c ibuf full", H1_EV_H1C_RECV|H1_EV_H1C_BLK);
@@ -2588,6 +2806,9 @@ static int h1_send(struct h1c *h1c)
 	if (h1c->flags & H1C_F_CO_STREAMER)
 		flags |= CO_SFL_STREAMER;
 
+	/* obuf is only referenced here, its storage may be swapped */
+	flags |= CO_SFL_ZEROCOPY;
+
 	ret = conn->xprt->snd_buf(conn, conn->xprt_ctx, &h1c->obuf, b_data(&h1c->obuf), flags);
 	if (ret > 0) {
 		TRACE_DATA("data sent", H1_EV_H1C_SEND, h1c->conn, 0, 0, (size_t[]){ret});
@@ -2752,6 +2973,18 @@ static int h1_process(struct h1c * h1c)
 		}
 	}
 
+	if (h1c->flags & H1C_F_WARMING) {
+		/* A warm connection has no stream yet. Once ready, it is moved
+		 * to the idle list from the I/O callback so that nobody touches
+		 * it anymore past this point. Its connect timeout is left
+		 * untouched.
+		 */
+		if (!(conn->flags & CO_FL_WAIT_XPRT))
+			tasklet_wakeup(h1c->wait_event.tasklet);
+		TRACE_LEAVE(H1_EV_H1C_WAKE, conn);
+		return 0;
+	}
+
 	if (!b_data(&h1c->ibuf))
 		h1_release_buf(h1c, &h1c->ibuf);
 
@@ -2801,6 +3034,7 @@ struct task *h1_io_cb(struct task *t, void *ctx, unsigned int state)
 	struct tasklet *tl = (struct tasklet *)t;
 	int conn_in_list;
 	struct h1c *h1c = ctx;
+	uint64_t cpu_start = conn_cpu_start();
 	int ret = 0;
 
 	if (state & TASK_F_USR1) {
@@ -2849,6 +3083,19 @@ struct task *h1_io_cb(struct task *t, void *ctx, unsigned int state)
 	 */
 	if (ret < 0)
 		t = NULL;
+	else if ((h1c->flags & H1C_F_WARMING) && (ret = h1c_warm_done(h1c)) != 0) {
+		/* the connection was either released or moved to the idle
+		 * list where it may already have been taken by another thread.
+		 */
+		return (ret < 0) ? NULL : t;
+	}
+
+	if (!ret)
+		h1_update_idle_bufs(h1c, 0);
+
+	/* the connection is still ours here */
+	if (ret >= 0)
+		conn_cpu_account(conn, cpu_start);
 
 	if (!ret && conn_in_list) {
 		struct server *srv = objt_server(conn->target);
@@ -3136,11 +3383,17 @@ static void h1_detach(struct conn_stream *cs)
 				if (h1_process(h1c) == -1)
 					goto end;
 			}
-			else
+			else {
+				/* don't keep empty buffers while waiting for the next request */
+				h1_release_buf(h1c, &h1c->ibuf);
+				if (!b_data(&h1c->obuf))
+					h1_release_buf(h1c, &h1c->obuf);
 				h1c->conn->xprt->subscribe(h1c->conn, h1c->conn->xprt_ctx, SUB_RETRY_RECV, &h1c->wait_event);
+			}
 		}
 		h1_set_idle_expiration(h1c);
 		h1_refresh_timeout(h1c);
+		h1_update_idle_bufs(h1c, 0);
 	}
   end:
 	TRACE_LEAVE(H1_EV_STRM_END);
@@ -3836,7 +4089,7 @@ static const struct mux_ops mux_http_ops = {
 	.show_fd     = h1_show_fd,
 	.ctl         = h1_ctl,
 	.takeover    = h1_takeover,
-	.flags       = MX_FL_HTX,
+	.flags       = MX_FL_HTX|MX_FL_WARM_CONN,
 	.name        = "H1",
 };
 
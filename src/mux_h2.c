@@ -18,9 +18,11 @@
 #include <haproxy/hpack-dec.h>
 #include <haproxy/hpack-enc.h>
 #include <haproxy/hpack-tbl.h>
+#include <haproxy/http.h>
 #include <haproxy/http_htx.h>
 #include <haproxy/htx.h>
 #include <haproxy/istbuf.h>
+#include <haproxy/listener.h>
 #include <haproxy/log.h>
 #include <haproxy/net_helper.h>
 #include <haproxy/session-t.h>
@@ -59,6 +61,11 @@ static const struct h2s *h2_idle_stream;
 #define H2_CF_DEM_TOOMANY       0x00000100  // demux blocked waiting for some conn_streams to leave
 #define H2_CF_DEM_BLOCK_ANY     0x000001F0  // aggregate of the demux flags above except DALLOC/DFULL
 
+/* flags for the estimation of the bandwidth-delay product */
+#define H2_CF_BDP_PROBE         0x00000200  // a BDP probe (PING) must be sent
+#define H2_CF_BDP_WAIT          0x00000400  // a BDP probe was sent, waiting for its ACK
+#define H2_CF_MCS_UPDATE        0x00000800  // a new MAX_CONCURRENT_STREAMS setting must be sent
+
 /* other flags */
 #define H2_CF_GOAWAY_SENT       0x00001000  // a GOAWAY frame was successfully sent
 #define H2_CF_GOAWAY_FAILED     0x00002000  // a GOAWAY frame failed to be sent
@@ -67,6 +74,11 @@ static const struct h2s *h2_idle_stream;
 #define H2_CF_WINDOW_OPENED     0x00010000  // demux increased window already advertised
 #define H2_CF_RCVD_SHUT         0x00020000  // a recv() attempt already failed on a shutdown
 #define H2_CF_END_REACHED       0x00040000  // pending data too short with RCVD_SHUT present
+#define H2_CF_SND_DEFERRED      0x00080000  // sender tasklet queued late to coalesce streams' frames
+#define H2_CF_EDHT_RESIZE       0x00100000  // a table size update must start the next header block
+#define H2_CF_EDHT_SAVED        0x00200000  // the encoder's table was saved for the header block being built
+#define H2_CF_MIGRATING         0x00400000  // idle frontend connection offered to another thread
+#define H2_CF_IDLE_BUFS         0x00800000  // idle frontend connection accounted in idle_conn_bufs
 
 /* H2 connection state, in h2c->st0 */
 enum h2_cs {
@@ -94,13 +106,18 @@ struct h2c {
 
 	/* 16 bit hole here */
 	uint32_t flags; /* connection flags: H2_CF_* */
-	uint32_t streams_limit; /* maximum number of concurrent streams the peer supports */
+	uint32_t streams_limit; /* max concurrent streams the peer supports (back) or was granted (front) */
 	int32_t max_id; /* highest ID known on this connection, <0 before preface */
 	uint32_t rcvd_c; /* newly received data to ACK for the connection */
 	uint32_t rcvd_s; /* newly received data to ACK for the current stream (dsi) */
+	uint32_t rwin;   /* receive window granted to streams, grown with the BDP */
+	uint32_t bdp_bytes; /* data received since the last BDP probe was sent */
+	uint32_t bdp_date;  /* date the last BDP probe was sent (now_ms) */
+	uint32_t rtt;       /* RTT measured by the last BDP probe, in ms */
+	uint32_t tx_sent;   /* total amount of data sent, for the streams' budgets */
 
 	/* states for the demux direction */
-	struct hpack_dht *ddht; /* demux dynamic header table */
+	struct hpack_dht *ddht; /* demux dynamic header table, NULL until needed */
 	struct buffer dbuf;    /* demux buffer */
 
 	int32_t dsi; /* demux stream ID (<0 = idle) */
@@ -113,6 +130,9 @@ struct h2c {
 
 	/* states for the mux direction */
 	struct buffer mbuf[H2C_MBUF_CNT];   /* mux buffers (ring) */
+	struct hpack_dht *edht; /* mux (encoder) dynamic header table, NULL if unused */
+	uint32_t edht_size; /* current encoder table size, as last announced */
+	uint32_t edht_next; /* encoder table size to apply once peer's settings are ACKed */
 	int32_t msi; /* mux stream ID (<0 = idle) */
 	int32_t mfl; /* mux frame length (if dsi >= 0) */
 	int8_t  mft; /* mux frame type   (if dsi >= 0) */
@@ -121,6 +141,7 @@ struct h2c {
 	int32_t miw; /* mux initial window size for all new streams */
 	int32_t mws; /* mux window size. Can be negative. */
 	int32_t mfs; /* mux's max frame size */
+	unsigned int lane;  /* mbuf index of the urgent frames after the head, or 0 */
 
 	int timeout;        /* idle timeout duration in ticks */
 	int shut_timeout;   /* idle timeout duration in ticks after GOAWAY was sent */
@@ -197,6 +218,14 @@ enum h2_ss {
 #define H2_SF_EXT_CONNECT_RCVD  0x00080000  // rfc 8441 an Extended CONNECT has been received and parsed
 
 #define H2_SF_TUNNEL_ABRT       0x00100000  // A tunnel attempt was aborted
+#define H2_SF_INCREMENTAL       0x00200000  // RFC9218: the response may be delivered incrementally
+#define H2_SF_INTERIM_SENT      0x00400000  // a HEADERS frame for a 1xx response was sent
+
+/* RFC9218 default urgency for streams which don't advertise any */
+#define H2_DEFAULT_URGENCY      3
+
+/* max number of mux buffers DATA frames may use when prioritizing */
+#define H2_PRIO_DATA_MBUFS      2
 
 /* H2 stream descriptor, describing the stream as it appears in the H2C, and as
  * it is being processed in the internal HTTP representation (HTX).
@@ -209,9 +238,12 @@ struct h2s {
 	int32_t id; /* stream ID */
 	uint32_t flags;      /* H2_SF_* */
 	int sws;             /* stream window size, to be added to the mux's initial window size */
+	uint32_t rwin;       /* receive window advertised to the peer for this stream */
+	uint32_t tx_end;     /* value of h2c->tx_sent once its last DATA is sent */
 	enum h2_err errcode; /* H2 err code (H2_ERR_*) */
 	enum h2_ss st;
 	uint16_t status;     /* HTTP response status */
+	uint8_t urgency;     /* RFC9218 urgency, from 0 (highest) to 7 (lowest) */
 	unsigned long long body_len; /* remaining body length according to content-length if H2_SF_DATA_CLEN */
 	struct buffer rxbuf; /* receive buffer, always valid (buf_empty or real buffer) */
 	struct wait_event *subs;      /* recv wait_event the conn_stream associated is waiting on (via h2_subscribe) */
@@ -404,6 +436,9 @@ enum {
 	H2_ST_TOTAL_CONN,
 	H2_ST_TOTAL_STREAM,
 
+	H2_ST_IDLE_RECLAIMED,
+	H2_ST_STRM_REFUSED,
+
 	H2_STATS_COUNT /* must be the last member of the enum */
 };
 
@@ -436,6 +471,11 @@ static struct name_desc h2_stats[] = {
 	                         .desc = "Total number of connections" },
 	[H2_ST_TOTAL_STREAM] = { .name = "h2_backend_total_streams",
 	                         .desc = "Total number of streams" },
+
+	[H2_ST_IDLE_RECLAIMED] = { .name = "h2_idle_bytes_reclaimed",
+	                           .desc = "Total number of bytes released by connections without streams" },
+	[H2_ST_STRM_REFUSED]   = { .name = "h2_refused_streams",
+	                           .desc = "Total number of streams refused above the adapted concurrency limit" },
 };
 
 static struct h2_counters {
@@ -454,6 +494,9 @@ static struct h2_counters {
 	long long open_streams;  /* count of currently open streams */
 	long long total_conns;   /* total number of connections */
 	long long total_streams; /* total number of streams */
+
+	long long idle_reclaimed; /* total number of bytes released by idle connections */
+	long long strm_refused;   /* total number of streams refused above the adapted limit */
 } h2_counters;
 
 static void h2_fill_stats(void *data, struct field *stats)
@@ -475,6 +518,9 @@ static void h2_fill_stats(void *data, struct field *stats)
 	stats[H2_ST_OPEN_STREAM]  = mkf_u64(FN_GAUGE,   counters->open_streams);
 	stats[H2_ST_TOTAL_CONN]   = mkf_u64(FN_COUNTER, counters->total_conns);
 	stats[H2_ST_TOTAL_STREAM] = mkf_u64(FN_COUNTER, counters->total_streams);
+
+	stats[H2_ST_IDLE_RECLAIMED] = mkf_u64(FN_COUNTER, counters->idle_reclaimed);
+	stats[H2_ST_STRM_REFUSED]   = mkf_u64(FN_COUNTER, counters->strm_refused);
 }
 
 static struct stats_module h2_stats_module = {
@@ -503,14 +549,31 @@ DECLARE_STATIC_POOL(pool_head_h2s, "h2s", sizeof(struct h2s));
  */
 #define H2_INITIAL_WINDOW_INCREMENT ((1U<<31)-1 - 65535)
 
+/* Payload of the PING frames used to estimate the bandwidth-delay product.
+ * The amount of data received between the emission of such a PING and the
+ * reception of its ACK is the amount the peer could send during one RTT. When
+ * it gets close to the stream window, the window is what limits the transfer,
+ * so it is doubled, within the limit set by "tune.h2.max-window-size".
+ */
+#define H2_BDP_PROBE_DATA "HAPx-BDP"
+
 /* maximum amount of data we're OK with re-aligning for buffer optimizations */
 #define MAX_DATA_REALIGN 1024
 
 /* a few settings from the global section */
 static int h2_settings_header_table_size      =  4096; /* initial value */
 static int h2_settings_initial_window_size    = 65535; /* initial value */
+static int h2_settings_max_window_size        = 0;     /* limit for the window growth, 0=disabled */
 static unsigned int h2_settings_max_concurrent_streams = 100;
+static unsigned int h2_settings_min_concurrent_streams = 0; /* lowest adapted limit, 0=fixed limit */
 static int h2_settings_max_frame_size         = 0;     /* unset */
+static int h2_coalesce_sends                  = 0;     /* defer sends to the end of the scheduler pass */
+static int h2_enc_table_size                  = 0;     /* encoder's dynamic table size, 0=disabled */
+static int h2_prioritize                      = 0;     /* order sending streams by RFC9218 priority */
+static unsigned int h2_stream_send_budget     = 0;     /* max data queued per stream when others wait, 0=unlimited */
+
+/* per-thread copy of the encoder's table used to roll back aborted blocks */
+static THREAD_LOCAL struct hpack_dht *h2_edht_undo = NULL;
 
 /* a dmumy closed stream */
 static const struct h2s *h2_closed_stream = &(const struct h2s){
@@ -700,6 +763,43 @@ static inline int h2c_may_expire(const struct h2c *h2c)
 	       !LIST_ISEMPTY(&h2c->send_list);
 }
 
+/* Returns the thread the frontend connection <h2c> should move to, or -1 if it
+ * must stay on the current one. Only connections which are idle, i.e. waiting
+ * for a new frame with no stream, nothing buffered and only a pending receive
+ * subscription may move, and only when the current thread runs too many of its
+ * listener's connections (see listener_lighter_thread()).
+ */
+static inline int h2c_migrate_thread(const struct h2c *h2c)
+{
+	const struct listener *l;
+
+	if (!global.tune.listener_rebalance)
+		return -1;
+
+	if ((h2c->flags & (H2_CF_IS_BACK | H2_CF_MIGRATING | H2_CF_GOAWAY_SENT | H2_CF_GOAWAY_FAILED |
+	                   H2_CF_RCVD_SHUT | H2_CF_SND_DEFERRED | H2_CF_MUX_BLOCK_ANY |
+	                   H2_CF_DEM_DALLOC | H2_CF_DEM_DFULL | H2_CF_DEM_BLOCK_ANY)) ||
+	    h2c->st0 != H2_CS_FRAME_H || !eb_is_empty(&h2c->streams_by_id) ||
+	    b_data(&h2c->dbuf) || br_data(h2c->mbuf) || LIST_INLIST(&h2c->buf_wait.list) ||
+	    h2c->wait_event.events != SUB_RETRY_RECV || h2c->proxy->disabled ||
+	    (h2c->conn->flags & (CO_FL_ERROR | CO_FL_SOCK_RD_SH | CO_FL_SOCK_WR_SH | CO_FL_WAIT_XPRT)))
+		return -1;
+
+	l = objt_listener(h2c->conn->target);
+	return l ? listener_lighter_thread(l) : -1;
+}
+
+/* Withdraws the frontend connection <h2c> offered to other threads, which was
+ * not taken over. Must be called with the thread's idle_conns_lock held.
+ */
+static inline void h2c_migrate_cancel(struct h2c *h2c)
+{
+	h2c->flags &= ~H2_CF_MIGRATING;
+	conn_migrate_cancel(h2c->conn);
+	HA_ATOMIC_AND(&h2c->wait_event.tasklet->state, ~TASK_F_USR1);
+	xprt_set_used(h2c->conn, h2c->conn->xprt, h2c->conn->xprt_ctx);
+}
+
 static __inline int
 h2c_is_dead(const struct h2c *h2c)
 {
@@ -762,6 +862,57 @@ static inline void h2c_restart_reading(const struct h2c *h2c, int consider_buffe
 }
 
 
+/* Returns the number of concurrent streams the frontend connection <h2c> should
+ * be granted. It is "tune.h2.max-concurrent-streams" on an idle thread and goes
+ * down to "tune.h2.min-concurrent-streams" as the thread's run queue fills up
+ * to "tune.runqueue-depth" entries, or as soon as the default backend of the
+ * frontend has queued streams, since there is no point in accepting more work
+ * which will only wait there.
+ */
+static inline unsigned int h2c_frt_streams_target(const struct h2c *h2c)
+{
+	const struct proxy *be = h2c->proxy->defbe.be;
+	unsigned int max = h2_settings_max_concurrent_streams;
+	unsigned int min = h2_settings_min_concurrent_streams;
+	unsigned int load, depth;
+
+	if (!min)
+		return max;
+
+	if (be && be->totpend)
+		return min;
+
+	load  = _HA_ATOMIC_LOAD(&task_per_thread[tid].rq_total);
+	depth = global.tune.runqueue_depth;
+	if (load >= depth)
+		return min;
+	return max - (unsigned long long)(max - min) * load / depth;
+}
+
+/* Adapts the number of concurrent streams granted to the frontend connection
+ * <h2c> to the current load. The peer is only notified when the limit reaches
+ * one of its bounds or moves by at least a quarter of the range, so that it
+ * does not receive a SETTINGS frame for each new stream. A lower limit is
+ * enforced at once: the streams the peer may open before it gets the new
+ * setting are refused with REFUSED_STREAM, which it may safely retry.
+ */
+static inline void h2c_frt_adapt_streams(struct h2c *h2c)
+{
+	unsigned int target = h2c_frt_streams_target(h2c);
+	unsigned int step = (h2_settings_max_concurrent_streams - h2_settings_min_concurrent_streams + 3) / 4;
+
+	if (target == h2c->streams_limit)
+		return;
+
+	if (target == h2_settings_min_concurrent_streams ||
+	    target == h2_settings_max_concurrent_streams ||
+	    target >= h2c->streams_limit + step || target + step <= h2c->streams_limit) {
+		TRACE_STATE("adapting max concurrent streams", H2_EV_H2C_WAKE, h2c->conn);
+		h2c->streams_limit = target;
+		h2c->flags |= H2_CF_MCS_UPDATE;
+	}
+}
+
 /* returns true if the front connection has too many conn_streams attached */
 static inline int h2_frt_has_too_many_cs(const struct h2c *h2c)
 {
@@ -813,30 +964,76 @@ static inline struct buffer *h2_get_buf(struct h2c *h2c, struct buffer *bptr)
 	    unlikely((buf = b_alloc(bptr)) == NULL)) {
 		h2c->buf_wait.target = h2c;
 		h2c->buf_wait.wakeup_cb = h2_buf_available;
-		LIST_APPEND(&ti->buffer_wq, &h2c->buf_wait.list);
+		/* responses are received on the backend side and sent on the
+		 * frontend side.
+		 */
+		b_queue((!(h2c->flags & H2_CF_IS_BACK) == (bptr != &h2c->dbuf)) ? DB_CRIT_RES : DB_CRIT_DEFAULT,
+			&h2c->buf_wait);
 	}
 	return buf;
 }
 
-static inline void h2_release_buf(struct h2c *h2c, struct buffer *bptr)
+static inline size_t h2_release_buf(struct h2c *h2c, struct buffer *bptr)
 {
-	if (bptr->size) {
+	size_t size = bptr->size;
+
+	if (size) {
 		b_free(bptr);
 		offer_buffers(NULL, 1);
 	}
+	return size;
 }
 
-static inline void h2_release_mbuf(struct h2c *h2c)
+/* releases the mux buffers and returns the number of bytes released */
+static inline size_t h2_release_mbuf(struct h2c *h2c)
 {
 	struct buffer *buf;
 	unsigned int count = 0;
+	size_t size = 0;
 
 	while (b_size(buf = br_head_pick(h2c->mbuf))) {
+		size += b_size(buf);
 		b_free(buf);
 		count++;
 	}
 	if (count)
 		offer_buffers(NULL, count);
+	return size;
+}
+
+/* Releases the demux dynamic headers table of connection <h2c> if it holds
+ * no entry and still has its initial size, since it may then be allocated
+ * again on the next HEADERS frame without any visible change for the peer's
+ * encoder. Returns the number of bytes released.
+ */
+static inline size_t h2c_release_ddht(struct h2c *h2c)
+{
+	if (!h2c->ddht || h2c->ddht->used || h2c->ddht->size != pool_head_hpack_tbl->size)
+		return 0;
+
+	hpack_dht_free(h2c->ddht);
+	h2c->ddht = NULL;
+	return pool_head_hpack_tbl->size;
+}
+
+/* Updates the accounting of frontend connection <h2c> in idle_conn_bufs when it
+ * has no stream but still holds its demux buffer or some mux buffers. If <gone>
+ * is non-zero, the connection is about to be released and leaves the gauge.
+ */
+static inline void h2c_update_idle_bufs(struct h2c *h2c, int gone)
+{
+	int holds = !gone && !(h2c->flags & H2_CF_IS_BACK) &&
+		eb_is_empty(&h2c->streams_by_id) &&
+		(b_size(&h2c->dbuf) || b_size(br_head(h2c->mbuf)));
+
+	if (holds && !(h2c->flags & H2_CF_IDLE_BUFS)) {
+		h2c->flags |= H2_CF_IDLE_BUFS;
+		_HA_ATOMIC_INC(&idle_conn_bufs);
+	}
+	else if (!holds && (h2c->flags & H2_CF_IDLE_BUFS)) {
+		h2c->flags &= ~H2_CF_IDLE_BUFS;
+		_HA_ATOMIC_DEC(&idle_conn_bufs);
+	}
 }
 
 /* returns the number of allocatable outgoing streams for the connection taking
@@ -968,9 +1165,24 @@ static int h2_init(struct connection *conn, struct proxy *prx, struct session *s
 		}
 	}
 
-	h2c->ddht = hpack_dht_alloc();
-	if (!h2c->ddht)
-		goto fail;
+	/* the decoder's table is only allocated when a HEADERS frame needs
+	 * it, and released when the connection becomes idle, see
+	 * h2c_release_ddht().
+	 */
+	h2c->ddht = NULL;
+
+	/* the encoder's table is optional, only responses may use it */
+	h2c->edht = NULL;
+	if (h2_enc_table_size && !conn_is_back(conn) && h2_edht_undo)
+		h2c->edht = hpack_dht_alloc();
+
+	if (h2c->edht) {
+		/* the peer's decoder starts with a 4096 bytes table */
+		h2c->edht_size = h2c->edht_next = MIN(h2_enc_table_size, 4096);
+		hpack_dht_init(h2c->edht, h2c->edht_size);
+		if (h2c->edht_size != 4096)
+			h2c->flags |= H2_CF_EDHT_RESIZE;
+	}
 
 	/* Initialise the context. */
 	h2c->st0 = H2_CS_PREFACE;
@@ -980,6 +1192,11 @@ static int h2_init(struct connection *conn, struct proxy *prx, struct session *s
 	h2c->errcode = H2_ERR_NO_ERROR;
 	h2c->rcvd_c = 0;
 	h2c->rcvd_s = 0;
+	h2c->rwin = h2_settings_initial_window_size;
+	h2c->bdp_bytes = 0;
+	h2c->bdp_date = 0;
+	h2c->rtt = 0;
+	h2c->tx_sent = 0;
 	h2c->nb_streams = 0;
 	h2c->nb_cs = 0;
 	h2c->nb_reserved = 0;
@@ -995,6 +1212,7 @@ static int h2_init(struct connection *conn, struct proxy *prx, struct session *s
 	h2c->miw = 65535; /* mux initial window size */
 	h2c->mws = 65535; /* mux window size */
 	h2c->mfs = 16384; /* initial max frame size */
+	h2c->lane = 0;
 	h2c->streams_by_id = EB_ROOT;
 	LIST_INIT(&h2c->send_list);
 	LIST_INIT(&h2c->fctl_list);
@@ -1029,6 +1247,7 @@ static int h2_init(struct connection *conn, struct proxy *prx, struct session *s
 	TRACE_LEAVE(H2_EV_H2C_NEW, conn);
 	return 0;
   fail_stream:
+	hpack_dht_free(h2c->edht);
 	hpack_dht_free(h2c->ddht);
   fail:
 	task_destroy(t);
@@ -1086,6 +1305,8 @@ static void h2_release(struct h2c *h2c)
 			conn = h2c->conn;
 
 		TRACE_DEVEL("freeing h2c", H2_EV_H2C_END, conn);
+		h2c_update_idle_bufs(h2c, 1);
+		hpack_dht_free(h2c->edht);
 		hpack_dht_free(h2c->ddht);
 
 		if (LIST_INLIST(&h2c->buf_wait.list))
@@ -1429,6 +1650,240 @@ static void h2s_destroy(struct h2s *h2s)
 	TRACE_LEAVE(H2_EV_H2S_END, conn);
 }
 
+/* returns non-zero if stream <a> must be served before stream <b> according
+ * to their RFC9218 priorities: lower urgencies come first, then within a same
+ * urgency, non-incremental streams are delivered one at a time in stream ID
+ * order, and incremental ones share what remains in turn.
+ */
+static inline int h2s_precedes(const struct h2s *a, const struct h2s *b)
+{
+	if (a->urgency != b->urgency)
+		return a->urgency < b->urgency;
+
+	if ((a->flags ^ b->flags) & H2_SF_INCREMENTAL)
+		return !(a->flags & H2_SF_INCREMENTAL);
+
+	if (a->flags & H2_SF_INCREMENTAL)
+		return 0;
+
+	return a->id < b->id;
+}
+
+/* queues stream <h2s> at the end of list <head> which must be its connection's
+ * send_list or fctl_list. When "tune.h2.prioritize" is set, frontend streams
+ * are instead inserted before the first queued stream they must precede, so
+ * that the streams are woken up in priority order.
+ */
+static inline void h2s_queue_send(struct h2s *h2s, struct list *head)
+{
+	struct h2s *next;
+
+	if (h2_prioritize && !(h2s->h2c->flags & H2_CF_IS_BACK)) {
+		list_for_each_entry(next, head, list) {
+			if (h2s_precedes(h2s, next)) {
+				LIST_APPEND(&next->list, &h2s->list);
+				return;
+			}
+		}
+	}
+	LIST_APPEND(head, &h2s->list);
+}
+
+/* allocates a new tail mux buffer for DATA frames on connection <h2c> and
+ * returns it, or NULL if none is available. When prioritizing on frontend
+ * connections, DATA frames may only use H2_PRIO_DATA_MBUFS buffers so that
+ * lower priority streams cannot fill the whole ring ahead of urgent ones.
+ */
+static inline struct buffer *h2c_data_tail_add(struct h2c *h2c)
+{
+	if (h2_prioritize && !(h2c->flags & H2_CF_IS_BACK) &&
+	    br_count(h2c->mbuf) >= H2_PRIO_DATA_MBUFS)
+		return NULL;
+
+	/* always leave one slot for h2c_lane_buf() */
+	if (br_count(h2c->mbuf) + 2 >= br_size(h2c->mbuf))
+		return NULL;
+	return br_tail_add(h2c->mbuf);
+}
+
+/* Returns the mux buffer to write a frame which may be delivered before the
+ * frames already queued on connection <h2c>, such as a WINDOW_UPDATE, a PING
+ * ACK or the first HEADERS of a response. Such frames are written to a buffer
+ * placed right after the head one, which is being sent, so that they don't
+ * wait behind many buffers full of DATA. Frames written this way are still
+ * delivered in their emission order. The buffer is inserted on first use and
+ * reused as long as it follows the head. If the ring has a single buffer, or
+ * if no buffer may be inserted, the tail is returned as usual.
+ */
+static struct buffer *h2c_lane_buf(struct h2c *h2c)
+{
+	struct buffer *ring = h2c->mbuf;
+	struct buffer buf = BUF_NULL;
+	struct buffer *lane;
+	unsigned int idx;
+
+	if (br_count(ring) == 1)
+		return br_tail(ring);
+
+	idx = br_head_idx(ring) + 1;
+	if (idx >= br_size(ring))
+		idx = 1;
+
+	if (idx == h2c->lane)
+		return &ring[idx];
+
+	/* the buffer is allocated first so that an empty buffer is never
+	 * left in the middle of the ring.
+	 */
+	if (br_full(ring) || !b_alloc(&buf))
+		return br_tail(ring);
+
+	lane = br_insert_next(ring);
+	if (!lane) {
+		b_free(&buf);
+		offer_buffers(NULL, 1);
+		return br_tail(ring);
+	}
+	*lane = buf;
+	h2c->lane = idx;
+	return lane;
+}
+
+/* returns the amount of data pending in the mux buffers of connection <h2c> */
+static inline size_t h2c_mbuf_pending(struct h2c *h2c)
+{
+	struct buffer *ring = h2c->mbuf;
+	unsigned int idx = br_head_idx(ring);
+	size_t len = b_data(&ring[idx]);
+
+	while (idx != br_tail_idx(ring)) {
+		if (++idx >= br_size(ring))
+			idx = 1;
+		len += b_data(&ring[idx]);
+	}
+	return len;
+}
+
+/* returns non-zero if stream <h2s> must let the other streams waiting to send
+ * on its connection pass before queuing more DATA, because more than
+ * "tune.h2.stream-send-budget" bytes precede the end of its last DATA frame
+ * in the mux buffers.
+ */
+static inline int h2s_over_send_budget(const struct h2s *h2s)
+{
+	const struct h2c *h2c = h2s->h2c;
+	const struct list *l = &h2c->send_list;
+
+	if (!h2_stream_send_budget)
+		return 0;
+
+	if (LIST_ISEMPTY(l) || (l->n == &h2s->list && l->p == &h2s->list))
+		return 0;
+
+	return (int)(h2s->tx_end - h2c->tx_sent) > (int)h2_stream_send_budget;
+}
+
+/* moves stream <h2s> to its new place if it is currently queued into its
+ * connection's send_list or fctl_list, after its priority was changed.
+ */
+static void h2s_requeue_send(struct h2s *h2s)
+{
+	struct h2c *h2c = h2s->h2c;
+	struct h2s *cur;
+
+	list_for_each_entry(cur, &h2c->fctl_list, list) {
+		if (cur == h2s) {
+			LIST_DEL_INIT(&h2s->list);
+			h2s_queue_send(h2s, &h2c->fctl_list);
+			return;
+		}
+	}
+
+	list_for_each_entry(cur, &h2c->send_list, list) {
+		if (cur == h2s) {
+			LIST_DEL_INIT(&h2s->list);
+			h2s_queue_send(h2s, &h2c->send_list);
+			return;
+		}
+	}
+}
+
+/* returns non-zero if stream <h2s> which was not notified has to wait behind
+ * the streams already queued for sending on its connection. Without
+ * prioritization, any queued stream is enough to wait. Otherwise it may pass
+ * if it precedes the head of each list.
+ */
+static inline int h2s_must_wait_send(const struct h2s *h2s)
+{
+	const struct h2c *h2c = h2s->h2c;
+
+	if (!h2_prioritize || (h2c->flags & H2_CF_IS_BACK))
+		return !LIST_ISEMPTY(&h2c->send_list) || !LIST_ISEMPTY(&h2c->fctl_list);
+
+	if (!LIST_ISEMPTY(&h2c->fctl_list) &&
+	    !h2s_precedes(h2s, LIST_ELEM(h2c->fctl_list.n, struct h2s *, list)))
+		return 1;
+
+	if (!LIST_ISEMPTY(&h2c->send_list) &&
+	    !h2s_precedes(h2s, LIST_ELEM(h2c->send_list.n, struct h2s *, list)))
+		return 1;
+
+	return 0;
+}
+
+/* returns non-zero if stream <h2s> is about to emit the HEADERS frame of a
+ * final response which may be sent ahead of the queued DATA frames.
+ */
+static inline int h2s_headers_may_pass(const struct h2s *h2s)
+{
+	return !(h2s->h2c->flags & H2_CF_IS_BACK) && !h2s->h2c->edht &&
+		!(h2s->flags & (H2_SF_HEADERS_SENT | H2_SF_INTERIM_SENT));
+}
+
+/* parses the RFC9218 priority field value <value>, as found in a "priority"
+ * header field or in a PRIORITY_UPDATE frame, and updates <urgency> and the
+ * H2_SF_INCREMENTAL bit in <flags> accordingly. As mandated by the spec,
+ * unknown or invalid members are ignored and so are parameters.
+ */
+static void h2_parse_priority(struct ist value, uint8_t *urgency, uint32_t *flags)
+{
+	while (istlen(value)) {
+		struct ist member = iststop(istsplit(&value, ','), ';');
+		struct ist key;
+		int has_val;
+
+		while (istlen(member) && HTTP_IS_SPHT(*istptr(member)))
+			member = istnext(member);
+		while (istlen(member) && HTTP_IS_SPHT(*(istend(member) - 1)))
+			member.len--;
+
+		has_val = !!istchr(member, '=');
+		key = istsplit(&member, '=');
+
+		if (isteq(key, ist("u"))) {
+			if (istlen(member) == 1 && *istptr(member) >= '0' && *istptr(member) <= '7')
+				*urgency = *istptr(member) - '0';
+		}
+		else if (isteq(key, ist("i"))) {
+			if (!has_val || isteq(member, ist("?1")))
+				*flags |= H2_SF_INCREMENTAL;
+			else if (isteq(member, ist("?0")))
+				*flags &= ~H2_SF_INCREMENTAL;
+		}
+	}
+}
+
+/* looks up all "priority" header fields in the request stored in <htx> and
+ * applies them to <urgency> and <flags> using h2_parse_priority().
+ */
+static void h2_htx_get_priority(struct htx *htx, uint8_t *urgency, uint32_t *flags)
+{
+	struct http_hdr_ctx ctx = { .blk = NULL };
+
+	while (http_find_header(htx, ist("priority"), &ctx, 1))
+		h2_parse_priority(ctx.value, urgency, flags);
+}
+
 /* allocates a new stream <id> for connection <h2c> and adds it into h2c's
  * stream tree. In case of error, nothing is added and NULL is returned. The
  * causes of errors can be any failed memory allocation. The caller is
@@ -1457,10 +1912,13 @@ static struct h2s *h2s_new(struct h2c *h2c, int id)
 	h2s->h2c       = h2c;
 	h2s->cs        = NULL;
 	h2s->sws       = 0;
+	h2s->rwin      = h2_settings_initial_window_size;
+	h2s->tx_end    = 0;
 	h2s->flags     = H2_SF_NONE;
 	h2s->errcode   = H2_ERR_NO_ERROR;
 	h2s->st        = H2_SS_IDLE;
 	h2s->status    = 0;
+	h2s->urgency   = H2_DEFAULT_URGENCY;
 	h2s->body_len  = 0;
 	h2s->rxbuf     = BUF_NULL;
 	memset(h2s->upgrade_protocol, 0, sizeof(h2s->upgrade_protocol));
@@ -1506,7 +1964,7 @@ static struct h2s *h2c_frt_stream_new(struct h2c *h2c, int id, struct buffer *in
 	if (!h2s)
 		goto out;
 
-	cs = cs_new(h2c->conn, h2c->conn->target);
+	cs = cs_new_with_stream(h2c->conn);
 	if (!cs)
 		goto out_close;
 
@@ -1632,9 +2090,13 @@ static int h2c_send_settings(struct h2c *h2c)
 		char str[6] = "\x00\x03"; /* max_concurrent_streams */
 
 		/* Note: 0 means "unlimited" for haproxy's config but not for
-		 * the protocol, so never send this value!
+		 * the protocol, so never send this value! A frontend connection
+		 * may start with a lower limit if the thread is already loaded.
 		 */
-		write_n32(str + 2, h2_settings_max_concurrent_streams);
+		if (!(h2c->flags & H2_CF_IS_BACK))
+			h2c->streams_limit = h2c_frt_streams_target(h2c);
+		write_n32(str + 2, (h2c->flags & H2_CF_IS_BACK) ?
+		          h2_settings_max_concurrent_streams : h2c->streams_limit);
 		chunk_memcat(&buf, str, 6);
 	}
 
@@ -2144,7 +2606,7 @@ static void h2c_unblock_sfctl(struct h2c *h2c)
 			LIST_DEL_INIT(&h2s->list);
 			if ((h2s->subs && h2s->subs->events & SUB_RETRY_SEND) ||
 			    h2s->flags & (H2_SF_WANT_SHUTR|H2_SF_WANT_SHUTW))
-				LIST_APPEND(&h2c->send_list, &h2s->list);
+				h2s_queue_send(h2s, &h2c->send_list);
 		}
 		node = eb32_next(node);
 	}
@@ -2221,6 +2683,11 @@ static int h2c_handle_settings(struct h2c *h2c)
 			/* nothing to do here as this settings is automatically
 			 * transmits to the client */
 			break;
+		case H2_SETTINGS_HEADER_TABLE_SIZE:
+			/* bounds our encoder's table, applies after the ACK */
+			if (h2c->edht)
+				h2c->edht_next = MIN((uint32_t)arg, (uint32_t)h2_enc_table_size);
+			break;
 		}
 	}
 
@@ -2280,11 +2747,51 @@ static int h2c_ack_settings(struct h2c *h2c)
 			ret = 0;
 		}
 	}
+	else if (h2c->edht && h2c->edht_next != h2c->edht_size) {
+		/* the peer's new table size is now in effect */
+		h2c->edht_size = h2c->edht_next;
+		h2c->flags |= H2_CF_EDHT_RESIZE;
+	}
  out:
 	TRACE_LEAVE(H2_EV_TX_FRAME|H2_EV_TX_SETTINGS, h2c->conn);
 	return ret;
 }
 
+/* Accounts for <bytes> of payload received, for the estimation of the
+ * bandwidth-delay product, and schedules a BDP probe if none is in flight.
+ * Only called while the window may still grow.
+ */
+static inline void h2c_bdp_count(struct h2c *h2c, uint32_t bytes)
+{
+	h2c->bdp_bytes += bytes;
+	if (!(h2c->flags & (H2_CF_BDP_PROBE | H2_CF_BDP_WAIT)))
+		h2c->flags |= H2_CF_BDP_PROBE;
+}
+
+/* Updates the receive window of connection <h2c> upon receipt of the ACK of
+ * the BDP probe. The window is doubled from the amount of data received during
+ * the last RTT when this amount is at least two thirds of the window, which
+ * indicates that the peer was likely limited by the window.
+ */
+static void h2c_bdp_update(struct h2c *h2c)
+{
+	uint64_t win;
+
+	h2c->flags &= ~H2_CF_BDP_WAIT;
+	h2c->rtt = now_ms - h2c->bdp_date;
+
+	if (h2c->bdp_bytes < h2c->rwin / 3 * 2)
+		return;
+
+	win = (uint64_t)h2c->bdp_bytes * 2;
+	if (win > h2_settings_max_window_size)
+		win = h2_settings_max_window_size;
+	if (win > h2c->rwin) {
+		TRACE_STATE("growing receive window", H2_EV_RX_FRAME|H2_EV_RX_PING, h2c->conn, 0, 0, (void *)(long)win);
+		h2c->rwin = win;
+	}
+}
+
 /* processes a PING frame and schedules an ACK if needed. The caller must pass
  * the pointer to the payload in <payload>. Returns > 0 on success or zero on
  * missing data. The caller must have already verified frame length
@@ -2292,9 +2799,22 @@ static int h2c_ack_settings(struct h2c *h2c)
  */
 static int h2c_handle_ping(struct h2c *h2c)
 {
+	char data[8];
+
 	/* schedule a response */
-	if (!(h2c->dff & H2_F_PING_ACK))
+	if (!(h2c->dff & H2_F_PING_ACK)) {
 		h2c->st0 = H2_CS_FRAME_A;
+		return 1;
+	}
+
+	if (h2c->flags & H2_CF_BDP_WAIT) {
+		if (b_data(&h2c->dbuf) < 8)
+			return 0;
+
+		h2_get_buf_bytes(data, 8, &h2c->dbuf, 0);
+		if (memcmp(data, H2_BDP_PROBE_DATA, 8) == 0)
+			h2c_bdp_update(h2c);
+	}
 	return 1;
 }
 
@@ -2320,7 +2840,7 @@ static int h2c_send_window_update(struct h2c *h2c, int sid, uint32_t increment)
 	write_n32(str + 5, sid);
 	write_n32(str + 9, increment);
 
-	res = br_tail(h2c->mbuf);
+	res = h2c_lane_buf(h2c);
  retry:
 	if (!h2_get_buf(h2c, res)) {
 		h2c->flags |= H2_CF_MUX_MALLOC;
@@ -2383,6 +2903,8 @@ static int h2c_send_conn_wu(struct h2c *h2c)
  */
 static int h2c_send_strm_wu(struct h2c *h2c)
 {
+	struct h2s *h2s = NULL;
+	uint32_t inc;
 	int ret = 1;
 
 	TRACE_ENTER(H2_EV_TX_FRAME|H2_EV_TX_WU, h2c->conn);
@@ -2390,10 +2912,25 @@ static int h2c_send_strm_wu(struct h2c *h2c)
 	if (h2c->rcvd_s <= 0)
 		goto out;
 
+	inc = h2c->rcvd_s;
+	if (h2c->rwin > h2_settings_initial_window_size) {
+		/* the window was grown, enlarge the stream's if it may
+		 * still receive data.
+		 */
+		h2s = h2c_st_by_id(h2c, h2c->dsi);
+		if ((h2s->st == H2_SS_OPEN || h2s->st == H2_SS_HLOC) && h2s->rwin < h2c->rwin)
+			inc += h2c->rwin - h2s->rwin;
+		else
+			h2s = NULL;
+	}
+
 	/* send WU for the stream */
-	ret = h2c_send_window_update(h2c, h2c->dsi, h2c->rcvd_s);
-	if (ret > 0)
+	ret = h2c_send_window_update(h2c, h2c->dsi, inc);
+	if (ret > 0) {
 		h2c->rcvd_s = 0;
+		if (h2s)
+			h2s->rwin = h2c->rwin;
+	}
  out:
 	TRACE_LEAVE(H2_EV_TX_FRAME|H2_EV_TX_WU, h2c->conn);
 	return ret;
@@ -2426,7 +2963,7 @@ static int h2c_ack_ping(struct h2c *h2c)
 	/* copy the original payload */
 	h2_get_buf_bytes(str + 9, 8, &h2c->dbuf, 0);
 
-	res = br_tail(h2c->mbuf);
+	res = h2c_lane_buf(h2c);
  retry:
 	if (!h2_get_buf(h2c, res)) {
 		h2c->flags |= H2_CF_MUX_MALLOC;
@@ -2452,6 +2989,113 @@ static int h2c_ack_ping(struct h2c *h2c)
 	return ret;
 }
 
+/* try to send a BDP probe, which is a PING frame carrying H2_BDP_PROBE_DATA.
+ * Returns > 0 on success or zero on missing room or failure. It may return an
+ * error in h2c.
+ */
+static int h2c_send_bdp_probe(struct h2c *h2c)
+{
+	struct buffer *res;
+	char str[17];
+	int ret = 0;
+
+	TRACE_ENTER(H2_EV_TX_FRAME|H2_EV_TX_PING, h2c->conn);
+
+	if (h2c_mux_busy(h2c, NULL)) {
+		h2c->flags |= H2_CF_DEM_MBUSY;
+		goto out;
+	}
+
+	memcpy(str,
+	       "\x00\x00\x08"     /* length : 8 */
+	       "\x06" "\x00"      /* type   : 6, flags : none */
+	       "\x00\x00\x00\x00" /* stream ID */
+	       H2_BDP_PROBE_DATA, 17);
+
+	res = h2c_lane_buf(h2c);
+ retry:
+	if (!h2_get_buf(h2c, res)) {
+		h2c->flags |= H2_CF_MUX_MALLOC;
+		h2c->flags |= H2_CF_DEM_MROOM;
+		goto out;
+	}
+
+	ret = b_istput(res, ist2(str, 17));
+	if (unlikely(ret <= 0)) {
+		if (!ret) {
+			if ((res = br_tail_add(h2c->mbuf)) != NULL)
+				goto retry;
+			h2c->flags |= H2_CF_MUX_MFULL;
+			h2c->flags |= H2_CF_DEM_MROOM;
+		}
+		else {
+			h2c_error(h2c, H2_ERR_INTERNAL_ERROR);
+			ret = 0;
+		}
+		goto out;
+	}
+
+	h2c->flags = (h2c->flags & ~H2_CF_BDP_PROBE) | H2_CF_BDP_WAIT;
+	h2c->bdp_bytes = 0;
+	h2c->bdp_date = now_ms;
+ out:
+	TRACE_LEAVE(H2_EV_TX_FRAME|H2_EV_TX_PING, h2c->conn);
+	return ret;
+}
+
+/* try to send a SETTINGS frame only carrying the MAX_CONCURRENT_STREAMS value
+ * granted to the peer of a frontend connection. Returns > 0 on success or zero
+ * on missing room or failure. It may return an error in h2c.
+ */
+static int h2c_send_max_streams(struct h2c *h2c)
+{
+	struct buffer *res;
+	char str[15];
+	int ret = 0;
+
+	TRACE_ENTER(H2_EV_TX_FRAME|H2_EV_TX_SETTINGS, h2c->conn);
+
+	if (h2c_mux_busy(h2c, NULL)) {
+		h2c->flags |= H2_CF_DEM_MBUSY;
+		goto out;
+	}
+
+	memcpy(str,
+	       "\x00\x00\x06"     /* length : 6 */
+	       "\x04" "\x00"      /* type   : 4 (settings), flags : none */
+	       "\x00\x00\x00\x00" /* stream ID */
+	       "\x00\x03", 11);  /* max_concurrent_streams */
+	write_n32(str + 11, h2c->streams_limit);
+
+	res = h2c_lane_buf(h2c);
+ retry:
+	if (!h2_get_buf(h2c, res)) {
+		h2c->flags |= H2_CF_MUX_MALLOC;
+		h2c->flags |= H2_CF_DEM_MROOM;
+		goto out;
+	}
+
+	ret = b_istput(res, ist2(str, 15));
+	if (unlikely(ret <= 0)) {
+		if (!ret) {
+			if ((res = br_tail_add(h2c->mbuf)) != NULL)
+				goto retry;
+			h2c->flags |= H2_CF_MUX_MFULL;
+			h2c->flags |= H2_CF_DEM_MROOM;
+		}
+		else {
+			h2c_error(h2c, H2_ERR_INTERNAL_ERROR);
+			ret = 0;
+		}
+		goto out;
+	}
+
+	h2c->flags &= ~H2_CF_MCS_UPDATE;
+ out:
+	TRACE_LEAVE(H2_EV_TX_FRAME|H2_EV_TX_SETTINGS, h2c->conn);
+	return ret;
+}
+
 /* processes a WINDOW_UPDATE frame whose payload is <payload> for <plen> bytes.
  * Returns > 0 on success or zero on missing data. It may return an error in
  * h2c or h2s. The caller must have already verified frame length and stream ID
@@ -2497,7 +3141,7 @@ static int h2c_handle_window_update(struct h2c *h2c, struct h2s *h2s)
 			LIST_DEL_INIT(&h2s->list);
 			if ((h2s->subs && h2s->subs->events & SUB_RETRY_SEND) ||
 			    h2s->flags & (H2_SF_WANT_SHUTR|H2_SF_WANT_SHUTW))
-				LIST_APPEND(&h2c->send_list, &h2s->list);
+				h2s_queue_send(h2s, &h2c->send_list);
 		}
 	}
 	else {
@@ -2586,6 +3230,62 @@ static int h2c_handle_priority(struct h2c *h2c)
 	return 1;
 }
 
+/* processes a PRIORITY_UPDATE frame (RFC9218#7.1) and applies the priority
+ * field value it carries to the designated stream, which is moved in the send
+ * lists if needed. Updates for idle or closed streams are silently ignored.
+ * Returns > 0 on success or zero on missing data. It may return an error in
+ * h2c.
+ */
+static int h2c_handle_priority_update(struct h2c *h2c)
+{
+	struct buffer *tmp;
+	struct h2s *h2s;
+	struct ist value;
+	uint32_t flags;
+	int32_t id;
+
+	TRACE_ENTER(H2_EV_RX_FRAME|H2_EV_RX_PRIO, h2c->conn);
+
+	if (h2c->dsi != 0 || h2c->dfl < 4) {
+		TRACE_ERROR("invalid PRIORITY_UPDATE frame", H2_EV_RX_FRAME|H2_EV_RX_PRIO|H2_EV_PROTO_ERR, h2c->conn);
+		h2c_error(h2c, (h2c->dsi != 0) ? H2_ERR_PROTOCOL_ERROR : H2_ERR_FRAME_SIZE_ERROR);
+		HA_ATOMIC_INC(&h2c->px_counters->conn_proto_err);
+		goto fail;
+	}
+
+	/* process full frame only */
+	if (b_data(&h2c->dbuf) < h2c->dfl) {
+		TRACE_DEVEL("leaving on missing data", H2_EV_RX_FRAME|H2_EV_RX_PRIO, h2c->conn);
+		return 0;
+	}
+
+	id = h2_get_n32(&h2c->dbuf, 0) & 0x7FFFFFFF;
+	if (!id) {
+		TRACE_ERROR("PRIORITY_UPDATE on stream 0", H2_EV_RX_FRAME|H2_EV_RX_PRIO|H2_EV_PROTO_ERR, h2c->conn);
+		h2c_error(h2c, H2_ERR_PROTOCOL_ERROR);
+		HA_ATOMIC_INC(&h2c->px_counters->conn_proto_err);
+		goto fail;
+	}
+
+	h2s = h2c_st_by_id(h2c, id);
+	if (!h2s->h2c || h2s->st == H2_SS_IDLE || h2s->st == H2_SS_CLOSED)
+		goto done;
+
+	/* the field value may wrap in the buffer */
+	tmp = get_trash_chunk();
+	value = ist2(tmp->area, b_getblk(&h2c->dbuf, tmp->area, h2c->dfl - 4, 4));
+	flags = h2s->flags;
+	h2_parse_priority(value, &h2s->urgency, &flags);
+	h2s->flags = flags;
+	h2s_requeue_send(h2s);
+ done:
+	TRACE_LEAVE(H2_EV_RX_FRAME|H2_EV_RX_PRIO, h2c->conn);
+	return 1;
+ fail:
+	TRACE_DEVEL("leaving on error", H2_EV_RX_FRAME|H2_EV_RX_PRIO, h2c->conn);
+	return 0;
+}
+
 /* processes an RST_STREAM frame, and sets the 32-bit error code on the stream.
  * Returns > 0 on success or zero on missing data. The caller must have already
  * verified frame length and stream ID validity. Described in RFC7540#6.4.
@@ -2630,6 +3330,7 @@ static struct h2s *h2c_frt_handle_headers(struct h2c *h2c, struct h2s *h2s)
 {
 	struct buffer rxbuf = BUF_NULL;
 	unsigned long long body_len = 0;
+	uint8_t urgency = H2_DEFAULT_URGENCY;
 	uint32_t flags = 0;
 	int error;
 
@@ -2681,6 +3382,25 @@ static struct h2s *h2c_frt_handle_headers(struct h2c *h2c, struct h2s *h2s)
 	else if (h2c->flags & H2_CF_DEM_TOOMANY)
 		goto out; // IDLE but too many cs still present
 
+	if (h2_settings_min_concurrent_streams) {
+		h2c_frt_adapt_streams(h2c);
+		if (h2c->nb_streams >= h2c->streams_limit) {
+			/* above the adapted limit: the headers are only
+			 * decoded to keep the HPACK decoder synchronized,
+			 * no stream is allocated.
+			 */
+			error = h2c_decode_headers(h2c, &rxbuf, &flags, &body_len, NULL);
+			if (h2c->st0 >= H2_CS_ERROR)
+				goto out;
+			if (error == 0)
+				goto out; // missing data
+			TRACE_STATE("refusing stream above adapted limit", H2_EV_RX_FRAME|H2_EV_RX_HDR|H2_EV_STRM_NEW, h2c->conn);
+			HA_ATOMIC_INC(&h2c->px_counters->strm_refused);
+			h2s = (struct h2s*)h2_refused_stream;
+			goto send_rst;
+		}
+	}
+
 	error = h2c_decode_headers(h2c, &rxbuf, &flags, &body_len, NULL);
 
 	/* unrecoverable error ? */
@@ -2700,6 +3420,12 @@ static struct h2s *h2c_frt_handle_headers(struct h2c *h2c, struct h2s *h2s)
 
 	TRACE_USER("rcvd H2 request  ", H2_EV_RX_FRAME|H2_EV_RX_HDR|H2_EV_STRM_NEW, h2c->conn, 0, &rxbuf);
 
+	/* the request is handed over to the stream below, so its priority
+	 * needs to be retrieved now.
+	 */
+	if (h2_prioritize)
+		h2_htx_get_priority(htx_from_buf(&rxbuf), &urgency, &flags);
+
 	/* Note: we don't emit any other logs below because ff we return
 	 * positively from h2c_frt_stream_new(), the stream will report the error,
 	 * and if we return in error, h2c_frt_stream_new() will emit the error.
@@ -2715,6 +3441,7 @@ static struct h2s *h2c_frt_handle_headers(struct h2c *h2c, struct h2s *h2s)
 
 	h2s->st = H2_SS_OPEN;
 	h2s->flags |= flags;
+	h2s->urgency = urgency;
 	h2s->body_len = body_len;
 
  done:
@@ -3414,6 +4141,16 @@ static void h2_process_demux(struct h2c *h2c)
 			break;
 
 			/* implement all extra frame types here */
+		case H2_FT_PRIORITY_UPDATE:
+			if (h2_prioritize && !(h2c->flags & H2_CF_IS_BACK)) {
+				if (h2c->st0 == H2_CS_FRAME_P) {
+					TRACE_PROTO("receiving H2 PRIORITY_UPDATE frame", H2_EV_RX_FRAME|H2_EV_RX_PRIO, h2c->conn, h2s);
+					ret = h2c_handle_priority_update(h2c);
+				}
+				break;
+			}
+			/* fall through */
+
 		default:
 			TRACE_PROTO("receiving H2 ignored frame", H2_EV_RX_FRAME, h2c->conn, h2s);
 			/* drop frames that we ignore. They may be larger than
@@ -3467,6 +4204,18 @@ static void h2_process_demux(struct h2c *h2c)
 		h2c_send_conn_wu(h2c);
 	}
 
+	if ((h2c->flags & H2_CF_BDP_PROBE) &&
+	    !(h2c->flags & (H2_CF_MUX_MFULL | H2_CF_DEM_MBUSY | H2_CF_DEM_MROOM))) {
+		TRACE_PROTO("sending H2 PING frame", H2_EV_TX_FRAME|H2_EV_TX_PING, h2c->conn);
+		h2c_send_bdp_probe(h2c);
+	}
+
+	if ((h2c->flags & H2_CF_MCS_UPDATE) &&
+	    !(h2c->flags & (H2_CF_MUX_MFULL | H2_CF_DEM_MBUSY | H2_CF_DEM_MROOM))) {
+		TRACE_PROTO("sending H2 SETTINGS frame", H2_EV_TX_FRAME|H2_EV_TX_SETTINGS, h2c->conn);
+		h2c_send_max_streams(h2c);
+	}
+
  done:
 	if (h2s && h2s->cs &&
 	    (b_data(&h2s->rxbuf) ||
@@ -3503,6 +4252,8 @@ static void h2_process_demux(struct h2c *h2c)
 static void h2_resume_each_sending_h2s(struct h2c *h2c, struct list *head)
 {
 	struct h2s *h2s, *h2s_back;
+	struct h2s *woken = NULL;
+	int prio = h2_prioritize && !(h2c->flags & H2_CF_IS_BACK);
 
 	TRACE_ENTER(H2_EV_H2C_SEND|H2_EV_H2S_WAKE, h2c->conn);
 
@@ -3512,6 +4263,17 @@ static void h2_resume_each_sending_h2s(struct h2c *h2c, struct list *head)
 		    h2c->st0 >= H2_CS_ERROR)
 			break;
 
+		/* when prioritizing, the list is sorted and streams of lower
+		 * priority than the ones just woken up have to wait for them
+		 * to fill the room first. We'll come back here once they had
+		 * a chance to run, so that nobody waits forever if they don't
+		 * send anything.
+		 */
+		if (prio && woken && h2s_precedes(woken, h2s)) {
+			tasklet_wakeup(h2c->wait_event.tasklet);
+			break;
+		}
+
 		h2s->flags &= ~H2_SF_BLK_ANY;
 
 		if (h2s->flags & H2_SF_NOTIFIED)
@@ -3532,9 +4294,11 @@ static void h2_resume_each_sending_h2s(struct h2c *h2c, struct list *head)
 			h2s->subs->events &= ~SUB_RETRY_SEND;
 			if (!h2s->subs->events)
 				h2s->subs = NULL;
+			woken = h2s;
 		}
 		else if (h2s->flags & (H2_SF_WANT_SHUTR|H2_SF_WANT_SHUTW)) {
 			tasklet_wakeup(h2s->shut_tl);
+			woken = h2s;
 		}
 	}
 
@@ -3574,6 +4338,16 @@ static int h2_process_mux(struct h2c *h2c)
 	    h2c_send_conn_wu(h2c) < 0)
 		goto fail;
 
+	if ((h2c->flags & H2_CF_BDP_PROBE) &&
+	    !(h2c->flags & (H2_CF_MUX_MFULL | H2_CF_MUX_MALLOC)) &&
+	    h2c_send_bdp_probe(h2c) < 0)
+		goto fail;
+
+	if ((h2c->flags & H2_CF_MCS_UPDATE) &&
+	    !(h2c->flags & (H2_CF_MUX_MFULL | H2_CF_MUX_MALLOC)) &&
+	    h2c_send_max_streams(h2c) < 0)
+		goto fail;
+
 	/* First we always process the flow control list because the streams
 	 * waiting there were already elected for immediate emission but were
 	 * blocked just on this.
@@ -3679,6 +4453,37 @@ static int h2_recv(struct h2c *h2c)
 	return !!ret || (conn->flags & CO_FL_ERROR) || conn_xprt_read0_pending(conn);
 }
 
+/* Moves the contents of the mux ring's buffers towards the head when they fit
+ * into the room left in a previous buffer, so that fewer, larger writes are
+ * performed when many small frames were spread over several buffers (e.g. a
+ * large DATA frame which did not fit followed by small HEADERS frames from
+ * other streams). Order is preserved since data are only appended after the
+ * last data of the previous buffer. Blocks eligible to zero-copy sends are
+ * left untouched as it would defeat its purpose.
+ */
+static void h2_coalesce_mbufs(struct h2c *h2c)
+{
+	struct buffer *ring = h2c->mbuf;
+	struct buffer *dst = br_head(ring);
+	unsigned int idx = br_head_idx(ring);
+	size_t len;
+
+	while (idx != br_tail_idx(ring)) {
+		if (++idx >= br_size(ring))
+			idx = 1;
+
+		len = b_data(&ring[idx]);
+		if (!len)
+			continue;
+
+		if (b_data(dst) && len <= b_room(dst) &&
+		    (!global.tune.zerocopy_send || len < global.tune.zerocopy_send))
+			b_xfer(dst, &ring[idx], len);
+		else
+			dst = &ring[idx];
+	}
+}
+
 /* Try to send data if possible.
  * The function returns 1 if data have been sent, otherwise zero.
  */
@@ -3736,9 +4541,19 @@ static int h2_send(struct h2c *h2c)
 		    (h2c->st0 == H2_CS_ERROR2) || (h2c->flags & H2_CF_GOAWAY_FAILED))
 			break;
 
-		if (h2c->flags & (H2_CF_MUX_MFULL | H2_CF_DEM_MBUSY | H2_CF_DEM_MROOM))
+		/* when prioritizing, the mux buffers are voluntarily kept short
+		 * so they're often reported full while the pending data may be
+		 * waiting for a window update that would be delayed by MSG_MORE.
+		 */
+		if ((h2c->flags & (H2_CF_MUX_MFULL | H2_CF_DEM_MBUSY | H2_CF_DEM_MROOM)) &&
+		    (!h2_prioritize || (h2c->flags & H2_CF_IS_BACK)))
 			flags |= CO_SFL_MSG_MORE;
 
+		/* mbufs are only referenced here, their storage may be swapped */
+		flags |= CO_SFL_ZEROCOPY;
+
+		h2_coalesce_mbufs(h2c);
+
 		for (buf = br_head(h2c->mbuf); b_size(buf); buf = br_del_head(h2c->mbuf)) {
 			if (b_data(buf)) {
 				int ret = conn->xprt->snd_buf(conn, conn->xprt_ctx, buf, b_data(buf), flags);
@@ -3749,6 +4564,7 @@ static int h2_send(struct h2c *h2c)
 				sent = 1;
 				TRACE_DATA("sent data", H2_EV_H2C_SEND, h2c->conn, 0, buf, (void*)(long)ret);
 				b_del(buf, ret);
+				h2c->tx_sent += ret;
 				if (b_data(buf)) {
 					done = 1;
 					break;
@@ -3800,6 +4616,14 @@ struct task *h2_io_cb(struct task *t, void *ctx, unsigned int state)
 	struct h2c *h2c = ctx;
 	int ret = 0;
 
+	if ((state & TASK_SELF_WAKING) && h2c && (h2c->flags & H2_CF_SND_DEFERRED)) {
+		/* we were queued into the bulk class by h2_snd_buf(), this
+		 * must not stick.
+		 */
+		HA_ATOMIC_AND(&t->state, ~TASK_SELF_WAKING);
+		h2c->flags &= ~H2_CF_SND_DEFERRED;
+	}
+
 	if (state & TASK_F_USR1) {
 		/* the tasklet was idling on an idle connection, it might have
 		 * been stolen, let's be careful!
@@ -3826,6 +4650,10 @@ struct task *h2_io_cb(struct task *t, void *ctx, unsigned int state)
 		if (conn_in_list)
 			conn_delete_from_tree(&conn->hash_node->node);
 
+		/* an offered frontend connection is not idle anymore */
+		if (h2c->flags & H2_CF_MIGRATING)
+			h2c_migrate_cancel(h2c);
+
 		HA_SPIN_UNLOCK(IDLE_CONNS_LOCK, &idle_conns[tid].idle_conns_lock);
 	} else {
 		/* we're certain the connection was not in an idle list */
@@ -3848,6 +4676,8 @@ struct task *h2_io_cb(struct task *t, void *ctx, unsigned int state)
 	 */
 	if (ret < 0)
 		t = NULL;
+	else
+		h2c_update_idle_bufs(h2c, 0);
 
 	if (!ret && conn_in_list) {
 		struct server *srv = objt_server(conn->target);
@@ -3859,6 +4689,22 @@ struct task *h2_io_cb(struct task *t, void *ctx, unsigned int state)
 			ebmb_insert(&srv->per_thr[tid].idle_conns, &conn->hash_node->node, sizeof(conn->hash_node->hash));
 		HA_SPIN_UNLOCK(IDLE_CONNS_LOCK, &idle_conns[tid].idle_conns_lock);
 	}
+	else if (!ret) {
+		int thr = h2c_migrate_thread(h2c);
+
+		/* idle frontend connection on a loaded thread: offer it to a
+		 * lighter one, which will take it over just like an idle
+		 * backend connection. It must not be touched anymore without
+		 * checking under the lock that it was not stolen.
+		 */
+		if (thr >= 0) {
+			TRACE_STATE("offering idle connection to another thread", H2_EV_H2C_WAKE, conn);
+			h2c->flags |= H2_CF_MIGRATING;
+			HA_ATOMIC_OR(&tl->state, TASK_F_USR1);
+			xprt_set_idle(conn, conn->xprt, conn->xprt_ctx);
+			conn_migrate_offer(conn, thr);
+		}
+	}
 
 leave:
 	TRACE_LEAVE(H2_EV_H2C_WAKE);
@@ -3872,6 +4718,7 @@ struct task *h2_io_cb(struct task *t, void *ctx, unsigned int state)
 static int h2_process(struct h2c *h2c)
 {
 	struct connection *conn = h2c->conn;
+	size_t reclaimed = 0;
 
 	TRACE_ENTER(H2_EV_H2C_WAKE, conn);
 
@@ -3950,7 +4797,7 @@ static int h2_process(struct h2c *h2c)
 	}
 
 	if (!b_data(&h2c->dbuf))
-		h2_release_buf(h2c, &h2c->dbuf);
+		reclaimed += h2_release_buf(h2c, &h2c->dbuf);
 
 	if ((conn->flags & CO_FL_SOCK_WR_SH) ||
 	    h2c->st0 == H2_CS_ERROR2 || (h2c->flags & H2_CF_GOAWAY_FAILED) ||
@@ -3958,7 +4805,14 @@ static int h2_process(struct h2c *h2c)
 	     !br_data(h2c->mbuf) &&
 	     (h2c->mws <= 0 || LIST_ISEMPTY(&h2c->fctl_list)) &&
 	     ((h2c->flags & H2_CF_MUX_BLOCK_ANY) || LIST_ISEMPTY(&h2c->send_list))))
-		h2_release_mbuf(h2c);
+		reclaimed += h2_release_mbuf(h2c);
+
+	/* an idle connection keeps nothing it can allocate again later */
+	if (eb_is_empty(&h2c->streams_by_id)) {
+		reclaimed += h2c_release_ddht(h2c);
+		if (reclaimed)
+			HA_ATOMIC_ADD(&h2c->px_counters->idle_reclaimed, reclaimed);
+	}
 
 	if (h2c->task) {
 		if (h2c_may_expire(h2c))
@@ -3969,6 +4823,7 @@ static int h2_process(struct h2c *h2c)
 	}
 
 	h2_send(h2c);
+	h2c_update_idle_bufs(h2c, 0);
 	TRACE_LEAVE(H2_EV_H2C_WAKE, conn);
 	return 0;
 }
@@ -3980,6 +4835,14 @@ static int h2_wake(struct connection *conn)
 	int ret;
 
 	TRACE_ENTER(H2_EV_H2C_WAKE, conn);
+
+	/* an error or shutdown was reported on an offered connection */
+	if (h2c->flags & H2_CF_MIGRATING) {
+		HA_SPIN_LOCK(IDLE_CONNS_LOCK, &idle_conns[tid].idle_conns_lock);
+		h2c_migrate_cancel(h2c);
+		HA_SPIN_UNLOCK(IDLE_CONNS_LOCK, &idle_conns[tid].idle_conns_lock);
+	}
+
 	ret = h2_process(h2c);
 	if (ret >= 0)
 		h2_wake_some_streams(h2c, 0);
@@ -4035,6 +4898,9 @@ struct task *h2_timeout_task(struct task *t, void *context, unsigned int state)
 		if (h2c->conn->flags & CO_FL_LIST_MASK)
 			conn_delete_from_tree(&h2c->conn->hash_node->node);
 
+		if (h2c->flags & H2_CF_MIGRATING)
+			h2c_migrate_cancel(h2c);
+
 		HA_SPIN_UNLOCK(IDLE_CONNS_LOCK, &idle_conns[tid].idle_conns_lock);
 	}
 
@@ -4385,9 +5251,9 @@ static void h2_do_shutr(struct h2s *h2s)
 	h2s->flags |= H2_SF_WANT_SHUTR;
 	if (!LIST_INLIST(&h2s->list)) {
 		if (h2s->flags & H2_SF_BLK_MFCTL)
-			LIST_APPEND(&h2c->fctl_list, &h2s->list);
+			h2s_queue_send(h2s, &h2c->fctl_list);
 		else if (h2s->flags & (H2_SF_BLK_MBUSY|H2_SF_BLK_MROOM))
-			LIST_APPEND(&h2c->send_list, &h2s->list);
+			h2s_queue_send(h2s, &h2c->send_list);
 	}
 	TRACE_LEAVE(H2_EV_STRM_SHUT, h2c->conn, h2s);
 	return;
@@ -4460,9 +5326,9 @@ static void h2_do_shutw(struct h2s *h2s)
 	h2s->flags |= H2_SF_WANT_SHUTW;
 	if (!LIST_INLIST(&h2s->list)) {
 		if (h2s->flags & H2_SF_BLK_MFCTL)
-			LIST_APPEND(&h2c->fctl_list, &h2s->list);
+			h2s_queue_send(h2s, &h2c->fctl_list);
 		else if (h2s->flags & (H2_SF_BLK_MBUSY|H2_SF_BLK_MROOM))
-			LIST_APPEND(&h2c->send_list, &h2s->list);
+			h2s_queue_send(h2s, &h2c->send_list);
 	}
 	TRACE_LEAVE(H2_EV_STRM_SHUT, h2c->conn, h2s);
 	return;
@@ -4725,6 +5591,12 @@ static int h2c_decode_headers(struct h2c *h2c, struct buffer *rxbuf, uint32_t *f
 		goto leave;
 	}
 
+	if (!h2c->ddht && (h2c->ddht = hpack_dht_alloc()) == NULL) {
+		TRACE_STATE("failed to allocate the HPACK table", H2_EV_RX_FRAME|H2_EV_RX_HDR|H2_EV_H2C_ERR, h2c->conn);
+		h2c_error(h2c, H2_ERR_INTERNAL_ERROR);
+		goto fail;
+	}
+
 	/* past this point we cannot roll back in case of error */
 	outlen = hpack_decode_frame(h2c->ddht, hdrs, flen, list,
 	                            sizeof(list)/sizeof(list[0]), tmp);
@@ -4889,6 +5761,19 @@ static int h2_frt_transfer_data(struct h2s *h2s)
 			goto fail;
 	}
 
+	/* Very often with large transfers, the demux buffer only contains
+	 * this frame's payload, which h2_recv() pre-aligned to land after an
+	 * HTX header. If so we can simply swap the buffers and alias the
+	 * payload as the stream's DATA block.
+	 */
+	if (flen == b_data(&h2c->dbuf) &&
+	    htx_xfer_raw_data(csbuf, &h2c->dbuf, 0, flen)) {
+		htx = htx_from_buf(csbuf);
+		sent = flen;
+		TRACE_DATA("move some data to h2s rxbuf (zero-copy)", H2_EV_RX_FRAME|H2_EV_RX_DATA, h2c->conn, h2s, 0, (void *)(long)sent);
+		goto moved;
+	}
+
 	block = htx_free_data_space(htx);
 	if (!block) {
 		h2c->flags |= H2_CF_DEM_SFULL;
@@ -4906,11 +5791,15 @@ static int h2_frt_transfer_data(struct h2s *h2s)
 	sent = htx_add_data(htx, ist2(b_head(&h2c->dbuf), flen));
 	TRACE_DATA("move some data to h2s rxbuf", H2_EV_RX_FRAME|H2_EV_RX_DATA, h2c->conn, h2s, 0, (void *)(long)sent);
 
+ moved:
 	b_del(&h2c->dbuf, sent);
 	h2c->dfl    -= sent;
 	h2c->rcvd_c += sent;
 	h2c->rcvd_s += sent;  // warning, this can also affect the closed streams!
 
+	if (h2c->rwin < h2_settings_max_window_size)
+		h2c_bdp_count(h2c, sent);
+
 	if (h2s->flags & H2_SF_DATA_CLEN) {
 		h2s->body_len -= sent;
 		htx->extra = h2s->body_len;
@@ -4965,6 +5854,68 @@ static int h2_frt_transfer_data(struct h2s *h2s)
 	return 0;
 }
 
+/* Returns the number of bytes to save or restore for encoder table <dht>. */
+static inline size_t h2_edht_bytes(const struct hpack_dht *dht)
+{
+	return MAX(dht->size, sizeof(*dht));
+}
+
+/* Restores the encoder's dynamic table of <h2c> to its state before the header
+ * block being built was started, if h2c_edht_begin() saved it.
+ */
+static inline void h2c_edht_rollback(struct h2c *h2c)
+{
+	if (!(h2c->flags & H2_CF_EDHT_SAVED))
+		return;
+	memcpy(h2c->edht, h2_edht_undo, h2_edht_bytes(h2_edht_undo));
+	h2c->flags &= ~H2_CF_EDHT_SAVED;
+}
+
+/* Validates the header block which was just committed into the mux buffer */
+static inline void h2c_edht_commit(struct h2c *h2c)
+{
+	h2c->flags &= ~(H2_CF_EDHT_SAVED | H2_CF_EDHT_RESIZE);
+}
+
+/* Prepares the encoder's dynamic table of <h2c> before a new header block is
+ * encoded into <outbuf>. The table is saved so that it may be rolled back if
+ * the block cannot be sent, or restored if the block is restarted, and any
+ * pending table size update is emitted. Returns 0 if <outbuf> is full,
+ * otherwise non-zero. Nothing is done if the encoder's table is not used.
+ */
+static int h2c_edht_begin(struct h2c *h2c, struct buffer *outbuf)
+{
+	struct hpack_dht *dht = h2c->edht;
+
+	if (!dht)
+		return 1;
+
+	if (h2c->flags & H2_CF_EDHT_SAVED)
+		memcpy(dht, h2_edht_undo, h2_edht_bytes(h2_edht_undo));
+	else
+		memcpy(h2_edht_undo, dht, h2_edht_bytes(dht));
+	h2c->flags |= H2_CF_EDHT_SAVED;
+
+	if (h2c->flags & H2_CF_EDHT_RESIZE) {
+		/* first evict everything, then announce the new size (7541#4.2) */
+		if (!hpack_encode_dht_size_update(outbuf, 0) ||
+		    (h2c->edht_size && !hpack_encode_dht_size_update(outbuf, h2c->edht_size)))
+			return 0;
+		hpack_dht_init(dht, h2c->edht_size);
+	}
+	return 1;
+}
+
+/* Encodes header <n>:<v> into <outbuf> for <h2c>, relying on the encoder's
+ * dynamic table when it is in use. Returns non-zero on success, 0 on failure.
+ */
+static inline int h2c_encode_header(struct h2c *h2c, struct buffer *outbuf, const struct ist n, const struct ist v)
+{
+	if (h2c->edht)
+		return hpack_encode_header_dht(outbuf, h2c->edht, n, v);
+	return hpack_encode_header(outbuf, n, v);
+}
+
 /* Try to send a HEADERS frame matching HTX response present in HTX message
  * <htx> for the H2 stream <h2s>. Returns the number of bytes sent. The caller
  * must check the stream's status to detect any error which might have happened
@@ -5060,7 +6011,15 @@ static size_t h2s_frt_make_resp_headers(struct h2s *h2s, struct htx *htx)
 	/* marker for end of headers */
 	list[hdr].n = ist("");
 
-	mbuf = br_tail(h2c->mbuf);
+	/* Without the encoder's dynamic table, header blocks do not depend
+	 * on each other and a final response's HEADERS frame may be sent
+	 * before the DATA frames of other streams, provided that nothing was
+	 * queued for this stream yet.
+	 */
+	if (!h2c->edht && h2s->status >= 200 && !(h2s->flags & H2_SF_INTERIM_SENT))
+		mbuf = h2c_lane_buf(h2c);
+	else
+		mbuf = br_tail(h2c->mbuf);
  retry:
 	if (!h2_get_buf(h2c, mbuf)) {
 		h2c->flags |= H2_CF_MUX_MALLOC;
@@ -5087,8 +6046,25 @@ static size_t h2s_frt_make_resp_headers(struct h2s *h2s, struct htx *htx)
 	write_n32(outbuf.area + 5, h2s->id); // 4 bytes
 	outbuf.data = 9;
 
+	if (!h2c_edht_begin(h2c, &outbuf)) {
+		if (b_space_wraps(mbuf))
+			goto realign_again;
+		goto full;
+	}
+
 	/* encode status, which necessarily is the first one */
-	if (!hpack_encode_int_status(&outbuf, h2s->status)) {
+	if (h2c->edht) {
+		char status[3];
+
+		status[0] = '0' + h2s->status / 100;
+		status[1] = '0' + h2s->status / 10 % 10;
+		status[2] = '0' + h2s->status % 10;
+		ret = hpack_encode_header_dht(&outbuf, h2c->edht, ist(":status"), ist2(status, 3));
+	}
+	else
+		ret = hpack_encode_int_status(&outbuf, h2s->status);
+
+	if (!ret) {
 		if (b_space_wraps(mbuf))
 			goto realign_again;
 		goto full;
@@ -5111,7 +6087,7 @@ static size_t h2s_frt_make_resp_headers(struct h2s *h2s, struct htx *htx)
 		if (isteq(list[hdr].n, ist("")))
 			break; // end
 
-		if (!hpack_encode_header(&outbuf, list[hdr].n, list[hdr].v)) {
+		if (!h2c_encode_header(h2c, &outbuf, list[hdr].n, list[hdr].v)) {
 			/* output full */
 			if (b_space_wraps(mbuf))
 				goto realign_again;
@@ -5164,12 +6140,15 @@ static size_t h2s_frt_make_resp_headers(struct h2s *h2s, struct htx *htx)
 
 	/* commit the H2 response */
 	b_add(mbuf, outbuf.data);
+	h2c_edht_commit(h2c);
 
 	/* indicates the HEADERS frame was sent, except for 1xx responses. For
 	 * 1xx responses, another HEADERS frame is expected.
 	 */
 	if (h2s->status >= 200)
 		h2s->flags |= H2_SF_HEADERS_SENT;
+	else
+		h2s->flags |= H2_SF_INTERIM_SENT;
 
 	if (es_now) {
 		h2s->flags |= H2_SF_ES_SENT;
@@ -5185,6 +6164,7 @@ static size_t h2s_frt_make_resp_headers(struct h2s *h2s, struct htx *htx)
 	TRACE_LEAVE(H2_EV_TX_FRAME|H2_EV_TX_HDR, h2c->conn, h2s);
 	return ret;
  full:
+	h2c_edht_rollback(h2c);
 	if ((mbuf = br_tail_add(h2c->mbuf)) != NULL)
 		goto retry;
 	h2c->flags |= H2_CF_MUX_MFULL;
@@ -5196,6 +6176,7 @@ static size_t h2s_frt_make_resp_headers(struct h2s *h2s, struct htx *htx)
 	/* unparsable HTX messages, too large ones to be produced in the local
 	 * list etc go here (unrecoverable errors).
 	 */
+	h2c_edht_rollback(h2c);
 	h2s_error(h2s, H2_ERR_INTERNAL_ERROR);
 	ret = 0;
 	goto end;
@@ -5718,7 +6699,7 @@ static size_t h2s_make_data(struct h2s *h2s, struct buffer *buf, size_t count)
 				goto copy;
 			}
 
-			if ((mbuf = br_tail_add(h2c->mbuf)) != NULL)
+			if ((mbuf = h2c_data_tail_add(h2c)) != NULL)
 				goto retry;
 
 			h2c->flags |= H2_CF_MUX_MFULL;
@@ -5773,7 +6754,7 @@ static size_t h2s_make_data(struct h2s *h2s, struct buffer *buf, size_t count)
 	}
 
 	if (outbuf.size < 9) {
-		if ((mbuf = br_tail_add(h2c->mbuf)) != NULL)
+		if ((mbuf = h2c_data_tail_add(h2c)) != NULL)
 			goto retry;
 		h2c->flags |= H2_CF_MUX_MFULL;
 		h2s->flags |= H2_SF_BLK_MROOM;
@@ -5830,7 +6811,7 @@ static size_t h2s_make_data(struct h2s *h2s, struct buffer *buf, size_t count)
 
 		if (fsize <= 0) {
 			/* no need to send an empty frame here */
-			if ((mbuf = br_tail_add(h2c->mbuf)) != NULL)
+			if ((mbuf = h2c_data_tail_add(h2c)) != NULL)
 				goto retry;
 			h2c->flags |= H2_CF_MUX_MFULL;
 			h2s->flags |= H2_SF_BLK_MROOM;
@@ -6001,6 +6982,7 @@ static size_t h2s_make_trailers(struct h2s *h2s, struct htx *htx)
 	struct buffer *mbuf;
 	enum htx_blk_type type;
 	int ret = 0;
+	int start;
 	int hdr;
 	int idx;
 
@@ -6069,6 +7051,13 @@ static size_t h2s_make_trailers(struct h2s *h2s, struct htx *htx)
 	write_n32(outbuf.area + 5, h2s->id); // 4 bytes
 	outbuf.data = 9;
 
+	if (!h2c_edht_begin(h2c, &outbuf)) {
+		if (b_space_wraps(mbuf))
+			goto realign_again;
+		goto full;
+	}
+	start = outbuf.data;
+
 	/* encode all headers */
 	for (idx = 0; idx < hdr; idx++) {
 		/* these ones do not exist in H2 or must not appear in
@@ -6088,7 +7077,7 @@ static size_t h2s_make_trailers(struct h2s *h2s, struct htx *htx)
 		if (*(list[idx].n.ptr) == ':')
 			continue;
 
-		if (!hpack_encode_header(&outbuf, list[idx].n, list[idx].v)) {
+		if (!h2c_encode_header(h2c, &outbuf, list[idx].n, list[idx].v)) {
 			/* output full */
 			if (b_space_wraps(mbuf))
 				goto realign_again;
@@ -6096,7 +7085,7 @@ static size_t h2s_make_trailers(struct h2s *h2s, struct htx *htx)
 		}
 	}
 
-	if (outbuf.data == 9) {
+	if (outbuf.data == start) {
 		/* here we have a problem, we have nothing to emit (either we
 		 * received an empty trailers block followed or we removed its
 		 * contents above). Because of this we can't send a HEADERS
@@ -6105,6 +7094,10 @@ static size_t h2s_make_trailers(struct h2s *h2s, struct htx *htx)
 		 */
 		outbuf.area[3] = H2_FT_DATA;
 		outbuf.area[4] = H2_F_DATA_END_STREAM;
+
+		/* a pending table size update must wait for the next block */
+		h2c_edht_rollback(h2c);
+		outbuf.data = 9;
 	}
 
 	/* update the frame's size */
@@ -6122,6 +7115,7 @@ static size_t h2s_make_trailers(struct h2s *h2s, struct htx *htx)
 	/* commit the H2 response */
 	TRACE_PROTO("sent H2 trailers HEADERS frame", H2_EV_TX_FRAME|H2_EV_TX_HDR|H2_EV_TX_EOI, h2c->conn, h2s);
 	b_add(mbuf, outbuf.data);
+	h2c_edht_commit(h2c);
 	h2s->flags |= H2_SF_ES_SENT;
 
 	if (h2s->st == H2_SS_OPEN)
@@ -6147,6 +7141,7 @@ static size_t h2s_make_trailers(struct h2s *h2s, struct htx *htx)
 	TRACE_LEAVE(H2_EV_TX_FRAME|H2_EV_TX_HDR, h2c->conn, h2s);
 	return ret;
  full:
+	h2c_edht_rollback(h2c);
 	if ((mbuf = br_tail_add(h2c->mbuf)) != NULL)
 		goto retry;
 	h2c->flags |= H2_CF_MUX_MFULL;
@@ -6189,9 +7184,9 @@ static int h2_subscribe(struct conn_stream *cs, int event_type, struct wait_even
 		if (!(h2s->flags & H2_SF_BLK_SFCTL) &&
 		    !LIST_INLIST(&h2s->list)) {
 			if (h2s->flags & H2_SF_BLK_MFCTL)
-				LIST_APPEND(&h2c->fctl_list, &h2s->list);
+				h2s_queue_send(h2s, &h2c->fctl_list);
 			else
-				LIST_APPEND(&h2c->send_list, &h2s->list);
+				h2s_queue_send(h2s, &h2c->send_list);
 		}
 	}
 	TRACE_LEAVE(H2_EV_STRM_SEND|H2_EV_STRM_RECV, h2c->conn, h2s);
@@ -6329,10 +7324,12 @@ static size_t h2_snd_buf(struct conn_stream *cs, struct buffer *buf, size_t coun
 
 	/* If we were not just woken because we wanted to send but couldn't,
 	 * and there's somebody else that is waiting to send, do nothing,
-	 * we will subscribe later and be put at the end of the list
+	 * we will subscribe later and be put at the end of the list (or at
+	 * our priority's place when prioritizing). A response which did not
+	 * emit its HEADERS yet doesn't wait since they may be sent ahead of
+	 * the queued DATA (see h2c_lane_buf()).
 	 */
-	if (!(h2s->flags & H2_SF_NOTIFIED) &&
-	    (!LIST_ISEMPTY(&h2s->h2c->send_list) || !LIST_ISEMPTY(&h2s->h2c->fctl_list))) {
+	if (!(h2s->flags & H2_SF_NOTIFIED) && !h2s_headers_may_pass(h2s) && h2s_must_wait_send(h2s)) {
 		TRACE_DEVEL("other streams already waiting, going to the queue and leaving", H2_EV_H2S_SEND|H2_EV_H2S_BLK, h2s->h2c->conn, h2s);
 		return 0;
 	}
@@ -6405,8 +7402,20 @@ static size_t h2_snd_buf(struct conn_stream *cs, struct buffer *buf, size_t coun
 				if (!(h2s->h2c->flags & H2_CF_IS_BACK) &&
 				    (h2s->flags & (H2_SF_BODY_TUNNEL|H2_SF_BODYLESS_RESP)) == H2_SF_BODYLESS_RESP)
 					ret = h2s_skip_data(h2s, buf, count);
-				else
+				else if (h2s_over_send_budget(h2s)) {
+					/* let the other streams pass, we'll be
+					 * queued at the end of the send list.
+					 */
+					TRACE_STATE("send budget exhausted, yielding", H2_EV_H2S_SEND|H2_EV_H2S_BLK, h2s->h2c->conn, h2s);
+					h2s->flags |= H2_SF_BLK_MROOM;
+					LIST_DEL_INIT(&h2s->list);
+					goto done;
+				}
+				else {
 					ret = h2s_make_data(h2s, buf, count);
+					if (ret > 0 && h2_stream_send_budget)
+						h2s->tx_end = h2s->h2c->tx_sent + h2c_mbuf_pending(h2s->h2c);
+				}
 				if (ret > 0) {
 					htx = htx_from_buf(buf);
 					total += ret;
@@ -6457,8 +7466,18 @@ static size_t h2_snd_buf(struct conn_stream *cs, struct buffer *buf, size_t coun
 
 	if (total > 0) {
 		if (!(h2s->h2c->wait_event.events & SUB_RETRY_SEND)) {
+			struct tasklet *tl = h2s->h2c->wait_event.tasklet;
+
 			TRACE_DEVEL("data queued, waking up h2c sender", H2_EV_H2S_SEND|H2_EV_H2C_SEND, h2s->h2c->conn, h2s);
-			tasklet_wakeup(h2s->h2c->wait_event.tasklet);
+			if (h2_coalesce_sends && !(tl->state & (TASK_IN_LIST|TASK_SELF_WAKING))) {
+				/* queue the sender after the other streams
+				 * processed during this pass so that their
+				 * frames are sent together.
+				 */
+				h2s->h2c->flags |= H2_CF_SND_DEFERRED;
+				HA_ATOMIC_OR(&tl->state, TASK_SELF_WAKING);
+			}
+			tasklet_wakeup(tl);
 		}
 
 	}
@@ -6522,14 +7541,14 @@ static int h2_show_fd(struct buffer *msg, struct connection *conn)
 	tmbuf = br_tail(h2c->mbuf);
 	chunk_appendf(msg, " h2c.st0=%s .err=%d .maxid=%d .lastid=%d .flg=0x%04x"
 		      " .nbst=%u .nbcs=%u .fctl_cnt=%d .send_cnt=%d .tree_cnt=%d"
-		      " .orph_cnt=%d .sub=%d .dsi=%d .dbuf=%u@%p+%u/%u .msi=%d"
+		      " .orph_cnt=%d .sub=%d .dsi=%d .dbuf=%u@%p+%u/%u .rwin=%u .rtt=%u .msi=%d"
 		      " .mbuf=[%u..%u|%u],h=[%u@%p+%u/%u],t=[%u@%p+%u/%u]",
 		      h2c_st_to_str(h2c->st0), h2c->errcode, h2c->max_id, h2c->last_sid, h2c->flags,
 		      h2c->nb_streams, h2c->nb_cs, fctl_cnt, send_cnt, tree_cnt, orph_cnt,
 		      h2c->wait_event.events, h2c->dsi,
 		      (unsigned int)b_data(&h2c->dbuf), b_orig(&h2c->dbuf),
 		      (unsigned int)b_head_ofs(&h2c->dbuf), (unsigned int)b_size(&h2c->dbuf),
-		      h2c->msi,
+		      h2c->rwin, h2c->rtt, h2c->msi,
 		      br_head_idx(h2c->mbuf), br_tail_idx(h2c->mbuf), br_size(h2c->mbuf),
 		      (unsigned int)b_data(hmbuf), b_orig(hmbuf),
 		      (unsigned int)b_head_ofs(hmbuf), (unsigned int)b_size(hmbuf),
@@ -6573,6 +7592,14 @@ static int h2_takeover(struct connection *conn, int orig_tid)
 	if (fd_takeover(conn->handle.fd, conn) != 0)
 		return -1;
 
+	if (h2c->flags & H2_CF_MIGRATING) {
+		/* frontend connection offered by <orig_tid>, whose lock is
+		 * held by the caller.
+		 */
+		h2c->flags &= ~H2_CF_MIGRATING;
+		LIST_DEL_INIT(&conn->stopping_list);
+	}
+
 	if (conn->xprt->takeover && conn->xprt->takeover(conn, conn->xprt_ctx, orig_tid) != 0) {
 		/* We failed to takeover the xprt, even if the connection may
 		 * still be valid, flag it as error'd, as we have already
@@ -6607,6 +7634,11 @@ static int h2_takeover(struct connection *conn, int orig_tid)
 		}
 		h2c->task->process = h2_timeout_task;
 		h2c->task->context = h2c;
+		if (!conn_is_back(conn)) {
+			/* frontend connections keep their idle timeout */
+			h2c->task->expire = tick_add(now_ms, h2c->last_sid < 0 ? h2c->timeout : h2c->shut_timeout);
+			task_queue(h2c->task);
+		}
 	}
 	h2c->wait_event.tasklet = tasklet_new();
 	if (!h2c->wait_event.tasklet) {
@@ -6625,6 +7657,60 @@ static int h2_takeover(struct connection *conn, int orig_tid)
 /* functions below are dedicated to the config parsers */
 /*******************************************************/
 
+/* config parser for global "tune.h2.coalesce-sends", accepts "on" or "off" */
+static int h2_parse_coalesce_sends(char **args, int section_type, struct proxy *curpx,
+                                   const struct proxy *defpx, const char *file, int line,
+                                   char **err)
+{
+	if (too_many_args(1, args, err, NULL))
+		return -1;
+
+	if (strcmp(args[1], "on") == 0)
+		h2_coalesce_sends = 1;
+	else if (strcmp(args[1], "off") == 0)
+		h2_coalesce_sends = 0;
+	else {
+		memprintf(err, "'%s' expects either 'on' or 'off' but got '%s'.", args[0], args[1]);
+		return -1;
+	}
+	return 0;
+}
+
+/* config parser for global "tune.h2.encoder-table-size" */
+static int h2_parse_encoder_table_size(char **args, int section_type, struct proxy *curpx,
+                                       const struct proxy *defpx, const char *file, int line,
+                                       char **err)
+{
+	if (too_many_args(1, args, err, NULL))
+		return -1;
+
+	h2_enc_table_size = atoi(args[1]);
+	if (h2_enc_table_size < 0 || h2_enc_table_size > 65536) {
+		memprintf(err, "'%s' expects a numeric value between 0 and 65536.", args[0]);
+		return -1;
+	}
+	return 0;
+}
+
+/* config parser for global "tune.h2.prioritize", accepts "on" or "off" */
+static int h2_parse_prioritize(char **args, int section_type, struct proxy *curpx,
+                               const struct proxy *defpx, const char *file, int line,
+                               char **err)
+{
+	if (too_many_args(1, args, err, NULL))
+		return -1;
+
+	if (strcmp(args[1], "on") == 0)
+		h2_prioritize = 1;
+	else if (strcmp(args[1], "off") == 0)
+		h2_prioritize = 0;
+	else {
+		memprintf(err, "'%s' expects either 'on' or 'off' but got '%s'.", args[0], args[1]);
+		return -1;
+	}
+	return 0;
+}
+
 /* config parser for global "tune.h2.header-table-size" */
 static int h2_parse_header_table_size(char **args, int section_type, struct proxy *curpx,
                                       const struct proxy *defpx, const char *file, int line,
@@ -6657,6 +7743,54 @@ static int h2_parse_initial_window_size(char **args, int section_type, struct pr
 	return 0;
 }
 
+/* config parser for global "tune.h2.max-window-size" */
+static int h2_parse_max_window_size(char **args, int section_type, struct proxy *curpx,
+                                    const struct proxy *defpx, const char *file, int line,
+                                    char **err)
+{
+	const char *res;
+	unsigned int size;
+
+	if (too_many_args(1, args, err, NULL))
+		return -1;
+
+	res = parse_size_err(args[1], &size);
+	if (res != NULL) {
+		memprintf(err, "unexpected '%s' after size passed to '%s'", res, args[0]);
+		return -1;
+	}
+
+	if (size > 0x7fffffff) {
+		memprintf(err, "'%s' cannot be larger than 2147483647.", args[0]);
+		return -1;
+	}
+	h2_settings_max_window_size = size;
+	return 0;
+}
+
+/* config parser for global "tune.h2.stream-send-budget" */
+static int h2_parse_stream_send_budget(char **args, int section_type, struct proxy *curpx,
+                                       const struct proxy *defpx, const char *file, int line,
+                                       char **err)
+{
+	const char *res;
+
+	if (too_many_args(1, args, err, NULL))
+		return -1;
+
+	res = parse_size_err(args[1], &h2_stream_send_budget);
+	if (res != NULL) {
+		memprintf(err, "unexpected '%s' after size passed to '%s'", res, args[0]);
+		return -1;
+	}
+
+	if (h2_stream_send_budget > 0x7fffffff) {
+		memprintf(err, "'%s' cannot be larger than 2147483647.", args[0]);
+		return -1;
+	}
+	return 0;
+}
+
 /* config parser for global "tune.h2.max-concurrent-streams" */
 static int h2_parse_max_concurrent_streams(char **args, int section_type, struct proxy *curpx,
                                            const struct proxy *defpx, const char *file, int line,
@@ -6673,6 +7807,22 @@ static int h2_parse_max_concurrent_streams(char **args, int section_type, struct
 	return 0;
 }
 
+/* config parser for global "tune.h2.min-concurrent-streams" */
+static int h2_parse_min_concurrent_streams(char **args, int section_type, struct proxy *curpx,
+                                           const struct proxy *defpx, const char *file, int line,
+                                           char **err)
+{
+	if (too_many_args(1, args, err, NULL))
+		return -1;
+
+	h2_settings_min_concurrent_streams = atoi(args[1]);
+	if ((int)h2_settings_min_concurrent_streams < 0) {
+		memprintf(err, "'%s' expects a positive numeric value.", args[0]);
+		return -1;
+	}
+	return 0;
+}
+
 /* config parser for global "tune.h2.max-frame-size" */
 static int h2_parse_max_frame_size(char **args, int section_type, struct proxy *curpx,
                                    const struct proxy *defpx, const char *file, int line,
@@ -6713,7 +7863,7 @@ static const struct mux_ops h2_ops = {
 	.ctl = h2_ctl,
 	.show_fd = h2_show_fd,
 	.takeover = h2_takeover,
-	.flags = MX_FL_CLEAN_ABRT|MX_FL_HTX|MX_FL_HOL_RISK|MX_FL_NO_UPG,
+	.flags = MX_FL_CLEAN_ABRT|MX_FL_HTX|MX_FL_HOL_RISK|MX_FL_NO_UPG|MX_FL_MULTIPLEX,
 	.name = "H2",
 };
 
@@ -6724,10 +7874,16 @@ INITCALL1(STG_REGISTER, register_mux_proto, &mux_proto_h2);
 
 /* config keyword parsers */
 static struct cfg_kw_list cfg_kws = {ILH, {
+	{ CFG_GLOBAL, "tune.h2.coalesce-sends",         h2_parse_coalesce_sends         },
+	{ CFG_GLOBAL, "tune.h2.encoder-table-size",     h2_parse_encoder_table_size     },
 	{ CFG_GLOBAL, "tune.h2.header-table-size",      h2_parse_header_table_size      },
 	{ CFG_GLOBAL, "tune.h2.initial-window-size",    h2_parse_initial_window_size    },
 	{ CFG_GLOBAL, "tune.h2.max-concurrent-streams", h2_parse_max_concurrent_streams },
 	{ CFG_GLOBAL, "tune.h2.max-frame-size",         h2_parse_max_frame_size         },
+	{ CFG_GLOBAL, "tune.h2.max-window-size",        h2_parse_max_window_size        },
+	{ CFG_GLOBAL, "tune.h2.min-concurrent-streams", h2_parse_min_concurrent_streams },
+	{ CFG_GLOBAL, "tune.h2.prioritize",             h2_parse_prioritize             },
+	{ CFG_GLOBAL, "tune.h2.stream-send-budget",     h2_parse_stream_send_budget     },
 	{ 0, NULL, NULL }
 }};
 
@@ -6745,7 +7901,45 @@ static int init_h2()
 		ha_alert("failed to allocate hpack_tbl memory pool\n");
 		return (ERR_ALERT | ERR_FATAL);
 	}
+
+	/* encoder tables are allocated from the same pool */
+	if (h2_enc_table_size > h2_settings_header_table_size) {
+		ha_warning("tune.h2.encoder-table-size %d is larger than tune.h2.header-table-size, limiting it to %d.\n",
+		           h2_enc_table_size, h2_settings_header_table_size);
+		h2_enc_table_size = h2_settings_header_table_size;
+	}
+
+	/* the limit only adapts within a non-empty range */
+	if (h2_settings_min_concurrent_streams &&
+	    (!h2_settings_max_concurrent_streams ||
+	     h2_settings_min_concurrent_streams >= h2_settings_max_concurrent_streams)) {
+		ha_warning("tune.h2.min-concurrent-streams %u is not lower than tune.h2.max-concurrent-streams, ignoring it.\n",
+		           h2_settings_min_concurrent_streams);
+		h2_settings_min_concurrent_streams = 0;
+	}
 	return ERR_NONE;
 }
 
+/* allocates the per-thread copy of the encoder's table when it's enabled */
+static int alloc_h2_edht_undo()
+{
+	if (!h2_enc_table_size)
+		return 1;
+
+	h2_edht_undo = hpack_dht_alloc();
+	if (!h2_edht_undo) {
+		ha_alert("failed to allocate the HPACK encoder's undo table\n");
+		return 0;
+	}
+	return 1;
+}
+
+static void free_h2_edht_undo()
+{
+	hpack_dht_free(h2_edht_undo);
+	h2_edht_undo = NULL;
+}
+
 REGISTER_POST_CHECK(init_h2);
+REGISTER_PER_THREAD_ALLOC(alloc_h2_edht_undo);
+REGISTER_PER_THREAD_FREE(free_h2_edht_undo);
@@ -17,12 +17,16 @@
 #include <signal.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
 #include <sys/wait.h>
+#include <unistd.h>
 
 #if defined(USE_SYSTEMD)
 #include <systemd/sd-daemon.h>
 #endif
 
+#include <import/ebsttree.h>
 #include <haproxy/api.h>
 #include <haproxy/cfgparse.h>
 #include <haproxy/cli.h>
@@ -34,9 +38,12 @@
 #include <haproxy/mworker.h>
 #include <haproxy/peers.h>
 #include <haproxy/proxy.h>
+#include <haproxy/server.h>
 #include <haproxy/signal.h>
+#include <haproxy/stats.h>
 #include <haproxy/stream.h>
 #include <haproxy/stream_interface.h>
+#include <haproxy/task.h>
 #include <haproxy/tools.h>
 #include <haproxy/version.h>
 
@@ -126,6 +133,8 @@ void mworker_proc_list_to_env()
 	}
 	if (msg)
 		setenv("HAPROXY_PROCESSES", msg, 1);
+
+	mworker_stats_to_env();
 }
 
 /*
@@ -284,6 +293,7 @@ void mworker_catch_sigchld(struct sig_handler *sh)
 
 			LIST_DELETE(&child->list);
 			close(child->ipc_fd[0]);
+			mworker_stats_release(exitpid);
 			childfound = 1;
 			break;
 		}
@@ -337,6 +347,442 @@ void mworker_catch_sigchld(struct sig_handler *sh)
 
 }
 
+/* ----- workers' statistics ----- */
+
+/* The workers periodically publish some counters of their proxies and servers
+ * into an area shared with the master, which sums them to present consolidated
+ * statistics for all current and leaving workers. The area is a memory file
+ * whose FD is passed to the new master across reloads, and contains one slot
+ * per worker. The master assigns the slots and releases them once the workers
+ * have exited.
+ */
+
+#define MWORKER_STATS_SLOTS    16     /* workers which may publish at once */
+#define MWORKER_STATS_RECS     4096   /* objects published by each worker */
+#define MWORKER_STATS_NAMELEN  64     /* longer names are truncated */
+#define MWORKER_STATS_PERIOD   1000   /* publication interval, in ms */
+#define MWORKER_STATS_FIELDS   11
+
+/* published counters, with their names in the Prometheus output */
+static const struct {
+	enum stat_field field;
+	const char *name;
+	const char *type;
+} mworker_stats_fields[MWORKER_STATS_FIELDS] = {
+	{ ST_F_SCUR,     "current_sessions",        "gauge"   },
+	{ ST_F_STOT,     "sessions_total",          "counter" },
+	{ ST_F_BIN,      "bytes_in_total",          "counter" },
+	{ ST_F_BOUT,     "bytes_out_total",         "counter" },
+	{ ST_F_DREQ,     "requests_denied_total",   "counter" },
+	{ ST_F_DRESP,    "responses_denied_total",  "counter" },
+	{ ST_F_EREQ,     "request_errors_total",    "counter" },
+	{ ST_F_ECON,     "connection_errors_total", "counter" },
+	{ ST_F_ERESP,    "response_errors_total",   "counter" },
+	{ ST_F_REQ_TOT,  "http_requests_total",     "counter" },
+	{ ST_F_CONN_TOT, "connections_total",       "counter" },
+};
+
+/* counters of one frontend, backend or server */
+struct mworker_stats_rec {
+	char px[MWORKER_STATS_NAMELEN];
+	char sv[MWORKER_STATS_NAMELEN];
+	unsigned int type;                     /* STATS_TYPE_FE/BE/SV */
+	unsigned int present;                  /* bit field of the reported counters */
+	unsigned long long val[MWORKER_STATS_FIELDS];
+};
+
+struct mworker_stats_slot {
+	int pid;                               /* worker owning the slot, 0 if free */
+	unsigned int count;                    /* number of valid records */
+	struct mworker_stats_rec rec[MWORKER_STATS_RECS];
+};
+
+/* records summed by the master, in the order they were first met */
+struct mworker_stats_sum {
+	struct mworker_stats_sum *next;
+	struct mworker_stats_rec rec;
+	struct ebmb_node node;                 /* indexed by "<type>/<px>/<sv>" */
+};
+
+static struct mworker_stats_slot *mworker_stats_area = NULL;
+static int mworker_stats_fd = -1;
+
+#define MWORKER_STATS_SIZE (MWORKER_STATS_SLOTS * sizeof(struct mworker_stats_slot))
+
+/* Creates the area where the workers publish their counters, or recovers it
+ * from the environment after a reload. Must be called by the master before
+ * forking the workers. It is only supported on Linux, where the area does not
+ * use memory until it is written to. Failures leave the feature disabled.
+ */
+void mworker_stats_init()
+{
+	const char *env = getenv("HAPROXY_MWORKER_STATS_FD");
+	void *area;
+	int fd = -1;
+
+	if (env) {
+		fd = atoi(env);
+		unsetenv("HAPROXY_MWORKER_STATS_FD");
+		fcntl(fd, F_SETFD, FD_CLOEXEC);
+	}
+#if defined(__linux__) && defined(SYS_memfd_create)
+	else {
+		fd = syscall(SYS_memfd_create, "haproxy-stats", 1 /* MFD_CLOEXEC */);
+		if (fd >= 0 && ftruncate(fd, MWORKER_STATS_SIZE) < 0) {
+			close(fd);
+			fd = -1;
+		}
+	}
+#endif
+	if (fd < 0)
+		return;
+
+	area = mmap(NULL, MWORKER_STATS_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (area == MAP_FAILED) {
+		close(fd);
+		return;
+	}
+	mworker_stats_area = area;
+	mworker_stats_fd = fd;
+}
+
+/* passes the area's FD to the next master, it must survive the exec() */
+void mworker_stats_to_env()
+{
+	char str[12];
+
+	if (mworker_stats_fd < 0)
+		return;
+	fcntl(mworker_stats_fd, F_SETFD, 0);
+	snprintf(str, sizeof(str), "%d", mworker_stats_fd);
+	setenv("HAPROXY_MWORKER_STATS_FD", str, 1);
+}
+
+/* Assigns a free slot to the new worker <pid>. Called by the master. */
+void mworker_stats_assign(int pid)
+{
+	int i;
+
+	if (!mworker_stats_area)
+		return;
+
+	for (i = 0; i < MWORKER_STATS_SLOTS; i++) {
+		if (mworker_stats_area[i].pid)
+			continue;
+		mworker_stats_area[i].count = 0;
+		__sync_synchronize(); /* other processes, not threads */
+		mworker_stats_area[i].pid = pid;
+		return;
+	}
+}
+
+/* Releases the slot of worker <pid> which exited. Called by the master. */
+void mworker_stats_release(int pid)
+{
+	int i;
+
+	if (!mworker_stats_area)
+		return;
+
+	for (i = 0; i < MWORKER_STATS_SLOTS; i++) {
+		if (mworker_stats_area[i].pid == pid) {
+			mworker_stats_area[i].count = 0;
+			mworker_stats_area[i].pid = 0;
+		}
+	}
+}
+
+/* Appends to slot <slot> the record for the object of type <type> made of proxy
+ * <px> and server <sv> if any, at position <n>. <stats> is a work area of
+ * ST_F_TOTAL_FIELDS. Returns the next position.
+ */
+static unsigned int mworker_stats_add(struct mworker_stats_slot *slot, unsigned int n, int type,
+                                      struct proxy *px, struct server *sv, struct field *stats)
+{
+	struct mworker_stats_rec *rec;
+	enum stat_field f;
+	int i, ok;
+
+	if (n >= MWORKER_STATS_RECS)
+		return n;
+
+	rec = &slot->rec[n];
+	strlcpy2(rec->px, px->id, sizeof(rec->px));
+	strlcpy2(rec->sv, sv ? sv->id : "", sizeof(rec->sv));
+	rec->type = type;
+	rec->present = 0;
+
+	for (i = 0; i < MWORKER_STATS_FIELDS; i++) {
+		f = mworker_stats_fields[i].field;
+		memset(&stats[f], 0, sizeof(stats[f]));
+		if (type == STATS_TYPE_FE)
+			ok = stats_fill_fe_stats(px, stats, ST_F_TOTAL_FIELDS, &f);
+		else if (type == STATS_TYPE_BE)
+			ok = stats_fill_be_stats(px, 0, stats, ST_F_TOTAL_FIELDS, &f);
+		else
+			ok = stats_fill_sv_stats(px, sv, 0, stats, ST_F_TOTAL_FIELDS, &f);
+
+		if (!ok)
+			continue;
+
+		f = mworker_stats_fields[i].field;
+		switch (field_format(stats, f)) {
+		case FF_S32: rec->val[i] = stats[f].u.s32; break;
+		case FF_U32: rec->val[i] = stats[f].u.u32; break;
+		case FF_S64: rec->val[i] = stats[f].u.s64; break;
+		case FF_U64: rec->val[i] = stats[f].u.u64; break;
+		default: continue;
+		}
+		rec->present |= 1U << i;
+	}
+	return n + 1;
+}
+
+/* Worker task publishing the counters into the slot the master assigned */
+static struct task *mworker_stats_publish(struct task *t, void *context, unsigned int state)
+{
+	struct mworker_stats_slot *slot = context;
+	struct field stats[ST_F_TOTAL_FIELDS];
+	struct proxy *px;
+	struct server *sv;
+	unsigned int n = 0;
+	int i;
+
+	/* the master may not have assigned the slot yet */
+	for (i = 0; !slot && i < MWORKER_STATS_SLOTS; i++) {
+		if (mworker_stats_area[i].pid == pid)
+			slot = t->context = &mworker_stats_area[i];
+	}
+	if (!slot)
+		goto out;
+
+	/* the records are updated in place, and only ever appended, so that
+	 * the master always reads consistent ones.
+	 */
+	for (px = proxies_list; px; px = px->next) {
+		/* stopping proxies are kept to cover leaving workers */
+		if (px->uuid <= 0 || px->mode == PR_MODE_CLI || !(px->cap & (PR_CAP_FE | PR_CAP_BE)))
+			continue;
+
+		if (px->cap & PR_CAP_FE)
+			n = mworker_stats_add(slot, n, STATS_TYPE_FE, px, NULL, stats);
+
+		if (px->cap & PR_CAP_BE) {
+			n = mworker_stats_add(slot, n, STATS_TYPE_BE, px, NULL, stats);
+			for (sv = px->srv; sv; sv = sv->next)
+				n = mworker_stats_add(slot, n, STATS_TYPE_SV, px, sv, stats);
+		}
+	}
+	__sync_synchronize();
+	slot->count = n;
+ out:
+	t->expire = tick_add(now_ms, MWORKER_STATS_PERIOD);
+	return t;
+}
+
+/* Starts the publication of the counters. Called by the workers after the fork. */
+void mworker_stats_attach()
+{
+	struct task *t;
+
+	if (!mworker_stats_area)
+		return;
+
+	/* the mapping remains */
+	close(mworker_stats_fd);
+	mworker_stats_fd = -1;
+
+	t = task_new(MAX_THREADS_MASK);
+	if (!t)
+		return;
+	t->process = mworker_stats_publish;
+	t->context = NULL;
+	task_wakeup(t, TASK_WOKEN_INIT);
+}
+
+/* Sums the records of the slots of the known workers into a list whose head is
+ * returned, or NULL if there is none or in case of allocation failure.
+ */
+static struct mworker_stats_sum *mworker_stats_sum_all()
+{
+	struct mworker_stats_sum *head = NULL, **tail = &head;
+	struct mworker_stats_sum *sum, *next;
+	struct mworker_stats_slot *slot;
+	struct mworker_stats_rec *rec;
+	struct mworker_proc *child;
+	struct eb_root root = EB_ROOT_UNIQUE;
+	struct ebmb_node *node;
+	unsigned int count, n;
+	int i, f, len;
+
+	for (i = 0; i < MWORKER_STATS_SLOTS; i++) {
+		slot = &mworker_stats_area[i];
+		if (!slot->pid)
+			continue;
+
+		list_for_each_entry(child, &proc_list, list) {
+			if (child->pid == slot->pid && (child->options & PROC_O_TYPE_WORKER))
+				break;
+		}
+		if (&child->list == &proc_list)
+			continue;
+
+		count = slot->count;
+		__sync_synchronize();
+		for (n = 0; n < count && n < MWORKER_STATS_RECS; n++) {
+			rec = &slot->rec[n];
+			chunk_printf(&trash, "%u/%.*s/%.*s", rec->type,
+				     MWORKER_STATS_NAMELEN, rec->px, MWORKER_STATS_NAMELEN, rec->sv);
+
+			node = ebst_lookup(&root, trash.area);
+			if (node) {
+				sum = container_of(node, struct mworker_stats_sum, node);
+				for (f = 0; f < MWORKER_STATS_FIELDS; f++)
+					sum->rec.val[f] += rec->val[f];
+				sum->rec.present |= rec->present;
+				continue;
+			}
+
+			len = trash.data + 1;
+			sum = malloc(sizeof(*sum) + len);
+			if (!sum)
+				goto fail;
+			sum->rec = *rec;
+			sum->next = NULL;
+			memcpy(sum->node.key, trash.area, len);
+			ebst_insert(&root, &sum->node);
+			*tail = sum;
+			tail = &sum->next;
+		}
+	}
+	return head;
+
+ fail:
+	for (sum = head; sum; sum = next) {
+		next = sum->next;
+		free(sum);
+	}
+	return NULL;
+}
+
+/* parses "show proc stat [prometheus]" on the master CLI */
+static int cli_parse_show_proc_stat(char **args, char *payload, struct appctx *appctx, void *private)
+{
+	if (*args[3] && strcmp(args[3], "prometheus") != 0)
+		return cli_err(appctx, "Expects either no argument or 'prometheus'.\n");
+
+	if (!mworker_stats_area)
+		return cli_err(appctx, "The workers' statistics are not available on this system.\n");
+
+	appctx->ctx.cli.i0 = !!*args[3]; /* Prometheus format */
+	appctx->ctx.cli.i1 = 0;          /* Prometheus: current type and field */
+	appctx->ctx.cli.p0 = mworker_stats_sum_all();
+	appctx->ctx.cli.p1 = appctx->ctx.cli.p0;
+	return 0;
+}
+
+/* Dumps the counters summed over all workers, either in CSV like "show stat",
+ * or in the Prometheus text format. The line of each object is emitted in one
+ * piece so that the dump may be interrupted between them.
+ */
+static int cli_io_handler_show_proc_stat(struct appctx *appctx)
+{
+	static const char *types[3] = { "frontend", "backend", "server" };
+	struct stream_interface *si = appctx->owner;
+	struct mworker_stats_sum *sum;
+	int f, type;
+
+	if (unlikely(si_ic(si)->flags & (CF_WRITE_ERROR|CF_SHUTW)))
+		return 1;
+
+	if (!appctx->ctx.cli.i0) {
+		if (appctx->ctx.cli.p1 == appctx->ctx.cli.p0 && !appctx->ctx.cli.i1) {
+			chunk_printf(&trash, "# pxname,svname,type");
+			for (f = 0; f < MWORKER_STATS_FIELDS; f++)
+				chunk_appendf(&trash, ",%s", stat_fields[mworker_stats_fields[f].field].name);
+			chunk_appendf(&trash, "\n");
+			if (ci_putchk(si_ic(si), &trash) == -1)
+				goto full;
+			appctx->ctx.cli.i1 = 1;
+		}
+
+		for (sum = appctx->ctx.cli.p1; sum; sum = appctx->ctx.cli.p1 = sum->next) {
+			chunk_printf(&trash, "%s,%s,%d", sum->rec.px,
+				     sum->rec.type == STATS_TYPE_FE ? "FRONTEND" :
+				     sum->rec.type == STATS_TYPE_BE ? "BACKEND" : sum->rec.sv,
+				     sum->rec.type);
+			for (f = 0; f < MWORKER_STATS_FIELDS; f++) {
+				if (sum->rec.present & (1U << f))
+					chunk_appendf(&trash, ",%llu", sum->rec.val[f]);
+				else
+					chunk_appendf(&trash, ",");
+			}
+			chunk_appendf(&trash, "\n");
+			if (ci_putchk(si_ic(si), &trash) == -1)
+				goto full;
+		}
+		return 1;
+	}
+
+	/* Prometheus: all objects for each type and field. <i1> counts the
+	 * metrics already dumped, twice for the one in progress once its header
+	 * was emitted.
+	 */
+	for (; appctx->ctx.cli.i1 < 2 * 3 * MWORKER_STATS_FIELDS; appctx->ctx.cli.i1++) {
+		type = appctx->ctx.cli.i1 / (2 * MWORKER_STATS_FIELDS);
+		f = (appctx->ctx.cli.i1 / 2) % MWORKER_STATS_FIELDS;
+
+		if (!(appctx->ctx.cli.i1 & 1)) {
+			for (sum = appctx->ctx.cli.p0; sum; sum = sum->next)
+				if (sum->rec.type == type && (sum->rec.present & (1U << f)))
+					break;
+			if (!sum) {
+				/* nothing to dump for this one */
+				appctx->ctx.cli.i1++;
+				continue;
+			}
+			chunk_printf(&trash, "# HELP haproxy_%s_%s %s summed over all workers.\n"
+				     "# TYPE haproxy_%s_%s %s\n",
+				     types[type], mworker_stats_fields[f].name,
+				     stat_fields[mworker_stats_fields[f].field].desc,
+				     types[type], mworker_stats_fields[f].name, mworker_stats_fields[f].type);
+			if (ci_putchk(si_ic(si), &trash) == -1)
+				goto full;
+			appctx->ctx.cli.p1 = appctx->ctx.cli.p0;
+			continue;
+		}
+
+		for (sum = appctx->ctx.cli.p1; sum; sum = appctx->ctx.cli.p1 = sum->next) {
+			if (sum->rec.type != type || !(sum->rec.present & (1U << f)))
+				continue;
+			if (type == STATS_TYPE_SV)
+				chunk_printf(&trash, "haproxy_%s_%s{proxy=\"%s\",server=\"%s\"} %llu\n",
+					     types[type], mworker_stats_fields[f].name, sum->rec.px, sum->rec.sv, sum->rec.val[f]);
+			else
+				chunk_printf(&trash, "haproxy_%s_%s{proxy=\"%s\"} %llu\n",
+					     types[type], mworker_stats_fields[f].name, sum->rec.px, sum->rec.val[f]);
+			if (ci_putchk(si_ic(si), &trash) == -1)
+				goto full;
+		}
+	}
+	return 1;
+
+ full:
+	si_rx_room_blk(si);
+	return 0;
+}
+
+static void cli_release_show_proc_stat(struct appctx *appctx)
+{
+	struct mworker_stats_sum *sum, *next;
+
+	for (sum = appctx->ctx.cli.p0; sum; sum = next) {
+		next = sum->next;
+		free(sum);
+	}
+	appctx->ctx.cli.p0 = appctx->ctx.cli.p1 = NULL;
+}
+
 /* ----- IPC FD (sockpair) related ----- */
 
 /* This wrapper is called from the workers. It is registered instead of the
@@ -627,6 +1073,7 @@ static struct cli_kw_list cli_kws = {{ },{
 	{ { "@<relative pid>", NULL }, "@<relative pid>                         : send a command to the <relative pid> process", NULL, cli_io_handler_show_proc, NULL, NULL, ACCESS_MASTER_ONLY},
 	{ { "@!<pid>", NULL },         "@!<pid>                                 : send a command to the <pid> process", cli_parse_default, NULL, NULL, NULL, ACCESS_MASTER_ONLY},
 	{ { "@master", NULL },         "@master                                 : send a command to the master process", cli_parse_default, NULL, NULL, NULL, ACCESS_MASTER_ONLY},
+	{ { "show", "proc", "stat", NULL }, "show proc stat [prometheus]             : show the counters summed over all workers", cli_parse_show_proc_stat, cli_io_handler_show_proc_stat, cli_release_show_proc_stat, NULL, ACCESS_MASTER_ONLY},
 	{ { "show", "proc", NULL },    "show proc                               : show processes status", cli_parse_default, cli_io_handler_show_proc, NULL, NULL, ACCESS_MASTER_ONLY},
 	{ { "reload", NULL },          "reload                                  : reload haproxy", cli_parse_reload, NULL, NULL, NULL, ACCESS_MASTER_ONLY},
 	{{},}
@@ -25,6 +25,8 @@
 #include <haproxy/pattern.h>
 #include <haproxy/regex.h>
 #include <haproxy/sample.h>
+#include <haproxy/thread.h>
+#include <haproxy/time.h>
 #include <haproxy/tools.h>
 
 
@@ -73,8 +75,8 @@ int (*const pat_index_fcts[PAT_MATCH_NUM])(struct pattern_expr *, struct pattern
 	[PAT_MATCH_BEG]   = pat_idx_tree_pfx,
 	[PAT_MATCH_SUB]   = pat_idx_list_str,
 	[PAT_MATCH_DIR]   = pat_idx_list_str,
-	[PAT_MATCH_DOM]   = pat_idx_list_str,
-	[PAT_MATCH_END]   = pat_idx_list_str,
+	[PAT_MATCH_DOM]   = pat_idx_tree_dom,
+	[PAT_MATCH_END]   = pat_idx_tree_sfx,
 	[PAT_MATCH_REG]   = pat_idx_list_reg,
 	[PAT_MATCH_REGM]  = pat_idx_list_regm,
 };
@@ -138,8 +140,77 @@ static THREAD_LOCAL struct sample_data static_sample_data;
 /* This is the root of the list of all pattern_ref avalaibles. */
 struct list pattern_reference = LIST_HEAD_INIT(pattern_reference);
 
+/* Incremented each time the patterns of a reference flagged PAT_REF_INDEXED
+ * change, so that the external indexes built from them know they are stale.
+ */
+unsigned int pat_ref_indexed_rev = 0;
+
 static THREAD_LOCAL struct lru64_head *pat_lru_tree;
 static unsigned long long pat_lru_seed __read_mostly;
+static THREAD_LOCAL unsigned int pat_lru_probe;     /* 0, or 1/2 when probing without/with the cache */
+static THREAD_LOCAL unsigned long long pat_lru_start; /* start date of the probed lookup */
+
+/* Decides whether the pattern cache is worth using for <expr> by comparing the
+ * cycles spent in the last probes without and with it.
+ */
+static void pat_lru_decide(struct pattern_expr *expr)
+{
+	unsigned long long off = HA_ATOMIC_XCHG(&expr->lru_cost[0], 0);
+	unsigned long long on  = HA_ATOMIC_XCHG(&expr->lru_cost[1], 0);
+
+	HA_ATOMIC_STORE(&expr->lru_off, on > off);
+}
+
+/* Looks up the result of matching <smp> against <expr> in the pattern cache.
+ * Returns the cache entry, whose domain is set if the result is known, or NULL
+ * if the cache is not used for this lookup. The matching function must then
+ * pass its result through pat_lru_done(). The first lookups of each period
+ * are used to measure their cost without, then with the cache, and the
+ * cheapest method is used for the rest of the period.
+ */
+static inline struct lru64 *pat_lru_lookup(struct sample *smp, struct pattern_expr *expr)
+{
+	unsigned long long seed;
+	struct lru64 *lru;
+	unsigned int n;
+
+	if (!pat_lru_tree)
+		return NULL;
+
+	n = HA_ATOMIC_FETCH_ADD(&expr->lru_calls, 1) & (PAT_LRU_PERIOD - 1);
+	if (unlikely(n < 2 * PAT_LRU_PROBE)) {
+		pat_lru_probe = 1 + (n >= PAT_LRU_PROBE);
+		pat_lru_start = rdtsc();
+		if (pat_lru_probe == 1)
+			return NULL;
+	}
+	else {
+		if (unlikely(n == 2 * PAT_LRU_PROBE))
+			pat_lru_decide(expr);
+		pat_lru_probe = 0;
+		if (HA_ATOMIC_LOAD(&expr->lru_off))
+			return NULL;
+	}
+
+	seed = pat_lru_seed ^ (long)expr;
+	lru = lru64_get(XXH3(smp->data.u.str.area, smp->data.u.str.data, seed),
+	                pat_lru_tree, expr, expr->ref->revision);
+	if (lru && lru->domain)
+		HA_ATOMIC_INC(&expr->lru_hits);
+	else
+		HA_ATOMIC_INC(&expr->lru_misses);
+	return lru;
+}
+
+/* Accounts for the cost of the lookup in <expr> if it was probed, and returns
+ * its result <ret>.
+ */
+static inline struct pattern *pat_lru_done(struct pattern_expr *expr, struct pattern *ret)
+{
+	if (unlikely(pat_lru_probe))
+		HA_ATOMIC_ADD(&expr->lru_cost[pat_lru_probe - 1], rdtsc() - pat_lru_start);
+	return ret;
+}
 
 /*
  *
@@ -170,6 +241,848 @@ static inline unsigned int make_4delim(unsigned char d1, unsigned char d2, unsig
 	return d1 << 24 | d2 << 16 | d3 << 8 | d4;
 }
 
+/* Aho-Corasick automaton built over the string patterns of an expression's
+ * list, so that all of them are looked up in a single pass over the sample.
+ * The states are those of the patterns' prefix tree. Their edges are stored
+ * sorted by byte in the <key>/<next> arrays, from <edges> to <edges>+<nb_edges>,
+ * except for the root whose transitions are all in <root>. The patterns ending
+ * on a state are in <pats>, in the list order, which is also their <rank>.
+ * Matching must return the first pattern of the list which matches, so each
+ * state also knows the lowest rank of the patterns ending on it or on any state
+ * of its output chain, which allows to stop walking the chain early.
+ */
+struct pat_acm_state {
+	unsigned int edges;      /* index of the first edge in key[]/next[] */
+	unsigned int nb_edges;   /* number of edges leaving this state */
+	unsigned int fail;       /* state of the longest proper suffix in the tree */
+	unsigned int out;        /* next state along the fail chain with patterns, or 0 */
+	unsigned int pats;       /* index of the first pattern in pats[]/rank[] */
+	unsigned int nb_pats;    /* number of patterns ending on this state */
+	unsigned int min_rank;   /* lowest rank on this state and its output chain */
+};
+
+struct pat_acm {
+	struct pat_acm_state *states;
+	unsigned char *key;           /* edges' bytes */
+	unsigned int *next;           /* edges' target states */
+	struct pattern **pats;        /* patterns grouped per state */
+	unsigned int *rank;           /* position of each pattern in the list */
+	unsigned int root[256];       /* transitions from the root state (0=none) */
+	int icase;                    /* bytes were folded to lower case */
+};
+
+/* Kinds of lookups supported by pat_acm_lookup() */
+enum pat_acm_mode {
+	PAT_ACM_SUB = 0,              /* pattern anywhere in the sample */
+	PAT_ACM_BEG,                  /* pattern at the beginning of the sample */
+	PAT_ACM_END,                  /* pattern at the end of the sample */
+};
+
+/* Returns the state reached from state <st> with byte <c>, or 0 if there is no
+ * such edge.
+ */
+static inline unsigned int pat_acm_goto(const struct pat_acm *acm, unsigned int st, unsigned char c)
+{
+	const struct pat_acm_state *s = &acm->states[st];
+	const unsigned char *key = acm->key + s->edges;
+	unsigned int l = 0, r = s->nb_edges;
+
+	if (!st)
+		return acm->root[c];
+
+	if (r <= 8) {
+		for (; l < r; l++)
+			if (key[l] == c)
+				return acm->next[s->edges + l];
+		return 0;
+	}
+
+	while (l < r) {
+		unsigned int m = (l + r) / 2;
+
+		if (key[m] == c)
+			return acm->next[s->edges + m];
+		if (key[m] < c)
+			l = m + 1;
+		else
+			r = m;
+	}
+	return 0;
+}
+
+/* Releases the automaton <acm> */
+static void pat_acm_free(struct pat_acm *acm)
+{
+	if (!acm)
+		return;
+	free(acm->states);
+	free(acm->key);
+	free(acm->next);
+	free(acm->pats);
+	free(acm->rank);
+	free(acm);
+}
+
+/* Builds the automaton for the string patterns of <expr>'s list. Returns it,
+ * or NULL on memory allocation error. The list is not modified.
+ */
+static struct pat_acm *pat_acm_build(struct pattern_expr *expr)
+{
+	struct pat_acm *acm;
+	struct pattern_list *lst;
+	unsigned int *child = NULL, *sibling = NULL, *pat_st = NULL, *queue = NULL;
+	unsigned char *chr = NULL;
+	unsigned int nb_pats = 0, nb_states = 1, max_states = 1;
+	unsigned int i, j, st, qh, qt;
+
+	acm = calloc(1, sizeof(*acm));
+	if (!acm)
+		return NULL;
+	acm->icase = !!(expr->mflags & PAT_MF_IGNORE_CASE);
+
+	list_for_each_entry(lst, &expr->patterns, list) {
+		nb_pats++;
+		max_states += lst->pat.len;
+	}
+
+	/* the prefix tree is first built with first-child/next-sibling links */
+	child   = calloc(max_states, sizeof(*child));
+	sibling = calloc(max_states, sizeof(*sibling));
+	chr     = calloc(max_states, sizeof(*chr));
+	pat_st  = calloc(nb_pats + 1, sizeof(*pat_st));
+	queue   = calloc(max_states, sizeof(*queue));
+	acm->states = calloc(max_states, sizeof(*acm->states));
+	acm->pats   = calloc(nb_pats + 1, sizeof(*acm->pats));
+	acm->rank   = calloc(nb_pats + 1, sizeof(*acm->rank));
+	if (!child || !sibling || !chr || !pat_st || !queue ||
+	    !acm->states || !acm->pats || !acm->rank)
+		goto fail;
+
+	i = 0;
+	list_for_each_entry(lst, &expr->patterns, list) {
+		const unsigned char *p = (const unsigned char *)lst->pat.ptr.str;
+
+		st = 0;
+		for (j = 0; j < lst->pat.len; j++) {
+			unsigned char c = acm->icase ? tolower(p[j]) : p[j];
+			unsigned int n;
+
+			if (!st)
+				n = acm->root[c];
+			else
+				for (n = child[st]; n && chr[n] != c; n = sibling[n])
+					;
+
+			if (!n) {
+				n = nb_states++;
+				chr[n] = c;
+				if (!st)
+					acm->root[c] = n;
+				else {
+					sibling[n] = child[st];
+					child[st] = n;
+				}
+			}
+			st = n;
+		}
+		pat_st[i++] = st;
+		acm->states[st].nb_pats++;
+	}
+
+	/* assign the patterns to their states, keeping the list order */
+	for (st = 0, j = 0; st < nb_states; st++) {
+		acm->states[st].pats = j;
+		j += acm->states[st].nb_pats;
+		acm->states[st].nb_pats = 0;
+		acm->states[st].min_rank = ~0U;
+	}
+
+	i = 0;
+	list_for_each_entry(lst, &expr->patterns, list) {
+		struct pat_acm_state *s = &acm->states[pat_st[i]];
+
+		acm->pats[s->pats + s->nb_pats] = &lst->pat;
+		acm->rank[s->pats + s->nb_pats] = i;
+		if (!s->nb_pats++)
+			s->min_rank = i;
+		i++;
+	}
+
+	/* flatten the edges, sorted by byte */
+	acm->key  = calloc(nb_states, sizeof(*acm->key));
+	acm->next = calloc(nb_states, sizeof(*acm->next));
+	if (!acm->key || !acm->next)
+		goto fail;
+
+	for (st = 1, j = 0; st < nb_states; st++) {
+		unsigned int n, k;
+
+		acm->states[st].edges = j;
+		for (n = child[st]; n; n = sibling[n]) {
+			for (k = j; k > acm->states[st].edges && acm->key[k - 1] > chr[n]; k--) {
+				acm->key[k]  = acm->key[k - 1];
+				acm->next[k] = acm->next[k - 1];
+			}
+			acm->key[k]  = chr[n];
+			acm->next[k] = n;
+			j++;
+		}
+		acm->states[st].nb_edges = j - acm->states[st].edges;
+	}
+
+	/* set the fail and output links breadth-first, so that the fail state
+	 * of each state is always complete when it is visited. The root's own
+	 * patterns (empty strings) are handled apart by the lookup.
+	 */
+	qh = qt = 0;
+	for (i = 0; i < 256; i++) {
+		if (acm->root[i])
+			queue[qt++] = acm->root[i];
+	}
+
+	while (qh < qt) {
+		struct pat_acm_state *s;
+		unsigned int k, f, n;
+
+		st = queue[qh++];
+		s = &acm->states[st];
+
+		if (s->fail) {
+			struct pat_acm_state *fs = &acm->states[s->fail];
+
+			s->out = fs->nb_pats ? s->fail : fs->out;
+			if (fs->min_rank < s->min_rank)
+				s->min_rank = fs->min_rank;
+		}
+
+		for (k = s->edges; k < s->edges + s->nb_edges; k++) {
+			n = acm->next[k];
+			for (f = s->fail; f && !pat_acm_goto(acm, f, acm->key[k]); f = acm->states[f].fail)
+				;
+			acm->states[n].fail = pat_acm_goto(acm, f, acm->key[k]);
+			queue[qt++] = n;
+		}
+	}
+
+	free(child);
+	free(sibling);
+	free(chr);
+	free(pat_st);
+	free(queue);
+	return acm;
+
+ fail:
+	free(child);
+	free(sibling);
+	free(chr);
+	free(pat_st);
+	free(queue);
+	pat_acm_free(acm);
+	return NULL;
+}
+
+/* Returns the automaton of <expr>, building it if needed, or NULL if it is not
+ * available, in which case the caller has to scan the list. It must be called
+ * with the expression at least read-locked: it may be built concurrently with
+ * other readers but is only released under the write lock (pat_cidx_drop()).
+ * A single thread builds it at once, and a failed build is not retried until
+ * the list changes.
+ */
+static struct pat_acm *pat_acm_get(struct pattern_expr *expr)
+{
+	struct pat_acm *acm = HA_ATOMIC_LOAD(&expr->acm);
+
+	if (likely(acm))
+		return acm;
+
+	if (LIST_ISEMPTY(&expr->patterns) || HA_ATOMIC_XCHG(&expr->cidx_busy, 1))
+		return NULL;
+
+	acm = pat_acm_build(expr);
+	if (acm) {
+		HA_ATOMIC_STORE(&expr->acm, acm);
+		HA_ATOMIC_STORE(&expr->cidx_busy, 0);
+	}
+	return acm;
+}
+
+/* Considers the patterns ending on state <st> as candidates, and updates
+ * <best>/<best_rank> with the first one in the list order which belongs to
+ * the current generation <gen> and comes before <best_rank>.
+ */
+static inline void pat_acm_check(const struct pat_acm *acm, unsigned int st, unsigned int gen,
+                                 struct pattern **best, unsigned int *best_rank)
+{
+	const struct pat_acm_state *s = &acm->states[st];
+	unsigned int k;
+
+	for (k = s->pats; k < s->pats + s->nb_pats; k++) {
+		if (acm->rank[k] >= *best_rank)
+			break;
+		if (acm->pats[k]->ref->gen_id != gen)
+			continue;
+		*best = acm->pats[k];
+		*best_rank = acm->rank[k];
+		break;
+	}
+}
+
+/* Looks up the <len> bytes at <str> in automaton <acm> according to <mode>,
+ * and returns the first pattern of the list in generation <gen> which is
+ * respectively included in, at the beginning of, or at the end of the string,
+ * or NULL if none matches.
+ */
+static struct pattern *pat_acm_lookup(const struct pat_acm *acm, const char *str, size_t len,
+                                      enum pat_acm_mode mode, unsigned int gen)
+{
+	struct pattern *best = NULL;
+	unsigned int best_rank = ~0U;
+	unsigned int st = 0, n;
+	size_t i;
+
+	/* empty patterns match anything */
+	pat_acm_check(acm, 0, gen, &best, &best_rank);
+
+	for (i = 0; i < len; i++) {
+		unsigned char c = acm->icase ? tolower((unsigned char)str[i]) : (unsigned char)str[i];
+
+		if (mode == PAT_ACM_BEG) {
+			/* only the path from the root matters */
+			st = pat_acm_goto(acm, st, c);
+			if (!st)
+				break;
+			if (acm->states[st].min_rank < best_rank)
+				pat_acm_check(acm, st, gen, &best, &best_rank);
+			continue;
+		}
+
+		while (st && !(n = pat_acm_goto(acm, st, c)))
+			st = acm->states[st].fail;
+		st = st ? n : acm->root[c];
+
+		if (mode != PAT_ACM_SUB)
+			continue;
+
+		for (n = st; n && acm->states[n].min_rank < best_rank; n = acm->states[n].out)
+			pat_acm_check(acm, n, gen, &best, &best_rank);
+		if (!best_rank)
+			break;
+	}
+
+	if (mode == PAT_ACM_END) {
+		/* the output chain of the last state lists all suffixes */
+		for (n = st; n && acm->states[n].min_rank < best_rank; n = acm->states[n].out)
+			pat_acm_check(acm, n, gen, &best, &best_rank);
+	}
+	return best;
+}
+
+/* Set of regex compiled from the patterns of an expression's list, used to
+ * find in a single pass whether any of them matches. The patterns are kept in
+ * <pats> in the list order, and are split into groups of consecutive patterns
+ * which share a single combined regex in <reg>, or which have to be evaluated
+ * one at a time if it could not be built (<reg> is NULL).
+ */
+#define PAT_REGSET_GRP_SIZE 64
+
+struct pat_regset_grp {
+	unsigned int first;           /* index of the first pattern in pats[] */
+	unsigned int nb;              /* number of patterns in the group */
+	struct my_regex *reg;         /* combined regex, or NULL */
+};
+
+struct pat_regset {
+	struct pattern **pats;        /* all patterns, in the list order */
+	struct pat_regset_grp *grps;
+	unsigned int nb_grps;
+};
+
+/* Releases the regex set <set> */
+static void pat_regset_free(struct pat_regset *set)
+{
+	unsigned int i;
+
+	if (!set)
+		return;
+	for (i = 0; i < set->nb_grps; i++)
+		regex_free(set->grps[i].reg);
+	free(set->grps);
+	free(set->pats);
+	free(set);
+}
+
+/* Builds the regex set for the regex patterns of <expr>'s list, whose sources
+ * are taken from their reference. Patterns which cannot be combined are placed
+ * alone in their group. Returns the set or NULL on memory allocation error.
+ */
+static struct pat_regset *pat_regset_build(struct pattern_expr *expr)
+{
+	struct pat_regset *set;
+	struct pat_regset_grp *grp = NULL;
+	struct pattern_list *lst;
+	const char **strs = NULL;
+	unsigned int nb_pats = 0, i;
+	char *err = NULL;
+
+	list_for_each_entry(lst, &expr->patterns, list)
+		nb_pats++;
+
+	set = calloc(1, sizeof(*set));
+	if (!set)
+		return NULL;
+
+	set->pats = calloc(nb_pats, sizeof(*set->pats));
+	set->grps = calloc(nb_pats, sizeof(*set->grps));
+	strs = calloc(PAT_REGSET_GRP_SIZE, sizeof(*strs));
+	if (!set->pats || !set->grps || !strs)
+		goto fail;
+
+	i = 0;
+	list_for_each_entry(lst, &expr->patterns, list) {
+		const char *str = lst->pat.ref->pattern;
+		int alone = !str || !regex_set_compatible(str);
+
+		set->pats[i] = &lst->pat;
+		if (alone || !grp || grp->nb >= PAT_REGSET_GRP_SIZE) {
+			grp = &set->grps[set->nb_grps++];
+			grp->first = i;
+		}
+		grp->nb++;
+		i++;
+
+		/* patterns which cannot be combined are evaluated alone */
+		if (alone)
+			grp = NULL;
+	}
+
+	/* now compile the groups of several patterns */
+	for (i = 0; i < set->nb_grps; i++) {
+		unsigned int j;
+
+		grp = &set->grps[i];
+		if (grp->nb < 2)
+			continue;
+
+		for (j = 0; j < grp->nb; j++)
+			strs[j] = set->pats[grp->first + j]->ref->pattern;
+
+		/* on failure the group is evaluated one pattern at a time */
+		grp->reg = regex_comp_set(strs, grp->nb, !(expr->mflags & PAT_MF_IGNORE_CASE), &err);
+		ha_free(&err);
+	}
+
+	free(strs);
+	return set;
+
+ fail:
+	free(strs);
+	pat_regset_free(set);
+	return NULL;
+}
+
+/* Returns the regex set of <expr>, building it if needed, or NULL if it is not
+ * available, in which case the caller has to scan the list. The same rules as
+ * for pat_acm_get() apply. Regex can only be combined with PCRE and PCRE2.
+ */
+static struct pat_regset *pat_regset_get(struct pattern_expr *expr)
+{
+	struct pat_regset *set = HA_ATOMIC_LOAD(&expr->regset);
+
+#if !defined(USE_PCRE) && !defined(USE_PCRE2)
+	/* regex cannot be combined */
+	return NULL;
+#endif
+	if (likely(set))
+		return set;
+
+	if (LIST_ISEMPTY(&expr->patterns) || HA_ATOMIC_XCHG(&expr->cidx_busy, 1))
+		return NULL;
+
+	set = pat_regset_build(expr);
+	if (set) {
+		HA_ATOMIC_STORE(&expr->regset, set);
+		HA_ATOMIC_STORE(&expr->cidx_busy, 0);
+	}
+	return set;
+}
+
+/* Looks up the <len> bytes at <str> in regex set <set>, and returns the first
+ * pattern of the list in generation <gen> which matches, or NULL if none does.
+ * A combined regex reports the pattern matching at the leftmost position, so
+ * the patterns which precede it in its group still have to be tried alone.
+ * <str> must be writable and at least <len>+1 bytes long.
+ */
+static struct pattern *pat_regset_lookup(const struct pat_regset *set, char *str, int len,
+                                         unsigned int gen)
+{
+	unsigned int g, i, last;
+	int idx;
+
+	for (g = 0; g < set->nb_grps; g++) {
+		const struct pat_regset_grp *grp = &set->grps[g];
+
+		i = grp->first;
+		last = grp->first + grp->nb;
+		if (grp->reg) {
+			idx = regex_exec_set(grp->reg, str, len);
+			if (idx < 0)
+				continue;
+
+			if ((unsigned int)idx < grp->nb) {
+				/* pattern <idx> is known to match */
+				for (; i < grp->first + idx; i++) {
+					if (set->pats[i]->ref->gen_id == gen &&
+					    regex_exec2(set->pats[i]->ptr.reg, str, len))
+						return set->pats[i];
+				}
+
+				if (set->pats[i]->ref->gen_id == gen)
+					return set->pats[i];
+				i++;
+			}
+		}
+
+		for (; i < last; i++) {
+			if (set->pats[i]->ref->gen_id == gen &&
+			    regex_exec2(set->pats[i]->ptr.reg, str, len))
+				return set->pats[i];
+		}
+	}
+	return NULL;
+}
+
+/* Flat index of the IP trees of an expression. Each family's networks from
+ * the current generation are flattened into sorted non-overlapping ranges,
+ * each one pointing to the most specific network covering it (or NULL), so
+ * that a lookup is a binary search. <dir> gives for each value of the 16
+ * highest bits of an address the range containing the first address with
+ * these bits, so that the search is only performed on the few ranges starting
+ * in the same block. Only families with at least PAT_IPIDX_MIN networks are
+ * indexed, the other ones are looked up in their tree. Since it has to be
+ * rebuilt after each change, it is only built once the expression was left
+ * unchanged for PAT_IPIDX_DELAY seconds.
+ */
+#define PAT_IPIDX_MIN    64
+#define PAT_IPIDX_DELAY  1
+#define PAT_IPIDX_BITS   16
+
+/* a 32 or 128-bit address in host order */
+struct pat_ipidx_key {
+	uint64_t hi, lo;
+};
+
+/* a network being flattened */
+struct pat_ipidx_net {
+	struct pat_ipidx_key from, to;
+	struct pattern_tree *elt;
+	unsigned int ord;             /* position in the tree, for duplicates */
+	unsigned int pfx;
+};
+
+struct pat_ipidx_fam {
+	unsigned int nb;              /* number of ranges, 0 if not indexed */
+	unsigned int *dir;            /* (1 << PAT_IPIDX_BITS) + 1 entries */
+	uint32_t *from4;              /* IPv4 range starts */
+	struct pat_ipidx_key *from6;  /* IPv6 range starts */
+	struct pattern_tree **elt;    /* network of each range, or NULL */
+};
+
+struct pat_ipidx {
+	struct pat_ipidx_fam v4, v6;
+	unsigned int gen;             /* indexed generation */
+};
+
+static inline int pat_ipidx_cmp(const struct pat_ipidx_key *a, const struct pat_ipidx_key *b)
+{
+	if (a->hi != b->hi)
+		return a->hi < b->hi ? -1 : 1;
+	if (a->lo != b->lo)
+		return a->lo < b->lo ? -1 : 1;
+	return 0;
+}
+
+/* sorts networks by start, then larger first, then in tree order */
+static int pat_ipidx_net_cmp(const void *a, const void *b)
+{
+	const struct pat_ipidx_net *na = a, *nb = b;
+	int ret = pat_ipidx_cmp(&na->from, &nb->from);
+
+	if (ret)
+		return ret;
+	if (na->pfx != nb->pfx)
+		return na->pfx < nb->pfx ? -1 : 1;
+	return na->ord < nb->ord ? -1 : 1;
+}
+
+static void pat_ipidx_free_fam(struct pat_ipidx_fam *fam)
+{
+	free(fam->dir);
+	free(fam->from4);
+	free(fam->from6);
+	free(fam->elt);
+}
+
+/* Releases the IP index <idx> */
+static void pat_ipidx_free(struct pat_ipidx *idx)
+{
+	if (!idx)
+		return;
+	pat_ipidx_free_fam(&idx->v4);
+	pat_ipidx_free_fam(&idx->v6);
+	free(idx);
+}
+
+/* Appends to <fam> a range starting at <from> and pointing to <elt>, merging
+ * it with the previous ones when possible.
+ */
+static void pat_ipidx_emit(struct pat_ipidx_fam *fam, struct pat_ipidx_key *from,
+                           struct pat_ipidx_key *starts, struct pattern_tree *elt)
+{
+	unsigned int n = fam->nb;
+
+	if (n && pat_ipidx_cmp(&starts[n - 1], from) == 0) {
+		/* replaces an empty range */
+		fam->elt[n - 1] = elt;
+		if (n > 1 && fam->elt[n - 2] == elt)
+			fam->nb--;
+		return;
+	}
+	if (n && fam->elt[n - 1] == elt)
+		return;
+	starts[n] = *from;
+	fam->elt[n] = elt;
+	fam->nb++;
+}
+
+/* Flattens the networks of the current generation <gen> found in tree <root>
+ * holding <width>-bit keys into <fam>. Returns 0 on memory error, otherwise
+ * non-zero, with <fam> left empty if there are too few networks.
+ */
+static int pat_ipidx_build_fam(struct pat_ipidx_fam *fam, struct eb_root *root,
+                               int width, unsigned int gen)
+{
+	struct pat_ipidx_net *nets = NULL, **stack = NULL;
+	struct pat_ipidx_key *starts = NULL;
+	struct pat_ipidx_key max, key, bound;
+	struct pattern_tree *elt;
+	struct ebmb_node *node;
+	unsigned int nb = 0, depth = 0, i, b;
+	int hbits;
+
+	for (node = ebmb_first(root); node; node = ebmb_next(node)) {
+		if (ebmb_entry(node, struct pattern_tree, node)->ref->gen_id == gen)
+			nb++;
+	}
+	if (nb < PAT_IPIDX_MIN)
+		return 1;
+
+	nets = calloc(nb, sizeof(*nets));
+	stack = calloc(nb, sizeof(*stack));
+	starts = calloc(2 * nb + 1, sizeof(*starts));
+	fam->elt = calloc(2 * nb + 1, sizeof(*fam->elt));
+	fam->dir = calloc((1 << PAT_IPIDX_BITS) + 1, sizeof(*fam->dir));
+	if (!nets || !stack || !starts || !fam->elt || !fam->dir)
+		goto fail;
+
+	nb = 0;
+	for (node = ebmb_first(root); node; node = ebmb_next(node)) {
+		struct pat_ipidx_key mask = { 0, 0 };
+
+		elt = ebmb_entry(node, struct pattern_tree, node);
+		if (elt->ref->gen_id != gen)
+			continue;
+
+		if (width == 32) {
+			key.hi = 0;
+			key.lo = read_n32(node->key);
+		} else {
+			key.hi = read_n64(node->key);
+			key.lo = read_n64(node->key + 8);
+		}
+
+		/* mask of the host part */
+		hbits = width - node->node.pfx;
+		if (hbits >= 64) {
+			mask.lo = ~0ULL;
+			mask.hi = hbits == 64 ? 0 : ~0ULL >> (128 - hbits);
+		}
+		else if (hbits > 0)
+			mask.lo = ~0ULL >> (64 - hbits);
+
+		nets[nb].from.hi = key.hi & ~mask.hi;
+		nets[nb].from.lo = key.lo & ~mask.lo;
+		nets[nb].to.hi   = key.hi | mask.hi;
+		nets[nb].to.lo   = key.lo | mask.lo;
+		nets[nb].elt = elt;
+		nets[nb].ord = nb;
+		nets[nb].pfx = node->node.pfx;
+		nb++;
+	}
+	qsort(nets, nb, sizeof(*nets), pat_ipidx_net_cmp);
+
+	max.hi = width == 32 ? 0 : ~0ULL;
+	max.lo = width == 32 ? 0xffffffffULL : ~0ULL;
+
+	/* The networks are either nested or disjoint. Each one starts a range
+	 * which lasts until the next one starts or it ends, then the enclosing
+	 * network continues. Identical networks are ignored after the first
+	 * one, which is the one the tree would return.
+	 */
+	key.hi = key.lo = 0;
+	pat_ipidx_emit(fam, &key, starts, NULL);
+	for (i = 0; i <= nb; i++) {
+		while (depth && (i == nb || pat_ipidx_cmp(&stack[depth - 1]->to, &nets[i].from) < 0)) {
+			key = stack[--depth]->to;
+			if (pat_ipidx_cmp(&key, &max) == 0)
+				continue;
+			if (!++key.lo)
+				key.hi++;
+			pat_ipidx_emit(fam, &key, starts, depth ? stack[depth - 1]->elt : NULL);
+		}
+		if (i == nb)
+			break;
+
+		if (depth && stack[depth - 1]->pfx == nets[i].pfx &&
+		    pat_ipidx_cmp(&stack[depth - 1]->from, &nets[i].from) == 0)
+			continue;
+
+		pat_ipidx_emit(fam, &nets[i].from, starts, nets[i].elt);
+		stack[depth++] = &nets[i];
+	}
+
+	/* index the ranges by their highest bits */
+	for (b = i = 0; b < (1 << PAT_IPIDX_BITS); b++) {
+		bound.hi = width == 32 ? 0 : (uint64_t)b << (64 - PAT_IPIDX_BITS);
+		bound.lo = width == 32 ? (uint64_t)b << (32 - PAT_IPIDX_BITS) : 0;
+		while (i + 1 < fam->nb && pat_ipidx_cmp(&starts[i + 1], &bound) <= 0)
+			i++;
+		fam->dir[b] = i;
+	}
+	fam->dir[b] = fam->nb - 1;
+
+	if (width == 32) {
+		fam->from4 = calloc(fam->nb, sizeof(*fam->from4));
+		if (!fam->from4)
+			goto fail;
+		for (i = 0; i < fam->nb; i++)
+			fam->from4[i] = starts[i].lo;
+		free(starts);
+	}
+	else
+		fam->from6 = starts;
+
+	free(stack);
+	free(nets);
+	return 1;
+
+ fail:
+	free(starts);
+	free(stack);
+	free(nets);
+	pat_ipidx_free_fam(fam);
+	memset(fam, 0, sizeof(*fam));
+	return 0;
+}
+
+/* Builds the IP index of <expr>. Returns NULL on memory error or if no
+ * family has enough networks.
+ */
+static struct pat_ipidx *pat_ipidx_build(struct pattern_expr *expr)
+{
+	struct pat_ipidx *idx;
+
+	idx = calloc(1, sizeof(*idx));
+	if (!idx)
+		return NULL;
+
+	idx->gen = expr->ref->curr_gen;
+	if (!pat_ipidx_build_fam(&idx->v4, &expr->pattern_tree, 32, idx->gen) ||
+	    !pat_ipidx_build_fam(&idx->v6, &expr->pattern_tree_2, 128, idx->gen) ||
+	    (!idx->v4.nb && !idx->v6.nb)) {
+		pat_ipidx_free(idx);
+		return NULL;
+	}
+	return idx;
+}
+
+/* Returns the IP index of <expr>, building it if needed, or NULL if it is not
+ * available, in which case the caller has to look up the trees. The same rules
+ * as for pat_acm_get() apply, except that it is not built before the
+ * expression has been left unchanged for a while, and that it is ignored once
+ * another generation has been committed.
+ */
+static struct pat_ipidx *pat_ipidx_get(struct pattern_expr *expr)
+{
+	struct pat_ipidx *idx = HA_ATOMIC_LOAD(&expr->ipidx);
+
+	if (likely(idx))
+		return idx->gen == expr->ref->curr_gen ? idx : NULL;
+
+	if ((unsigned int)now.tv_sec - HA_ATOMIC_LOAD(&expr->cidx_date) <= PAT_IPIDX_DELAY ||
+	    HA_ATOMIC_XCHG(&expr->cidx_busy, 1))
+		return NULL;
+
+	idx = pat_ipidx_build(expr);
+	if (idx) {
+		HA_ATOMIC_STORE(&expr->ipidx, idx);
+		HA_ATOMIC_STORE(&expr->cidx_busy, 0);
+	}
+	return idx;
+}
+
+/* Returns the network of IPv4 index <fam> containing <addr> (host order), or
+ * NULL if there is none.
+ */
+static inline struct pattern_tree *pat_ipidx_lookup4(const struct pat_ipidx_fam *fam, uint32_t addr)
+{
+	unsigned int b = addr >> (32 - PAT_IPIDX_BITS);
+	unsigned int lo = fam->dir[b], hi = fam->dir[b + 1], mid;
+
+	while (lo < hi) {
+		mid = (lo + hi + 1) / 2;
+		if (fam->from4[mid] <= addr)
+			lo = mid;
+		else
+			hi = mid - 1;
+	}
+	return fam->elt[lo];
+}
+
+/* Returns the network of IPv6 index <fam> containing <addr> (network order),
+ * or NULL if there is none.
+ */
+static inline struct pattern_tree *pat_ipidx_lookup6(const struct pat_ipidx_fam *fam, const void *addr)
+{
+	struct pat_ipidx_key key = { .hi = read_n64(addr), .lo = read_n64((const char *)addr + 8) };
+	unsigned int b = key.hi >> (64 - PAT_IPIDX_BITS);
+	unsigned int lo = fam->dir[b], hi = fam->dir[b + 1], mid;
+
+	while (lo < hi) {
+		mid = (lo + hi + 1) / 2;
+		if (pat_ipidx_cmp(&fam->from6[mid], &key) <= 0)
+			lo = mid;
+		else
+			hi = mid - 1;
+	}
+	return fam->elt[lo];
+}
+
+/* Releases the compiled indexes (automaton, regex set, IP index) of <expr>
+ * after a change to its patterns. They will be rebuilt on next lookup. The
+ * expression must be write-locked.
+ */
+static inline void pat_cidx_drop(struct pattern_expr *expr)
+{
+	pat_acm_free(expr->acm);
+	expr->acm = NULL;
+	pat_regset_free(expr->regset);
+	expr->regset = NULL;
+	pat_ipidx_free(expr->ipidx);
+	expr->ipidx = NULL;
+	expr->cidx_busy = 0;
+	expr->cidx_date = now.tv_sec;
+}
+
 
 /*
  *
@@ -491,16 +1404,9 @@ struct pattern *pat_match_str(struct sample *smp, struct pattern_expr *expr, int
 	}
 
 	/* look in the list */
-	if (pat_lru_tree) {
-		unsigned long long seed = pat_lru_seed ^ (long)expr;
-
-		lru = lru64_get(XXH3(smp->data.u.str.area, smp->data.u.str.data, seed),
-				pat_lru_tree, expr, expr->ref->revision);
-		if (lru && lru->domain) {
-			ret = lru->data;
-			return ret;
-		}
-	}
+	lru = pat_lru_lookup(smp, expr);
+	if (lru && lru->domain)
+		return pat_lru_done(expr, lru->data);
 
 
 	list_for_each_entry(lst, &expr->patterns, list) {
@@ -523,7 +1429,7 @@ struct pattern *pat_match_str(struct sample *smp, struct pattern_expr *expr, int
 	if (lru)
 		lru64_commit(lru, ret, expr, expr->ref->revision, NULL);
 
-	return ret;
+	return pat_lru_done(expr, ret);
 }
 
 /* NB: For two binaries buf to be identical, it is required that their lengths match */
@@ -534,16 +1440,9 @@ struct pattern *pat_match_bin(struct sample *smp, struct pattern_expr *expr, int
 	struct pattern *ret = NULL;
 	struct lru64 *lru = NULL;
 
-	if (pat_lru_tree) {
-		unsigned long long seed = pat_lru_seed ^ (long)expr;
-
-		lru = lru64_get(XXH3(smp->data.u.str.area, smp->data.u.str.data, seed),
-				pat_lru_tree, expr, expr->ref->revision);
-		if (lru && lru->domain) {
-			ret = lru->data;
-			return ret;
-		}
-	}
+	lru = pat_lru_lookup(smp, expr);
+	if (lru && lru->domain)
+		return pat_lru_done(expr, lru->data);
 
 	list_for_each_entry(lst, &expr->patterns, list) {
 		pattern = &lst->pat;
@@ -563,7 +1462,7 @@ struct pattern *pat_match_bin(struct sample *smp, struct pattern_expr *expr, int
 	if (lru)
 		lru64_commit(lru, ret, expr, expr->ref->revision, NULL);
 
-	return ret;
+	return pat_lru_done(expr, ret);
 }
 
 /* Executes a regex. It temporarily changes the data to add a trailing zero,
@@ -594,7 +1493,9 @@ struct pattern *pat_match_regm(struct sample *smp, struct pattern_expr *expr, in
 }
 
 /* Executes a regex. It temporarily changes the data to add a trailing zero,
- * and restores the previous character when leaving.
+ * and restores the previous character when leaving. When possible, the list's
+ * regex are combined into a few ones so that a non-matching sample is only
+ * scanned once per group of patterns.
  */
 struct pattern *pat_match_reg(struct sample *smp, struct pattern_expr *expr, int fill)
 {
@@ -602,16 +1503,17 @@ struct pattern *pat_match_reg(struct sample *smp, struct pattern_expr *expr, int
 	struct pattern *pattern;
 	struct pattern *ret = NULL;
 	struct lru64 *lru = NULL;
+	struct pat_regset *set;
 
-	if (pat_lru_tree) {
-		unsigned long long seed = pat_lru_seed ^ (long)expr;
+	lru = pat_lru_lookup(smp, expr);
+	if (lru && lru->domain)
+		return pat_lru_done(expr, lru->data);
 
-		lru = lru64_get(XXH3(smp->data.u.str.area, smp->data.u.str.data, seed),
-				pat_lru_tree, expr, expr->ref->revision);
-		if (lru && lru->domain) {
-			ret = lru->data;
-			return ret;
-		}
+	set = pat_regset_get(expr);
+	if (set) {
+		ret = pat_regset_lookup(set, smp->data.u.str.area, smp->data.u.str.data,
+		                        expr->ref->curr_gen);
+		goto leave;
 	}
 
 	list_for_each_entry(lst, &expr->patterns, list) {
@@ -626,10 +1528,11 @@ struct pattern *pat_match_reg(struct sample *smp, struct pattern_expr *expr, int
 		}
 	}
 
+ leave:
 	if (lru)
 		lru64_commit(lru, ret, expr, expr->ref->revision, NULL);
 
-	return ret;
+	return pat_lru_done(expr, ret);
 }
 
 /* Checks that the pattern matches the beginning of the tested string. */
@@ -642,6 +1545,7 @@ struct pattern *pat_match_beg(struct sample *smp, struct pattern_expr *expr, int
 	struct pattern *pattern;
 	struct pattern *ret = NULL;
 	struct lru64 *lru = NULL;
+	struct pat_acm *acm;
 
 	/* Lookup a string in the expression's pattern tree. */
 	if (!eb_is_empty(&expr->pattern_tree)) {
@@ -686,15 +1590,15 @@ struct pattern *pat_match_beg(struct sample *smp, struct pattern_expr *expr, int
 	}
 
 	/* look in the list */
-	if (pat_lru_tree) {
-		unsigned long long seed = pat_lru_seed ^ (long)expr;
+	lru = pat_lru_lookup(smp, expr);
+	if (lru && lru->domain)
+		return pat_lru_done(expr, lru->data);
 
-		lru = lru64_get(XXH3(smp->data.u.str.area, smp->data.u.str.data, seed),
-				pat_lru_tree, expr, expr->ref->revision);
-		if (lru && lru->domain) {
-			ret = lru->data;
-			return ret;
-		}
+	acm = pat_acm_get(expr);
+	if (acm) {
+		ret = pat_acm_lookup(acm, smp->data.u.str.area, smp->data.u.str.data,
+		                     PAT_ACM_BEG, expr->ref->curr_gen);
+		goto leave;
 	}
 
 	list_for_each_entry(lst, &expr->patterns, list) {
@@ -715,30 +1619,76 @@ struct pattern *pat_match_beg(struct sample *smp, struct pattern_expr *expr, int
 		break;
 	}
 
+ leave:
 	if (lru)
 		lru64_commit(lru, ret, expr, expr->ref->revision, NULL);
 
-	return ret;
+	return pat_lru_done(expr, ret);
 }
 
 /* Checks that the pattern matches the end of the tested string. */
 struct pattern *pat_match_end(struct sample *smp, struct pattern_expr *expr, int fill)
 {
 	int icase;
+	struct ebmb_node *node;
+	struct pattern_tree *elt;
 	struct pattern_list *lst;
 	struct pattern *pattern;
 	struct pattern *ret = NULL;
 	struct lru64 *lru = NULL;
+	struct pat_acm *acm;
+
+	/* Lookup the reversed string in the expression's pattern tree, which
+	 * holds the reversed patterns, so that the longest suffix is found.
+	 */
+	if (!eb_is_empty(&expr->pattern_tree)) {
+		struct buffer *rev = get_trash_chunk();
+		const char *str = smp->data.u.str.area;
+		size_t len = smp->data.u.str.data;
+		size_t i;
+
+		/* the sample may already be in this chunk */
+		if (str >= rev->area && str < rev->area + rev->size)
+			rev = get_trash_chunk();
+
+		/* longer suffixes cannot match any pattern */
+		if (len >= rev->size) {
+			str += len - (rev->size - 1);
+			len = rev->size - 1;
+		}
+
+		for (i = 0; i < len; i++)
+			rev->area[i] = str[len - 1 - i];
+		rev->area[len] = '\0';
+
+		node = ebmb_lookup_longest(&expr->pattern_tree, rev->area);
+		while (node) {
+			elt = ebmb_entry(node, struct pattern_tree, node);
+			if (elt->ref->gen_id != expr->ref->curr_gen) {
+				node = ebmb_next(node);
+				continue;
+			}
+			if (fill) {
+				static_pattern.data = elt->data;
+				static_pattern.ref = elt->ref;
+				static_pattern.sflags = PAT_SF_TREE;
+				static_pattern.type = SMP_T_STR;
+				/* the original string follows the reversed key */
+				static_pattern.ptr.str = (char *)elt->node.key + elt->node.node.pfx / 8 + 1;
+			}
+			return &static_pattern;
+		}
+	}
 
-	if (pat_lru_tree) {
-		unsigned long long seed = pat_lru_seed ^ (long)expr;
+	lru = pat_lru_lookup(smp, expr);
+	if (lru && lru->domain)
+		return pat_lru_done(expr, lru->data);
 
-		lru = lru64_get(XXH3(smp->data.u.str.area, smp->data.u.str.data, seed),
-				pat_lru_tree, expr, expr->ref->revision);
-		if (lru && lru->domain) {
-			ret = lru->data;
-			return ret;
-		}
+	acm = pat_acm_get(expr);
+	if (acm) {
+		ret = pat_acm_lookup(acm, smp->data.u.str.area, smp->data.u.str.data,
+		                     PAT_ACM_END, expr->ref->curr_gen);
+		goto leave;
 	}
 
 	list_for_each_entry(lst, &expr->patterns, list) {
@@ -759,14 +1709,16 @@ struct pattern *pat_match_end(struct sample *smp, struct pattern_expr *expr, int
 		break;
 	}
 
+ leave:
 	if (lru)
 		lru64_commit(lru, ret, expr, expr->ref->revision, NULL);
 
-	return ret;
+	return pat_lru_done(expr, ret);
 }
 
-/* Checks that the pattern is included inside the tested string.
- * NB: Suboptimal, should be rewritten using a Boyer-Moore method.
+/* Checks that the pattern is included inside the tested string. All the
+ * patterns are looked up at once using the expression's Aho-Corasick automaton,
+ * the list is only scanned if it could not be built.
  */
 struct pattern *pat_match_sub(struct sample *smp, struct pattern_expr *expr, int fill)
 {
@@ -777,16 +1729,17 @@ struct pattern *pat_match_sub(struct sample *smp, struct pattern_expr *expr, int
 	struct pattern *pattern;
 	struct pattern *ret = NULL;
 	struct lru64 *lru = NULL;
+	struct pat_acm *acm;
 
-	if (pat_lru_tree) {
-		unsigned long long seed = pat_lru_seed ^ (long)expr;
+	lru = pat_lru_lookup(smp, expr);
+	if (lru && lru->domain)
+		return pat_lru_done(expr, lru->data);
 
-		lru = lru64_get(XXH3(smp->data.u.str.area, smp->data.u.str.data, seed),
-				pat_lru_tree, expr, expr->ref->revision);
-		if (lru && lru->domain) {
-			ret = lru->data;
-			return ret;
-		}
+	acm = pat_acm_get(expr);
+	if (acm) {
+		ret = pat_acm_lookup(acm, smp->data.u.str.area, smp->data.u.str.data,
+		                     PAT_ACM_SUB, expr->ref->curr_gen);
+		goto leave;
 	}
 
 	list_for_each_entry(lst, &expr->patterns, list) {
@@ -824,7 +1777,7 @@ struct pattern *pat_match_sub(struct sample *smp, struct pattern_expr *expr, int
 	if (lru)
 		lru64_commit(lru, ret, expr, expr->ref->revision, NULL);
 
-	return ret;
+	return pat_lru_done(expr, ret);
 }
 
 /* This one is used by other real functions. It checks that the pattern is
@@ -909,9 +1862,76 @@ struct pattern *pat_match_dir(struct sample *smp, struct pattern_expr *expr, int
  */
 struct pattern *pat_match_dom(struct sample *smp, struct pattern_expr *expr, int fill)
 {
+	unsigned int delimiters = make_4delim('/', '?', '.', ':');
+	struct ebmb_node *node;
+	struct pattern_tree *elt;
 	struct pattern_list *lst;
 	struct pattern *pattern;
 
+	/* The tree holds the patterns stripped from their delimiters. Every
+	 * portion of the string starting at the beginning of a word and ending
+	 * before a delimiter or at the end of the string is looked up, and the
+	 * longest one is kept for the leftmost word start where one matches.
+	 */
+	if (!eb_is_empty(&expr->pattern_tree)) {
+		struct buffer *tmp = get_trash_chunk();
+		size_t len = smp->data.u.str.data;
+		size_t i, j;
+		char *str;
+
+		/* the sample may already be in this chunk */
+		if (smp->data.u.str.area >= tmp->area && smp->data.u.str.area < tmp->area + tmp->size)
+			tmp = get_trash_chunk();
+
+		/* longer strings are only matched on their beginning */
+		if (len >= tmp->size)
+			len = tmp->size - 1;
+		memcpy(tmp->area, smp->data.u.str.area, len);
+		tmp->area[len] = '\0';
+		str = tmp->area;
+
+		for (i = 0; i < len; i++) {
+			struct ebmb_node *best = NULL;
+
+			if (is_delimiter(str[i], delimiters) ||
+			    (i && !is_delimiter(str[i - 1], delimiters)))
+				continue;
+
+			/* zeroes cannot be part of a pattern */
+			for (j = i + 1; j <= len && str[j - 1]; j++) {
+				char c = str[j];
+
+				if (j < len && !is_delimiter(c, delimiters))
+					continue;
+
+				str[j] = '\0';
+				node = ebst_lookup(&expr->pattern_tree, str + i);
+				str[j] = c;
+
+				while (node) {
+					elt = ebmb_entry(node, struct pattern_tree, node);
+					if (elt->ref->gen_id == expr->ref->curr_gen) {
+						best = node;
+						break;
+					}
+					node = ebmb_next_dup(node);
+				}
+			}
+
+			if (best) {
+				elt = ebmb_entry(best, struct pattern_tree, node);
+				if (fill) {
+					static_pattern.data = elt->data;
+					static_pattern.ref = elt->ref;
+					static_pattern.sflags = PAT_SF_TREE;
+					static_pattern.type = SMP_T_STR;
+					static_pattern.ptr.str = (char *)elt->node.key;
+				}
+				return &static_pattern;
+			}
+		}
+	}
+
 	list_for_each_entry(lst, &expr->patterns, list) {
 		pattern = &lst->pat;
 
@@ -962,40 +1982,98 @@ struct pattern *pat_match_len(struct sample *smp, struct pattern_expr *expr, int
 	return NULL;
 }
 
+/* Returns the IPv4 network of <expr> containing <addr> (network order) in the
+ * current generation using its IP index <idx> if not NULL, or its tree, or
+ * NULL if there is none.
+ */
+static struct pattern_tree *pat_lookup_ip4(struct pattern_expr *expr, const struct pat_ipidx *idx,
+                                           const void *addr)
+{
+	struct ebmb_node *node;
+	struct pattern_tree *elt;
+
+	if (idx && idx->v4.nb)
+		return pat_ipidx_lookup4(&idx->v4, read_n32(addr));
+
+	node = ebmb_lookup_longest(&expr->pattern_tree, addr);
+	while (node) {
+		elt = ebmb_entry(node, struct pattern_tree, node);
+		if (elt->ref->gen_id == expr->ref->curr_gen)
+			return elt;
+		node = ebmb_next(node);
+	}
+	return NULL;
+}
+
+/* Same as pat_lookup_ip4() for IPv6 networks */
+static struct pattern_tree *pat_lookup_ip6(struct pattern_expr *expr, const struct pat_ipidx *idx,
+                                           const void *addr)
+{
+	struct ebmb_node *node;
+	struct pattern_tree *elt;
+
+	if (idx && idx->v6.nb)
+		return pat_ipidx_lookup6(&idx->v6, addr);
+
+	node = ebmb_lookup_longest(&expr->pattern_tree_2, addr);
+	while (node) {
+		elt = ebmb_entry(node, struct pattern_tree, node);
+		if (elt->ref->gen_id == expr->ref->curr_gen)
+			return elt;
+		node = ebmb_next(node);
+	}
+	return NULL;
+}
+
+/* Returns the static pattern filled from IPv4 network <elt> if <fill> is set */
+static struct pattern *pat_fill_ip4(struct pattern_tree *elt, int fill)
+{
+	if (fill) {
+		static_pattern.data = elt->data;
+		static_pattern.ref = elt->ref;
+		static_pattern.sflags = PAT_SF_TREE;
+		static_pattern.type = SMP_T_IPV4;
+		static_pattern.val.ipv4.addr.s_addr = read_u32(elt->node.key);
+		if (!cidr2dotted(elt->node.node.pfx, &static_pattern.val.ipv4.mask))
+			return NULL;
+	}
+	return &static_pattern;
+}
+
+/* Returns the static pattern filled from IPv6 network <elt> if <fill> is set */
+static struct pattern *pat_fill_ip6(struct pattern_tree *elt, int fill)
+{
+	if (fill) {
+		static_pattern.data = elt->data;
+		static_pattern.ref = elt->ref;
+		static_pattern.sflags = PAT_SF_TREE;
+		static_pattern.type = SMP_T_IPV6;
+		memcpy(&static_pattern.val.ipv6.addr, elt->node.key, 16);
+		static_pattern.val.ipv6.mask = elt->node.node.pfx;
+	}
+	return &static_pattern;
+}
+
 struct pattern *pat_match_ip(struct sample *smp, struct pattern_expr *expr, int fill)
 {
 	unsigned int v4; /* in network byte order */
 	struct in6_addr tmp6;
-	struct in_addr *s;
-	struct ebmb_node *node;
+	struct pat_ipidx *idx;
 	struct pattern_tree *elt;
 	struct pattern_list *lst;
 	struct pattern *pattern;
 
+	/* Use the flat index of the trees when available */
+	idx = pat_ipidx_get(expr);
+
 	/* The input sample is IPv4. Try to match in the trees. */
 	if (smp->data.type == SMP_T_IPV4) {
 		/* Lookup an IPv4 address in the expression's pattern tree using
 		 * the longest match method.
 		 */
-		s = &smp->data.u.ipv4;
-		node = ebmb_lookup_longest(&expr->pattern_tree, &s->s_addr);
-		while (node) {
-			elt = ebmb_entry(node, struct pattern_tree, node);
-			if (elt->ref->gen_id != expr->ref->curr_gen) {
-				node = ebmb_next(node);
-				continue;
-			}
-			if (fill) {
-				static_pattern.data = elt->data;
-				static_pattern.ref = elt->ref;
-				static_pattern.sflags = PAT_SF_TREE;
-				static_pattern.type = SMP_T_IPV4;
-				static_pattern.val.ipv4.addr.s_addr = read_u32(elt->node.key);
-				if (!cidr2dotted(elt->node.node.pfx, &static_pattern.val.ipv4.mask))
-					return NULL;
-			}
-			return &static_pattern;
-		}
+		elt = pat_lookup_ip4(expr, idx, &smp->data.u.ipv4.s_addr);
+		if (elt)
+			return pat_fill_ip4(elt, fill);
 
 		/* The IPv4 sample don't match the IPv4 tree. Convert the IPv4
 		 * sample address to IPv6 with the mapping method using the ::ffff:
@@ -1004,23 +2082,9 @@ struct pattern *pat_match_ip(struct sample *smp, struct pattern_expr *expr, int
 		memset(&tmp6, 0, 10);
 		write_u16(&tmp6.s6_addr[10], htons(0xffff));
 		write_u32(&tmp6.s6_addr[12], smp->data.u.ipv4.s_addr);
-		node = ebmb_lookup_longest(&expr->pattern_tree_2, &tmp6);
-		while (node) {
-			elt = ebmb_entry(node, struct pattern_tree, node);
-			if (elt->ref->gen_id != expr->ref->curr_gen) {
-				node = ebmb_next(node);
-				continue;
-			}
-			if (fill) {
-				static_pattern.data = elt->data;
-				static_pattern.ref = elt->ref;
-				static_pattern.sflags = PAT_SF_TREE;
-				static_pattern.type = SMP_T_IPV6;
-				memcpy(&static_pattern.val.ipv6.addr, elt->node.key, 16);
-				static_pattern.val.ipv6.mask = elt->node.node.pfx;
-			}
-			return &static_pattern;
-		}
+		elt = pat_lookup_ip6(expr, idx, &tmp6);
+		if (elt)
+			return pat_fill_ip6(elt, fill);
 	}
 
 	/* The input sample is IPv6. Try to match in the trees. */
@@ -1028,23 +2092,9 @@ struct pattern *pat_match_ip(struct sample *smp, struct pattern_expr *expr, int
 		/* Lookup an IPv6 address in the expression's pattern tree using
 		 * the longest match method.
 		 */
-		node = ebmb_lookup_longest(&expr->pattern_tree_2, &smp->data.u.ipv6);
-		while (node) {
-			elt = ebmb_entry(node, struct pattern_tree, node);
-			if (elt->ref->gen_id != expr->ref->curr_gen) {
-				node = ebmb_next(node);
-				continue;
-			}
-			if (fill) {
-				static_pattern.data = elt->data;
-				static_pattern.ref = elt->ref;
-				static_pattern.sflags = PAT_SF_TREE;
-				static_pattern.type = SMP_T_IPV6;
-				memcpy(&static_pattern.val.ipv6.addr, elt->node.key, 16);
-				static_pattern.val.ipv6.mask = elt->node.node.pfx;
-			}
-			return &static_pattern;
-		}
+		elt = pat_lookup_ip6(expr, idx, &smp->data.u.ipv6);
+		if (elt)
+			return pat_fill_ip6(elt, fill);
 
 		/* Try to convert 6 to 4 when the start of the ipv6 address match the
 		 * following forms :
@@ -1065,24 +2115,9 @@ struct pattern *pat_match_ip(struct sample *smp, struct pattern_expr *expr, int
 			/* Lookup an IPv4 address in the expression's pattern tree using the longest
 			 * match method.
 			 */
-			node = ebmb_lookup_longest(&expr->pattern_tree, &v4);
-			while (node) {
-				elt = ebmb_entry(node, struct pattern_tree, node);
-				if (elt->ref->gen_id != expr->ref->curr_gen) {
-					node = ebmb_next(node);
-					continue;
-				}
-				if (fill) {
-					static_pattern.data = elt->data;
-					static_pattern.ref = elt->ref;
-					static_pattern.sflags = PAT_SF_TREE;
-					static_pattern.type = SMP_T_IPV4;
-					static_pattern.val.ipv4.addr.s_addr = read_u32(elt->node.key);
-					if (!cidr2dotted(elt->node.node.pfx, &static_pattern.val.ipv4.mask))
-						return NULL;
-				}
-				return &static_pattern;
-			}
+			elt = pat_lookup_ip4(expr, idx, &v4);
+			if (elt)
+				return pat_fill_ip4(elt, fill);
 		}
 	}
 
@@ -1176,6 +2211,7 @@ void pat_prune_gen(struct pattern_expr *expr)
 	free_pattern_tree(&expr->pattern_tree);
 	free_pattern_tree(&expr->pattern_tree_2);
 	LIST_INIT(&expr->patterns);
+	pat_cidx_drop(expr);
 	expr->ref->revision = rdtsc();
 	expr->ref->entry_cnt = 0;
 }
@@ -1274,6 +2310,7 @@ int pat_idx_list_str(struct pattern_expr *expr, struct pattern *pat, char **err)
 	pat->ref->list_head = &patl->from_ref;
 	expr->ref->revision = rdtsc();
 	expr->ref->entry_cnt++;
+	pat_cidx_drop(expr);
 
 	/* that's ok */
 	return 1;
@@ -1308,6 +2345,7 @@ int pat_idx_list_reg_cap(struct pattern_expr *expr, struct pattern *pat, int cap
 	pat->ref->list_head = &patl->from_ref;
 	expr->ref->revision = rdtsc();
 	expr->ref->entry_cnt++;
+	pat_cidx_drop(expr);
 
 	/* that's ok */
 	return 1;
@@ -1359,6 +2397,7 @@ int pat_idx_tree_ip(struct pattern_expr *expr, struct pattern *pat, char **err)
 			node->from_ref = pat->ref->tree_head;
 			pat->ref->tree_head = &node->from_ref;
 			expr->ref->revision = rdtsc();
+			pat_cidx_drop(expr);
 			expr->ref->entry_cnt++;
 
 			/* that's ok */
@@ -1390,6 +2429,7 @@ int pat_idx_tree_ip(struct pattern_expr *expr, struct pattern *pat, char **err)
 		node->from_ref = pat->ref->tree_head;
 		pat->ref->tree_head = &node->from_ref;
 		expr->ref->revision = rdtsc();
+		pat_cidx_drop(expr);
 		expr->ref->entry_cnt++;
 
 		/* that's ok */
@@ -1488,6 +2528,114 @@ int pat_idx_tree_pfx(struct pattern_expr *expr, struct pattern *pat, char **err)
 	return 1;
 }
 
+/* Indexes the string pattern <pat> for suffix matching: it is stored reversed
+ * in a prefix tree, followed by its original form, so that the longest suffix
+ * of a reversed string may be looked up.
+ */
+int pat_idx_tree_sfx(struct pattern_expr *expr, struct pattern *pat, char **err)
+{
+	int len, i;
+	struct pattern_tree *node;
+
+	/* Only string can be indexed */
+	if (pat->type != SMP_T_STR) {
+		memprintf(err, "internal error: string expected, but the type is '%s'",
+		          smp_to_type[pat->type]);
+		return 0;
+	}
+
+	/* If the flag PAT_F_IGNORE_CASE is set, we cannot use trees */
+	if (expr->mflags & PAT_MF_IGNORE_CASE)
+		return pat_idx_list_str(expr, pat, err);
+
+	/* Process the key len */
+	len = strlen(pat->ptr.str);
+
+	/* node memory allocation */
+	node = calloc(1, sizeof(*node) + 2 * (len + 1));
+	if (!node) {
+		memprintf(err, "out of memory while loading pattern");
+		return 0;
+	}
+
+	/* copy the pointer to sample associated to this node */
+	node->data = pat->data;
+	node->ref = pat->ref;
+
+	/* copy the reversed string and the original one */
+	for (i = 0; i < len; i++)
+		node->node.key[i] = pat->ptr.str[len - 1 - i];
+	memcpy(node->node.key + len + 1, pat->ptr.str, len + 1);
+	node->node.node.pfx = len * 8;
+
+	/* index the new node */
+	ebmb_insert_prefix(&expr->pattern_tree, &node->node, len);
+	node->from_ref = pat->ref->tree_head;
+	pat->ref->tree_head = &node->from_ref;
+	expr->ref->revision = rdtsc();
+	expr->ref->entry_cnt++;
+
+	/* that's ok */
+	return 1;
+}
+
+/* Indexes the string pattern <pat> for domain matching: it is stored stripped
+ * from the delimiters at its beginning and end in a string tree. Patterns made
+ * only of delimiters are kept in the list.
+ */
+int pat_idx_tree_dom(struct pattern_expr *expr, struct pattern *pat, char **err)
+{
+	unsigned int delimiters = make_4delim('/', '?', '.', ':');
+	struct pattern_tree *node;
+	const char *ps;
+	int len;
+
+	/* Only string can be indexed */
+	if (pat->type != SMP_T_STR) {
+		memprintf(err, "internal error: string expected, but the type is '%s'",
+		          smp_to_type[pat->type]);
+		return 0;
+	}
+
+	ps = pat->ptr.str;
+	len = strlen(ps);
+	while (len > 0 && is_delimiter(*ps, delimiters)) {
+		len--;
+		ps++;
+	}
+
+	while (len > 0 && is_delimiter(ps[len - 1], delimiters))
+		len--;
+
+	/* If the flag PAT_F_IGNORE_CASE is set, we cannot use trees */
+	if ((expr->mflags & PAT_MF_IGNORE_CASE) || !len)
+		return pat_idx_list_str(expr, pat, err);
+
+	/* node memory allocation */
+	node = calloc(1, sizeof(*node) + len + 1);
+	if (!node) {
+		memprintf(err, "out of memory while loading pattern");
+		return 0;
+	}
+
+	/* copy the pointer to sample associated to this node */
+	node->data = pat->data;
+	node->ref = pat->ref;
+
+	/* copy the stripped string, the trailing zero is already there */
+	memcpy(node->node.key, ps, len);
+
+	/* index the new node */
+	ebst_insert(&expr->pattern_tree, &node->node);
+	node->from_ref = pat->ref->tree_head;
+	pat->ref->tree_head = &node->from_ref;
+	expr->ref->revision = rdtsc();
+	expr->ref->entry_cnt++;
+
+	/* that's ok */
+	return 1;
+}
+
 /* Deletes all patterns from reference <elt>. Note that all of their
  * expressions must be locked, and the pattern lock must be held as well.
  */
@@ -1495,6 +2643,7 @@ void pat_delete_gen(struct pat_ref *ref, struct pat_ref_elt *elt)
 {
 	struct pattern_tree *tree;
 	struct pattern_list *pat;
+	struct pattern_expr *expr;
 	void **node;
 
 	/* delete all known tree nodes. They are all allocated inline */
@@ -1524,6 +2673,12 @@ void pat_delete_gen(struct pat_ref *ref, struct pat_ref_elt *elt)
 		free(pat);
 	}
 
+	/* the compiled indexes may reference the deleted entries */
+	if (elt->list_head || elt->tree_head) {
+		list_for_each_entry(expr, &ref->pat, list)
+			pat_cidx_drop(expr);
+	}
+
 	/* update revision number to refresh the cache */
 	ref->revision = rdtsc();
 	ref->entry_cnt--;
@@ -1593,6 +2748,57 @@ struct pat_ref *pat_ref_lookupid(int unique_id)
 	return NULL;
 }
 
+/* Returns the amount of memory in bytes used by the elements of reference
+ * <ref>, including their pattern and sample strings, and stores their number
+ * into <elts>. The patterns derived from them by the expressions are not
+ * accounted for, their number is in <ref->entry_cnt>. It takes the reference's
+ * lock, and walks over all of its elements, so it is meant for debugging only.
+ */
+unsigned long long pat_ref_mem_usage(struct pat_ref *ref, unsigned int *elts)
+{
+	struct pat_ref_elt *elt;
+	unsigned long long bytes = 0;
+
+	*elts = 0;
+	HA_SPIN_LOCK(PATREF_LOCK, &ref->lock);
+	list_for_each_entry(elt, &ref->head, list) {
+		bytes += sizeof(*elt) + strlen(elt->pattern) + 1;
+		if (elt->sample)
+			bytes += strlen(elt->sample) + 1;
+		(*elts)++;
+	}
+	HA_SPIN_UNLOCK(PATREF_LOCK, &ref->lock);
+	return bytes;
+}
+
+/* Reports the pattern cache statistics of all the expressions of <ref>: the
+ * number of lookups answered by the cache into <hits>, the ones not found in
+ * it into <misses>, and the ones which did not use it into <bypassed>.
+ */
+void pat_ref_lru_stats(struct pat_ref *ref, unsigned long long *hits,
+                       unsigned long long *misses, unsigned long long *bypassed)
+{
+	struct pattern_expr *expr;
+	unsigned long long calls = 0;
+
+	*hits = *misses = 0;
+	list_for_each_entry(expr, &ref->pat, list) {
+		calls   += HA_ATOMIC_LOAD(&expr->lru_calls);
+		*hits   += HA_ATOMIC_LOAD(&expr->lru_hits);
+		*misses += HA_ATOMIC_LOAD(&expr->lru_misses);
+	}
+	*bypassed = calls > *hits + *misses ? calls - *hits - *misses : 0;
+}
+
+/* Reports a change to the patterns of <ref> to the external indexes built from
+ * them, if any.
+ */
+static inline void pat_ref_touch(struct pat_ref *ref)
+{
+	if (ref->flags & PAT_REF_INDEXED)
+		HA_ATOMIC_INC(&pat_ref_indexed_rev);
+}
+
 /* This function removes from the pattern reference <ref> all the patterns
  * attached to the reference element <elt>, and the element itself. The
  * reference must be locked.
@@ -1627,6 +2833,7 @@ void pat_ref_delete_by_ptr(struct pat_ref *ref, struct pat_ref_elt *elt)
 	free(elt->sample);
 	free(elt->pattern);
 	free(elt);
+	pat_ref_touch(ref);
 }
 
 /* This function removes all the patterns matching the pointer <refelt> from
@@ -1684,23 +2891,54 @@ struct pat_ref_elt *pat_ref_find_elt(struct pat_ref *ref, const char *key)
 }
 
 
+/* Replaces the sample at <data> with the one parsed from <value> using
+ * <parse_smp>, or with NULL if it cannot be parsed. Lookups read the samples
+ * without any lock, so the new one is atomically published and the previous
+ * one is only released once no thread may be copying it anymore.
+ */
+static void pat_ref_swap_smp(struct sample_data **data, const char *value,
+                             int (*parse_smp)(const char *, struct sample_data *))
+{
+	struct sample_data *new, *old;
+
+	new = malloc(sizeof(*new));
+	if (new && !parse_smp(value, new))
+		ha_free(&new);
+
+	old = HA_ATOMIC_XCHG(data, new);
+	thread_retire(old, free);
+}
+
 /* This function modifies the sample of pat_ref_elt <elt> in all expressions
  * found under <ref> to become <value>. It is assumed that the caller has
- * already verified that <elt> belongs to <ref>.
+ * already verified that <elt> belongs to <ref>, and holds the PATREF_LOCK on
+ * <ref>. Since only the samples change, the expressions are not locked and the
+ * lookups are never blocked. When all the expressions use the same sample
+ * parser, the patterns are directly reached from <elt> instead of being looked
+ * up in each expression.
  */
 static inline int pat_ref_set_elt(struct pat_ref *ref, struct pat_ref_elt *elt,
                                   const char *value, char **err)
 {
+	int (*parse_smp)(const char *, struct sample_data *) = NULL;
 	struct pattern_expr *expr;
+	struct pattern_tree *tree;
+	struct pattern_list *pat;
 	struct sample_data **data;
-	char *sample;
 	struct sample_data test;
+	int uniform = 1;
+	char *sample;
+	void **node;
 
 	/* Try all needed converters. */
 	list_for_each_entry(expr, &ref->pat, list) {
 		if (!expr->pat_head->parse_smp)
 			continue;
 
+		if (parse_smp && parse_smp != expr->pat_head->parse_smp)
+			uniform = 0;
+		parse_smp = expr->pat_head->parse_smp;
+
 		if (!expr->pat_head->parse_smp(value, &test)) {
 			memprintf(err, "unable to parse '%s'", value);
 			return 0;
@@ -1713,25 +2951,40 @@ static inline int pat_ref_set_elt(struct pat_ref *ref, struct pat_ref_elt *elt,
 		memprintf(err, "out of memory error");
 		return 0;
 	}
+
 	/* Load sample in each reference. All the conversions are tested
-	 * below, normally these calls don't fail.
+	 * above, normally these calls don't fail. The patterns without a
+	 * sample belong to ACLs.
 	 */
-	list_for_each_entry(expr, &ref->pat, list) {
-		if (!expr->pat_head->parse_smp)
-			continue;
+	if (parse_smp && uniform) {
+		for (node = elt->tree_head; node; node = *node) {
+			tree = container_of(node, struct pattern_tree, from_ref);
+			if (tree->data)
+				pat_ref_swap_smp(&tree->data, sample, parse_smp);
+		}
 
-		HA_RWLOCK_WRLOCK(PATEXP_LOCK, &expr->lock);
-		data = pattern_find_smp(expr, elt);
-		if (data && *data && !expr->pat_head->parse_smp(sample, *data))
-			*data = NULL;
-		HA_RWLOCK_WRUNLOCK(PATEXP_LOCK, &expr->lock);
+		for (node = elt->list_head; node; node = *node) {
+			pat = container_of(node, struct pattern_list, from_ref);
+			if (pat->pat.data)
+				pat_ref_swap_smp(&pat->pat.data, sample, parse_smp);
+		}
+	}
+	else if (parse_smp) {
+		list_for_each_entry(expr, &ref->pat, list) {
+			if (!expr->pat_head->parse_smp)
+				continue;
+
+			data = pattern_find_smp(expr, elt);
+			if (data && *data)
+				pat_ref_swap_smp(data, sample, expr->pat_head->parse_smp);
+		}
 	}
 
-	/* free old sample only when all exprs are updated */
-	free(elt->sample);
+	/* the string samples point to the old value */
+	if (elt->sample)
+		thread_retire(elt->sample, free);
 	elt->sample = sample;
 
-
 	return 1;
 }
 
@@ -1985,6 +3238,7 @@ int pat_ref_commit_elt(struct pat_ref *ref, struct pat_ref_elt *elt, char **err)
 			return 0;
 		}
 	}
+	pat_ref_touch(ref);
 	return 1;
 }
 
@@ -2080,8 +3334,13 @@ int pat_ref_purge_range(struct pat_ref *ref, uint from, uint to, int budget)
 		free(elt);
 	}
 
-	list_for_each_entry(expr, &ref->pat, list)
+	list_for_each_entry(expr, &ref->pat, list) {
+		/* the IP index only covers the generation it was built for */
+		if (expr->ipidx && expr->ipidx->gen != ref->curr_gen)
+			pat_cidx_drop(expr);
 		HA_RWLOCK_WRUNLOCK(PATEXP_LOCK, &expr->lock);
+	}
+	pat_ref_touch(ref);
 
 #if defined(HA_HAVE_MALLOC_TRIM)
 	if (done) {
@@ -2513,6 +3772,8 @@ struct pattern *pattern_exec_match(struct pattern_head *head, struct sample *smp
 			   by another thread */
 			if (pat != &static_pattern) {
 				memcpy(&static_pattern, pat, sizeof(struct pattern));
+				/* the sample may be replaced at any time */
+				static_pattern.data = HA_ATOMIC_LOAD(&pat->data);
 				pat = &static_pattern;
 			}
 
@@ -20,9 +20,15 @@
 #include <sys/stat.h>
 #include <sys/types.h>
 
+#if defined(USE_ZLIB)
+#include <zlib.h>
+#endif
+
 #include <haproxy/api.h>
 #include <haproxy/applet.h>
+#include <haproxy/cfgparse.h>
 #include <haproxy/channel.h>
+#include <haproxy/chunk.h>
 #include <haproxy/cli.h>
 #include <haproxy/dict.h>
 #include <haproxy/errors.h>
@@ -91,7 +97,6 @@
 #define PEER_F_LEARN_NOTUP2DATE     0x00000200 /* Learn from peer finished but peer is not up to date */
 #define PEER_F_ALIVE                0x20000000 /* Used to flag a peer a alive. */
 #define PEER_F_HEARTBEAT            0x40000000 /* Heartbeat message to send. */
-#define PEER_F_DWNGRD               0x80000000 /* When this flag is enabled, we must downgrade the supported version announced during peer sessions. */
 
 #define PEER_TEACH_RESET            ~(PEER_F_TEACH_PROCESS|PEER_F_TEACH_FINISHED) /* PEER_F_TEACH_COMPLETE should never be reset */
 #define PEER_LEARN_RESET            ~(PEER_F_LEARN_ASSIGN|PEER_F_LEARN_NOTUP2DATE)
@@ -217,6 +222,7 @@ struct peer_prep_params {
 #define PEER_MSG_STKT_ACK              0x84
 #define PEER_MSG_STKT_UPDATE_TIMED     0x85
 #define PEER_MSG_STKT_INCUPDATE_TIMED  0x86
+#define PEER_MSG_STKT_UPDATE_BATCH     0x87
 /* All the stick-table message identifiers abova have the #7 bit set */
 #define PEER_MSG_STKT_BIT                 7
 #define PEER_MSG_STKT_BIT_MASK         (1 << PEER_MSG_STKT_BIT)
@@ -254,6 +260,12 @@ struct peer_prep_params {
 
 #define PEER_STKT_CACHE_MAX_ENTRIES       128
 
+/* flags of the first byte of an updates batch message */
+#define PEER_BATCH_F_DEFLATE              0x01 /* records are zlib-compressed */
+
+/* batches smaller than this are never worth compressing */
+#define PEER_BATCH_COMPRESS_MIN           256
+
 /**********************************/
 /* Peer Session IO handler states */
 /**********************************/
@@ -292,13 +304,52 @@ enum {
 
 #define PEER_SESSION_PROTO_NAME         "HAProxyS"
 #define PEER_MAJOR_VER        2
-#define PEER_MINOR_VER        1
-#define PEER_DWNGRD_MINOR_VER 0
+#define PEER_DWNGRD_MINOR_VER 0  /* oldest version we may step down to */
+#define PEER_TIMED_MINOR_VER  1  /* first version with timed updates */
+#define PEER_BATCH_MINOR_VER  2  /* first version with updates batches */
+#define PEER_ZLIB_MINOR_VER   3  /* first version with compressed batches */
+#if defined(USE_ZLIB)
+#define PEER_MINOR_VER        PEER_ZLIB_MINOR_VER
+#else
+#define PEER_MINOR_VER        PEER_BATCH_MINOR_VER
+#endif
 
 static size_t proto_len = sizeof(PEER_SESSION_PROTO_NAME) - 1;
 struct peers *cfg_peers = NULL;
+
+/* max number of updates sent for a table before switching to the next one and
+ * yielding, see tune.peers.max-updates-at-once.
+ */
+static unsigned int peers_max_updates_at_once = 200;
 static void peer_session_forceshutdown(struct peer *peer);
 
+/* Returns the minor version of the protocol announced to / used with <peer>. */
+static inline unsigned int peer_min_ver(const struct peer *peer)
+{
+	return PEER_MINOR_VER - peer->dwngrd;
+}
+
+/* Returns non-zero if the local node and remote peer <peer> of section <peers>
+ * must be connected together. This is always the case in a full mesh, while
+ * when hubs are declared, the nodes which are not hubs only talk to the hubs.
+ * The local peer (the other process on reload) is always reachable.
+ */
+static inline int peer_is_linked(const struct peers *peers, const struct peer *peer)
+{
+	return !peers->nb_hubs || peer->local || peer->hub ||
+	       (peers->local && peers->local->hub);
+}
+
+/* Returns non-zero if the updates learned from <peer> must be relayed to the
+ * other peers, which is the case when the local node is a hub and <peer> is a
+ * remote node which is not one.
+ */
+static inline int peer_must_relay(const struct peers *peers, const struct peer *peer)
+{
+	return peers->nb_hubs && peers->local && peers->local->hub &&
+	       !peer->local && !peer->hub;
+}
+
 static struct ebpt_node *dcache_tx_insert(struct dcache *dc,
                                           struct dcache_tx_entry *i);
 static inline void flush_dcache(struct peer *peer);
@@ -564,7 +615,7 @@ static int peer_prepare_hellomsg(char *msg, size_t size, struct peer_prep_params
 	struct peer *peer;
 
 	peer = p->hello.peer;
-	min_ver = (peer->flags & PEER_F_DWNGRD) ? PEER_DWNGRD_MINOR_VER : PEER_MINOR_VER;
+	min_ver = peer_min_ver(peer);
 	/* Prepare headers */
 	ret = snprintf(msg, size, PEER_SESSION_PROTO_NAME " %u.%u\n%s\n%s %d %d\n",
 	              PEER_MAJOR_VER, min_ver, peer->id, localpeer, (int)getpid(), 1);
@@ -1188,6 +1239,155 @@ static inline int peer_send_updatemsg(struct shared_table *st, struct appctx *ap
 	return peer_send_msg(appctx, peer_prepare_updatemsg, &p);
 }
 
+/*
+ * Returns the number of bytes of update records an updates batch may hold so
+ * that the whole batch message still fits both into a trash buffer and into
+ * the room currently left in the output channel of <appctx>. May be negative.
+ */
+static inline int peer_batch_room(struct appctx *appctx)
+{
+	struct stream_interface *si = appctx->owner;
+	struct channel *chn = si_ic(si);
+	int room;
+
+	room = channel_recv_limit(chn) - c_data(chn);
+	if (room > trash.size)
+		room = trash.size;
+
+	/* message header, encoded length and batch flags */
+	return room - (PEER_MSG_HEADER_LEN + PEER_MSG_ENC_LENGTH_MAXLEN + 1);
+}
+
+/*
+ * Send the update records accumulated into <batch> as a single updates batch
+ * message, compressed if the peer supports it and if it is worth it. <batch>
+ * is emptied on success. Since peer_batch_room() was checked for each record,
+ * the message always fits, so any failure is fatal to the session.
+ * Return 0 if the message could not be sent modifying the appcxt st0 to
+ * PEER_SESS_ST_END value, a positive value if succeeded.
+ */
+static int peer_send_batchmsg(struct appctx *appctx, struct buffer *batch)
+{
+	struct stream_interface *si = appctx->owner;
+	struct buffer *out;
+	char *cursor, *datamsg;
+	unsigned char flags = 0;
+	size_t datalen;
+	int ret;
+
+	out = alloc_trash_chunk();
+	if (!out) {
+		appctx->st0 = PEER_SESS_ST_END;
+		return 0;
+	}
+
+	datamsg = out->area + PEER_MSG_HEADER_LEN + PEER_MSG_ENC_LENGTH_MAXLEN;
+	cursor = datamsg + 1;
+
+#if defined(USE_ZLIB)
+	if (peer_min_ver(appctx->ctx.peers.ptr) >= PEER_ZLIB_MINOR_VER &&
+	    batch->data >= PEER_BATCH_COMPRESS_MIN) {
+		uLongf zlen;
+
+		/* the raw length is announced first so that the receiver
+		 * may check it before inflating.
+		 */
+		intencode(batch->data, &cursor);
+
+		/* only keep the compressed form if it is smaller */
+		zlen = batch->data - (cursor - datamsg);
+		if (compress2((Bytef *)cursor, &zlen, (const Bytef *)batch->area,
+		              batch->data, Z_BEST_SPEED) == Z_OK) {
+			flags |= PEER_BATCH_F_DEFLATE;
+			cursor += zlen;
+		}
+		else
+			cursor = datamsg + 1;
+	}
+#endif
+
+	if (!(flags & PEER_BATCH_F_DEFLATE)) {
+		memcpy(cursor, batch->area, batch->data);
+		cursor += batch->data;
+	}
+	*datamsg = flags;
+
+	/* Compute datalen */
+	datalen = (cursor - datamsg);
+
+	/*  prepare message header */
+	out->area[0] = PEER_MSG_CLASS_STICKTABLE;
+	out->area[1] = PEER_MSG_STKT_UPDATE_BATCH;
+	cursor = &out->area[2];
+	intencode(datalen, &cursor);
+
+	/* move data after header */
+	memmove(cursor, datamsg, datalen);
+
+	ret = ci_putblk(si_ic(si), out->area, (cursor - out->area) + datalen);
+	free_trash_chunk(out);
+	if (ret <= 0) {
+		appctx->st0 = PEER_SESS_ST_END;
+		return 0;
+	}
+
+	batch->data = 0;
+	return ret;
+}
+
+/*
+ * Append an update record for <ts> stick session to <batch>. Such a record
+ * is the update message without its class byte. The pending batch is sent
+ * first if there is not enough room left to append the record.
+ * Return 0 if the message could not be built modifying the appcxt st0 to PEER_SESS_ST_END value.
+ * Returns -1 if there was not enough room left to send the message, in
+ * which case <batch> is always empty.
+ * Any other negative returned value must be considered as an error with an
+ * appcxt st0 returned value equal to PEER_SESS_ST_END.
+ */
+static inline int peer_append_updatemsg(struct shared_table *st, struct appctx *appctx,
+                                        struct buffer *batch, struct stksess *ts,
+                                        unsigned int updateid, int use_identifier, int use_timed)
+{
+	struct stream_interface *si = appctx->owner;
+	struct peer_prep_params p = {
+		.updt = {
+			.stksess = ts,
+			.shared_table = st,
+			.updateid = updateid,
+			.use_identifier = use_identifier,
+			.use_timed = use_timed,
+			.peer = appctx->ctx.peers.ptr,
+		},
+	};
+	int msglen, ret;
+
+	msglen = peer_prepare_updatemsg(trash.area, trash.size, &p);
+	if (!msglen) {
+		/* internal error: message does not fit in trash */
+		appctx->st0 = PEER_SESS_ST_END;
+		return 0;
+	}
+
+	/* the class byte is implicit within a batch */
+	msglen--;
+	if (batch->data && msglen > peer_batch_room(appctx) - (int)batch->data) {
+		ret = peer_send_batchmsg(appctx, batch);
+		if (ret <= 0)
+			return ret;
+	}
+
+	if (msglen > peer_batch_room(appctx) - (int)batch->data) {
+		/* No more write possible */
+		si_rx_room_blk(si);
+		return -1;
+	}
+
+	memcpy(batch->area + batch->data, trash.area + 1, msglen);
+	batch->data += msglen;
+	return 1;
+}
+
 /*
  * Build a peer protocol control class message.
  * Returns the number of written bytes used to build the message if succeeded,
@@ -1414,6 +1614,7 @@ static inline struct stksess *peer_teach_stage2_stksess_lookup(struct shared_tab
  * Returns -1 if there was not enough room left to send the message,
  * any other negative returned value must  be considered as an error with an appcxt st0
  * returned value equal to PEER_SESS_ST_END.
+ * Returns 2 if the updates limit was reached while some could remain to be sent.
  * If it returns 0 or -1, this function leave <st> locked if already locked when entering this function
  * unlocked if not already locked when entering this function.
  */
@@ -1421,7 +1622,9 @@ static inline int peer_send_teachmsgs(struct appctx *appctx, struct peer *p,
                                       struct stksess *(*peer_stksess_lookup)(struct shared_table *),
                                       struct shared_table *st, int locked)
 {
-	int ret, new_pushed, use_timed;
+	struct buffer *batch = NULL;
+	unsigned int updates_sent = 0;
+	int ret, new_pushed, use_timed, yield = 0;
 
 	ret = 1;
 	use_timed = 0;
@@ -1434,7 +1637,13 @@ static inline int peer_send_teachmsgs(struct appctx *appctx, struct peer *p,
 	}
 
 	if (peer_stksess_lookup != peer_teach_process_stksess_lookup)
-		use_timed = !(p->flags & PEER_F_DWNGRD);
+		use_timed = peer_min_ver(p) >= PEER_TIMED_MINOR_VER;
+
+	/* Pack the updates into batches if the peer supports them; if no
+	 * buffer is available they are simply sent one at a time.
+	 */
+	if (peer_min_ver(p) >= PEER_BATCH_MINOR_VER)
+		batch = alloc_trash_chunk();
 
 	/* We force new pushed to 1 to force identifier in update message */
 	new_pushed = 1;
@@ -1446,26 +1655,50 @@ static inline int peer_send_teachmsgs(struct appctx *appctx, struct peer *p,
 		struct stksess *ts;
 		unsigned updateid;
 
+		/* leave some room to the other tables and tasks */
+		if (updates_sent >= peers_max_updates_at_once) {
+			yield = 1;
+			break;
+		}
+
 		/* push local updates */
 		ts = peer_stksess_lookup(st);
 		if (!ts)
 			break;
 
 		updateid = ts->upd.key;
-		ts->ref_cnt++;
+
+		/* a relayed update is neither sent back to the peer it was
+		 * learned from, nor to the other hubs which got it as well.
+		 */
+		if (ts->relay_src && peer_stksess_lookup == peer_teach_process_stksess_lookup &&
+		    (p->hub || ts->relay_src == p->relay_id)) {
+			st->last_pushed = updateid;
+			if ((int)(st->last_pushed - st->table->commitupdate) > 0)
+				st->table->commitupdate = st->last_pushed;
+			/* the next update message must carry its identifier */
+			new_pushed = 1;
+			continue;
+		}
+
+		HA_ATOMIC_INC(&ts->ref_cnt);
 		HA_SPIN_UNLOCK(STK_TABLE_LOCK, &st->table->lock);
 
-		ret = peer_send_updatemsg(st, appctx, ts, updateid, new_pushed, use_timed);
+		if (batch)
+			ret = peer_append_updatemsg(st, appctx, batch, ts, updateid, new_pushed, use_timed);
+		else
+			ret = peer_send_updatemsg(st, appctx, ts, updateid, new_pushed, use_timed);
 		if (ret <= 0) {
 			HA_SPIN_LOCK(STK_TABLE_LOCK, &st->table->lock);
-			ts->ref_cnt--;
+			HA_ATOMIC_DEC(&ts->ref_cnt);
 			if (!locked)
 				HA_SPIN_UNLOCK(STK_TABLE_LOCK, &st->table->lock);
+			free_trash_chunk(batch);
 			return ret;
 		}
 
 		HA_SPIN_LOCK(STK_TABLE_LOCK, &st->table->lock);
-		ts->ref_cnt--;
+		HA_ATOMIC_DEC(&ts->ref_cnt);
 		st->last_pushed = updateid;
 
 		if (peer_stksess_lookup == peer_teach_process_stksess_lookup &&
@@ -1474,12 +1707,23 @@ static inline int peer_send_teachmsgs(struct appctx *appctx, struct peer *p,
 
 		/* identifier may not needed in next update message */
 		new_pushed = 0;
+		updates_sent++;
+	}
+
+	if (batch && batch->data) {
+		/* flush the pending records */
+		HA_SPIN_UNLOCK(STK_TABLE_LOCK, &st->table->lock);
+		ret = peer_send_batchmsg(appctx, batch);
+		HA_SPIN_LOCK(STK_TABLE_LOCK, &st->table->lock);
 	}
+	free_trash_chunk(batch);
 
  out:
 	if (!locked)
 		HA_SPIN_UNLOCK(STK_TABLE_LOCK, &st->table->lock);
-	return 1;
+	if (ret <= 0)
+		return ret;
+	return yield ? 2 : 1;
 }
 
 /*
@@ -1546,8 +1790,11 @@ static int peer_treat_updatemsg(struct appctx *appctx, struct peer *p, int updt,
                                 char **msg_cur, char *msg_end, int msg_len, int totl)
 {
 	struct stream_interface *si = appctx->owner;
+	struct peers *peers = strm_fe(si_strm(si))->parent;
 	struct shared_table *st = p->remote_table;
 	struct stksess *ts, *newts;
+	struct stktable_key key;
+	unsigned int netinteger;
 	uint32_t update;
 	int expire;
 	unsigned int data_type;
@@ -1590,17 +1837,13 @@ static int peer_treat_updatemsg(struct appctx *appctx, struct peer *p, int updt,
 		expire = ntohl(expire);
 	}
 
-	newts = stksess_new(st->table, NULL);
-	if (!newts)
-		goto ignore_msg;
-
 	if (st->table->type == SMP_T_STR) {
 		unsigned int to_read, to_store;
 
 		to_read = intdecode(msg_cur, msg_end);
 		if (!*msg_cur) {
 			TRACE_PROTO("malformed message", PEERS_EV_UPDTMSG, NULL, p);
-			goto malformed_free_newts;
+			goto malformed_exit;
 		}
 
 		to_store = MIN(to_read, st->table->key_size - 1);
@@ -1609,27 +1852,26 @@ static int peer_treat_updatemsg(struct appctx *appctx, struct peer *p, int updt,
 			            NULL, p, *msg_cur);
 			TRACE_PROTO("malformed message", PEERS_EV_UPDTMSG,
 			            NULL, p, msg_end, &to_store);
-			goto malformed_free_newts;
+			goto malformed_exit;
 		}
 
-		memcpy(newts->key.key, *msg_cur, to_store);
-		newts->key.key[to_store] = 0;
+		key.key = *msg_cur;
+		key.key_len = to_store;
 		*msg_cur += to_read;
 	}
 	else if (st->table->type == SMP_T_SINT) {
-		unsigned int netinteger;
-
 		if (*msg_cur + sizeof(netinteger) > msg_end) {
 			TRACE_PROTO("malformed message", PEERS_EV_UPDTMSG,
 			            NULL, p, *msg_cur);
 			TRACE_PROTO("malformed message", PEERS_EV_UPDTMSG,
 			            NULL, p, msg_end);
-			goto malformed_free_newts;
+			goto malformed_exit;
 		}
 
 		memcpy(&netinteger, *msg_cur, sizeof(netinteger));
 		netinteger = ntohl(netinteger);
-		memcpy(newts->key.key, &netinteger, sizeof(netinteger));
+		key.key = &netinteger;
+		key.key_len = sizeof(netinteger);
 		*msg_cur += sizeof(netinteger);
 	}
 	else {
@@ -1638,13 +1880,19 @@ static int peer_treat_updatemsg(struct appctx *appctx, struct peer *p, int updt,
 			            NULL, p, *msg_cur);
 			TRACE_PROTO("malformed message", PEERS_EV_UPDTMSG,
 			            NULL, p, msg_end, &st->table->key_size);
-			goto malformed_free_newts;
+			goto malformed_exit;
 		}
 
-		memcpy(newts->key.key, *msg_cur, st->table->key_size);
+		key.key = *msg_cur;
+		key.key_len = st->table->key_size;
 		*msg_cur += st->table->key_size;
 	}
 
+	/* the key is known first so that the entry only reserves its room */
+	newts = stksess_new(st->table, &key);
+	if (!newts)
+		goto ignore_msg;
+
 	/* lookup for existing entry */
 	ts = stktable_set_entry(st->table, newts);
 	if (ts != newts) {
@@ -1689,9 +1937,10 @@ static int peer_treat_updatemsg(struct appctx *appctx, struct peer *p, int updt,
 			struct freq_ctr data;
 
 			/* First bit is reserved for the freq_ctr lock
-			Note: here we're still protected by the stksess lock
-			so we don't need to update the update the freq_ctr
-			using its internal lock */
+			Note: local updates of the freq_ctr do not take the
+			stksess lock, so one may happen while the counter is
+			overwritten here, but the received value wins anyway
+			and the rotation bit is never left set. */
 
 			data.curr_tick = tick_add(now_ms, -decoded_int) & ~0x1;
 			data.curr_ctr = intdecode(msg_cur, msg_end);
@@ -1789,7 +2038,10 @@ static int peer_treat_updatemsg(struct appctx *appctx, struct peer *p, int updt,
 	ts->expire = tick_add(now_ms, expire);
 
 	HA_RWLOCK_WRUNLOCK(STK_SESS_LOCK, &ts->lock);
-	stktable_touch_remote(st->table, ts, 1);
+	if (peer_must_relay(peers, p))
+		stktable_touch_relay(st->table, ts, p->relay_id, 1);
+	else
+		stktable_touch_remote(st->table, ts, 1);
 	TRACE_LEAVE(PEERS_EV_UPDTMSG, NULL, p);
 	return 1;
 
@@ -1807,15 +2059,115 @@ static int peer_treat_updatemsg(struct appctx *appctx, struct peer *p, int updt,
 	TRACE_DEVEL("leaving in error", PEERS_EV_UPDTMSG);
 	return 0;
 
- malformed_free_newts:
-	/* malformed message */
-	stksess_free(st->table, newts);
  malformed_exit:
 	appctx->st0 = PEER_SESS_ST_ERRPROTO;
 	TRACE_DEVEL("leaving in error", PEERS_EV_UPDTMSG);
 	return 0;
 }
 
+/*
+ * Function used to parse a stick-table updates batch message after it has been
+ * received by <p> peer with <msg_cur> as address of the pointer to the position
+ * in the receipt buffer with <msg_end> being position of the end of the message.
+ * Each update record it carries is treated as a regular update message.
+ * <totl> is the length of the batch message computed upon receipt.
+ * Return 1 if succeeded, 0 if not with the appctx state st0 set accordingly.
+ */
+static int peer_treat_batchmsg(struct appctx *appctx, struct peer *p,
+                               char **msg_cur, char *msg_end, int totl)
+{
+	struct buffer *raw = NULL;
+	char *cur, *end;
+	unsigned char flags;
+	int ret = 0;
+
+	TRACE_ENTER(PEERS_EV_UPDTMSG, NULL, p);
+	if (*msg_cur >= msg_end) {
+		TRACE_PROTO("malformed message", PEERS_EV_UPDTMSG, NULL, p);
+		goto malformed;
+	}
+
+	flags = *(*msg_cur)++;
+	cur = *msg_cur;
+	end = msg_end;
+
+	if (flags & PEER_BATCH_F_DEFLATE) {
+#if defined(USE_ZLIB)
+		uLongf rawlen, zlen;
+
+		rawlen = intdecode(&cur, end);
+		if (!cur) {
+			TRACE_PROTO("malformed message", PEERS_EV_UPDTMSG, NULL, p);
+			goto malformed;
+		}
+
+		raw = alloc_trash_chunk();
+		if (!raw) {
+			appctx->st0 = PEER_SESS_ST_END;
+			goto out;
+		}
+
+		if (rawlen > raw->size) {
+			appctx->st0 = PEER_SESS_ST_ERRSIZE;
+			goto out;
+		}
+
+		zlen = rawlen;
+		if (uncompress((Bytef *)raw->area, &zlen, (const Bytef *)cur, end - cur) != Z_OK ||
+		    zlen != rawlen) {
+			TRACE_PROTO("malformed message", PEERS_EV_UPDTMSG, NULL, p);
+			goto malformed;
+		}
+
+		cur = raw->area;
+		end = cur + rawlen;
+#else
+		/* never announced, this peer does not respect the protocol */
+		TRACE_PROTO("malformed message", PEERS_EV_UPDTMSG, NULL, p);
+		goto malformed;
+#endif
+	}
+
+	while (cur < end) {
+		unsigned char type;
+		uint32_t len;
+		char *rec_end;
+		int update, expire;
+
+		type = *cur++;
+		if (type != PEER_MSG_STKT_UPDATE && type != PEER_MSG_STKT_INCUPDATE &&
+		    type != PEER_MSG_STKT_UPDATE_TIMED && type != PEER_MSG_STKT_INCUPDATE_TIMED) {
+			TRACE_PROTO("malformed message", PEERS_EV_UPDTMSG, NULL, p);
+			goto malformed;
+		}
+
+		len = intdecode(&cur, end);
+		if (!cur || cur + len > end) {
+			TRACE_PROTO("malformed message", PEERS_EV_UPDTMSG, NULL, p);
+			goto malformed;
+		}
+
+		rec_end = cur + len;
+		update = type == PEER_MSG_STKT_UPDATE || type == PEER_MSG_STKT_UPDATE_TIMED;
+		expire = type == PEER_MSG_STKT_UPDATE_TIMED || type == PEER_MSG_STKT_INCUPDATE_TIMED;
+		if (!peer_treat_updatemsg(appctx, p, update, expire, &cur, rec_end, len, totl))
+			goto out;
+		cur = rec_end;
+	}
+
+	*msg_cur = msg_end;
+	ret = 1;
+	TRACE_LEAVE(PEERS_EV_UPDTMSG, NULL, p);
+ out:
+	free_trash_chunk(raw);
+	return ret;
+
+ malformed:
+	appctx->st0 = PEER_SESS_ST_ERRPROTO;
+	TRACE_DEVEL("leaving in error", PEERS_EV_UPDTMSG);
+	goto out;
+}
+
 /*
  * Function used to parse a stick-table update acknowledgement message after it
  * has been received by <p> peer with <msg_cur> as address of the pointer to the position in the
@@ -2182,6 +2534,10 @@ static inline int peer_treat_awaited_msg(struct appctx *appctx, struct peer *pee
 				return 0;
 
 		}
+		else if (msg_head[1] == PEER_MSG_STKT_UPDATE_BATCH) {
+			if (!peer_treat_batchmsg(appctx, peer, msg_cur, msg_end, totl))
+				return 0;
+		}
 		else if (msg_head[1] == PEER_MSG_STKT_ACK) {
 			if (!peer_treat_ackmsg(appctx, peer, msg_cur, msg_end))
 				return 0;
@@ -2205,7 +2561,7 @@ static inline int peer_treat_awaited_msg(struct appctx *appctx, struct peer *pee
 static inline int peer_send_msgs(struct appctx *appctx,
                                  struct peer *peer, struct peers *peers)
 {
-	int repl;
+	int repl, more = 0;
 
 	/* Need to request a resync */
 	if ((peer->flags & PEER_F_LEARN_ASSIGN) &&
@@ -2252,21 +2608,28 @@ static inline int peer_send_msgs(struct appctx *appctx,
 						HA_SPIN_UNLOCK(STK_TABLE_LOCK, &st->table->lock);
 						return repl;
 					}
+					if (repl > 1)
+						more = 1;
 				}
 				HA_SPIN_UNLOCK(STK_TABLE_LOCK, &st->table->lock);
 			}
 			else if (!(peer->flags & PEER_F_TEACH_FINISHED)) {
+				repl = 1;
 				if (!(st->flags & SHTABLE_F_TEACH_STAGE1)) {
 					repl = peer_send_teach_stage1_msgs(appctx, peer, st);
 					if (repl <= 0)
 						return repl;
 				}
 
-				if (!(st->flags & SHTABLE_F_TEACH_STAGE2)) {
+				/* stage 2 only starts once stage 1 is complete */
+				if (repl == 1 && !(st->flags & SHTABLE_F_TEACH_STAGE2)) {
 					repl = peer_send_teach_stage2_msgs(appctx, peer, st);
 					if (repl <= 0)
 						return repl;
 				}
+
+				if (repl > 1)
+					more = 1;
 			}
 
 			if (st == last_local_table)
@@ -2275,7 +2638,14 @@ static inline int peer_send_msgs(struct appctx *appctx,
 		}
 	}
 
-	if ((peer->flags & PEER_F_TEACH_PROCESS) && !(peer->flags & PEER_F_TEACH_FINISHED)) {
+	if (more) {
+		/* the tables were interleaved and some of them still have
+		 * updates to send, this will continue once the other tasks
+		 * had a chance to run.
+		 */
+		appctx_wakeup(appctx);
+	}
+	else if ((peer->flags & PEER_F_TEACH_PROCESS) && !(peer->flags & PEER_F_TEACH_FINISHED)) {
 		repl = peer_send_resync_finishedmsg(appctx, peer, peers);
 		if (repl <= 0)
 			return repl;
@@ -2392,8 +2762,8 @@ static inline int peer_getline_last(struct appctx *appctx, struct peer **curpeer
 			break;
 	}
 
-	/* if unknown peer */
-	if (!peer) {
+	/* if unknown peer, or a peer which is not supposed to talk to us */
+	if (!peer || !peer_is_linked(peers, peer)) {
 		appctx->st0 = PEER_SESS_ST_EXIT;
 		appctx->st1 = PEER_SESS_SC_ERRPEER;
 		return -1;
@@ -2602,12 +2972,10 @@ static void peer_io_handler(struct appctx *appctx)
 					curpeer->coll++;
 				}
 				if (maj_ver != (unsigned int)-1 && min_ver != (unsigned int)-1) {
-					if (min_ver == PEER_DWNGRD_MINOR_VER) {
-						curpeer->flags |= PEER_F_DWNGRD;
-					}
-					else {
-						curpeer->flags &= ~PEER_F_DWNGRD;
-					}
+					/* speak the version the remote peer announced,
+					 * it is never above ours.
+					 */
+					curpeer->dwngrd = PEER_MINOR_VER - min_ver;
 				}
 				curpeer->appctx = appctx;
 				curpeer->flags |= PEER_F_ALIVE;
@@ -2696,8 +3064,10 @@ static void peer_io_handler(struct appctx *appctx)
 					init_connected_peer(curpeer, curpeers);
 				}
 				else {
-					if (curpeer->statuscode == PEER_SESS_SC_ERRVERSION)
-						curpeer->flags |= PEER_F_DWNGRD;
+					/* retry with the previous minor version */
+					if (curpeer->statuscode == PEER_SESS_SC_ERRVERSION &&
+					    peer_min_ver(curpeer) > PEER_DWNGRD_MINOR_VER)
+						curpeer->dwngrd++;
 					/* Status code is not success, abort */
 					appctx->st0 = PEER_SESS_ST_END;
 					goto switchstate;
@@ -2989,8 +3359,8 @@ struct task *process_peer_sync(struct task * task, void *context, unsigned int s
 
 		/* For each session */
 		for (ps = peers->remote; ps; ps = ps->next) {
-			/* For each remote peers */
-			if (!ps->local) {
+			/* For each remote peers we must talk to */
+			if (!ps->local && peer_is_linked(peers, ps)) {
 				if (!ps->appctx) {
 					/* no active peer connection */
 					if (ps->statuscode == 0 ||
@@ -3363,6 +3733,23 @@ int peers_alloc_dcache(struct peers *peers)
 	return 1;
 }
 
+/* Returns the number of remote peers of section <peers> with which a session
+ * is currently established. It is read without any lock and is thus only
+ * indicative.
+ */
+int peers_count_connected(const struct peers *peers)
+{
+	const struct peer *p;
+	int count = 0;
+
+	for (p = peers->remote; p; p = p->next) {
+		if (!p->local && HA_ATOMIC_LOAD(&p->appctx) &&
+		    p->statuscode == PEER_SESS_SC_SUCCESSCODE)
+			count++;
+	}
+	return count;
+}
+
 /*
  * Function used to register a table for sync on a group of peers
  * Returns 0 in case of success.
@@ -3713,3 +4100,26 @@ static struct cli_kw_list cli_kws = {{ }, {
 /* Register cli keywords */
 INITCALL1(STG_REGISTER, cli_register_kw, &cli_kws);
 
+/* config parser for global "tune.peers.max-updates-at-once" */
+static int peers_parse_max_updates_at_once(char **args, int section_type, struct proxy *curpx,
+                                           const struct proxy *defpx, const char *file, int line,
+                                           char **err)
+{
+	if (too_many_args(1, args, err, NULL))
+		return -1;
+
+	if (atoi(args[1]) <= 0) {
+		memprintf(err, "'%s' expects a strictly positive numeric value.", args[0]);
+		return -1;
+	}
+	peers_max_updates_at_once = atoi(args[1]);
+	return 0;
+}
+
+static struct cfg_kw_list cfg_kws = {ILH, {
+	{ CFG_GLOBAL, "tune.peers.max-updates-at-once", peers_parse_max_updates_at_once },
+	{ 0, NULL, NULL }
+}};
+
+INITCALL1(STG_REGISTER, cfg_register_keywords, &cfg_kws);
+
@@ -10,6 +10,9 @@
  *
  */
 #include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
 
 #include <haproxy/activity-t.h>
 #include <haproxy/api.h>
@@ -17,13 +20,16 @@
 #include <haproxy/cfgparse.h>
 #include <haproxy/channel.h>
 #include <haproxy/cli.h>
+#include <haproxy/cpuset.h>
 #include <haproxy/errors.h>
 #include <haproxy/global.h>
 #include <haproxy/list.h>
 #include <haproxy/pool.h>
 #include <haproxy/stats-t.h>
 #include <haproxy/stream_interface.h>
+#include <haproxy/task.h>
 #include <haproxy/thread.h>
+#include <haproxy/ticks.h>
 #include <haproxy/tools.h>
 
 
@@ -40,6 +46,16 @@ int mem_poison_byte = -1;
 static int mem_fail_rate = 0;
 #endif
 
+/* size of the huge-page backed area reserved per eligible pool, 0=disabled */
+static unsigned int pool_huge_size = 0;
+
+/* RSS above which free objects are progressively released, in MB, 0=disabled */
+static unsigned int pool_rss_target = 0;
+static struct task *pool_trim_task = NULL;
+#ifdef CONFIG_HAP_POOLS
+static struct tasklet *pool_trim_tasklets[MAX_THREADS];
+#endif
+
 /* Try to find an existing shared pool with the same characteristics and
  * returns it, otherwise creates this one. NULL is returned if no memory
  * is available for a new creation. Two flags are supported :
@@ -69,6 +85,12 @@ struct pool_head *create_pool(char *name, unsigned int size, unsigned int flags)
 		size  = ((size + POOL_EXTRA + align - 1) & -align) - POOL_EXTRA;
 	}
 
+#if defined(CONFIG_HAP_POOLS) && defined(USE_CPU_AFFINITY)
+	/* objects need to carry their node on NUMA systems */
+	if (ha_numa_nodes() > 1)
+		flags |= MEM_F_NUMA;
+#endif
+
 	/* TODO: thread: we do not lock pool list for now because all pools are
 	 * created during HAProxy startup (so before threads creation) */
 	start = &pools;
@@ -121,6 +143,148 @@ struct pool_head *create_pool(char *name, unsigned int size, unsigned int flags)
 	return pool;
 }
 
+/* Returns the size of the areas allocated from the OS for pool <pool>, which
+ * includes the optional link and NUMA node tag.
+ */
+static inline size_t pool_area_size(const struct pool_head *pool)
+{
+	return pool->size + POOL_EXTRA + ((pool->flags & MEM_F_NUMA) ? 1 : 0);
+}
+
+#ifndef DEBUG_UAF
+/* Returns the distance between two consecutive objects in the huge area */
+static inline size_t pool_huge_stride(const struct pool_head *pool)
+{
+	return (pool_area_size(pool) + 15) & -(size_t)16;
+}
+
+/* Returns non-zero if <ptr> was allocated from the huge area of <pool> */
+static inline int pool_huge_owns(const struct pool_head *pool, const void *ptr)
+{
+	const char *area = pool->huge_area;
+
+	return area && area != MAP_FAILED && area != POOL_BUSY &&
+	       (const char *)ptr >= area && (const char *)ptr < area + pool->huge_size;
+}
+
+/* Reserves the huge area of pool <pool>. Explicitly reserved huge pages are
+ * used when available, otherwise a 2MB-aligned area is allocated and the
+ * kernel is advised to back it with transparent huge pages. Pages are only
+ * committed upon first access. Returns the area or NULL on failure.
+ */
+static char *pool_huge_reserve(struct pool_head *pool)
+{
+	size_t size = ((size_t)pool_huge_size + POOL_HUGE_PAGE_SIZE - 1) & -POOL_HUGE_PAGE_SIZE;
+	char *area, *raw;
+	size_t head;
+
+#ifdef MAP_HUGETLB
+	area = mmap(NULL, size, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS|MAP_HUGETLB, -1, 0);
+	if (area != MAP_FAILED)
+		goto done;
+#endif
+	raw = mmap(NULL, size + POOL_HUGE_PAGE_SIZE, PROT_READ|PROT_WRITE,
+	           MAP_PRIVATE|MAP_ANONYMOUS|MAP_NORESERVE, -1, 0);
+	if (raw == MAP_FAILED)
+		return NULL;
+
+	area = (char *)(((uintptr_t)raw + POOL_HUGE_PAGE_SIZE - 1) & -POOL_HUGE_PAGE_SIZE);
+	head = area - raw;
+	if (head)
+		munmap(raw, head);
+	munmap(area + size, POOL_HUGE_PAGE_SIZE - head);
+#ifdef MADV_HUGEPAGE
+	madvise(area, size, MADV_HUGEPAGE);
+#endif
+ done:
+	pool->huge_size = size;
+	return area;
+}
+
+/* Tries to allocate an object for pool <pool> from its huge area, which is
+ * reserved upon first call. Released objects are reused first, then new ones
+ * are carved from the area. Returns NULL if the area is exhausted or could
+ * not be reserved, in which case the caller must fall back to the regular
+ * allocator.
+ */
+static void *pool_huge_get(struct pool_head *pool)
+{
+	size_t stride = pool_huge_stride(pool);
+	char *area;
+	void *ret;
+	size_t ofs;
+
+	area = _HA_ATOMIC_LOAD(&pool->huge_area);
+	if (unlikely(!area)) {
+		/* first use, only one thread reserves the area */
+		if (_HA_ATOMIC_CAS(&pool->huge_area, &area, POOL_BUSY)) {
+			area = pool_huge_reserve(pool);
+			if (!area)
+				area = MAP_FAILED;
+			__ha_barrier_store();
+			_HA_ATOMIC_STORE(&pool->huge_area, area);
+		}
+	}
+
+	while (unlikely(area == POOL_BUSY)) {
+		__ha_cpu_relax();
+		area = _HA_ATOMIC_LOAD(&pool->huge_area);
+	}
+
+	if (area == MAP_FAILED)
+		return NULL;
+
+	/* first try to recycle a released object */
+	ret = _HA_ATOMIC_LOAD(&pool->huge_free);
+	do {
+		while (unlikely(ret == POOL_BUSY)) {
+			__ha_cpu_relax();
+			ret = _HA_ATOMIC_LOAD(&pool->huge_free);
+		}
+		if (ret == NULL)
+			goto carve;
+	} while (unlikely((ret = _HA_ATOMIC_XCHG(&pool->huge_free, POOL_BUSY)) == POOL_BUSY));
+
+	if (unlikely(ret == NULL)) {
+		/* we got the lock on an empty list */
+		_HA_ATOMIC_STORE(&pool->huge_free, NULL);
+		goto carve;
+	}
+
+	/* this releases the lock */
+	_HA_ATOMIC_STORE(&pool->huge_free, *POOL_LINK(pool, ret));
+	return ret;
+
+ carve:
+	/* then carve a new one */
+	if (_HA_ATOMIC_LOAD(&pool->huge_next) + stride > pool->huge_size)
+		return NULL;
+
+	ofs = _HA_ATOMIC_FETCH_ADD(&pool->huge_next, stride);
+	if (ofs + stride > pool->huge_size)
+		return NULL;
+
+	return area + ofs;
+}
+
+/* Returns object <ptr> to the huge area of pool <pool> */
+static void pool_huge_put(struct pool_head *pool, void *ptr)
+{
+	void **free_list;
+
+	free_list = _HA_ATOMIC_LOAD(&pool->huge_free);
+	do {
+		while (unlikely(free_list == POOL_BUSY)) {
+			__ha_cpu_relax();
+			free_list = _HA_ATOMIC_LOAD(&pool->huge_free);
+		}
+		_HA_ATOMIC_STORE(POOL_LINK(pool, ptr), (void *)free_list);
+		__ha_barrier_atomic_store();
+	} while (!_HA_ATOMIC_CAS(&pool->huge_free, &free_list, ptr));
+	__ha_barrier_atomic_store();
+}
+#endif /* DEBUG_UAF */
+
 /* Tries to allocate an object for the pool <pool> using the system's allocator
  * and directly returns it. The pool's allocated counter is checked and updated,
  * but no other checks are performed.
@@ -128,7 +292,14 @@ struct pool_head *create_pool(char *name, unsigned int size, unsigned int flags)
 void *pool_get_from_os(struct pool_head *pool)
 {
 	if (!pool->limit || pool->allocated < pool->limit) {
-		void *ptr = pool_alloc_area(pool->size + POOL_EXTRA);
+		void *ptr = NULL;
+
+#ifndef DEBUG_UAF
+		if (pool_huge_size && pool->size >= POOL_HUGE_MIN_SIZE)
+			ptr = pool_huge_get(pool);
+		if (!ptr)
+#endif
+			ptr = pool_alloc_area(pool_area_size(pool));
 		if (ptr) {
 			_HA_ATOMIC_INC(&pool->allocated);
 			return ptr;
@@ -151,9 +322,12 @@ void pool_put_to_os(struct pool_head *pool, void *ptr)
 	 * free or free of a const area.
 	 */
 	*(uint32_t *)ptr = 0xDEADADD4;
+#else
+	if (unlikely(pool_huge_owns(pool, ptr)))
+		pool_huge_put(pool, ptr);
+	else
 #endif /* DEBUG_UAF */
-
-	pool_free_area(ptr, pool->size + POOL_EXTRA);
+		pool_free_area(ptr, pool_area_size(pool));
 	_HA_ATOMIC_DEC(&pool->allocated);
 }
 
@@ -172,6 +346,10 @@ void *pool_alloc_nocache(struct pool_head *pool)
 	swrate_add_scaled(&pool->needed_avg, POOL_AVG_SAMPLES, pool->used, POOL_AVG_SAMPLES/4);
 	_HA_ATOMIC_INC(&pool->used);
 
+	/* the object belongs to the node of the thread which touches it first */
+	if (pool->flags & MEM_F_NUMA)
+		*POOL_NODE(pool, ptr) = (ti->numa_node >= 0) ? ti->numa_node : POOL_NODE_ANY;
+
 #ifdef DEBUG_MEMORY_POOLS
 	/* keep track of where the element was allocated from */
 	*POOL_LINK(pool, ptr) = (void *)pool;
@@ -193,6 +371,118 @@ void pool_free_nocache(struct pool_head *pool, void *ptr)
 
 #ifdef CONFIG_HAP_POOLS
 
+/* Tries to retrieve an object from the free list of NUMA node <node> of pool
+ * <pool>. Returns NULL if none is available. The principle is the same as for
+ * the shared cache.
+ */
+void *pool_get_from_node(struct pool_head *pool, int node)
+{
+	struct pool_node_head *nh = &pool->nodes[node];
+	void *ret;
+
+	ret = _HA_ATOMIC_LOAD(&nh->free_list);
+	do {
+		while (unlikely(ret == POOL_BUSY)) {
+			__ha_cpu_relax();
+			ret = _HA_ATOMIC_LOAD(&nh->free_list);
+		}
+		if (ret == NULL)
+			return ret;
+	} while (unlikely((ret = _HA_ATOMIC_XCHG(&nh->free_list, POOL_BUSY)) == POOL_BUSY));
+
+	if (unlikely(ret == NULL)) {
+		_HA_ATOMIC_STORE(&nh->free_list, NULL);
+		goto out;
+	}
+
+	/* this releases the lock */
+	_HA_ATOMIC_STORE(&nh->free_list, *POOL_LINK(pool, ret));
+	_HA_ATOMIC_INC(&pool->used);
+
+#ifdef DEBUG_MEMORY_POOLS
+	/* keep track of where the element was allocated from */
+	*POOL_LINK(pool, ret) = (void *)pool;
+#endif
+ out:
+	__ha_barrier_atomic_store();
+	return ret;
+}
+
+/* Releases object <ptr> of pool <pool> to the free list of NUMA node <node>,
+ * or to the OS if the pool already has too many free objects.
+ */
+void pool_put_to_node(struct pool_head *pool, void *ptr, int node)
+{
+	struct pool_node_head *nh = &pool->nodes[node];
+	void **free_list;
+
+	_HA_ATOMIC_DEC(&pool->used);
+
+	if (unlikely(pool_is_crowded(pool))) {
+		pool_put_to_os(pool, ptr);
+	} else {
+		free_list = _HA_ATOMIC_LOAD(&nh->free_list);
+		do {
+			while (unlikely(free_list == POOL_BUSY)) {
+				__ha_cpu_relax();
+				free_list = _HA_ATOMIC_LOAD(&nh->free_list);
+			}
+			_HA_ATOMIC_STORE(POOL_LINK(pool, ptr), (void *)free_list);
+			__ha_barrier_atomic_store();
+		} while (!_HA_ATOMIC_CAS(&nh->free_list, &free_list, ptr));
+		__ha_barrier_atomic_store();
+	}
+	swrate_add(&pool->needed_avg, POOL_AVG_SAMPLES, pool->used);
+}
+
+/* Releases all objects from the per-node free lists of pool <pool> to the OS */
+static void pool_flush_nodes(struct pool_head *pool)
+{
+	void *next, *temp;
+	int node;
+
+	if (!(pool->flags & MEM_F_NUMA))
+		return;
+
+	for (node = 0; node < HA_MAX_NODES; node++) {
+		struct pool_node_head *nh = &pool->nodes[node];
+
+		next = _HA_ATOMIC_LOAD(&nh->free_list);
+		do {
+			while (unlikely(next == POOL_BUSY)) {
+				__ha_cpu_relax();
+				next = _HA_ATOMIC_LOAD(&nh->free_list);
+			}
+			if (next == NULL)
+				break;
+		} while (unlikely((next = _HA_ATOMIC_XCHG(&nh->free_list, POOL_BUSY)) == POOL_BUSY));
+
+		if (next == NULL)
+			continue;
+
+		_HA_ATOMIC_STORE(&nh->free_list, NULL);
+		__ha_barrier_atomic_store();
+
+		while (next) {
+			temp = next;
+			next = *POOL_LINK(pool, temp);
+			pool_put_to_os(pool, temp);
+		}
+	}
+}
+
+/* Releases object <item> evicted from the local cache of pool <pool> to the
+ * shared cache, or to the local node's free list on NUMA systems so that it
+ * is not reused by a thread running on another node.
+ */
+static inline void pool_put_evicted(struct pool_head *pool, void *item)
+{
+	if ((pool->flags & MEM_F_NUMA) && ti->numa_node >= 0)
+		pool_put_to_node(pool, item, ti->numa_node);
+	else
+		pool_put_to_shared_cache(pool, item);
+}
+
 /* Evicts some of the oldest objects from one local cache, until its number of
  * objects is no more than 16+1/8 of the total number of locally cached objects
  * or the total size of the local cache is no more than 75% of its maximum (i.e.
@@ -212,32 +502,40 @@ void pool_evict_from_local_cache(struct pool_head *pool)
 		pool_cache_count--;
 		LIST_DELETE(&item->by_pool);
 		LIST_DELETE(&item->by_lru);
-		pool_put_to_shared_cache(pool, item);
+		pool_put_evicted(pool, item);
 	}
 }
 
-/* Evicts some of the oldest objects from the local cache, pushing them to the
- * global pool.
+/* Evicts the oldest object from the local cache, which must not be empty,
+ * pushing it to the global pool.
  */
-void pool_evict_from_local_caches()
+static inline void pool_evict_oldest_from_local_cache()
 {
 	struct pool_cache_item *item;
 	struct pool_cache_head *ph;
 	struct pool_head *pool;
 
+	item = LIST_PREV(&ti->pool_lru_head, struct pool_cache_item *, by_lru);
+	/* note: by definition we remove oldest objects so they also are the
+	 * oldest in their own pools, thus their next is the pool's head.
+	 */
+	ph = LIST_NEXT(&item->by_pool, struct pool_cache_head *, list);
+	pool = container_of(ph - tid, struct pool_head, cache);
+	LIST_DELETE(&item->by_pool);
+	LIST_DELETE(&item->by_lru);
+	ph->count--;
+	pool_cache_count--;
+	pool_cache_bytes -= pool->size;
+	pool_put_evicted(pool, item);
+}
+
+/* Evicts some of the oldest objects from the local cache, pushing them to the
+ * global pool.
+ */
+void pool_evict_from_local_caches()
+{
 	do {
-		item = LIST_PREV(&ti->pool_lru_head, struct pool_cache_item *, by_lru);
-		/* note: by definition we remove oldest objects so they also are the
-		 * oldest in their own pools, thus their next is the pool's head.
-		 */
-		ph = LIST_NEXT(&item->by_pool, struct pool_cache_head *, list);
-		pool = container_of(ph - tid, struct pool_head, cache);
-		LIST_DELETE(&item->by_pool);
-		LIST_DELETE(&item->by_lru);
-		ph->count--;
-		pool_cache_count--;
-		pool_cache_bytes -= pool->size;
-		pool_put_to_shared_cache(pool, item);
+		pool_evict_oldest_from_local_cache();
 	} while (pool_cache_bytes > CONFIG_HAP_POOL_CACHE_SIZE * 7 / 8);
 }
 
@@ -267,14 +565,23 @@ void pool_put_to_cache(struct pool_head *pool, void *ptr)
 
 #if defined(CONFIG_HAP_NO_GLOBAL_POOLS)
 
-/* legacy stuff */
+/* only the per-node free lists may hold objects */
 void pool_flush(struct pool_head *pool)
 {
+	if (pool)
+		pool_flush_nodes(pool);
 }
 
-/* This function might ask the malloc library to trim its buffers. */
+/* This function releases the objects held in the per-node free lists and
+ * might ask the malloc library to trim its buffers.
+ */
 void pool_gc(struct pool_head *pool_ctx)
 {
+	struct pool_head *entry;
+
+	list_for_each_entry(entry, &pools, list)
+		pool_flush_nodes(entry);
+
 #if defined(HA_HAVE_MALLOC_TRIM)
 	malloc_trim(0);
 #endif
@@ -292,6 +599,8 @@ void pool_flush(struct pool_head *pool)
 	if (!pool)
 		return;
 
+	pool_flush_nodes(pool);
+
 	/* The loop below atomically detaches the head of the free list and
 	 * replaces it with a NULL. Then the list can be released.
 	 */
@@ -337,6 +646,7 @@ void pool_gc(struct pool_head *pool_ctx)
 			entry->free_list = *POOL_LINK(entry, temp);
 			pool_put_to_os(entry, temp);
 		}
+		pool_flush_nodes(entry);
 	}
 
 #if defined(HA_HAVE_MALLOC_TRIM)
@@ -348,6 +658,42 @@ void pool_gc(struct pool_head *pool_ctx)
 }
 #endif /* CONFIG_HAP_NO_GLOBAL_POOLS */
 
+/* Releases to the OS half of the free objects of each pool in excess of its
+ * minimum, as well as the objects of the per-node free lists. This is used to
+ * progressively reduce the memory usage when tune.pool-rss-target is set. The
+ * caller must be isolated.
+ */
+static void pool_trim_shared_caches()
+{
+	struct pool_head *entry;
+
+	list_for_each_entry(entry, &pools, list) {
+#if !defined(CONFIG_HAP_NO_GLOBAL_POOLS)
+		int excess = ((int)(entry->allocated - entry->used) - (int)entry->minavail + 1) / 2;
+		void *temp;
+
+		while (excess-- > 0 && entry->free_list) {
+			temp = entry->free_list;
+			entry->free_list = *POOL_LINK(entry, temp);
+			pool_put_to_os(entry, temp);
+		}
+#endif
+		pool_flush_nodes(entry);
+	}
+}
+
+/* Per-thread tasklet evicting the oldest half of the local cache of the thread
+ * it runs on when tune.pool-rss-target is exceeded.
+ */
+static struct task *pool_trim_local_cache(struct task *t, void *context, unsigned int state)
+{
+	size_t target = pool_cache_bytes / 2;
+
+	while (pool_cache_bytes > target)
+		pool_evict_oldest_from_local_cache();
+	return t;
+}
+
 #else  /* CONFIG_HAP_POOLS */
 
 /* legacy stuff */
@@ -365,6 +711,104 @@ void pool_gc(struct pool_head *pool_ctx)
 
 #endif /* CONFIG_HAP_POOLS */
 
+/* Returns the resident set size of the process in bytes, or 0 if it cannot be
+ * retrieved.
+ */
+static ullong pool_get_rss()
+{
+	static long page_size = 0;
+	char buf[64];
+	ssize_t len;
+	char *p;
+	int fd;
+
+	if (!page_size)
+		page_size = sysconf(_SC_PAGESIZE);
+
+	fd = open("/proc/self/statm", O_RDONLY);
+	if (fd < 0)
+		return 0;
+	len = read(fd, buf, sizeof(buf) - 1);
+	close(fd);
+	if (len <= 0)
+		return 0;
+	buf[len] = 0;
+
+	/* the RSS in pages is the second field */
+	p = strchr(buf, ' ');
+	if (!p || page_size <= 0)
+		return 0;
+	return strtoull(p + 1, NULL, 10) * page_size;
+}
+
+/* Low priority task checking the RSS against tune.pool-rss-target. As long as
+ * it is exceeded, the threads are asked to evict the oldest half of their
+ * local cache, part of the free objects of the pools are released to the OS,
+ * and the malloc library is asked to trim its buffers. The objects evicted
+ * from the local caches are released on the next runs if still needed.
+ */
+static struct task *pool_trim_process(struct task *t, void *context, unsigned int state)
+{
+#ifdef CONFIG_HAP_POOLS
+	int thr;
+#endif
+
+	if (pool_get_rss() > (ullong)pool_rss_target << 20) {
+#ifdef CONFIG_HAP_POOLS
+		for (thr = 0; thr < global.nbthread; thr++)
+			tasklet_wakeup(pool_trim_tasklets[thr]);
+
+		thread_isolate();
+		pool_trim_shared_caches();
+		thread_release();
+#endif
+#if defined(HA_HAVE_MALLOC_TRIM)
+		malloc_trim(0);
+#endif
+	}
+
+	t->expire = tick_add(now_ms, MS_TO_TICKS(POOL_TRIM_INTERVAL));
+	return t;
+}
+
+/* Starts the trim task if tune.pool-rss-target is set. Returns 0 on success,
+ * otherwise ERR_* flags.
+ */
+static int pool_trim_init()
+{
+#ifdef CONFIG_HAP_POOLS
+	int thr;
+#endif
+
+	if (!pool_rss_target)
+		return 0;
+
+#ifdef CONFIG_HAP_POOLS
+	for (thr = 0; thr < global.nbthread; thr++) {
+		pool_trim_tasklets[thr] = tasklet_new();
+		if (!pool_trim_tasklets[thr])
+			goto fail;
+		pool_trim_tasklets[thr]->tid = thr;
+		pool_trim_tasklets[thr]->process = pool_trim_local_cache;
+	}
+#endif
+
+	pool_trim_task = task_new(MAX_THREADS_MASK);
+	if (!pool_trim_task)
+		goto fail;
+	pool_trim_task->process = pool_trim_process;
+	pool_trim_task->nice = 1024;
+	pool_trim_task->expire = tick_add(now_ms, MS_TO_TICKS(POOL_TRIM_INTERVAL));
+	task_queue(pool_trim_task);
+	return 0;
+
+ fail:
+	ha_alert("Out of memory while initializing the pools' trim task.\n");
+	return ERR_ALERT | ERR_FATAL;
+}
+
+REGISTER_POST_CHECK(pool_trim_init);
+
 /*
  * This function destroys a pool by freeing it completely, unless it's still
  * in use. This should be called only under extreme circumstances. It always
@@ -382,6 +826,8 @@ void *pool_destroy(struct pool_head *pool)
 		if (!pool->users) {
 			LIST_DELETE(&pool->list);
 			/* note that if used == 0, the cache is empty */
+			if (pool->huge_area && pool->huge_area != MAP_FAILED)
+				munmap(pool->huge_area, pool->huge_size);
 			free(pool);
 		}
 	}
@@ -407,12 +853,18 @@ void dump_pools_to_trash()
 	allocated = used = nbpools = 0;
 	chunk_printf(&trash, "Dumping pools usage. Use SIGQUIT to flush them.\n");
 	list_for_each_entry(entry, &pools, list) {
-		chunk_appendf(&trash, "  - Pool %s (%u bytes) : %u allocated (%u bytes), %u used, needed_avg %u, %u failures, %u users, @%p%s\n",
+		chunk_appendf(&trash, "  - Pool %s (%u bytes) : %u allocated (%u bytes), %u used, needed_avg %u, %u failures, %u users, @%p%s%s\n",
 			 entry->name, entry->size, entry->allocated,
 		         entry->size * entry->allocated, entry->used,
 		         swrate_avg(entry->needed_avg, POOL_AVG_SAMPLES), entry->failed,
 			 entry->users, entry,
-			 (entry->flags & MEM_F_SHARED) ? " [SHARED]" : "");
+			 (entry->flags & MEM_F_SHARED) ? " [SHARED]" : "",
+			 (entry->flags & MEM_F_NUMA) ? " [NUMA]" : "");
+
+		if (entry->huge_area && entry->huge_area != MAP_FAILED)
+			chunk_appendf(&trash, "    huge pages area: %lu bytes reserved, %lu carved\n",
+			              (ulong)entry->huge_size,
+			              (ulong)MIN(entry->huge_next, entry->huge_size));
 
 		allocated += entry->allocated * entry->size;
 		used += entry->used * entry->size;
@@ -500,6 +952,7 @@ static void init_pools()
 
 	for (thr = 0; thr < MAX_THREADS; thr++) {
 		LIST_INIT(&ha_thread_info[thr].pool_lru_head);
+		ha_thread_info[thr].numa_node = -1;
 	}
 #endif
 }
@@ -546,11 +999,60 @@ static int mem_parse_global_fail_alloc(char **args, int section_type, struct pro
 }
 #endif
 
+/* config parser for global "tune.pool-hugepages" */
+static int mem_parse_global_pool_hugepages(char **args, int section_type, struct proxy *curpx,
+                                           const struct proxy *defpx, const char *file, int line,
+                                           char **err)
+{
+	const char *res;
+
+	if (too_many_args(1, args, err, NULL))
+		return -1;
+
+	if (!*args[1]) {
+		memprintf(err, "'%s' expects a size in bytes, with an optional unit suffix.", args[0]);
+		return -1;
+	}
+
+	res = parse_size_err(args[1], &pool_huge_size);
+	if (res) {
+		memprintf(err, "unexpected '%s' after size passed to '%s'.", res, args[0]);
+		return -1;
+	}
+#ifdef DEBUG_UAF
+	if (pool_huge_size)
+		memprintf(err, "'%s' is ignored when built with DEBUG_UAF.", args[0]);
+	pool_huge_size = 0;
+	return *err ? 1 : 0;
+#endif
+	return 0;
+}
+
+/* config parser for global "tune.pool-rss-target" */
+static int mem_parse_global_pool_rss_target(char **args, int section_type, struct proxy *curpx,
+                                            const struct proxy *defpx, const char *file, int line,
+                                            char **err)
+{
+	char *end;
+
+	if (too_many_args(1, args, err, NULL))
+		return -1;
+
+	pool_rss_target = strtoul(args[1], &end, 10);
+	if (!*args[1] || *end) {
+		memprintf(err, "'%s' expects a size in megabytes.", args[0]);
+		return -1;
+	}
+	return 0;
+}
+
 /* register global config keywords */
 static struct cfg_kw_list mem_cfg_kws = {ILH, {
 #ifdef DEBUG_FAIL_ALLOC
 	{ CFG_GLOBAL, "tune.fail-alloc", mem_parse_global_fail_alloc },
 #endif
+	{ CFG_GLOBAL, "tune.pool-hugepages", mem_parse_global_pool_hugepages },
+	{ CFG_GLOBAL, "tune.pool-rss-target", mem_parse_global_pool_rss_target },
 	{ 0, NULL, NULL }
 }};
 
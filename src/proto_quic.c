@@ -514,9 +514,7 @@ int quic_connect_server(struct connection *conn, int flags)
  */
 static void quic_add_listener(struct protocol *proto, struct listener *listener)
 {
-	LIST_INIT(&listener->rx.qpkts);
-	listener->rx.odcids = EB_ROOT_UNIQUE;
-	listener->rx.cids = EB_ROOT_UNIQUE;
+	listener->rx.quic_thr = NULL;
 	default_add_listener(proto, listener);
 }
 
@@ -537,6 +535,7 @@ static int quic_bind_listener(struct listener *listener, char *errmsg, int errle
 {
 	int err = ERR_NONE;
 	char *msg = NULL;
+	int i;
 
 	/* ensure we never return garbage */
 	if (errlen)
@@ -550,6 +549,26 @@ static int quic_bind_listener(struct listener *listener, char *errmsg, int errle
 		goto udp_return;
 	}
 
+	/* each thread handles the connections whose IDs designate it */
+	listener->rx.quic_thr = calloc(MAX_THREADS, sizeof(*listener->rx.quic_thr));
+	if (!listener->rx.quic_thr) {
+		msg = "not enough memory";
+		err |= ERR_ALERT | ERR_FATAL;
+		goto udp_return;
+	}
+	for (i = 0; i < MAX_THREADS; i++) {
+		LIST_INIT(&listener->rx.quic_thr[i].qpkts);
+		listener->rx.quic_thr[i].odcids = EB_ROOT_UNIQUE;
+		listener->rx.quic_thr[i].cids = EB_ROOT_UNIQUE;
+	}
+	/* and accepts them itself, the queued packets being per-thread */
+	listener->rx.flags |= RX_F_LOCAL_ACCEPT;
+
+	/* let the kernel aggregate datagrams, they are split on receipt */
+	quic_sock_enable_gro(listener->rx.fd);
+	/* and let it split the datagrams we send at once */
+	quic_sock_enable_gso(listener->rx.fd);
+
 	listener_set_state(listener, LI_LISTEN);
 
  udp_return:
@@ -10,6 +10,7 @@
  *
  */
 
+#include <ctype.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <string.h>
@@ -19,6 +20,7 @@
 
 #include <import/eb32tree.h>
 #include <import/ebistree.h>
+#include <import/ebsttree.h>
 
 #include <haproxy/acl.h>
 #include <haproxy/api.h>
@@ -32,17 +34,24 @@
 #include <haproxy/global.h>
 #include <haproxy/http_ana.h>
 #include <haproxy/http_htx.h>
+#include <haproxy/lb_local.h>
 #include <haproxy/listener.h>
 #include <haproxy/log.h>
+#include <haproxy/net_helper.h>
 #include <haproxy/obj_type-t.h>
+#include <haproxy/pattern.h>
 #include <haproxy/peers.h>
 #include <haproxy/pool.h>
 #include <haproxy/protocol.h>
 #include <haproxy/proto_tcp.h>
 #include <haproxy/proxy.h>
+#include <haproxy/queue.h>
+#include <haproxy/rmtree.h>
 #include <haproxy/server-t.h>
+#include <haproxy/server.h>
 #include <haproxy/signal.h>
 #include <haproxy/stats-t.h>
+#include <haproxy/stick_table.h>
 #include <haproxy/stream.h>
 #include <haproxy/stream_interface.h>
 #include <haproxy/task.h>
@@ -97,6 +106,12 @@ const struct cfg_opt cfg_opts2[] =
         { "splice-response", 0, 0, 0, 0 },
         { "splice-auto",     0, 0, 0, 0 },
 #endif
+#ifdef USE_SOCKMAP
+	{ "sockmap",                      PR_O2_SOCKMAP,   PR_CAP_FE|PR_CAP_BE, 0, PR_MODE_TCP },
+#else
+	{ "sockmap",                      0, 0, 0, 0 },
+#endif
+	{ "udp-stateless",                PR_O2_UDP_STLS,  PR_CAP_FE, 0, PR_MODE_UDP },
 	{ "accept-invalid-http-request",  PR_O2_REQBUG_OK, PR_CAP_FE, 0, PR_MODE_HTTP },
 	{ "accept-invalid-http-response", PR_O2_RSPBUG_OK, PR_CAP_BE, 0, PR_MODE_HTTP },
 	{ "dontlog-normal",               PR_O2_NOLOGNORM, PR_CAP_FE, 0, 0 },
@@ -116,6 +131,22 @@ const struct cfg_opt cfg_opts2[] =
 	{ NULL, 0, 0, 0 }
 };
 
+/* Releases index <idx> and the names it contains. */
+static void switching_idx_free(struct switching_idx *idx)
+{
+	struct ebmb_node *node, *next;
+
+	if (!idx)
+		return;
+
+	for (node = ebmb_first(&idx->hosts); node; node = next) {
+		next = ebmb_next(node);
+		ebmb_delete(node);
+		free(container_of(node, struct switching_host, node));
+	}
+	free(idx);
+}
+
 static void free_stick_rules(struct list *rules)
 {
 	struct sticking_rule *rule, *ruleb;
@@ -146,6 +177,7 @@ void free_proxy(struct proxy *p)
 
 	free(p->conf.file);
 	free(p->id);
+	free(p->promex_labels);
 	free(p->cookie_name);
 	free(p->cookie_domain);
 	free(p->cookie_attrs);
@@ -170,6 +202,11 @@ void free_proxy(struct proxy *p)
 	free(p->conf.uif_file);
 	if ((p->lbprm.algo & BE_LB_LKUP) == BE_LB_LKUP_MAP)
 		free(p->lbprm.map.srv);
+	else if ((p->lbprm.algo & BE_LB_LKUP) == BE_LB_LKUP_MAGLEV) {
+		free(p->lbprm.maglev.table);
+		free(p->lbprm.maglev.spare);
+	}
+	lb_local_deinit(p);
 
 	if (p->conf.logformat_sd_string != default_rfc5424_sd_log_format)
 		free(p->conf.logformat_sd_string);
@@ -183,6 +220,10 @@ void free_proxy(struct proxy *p)
 
 	EXTRA_COUNTERS_FREE(p->extra_counters_fe);
 	EXTRA_COUNTERS_FREE(p->extra_counters_be);
+	rmtree_destroy(&p->used_server_addr);
+	free(p->fe_counters.shards);
+	free(p->be_counters.shards);
+	free(p->be_counters.hist);
 
 	list_for_each_entry_safe(acl, aclb, &p->acl, list) {
 		LIST_DELETE(&acl->list);
@@ -206,6 +247,7 @@ void free_proxy(struct proxy *p)
 
 	list_for_each_entry_safe(rule, ruleb, &p->switching_rules, list) {
 		LIST_DELETE(&rule->list);
+		switching_idx_free(rule->idx);
 		if (rule->cond) {
 			prune_acl_cond(rule->cond);
 			free(rule->cond);
@@ -295,7 +337,11 @@ void free_proxy(struct proxy *p)
 	list_for_each_entry_safe(l, l_next, &p->conf.listeners, by_fe) {
 		LIST_DELETE(&l->by_fe);
 		LIST_DELETE(&l->by_bind);
+		if (l->rx.settings != &l->bind_conf->settings)
+			free(l->rx.settings);
 		free(l->name);
+		if (l->counters)
+			free(l->counters->shards);
 		free(l->counters);
 
 		EXTRA_COUNTERS_FREE(l->extra_counters);
@@ -324,8 +370,12 @@ void free_proxy(struct proxy *p)
 
 	pool_destroy(p->req_cap_pool);
 	pool_destroy(p->rsp_cap_pool);
-	if (p->table)
-		pool_destroy(p->table->pool);
+	if (p->table) {
+		unsigned int i;
+
+		for (i = 0; i < p->table->nb_key_classes; i++)
+			pool_destroy(p->table->key_classes[i].pool);
+	}
 
 	HA_RWLOCK_DESTROY(&p->lbprm.lock);
 	HA_RWLOCK_DESTROY(&p->lock);
@@ -365,6 +415,8 @@ const char *proxy_mode_str(int mode) {
 		return "http";
 	else if (mode == PR_MODE_CLI)
 		return "cli";
+	else if (mode == PR_MODE_UDP)
+		return "udp";
 	else
 		return "unknown";
 }
@@ -444,10 +496,7 @@ int get_backend_server(const char *bk_name, const char *sv_name,
 	if (!p)
 		return 0;
 
-	for (s = p->srv; s; s = s->next)
-		if ((sid >= 0 && s->puid == sid) ||
-		    (sid < 0 && strcmp(s->id, sv_name) == 0))
-			break;
+	s = (sid >= 0) ? server_find_by_id(p, sid) : server_find_by_name(p, sv_name);
 	*sv = s;
 	if (!s)
 		return 0;
@@ -507,6 +556,10 @@ static int proxy_parse_timeout(char **args, int section, struct proxy *proxy,
 		tv = &proxy->timeout.connect;
 		td = &defpx->timeout.connect;
 		cap = PR_CAP_BE;
+	} else if (strcmp(args[0], "hedge") == 0) {
+		tv = &proxy->timeout.hedge;
+		td = &defpx->timeout.hedge;
+		cap = PR_CAP_BE;
 	} else if (strcmp(args[0], "check") == 0) {
 		tv = &proxy->timeout.check;
 		td = &defpx->timeout.check;
@@ -540,7 +593,7 @@ static int proxy_parse_timeout(char **args, int section, struct proxy *proxy,
 		memprintf(err,
 		          "'timeout' supports 'client', 'server', 'connect', 'check', "
 		          "'queue', 'http-keep-alive', 'http-request', 'tunnel', 'tarpit', "
-			  "'client-fin' and 'server-fin' (got '%s')",
+			  "'client-fin', 'server-fin' and 'hedge' (got '%s')",
 		          args[0]);
 		return -1;
 	}
@@ -1085,6 +1138,236 @@ struct proxy *proxy_find_by_name(const char *name, int cap, int table)
 	return NULL;
 }
 
+/* Returns non-zero if ACL expression <expr> performs an exact match of the
+ * Host header values against strings, regardless of their case.
+ */
+static int switching_host_expr(const struct acl_expr *expr)
+{
+	const struct sample_conv_expr *conv;
+	const struct pattern_expr_list *pel;
+	const struct arg *args = expr->smp->arg_p;
+	int lower = 0;
+
+	if (expr->pat.match != pat_match_str)
+		return 0;
+
+	if (strcmp(expr->smp->fetch->kw, "hdr") != 0 && strcmp(expr->smp->fetch->kw, "req.hdr") != 0)
+		return 0;
+
+	/* no occurrence, all values are considered */
+	if (!args || args[0].type != ARGT_STR || args[1].type != ARGT_STOP ||
+	    !isteqi(ist2(args[0].data.str.area, args[0].data.str.data), ist("host")))
+		return 0;
+
+	list_for_each_entry(conv, &expr->smp->conv_exprs, list) {
+		if (lower || strcmp(conv->conv->kw, "lower") != 0)
+			return 0;
+		lower = 1;
+	}
+
+	list_for_each_entry(pel, &expr->pat.head, list) {
+		if (!lower && !(pel->expr->mflags & PAT_MF_IGNORE_CASE))
+			return 0;
+	}
+	return 1;
+}
+
+/* Returns the ACL of switching rule <rule> if its condition may be evaluated
+ * using a host name index, that is, if it's only made of this ACL, which only
+ * contains expressions accepted by switching_host_expr(). Otherwise NULL is
+ * returned.
+ */
+static struct acl *switching_host_acl(const struct switching_rule *rule)
+{
+	struct acl_term_suite *suite;
+	struct acl_term *term;
+	struct acl_expr *expr;
+
+	if (!rule->cond || rule->cond->pol != ACL_COND_IF ||
+	    LIST_ISEMPTY(&rule->cond->suites) || rule->cond->suites.n->n != &rule->cond->suites)
+		return NULL;
+
+	suite = LIST_NEXT(&rule->cond->suites, struct acl_term_suite *, list);
+	if (LIST_ISEMPTY(&suite->terms) || suite->terms.n->n != &suite->terms)
+		return NULL;
+
+	term = LIST_NEXT(&suite->terms, struct acl_term *, list);
+	if (term->neg || LIST_ISEMPTY(&term->acl->expr))
+		return NULL;
+
+	list_for_each_entry(expr, &term->acl->expr, list) {
+		if (!switching_host_expr(expr))
+			return NULL;
+	}
+	return term->acl;
+}
+
+/* Adds host name <name> of length <len> matched by <rule> to index <idx>,
+ * unless a previous rule already matches it, or unless it cannot match because
+ * it contains upper case characters while the case was not ignored (<icase> is
+ * zero). Returns 1 if the name was indexed, 0 if it was ignored, or -1 on
+ * memory allocation error.
+ */
+static int switching_idx_add(struct switching_idx *idx, struct switching_rule *rule,
+                             const char *name, size_t len, int icase)
+{
+	struct switching_host *host;
+	size_t i;
+
+	host = malloc(sizeof(*host) + len + 1);
+	if (!host)
+		return -1;
+
+	for (i = 0; i < len; i++) {
+		if (!icase && isupper((unsigned char)name[i])) {
+			free(host);
+			return 0;
+		}
+		host->node.key[i] = tolower((unsigned char)name[i]);
+	}
+	host->node.key[len] = 0;
+	host->rule = rule;
+
+	if (ebst_insert(&idx->hosts, &host->node) != &host->node) {
+		free(host);
+		return 0;
+	}
+	return 1;
+}
+
+/* Indexes the patterns of the expressions of ACL <acl> into <idx> for rule
+ * <rule>, and adds the number of indexed names to <count>. Returns 0 on
+ * memory allocation error, otherwise non-zero.
+ */
+static int switching_idx_add_acl(struct switching_idx *idx, struct switching_rule *rule,
+                                 struct acl *acl, int *count)
+{
+	struct pattern_expr_list *pel;
+	struct pattern_list *plist;
+	struct pattern_tree *ptree;
+	struct ebmb_node *node;
+	struct acl_expr *expr;
+	int icase, ret;
+
+	list_for_each_entry(expr, &acl->expr, list) {
+		list_for_each_entry(pel, &expr->pat.head, list) {
+			icase = pel->expr->mflags & PAT_MF_IGNORE_CASE;
+
+			list_for_each_entry(plist, &pel->expr->patterns, list) {
+				ret = switching_idx_add(idx, rule, plist->pat.ptr.str, plist->pat.len, icase);
+				if (ret < 0)
+					return 0;
+				*count += ret;
+			}
+
+			for (node = ebmb_first(&pel->expr->pattern_tree); node; node = ebmb_next(node)) {
+				ptree = container_of(node, struct pattern_tree, node);
+				ret = switching_idx_add(idx, rule, (const char *)ptree->node.key,
+				                        strlen((const char *)ptree->node.key), icase);
+				if (ret < 0)
+					return 0;
+				*count += ret;
+			}
+		}
+	}
+	return 1;
+}
+
+/* Attaches index <idx> to the first rule of its run if it holds enough names
+ * to be worth it, and marks the pattern references it was built from so that
+ * changes to them disable it. Otherwise the index is released.
+ */
+static void switching_idx_close(struct switching_idx *idx, struct switching_rule *first, int count)
+{
+	struct switching_rule *rule;
+	struct pattern_expr_list *pel;
+	struct acl_expr *expr;
+	struct acl *acl;
+
+	if (count < SWITCHING_IDX_MIN_KEYS) {
+		switching_idx_free(idx);
+		return;
+	}
+
+	for (rule = first; ; rule = LIST_NEXT(&rule->list, struct switching_rule *, list)) {
+		acl = switching_host_acl(rule);
+		list_for_each_entry(expr, &acl->expr, list) {
+			list_for_each_entry(pel, &expr->pat.head, list) {
+				if (pel->expr->ref)
+					pel->expr->ref->flags |= PAT_REF_INDEXED;
+			}
+		}
+		if (rule == idx->last)
+			break;
+	}
+
+	idx->rev = pat_ref_indexed_rev;
+	first->idx = idx;
+}
+
+/* Replaces the runs of consecutive switching rules of proxy <px> which only
+ * match the Host header against a list of names by a single lookup in an index
+ * of these names. Returns ERR_NONE on success, or an error code on memory
+ * allocation error.
+ */
+static int proxy_index_switching_rules(struct proxy *px)
+{
+	struct switching_rule *rule, *first = NULL;
+	struct switching_idx *idx = NULL;
+	struct acl *acl;
+	int count = 0;
+
+	list_for_each_entry(rule, &px->switching_rules, list) {
+		acl = switching_host_acl(rule);
+		if (!acl) {
+			if (idx)
+				switching_idx_close(idx, first, count);
+			idx = NULL;
+			continue;
+		}
+
+		if (!idx) {
+			idx = calloc(1, sizeof(*idx));
+			if (!idx)
+				goto alloc_error;
+			idx->hosts = EB_ROOT_UNIQUE;
+			idx->smp = LIST_NEXT(&acl->expr, struct acl_expr *, list)->smp;
+			first = rule;
+			count = 0;
+		}
+
+		rule->rank = rule == first ? 0 : idx->last->rank + 1;
+		idx->last = rule;
+		if (!switching_idx_add_acl(idx, rule, acl, &count))
+			goto alloc_error;
+	}
+
+	if (idx)
+		switching_idx_close(idx, first, count);
+	return ERR_NONE;
+
+ alloc_error:
+	switching_idx_free(idx);
+	ha_alert("Proxy '%s': out of memory while indexing the 'use_backend' rules.\n", px->id);
+	return ERR_ALERT | ERR_FATAL;
+}
+
+/* Builds the indexes of the switching rules of all frontends. */
+static int proxy_index_all_switching_rules()
+{
+	struct proxy *px;
+	int err_code = ERR_NONE;
+
+	for (px = proxies_list; px && !(err_code & ERR_FATAL); px = px->next) {
+		if (!(px->cap & PR_CAP_FE) || px->disabled)
+			continue;
+		err_code |= proxy_index_switching_rules(px);
+	}
+	return err_code;
+}
+
+REGISTER_POST_CHECK(proxy_index_all_switching_rules);
+
 /* Finds the best match for a proxy with capabilities <cap>, name <name> and id
  * <id>. At most one of <id> or <name> may be different provided that <cap> is
  * valid. Either <id> or <name> may be left unspecified (0). The purpose is to
@@ -1222,10 +1505,25 @@ struct proxy *proxy_find_best_match(int cap, const char *name, int id, int *diff
 struct server *findserver(const struct proxy *px, const char *name) {
 
 	struct server *cursrv, *target = NULL;
+	struct ebpt_node *node;
 
 	if (!px)
 		return NULL;
 
+	/* the servers are indexed by name once the configuration is checked */
+	if (!eb_is_empty(&px->conf.used_server_name)) {
+		node = ebis_lookup((struct eb_root *)&px->conf.used_server_name, name);
+		if (!node)
+			return NULL;
+
+		if (ebpt_next_dup(node)) {
+			ha_alert("Refusing to use duplicated server '%s' found in proxy: %s!\n",
+				 name, px->id);
+			return NULL;
+		}
+		return container_of(node, struct server, conf.name);
+	}
+
 	for (cursrv = px->srv; cursrv; cursrv = cursrv->next) {
 		if (strcmp(cursrv->id, name) != 0)
 			continue;
@@ -1292,7 +1590,7 @@ void init_new_proxy(struct proxy *p)
 {
 	memset(p, 0, sizeof(struct proxy));
 	p->obj_type = OBJ_TYPE_PROXY;
-	p->pendconns = EB_ROOT;
+	queue_init(p->queues);
 	LIST_INIT(&p->acl);
 	LIST_INIT(&p->http_req_rules);
 	LIST_INIT(&p->http_res_rules);
@@ -1323,7 +1621,7 @@ void init_new_proxy(struct proxy *p)
 	p->defsrv.id = "default-server";
 	p->conf.used_listener_id = EB_ROOT;
 	p->conf.used_server_id   = EB_ROOT;
-	p->used_server_addr      = EB_ROOT_UNIQUE;
+	rmtree_init(&p->used_server_addr);
 
 	/* Timeouts are defined as -1 */
 	proxy_reset_timeouts(p);
@@ -1561,6 +1859,9 @@ static int proxy_defproxy_cpy(struct proxy *curproxy, const struct proxy *defpro
 		curproxy->conn_retries = defproxy->conn_retries;
 		curproxy->redispatch_after = defproxy->redispatch_after;
 		curproxy->max_ka_queue = defproxy->max_ka_queue;
+		curproxy->codel.target = defproxy->codel.target;
+		curproxy->codel.interval = defproxy->codel.interval;
+		curproxy->codel.lifo = defproxy->codel.lifo;
 
 		curproxy->tcpcheck_rules.flags = (defproxy->tcpcheck_rules.flags & ~TCPCHK_RULES_UNUSED_RS);
 		curproxy->tcpcheck_rules.list  = defproxy->tcpcheck_rules.list;
@@ -1670,6 +1971,7 @@ static int proxy_defproxy_cpy(struct proxy *curproxy, const struct proxy *defpro
 		curproxy->timeout.httpreq = defproxy->timeout.httpreq;
 		curproxy->timeout.httpka = defproxy->timeout.httpka;
 		curproxy->timeout.tunnel = defproxy->timeout.tunnel;
+		curproxy->timeout.hedge = defproxy->timeout.hedge;
 		curproxy->conn_src.source_addr = defproxy->conn_src.source_addr;
 	}
 
@@ -1727,6 +2029,7 @@ static int proxy_defproxy_cpy(struct proxy *curproxy, const struct proxy *defpro
 		curproxy->check_path = strdup(defproxy->check_path);
 	if (defproxy->check_command)
 		curproxy->check_command = strdup(defproxy->check_command);
+	curproxy->check_nb_runners = defproxy->check_nb_runners;
 
 	if (defproxy->email_alert.mailers.name)
 		curproxy->email_alert.mailers.name = strdup(defproxy->email_alert.mailers.name);
@@ -1799,7 +2102,7 @@ void proxy_cond_disable(struct proxy *p)
 	 * peers, etc) we must not report them at all as they're not really on
 	 * the data plane but on the control plane.
 	 */
-	if (p->mode == PR_MODE_TCP || p->mode == PR_MODE_HTTP || p->mode == PR_MODE_SYSLOG)
+	if (p->mode == PR_MODE_TCP || p->mode == PR_MODE_HTTP || p->mode == PR_MODE_SYSLOG || p->mode == PR_MODE_UDP)
 		ha_warning("Proxy %s stopped (cumulated conns: FE: %lld, BE: %lld).\n",
 			   p->id, p->fe_counters.cum_conn, p->be_counters.cum_conn);
 
@@ -2413,18 +2716,34 @@ struct proxy *cli_find_backend(struct appctx *appctx, const char *arg)
 /* parse a "show servers [state|conn]" CLI line, returns 0 if it wants to start
  * the dump or 1 if it stops immediately. If an argument is specified, it will
  * set the proxy pointer into cli.p0 and its ID into cli.i0. It sets cli.o0 to
- * 0 for "state", or 1 for "conn".
+ * 0 for "state", 1 for "conn", or 2 for "state" with the "binary" option.
  */
 static int cli_parse_show_servers(char **args, char *payload, struct appctx *appctx, void *private)
 {
 	struct proxy *px;
+	const char *be = args[3];
 
 	appctx->ctx.cli.o0 = *args[2] == 'c'; // "conn" vs "state"
 
+	/* "binary" may follow the optional backend name, which may also be
+	 * called this way.
+	 */
+	if (!appctx->ctx.cli.o0 && *args[3]) {
+		if (*args[4]) {
+			if (strcmp(args[4], "binary") != 0)
+				return cli_err(appctx, "Expects an optional backend name followed by an optional 'binary'.\n");
+			appctx->ctx.cli.o0 = 2;
+		}
+		else if (strcmp(args[3], "binary") == 0 && !proxy_be_by_name(args[3])) {
+			appctx->ctx.cli.o0 = 2;
+			be = "";
+		}
+	}
+
 	/* check if a backend name has been provided */
-	if (*args[3]) {
+	if (*be) {
 		/* read server state from local file */
-		px = proxy_be_by_name(args[3]);
+		px = proxy_be_by_name(be);
 
 		if (!px)
 			return cli_err(appctx, "Can't find backend.\n");
@@ -2487,7 +2806,7 @@ static int dump_servers_state(struct stream_interface *si)
 		if (srv->srvrq && srv->srvrq->name)
 			srvrecord = srv->srvrq->name;
 
-		if (appctx->ctx.cli.o0 == 0) {
+		if (appctx->ctx.cli.o0 != 1) {
 			/* show servers state */
 			chunk_printf(&trash,
 			             "%d %s "
@@ -2505,6 +2824,9 @@ static int dump_servers_state(struct stream_interface *si)
 			             bk_f_forced_id, srv_f_forced_id, srv->hostname ? srv->hostname : "-", srv->svc_port,
 			             srvrecord ? srvrecord : "-", srv->use_ssl, srv->check.port,
 				     srv_check_addr, srv_agent_addr, srv->agent.port);
+
+			if (appctx->ctx.cli.o0 == 2 && !srv_state_bin_encode(&trash, px->uuid, srv->puid))
+				continue; /* too large, should not happen */
 		} else {
 			/* show servers conn */
 			int thr;
@@ -2548,7 +2870,12 @@ static int cli_io_handler_servers_state(struct appctx *appctx)
 	}
 
 	if (appctx->st2 == STAT_ST_HEAD) {
-		if (appctx->ctx.cli.o0 == 0)
+		if (appctx->ctx.cli.o0 == 2) {
+			memcpy(trash.area, SRV_STATE_BIN_MAGIC, SRV_STATE_BIN_MAGIC_LEN);
+			write_n32(trash.area + SRV_STATE_BIN_MAGIC_LEN, SRV_STATE_BIN_VERSION);
+			trash.data = SRV_STATE_BIN_HDR_LEN;
+		}
+		else if (appctx->ctx.cli.o0 == 0)
 			chunk_printf(&trash, "%d\n# %s\n", SRV_STATE_FILE_VERSION, SRV_STATE_FILE_FIELD_NAMES);
 		else
 			chunk_printf(&trash,
@@ -2578,6 +2905,144 @@ static int cli_io_handler_servers_state(struct appctx *appctx)
 	return 1;
 }
 
+/* Accounts stream <s> and the buffers it holds into the memory usage of proxy
+ * <px>.
+ */
+static void proxy_add_strm_mem_usage(struct proxy *px, const struct stream *s)
+{
+	const struct buffer *bufs[3] = { &s->req.buf, &s->res.buf, &s->si[1].l7_buffer };
+	int i;
+
+	px->mem.streams++;
+	px->mem.strm_bytes += sizeof(*s) + (s->txn ? sizeof(*s->txn) : 0);
+	for (i = 0; i < 3; i++) {
+		if (!b_size(bufs[i]))
+			continue;
+		px->mem.bufs++;
+		px->mem.buf_bytes += b_size(bufs[i]);
+	}
+}
+
+/* Refreshes the memory usage of all proxies (their <mem> field), by walking
+ * over all streams of all threads under thread isolation. Streams are counted
+ * both in their frontend and in their backend when they differ. Unless <force>
+ * is set, nothing is done if the previous refresh is less than one second old,
+ * so that it may be called at the beginning of each stats dump. It must not be
+ * called with any lock held.
+ */
+void proxy_update_mem_usage(int force)
+{
+	static unsigned int last_update = TICK_ETERNITY;
+	struct proxy *px;
+	struct stream *s;
+	unsigned int date;
+	int thr;
+
+	date = HA_ATOMIC_LOAD(&last_update);
+	if (!force && tick_isset(date) && !tick_is_expired(tick_add(date, MS_TO_TICKS(1000)), now_ms))
+		return;
+	HA_ATOMIC_STORE(&last_update, tick_add(now_ms, 0));
+
+	thread_isolate();
+
+	for (px = proxies_list; px; px = px->next)
+		memset(&px->mem, 0, sizeof(px->mem));
+
+	for (thr = 0; thr < global.nbthread; thr++) {
+		list_for_each_entry(s, &ha_thread_info[thr].streams, list) {
+			proxy_add_strm_mem_usage(strm_fe(s), s);
+			if (s->be != strm_fe(s))
+				proxy_add_strm_mem_usage(s->be, s);
+		}
+	}
+
+	thread_release();
+}
+
+/* Parses the "show memory" command. The usage is refreshed at once so that the
+ * dump is consistent.
+ */
+static int cli_parse_show_memory(char **args, char *payload, struct appctx *appctx, void *private)
+{
+	if (!cli_has_level(appctx, ACCESS_LVL_OPER))
+		return 1;
+
+	proxy_update_mem_usage(1);
+	appctx->st2 = 0;
+	appctx->ctx.cli.p0 = NULL;
+	appctx->ctx.cli.p1 = NULL;
+	return 0;
+}
+
+/* Dumps the memory used by each proxy, then by each pattern reference (maps
+ * and ACLs). It uses st2 as the section being dumped, cli.p0 as the current
+ * proxy and cli.p1 as the current pattern reference.
+ */
+static int cli_io_handler_show_memory(struct appctx *appctx)
+{
+	struct stream_interface *si = appctx->owner;
+	struct proxy *px;
+	struct pat_ref *ref;
+	unsigned long long bytes;
+	unsigned int elts;
+
+	if (unlikely(si_ic(si)->flags & (CF_WRITE_ERROR|CF_SHUTW)))
+		return 1;
+
+	chunk_reset(&trash);
+
+	if (appctx->st2 == 0) {
+		chunk_appendf(&trash, "# proxies: name type streams strm_bytes bufs buf_bytes tbl_entries tbl_bytes\n");
+		if (ci_putchk(si_ic(si), &trash) == -1) {
+			si_rx_room_blk(si);
+			return 0;
+		}
+		appctx->ctx.cli.p0 = proxies_list;
+		appctx->st2 = 1;
+	}
+
+	if (appctx->st2 == 1) {
+		for (; appctx->ctx.cli.p0 != NULL; appctx->ctx.cli.p0 = px->next) {
+			px = appctx->ctx.cli.p0;
+			chunk_reset(&trash);
+			chunk_appendf(&trash, "%s %s %u %llu %u %llu %u %llu\n",
+			              px->id, proxy_type_str(px),
+			              px->mem.streams, px->mem.strm_bytes,
+			              px->mem.bufs, px->mem.buf_bytes,
+			              px->table ? HA_ATOMIC_LOAD(&px->table->current) : 0,
+			              px->table ? stktable_mem_usage(px->table) : 0);
+			if (ci_putchk(si_ic(si), &trash) == -1) {
+				si_rx_room_blk(si);
+				return 0;
+			}
+		}
+
+		chunk_reset(&trash);
+		chunk_appendf(&trash, "# patterns: id elts elt_bytes patterns reference\n");
+		if (ci_putchk(si_ic(si), &trash) == -1) {
+			si_rx_room_blk(si);
+			return 0;
+		}
+		appctx->ctx.cli.p1 = LIST_NEXT(&pattern_reference, struct pat_ref *, list);
+		appctx->st2 = 2;
+	}
+
+	for (; appctx->ctx.cli.p1 != &pattern_reference; appctx->ctx.cli.p1 = ref->list.n) {
+		ref = LIST_ELEM(appctx->ctx.cli.p1, struct pat_ref *, list);
+		bytes = pat_ref_mem_usage(ref, &elts);
+		chunk_reset(&trash);
+		chunk_appendf(&trash, "%d %u %llu %llu %s\n",
+		              ref->unique_id, elts, bytes, ref->entry_cnt,
+		              ref->reference ? ref->reference : ref->display);
+		if (ci_putchk(si_ic(si), &trash) == -1) {
+			si_rx_room_blk(si);
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
 /* Parses backend list and simply report backend names. It keeps the proxy
  * pointer in cli.p0.
  */
@@ -3054,8 +3519,9 @@ static struct cli_kw_list cli_kws = {{ },{
 	{ { "enable", "frontend",  NULL },                  "enable frontend <frontend>              : re-enable specific frontend",                                    cli_parse_enable_frontend, NULL, NULL },
 	{ { "set", "maxconn", "frontend",  NULL },          "set maxconn frontend <frontend> <value> : change a frontend's maxconn setting",                            cli_parse_set_maxconn_frontend, NULL },
 	{ { "show","servers", "conn",  NULL },              "show servers conn [<backend>]           : dump server connections status (all or for a single backend)",   cli_parse_show_servers, cli_io_handler_servers_state },
-	{ { "show","servers", "state",  NULL },             "show servers state [<backend>]          : dump volatile server information (all or for a single backend)", cli_parse_show_servers, cli_io_handler_servers_state },
+	{ { "show","servers", "state",  NULL },             "show servers state [<backend>] [binary] : dump volatile server information (all or for a single backend)", cli_parse_show_servers, cli_io_handler_servers_state },
 	{ { "show", "backend", NULL },                      "show backend                            : list backends in the current running config", NULL,              cli_io_handler_show_backend },
+	{ { "show", "memory", NULL },                       "show memory                             : report the memory used by each proxy, map and ACL",              cli_parse_show_memory, cli_io_handler_show_memory },
 	{ { "shutdown", "frontend",  NULL },                "shutdown frontend <frontend>            : stop a specific frontend",                                       cli_parse_shutdown_frontend, NULL, NULL },
 	{ { "set", "dynamic-cookie-key", "backend", NULL }, "set dynamic-cookie-key backend <bk> <k> : change a backend secret key for dynamic cookies",                cli_parse_set_dyncookie_key_backend, NULL },
 	{ { "enable", "dynamic-cookie", "backend", NULL },  "enable dynamic-cookie backend <bk>      : enable dynamic cookies on a specific backend",                   cli_parse_enable_dyncookie_backend, NULL },
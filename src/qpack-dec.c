@@ -0,0 +1,453 @@
+/*
+ * QPACK decompressor (RFC 9204)
+ *
+ * Copyright 2021 HAProxy Technologies
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <import/ist.h>
+#include <haproxy/chunk.h>
+#include <haproxy/hpack-huff.h>
+#include <haproxy/qpack-dec.h>
+#include <haproxy/qpack-tbl.h>
+
+
+/* Copies <in> into chunk <store> and returns the string allocated there. This
+ * is needed for the strings which live in the dynamic table since it may be
+ * modified before the caller is done with them. In case of lack of room,
+ * returns a string whose pointer is NULL.
+ */
+static inline struct ist qpack_dup_string(struct buffer *store, struct ist in)
+{
+	struct ist out = IST_NULL;
+
+	if (unlikely(store->data + in.len > store->size))
+		return out;
+
+	out = ist2(store->area + store->data, in.len);
+	store->data += in.len;
+	memcpy(out.ptr, in.ptr, in.len);
+	return out;
+}
+
+/* Reads a string literal (RFC 9204 4.1.2) whose length uses a <b>-bit prefix,
+ * the Huffman flag being the bit just above it, from <*raw> with <*len> bytes
+ * available. Huffman-encoded strings are decoded into chunk <tmp>, the other
+ * ones point to <*raw>. Strings longer than <max> bytes are rejected. Returns
+ * 1 on success after updating <*raw> and <*len> and storing the string into
+ * <*str>, 0 if more bytes are needed, or the opposite one of the QPACK_ERR_*
+ * codes on failure.
+ */
+static int qpack_get_str(const unsigned char **raw, uint64_t *len, int b,
+                         uint64_t max, struct buffer *tmp, struct ist *str)
+{
+	const unsigned char *pos = *raw;
+	uint64_t left = *len;
+	uint64_t slen;
+	int huff, ret;
+
+	if (!left)
+		return 0;
+
+	huff = *pos & (1 << b);
+	ret = qpack_get_int(&pos, &left, b, &slen);
+	if (ret <= 0)
+		return ret;
+
+	if (slen > max)
+		return -QPACK_ERR_TOO_LARGE;
+
+	if (left < slen)
+		return 0;
+
+	*str = ist2(pos, slen);
+	if (huff) {
+		int dlen = huff_dec(pos, slen, tmp->area + tmp->data, tmp->size - tmp->data);
+
+		if (dlen < 0)
+			return -QPACK_ERR_HUFFMAN;
+		*str = ist2(tmp->area + tmp->data, dlen);
+		tmp->data += dlen;
+	}
+
+	*raw = pos + slen;
+	*len = left - slen;
+	return 1;
+}
+
+/* Initializes the QPACK decoder <dec> and allocates its dynamic table.
+ * Returns non-zero on success, 0 on allocation failure.
+ */
+int qpack_dec_init(struct qpack_dec *dec)
+{
+	dec->krc = 0;
+	dec->nb_blocked = 0;
+	dec->max_blocked = QPACK_DEC_MAX_BLOCKED;
+	dec->dht = qpack_dht_alloc();
+	return !!dec->dht;
+}
+
+/* Releases the dynamic table of the QPACK decoder <dec>. */
+void qpack_dec_release(struct qpack_dec *dec)
+{
+	if (dec->dht)
+		qpack_dht_free(dec->dht);
+	dec->dht = NULL;
+}
+
+/* Processes the instructions received on the encoder stream (RFC 9204 4.3)
+ * starting at <raw> for <len> bytes, updating the dynamic table of decoder
+ * <dec>. Chunk <tmp> is used for temporary storage. Only complete instructions
+ * are processed, and the number of bytes consumed is returned so that the
+ * caller may keep the remaining ones until more data arrive. Once done, an
+ * Insert Count Increment instruction (RFC 9204 4.4.3) is appended to buffer
+ * <out> for the decoder stream if new entries were inserted. On failure, the
+ * opposite one of the QPACK_ERR_* codes is returned, which must be treated as
+ * a connection error of type QPACK_ENCODER_STREAM_ERROR.
+ */
+int qpack_decode_enc(struct qpack_dec *dec, const unsigned char *raw, uint64_t len,
+                     struct buffer *tmp, struct buffer *out)
+{
+	struct qpack_dht *dht = dec->dht;
+	const unsigned char *start = raw;
+	const struct qpack_dte *dte;
+	struct ist name, value;
+	uint64_t idx;
+	int ret;
+
+	while (len) {
+		const unsigned char *pos = raw;
+		uint64_t left = len;
+
+		chunk_reset(tmp);
+		if (*pos & 0x80) {
+			/* insert with name reference: [ 1 | T | Index (6+) ] */
+			int is_static = *pos & 0x40;
+
+			ret = qpack_get_int(&pos, &left, 6, &idx);
+			if (ret <= 0)
+				goto truncated;
+
+			if (is_static) {
+				if (idx >= QPACK_SHT_SIZE)
+					return -QPACK_ERR_INVALID_IDX;
+				name = qpack_sht[idx].n;
+			}
+			else {
+				/* relative to the insert count, and the entry may
+				 * be evicted by the insertion.
+				 */
+				if (idx >= dht->ins_cnt ||
+				    !(dte = qpack_get_dte(dht, dht->ins_cnt - 1 - idx)))
+					return -QPACK_ERR_INVALID_IDX;
+				name = qpack_dup_string(tmp, qpack_get_name(dht, dte));
+				if (!isttest(name))
+					return -QPACK_ERR_TOO_LARGE;
+			}
+
+			ret = qpack_get_str(&pos, &left, 7, dht->size, tmp, &value);
+			if (ret <= 0)
+				goto truncated;
+		}
+		else if (*pos & 0x40) {
+			/* insert with literal name: [ 0 | 1 | H | Length (5+) ] */
+			ret = qpack_get_str(&pos, &left, 5, dht->size, tmp, &name);
+			if (ret <= 0)
+				goto truncated;
+
+			ret = qpack_get_str(&pos, &left, 7, dht->size, tmp, &value);
+			if (ret <= 0)
+				goto truncated;
+		}
+		else if (*pos & 0x20) {
+			/* set dynamic table capacity: [ 0 | 0 | 1 | Capacity (5+) ] */
+			ret = qpack_get_int(&pos, &left, 5, &idx);
+			if (ret <= 0)
+				goto truncated;
+
+			if (idx > dht->size)
+				return -QPACK_ERR_INVALID_CAP;
+
+			qpack_dht_set_cap(dht, idx);
+			goto next;
+		}
+		else {
+			/* duplicate: [ 0 | 0 | 0 | Index (5+) ] */
+			ret = qpack_get_int(&pos, &left, 5, &idx);
+			if (ret <= 0)
+				goto truncated;
+
+			if (idx >= dht->ins_cnt ||
+			    !(dte = qpack_get_dte(dht, dht->ins_cnt - 1 - idx)))
+				return -QPACK_ERR_INVALID_IDX;
+
+			name = qpack_dup_string(tmp, qpack_get_name(dht, dte));
+			value = qpack_dup_string(tmp, qpack_get_value(dht, dte));
+			if (!isttest(name) || !isttest(value))
+				return -QPACK_ERR_TOO_LARGE;
+		}
+
+		if (qpack_dht_insert(dht, name, value) < 0)
+			return -QPACK_ERR_DHT_INSERT_FAIL;
+	next:
+		raw = pos;
+		len = left;
+	}
+
+ done:
+	/* acknowledge the new entries: [ 0 | 0 | Increment (6+) ]. If there
+	 * is no room, it will be done on the next call.
+	 */
+	if (dht->ins_cnt > dec->krc &&
+	    qpack_put_int(out, 0x00, 6, dht->ins_cnt - dec->krc))
+		dec->krc = dht->ins_cnt;
+
+	return raw - start;
+
+ truncated:
+	if (ret < 0)
+		return ret;
+	goto done;
+}
+
+/* Decodes a field section (RFC 9204 4.5) from stream <stream_id> starting at
+ * <raw> for <len> bytes, using the dynamic table of decoder <dec>. It produces
+ * the output into list <list> of <list_size> entries max, and uses the
+ * pre-allocated chunk <tmp> for temporary storage (some list elements will
+ * point to it). The number of <list> entries used is returned on success, or
+ * <0 on failure, with the opposite one of the QPACK_ERR_* codes. A last
+ * element is always zeroed and is not counted in the number of returned
+ * entries, like for hpack_decode_frame().
+ *
+ * <blocked> is the stream's blocked state, which must be zero initially and is
+ * maintained by this function. If the section references entries which were
+ * not received yet, -QPACK_ERR_BLOCKED is returned and the stream is accounted
+ * as blocked. The caller must then call the function again once new entries
+ * were inserted by qpack_decode_enc(). If too many streams are blocked,
+ * -QPACK_ERR_TOO_MANY_BLOCKED is returned. Once a section referencing the
+ * dynamic table is decoded, a Section Acknowledgment instruction is appended
+ * to buffer <out> for the decoder stream. All the other errors must be treated
+ * as connection errors of type QPACK_DECOMPRESSION_FAILED.
+ */
+int qpack_decode_fs(struct qpack_dec *dec, uint64_t stream_id, int *blocked,
+                    const unsigned char *raw, uint64_t len,
+                    struct http_hdr *list, int list_size,
+                    struct buffer *tmp, struct buffer *out)
+{
+	struct qpack_dht *dht = dec->dht;
+	const struct qpack_dte *dte;
+	struct ist name, value;
+	uint64_t enc_ric, ric, delta, base;
+	uint64_t max_entries, idx;
+	int ret, err;
+
+	chunk_reset(tmp);
+
+	/* encoded field section prefix (RFC 9204 4.5.1) */
+	if (qpack_get_int(&raw, &len, 8, &enc_ric) <= 0 || !len)
+		return -QPACK_ERR_TRUNCATED;
+
+	ric = 0;
+	if (enc_ric) {
+		uint64_t full_range, max_value;
+
+		/* RFC 9204 4.5.1.1 */
+		max_entries = dht->size / 32;
+		full_range  = 2 * max_entries;
+		if (enc_ric > full_range)
+			return -QPACK_ERR_INVALID_RIC;
+
+		max_value = dht->ins_cnt + max_entries;
+		ric = max_value / full_range * full_range + enc_ric - 1;
+		if (ric > max_value) {
+			if (ric <= full_range)
+				return -QPACK_ERR_INVALID_RIC;
+			ric -= full_range;
+		}
+
+		if (!ric)
+			return -QPACK_ERR_INVALID_RIC;
+	}
+
+	/* [ S | Delta Base (7+) ] */
+	err = *raw & 0x80;
+	if (qpack_get_int(&raw, &len, 7, &delta) <= 0)
+		return -QPACK_ERR_TRUNCATED;
+
+	if (!err)
+		base = ric + delta;
+	else if (ric > delta)
+		base = ric - delta - 1;
+	else
+		return -QPACK_ERR_INVALID_RIC;
+
+	if (ric > dht->ins_cnt) {
+		/* RFC 9204 2.1.2 : the stream is blocked */
+		if (!*blocked) {
+			if (dec->nb_blocked >= dec->max_blocked)
+				return -QPACK_ERR_TOO_MANY_BLOCKED;
+			dec->nb_blocked++;
+			*blocked = 1;
+		}
+		return -QPACK_ERR_BLOCKED;
+	}
+
+	ret = 0;
+	while (len) {
+		dte = NULL;
+		if (*raw & 0x80) {
+			/* indexed field line: [ 1 | T | Index (6+) ] */
+			int is_static = *raw & 0x40;
+
+			if (qpack_get_int(&raw, &len, 6, &idx) <= 0)
+				return -QPACK_ERR_TRUNCATED;
+
+			if (is_static) {
+				if (idx >= QPACK_SHT_SIZE)
+					return -QPACK_ERR_INVALID_IDX;
+				name  = qpack_sht[idx].n;
+				value = qpack_sht[idx].v;
+				goto store;
+			}
+
+			if (idx >= base)
+				return -QPACK_ERR_INVALID_IDX;
+			idx = base - 1 - idx;
+			goto indexed;
+		}
+		else if (*raw & 0x40) {
+			/* literal with name reference: [ 0 | 1 | N | T | Index (4+) ] */
+			int is_static = *raw & 0x10;
+
+			if (qpack_get_int(&raw, &len, 4, &idx) <= 0)
+				return -QPACK_ERR_TRUNCATED;
+
+			if (is_static) {
+				if (idx >= QPACK_SHT_SIZE)
+					return -QPACK_ERR_INVALID_IDX;
+				name = qpack_sht[idx].n;
+				goto literal_value;
+			}
+
+			if (idx >= base)
+				return -QPACK_ERR_INVALID_IDX;
+			idx = base - 1 - idx;
+			goto name_ref;
+		}
+		else if (*raw & 0x20) {
+			/* literal with literal name: [ 0 | 0 | 1 | N | H | NameLen (3+) ] */
+			err = qpack_get_str(&raw, &len, 3, len, tmp, &name);
+			if (err <= 0)
+				return err ? err : -QPACK_ERR_TRUNCATED;
+			goto literal_value;
+		}
+		else if (*raw & 0x10) {
+			/* indexed field line with post-base index: [ 0 | 0 | 0 | 1 | Index (4+) ] */
+			if (qpack_get_int(&raw, &len, 4, &idx) <= 0)
+				return -QPACK_ERR_TRUNCATED;
+			idx += base;
+			goto indexed;
+		}
+		else {
+			/* literal with post-base name reference: [ 0 | 0 | 0 | 0 | N | Index (3+) ] */
+			if (qpack_get_int(&raw, &len, 3, &idx) <= 0)
+				return -QPACK_ERR_TRUNCATED;
+			idx += base;
+			goto name_ref;
+		}
+
+	indexed:
+		/* <idx> is the absolute index of the whole field */
+		if (idx >= ric || !(dte = qpack_get_dte(dht, idx)))
+			return -QPACK_ERR_INVALID_IDX;
+		name  = qpack_dup_string(tmp, qpack_get_name(dht, dte));
+		value = qpack_dup_string(tmp, qpack_get_value(dht, dte));
+		if (!isttest(name) || !isttest(value))
+			return -QPACK_ERR_TOO_LARGE;
+		goto store;
+
+	name_ref:
+		/* <idx> is the absolute index of the name */
+		if (idx >= ric || !(dte = qpack_get_dte(dht, idx)))
+			return -QPACK_ERR_INVALID_IDX;
+		name = qpack_dup_string(tmp, qpack_get_name(dht, dte));
+		if (!isttest(name))
+			return -QPACK_ERR_TOO_LARGE;
+
+	literal_value:
+		err = qpack_get_str(&raw, &len, 7, len, tmp, &value);
+		if (err <= 0)
+			return err ? err : -QPACK_ERR_TRUNCATED;
+
+	store:
+		if (ret >= list_size)
+			return -QPACK_ERR_TOO_LARGE;
+
+		list[ret].n = name;
+		list[ret].v = value;
+		ret++;
+	}
+
+	if (ret >= list_size)
+		return -QPACK_ERR_TOO_LARGE;
+
+	/* put an end marker */
+	list[ret].n = list[ret].v = IST_NULL;
+
+	if (ric) {
+		/* section acknowledgment: [ 1 | Stream ID (7+) ] */
+		if (!qpack_put_int(out, 0x80, 7, stream_id))
+			return -QPACK_ERR_TOO_LARGE;
+		if (ric > dec->krc)
+			dec->krc = ric;
+	}
+
+	if (*blocked) {
+		dec->nb_blocked--;
+		*blocked = 0;
+	}
+
+	return ret;
+}
+
+/* Reports to the peer's encoder that stream <stream_id> of decoder <dec> was
+ * reset or abandoned, by appending a Stream Cancellation instruction (RFC 9204
+ * 4.4.2) to buffer <out>. <blocked> is the stream's blocked state as passed to
+ * qpack_decode_fs(). Returns non-zero on success, 0 if <out> is full.
+ */
+int qpack_dec_cancel_stream(struct qpack_dec *dec, uint64_t stream_id, int *blocked,
+                            struct buffer *out)
+{
+	if (!qpack_put_int(out, 0x40, 6, stream_id))
+		return 0;
+
+	if (*blocked) {
+		dec->nb_blocked--;
+		*blocked = 0;
+	}
+	return 1;
+}
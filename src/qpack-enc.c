@@ -0,0 +1,450 @@
+/*
+ * QPACK compressor (RFC 9204)
+ *
+ * Copyright 2021 HAProxy Technologies
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <import/ist.h>
+#include <haproxy/buf.h>
+#include <haproxy/qpack-enc.h>
+#include <haproxy/qpack-tbl.h>
+
+/* Room reserved in front of the field lines for the field section prefix: a
+ * 28-bit Required Insert Count with an 8-bit prefix and a 32-bit Delta Base
+ * with a 7-bit prefix.
+ */
+#define QPACK_FS_PFX_MAX 12
+
+/* ways to emit a field which is not found in the tables */
+enum qpack_enc_pol {
+	QPACK_POL_LITERAL = 0, /* literal, not added to the dynamic table */
+	QPACK_POL_INDEX,       /* added to the dynamic table */
+	QPACK_POL_NEVER,       /* literal which must never be indexed */
+};
+
+/* Returns the way header field <n>:<v> may be added to the dynamic table
+ * <dht> of the encoder. This is the same policy as for HPACK: fields which
+ * usually convey secrets are never indexed (RFC 9204 7.1.3), and those whose
+ * values change with almost every message would only evict useful entries.
+ */
+static inline enum qpack_enc_pol qpack_enc_policy(const struct qpack_dht *dht,
+                                                  const struct ist n, const struct ist v)
+{
+	if (isteq(n, ist("cookie")) || isteq(n, ist("set-cookie")) ||
+	    isteq(n, ist("authorization")) || isteq(n, ist("proxy-authorization")))
+		return QPACK_POL_NEVER;
+
+	if (isteq(n, ist("content-length")) || isteq(n, ist("content-range")) ||
+	    isteq(n, ist("etag")) || isteq(n, ist("last-modified")) ||
+	    isteq(n, ist("age")) || isteq(n, ist(":path")))
+		return QPACK_POL_LITERAL;
+
+	/* keep room for several entries */
+	if (!dht || (n.len + v.len + 32) * 4 > dht->cap)
+		return QPACK_POL_LITERAL;
+
+	return QPACK_POL_INDEX;
+}
+
+/* Returns the number of field sections of encoder <enc> which may still be
+ * blocked on the peer's decoder. This is at least the number of blocked
+ * streams.
+ */
+static inline uint32_t qpack_enc_nb_blocking(const struct qpack_enc *enc)
+{
+	uint32_t i, ret = 0;
+
+	for (i = 0; i < enc->nb_sect; i++)
+		ret += enc->sect[i].ric > enc->krc;
+	return ret;
+}
+
+/* Returns non-zero if an entry of <needed> bytes may be inserted into the
+ * dynamic table of encoder <enc> without evicting an entry whose absolute
+ * index is <pin> or above, nor one referenced by an unacknowledged section
+ * (RFC 9204 2.1.1).
+ */
+static int qpack_enc_can_insert(const struct qpack_enc *enc, uint32_t needed, uint32_t pin)
+{
+	const struct qpack_dht *dht = enc->dht;
+	const struct qpack_dte *dte;
+	uint32_t used = dht->used;
+	uint32_t total = dht->total;
+	uint32_t abs = qpack_dht_first_abs(dht);
+	uint32_t i;
+
+	if (needed + 32 > dht->cap)
+		return 0;
+
+	for (i = 0; i < enc->nb_sect; i++) {
+		if (enc->sect[i].min_ref < pin)
+			pin = enc->sect[i].min_ref;
+	}
+
+	while (used * 32 + total + needed + 32 > dht->cap) {
+		if (abs >= pin || !(dte = qpack_get_dte(dht, abs)))
+			return 0;
+		total -= dte->nlen + dte->vlen;
+		used--;
+		abs++;
+	}
+	return 1;
+}
+
+/* Appends string literal <str> without Huffman encoding using a <b>-bit length
+ * prefix after <flags> to buffer <out>. Returns non-zero on success, 0 if the
+ * buffer is full.
+ */
+static inline int qpack_put_str(struct buffer *out, unsigned char flags, int b, const struct ist str)
+{
+	if (!qpack_put_int(out, flags, b, str.len) || out->data + str.len > out->size)
+		return 0;
+
+	memcpy(out->area + out->data, str.ptr, str.len);
+	out->data += str.len;
+	return 1;
+}
+
+/* Initializes the QPACK encoder <enc> for a peer which advertised a maximum
+ * dynamic table capacity of <max_cap> bytes and <max_blocked> blocked streams.
+ * The dynamic table is only allocated if the peer supports one. Returns
+ * non-zero on success, 0 on allocation failure, in which case the encoder
+ * remains usable without a dynamic table.
+ */
+int qpack_enc_init(struct qpack_enc *enc, uint64_t max_cap, uint64_t max_blocked)
+{
+	enc->dht = NULL;
+	enc->max_cap = max_cap > UINT32_MAX ? UINT32_MAX : max_cap;
+	enc->max_blocked = max_blocked > UINT32_MAX ? UINT32_MAX : max_blocked;
+	enc->krc = 0;
+	enc->cap_sent = 0;
+	enc->nb_sect = 0;
+
+	if (!enc->max_cap)
+		return 1;
+
+	enc->dht = qpack_dht_alloc();
+	return !!enc->dht;
+}
+
+/* Releases the dynamic table of the QPACK encoder <enc>. */
+void qpack_enc_release(struct qpack_enc *enc)
+{
+	if (enc->dht)
+		qpack_dht_free(enc->dht);
+	enc->dht = NULL;
+}
+
+/* Encodes the header list <list>, terminated by an entry with an empty name,
+ * as a field section (RFC 9204 4.5) for stream <stream_id> into buffer <out>,
+ * using and updating the dynamic table of encoder <enc>. The fields which may
+ * be indexed are inserted into the dynamic table, and the matching encoder
+ * instructions are appended to buffer <ins> for the encoder stream. Entries
+ * are only referenced once acknowledged by the peer's decoder, unless it
+ * still accepts more blocked streams. Neither buffer may wrap. Returns
+ * non-zero on success, 0 on failure (buffer full). In case of failure, the
+ * instructions already appended to <ins> are valid and must be sent anyway.
+ */
+int qpack_encode_fs(struct qpack_enc *enc, uint64_t stream_id, const struct http_hdr *list,
+                    struct buffer *out, struct buffer *ins)
+{
+	struct qpack_dht *dht = enc->dht;
+	const struct qpack_dte *dte;
+	size_t start = out->data;
+	uint32_t base, ric, min_ref, limit;
+	uint32_t abs, didx, dname, dname_any;
+	int sidx, sname, can_ref;
+	enum qpack_enc_pol pol;
+	struct buffer pfx;
+	char pfx_area[QPACK_FS_PFX_MAX];
+	uint64_t enc_ric;
+	size_t data;
+
+	if (dht && !enc->cap_sent) {
+		/* set dynamic table capacity: [ 0 | 0 | 1 | Capacity (5+) ] */
+		uint32_t cap = enc->max_cap < dht->size ? enc->max_cap : dht->size;
+
+		if (!qpack_put_int(ins, 0x20, 5, cap))
+			return 0;
+		qpack_dht_set_cap(dht, cap);
+		enc->cap_sent = 1;
+	}
+
+	base = dht ? dht->ins_cnt : 0;
+	ric = 0;
+	min_ref = UINT32_MAX;
+
+	/* references to the dynamic table are only possible if the section
+	 * can be tracked until it is acknowledged. Unacknowledged entries may
+	 * only be referenced if the stream is allowed to block.
+	 */
+	can_ref = dht && enc->nb_sect < QPACK_ENC_MAX_SECT;
+	limit = 0;
+	if (can_ref)
+		limit = (qpack_enc_nb_blocking(enc) < enc->max_blocked) ? UINT32_MAX : enc->krc;
+
+	if (out->data + QPACK_FS_PFX_MAX > out->size)
+		return 0;
+	out->data += QPACK_FS_PFX_MAX;
+
+	for (; list->n.len; list++) {
+		const struct ist n = list->n;
+		const struct ist v = list->v;
+
+		/* look for the whole field, then only the name, in the static table */
+		sidx = qpack_find_static(n, v, &sname);
+		if (sidx >= 0) {
+			/* indexed field line: [ 1 | T | Index (6+) ] */
+			if (!qpack_put_int(out, 0xc0, 6, sidx))
+				goto fail;
+			continue;
+		}
+
+		/* then in the dynamic table, most recent entries first */
+		didx = dname = dname_any = UINT32_MAX;
+		if (dht) {
+			for (abs = dht->ins_cnt; abs-- && (dte = qpack_get_dte(dht, abs)) != NULL; ) {
+				if (dte->nlen != n.len || !isteq(qpack_get_name(dht, dte), n))
+					continue;
+
+				if (dname_any == UINT32_MAX)
+					dname_any = abs;
+
+				if (!can_ref || abs >= limit)
+					continue;
+
+				if (dname == UINT32_MAX)
+					dname = abs;
+
+				if (dte->vlen == v.len && isteq(qpack_get_value(dht, dte), v)) {
+					didx = abs;
+					break;
+				}
+			}
+		}
+
+		if (didx != UINT32_MAX)
+			goto emit_indexed;
+
+		/* the entries referenced so far in this section must not be
+		 * evicted, nor the one we may use as a name reference below.
+		 */
+		pol = qpack_enc_policy(dht, n, v);
+		if (pol == QPACK_POL_INDEX &&
+		    qpack_enc_can_insert(enc, n.len + v.len, MIN(min_ref, dname))) {
+			data = ins->data;
+
+			if (sname >= 0) {
+				/* insert with static name reference: [ 1 | 1 | Index (6+) ] */
+				if (!qpack_put_int(ins, 0xc0, 6, sname))
+					goto no_insert;
+			}
+			else if (dname_any != UINT32_MAX) {
+				/* insert with dynamic name reference: [ 1 | 0 | Index (6+) ] */
+				if (!qpack_put_int(ins, 0x80, 6, dht->ins_cnt - 1 - dname_any))
+					goto no_insert;
+			}
+			else {
+				/* insert with literal name: [ 0 | 1 | H | Length (5+) ] */
+				if (!qpack_put_str(ins, 0x40, 5, n))
+					goto no_insert;
+			}
+
+			/* value: [ H | Length (7+) ] */
+			if (!qpack_put_str(ins, 0x00, 7, v) ||
+			    qpack_dht_insert(dht, n, v) < 0)
+				goto no_insert;
+
+			if (can_ref && dht->ins_cnt - 1 < limit) {
+				didx = dht->ins_cnt - 1;
+				goto emit_indexed;
+			}
+			goto emit_literal;
+
+		no_insert:
+			ins->data = data;
+		}
+
+	emit_literal:
+		/* the N bit is set for fields which must never be indexed */
+		if (sname >= 0) {
+			/* literal with static name reference: [ 0 | 1 | N | T | Index (4+) ] */
+			if (!qpack_put_int(out, (pol == QPACK_POL_NEVER) ? 0x70 : 0x50, 4, sname))
+				goto fail;
+		}
+		else if (dname != UINT32_MAX && dname < base) {
+			/* literal with dynamic name reference: [ 0 | 1 | N | T | Index (4+) ] */
+			if (!qpack_put_int(out, (pol == QPACK_POL_NEVER) ? 0x60 : 0x40, 4, base - 1 - dname))
+				goto fail;
+			abs = dname;
+			goto ref_name;
+		}
+		else if (dname != UINT32_MAX) {
+			/* literal with post-base name reference: [ 0 | 0 | 0 | 0 | N | Index (3+) ] */
+			if (!qpack_put_int(out, (pol == QPACK_POL_NEVER) ? 0x08 : 0x00, 3, dname - base))
+				goto fail;
+			abs = dname;
+			goto ref_name;
+		}
+		else {
+			/* literal with literal name: [ 0 | 0 | 1 | N | H | NameLen (3+) ] */
+			if (!qpack_put_str(out, (pol == QPACK_POL_NEVER) ? 0x30 : 0x20, 3, n))
+				goto fail;
+		}
+		goto emit_value;
+
+	ref_name:
+		if (abs + 1 > ric)
+			ric = abs + 1;
+		if (abs < min_ref)
+			min_ref = abs;
+
+	emit_value:
+		if (!qpack_put_str(out, 0x00, 7, v))
+			goto fail;
+		continue;
+
+	emit_indexed:
+		if (didx < base) {
+			/* indexed field line: [ 1 | T | Index (6+) ] */
+			if (!qpack_put_int(out, 0x80, 6, base - 1 - didx))
+				goto fail;
+		}
+		else {
+			/* indexed field line with post-base index: [ 0 | 0 | 0 | 1 | Index (4+) ] */
+			if (!qpack_put_int(out, 0x10, 4, didx - base))
+				goto fail;
+		}
+
+		if (didx + 1 > ric)
+			ric = didx + 1;
+		if (didx < min_ref)
+			min_ref = didx;
+	}
+
+	/* now the field section prefix (RFC 9204 4.5.1) :
+	 * [ Required Insert Count (8+) ] [ S | Delta Base (7+) ]
+	 */
+	pfx = b_make(pfx_area, sizeof(pfx_area), 0, 0);
+	if (!ric) {
+		qpack_put_int(&pfx, 0x00, 8, 0);
+		qpack_put_int(&pfx, 0x00, 7, 0);
+	}
+	else {
+		enc_ric = ric % (2 * (uint64_t)(enc->max_cap / 32)) + 1;
+		qpack_put_int(&pfx, 0x00, 8, enc_ric);
+		if (base >= ric)
+			qpack_put_int(&pfx, 0x00, 7, base - ric);
+		else
+			qpack_put_int(&pfx, 0x80, 7, ric - base - 1);
+	}
+
+	memcpy(out->area + start, pfx.area, pfx.data);
+	memmove(out->area + start + pfx.data, out->area + start + QPACK_FS_PFX_MAX,
+	        out->data - start - QPACK_FS_PFX_MAX);
+	out->data -= QPACK_FS_PFX_MAX - pfx.data;
+
+	if (ric) {
+		/* this section pins its entries until it is acknowledged */
+		enc->sect[enc->nb_sect].stream_id = stream_id;
+		enc->sect[enc->nb_sect].ric = ric;
+		enc->sect[enc->nb_sect].min_ref = min_ref;
+		enc->nb_sect++;
+	}
+	return 1;
+
+ fail:
+	out->data = start;
+	return 0;
+}
+
+/* Processes the instructions received on the decoder stream (RFC 9204 4.4)
+ * starting at <raw> for <len> bytes, updating the state of encoder <enc>.
+ * Only complete instructions are processed, and the number of bytes consumed
+ * is returned so that the caller may keep the remaining ones until more data
+ * arrive. On failure, the opposite one of the QPACK_ERR_* codes is returned,
+ * which must be treated as a connection error of type
+ * QPACK_DECODER_STREAM_ERROR.
+ */
+int qpack_decode_dec(struct qpack_enc *enc, const unsigned char *raw, uint64_t len)
+{
+	const unsigned char *start = raw;
+	uint64_t val;
+	uint32_t i, j;
+	int ret;
+
+	while (len) {
+		if (*raw & 0x80) {
+			/* section acknowledgment: [ 1 | Stream ID (7+) ] */
+			ret = qpack_get_int(&raw, &len, 7, &val);
+			if (ret <= 0)
+				goto leave;
+
+			for (i = 0; i < enc->nb_sect && enc->sect[i].stream_id != val; i++)
+				;
+
+			if (i == enc->nb_sect)
+				return -QPACK_ERR_UNKNOWN_STREAM;
+
+			if (enc->sect[i].ric > enc->krc)
+				enc->krc = enc->sect[i].ric;
+
+			enc->nb_sect--;
+			memmove(&enc->sect[i], &enc->sect[i + 1], (enc->nb_sect - i) * sizeof(enc->sect[0]));
+		}
+		else if (*raw & 0x40) {
+			/* stream cancellation: [ 0 | 1 | Stream ID (6+) ] */
+			ret = qpack_get_int(&raw, &len, 6, &val);
+			if (ret <= 0)
+				goto leave;
+
+			for (i = j = 0; i < enc->nb_sect; i++) {
+				if (enc->sect[i].stream_id != val)
+					enc->sect[j++] = enc->sect[i];
+			}
+			enc->nb_sect = j;
+		}
+		else {
+			/* insert count increment: [ 0 | 0 | Increment (6+) ] */
+			ret = qpack_get_int(&raw, &len, 6, &val);
+			if (ret <= 0)
+				goto leave;
+
+			if (!val || !enc->dht || val > enc->dht->ins_cnt - enc->krc)
+				return -QPACK_ERR_INVALID_INC;
+
+			enc->krc += val;
+		}
+	}
+	ret = 0;
+
+ leave:
+	if (ret < 0)
+		return ret;
+	return raw - start;
+}
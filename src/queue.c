@@ -31,32 +31,36 @@
  *     assigned server when the pendconn is picked.
  *
  * Threads complicate the design a little bit but rules remain simple :
- *   - the server's queue lock must be held at least when manipulating the
- *     server's queue, which is when adding a pendconn to the queue and when
- *     removing a pendconn from the queue. It protects the queue's integrity.
+ *   - each server and proxy queue is made of QUEUE_SHARDS shards, each with
+ *     its own tree and lock. A pendconn is added to the shard matching its
+ *     thread ID and stays there, p->queue designates it.
  *
- *   - the proxy's queue lock must be held at least when manipulating the
- *     proxy's queue, which is when adding a pendconn to the queue and when
- *     removing a pendconn from the queue. It protects the queue's integrity.
+ *   - the shard's lock must be held at least when manipulating the shard,
+ *     which is when adding a pendconn to it and when removing a pendconn from
+ *     it. It protects the shard's integrity. Neither the server's nor the
+ *     proxy's lock are needed for this.
  *
- *   - both locks are compatible and may be held at the same time.
+ *   - shard locks are only held one at a time. When looking for the next
+ *     pendconn to serve, the heads of the shards are compared one shard at a
+ *     time, then the best shard is locked again and its head is picked. The
+ *     ordering is thus strict within a shard and only best effort between
+ *     shards, which is enough to respect the priority classes and offsets.
  *
  *   - a pendconn_add() is only performed by the stream which will own the
  *     pendconn ; the pendconn is allocated at this moment and returned ; it is
  *     added to either the server or the proxy's queue while holding this
-s *     queue's lock.
+ *     shard's lock.
  *
  *   - the pendconn is then met by a thread walking over the proxy or server's
- *     queue with the respective lock held. This lock is exclusive and the
- *     pendconn can only appear in one queue so by definition a single thread
- *     may find this pendconn at a time.
+ *     queue shard with its lock held. This lock is exclusive and the pendconn
+ *     can only appear in one shard so by definition a single thread may find
+ *     this pendconn at a time.
  *
  *   - the pendconn is unlinked either by its own stream upon success/abort/
  *     free, or by another one offering it its server slot. This is achieved by
- *     pendconn_process_next_strm() under either the server or proxy's lock,
- *     pendconn_redistribute() under the server's lock, pendconn_grab_from_px()
- *     under the proxy's lock, or pendconn_unlink() under either the proxy's or
- *     the server's lock depending on the queue the pendconn is attached to.
+ *     pendconn_process_next_strm(), pendconn_redistribute(),
+ *     pendconn_grab_from_px() or pendconn_unlink(), always under the lock of
+ *     the shard the pendconn is attached to.
  *
  *   - no single operation except the pendconn initialisation prior to the
  *     insertion are performed without eithre a queue lock held or the element
@@ -72,8 +76,10 @@ s *     queue's lock.
 #include <import/eb32tree.h>
 #include <haproxy/api.h>
 #include <haproxy/backend.h>
+#include <haproxy/cfgparse.h>
 #include <haproxy/http_rules.h>
 #include <haproxy/pool.h>
+#include <haproxy/proxy.h>
 #include <haproxy/queue.h>
 #include <haproxy/sample.h>
 #include <haproxy/server-t.h>
@@ -84,6 +90,7 @@ s *     queue's lock.
 #include <haproxy/thread.h>
 #include <haproxy/time.h>
 #include <haproxy/tools.h>
+#include <haproxy/usdt.h>
 
 
 #define NOW_OFFSET_BOUNDARY()          ((now_ms - (TIMER_LOOK_BACK >> 12)) & 0xfffff)
@@ -128,12 +135,13 @@ unsigned int srv_dynamic_maxconn(const struct server *s)
  * is not really dequeued. It will be done during the process_stream. It is
  * up to the caller to atomically decrement the pending counts.
  *
- * The caller must own the lock on the server queue. The pendconn must still be
- * queued (p->node.leaf_p != NULL) and must be in a server (p->srv != NULL).
+ * The caller must own the lock on the pendconn's queue shard. The pendconn must
+ * still be queued (p->node.leaf_p != NULL) and must be in a server (p->srv !=
+ * NULL).
  */
 static void __pendconn_unlink_srv(struct pendconn *p)
 {
-	p->strm->logs.srv_queue_pos += p->srv->queue_idx - p->queue_idx;
+	p->strm->logs.srv_queue_pos += HA_ATOMIC_LOAD(&p->srv->queue_idx) - p->queue_idx;
 	eb32_delete(&p->node);
 }
 
@@ -141,37 +149,32 @@ static void __pendconn_unlink_srv(struct pendconn *p)
  * is not really dequeued. It will be done during the process_stream. It is
  * up to the caller to atomically decrement the pending counts.
  *
- * The caller must own the lock on the proxy queue. The pendconn must still be
- * queued (p->node.leaf_p != NULL) and must be in the proxy (p->srv == NULL).
+ * The caller must own the lock on the pendconn's queue shard. The pendconn must
+ * still be queued (p->node.leaf_p != NULL) and must be in the proxy (p->srv ==
+ * NULL).
  */
 static void __pendconn_unlink_prx(struct pendconn *p)
 {
-	p->strm->logs.prx_queue_pos += p->px->queue_idx - p->queue_idx;
+	p->strm->logs.prx_queue_pos += HA_ATOMIC_LOAD(&p->px->queue_idx) - p->queue_idx;
 	eb32_delete(&p->node);
 }
 
-/* Locks the queue the pendconn element belongs to. This relies on both p->px
- * and p->srv to be properly initialized (which is always the case once the
+/* Locks the queue shard the pendconn element belongs to. This relies on
+ * p->queue to be properly initialized (which is always the case once the
  * element has been added).
  */
 static inline void pendconn_queue_lock(struct pendconn *p)
 {
-	if (p->srv)
-		HA_SPIN_LOCK(SERVER_LOCK, &p->srv->lock);
-	else
-		HA_RWLOCK_WRLOCK(PROXY_LOCK, &p->px->lock);
+	HA_SPIN_LOCK(QUEUE_LOCK, &p->queue->lock);
 }
 
-/* Unlocks the queue the pendconn element belongs to. This relies on both p->px
- * and p->srv to be properly initialized (which is always the case once the
+/* Unlocks the queue shard the pendconn element belongs to. This relies on
+ * p->queue to be properly initialized (which is always the case once the
  * element has been added).
  */
 static inline void pendconn_queue_unlock(struct pendconn *p)
 {
-	if (p->srv)
-		HA_SPIN_UNLOCK(SERVER_LOCK, &p->srv->lock);
-	else
-		HA_RWLOCK_WRUNLOCK(PROXY_LOCK, &p->px->lock);
+	HA_SPIN_UNLOCK(QUEUE_LOCK, &p->queue->lock);
 }
 
 /* Removes the pendconn from the server/proxy queue. At this stage, the
@@ -185,31 +188,22 @@ void pendconn_unlink(struct pendconn *p)
 {
 	int done = 0;
 
-	if (p->srv) {
-		/* queued in the server */
-		HA_SPIN_LOCK(SERVER_LOCK, &p->srv->lock);
-		if (p->node.node.leaf_p) {
+	pendconn_queue_lock(p);
+	if (p->node.node.leaf_p) {
+		if (p->srv)
 			__pendconn_unlink_srv(p);
-			done = 1;
-		}
-		HA_SPIN_UNLOCK(SERVER_LOCK, &p->srv->lock);
-		if (done) {
-			_HA_ATOMIC_DEC(&p->srv->nbpend);
-			_HA_ATOMIC_DEC(&p->px->totpend);
-		}
-	}
-	else {
-		/* queued in the proxy */
-		HA_RWLOCK_WRLOCK(PROXY_LOCK, &p->px->lock);
-		if (p->node.node.leaf_p) {
+		else
 			__pendconn_unlink_prx(p);
-			done = 1;
-		}
-		HA_RWLOCK_WRUNLOCK(PROXY_LOCK, &p->px->lock);
-		if (done) {
+		done = 1;
+	}
+	pendconn_queue_unlock(p);
+
+	if (done) {
+		if (p->srv)
+			_HA_ATOMIC_DEC(&p->srv->nbpend);
+		else
 			_HA_ATOMIC_DEC(&p->px->nbpend);
-			_HA_ATOMIC_DEC(&p->px->totpend);
-		}
+		_HA_ATOMIC_DEC(&p->px->totpend);
 	}
 }
 
@@ -240,6 +234,124 @@ static struct pendconn *pendconn_first(struct eb_root *pendconns)
 	return eb32_entry(node2, struct pendconn, node);
 }
 
+/* Retrieve the pendconn of the first class with the latest time offset from
+ * tree <pendconns>, which is the most recently queued one in the absence of
+ * priority offsets. The keys of this class below the time boundary wrapped
+ * and are thus later than the ones above it.
+ */
+static struct pendconn *pendconn_last(struct eb_root *pendconns)
+{
+	struct eb32_node *node, *node2;
+	u32 key;
+
+	node = eb32_first(pendconns);
+	if (!node)
+		return NULL;
+
+	key = KEY_CLASS_OFFSET_BOUNDARY(node->key);
+	if (KEY_OFFSET(key)) {
+		node2 = eb32_lookup_le(pendconns, key - 1);
+		if (node2 && KEY_CLASS(node2->key) == KEY_CLASS(node->key))
+			return eb32_entry(node2, struct pendconn, node);
+	}
+
+	node2 = eb32_lookup_le(pendconns, KEY_CLASS(node->key) | 0xfffff);
+	return eb32_entry(node2, struct pendconn, node);
+}
+
+/* Returns the pendconn to serve first from tree <pendconns>, which is the
+ * latest one of the first class if <lifo> is set, otherwise the earliest one.
+ */
+static inline struct pendconn *pendconn_next(struct eb_root *pendconns, int lifo)
+{
+	return lifo ? pendconn_last(pendconns) : pendconn_first(pendconns);
+}
+
+/* Returns non-zero if a pendconn of key <k1> must be served before, or at the
+ * same time as, a pendconn of key <k2>. Classes are compared first, then the
+ * time offsets, which may wrap. The latest offset wins if <lifo> is set.
+ */
+static inline int pendconn_key_first(u32 k1, u32 k2, int lifo)
+{
+	if (KEY_CLASS(k1) != KEY_CLASS(k2))
+		return KEY_CLASS(k1) < KEY_CLASS(k2);
+
+	k1 = KEY_OFFSET(k1);
+	k2 = KEY_OFFSET(k2);
+
+	if (k1 < NOW_OFFSET_BOUNDARY())
+		k1 += 0x100000; // key in the future
+
+	if (k2 < NOW_OFFSET_BOUNDARY())
+		k2 += 0x100000; // key in the future
+
+	return lifo ? k1 >= k2 : k1 <= k2;
+}
+
+/* Returns the shard of queue <q> whose first pendconn must be served first,
+ * or NULL if all of them are empty. The key of this pendconn is stored into
+ * <key>. The latest pendconns are served first if <lifo> is set. The shards
+ * are locked one at a time, so the result is only a hint that the caller must
+ * check again once the shard is locked.
+ */
+static struct queue *queue_first_shard(struct queue *q, u32 *key, int lifo)
+{
+	struct queue *best = NULL;
+	struct pendconn *p;
+	int i;
+
+	for (i = 0; i < QUEUE_SHARDS; i++) {
+		if (eb_is_empty(&q[i].head))
+			continue;
+
+		HA_SPIN_LOCK(QUEUE_LOCK, &q[i].lock);
+		p = pendconn_next(&q[i].head, lifo);
+		if (p && (!best || !pendconn_key_first(*key, p->node.key, lifo))) {
+			best = &q[i];
+			*key = p->node.key;
+		}
+		HA_SPIN_UNLOCK(QUEUE_LOCK, &q[i].lock);
+	}
+	return best;
+}
+
+/* Returns the first pendconn of the queue <q> with the shard it belongs to
+ * locked, or NULL if the queue is empty. The latest one is returned instead if
+ * <lifo> is set. The caller has to unlock p->queue once done with the
+ * pendconn.
+ */
+static struct pendconn *queue_lock_first(struct queue *q, int lifo)
+{
+	struct pendconn *p;
+	struct queue *shard;
+	u32 key;
+
+	while ((shard = queue_first_shard(q, &key, lifo))) {
+		HA_SPIN_LOCK(QUEUE_LOCK, &shard->lock);
+		p = pendconn_next(&shard->head, lifo);
+		if (p)
+			return p;
+		/* emptied in the mean time */
+		HA_SPIN_UNLOCK(QUEUE_LOCK, &shard->lock);
+	}
+	return NULL;
+}
+
+/* Updates the "queue-codel" state of backend <px> when pendconn <p> is
+ * dequeued. The queues are considered below target when a pendconn served in
+ * FIFO order waited less than the target, or when they are empty after a
+ * pendconn was served in LIFO order, which is the only way to know that the
+ * old ones were served or rejected.
+ */
+static inline void pendconn_codel_update(struct proxy *px, const struct pendconn *p, int lifo)
+{
+	if (!px->codel.target)
+		return;
+
+	if (lifo ? !HA_ATOMIC_LOAD(&px->totpend) : (int)(now_ms - p->date) < (int)px->codel.target)
+		HA_ATOMIC_STORE(&px->codel.ok_date, now_ms);
+}
+
 /* Process the next pending connection from either a server or a proxy, and
  * returns a strictly positive value on success (see below). If no pending
  * connection is found, 0 is returned.  Note that neither <srv> nor <px> may be
@@ -251,76 +363,84 @@ static struct pendconn *pendconn_first(struct eb_root *pendconns)
  * connections remain there, it means that some requests have been forced there
  * after it was seen down (eg: due to option persist).  The stream is
  * immediately marked as "assigned", and both its <srv> and <srv_conn> are set
- * to <srv>.
+ * to <srv>. While the backend's queues are shedding load ("queue-codel"), the
+ * pending connections which waited longer than the target are rejected, or
+ * the most recent ones are served first with the "lifo" option.
  *
- * This function must only be called if the server queue _AND_ the proxy queue
- * are locked. Today it is only called by process_srv_queue. When a pending
- * connection is dequeued, this function returns 1 if the pending connection can
- * be handled by the current thread, else it returns 2.
+ * This function must only be called with the server's lock held, so that a
+ * single thread dequeues for a given server. Today it is only called by
+ * process_srv_queue. It takes the queue shards' locks. When a pending
+ * connection is dequeued, this function returns 1 if the pending connection
+ * can be handled by the current thread, else it returns 2.
  */
 static int pendconn_process_next_strm(struct server *srv, struct proxy *px)
 {
-	struct pendconn *p = NULL;
-	struct pendconn *pp = NULL;
-	struct server   *rsrv;
-	u32 pkey, ppkey;
+	struct pendconn *p;
+	struct queue *q, *pq;
+	struct server *rsrv;
+	u32 key, pkey;
+	int shedding, lifo;
 
 	rsrv = srv->track;
 	if (!rsrv)
 		rsrv = srv;
 
-	p = NULL;
+	shedding = queue_codel_shedding(px);
+	lifo = shedding && px->codel.lifo;
+ again:
+	q = NULL;
 	if (srv->nbpend)
-		p = pendconn_first(&srv->pendconns);
+		q = queue_first_shard(srv->queues, &key, lifo);
 
-	pp = NULL;
+	pq = NULL;
 	if (srv_currently_usable(rsrv) && px->nbpend &&
 	    (!(srv->flags & SRV_F_BACKUP) ||
 	     (!px->srv_act &&
 	      (srv == px->lbprm.fbck || (px->options & PR_O_USE_ALL_BK)))))
-		pp = pendconn_first(&px->pendconns);
+		pq = queue_first_shard(px->queues, &pkey, lifo);
 
-	if (!p && !pp)
+	if (!q && !pq)
 		return 0;
-	else if (!pp)
-		goto use_p; /*  p != NULL */
-	else if (!p)
-		goto use_pp; /* pp != NULL */
-
-	/* p != NULL && pp != NULL*/
 
-	if (KEY_CLASS(p->node.key) < KEY_CLASS(pp->node.key))
-		goto use_p;
+	/* the server's pendconn wins on equal keys */
+	if (q && pq && !pendconn_key_first(key, pkey, lifo))
+		q = NULL;
 
-	if (KEY_CLASS(pp->node.key) < KEY_CLASS(p->node.key))
-		goto use_pp;
+	if (!q)
+		q = pq;
 
-	pkey  = KEY_OFFSET(p->node.key);
-	ppkey = KEY_OFFSET(pp->node.key);
-
-	if (pkey < NOW_OFFSET_BOUNDARY())
-		pkey += 0x100000; // key in the future
+	HA_SPIN_LOCK(QUEUE_LOCK, &q->lock);
+	p = pendconn_next(&q->head, lifo);
+	if (!p) {
+		/* emptied in the mean time */
+		HA_SPIN_UNLOCK(QUEUE_LOCK, &q->lock);
+		goto again;
+	}
 
-	if (ppkey < NOW_OFFSET_BOUNDARY())
-		ppkey += 0x100000; // key in the future
+	if (p->srv) {
+		__pendconn_unlink_srv(p);
+		_HA_ATOMIC_DEC(&srv->nbpend);
+		_HA_ATOMIC_INC(&srv->queue_idx);
+	}
+	else {
+		/* Let's switch from the server pendconn to the proxy pendconn */
+		__pendconn_unlink_prx(p);
+		_HA_ATOMIC_DEC(&px->nbpend);
+		_HA_ATOMIC_INC(&px->queue_idx);
+	}
+	_HA_ATOMIC_DEC(&px->totpend);
 
-	if (pkey <= ppkey)
-		goto use_p;
+	if (unlikely(shedding && !lifo) && (int)(now_ms - p->date) >= (int)px->codel.target) {
+		/* waited too long while shedding load, let the stream
+		 * reject it and try the next one.
+		 */
+		p->rejected = 1;
+		task_wakeup(p->strm->task, TASK_WOKEN_RES);
+		HA_SPIN_UNLOCK(QUEUE_LOCK, &q->lock);
+		goto again;
+	}
+	pendconn_codel_update(px, p, lifo);
 
- use_pp:
-	/* Let's switch from the server pendconn to the proxy pendconn */
-	__pendconn_unlink_prx(pp);
-	_HA_ATOMIC_DEC(&px->nbpend);
-	_HA_ATOMIC_DEC(&px->totpend);
-	px->queue_idx++;
-	p = pp;
-	goto unlinked;
- use_p:
-	__pendconn_unlink_srv(p);
-	_HA_ATOMIC_DEC(&srv->nbpend);
-	_HA_ATOMIC_DEC(&px->totpend);
-	srv->queue_idx++;
- unlinked:
 	p->strm_flags |= SF_ASSIGNED;
 	p->target = srv;
 
@@ -332,6 +452,7 @@ static int pendconn_process_next_strm(struct server *srv, struct proxy *px)
 	stream_add_srv_conn(p->strm, srv);
 
 	task_wakeup(p->strm->task, TASK_WOKEN_RES);
+	HA_SPIN_UNLOCK(QUEUE_LOCK, &q->lock);
 
 	return 1;
 }
@@ -345,14 +466,12 @@ void process_srv_queue(struct server *s)
 	int maxconn;
 
 	HA_SPIN_LOCK(SERVER_LOCK, &s->lock);
-	HA_RWLOCK_WRLOCK(PROXY_LOCK,  &p->lock);
 	maxconn = srv_dynamic_maxconn(s);
 	while (s->served < maxconn) {
 		int ret = pendconn_process_next_strm(s, p);
 		if (!ret)
 			break;
 	}
-	HA_RWLOCK_WRUNLOCK(PROXY_LOCK,  &p->lock);
 	HA_SPIN_UNLOCK(SERVER_LOCK, &s->lock);
 }
 
@@ -397,6 +516,8 @@ struct pendconn *pendconn_add(struct stream *strm)
 	p->px         = px;
 	p->strm       = strm;
 	p->strm_flags = strm->flags;
+	p->date       = now_ms;
+	p->rejected   = 0;
 
 	if (srv) {
 		unsigned int old_max, new_max;
@@ -409,10 +530,11 @@ struct pendconn *pendconn_add(struct stream *strm)
 		}
 		__ha_barrier_atomic_store();
 
-		HA_SPIN_LOCK(SERVER_LOCK, &p->srv->lock);
-		p->queue_idx = srv->queue_idx - 1; // for increment
-		eb32_insert(&srv->pendconns, &p->node);
-		HA_SPIN_UNLOCK(SERVER_LOCK, &p->srv->lock);
+		p->queue = &srv->queues[tid % QUEUE_SHARDS];
+		HA_SPIN_LOCK(QUEUE_LOCK, &p->queue->lock);
+		p->queue_idx = HA_ATOMIC_LOAD(&srv->queue_idx) - 1; // for increment
+		eb32_insert(&p->queue->head, &p->node);
+		HA_SPIN_UNLOCK(QUEUE_LOCK, &p->queue->lock);
 	}
 	else {
 		unsigned int old_max, new_max;
@@ -425,45 +547,55 @@ struct pendconn *pendconn_add(struct stream *strm)
 		}
 		__ha_barrier_atomic_store();
 
-		HA_RWLOCK_WRLOCK(PROXY_LOCK, &p->px->lock);
-		p->queue_idx = px->queue_idx - 1; // for increment
-		eb32_insert(&px->pendconns, &p->node);
-		HA_RWLOCK_WRUNLOCK(PROXY_LOCK, &p->px->lock);
+		p->queue = &px->queues[tid % QUEUE_SHARDS];
+		HA_SPIN_LOCK(QUEUE_LOCK, &p->queue->lock);
+		p->queue_idx = HA_ATOMIC_LOAD(&px->queue_idx) - 1; // for increment
+		eb32_insert(&p->queue->head, &p->node);
+		HA_SPIN_UNLOCK(QUEUE_LOCK, &p->queue->lock);
 	}
 	strm->pend_pos = p;
 
-	_HA_ATOMIC_INC(&px->totpend);
+	/* a request arriving in empty queues does not face any standing queue */
+	if (!_HA_ATOMIC_FETCH_ADD(&px->totpend, 1) && px->codel.target)
+		HA_ATOMIC_STORE(&px->codel.ok_date, now_ms);
+	HA_USDT(queue_add, strm->uniq_id, strm, srv ? srv->puid : 0, px->uuid,
+	        srv ? srv->nbpend : px->nbpend);
 	return p;
 }
 
 /* Redistribute pending connections when a server goes down. The number of
  * connections redistributed is returned. It must be called with the server
- * lock held.
+ * lock held, and will take the queue shards' locks.
  */
 int pendconn_redistribute(struct server *s)
 {
 	struct pendconn *p;
 	struct eb32_node *node, *nodeb;
 	int xferred = 0;
+	int i;
 
 	/* The REDISP option was specified. We will ignore cookie and force to
 	 * balance or use the dispatcher. */
 	if ((s->proxy->options & (PR_O_REDISP|PR_O_PERSIST)) != PR_O_REDISP)
 		return 0;
 
-	for (node = eb32_first(&s->pendconns); node; node = nodeb) {
-		nodeb =	eb32_next(node);
+	for (i = 0; i < QUEUE_SHARDS; i++) {
+		HA_SPIN_LOCK(QUEUE_LOCK, &s->queues[i].lock);
+		for (node = eb32_first(&s->queues[i].head); node; node = nodeb) {
+			nodeb =	eb32_next(node);
 
-		p = eb32_entry(node, struct pendconn, node);
-		if (p->strm_flags & SF_FORCE_PRST)
-			continue;
+			p = eb32_entry(node, struct pendconn, node);
+			if (p->strm_flags & SF_FORCE_PRST)
+				continue;
 
-		/* it's left to the dispatcher to choose a server */
-		__pendconn_unlink_srv(p);
-		p->strm_flags &= ~(SF_DIRECT | SF_ASSIGNED | SF_ADDR_SET);
+			/* it's left to the dispatcher to choose a server */
+			__pendconn_unlink_srv(p);
+			p->strm_flags &= ~(SF_DIRECT | SF_ASSIGNED | SF_ADDR_SET);
 
-		task_wakeup(p->strm->task, TASK_WOKEN_RES);
-		xferred++;
+			task_wakeup(p->strm->task, TASK_WOKEN_RES);
+			xferred++;
+		}
+		HA_SPIN_UNLOCK(QUEUE_LOCK, &s->queues[i].lock);
 	}
 	if (xferred) {
 		_HA_ATOMIC_SUB(&s->nbpend, xferred);
@@ -476,12 +608,13 @@ int pendconn_redistribute(struct server *s)
  * the server coming up. The server's weight is checked before being assigned
  * connections it may not be able to handle. The total number of transferred
  * connections is returned. It must be called with the server lock held, and
- * will take the proxy's lock.
+ * will take the proxy's queue shards' locks.
  */
 int pendconn_grab_from_px(struct server *s)
 {
 	struct pendconn *p;
 	int maxconn, xferred = 0;
+	int lifo;
 
 	if (!srv_currently_usable(s))
 		return 0;
@@ -495,19 +628,21 @@ int pendconn_grab_from_px(struct server *s)
 	     ((s != s->proxy->lbprm.fbck) && !(s->proxy->options & PR_O_USE_ALL_BK))))
 		return 0;
 
-	HA_RWLOCK_WRLOCK(PROXY_LOCK, &s->proxy->lock);
+	lifo = s->proxy->codel.lifo && queue_codel_shedding(s->proxy);
 	maxconn = srv_dynamic_maxconn(s);
-	while ((p = pendconn_first(&s->proxy->pendconns))) {
-		if (s->maxconn && s->served + xferred >= maxconn)
+	while (!s->maxconn || s->served + xferred < maxconn) {
+		p = queue_lock_first(s->proxy->queues, lifo);
+		if (!p)
 			break;
 
 		__pendconn_unlink_prx(p);
 		p->target = s;
+		pendconn_codel_update(s->proxy, p, lifo);
 
 		task_wakeup(p->strm->task, TASK_WOKEN_RES);
+		HA_SPIN_UNLOCK(QUEUE_LOCK, &p->queue->lock);
 		xferred++;
 	}
-	HA_RWLOCK_WRUNLOCK(PROXY_LOCK, &s->proxy->lock);
 	if (xferred) {
 		_HA_ATOMIC_SUB(&s->proxy->nbpend, xferred);
 		_HA_ATOMIC_SUB(&s->proxy->totpend, xferred);
@@ -517,7 +652,8 @@ int pendconn_grab_from_px(struct server *s)
 
 /* Try to dequeue pending connection attached to the stream <strm>. It must
  * always exists here. If the pendconn is still linked to the server or the
- * proxy queue, nothing is done and the function returns 1. Otherwise,
+ * proxy queue, nothing is done and the function returns 1. If it was unlinked
+ * to be rejected, it is left in place and -1 is returned. Otherwise,
  * <strm>->flags and <strm>->target are updated, the pendconn is released and 0
  * is returned.
  *
@@ -552,6 +688,9 @@ int pendconn_dequeue(struct stream *strm)
 	if (!is_unlinked)
 		return 1;
 
+	if (p->rejected)
+		return -1;
+
 	/* the pendconn is not queued anymore and will not be so we're safe
 	 * to proceed.
 	 */
@@ -693,6 +832,66 @@ smp_fetch_priority_offset(const struct arg *args, struct sample *smp, const char
 }
 
 
+/* Parses "queue-codel <target> [interval <time>] [lifo]" in a proxy section.
+ * Returns -1 on error, 1 on warning, otherwise 0, with <err> filled if
+ * non-zero.
+ */
+static int proxy_parse_queue_codel(char **args, int section, struct proxy *curpx,
+                                   const struct proxy *defpx, const char *file, int line,
+                                   char **err)
+{
+	unsigned int target, interval = QUEUE_CODEL_INTERVAL;
+	int lifo = 0;
+	const char *res;
+	int cur_arg;
+
+	if (!*args[1]) {
+		memprintf(err, "'%s' expects a target queueing delay", args[0]);
+		return -1;
+	}
+
+	res = parse_time_err(args[1], &target, TIME_UNIT_MS);
+	if (res == PARSE_TIME_OVER || res == PARSE_TIME_UNDER || res || !target) {
+		memprintf(err, "'%s' expects a non-null target delay, got '%s'", args[0], args[1]);
+		return -1;
+	}
+
+	for (cur_arg = 2; *args[cur_arg]; cur_arg++) {
+		if (strcmp(args[cur_arg], "interval") == 0) {
+			res = *args[cur_arg + 1] ? parse_time_err(args[cur_arg + 1], &interval, TIME_UNIT_MS) : args[cur_arg];
+			if (res == PARSE_TIME_OVER || res == PARSE_TIME_UNDER || res || !interval) {
+				memprintf(err, "'%s %s' expects a non-null delay", args[0], args[cur_arg]);
+				return -1;
+			}
+			cur_arg++;
+		}
+		else if (strcmp(args[cur_arg], "lifo") == 0)
+			lifo = 1;
+		else {
+			memprintf(err, "'%s' : unknown option '%s', expects 'interval' or 'lifo'", args[0], args[cur_arg]);
+			return -1;
+		}
+	}
+
+	if (!(curpx->cap & PR_CAP_BE)) {
+		memprintf(err, "%s will be ignored because %s '%s' has no backend capability",
+		          args[0], proxy_type_str(curpx), curpx->id);
+		return 1;
+	}
+
+	curpx->codel.target = target;
+	curpx->codel.interval = interval;
+	curpx->codel.lifo = lifo;
+	return 0;
+}
+
+static struct cfg_kw_list cfg_kws = {ILH, {
+	{ CFG_LISTEN, "queue-codel", proxy_parse_queue_codel },
+	{ 0, NULL, NULL },
+}};
+
+INITCALL1(STG_REGISTER, cfg_register_keywords, &cfg_kws);
+
 static struct sample_fetch_kw_list smp_kws = {ILH, {
 	{ "prio_class", smp_fetch_priority_class, 0, NULL, SMP_T_SINT, SMP_USE_INTRN, },
 	{ "prio_offset", smp_fetch_priority_offset, 0, NULL, SMP_T_SINT, SMP_USE_INTRN, },
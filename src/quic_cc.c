@@ -20,8 +20,14 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
  */
 
+#include <string.h>
+
+#include <haproxy/api.h>
 #include <haproxy/buf.h>
+#include <haproxy/connection.h>
+#include <haproxy/listener.h>
 #include <haproxy/quic_cc-t.h>
+#include <haproxy/tools.h>
 #include <haproxy/xprt_quic-t.h>
 
 
@@ -50,3 +56,44 @@ void quic_cc_state_trace(struct buffer *buf, const struct quic_cc *cc)
 {
 	cc->algo->state_trace(buf, cc);
 }
+
+/* The congestion control algorithms which may be selected by their name */
+static struct quic_cc_algo *quic_cc_algos[] = {
+	&quic_cc_algo_nr,
+	&quic_cc_algo_cubic,
+};
+
+/* parse the "quic-cc-algo" bind keyword */
+static int bind_parse_quic_cc_algo(char **args, int cur_arg, struct proxy *px,
+                                   struct bind_conf *conf, char **err)
+{
+	int i;
+
+	if (!*args[cur_arg + 1]) {
+		memprintf(err, "'%s' : missing algorithm name", args[cur_arg]);
+		return ERR_ALERT | ERR_FATAL;
+	}
+
+	if (conf->xprt != xprt_get(XPRT_QUIC)) {
+		memprintf(err, "'%s' : only supported on QUIC listeners", args[cur_arg]);
+		return ERR_ALERT | ERR_FATAL;
+	}
+
+	for (i = 0; i < sizeof(quic_cc_algos) / sizeof(*quic_cc_algos); i++) {
+		if (strcmp(args[cur_arg + 1], quic_cc_algos[i]->name) == 0) {
+			conf->quic_cc_algo = quic_cc_algos[i];
+			return 0;
+		}
+	}
+
+	memprintf(err, "'%s' : unknown algorithm '%s', expects 'newreno' or 'cubic'",
+	          args[cur_arg], args[cur_arg + 1]);
+	return ERR_ALERT | ERR_FATAL;
+}
+
+static struct bind_kw_list bind_kws = { "QUIC", { }, {
+	{ "quic-cc-algo", bind_parse_quic_cc_algo, 1 }, /* congestion control algorithm */
+	{ NULL, NULL, 0 },
+}};
+
+INITCALL1(STG_REGISTER, bind_register_keywords, &bind_kws);
@@ -0,0 +1,270 @@
+/*
+ * CUBIC congestion control algorithm (RFC 8312).
+ *
+ * This file contains definitions for QUIC congestion control.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, version 2.1
+ * exclusively.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include <haproxy/quic_cc.h>
+#include <haproxy/ticks.h>
+#include <haproxy/trace.h>
+#include <haproxy/xprt_quic.h>
+
+#define TRACE_SOURCE    &trace_quic
+
+/* The multiplicative decrease factor (beta = 0.7) and the scaling constant
+ * (C = 0.4 in MSS/s^3) are expressed in 1/1024th and in 1/10th.
+ */
+#define CUBIC_BETA_SCALED   717
+#define CUBIC_BETA_SHIFT    10
+#define CUBIC_C_NUM         4
+#define CUBIC_C_DEN         10
+/* Additive increase factor of the Reno-friendly region, 3*(1-beta)/(1+beta),
+ * in 1/1024th.
+ */
+#define CUBIC_ALPHA_SCALED  542
+/* Time elapsed in an epoch above which the cubic function is not evaluated
+ * anymore, to prevent overflows (ms).
+ */
+#define CUBIC_MAX_T         1000000U
+
+/* Returns the integer cubic root of <x>. */
+static uint64_t cubic_root(uint64_t x)
+{
+	uint64_t y = 0;
+	int s;
+
+	for (s = 63; s >= 0; s -= 3) {
+		uint64_t b;
+
+		y <<= 1;
+		b = 3 * y * (y + 1) + 1;
+		if ((x >> s) >= b) {
+			x -= b << s;
+			y++;
+		}
+	}
+	return y;
+}
+
+static int quic_cc_cubic_init(struct quic_cc *cc)
+{
+	struct quic_path *path;
+
+	path = container_of(cc, struct quic_path, cc);
+	cc->algo_state.cu.state = QUIC_CC_ST_SS;
+	cc->algo_state.cu.cwnd = path->cwnd;
+	cc->algo_state.cu.ssthresh = QUIC_CC_INFINITE_SSTHESH;
+	cc->algo_state.cu.recovery_start_time = 0;
+	cc->algo_state.cu.last_w_max = 0;
+	cc->algo_state.cu.origin = 0;
+	cc->algo_state.cu.tcp_wnd = 0;
+	cc->algo_state.cu.epoch_start = 0;
+	cc->algo_state.cu.K = 0;
+
+	return 1;
+}
+
+/* Grows the congestion window of <cc> in congestion avoidance on receipt of an
+ * acknowledgement for <acked> bytes, following the cubic function from the
+ * start of the epoch, or the Reno-friendly window if it is larger.
+ */
+static void quic_cc_cubic_update(struct quic_cc *cc, uint64_t acked)
+{
+	struct cubic *cu = &cc->algo_state.cu;
+	struct quic_path *path;
+	uint64_t target, delta, t, d;
+
+	path = container_of(cc, struct quic_path, cc);
+	if (!cu->epoch_start) {
+		/* epoch_start must never be zero */
+		cu->epoch_start = now_ms | 1;
+		if (cu->cwnd < cu->last_w_max) {
+			/* K = cubic_root((W_max - cwnd) / C), in ms */
+			cu->K = cubic_root((cu->last_w_max - cu->cwnd) * CUBIC_C_DEN /
+			                   (CUBIC_C_NUM * path->mtu) * 1000000000ULL);
+			cu->origin = cu->last_w_max;
+		}
+		else {
+			cu->K = 0;
+			cu->origin = cu->cwnd;
+		}
+		cu->tcp_wnd = cu->cwnd;
+	}
+
+	/* The target is the window the cubic function gives one RTT ahead */
+	t = (unsigned int)(now_ms - cu->epoch_start) + (path->loss.srtt >> 3);
+	if (t > CUBIC_MAX_T)
+		t = CUBIC_MAX_T;
+
+	d = t > cu->K ? t - cu->K : cu->K - t;
+	/* C * d^3 in bytes with <d> in ms */
+	delta = d * d * d * CUBIC_C_NUM / 1000000 * path->mtu / (CUBIC_C_DEN * 1000);
+	if (t > cu->K)
+		target = cu->origin + delta;
+	else
+		target = cu->origin > delta ? cu->origin - delta : 0;
+
+	/* never grow faster than 1.5 times per RTT */
+	if (target > cu->cwnd + cu->cwnd / 2)
+		target = cu->cwnd + cu->cwnd / 2;
+
+	if (target > cu->cwnd)
+		cu->cwnd += (target - cu->cwnd) * acked / cu->cwnd;
+
+	/* Reno-friendly region */
+	cu->tcp_wnd += path->mtu * acked * CUBIC_ALPHA_SCALED / (cu->cwnd << 10);
+	if (cu->tcp_wnd > cu->cwnd)
+		cu->cwnd = cu->tcp_wnd;
+}
+
+/* Reduces the congestion window of <cc> after a packet loss detected at <now>,
+ * and enters the recovery period.
+ */
+static void quic_cc_cubic_reduce(struct quic_cc *cc, unsigned int now)
+{
+	struct cubic *cu = &cc->algo_state.cu;
+	struct quic_path *path;
+
+	path = container_of(cc, struct quic_path, cc);
+	cu->recovery_start_time = now;
+	cu->epoch_start = 0;
+	/* fast convergence: release some bandwidth when the window shrinks */
+	if (cu->cwnd < cu->last_w_max)
+		cu->last_w_max = (cu->cwnd * (1024 + CUBIC_BETA_SCALED)) >> (CUBIC_BETA_SHIFT + 1);
+	else
+		cu->last_w_max = cu->cwnd;
+	cu->cwnd = QUIC_MAX((cu->cwnd * CUBIC_BETA_SCALED) >> CUBIC_BETA_SHIFT, path->min_cwnd);
+	cu->ssthresh = cu->cwnd;
+}
+
+/* Slow start callback. */
+static void quic_cc_cubic_ss_cb(struct quic_cc *cc, struct quic_cc_event *ev)
+{
+	struct cubic *cu = &cc->algo_state.cu;
+	struct quic_path *path;
+
+	TRACE_ENTER(QUIC_EV_CONN_CC, cc->qc->conn, ev);
+	path = container_of(cc, struct quic_path, cc);
+	switch (ev->type) {
+	case QUIC_CC_EVT_ACK:
+		path->in_flight -= ev->ack.acked;
+		/* Do not increase the congestion window in recovery period. */
+		if (ev->ack.time_sent <= cu->recovery_start_time)
+			goto out;
+
+		cu->cwnd += ev->ack.acked;
+		/* Exit to congestion avoidance if slow start threshold is reached. */
+		if (cu->cwnd > cu->ssthresh)
+			cu->state = QUIC_CC_ST_CA;
+		path->cwnd = cu->cwnd;
+		break;
+
+	case QUIC_CC_EVT_LOSS:
+		path->in_flight -= ev->loss.lost_bytes;
+		quic_cc_cubic_reduce(cc, ev->loss.now_ms);
+		path->cwnd = cu->cwnd;
+		/* Exit to congestion avoidance. */
+		cu->state = QUIC_CC_ST_CA;
+		break;
+
+	case QUIC_CC_EVT_ECN_CE:
+		/* XXX TO DO XXX */
+		break;
+	}
+
+ out:
+	TRACE_LEAVE(QUIC_EV_CONN_CC, cc->qc->conn, NULL, cc);
+}
+
+/* Congestion avoidance callback. */
+static void quic_cc_cubic_ca_cb(struct quic_cc *cc, struct quic_cc_event *ev)
+{
+	struct cubic *cu = &cc->algo_state.cu;
+	struct quic_path *path;
+
+	TRACE_ENTER(QUIC_EV_CONN_CC, cc->qc->conn, ev);
+	path = container_of(cc, struct quic_path, cc);
+	switch (ev->type) {
+	case QUIC_CC_EVT_ACK:
+		path->in_flight -= ev->ack.acked;
+		/* Do not increase the congestion window in recovery period. */
+		if (ev->ack.time_sent <= cu->recovery_start_time)
+			goto out;
+
+		quic_cc_cubic_update(cc, ev->ack.acked);
+		path->cwnd = cu->cwnd;
+		break;
+
+	case QUIC_CC_EVT_LOSS:
+		path->in_flight -= ev->loss.lost_bytes;
+		if (ev->loss.newest_time_sent > cu->recovery_start_time)
+			quic_cc_cubic_reduce(cc, ev->loss.now_ms);
+		if (quic_loss_persistent_congestion(&path->loss,
+		                                    ev->loss.period,
+		                                    ev->loss.now_ms,
+		                                    ev->loss.max_ack_delay)) {
+			cu->cwnd = path->min_cwnd;
+			cu->epoch_start = 0;
+			/* Re-entering slow start state. */
+			cu->state = QUIC_CC_ST_SS;
+		}
+		path->cwnd = cu->cwnd;
+		break;
+
+	case QUIC_CC_EVT_ECN_CE:
+		/* XXX TO DO XXX */
+		break;
+	}
+
+ out:
+	TRACE_LEAVE(QUIC_EV_CONN_CC, cc->qc->conn, NULL, cc);
+}
+
+static void quic_cc_cubic_state_trace(struct buffer *buf, const struct quic_cc *cc)
+{
+	const struct cubic *cu = &cc->algo_state.cu;
+
+	chunk_appendf(buf, " state=%s cwnd=%llu ssthresh=%ld recovery_start_time=%llu"
+	              " w_max=%llu origin=%llu tcp_wnd=%llu epoch_start=%u K=%u",
+	              quic_cc_state_str(cu->state),
+	              (unsigned long long)cu->cwnd,
+	              (long)cu->ssthresh,
+	              (unsigned long long)cu->recovery_start_time,
+	              (unsigned long long)cu->last_w_max,
+	              (unsigned long long)cu->origin,
+	              (unsigned long long)cu->tcp_wnd,
+	              cu->epoch_start, cu->K);
+}
+
+static void (*quic_cc_cubic_state_cbs[])(struct quic_cc *cc,
+                                         struct quic_cc_event *ev) = {
+	[QUIC_CC_ST_SS] = quic_cc_cubic_ss_cb,
+	[QUIC_CC_ST_CA] = quic_cc_cubic_ca_cb,
+};
+
+static void quic_cc_cubic_event(struct quic_cc *cc, struct quic_cc_event *ev)
+{
+	return quic_cc_cubic_state_cbs[cc->algo_state.cu.state](cc, ev);
+}
+
+struct quic_cc_algo quic_cc_algo_cubic = {
+	.type        = QUIC_CC_ALGO_TP_CUBIC,
+	.name        = "cubic",
+	.init        = quic_cc_cubic_init,
+	.event       = quic_cc_cubic_event,
+	.state_trace = quic_cc_cubic_state_trace,
+};
@@ -146,6 +146,7 @@ static void quic_cc_nr_event(struct quic_cc *cc, struct quic_cc_event *ev)
 
 struct quic_cc_algo quic_cc_algo_nr = {
 	.type        = QUIC_CC_ALGO_TP_NEWRENO,
+	.name        = "newreno",
 	.init        = quic_cc_nr_init,
 	.event       = quic_cc_nr_event,
 	.state_trace = quic_cc_nr_state_trace,
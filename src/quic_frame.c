@@ -148,29 +148,27 @@ static int quic_build_ack_frame(unsigned char **buf, const unsigned char *end,
                                 struct quic_frame *frm, struct quic_conn *conn)
 {
 	struct quic_tx_ack *tx_ack = &frm->tx_ack;
-	struct eb64_node *ar, *prev_ar;
-	struct quic_arng_node *ar_node, *prev_ar_node;
+	struct quic_arng *ar, *prev_ar;
+	size_t i;
 
-	ar = eb64_last(&tx_ack->arngs->root);
-	ar_node = eb64_entry(&ar->node, struct quic_arng_node, first);
+	ar = quic_arng_at(tx_ack->arngs, 0);
 	TRACE_PROTO("ack range", QUIC_EV_CONN_PRSAFRM,
-	            conn->conn,, &ar_node->last, &ar_node->first.key);
-	if (!quic_enc_int(buf, end, ar_node->last) ||
+	            conn->conn,, &ar->last, &ar->first);
+	if (!quic_enc_int(buf, end, ar->last) ||
 	    !quic_enc_int(buf, end, tx_ack->ack_delay) ||
 	    !quic_enc_int(buf, end, tx_ack->arngs->sz - 1) ||
-	    !quic_enc_int(buf, end, ar_node->last - ar_node->first.key))
+	    !quic_enc_int(buf, end, ar->last - ar->first))
 		return 0;
 
-	while ((prev_ar = eb64_prev(ar))) {
-		prev_ar_node = eb64_entry(&prev_ar->node, struct quic_arng_node, first);
+	for (i = 1; i < tx_ack->arngs->sz; i++) {
+		prev_ar = quic_arng_at(tx_ack->arngs, i);
 		TRACE_PROTO("ack range", QUIC_EV_CONN_PRSAFRM, conn->conn,,
-		            &prev_ar_node->last, &prev_ar_node->first.key);
-		if (!quic_enc_int(buf, end, ar_node->first.key - prev_ar_node->last - 2) ||
-		    !quic_enc_int(buf, end, prev_ar_node->last - prev_ar_node->first.key))
+		            &prev_ar->last, &prev_ar->first);
+		if (!quic_enc_int(buf, end, ar->first - prev_ar->last - 2) ||
+		    !quic_enc_int(buf, end, prev_ar->last - prev_ar->first))
 			return 0;
 
 		ar = prev_ar;
-		ar_node = eb64_entry(&ar->node, struct quic_arng_node, first);
 	}
 
 	return 1;
@@ -10,15 +10,59 @@
  *
  */
 
+#define _GNU_SOURCE /* for recvmmsg() / sendmmsg() */
 #include <errno.h>
+#include <string.h>
 
+#include <netinet/in.h>
 #include <sys/socket.h>
 #include <sys/types.h>
 
+#include <haproxy/api.h>
 #include <haproxy/connection.h>
+#include <haproxy/fd.h>
+#include <haproxy/global.h>
 #include <haproxy/listener.h>
+#include <haproxy/quic_sock.h>
+#include <haproxy/tools.h>
 #include <haproxy/xprt_quic.h>
 
+#if defined(__linux__)
+#define QUIC_HAVE_MMSG
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
+#ifndef UDP_GRO
+#define UDP_GRO 104
+#endif
+#ifndef SOL_UDP
+#define SOL_UDP 17
+#endif
+#endif
+
+/* Number of datagrams read at once by a single recvmmsg() call */
+#define QUIC_RX_BATCH      8
+/* Maximum number of datagrams sent at once by a single sendmmsg() call */
+#define QUIC_TX_BATCH      QUIC_CONN_TX_BUFS_NB
+/* Maximum number of datagrams sent as a single GSO message, and maximum size
+ * of such a message, both enforced by the kernel.
+ */
+#define QUIC_GSO_MAX_SEGS  64
+#define QUIC_GSO_MAX_SZ    65000
+/* per-thread datagram receive context for recvmmsg() */
+struct quic_rx_batch {
+	struct mmsghdr msgs[QUIC_RX_BATCH];
+	struct iovec iov[QUIC_RX_BATCH];
+	struct sockaddr_storage addrs[QUIC_RX_BATCH];
+	char cmsgs[QUIC_RX_BATCH][CMSG_SPACE(sizeof(int))];
+	struct quic_rxbuf *rxbufs[QUIC_RX_BATCH]; /* the buffers of the slots */
+};
+
+static THREAD_LOCAL struct quic_rx_batch *quic_rx_batch;
+
+/* set when the kernel supports UDP GSO, reset if it fails on the first send */
+static int quic_gso = 0;
+
 /* This function is called from the protocol layer accept() in order to
  * instantiate a new session on behalf of a given listener and frontend. It
  * returns a positive value upon success, 0 if the connection can be ignored,
@@ -145,9 +189,9 @@ struct connection *quic_sock_accept_conn(struct listener *l, int *status)
 	int ret, ipv4;
 
 	qc = NULL;
-	pkt = LIST_ELEM(l->rx.qpkts.n, struct quic_rx_packet *, rx_list);
+	pkt = LIST_ELEM(l->rx.quic_thr[tid].qpkts.n, struct quic_rx_packet *, rx_list);
 	/* Should never happen. */
-	if (&pkt->rx_list == &l->rx.qpkts)
+	if (&pkt->rx_list == &l->rx.quic_thr[tid].qpkts)
 		goto err;
 
 	qc = pkt->qc;
@@ -156,7 +200,7 @@ struct connection *quic_sock_accept_conn(struct listener *l, int *status)
 		goto err;
 
 	ipv4 = pkt->saddr.ss_family == AF_INET;
-	if (!qc_new_conn_init(qc, ipv4, &l->rx.odcids, &l->rx.cids,
+	if (!qc_new_conn_init(qc, ipv4, &l->rx.quic_thr[tid].odcids, &l->rx.quic_thr[tid].cids,
 	                      pkt->dcid.data, pkt->dcid.len,
 	                      pkt->scid.data, pkt->scid.len))
 		goto err;
@@ -164,9 +208,22 @@ struct connection *quic_sock_accept_conn(struct listener *l, int *status)
 	odcid = &qc->params.original_destination_connection_id;
 	/* Copy the transport parameters. */
 	qc->params = l->bind_conf->quic_params;
-	/* Copy original_destination_connection_id transport parameter. */
-	memcpy(odcid->data, &pkt->dcid, pkt->odcid_len);
-	odcid->len = pkt->odcid_len;
+	if (pkt->flags & QUIC_FL_RX_PACKET_VALIDATED) {
+		struct quic_cid *rscid = &qc->params.retry_source_connection_id;
+
+		/* The client was sent a Retry packet whose SCID is the DCID of
+		 * this packet, and its original DCID was found in the token.
+		 */
+		quic_cid_cpy(odcid, &pkt->token_odcid);
+		memcpy(rscid->data, pkt->dcid.data, pkt->odcid_len);
+		rscid->len = pkt->odcid_len;
+		qc->params.retry_source_connection_id_present = 1;
+	}
+	else {
+		/* Copy original_destination_connection_id transport parameter. */
+		memcpy(odcid->data, &pkt->dcid, pkt->odcid_len);
+		odcid->len = pkt->odcid_len;
+	}
 	/* Copy the initial source connection ID. */
 	quic_cid_cpy(&qc->params.initial_source_connection_id, &qc->scid);
 	qc->enc_params_len =
@@ -189,38 +246,302 @@ struct connection *quic_sock_accept_conn(struct listener *l, int *status)
 	goto done;
 }
 
-/* Function called on a read event from a listening socket. It tries
- * to handle as many connections as possible.
+/* Enables UDP GRO on socket <fd> when supported so that consecutive datagrams
+ * of the same flow may be received at once. Failures are silently ignored.
  */
-void quic_sock_fd_iocb(int fd)
+void quic_sock_enable_gro(int fd)
 {
-	ssize_t ret;
-	struct buffer *buf;
-	struct listener *l = objt_listener(fdtab[fd].owner);
-	/* Source address */
-	struct sockaddr_storage saddr = {0};
-	socklen_t saddrlen;
+#if defined(QUIC_HAVE_MMSG)
+	int one = 1;
 
-	if (!l)
-		ABORT_NOW();
+	setsockopt(fd, SOL_UDP, UDP_GRO, &one, sizeof(one));
+#endif
+}
 
-	if (!(fdtab[fd].state & FD_POLL_IN) || !fd_recv_ready(fd))
-		return;
+/* Checks if UDP GSO is supported for socket <fd>, in which case consecutive
+ * datagrams of the same size are sent at once and split by the kernel or the
+ * NIC. Kernels which do not support UDP_SEGMENT would silently ignore its
+ * control message, so it is only used if the socket option is known.
+ */
+void quic_sock_enable_gso(int fd)
+{
+#if defined(QUIC_HAVE_MMSG)
+	socklen_t len = sizeof(int);
+	int val;
+
+	if (getsockopt(fd, SOL_UDP, UDP_SEGMENT, &val, &len) == 0)
+		quic_gso = 1;
+#endif
+}
+
+/* Makes sure slot <i> of <rxb> receive batch has a buffer nobody else uses,
+ * replacing its buffer if it is still referenced by some packets. Returns 1
+ * if succeeded, 0 if not.
+ */
+static int quic_rx_batch_slot_prepare(struct quic_rx_batch *rxb, int i)
+{
+	struct quic_rxbuf *rxbuf = rxb->rxbufs[i];
+
+	if (likely(rxbuf && HA_ATOMIC_LOAD(&rxbuf->refcnt) == 1))
+		return 1;
+
+	if (rxbuf)
+		quic_rxbuf_refdec(rxbuf);
+
+	rxbuf = rxb->rxbufs[i] = pool_alloc(pool_head_quic_rxbuf);
+	if (!rxbuf)
+		return 0;
+
+	rxbuf->refcnt = 1;
+	rxb->iov[i].iov_base = rxbuf->data;
+	rxb->iov[i].iov_len  = sizeof(rxbuf->data);
+	return 1;
+}
+
+/* Returns the per-thread receive batch, allocating it on first use, or NULL
+ * if it could not be allocated.
+ */
+static struct quic_rx_batch *quic_get_rx_batch()
+{
+	struct quic_rx_batch *rxb = quic_rx_batch;
+
+	if (likely(rxb))
+		return rxb;
+
+	rxb = calloc(1, sizeof(*rxb));
+	if (!rxb)
+		return NULL;
+
+	quic_rx_batch = rxb;
+	return rxb;
+}
+
+static void quic_free_rx_batch_per_thread()
+{
+	int i;
+
+	if (quic_rx_batch) {
+		for (i = 0; i < QUIC_RX_BATCH; i++) {
+			if (quic_rx_batch->rxbufs[i])
+				quic_rxbuf_refdec(quic_rx_batch->rxbufs[i]);
+		}
+	}
+	ha_free(&quic_rx_batch);
+}
+
+/* Returns the GRO segment size reported in the control data of <msg>, or 0
+ * if the datagram was not aggregated.
+ */
+static inline int quic_dgram_gro_size(struct msghdr *msg)
+{
+#if defined(QUIC_HAVE_MMSG)
+	struct cmsghdr *cmsg;
+
+	for (cmsg = CMSG_FIRSTHDR(msg); cmsg; cmsg = CMSG_NXTHDR(msg, cmsg)) {
+		if (cmsg->cmsg_level == SOL_UDP && cmsg->cmsg_type == UDP_GRO) {
+			int gso_size;
+
+			memcpy(&gso_size, CMSG_DATA(cmsg), sizeof(gso_size));
+			return gso_size;
+		}
+	}
+#endif
+	return 0;
+}
 
-	buf = get_trash_chunk();
-	saddrlen = sizeof saddr;
-	do {
-		ret = recvfrom(fd, buf->area, buf->size, 0,
-		               (struct sockaddr *)&saddr, &saddrlen);
+/* Reads as many UDP datagrams as possible from <fd> by batches of up to
+ * QUIC_RX_BATCH datagrams per syscall, and calls <func> for each of them with
+ * <owner> as context and the buffer it was received in, which the packets may
+ * keep referencing. Datagrams aggregated by GRO are split back into their
+ * original segments. Reading stops when the socket is drained, in which case
+ * the FD is marked as not ready, or after global.tune.maxpollevents datagrams
+ * so as not to starve other FDs. Returns the number of datagrams processed.
+ */
+int quic_sock_recv_dgrams(int fd, void *owner, qdgram_read_func *func)
+{
+	struct quic_rx_batch *rxb;
+	int done = 0;
+	int ret, i;
+
+	if (!fd_recv_ready(fd))
+		return 0;
+
+	rxb = quic_get_rx_batch();
+	if (!rxb)
+		return 0;
+
+	while (done < global.tune.maxpollevents) {
+		for (i = 0; i < QUIC_RX_BATCH; i++) {
+			struct msghdr *msg = &rxb->msgs[i].msg_hdr;
+
+			/* the buffers still referenced by some packets from
+			 * the previous batch are replaced.
+			 */
+			if (!quic_rx_batch_slot_prepare(rxb, i))
+				goto out;
+
+			msg->msg_name       = &rxb->addrs[i];
+			msg->msg_namelen    = sizeof(rxb->addrs[i]);
+			msg->msg_iov        = &rxb->iov[i];
+			msg->msg_iovlen     = 1;
+			msg->msg_control    = rxb->cmsgs[i];
+			msg->msg_controllen = sizeof(rxb->cmsgs[i]);
+			msg->msg_flags      = 0;
+		}
+
+#if defined(QUIC_HAVE_MMSG)
+		ret = recvmmsg(fd, rxb->msgs, QUIC_RX_BATCH, 0, NULL);
+#else
+		ret = recvmsg(fd, &rxb->msgs[0].msg_hdr, 0);
+		if (ret >= 0) {
+			rxb->msgs[0].msg_len = ret;
+			ret = 1;
+		}
+#endif
 		if (ret < 0) {
 			if (errno == EINTR)
 				continue;
 			if (errno == EAGAIN)
 				fd_cant_recv(fd);
-			return;
+			break;
+		}
+
+		for (i = 0; i < ret; i++) {
+			struct msghdr *msg = &rxb->msgs[i].msg_hdr;
+			char *pos = rxb->iov[i].iov_base;
+			size_t len = rxb->msgs[i].msg_len;
+			size_t seg = quic_dgram_gro_size(msg);
+
+			if (!seg || seg > len)
+				seg = len;
+
+			while (len) {
+				size_t cur = MIN(seg, len);
+
+				func(pos, cur, owner, &rxb->addrs[i], rxb->rxbufs[i]);
+				pos += cur;
+				len -= cur;
+				done++;
+			}
+		}
+
+		if (ret < QUIC_RX_BATCH) {
+			/* the socket is very likely empty now */
+			break;
+		}
+	}
+
+ out:
+	return done;
+}
+
+/* Returns the number of datagrams starting at <iov> among <count> which may be
+ * sent as a single GSO message: all of them must have the same size as the
+ * first one, except the last one which may be smaller.
+ */
+static inline int quic_gso_segs(const struct iovec *iov, int count)
+{
+	size_t seg = iov[0].iov_len;
+	size_t total = seg;
+	int nb = 1;
+
+	while (nb < count && nb < QUIC_GSO_MAX_SEGS &&
+	       iov[nb].iov_len <= seg && total + iov[nb].iov_len <= QUIC_GSO_MAX_SZ) {
+		total += iov[nb].iov_len;
+		if (iov[nb++].iov_len < seg)
+			break;
+	}
+	return nb;
+}
+
+/* Sends the <count> datagrams described by the <iov> array to <dst> on socket
+ * <fd>, using a single syscall when possible. When UDP GSO is supported, each
+ * run of datagrams of the same size is passed as a single message. Returns the
+ * number of datagrams which were sent, or -1 on fatal error. Zero is returned
+ * if the socket buffer is full, in which case the FD is marked as not ready
+ * for sending.
+ */
+int quic_sock_send_dgrams(int fd, struct sockaddr_storage *dst,
+                          struct iovec *iov, int count)
+{
+	struct mmsghdr msgs[QUIC_TX_BATCH];
+	int segs[QUIC_TX_BATCH];
+#if defined(QUIC_HAVE_MMSG)
+	char cmsgs[QUIC_TX_BATCH][CMSG_SPACE(sizeof(uint16_t))];
+#endif
+	int sent = 0;
+	int ret, i, nb, pos;
+
+	while (sent < count) {
+		memset(msgs, 0, sizeof(msgs));
+		for (nb = 0, pos = sent; nb < QUIC_TX_BATCH && pos < count; nb++) {
+			segs[nb] = quic_gso ? quic_gso_segs(&iov[pos], count - pos) : 1;
+			msgs[nb].msg_hdr.msg_name    = dst;
+			msgs[nb].msg_hdr.msg_namelen = get_addr_len(dst);
+			msgs[nb].msg_hdr.msg_iov     = &iov[pos];
+			msgs[nb].msg_hdr.msg_iovlen  = segs[nb];
+#if defined(QUIC_HAVE_MMSG)
+			if (segs[nb] > 1) {
+				struct cmsghdr *cmsg;
+				uint16_t gso_size = iov[pos].iov_len;
+
+				msgs[nb].msg_hdr.msg_control    = cmsgs[nb];
+				msgs[nb].msg_hdr.msg_controllen = sizeof(cmsgs[nb]);
+				cmsg = CMSG_FIRSTHDR(&msgs[nb].msg_hdr);
+				cmsg->cmsg_level = SOL_UDP;
+				cmsg->cmsg_type  = UDP_SEGMENT;
+				cmsg->cmsg_len   = CMSG_LEN(sizeof(gso_size));
+				memcpy(CMSG_DATA(cmsg), &gso_size, sizeof(gso_size));
+			}
+#endif
+			pos += segs[nb];
+		}
+
+#if defined(QUIC_HAVE_MMSG)
+		ret = sendmmsg(fd, msgs, nb, MSG_DONTWAIT | MSG_NOSIGNAL);
+#else
+		ret = sendmsg(fd, &msgs[0].msg_hdr, MSG_DONTWAIT | MSG_NOSIGNAL);
+		if (ret >= 0)
+			ret = 1;
+#endif
+		if (ret > 0) {
+			for (i = 0; i < ret; i++)
+				sent += segs[i];
+			if (ret < nb)
+				break;
+		}
+		else if (ret == 0 || errno == EAGAIN || errno == ENOTCONN || errno == EINPROGRESS) {
+			fd_cant_send(fd);
+			break;
+		}
+		else if (quic_gso && segs[0] > 1 && (errno == EIO || errno == EINVAL)) {
+			/* the device does not support GSO (e.g. no checksum
+			 * offload), let's send the datagrams one at a time.
+			 */
+			HA_ATOMIC_STORE(&quic_gso, 0);
 		}
-	} while (0);
+		else if (errno != EINTR) {
+			return sent ? sent : -1;
+		}
+	}
 
-	buf->data = ret;
-	quic_lstnr_dgram_read(buf->area, buf->data, l, &saddr);
+	return sent;
 }
+
+/* Function called on a read event from a listening socket. It tries
+ * to handle as many connections as possible.
+ */
+void quic_sock_fd_iocb(int fd)
+{
+	struct listener *l = objt_listener(fdtab[fd].owner);
+
+	if (!l)
+		ABORT_NOW();
+
+	if (!(fdtab[fd].state & FD_POLL_IN))
+		return;
+
+	quic_sock_recv_dgrams(fd, l, quic_lstnr_dgram_read);
+}
+
+REGISTER_PER_THREAD_FREE(quic_free_rx_batch_per_thread);
@@ -327,62 +327,157 @@ int quic_aead_iv_build(unsigned char *iv, size_t ivlen,
 
 int quic_tls_encrypt(unsigned char *buf, size_t len,
                      const unsigned char *aad, size_t aad_len,
-                     const EVP_CIPHER *aead, const unsigned char *key, const unsigned char *iv)
+                     EVP_CIPHER_CTX *ctx, const unsigned char *iv)
 {
-	EVP_CIPHER_CTX *ctx;
-	int ret, outlen;
-
-	ret = 0;
-	ctx = EVP_CIPHER_CTX_new();
-	if (!ctx)
-		return 0;
+	int outlen;
 
-	if (!EVP_EncryptInit_ex(ctx, aead, NULL, key, iv) ||
+	if (!EVP_EncryptInit_ex(ctx, NULL, NULL, NULL, iv) ||
 		!EVP_EncryptUpdate(ctx, NULL, &outlen, aad, aad_len) ||
 		!EVP_EncryptUpdate(ctx, buf, &outlen, buf, len) ||
 		!EVP_EncryptFinal_ex(ctx, buf + outlen, &outlen) ||
 		!EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_AEAD_GET_TAG, QUIC_TLS_TAG_LEN, buf + len))
-		goto out;
-
-	ret = 1;
-
- out:
-	EVP_CIPHER_CTX_free(ctx);
+		return 0;
 
-	return ret;
+	return 1;
 }
 
 int quic_tls_decrypt(unsigned char *buf, size_t len,
                      unsigned char *aad, size_t aad_len,
-                     const EVP_CIPHER *aead, const unsigned char *key, const unsigned char *iv)
+                     EVP_CIPHER_CTX *ctx, const unsigned char *iv)
 {
-	int ret, outlen;
+	int outlen;
 	size_t off;
-	EVP_CIPHER_CTX *ctx;
 
-	ret = 0;
 	off = 0;
-	ctx = EVP_CIPHER_CTX_new();
-	if (!ctx)
-		return 0;
-
-	if (!EVP_DecryptInit_ex(ctx, aead, NULL, key, iv) ||
+	if (!EVP_DecryptInit_ex(ctx, NULL, NULL, NULL, iv) ||
 		!EVP_DecryptUpdate(ctx, NULL, &outlen, aad, aad_len) ||
 		!EVP_DecryptUpdate(ctx, buf, &outlen, buf, len - QUIC_TLS_TAG_LEN))
-		goto out;
+		return 0;
 
 	off += outlen;
 
 	if (!EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_AEAD_SET_TAG, QUIC_TLS_TAG_LEN,
 	                         buf + len - QUIC_TLS_TAG_LEN) ||
 	    !EVP_DecryptFinal_ex(ctx, buf + off, &outlen))
-		goto out;
+		return 0;
 
 	off += outlen;
 
-	ret = off;
+	return off;
+}
+
+/* Release the cipher contexts of <secs> QUIC TLS secrets. */
+void quic_tls_secrets_ctx_free(struct quic_tls_secrets *secs)
+{
+	EVP_CIPHER_CTX_free(secs->ctx);
+	secs->ctx = NULL;
+	EVP_CIPHER_CTX_free(secs->hp_ctx);
+	secs->hp_ctx = NULL;
+}
+
+/* Initialize the cipher contexts of <secs> QUIC TLS secrets from their keys
+ * which must have been derived, for encryption if <enc> is non-zero or for
+ * decryption if not. Only the IV has then to be set for each packet.
+ * The AES-CTR header protection only uses the first block of the key stream,
+ * which is the sample encrypted with AES-ECB, so AES-ECB is used instead, which
+ * allows to compute the masks of several packets at once.
+ * Returns 1 if succeeded, 0 if not.
+ */
+int quic_tls_secrets_ctx_init(struct quic_tls_secrets *secs, int enc)
+{
+	const EVP_CIPHER *hp = secs->hp;
+
+	quic_tls_secrets_ctx_free(secs);
+	secs->ctx = EVP_CIPHER_CTX_new();
+	secs->hp_ctx = EVP_CIPHER_CTX_new();
+	if (!secs->ctx || !secs->hp_ctx)
+		goto err;
+
+	if (!EVP_CipherInit_ex(secs->ctx, secs->aead, NULL, secs->key, NULL, enc))
+		goto err;
 
+	if (EVP_CIPHER_mode(hp) == EVP_CIPH_CTR_MODE)
+		hp = EVP_CIPHER_key_length(hp) == 32 ? EVP_aes_256_ecb() : EVP_aes_128_ecb();
+
+	if (!EVP_EncryptInit_ex(secs->hp_ctx, hp, NULL, secs->hp_key, NULL))
+		goto err;
+
+	EVP_CIPHER_CTX_set_padding(secs->hp_ctx, 0);
+	return 1;
+
+ err:
+	quic_tls_secrets_ctx_free(secs);
+	return 0;
+}
+
+/* Retry integrity key and nonce for the draft-29 QUIC version, which is the one
+ * the initial salt above is for.
+ */
+static const unsigned char quic_retry_key[16] = {
+	0xcc, 0xce, 0x18, 0x7e, 0xd0, 0x9a, 0x09, 0xd0,
+	0x57, 0x28, 0x15, 0x5a, 0x6c, 0xb9, 0x6b, 0xe1,
+};
+
+static const unsigned char quic_retry_nonce[12] = {
+	0xe5, 0x49, 0x30, 0xf9, 0x7f, 0x21, 0x36, 0xf0,
+	0x53, 0x0a, 0x8c, 0x1c,
+};
+
+/* Compute the integrity tag of the <len> bytes long Retry packet <pkt> sent
+ * to a client whose original destination connection ID is <odcid>, and write
+ * it after this packet, which must be followed by QUIC_TLS_TAG_LEN bytes of
+ * room. The tag is the one of an empty AEAD_AES_128_GCM plaintext with, as
+ * associated data, the Retry packet prefixed by the client ODCID.
+ * Returns 1 if succeeded, 0 if not.
+ */
+int quic_tls_generate_retry_integrity_tag(const struct quic_cid *odcid,
+                                          unsigned char *pkt, size_t len)
+{
+	EVP_CIPHER_CTX *ctx;
+	unsigned char odcid_len = odcid->len;
+	int outlen, ret = 0;
+
+	ctx = EVP_CIPHER_CTX_new();
+	if (!ctx)
+		return 0;
+
+	if (!EVP_EncryptInit_ex(ctx, EVP_aes_128_gcm(), NULL, quic_retry_key, quic_retry_nonce) ||
+	    !EVP_EncryptUpdate(ctx, NULL, &outlen, &odcid_len, sizeof odcid_len) ||
+	    !EVP_EncryptUpdate(ctx, NULL, &outlen, odcid->data, odcid->len) ||
+	    !EVP_EncryptUpdate(ctx, NULL, &outlen, pkt, len) ||
+	    !EVP_EncryptFinal_ex(ctx, pkt + len, &outlen) ||
+	    !EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_AEAD_GET_TAG, QUIC_TLS_TAG_LEN, pkt + len))
+		goto out;
+
+	ret = 1;
  out:
 	EVP_CIPHER_CTX_free(ctx);
 	return ret;
 }
+
+/* Compute into <masks> the header protection masks of <n> packets with <hp_ctx>
+ * as header protection cipher context, from their samples of
+ * QUIC_TLS_HP_SAMPLE_LEN bytes found in <samples>, both arrays being made of
+ * <n> blocks of QUIC_TLS_HP_SAMPLE_LEN bytes. Only the first five bytes of each
+ * mask are meaningful. With AES, all the masks are computed by a single call.
+ * Returns 1 if succeeded, 0 if not.
+ */
+int quic_tls_hp_masks(EVP_CIPHER_CTX *hp_ctx, const unsigned char *samples,
+                      unsigned char *masks, int n)
+{
+	int i, outlen;
+
+	if (EVP_CIPHER_CTX_mode(hp_ctx) == EVP_CIPH_ECB_MODE)
+		return EVP_EncryptUpdate(hp_ctx, masks, &outlen, samples, n * QUIC_TLS_HP_SAMPLE_LEN);
+
+	/* ChaCha20: the sample is used as counter and nonce */
+	memset(masks, 0, n * QUIC_TLS_HP_SAMPLE_LEN);
+	for (i = 0; i < n; i++) {
+		unsigned char *mask = masks + i * QUIC_TLS_HP_SAMPLE_LEN;
+
+		if (!EVP_EncryptInit_ex(hp_ctx, NULL, NULL, NULL, samples + i * QUIC_TLS_HP_SAMPLE_LEN) ||
+		    !EVP_EncryptUpdate(hp_ctx, mask, &outlen, mask, 5))
+			return 0;
+	}
+	return 1;
+}
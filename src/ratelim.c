@@ -0,0 +1,288 @@
+/*
+ * Rate limiting based on per-thread token buckets.
+ *
+ * The "http-request rate-limit" action accepts a given number of requests per
+ * period, and denies the excess. Contrary to the combination of "track-sc",
+ * "sc_http_req_rate" and "deny", no stick table is involved: each thread
+ * consumes tokens from its own bucket, and only falls back to a shared bucket
+ * when its own one is empty. A task periodically converts the configured rate
+ * into new tokens and distributes most of them among the threads depending on
+ * their recent demand, leaving the rest in the shared bucket. When a peers
+ * section is referenced, the rate is divided by the number of nodes currently
+ * connected, so that the limit approximately applies to the whole fleet.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <haproxy/action.h>
+#include <haproxy/api.h>
+#include <haproxy/global.h>
+#include <haproxy/http.h>
+#include <haproxy/http_ana-t.h>
+#include <haproxy/http_rules.h>
+#include <haproxy/peers.h>
+#include <haproxy/ratelim-t.h>
+#include <haproxy/stream-t.h>
+#include <haproxy/task.h>
+#include <haproxy/ticks.h>
+#include <haproxy/time.h>
+#include <haproxy/tools.h>
+
+
+/* Takes one token from the bucket of the current thread, or from the shared
+ * one if it is empty. Returns non-zero on success, or zero if no token is
+ * left.
+ */
+static inline int ratelim_take(struct ratelim *rl)
+{
+	struct ratelim_bucket *b = &rl->buckets[tid];
+	int tok;
+
+	HA_ATOMIC_INC(&b->hits);
+
+	tok = HA_ATOMIC_LOAD(&b->tokens);
+	while (tok > 0 && !HA_ATOMIC_CAS(&b->tokens, &tok, tok - 1))
+		__ha_cpu_relax();
+	if (tok > 0)
+		return 1;
+
+	tok = HA_ATOMIC_LOAD(&rl->spare);
+	while (tok > 0 && !HA_ATOMIC_CAS(&rl->spare, &tok, tok - 1))
+		__ha_cpu_relax();
+	return tok > 0;
+}
+
+/* Refill task of a rate limiter. The tokens earned since the last refill are
+ * distributed to the threads which saw events, in proportion of these events,
+ * and the remaining ones are put into the shared bucket. The tokens of idle
+ * threads are moved to the shared bucket as well. The total number of tokens
+ * never exceeds the burst size.
+ */
+static struct task *ratelim_refill(struct task *t, void *context, unsigned int state)
+{
+	struct ratelim *rl = context;
+	unsigned int hits[MAX_THREADS];
+	unsigned long long total = 0;
+	unsigned long long div;
+	long long stock, grant, local, share;
+	int thr;
+
+	div = rl->period;
+	if (rl->peers)
+		div *= 1 + peers_count_connected(rl->peers);
+
+	rl->credit += (unsigned long long)rl->rate * (unsigned int)(now_ms - rl->last);
+	rl->last = now_ms;
+	grant = rl->credit / div;
+	rl->credit -= grant * div;
+
+	stock = HA_ATOMIC_LOAD(&rl->spare);
+	for (thr = 0; thr < global.nbthread; thr++) {
+		hits[thr] = HA_ATOMIC_XCHG(&rl->buckets[thr].hits, 0);
+		total += hits[thr];
+		if (!hits[thr] && HA_ATOMIC_LOAD(&rl->buckets[thr].tokens))
+			HA_ATOMIC_ADD(&rl->spare, HA_ATOMIC_XCHG(&rl->buckets[thr].tokens, 0));
+		stock += HA_ATOMIC_LOAD(&rl->buckets[thr].tokens);
+	}
+
+	if (grant > (long long)rl->burst - stock)
+		grant = (long long)rl->burst - stock;
+
+	if (grant > 0) {
+		local = grant * RATELIM_LOCAL_SHARE / 1024;
+		for (thr = 0; total && thr < global.nbthread; thr++) {
+			share = local * hits[thr] / total;
+			if (share) {
+				HA_ATOMIC_ADD(&rl->buckets[thr].tokens, share);
+				grant -= share;
+			}
+		}
+		HA_ATOMIC_ADD(&rl->spare, grant);
+	}
+
+	t->expire = tick_add(now_ms, MS_TO_TICKS(rl->tick));
+	return t;
+}
+
+/* Always returns ACT_RET_CONT if a token could be taken from the rule's rate
+ * limiter, otherwise ACT_RET_DENY with the configured status.
+ */
+static enum act_return http_action_rate_limit(struct act_rule *rule, struct proxy *px,
+                                              struct session *sess, struct stream *s, int flags)
+{
+	struct ratelim *rl = rule->arg.act.p[0];
+
+	if (likely(ratelim_take(rl)))
+		return ACT_RET_CONT;
+
+	s->txn->status = rl->deny_status;
+	return ACT_RET_DENY;
+}
+
+/* Resolves the peers section of the rule's rate limiter if any, and starts the
+ * refill task. Returns 1 on success, 0 on error with <err> filled.
+ */
+static int check_rate_limit(struct act_rule *rule, struct proxy *px, char **err)
+{
+	struct ratelim *rl = rule->arg.act.p[0];
+	struct peers *peers;
+
+	if (rl->peers_id) {
+		for (peers = cfg_peers; peers; peers = peers->next) {
+			if (strcmp(peers->id, rl->peers_id) == 0)
+				break;
+		}
+		if (!peers) {
+			memprintf(err, "unknown peers section '%s'", rl->peers_id);
+			return 0;
+		}
+		rl->peers = peers;
+		ha_free(&rl->peers_id);
+	}
+
+	rl->task = task_new(MAX_THREADS_MASK);
+	if (!rl->task) {
+		memprintf(err, "out of memory");
+		return 0;
+	}
+	rl->task->process = ratelim_refill;
+	rl->task->context = rl;
+
+	/* start with a full shared bucket */
+	rl->spare = rl->burst;
+	rl->last = now_ms;
+	rl->task->expire = tick_add(now_ms, MS_TO_TICKS(rl->tick));
+	task_queue(rl->task);
+	return 1;
+}
+
+static void release_rate_limit(struct act_rule *rule)
+{
+	struct ratelim *rl = rule->arg.act.p[0];
+
+	if (!rl)
+		return;
+	task_destroy(rl->task);
+	free(rl->peers_id);
+	free(rl);
+}
+
+/* Parses "rate-limit <rate> [period <time>] [burst <count>] [peers <section>]
+ * [deny_status <code>]". Returns ACT_RET_PRS_OK on success, ACT_RET_PRS_ERR on
+ * error with <err> filled.
+ */
+static enum act_parse_ret parse_http_rate_limit(const char **args, int *orig_arg, struct proxy *px,
+                                                struct act_rule *rule, char **err)
+{
+	struct ratelim *rl = NULL;
+	unsigned long long per_tick;
+	unsigned int burst = 0;
+	int cur_arg = *orig_arg;
+	const char *res;
+	void *ptr;
+	char *end;
+
+	if (posix_memalign(&ptr, 64, sizeof(*rl)) != 0) {
+		memprintf(err, "out of memory");
+		return ACT_RET_PRS_ERR;
+	}
+	rl = ptr;
+	memset(rl, 0, sizeof(*rl));
+	rl->period = 1000;
+	rl->deny_status = 429;
+
+	rl->rate = strtoul(args[cur_arg], &end, 10);
+	if (!*args[cur_arg] || *end || !rl->rate || rl->rate > 0x3fffffff) {
+		memprintf(err, "expects a number of events between 1 and %u as first argument, got '%s'",
+			  0x3fffffff, args[cur_arg]);
+		goto error;
+	}
+	cur_arg++;
+
+	while (*args[cur_arg]) {
+		if (strcmp(args[cur_arg], "period") == 0) {
+			res = *args[cur_arg + 1] ? parse_time_err(args[cur_arg + 1], &rl->period, TIME_UNIT_MS) : args[cur_arg];
+			if (res == PARSE_TIME_OVER || res == PARSE_TIME_UNDER || res || !rl->period) {
+				memprintf(err, "'%s' expects a non-null delay", args[cur_arg]);
+				goto error;
+			}
+		}
+		else if (strcmp(args[cur_arg], "burst") == 0) {
+			burst = strtoul(args[cur_arg + 1], &end, 10);
+			if (!*args[cur_arg + 1] || *end || !burst || burst > 0x3fffffff) {
+				memprintf(err, "'%s' expects a number between 1 and %u", args[cur_arg], 0x3fffffff);
+				goto error;
+			}
+		}
+		else if (strcmp(args[cur_arg], "peers") == 0) {
+			if (!*args[cur_arg + 1]) {
+				memprintf(err, "'%s' expects a peers section name", args[cur_arg]);
+				goto error;
+			}
+			free(rl->peers_id);
+			rl->peers_id = strdup(args[cur_arg + 1]);
+			if (!rl->peers_id) {
+				memprintf(err, "out of memory");
+				goto error;
+			}
+		}
+		else if (strcmp(args[cur_arg], "deny_status") == 0) {
+			rl->deny_status = strtoul(args[cur_arg + 1], &end, 10);
+			if (!*args[cur_arg + 1] || *end ||
+			    http_err_codes[http_get_status_idx(rl->deny_status)] != rl->deny_status) {
+				memprintf(err, "'%s' expects one of the status codes supported by 'errorfile'", args[cur_arg]);
+				goto error;
+			}
+		}
+		else
+			break;
+		cur_arg += 2;
+	}
+
+	if (*args[cur_arg] && strcmp(args[cur_arg], "if") != 0 && strcmp(args[cur_arg], "unless") != 0) {
+		memprintf(err, "unexpected argument '%s', expects 'period', 'burst', 'peers', 'deny_status' or a condition",
+			  args[cur_arg]);
+		goto error;
+	}
+
+	/* Refills happen at least 10 times per period, and never hold more
+	 * tokens than the burst size, which must thus cover one refill.
+	 */
+	rl->tick = MIN(MAX(rl->period / 10, 1), RATELIM_MAX_TICK);
+	per_tick = ((unsigned long long)rl->rate * rl->tick + rl->period - 1) / rl->period;
+	rl->burst = MAX(burst, per_tick);
+
+	*orig_arg = cur_arg;
+	rule->arg.act.p[0] = rl;
+	rule->action = ACT_CUSTOM;
+	rule->action_ptr = http_action_rate_limit;
+	rule->check_ptr = check_rate_limit;
+	rule->release_ptr = release_rate_limit;
+	return ACT_RET_PRS_OK;
+
+  error:
+	free(rl->peers_id);
+	free(rl);
+	return ACT_RET_PRS_ERR;
+}
+
+static struct action_kw_list http_req_kws = { { }, {
+	{ "rate-limit", parse_http_rate_limit, 0 },
+	{ /* END */ }
+}};
+
+INITCALL1(STG_REGISTER, http_req_keywords_register, &http_req_kws);
+
+/*
+ * Local variables:
+ *  c-indent-level: 8
+ *  c-basic-offset: 8
+ * End:
+ */
@@ -15,6 +15,7 @@
 #include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include <sys/socket.h>
 #include <sys/stat.h>
@@ -23,12 +24,15 @@
 
 #include <haproxy/api.h>
 #include <haproxy/buf.h>
+#include <haproxy/cfgparse.h>
 #include <haproxy/connection.h>
 #include <haproxy/errors.h>
 #include <haproxy/fd.h>
 #include <haproxy/freq_ctr.h>
 #include <haproxy/global.h>
 #include <haproxy/pipe.h>
+#include <haproxy/pool.h>
+#include <haproxy/sock.h>
 #include <haproxy/stream_interface.h>
 #include <haproxy/ticks.h>
 #include <haproxy/time.h>
@@ -64,6 +68,7 @@ int raw_sock_to_pipe(struct connection *conn, void *xprt_ctx, struct pipe *pipe,
 	if (!fd_recv_ready(conn->handle.fd))
 		return 0;
 
+	sock_zc_check_err(conn);
 	conn->flags &= ~CO_FL_WAIT_ROOM;
 	errno = 0;
 
@@ -116,9 +121,13 @@ int raw_sock_to_pipe(struct connection *conn, void *xprt_ctx, struct pipe *pipe,
 			}
 			else if (errno == ENOSYS || errno == EINVAL || errno == EBADF) {
 				/* splice not supported on this end, disable it.
-				 * We can safely return -1 since there is no
-				 * chance that any data has been piped yet.
+				 * Some data may already have been piped (e.g. a
+				 * kTLS socket refuses to splice a non-data record
+				 * met after some data), in which case we report
+				 * them first and will fail on next call.
 				 */
+				if (retval > 0)
+					break;
 				retval = -1;
 				goto leave;
 			}
@@ -236,6 +245,7 @@ static size_t raw_sock_to_buf(struct connection *conn, void *xprt_ctx, struct bu
 	if (!fd_recv_ready(conn->handle.fd))
 		return 0;
 
+	sock_zc_check_err(conn);
 	conn->flags &= ~CO_FL_WAIT_ROOM;
 	errno = 0;
 
@@ -341,13 +351,19 @@ static size_t raw_sock_to_buf(struct connection *conn, void *xprt_ctx, struct bu
  * for taking care of those events and avoiding the call if inappropriate. The
  * function does not call the connection's polling update function, so the caller
  * is responsible for this. It's up to the caller to update the buffer's contents
- * based on the return value.
+ * based on the return value. If CO_SFL_ZEROCOPY is set in <flags>, the buffer's
+ * storage may be replaced by another one with the unsent data at the same place,
+ * after it was passed to the kernel using MSG_ZEROCOPY.
  */
 static size_t raw_sock_from_buf(struct connection *conn, void *xprt_ctx, const struct buffer *buf, size_t count, int flags)
 {
 	ssize_t ret;
 	size_t try, done;
 	int send_flag;
+#ifdef HA_HAVE_MSG_ZEROCOPY
+	struct sock_zc_buf *zb = NULL;
+	uint zc_ids = 0;
+#endif
 
 	if (!conn_ctrl_ready(conn))
 		return 0;
@@ -362,6 +378,14 @@ static size_t raw_sock_from_buf(struct connection *conn, void *xprt_ctx, const s
 		return 0;
 	}
 
+#ifdef HA_HAVE_MSG_ZEROCOPY
+	/* large sends from pool buffers may leave the data to the kernel */
+	if ((flags & CO_SFL_ZEROCOPY) && global.tune.zerocopy_send &&
+	    count >= global.tune.zerocopy_send && buf->size == global.tune.bufsize &&
+	    !(conn->flags & CO_FL_WAIT_L4_CONN))
+		zb = sock_zc_prepare(conn);
+#endif
+
 	done = 0;
 	/* send the largest possible block. For this we perform only one call
 	 * to send() unless the buffer wraps and we exactly fill the first hunk,
@@ -376,8 +400,23 @@ static size_t raw_sock_from_buf(struct connection *conn, void *xprt_ctx, const s
 		if (try < count || flags & CO_SFL_MSG_MORE)
 			send_flag |= MSG_MORE;
 
+#ifdef HA_HAVE_MSG_ZEROCOPY
+		if (zb && try >= global.tune.zerocopy_send)
+			send_flag |= MSG_ZEROCOPY;
+#endif
 		ret = send(conn->handle.fd, b_peek(buf, done), try, send_flag);
 
+#ifdef HA_HAVE_MSG_ZEROCOPY
+		if (send_flag & MSG_ZEROCOPY) {
+			if (ret > 0)
+				zc_ids++;
+			else if (ret < 0 && errno == ENOBUFS) {
+				/* out of option memory, send a copy */
+				send_flag &= ~MSG_ZEROCOPY;
+				ret = send(conn->handle.fd, b_peek(buf, done), try, send_flag);
+			}
+		}
+#endif
 		if (ret > 0) {
 			count -= ret;
 			done += ret;
@@ -404,6 +443,29 @@ static size_t raw_sock_from_buf(struct connection *conn, void *xprt_ctx, const s
 		conn->flags &= ~CO_FL_WAIT_L4_CONN;
 	}
 
+#ifdef HA_HAVE_MSG_ZEROCOPY
+	if (zb) {
+		if (zc_ids) {
+			/* the kernel now references the storage, the caller
+			 * gets the new one with the unsent data copied at the
+			 * same place.
+			 */
+			struct buffer *zbuf = (struct buffer *)buf;
+			char *area = zbuf->area;
+			size_t ofs, len;
+
+			for (ofs = done; ofs < b_data(zbuf); ofs += len) {
+				len = b_contig_data(zbuf, ofs);
+				memcpy(zb->area + (b_peek(zbuf, ofs) - area), b_peek(zbuf, ofs), len);
+			}
+			zbuf->area = zb->area;
+			sock_zc_hold(conn, zb, area, zc_ids);
+		}
+		else
+			sock_zc_cancel(zb);
+	}
+#endif
+
 	if (done > 0) {
 		/* we count the total bytes sent, and the send rate for 32-byte
 		 * blocks. The reason for the latter is that freq_ctr are
@@ -415,6 +477,75 @@ static size_t raw_sock_from_buf(struct connection *conn, void *xprt_ctx, const s
 	return done;
 }
 
+/* Send the <iovcnt> blocks described by <iov> at once, for a mux which wants
+ * to emit data it does not hold in a contiguous buffer without first copying
+ * them. Only one call to sendmsg() is performed. It returns the number of
+ * bytes sent, which may be lower than the total when the system buffers are
+ * full, and updates the connection's flags just like raw_sock_from_buf().
+ */
+static size_t raw_sock_from_iov(struct connection *conn, void *xprt_ctx, const struct iovec *iov, int iovcnt, int flags)
+{
+	struct msghdr msg;
+	ssize_t ret;
+	size_t try = 0;
+	int send_flag;
+	int i;
+
+	if (!conn_ctrl_ready(conn))
+		return 0;
+
+	if (!fd_send_ready(conn->handle.fd))
+		return 0;
+
+	if (conn->flags & CO_FL_SOCK_WR_SH) {
+		/* it's already closed */
+		conn->flags |= CO_FL_ERROR | CO_FL_SOCK_RD_SH;
+		errno = EPIPE;
+		return 0;
+	}
+
+	for (i = 0; i < iovcnt; i++)
+		try += iov[i].iov_len;
+
+	if (!try)
+		return 0;
+
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = (struct iovec *)iov;
+	msg.msg_iovlen = iovcnt;
+
+	send_flag = MSG_DONTWAIT | MSG_NOSIGNAL;
+	if (flags & CO_SFL_MSG_MORE)
+		send_flag |= MSG_MORE;
+
+	do {
+		ret = sendmsg(conn->handle.fd, &msg, send_flag);
+	} while (ret < 0 && errno == EINTR);
+
+	if (ret > 0) {
+		/* if the system buffer is full, don't insist */
+		if (ret < try)
+			fd_cant_send(conn->handle.fd);
+		else
+			fd_stop_send(conn->handle.fd);
+
+		if (unlikely(conn->flags & CO_FL_WAIT_L4_CONN))
+			conn->flags &= ~CO_FL_WAIT_L4_CONN;
+
+		_HA_ATOMIC_ADD(&global.out_bytes, ret);
+		update_freq_ctr(&global.out_32bps, (ret + 16) / 32);
+		return ret;
+	}
+
+	if (ret == 0 || errno == EAGAIN || errno == ENOTCONN || errno == EINPROGRESS) {
+		/* nothing written, we need to poll for write first */
+		fd_cant_send(conn->handle.fd);
+	}
+	else
+		conn->flags |= CO_FL_ERROR | CO_FL_SOCK_RD_SH | CO_FL_SOCK_WR_SH;
+	return 0;
+}
+
 /* Called from the upper layer, to subscribe <es> to events <event_type>. The
  * event subscriber <es> is not allowed to change from a previous call as long
  * as at least one event is still subscribed. The <event_type> must only be a
@@ -455,6 +586,7 @@ static int raw_sock_remove_xprt(struct connection *conn, void *xprt_ctx, void *t
 static struct xprt_ops raw_sock = {
 	.snd_buf  = raw_sock_from_buf,
 	.rcv_buf  = raw_sock_to_buf,
+	.snd_iov  = raw_sock_from_iov,
 	.subscribe = raw_sock_subscribe,
 	.unsubscribe = raw_sock_unsubscribe,
 	.remove_xprt = raw_sock_remove_xprt,
@@ -469,6 +601,42 @@ static struct xprt_ops raw_sock = {
 };
 
 
+#ifdef HA_HAVE_MSG_ZEROCOPY
+/* config parser for global "tune.zerocopy-send" */
+static int cfg_parse_zerocopy_send(char **args, int section_type, struct proxy *curpx,
+                                   const struct proxy *defpx, const char *file, int line,
+                                   char **err)
+{
+	const char *res;
+	uint size;
+
+	if (too_many_args(1, args, err, NULL))
+		return -1;
+
+	res = parse_size_err(args[1], &size);
+	if (res != NULL) {
+		memprintf(err, "unexpected '%s' after size passed to '%s'", res, args[0]);
+		return -1;
+	}
+
+	if (size && size < 4096) {
+		memprintf(err, "'%s' expects 0 or a size of at least 4096 bytes", args[0]);
+		return -1;
+	}
+
+	global.tune.zerocopy_send = size;
+	return 0;
+}
+
+/* config keyword parsers */
+static struct cfg_kw_list cfg_kws = {ILH, {
+	{ CFG_GLOBAL, "tune.zerocopy-send", cfg_parse_zerocopy_send },
+	{ 0, NULL, NULL }
+}};
+
+INITCALL1(STG_REGISTER, cfg_register_keywords, &cfg_kws);
+#endif
+
 __attribute__((constructor))
 static void __raw_sock_init(void)
 {
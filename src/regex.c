@@ -399,6 +399,115 @@ struct my_regex *regex_comp(const char *str, int cs, int cap, char **err)
 	return NULL;
 }
 
+/* Returns non-zero if regex <str> may be combined with other ones into a set
+ * by regex_comp_set(), which is not the case when it refers to groups by
+ * their number or name, makes use of verbs, quoting or extended mode, all of
+ * which could change meaning once the regex is enclosed in an alternation.
+ */
+int regex_set_compatible(const char *str)
+{
+	const char *p;
+
+	for (p = str; *p; p++) {
+		if (*p == '\\') {
+			p++;
+			if (!*p || isdigit((unsigned char)*p) || *p == 'g' || *p == 'k' || *p == 'Q')
+				return 0;
+			continue;
+		}
+
+		if (*p != '(')
+			continue;
+
+		if (p[1] == '*')
+			return 0;
+
+		if (p[1] == '?') {
+			const char *o = p + 2;
+
+			if (*o == 'P' || *o == '&' || *o == 'R' || *o == '(' ||
+			    isdigit((unsigned char)*o) || *o == '+' || *o == '-')
+				return 0;
+
+			/* inline options, possibly followed by ':' */
+			for (; isalpha((unsigned char)*o) || *o == '^' || *o == '-'; o++)
+				if (*o == 'x')
+					return 0;
+		}
+	}
+	return 1;
+}
+
+/* Compiles the <nb> regex in <strs> into a single one which matches when any
+ * of them matches, and which reports through regex_exec_set() the index of the
+ * one which matched, which is the one matching at the leftmost position, or
+ * the first one in <strs> if several match there. The regex must have been
+ * checked with regex_set_compatible(). <cs> is the case sensitive flag. This
+ * is only supported with PCRE and PCRE2. Returns the regex, or NULL with <err>
+ * filled on error.
+ */
+struct my_regex *regex_comp_set(const char **strs, int nb, int cs, char **err)
+{
+#if defined(USE_PCRE) || defined(USE_PCRE_JIT) || defined(USE_PCRE2) || defined(USE_PCRE2_JIT)
+	struct my_regex *regex;
+	char *str = NULL;
+	int i;
+
+	for (i = 0; i < nb; i++) {
+		if (!memprintf(&str, "%s%s(?:%s)(*MARK:%d)", str ? str : "", i ? "|" : "", strs[i], i)) {
+			memprintf(err, "not enough memory to build regex");
+			return NULL;
+		}
+	}
+
+	regex = regex_comp(str ? str : "", cs, 0, err);
+	free(str);
+	return regex;
+#else
+	memprintf(err, "combined regex are only supported with PCRE or PCRE2");
+	return NULL;
+#endif
+}
+
+/* Executes regex <preg> built by regex_comp_set() on the <length> bytes of
+ * <subject>. Returns the index of the regex which matched, or -1 if none did.
+ */
+int regex_exec_set(const struct my_regex *preg, const char *subject, int length)
+{
+#if defined(USE_PCRE) || defined(USE_PCRE_JIT)
+	unsigned char *mark = NULL;
+	pcre_extra extra;
+
+	if (preg->extra)
+		extra = *preg->extra;
+	else
+		memset(&extra, 0, sizeof(extra));
+	extra.flags |= PCRE_EXTRA_MARK;
+	extra.mark = &mark;
+
+	if (pcre_exec(preg->reg, &extra, subject, length, 0, 0, NULL, 0) < 0 || !mark)
+		return -1;
+	return atoi((const char *)mark);
+#elif defined(USE_PCRE2) || defined(USE_PCRE2_JIT)
+	pcre2_match_data *pm;
+	PCRE2_SPTR mark;
+	int ret = -1;
+
+	pm = pcre2_match_data_create_from_pattern(preg->reg, NULL);
+	if (!pm)
+		return -1;
+
+	if (preg->mfn(preg->reg, (PCRE2_SPTR)subject, (PCRE2_SIZE)length, 0, 0, pm, NULL) >= 0 &&
+	    (mark = pcre2_get_mark(pm)) != NULL)
+		ret = atoi((const char *)mark);
+
+	pcre2_match_data_free(pm);
+	return ret;
+#else
+	return -1;
+#endif
+}
+
 static void regex_register_build_options(void)
 {
 	char *ptr = NULL;
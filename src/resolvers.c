@@ -10,6 +10,7 @@
  *
  */
 
+#include <ctype.h>
 #include <errno.h>
 #include <fcntl.h>
 #include <stdio.h>
@@ -20,6 +21,7 @@
 #include <sys/types.h>
 
 #include <import/ebistree.h>
+#include <import/xxhash.h>
 
 #include <haproxy/action.h>
 #include <haproxy/api.h>
@@ -58,6 +60,7 @@ struct resolvers *curr_resolvers = NULL;
 DECLARE_STATIC_POOL(resolv_answer_item_pool, "resolv_answer_item", sizeof(struct resolv_answer_item));
 DECLARE_STATIC_POOL(resolv_resolution_pool,  "resolv_resolution",  sizeof(struct resolv_resolution));
 DECLARE_POOL(resolv_requester_pool,  "resolv_requester",  sizeof(struct resolv_requester));
+DECLARE_STATIC_POOL(resolv_cache_pool,     "resolv_cache",      sizeof(struct resolv_cache_entry));
 
 static unsigned int resolution_uuid = 1;
 unsigned int resolv_failed_resolutions = 0;
@@ -167,6 +170,57 @@ static __inline int resolv_hostname_cmp(const char *name1, const char *name2, in
 	return 0;
 }
 
+/* Returns a hash of the <len> first characters of domain name <name> which
+ * does not depend on their case, so that names equal for resolv_hostname_cmp()
+ * have the same hash.
+ */
+static inline unsigned int resolv_target_hash(const char *name, int len)
+{
+	unsigned int hash = 5381;
+	int i;
+
+	for (i = 0; i < len; i++)
+		hash = (hash << 5) + hash + tolower((unsigned char)name[i]);
+	return hash;
+}
+
+/* Returns the key of answer item <item> in its response's answer_tree. It only
+ * depends on the fields used to tell whether two records are the same.
+ */
+static unsigned int resolv_answer_item_hash(const struct resolv_answer_item *item)
+{
+	switch (item->type) {
+	case DNS_RTYPE_A:
+		return XXH32(&((struct sockaddr_in *)&item->address)->sin_addr, sizeof(in_addr_t), item->type);
+	case DNS_RTYPE_AAAA:
+		return XXH32(&((struct sockaddr_in6 *)&item->address)->sin6_addr, sizeof(struct in6_addr), item->type);
+	case DNS_RTYPE_SRV:
+		return resolv_target_hash(item->target, item->data_len) ^ ((unsigned int)item->port << 16);
+	default:
+		return item->type;
+	}
+}
+
+/* Indexes answer item <item> which was just appended to response <r_res>. */
+static void resolv_index_answer_item(struct resolv_response *r_res, struct resolv_answer_item *item)
+{
+	item->node.key = resolv_answer_item_hash(item);
+	eb32_insert(&r_res->answer_tree, &item->node);
+	if (item->type == DNS_RTYPE_SRV) {
+		item->target_node.key = resolv_target_hash(item->target, item->data_len);
+		eb32_insert(&r_res->target_tree, &item->target_node);
+	}
+}
+
+/* Removes answer item <item> from its response's list and indexes. */
+static void resolv_unlink_answer_item(struct resolv_answer_item *item)
+{
+	LIST_DELETE(&item->list);
+	eb32_delete(&item->node);
+	if (item->type == DNS_RTYPE_SRV)
+		eb32_delete(&item->target_node);
+}
+
 /* Returns a pointer on the SRV request matching the name <name> for the proxy
  * <px>. NULL is returned if no match is found.
  */
@@ -620,7 +674,7 @@ static void resolv_check_response(struct resolv_resolution *res)
 				}
 			}
 
-			LIST_DELETE(&item->list);
+			resolv_unlink_answer_item(item);
 			if (item->ar_item) {
 				pool_free(resolv_answer_item_pool, item->ar_item);
 				item->ar_item = NULL;
@@ -782,8 +836,13 @@ static void resolv_check_response(struct resolv_resolution *res)
 					 */
 					ha_weight = (item->weight + 255) / 256;
 
-					snprintf(weight, sizeof(weight), "%d", ha_weight);
-					server_parse_weight_change_request(srv, weight);
+					/* only propagate actual changes, most responses
+					 * repeat the same records.
+					 */
+					if (ha_weight != srv->uweight) {
+						snprintf(weight, sizeof(weight), "%d", ha_weight);
+						server_parse_weight_change_request(srv, weight);
+					}
 				}
 				HA_SPIN_UNLOCK(SERVER_LOCK, &srv->lock);
 			}
@@ -811,6 +870,7 @@ static int resolv_validate_dns_response(unsigned char *resp, unsigned char *bufe
 	struct resolv_query_item *query;
 	struct resolv_answer_item *answer_record, *tmp_record;
 	struct resolv_response *r_res;
+	struct eb32_node *node;
 	int i, found = 0;
 	int cause = RSLV_RESP_ERROR;
 
@@ -1117,7 +1177,9 @@ static int resolv_validate_dns_response(unsigned char *resp, unsigned char *bufe
 
 		/* Lookup to see if we already had this entry */
 		found = 0;
-		list_for_each_entry(tmp_record, &r_res->answer_list, list) {
+		node = eb32_lookup(&r_res->answer_tree, resolv_answer_item_hash(answer_record));
+		for (; node; node = eb32_next_dup(node)) {
+			tmp_record = eb32_entry(node, struct resolv_answer_item, node);
 			if (tmp_record->type != answer_record->type)
 				continue;
 
@@ -1162,6 +1224,7 @@ static int resolv_validate_dns_response(unsigned char *resp, unsigned char *bufe
 			answer_record->last_seen = now_ms;
 			answer_record->ar_item = NULL;
 			LIST_APPEND(&r_res->answer_list, &answer_record->list);
+			resolv_index_answer_item(r_res, answer_record);
 			answer_record = NULL;
 		}
 	} /* for i 0 to ancount */
@@ -1301,10 +1364,12 @@ static int resolv_validate_dns_response(unsigned char *resp, unsigned char *bufe
 
 		/* Lookup to see if we already had this entry */
 		found = 0;
-		list_for_each_entry(tmp_record, &r_res->answer_list, list) {
+		node = eb32_lookup(&r_res->target_tree, resolv_target_hash(answer_record->name, len));
+		for (; node; node = eb32_next_dup(node)) {
 			struct resolv_answer_item *ar_item;
 
-			if (tmp_record->type != DNS_RTYPE_SRV || !tmp_record->ar_item)
+			tmp_record = eb32_entry(node, struct resolv_answer_item, target_node);
+			if (!tmp_record->ar_item)
 				continue;
 
 			ar_item = tmp_record->ar_item;
@@ -1346,9 +1411,11 @@ static int resolv_validate_dns_response(unsigned char *resp, unsigned char *bufe
 			answer_record->ar_item = NULL;
 
 			// looking for the SRV record in the response list linked to this additional record
-			list_for_each_entry(tmp_record, &r_res->answer_list, list) {
-				if (tmp_record->type == DNS_RTYPE_SRV &&
-				    tmp_record->ar_item == NULL &&
+			node = eb32_lookup(&r_res->target_tree, resolv_target_hash(answer_record->name, len));
+			for (; node; node = eb32_next_dup(node)) {
+				tmp_record = eb32_entry(node, struct resolv_answer_item, target_node);
+				if (tmp_record->ar_item == NULL &&
+				    len == tmp_record->data_len &&
 				    !resolv_hostname_cmp(tmp_record->target, answer_record->name, tmp_record->data_len)) {
 					/* Always use the received additional record to refresh info */
 					if (tmp_record->ar_item)
@@ -1759,6 +1826,8 @@ static struct resolv_resolution *resolv_pick_resolution(struct resolvers *resolv
 
 		LIST_INIT(&res->requesters);
 		LIST_INIT(&res->response.answer_list);
+		res->response.answer_tree = EB_ROOT;
+		res->response.target_tree = EB_ROOT;
 
 		res->prefered_query_type = query_type;
 		res->query_type          = query_type;
@@ -1773,12 +1842,221 @@ static struct resolv_resolution *resolv_pick_resolution(struct resolvers *resolv
 	return res;
 }
 
+/* Returns the key indexing the answer for <hostname_dn> selected with <opts> */
+static inline uint64_t resolv_cache_key(const struct resolv_options *opts,
+                                        const char *hostname_dn, int hostname_dn_len)
+{
+	return XXH64(hostname_dn, hostname_dn_len, (uint64_t)(uintptr_t)opts);
+}
+
+/* Detaches the answer cache entry <entry> from the resolution which refreshed
+ * it, if any. Must not be called from a requester callback.
+ */
+static void resolv_cache_detach(struct resolv_cache_entry *entry)
+{
+	LIST_DEL_INIT(&entry->refreshed);
+	if (entry->requester) {
+		resolv_unlink_resolution(entry->requester, 0);
+		pool_free(resolv_requester_pool, entry->requester);
+		entry->requester = NULL;
+	}
+}
+
+static void resolv_cache_free_entry(struct resolv_cache_entry *entry)
+{
+	resolv_cache_detach(entry);
+	eb64_delete(&entry->node);
+	LIST_DELETE(&entry->list);
+	entry->resolvers->cache.used--;
+	free(entry->hostname_dn);
+	pool_free(resolv_cache_pool, entry);
+}
+
+/* Looks up in the cache of <resolvers> the answer for <hostname_dn>, in lower
+ * case, selected with <opts>. The entry found, which may have expired, is moved
+ * to the head of the LRU list. Must be called with the resolvers lock held.
+ */
+static struct resolv_cache_entry *resolv_cache_lookup(struct resolvers *resolvers,
+                                                      const struct resolv_options *opts,
+                                                      const char *hostname_dn, int hostname_dn_len)
+{
+	struct resolv_cache_entry *entry;
+	struct eb64_node *node;
+
+	node = eb64_lookup(&resolvers->cache.entries, resolv_cache_key(opts, hostname_dn, hostname_dn_len));
+	for (; node; node = eb64_next_dup(node)) {
+		entry = eb64_entry(node, struct resolv_cache_entry, node);
+		if (entry->opts == opts && entry->hostname_dn_len == hostname_dn_len &&
+		    memcmp(entry->hostname_dn, hostname_dn, hostname_dn_len) == 0) {
+			LIST_DELETE(&entry->list);
+			LIST_INSERT(&resolvers->cache.lru, &entry->list);
+			return entry;
+		}
+	}
+	return NULL;
+}
+
+/* Updates the answer cache entry <entry> from the result of the resolution
+ * <res>. <error> is set when the resolution failed. A failure does not replace
+ * a valid answer which has not expired yet, it only delays its next refresh.
+ */
+static void resolv_cache_update(struct resolv_cache_entry *entry, struct resolv_resolution *res, int error)
+{
+	struct resolvers *resolvers = entry->resolvers;
+	void *ip = NULL;
+	short family = 0;
+	int status, hold;
+
+	status = res->status;
+	if (error && status == RSLV_STATUS_VALID)
+		status = RSLV_STATUS_OTHER;
+
+	if (status != RSLV_STATUS_VALID && entry->status == RSLV_STATUS_VALID &&
+	    !tick_is_expired(entry->expire, now_ms)) {
+		entry->refresh = tick_add(now_ms, resolvers->timeout.resolve);
+		return;
+	}
+
+	switch (status) {
+	case RSLV_STATUS_VALID:   hold = resolvers->hold.valid;   break;
+	case RSLV_STATUS_NX:      hold = resolvers->hold.nx;      break;
+	case RSLV_STATUS_REFUSED: hold = resolvers->hold.refused; break;
+	case RSLV_STATUS_TIMEOUT: hold = resolvers->hold.timeout; break;
+	default:                  hold = resolvers->hold.other;   break;
+	}
+
+	if (status == RSLV_STATUS_VALID)
+		resolv_get_ip_from_response(&res->response, (struct resolv_options *)entry->opts, NULL,
+		                            0, &ip, &family, NULL);
+	entry->status = status;
+	entry->family = 0;
+	if (family == AF_INET) {
+		entry->family = AF_INET;
+		memcpy(&entry->addr.in4, ip, 4);
+	}
+	else if (family == AF_INET6) {
+		entry->family = AF_INET6;
+		memcpy(&entry->addr.in6, ip, 16);
+	}
+
+	entry->expire = tick_add(now_ms, hold);
+	entry->refresh = TICK_ETERNITY;
+	if (status == RSLV_STATUS_VALID && resolvers->cache.prefetch && resolvers->cache.prefetch < hold)
+		entry->refresh = tick_add(now_ms, hold - resolvers->cache.prefetch);
+}
+
+/* Stores in the cache of its resolvers section the result of the resolution
+ * <res> performed for the do-resolve action of stream <s>. <error> is set when
+ * the resolution failed. An entry being refreshed is never evicted, since this
+ * may be called from a requester callback. Must be called with the resolvers
+ * lock held.
+ */
+void resolv_cache_store(struct stream *s, struct resolv_resolution *res, int error)
+{
+	struct act_rule *rule = s->resolv_ctx.parent;
+	struct resolvers *resolvers;
+	struct resolv_cache_entry *entry;
+
+	if (!rule || !s->resolv_ctx.hostname_dn)
+		return;
+	resolvers = rule->arg.resolv.resolvers;
+	if (!resolvers->cache.size)
+		return;
+
+	entry = resolv_cache_lookup(resolvers, rule->arg.resolv.opts,
+	                            s->resolv_ctx.hostname_dn, s->resolv_ctx.hostname_dn_len);
+	if (!entry) {
+		if (resolvers->cache.used >= resolvers->cache.size) {
+			list_for_each_entry_rev(entry, &resolvers->cache.lru, list) {
+				if (!entry->requester)
+					break;
+			}
+			if (&entry->list == &resolvers->cache.lru)
+				return;
+			resolv_cache_free_entry(entry);
+		}
+
+		entry = pool_zalloc(resolv_cache_pool);
+		if (!entry)
+			return;
+		entry->hostname_dn = strdup(s->resolv_ctx.hostname_dn);
+		if (!entry->hostname_dn) {
+			pool_free(resolv_cache_pool, entry);
+			return;
+		}
+		entry->obj_type = OBJ_TYPE_RESOLV_CACHE;
+		entry->hostname_dn_len = s->resolv_ctx.hostname_dn_len;
+		entry->resolvers = resolvers;
+		entry->opts = rule->arg.resolv.opts;
+		entry->status = RSLV_STATUS_NONE;
+		LIST_INIT(&entry->refreshed);
+		entry->node.key = resolv_cache_key(entry->opts, entry->hostname_dn, entry->hostname_dn_len);
+		eb64_insert(&resolvers->cache.entries, &entry->node);
+		LIST_INSERT(&resolvers->cache.lru, &entry->list);
+		resolvers->cache.used++;
+	}
+	resolv_cache_update(entry, res, error);
+}
+
+/* Requester callbacks of a refresh of an answer cache entry. The entry is
+ * queued to be detached from the resolution by the resolvers task, since it
+ * cannot be done while the requesters are being walked.
+ */
+static void resolv_cache_refreshed(struct resolv_requester *requester, int error)
+{
+	struct resolv_cache_entry *entry = objt_resolv_cache(requester->owner);
+
+	if (!entry || !requester->resolution)
+		return;
+
+	resolv_cache_update(entry, requester->resolution, error);
+	if (!LIST_INLIST(&entry->refreshed))
+		LIST_APPEND(&entry->resolvers->cache.refreshed, &entry->refreshed);
+	task_wakeup(entry->resolvers->t, TASK_WOKEN_OTHER);
+}
+
+static int resolv_cache_refresh_cb(struct resolv_requester *requester, struct dns_counters *counters)
+{
+	resolv_cache_refreshed(requester, 0);
+	return 0;
+}
+
+static int resolv_cache_refresh_error_cb(struct resolv_requester *requester, int error_code)
+{
+	resolv_cache_refreshed(requester, 1);
+	return 0;
+}
+
+/* Starts the refresh of the valid answer cache entry <entry>, or immediately
+ * updates it if a fresh enough response is already known for this name. Must
+ * be called with the resolvers lock held.
+ */
+static void resolv_cache_prefetch(struct resolv_cache_entry *entry)
+{
+	struct resolvers *resolvers = entry->resolvers;
+	struct resolv_resolution *res;
+
+	entry->refresh = tick_add(now_ms, resolvers->timeout.retry * (resolvers->resolve_retries + 1));
+	if (resolv_link_resolution(entry, OBJ_TYPE_RESOLV_CACHE, 0) == -1)
+		return;
+	resolvers->cache.prefetches++;
+
+	res = entry->requester->resolution;
+	if (res->step == RSLV_STEP_NONE && res->status == RSLV_STATUS_VALID && tick_isset(res->last_resolution) &&
+	    !tick_is_expired(tick_add(res->last_resolution, resolvers->hold.valid), now_ms)) {
+		resolv_cache_update(entry, res, 0);
+		resolv_cache_detach(entry);
+		return;
+	}
+	resolv_trigger_resolution(entry->requester);
+}
+
 void resolv_purge_resolution_answer_records(struct resolv_resolution *resolution)
 {
 	struct resolv_answer_item *item, *itemback;
 
 	list_for_each_entry_safe(item, itemback, &resolution->response.answer_list, list) {
-		LIST_DELETE(&item->list);
+		resolv_unlink_answer_item(item);
 		pool_free(resolv_answer_item_pool, item->ar_item);
 		pool_free(resolv_answer_item_pool, item);
 	}
@@ -1814,6 +2092,7 @@ int resolv_link_resolution(void *requester, int requester_type, int requester_lo
 	struct server         *srv   = NULL;
 	struct resolv_srvrq      *srvrq = NULL;
 	struct stream         *stream = NULL;
+	struct resolv_cache_entry *entry = NULL;
 	char **hostname_dn;
 	int   hostname_dn_len, query_type;
 
@@ -1845,6 +2124,16 @@ int resolv_link_resolution(void *requester, int requester_type, int requester_lo
 					   ? DNS_RTYPE_A
 					   : DNS_RTYPE_AAAA);
 			break;
+
+		case OBJ_TYPE_RESOLV_CACHE:
+			entry           = (struct resolv_cache_entry *)requester;
+			hostname_dn     = &entry->hostname_dn;
+			hostname_dn_len = entry->hostname_dn_len;
+			resolvers       = entry->resolvers;
+			query_type      = ((entry->opts->family_prio == AF_INET)
+					   ? DNS_RTYPE_A
+					   : DNS_RTYPE_AAAA);
+			break;
 		default:
 			goto err;
 	}
@@ -1899,6 +2188,19 @@ int resolv_link_resolution(void *requester, int requester_type, int requester_lo
 		req->requester_cb       = act_resolution_cb;
 		req->requester_error_cb = act_resolution_error_cb;
 	}
+	else if (entry) {
+		if (entry->requester == NULL) {
+			if ((req = pool_alloc(resolv_requester_pool)) == NULL)
+				goto err;
+			req->owner           = &entry->obj_type;
+			entry->requester     = req;
+		}
+		else
+			req = entry->requester;
+
+		req->requester_cb       = resolv_cache_refresh_cb;
+		req->requester_error_cb = resolv_cache_refresh_error_cb;
+	}
 	else
 		goto err;
 
@@ -2002,6 +2304,10 @@ void resolv_unlink_resolution(struct resolv_requester *requester, int safe)
 			res->hostname_dn     = __objt_stream(req->owner)->resolv_ctx.hostname_dn;
 			res->hostname_dn_len = __objt_stream(req->owner)->resolv_ctx.hostname_dn_len;
 			break;
+		case OBJ_TYPE_RESOLV_CACHE:
+			res->hostname_dn     = __objt_resolv_cache(req->owner)->hostname_dn;
+			res->hostname_dn_len = __objt_resolv_cache(req->owner)->hostname_dn_len;
+			break;
 		default:
 			res->hostname_dn     = NULL;
 			res->hostname_dn_len = 0;
@@ -2212,6 +2518,10 @@ static struct task *process_resolvers(struct task *t, void *context, unsigned in
 
 	HA_SPIN_LOCK(DNS_LOCK, &resolvers->lock);
 
+	/* Detach the answer cache entries from their completed refresh */
+	while (!LIST_ISEMPTY(&resolvers->cache.refreshed))
+		resolv_cache_detach(LIST_NEXT(&resolvers->cache.refreshed, struct resolv_cache_entry *, refreshed));
+
 	/* Handle all expired resolutions from the active list */
 	list_for_each_entry_safe(res, resback, &resolvers->resolutions.curr, list) {
 		if (LIST_ISEMPTY(&res->requesters)) {
@@ -2327,6 +2637,9 @@ static void resolvers_deinit(void)
 			free(ns);
 		}
 
+		while (!LIST_ISEMPTY(&resolvers->cache.lru))
+			resolv_cache_free_entry(LIST_NEXT(&resolvers->cache.lru, struct resolv_cache_entry *, list));
+
 		list_for_each_entry_safe(res, resback, &resolvers->resolutions.curr, list) {
 			list_for_each_entry_safe(req, reqback, &res->requesters, list) {
 				LIST_DELETE(&req->list);
@@ -2658,6 +2971,13 @@ static int cli_io_handler_dump_resolvers_to_buffer(struct appctx *appctx)
 					chunk_appendf(&trash, "  truncated:   %lld\n", ns->counters->truncated);
 					chunk_appendf(&trash, "  outdated:    %lld\n",  ns->counters->outdated);
 				}
+				if (resolvers->cache.size) {
+					chunk_appendf(&trash, " answer cache:\n");
+					chunk_appendf(&trash, "  entries:     %u/%u\n", resolvers->cache.used, resolvers->cache.size);
+					chunk_appendf(&trash, "  hits:        %llu\n", resolvers->cache.hits);
+					chunk_appendf(&trash, "  misses:      %llu\n", resolvers->cache.misses);
+					chunk_appendf(&trash, "  prefetches:  %llu\n", resolvers->cache.prefetches);
+				}
 				chunk_appendf(&trash, "\n");
 			}
 		}
@@ -2689,27 +3009,14 @@ static struct cli_kw_list cli_kws = {{ }, {
 INITCALL1(STG_REGISTER, cli_register_kw, &cli_kws);
 
 /*
- * Prepare <rule> for hostname resolution.
+ * Prepare <stream> for the resolution of <hostname_dn>, of length
+ * <hostname_dn_len>, in domain name format.
  * Returns -1 in case of any allocation failure, 0 if not.
  * On error, a global failure counter is also incremented.
  */
-static int action_prepare_for_resolution(struct stream *stream, const char *hostname)
+static int action_prepare_for_resolution(struct stream *stream, const char *hostname_dn,
+                                         int hostname_dn_len)
 {
-	char *hostname_dn;
-	int   hostname_len, hostname_dn_len;
-	struct buffer *tmp = get_trash_chunk();
-
-	if (!hostname)
-		return 0;
-
-	hostname_len    = strlen(hostname);
-	hostname_dn     = tmp->area;
-	hostname_dn_len = resolv_str_to_dn_label(hostname, hostname_len + 1,
-	                                         hostname_dn, tmp->size);
-	if (hostname_dn_len == -1)
-		goto err;
-
-
 	stream->resolv_ctx.hostname_dn     = strdup(hostname_dn);
 	stream->resolv_ctx.hostname_dn_len = hostname_dn_len;
 	if (!stream->resolv_ctx.hostname_dn)
@@ -2718,25 +3025,50 @@ static int action_prepare_for_resolution(struct stream *stream, const char *host
 	return 0;
 
  err:
-	ha_free(&stream->resolv_ctx.hostname_dn);
 	resolv_failed_resolutions += 1;
 	return -1;
 }
 
-
-/*
- * Execute the "do-resolution" action. May be called from {tcp,http}request.
+/* Sets the variable of the do-resolve <rule> to the address <ip> of family
+ * <family>. Nothing is done if <family> is neither AF_INET nor AF_INET6.
  */
+static void action_set_resolved_ip(struct act_rule *rule, struct proxy *px, struct session *sess,
+                                   struct stream *s, short family, const void *ip)
+{
+	struct sample smp;
+
+	switch (family) {
+	case AF_INET:
+		smp.data.type = SMP_T_IPV4;
+		memcpy(&smp.data.u.ipv4, ip, 4);
+		break;
+	case AF_INET6:
+		smp.data.type = SMP_T_IPV6;
+		memcpy(&smp.data.u.ipv6, ip, 16);
+		break;
+	default:
+		return;
+	}
+
+	smp.px = px;
+	smp.sess = sess;
+	smp.strm = s;
+	vars_set_by_name(rule->arg.resolv.varname, strlen(rule->arg.resolv.varname), &smp);
+}
+
 enum act_return resolv_action_do_resolve(struct act_rule *rule, struct proxy *px,
 					      struct session *sess, struct stream *s, int flags)
 {
 	struct resolv_resolution *resolution;
+	struct resolv_cache_entry *entry;
 	struct sample *smp;
-	char *fqdn;
+	char *fqdn, *hostname_dn;
+	struct buffer *tmp;
 	struct resolv_requester *req;
 	struct resolvers  *resolvers;
 	struct resolv_resolution *res;
 	int exp, locked = 0;
+	int hostname_dn_len, i;
 	enum act_return ret = ACT_RET_CONT;
 
 	resolvers = rule->arg.resolv.resolvers;
@@ -2753,35 +3085,17 @@ enum act_return resolv_action_do_resolve(struct act_rule *rule, struct proxy *px
 		if (resolution->step == RSLV_STEP_RUNNING)
 			goto yield;
 		if (resolution->step == RSLV_STEP_NONE) {
+			/* the response may come from an earlier resolution */
+			resolv_cache_store(s, resolution, resolution->status != RSLV_STATUS_VALID);
+
 			/* We update the variable only if we have a valid response. */
 			if (resolution->status == RSLV_STATUS_VALID) {
-				struct sample smp;
 				short ip_sin_family = 0;
 				void *ip = NULL;
 
 				resolv_get_ip_from_response(&resolution->response, rule->arg.resolv.opts, NULL,
 							 0, &ip, &ip_sin_family, NULL);
-
-				switch (ip_sin_family) {
-				case AF_INET:
-					smp.data.type = SMP_T_IPV4;
-					memcpy(&smp.data.u.ipv4, ip, 4);
-					break;
-				case AF_INET6:
-					smp.data.type = SMP_T_IPV6;
-					memcpy(&smp.data.u.ipv6, ip, 16);
-					break;
-				default:
-					ip = NULL;
-				}
-
-				if (ip) {
-					smp.px = px;
-					smp.sess = sess;
-					smp.strm = s;
-
-					vars_set_by_name(rule->arg.resolv.varname, strlen(rule->arg.resolv.varname), &smp);
-				}
+				action_set_resolved_ip(rule, px, sess, s, ip_sin_family, ip);
 			}
 		}
 
@@ -2794,14 +3108,41 @@ enum act_return resolv_action_do_resolve(struct act_rule *rule, struct proxy *px
 		goto end;
 
 	fqdn = smp->data.u.str.area;
-	if (action_prepare_for_resolution(s, fqdn) == -1)
+	tmp = get_trash_chunk();
+	hostname_dn = tmp->area;
+	hostname_dn_len = resolv_str_to_dn_label(fqdn, strlen(fqdn) + 1, hostname_dn, tmp->size);
+	if (hostname_dn_len == -1) {
+		resolv_failed_resolutions += 1;
 		goto end; /* on error, ignore the action */
-
-	s->resolv_ctx.parent = rule;
+	}
+	for (i = 0; i < hostname_dn_len; i++)
+		hostname_dn[i] = tolower((unsigned char)hostname_dn[i]);
 
 	HA_SPIN_LOCK(DNS_LOCK, &resolvers->lock);
 	locked = 1;
 
+	/* The answer may be in the cache of the resolvers section. When a valid
+	 * one is about to expire, it is refreshed in background while the
+	 * current answer is still used.
+	 */
+	if (resolvers->cache.size) {
+		entry = resolv_cache_lookup(resolvers, rule->arg.resolv.opts, hostname_dn, hostname_dn_len);
+		if (entry && !tick_is_expired(entry->expire, now_ms)) {
+			resolvers->cache.hits++;
+			action_set_resolved_ip(rule, px, sess, s, entry->family, &entry->addr);
+			if (entry->status == RSLV_STATUS_VALID && !entry->requester &&
+			    tick_is_expired(entry->refresh, now_ms))
+				resolv_cache_prefetch(entry);
+			goto end;
+		}
+		resolvers->cache.misses++;
+	}
+
+	if (action_prepare_for_resolution(s, hostname_dn, hostname_dn_len) == -1)
+		goto end; /* on error, ignore the action */
+
+	s->resolv_ctx.parent = rule;
+
 	resolv_link_resolution(s, OBJ_TYPE_STREAM, 0);
 
 	/* Check if there is a fresh enough response in the cache of our associated resolution */
@@ -3085,6 +3426,9 @@ int cfg_parse_resolvers(const char *file, int linenum, char **args, int kwm)
 		curr_resolvers->conf.line = linenum;
 		curr_resolvers->id = strdup(args[1]);
 		curr_resolvers->query_ids = EB_ROOT;
+		curr_resolvers->cache.entries = EB_ROOT;
+		LIST_INIT(&curr_resolvers->cache.lru);
+		LIST_INIT(&curr_resolvers->cache.refreshed);
 		/* default maximum response size */
 		curr_resolvers->accepted_payload_size = 512;
 		/* default hold period for nx, other, refuse and timeout is 30s */
@@ -3377,6 +3721,46 @@ int cfg_parse_resolvers(const char *file, int linenum, char **args, int kwm)
 
 		curr_resolvers->accepted_payload_size = i;
 	}
+	else if (strcmp(args[0], "answer-cache") == 0) {
+		if (!*args[1]) {
+			ha_alert("parsing [%s:%d] : '%s' expects <entries> as argument.\n",
+				 file, linenum, args[0]);
+			err_code |= ERR_ALERT | ERR_FATAL;
+			goto out;
+		}
+		curr_resolvers->cache.size = atoi(args[1]);
+	}
+	else if (strcmp(args[0], "answer-prefetch") == 0) {
+		const char *res;
+		unsigned int time;
+
+		if (!*args[1]) {
+			ha_alert("parsing [%s:%d] : '%s' expects <time> as argument.\n",
+				 file, linenum, args[0]);
+			err_code |= ERR_ALERT | ERR_FATAL;
+			goto out;
+		}
+		res = parse_time_err(args[1], &time, TIME_UNIT_MS);
+		if (res == PARSE_TIME_OVER) {
+			ha_alert("parsing [%s:%d]: timer overflow in argument <%s> to <%s>, maximum value is 2147483647 ms (~24.8 days).\n",
+			         file, linenum, args[1], args[0]);
+			err_code |= ERR_ALERT | ERR_FATAL;
+			goto out;
+		}
+		else if (res == PARSE_TIME_UNDER) {
+			ha_alert("parsing [%s:%d]: timer underflow in argument <%s> to <%s>, minimum non-null value is 1 ms.\n",
+			         file, linenum, args[1], args[0]);
+			err_code |= ERR_ALERT | ERR_FATAL;
+			goto out;
+		}
+		else if (res) {
+			ha_alert("parsing [%s:%d]: unexpected character '%c' in argument to <%s>.\n",
+				 file, linenum, *res, args[0]);
+			err_code |= ERR_ALERT | ERR_FATAL;
+			goto out;
+		}
+		curr_resolvers->cache.prefetch = time;
+	}
 	else if (strcmp(args[0], "resolution_pool_size") == 0) {
 		ha_alert("parsing [%s:%d] : '%s' directive is not supported anymore (it never appeared in a stable release).\n",
 			   file, linenum, args[0]);
@@ -38,6 +38,7 @@ void ring_init(struct ring *ring, void *area, size_t size)
 	ring->buf = b_make(area, size, 0, 0);
 	/* write the initial RC byte */
 	b_putchr(&ring->buf, 0);
+	ring->committed = 1;
 }
 
 /* Creates and returns a ring buffer of size <size> bytes. Returns NULL on
@@ -85,6 +86,10 @@ struct ring *ring_resize(struct ring *ring, size_t size)
 
 	HA_RWLOCK_WRLOCK(LOGSRV_LOCK, &ring->lock);
 
+	/* writers may still be copying into reserved room */
+	while (HA_ATOMIC_LOAD(&ring->committed) != ring->ofs + ring->buf.data)
+		__ha_cpu_relax();
+
 	/* recheck the buffer's size, it may have changed during the malloc */
 	if (b_size(&ring->buf) < size) {
 		/* copy old contents */
@@ -109,32 +114,54 @@ void ring_free(struct ring *ring)
 	free(ring);
 }
 
+/* Copies <len> bytes from <blk> at storage position <*pos> of buffer <buf>,
+ * wrapping at the end of the storage area, and advances <*pos>. The caller
+ * must have reserved the room.
+ */
+static inline void ring_put_blk(struct buffer *buf, size_t *pos, const char *blk, size_t len)
+{
+	size_t half = b_size(buf) - *pos;
+
+	if (half > len)
+		half = len;
+	memcpy(b_orig(buf) + *pos, blk, half);
+	if (len > half)
+		memcpy(b_orig(buf), blk + half, len - half);
+
+	*pos += len;
+	if (*pos >= b_size(buf))
+		*pos -= b_size(buf);
+}
+
 /* Tries to send <npfx> parts from <prefix> followed by <nmsg> parts from <msg>
  * to ring <ring>. The message is sent atomically. It may be truncated to
  * <maxlen> bytes if <maxlen> is non-null. There is no distinction between the
  * two lists, it's just a convenience to help the caller prepend some prefixes
- * when necessary. It takes the ring's write lock to make sure no other thread
- * will touch the buffer during the update. Returns the number of bytes sent,
- * or <=0 on failure.
+ * when necessary.
+ *
+ * Writers do not serialize: each of them reserves its room by atomically
+ * moving the buffer's tail under the ring's read lock, copies its message
+ * without any lock, then commits it. Commits are made visible to readers in
+ * reservation order, via ring->committed. Only when old messages have to be
+ * deleted to make room is the write lock taken, since this moves the head
+ * that readers rely on. Returns the number of bytes sent, or <=0 on failure.
  */
 ssize_t ring_write(struct ring *ring, size_t maxlen, const struct ist pfx[], size_t npfx, const struct ist msg[], size_t nmsg)
 {
 	struct buffer *buf = &ring->buf;
 	struct appctx *appctx;
 	size_t totlen = 0;
-	size_t lenlen;
+	size_t lenlen, need, data, pos, abs;
 	uint64_t dellen;
 	int dellenlen;
-	ssize_t sent = 0;
+	char varint[10], *p;
 	int i;
 
 	/* we have to find some room to add our message (the buffer is
-	 * never empty and at least contains the previous counter) and
-	 * to update both the buffer contents and heads at the same
-	 * time (it's doable using atomic ops but not worth the
-	 * trouble, let's just lock). For this we first need to know
-	 * the total message's length. We cannot measure it while
-	 * copying due to the varint encoding of the length.
+	 * never empty and at least contains the previous counter). For
+	 * this we first need to know the total message's length. We
+	 * cannot measure it while copying due to the varint encoding of
+	 * the length.
 	 */
 	for (i = 0; i < npfx; i++)
 		totlen += pfx[i].len;
@@ -145,32 +172,57 @@ ssize_t ring_write(struct ring *ring, size_t maxlen, const struct ist pfx[], siz
 		totlen = maxlen;
 
 	lenlen = varint_bytes(totlen);
+	need = lenlen + totlen + 1;
+
+	if (need + 1 > b_size(buf))
+		return 0;
+
+	/* fast path: there is enough room after the tail, only compete with
+	 * the other writers to reserve it.
+	 */
+	HA_RWLOCK_RDLOCK(LOGSRV_LOCK, &ring->lock);
+	data = HA_ATOMIC_LOAD(&buf->data);
+	while (b_size(buf) - data >= need) {
+		if (HA_ATOMIC_CAS(&buf->data, &data, data + need))
+			goto reserved;
+		__ha_cpu_relax();
+	}
+	HA_RWLOCK_RDUNLOCK(LOGSRV_LOCK, &ring->lock);
 
+	/* slow path: we need to delete the oldest messages (from the end),
+	 * and we have to stop if there's a reader stuck there, or if no
+	 * committed message remains since the next ones are still being
+	 * written. Unless there's corruption in the buffer it's guaranteed
+	 * that we have enough data to find 1 counter byte, a varint-encoded
+	 * length (1 byte min) and the message payload (0 bytes min).
+	 */
 	HA_RWLOCK_WRLOCK(LOGSRV_LOCK, &ring->lock);
-	if (lenlen + totlen + 1 + 1 > b_size(buf))
-		goto done_buf;
-
-	while (b_room(buf) < lenlen + totlen + 1) {
-		/* we need to delete the oldest message (from the end),
-		 * and we have to stop if there's a reader stuck there.
-		 * Unless there's corruption in the buffer it's guaranteed
-		 * that we have enough data to find 1 counter byte, a
-		 * varint-encoded length (1 byte min) and the message
-		 * payload (0 bytes min).
-		 */
-		if (*b_head(buf))
-			goto done_buf;
+	while (b_room(buf) < need) {
+		if (*b_head(buf) || ring->ofs + 1 >= HA_ATOMIC_LOAD(&ring->committed))
+			goto drop;
 		dellenlen = b_peek_varint(buf, 1, &dellen);
 		if (!dellenlen)
-			goto done_buf;
+			goto drop;
 		BUG_ON(b_data(buf) < 1 + dellenlen + dellen);
 
 		b_del(buf, 1 + dellenlen + dellen);
 		ring->ofs += 1 + dellenlen + dellen;
 	}
+	data = buf->data;
+	buf->data += need;
+	HA_RWLOCK_WRTORD(LOGSRV_LOCK, &ring->lock);
 
-	/* OK now we do have room */
-	__b_put_varint(buf, totlen);
+ reserved:
+	/* the room between <data> and <data+need> is ours. The head cannot
+	 * move past it until we commit, so the storage position is stable.
+	 */
+	pos = b_peek(buf, data) - b_orig(buf);
+	abs = ring->ofs + data;
+	HA_RWLOCK_RDUNLOCK(LOGSRV_LOCK, &ring->lock);
+
+	p = varint;
+	encode_varint(totlen, &p, varint + sizeof(varint));
+	ring_put_blk(buf, &pos, varint, p - varint);
 
 	totlen = 0;
 	for (i = 0; i < npfx; i++) {
@@ -179,7 +231,7 @@ ssize_t ring_write(struct ring *ring, size_t maxlen, const struct ist pfx[], siz
 		if (len + totlen > maxlen)
 			len = maxlen - totlen;
 		if (len)
-			__b_putblk(buf, pfx[i].ptr, len);
+			ring_put_blk(buf, &pos, pfx[i].ptr, len);
 		totlen += len;
 	}
 
@@ -189,20 +241,29 @@ ssize_t ring_write(struct ring *ring, size_t maxlen, const struct ist pfx[], siz
 		if (len + totlen > maxlen)
 			len = maxlen - totlen;
 		if (len)
-			__b_putblk(buf, msg[i].ptr, len);
+			ring_put_blk(buf, &pos, msg[i].ptr, len);
 		totlen += len;
 	}
 
-	*b_tail(buf) = 0; buf->data++; // new read counter
-	sent = lenlen + totlen + 1;
+	b_orig(buf)[pos] = 0; // new read counter
+
+	/* wait for the previous writers to commit, then commit ours */
+	while (HA_ATOMIC_LOAD(&ring->committed) != abs)
+		__ha_cpu_relax();
+	HA_ATOMIC_STORE(&ring->committed, abs + need);
 
 	/* notify potential readers */
-	list_for_each_entry(appctx, &ring->waiters, wait_entry)
-		appctx_wakeup(appctx);
+	if (!LIST_ISEMPTY(&ring->waiters)) {
+		HA_RWLOCK_RDLOCK(LOGSRV_LOCK, &ring->lock);
+		list_for_each_entry(appctx, &ring->waiters, wait_entry)
+			appctx_wakeup(appctx);
+		HA_RWLOCK_RDUNLOCK(LOGSRV_LOCK, &ring->lock);
+	}
+	return need;
 
- done_buf:
+ drop:
 	HA_RWLOCK_WRUNLOCK(LOGSRV_LOCK, &ring->lock);
-	return sent;
+	return 0;
 }
 
 /* Tries to attach appctx <appctx> as a new reader on ring <ring>. This is
@@ -306,7 +367,7 @@ int cli_io_handler_show_ring(struct appctx *appctx)
 
 		/* going to the end means looking at tail-1 */
 		if (appctx->ctx.cli.i0 & 2)
-			ofs += b_data(buf) - 1;
+			ofs += ring_data(ring) - 1;
 
 		HA_ATOMIC_INC(b_peek(buf, ofs));
 		ofs += ring->ofs;
@@ -324,13 +385,13 @@ int cli_io_handler_show_ring(struct appctx *appctx)
 	 * stop before the end (ret=0).
 	 */
 	ret = 1;
-	while (ofs + 1 < b_data(buf)) {
+	while (ofs + 1 < ring_data(ring)) {
 		cnt = 1;
 		len = b_peek_varint(buf, ofs + cnt, &msg_len);
 		if (!len)
 			break;
 		cnt += len;
-		BUG_ON(msg_len + ofs + cnt + 1 > b_data(buf));
+		BUG_ON(msg_len + ofs + cnt + 1 > ring_data(ring));
 
 		if (unlikely(msg_len + 1 > b_size(&trash))) {
 			/* too large a message to ever fit, let's skip it */
@@ -0,0 +1,153 @@
+/*
+ * Read-mostly string trees.
+ *
+ * These trees map strings to objects for lookups performed on the data path
+ * while the mapping may change at run time, for example from the CLI or the
+ * DNS resolution. Lookups are performed on an immutable ebtree snapshot which
+ * is read without any lock. Each change builds a new snapshot, publishes it,
+ * and retires the previous one which is released once all threads went
+ * through their polling loop (see thread_retire()). Changes are thus costly
+ * (O(N) per change) and only suited to small and rarely modified sets, such
+ * as the servers of a backend.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <haproxy/api.h>
+#include <haproxy/rmtree.h>
+#include <haproxy/thread.h>
+
+
+/* Associates key <key> with object <obj> in tree <t>, replacing any previous
+ * key of <obj>, or removes <obj> from the tree if <key> is NULL. The key is
+ * copied. An object may only appear once, but several objects may share the
+ * same key, in which case the first inserted one is returned by lookups.
+ * Returns non-zero on success, or zero on memory allocation failure, in which
+ * case the tree is left unchanged, except when removing an object, which
+ * always succeeds.
+ */
+int rmtree_set(struct rmtree *t, void *obj, const char *key)
+{
+	struct rmtree_snap *old, *new = NULL;
+	struct rmtree_node *node;
+	unsigned int i, n = 0;
+	size_t len = 0;
+	char *str;
+
+	HA_SPIN_LOCK(OTHER_LOCK, &t->lock);
+	old = t->snap;
+
+	if (old) {
+		for (i = 0; i < old->count; i++) {
+			if (old->nodes[i].obj == obj)
+				continue;
+			n++;
+			len += strlen(old->nodes[i].node.key) + 1;
+		}
+	}
+
+	if (key) {
+		n++;
+		len += strlen(key) + 1;
+	}
+
+	if (!n)
+		goto publish;
+
+	new = malloc(sizeof(*new) + n * sizeof(new->nodes[0]) + len);
+	if (!new) {
+		if (key)
+			goto fail;
+
+		/* We cannot leave a reference to a removed object, which is
+		 * likely about to be released. Remove it from the current
+		 * snapshot instead, while no other thread may be reading it.
+		 */
+		if (!thread_isolated())
+			thread_isolate();
+		else
+			n = ~0U;
+
+		for (i = 0; i < old->count; i++) {
+			if (old->nodes[i].obj == obj && old->nodes[i].node.node.leaf_p) {
+				ebpt_delete(&old->nodes[i].node);
+				old->nodes[i].node.node.leaf_p = NULL;
+			}
+		}
+
+		if (n != ~0U)
+			thread_release();
+		HA_SPIN_UNLOCK(OTHER_LOCK, &t->lock);
+		return 1;
+	}
+
+	new->root = EB_ROOT;
+	new->count = 0;
+	str = (char *)&new->nodes[n];
+
+	/* keep the insertion order so that the first of duplicate keys stays
+	 * the same.
+	 */
+	for (i = 0; old && i < old->count; i++) {
+		if (old->nodes[i].obj == obj)
+			continue;
+		if (!old->nodes[i].node.node.leaf_p)
+			continue; // removed in place
+		node = &new->nodes[new->count++];
+		len = strlen(old->nodes[i].node.key) + 1;
+		memcpy(str, old->nodes[i].node.key, len);
+		node->node.key = str;
+		node->obj = old->nodes[i].obj;
+		ebis_insert(&new->root, &node->node);
+		str += len;
+	}
+
+	if (key) {
+		node = &new->nodes[new->count++];
+		len = strlen(key) + 1;
+		memcpy(str, key, len);
+		node->node.key = str;
+		node->obj = obj;
+		ebis_insert(&new->root, &node->node);
+	}
+
+ publish:
+	HA_ATOMIC_STORE(&t->snap, new);
+	HA_SPIN_UNLOCK(OTHER_LOCK, &t->lock);
+
+	if (old) {
+		if (thread_isolated())
+			free(old);
+		else
+			thread_retire(old, free);
+	}
+	return 1;
+
+ fail:
+	HA_SPIN_UNLOCK(OTHER_LOCK, &t->lock);
+	return 0;
+}
+
+/* Releases all the memory used by tree <t> which must not be used anymore
+ * by any thread.
+ */
+void rmtree_destroy(struct rmtree *t)
+{
+	free(t->snap);
+	t->snap = NULL;
+	HA_SPIN_DESTROY(&t->lock);
+}
+
+/*
+ * Local variables:
+ *  c-indent-level: 8
+ *  c-basic-offset: 8
+ * End:
+ */
@@ -550,10 +550,10 @@ static int c_ip2str(struct sample *smp)
 {
 	struct buffer *trash = get_trash_chunk();
 
-	if (!inet_ntop(AF_INET, (void *)&smp->data.u.ipv4, trash->area, trash->size))
+	if (trash->size < INET_ADDRSTRLEN)
 		return 0;
 
-	trash->data = strlen(trash->area);
+	trash->data = ipv4_to_str(&smp->data.u.ipv4, trash->area) - trash->area;
 	smp->data.u.str = *trash;
 	smp->data.type = SMP_T_STR;
 	smp->flags &= ~SMP_F_CONST;
@@ -2060,14 +2060,17 @@ static int sample_conv_crypto_hmac(const struct arg *args, struct sample *smp, v
 static int sample_conv_bin2hex(const struct arg *arg_p, struct sample *smp, void *private)
 {
 	struct buffer *trash = get_trash_chunk();
-	unsigned char c;
-	int ptr = 0;
-
-	trash->data = 0;
-	while (ptr < smp->data.u.str.data && trash->data <= trash->size - 2) {
-		c = smp->data.u.str.area[ptr++];
-		trash->area[trash->data++] = hextab[(c >> 4) & 0xF];
-		trash->area[trash->data++] = hextab[c & 0xF];
+	const unsigned char *in = (const unsigned char *)smp->data.u.str.area;
+	char *out = trash->area;
+	size_t len;
+
+	len = MIN(smp->data.u.str.data, trash->size / 2);
+	trash->data = len * 2;
+	while (len--) {
+		out[0] = hextab[*in >> 4];
+		out[1] = hextab[*in & 0xF];
+		out += 2;
+		in++;
 	}
 	smp->data.u.str = *trash;
 	smp->data.type = SMP_T_STR;
@@ -2112,31 +2115,45 @@ static int sample_conv_length(const struct arg *arg_p, struct sample *smp, void
 }
 
 
-static int sample_conv_str2lower(const struct arg *arg_p, struct sample *smp, void *private)
+/* Changes the case of the letters between <from> and <from>+25 in string
+ * sample <smp> by adding <diff> to them. The string is modified in place when
+ * it is writable, otherwise it is converted while being duplicated the same
+ * way as smp_dup() does, in order to avoid a second pass.
+ */
+static inline void smp_change_case(struct sample *smp, char from, char diff)
 {
-	int i;
-
-	if (!smp_make_rw(smp))
-		return 0;
+	const char *src = smp->data.u.str.area;
+	struct buffer *trash;
+	char *dst;
+	int i, len;
 
-	for (i = 0; i < smp->data.u.str.data; i++) {
-		if ((smp->data.u.str.area[i] >= 'A') && (smp->data.u.str.area[i] <= 'Z'))
-			smp->data.u.str.area[i] += 'a' - 'A';
+	len = smp->data.u.str.data;
+	dst = smp->data.u.str.area;
+	if (!smp_is_rw(smp)) {
+		trash = get_trash_chunk();
+		if (len > trash->size - 1)
+			len = trash->size - 1;
+		dst = trash->area;
+		dst[len] = 0;
+		smp->data.u.str.area = trash->area;
+		smp->data.u.str.size = trash->size;
+		smp->data.u.str.data = len;
+		smp->flags &= ~SMP_F_CONST;
 	}
+
+	for (i = 0; i < len; i++)
+		dst[i] = src[i] + ((unsigned char)(src[i] - from) < 26 ? diff : 0);
+}
+
+static int sample_conv_str2lower(const struct arg *arg_p, struct sample *smp, void *private)
+{
+	smp_change_case(smp, 'A', 'a' - 'A');
 	return 1;
 }
 
 static int sample_conv_str2upper(const struct arg *arg_p, struct sample *smp, void *private)
 {
-	int i;
-
-	if (!smp_make_rw(smp))
-		return 0;
-
-	for (i = 0; i < smp->data.u.str.data; i++) {
-		if ((smp->data.u.str.area[i] >= 'a') && (smp->data.u.str.area[i] <= 'z'))
-			smp->data.u.str.area[i] += 'A' - 'a';
-	}
+	smp_change_case(smp, 'a', 'A' - 'a');
 	return 1;
 }
 
@@ -2372,6 +2389,16 @@ static int sample_conv_json(const struct arg *arg_p, struct sample *smp, void *p
 
 	input_type = arg_p->data.sint;
 
+	/* printable ASCII characters which need no escaping are valid in all
+	 * modes, so a string made only of them is returned as-is.
+	 */
+	for (p = smp->data.u.str.area; p < smp->data.u.str.area + smp->data.u.str.data; p++) {
+		if (*p < 0x20 || *p > 0x7e || *p == '"' || *p == '\\' || *p == '/')
+			break;
+	}
+	if (p == smp->data.u.str.area + smp->data.u.str.data)
+		return 1;
+
 	temp = get_trash_chunk();
 	temp->data = 0;
 
@@ -2762,8 +2789,12 @@ static int sample_conv_regsub(const struct arg *arg_p, struct sample *smp, void
 			found = regex_exec_match2(reg, start, end - start, MAX_MATCH, pmatch, flag);
 		}
 
-		if (!found)
+		if (!found) {
+			/* nothing to replace, the input is returned as-is */
+			if (!flag)
+				return 1;
 			pmatch[0].rm_so = end - start;
+		}
 
 		/* copy the heading non-matching part (which may also be the tail if nothing matches) */
 		max = trash->size - trash->data;
@@ -3162,6 +3193,20 @@ static int sample_conv_concat(const struct arg *arg_p, struct sample *smp, void
 	struct sample tmp;
 	int max;
 
+	/* Without a variable, the strings may be appended in place if there
+	 * is enough room. A variable would have to be duplicated into a trash
+	 * chunk, possibly the one the input lies in.
+	 */
+	if (arg_p[1].type != ARGT_VAR && smp_is_rw(smp) &&
+	    smp->data.u.str.size - 1 - smp->data.u.str.data >= arg_p[0].data.str.data + arg_p[2].data.str.data) {
+		if (arg_p[0].data.str.data)
+			chunk_memcat(&smp->data.u.str, arg_p[0].data.str.area, arg_p[0].data.str.data);
+		if (arg_p[2].data.str.data)
+			chunk_memcat(&smp->data.u.str, arg_p[2].data.str.area, arg_p[2].data.str.data);
+		smp->data.u.str.area[smp->data.u.str.data] = 0;
+		return 1;
+	}
+
 	trash = alloc_trash_chunk();
 	if (!trash)
 		return 0;
@@ -3720,18 +3765,222 @@ static int sample_check_json_query(struct arg *arg, struct sample_conv *conv,
 #define JSON_INT_MAX ((1LL << 53) - 1)
 #define JSON_INT_MIN (-JSON_INT_MAX)
 
+/* A JSON document indexed by json_idx_build(). Each value of the document is
+ * described by a node, in the order of appearance, so that the descendants of
+ * a container are the nodes following it up to its <end>. The offsets are
+ * relative to the copy of the document held in <doc>.
+ */
+struct json_idx_node {
+	int tok;                  /* MJSON_TOK_* */
+	int ofs, len;             /* location of the value */
+	int key_ofs, key_len;     /* location of the key, quotes excluded, or -1 */
+	int end;                  /* index of the first node after the descendants */
+};
+
+struct json_idx {
+	char *doc;                /* copy of the indexed document */
+	int len, size;            /* length of the document and size of <doc> */
+	struct json_idx_node *nodes;
+	int nb, alloc;            /* used and allocated nodes */
+	int stack[MJSON_MAX_DEPTH];
+	int depth;
+	int key_ofs, key_len;     /* last key met, or -1 */
+	uint64_t seen_hash;       /* hash of the last document seen once */
+	int seen_len;             /* length of this document, or -1 */
+};
+
+/* The last document seen by json_query on each thread is indexed when it is
+ * queried a second time, so that the following queries on the same request
+ * or response body do not have to parse it again.
+ */
+static THREAD_LOCAL struct json_idx json_idx = { .len = -1, .seen_len = -1 };
+
+/* mjson() callback building the nodes of the json_idx <ud> */
+static int json_idx_cb(int tok, const char *s, int off, int len, void *ud)
+{
+	struct json_idx *idx = ud;
+	struct json_idx_node *node;
+
+	if (tok == MJSON_TOK_KEY) {
+		idx->key_ofs = off + 1;
+		idx->key_len = len - 2;
+		return 0;
+	}
+
+	if (tok == '}' || tok == ']') {
+		node = &idx->nodes[idx->stack[--idx->depth]];
+		node->len = off + 1 - node->ofs;
+		node->end = idx->nb;
+		return 0;
+	}
+
+	if (tok != '{' && tok != '[' && !MJSON_TOK_IS_VALUE(tok))
+		return 0;
+
+	if (idx->nb == idx->alloc) {
+		int alloc = idx->alloc ? idx->alloc * 2 : 64;
+
+		node = realloc(idx->nodes, alloc * sizeof(*node));
+		if (!node)
+			return 1;
+		idx->nodes = node;
+		idx->alloc = alloc;
+	}
+
+	node = &idx->nodes[idx->nb++];
+	node->tok = tok;
+	node->ofs = off;
+	node->len = len;
+	node->key_ofs = idx->key_ofs;
+	node->key_len = idx->key_len;
+	node->end = idx->nb;
+	idx->key_ofs = idx->key_len = -1;
+
+	if (tok == '{' || tok == '[')
+		idx->stack[idx->depth++] = idx->nb - 1;
+	return 0;
+}
+
+/* Indexes the JSON document <s> of length <len> into the current thread's
+ * json_idx. Returns non-zero on success. On failure, the index is left empty
+ * and the queries must be performed on the document itself, which also keeps
+ * the mjson behaviour for partially invalid documents.
+ */
+static int json_idx_build(const char *s, int len)
+{
+	struct json_idx *idx = &json_idx;
+
+	idx->len = -1;
+	if (len > idx->size) {
+		char *doc = realloc(idx->doc, len);
+
+		if (!doc)
+			return 0;
+		idx->doc = doc;
+		idx->size = len;
+	}
+	memcpy(idx->doc, s, len);
+
+	idx->nb = idx->depth = 0;
+	idx->key_ofs = idx->key_len = -1;
+	if (mjson(idx->doc, len, json_idx_cb, idx) < 0 || idx->depth || !idx->nb)
+		return 0;
+
+	idx->len = len;
+	return 1;
+}
+
+/* Looks up path <jp> in the current thread's json_idx, following the same
+ * rules as mjson_find(): object keys are compared with the path's names after
+ * removal of their backslashes, and the first matching key is the only one
+ * considered. Returns the type of the value found and sets <tokptr> and
+ * <toklen> to its location, or returns MJSON_TOK_INVALID.
+ */
+static enum mjson_tok json_idx_find(const char *jp, const char **tokptr, int *toklen)
+{
+	const struct json_idx *idx = &json_idx;
+	const struct json_idx_node *node;
+	const char *key;
+	int cur = 0, child, pos, n, i;
+	char *end;
+
+	if (*jp++ != '$')
+		return MJSON_TOK_INVALID;
+
+	while (*jp) {
+		node = &idx->nodes[cur];
+		if (*jp == '.' && node->tok == '{') {
+			jp++;
+			for (child = cur + 1; child < node->end; child = idx->nodes[child].end) {
+				key = idx->doc + idx->nodes[child].key_ofs;
+				n = idx->nodes[child].key_len;
+				for (i = pos = 0; i < n && jp[pos] && jp[pos] != '.' && jp[pos] != '['; i++, pos++) {
+					if (jp[pos] == '\\')
+						pos++;
+					if (key[i] != jp[pos])
+						break;
+				}
+				if (i == n && (!jp[pos] || jp[pos] == '.' || jp[pos] == '['))
+					break;
+			}
+			if (child >= node->end)
+				return MJSON_TOK_INVALID;
+			jp += pos;
+		}
+		else if (*jp == '[' && node->tok == '[') {
+			/* like mjson, ignore what follows the index up to ']' */
+			n = strtol(jp + 1, &end, 10);
+			if (n < 0)
+				return MJSON_TOK_INVALID;
+			while (*end && *end++ != ']')
+				;
+			jp = end;
+			for (child = cur + 1; n && child < node->end; n--)
+				child = idx->nodes[child].end;
+			if (child >= node->end)
+				return MJSON_TOK_INVALID;
+		}
+		else
+			return MJSON_TOK_INVALID;
+		cur = child;
+	}
+
+	node = &idx->nodes[cur];
+	*tokptr = idx->doc + node->ofs;
+	*toklen = node->len;
+	return node->tok;
+}
+
+/* Looks up path <jp> in JSON document <s> of length <len> like mjson_find()
+ * does. The document is indexed when it is the same as the one of the previous
+ * call, and the index is used as long as the same document is queried.
+ */
+static enum mjson_tok json_find(const char *s, int len, const char *jp,
+                                const char **tokptr, int *toklen)
+{
+	struct json_idx *idx = &json_idx;
+	uint64_t hash;
+
+	if (len == idx->len && memcmp(s, idx->doc, len) == 0)
+		return json_idx_find(jp, tokptr, toklen);
+
+	hash = XXH3(s, len, 0);
+	if (len == idx->seen_len && hash == idx->seen_hash) {
+		idx->seen_len = -1;
+		if (json_idx_build(s, len))
+			return json_idx_find(jp, tokptr, toklen);
+	}
+	else {
+		idx->seen_len = len;
+		idx->seen_hash = hash;
+	}
+	return mjson_find(s, len, jp, tokptr, toklen);
+}
+
+static void json_idx_free(void)
+{
+	ha_free(&json_idx.doc);
+	ha_free(&json_idx.nodes);
+	json_idx.size = json_idx.alloc = 0;
+	json_idx.len = json_idx.seen_len = -1;
+}
+
+REGISTER_PER_THREAD_FREE(json_idx_free);
+
 /* This sample function get the value from a given json string.
- * The mjson library is used to parse the JSON struct
+ * The mjson library is used to parse the JSON struct. The value found is
+ * then decoded by querying its own token so that the document is only parsed
+ * once.
  */
 static int sample_conv_json_query(const struct arg *args, struct sample *smp, void *private)
 {
 	struct buffer *trash = get_trash_chunk();
-	const char *token; /* holds the temporary string from mjson_find */
+	const char *token; /* holds the temporary string from json_find */
 	int token_size;    /* holds the length of <token> */
 
 	enum mjson_tok token_type;
 
-	token_type = mjson_find(smp->data.u.str.area, smp->data.u.str.data, args[0].data.str.area, &token, &token_size);
+	token_type = json_find(smp->data.u.str.area, smp->data.u.str.data, args[0].data.str.area, &token, &token_size);
 
 	switch (token_type) {
 		case MJSON_TOK_NUMBER:
@@ -3747,7 +3996,7 @@ static int sample_conv_json_query(const struct arg *args, struct sample *smp, vo
 			} else {
 				double double_val;
 
-				if (mjson_get_number(smp->data.u.str.area, smp->data.u.str.data, args[0].data.str.area, &double_val) == 0)
+				if (mjson_get_number(token, token_size, "$", &double_val) == 0)
 					return 0;
 
 				trash->data = snprintf(trash->area,trash->size,"%g",double_val);
@@ -3769,7 +4018,7 @@ static int sample_conv_json_query(const struct arg *args, struct sample *smp, vo
 		case MJSON_TOK_STRING: {
 			int len;
 
-			len = mjson_get_string(smp->data.u.str.area, smp->data.u.str.data, args[0].data.str.area, trash->area, trash->size);
+			len = mjson_get_string(token, token_size, "$", trash->area, trash->size);
 
 			if (len == -1) {
 				/* invalid string */
@@ -15,6 +15,8 @@
 #include <netinet/tcp.h>
 #include <ctype.h>
 #include <errno.h>
+#include <netdb.h>
+#include <pthread.h>
 
 #include <import/xxhash.h>
 
@@ -24,6 +26,7 @@
 #include <haproxy/cfgparse.h>
 #include <haproxy/check.h>
 #include <haproxy/cli.h>
+#include <haproxy/compression.h>
 #include <haproxy/connection.h>
 #include <haproxy/dict-t.h>
 #include <haproxy/errors.h>
@@ -36,8 +39,10 @@
 #include <haproxy/proxy.h>
 #include <haproxy/queue.h>
 #include <haproxy/resolvers.h>
+#include <haproxy/rmtree.h>
 #include <haproxy/sample.h>
 #include <haproxy/server.h>
+#include <haproxy/sock.h>
 #include <haproxy/ssl_sock.h>
 #include <haproxy/stats.h>
 #include <haproxy/stream.h>
@@ -198,10 +203,10 @@ void srv_set_dyncookie(struct server *s)
 }
 
 /*
- * Must be called with the server lock held. The server is first removed from
- * the proxy tree if it was already attached. If <reattach> is true, the server
- * will then be attached in the proxy tree. The proxy lock is held to
- * manipulate the tree.
+ * Must be called with the server lock held. The server's address description
+ * is updated, and if <reattach> is true, the server is indexed under it in
+ * the proxy's address tree, otherwise it is only removed from this tree. The
+ * tree is read-mostly so readers are never blocked.
  */
 static void srv_set_addr_desc(struct server *s, int reattach)
 {
@@ -215,23 +220,12 @@ static void srv_set_addr_desc(struct server *s, int reattach)
 			free(key);
 			return;
 		}
-
-		HA_RWLOCK_WRLOCK(PROXY_LOCK, &p->lock);
-		ebpt_delete(&s->addr_node);
-		HA_RWLOCK_WRUNLOCK(PROXY_LOCK, &p->lock);
-
-		free(s->addr_node.key);
 	}
 
+	/* the tree keeps its own copy of the key */
+	rmtree_set(&p->used_server_addr, s, reattach ? key : NULL);
+	free(s->addr_node.key);
 	s->addr_node.key = key;
-
-	if (reattach) {
-		if (s->addr_node.key) {
-			HA_RWLOCK_WRLOCK(PROXY_LOCK, &p->lock);
-			ebis_insert(&p->used_server_addr, &s->addr_node);
-			HA_RWLOCK_WRUNLOCK(PROXY_LOCK, &p->lock);
-		}
-	}
 }
 
 /*
@@ -485,6 +479,35 @@ static int srv_parse_log_proto(char **args, int *cur_arg,
 	return 0;
 }
 
+/* Parse the "log-compression" server keyword. Only algorithms whose
+ * successive frames may be concatenated into a stream are accepted.
+ */
+static int srv_parse_log_compression(char **args, int *cur_arg,
+                                     struct proxy *curproxy, struct server *newsrv, char **err)
+{
+	const struct comp_algo *algo;
+
+	if (strcmp(args[*cur_arg + 1], "gzip") == 0 || strcmp(args[*cur_arg + 1], "zstd") == 0) {
+		for (algo = comp_algos; algo->cfg_name; algo++) {
+			if (strcmp(algo->cfg_name, args[*cur_arg + 1]) == 0) {
+				newsrv->log_comp = algo;
+				return 0;
+			}
+		}
+		memprintf(err, "'%s' : algorithm '%s' is not supported by this build",
+		          args[*cur_arg], args[*cur_arg + 1]);
+		return ERR_ALERT | ERR_FATAL;
+	}
+	else if (strcmp(args[*cur_arg + 1], "none") == 0) {
+		newsrv->log_comp = NULL;
+		return 0;
+	}
+
+	memprintf(err, "'%s' expects one of 'none', 'gzip' or 'zstd' but got '%s'",
+	          args[*cur_arg], args[*cur_arg + 1]);
+	return ERR_ALERT | ERR_FATAL;
+}
+
 /* Parse the "maxconn" server keyword */
 static int srv_parse_maxconn(char **args, int *cur_arg,
                              struct proxy *curproxy, struct server *newsrv, char **err)
@@ -588,6 +611,25 @@ static int srv_parse_pool_max_conn(char **args, int *cur_arg, struct proxy *curp
 	return 0;
 }
 
+static int srv_parse_pool_warm_conn(char **args, int *cur_arg, struct proxy *curproxy, struct server *newsrv, char **err)
+{
+	char *arg;
+
+	arg = args[*cur_arg + 1];
+	if (!*arg) {
+		memprintf(err, "'%s' expects <value> as argument.\n", args[*cur_arg]);
+		return ERR_ALERT | ERR_FATAL;
+	}
+
+	if (atoi(arg) < 0) {
+		memprintf(err, "'%s' must be >= 0", args[*cur_arg]);
+		return ERR_ALERT | ERR_FATAL;
+	}
+
+	newsrv->warm_conns = atoi(arg);
+	return 0;
+}
+
 /* parse the "id" server keyword */
 static int srv_parse_id(char **args, int *cur_arg, struct proxy *curproxy, struct server *newsrv, char **err)
 {
@@ -1647,6 +1689,7 @@ static struct srv_kw_list srv_kws = { "ALL", { }, {
 	{ "error-limit",         srv_parse_error_limit,         1,  1,  0 }, /* Configure the consecutive count of check failures to consider a server on error */
 	{ "id",                  srv_parse_id,                  1,  0,  1 }, /* set id# of server */
 	{ "init-addr",           srv_parse_init_addr,           1,  1,  0 }, /* */
+	{ "log-compression",     srv_parse_log_compression,     1,  1,  0 }, /* Set the compression of event messages, only relevant in a ring section */
 	{ "log-proto",           srv_parse_log_proto,           1,  1,  0 }, /* Set the protocol for event messages, only relevant in a ring section */
 	{ "maxconn",             srv_parse_maxconn,             1,  1,  1 }, /* Set the max number of concurrent connection */
 	{ "maxqueue",            srv_parse_maxqueue,            1,  1,  1 }, /* Set the max number of connection to put in queue */
@@ -1665,6 +1708,7 @@ static struct srv_kw_list srv_kws = { "ALL", { }, {
 	{ "pool-low-conn",       srv_parse_pool_low_conn,       1,  1,  1 }, /* Set the min number of orphan idle connecbefore being allowed to pick from other threads */
 	{ "pool-max-conn",       srv_parse_pool_max_conn,       1,  1,  1 }, /* Set the max number of orphan idle connections, -1 means unlimited */
 	{ "pool-purge-delay",    srv_parse_pool_purge_delay,    1,  1,  1 }, /* Set the time before we destroy orphan idle connections, defaults to 1s */
+	{ "pool-warm-conn",      srv_parse_pool_warm_conn,      1,  1,  0 }, /* Set the number of idle connections to open ahead of time */
 	{ "proto",               srv_parse_proto,               1,  1,  1 }, /* Set the proto to use for all outgoing connections */
 	{ "proxy-v2-options",    srv_parse_proxy_v2_options,    1,  1,  1 }, /* options for send-proxy-v2 */
 	{ "redir",               srv_parse_redir,               1,  1,  0 }, /* Enable redirection mode */
@@ -2096,10 +2140,14 @@ static void srv_settings_cpy(struct server *srv, struct server *src, int srv_tmp
 	srv->onmarkedup               = src->onmarkedup;
 	if (src->trackit != NULL)
 		srv->trackit = strdup(src->trackit);
+	if (src->check_share != NULL)
+		srv->check_share = strdup(src->check_share);
+	srv->check_share_owners       = src->check_share_owners;
 	srv->consecutive_errors_limit = src->consecutive_errors_limit;
 	srv->uweight = srv->iweight   = src->iweight;
 
 	srv->check.send_proxy         = src->check.send_proxy;
+	srv->check.keep_alive         = src->check.keep_alive;
 	/* health: up, but will fall down at first failure */
 	srv->check.rise = srv->check.health = src->check.rise;
 	srv->check.fall               = src->check.fall;
@@ -2140,6 +2188,7 @@ static void srv_settings_cpy(struct server *srv, struct server *src, int srv_tmp
 	srv->pool_purge_delay = src->pool_purge_delay;
 	srv->low_idle_conns = src->low_idle_conns;
 	srv->max_idle_conns = src->max_idle_conns;
+	srv->warm_conns = src->warm_conns;
 	srv->max_reuse = src->max_reuse;
 
 	if (srv_tmpl)
@@ -2162,7 +2211,7 @@ struct server *new_server(struct proxy *proxy)
 
 	srv->obj_type = OBJ_TYPE_SERVER;
 	srv->proxy = proxy;
-	srv->pendconns = EB_ROOT;
+	queue_init(srv->queues);
 	LIST_APPEND(&servers_list, &srv->global_list);
 	LIST_INIT(&srv->srv_rec_item);
 	LIST_INIT(&srv->ip_rec_item);
@@ -2201,8 +2250,11 @@ struct server *new_server(struct proxy *proxy)
 void free_server(struct server *srv)
 {
 	task_destroy(srv->warmup);
+	task_destroy(srv->warm_conn_task);
+	srv->warm_conn_task = NULL;
 
 	free(srv->id);
+	free(srv->promex_labels);
 	free(srv->cookie);
 	free(srv->hostname);
 	free(srv->hostname_dn);
@@ -2210,6 +2262,7 @@ void free_server(struct server *srv)
 	free(srv->per_thr);
 	free(srv->curr_idle_thr);
 	free(srv->resolvers_id);
+	free(srv->check_share);
 	free(srv->addr_node.key);
 	free(srv->lb_nodes);
 
@@ -2222,6 +2275,8 @@ void free_server(struct server *srv)
 	LIST_DELETE(&srv->global_list);
 
 	EXTRA_COUNTERS_FREE(srv->extra_counters);
+	free(srv->counters.shards);
+	free(srv->counters.hist);
 
 	free(srv);
 	srv = NULL;
@@ -2790,6 +2845,14 @@ struct server *server_find_by_name(struct proxy *bk, const char *name)
 		if (curserver)
 			return curserver;
 	}
+	else if (!eb_is_empty(&bk->conf.used_server_name)) {
+		struct ebpt_node *node;
+
+		/* the servers are indexed by name once the configuration is checked */
+		node = ebis_lookup(&bk->conf.used_server_name, name);
+		if (node)
+			return container_of(node, struct server, conf.name);
+	}
 	else {
 		curserver = bk->srv;
 
@@ -3599,14 +3662,250 @@ struct server *snr_check_ip_callback(struct server *srv, void *ip, unsigned char
 	return NULL;
 }
 
+/* An address resolved at boot by the libc for all servers sharing the same host
+ * name and address family, before their initial address is applied.
+ */
+struct srv_addr_pref {
+	struct ebpt_node node;            /* indexed on "<family>:<hostname>" */
+	const char *name;                 /* host name, points into the key */
+	int status;                       /* 0 = unknown, >0 = resolved, <0 = failed */
+	struct sockaddr_storage addr;     /* resolved address if status > 0 */
+};
+
+static struct eb_root srv_addr_prefs = EB_ROOT_UNIQUE;
+static struct srv_addr_pref **srv_addr_jobs;
+static unsigned int srv_addr_jobs_cnt;
+static unsigned int srv_addr_jobs_next;
+
+/* Returns the pre-resolved address entry for host name <name> and family
+ * <family>, or NULL if none exists.
+ */
+static struct srv_addr_pref *srv_addr_pref_lookup(const char *name, int family)
+{
+	struct ebpt_node *node;
+
+	if (eb_is_empty(&srv_addr_prefs))
+		return NULL;
+
+	chunk_printf(&trash, "%d:%s", family, name);
+	node = ebis_lookup(&srv_addr_prefs, trash.area);
+	return node ? container_of(node, struct srv_addr_pref, node) : NULL;
+}
+
+/* Resolves the host name of <pref> exactly like str2ip2() would, but using only
+ * thread-safe functions. The status is left to zero if this is not possible,
+ * so that str2ip2() is used later.
+ */
+static void srv_addr_pref_resolve(struct srv_addr_pref *pref)
+{
+	struct sockaddr_storage *sa = &pref->addr;
+	int family = sa->ss_family;
+
+#ifdef USE_GETADDRINFO
+	if (global.tune.options & GTUNE_USE_GAI) {
+		struct addrinfo hints, *result = NULL;
+
+		memset(&hints, 0, sizeof(hints));
+		hints.ai_family = family ? family : AF_UNSPEC;
+		hints.ai_socktype = SOCK_DGRAM;
+
+		if (getaddrinfo(pref->name, NULL, &hints, &result) == 0 &&
+		    (!family || family == result->ai_family) &&
+		    (result->ai_family == AF_INET || result->ai_family == AF_INET6)) {
+			memcpy(sa, result->ai_addr, result->ai_addrlen);
+			pref->status = 1;
+		}
+
+		if (result)
+			freeaddrinfo(result);
+
+		if (pref->status)
+			return;
+	}
+#endif
+
+#ifdef HA_HAVE_GETHOSTBYNAME_R
+	{
+		struct hostent he_buf, *he = NULL;
+		size_t len = 1024;
+		char *buf = NULL, *tmp;
+		int herr;
+
+		do {
+			tmp = realloc(buf, len);
+			if (!tmp)
+				break;
+			buf = tmp;
+			if (gethostbyname_r(pref->name, &he_buf, buf, len, &he, &herr) != ERANGE)
+				break;
+			len *= 2;
+		} while (len <= 65536);
+
+		if (!tmp || len > 65536) {
+			/* let str2ip2() deal with this one */
+		}
+		else if (!he || (family && family != he->h_addrtype))
+			pref->status = -1;
+		else if (he->h_addrtype == AF_INET) {
+			sa->ss_family = AF_INET;
+			((struct sockaddr_in *)sa)->sin_addr = *(struct in_addr *)*(he->h_addr_list);
+			pref->status = 1;
+		}
+		else if (he->h_addrtype == AF_INET6) {
+			sa->ss_family = AF_INET6;
+			((struct sockaddr_in6 *)sa)->sin6_addr = *(struct in6_addr *)*(he->h_addr_list);
+			pref->status = 1;
+		}
+		else
+			pref->status = -1;
+		free(buf);
+	}
+#endif
+}
+
+/* Resolves the pending host names until none is left. It may be called from
+ * several threads at once.
+ */
+static void *srv_addr_pref_worker(void *arg)
+{
+	unsigned int job;
+
+	while ((job = HA_ATOMIC_FETCH_ADD(&srv_addr_jobs_next, 1)) < srv_addr_jobs_cnt)
+		srv_addr_pref_resolve(srv_addr_jobs[job]);
+	return NULL;
+}
+
+/* Returns non-zero if the initial address of server <srv> may have to be
+ * resolved using the libc, and not likely from the state file.
+ */
+static int srv_may_resolve_via_libc(const struct server *srv)
+{
+	unsigned int methods = srv->init_addr_methods;
+	enum srv_initaddr method;
+	int first = 1;
+
+	if (!srv->hostname)
+		return 0;
+
+	if (!methods)
+		return !srv->lastaddr; // "last,libc"
+
+	while (methods) {
+		method = srv_get_next_initaddr(&methods);
+		if (method == SRV_IADDR_LIBC)
+			return 1;
+		if (first && method == SRV_IADDR_LAST && srv->lastaddr)
+			return 0;
+		first = 0;
+	}
+	return 0;
+}
+
+/* Resolves at once the host names of all servers which may need the libc to
+ * find their initial address. Identical names are resolved only once, and
+ * up to INIT_ADDR_WORKERS threads perform the lookups in parallel. The results
+ * are then used by srv_set_addr_via_libc(). Errors are silently ignored, they
+ * only cause the names to be resolved later by str2ip2().
+ */
+static void srv_prefetch_addrs(void)
+{
+	struct sockaddr_storage sa;
+	struct srv_addr_pref *pref, **jobs;
+	struct proxy *px;
+	struct server *srv;
+	unsigned int alloc = 0;
+	char *key;
+#ifdef USE_THREAD
+	pthread_t workers[INIT_ADDR_WORKERS];
+	int nbw = 0;
+#endif
+
+	for (px = proxies_list; px; px = px->next) {
+		if (!(px->cap & PR_CAP_BE) || px->disabled)
+			continue;
+
+		for (srv = px->srv; srv; srv = srv->next) {
+			if (!srv_may_resolve_via_libc(srv) || srv_addr_pref_lookup(srv->hostname, srv->addr.ss_family))
+				continue;
+
+			/* IP addresses and invalid names are quickly processed */
+			memset(&sa, 0, sizeof(sa));
+			if (str2ip2(srv->hostname, &sa, 0) || !resolv_hostname_validation(srv->hostname, NULL))
+				continue;
+
+			if (srv_addr_jobs_cnt == alloc) {
+				alloc = alloc ? 2 * alloc : 64;
+				jobs = realloc(srv_addr_jobs, alloc * sizeof(*jobs));
+				if (!jobs)
+					goto resolve;
+				srv_addr_jobs = jobs;
+			}
+
+			pref = calloc(1, sizeof(*pref));
+			key = NULL;
+			memprintf(&key, "%d:%s", srv->addr.ss_family, srv->hostname);
+			if (!pref || !key) {
+				free(pref);
+				free(key);
+				goto resolve;
+			}
+
+			pref->node.key = key;
+			pref->name = strchr(key, ':') + 1;
+			pref->addr.ss_family = srv->addr.ss_family;
+			ebis_insert(&srv_addr_prefs, &pref->node);
+			srv_addr_jobs[srv_addr_jobs_cnt++] = pref;
+		}
+	}
+
+ resolve:
+#ifdef USE_THREAD
+	while (nbw < INIT_ADDR_WORKERS && nbw + 1 < srv_addr_jobs_cnt &&
+	       pthread_create(&workers[nbw], NULL, srv_addr_pref_worker, NULL) == 0)
+		nbw++;
+#endif
+	/* the current thread takes its share of the work */
+	srv_addr_pref_worker(NULL);
+#ifdef USE_THREAD
+	while (nbw)
+		pthread_join(workers[--nbw], NULL);
+#endif
+}
+
+/* Releases the addresses resolved by srv_prefetch_addrs(). */
+static void srv_release_prefetched_addrs(void)
+{
+	struct ebpt_node *node, *next;
+
+	for (node = ebpt_first(&srv_addr_prefs); node; node = next) {
+		next = ebpt_next(node);
+		ebpt_delete(node);
+		free(node->key);
+		free(container_of(node, struct srv_addr_pref, node));
+	}
+	ha_free(&srv_addr_jobs);
+	srv_addr_jobs_cnt = srv_addr_jobs_next = 0;
+}
+
 /* Sets the server's address (srv->addr) from srv->hostname using the libc's
- * resolver. This is suited for initial address configuration. Returns 0 on
- * success otherwise a non-zero error code. In case of error, *err_code, if
- * not NULL, is filled up.
+ * resolver, or using the address resolved at once for all servers if any.
+ * This is suited for initial address configuration. Returns 0 on success
+ * otherwise a non-zero error code. In case of error, *err_code, if not NULL,
+ * is filled up.
  */
 int srv_set_addr_via_libc(struct server *srv, int *err_code)
 {
-	if (str2ip2(srv->hostname, &srv->addr, 1) == NULL) {
+	struct srv_addr_pref *pref = srv_addr_pref_lookup(srv->hostname, srv->addr.ss_family);
+	int port;
+
+	if (pref && pref->status > 0) {
+		port = get_host_port(&srv->addr);
+		srv->addr = pref->addr;
+		set_host_port(&srv->addr, port);
+		return 0;
+	}
+
+	if ((pref && pref->status < 0) || str2ip2(srv->hostname, &srv->addr, 1) == NULL) {
 		if (err_code)
 			*err_code |= ERR_WARN;
 		return 1;
@@ -3790,6 +4089,8 @@ int srv_init_addr(void)
 	struct proxy *curproxy;
 	int return_code = 0;
 
+	srv_prefetch_addrs();
+
 	curproxy = proxies_list;
 	while (curproxy) {
 		struct server *srv;
@@ -3809,6 +4110,7 @@ int srv_init_addr(void)
 		curproxy = curproxy->next;
 	}
 
+	srv_release_prefetched_addrs();
 	return return_code;
 }
 
@@ -4079,6 +4381,104 @@ static int cli_parse_set_server(char **args, char *payload, struct appctx *appct
 	return 1;
 }
 
+/* Parses "set servers <backend>" followed by a payload of one update per line,
+ * each made of a server name followed by "state <ready|drain|maint>", "weight
+ * <weight>" or "addr <addr> [port <port>]". All the updates are applied while
+ * the other threads are isolated, so that no request sees a partially applied
+ * batch and the servers' locks are never waited for. The messages and errors
+ * are reported per server at the end.
+ */
+static int cli_parse_set_servers(char **args, char *payload, struct appctx *appctx, void *private)
+{
+	struct proxy *px;
+	struct server *sv;
+	char *line, *end, *msg = NULL;
+	char *words[6];
+	const char *res;
+	int linenum, nbw, errors = 0;
+
+	if (!cli_has_level(appctx, ACCESS_LVL_ADMIN))
+		return 1;
+
+	if (!*args[2] || !payload)
+		return cli_err(appctx, "'set servers' expects a backend and a payload of '<server> <state|weight|addr> <value>' lines.\n");
+
+	px = proxy_be_by_name(args[2]);
+	if (!px)
+		return cli_err(appctx, "No such backend.\n");
+
+	if (px->disabled)
+		return cli_err(appctx, "Proxy is disabled.\n");
+
+	thread_isolate();
+
+	for (linenum = 1, line = payload; *line; line = end, linenum++) {
+		end = line + strcspn(line, "\n");
+		if (*end)
+			*end++ = 0;
+
+		/* split the line into words */
+		for (nbw = 0; nbw < sizeof(words) / sizeof(*words); nbw++) {
+			line += strspn(line, " \t");
+			words[nbw] = line;
+			line += strcspn(line, " \t");
+			if (*line)
+				*line++ = 0;
+		}
+
+		if (!*words[0])
+			continue;
+
+		sv = server_find_by_name(px, words[0]);
+		if (!sv) {
+			memprintf(&msg, "%sline %d: no such server '%s'.\n", msg ? msg : "", linenum, words[0]);
+			errors++;
+			continue;
+		}
+
+		HA_SPIN_LOCK(SERVER_LOCK, &sv->lock);
+		res = NULL;
+		if (strcmp(words[1], "weight") == 0)
+			res = server_parse_weight_change_request(sv, words[2]);
+		else if (strcmp(words[1], "state") == 0) {
+			if (strcmp(words[2], "ready") == 0)
+				srv_adm_set_ready(sv);
+			else if (strcmp(words[2], "drain") == 0)
+				srv_adm_set_drain(sv);
+			else if (strcmp(words[2], "maint") == 0)
+				srv_adm_set_maint(sv);
+			else
+				res = "'state' expects 'ready', 'drain' and 'maint'.\n";
+		}
+		else if (strcmp(words[1], "addr") == 0) {
+			if (!*words[2])
+				res = "'addr' requires an address and optionally a port.\n";
+			else {
+				res = srv_update_addr_port(sv, words[2], strcmp(words[3], "port") == 0 ? words[4] : NULL,
+				                           "stats socket command");
+				srv_clr_admin_flag(sv, SRV_ADMF_RMAINT);
+			}
+		}
+		else
+			res = "expects 'state', 'weight' or 'addr'.\n";
+		HA_SPIN_UNLOCK(SERVER_LOCK, &sv->lock);
+
+		if (res && *res) {
+			memprintf(&msg, "%sline %d: %s: %s", msg ? msg : "", linenum, sv->id, res);
+			if (strcmp(words[1], "addr") != 0)
+				errors++;
+		}
+	}
+
+	thread_release();
+
+	if (errors)
+		return cli_dynerr(appctx, msg);
+	if (msg)
+		return cli_dynmsg(appctx, LOG_INFO, msg);
+	return 1;
+}
+
 static int cli_parse_get_weight(char **args, char *payload, struct appctx *appctx, void *private)
 {
 	struct stream_interface *si = appctx->owner;
@@ -4311,6 +4711,7 @@ static int srv_alloc_lb(struct server *sv, struct proxy *be)
 	sv->lb_nodes_now = 0;
 
 	if (((be->lbprm.algo & (BE_LB_KIND | BE_LB_PARM)) == (BE_LB_KIND_RR | BE_LB_RR_RANDOM)) ||
+	    ((be->lbprm.algo & (BE_LB_KIND | BE_LB_PARM)) == (BE_LB_KIND_RR | BE_LB_RR_EWMA)) ||
 	    ((be->lbprm.algo & (BE_LB_KIND | BE_LB_HASH_TYPE)) == (BE_LB_KIND_HI | BE_LB_HASH_CONS))) {
 		sv->lb_nodes = calloc(sv->lb_nodes_tot, sizeof(*sv->lb_nodes));
 
@@ -4438,6 +4839,12 @@ static int cli_parse_add_server(char **args, char *payload, struct appctx *appct
 		goto out;
 	}
 
+	if (!stats_allocate_counters_shards(&srv->counters.shards) ||
+	    !stats_allocate_time_hist(&srv->counters.hist)) {
+		ha_alert("failed to allocate per-thread counters for server.\n");
+		goto out;
+	}
+
 	/* Attach the server to the end of the proxy linked list. Note that this
 	 * operation is not thread-safe so this is executed under thread
 	 * isolation.
@@ -4478,13 +4885,14 @@ static int cli_parse_add_server(char **args, char *payload, struct appctx *appct
 		}
 
 		srv->conf.id.key = srv->puid = next_id;
-		srv->conf.name.key = srv->id;
 	}
+	srv->conf.name.key = srv->id;
 
 	/* insert the server in the backend trees */
 	eb32_insert(&be->conf.used_server_id, &srv->conf.id);
 	ebis_insert(&be->conf.used_server_name, &srv->conf.name);
-	ebis_insert(&be->used_server_addr, &srv->addr_node);
+	if (srv->addr_node.key)
+		rmtree_set(&be->used_server_addr, srv, srv->addr_node.key);
 
 	thread_release();
 
@@ -4577,7 +4985,7 @@ static int cli_parse_delete_server(char **args, char *payload, struct appctx *ap
 	 * cleanup function should be implemented to be used here.
 	 */
 	if (srv->cur_sess || srv->curr_idle_conns ||
-	    !eb_is_empty(&srv->pendconns)) {
+	    !queue_is_empty(srv->queues)) {
 		cli_err(appctx, "Server still has connections attached to it, cannot remove it.");
 		goto out;
 	}
@@ -4608,10 +5016,10 @@ static int cli_parse_delete_server(char **args, char *payload, struct appctx *ap
 		next->next = srv->next;
 	}
 
-	/* remove srv from addr_node tree */
+	/* remove srv from the backend trees */
 	eb32_delete(&srv->conf.id);
 	ebpt_delete(&srv->conf.name);
-	ebpt_delete(&srv->addr_node);
+	rmtree_set(&be->used_server_addr, srv, NULL);
 
 	/* remove srv from idle_node tree for idle conn cleanup */
 	eb32_delete(&srv->idle_node);
@@ -4641,6 +5049,7 @@ static struct cli_kw_list cli_kws = {{ },{
 	{ { "enable", "server",  NULL },         "enable server  (DEPRECATED)             : enable a disabled server (use 'set server' instead)",         cli_parse_enable_server, NULL },
 	{ { "set", "maxconn", "server",  NULL }, "set maxconn server <bk>/<srv>           : change a server's maxconn setting",                           cli_parse_set_maxconn_server, NULL },
 	{ { "set", "server", NULL },             "set server <bk>/<srv> [opts]            : change a server's state, weight, address or ssl",             cli_parse_set_server },
+	{ { "set", "servers", NULL },            "set servers <bk> <<                     : change many servers' state, weight or address at once",       cli_parse_set_servers },
 	{ { "get", "weight", NULL },             "get weight <bk>/<srv>                   : report a server's current weight",                            cli_parse_get_weight },
 	{ { "set", "weight", NULL },             "set weight <bk>/<srv>  (DEPRECATED)     : change a server's weight (use 'set server' instead)",         cli_parse_set_weight },
 	{ { "add", "server", NULL },             "add server <bk>/<srv>                   : create a new server (EXPERIMENTAL)",                          cli_parse_add_server, NULL, NULL, NULL, ACCESS_EXPERIMENTAL },
@@ -5301,6 +5710,10 @@ struct task *srv_cleanup_idle_conns(struct task *task, void *context, unsigned i
 		if (curr_idle == 0)
 			goto remove;
 		exceed_conns = srv->curr_used_conns + curr_idle - MAX(srv->max_used_conns, srv->est_need_conns);
+
+		/* never go below the number of warm connections to keep */
+		if (exceed_conns > (int)srv->curr_used_conns + curr_idle - (int)srv->warm_conns)
+			exceed_conns = (int)srv->curr_used_conns + curr_idle - (int)srv->warm_conns;
 		exceed_conns = to_kill = exceed_conns / 2 + (exceed_conns & 1);
 
 		srv->est_need_conns = (srv->est_need_conns + srv->max_used_conns) / 2;
@@ -5354,6 +5767,324 @@ struct task *srv_cleanup_idle_conns(struct task *task, void *context, unsigned i
 	return task;
 }
 
+/* Returns NULL if connections to server <srv> may be opened or kept without
+ * any stream attached to them, i.e. if they do not depend on anything but the
+ * server and are handled by a mux supporting it, otherwise the reason why they
+ * cannot. This is required for warm and inherited idle connections.
+ */
+const char *srv_warm_conn_unsupported(const struct server *srv)
+{
+	const struct mux_proto_list *mux_ent = srv->mux_proto;
+
+	/* without any "proto", HTTP servers get the default HTTP mux, which
+	 * is the one installed on warm connections.
+	 */
+	if (!mux_ent && srv->proxy->mode == PR_MODE_HTTP)
+		mux_ent = conn_get_best_mux_entry(IST_NULL, PROTO_SIDE_BE, PROTO_MODE_HTTP);
+
+	if (!mux_ent || !(mux_ent->mux->flags & MX_FL_WARM_CONN))
+		return "its protocol does not support it";
+	if (!srv->max_idle_conns || !srv->pool_purge_delay ||
+	    (srv->proxy->options & PR_O_REUSE_MASK) == PR_O_REUSE_NEVR)
+		return "idle connections are disabled";
+	if (!is_addr(&srv->addr) || (srv->flags & SRV_F_MAPPORTS))
+		return "its destination address depends on the client";
+	if (srv->pp_opts || (srv->flags & SRV_F_SOCKS4_PROXY))
+		return "it uses the PROXY protocol or a SOCKS4 proxy";
+	if ((srv->conn_src.opts | srv->proxy->conn_src.opts) & CO_SRC_TPROXY_MASK)
+		return "it uses a transparent source address";
+#ifdef USE_OPENSSL
+	if (srv->ssl_ctx.sni)
+		return "its SNI depends on the request";
+	if (!srv->mux_proto && (srv->ssl_ctx.alpn_str || srv->ssl_ctx.npn_str))
+		return "its protocol is negotiated by ALPN or NPN, please set 'proto'";
+#endif
+	return NULL;
+}
+
+/* Opens a warm connection to server <srv>, without any stream attached to it.
+ * The server's mux is installed right away and is responsible for moving the
+ * connection to the idle list once it is established. Only servers whose
+ * connections are solely identified by the server itself are supported (see
+ * connect_server()), so the hash only covers the target. Returns 0 on success
+ * or non-zero on failure.
+ */
+static int srv_open_warm_conn(struct server *srv)
+{
+	struct conn_hash_params hash_params;
+	struct connection *conn;
+
+	conn = conn_new(&srv->obj_type);
+	if (!conn)
+		return 1;
+
+	if (!sockaddr_alloc(&conn->dst, &srv->addr, sizeof(srv->addr)))
+		goto fail;
+	set_host_port(conn->dst, srv->svc_port);
+
+	if (conn_prepare(conn, protocol_by_family(conn->dst->ss_family), srv->xprt) < 0)
+		goto fail;
+
+	memset(&hash_params, 0, sizeof(hash_params));
+	hash_params.target = &srv->obj_type;
+	conn->hash_node->hash = conn_calculate_hash(&hash_params);
+
+	if (!conn->ctrl->connect || conn->ctrl->connect(conn, 0) != SF_ERR_NONE)
+		goto fail;
+
+	if (conn_xprt_start(conn) < 0 || conn_install_mux_be(conn, NULL, NULL) < 0)
+		goto fail;
+
+	_HA_ATOMIC_INC(&srv->counters.connect);
+	return 0;
+
+  fail:
+	conn_full_close(conn);
+	conn_free(conn);
+	return 1;
+}
+
+/* idle connections inherited from the old process, waiting for the threads */
+struct srv_inherited_conn {
+	struct server *srv;
+	int fd;
+};
+
+static struct srv_inherited_conn *srv_inherited_conns = NULL;
+static int srv_nb_inherited_conns = 0;
+
+/* Returns non-zero if the idle connection <conn> may be handed over to another
+ * process, which is only possible for clear H1 connections over a stream
+ * socket, solely identified by their server and which are still clean.
+ */
+static int srv_conn_may_be_exported(const struct connection *conn)
+{
+	if ((conn->flags & (CO_FL_ERROR|CO_FL_SOCK_RD_SH|CO_FL_SOCK_WR_SH|CO_FL_WAIT_XPRT|CO_FL_PRIVATE)) ||
+	    !conn->ctrl || conn->ctrl->sock_type != SOCK_STREAM || !conn_ctrl_ready(conn))
+		return 0;
+
+	return conn->xprt == xprt_get(XPRT_RAW) && conn->mux && strcmp(conn->mux->name, "H1") == 0;
+}
+
+/* Detaches up to <max> idle connections from server <srv> to hand them over to
+ * a new process. A duplicate of each connection's FD is stored into <fds> and
+ * the connections are scheduled for release in their thread, without lingering
+ * so that the duplicated socket is left intact. Only connections solely
+ * identified by the server (see srv_open_warm_conn()) are considered. Returns
+ * the number of FDs stored into <fds>, which the caller must close once sent.
+ */
+int srv_export_idle_conns(struct server *srv, int *fds, int max)
+{
+	struct conn_hash_params hash_params;
+	struct connection *conn, *next;
+	int64_t hash;
+	int nb = 0;
+	int i;
+
+	if (!srv->per_thr)
+		return 0;
+
+	memset(&hash_params, 0, sizeof(hash_params));
+	hash_params.target = &srv->obj_type;
+	hash = conn_calculate_hash(&hash_params);
+
+	for (i = 0; i < global.nbthread && nb < max; i++) {
+		struct eb_root *trees[] = {
+			&srv->per_thr[i].safe_conns,
+			&srv->per_thr[i].idle_conns,
+			NULL
+		};
+		struct eb_root **tree;
+		int did_remove = 0;
+
+		HA_SPIN_LOCK(IDLE_CONNS_LOCK, &idle_conns[i].idle_conns_lock);
+		for (tree = trees; *tree && nb < max; tree++) {
+			for (conn = srv_lookup_conn(*tree, hash); conn && nb < max; conn = next) {
+				int fd;
+
+				next = srv_lookup_conn_next(conn);
+				if (!srv_conn_may_be_exported(conn))
+					continue;
+
+				fd = dup(conn->handle.fd);
+				if (fd < 0)
+					break;
+
+				/* the other process holds the socket now */
+				HA_ATOMIC_AND(&fdtab[conn->handle.fd].state, ~FD_LINGER_RISK);
+				fds[nb++] = fd;
+
+				eb_delete(&conn->hash_node->node.node);
+				MT_LIST_APPEND(&idle_conns[i].toremove_conns, &conn->toremove_list);
+				did_remove = 1;
+			}
+		}
+		HA_SPIN_UNLOCK(IDLE_CONNS_LOCK, &idle_conns[i].idle_conns_lock);
+
+		if (did_remove)
+			task_wakeup(idle_conns[i].cleanup_task, TASK_WOKEN_OTHER);
+	}
+	return nb;
+}
+
+/* Queues FD <fd>, received from the old process for server <sname> of backend
+ * <pname>, so that it is adopted as an idle connection once the threads are
+ * started. The connection is refused if the server does not exist anymore, if
+ * its connections cannot be kept without a stream or if the socket is not
+ * connected to the server's address. Returns 0 on success or -1 if the caller
+ * must close the FD.
+ */
+int srv_inherit_idle_conn(const char *pname, const char *sname, int fd)
+{
+	struct sockaddr_storage addr;
+	struct srv_inherited_conn *new;
+	struct server *srv;
+	struct proxy *px;
+
+	px = proxy_be_by_name(pname);
+	srv = px ? findserver(px, sname) : NULL;
+	if (!srv || srv_warm_conn_unsupported(srv) || srv->xprt != xprt_get(XPRT_RAW) ||
+	    fd >= global.maxsock)
+		return -1;
+
+	if (sock_get_dst(fd, (struct sockaddr *)&addr, sizeof(addr), 1) == -1 ||
+	    ipcmp(&addr, &srv->addr) != 0 || get_host_port(&addr) != srv->svc_port)
+		return -1;
+
+	new = realloc(srv_inherited_conns, (srv_nb_inherited_conns + 1) * sizeof(*new));
+	if (!new)
+		return -1;
+
+	srv_inherited_conns = new;
+	srv_inherited_conns[srv_nb_inherited_conns].srv = srv;
+	srv_inherited_conns[srv_nb_inherited_conns].fd = fd;
+	srv_nb_inherited_conns++;
+
+	/* the old process needed them, so they must survive the first purges */
+	srv->est_need_conns++;
+	return 0;
+}
+
+/* Loads the TLS session <der> of <len> bytes received from the old process for
+ * server <sname> of backend <pname> so that the first connections to this
+ * server may be resumed. Returns 0 on success or -1 if it was ignored.
+ */
+int srv_inherit_ssl_session(const char *pname, const char *sname, const unsigned char *der, int len)
+{
+#ifdef USE_OPENSSL
+	struct server *srv;
+	struct proxy *px;
+
+	px = proxy_be_by_name(pname);
+	srv = px ? findserver(px, sname) : NULL;
+	if (srv && srv->use_ssl == 1)
+		return ssl_sock_srv_load_session(srv, der, len);
+#endif
+	return -1;
+}
+
+/* Adopts the idle connection to server <srv> inherited from the old process on
+ * FD <fd>. It is set up like a warm connection which is already established,
+ * so that the mux moves it to the server's idle list once woken up. Returns 0
+ * on success or non-zero on failure, in which case the FD is closed.
+ */
+static int srv_adopt_inherited_conn(struct server *srv, int fd)
+{
+	struct conn_hash_params hash_params;
+	struct sockaddr_storage addr;
+	struct connection *conn;
+
+	conn = conn_new(&srv->obj_type);
+	if (!conn)
+		goto fail_fd;
+
+	if (sock_get_dst(fd, (struct sockaddr *)&addr, sizeof(addr), 1) == -1 ||
+	    !sockaddr_alloc(&conn->dst, &addr, sizeof(addr)))
+		goto fail_conn;
+
+	if (conn_prepare(conn, protocol_by_family(conn->dst->ss_family), srv->xprt) < 0)
+		goto fail_conn;
+
+	memset(&hash_params, 0, sizeof(hash_params));
+	hash_params.target = &srv->obj_type;
+	conn->hash_node->hash = conn_calculate_hash(&hash_params);
+
+	conn->handle.fd = fd;
+	conn_ctrl_init(conn);       /* registers the FD */
+	HA_ATOMIC_OR(&fdtab[fd].state, FD_LINGER_RISK);  /* close hard if needed */
+
+	if (conn_xprt_start(conn) < 0 || conn_install_mux_be(conn, NULL, NULL) < 0) {
+		conn_full_close(conn);
+		conn_free(conn);
+		return 1;
+	}
+
+	/* the mux only moves it to the idle list from its I/O callback */
+	if (conn->mux->wake)
+		conn->mux->wake(conn);
+	return 0;
+
+  fail_conn:
+	conn_free(conn);
+  fail_fd:
+	close(fd);
+	return 1;
+}
+
+/* Adopts the idle connections inherited from the old process, each thread
+ * taking its share of them. The master process has no use for them and
+ * only closes them.
+ */
+static int srv_adopt_inherited_conns_per_thread()
+{
+	int i;
+
+	for (i = tid; i < srv_nb_inherited_conns; i += global.nbthread) {
+		if (master)
+			close(srv_inherited_conns[i].fd);
+		else
+			srv_adopt_inherited_conn(srv_inherited_conns[i].srv, srv_inherited_conns[i].fd);
+	}
+	return 1;
+}
+
+static void srv_free_inherited_conns()
+{
+	ha_free(&srv_inherited_conns);
+	srv_nb_inherited_conns = 0;
+}
+
+REGISTER_PER_THREAD_INIT(srv_adopt_inherited_conns_per_thread);
+REGISTER_POST_DEINIT(srv_free_inherited_conns);
+
+/* Opens new idle connections to the server passed in <context> so that at
+ * least "pool-warm-conn" connections are established to it, either used or
+ * idle. Connections being established are accounted as used. It runs every
+ * "pool-purge-delay".
+ */
+struct task *srv_warm_conns_task(struct task *task, void *context, unsigned int state)
+{
+	struct server *srv = context;
+	int missing;
+
+	if (stopping || srv->proxy->disabled ||
+	    srv->cur_state == SRV_ST_STOPPED || (srv->cur_admin & SRV_ADMF_MAINT))
+		goto out;
+
+	missing = (int)srv->warm_conns - (int)(srv->curr_used_conns + srv->curr_idle_conns);
+	if (srv->max_idle_conns != -1 &&
+	    missing > (int)(srv->max_idle_conns - srv->curr_idle_conns))
+		missing = (int)(srv->max_idle_conns - srv->curr_idle_conns);
+
+	while (missing-- > 0 && ha_used_fds < global.tune.pool_low_count) {
+		if (srv_open_warm_conn(srv) != 0)
+			break;
+	}
+  out:
+	task->expire = tick_add(now_ms, MS_TO_TICKS(srv->pool_purge_delay));
+	return task;
+}
+
 /* Close remaining idle connections. This functions is designed to be run on
  * process shutdown. This guarantees a proper socket shutdown to avoid
  * TIME_WAIT state. For a quick operation, only ctrl is closed, xprt stack is
@@ -5391,18 +6122,20 @@ static void srv_close_idle_conns(struct server *srv)
 
 REGISTER_SERVER_DEINIT(srv_close_idle_conns);
 
-/* config parser for global "tune.idle-pool.shared", accepts "on" or "off" */
+/* config parser for global "tune.idle-pool.{shared,inherit}", accepts "on" or "off" */
 static int cfg_parse_idle_pool_shared(char **args, int section_type, struct proxy *curpx,
                                       const struct proxy *defpx, const char *file, int line,
                                       char **err)
 {
+	int opt = (args[0][15] == 's') ? GTUNE_IDLE_POOL_SHARED : GTUNE_IDLE_POOL_INHERIT;
+
 	if (too_many_args(1, args, err, NULL))
 		return -1;
 
 	if (strcmp(args[1], "on") == 0)
-		global.tune.options |= GTUNE_IDLE_POOL_SHARED;
+		global.tune.options |= opt;
 	else if (strcmp(args[1], "off") == 0)
-		global.tune.options &= ~GTUNE_IDLE_POOL_SHARED;
+		global.tune.options &= ~opt;
 	else {
 		memprintf(err, "'%s' expects either 'on' or 'off' but got '%s'.", args[0], args[1]);
 		return -1;
@@ -5438,6 +6171,7 @@ static int cfg_parse_pool_fd_ratio(char **args, int section_type, struct proxy *
 /* config keyword parsers */
 static struct cfg_kw_list cfg_kws = {ILH, {
 	{ CFG_GLOBAL, "tune.idle-pool.shared",       cfg_parse_idle_pool_shared },
+	{ CFG_GLOBAL, "tune.idle-pool.inherit",      cfg_parse_idle_pool_shared },
 	{ CFG_GLOBAL, "tune.pool-high-fd-ratio",     cfg_parse_pool_fd_ratio },
 	{ CFG_GLOBAL, "tune.pool-low-fd-ratio",      cfg_parse_pool_fd_ratio },
 	{ 0, NULL, NULL }
@@ -23,6 +23,7 @@
 #include <haproxy/errors.h>
 #include <haproxy/global.h>
 #include <haproxy/log.h>
+#include <haproxy/net_helper.h>
 #include <haproxy/port_range.h>
 #include <haproxy/proxy.h>
 #include <haproxy/resolvers.h>
@@ -730,6 +731,176 @@ static int srv_state_parse_and_store_line(char *line, int vsn, struct eb_root *s
 	return ret;
 }
 
+/* Converts the text server-state line in <buf>, terminated by a '\n', into a
+ * binary record for backend <be_id> and server <srv_id>, in place. Returns
+ * non-zero on success, or zero if there is not enough room in <buf>.
+ */
+int srv_state_bin_encode(struct buffer *buf, int be_id, int srv_id)
+{
+	size_t len = buf->data;
+	size_t i;
+	int fields = 1;
+
+	if (!len || len + SRV_STATE_BIN_REC_HDR_LEN > buf->size)
+		return 0;
+
+	memmove(buf->area + SRV_STATE_BIN_REC_HDR_LEN, buf->area, len);
+	for (i = SRV_STATE_BIN_REC_HDR_LEN; i < SRV_STATE_BIN_REC_HDR_LEN + len - 1; i++) {
+		if (buf->area[i] == ' ') {
+			buf->area[i] = 0;
+			fields++;
+		}
+	}
+	buf->area[i] = 0; /* the trailing '\n' */
+
+	write_n32(buf->area, len + SRV_STATE_BIN_REC_HDR_LEN - 4);
+	write_n32(buf->area + 4, be_id);
+	write_n32(buf->area + 8, srv_id);
+	buf->area[12] = fields;
+	buf->data = len + SRV_STATE_BIN_REC_HDR_LEN;
+	return 1;
+}
+
+/* Checks whether server-state file <f> is in the binary format, in which case
+ * its header is consumed and its version is returned, or -1 if this version is
+ * not supported. Otherwise <f> is rewound and 0 is returned.
+ */
+static int srv_state_bin_get_version(FILE *f)
+{
+	char hdr[SRV_STATE_BIN_HDR_LEN];
+	uint32_t vsn;
+
+	if (fread(hdr, 1, sizeof(hdr), f) != sizeof(hdr) ||
+	    memcmp(hdr, SRV_STATE_BIN_MAGIC, SRV_STATE_BIN_MAGIC_LEN) != 0) {
+		rewind(f);
+		return 0;
+	}
+
+	vsn = read_n32(hdr + SRV_STATE_BIN_MAGIC_LEN);
+	if (vsn != SRV_STATE_BIN_VERSION)
+		return -1;
+	return vsn;
+}
+
+/* Reads the next record of binary server-state file <f> into <buf>, which
+ * must be SRV_STATE_LINE_MAXLEN bytes long, and sets <be_id>, <srv_id> and
+ * <params> accordingly. <params> are indexed like for the text format. Returns
+ * 1 on success, 0 at the end of the file and -1 on error.
+ */
+static int srv_state_bin_read(FILE *f, char *buf, int *be_id, int *srv_id, char **params)
+{
+	char hdr[SRV_STATE_BIN_REC_HDR_LEN];
+	uint32_t len;
+	size_t ret;
+	char *cur, *end;
+	int arg, fields;
+
+	ret = fread(hdr, 1, sizeof(hdr), f);
+	/* a dump from the CLI ends with an empty line */
+	if (!ret || (ret == 1 && *hdr == '\n'))
+		return feof(f) ? 0 : -1;
+	if (ret != sizeof(hdr))
+		return -1;
+
+	len = read_n32(hdr);
+	fields = (unsigned char)hdr[12];
+	if (len <= SRV_STATE_BIN_REC_HDR_LEN - 4 || len - (SRV_STATE_BIN_REC_HDR_LEN - 4) > SRV_STATE_LINE_MAXLEN ||
+	    fields < SRV_STATE_FILE_MIN_FIELDS_VERSION_1 || fields > SRV_STATE_FILE_MAX_FIELDS_VERSION_1)
+		return -1;
+
+	len -= SRV_STATE_BIN_REC_HDR_LEN - 4;
+	if (fread(buf, 1, len, f) != len || buf[len - 1] != 0)
+		return -1;
+
+	*be_id  = read_n32(hdr + 4);
+	*srv_id = read_n32(hdr + 8);
+
+	memset(params, 0, SRV_STATE_FILE_MAX_FIELDS * sizeof(*params));
+	cur = buf;
+	end = buf + len;
+	for (arg = 0; arg < fields; arg++) {
+		if (cur >= end)
+			return -1;
+		params[arg] = cur;
+		cur += strlen(cur) + 1;
+	}
+	return 1;
+}
+
+/* Applies the records of binary server-state file <f>, whose header was
+ * already consumed, in a single pass. The backends and servers are looked up
+ * by their ids, then by their names if the ids do not match anymore. If <px>
+ * is not NULL, this is the local file of this backend and only its records are
+ * considered, using the same rules as for the text format. Otherwise it is the
+ * global file, which applies to the backends configured to use it. <file> is
+ * only used to report errors.
+ */
+static void srv_state_bin_apply(FILE *f, const char *file, struct proxy *px)
+{
+	char buf[SRV_STATE_LINE_MAXLEN];
+	char *params[SRV_STATE_FILE_MAX_FIELDS];
+	struct proxy *bk;
+	struct server *srv;
+	int be_id, srv_id, ret, rec;
+
+	for (rec = 1; (ret = srv_state_bin_read(f, buf, &be_id, &srv_id, params)) > 0; rec++) {
+		if (px) {
+			int check_id = (be_id == px->uuid);
+			int check_name = (strcmp(px->id, params[1]) == 0);
+
+			if (!check_id && !check_name)
+				continue;
+			else if (!check_id) {
+				ha_warning("Proxy '%s': backend ID mismatch: from server state file: '%d', from running config '%d'\n",
+					   px->id, be_id, px->uuid);
+				send_log(px, LOG_NOTICE, "backend ID mismatch: from server state file: '%d', from running config '%d'\n",
+					 be_id, px->uuid);
+			}
+			else if (!check_name) {
+				ha_warning("Proxy '%s': backend name mismatch: from server state file: '%s', from running config '%s'\n",
+					   px->id, params[1], px->id);
+				send_log(px, LOG_NOTICE, "backend name mismatch: from server state file: '%s', from running config '%s'\n",
+					 params[1], px->id);
+				if (!(atoi(params[15]) & PR_O_FORCED_ID))
+					continue;
+			}
+			bk = px;
+		}
+		else {
+			bk = proxy_find_by_id(be_id, PR_CAP_BE, 0);
+			if (!bk || strcmp(bk->id, params[1]) != 0)
+				bk = proxy_be_by_name(params[1]);
+			if (!bk || bk->disabled ||
+			    bk->load_server_state_from_file != PR_SRV_STATE_FILE_GLOBAL)
+				continue;
+		}
+
+		srv = server_find_by_id(bk, srv_id);
+		if (!srv || strcmp(srv->id, params[3]) != 0)
+			srv = server_find_by_name(bk, params[3]);
+		if (!srv) {
+			if (px) {
+				ha_warning("Proxy '%s': can't find server '%s' in backend '%s'\n",
+					   px->id, params[3], px->id);
+				send_log(px, LOG_NOTICE, "can't find server '%s' in backend '%s'\n",
+					 params[3], px->id);
+			}
+			continue;
+		}
+
+		srv_state_srv_update(srv, SRV_STATE_FILE_VERSION, params + 4);
+	}
+
+	if (ret < 0) {
+		if (px)
+			ha_warning("Proxy '%s': corrupted server state file '%s' at record %d.\n",
+				   px->id, file, rec);
+		else
+			ha_warning("config: corrupted global server state file '%s' at record %d.\n",
+				   file, rec);
+	}
+}
+
 /* Helper function to get the server-state file path.
  * If <filename> starts with a '/', it is considered as an absolute path. In
  * this case or if <global.server_state_base> is not set, <filename> only is
@@ -762,6 +933,7 @@ static inline int srv_state_get_filepath(char *dst_path, int maxpathlen, const c
 /* This function parses all the proxies and only take care of the backends (since we're looking for server)
  * For each proxy, it does the following:
  *  - opens its server state file (either one or local one)
+ *  - applies it in a single pass if it is in the binary format, otherwise:
  *  - read whole file, line by line
  *  - analyse each line to check if it matches our current backend:
  *    - backend name matches
@@ -783,7 +955,7 @@ void apply_server_state(void)
 	FILE *f;
 	char mybuf[SRV_STATE_LINE_MAXLEN];
 	char file[MAXPATHLEN];
-	int local_vsn, global_vsn, len, linenum;
+	int local_vsn, global_vsn, bin_vsn, len, linenum;
 
 	global_vsn = 0; /* no global file */
 	if (!global.server_state_file)
@@ -802,6 +974,17 @@ void apply_server_state(void)
 		goto no_globalfile;
 	}
 
+	/* a binary file is directly applied to the servers */
+	bin_vsn = srv_state_bin_get_version(f);
+	if (bin_vsn) {
+		if (bin_vsn > 0)
+			srv_state_bin_apply(f, file, NULL);
+		else
+			ha_warning("config: Unsupported version of the binary global server state file '%s'.\n",
+				   file);
+		goto close_globalfile;
+	}
+
 	global_vsn = srv_state_get_version(f);
 	if (global_vsn == 0) {
 		ha_warning("config: Can't get version of the global server state file '%s'.\n",
@@ -871,6 +1054,16 @@ void apply_server_state(void)
 			continue; /* next proxy */
 		}
 
+		bin_vsn = srv_state_bin_get_version(f);
+		if (bin_vsn) {
+			if (bin_vsn > 0)
+				srv_state_bin_apply(f, file, curproxy);
+			else
+				ha_warning("Proxy '%s': Unsupported version of the binary server state file '%s'.\n",
+					   curproxy->id, file);
+			goto close_localfile;
+		}
+
 		/* first character of first line of the file must contain the version of the export */
 		local_vsn = srv_state_get_version(f);
 		if (local_vsn == 0) {
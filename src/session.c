@@ -21,6 +21,7 @@
 #include <haproxy/session.h>
 #include <haproxy/tcp_rules.h>
 #include <haproxy/tools.h>
+#include <haproxy/usdt.h>
 #include <haproxy/vars.h>
 
 
@@ -147,6 +148,7 @@ int session_accept_fd(struct connection *cli_conn)
 
 	ret = -1; /* assume unrecoverable error by default */
 
+	HA_USDT(conn_accept, cli_conn, cfd, p->uuid);
 	cli_conn->proxy_netns = l->rx.settings->netns;
 
 	if (conn_prepare(cli_conn, l->rx.proto, l->bind_conf->xprt) < 0)
@@ -91,6 +91,7 @@ struct shared_block *shctx_row_reserve_hot(struct shared_context *shctx,
 
 			block->block_count = 1;
 			block->len = 0;
+			block->last_reserved = NULL;
 
 			freed++;
 			data_len -= shctx->block_size;
@@ -139,21 +140,9 @@ struct shared_block *shctx_row_reserve_hot(struct shared_context *shctx,
  */
 void shctx_row_inc_hot(struct shared_context *shctx, struct shared_block *first)
 {
-	struct shared_block *block, *sblock;
-	int count = 0;
-
 	if (first->refcount <= 0) {
-
-		block = first;
-
-		list_for_each_entry_safe_from(block, sblock, &shctx->avail, list) {
-
-			shctx_block_set_hot(shctx, block);
-
-			count++;
-			if (count >= first->block_count)
-				break;
-		}
+		shctx_row_move(&shctx->hot, first);
+		shctx->nbav -= first->block_count;
 	}
 
 	first->refcount++;
@@ -164,25 +153,12 @@ void shctx_row_inc_hot(struct shared_context *shctx, struct shared_block *first)
  */
 void shctx_row_dec_hot(struct shared_context *shctx, struct shared_block *first)
 {
-	struct shared_block *block, *sblock;
-	int count = 0;
-
 	first->refcount--;
 
 	if (first->refcount <= 0) {
-
-		block = first;
-
-		list_for_each_entry_safe_from(block, sblock, &shctx->hot, list) {
-
-			shctx_block_set_avail(shctx, block);
-
-			count++;
-			if (count >= first->block_count)
-				break;
-		}
+		shctx_row_move(&shctx->avail, first);
+		shctx->nbav += first->block_count;
 	}
-
 }
 
 
@@ -280,42 +256,34 @@ int shctx_row_data_get(struct shared_context *shctx, struct shared_block *first,
 	return len;
 }
 
-/* Allocate shared memory context.
- * <maxblocks> is maximum blocks.
- * If <maxblocks> is set to less or equal to 0, ssl cache is disabled.
- * Returns: -1 on alloc failure, <maxblocks> if it performs context alloc,
- * and 0 if cache is already allocated.
+/* Returns the size of the area needed by a shared context of <maxblocks>
+ * blocks of <blocksize> bytes with <extra> bytes of user data.
  */
-int shctx_init(struct shared_context **orig_shctx, int maxblocks, int blocksize,
-               unsigned int maxobjsz, int extra, int shared)
+size_t shctx_area_size(int maxblocks, int blocksize, int extra)
+{
+	/* make sure to align the records on a pointer size */
+	blocksize = (blocksize + sizeof(void *) - 1) & -sizeof(void *);
+	extra     = (extra     + sizeof(void *) - 1) & -sizeof(void *);
+
+	return sizeof(struct shared_context) + extra + ((size_t)maxblocks * (sizeof(struct shared_block) + blocksize));
+}
+
+/* Initializes a shared context in area <shctx> which must be at least
+ * shctx_area_size() bytes large. The arguments are the same as for
+ * shctx_init(). If the area is shared between processes, the caller must also
+ * set use_shared_mem. Returns <maxblocks>.
+ */
+int shctx_init_area(struct shared_context *shctx, int maxblocks, int blocksize,
+                    unsigned int maxobjsz, int extra)
 {
 	int i;
-	struct shared_context *shctx;
-	int ret;
 	void *cur;
-	int maptype = MAP_PRIVATE;
-
-	if (maxblocks <= 0)
-		return 0;
 
 	/* make sure to align the records on a pointer size */
 	blocksize = (blocksize + sizeof(void *) - 1) & -sizeof(void *);
 	extra     = (extra     + sizeof(void *) - 1) & -sizeof(void *);
 
-	if (shared) {
-		maptype = MAP_SHARED;
-		use_shared_mem = 1;
-	}
-
-	shctx = (struct shared_context *)mmap(NULL, sizeof(struct shared_context) + extra + (maxblocks * (sizeof(struct shared_block) + blocksize)),
-	                                      PROT_READ | PROT_WRITE, maptype | MAP_ANON, -1, 0);
-	if (!shctx || shctx == MAP_FAILED) {
-		shctx = NULL;
-		ret = SHCTX_E_ALLOC_CACHE;
-		goto err;
-	}
-
-	HA_SPIN_INIT(&shctx->lock);
+	HA_RWLOCK_INIT(&shctx->lock);
 	shctx->nbav = 0;
 
 	LIST_INIT(&shctx->avail);
@@ -331,14 +299,46 @@ int shctx_init(struct shared_context **orig_shctx, int maxblocks, int blocksize,
 		cur_block->len = 0;
 		cur_block->refcount = 0;
 		cur_block->block_count = 1;
+		cur_block->last_reserved = NULL;
 		LIST_APPEND(&shctx->avail, &cur_block->list);
 		shctx->nbav++;
 		cur += sizeof(struct shared_block) + blocksize;
 	}
-	ret = maxblocks;
+	return maxblocks;
+}
+
+/* Allocate shared memory context.
+ * <maxblocks> is maximum blocks.
+ * If <maxblocks> is set to less or equal to 0, ssl cache is disabled.
+ * Returns: -1 on alloc failure, <maxblocks> if it performs context alloc,
+ * and 0 if cache is already allocated.
+ */
+int shctx_init(struct shared_context **orig_shctx, int maxblocks, int blocksize,
+               unsigned int maxobjsz, int extra, int shared)
+{
+	struct shared_context *shctx;
+	int ret;
+	int maptype = MAP_PRIVATE;
+
+	if (maxblocks <= 0)
+		return 0;
+
+	if (shared) {
+		maptype = MAP_SHARED;
+		use_shared_mem = 1;
+	}
+
+	shctx = (struct shared_context *)mmap(NULL, shctx_area_size(maxblocks, blocksize, extra),
+	                                      PROT_READ | PROT_WRITE, maptype | MAP_ANON, -1, 0);
+	if (!shctx || shctx == MAP_FAILED) {
+		shctx = NULL;
+		ret = SHCTX_E_ALLOC_CACHE;
+		goto err;
+	}
+
+	ret = shctx_init_area(shctx, maxblocks, blocksize, maxobjsz, extra);
 
 err:
 	*orig_shctx = shctx;
 	return ret;
 }
-
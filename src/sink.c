@@ -22,6 +22,7 @@
 #include <haproxy/api.h>
 #include <haproxy/cfgparse.h>
 #include <haproxy/cli.h>
+#include <haproxy/compression.h>
 #include <haproxy/errors.h>
 #include <haproxy/list.h>
 #include <haproxy/log.h>
@@ -289,6 +290,122 @@ void sink_setup_proxy(struct proxy *px)
 	px->options2 |= PR_O2_INDEPSTR | PR_O2_SMARTCON | PR_O2_SMARTACC;
 }
 
+/* Checks whether the forwarder <appctx> of target <sft> should wait for more
+ * messages before reading the ring, in order to send them all at once once
+ * the ring's flush delay expires. The batch is sent earlier if the pending
+ * messages reach half of the room in the channel or in the ring, so that the
+ * wait never causes more messages to be dropped. When deciding to wait, the
+ * applet's task is set to expire at the deadline and the applet is kept in
+ * the ring's waiters list. Must be called with the target's lock held.
+ * Returns non-zero if the applet must wait, otherwise zero.
+ */
+static int sink_forward_must_wait(struct sink *sink, struct sink_forward_target *sft, struct appctx *appctx)
+{
+	struct stream_interface *si = appctx->owner;
+	struct ring *ring = sink->ctx.ring;
+	size_t pending, max;
+
+	if (!sink->flush_delay || sft->ofs == ~0)
+		return 0;
+
+	/* <ofs> designates our counter byte, which is always committed */
+	pending = HA_ATOMIC_LOAD(&ring->committed) - sft->ofs - 1;
+	max = MIN(channel_recv_max(si_ic(si)), b_size(&ring->buf)) / 2;
+
+	if (pending && pending < max) {
+		if (!tick_isset(sft->flush_exp))
+			sft->flush_exp = tick_add(now_ms, sink->flush_delay);
+
+		if (!tick_is_expired(sft->flush_exp, now_ms)) {
+			appctx->t->expire = sft->flush_exp;
+			if (!LIST_INLIST(&appctx->wait_entry)) {
+				HA_RWLOCK_WRLOCK(LOGSRV_LOCK, &ring->lock);
+				LIST_APPEND(&ring->waiters, &appctx->wait_entry);
+				HA_RWLOCK_WRUNLOCK(LOGSRV_LOCK, &ring->lock);
+			}
+			return 1;
+		}
+	}
+
+	sft->flush_exp = TICK_ETERNITY;
+	appctx->t->expire = TICK_ETERNITY;
+	return 0;
+}
+
+/* Returns the maximum number of message bytes that may be collected into a
+ * batch compressed for stream interface <si>, such that the compressed batch
+ * is guaranteed to fit into the channel. Deflate may expand incompressible
+ * contents by one bit per byte, the margin covers headers and trailers. The
+ * batch cannot be larger than 3/4 of a buffer so that it always fits into a
+ * trash chunk once compressed.
+ */
+static size_t sink_forward_batch_max(struct stream_interface *si)
+{
+	size_t room = channel_recv_max(si_ic(si));
+	size_t max = (size_t)global.tune.bufsize * 3 / 4;
+
+	if (room < 64)
+		return 0;
+	room = (room - 64) * 8 / 9;
+	return MIN(room, max);
+}
+
+/* Compresses the messages collected into <batch> as a complete frame using
+ * algorithm <algo> and appends it to the channel of stream interface <si>.
+ * Each batch being a self-contained frame (gzip member or zstd frame), the
+ * receiver may decompress the stream with standard tools. The caller must
+ * have limited the batch using sink_forward_batch_max(). Returns 0 on
+ * success or -1 on failure.
+ */
+static int sink_forward_send_batch(struct stream_interface *si, const struct comp_algo *algo, struct buffer *batch)
+{
+	struct comp_ctx *comp_ctx = NULL;
+	struct buffer *out;
+	int ret = -1;
+
+	out = alloc_trash_chunk();
+	if (!out)
+		return -1;
+
+	if (algo->init(&comp_ctx, global.tune.comp_maxlevel) < 0)
+		goto leave;
+
+	if (algo->add_data(comp_ctx, b_head(batch), b_data(batch), out) >= 0 &&
+	    algo->finish(comp_ctx, out) >= 0 &&
+	    ci_putchk(si_ic(si), out) != -1)
+		ret = 0;
+
+	algo->end(&comp_ctx);
+ leave:
+	free_trash_chunk(out);
+	b_reset(batch);
+	return ret;
+}
+
+/* Appends the message formatted in <msg> to <batch>, whose size is limited
+ * to <*batch_max>. When the message doesn't fit, the pending batch is sent
+ * first and the limit is recomputed. Returns 1 on success, 0 if there is not
+ * enough room left in the channel, in which case the message must be retried
+ * later, or -1 if compression failed.
+ */
+static int sink_forward_batch_msg(struct stream_interface *si, const struct comp_algo *algo,
+                                  struct buffer *batch, size_t *batch_max, const struct buffer *msg)
+{
+	if (b_data(batch) + b_data(msg) > *batch_max) {
+		if (b_data(batch) && sink_forward_send_batch(si, algo, batch) < 0)
+			return -1;
+		*batch_max = sink_forward_batch_max(si);
+		if (b_data(msg) > *batch_max) {
+			si_rx_room_blk(si);
+			return 0;
+		}
+	}
+
+	memcpy(b_tail(batch), b_head(msg), b_data(msg));
+	b_add(batch, b_data(msg));
+	return 1;
+}
+
 /*
  * IO Handler to handle message push to syslog tcp server
  */
@@ -300,9 +417,11 @@ static void sink_forward_io_handler(struct appctx *appctx)
 	struct sink_forward_target *sft = appctx->ctx.sft.ptr;
 	struct ring *ring = sink->ctx.ring;
 	struct buffer *buf = &ring->buf;
+	const struct comp_algo *algo = sft->srv->log_comp;
+	struct buffer *batch = NULL;
 	uint64_t msg_len;
-	size_t len, cnt, ofs;
-	int ret = 0;
+	size_t len, cnt, ofs, msg_max, batch_max = 0;
+	int ret = 0, err = 0;
 
 	/* if stopping was requested, close immediately */
 	if (unlikely(stopping))
@@ -341,6 +460,26 @@ static void sink_forward_io_handler(struct appctx *appctx)
 	}
 	ofs = sft->ofs;
 
+	/* leave some time to the next messages to join the batch */
+	if (sink_forward_must_wait(sink, sft, appctx)) {
+		HA_SPIN_UNLOCK(SFT_LOCK, &sft->lock);
+		si_rx_endp_done(si);
+		co_skip(si_oc(si), si_oc(si)->output);
+		return;
+	}
+
+	/* compressed messages are collected into batches */
+	msg_max = b_size(&trash);
+	if (algo) {
+		batch = alloc_trash_chunk();
+		if (!batch) {
+			HA_SPIN_UNLOCK(SFT_LOCK, &sft->lock);
+			goto close;
+		}
+		msg_max = b_size(batch) * 3 / 4;
+		batch_max = sink_forward_batch_max(si);
+	}
+
 	HA_RWLOCK_WRLOCK(LOGSRV_LOCK, &ring->lock);
 	LIST_DEL_INIT(&appctx->wait_entry);
 	HA_RWLOCK_WRUNLOCK(LOGSRV_LOCK, &ring->lock);
@@ -375,15 +514,15 @@ static void sink_forward_io_handler(struct appctx *appctx)
 		HA_ATOMIC_DEC(b_peek(buf, ofs));
 
 		ret = 1;
-		while (ofs + 1 < b_data(buf)) {
+		while (ofs + 1 < ring_data(ring)) {
 			cnt = 1;
 			len = b_peek_varint(buf, ofs + cnt, &msg_len);
 			if (!len)
 				break;
 			cnt += len;
-			BUG_ON(msg_len + ofs + cnt + 1 > b_data(buf));
+			BUG_ON(msg_len + ofs + cnt + 1 > ring_data(ring));
 
-			if (unlikely(msg_len + 1 > b_size(&trash))) {
+			if (unlikely(msg_len + 1 > msg_max)) {
 				/* too large a message to ever fit, let's skip it */
 				ofs += cnt + msg_len;
 				continue;
@@ -394,7 +533,15 @@ static void sink_forward_io_handler(struct appctx *appctx)
 			trash.data += len;
 			trash.area[trash.data++] = '\n';
 
-			if (ci_putchk(si_ic(si), &trash) == -1) {
+			if (batch) {
+				ret = sink_forward_batch_msg(si, algo, batch, &batch_max, &trash);
+				if (ret <= 0) {
+					err = ret < 0;
+					ret = 0;
+					break;
+				}
+			}
+			else if (ci_putchk(si_ic(si), &trash) == -1) {
 				si_rx_room_blk(si);
 				ret = 0;
 				break;
@@ -402,6 +549,9 @@ static void sink_forward_io_handler(struct appctx *appctx)
 			ofs += cnt + msg_len;
 		}
 
+		if (batch && b_data(batch) && sink_forward_send_batch(si, algo, batch) < 0)
+			err = 1;
+
 		HA_ATOMIC_INC(b_peek(buf, ofs));
 		ofs += ring->ofs;
 		sft->ofs = ofs;
@@ -416,6 +566,10 @@ static void sink_forward_io_handler(struct appctx *appctx)
 		si_rx_endp_done(si);
 	}
 	HA_SPIN_UNLOCK(SFT_LOCK, &sft->lock);
+	free_trash_chunk(batch);
+
+	if (unlikely(err))
+		goto close;
 
 	/* always drain data from server */
 	co_skip(si_oc(si), si_oc(si)->output);
@@ -439,9 +593,11 @@ static void sink_forward_oc_io_handler(struct appctx *appctx)
 	struct sink_forward_target *sft = appctx->ctx.sft.ptr;
 	struct ring *ring = sink->ctx.ring;
 	struct buffer *buf = &ring->buf;
+	const struct comp_algo *algo = sft->srv->log_comp;
+	struct buffer *batch = NULL;
 	uint64_t msg_len;
-	size_t len, cnt, ofs;
-	int ret = 0;
+	size_t len, cnt, ofs, msg_max, batch_max = 0;
+	int ret = 0, err = 0;
 	char *p;
 
 	/* if stopping was requested, close immediately */
@@ -481,6 +637,26 @@ static void sink_forward_oc_io_handler(struct appctx *appctx)
 	}
 	ofs = sft->ofs;
 
+	/* leave some time to the next messages to join the batch */
+	if (sink_forward_must_wait(sink, sft, appctx)) {
+		HA_SPIN_UNLOCK(SFT_LOCK, &sft->lock);
+		si_rx_endp_done(si);
+		co_skip(si_oc(si), si_oc(si)->output);
+		return;
+	}
+
+	/* compressed messages are collected into batches */
+	msg_max = b_size(&trash);
+	if (algo) {
+		batch = alloc_trash_chunk();
+		if (!batch) {
+			HA_SPIN_UNLOCK(SFT_LOCK, &sft->lock);
+			goto close;
+		}
+		msg_max = b_size(batch) * 3 / 4;
+		batch_max = sink_forward_batch_max(si);
+	}
+
 	HA_RWLOCK_WRLOCK(LOGSRV_LOCK, &ring->lock);
 	LIST_DEL_INIT(&appctx->wait_entry);
 	HA_RWLOCK_WRUNLOCK(LOGSRV_LOCK, &ring->lock);
@@ -515,13 +691,13 @@ static void sink_forward_oc_io_handler(struct appctx *appctx)
 		HA_ATOMIC_DEC(b_peek(buf, ofs));
 
 		ret = 1;
-		while (ofs + 1 < b_data(buf)) {
+		while (ofs + 1 < ring_data(ring)) {
 			cnt = 1;
 			len = b_peek_varint(buf, ofs + cnt, &msg_len);
 			if (!len)
 				break;
 			cnt += len;
-			BUG_ON(msg_len + ofs + cnt + 1 > b_data(buf));
+			BUG_ON(msg_len + ofs + cnt + 1 > ring_data(ring));
 
 			chunk_reset(&trash);
 			p = ulltoa(msg_len, trash.area, b_size(&trash));
@@ -530,7 +706,7 @@ static void sink_forward_oc_io_handler(struct appctx *appctx)
 				*p = ' ';
 			}
 
-			if (!p || (trash.data + msg_len > b_size(&trash))) {
+			if (!p || (trash.data + msg_len > msg_max)) {
 				/* too large a message to ever fit, let's skip it */
 				ofs += cnt + msg_len;
 				continue;
@@ -538,7 +714,15 @@ static void sink_forward_oc_io_handler(struct appctx *appctx)
 
 			trash.data += b_getblk(buf, p + 1, msg_len, ofs + cnt);
 
-			if (ci_putchk(si_ic(si), &trash) == -1) {
+			if (batch) {
+				ret = sink_forward_batch_msg(si, algo, batch, &batch_max, &trash);
+				if (ret <= 0) {
+					err = ret < 0;
+					ret = 0;
+					break;
+				}
+			}
+			else if (ci_putchk(si_ic(si), &trash) == -1) {
 				si_rx_room_blk(si);
 				ret = 0;
 				break;
@@ -546,6 +730,9 @@ static void sink_forward_oc_io_handler(struct appctx *appctx)
 			ofs += cnt + msg_len;
 		}
 
+		if (batch && b_data(batch) && sink_forward_send_batch(si, algo, batch) < 0)
+			err = 1;
+
 		HA_ATOMIC_INC(b_peek(buf, ofs));
 		ofs += ring->ofs;
 		sft->ofs = ofs;
@@ -560,6 +747,10 @@ static void sink_forward_oc_io_handler(struct appctx *appctx)
 		si_rx_endp_done(si);
 	}
 	HA_SPIN_UNLOCK(SFT_LOCK, &sft->lock);
+	free_trash_chunk(batch);
+
+	if (unlikely(err))
+		goto close;
 
 	/* always drain data from server */
 	co_skip(si_oc(si), si_oc(si)->output);
@@ -676,6 +867,7 @@ static struct appctx *sink_forward_session_create(struct sink *sink, struct sink
 	s->res.rto = TICK_ETERNITY;
 	s->res.rex = TICK_ETERNITY;
 	sft->appctx = appctx;
+	sft->flush_exp = TICK_ETERNITY;
 	task_wakeup(s->task, TASK_WOKEN_INIT);
 	return appctx;
 
@@ -824,7 +1016,8 @@ int cfg_parse_ring(const char *file, int linenum, char **args, int kwm)
 		}
 
                 if (strcmp(args[1], "connect") == 0 ||
-		    strcmp(args[1], "server") == 0) {
+		    strcmp(args[1], "server") == 0 ||
+		    strcmp(args[1], "flush") == 0) {
 			const char *res;
 			unsigned int tout;
 
@@ -853,7 +1046,9 @@ int cfg_parse_ring(const char *file, int linenum, char **args, int kwm)
 				err_code |= ERR_ALERT | ERR_FATAL;
 				goto err;
 			}
-                        if (args[1][2] == 'c')
+                        if (args[1][0] == 'f')
+                                cfg_sink->flush_delay = tout;
+                        else if (args[1][2] == 'c')
                                 cfg_sink->forward_px->timeout.connect = tout;
                         else
                                 cfg_sink->forward_px->timeout.server = tout;
@@ -872,6 +1067,11 @@ int cfg_parse_ring(const char *file, int linenum, char **args, int kwm)
 			err_code |= ERR_ALERT | ERR_FATAL;
 			goto err;
 		}
+		if (cfg_sink->fmt == LOG_FORMAT_CBOR) {
+			ha_alert("parsing [%s:%d] : format '%s' is not supported on rings.\n", file, linenum, args[1]);
+			err_code |= ERR_ALERT | ERR_FATAL;
+			goto err;
+		}
 	}
 	else if (strcmp(args[0],"maxlen") == 0) {
 		if (!cfg_sink) {
@@ -997,6 +1197,7 @@ struct sink *sink_new_from_logsrv(struct logsrv *logsrv)
 	sft->srv = srv;
 	sft->appctx = NULL;
 	sft->ofs = ~0;
+	sft->flush_exp = TICK_ETERNITY;
 	HA_SPIN_INIT(&sft->lock);
 
 	/* prepare description for the sink */
@@ -1113,6 +1314,7 @@ int cfg_post_parse_ring()
 				sft->srv = srv;
 				sft->appctx = NULL;
 				sft->ofs = ~0; /* init ring offset */
+				sft->flush_exp = TICK_ETERNITY;
 				sft->next = cfg_sink->sft;
 				HA_SPIN_INIT(&sft->lock);
 
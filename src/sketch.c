@@ -0,0 +1,738 @@
+/*
+ * Probabilistic sketches: count-min sketch and HyperLogLog.
+ *
+ * A count-min sketch estimates the rate of events per key, and a HyperLogLog
+ * estimates the number of distinct keys seen. Both use a fixed amount of
+ * memory decided at configuration time, regardless of the number of keys,
+ * and are updated without any lock. They are meant as a cheaper alternative
+ * to stick tables when tracking very large key spaces, at the expense of
+ * accuracy: a count-min sketch may only over-estimate a rate, and a
+ * HyperLogLog has a standard error of about 1.04/sqrt(2^precision).
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ *
+ */
+
+#include <import/xxhash.h>
+
+#include <haproxy/action.h>
+#include <haproxy/api.h>
+#include <haproxy/arg.h>
+#include <haproxy/cfgparse.h>
+#include <haproxy/channel.h>
+#include <haproxy/cli.h>
+#include <haproxy/errors.h>
+#include <haproxy/freq_ctr.h>
+#include <haproxy/global.h>
+#include <haproxy/http_rules.h>
+#include <haproxy/list.h>
+#include <haproxy/sample.h>
+#include <haproxy/sketch.h>
+#include <haproxy/stream_interface.h>
+#include <haproxy/tcp_rules.h>
+#include <haproxy/tools.h>
+
+
+/* all declared or referenced sketches */
+struct list sketches = LIST_HEAD_INIT(sketches);
+
+/* sketch section being parsed */
+static struct sketch *cur_sketch;
+
+static const char *sketch_type_names[] = {
+	[SKETCH_T_NONE] = "undeclared",
+	[SKETCH_T_CMS]  = "count-min",
+	[SKETCH_T_HLL]  = "hyperloglog",
+};
+
+/* Returns a description of where sketch <sk> was first referenced. Sample
+ * fetches do not provide their location.
+ */
+static const char *sketch_ref_loc(const struct sketch *sk)
+{
+	static char loc[256];
+
+	if (!sk->ref.file)
+		return "in a sample fetch";
+	snprintf(loc, sizeof(loc), "at %s:%d", sk->ref.file, sk->ref.line);
+	return loc;
+}
+
+/* Returns the sketch named <name>, or NULL if not found. */
+struct sketch *sketch_find(const char *name)
+{
+	struct sketch *sk;
+
+	list_for_each_entry(sk, &sketches, list) {
+		if (strcmp(sk->id, name) == 0)
+			return sk;
+	}
+	return NULL;
+}
+
+/* Allocates a new sketch named <name> of undefined type and appends it to the
+ * list. Returns NULL on memory allocation failure.
+ */
+static struct sketch *sketch_new(const char *name)
+{
+	struct sketch *sk;
+
+	sk = calloc(1, sizeof(*sk));
+	if (!sk)
+		return NULL;
+
+	sk->id = strdup(name);
+	if (!sk->id) {
+		free(sk);
+		return NULL;
+	}
+	LIST_APPEND(&sketches, &sk->list);
+	return sk;
+}
+
+/* Returns the sketch named <name> for use by a keyword at <file>:<line> which
+ * expects a sketch of type <type>. The sketch is created if it was not
+ * declared yet, so that it may be declared after its first use, and all
+ * references are checked once the configuration is parsed. Returns NULL with
+ * <err> filled on error.
+ */
+struct sketch *sketch_get_ref(const char *name, enum sketch_type type,
+                              const char *file, int line, char **err)
+{
+	struct sketch *sk;
+
+	sk = sketch_find(name);
+	if (!sk) {
+		sk = sketch_new(name);
+		if (!sk) {
+			memprintf(err, "out of memory");
+			return NULL;
+		}
+	}
+
+	if (type != SKETCH_T_NONE && sk->type != SKETCH_T_NONE && sk->type != type) {
+		memprintf(err, "sketch '%s' declared at %s:%d is a %s sketch, while a %s one is expected here",
+			  name, sk->conf.file, sk->conf.line, sketch_type_names[sk->type], sketch_type_names[type]);
+		return NULL;
+	}
+
+	if (type != SKETCH_T_NONE && sk->ref.type != SKETCH_T_NONE && sk->ref.type != type) {
+		memprintf(err, "sketch '%s' is used as a %s sketch %s, while a %s one is expected here",
+			  name, sketch_type_names[sk->ref.type], sketch_ref_loc(sk), sketch_type_names[type]);
+		return NULL;
+	}
+
+	if (sk->ref.type == SKETCH_T_NONE && (type != SKETCH_T_NONE || !sk->ref.line)) {
+		sk->ref.type = type;
+		sk->ref.file = file;
+		sk->ref.line = line;
+	}
+	return sk;
+}
+
+/* Records key <key> of length <len> into sketch <sk>: for a count-min sketch,
+ * one event is counted for the key, and for a HyperLogLog, the key is added
+ * to the set of distinct keys.
+ */
+void sketch_add(struct sketch *sk, const char *key, size_t len)
+{
+	unsigned long long hash = XXH64(key, len, 0);
+	unsigned int i;
+
+	if (sk->type == SKETCH_T_CMS) {
+		unsigned int h1 = hash, h2 = (hash >> 32) | 1;
+
+		/* rows are indexed using double hashing */
+		for (i = 0; i < sk->cms.depth; i++)
+			update_freq_ctr_period(&sk->cms.cells[i * sk->cms.width + ((h1 + i * h2) & (sk->cms.width - 1))],
+			                       sk->cms.period, 1);
+	}
+	else if (sk->type == SKETCH_T_HLL) {
+		unsigned int p = sk->hll.precision;
+		unsigned char old, rank;
+
+		/* the first <p> bits select the register, which keeps the
+		 * highest position of the first bit set in the remaining ones.
+		 * The guard bit caps the rank to 64 - p + 1.
+		 */
+		i = hash >> (64 - p);
+		rank = __builtin_clzll((hash << p) | (1ULL << (p - 1))) + 1;
+		old = HA_ATOMIC_LOAD(&sk->hll.regs[i]);
+		while (old < rank && !HA_ATOMIC_CAS(&sk->hll.regs[i], &old, rank))
+			__ha_cpu_relax();
+	}
+}
+
+/* Returns the estimated rate over its period of key <key> of length <len> in
+ * count-min sketch <sk>. The estimate is never lower than the real rate.
+ */
+unsigned int sketch_cms_rate(struct sketch *sk, const char *key, size_t len)
+{
+	unsigned long long hash = XXH64(key, len, 0);
+	unsigned int h1 = hash, h2 = (hash >> 32) | 1;
+	unsigned int i, rate, min = ~0U;
+
+	for (i = 0; i < sk->cms.depth; i++) {
+		rate = read_freq_ctr_period(&sk->cms.cells[i * sk->cms.width + ((h1 + i * h2) & (sk->cms.width - 1))],
+		                            sk->cms.period);
+		if (rate < min)
+			min = rate;
+	}
+	return min;
+}
+
+/* Returns the natural logarithm of <x> which must be at least 1. It is only
+ * used by HyperLogLog estimates, which is not worth a dependency on libm.
+ */
+static double sketch_ln(double x)
+{
+	double y, y2, sum = 0.0;
+	int k = 0, n;
+
+	while (x >= 2.0) {
+		x /= 2.0;
+		k++;
+	}
+
+	/* ln(x) = 2 * atanh((x - 1) / (x + 1)) with y < 1/3 here */
+	y = (x - 1.0) / (x + 1.0);
+	y2 = y * y;
+	for (n = 1; n < 40; n += 2) {
+		sum += y / n;
+		y *= y2;
+	}
+	return 2.0 * sum + k * 0.69314718055994530942;
+}
+
+/* Returns the estimated number of distinct keys added to HyperLogLog <sk>. */
+unsigned long long sketch_hll_count(const struct sketch *sk)
+{
+	unsigned int m = 1U << sk->hll.precision;
+	unsigned int i, zeros = 0;
+	double alpha, sum = 0.0, est;
+
+	for (i = 0; i < m; i++) {
+		unsigned char r = sk->hll.regs[i];
+
+		sum += 1.0 / (double)(1ULL << r);
+		if (!r)
+			zeros++;
+	}
+
+	switch (m) {
+	case 16: alpha = 0.673; break;
+	case 32: alpha = 0.697; break;
+	case 64: alpha = 0.709; break;
+	default: alpha = 0.7213 / (1.0 + 1.079 / m); break;
+	}
+
+	est = alpha * m * m / sum;
+
+	/* small cardinalities are better estimated by linear counting. No
+	 * correction is needed for large ones with 64-bit hashes.
+	 */
+	if (est <= 2.5 * m && zeros)
+		est = m * sketch_ln((double)m / zeros);
+
+	return (unsigned long long)(est + 0.5);
+}
+
+/* Resets all counters or registers of sketch <sk>. Concurrent updates may be
+ * partially lost.
+ */
+void sketch_clear(struct sketch *sk)
+{
+	if (sk->type == SKETCH_T_CMS)
+		memset(sk->cms.cells, 0, (size_t)sk->cms.width * sk->cms.depth * sizeof(*sk->cms.cells));
+	else if (sk->type == SKETCH_T_HLL)
+		memset(sk->hll.regs, 0, 1UL << sk->hll.precision);
+}
+
+/* Returns the memory used by the data of sketch <sk>. */
+static size_t sketch_mem(const struct sketch *sk)
+{
+	if (sk->type == SKETCH_T_CMS)
+		return (size_t)sk->cms.width * sk->cms.depth * sizeof(*sk->cms.cells);
+	else if (sk->type == SKETCH_T_HLL)
+		return 1UL << sk->hll.precision;
+	return 0;
+}
+
+/*
+ * Configuration parsing
+ */
+
+/* Parses a "sketch" section. */
+int cfg_parse_sketch(const char *file, int linenum, char **args, int kwm)
+{
+	int err_code = 0;
+	int cur_arg;
+
+	if (strcmp(args[0], "sketch") == 0) { /* new sketch section */
+		if (!*args[1]) {
+			ha_alert("parsing [%s:%d] : '%s' expects a <name> argument.\n",
+				 file, linenum, args[0]);
+			err_code |= ERR_ALERT | ERR_ABORT;
+			goto out;
+		}
+
+		if (alertif_too_many_args(1, file, linenum, args, &err_code)) {
+			err_code |= ERR_ABORT;
+			goto out;
+		}
+
+		cur_sketch = sketch_find(args[1]);
+		if (cur_sketch && cur_sketch->conf.file) {
+			ha_alert("parsing [%s:%d] : sketch '%s' has the same name as another sketch declared at %s:%d.\n",
+				 file, linenum, args[1], cur_sketch->conf.file, cur_sketch->conf.line);
+			err_code |= ERR_ALERT | ERR_FATAL;
+			cur_sketch = NULL;
+			goto out;
+		}
+
+		if (!cur_sketch)
+			cur_sketch = sketch_new(args[1]);
+		if (!cur_sketch) {
+			ha_alert("parsing [%s:%d] : out of memory.\n", file, linenum);
+			err_code |= ERR_ALERT | ERR_ABORT;
+			goto out;
+		}
+		cur_sketch->conf.file = file;
+		cur_sketch->conf.line = linenum;
+	}
+	else if (!cur_sketch) {
+		/* an error was already reported for the section */
+		goto out;
+	}
+	else if (strcmp(args[0], "count-min") == 0 || strcmp(args[0], "hyperloglog") == 0) {
+		if (cur_sketch->type != SKETCH_T_NONE) {
+			ha_alert("parsing [%s:%d] : the type of sketch '%s' is already set.\n",
+				 file, linenum, cur_sketch->id);
+			err_code |= ERR_ALERT | ERR_FATAL;
+			goto out;
+		}
+
+		if (*args[0] == 'c') {
+			cur_sketch->type = SKETCH_T_CMS;
+			cur_sketch->cms.width = SKETCH_CMS_WIDTH;
+			cur_sketch->cms.depth = SKETCH_CMS_DEPTH;
+		}
+		else {
+			cur_sketch->type = SKETCH_T_HLL;
+			cur_sketch->hll.precision = SKETCH_HLL_PRECISION;
+		}
+
+		for (cur_arg = 1; *args[cur_arg]; cur_arg += 2) {
+			const char *res;
+			unsigned int val;
+
+			if (!*args[cur_arg + 1]) {
+				ha_alert("parsing [%s:%d] : '%s' : missing value for '%s'.\n",
+					 file, linenum, args[0], args[cur_arg]);
+				err_code |= ERR_ALERT | ERR_FATAL;
+				goto out;
+			}
+
+			if (cur_sketch->type == SKETCH_T_CMS && strcmp(args[cur_arg], "period") == 0) {
+				res = parse_time_err(args[cur_arg + 1], &val, TIME_UNIT_MS);
+				if (res == PARSE_TIME_OVER || res == PARSE_TIME_UNDER || res || val < 2) {
+					ha_alert("parsing [%s:%d] : '%s' : invalid period '%s', expects a duration between 2ms and 24 days.\n",
+						 file, linenum, args[0], args[cur_arg + 1]);
+					err_code |= ERR_ALERT | ERR_FATAL;
+					goto out;
+				}
+				cur_sketch->cms.period = MS_TO_TICKS(val);
+				continue;
+			}
+
+			val = atoi(args[cur_arg + 1]);
+			if (cur_sketch->type == SKETCH_T_CMS && strcmp(args[cur_arg], "width") == 0) {
+				if (val < 2 || val > (1U << 30) || (val & (val - 1))) {
+					ha_alert("parsing [%s:%d] : '%s' : '%s' expects a power of two between 2 and 2^30, got '%s'.\n",
+						 file, linenum, args[0], args[cur_arg], args[cur_arg + 1]);
+					err_code |= ERR_ALERT | ERR_FATAL;
+					goto out;
+				}
+				cur_sketch->cms.width = val;
+			}
+			else if (cur_sketch->type == SKETCH_T_CMS && strcmp(args[cur_arg], "depth") == 0) {
+				if (val < 1 || val > SKETCH_CMS_MAX_DEPTH) {
+					ha_alert("parsing [%s:%d] : '%s' : '%s' expects a value between 1 and %d, got '%s'.\n",
+						 file, linenum, args[0], args[cur_arg], SKETCH_CMS_MAX_DEPTH, args[cur_arg + 1]);
+					err_code |= ERR_ALERT | ERR_FATAL;
+					goto out;
+				}
+				cur_sketch->cms.depth = val;
+			}
+			else if (cur_sketch->type == SKETCH_T_HLL && strcmp(args[cur_arg], "precision") == 0) {
+				if (val < SKETCH_HLL_MIN_PREC || val > SKETCH_HLL_MAX_PREC) {
+					ha_alert("parsing [%s:%d] : '%s' : '%s' expects a value between %d and %d, got '%s'.\n",
+						 file, linenum, args[0], args[cur_arg],
+						 SKETCH_HLL_MIN_PREC, SKETCH_HLL_MAX_PREC, args[cur_arg + 1]);
+					err_code |= ERR_ALERT | ERR_FATAL;
+					goto out;
+				}
+				cur_sketch->hll.precision = val;
+			}
+			else {
+				ha_alert("parsing [%s:%d] : '%s' : unknown argument '%s', expects %s.\n",
+					 file, linenum, args[0], args[cur_arg],
+					 cur_sketch->type == SKETCH_T_CMS ? "'width', 'depth' or 'period'" : "'precision'");
+				err_code |= ERR_ALERT | ERR_FATAL;
+				goto out;
+			}
+		}
+
+		if (cur_sketch->type == SKETCH_T_CMS && !cur_sketch->cms.period) {
+			ha_alert("parsing [%s:%d] : '%s' : missing 'period' argument.\n",
+				 file, linenum, args[0]);
+			err_code |= ERR_ALERT | ERR_FATAL;
+			goto out;
+		}
+	}
+	else if (*args[0]) {
+		ha_alert("parsing [%s:%d] : unknown keyword '%s' in '%s' section, expects 'count-min' or 'hyperloglog'.\n",
+			 file, linenum, args[0], cursection);
+		err_code |= ERR_ALERT | ERR_FATAL;
+	}
+ out:
+	return err_code;
+}
+
+/* Checks the sketch sections and references, and allocates the sketches.
+ * Returns the number of errors.
+ */
+static int sketch_postparser()
+{
+	struct sketch *sk;
+	int cfgerr = 0;
+
+	list_for_each_entry(sk, &sketches, list) {
+		if (!sk->conf.file) {
+			ha_alert("sketch '%s' referenced %s is not declared.\n",
+				 sk->id, sketch_ref_loc(sk));
+			cfgerr++;
+			continue;
+		}
+
+		if (sk->type == SKETCH_T_NONE) {
+			ha_alert("sketch '%s' declared at %s:%d has no type, expects 'count-min' or 'hyperloglog'.\n",
+				 sk->id, sk->conf.file, sk->conf.line);
+			cfgerr++;
+			continue;
+		}
+
+		if (sk->ref.type != SKETCH_T_NONE && sk->ref.type != sk->type) {
+			ha_alert("sketch '%s' declared at %s:%d is a %s sketch but is used as a %s one %s.\n",
+				 sk->id, sk->conf.file, sk->conf.line, sketch_type_names[sk->type],
+				 sketch_type_names[sk->ref.type], sketch_ref_loc(sk));
+			cfgerr++;
+			continue;
+		}
+
+		if (sk->type == SKETCH_T_CMS)
+			sk->cms.cells = calloc((size_t)sk->cms.width * sk->cms.depth, sizeof(*sk->cms.cells));
+		else
+			sk->hll.regs = calloc(1UL << sk->hll.precision, 1);
+
+		if (!sketch_mem(sk) || (sk->type == SKETCH_T_CMS ? !sk->cms.cells : !sk->hll.regs)) {
+			ha_alert("sketch '%s': out of memory.\n", sk->id);
+			cfgerr++;
+			break;
+		}
+	}
+	return cfgerr;
+}
+
+static void sketch_deinit()
+{
+	struct sketch *sk, *back;
+
+	list_for_each_entry_safe(sk, back, &sketches, list) {
+		LIST_DELETE(&sk->list);
+		if (sk->type == SKETCH_T_CMS)
+			free(sk->cms.cells);
+		else if (sk->type == SKETCH_T_HLL)
+			free(sk->hll.regs);
+		free(sk->id);
+		free(sk);
+	}
+}
+
+REGISTER_CONFIG_SECTION("sketch", cfg_parse_sketch, NULL);
+REGISTER_CONFIG_POSTPARSER("sketch", sketch_postparser);
+REGISTER_POST_DEINIT(sketch_deinit);
+
+/*
+ * Actions
+ */
+
+/* Always returns ACT_RET_CONT. Adds the key built from the rule's expression
+ * to the rule's sketch.
+ */
+static enum act_return action_sketch_add(struct act_rule *rule, struct proxy *px,
+                                         struct session *sess, struct stream *s, int flags)
+{
+	struct sketch *sk = rule->arg.act.p[0];
+	struct sample *smp;
+	int dir;
+
+	dir = (rule->from == ACT_F_TCP_RES_CNT || rule->from == ACT_F_HTTP_RES) ? SMP_OPT_DIR_RES : SMP_OPT_DIR_REQ;
+	smp = sample_fetch_as_type(px, sess, s, dir | SMP_OPT_FINAL, rule->arg.act.p[1], SMP_T_BIN);
+	if (smp)
+		sketch_add(sk, smp->data.u.str.area, smp->data.u.str.data);
+	return ACT_RET_CONT;
+}
+
+static void release_sketch_add(struct act_rule *rule)
+{
+	release_sample_expr(rule->arg.act.p[1]);
+}
+
+/* Parses "sketch-add(<name>) <expr>" which adds a key to a sketch of any type.
+ * Returns ACT_RET_PRS_OK on success, ACT_RET_PRS_ERR on error with <err>
+ * filled.
+ */
+static enum act_parse_ret parse_sketch_add(const char **args, int *arg, struct proxy *px,
+                                           struct act_rule *rule, char **err)
+{
+	const char *kw_name = args[*arg - 1];
+	const char *name = kw_name + strlen("sketch-add");
+	struct sample_expr *expr;
+	struct sketch *sk;
+	char *id;
+	size_t len;
+	unsigned int flags;
+
+	len = strlen(name);
+	if (len < 3 || *name != '(' || name[len - 1] != ')') {
+		memprintf(err, "invalid or incomplete action '%s'. Expects 'sketch-add(<name>)'", kw_name);
+		return ACT_RET_PRS_ERR;
+	}
+
+	id = my_strndup(name + 1, len - 2);
+	if (!id) {
+		memprintf(err, "out of memory");
+		return ACT_RET_PRS_ERR;
+	}
+
+	/* any type is accepted here */
+	sk = sketch_get_ref(id, SKETCH_T_NONE, px->conf.args.file, px->conf.args.line, err);
+	free(id);
+	if (!sk)
+		return ACT_RET_PRS_ERR;
+
+	switch (rule->from) {
+	case ACT_F_TCP_REQ_CON: flags = SMP_VAL_FE_CON_ACC; break;
+	case ACT_F_TCP_REQ_SES: flags = SMP_VAL_FE_SES_ACC; break;
+	case ACT_F_TCP_REQ_CNT: flags = SMP_VAL_FE_REQ_CNT; break;
+	case ACT_F_TCP_RES_CNT: flags = SMP_VAL_BE_RES_CNT; break;
+	case ACT_F_HTTP_REQ:    flags = SMP_VAL_FE_HRQ_HDR; break;
+	case ACT_F_HTTP_RES:    flags = SMP_VAL_BE_HRS_HDR; break;
+	default:
+		memprintf(err, "internal error, unexpected rule->from=%d, please report this bug!", rule->from);
+		return ACT_RET_PRS_ERR;
+	}
+
+	expr = sample_parse_expr((char **)args, arg, px->conf.args.file, px->conf.args.line,
+	                         err, &px->conf.args, NULL);
+	if (!expr)
+		return ACT_RET_PRS_ERR;
+
+	if (!(expr->fetch->val & flags)) {
+		memprintf(err, "fetch method '%s' extracts information from '%s', none of which is available here",
+			  args[*arg - 1], sample_src_names(expr->fetch->use));
+		release_sample_expr(expr);
+		return ACT_RET_PRS_ERR;
+	}
+
+	rule->arg.act.p[0] = sk;
+	rule->arg.act.p[1] = expr;
+	rule->action = ACT_CUSTOM;
+	rule->action_ptr = action_sketch_add;
+	rule->release_ptr = release_sketch_add;
+	return ACT_RET_PRS_OK;
+}
+
+static struct action_kw_list tcp_req_conn_kws = { { }, {
+	{ "sketch-add", parse_sketch_add, KWF_MATCH_PREFIX },
+	{ /* END */ }
+}};
+
+INITCALL1(STG_REGISTER, tcp_req_conn_keywords_register, &tcp_req_conn_kws);
+
+static struct action_kw_list tcp_req_sess_kws = { { }, {
+	{ "sketch-add", parse_sketch_add, KWF_MATCH_PREFIX },
+	{ /* END */ }
+}};
+
+INITCALL1(STG_REGISTER, tcp_req_sess_keywords_register, &tcp_req_sess_kws);
+
+static struct action_kw_list tcp_req_cont_kws = { { }, {
+	{ "sketch-add", parse_sketch_add, KWF_MATCH_PREFIX },
+	{ /* END */ }
+}};
+
+INITCALL1(STG_REGISTER, tcp_req_cont_keywords_register, &tcp_req_cont_kws);
+
+static struct action_kw_list tcp_res_kws = { { }, {
+	{ "sketch-add", parse_sketch_add, KWF_MATCH_PREFIX },
+	{ /* END */ }
+}};
+
+INITCALL1(STG_REGISTER, tcp_res_cont_keywords_register, &tcp_res_kws);
+
+static struct action_kw_list http_req_kws = { { }, {
+	{ "sketch-add", parse_sketch_add, KWF_MATCH_PREFIX },
+	{ /* END */ }
+}};
+
+INITCALL1(STG_REGISTER, http_req_keywords_register, &http_req_kws);
+
+static struct action_kw_list http_res_kws = { { }, {
+	{ "sketch-add", parse_sketch_add, KWF_MATCH_PREFIX },
+	{ /* END */ }
+}};
+
+INITCALL1(STG_REGISTER, http_res_keywords_register, &http_res_kws);
+
+/*
+ * Sample fetches and converters
+ */
+
+/* Replaces the sketch name in <arg> with a pointer to the sketch, which must
+ * be of type <type>. Returns 0 with <err> filled on error, otherwise 1.
+ */
+static int sketch_resolve_arg(struct arg *arg, enum sketch_type type,
+                              const char *file, int line, char **err)
+{
+	struct sketch *sk;
+
+	sk = sketch_get_ref(arg->data.str.area, type, file, line, err);
+	if (!sk)
+		return 0;
+
+	chunk_destroy(&arg->data.str);
+	arg->type = ARGT_PTR;
+	arg->data.ptr = sk;
+	return 1;
+}
+
+static int smp_check_sketch_count(struct arg *args, char **err)
+{
+	return sketch_resolve_arg(&args[0], SKETCH_T_HLL, NULL, 0, err);
+}
+
+static int conv_check_sketch_rate(struct arg *args, struct sample_conv *conv,
+                                  const char *file, int line, char **err)
+{
+	return sketch_resolve_arg(&args[0], SKETCH_T_CMS, file, line, err);
+}
+
+/* Returns the estimated number of distinct keys in the HyperLogLog sketch in
+ * args[0].
+ */
+static int smp_fetch_sketch_count(const struct arg *args, struct sample *smp, const char *kw, void *private)
+{
+	smp->flags = SMP_F_VOL_TEST;
+	smp->data.type = SMP_T_SINT;
+	smp->data.u.sint = sketch_hll_count(args[0].data.ptr);
+	return 1;
+}
+
+/* Takes a key as input and returns its estimated rate from the count-min
+ * sketch in args[0].
+ */
+static int sample_conv_sketch_rate(const struct arg *args, struct sample *smp, void *private)
+{
+	smp->data.u.sint = sketch_cms_rate(args[0].data.ptr, smp->data.u.str.area, smp->data.u.str.data);
+	smp->data.type = SMP_T_SINT;
+	smp->flags |= SMP_F_VOL_TEST;
+	return 1;
+}
+
+static struct sample_fetch_kw_list smp_fetch_keywords = {ILH, {
+	{ "sketch_count", smp_fetch_sketch_count, ARG1(1,STR), smp_check_sketch_count, SMP_T_SINT, SMP_USE_CONST },
+	{ /* END */ },
+}};
+
+INITCALL1(STG_REGISTER, sample_register_fetches, &smp_fetch_keywords);
+
+static struct sample_conv_kw_list sample_conv_kws = {ILH, {
+	{ "sketch_rate", sample_conv_sketch_rate, ARG1(1,STR), conv_check_sketch_rate, SMP_T_BIN, SMP_T_SINT },
+	{ /* END */ },
+}};
+
+INITCALL1(STG_REGISTER, sample_register_convs, &sample_conv_kws);
+
+/*
+ * CLI
+ */
+
+/* Parses "show sketch [<name>]" and "clear sketch <name>". */
+static int cli_parse_sketch(char **args, char *payload, struct appctx *appctx, void *private)
+{
+	struct sketch *sk = NULL;
+
+	if (!cli_has_level(appctx, private ? ACCESS_LVL_ADMIN : ACCESS_LVL_OPER))
+		return 1;
+
+	if (*args[2]) {
+		sk = sketch_find(args[2]);
+		if (!sk)
+			return cli_err(appctx, "No such sketch.\n");
+	}
+	else if (private)
+		return cli_err(appctx, "Missing sketch name.\n");
+
+	if (private) {
+		sketch_clear(sk);
+		return 1;
+	}
+
+	appctx->ctx.cli.p0 = sk;
+	appctx->ctx.cli.i0 = !!sk;
+	return 0;
+}
+
+/* Dumps one line per sketch, or only the one being targeted. */
+static int cli_io_handler_show_sketch(struct appctx *appctx)
+{
+	struct stream_interface *si = appctx->owner;
+	struct sketch *sk = appctx->ctx.cli.p0;
+
+	if (!sk)
+		sk = LIST_ELEM(sketches.n, struct sketch *, list);
+
+	list_for_each_entry_from(sk, &sketches, list) {
+		chunk_printf(&trash, "%s: type=%s mem=%lu", sk->id, sketch_type_names[sk->type],
+		             (unsigned long)sketch_mem(sk));
+		if (sk->type == SKETCH_T_CMS)
+			chunk_appendf(&trash, " width=%u depth=%u period=%u\n",
+			              sk->cms.width, sk->cms.depth, TICKS_TO_MS(sk->cms.period));
+		else
+			chunk_appendf(&trash, " precision=%u count=%llu\n",
+			              sk->hll.precision, sketch_hll_count(sk));
+
+		if (ci_putchk(si_ic(si), &trash) == -1) {
+			appctx->ctx.cli.p0 = sk;
+			si_rx_room_blk(si);
+			return 0;
+		}
+
+		if (appctx->ctx.cli.i0)
+			break;
+	}
+	return 1;
+}
+
+static struct cli_kw_list cli_kws = {{ },{
+	{ { "clear", "sketch", NULL }, "clear sketch <name>                     : reset all counters of a sketch",                    cli_parse_sketch, NULL, NULL, (void *)1 },
+	{ { "show",  "sketch", NULL }, "show sketch [<name>]                    : report the sketches' settings and distinct counts", cli_parse_sketch, cli_io_handler_show_sketch, NULL, NULL },
+	{{},}
+}};
+
+INITCALL1(STG_REGISTER, cli_register_kw, &cli_kws);
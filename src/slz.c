@@ -28,6 +28,10 @@
 #include <import/slz.h>
 #include <import/slz-tables.h>
 
+#if defined(__PCLMUL__) && defined(__SSE4_1__)
+#include <immintrin.h>
+#endif
+
 /* First, RFC1951-specific declarations and extracts from the RFC.
  *
  * RFC1951 - deflate stream format
@@ -396,6 +400,13 @@ static inline long memmatch(const unsigned char *a, const unsigned char *b, long
 
 	while (1) {
 		if ((long)(len + 2 * sizeof(long)) > max) {
+			/* less than two words left, try a last word first */
+			if ((long)(len + sizeof(long)) <= max) {
+				xor = *(long *)&a[len] ^ *(long *)&b[len];
+				if (xor)
+					break;
+				len += sizeof(long);
+			}
 			while (len < max) {
 				if (a[len] != b[len])
 					break;
@@ -415,36 +426,11 @@ static inline long memmatch(const unsigned char *a, const unsigned char *b, long
 		len += sizeof(long);
 	}
 
-#if defined(__x86_64__) || defined(__i386__) || defined(__i486__) || defined(__i586__) || defined(__i686__)
-	/* x86 has bsf. We know that xor is non-null here */
-	asm("bsf %1,%0\n" : "=r"(xor) : "0" (xor));
-	return len + xor / 8;
-#else
-	if (sizeof(long) > 4 && !(xor & 0xffffffff)) {
-		/* This code is optimized out on 32-bit archs, but we still
-		 * need to shift in two passes to avoid a warning. It is
-		 * properly optimized out as a single shift.
-		 */
-		xor >>= 16; xor >>= 16;
-		if (xor & 0xffff) {
-			if (xor & 0xff)
-				return len + 4;
-			return len + 5;
-		}
-		if (xor & 0xffffff)
-			return len + 6;
-		return len + 7;
-	}
-
-	if (xor & 0xffff) {
-		if (xor & 0xff)
-			return len;
-		return len + 1;
-	}
-	if (xor & 0xffffff)
-		return len + 2;
-	return len + 3;
-#endif // x86
+	/* we know that xor is non-null here, and the first differing byte is
+	 * the lowest non-null one. This uses bsf/tzcnt on x86 and rbit+clz on
+	 * ARMv8.
+	 */
+	return len + __builtin_ctzl(xor) / 8;
 
 #else // UNALIGNED_LE_OK
 	/* This is the generic version for big endian or unaligned-incompatible
@@ -892,6 +878,109 @@ static inline uint32_t crc32_uint32(uint32_t data)
 	return data;
 }
 
+#if defined(__PCLMUL__) && defined(__SSE4_1__)
+/* Computes the crc32 of <buf> over <len> bytes using carry-less
+ * multiplications to fold 64 bytes at a time, as described in Intel's paper
+ * "Fast CRC Computation for Generic Polynomials Using PCLMULQDQ Instruction".
+ * The constants are the bit-reflected ones for the gzip polynomial. <len> must
+ * be a multiple of 16 and at least 64.
+ */
+static uint32_t crc32_fold_pclmul(uint32_t crc, const unsigned char *buf, long len)
+{
+	static const uint64_t k1k2[2] __attribute__((aligned(16))) = { 0x0154442bd4, 0x01c6e41596 };
+	static const uint64_t k3k4[2] __attribute__((aligned(16))) = { 0x01751997d0, 0x00ccaa009e };
+	static const uint64_t k5k0[2] __attribute__((aligned(16))) = { 0x0163cd6124, 0x0000000000 };
+	static const uint64_t poly[2] __attribute__((aligned(16))) = { 0x01db710641, 0x01f7011641 };
+	__m128i x0, x1, x2, x3, x4, x5, x6, x7, x8, y5, y6, y7, y8;
+
+	x1 = _mm_loadu_si128((__m128i *)(buf + 0x00));
+	x2 = _mm_loadu_si128((__m128i *)(buf + 0x10));
+	x3 = _mm_loadu_si128((__m128i *)(buf + 0x20));
+	x4 = _mm_loadu_si128((__m128i *)(buf + 0x30));
+	x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128(~crc));
+	x0 = _mm_load_si128((__m128i *)k1k2);
+	buf += 64;
+	len -= 64;
+
+	/* fold four 128-bit lanes in parallel */
+	while (len >= 64) {
+		x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+		x6 = _mm_clmulepi64_si128(x2, x0, 0x00);
+		x7 = _mm_clmulepi64_si128(x3, x0, 0x00);
+		x8 = _mm_clmulepi64_si128(x4, x0, 0x00);
+
+		x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+		x2 = _mm_clmulepi64_si128(x2, x0, 0x11);
+		x3 = _mm_clmulepi64_si128(x3, x0, 0x11);
+		x4 = _mm_clmulepi64_si128(x4, x0, 0x11);
+
+		y5 = _mm_loadu_si128((__m128i *)(buf + 0x00));
+		y6 = _mm_loadu_si128((__m128i *)(buf + 0x10));
+		y7 = _mm_loadu_si128((__m128i *)(buf + 0x20));
+		y8 = _mm_loadu_si128((__m128i *)(buf + 0x30));
+
+		x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), y5);
+		x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), y6);
+		x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), y7);
+		x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), y8);
+
+		buf += 64;
+		len -= 64;
+	}
+
+	/* fold the four lanes into a single one */
+	x0 = _mm_load_si128((__m128i *)k3k4);
+
+	x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+	x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+	x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+
+	x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+	x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+	x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+
+	x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+	x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+	x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+
+	/* fold the remaining 16-byte blocks */
+	while (len >= 16) {
+		x2 = _mm_loadu_si128((__m128i *)buf);
+
+		x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+		x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+		x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+
+		buf += 16;
+		len -= 16;
+	}
+
+	/* reduce 128 bits to 64 bits */
+	x2 = _mm_clmulepi64_si128(x1, x0, 0x10);
+	x3 = _mm_setr_epi32(~0, 0, ~0, 0);
+	x1 = _mm_srli_si128(x1, 8);
+	x1 = _mm_xor_si128(x1, x2);
+
+	x0 = _mm_loadl_epi64((__m128i *)k5k0);
+
+	x2 = _mm_srli_si128(x1, 4);
+	x1 = _mm_and_si128(x1, x3);
+	x1 = _mm_clmulepi64_si128(x1, x0, 0x00);
+	x1 = _mm_xor_si128(x1, x2);
+
+	/* Barrett reduction to 32 bits */
+	x0 = _mm_load_si128((__m128i *)poly);
+
+	x2 = _mm_and_si128(x1, x3);
+	x2 = _mm_clmulepi64_si128(x2, x0, 0x10);
+	x2 = _mm_and_si128(x2, x3);
+	x2 = _mm_clmulepi64_si128(x2, x0, 0x00);
+	x1 = _mm_xor_si128(x1, x2);
+
+	return ~(uint32_t)_mm_extract_epi32(x1, 1);
+}
+#endif
+
 /* Modified version originally from RFC1952, working with non-inverting CRCs */
 uint32_t slz_crc32_by1(uint32_t crc, const unsigned char *buf, int len)
 {
@@ -909,6 +998,13 @@ uint32_t slz_crc32_by4(uint32_t crc, const unsigned char *buf, int len)
 {
 	const unsigned char *end = buf + len;
 
+#if defined(__PCLMUL__) && defined(__SSE4_1__)
+	if (len >= 64) {
+		crc = crc32_fold_pclmul(crc, buf, len & ~15);
+		buf += len & ~15;
+	}
+#endif
+
 	while (buf <= end - 16) {
 #ifdef UNALIGNED_LE_OK
 #if defined(__ARM_FEATURE_CRC32)
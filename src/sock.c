@@ -25,11 +25,19 @@
 
 #include <net/if.h>
 
+#ifdef __linux__
+#include <poll.h>
+#include <linux/errqueue.h>
+#endif
+
 #include <haproxy/api.h>
 #include <haproxy/connection.h>
+#include <haproxy/dynbuf.h>
 #include <haproxy/listener.h>
 #include <haproxy/log.h>
 #include <haproxy/namespace.h>
+#include <haproxy/pool.h>
+#include <haproxy/server.h>
 #include <haproxy/sock.h>
 #include <haproxy/sock_inet.h>
 #include <haproxy/tools.h>
@@ -37,6 +45,14 @@
 /* the list of remaining sockets transferred from an older process */
 struct xfer_sock_list *xfer_sock_list = NULL;
 
+#ifdef HA_HAVE_MSG_ZEROCOPY
+DECLARE_STATIC_POOL(pool_head_sock_zc, "sock_zc", sizeof(struct sock_zc));
+DECLARE_STATIC_POOL(pool_head_sock_zc_buf, "sock_zc_buf", sizeof(struct sock_zc_buf));
+
+/* buffers still held by the kernel for connections which were closed */
+static THREAD_LOCAL struct list sock_zc_orphans;
+#endif
+
 
 /* Accept an incoming connection from listener <l>, and return it, as well as
  * a CO_AC_* status code into <status> if not null. Null is returned on error.
@@ -525,6 +541,220 @@ int sock_get_old_sockets(const char *unixsocket)
 	return (ret2);
 }
 
+/* Reads from <blk> of <len> bytes at offset <*ofs> a proxy name and a server
+ * name, each preceded by its length, into <px> and <srv> which must be at
+ * least 256 bytes long. Returns 0 on success or -1 if <blk> is truncated.
+ */
+static int sock_get_srv_names(const unsigned char *blk, size_t len, size_t *ofs, char *px, char *srv)
+{
+	size_t nlen;
+
+	if (*ofs >= len || *ofs + 1 + (nlen = blk[*ofs]) > len)
+		return -1;
+	memcpy(px, blk + *ofs + 1, nlen);
+	px[nlen] = 0;
+	*ofs += 1 + nlen;
+
+	if (*ofs >= len || *ofs + 1 + (nlen = blk[*ofs]) > len)
+		return -1;
+	memcpy(srv, blk + *ofs + 1, nlen);
+	srv[nlen] = 0;
+	*ofs += 1 + nlen;
+	return 0;
+}
+
+/* Try to retrieve the idle backend connections and the TLS sessions exported
+ * by the old process at CLI <unixsocket> (see "_getidleconns"), and pass them
+ * to the servers, which will adopt the connections once started. Returns 0 on
+ * success, -1 on failure. Connections which could not be transferred are
+ * simply lost, the old process having already given up on them.
+ */
+int sock_get_old_idle_conns(const char *unixsocket)
+{
+	char *cmsgbuf = NULL;
+	unsigned char *meta = NULL, *sess = NULL;
+	char px_name[256], srv_name[256];
+	struct sockaddr_un addr;
+	struct cmsghdr *cmsg;
+	struct msghdr msghdr;
+	struct iovec iov;
+	struct timeval tv = { .tv_sec = 1, .tv_usec = 0 };
+	int hdr[4];
+	int *tmpfd = NULL;
+	int sock = -1;
+	int ret = -1;
+	int got_fd = 0;
+	int cur_fd = 0;
+	size_t curoff = 0;
+
+	memset(&msghdr, 0, sizeof(msghdr));
+	cmsgbuf = malloc(CMSG_SPACE(sizeof(int)) * MAX_SEND_FD);
+	if (!cmsgbuf) {
+		ha_warning("Failed to allocate memory to receive idle connections\n");
+		goto out;
+	}
+
+	sock = socket(PF_UNIX, SOCK_STREAM, 0);
+	if (sock < 0) {
+		ha_warning("Failed to connect to the old process socket '%s'\n", unixsocket);
+		goto out;
+	}
+
+	strncpy(addr.sun_path, unixsocket, sizeof(addr.sun_path) - 1);
+	addr.sun_path[sizeof(addr.sun_path) - 1] = 0;
+	addr.sun_family = PF_UNIX;
+
+	if (connect(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+		ha_warning("Failed to connect to the old process socket '%s'\n", unixsocket);
+		goto out;
+	}
+
+	setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, (void *)&tv, sizeof(tv));
+	if (send(sock, "_getidleconns\n", strlen("_getidleconns\n"), 0) != strlen("_getidleconns\n") ||
+	    recv(sock, hdr, sizeof(hdr), MSG_WAITALL) != sizeof(hdr) ||
+	    hdr[0] != SOCK_IDLE_CONNS_MAGIC) {
+		ha_warning("The old process did not hand its idle connections over, it may be too old.\n");
+		goto out;
+	}
+
+	if (hdr[1] < 0 || hdr[2] < 0 || hdr[3] < 0 || (hdr[1] && !hdr[2])) {
+		ha_warning("Inconsistency while transferring idle connections\n");
+		goto out;
+	}
+
+	if (hdr[1]) {
+		tmpfd = malloc(hdr[1] * sizeof(int));
+		meta = malloc(hdr[2]);
+		if (!tmpfd || !meta) {
+			ha_warning("Failed to allocate memory while receiving idle connections\n");
+			goto out;
+		}
+	}
+
+	msghdr.msg_iov = &iov;
+	msghdr.msg_iovlen = 1;
+
+	while (curoff < hdr[2]) {
+		ssize_t len;
+		int ret3;
+		int nb = 0;
+
+		/* never read past the FD descriptions */
+		iov.iov_base = meta + curoff;
+		iov.iov_len = hdr[2] - curoff;
+		msghdr.msg_control = cmsgbuf;
+		msghdr.msg_controllen = CMSG_SPACE(sizeof(int)) * MAX_SEND_FD;
+
+		len = recvmsg(sock, &msghdr, 0);
+		if (len == -1 && errno == EINTR)
+			continue;
+
+		if (len <= 0)
+			break;
+
+		for (cmsg = CMSG_FIRSTHDR(&msghdr); cmsg != NULL; cmsg = CMSG_NXTHDR(&msghdr, cmsg)) {
+			if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+				size_t totlen = cmsg->cmsg_len - CMSG_LEN(0);
+				size_t i;
+
+				for (i = 0; i < totlen / sizeof(int); i++) {
+					int fd;
+
+					/* Be paranoid and use memcpy() to avoid any
+					 * potential alignment issue.
+					 */
+					memcpy(&fd, CMSG_DATA(cmsg) + i * sizeof(int), sizeof(int));
+					if (got_fd < hdr[1])
+						tmpfd[got_fd++] = fd;
+					else
+						close(fd);
+				}
+				nb++;
+			}
+		}
+
+		/* Send an ack to let the sender know we got the FDs and it can
+		 * send some more.
+		 */
+		if (nb) {
+			do {
+				ret3 = send(sock, &got_fd, sizeof(got_fd), 0);
+			} while (ret3 == -1 && errno == EINTR);
+		}
+		curoff += len;
+	}
+
+	if (got_fd != hdr[1] || curoff != hdr[2]) {
+		ha_warning("We didn't get the expected number of idle connections (expecting %d got %d)\n",
+			   hdr[1], got_fd);
+		goto out;
+	}
+
+	/* pass the connections to their servers */
+	curoff = 0;
+	for (cur_fd = 0; cur_fd < got_fd; cur_fd++) {
+		if (sock_get_srv_names(meta, hdr[2], &curoff, px_name, srv_name) < 0) {
+			ha_warning("Inconsistency while transferring idle connections\n");
+			goto out;
+		}
+
+		if (srv_inherit_idle_conn(px_name, srv_name, tmpfd[cur_fd]) < 0)
+			close(tmpfd[cur_fd]);
+	}
+
+	/* then the TLS sessions, if any */
+	if (hdr[3]) {
+		sess = malloc(hdr[3]);
+		if (!sess) {
+			ha_warning("Failed to allocate memory while receiving TLS sessions\n");
+			goto out;
+		}
+
+		if (recv(sock, sess, hdr[3], MSG_WAITALL) != hdr[3]) {
+			ha_warning("Failed to receive the TLS sessions\n");
+			goto out;
+		}
+
+		curoff = 0;
+		while (curoff < hdr[3]) {
+			uint32_t len;
+
+			if (sock_get_srv_names(sess, hdr[3], &curoff, px_name, srv_name) < 0 ||
+			    curoff + sizeof(len) > hdr[3]) {
+				ha_warning("Inconsistency while transferring TLS sessions\n");
+				goto out;
+			}
+
+			memcpy(&len, sess + curoff, sizeof(len));
+			curoff += sizeof(len);
+			if (len > hdr[3] - curoff) {
+				ha_warning("Inconsistency while transferring TLS sessions\n");
+				goto out;
+			}
+
+			srv_inherit_ssl_session(px_name, srv_name, sess + curoff, len);
+			curoff += len;
+		}
+	}
+
+	ret = 0;
+ out:
+	/* If we failed midway make sure to close the remaining
+	 * file descriptors
+	 */
+	for (; cur_fd < got_fd; cur_fd++)
+		close(tmpfd[cur_fd]);
+
+	free(tmpfd);
+	free(meta);
+	free(sess);
+	free(cmsgbuf);
+
+	if (sock != -1)
+		close(sock);
+	return ret;
+}
+
 /* When binding the receivers, check if a socket has been sent to us by the
  * previous process that we could reuse, instead of creating a new one. Note
  * that some address family-specific options are checked on the listener and
@@ -642,10 +872,212 @@ void sock_conn_ctrl_init(struct connection *conn)
  */
 void sock_conn_ctrl_close(struct connection *conn)
 {
+#ifdef HA_HAVE_MSG_ZEROCOPY
+	if (conn->zc)
+		sock_zc_release(conn);
+#endif
 	fd_delete(conn->handle.fd);
 	conn->handle.fd = DEAD_FD_MAGIC;
 }
 
+#ifdef HA_HAVE_MSG_ZEROCOPY
+/* releases the buffer storage held by <zb> and <zb> itself */
+static void sock_zc_free(struct sock_zc_buf *zb)
+{
+	pool_free(pool_head_buffer, zb->area);
+	pool_free(pool_head_sock_zc_buf, zb);
+}
+
+/* releases the orphan buffers which expired, or all of them if <all> is set */
+static void sock_zc_flush_orphans(int all)
+{
+	struct sock_zc_buf *zb, *back;
+
+	list_for_each_entry_safe(zb, back, &sock_zc_orphans, list) {
+		if (!all && !tick_is_expired(zb->expire, now_ms))
+			break;
+		LIST_DELETE(&zb->list);
+		sock_zc_free(zb);
+	}
+}
+
+/* Checks whether a zero-copy send may be attempted on connection <conn>, and
+ * if so, returns a sock_zc_buf with a new buffer storage in ->area that the
+ * caller will have to pass either to sock_zc_hold() once it sent data, or to
+ * sock_zc_cancel() otherwise. Returns NULL if no zero-copy send is possible
+ * now.
+ */
+struct sock_zc_buf *sock_zc_prepare(struct connection *conn)
+{
+	struct sock_zc *zc = conn->zc;
+	struct sock_zc_buf *zb;
+	int one = 1;
+
+	sock_zc_flush_orphans(0);
+
+	if (!zc) {
+		zc = pool_alloc(pool_head_sock_zc);
+		if (!zc)
+			return NULL;
+		LIST_INIT(&zc->held);
+		zc->next_id = 0;
+		zc->nheld = 0;
+		zc->flags = 0;
+		if (setsockopt(conn->handle.fd, SOL_SOCKET, SO_ZEROCOPY, &one, sizeof(one)) == -1)
+			zc->flags |= SOCK_ZC_F_DISABLED;
+		conn->zc = zc;
+	}
+
+	if (zc->flags & SOCK_ZC_F_DISABLED)
+		return NULL;
+
+	if (zc->nheld >= SOCK_ZC_MAX_HELD) {
+		sock_zc_reap(conn);
+		if (zc->nheld >= SOCK_ZC_MAX_HELD)
+			return NULL;
+	}
+
+	zb = pool_alloc(pool_head_sock_zc_buf);
+	if (!zb)
+		return NULL;
+
+	zb->area = pool_alloc(pool_head_buffer);
+	if (!zb->area) {
+		pool_free(pool_head_sock_zc_buf, zb);
+		return NULL;
+	}
+	return zb;
+}
+
+/* Returns <zb> and its storage after sock_zc_prepare() if no zero-copy send
+ * was finally performed.
+ */
+void sock_zc_cancel(struct sock_zc_buf *zb)
+{
+	sock_zc_free(zb);
+}
+
+/* Attaches <zb> to connection <conn> to hold buffer storage <area> which was
+ * passed to the kernel by <ids> successful zero-copy sends. <zb>'s previous
+ * storage must have been handed to the caller in exchange.
+ */
+void sock_zc_hold(struct connection *conn, struct sock_zc_buf *zb, char *area, uint ids)
+{
+	struct sock_zc *zc = conn->zc;
+
+	zb->area    = area;
+	zb->lo      = zc->next_id;
+	zb->hi      = zc->next_id + ids - 1;
+	zb->pending = ids;
+	zc->next_id += ids;
+	LIST_APPEND(&zc->held, &zb->list);
+	zc->nheld++;
+	_HA_ATOMIC_ADD(&activity[tid].zc_sent, ids);
+}
+
+/* Retrieves the zero-copy notifications pending on <conn>'s socket and releases
+ * the buffers the kernel doesn't need anymore. Since these notifications are
+ * reported as socket errors, the FD's error flag is cleared if no real error
+ * remains.
+ */
+void sock_zc_reap(struct connection *conn)
+{
+	struct sock_zc *zc = conn->zc;
+	struct sock_zc_buf *zb, *back;
+	struct sock_extended_err *serr;
+	struct cmsghdr *cmsg;
+	struct msghdr msg;
+	struct pollfd pfd;
+	char control[128];
+	uint32_t lo, hi;
+	int fd = conn->handle.fd;
+
+	while (1) {
+		memset(&msg, 0, sizeof(msg));
+		msg.msg_control = control;
+		msg.msg_controllen = sizeof(control);
+
+		if (recvmsg(fd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) == -1)
+			break;
+
+		for (cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+			if (!((cmsg->cmsg_level == SOL_IP && cmsg->cmsg_type == IP_RECVERR) ||
+			      (cmsg->cmsg_level == SOL_IPV6 && cmsg->cmsg_type == IPV6_RECVERR)))
+				continue;
+
+			serr = (struct sock_extended_err *)CMSG_DATA(cmsg);
+			if (serr->ee_errno != 0 || serr->ee_origin != SO_EE_ORIGIN_ZEROCOPY)
+				continue;
+
+			/* the kernel had to copy the data (e.g. loopback or
+			 * missing NIC support), zero-copy is only a waste here.
+			 */
+			if (serr->ee_code & SO_EE_CODE_ZEROCOPY_COPIED) {
+				zc->flags |= SOCK_ZC_F_DISABLED;
+				_HA_ATOMIC_INC(&activity[tid].zc_copied);
+			}
+
+			lo = serr->ee_info;
+			hi = serr->ee_data;
+			list_for_each_entry_safe(zb, back, &zc->held, list) {
+				uint32_t from = MAX(lo, zb->lo);
+				uint32_t to   = MIN(hi, zb->hi);
+
+				if (from > to)
+					continue;
+
+				zb->pending -= to - from + 1;
+				if (!zb->pending) {
+					LIST_DELETE(&zb->list);
+					zc->nheld--;
+					sock_zc_free(zb);
+				}
+			}
+		}
+	}
+
+	/* poll() doesn't consume the error contrary to SO_ERROR */
+	pfd.fd = fd;
+	pfd.events = 0;
+	if (poll(&pfd, 1, 0) >= 0 && !(pfd.revents & POLLERR))
+		_HA_ATOMIC_AND(&fdtab[fd].state, ~FD_POLL_ERR);
+}
+
+/* Releases the zero-copy context of connection <conn> before its socket gets
+ * closed. The buffers the kernel still holds are orphaned for a while.
+ */
+void sock_zc_release(struct connection *conn)
+{
+	struct sock_zc *zc = conn->zc;
+	struct sock_zc_buf *zb, *back;
+
+	sock_zc_reap(conn);
+	sock_zc_flush_orphans(0);
+	list_for_each_entry_safe(zb, back, &zc->held, list) {
+		LIST_DELETE(&zb->list);
+		zb->expire = tick_add(now_ms, MS_TO_TICKS(SOCK_ZC_ORPHAN_DELAY));
+		LIST_APPEND(&sock_zc_orphans, &zb->list);
+	}
+	pool_free(pool_head_sock_zc, zc);
+	conn->zc = NULL;
+}
+
+static int sock_zc_init_per_thread()
+{
+	LIST_INIT(&sock_zc_orphans);
+	return 1;
+}
+
+/* releases all orphans on exit */
+static void sock_zc_deinit_per_thread()
+{
+	sock_zc_flush_orphans(1);
+}
+
+REGISTER_PER_THREAD_ALLOC(sock_zc_init_per_thread);
+REGISTER_PER_THREAD_FREE(sock_zc_deinit_per_thread);
+#endif /* HA_HAVE_MSG_ZEROCOPY */
+
 /* This is the callback which is set when a connection establishment is pending
  * and we have nothing to send. It may update the FD polling status to indicate
  * !READY. It returns 0 if it fails in a fatal way or needs to poll to go
@@ -753,6 +1185,8 @@ void sock_conn_iocb(int fd)
 
 	flags = conn->flags & ~CO_FL_ERROR; /* ensure to call the wake handler upon error */
 
+	sock_zc_check_err(conn);
+
 	if (unlikely(conn->flags & CO_FL_WAIT_L4_CONN) &&
 	    ((fd_send_ready(fd) && fd_send_active(fd)) ||
 	     (fd_recv_ready(fd) && fd_recv_active(fd)))) {
@@ -832,6 +1266,7 @@ int sock_drain(struct connection *conn)
 	int fd = conn->handle.fd;
 	int len;
 
+	sock_zc_check_err(conn);
 	if (fdtab[fd].state & (FD_POLL_ERR|FD_POLL_HUP))
 		goto shut;
 
@@ -0,0 +1,391 @@
+/*
+ * In-kernel redirection of TCP traffic between two sockets using BPF sockmaps
+ *
+ * Copyright 2021 HAProxy Technologies
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ *
+ * Two maps are used. The "peers" map is a sockhash which, for each linked
+ * socket, stores its peer under the socket's cookie. No program is attached
+ * to it, it only serves as a redirect target. The "links" map is a sockmap
+ * indexed by FD, to which a stream parser and a stream verdict programs are
+ * attached: once a socket is inserted there, all data it receives are passed
+ * to the verdict program which redirects them to the peer found in the peers
+ * map, so that they never reach user space. The programs are hand-assembled
+ * and loaded with the raw bpf() syscall so that no external library nor BPF
+ * compiler is needed.
+ *
+ * Both sockets are always inserted into the peers map first, so that a
+ * redirect target always exists. Inserting a socket into the links map also
+ * runs the data already queued on it through the verdict program, so that no
+ * reordering may happen as long as the caller has no pending data for either
+ * socket.
+ *
+ * Since the data don't pass through user space anymore, the byte counts are
+ * retrieved from the TCP stack: the bytes received on a socket come from
+ * TCP_INFO, and the bytes written to a socket are the bytes acked plus the
+ * ones still in the send queue. Both are recorded at link time so that only
+ * the redirected part is reported. What was reported as received on a socket
+ * is also accounted as forwarded to its peer, which allows to tell how much of
+ * it is still in flight towards the peer even once the first socket is closed.
+ */
+
+#include <errno.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <linux/bpf.h>
+
+#include <haproxy/api.h>
+#include <haproxy/errors.h>
+#include <haproxy/global.h>
+#include <haproxy/proxy.h>
+#include <haproxy/sockmap.h>
+#include <haproxy/tools.h>
+
+#ifndef SO_COOKIE
+#define SO_COOKIE 57
+#endif
+
+/* the libc's struct tcp_info stops before the 64-bit counters that were added
+ * later to the kernel's one, which is append-only. These are the first ones.
+ */
+struct sockmap_tcp_info {
+	struct tcp_info info;
+	uint64_t pacing_rate;
+	uint64_t max_pacing_rate;
+	uint64_t bytes_acked;
+	uint64_t bytes_received;
+};
+
+/* per-FD counters recorded when the socket was linked */
+struct sockmap_sk {
+	uint64_t rcvd;   /* bytes received at link time */
+	uint64_t sent;   /* bytes written at link time */
+	uint64_t taken;  /* received bytes already reported */
+	uint64_t fwd;    /* bytes reported as taken from the peer */
+	int peer;        /* FD of the peer */
+};
+
+int sockmap_ready = 0;
+
+static int sockmap_links = -1;           /* sockmap with the programs, indexed by FD */
+static int sockmap_peers = -1;           /* sockhash of the peers, indexed by cookie */
+static struct sockmap_sk *sockmap_sk;    /* indexed by FD */
+
+#define SM_INSN(c, d, s, o, i) \
+	((struct bpf_insn){ .code = (c), .dst_reg = (d), .src_reg = (s), .off = (o), .imm = (i) })
+
+static int sockmap_bpf(int cmd, union bpf_attr *attr)
+{
+	return syscall(__NR_bpf, cmd, attr, sizeof(*attr));
+}
+
+static int sockmap_create(int type, int key_size, int max_entries)
+{
+	union bpf_attr attr;
+
+	memset(&attr, 0, sizeof(attr));
+	attr.map_type    = type;
+	attr.key_size    = key_size;
+	attr.value_size  = sizeof(int);
+	attr.max_entries = max_entries;
+	return sockmap_bpf(BPF_MAP_CREATE, &attr);
+}
+
+static int sockmap_load(const struct bpf_insn *insns, int count)
+{
+	union bpf_attr attr;
+
+	memset(&attr, 0, sizeof(attr));
+	attr.prog_type = BPF_PROG_TYPE_SK_SKB;
+	attr.insns     = (uintptr_t)insns;
+	attr.insn_cnt  = count;
+	attr.license   = (uintptr_t)"GPL";
+	return sockmap_bpf(BPF_PROG_LOAD, &attr);
+}
+
+static int sockmap_attach(int map, int prog, int type)
+{
+	union bpf_attr attr;
+
+	memset(&attr, 0, sizeof(attr));
+	attr.target_fd     = map;
+	attr.attach_bpf_fd = prog;
+	attr.attach_type   = type;
+	return sockmap_bpf(BPF_PROG_ATTACH, &attr);
+}
+
+static int sockmap_update(int map, const void *key, int fd)
+{
+	union bpf_attr attr;
+
+	memset(&attr, 0, sizeof(attr));
+	attr.map_fd = map;
+	attr.key    = (uintptr_t)key;
+	attr.value  = (uintptr_t)&fd;
+	attr.flags  = BPF_ANY;
+	return sockmap_bpf(BPF_MAP_UPDATE_ELEM, &attr);
+}
+
+static void sockmap_delete(int map, const void *key)
+{
+	union bpf_attr attr;
+
+	memset(&attr, 0, sizeof(attr));
+	attr.map_fd = map;
+	attr.key    = (uintptr_t)key;
+	sockmap_bpf(BPF_MAP_DELETE_ELEM, &attr);
+}
+
+/* Retrieves the number of bytes received from socket <fd> (excluding the FIN)
+ * and written to it (including the ones not yet sent). Returns 0 on success or
+ * -1 on error.
+ */
+static int sockmap_counters(int fd, uint64_t *rcvd, uint64_t *sent)
+{
+	struct sockmap_tcp_info ti;
+	socklen_t len = sizeof(ti);
+	int outq;
+
+	if (getsockopt(fd, IPPROTO_TCP, TCP_INFO, &ti, &len) == -1 || len < sizeof(ti))
+		return -1;
+
+	if (ioctl(fd, TIOCOUTQ, &outq) == -1)
+		return -1;
+
+	*rcvd = ti.bytes_received;
+	switch (ti.info.tcpi_state) {
+	case TCP_CLOSE_WAIT:
+	case TCP_LAST_ACK:
+	case TCP_CLOSING:
+	case TCP_TIME_WAIT:
+	case TCP_CLOSE:
+		/* the peer's FIN was counted, except after a reset on a closed
+		 * socket, which is then reported one byte short.
+		 */
+		if (*rcvd)
+			(*rcvd)--;
+		break;
+	}
+	*sent = ti.bytes_acked + outq;
+	return 0;
+}
+
+/* See sockmap.h */
+void sockmap_init()
+{
+	/* stream parser: each skb is a message */
+	const struct bpf_insn parser[] = {
+		SM_INSN(BPF_LDX | BPF_MEM | BPF_W, BPF_REG_0, BPF_REG_1, offsetof(struct __sk_buff, len), 0),
+		SM_INSN(BPF_JMP | BPF_EXIT, 0, 0, 0, 0),
+	};
+	/* stream verdict: return bpf_sk_redirect_hash(skb, peers, &cookie, 0)
+	 * where cookie is bpf_get_socket_cookie(skb).
+	 */
+	struct bpf_insn verdict[] = {
+		SM_INSN(BPF_ALU64 | BPF_MOV | BPF_X, BPF_REG_6, BPF_REG_1, 0, 0),
+		SM_INSN(BPF_JMP | BPF_CALL, 0, 0, 0, BPF_FUNC_get_socket_cookie),
+		SM_INSN(BPF_STX | BPF_MEM | BPF_DW, BPF_REG_10, BPF_REG_0, -8, 0),
+		SM_INSN(BPF_ALU64 | BPF_MOV | BPF_X, BPF_REG_1, BPF_REG_6, 0, 0),
+		SM_INSN(BPF_LD | BPF_DW | BPF_IMM, BPF_REG_2, BPF_PSEUDO_MAP_FD, 0, 0), // peers, set below
+		SM_INSN(0, 0, 0, 0, 0),
+		SM_INSN(BPF_ALU64 | BPF_MOV | BPF_X, BPF_REG_3, BPF_REG_10, 0, 0),
+		SM_INSN(BPF_ALU64 | BPF_ADD | BPF_K, BPF_REG_3, 0, 0, -8),
+		SM_INSN(BPF_ALU64 | BPF_MOV | BPF_K, BPF_REG_4, 0, 0, 0),
+		SM_INSN(BPF_JMP | BPF_CALL, 0, 0, 0, BPF_FUNC_sk_redirect_hash),
+		SM_INSN(BPF_JMP | BPF_EXIT, 0, 0, 0, 0),
+	};
+	struct proxy *px;
+	int prog_parser = -1, prog_verdict = -1;
+	const char *step;
+
+	for (px = proxies_list; px; px = px->next) {
+		if (!px->disabled && (px->options2 & PR_O2_SOCKMAP))
+			break;
+	}
+
+	if (!px)
+		return;
+
+	step = "create the maps";
+	sockmap_links = sockmap_create(BPF_MAP_TYPE_SOCKMAP, sizeof(int), global.maxsock);
+	if (sockmap_links < 0)
+		goto fail;
+
+	sockmap_peers = sockmap_create(BPF_MAP_TYPE_SOCKHASH, sizeof(uint64_t), global.maxsock);
+	if (sockmap_peers < 0)
+		goto fail;
+
+	step = "load the programs";
+	verdict[4].imm = sockmap_peers;
+	prog_parser = sockmap_load(parser, sizeof(parser) / sizeof(*parser));
+	if (prog_parser < 0)
+		goto fail;
+
+	prog_verdict = sockmap_load(verdict, sizeof(verdict) / sizeof(*verdict));
+	if (prog_verdict < 0)
+		goto fail;
+
+	step = "attach the programs";
+	if (sockmap_attach(sockmap_links, prog_parser, BPF_SK_SKB_STREAM_PARSER) < 0 ||
+	    sockmap_attach(sockmap_links, prog_verdict, BPF_SK_SKB_STREAM_VERDICT) < 0)
+		goto fail;
+
+	/* the map holds the programs now */
+	close(prog_parser);
+	close(prog_verdict);
+
+	step = "allocate the counters";
+	sockmap_sk = calloc(global.maxsock, sizeof(*sockmap_sk));
+	if (!sockmap_sk) {
+		errno = ENOMEM;
+		goto fail_maps;
+	}
+
+	sockmap_ready = 1;
+	return;
+
+ fail:
+	if (prog_parser >= 0)
+		close(prog_parser);
+	if (prog_verdict >= 0)
+		close(prog_verdict);
+ fail_maps:
+	ha_warning("'option sockmap' ignored: failed to %s (%s).\n", step, strerror(errno));
+	if (sockmap_links >= 0)
+		close(sockmap_links);
+	if (sockmap_peers >= 0)
+		close(sockmap_peers);
+	sockmap_links = sockmap_peers = -1;
+}
+
+/* Records the current counters of socket <fd> as the base of what will be
+ * redirected. What is already queued was not read yet and will be redirected
+ * as well once the socket is linked. Returns 0 on success, -1 on failure.
+ */
+static int sockmap_base(int fd)
+{
+	int inq;
+
+	if (sockmap_counters(fd, &sockmap_sk[fd].rcvd, &sockmap_sk[fd].sent) < 0 ||
+	    ioctl(fd, FIONREAD, &inq) == -1)
+		return -1;
+
+	sockmap_sk[fd].rcvd -= inq;
+	return 0;
+}
+
+/* See sockmap.h */
+int sockmap_link(int fd1, int fd2)
+{
+	uint64_t cookie1, cookie2;
+	socklen_t len;
+
+	if (!sockmap_ready)
+		return -1;
+
+	len = sizeof(cookie1);
+	if (getsockopt(fd1, SOL_SOCKET, SO_COOKIE, &cookie1, &len) == -1)
+		return -1;
+
+	len = sizeof(cookie2);
+	if (getsockopt(fd2, SOL_SOCKET, SO_COOKIE, &cookie2, &len) == -1)
+		return -1;
+
+	if (sockmap_base(fd1) < 0 || sockmap_base(fd2) < 0)
+		return -1;
+
+	sockmap_sk[fd1].taken = sockmap_sk[fd2].taken = 0;
+	sockmap_sk[fd1].fwd = sockmap_sk[fd2].fwd = 0;
+	sockmap_sk[fd1].peer = fd2;
+	sockmap_sk[fd2].peer = fd1;
+
+	/* the redirect targets must exist before the first socket is linked */
+	if (sockmap_update(sockmap_peers, &cookie1, fd2) < 0)
+		return -1;
+
+	if (sockmap_update(sockmap_peers, &cookie2, fd1) < 0)
+		goto fail_peer1;
+
+	if (sockmap_update(sockmap_links, &fd1, fd1) < 0)
+		goto fail_peer2;
+
+	if (sockmap_update(sockmap_links, &fd2, fd2) < 0)
+		goto fail_link1;
+
+	return 0;
+
+ fail_link1:
+	/* Note: anything fd1 received in between was already redirected to
+	 * fd2, and the caller will continue after it.
+	 */
+	sockmap_delete(sockmap_links, &fd1);
+ fail_peer2:
+	sockmap_delete(sockmap_peers, &cookie2);
+ fail_peer1:
+	sockmap_delete(sockmap_peers, &cookie1);
+	return -1;
+}
+
+/* See sockmap.h */
+long long sockmap_take_rcvd(int fd)
+{
+	uint64_t rcvd, sent, taken, delta;
+
+	if (sockmap_counters(fd, &rcvd, &sent) < 0)
+		return -1;
+
+	if (rcvd < sockmap_sk[fd].rcvd)
+		return 0;
+
+	taken = rcvd - sockmap_sk[fd].rcvd;
+	if (taken <= sockmap_sk[fd].taken)
+		return 0;
+
+	delta = taken - sockmap_sk[fd].taken;
+	sockmap_sk[fd].taken = taken;
+	sockmap_sk[sockmap_sk[fd].peer].fwd += delta;
+	return delta;
+}
+
+/* See sockmap.h */
+long long sockmap_pending(int fd)
+{
+	uint64_t rcvd, sent;
+
+	if (sockmap_counters(fd, &rcvd, &sent) < 0)
+		return -1;
+
+	sent -= sockmap_sk[fd].sent;
+	return (sockmap_sk[fd].fwd > sent) ? sockmap_sk[fd].fwd - sent : 0;
+}
+
+static void sockmap_deinit()
+{
+	if (sockmap_links >= 0)
+		close(sockmap_links);
+	if (sockmap_peers >= 0)
+		close(sockmap_peers);
+	sockmap_links = sockmap_peers = -1;
+	ha_free(&sockmap_sk);
+	sockmap_ready = 0;
+}
+
+REGISTER_POST_DEINIT(sockmap_deinit);
+
+/*
+ * Local variables:
+ *  c-indent-level: 8
+ *  c-basic-offset: 8
+ * End:
+ */
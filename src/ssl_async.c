@@ -0,0 +1,401 @@
+/*
+ * Private key operations offloaded to worker threads in SSL async mode
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ *
+ * When "tune.ssl.async-workers" is set, the RSA and EC private keys loaded
+ * from the certificates are given a method whose private key operations are
+ * run by a pool of worker threads instead of the thread processing the
+ * handshake. This relies on the OpenSSL async mode, which runs the handshakes
+ * in an ASYNC_JOB: the operation is queued to the workers, then the job is
+ * paused and the handshake returns SSL_ERROR_WANT_ASYNC. The worker signals an
+ * eventfd attached to the job's wait context once done, which is polled like
+ * a crypto engine's fd and resumes the handshake. Operations run outside of a
+ * job (e.g. at load time) are computed inline.
+ *
+ */
+
+#include <pthread.h>
+#include <signal.h>
+#include <unistd.h>
+
+#include <haproxy/api.h>
+#include <haproxy/errors.h>
+#include <haproxy/fd.h>
+#include <haproxy/global.h>
+#include <haproxy/list.h>
+#include <haproxy/openssl-compat.h>
+#include <haproxy/ssl_async.h>
+#include <haproxy/ssl_sock.h>
+
+#ifdef HAVE_SSL_ASYNC_WORKERS
+
+#include <sys/eventfd.h>
+#include <openssl/async.h>
+#include <openssl/ec.h>
+#include <openssl/rsa.h>
+
+/* a private key operation handed to the workers. It lives in the paused job's
+ * stack, so the worker must not touch it anymore once <done> is set.
+ */
+struct ssl_async_op {
+	struct list list;             /* element in the workers' queue */
+	int (*fct)(struct ssl_async_op *op); /* runs the operation using the original method */
+	int fd;                       /* eventfd to signal once done */
+	int ret;                      /* the operation's return value */
+	unsigned int done;            /* set by the worker once <ret> is set */
+	union {
+		struct {
+			const unsigned char *from;
+			unsigned char *to;
+			RSA *rsa;
+			int flen;
+			int padding;
+		} rsa;
+		struct {
+			const unsigned char *dgst;
+			unsigned char *sig;
+			unsigned int *siglen;
+			const BIGNUM *kinv;
+			const BIGNUM *r;
+			EC_KEY *eckey;
+			int type;
+			int dlen;
+		} ec;
+	};
+};
+
+static struct list ssl_async_ops = LIST_HEAD_INIT(ssl_async_ops);
+static pthread_mutex_t ssl_async_ops_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t ssl_async_ops_cond = PTHREAD_COND_INITIALIZER;
+static pthread_t *ssl_async_workers_thr = NULL;
+static int ssl_async_workers_started = 0;
+static int ssl_async_workers_stop = 0;
+
+static RSA_METHOD *ssl_async_rsa_meth = NULL;
+static EC_KEY_METHOD *ssl_async_ec_meth = NULL;
+
+/* the key of our fd in the jobs' wait contexts */
+static const char ssl_async_fd_key = 0;
+
+/* Releases the eventfd of a wait context. It is called by OpenSSL from the
+ * thread releasing the SSL, and the fd may be known by the poller.
+ */
+static void ssl_async_fd_cleanup(ASYNC_WAIT_CTX *wctx, const void *key, OSSL_ASYNC_FD fd, void *custom)
+{
+	if (fdtab[fd].owner)
+		fd_delete(fd);
+	else
+		close(fd);
+}
+
+/* Returns the eventfd of the wait context of the current job, creating it if
+ * needed, or -1 on failure.
+ */
+static int ssl_async_get_fd(ASYNC_JOB *job)
+{
+	ASYNC_WAIT_CTX *wctx = ASYNC_get_wait_ctx(job);
+	OSSL_ASYNC_FD fd;
+	void *custom;
+
+	if (!wctx)
+		return -1;
+
+	if (ASYNC_WAIT_CTX_get_fd(wctx, &ssl_async_fd_key, &fd, &custom))
+		return fd;
+
+	fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (fd < 0)
+		return -1;
+
+	if (fd >= global.maxsock ||
+	    !ASYNC_WAIT_CTX_set_wait_fd(wctx, &ssl_async_fd_key, fd, NULL, ssl_async_fd_cleanup)) {
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+/* Runs operation <op> on the workers if called from an async job, otherwise
+ * inline. Returns the operation's return value.
+ */
+static int ssl_async_run(struct ssl_async_op *op)
+{
+	ASYNC_JOB *job;
+	uint64_t val;
+
+	job = ASYNC_get_current_job();
+	if (!job || !ssl_async_workers_started)
+		return op->fct(op);
+
+	op->fd = ssl_async_get_fd(job);
+	if (op->fd < 0)
+		return op->fct(op);
+
+	/* flush a possibly stale notification */
+	if (read(op->fd, &val, sizeof(val)) < 0) { /* only EAGAIN */ }
+
+	op->done = 0;
+	pthread_mutex_lock(&ssl_async_ops_lock);
+	LIST_APPEND(&ssl_async_ops, &op->list);
+	pthread_cond_signal(&ssl_async_ops_cond);
+	pthread_mutex_unlock(&ssl_async_ops_lock);
+
+	/* the job may be resumed before the worker is done, for instance when
+	 * another fd of the same SSL is reported.
+	 */
+	while (!HA_ATOMIC_LOAD(&op->done))
+		ASYNC_pause_job();
+
+	if (read(op->fd, &val, sizeof(val)) < 0) { /* only EAGAIN */ }
+	return op->ret;
+}
+
+/* Main loop of a worker */
+static void *ssl_async_worker_run(void *arg)
+{
+	struct ssl_async_op *op;
+	uint64_t val = 1;
+	int fd;
+
+	pthread_mutex_lock(&ssl_async_ops_lock);
+	while (1) {
+		while (LIST_ISEMPTY(&ssl_async_ops) && !ssl_async_workers_stop)
+			pthread_cond_wait(&ssl_async_ops_cond, &ssl_async_ops_lock);
+		if (ssl_async_workers_stop)
+			break;
+
+		op = LIST_NEXT(&ssl_async_ops, struct ssl_async_op *, list);
+		LIST_DELETE(&op->list);
+		pthread_mutex_unlock(&ssl_async_ops_lock);
+
+		op->ret = op->fct(op);
+
+		/* the eventfd is signaled first so that it cannot be closed
+		 * by a job which would complete in the mean time.
+		 */
+		fd = op->fd;
+		if (write(fd, &val, sizeof(val)) < 0) { /* cannot fail */ }
+		HA_ATOMIC_STORE(&op->done, 1);
+
+		pthread_mutex_lock(&ssl_async_ops_lock);
+	}
+	pthread_mutex_unlock(&ssl_async_ops_lock);
+	return NULL;
+}
+
+static int ssl_async_rsa_priv_enc_fct(struct ssl_async_op *op)
+{
+	return RSA_meth_get_priv_enc(RSA_PKCS1_OpenSSL())(op->rsa.flen, op->rsa.from, op->rsa.to,
+	                                                  op->rsa.rsa, op->rsa.padding);
+}
+
+static int ssl_async_rsa_priv_dec_fct(struct ssl_async_op *op)
+{
+	return RSA_meth_get_priv_dec(RSA_PKCS1_OpenSSL())(op->rsa.flen, op->rsa.from, op->rsa.to,
+	                                                  op->rsa.rsa, op->rsa.padding);
+}
+
+static int ssl_async_ec_sign_fct(struct ssl_async_op *op)
+{
+	int (*sign)(int type, const unsigned char *dgst, int dlen, unsigned char *sig,
+	            unsigned int *siglen, const BIGNUM *kinv, const BIGNUM *r, EC_KEY *eckey);
+
+	EC_KEY_METHOD_get_sign(EC_KEY_OpenSSL(), &sign, NULL, NULL);
+	return sign(op->ec.type, op->ec.dgst, op->ec.dlen, op->ec.sig, op->ec.siglen,
+	            op->ec.kinv, op->ec.r, op->ec.eckey);
+}
+
+static int ssl_async_rsa_priv_enc(int flen, const unsigned char *from, unsigned char *to, RSA *rsa, int padding)
+{
+	struct ssl_async_op op = {
+		.fct = ssl_async_rsa_priv_enc_fct,
+		.rsa = { .from = from, .to = to, .rsa = rsa, .flen = flen, .padding = padding },
+	};
+
+	return ssl_async_run(&op);
+}
+
+static int ssl_async_rsa_priv_dec(int flen, const unsigned char *from, unsigned char *to, RSA *rsa, int padding)
+{
+	struct ssl_async_op op = {
+		.fct = ssl_async_rsa_priv_dec_fct,
+		.rsa = { .from = from, .to = to, .rsa = rsa, .flen = flen, .padding = padding },
+	};
+
+	return ssl_async_run(&op);
+}
+
+static int ssl_async_ec_sign(int type, const unsigned char *dgst, int dlen, unsigned char *sig,
+                             unsigned int *siglen, const BIGNUM *kinv, const BIGNUM *r, EC_KEY *eckey)
+{
+	struct ssl_async_op op = {
+		.fct = ssl_async_ec_sign_fct,
+		.ec = { .dgst = dgst, .sig = sig, .siglen = siglen, .kinv = kinv,
+		        .r = r, .eckey = eckey, .type = type, .dlen = dlen },
+	};
+
+	return ssl_async_run(&op);
+}
+
+/* Returns a new key holding a copy of <pkey> using the workers' method, or
+ * NULL if the workers are not used or if the key's type is not supported, in
+ * which case <pkey> should be used as-is. The caller must free the new key.
+ */
+EVP_PKEY *ssl_async_wrap_key(EVP_PKEY *pkey)
+{
+	EVP_PKEY *new = NULL;
+
+	if (!global_ssl.async_workers || !ssl_async_rsa_meth || !ssl_async_ec_meth)
+		return NULL;
+
+	switch (EVP_PKEY_base_id(pkey)) {
+	case EVP_PKEY_RSA: {
+		RSA *orig, *rsa = NULL;
+
+		orig = EVP_PKEY_get1_RSA(pkey);
+		if (orig)
+			rsa = RSAPrivateKey_dup(orig);
+		RSA_free(orig);
+		if (!rsa)
+			return NULL;
+
+		new = EVP_PKEY_new();
+		if (!new || !RSA_set_method(rsa, ssl_async_rsa_meth) || !EVP_PKEY_assign_RSA(new, rsa)) {
+			RSA_free(rsa);
+			EVP_PKEY_free(new);
+			return NULL;
+		}
+		break;
+	}
+	case EVP_PKEY_EC: {
+		EC_KEY *orig, *ec = NULL;
+
+		orig = EVP_PKEY_get1_EC_KEY(pkey);
+		if (orig)
+			ec = EC_KEY_dup(orig);
+		EC_KEY_free(orig);
+		if (!ec)
+			return NULL;
+
+		new = EVP_PKEY_new();
+		if (!new || !EC_KEY_set_method(ec, ssl_async_ec_meth) || !EVP_PKEY_assign_EC_KEY(new, ec)) {
+			EC_KEY_free(ec);
+			EVP_PKEY_free(new);
+			return NULL;
+		}
+		break;
+	}
+	default:
+		return NULL;
+	}
+	return new;
+}
+
+/* Allocates the methods used by the wrapped keys. This is done early since
+ * the keys are loaded while parsing the configuration. The methods are never
+ * released as keys may use them until the end.
+ */
+static void ssl_async_init_methods()
+{
+	int (*sign_setup)(EC_KEY *eckey, BN_CTX *ctx_in, BIGNUM **kinvp, BIGNUM **rp);
+	ECDSA_SIG *(*sign_sig)(const unsigned char *dgst, int dgst_len, const BIGNUM *in_kinv,
+	                       const BIGNUM *in_r, EC_KEY *eckey);
+
+	ssl_async_rsa_meth = RSA_meth_dup(RSA_PKCS1_OpenSSL());
+	ssl_async_ec_meth = EC_KEY_METHOD_new(EC_KEY_OpenSSL());
+	if (!ssl_async_rsa_meth || !ssl_async_ec_meth)
+		return;
+
+	RSA_meth_set1_name(ssl_async_rsa_meth, "haproxy async workers");
+	RSA_meth_set_priv_enc(ssl_async_rsa_meth, ssl_async_rsa_priv_enc);
+	RSA_meth_set_priv_dec(ssl_async_rsa_meth, ssl_async_rsa_priv_dec);
+
+	EC_KEY_METHOD_get_sign(EC_KEY_OpenSSL(), NULL, &sign_setup, &sign_sig);
+	EC_KEY_METHOD_set_sign(ssl_async_ec_meth, ssl_async_ec_sign, sign_setup, sign_sig);
+}
+
+/* Checks that the methods could be allocated and accounts for the eventfds in
+ * the number of sockets.
+ */
+static int ssl_async_check()
+{
+	if (!global_ssl.async_workers)
+		return ERR_NONE;
+
+	if (!ssl_async_rsa_meth || !ssl_async_ec_meth) {
+		ha_alert("failed to allocate the SSL async workers' key methods.\n");
+		return ERR_ALERT | ERR_FATAL;
+	}
+
+	/* one eventfd per connection, as an engine would use */
+	global.ssl_used_async_engines++;
+	return ERR_NONE;
+}
+
+/* Starts the workers from the first thread */
+static int ssl_async_init_per_thread()
+{
+	sigset_t blocked_sig, old_sig;
+	int i;
+
+	if (!global_ssl.async_workers || master || tid != 0)
+		return 1;
+
+	ssl_async_workers_thr = calloc(global_ssl.async_workers, sizeof(*ssl_async_workers_thr));
+	if (!ssl_async_workers_thr)
+		return 0;
+
+	/* the workers must never catch signals */
+	sigfillset(&blocked_sig);
+	pthread_sigmask(SIG_SETMASK, &blocked_sig, &old_sig);
+	for (i = 0; i < global_ssl.async_workers; i++) {
+		if (pthread_create(&ssl_async_workers_thr[i], NULL, ssl_async_worker_run, NULL) != 0) {
+			ha_alert("failed to start SSL async worker %d.\n", i);
+			break;
+		}
+	}
+	pthread_sigmask(SIG_SETMASK, &old_sig, NULL);
+
+	if (i < global_ssl.async_workers) {
+		global_ssl.async_workers = i;
+		return 0;
+	}
+	ssl_async_workers_started = 1;
+	return 1;
+}
+
+/* Stops the workers */
+static void ssl_async_deinit()
+{
+	int i;
+
+	if (ssl_async_workers_thr) {
+		pthread_mutex_lock(&ssl_async_ops_lock);
+		ssl_async_workers_stop = 1;
+		pthread_cond_broadcast(&ssl_async_ops_cond);
+		pthread_mutex_unlock(&ssl_async_ops_lock);
+
+		for (i = 0; i < global_ssl.async_workers; i++)
+			pthread_join(ssl_async_workers_thr[i], NULL);
+		ha_free(&ssl_async_workers_thr);
+	}
+	ssl_async_workers_started = 0;
+}
+
+INITCALL0(STG_INIT, ssl_async_init_methods);
+REGISTER_POST_CHECK(ssl_async_check);
+REGISTER_PER_THREAD_INIT(ssl_async_init_per_thread);
+REGISTER_POST_DEINIT(ssl_async_deinit);
+
+#endif /* HAVE_SSL_ASYNC_WORKERS */
+
+/*
+ * Local variables:
+ *  c-indent-level: 8
+ *  c-basic-offset: 8
+ * End:
+ */
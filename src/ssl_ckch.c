@@ -22,13 +22,19 @@
 #include <sys/stat.h>
 #include <sys/types.h>
 
+#ifdef USE_THREAD
+#include <pthread.h>
+#endif
+
 #include <import/ebsttree.h>
 
 #include <haproxy/base64.h>
 #include <haproxy/channel.h>
+#include <haproxy/chunk.h>
 #include <haproxy/cli.h>
 #include <haproxy/errors.h>
 #include <haproxy/ssl_ckch.h>
+#include <haproxy/ssl_lazy.h>
 #include <haproxy/ssl_sock.h>
 #include <haproxy/ssl_utils.h>
 #include <haproxy/stream_interface.h>
@@ -261,17 +267,26 @@ int ssl_sock_load_ocsp_response_from_file(const char *ocsp_path, char *buf, stru
  */
 int ssl_sock_load_files_into_ckch(const char *path, struct cert_key_and_chain *ckch, char **err)
 {
-	struct buffer *fp = NULL;
+	return ssl_sock_load_buf_files_into_ckch(path, NULL, ckch, err);
+}
+
+/*
+ * Same as ssl_sock_load_files_into_ckch() except that the PEM file's contents
+ * are read from <buf> if not NULL. The extra files are still looked up next to
+ * <path>.
+ */
+int ssl_sock_load_buf_files_into_ckch(const char *path, char *buf, struct cert_key_and_chain *ckch, char **err)
+{
+	/* no trash chunk is used here so that ckchs_preload() may call this
+	 * from threads which do not own any pool cache.
+	 */
+	char fp_area[MAXPATHLEN + 16];
+	struct buffer fp_chunk = b_make(fp_area, sizeof(fp_area), 0, 0);
+	struct buffer *fp = &fp_chunk;
 	int ret = 1;
 
 	/* try to load the PEM */
-	if (ssl_sock_load_pem_into_ckch(path, NULL, ckch , err) != 0) {
-		goto end;
-	}
-
-	fp = alloc_trash_chunk();
-	if (!fp) {
-		memprintf(err, "%sCan't allocate memory\n", err && *err ? *err : "");
+	if (ssl_sock_load_pem_into_ckch(path, buf, ckch , err) != 0) {
 		goto end;
 	}
 
@@ -423,8 +438,6 @@ int ssl_sock_load_files_into_ckch(const char *path, struct cert_key_and_chain *c
 	if (ret != 0)
 		ssl_sock_free_cert_key_and_chain_contents(ckch);
 
-	free_trash_chunk(fp);
-
 	return ret;
 }
 
@@ -896,6 +909,97 @@ struct ckch_store *ckchs_load_cert_file(char *path, char **err)
 	return NULL;
 }
 
+#ifdef USE_THREAD
+/* files being preloaded by ckchs_preload() */
+struct ckchs_preload {
+	char **paths;               /* paths of the files to load */
+	struct ckch_store **stores; /* resulting stores, NULL if they failed */
+	unsigned int count;         /* number of files */
+	unsigned int next;          /* next file to be loaded */
+};
+
+/* Loads files from the ckchs_preload <arg> until there are none left. This is
+ * the function run by the threads started by ckchs_preload(). Errors are not
+ * reported, the caller will load the failed files again to get them.
+ */
+static void *ckchs_preload_run(void *arg)
+{
+	struct ckchs_preload *pre = arg;
+	struct ckch_store *ckchs;
+	unsigned int i;
+	char *err;
+
+	/* the OCSP and SCTL files are read into the trash */
+	if (!alloc_trash_buffers_per_thread())
+		goto end;
+
+	while ((i = HA_ATOMIC_FETCH_ADD(&pre->next, 1)) < pre->count) {
+		err = NULL;
+		ckchs = ckch_store_new(pre->paths[i]);
+		if (ckchs && ssl_sock_load_files_into_ckch(pre->paths[i], ckchs->ckch, &err) == 1) {
+			ckch_store_free(ckchs);
+			ckchs = NULL;
+		}
+		free(err);
+		pre->stores[i] = ckchs;
+	}
+ end:
+	free_trash_buffers_per_thread();
+	return NULL;
+}
+#endif
+
+/*
+ * Loads the <count> certificate files of <paths> using "tune.ssl.load-threads"
+ * threads, and inserts the resulting stores into the ckchs tree in the order
+ * of <paths>, so that the result does not depend on the threads scheduling.
+ * The paths must not be in the tree yet. Nothing is reported on failure, the
+ * files which could not be loaded are simply left out of the tree for the
+ * caller to load them again with ckchs_load_cert_file() and report the error,
+ * which is also what happens when there is a single thread.
+ */
+void ckchs_preload(char **paths, int count)
+{
+#ifdef USE_THREAD
+	struct ckchs_preload pre;
+	pthread_t *threads;
+	int nbthreads, i;
+
+	nbthreads = MIN(global_ssl.load_threads, count);
+	if (nbthreads <= 1)
+		return;
+
+	pre.paths = paths;
+	pre.count = count;
+	pre.next  = 0;
+	pre.stores = calloc(count, sizeof(*pre.stores));
+	threads = calloc(nbthreads, sizeof(*threads));
+	if (!pre.stores || !threads)
+		goto end;
+
+	for (i = 0; i < nbthreads; i++) {
+		if (pthread_create(&threads[i], NULL, ckchs_preload_run, &pre) != 0)
+			break;
+	}
+	while (i--)
+		pthread_join(threads[i], NULL);
+
+	for (i = 0; i < count; i++) {
+		if (!pre.stores[i])
+			continue;
+		if (ckchs_lookup(pre.stores[i]->path)) {
+			/* the same file was listed twice */
+			ckch_store_free(pre.stores[i]);
+			continue;
+		}
+		ebst_insert(&ckchs_tree, &pre.stores[i]->node);
+	}
+ end:
+	free(threads);
+	free(pre.stores);
+#endif
+}
+
 
 /********************  ckch_inst functions ******************************/
 
@@ -909,6 +1013,9 @@ void ckch_inst_free(struct ckch_inst *inst)
 	if (inst == NULL)
 		return;
 
+	if (inst->lazy)
+		ssl_lazy_release_inst(inst);
+
 	list_for_each_entry_safe(sni, sni_s, &inst->sni_ctx, by_ckch_inst) {
 		SSL_CTX_free(sni->ctx);
 		LIST_DELETE(&sni->by_ckch_inst);
@@ -942,6 +1049,7 @@ struct ckch_inst *ckch_inst_new()
 	LIST_INIT(&ckch_inst->by_ckchs);
 	LIST_INIT(&ckch_inst->by_crtlist_entry);
 	LIST_INIT(&ckch_inst->cafile_link_refs);
+	LIST_INIT(&ckch_inst->lazy_lru);
 
 	return ckch_inst;
 }
@@ -1570,7 +1678,9 @@ static int cli_io_handler_show_cert_detail(struct appctx *appctx)
 	chunk_appendf(out, "%s\n", ckchs->path);
 
 	chunk_appendf(out, "Status: ");
-	if (ckchs->ckch->cert == NULL)
+	if (ckchs->ckch->cert == NULL && ckchs->lazy)
+		chunk_appendf(out, "Lazy\n");
+	else if (ckchs->ckch->cert == NULL)
 		chunk_appendf(out, "Empty\n");
 	else if (LIST_ISEMPTY(&ckchs->ckch_inst))
 		chunk_appendf(out, "Unused\n");
@@ -1768,7 +1878,8 @@ static int ckch_inst_rebuild(struct ckch_store *ckch_store, struct ckch_inst *ck
 	/* we need to initialize the SSL_CTX generated */
 	/* this iterate on the newly generated SNIs in the new instance to prepare their SSL_CTX */
 	list_for_each_entry_safe(sc0, sc0s, &(*new_inst)->sni_ctx, by_ckch_inst) {
-		if (!sc0->order) { /* we initialized only the first SSL_CTX because it's the same in the other sni_ctx's */
+		/* lazy instances are prepared when loaded */
+		if (!sc0->order && sc0->ctx) { /* we initialized only the first SSL_CTX because it's the same in the other sni_ctx's */
 			errcode |= ssl_sock_prep_ctx_and_inst(ckchi->bind_conf, ckchi->ssl_conf, sc0->ctx, *new_inst, err);
 			if (errcode & ERR_CODE)
 				return 1;
@@ -1786,7 +1897,6 @@ static void __ssl_sock_load_new_ckch_instance(struct ckch_inst *ckchi)
 {
 	/* The bind_conf will be null on server ckch_instances. */
 	if (ckchi->is_server_instance) {
-		int i;
 		/* a lock is needed here since we have to free the SSL cache */
 		HA_RWLOCK_WRLOCK(SSL_SERVER_LOCK, &ckchi->server->ssl_ctx.lock);
 		/* free the server current SSL_CTX */
@@ -1797,9 +1907,7 @@ static void __ssl_sock_load_new_ckch_instance(struct ckch_inst *ckchi)
 		ckchi->server->ssl_ctx.inst = ckchi;
 
 		/* flush the session cache of the server */
-		for (i = 0; i < global.nbthread; i++) {
-			ha_free(&ckchi->server->ssl_ctx.reused_sess[i].ptr);
-		}
+		ssl_sock_srv_flush_sessions(ckchi->server);
 		HA_RWLOCK_WRUNLOCK(SSL_SERVER_LOCK, &ckchi->server->ssl_ctx.lock);
 
 	} else {
@@ -25,6 +25,7 @@
 #include <haproxy/errors.h>
 #include <haproxy/ssl_ckch.h>
 #include <haproxy/ssl_crtlist.h>
+#include <haproxy/ssl_lazy.h>
 #include <haproxy/ssl_sock.h>
 #include <haproxy/stream_interface.h>
 #include <haproxy/tools.h>
@@ -427,6 +428,93 @@ int crtlist_parse_line(char *line, char **crt_path, struct crtlist_entry *entry,
 }
 
 
+/* Appends a copy of <path> to the array of <count> paths <paths>, which is
+ * reallocated. Returns 0 on failure, in which case the array is unchanged.
+ */
+static int crtlist_preload_add(char ***paths, int *count, const char *path)
+{
+	char **new;
+
+	new = realloc(*paths, (*count + 1) * sizeof(*new));
+	if (!new)
+		return 0;
+	*paths = new;
+	new[*count] = strdup(path);
+	if (!new[*count])
+		return 0;
+	(*count)++;
+	return 1;
+}
+
+/* Frees the array of <count> paths <paths> built by crtlist_preload_add() */
+static void crtlist_preload_free(char **paths, int count)
+{
+	while (count--)
+		free(paths[count]);
+	free(paths);
+}
+
+/* Collects the certificate files referenced by crt-list <file> opened as <f>
+ * which are not loaded yet and loads them in parallel with ckchs_preload(),
+ * then rewinds <f>. Invalid lines are skipped, they will be reported when
+ * the file is parsed again.
+ */
+static void crtlist_preload_file(FILE *f, const char *file)
+{
+	char thisline[CRT_LINESIZE];
+	char path[MAXPATHLEN+1];
+	char **paths = NULL;
+	int count = 0;
+	int linenum = 0;
+	struct stat buf;
+
+	if (global_ssl.load_threads <= 1)
+		return;
+
+	while (fgets(thisline, sizeof(thisline), f) != NULL) {
+		struct crtlist_entry *entry;
+		char *crt_path = NULL;
+		char *end, *err = NULL;
+		int cfgerr;
+
+		linenum++;
+		if (*thisline == '#' || *thisline == '\n' || *thisline == '\r')
+			continue;
+
+		end = thisline + strlen(thisline);
+		if (end > thisline && *(end-1) == '\n')
+			*(end - 1) = 0;
+
+		entry = crtlist_entry_new();
+		if (entry == NULL)
+			break;
+
+		cfgerr = crtlist_parse_line(thisline, &crt_path, entry, file, linenum, 0, &err);
+		free(err);
+		if ((cfgerr & ERR_CODE) || !crt_path || !*crt_path ||
+		    (global_ssl.lazy_load && ssl_lazy_filters(entry->filters, entry->fcount)))
+			goto next;
+
+		if (*crt_path != '/' && global_ssl.crt_base) {
+			if ((strlen(global_ssl.crt_base) + 1 + strlen(crt_path)) > MAXPATHLEN)
+				goto next;
+			snprintf(path, sizeof(path), "%s/%s",  global_ssl.crt_base, crt_path);
+			crt_path = path;
+		}
+
+		/* bundles and files which cannot be added are left to the
+		 * regular loading.
+		 */
+		if (!ckchs_lookup(crt_path) && stat(crt_path, &buf) == 0)
+			crtlist_preload_add(&paths, &count, crt_path);
+	next:
+		crtlist_entry_free(entry);
+	}
+
+	ckchs_preload(paths, count);
+	crtlist_preload_free(paths, count);
+	rewind(f);
+}
 
 /* This function parse a crt-list file and store it in a struct crtlist, each line is a crtlist_entry structure
  * Fill the <crtlist> argument with a pointer to a new crtlist struct
@@ -449,6 +537,8 @@ int crtlist_parse_file(char *file, struct bind_conf *bind_conf, struct proxy *cu
 		return ERR_ALERT | ERR_FATAL;
 	}
 
+	crtlist_preload_file(f, file);
+
 	newlist = crtlist_new(file, 0);
 	if (newlist == NULL) {
 		memprintf(err, "Not enough memory!");
@@ -527,6 +617,20 @@ int crtlist_parse_file(char *file, struct bind_conf *bind_conf, struct proxy *cu
 
 		/* Look for a ckch_store or create one */
 		ckchs = ckchs_lookup(crt_path);
+		if (ckchs == NULL && global_ssl.lazy_load &&
+		    ssl_lazy_filters(entry->filters, entry->fcount)) {
+			/* only indexed by the filters, the file will be read on
+			 * first use.
+			 */
+			ckchs = ckch_store_new(crt_path);
+			if (ckchs == NULL) {
+				memprintf(err, "%sunable to allocate memory.\n", err && *err ? *err : "");
+				cfgerr |= ERR_ALERT | ERR_FATAL;
+				goto error;
+			}
+			ckchs->lazy = 1;
+			ebst_insert(&ckchs_tree, &ckchs->node);
+		}
 		if (ckchs == NULL) {
 			if (stat(crt_path, &buf) == 0) {
 				found++;
@@ -670,6 +774,26 @@ int crtlist_load_cert_dir(char *path, struct bind_conf *bind_conf, struct crtlis
 		cfgerr |= ERR_ALERT | ERR_FATAL;
 	}
 	else {
+		if (global_ssl.load_threads > 1) {
+			char **paths = NULL;
+			int count = 0;
+
+			for (i = 0; i < n; i++) {
+				end = strrchr(de_list[i]->d_name, '.');
+				if (end && (strcmp(end, ".issuer") == 0 || strcmp(end, ".ocsp") == 0 || strcmp(end, ".sctl") == 0 || strcmp(end, ".key") == 0))
+					continue;
+
+				snprintf(fp, sizeof(fp), "%s/%s", path, de_list[i]->d_name);
+				if (stat(fp, &buf) != 0 || !S_ISREG(buf.st_mode) || ckchs_lookup(fp))
+					continue;
+
+				if (!crtlist_preload_add(&paths, &count, fp))
+					break;
+			}
+			ckchs_preload(paths, count);
+			crtlist_preload_free(paths, count);
+		}
+
 		for (i = 0; i < n; i++) {
 			struct crtlist_entry *entry;
 			struct dirent *de = de_list[i];
@@ -1093,7 +1217,8 @@ static int cli_io_handler_add_crtlist(struct appctx *appctx)
 					/* we need to initialize the SSL_CTX generated */
 					/* this iterate on the newly generated SNIs in the new instance to prepare their SSL_CTX */
 					list_for_each_entry(sni, &new_inst->sni_ctx, by_ckch_inst) {
-						if (!sni->order) { /* we initialized only the first SSL_CTX because it's the same in the other sni_ctx's */
+						/* lazy instances are prepared when loaded */
+						if (!sni->order && sni->ctx) { /* we initialized only the first SSL_CTX because it's the same in the other sni_ctx's */
 							errcode |= ssl_sock_prep_ctx_and_inst(bind_conf, new_inst->ssl_conf, sni->ctx, sni->ckch_inst, &err);
 							if (errcode & ERR_CODE)
 								goto error;
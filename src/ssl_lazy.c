@@ -0,0 +1,613 @@
+/*
+ * On-demand loading of the certificates of crt-list entries
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ *
+ * With "ssl-lazy-load", the crt-list entries having SNI filters only create
+ * their SNI entries at boot, pointing to no SSL context. The first handshake
+ * matching one of them requests the load of the certificate: its file is read
+ * by a loader thread while the handshake is parked (the client hello callback
+ * returns SSL_CLIENT_HELLO_RETRY). The requesting thread then builds the SSL
+ * context under the ckch_lock, as "commit ssl cert" does, and wakes up all the
+ * parked handshakes which look up their certificate again. When the handshake
+ * cannot be parked (QUIC, no threads or an old library), the certificate is
+ * loaded synchronously.
+ *
+ * When threads are dedicated to the "crypto" task class, the contexts are built
+ * there instead, by a shared task which then wakes the requesting threads up.
+ *
+ * The number of SSL contexts built this way is limited. Past the limit the
+ * least recently used ones are released, the instances being used during an
+ * eviction pass getting a second chance.
+ *
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include <haproxy/api.h>
+#include <haproxy/errors.h>
+#include <haproxy/global.h>
+#include <haproxy/list.h>
+#include <haproxy/log.h>
+#include <haproxy/ssl_ckch.h>
+#include <haproxy/ssl_lazy.h>
+#include <haproxy/ssl_sock.h>
+#include <haproxy/task.h>
+#include <haproxy/ticks.h>
+#include <haproxy/time.h>
+#include <haproxy/tools.h>
+
+/* a load requested for an instance */
+struct ssl_lazy_req {
+	struct ckch_inst *inst;   /* the instance to load, NULL if it was released */
+	char *buf;                /* the certificate file's contents, NULL if it could not be read */
+	int err;                  /* errno when the file could not be read */
+	int tid;                  /* the thread which requested the load */
+	struct list queue;        /* element in the loaders' queue */
+	struct mt_list list;      /* element in the requester's list of completed loads */
+	char path[VAR_ARRAY];     /* copy of the certificate's path */
+};
+
+/* lazy instances with an SSL context, oldest first, protected by ckch_lock */
+static struct list ssl_lazy_lru = LIST_HEAD_INIT(ssl_lazy_lru);
+static unsigned int ssl_lazy_loaded = 0;
+
+#ifdef HAVE_SSL_LAZY_ASYNC
+
+struct ssl_lazy_thr {
+	struct mt_list done;      /* completed reads to install */
+	struct list waiters;      /* parked handshakes (ssl_sock_ctx) */
+	struct tasklet *tasklet;  /* installs the completed reads and wakes the waiters */
+	struct task *retry;       /* wakes the tasklet up when the ckch_lock was busy */
+};
+
+static struct ssl_lazy_thr ssl_lazy_thr[MAX_THREADS];
+
+/* completed reads for the "crypto" threads, if any, and their task */
+static struct mt_list ssl_lazy_build_list = MT_LIST_HEAD_INIT(ssl_lazy_build_list);
+static struct task *ssl_lazy_build_task = NULL;
+
+static struct list ssl_lazy_queue = LIST_HEAD_INIT(ssl_lazy_queue);
+static pthread_mutex_t ssl_lazy_queue_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t ssl_lazy_queue_cond = PTHREAD_COND_INITIALIZER;
+static pthread_t *ssl_lazy_loaders_thr = NULL;
+static int ssl_lazy_loaders = 0;
+static int ssl_lazy_loaders_started = 0;
+static int ssl_lazy_loaders_stop = 0;
+
+#endif /* HAVE_SSL_LAZY_ASYNC */
+
+/* Reads the whole file <path> in an allocated and zero-terminated buffer.
+ * Returns NULL and sets errno on failure. It may be used out of the haproxy
+ * threads.
+ */
+static char *ssl_lazy_read_file(const char *path)
+{
+	struct stat st;
+	char *buf = NULL;
+	size_t len = 0;
+	ssize_t ret;
+	int fd;
+
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return NULL;
+
+	if (fstat(fd, &st) < 0)
+		goto fail;
+
+	buf = malloc(st.st_size + 1);
+	if (!buf)
+		goto fail;
+
+	while (len < st.st_size) {
+		ret = read(fd, buf + len, st.st_size - len);
+		if (ret < 0 && errno == EINTR)
+			continue;
+		if (ret <= 0)
+			break;
+		len += ret;
+	}
+	buf[len] = 0;
+	close(fd);
+	return buf;
+ fail:
+	ret = errno;
+	free(buf);
+	close(fd);
+	errno = ret;
+	return NULL;
+}
+
+/* Returns non-zero if the SNI filters <sni_filter> contain at least one name
+ * to match, which is required to index a certificate without loading it.
+ */
+int ssl_lazy_filters(char **sni_filter, int fcount)
+{
+	while (fcount--) {
+		if (*sni_filter[fcount] != '!')
+			return 1;
+	}
+	return 0;
+}
+
+/* Releases the SSL contexts of the least recently used lazy instances until
+ * there are no more than tune.ssl.lazy-cache-size of them. The instances used
+ * since the previous pass are kept and moved at the end. The handshakes in
+ * progress keep their own reference on their context. The ckch_lock must be
+ * held.
+ */
+static void ssl_lazy_evict()
+{
+	struct ckch_inst *inst;
+	struct sni_ctx *sc;
+	unsigned int loops = 0;
+
+	if (!global_ssl.lazy_cache_size)
+		return;
+
+	while (ssl_lazy_loaded > global_ssl.lazy_cache_size && !LIST_ISEMPTY(&ssl_lazy_lru)) {
+		inst = LIST_NEXT(&ssl_lazy_lru, struct ckch_inst *, lazy_lru);
+		LIST_DEL_INIT(&inst->lazy_lru);
+
+		if (HA_ATOMIC_XCHG(&inst->lazy_used, 0) && loops++ < ssl_lazy_loaded) {
+			LIST_APPEND(&ssl_lazy_lru, &inst->lazy_lru);
+			continue;
+		}
+
+		HA_RWLOCK_WRLOCK(SNI_LOCK, &inst->bind_conf->sni_lock);
+		list_for_each_entry(sc, &inst->sni_ctx, by_ckch_inst) {
+			SSL_CTX_free(sc->ctx);
+			sc->ctx = NULL;
+		}
+		HA_RWLOCK_WRUNLOCK(SNI_LOCK, &inst->bind_conf->sni_lock);
+
+		SSL_CTX_free(inst->ctx);
+		inst->ctx = NULL;
+		ssl_lazy_loaded--;
+	}
+}
+
+/* Builds the SSL context of lazy instance <inst> from the certificate file's
+ * contents <buf>, or from the file itself if <buf> is NULL, and makes its SNI
+ * entries use it. <path> is only used for the errors. Nothing is done if the
+ * instance is already loaded. The ckch_lock must be held.
+ */
+static void ssl_lazy_install(struct ckch_inst *inst, const char *path, char *buf)
+{
+	struct pkey_info kinfo = { .sig = TLSEXT_signature_anonymous, .bits = 0 };
+	struct cert_key_and_chain *ckch = NULL;
+	struct bind_conf *bind_conf = inst->bind_conf;
+	struct sni_ctx *sc;
+	SSL_CTX *ctx = NULL;
+	EVP_PKEY *pkey;
+	char *err = NULL;
+	int errcode = 0;
+
+	if (inst->ctx)
+		goto end;
+
+	ckch = calloc(1, sizeof(*ckch));
+	if (!ckch) {
+		memprintf(&err, "out of memory.\n");
+		goto fail;
+	}
+
+	if (ssl_sock_load_buf_files_into_ckch(path, buf, ckch, &err))
+		goto fail;
+
+	ctx = SSL_CTX_new(SSLv23_server_method());
+	if (!ctx) {
+		memprintf(&err, "unable to allocate SSL context.\n");
+		goto fail;
+	}
+
+	errcode |= ssl_sock_put_ckch_into_ctx(path, ckch, ctx, &err);
+	if (!(errcode & ERR_CODE))
+		errcode |= ssl_sock_prep_ctx_and_inst(bind_conf, inst->ssl_conf, ctx, inst, &err);
+	if (errcode & ERR_CODE)
+		goto fail;
+
+	pkey = X509_get_pubkey(ckch->cert);
+	if (pkey) {
+		kinfo.bits = EVP_PKEY_bits(pkey);
+		switch (EVP_PKEY_base_id(pkey)) {
+		case EVP_PKEY_RSA:
+			kinfo.sig = TLSEXT_signature_rsa;
+			break;
+		case EVP_PKEY_EC:
+			kinfo.sig = TLSEXT_signature_ecdsa;
+			break;
+		case EVP_PKEY_DSA:
+			kinfo.sig = TLSEXT_signature_dsa;
+			break;
+		}
+		EVP_PKEY_free(pkey);
+	}
+
+	HA_RWLOCK_WRLOCK(SNI_LOCK, &bind_conf->sni_lock);
+	list_for_each_entry(sc, &inst->sni_ctx, by_ckch_inst) {
+		SSL_CTX_up_ref(ctx);
+		sc->ctx = ctx;
+		sc->kinfo = kinfo;
+	}
+	HA_RWLOCK_WRUNLOCK(SNI_LOCK, &bind_conf->sni_lock);
+
+	/* the handshake which requested it will use it, it must not be the
+	 * first one evicted.
+	 */
+	inst->ctx = ctx;
+	ctx = NULL;
+	HA_ATOMIC_STORE(&inst->lazy_used, 1);
+	LIST_APPEND(&ssl_lazy_lru, &inst->lazy_lru);
+	ssl_lazy_loaded++;
+	HA_ATOMIC_STORE(&inst->lazy_state, SSL_LAZY_ST_IDLE);
+	ssl_lazy_evict();
+	goto end;
+
+ fail:
+	send_log(NULL, LOG_ERR, "unable to load lazy certificate '%s' : %s", path, err ? err : "unknown error.\n");
+	inst->lazy_retry = tick_add(now_ms, MS_TO_TICKS(SSL_LAZY_RETRY_DELAY));
+	HA_ATOMIC_STORE(&inst->lazy_state, SSL_LAZY_ST_FAILED);
+ end:
+	SSL_CTX_free(ctx);
+	if (ckch) {
+		ssl_sock_free_cert_key_and_chain_contents(ckch);
+		free(ckch);
+	}
+	free(err);
+}
+
+/* Loads lazy instance <inst> synchronously. It must be called with the
+ * ckch_lock held, as returned by ssl_lazy_request(), and releases it.
+ */
+void ssl_lazy_load_locked(struct ckch_inst *inst)
+{
+	ssl_lazy_install(inst, inst->ckch_store->path, NULL);
+	HA_SPIN_UNLOCK(CKCH_LOCK, &ckch_lock);
+}
+
+/* Detaches lazy instance <inst> which is about to be released from its pending
+ * load and from the LRU. The ckch_lock must be held.
+ */
+void ssl_lazy_release_inst(struct ckch_inst *inst)
+{
+	if (inst->lazy_req) {
+		inst->lazy_req->inst = NULL;
+		inst->lazy_req = NULL;
+	}
+	if (LIST_INLIST(&inst->lazy_lru)) {
+		LIST_DEL_INIT(&inst->lazy_lru);
+		ssl_lazy_loaded--;
+	}
+}
+
+#ifdef HAVE_SSL_LAZY_ASYNC
+
+/* Queues the load of lazy instance <inst> to the loaders. The SNI lock of its
+ * bind_conf must be held. Returns 0 on failure.
+ */
+static int ssl_lazy_queue_req(struct ckch_inst *inst)
+{
+	const char *path = inst->ckch_store->path;
+	struct ssl_lazy_req *req;
+
+	req = calloc(1, sizeof(*req) + strlen(path) + 1);
+	if (!req)
+		return 0;
+
+	strcpy(req->path, path);
+	req->inst = inst;
+	req->tid = tid;
+	MT_LIST_INIT(&req->list);
+	inst->lazy_req = req;
+
+	pthread_mutex_lock(&ssl_lazy_queue_lock);
+	LIST_APPEND(&ssl_lazy_queue, &req->queue);
+	pthread_cond_signal(&ssl_lazy_queue_cond);
+	pthread_mutex_unlock(&ssl_lazy_queue_lock);
+	return 1;
+}
+
+/* Main loop of a loader, only reading the files */
+static void *ssl_lazy_loader_run(void *arg)
+{
+	struct ssl_lazy_req *req;
+	int thr;
+
+	pthread_mutex_lock(&ssl_lazy_queue_lock);
+	while (1) {
+		while (LIST_ISEMPTY(&ssl_lazy_queue) && !ssl_lazy_loaders_stop)
+			pthread_cond_wait(&ssl_lazy_queue_cond, &ssl_lazy_queue_lock);
+		if (ssl_lazy_loaders_stop)
+			break;
+		req = LIST_NEXT(&ssl_lazy_queue, struct ssl_lazy_req *, queue);
+		LIST_DELETE(&req->queue);
+		pthread_mutex_unlock(&ssl_lazy_queue_lock);
+
+		req->buf = ssl_lazy_read_file(req->path);
+		if (!req->buf)
+			req->err = errno;
+
+		/* the request may be released as soon as it is in the list */
+		if (ssl_lazy_build_task) {
+			MT_LIST_APPEND(&ssl_lazy_build_list, &req->list);
+			task_wakeup(ssl_lazy_build_task, TASK_WOKEN_MSG);
+		}
+		else {
+			thr = req->tid;
+			MT_LIST_APPEND(&ssl_lazy_thr[thr].done, &req->list);
+			tasklet_wakeup(ssl_lazy_thr[thr].tasklet);
+		}
+
+		pthread_mutex_lock(&ssl_lazy_queue_lock);
+	}
+	pthread_mutex_unlock(&ssl_lazy_queue_lock);
+	return NULL;
+}
+
+/* Installs the certificates whose reads completed in list <done>, then releases
+ * the requests. The ckch_lock must be held.
+ */
+static void ssl_lazy_install_done(struct mt_list *done)
+{
+	struct ssl_lazy_req *req;
+
+	while ((req = MT_LIST_POP(done, struct ssl_lazy_req *, list))) {
+		if (req->inst) {
+			req->inst->lazy_req = NULL;
+			if (req->buf)
+				ssl_lazy_install(req->inst, req->path, req->buf);
+			else {
+				send_log(NULL, LOG_ERR, "unable to read lazy certificate '%s' : %s.\n",
+				         req->path, strerror(req->err));
+				req->inst->lazy_retry = tick_add(now_ms, MS_TO_TICKS(SSL_LAZY_RETRY_DELAY));
+				HA_ATOMIC_STORE(&req->inst->lazy_state, SSL_LAZY_ST_FAILED);
+			}
+		}
+		free(req->buf);
+		free(req);
+	}
+}
+
+/* Tasklet installing the certificates read for the current thread, then waking
+ * up the parked handshakes of the current thread so that they look their
+ * certificate up again. Those whose certificate is still being loaded will
+ * park again. The other threads are woken up when a certificate was installed.
+ */
+static struct task *ssl_lazy_process(struct task *t, void *context, unsigned int state)
+{
+	struct ssl_lazy_thr *thr = context;
+	struct ssl_sock_ctx *ctx, *back;
+	int i;
+
+	if (!MT_LIST_ISEMPTY(&thr->done)) {
+		/* the CLI may hold the lock while yielding */
+		if (HA_SPIN_TRYLOCK(CKCH_LOCK, &ckch_lock)) {
+			task_schedule(thr->retry, tick_add(now_ms, MS_TO_TICKS(10)));
+			return t;
+		}
+
+		ssl_lazy_install_done(&thr->done);
+		HA_SPIN_UNLOCK(CKCH_LOCK, &ckch_lock);
+
+		for (i = 0; i < global.nbthread; i++) {
+			if (i != tid)
+				tasklet_wakeup(ssl_lazy_thr[i].tasklet);
+		}
+	}
+
+	list_for_each_entry_safe(ctx, back, &thr->waiters, lazy_list) {
+		LIST_DEL_INIT(&ctx->lazy_list);
+		tasklet_wakeup(ctx->wait_event.tasklet);
+	}
+	return t;
+}
+
+/* Task running on the "crypto" threads, building the SSL contexts of the
+ * certificates read by the loaders, then waking all the threads up so that
+ * their parked handshakes look their certificate up again.
+ */
+static struct task *ssl_lazy_build(struct task *t, void *context, unsigned int state)
+{
+	int i;
+
+	if (MT_LIST_ISEMPTY(&ssl_lazy_build_list))
+		goto out;
+
+	/* the CLI may hold the lock while yielding */
+	if (HA_SPIN_TRYLOCK(CKCH_LOCK, &ckch_lock)) {
+		t->expire = tick_add(now_ms, MS_TO_TICKS(10));
+		return t;
+	}
+
+	ssl_lazy_install_done(&ssl_lazy_build_list);
+	HA_SPIN_UNLOCK(CKCH_LOCK, &ckch_lock);
+
+	for (i = 0; i < global.nbthread; i++)
+		tasklet_wakeup(ssl_lazy_thr[i].tasklet);
+ out:
+	t->expire = TICK_ETERNITY;
+	return t;
+}
+
+/* Task waking the tasklet up after the ckch_lock was found busy */
+static struct task *ssl_lazy_retry(struct task *t, void *context, unsigned int state)
+{
+	struct ssl_lazy_thr *thr = context;
+
+	tasklet_wakeup(thr->tasklet);
+	return t;
+}
+
+#endif /* HAVE_SSL_LAZY_ASYNC */
+
+/* Requests the SSL context of lazy instance <inst> for the handshake of
+ * connection <conn>. The SNI lock of the instance's bind_conf must be held.
+ * Returns :
+ *   1 if the handshake was parked until the load completes ;
+ *   0 if the certificate must be loaded synchronously by calling
+ *     ssl_lazy_load_locked() after releasing the SNI lock, the ckch_lock
+ *     being held ;
+ *  -1 if the certificate is not available.
+ */
+int ssl_lazy_request(struct connection *conn, struct ckch_inst *inst)
+{
+	int state = HA_ATOMIC_LOAD(&inst->lazy_state);
+
+	if (state == SSL_LAZY_ST_FAILED && !tick_is_expired(inst->lazy_retry, now_ms))
+		return -1;
+
+#ifdef HAVE_SSL_LAZY_ASYNC
+	if (ssl_lazy_loaders_started && conn->xprt == &ssl_sock
+#ifdef USE_QUIC
+	    && !conn->qc
+#endif
+	    ) {
+		struct ssl_sock_ctx *ctx = conn->xprt_ctx;
+
+		/* the load failed, or the context was evicted too many times
+		 * before the handshake could use it.
+		 */
+		if (ctx->lazy_parked >= SSL_LAZY_MAX_PARK ||
+		    (ctx->lazy_parked && state == SSL_LAZY_ST_FAILED))
+			return -1;
+
+		if (state != SSL_LAZY_ST_PENDING &&
+		    HA_ATOMIC_CAS(&inst->lazy_state, &state, SSL_LAZY_ST_PENDING) &&
+		    !ssl_lazy_queue_req(inst)) {
+			HA_ATOMIC_STORE(&inst->lazy_state, SSL_LAZY_ST_IDLE);
+			return -1;
+		}
+
+		LIST_APPEND(&ssl_lazy_thr[tid].waiters, &ctx->lazy_list);
+		ctx->lazy_parked++;
+		return 1;
+	}
+#endif
+	if (HA_SPIN_TRYLOCK(CKCH_LOCK, &ckch_lock))
+		return -1;
+	return 0;
+}
+
+#ifdef HAVE_SSL_LAZY_ASYNC
+
+/* Allocates the tasklet of the current thread and starts the loaders from the
+ * first thread.
+ */
+static int ssl_lazy_init_per_thread()
+{
+	struct ssl_lazy_thr *thr = &ssl_lazy_thr[tid];
+	sigset_t blocked_sig, old_sig;
+	int i;
+
+	if (!global_ssl.lazy_load || master)
+		return 1;
+
+	MT_LIST_INIT(&thr->done);
+	LIST_INIT(&thr->waiters);
+
+	thr->tasklet = tasklet_new();
+	thr->retry = task_new(tid_bit);
+	if (!thr->tasklet || !thr->retry)
+		return 0;
+	thr->tasklet->process = ssl_lazy_process;
+	thr->tasklet->context = thr;
+	thr->tasklet->tid = tid;
+	thr->retry->process = ssl_lazy_retry;
+	thr->retry->context = thr;
+
+	if (tid != 0)
+		return 1;
+
+	if (task_class_mask[TASK_CLASS_CRYPTO]) {
+		ssl_lazy_build_task = task_new(task_class_threads(TASK_CLASS_CRYPTO));
+		if (!ssl_lazy_build_task)
+			return 0;
+		ssl_lazy_build_task->process = ssl_lazy_build;
+	}
+
+	ssl_lazy_loaders_thr = calloc(SSL_LAZY_LOADERS, sizeof(*ssl_lazy_loaders_thr));
+	if (!ssl_lazy_loaders_thr)
+		return 0;
+
+	/* the loaders must never catch signals */
+	sigfillset(&blocked_sig);
+	pthread_sigmask(SIG_SETMASK, &blocked_sig, &old_sig);
+	for (i = 0; i < SSL_LAZY_LOADERS; i++) {
+		if (pthread_create(&ssl_lazy_loaders_thr[i], NULL, ssl_lazy_loader_run, NULL) != 0) {
+			ha_alert("failed to start SSL lazy certificate loader %d.\n", i);
+			break;
+		}
+	}
+	pthread_sigmask(SIG_SETMASK, &old_sig, NULL);
+
+	ssl_lazy_loaders = i;
+	if (i < SSL_LAZY_LOADERS)
+		return 0;
+	ssl_lazy_loaders_started = 1;
+	return 1;
+}
+
+/* Stops the loaders and releases the pending requests */
+static void ssl_lazy_deinit()
+{
+	struct ssl_lazy_req *req, *back;
+	int i;
+
+	if (!ssl_lazy_loaders_thr)
+		return;
+
+	pthread_mutex_lock(&ssl_lazy_queue_lock);
+	ssl_lazy_loaders_stop = 1;
+	pthread_cond_broadcast(&ssl_lazy_queue_cond);
+	pthread_mutex_unlock(&ssl_lazy_queue_lock);
+
+	for (i = 0; i < ssl_lazy_loaders; i++)
+		pthread_join(ssl_lazy_loaders_thr[i], NULL);
+	ha_free(&ssl_lazy_loaders_thr);
+
+	list_for_each_entry_safe(req, back, &ssl_lazy_queue, queue) {
+		LIST_DELETE(&req->queue);
+		if (req->inst)
+			req->inst->lazy_req = NULL;
+		free(req);
+	}
+
+	for (i = 0; i <= global.nbthread; i++) {
+		struct mt_list *done = i < global.nbthread ? &ssl_lazy_thr[i].done : &ssl_lazy_build_list;
+
+		while ((req = MT_LIST_POP(done, struct ssl_lazy_req *, list))) {
+			if (req->inst)
+				req->inst->lazy_req = NULL;
+			free(req->buf);
+			free(req);
+		}
+	}
+	task_destroy(ssl_lazy_build_task);
+	ssl_lazy_build_task = NULL;
+}
+
+REGISTER_PER_THREAD_INIT(ssl_lazy_init_per_thread);
+REGISTER_POST_DEINIT(ssl_lazy_deinit);
+
+#endif /* HAVE_SSL_LAZY_ASYNC */
+
+/*
+ * Local variables:
+ *  c-indent-level: 8
+ *  c-basic-offset: 8
+ * End:
+ */
@@ -41,6 +41,16 @@ smp_fetch_ssl_fc_has_early(const struct arg *args, struct sample *smp, const cha
 	struct connection *conn;
 
 	conn = objt_conn(smp->sess->origin);
+#ifdef USE_QUIC
+	/* QUIC connections report their early data using the same flags */
+	if (conn && conn->xprt == xprt_get(XPRT_QUIC)) {
+		smp->flags = 0;
+		smp->data.type = SMP_T_BOOL;
+		smp->data.u.sint = ((conn->flags & CO_FL_EARLY_DATA) &&
+		                    (conn->flags & CO_FL_EARLY_SSL_HS)) ? 1 : 0;
+		return 1;
+	}
+#endif
 	ssl = ssl_sock_get_ssl_object(conn);
 	if (!ssl)
 		return 0;
@@ -792,6 +802,38 @@ smp_fetch_ssl_fc_is_resumed(const struct arg *args, struct sample *smp, const ch
 	return 1;
 }
 
+/* integer, returns the CPU time in microseconds spent in the handshake if
+ * front conn. transport layer is SSL. This function is also usable on backend
+ * conn if the fetch keyword 5th char is 'b'.
+ */
+static int
+smp_fetch_ssl_fc_hsk_cpu(const struct arg *args, struct sample *smp, const char *kw, void *private)
+{
+	struct connection *conn;
+	struct ssl_sock_ctx *ctx;
+
+	if (obj_type(smp->sess->origin) == OBJ_TYPE_CHECK)
+		conn = (kw[4] == 'b') ? cs_conn(__objt_check(smp->sess->origin)->cs) : NULL;
+	else
+		conn = (kw[4] != 'b') ? objt_conn(smp->sess->origin) :
+			smp->strm ? cs_conn(objt_cs(smp->strm->si[1].end)) : NULL;
+
+	if (!conn || conn->xprt != &ssl_sock)
+		return 0;
+
+	if (conn->flags & CO_FL_WAIT_XPRT) {
+		smp->flags = SMP_F_MAY_CHANGE;
+		return 0;
+	}
+
+	ctx = conn->xprt_ctx;
+
+	smp->data.type = SMP_T_SINT;
+	smp->data.u.sint = ctx->hsk_cpu / 1000;
+	smp->flags = SMP_F_VOL_SESS;
+	return 1;
+}
+
 /* string, returns the used cipher if front conn. transport layer is SSL.
  * This function is also usable on backend conn if the fetch keyword 5th
  * char is 'b'.
@@ -1455,6 +1497,7 @@ static struct sample_fetch_kw_list sample_fetch_keywords = {ILH, {
 #if defined(OPENSSL_NPN_NEGOTIATED) && !defined(OPENSSL_NO_NEXTPROTONEG)
 	{ "ssl_bc_npn",             smp_fetch_ssl_fc_npn,         0,                   NULL,    SMP_T_STR,  SMP_USE_L5SRV },
 #endif
+	{ "ssl_bc_hsk_cpu",         smp_fetch_ssl_fc_hsk_cpu,     0,                   NULL,    SMP_T_SINT, SMP_USE_L5SRV },
 	{ "ssl_bc_is_resumed",      smp_fetch_ssl_fc_is_resumed,  0,                   NULL,    SMP_T_BOOL, SMP_USE_L5SRV },
 	{ "ssl_bc_protocol",        smp_fetch_ssl_fc_protocol,    0,                   NULL,    SMP_T_STR,  SMP_USE_L5SRV },
 	{ "ssl_bc_unique_id",       smp_fetch_ssl_fc_unique_id,   0,                   NULL,    SMP_T_BIN,  SMP_USE_L5SRV },
@@ -1499,6 +1542,7 @@ static struct sample_fetch_kw_list sample_fetch_keywords = {ILH, {
 	{ "ssl_fc_has_crt",         smp_fetch_ssl_fc_has_crt,     0,                   NULL,    SMP_T_BOOL, SMP_USE_L5CLI },
 	{ "ssl_fc_has_early",       smp_fetch_ssl_fc_has_early,   0,                   NULL,    SMP_T_BOOL, SMP_USE_L5CLI },
 	{ "ssl_fc_has_sni",         smp_fetch_ssl_fc_has_sni,     0,                   NULL,    SMP_T_BOOL, SMP_USE_L5CLI },
+	{ "ssl_fc_hsk_cpu",         smp_fetch_ssl_fc_hsk_cpu,     0,                   NULL,    SMP_T_SINT, SMP_USE_L5CLI },
 	{ "ssl_fc_is_resumed",      smp_fetch_ssl_fc_is_resumed,  0,                   NULL,    SMP_T_BOOL, SMP_USE_L5CLI },
 #if defined(OPENSSL_NPN_NEGOTIATED) && !defined(OPENSSL_NO_NEXTPROTONEG)
 	{ "ssl_fc_npn",             smp_fetch_ssl_fc_npn,         0,                   NULL,    SMP_T_STR,  SMP_USE_L5CLI },
@@ -39,6 +39,9 @@
 #include <sys/types.h>
 #include <netdb.h>
 #include <netinet/tcp.h>
+#ifdef __linux__
+#include <linux/tls.h>
+#endif
 
 #include <import/ebpttree.h>
 #include <import/ebsttree.h>
@@ -66,8 +69,10 @@
 #include <haproxy/proxy.h>
 #include <haproxy/server.h>
 #include <haproxy/shctx.h>
+#include <haproxy/ssl_async.h>
 #include <haproxy/ssl_ckch.h>
 #include <haproxy/ssl_crtlist.h>
+#include <haproxy/ssl_lazy.h>
 #include <haproxy/ssl_sock.h>
 #include <haproxy/ssl_utils.h>
 #include <haproxy/stats.h>
@@ -77,6 +82,7 @@
 #include <haproxy/ticks.h>
 #include <haproxy/time.h>
 #include <haproxy/tools.h>
+#include <haproxy/usdt.h>
 #include <haproxy/vars.h>
 #include <haproxy/xprt_quic.h>
 
@@ -124,6 +130,10 @@ struct global_ssl global_ssl = {
 #endif
 	.default_dh_param = SSL_DEFAULT_DH_PARAM,
 	.ctx_cache = DEFAULT_SSL_CTX_CACHE,
+	.cache_shards = 1,
+	.ticket_rotate = TLS_TICKETS_ROTATE,
+	.lazy_cache_size = SSL_LAZY_CACHE_SIZE,
+	.load_threads = 1,
 	.capture_cipherlist = 0,
 	.extra_files = SSL_GF_ALL,
 	.extra_files_noext = 0,
@@ -141,6 +151,8 @@ enum {
 	SSL_ST_SESS,
 	SSL_ST_REUSED_SESS,
 	SSL_ST_FAILED_HANDSHAKE,
+	SSL_ST_FULL_HSK_CPU,
+	SSL_ST_REUSED_HSK_CPU,
 
 	SSL_ST_STATS_COUNT /* must be the last member of the enum */
 };
@@ -152,12 +164,18 @@ static struct name_desc ssl_stats[] = {
 	                              .desc = "Total number of ssl sessions reused" },
 	[SSL_ST_FAILED_HANDSHAKE] = { .name = "ssl_failed_handshake",
 	                              .desc = "Total number of failed handshake" },
+	[SSL_ST_FULL_HSK_CPU]     = { .name = "ssl_full_hsk_cpu",
+	                              .desc = "Total CPU time spent in full or failed handshakes, in microseconds" },
+	[SSL_ST_REUSED_HSK_CPU]   = { .name = "ssl_reused_hsk_cpu",
+	                              .desc = "Total CPU time spent in handshakes reusing a session, in microseconds" },
 };
 
 static struct ssl_counters {
 	long long sess;
 	long long reused_sess;
 	long long failed_handshake;
+	long long full_hsk_cpu;
+	long long reused_hsk_cpu;
 } ssl_counters;
 
 static void ssl_fill_stats(void *data, struct field *stats)
@@ -167,6 +185,8 @@ static void ssl_fill_stats(void *data, struct field *stats)
 	stats[SSL_ST_SESS]             = mkf_u64(FN_COUNTER, counters->sess);
 	stats[SSL_ST_REUSED_SESS]      = mkf_u64(FN_COUNTER, counters->reused_sess);
 	stats[SSL_ST_FAILED_HANDSHAKE] = mkf_u64(FN_COUNTER, counters->failed_handshake);
+	stats[SSL_ST_FULL_HSK_CPU]     = mkf_u64(FN_COUNTER, counters->full_hsk_cpu);
+	stats[SSL_ST_REUSED_HSK_CPU]   = mkf_u64(FN_COUNTER, counters->reused_hsk_cpu);
 }
 
 static struct stats_module ssl_stats_module = {
@@ -186,6 +206,199 @@ INITCALL1(STG_REGISTER, stats_register_module, &ssl_stats_module);
 struct task *ssl_sock_io_cb(struct task *, void *, unsigned int);
 static int ssl_sock_handshake(struct connection *conn, unsigned int flag);
 
+#ifdef HAVE_SSL_KTLS
+/* these BIO controls are internal to OpenSSL, which sends them to the BIO
+ * when it wants to hand the crypto over to the kernel.
+ */
+#ifndef BIO_CTRL_SET_KTLS
+#define BIO_CTRL_SET_KTLS                    72
+#endif
+#ifndef BIO_CTRL_SET_KTLS_TX_SEND_CTRL_MSG
+#define BIO_CTRL_SET_KTLS_TX_SEND_CTRL_MSG   74
+#endif
+#ifndef BIO_CTRL_CLEAR_KTLS_TX_CTRL_MSG
+#define BIO_CTRL_CLEAR_KTLS_TX_CTRL_MSG      75
+#endif
+
+/* Installs the keys in <info> into the kernel for the socket below <ctx>, for
+ * transmission if <is_tx> is set, otherwise for reception. This is only
+ * possible when running directly over a socket. Returns 1 on success, 0 if
+ * OpenSSL must keep doing the crypto itself.
+ */
+static int ssl_sock_ktls_start(struct ssl_sock_ctx *ctx, int is_tx, void *info)
+{
+	const struct tls_crypto_info *ci = info;
+	struct connection *conn;
+	socklen_t len;
+
+	if (!ctx || !ci || ctx->xprt != xprt_get(XPRT_RAW))
+		return 0;
+
+	conn = ctx->conn;
+	if (!conn_ctrl_ready(conn) || conn->ctrl->sock_type != SOCK_STREAM)
+		return 0;
+
+	switch (ci->cipher_type) {
+	case TLS_CIPHER_AES_GCM_128:
+		len = sizeof(struct tls12_crypto_info_aes_gcm_128);
+		break;
+#ifdef TLS_CIPHER_AES_GCM_256
+	case TLS_CIPHER_AES_GCM_256:
+		len = sizeof(struct tls12_crypto_info_aes_gcm_256);
+		break;
+#endif
+#ifdef TLS_CIPHER_AES_CCM_128
+	case TLS_CIPHER_AES_CCM_128:
+		len = sizeof(struct tls12_crypto_info_aes_ccm_128);
+		break;
+#endif
+#ifdef TLS_CIPHER_CHACHA20_POLY1305
+	case TLS_CIPHER_CHACHA20_POLY1305:
+		len = sizeof(struct tls12_crypto_info_chacha20_poly1305);
+		break;
+#endif
+	default:
+		return 0;
+	}
+
+	if (!(ctx->xprt_st & (SSL_SOCK_ST_FL_KTLS_TX | SSL_SOCK_ST_FL_KTLS_RX)) &&
+	    setsockopt(conn->handle.fd, SOL_TCP, TCP_ULP, "tls", sizeof("tls")) == -1)
+		return 0;
+
+	if (setsockopt(conn->handle.fd, SOL_TLS, is_tx ? TLS_TX : TLS_RX, ci, len) == -1)
+		return 0;
+
+	ctx->xprt_st |= is_tx ? SSL_SOCK_ST_FL_KTLS_TX : SSL_SOCK_ST_FL_KTLS_RX;
+	return 1;
+}
+
+/* Sends <num> bytes from <buf> as a non-application data record of the type
+ * announced by OpenSSL, through the kernel. Works like ha_ssl_write().
+ */
+static int ha_ssl_ktls_write_ctrl(BIO *h, struct ssl_sock_ctx *ctx, const char *buf, int num)
+{
+	struct connection *conn = ctx->conn;
+	union {
+		struct cmsghdr hdr;
+		char buf[CMSG_SPACE(sizeof(unsigned char))];
+	} cmsgbuf;
+	struct cmsghdr *cmsg;
+	struct msghdr msg;
+	struct iovec iov;
+	int ret;
+
+	if (!conn_ctrl_ready(conn) || !fd_send_ready(conn->handle.fd))
+		goto retry;
+
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_control = cmsgbuf.buf;
+	msg.msg_controllen = sizeof(cmsgbuf.buf);
+	cmsg = CMSG_FIRSTHDR(&msg);
+	cmsg->cmsg_level = SOL_TLS;
+	cmsg->cmsg_type = TLS_SET_RECORD_TYPE;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(unsigned char));
+	*((unsigned char *)CMSG_DATA(cmsg)) = ctx->ktls_ctrl_type;
+	msg.msg_controllen = cmsg->cmsg_len;
+
+	iov.iov_base = (void *)buf;
+	iov.iov_len = num;
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+
+	do {
+		ret = sendmsg(conn->handle.fd, &msg, MSG_DONTWAIT | MSG_NOSIGNAL);
+	} while (ret == -1 && errno == EINTR);
+
+	if (ret >= 0) {
+		/* the record is always sent at once */
+		ctx->ktls_ctrl_type = 0;
+		return num;
+	}
+
+	if (errno == EAGAIN || errno == ENOTCONN) {
+		fd_cant_send(conn->handle.fd);
+		goto retry;
+	}
+
+	conn->flags |= CO_FL_ERROR | CO_FL_SOCK_RD_SH | CO_FL_SOCK_WR_SH;
+	BIO_clear_retry_flags(h);
+	return -1;
+
+ retry:
+	BIO_set_retry_write(h);
+	return -1;
+}
+
+/* Reads one record decrypted by the kernel into <buf> of size <size>, prefixed
+ * with the TLS record header OpenSSL expects. Works like ha_ssl_read().
+ */
+static int ha_ssl_ktls_read(BIO *h, struct ssl_sock_ctx *ctx, char *buf, int size)
+{
+	struct connection *conn = ctx->conn;
+	union {
+		struct cmsghdr hdr;
+		char buf[CMSG_SPACE(sizeof(unsigned char))];
+	} cmsgbuf;
+	struct cmsghdr *cmsg;
+	struct msghdr msg;
+	struct iovec iov;
+	int ret;
+
+	/* OpenSSL always passes room for a whole record */
+	if (size < SSL3_RT_HEADER_LENGTH + EVP_GCM_TLS_TAG_LEN) {
+		BIO_clear_retry_flags(h);
+		return -1;
+	}
+
+	if (!conn_ctrl_ready(conn) || !fd_recv_ready(conn->handle.fd))
+		goto retry;
+
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_control = cmsgbuf.buf;
+	msg.msg_controllen = sizeof(cmsgbuf.buf);
+	iov.iov_base = buf + SSL3_RT_HEADER_LENGTH;
+	iov.iov_len = size - SSL3_RT_HEADER_LENGTH - EVP_GCM_TLS_TAG_LEN;
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+
+	do {
+		ret = recvmsg(conn->handle.fd, &msg, MSG_DONTWAIT | MSG_NOSIGNAL);
+	} while (ret == -1 && errno == EINTR);
+
+	if (ret > 0) {
+		cmsg = CMSG_FIRSTHDR(&msg);
+		if (cmsg && cmsg->cmsg_level == SOL_TLS && cmsg->cmsg_type == TLS_GET_RECORD_TYPE) {
+			buf[0] = *((unsigned char *)CMSG_DATA(cmsg));
+			buf[1] = TLS1_2_VERSION_MAJOR;
+			buf[2] = TLS1_2_VERSION_MINOR;
+			buf[3] = (ret >> 8) & 0xff;
+			buf[4] = ret & 0xff;
+			ret += SSL3_RT_HEADER_LENGTH;
+		}
+		return ret;
+	}
+
+	if (ret == 0) {
+		conn_sock_read0(conn);
+		BIO_clear_retry_flags(h);
+		return 0;
+	}
+
+	if (errno == EAGAIN || errno == ENOTCONN) {
+		fd_cant_recv(conn->handle.fd);
+		goto retry;
+	}
+
+	conn->flags |= CO_FL_ERROR | CO_FL_SOCK_RD_SH | CO_FL_SOCK_WR_SH;
+	BIO_clear_retry_flags(h);
+	return -1;
+
+ retry:
+	BIO_set_retry_read(h);
+	return -1;
+}
+#endif /* HAVE_SSL_KTLS */
+
 /* Methods to implement OpenSSL BIO */
 static int ha_ssl_write(BIO *h, const char *buf, int num)
 {
@@ -194,6 +407,10 @@ static int ha_ssl_write(BIO *h, const char *buf, int num)
 	int ret;
 
 	ctx = BIO_get_data(h);
+#ifdef HAVE_SSL_KTLS
+	if (ctx->ktls_ctrl_type)
+		return ha_ssl_ktls_write_ctrl(h, ctx, buf, num);
+#endif
 	tmpbuf.size = num;
 	tmpbuf.area = (void *)(uintptr_t)buf;
 	tmpbuf.data = num;
@@ -226,6 +443,10 @@ static int ha_ssl_read(BIO *h, char *buf, int size)
 	int ret;
 
 	ctx = BIO_get_data(h);
+#ifdef HAVE_SSL_KTLS
+	if (ctx->xprt_st & SSL_SOCK_ST_FL_KTLS_RX)
+		return ha_ssl_ktls_read(h, ctx, buf, size);
+#endif
 	tmpbuf.size = size;
 	tmpbuf.area = buf;
 	tmpbuf.data = 0;
@@ -242,12 +463,36 @@ static int ha_ssl_read(BIO *h, char *buf, int size)
 
 static long ha_ssl_ctrl(BIO *h, int cmd, long arg1, void *arg2)
 {
+#ifdef HAVE_SSL_KTLS
+	struct ssl_sock_ctx *ctx = BIO_get_data(h);
+#endif
 	int ret = 0;
 	switch (cmd) {
 	case BIO_CTRL_DUP:
 	case BIO_CTRL_FLUSH:
 		ret = 1;
 		break;
+#ifdef HAVE_SSL_KTLS
+	case BIO_CTRL_SET_KTLS:
+		ret = ssl_sock_ktls_start(ctx, arg1, arg2);
+		break;
+	case BIO_CTRL_GET_KTLS_SEND:
+		ret = ctx && (ctx->xprt_st & SSL_SOCK_ST_FL_KTLS_TX);
+		break;
+	case BIO_CTRL_GET_KTLS_RECV:
+		ret = ctx && (ctx->xprt_st & SSL_SOCK_ST_FL_KTLS_RX);
+		break;
+	case BIO_CTRL_SET_KTLS_TX_SEND_CTRL_MSG:
+		if (ctx)
+			ctx->ktls_ctrl_type = arg1;
+		ret = 1;
+		break;
+	case BIO_CTRL_CLEAR_KTLS_TX_CTRL_MSG:
+		if (ctx)
+			ctx->ktls_ctrl_type = 0;
+		ret = 1;
+		break;
+#endif
 	}
 	return ret;
 }
@@ -499,8 +744,13 @@ const char *SSL_SOCK_KEYTYPE_NAMES[] = {
 	"rsa"
 };
 
-static struct shared_context *ssl_shctx = NULL; /* ssl shared session cache */
-static struct eb_root *sh_ssl_sess_tree; /* ssl shared session tree */
+/* The shared session cache is split into shards, each with its own shctx (hence
+ * its own blocks and lock) and its own tree of sessions stored in the extra area
+ * of the shctx. A session always lives in the shard designated by the hash of
+ * its id.
+ */
+static struct shared_context **ssl_shctx = NULL; /* ssl shared session cache shards */
+static unsigned int ssl_shctx_shards = 0;        /* number of shards */
 
 /* Dedicated callback functions for heartbeat and clienthello.
  */
@@ -2295,8 +2545,9 @@ int ssl_sock_switchctx_cbk(SSL *ssl, int *al, void *arg)
 	char *wildp = NULL;
 	const uint8_t *servername;
 	size_t servername_len;
-	struct ebmb_node *node, *n, *node_ecdsa = NULL, *node_rsa = NULL, *node_anonymous = NULL;
+	struct ebmb_node *node, *n, *node_ecdsa, *node_rsa, *node_anonymous;
 	int allow_early = 0;
+	int lazy_loaded = 0;
 	int i;
 
 	conn = SSL_get_ex_data(ssl, ssl_app_data_index);
@@ -2443,6 +2694,8 @@ int ssl_sock_switchctx_cbk(SSL *ssl, int *al, void *arg)
 	}
 	trash.area[i] = 0;
 
+ lookup:
+	node_ecdsa = node_rsa = node_anonymous = NULL;
 	HA_RWLOCK_RDLOCK(SNI_LOCK, &s->sni_lock);
 
 	/* Look for an ECDSA, RSA and DSA certificate, first in the single
@@ -2506,9 +2759,33 @@ int ssl_sock_switchctx_cbk(SSL *ssl, int *al, void *arg)
 	else
 		node = node_rsa;        /* no rsa signature case (far far away) */
 
+	if (node && !container_of(node, struct sni_ctx, name)->ctx) {
+		/* lazy certificate not loaded yet */
+		struct ckch_inst *inst = container_of(node, struct sni_ctx, name)->ckch_inst;
+
+		i = lazy_loaded ? -1 : ssl_lazy_request(conn, inst);
+		HA_RWLOCK_RDUNLOCK(SNI_LOCK, &s->sni_lock);
+#ifdef HAVE_SSL_LAZY_ASYNC
+		if (i > 0)
+			return SSL_CLIENT_HELLO_RETRY;
+#endif
+		if (i == 0) {
+			ssl_lazy_load_locked(inst);
+			lazy_loaded = 1;
+			goto lookup;
+		}
+		/* no certificate available */
+		HA_RWLOCK_RDLOCK(SNI_LOCK, &s->sni_lock);
+		node = NULL;
+	}
+
 	if (node) {
 		/* switch ctx */
 		struct ssl_bind_conf *conf = container_of(node, struct sni_ctx, name)->conf;
+		struct ckch_inst *inst = container_of(node, struct sni_ctx, name)->ckch_inst;
+
+		if (inst && inst->lazy)
+			HA_ATOMIC_STORE(&inst->lazy_used, 1);
 		ssl_sock_switchctx_set(ssl, container_of(node, struct sni_ctx, name)->ctx);
 		if (conf) {
 			methodVersions[conf->ssl_methods.min].ssl_set_version(ssl, SET_MIN);
@@ -2565,6 +2842,7 @@ static int ssl_sock_switchctx_cbk(SSL *ssl, int *al, void *priv)
 	const char *wildp = NULL;
 	struct ebmb_node *node, *n;
 	struct bind_conf *s = priv;
+	int lazy_loaded = 0;
 	int i;
 	(void)al; /* shut gcc stupid warning */
 
@@ -2591,6 +2869,7 @@ static int ssl_sock_switchctx_cbk(SSL *ssl, int *al, void *priv)
 	}
 	trash.area[i] = 0;
 
+ lookup:
 	HA_RWLOCK_RDLOCK(SNI_LOCK, &s->sni_lock);
 	node = NULL;
 	/* lookup in full qualified names */
@@ -2611,6 +2890,25 @@ static int ssl_sock_switchctx_cbk(SSL *ssl, int *al, void *priv)
 			}
 		}
 	}
+	if (node && !container_of(node, struct sni_ctx, name)->ctx) {
+		/* lazy certificate not loaded yet, it can only be loaded
+		 * synchronously here.
+		 */
+		struct ckch_inst *inst = container_of(node, struct sni_ctx, name)->ckch_inst;
+
+		i = lazy_loaded ? -1 : ssl_lazy_request(SSL_get_ex_data(ssl, ssl_app_data_index), inst);
+		HA_RWLOCK_RDUNLOCK(SNI_LOCK, &s->sni_lock);
+		if (i == 0) {
+			ssl_lazy_load_locked(inst);
+			lazy_loaded = 1;
+			goto lookup;
+		}
+		HA_RWLOCK_RDLOCK(SNI_LOCK, &s->sni_lock);
+		node = NULL;
+	}
+	else if (node && container_of(node, struct sni_ctx, name)->ckch_inst->lazy)
+		HA_ATOMIC_STORE(&container_of(node, struct sni_ctx, name)->ckch_inst->lazy_used, 1);
+
 	if (!node) {
 #if (!defined SSL_NO_GENERATE_CERTIFICATES)
 		if (s->generate_certs && ssl_sock_generate_certificate(servername, s, ssl)) {
@@ -2889,7 +3187,9 @@ static int ckch_inst_add_cert_sni(SSL_CTX *ctx, struct ckch_inst *ckch_inst,
 		if (!sc)
 			return -1;
 		memcpy(sc->name.key, trash.area, len + 1);
-		SSL_CTX_up_ref(ctx);
+		/* lazy instances have no context yet */
+		if (ctx)
+			SSL_CTX_up_ref(ctx);
 		sc->ctx = ctx;
 		sc->conf = conf;
 		sc->kinfo = kinfo;
@@ -2929,7 +3229,7 @@ void ssl_sock_load_cert_sni(struct ckch_inst *ckch_inst, struct bind_conf *bind_
 
 		for (; node; node = ebmb_next_dup(node)) {
 			sc1 = ebmb_entry(node, struct sni_ctx, name);
-			if (sc1->ctx == sc0->ctx && sc1->conf == sc0->conf
+			if (sc0->ctx && sc1->ctx == sc0->ctx && sc1->conf == sc0->conf
 			    && sc1->neg == sc0->neg && sc1->wild == sc0->wild) {
 				/* it's a duplicate, we should remove and free it */
 				LIST_DELETE(&sc0->by_ckch_inst);
@@ -3158,12 +3458,18 @@ static int ssl_sock_load_cert_chain(const char *path, const struct cert_key_and_
  * The value 0 means there is no error nor warning and
  * the operation succeed.
  */
-static int ssl_sock_put_ckch_into_ctx(const char *path, const struct cert_key_and_chain *ckch, SSL_CTX *ctx, char **err)
+int ssl_sock_put_ckch_into_ctx(const char *path, const struct cert_key_and_chain *ckch, SSL_CTX *ctx, char **err)
 {
 	int errcode = 0;
 	STACK_OF(X509) *find_chain = NULL;
+	EVP_PKEY *async_key;
+	int ret;
 
-	if (SSL_CTX_use_PrivateKey(ctx, ckch->key) <= 0) {
+	/* the key may be wrapped to run its operations on the async workers */
+	async_key = ssl_async_wrap_key(ckch->key);
+	ret = SSL_CTX_use_PrivateKey(ctx, async_key ? async_key : ckch->key);
+	EVP_PKEY_free(async_key);
+	if (ret <= 0) {
 		memprintf(err, "%sunable to load SSL private key into SSL Context '%s'.\n",
 				err && *err ? *err : "", path);
 		errcode |= ERR_ALERT | ERR_FATAL;
@@ -3231,9 +3537,16 @@ static int ssl_sock_put_srv_ckch_into_ctx(const char *path, const struct cert_ke
 {
 	int errcode = 0;
 	STACK_OF(X509) *find_chain = NULL;
+	EVP_PKEY *async_key;
+	int ret;
 
-	/* Load the private key */
-	if (SSL_CTX_use_PrivateKey(ctx, ckch->key) <= 0) {
+	/* Load the private key, possibly wrapped to run its operations on the
+	 * async workers.
+	 */
+	async_key = ssl_async_wrap_key(ckch->key);
+	ret = SSL_CTX_use_PrivateKey(ctx, async_key ? async_key : ckch->key);
+	EVP_PKEY_free(async_key);
+	if (ret <= 0) {
 		memprintf(err, "%sunable to load SSL private key into SSL Context '%s'.\n",
 				err && *err ? *err : "", path);
 		errcode |= ERR_ALERT | ERR_FATAL;
@@ -3255,6 +3568,44 @@ static int ssl_sock_put_srv_ckch_into_ctx(const char *path, const struct cert_ke
 }
 
 
+/* Allocates a lazy ckch_inst for <ckchs> whose certificate is not loaded. Its
+ * SNI entries are created from the filters and point to no SSL context until
+ * the certificate is loaded on first use by ssl_lazy_request().
+ *
+ * Returns a bitfield containing the ERR_* flags.
+ */
+static int ckch_inst_new_lazy(const char *path, struct ckch_store *ckchs, struct bind_conf *bind_conf,
+                              struct ssl_bind_conf *ssl_conf, char **sni_filter, int fcount,
+                              struct ckch_inst **ckchi, char **err)
+{
+	struct pkey_info kinfo = { .sig = TLSEXT_signature_anonymous, .bits = 0 };
+	struct ckch_inst *ckch_inst;
+	int order = 0;
+
+	ckch_inst = ckch_inst_new();
+	if (!ckch_inst) {
+		memprintf(err, "%sunable to allocate SSL context for cert '%s'.\n",
+		          err && *err ? *err : "", path);
+		return ERR_ALERT | ERR_FATAL;
+	}
+
+	while (fcount--) {
+		order = ckch_inst_add_cert_sni(NULL, ckch_inst, bind_conf, ssl_conf, kinfo, sni_filter[fcount], order);
+		if (order < 0) {
+			memprintf(err, "%sunable to create a sni context.\n", err && *err ? *err : "");
+			ckch_inst_free(ckch_inst);
+			return ERR_ALERT | ERR_FATAL;
+		}
+	}
+
+	ckch_inst->lazy = 1;
+	ckch_inst->bind_conf = bind_conf;
+	ckch_inst->ssl_conf = ssl_conf;
+	ckch_inst->ckch_store = ckchs;
+	*ckchi = ckch_inst;
+	return 0;
+}
+
 /*
  * This function allocate a ckch_inst and create its snis
  *
@@ -3287,6 +3638,17 @@ int ckch_inst_new_load_store(const char *path, struct ckch_store *ckchs, struct
 
 	ckch = ckchs->ckch;
 
+	if (ckchs->lazy && !ckch->cert) {
+		/* the default context must be loaded, and the names to index
+		 * can only come from the filters.
+		 */
+		if (bind_conf->default_ctx && ssl_lazy_filters(sni_filter, fcount))
+			return ckch_inst_new_lazy(path, ckchs, bind_conf, ssl_conf, sni_filter, fcount, ckchi, err);
+
+		if (ssl_sock_load_files_into_ckch(path, ckch, err))
+			return ERR_ALERT | ERR_FATAL;
+	}
+
 	ctx = SSL_CTX_new(SSLv23_server_method());
 	if (!ctx) {
 		memprintf(err, "%sunable to allocate SSL context for cert '%s'.\n",
@@ -3860,6 +4222,10 @@ ssl_sock_initial_ctx(struct bind_conf *bind_conf)
 		options |= SSL_OP_NO_TICKET;
 	if (bind_conf->ssl_options & BC_SSL_O_PREF_CLIE_CIPH)
 		options &= ~SSL_OP_CIPHER_SERVER_PREFERENCE;
+#ifdef HAVE_SSL_KTLS
+	if (bind_conf->ssl_options & BC_SSL_O_KTLS)
+		options |= SSL_OP_ENABLE_KTLS;
+#endif
 
 #ifdef SSL_OP_NO_RENEGOTIATION
 	options |= SSL_OP_NO_RENEGOTIATION;
@@ -3893,6 +4259,20 @@ ssl_sock_initial_ctx(struct bind_conf *bind_conf)
 }
 
 
+/* returns the shard of the session cache holding the sessions of padded id <key> */
+static inline struct shared_context *sh_ssl_sess_shctx(const unsigned char *key)
+{
+	if (ssl_shctx_shards == 1)
+		return ssl_shctx[0];
+	return ssl_shctx[XXH32(key, SSL_MAX_SSL_SESSION_ID_LENGTH, 0) % ssl_shctx_shards];
+}
+
+/* returns the tree of sessions of shard <shctx> */
+static inline struct eb_root *sh_ssl_sess_tree(struct shared_context *shctx)
+{
+	return (struct eb_root *)shctx->data;
+}
+
 static inline void sh_ssl_sess_free_blocks(struct shared_block *first, struct shared_block *block)
 {
 	if (first == block) {
@@ -3910,17 +4290,18 @@ static inline struct shared_block *sh_ssl_sess_first_block(struct sh_ssl_sess_hd
 }
 
 /* store a session into the cache
+ * shctx: the shard of the session cache, whose lock must be held
  * s_id : session id padded with zero to SSL_MAX_SSL_SESSION_ID_LENGTH
  * data: asn1 encoded session
  * data_len: asn1 encoded session length
  * Returns 1 id session was stored (else 0)
  */
-static int sh_ssl_sess_store(unsigned char *s_id, unsigned char *data, int data_len)
+static int sh_ssl_sess_store(struct shared_context *shctx, unsigned char *s_id, unsigned char *data, int data_len)
 {
 	struct shared_block *first;
 	struct sh_ssl_sess_hdr *sh_ssl_sess, *oldsh_ssl_sess;
 
-	first = shctx_row_reserve_hot(ssl_shctx, NULL, data_len + sizeof(struct sh_ssl_sess_hdr));
+	first = shctx_row_reserve_hot(shctx, NULL, data_len + sizeof(struct sh_ssl_sess_hdr));
 	if (!first) {
 		/* Could not retrieve enough free blocks to store that session */
 		return 0;
@@ -3933,29 +4314,112 @@ static int sh_ssl_sess_store(unsigned char *s_id, unsigned char *data, int data_
 
 	/* it returns the already existing node
            or current node if none, never returns null */
-	oldsh_ssl_sess = sh_ssl_sess_tree_insert(sh_ssl_sess);
+	oldsh_ssl_sess = sh_ssl_sess_tree_insert(sh_ssl_sess_tree(shctx), sh_ssl_sess);
 	if (oldsh_ssl_sess != sh_ssl_sess) {
 		 /* NOTE: Row couldn't be in use because we lock read & write function */
 		/* release the reserved row */
-		shctx_row_dec_hot(ssl_shctx, first);
+		shctx_row_dec_hot(shctx, first);
 		/* replace the previous session already in the tree */
 		sh_ssl_sess = oldsh_ssl_sess;
 		/* ignore the previous session data, only use the header */
 		first = sh_ssl_sess_first_block(sh_ssl_sess);
-		shctx_row_inc_hot(ssl_shctx, first);
+		shctx_row_inc_hot(shctx, first);
 		first->len = sizeof(struct sh_ssl_sess_hdr);
 	}
 
-	if (shctx_row_data_append(ssl_shctx, first, NULL, data, data_len) < 0) {
-		shctx_row_dec_hot(ssl_shctx, first);
+	if (shctx_row_data_append(shctx, first, NULL, data, data_len) < 0) {
+		shctx_row_dec_hot(shctx, first);
 		return 0;
 	}
 
-	shctx_row_dec_hot(ssl_shctx, first);
+	shctx_row_dec_hot(shctx, first);
 
 	return 1;
 }
 
+/* Stores a copy of session <sess> of <len> bytes once encoded into the sessions
+ * of server <srv> shared by all threads, replacing the oldest one. The caller
+ * must hold the server's SSL lock.
+ */
+static void ssl_sock_srv_share_session(struct server *srv, SSL_SESSION *sess, int len)
+{
+	struct srv_ssl_shared_sess *shared = srv->ssl_ctx.shared_sess;
+	unsigned char *ptr;
+	int slot;
+
+	HA_SPIN_LOCK(SSL_SERVER_LOCK, &shared->lock);
+	slot = shared->next;
+	shared->next = (slot + 1) % SSL_SRV_SHARED_SESS;
+	ptr = shared->sess[slot].ptr;
+	if (!ptr || shared->sess[slot].allocated_size < len) {
+		ptr = realloc(shared->sess[slot].ptr, len);
+		if (!ptr) {
+			ha_free(&shared->sess[slot].ptr);
+			goto end;
+		}
+		shared->sess[slot].ptr = ptr;
+		shared->sess[slot].allocated_size = len;
+	}
+	shared->sess[slot].size = i2d_SSL_SESSION(sess, &ptr);
+#ifdef TLS1_3_VERSION
+	shared->sess[slot].single_use = (SSL_SESSION_get_protocol_version(sess) >= TLS1_3_VERSION);
+#endif
+ end:
+	HA_SPIN_UNLOCK(SSL_SERVER_LOCK, &shared->lock);
+}
+
+/* Sets on <ssl> the most recent session shared by the threads of server <srv>,
+ * if any. A TLS 1.3 session is removed once taken. The caller must hold the
+ * server's SSL lock.
+ */
+static void ssl_sock_srv_take_session(struct server *srv, SSL *ssl)
+{
+	struct srv_ssl_shared_sess *shared = srv->ssl_ctx.shared_sess;
+	const unsigned char *ptr;
+	SSL_SESSION *sess = NULL;
+	int i, slot;
+
+	HA_SPIN_LOCK(SSL_SERVER_LOCK, &shared->lock);
+	for (i = 1; i <= SSL_SRV_SHARED_SESS; i++) {
+		slot = (shared->next + SSL_SRV_SHARED_SESS - i) % SSL_SRV_SHARED_SESS;
+		if (!shared->sess[slot].ptr || !shared->sess[slot].size)
+			continue;
+
+		ptr = shared->sess[slot].ptr;
+		sess = d2i_SSL_SESSION(NULL, &ptr, shared->sess[slot].size);
+		if (!sess || shared->sess[slot].single_use)
+			shared->sess[slot].size = 0;
+		if (sess)
+			break;
+	}
+	HA_SPIN_UNLOCK(SSL_SERVER_LOCK, &shared->lock);
+
+	if (sess) {
+		SSL_set_session(ssl, sess);
+		SSL_SESSION_free(sess);
+	}
+}
+
+/* Releases all the sessions cached for server <srv>, for all threads. The
+ * caller must hold the server's SSL lock for writing, or be the only user.
+ */
+void ssl_sock_srv_flush_sessions(struct server *srv)
+{
+	int i;
+
+	if (srv->ssl_ctx.reused_sess) {
+		for (i = 0; i < global.nbthread; i++)
+			ha_free(&srv->ssl_ctx.reused_sess[i].ptr);
+	}
+
+	if (srv->ssl_ctx.shared_sess) {
+		for (i = 0; i < SSL_SRV_SHARED_SESS; i++) {
+			ha_free(&srv->ssl_ctx.shared_sess->sess[i].ptr);
+			srv->ssl_ctx.shared_sess->sess[i].size = 0;
+		}
+	}
+}
+
 /* SSL callback used when a new session is created while connecting to a server */
 static int ssl_sess_new_srv_cb(SSL *ssl, SSL_SESSION *sess)
 {
@@ -3985,6 +4449,8 @@ static int ssl_sess_new_srv_cb(SSL *ssl, SSL_SESSION *sess)
 			s->ssl_ctx.reused_sess[tid].size = i2d_SSL_SESSION(sess,
 			    &ptr);
 		}
+		if (s->ssl_ctx.shared_sess)
+			ssl_sock_srv_share_session(s, sess, len);
 		HA_RWLOCK_RDUNLOCK(SSL_SERVER_LOCK, &s->ssl_ctx.lock);
 	} else {
 		HA_RWLOCK_RDLOCK(SSL_SERVER_LOCK, &s->ssl_ctx.lock);
@@ -3995,12 +4461,77 @@ static int ssl_sess_new_srv_cb(SSL *ssl, SSL_SESSION *sess)
 	return 0;
 }
 
+/* Returns a copy of the first TLS session cached for server <srv> in <der>,
+ * as ASN.1 DER, and its length, or 0 if there is none or on allocation
+ * failure. The caller is responsible for freeing it.
+ */
+int ssl_sock_srv_dump_session(struct server *srv, unsigned char **der)
+{
+	int len = 0;
+	int i;
+
+	*der = NULL;
+	if (!srv->ssl_ctx.reused_sess)
+		return 0;
+
+	HA_RWLOCK_WRLOCK(SSL_SERVER_LOCK, &srv->ssl_ctx.lock);
+	for (i = 0; i < global.nbthread; i++) {
+		if (!srv->ssl_ctx.reused_sess[i].ptr || !srv->ssl_ctx.reused_sess[i].size)
+			continue;
+
+		*der = malloc(srv->ssl_ctx.reused_sess[i].size);
+		if (*der) {
+			len = srv->ssl_ctx.reused_sess[i].size;
+			memcpy(*der, srv->ssl_ctx.reused_sess[i].ptr, len);
+		}
+		break;
+	}
+	HA_RWLOCK_WRUNLOCK(SSL_SERVER_LOCK, &srv->ssl_ctx.lock);
+	return len;
+}
+
+/* Loads the TLS session <der> of <len> bytes, as ASN.1 DER, into the session
+ * cache of each thread of server <srv> which does not have any, so that their
+ * next connection to this server tries to resume it. Returns 0 on success or
+ * -1 if the session is invalid or cannot be reused.
+ */
+int ssl_sock_srv_load_session(struct server *srv, const unsigned char *der, int len)
+{
+	const unsigned char *ptr = der;
+	SSL_SESSION *sess;
+	int i;
+
+	if (!srv->ssl_ctx.reused_sess || (srv->ssl_ctx.options & SRV_SSL_O_NO_REUSE))
+		return -1;
+
+	sess = d2i_SSL_SESSION(NULL, &ptr, len);
+	if (!sess)
+		return -1;
+	SSL_SESSION_free(sess);
+
+	HA_RWLOCK_WRLOCK(SSL_SERVER_LOCK, &srv->ssl_ctx.lock);
+	for (i = 0; i < global.nbthread; i++) {
+		if (srv->ssl_ctx.reused_sess[i].ptr)
+			continue;
+
+		srv->ssl_ctx.reused_sess[i].ptr = malloc(len);
+		if (!srv->ssl_ctx.reused_sess[i].ptr)
+			break;
+		memcpy(srv->ssl_ctx.reused_sess[i].ptr, der, len);
+		srv->ssl_ctx.reused_sess[i].size = len;
+		srv->ssl_ctx.reused_sess[i].allocated_size = len;
+	}
+	HA_RWLOCK_WRUNLOCK(SSL_SERVER_LOCK, &srv->ssl_ctx.lock);
+	return 0;
+}
+
 
 /* SSL callback used on new session creation */
 int sh_ssl_sess_new_cb(SSL *ssl, SSL_SESSION *sess)
 {
 	unsigned char encsess[SHSESS_MAX_DATA_LEN];           /* encoded session  */
 	unsigned char encid[SSL_MAX_SSL_SESSION_ID_LENGTH];   /* encoded id */
+	struct shared_context *shctx;
 	unsigned char *p;
 	int data_len;
 	unsigned int sid_length;
@@ -4040,10 +4571,11 @@ int sh_ssl_sess_new_cb(SSL *ssl, SSL_SESSION *sess)
 	i2d_SSL_SESSION(sess, &p);
 
 
-	shctx_lock(ssl_shctx);
+	shctx = sh_ssl_sess_shctx(encid);
+	shctx_lock(shctx);
 	/* store to cache */
-	sh_ssl_sess_store(encid, encsess, data_len);
-	shctx_unlock(ssl_shctx);
+	sh_ssl_sess_store(shctx, encid, encsess, data_len);
+	shctx_unlock(shctx);
 err:
 	/* reset original length values */
 	SSL_SESSION_set1_id(sess, encid, sid_length);
@@ -4058,6 +4590,7 @@ SSL_SESSION *sh_ssl_sess_get_cb(SSL *ssl, __OPENSSL_110_CONST__ unsigned char *k
 	struct sh_ssl_sess_hdr *sh_ssl_sess;
 	unsigned char data[SHSESS_MAX_DATA_LEN], *p;
 	unsigned char tmpkey[SSL_MAX_SSL_SESSION_ID_LENGTH];
+	struct shared_context *shctx;
 	SSL_SESSION *sess;
 	struct shared_block *first;
 
@@ -4073,14 +4606,15 @@ SSL_SESSION *sh_ssl_sess_get_cb(SSL *ssl, __OPENSSL_110_CONST__ unsigned char *k
 		key = tmpkey;
 	}
 
-	/* lock cache */
-	shctx_lock(ssl_shctx);
+	/* lock cache, lookups only need a read access */
+	shctx = sh_ssl_sess_shctx(key);
+	shctx_rdlock(shctx);
 
 	/* lookup for session */
-	sh_ssl_sess = sh_ssl_sess_tree_lookup(key);
+	sh_ssl_sess = sh_ssl_sess_tree_lookup(sh_ssl_sess_tree(shctx), key);
 	if (!sh_ssl_sess) {
 		/* no session found: unlock cache and exit */
-		shctx_unlock(ssl_shctx);
+		shctx_rdunlock(shctx);
 		_HA_ATOMIC_INC(&global.shctx_misses);
 		return NULL;
 	}
@@ -4088,9 +4622,9 @@ SSL_SESSION *sh_ssl_sess_get_cb(SSL *ssl, __OPENSSL_110_CONST__ unsigned char *k
 	/* sh_ssl_sess (shared_block->data) is at the end of shared_block */
 	first = sh_ssl_sess_first_block(sh_ssl_sess);
 
-	shctx_row_data_get(ssl_shctx, first, data, sizeof(struct sh_ssl_sess_hdr), first->len-sizeof(struct sh_ssl_sess_hdr));
+	shctx_row_data_get(shctx, first, data, sizeof(struct sh_ssl_sess_hdr), first->len-sizeof(struct sh_ssl_sess_hdr));
 
-	shctx_unlock(ssl_shctx);
+	shctx_rdunlock(shctx);
 
 	/* decode ASN1 session */
 	p = data;
@@ -4110,6 +4644,7 @@ void sh_ssl_sess_remove_cb(SSL_CTX *ctx, SSL_SESSION *sess)
 {
 	struct sh_ssl_sess_hdr *sh_ssl_sess;
 	unsigned char tmpkey[SSL_MAX_SSL_SESSION_ID_LENGTH];
+	struct shared_context *shctx;
 	unsigned int sid_length;
 	const unsigned char *sid_data;
 	(void)ctx;
@@ -4122,17 +4657,18 @@ void sh_ssl_sess_remove_cb(SSL_CTX *ctx, SSL_SESSION *sess)
 		sid_data = tmpkey;
 	}
 
-	shctx_lock(ssl_shctx);
+	shctx = sh_ssl_sess_shctx(sid_data);
+	shctx_lock(shctx);
 
 	/* lookup for session */
-	sh_ssl_sess = sh_ssl_sess_tree_lookup(sid_data);
+	sh_ssl_sess = sh_ssl_sess_tree_lookup(sh_ssl_sess_tree(shctx), sid_data);
 	if (sh_ssl_sess) {
 		/* free session */
 		sh_ssl_sess_tree_delete(sh_ssl_sess);
 	}
 
 	/* unlock cache */
-	shctx_unlock(ssl_shctx);
+	shctx_unlock(shctx);
 }
 
 /* Set session cache mode to server and disable openssl internal cache.
@@ -4634,6 +5170,8 @@ static int ssl_sock_srv_verifycbk(int ok, X509_STORE_CTX *ctx)
 	return ok;
 }
 
+static int ssl_sock_prepare_srv_ssl_ctx_job(void *arg);
+
 /* prepare ssl context from servers options. Returns an error count */
 int ssl_sock_prepare_srv_ctx(struct server *srv)
 {
@@ -4657,6 +5195,14 @@ int ssl_sock_prepare_srv_ctx(struct server *srv)
 			return cfgerr;
 		}
 	}
+	if (global.nbthread > 1 && !srv->ssl_ctx.shared_sess) {
+		if ((srv->ssl_ctx.shared_sess = calloc(1, sizeof(*srv->ssl_ctx.shared_sess))) == NULL) {
+			ha_alert("out of memory.\n");
+			cfgerr++;
+			return cfgerr;
+		}
+		HA_SPIN_INIT(&srv->ssl_ctx.shared_sess->lock);
+	}
 	if (srv->use_ssl == 1)
 		srv->xprt = &ssl_sock;
 
@@ -4673,7 +5219,16 @@ int ssl_sock_prepare_srv_ctx(struct server *srv)
 		srv->ssl_ctx.ctx = ctx;
 	}
 
-	cfgerr += ssl_sock_prep_srv_ctx_and_inst(srv, srv->ssl_ctx.ctx, srv->ssl_ctx.inst);
+	/* At boot, setting up the context, which is long with large CA files,
+	 * is done in parallel for all servers.
+	 */
+	if (global.mode & MODE_STARTING) {
+		if (srv->ssl_ctx.inst)
+			ckch_inst_add_cafile_link(srv->ssl_ctx.inst, NULL, NULL, srv);
+		cfgerr += startup_work_add(ssl_sock_prepare_srv_ssl_ctx_job, srv);
+	}
+	else
+		cfgerr += ssl_sock_prep_srv_ctx_and_inst(srv, srv->ssl_ctx.ctx, srv->ssl_ctx.inst);
 
 	return cfgerr;
 }
@@ -4758,6 +5313,10 @@ static int ssl_sock_prepare_srv_ssl_ctx(const struct server *srv, SSL_CTX *ctx)
 
 	if (srv->ssl_ctx.options & SRV_SSL_O_NO_TLS_TICKETS)
 		options |= SSL_OP_NO_TICKET;
+#ifdef HAVE_SSL_KTLS
+	if (srv->ssl_ctx.options & SRV_SSL_O_KTLS)
+		options |= SSL_OP_ENABLE_KTLS;
+#endif
 	SSL_CTX_set_options(ctx, options);
 
 #ifdef SSL_MODE_ASYNC
@@ -4840,6 +5399,20 @@ static int ssl_sock_prepare_srv_ssl_ctx(const struct server *srv, SSL_CTX *ctx)
 	return cfgerr;
 }
 
+/* Startup job setting up the SSL_CTX of server <arg> (see startup_work_add()).
+ * Returns the number of errors.
+ */
+static int ssl_sock_prepare_srv_ssl_ctx_job(void *arg)
+{
+	struct server *srv = arg;
+	int cfgerr;
+
+	set_usermsgs_ctx(srv->conf.file, srv->conf.line, &srv->obj_type);
+	cfgerr = ssl_sock_prepare_srv_ssl_ctx(srv, srv->ssl_ctx.ctx);
+	reset_usermsgs_ctx();
+	return cfgerr;
+}
+
 /*
  * Prepare the frontend's SSL_CTX based on the server line configuration.
  * Since the CA file loading is made depending on the verify option of the
@@ -4918,7 +5491,7 @@ int ssl_sock_prepare_all_ctx(struct bind_conf *bind_conf)
 	node = ebmb_first(&bind_conf->sni_ctx);
 	while (node) {
 		sni = ebmb_entry(node, struct sni_ctx, name);
-		if (!sni->order && sni->ctx != bind_conf->default_ctx) {
+		if (!sni->order && sni->ctx && sni->ctx != bind_conf->default_ctx) {
 			/* only initialize the CTX on its first occurrence and
 			   if it is not the default_ctx */
 			errcode |= ssl_sock_prep_ctx_and_inst(bind_conf, sni->conf, sni->ctx, sni->ckch_inst, &errmsg);
@@ -4929,7 +5502,7 @@ int ssl_sock_prepare_all_ctx(struct bind_conf *bind_conf)
 	node = ebmb_first(&bind_conf->sni_w_ctx);
 	while (node) {
 		sni = ebmb_entry(node, struct sni_ctx, name);
-		if (!sni->order && sni->ctx != bind_conf->default_ctx) {
+		if (!sni->order && sni->ctx && sni->ctx != bind_conf->default_ctx) {
 			/* only initialize the CTX on its first occurrence and
 			   if it is not the default_ctx */
 			errcode |= ssl_sock_prep_ctx_and_inst(bind_conf, sni->conf, sni->ctx, sni->ckch_inst, &errmsg);
@@ -4977,21 +5550,40 @@ int ssl_sock_prepare_bind_conf(struct bind_conf *bind_conf)
 		}
 	}
 	if (!ssl_shctx && global.tune.sslcachesize) {
-		alloc_ctx = shctx_init(&ssl_shctx, global.tune.sslcachesize,
-		                       sizeof(struct sh_ssl_sess_hdr) + SHSESS_BLOCK_MIN_SIZE, -1,
-		                       sizeof(*sh_ssl_sess_tree), (global.nbthread > 1));
-		if (alloc_ctx <= 0) {
-			if (alloc_ctx == SHCTX_E_INIT_LOCK)
-				ha_alert("Unable to initialize the lock for the shared SSL session cache. You can retry using the global statement 'tune.ssl.force-private-cache' but it could increase CPU usage due to renegotiations if nbproc > 1.\n");
-			else
-				ha_alert("Unable to allocate SSL session cache.\n");
+		unsigned int shards = global_ssl.cache_shards;
+		unsigned int i;
+
+		/* each shard must be able to hold the largest session */
+		while (shards > 1 &&
+		       global.tune.sslcachesize / shards < (SHSESS_MAX_DATA_LEN + SHSESS_BLOCK_MIN_SIZE - 1) / SHSESS_BLOCK_MIN_SIZE)
+			shards--;
+		if (shards != global_ssl.cache_shards)
+			ha_warning("tune.ssl.cachesize is too small for %d shards, only %u will be used.\n",
+			           global_ssl.cache_shards, shards);
+
+		ssl_shctx = calloc(shards, sizeof(*ssl_shctx));
+		if (!ssl_shctx) {
+			ha_alert("Unable to allocate SSL session cache.\n");
 			return -1;
 		}
-		/* free block callback */
-		ssl_shctx->free_block = sh_ssl_sess_free_blocks;
-		/* init the root tree within the extra space */
-		sh_ssl_sess_tree = (void *)ssl_shctx + sizeof(struct shared_context);
-		*sh_ssl_sess_tree = EB_ROOT_UNIQUE;
+
+		for (i = 0; i < shards; i++) {
+			alloc_ctx = shctx_init(&ssl_shctx[i], (global.tune.sslcachesize + shards - 1) / shards,
+			                       sizeof(struct sh_ssl_sess_hdr) + SHSESS_BLOCK_MIN_SIZE, -1,
+			                       sizeof(struct eb_root), (global.nbthread > 1));
+			if (alloc_ctx <= 0) {
+				if (alloc_ctx == SHCTX_E_INIT_LOCK)
+					ha_alert("Unable to initialize the lock for the shared SSL session cache. You can retry using the global statement 'tune.ssl.force-private-cache' but it could increase CPU usage due to renegotiations if nbproc > 1.\n");
+				else
+					ha_alert("Unable to allocate SSL session cache.\n");
+				return -1;
+			}
+			/* free block callback */
+			ssl_shctx[i]->free_block = sh_ssl_sess_free_blocks;
+			/* init the root tree within the extra space */
+			*sh_ssl_sess_tree(ssl_shctx[i]) = EB_ROOT_UNIQUE;
+		}
+		ssl_shctx_shards = shards;
 	}
 	err = 0;
 	/* initialize all certificate contexts */
@@ -5014,12 +5606,11 @@ void ssl_sock_free_srv_ctx(struct server *srv)
 	if (srv->ssl_ctx.npn_str)
 		ha_free(&srv->ssl_ctx.npn_str);
 #endif
-	if (srv->ssl_ctx.reused_sess) {
-		int i;
-
-		for (i = 0; i < global.nbthread; i++)
-			ha_free(&srv->ssl_ctx.reused_sess[i].ptr);
-		ha_free(&srv->ssl_ctx.reused_sess);
+	ssl_sock_srv_flush_sessions(srv);
+	ha_free(&srv->ssl_ctx.reused_sess);
+	if (srv->ssl_ctx.shared_sess) {
+		HA_SPIN_DESTROY(&srv->ssl_ctx.shared_sess->lock);
+		ha_free(&srv->ssl_ctx.shared_sess);
 	}
 
 	if (srv->ssl_ctx.ctx) {
@@ -5083,6 +5674,7 @@ void ssl_sock_destroy_bind_conf(struct bind_conf *bind_conf)
 	free(bind_conf->ca_sign_file);
 	free(bind_conf->ca_sign_pass);
 	if (bind_conf->keys_ref && !--bind_conf->keys_ref->refcount) {
+		task_destroy(bind_conf->keys_ref->task);
 		free(bind_conf->keys_ref->filename);
 		free(bind_conf->keys_ref->tlskeys);
 		LIST_DELETE(&bind_conf->keys_ref->list);
@@ -5274,6 +5866,10 @@ static int ssl_sock_init(struct connection *conn, void **xprt_ctx)
 	ctx->wait_event.tasklet->state  |= TASK_HEAVY; // assign it to the bulk queue during handshake
 	ctx->wait_event.events = 0;
 	ctx->sent_early_data = 0;
+	ctx->ktls_ctrl_type = 0;
+	ctx->lazy_parked = 0;
+	ctx->hsk_cpu = 0;
+	LIST_INIT(&ctx->lazy_list);
 	ctx->early_buf = BUF_NULL;
 	ctx->conn = conn;
 	ctx->subs = NULL;
@@ -5313,6 +5909,8 @@ static int ssl_sock_init(struct connection *conn, void **xprt_ctx)
 				SSL_SESSION_free(sess);
 			}
 		}
+		else if (__objt_server(conn->target)->ssl_ctx.shared_sess)
+			ssl_sock_srv_take_session(__objt_server(conn->target), ctx->ssl);
 		HA_RWLOCK_RDUNLOCK(SSL_SERVER_LOCK, &(__objt_server(conn->target)->ssl_ctx.lock));
 
 		/* leave init state and start handshake */
@@ -5321,6 +5919,7 @@ static int ssl_sock_init(struct connection *conn, void **xprt_ctx)
 		_HA_ATOMIC_INC(&sslconns);
 		_HA_ATOMIC_INC(&totalsslconns);
 		*xprt_ctx = ctx;
+		HA_USDT(ssl_hs_start, conn, 1);
 		return 0;
 	}
 	else if (objt_listener(conn->target)) {
@@ -5354,6 +5953,7 @@ static int ssl_sock_init(struct connection *conn, void **xprt_ctx)
 		_HA_ATOMIC_INC(&sslconns);
 		_HA_ATOMIC_INC(&totalsslconns);
 		*xprt_ctx = ctx;
+		HA_USDT(ssl_hs_start, conn, 0);
 		return 0;
 	}
 	/* don't know how to handle such a target */
@@ -5366,46 +5966,58 @@ static int ssl_sock_init(struct connection *conn, void **xprt_ctx)
 }
 
 
-/* This is the callback which is used when an SSL handshake is pending. It
- * updates the FD status if it wants some polling before being called again.
- * It returns 0 if it fails in a fatal way or needs to poll to go further,
- * otherwise it returns non-zero and removes itself from the connection's
- * flags (the bit is provided in <flag> by the caller).
+/* Sets <counters> and <counters_px> to the ssl stats counters of the listener
+ * or server of connection <conn> and of its proxy, or to NULL if there are
+ * none.
  */
-static int ssl_sock_handshake(struct connection *conn, unsigned int flag)
+static void ssl_sock_get_counters(struct connection *conn, struct ssl_counters **counters,
+                                  struct ssl_counters **counters_px)
 {
-	struct ssl_sock_ctx *ctx = conn->xprt_ctx;
-	int ret;
-	struct ssl_counters *counters = NULL;
-	struct ssl_counters *counters_px = NULL;
 	struct listener *li;
 	struct server *srv;
-	socklen_t lskerr;
-	int skerr;
 
+	*counters = *counters_px = NULL;
 
-	if (!conn_ctrl_ready(conn))
-		return 0;
-
-	/* get counters */
 	switch (obj_type(conn->target)) {
 	case OBJ_TYPE_LISTENER:
 		li = objt_listener(conn->target);
-		counters = EXTRA_COUNTERS_GET(li->extra_counters, &ssl_stats_module);
-		counters_px = EXTRA_COUNTERS_GET(li->bind_conf->frontend->extra_counters_fe,
-		                                 &ssl_stats_module);
+		*counters = EXTRA_COUNTERS_GET(li->extra_counters, &ssl_stats_module);
+		*counters_px = EXTRA_COUNTERS_GET(li->bind_conf->frontend->extra_counters_fe,
+		                                  &ssl_stats_module);
 		break;
 
 	case OBJ_TYPE_SERVER:
 		srv = objt_server(conn->target);
-		counters = EXTRA_COUNTERS_GET(srv->extra_counters, &ssl_stats_module);
-		counters_px = EXTRA_COUNTERS_GET(srv->proxy->extra_counters_be,
-		                                 &ssl_stats_module);
+		*counters = EXTRA_COUNTERS_GET(srv->extra_counters, &ssl_stats_module);
+		*counters_px = EXTRA_COUNTERS_GET(srv->proxy->extra_counters_be,
+		                                  &ssl_stats_module);
 		break;
 
 	default:
 		break;
 	}
+}
+
+/* This is the callback which is used when an SSL handshake is pending. It
+ * updates the FD status if it wants some polling before being called again.
+ * It returns 0 if it fails in a fatal way or needs to poll to go further,
+ * otherwise it returns non-zero and removes itself from the connection's
+ * flags (the bit is provided in <flag> by the caller).
+ */
+static int ssl_sock_do_handshake(struct connection *conn, unsigned int flag)
+{
+	struct ssl_sock_ctx *ctx = conn->xprt_ctx;
+	int ret;
+	struct ssl_counters *counters;
+	struct ssl_counters *counters_px;
+	socklen_t lskerr;
+	int skerr;
+
+
+	if (!conn_ctrl_ready(conn))
+		return 0;
+
+	ssl_sock_get_counters(conn, &counters, &counters_px);
 
 	if (!conn->xprt_ctx)
 		goto out_error;
@@ -5575,6 +6187,14 @@ static int ssl_sock_handshake(struct connection *conn, unsigned int flag)
 			ssl_async_process_fds(ctx);
 			return 0;
 		}
+#endif
+#ifdef HAVE_SSL_LAZY_ASYNC
+		else if (ret == SSL_ERROR_WANT_CLIENT_HELLO_CB) {
+			/* parked until its lazy certificate is loaded, see
+			 * ssl_lazy_request() which will wake us up.
+			 */
+			return 0;
+		}
 #endif
 		else if (ret == SSL_ERROR_SYSCALL) {
 			/* if errno is null, then connection was successfully established */
@@ -5716,6 +6336,49 @@ static int ssl_sock_handshake(struct connection *conn, unsigned int flag)
 	return 0;
 }
 
+/* Performs the pending SSL handshake on connection <conn> like
+ * ssl_sock_do_handshake(), and accounts the CPU time it spent into the
+ * connection, and into its listener's or server's ssl counters once the
+ * handshake is over. The time spent in the async engines or workers is not
+ * part of it.
+ */
+static int ssl_sock_handshake(struct connection *conn, unsigned int flag)
+{
+	struct ssl_sock_ctx *ctx = conn->xprt_ctx;
+	struct ssl_counters *counters;
+	struct ssl_counters *counters_px;
+	uint64_t start = now_cpu_time();
+	long long cpu;
+	int ret;
+
+	/* a dead connection was already accounted for */
+	if (!ctx || !conn_ctrl_ready(conn) || (conn->flags & CO_FL_ERROR))
+		return ssl_sock_do_handshake(conn, flag);
+
+	ret = ssl_sock_do_handshake(conn, flag);
+	ctx->hsk_cpu += now_cpu_time() - start;
+	if (!ret && !(conn->flags & CO_FL_ERROR))
+		return ret;
+
+	/* the handshake is over */
+	HA_USDT(ssl_hs_end, conn, conn_is_back(conn),
+	        ret && !(conn->flags & CO_FL_ERROR),
+	        ret && SSL_session_reused(ctx->ssl), ctx->hsk_cpu);
+	ssl_sock_get_counters(conn, &counters, &counters_px);
+	if (counters) {
+		cpu = ctx->hsk_cpu / 1000;
+		if (ret && SSL_session_reused(ctx->ssl)) {
+			counters->reused_hsk_cpu += cpu;
+			counters_px->reused_hsk_cpu += cpu;
+		}
+		else {
+			counters->full_hsk_cpu += cpu;
+			counters_px->full_hsk_cpu += cpu;
+		}
+	}
+	return ret;
+}
+
 /* Called from the upper layer, to subscribe <es> to events <event_type>. The
  * event subscriber <es> is not allowed to change from a previous call as long
  * as at least one event is still subscribed. The <event_type> must only be a
@@ -5858,6 +6521,7 @@ struct task *ssl_sock_io_cb(struct task *t, void *context, unsigned int state)
 	struct tasklet *tl = (struct tasklet *)t;
 	struct ssl_sock_ctx *ctx = context;
 	struct connection *conn;
+	uint64_t cpu_start = conn_cpu_start();
 	int conn_in_list;
 	int ret = 0;
 
@@ -5930,6 +6594,10 @@ struct task *ssl_sock_io_cb(struct task *t, void *context, unsigned int state)
 	}
 #endif
 leave:
+	/* a negative return from the mux means the connection is gone */
+	if (ret >= 0)
+		conn_cpu_account(conn, cpu_start);
+
 	if (!ret && conn_in_list) {
 		struct server *srv = objt_server(conn->target);
 
@@ -6215,6 +6883,8 @@ void ssl_sock_close(struct connection *conn, void *xprt_ctx) {
 
 
 	if (ctx) {
+		/* stop waiting for a lazy certificate */
+		LIST_DEL_INIT(&ctx->lazy_list);
 		if (ctx->wait_event.events != 0)
 			ctx->xprt->unsubscribe(ctx->conn, ctx->xprt_ctx,
 			                       ctx->wait_event.events,
@@ -6280,6 +6950,48 @@ void ssl_sock_close(struct connection *conn, void *xprt_ctx) {
 	}
 }
 
+#if defined(USE_LINUX_SPLICE) && defined(HAVE_SSL_KTLS)
+/* Reports whether data may be spliced in direction <dir> (0=recv, 1=send),
+ * which is only possible once the kernel does the crypto in that direction
+ * and nothing remains buffered inside the SSL layer.
+ */
+static int ssl_sock_may_splice(const struct connection *conn, const void *xprt_ctx, int dir)
+{
+	const struct ssl_sock_ctx *ctx = xprt_ctx;
+
+	if (!ctx || (conn->flags & CO_FL_SSL_WAIT_HS))
+		return 0;
+
+	if (dir)
+		return (ctx->xprt_st & SSL_SOCK_ST_FL_KTLS_TX) && ctx->xprt->snd_pipe;
+
+	return (ctx->xprt_st & SSL_SOCK_ST_FL_KTLS_RX) && ctx->xprt->rcv_pipe &&
+	       !SSL_has_pending(ctx->ssl);
+}
+
+/* Receive up to <count> bytes decrypted by the kernel into <pipe>. The
+ * caller must have checked ssl_sock_may_splice() first.
+ */
+static int ssl_sock_to_pipe(struct connection *conn, void *xprt_ctx, struct pipe *pipe, unsigned int count)
+{
+	struct ssl_sock_ctx *ctx = xprt_ctx;
+
+	if (!ssl_sock_may_splice(conn, ctx, 0))
+		return -1;
+	return ctx->xprt->rcv_pipe(conn, ctx->xprt_ctx, pipe, count);
+}
+
+/* Send the contents of <pipe>, the kernel taking care of the encryption. */
+static int ssl_sock_from_pipe(struct connection *conn, void *xprt_ctx, struct pipe *pipe)
+{
+	struct ssl_sock_ctx *ctx = xprt_ctx;
+
+	if (!ssl_sock_may_splice(conn, ctx, 1))
+		return 0;
+	return ctx->xprt->snd_pipe(conn, ctx->xprt_ctx, pipe);
+}
+#endif
+
 /* This function tries to perform a clean shutdown on an SSL connection, and in
  * any case, flags the connection as reusable if no handshake was in progress.
  */
@@ -6889,6 +7601,9 @@ static int cli_parse_set_tlskeys(char **args, char *payload, struct appctx *appc
 	if (!ref)
 		return cli_err(appctx, "'set ssl tls-key' unable to locate referenced filename\n");
 
+	if (ref->sync)
+		return cli_err(appctx, "'set ssl tls-key' cannot update keys synchronized through a table.\n");
+
 	ret = base64dec(args[4], strlen(args[4]), trash.area, trash.size);
 	if (ret < 0)
 		return cli_err(appctx, "'set ssl tls-key' received invalid base64 encoded TLS key.\n");
@@ -7211,8 +7926,14 @@ struct xprt_ops ssl_sock = {
 	.unsubscribe = ssl_unsubscribe,
 	.remove_xprt = ssl_remove_xprt,
 	.add_xprt = ssl_add_xprt,
+#if defined(USE_LINUX_SPLICE) && defined(HAVE_SSL_KTLS)
+	.rcv_pipe = ssl_sock_to_pipe,
+	.snd_pipe = ssl_sock_from_pipe,
+	.may_splice = ssl_sock_may_splice,
+#else
 	.rcv_pipe = NULL,
 	.snd_pipe = NULL,
+#endif
 	.shutr    = NULL,
 	.shutw    = ssl_sock_shutw,
 	.close    = ssl_sock_close,
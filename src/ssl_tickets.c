@@ -0,0 +1,270 @@
+/*
+ * TLS ticket keys synchronized through a stick-table
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ *
+ * With "tls-ticket-keys-table", the keys of a bind line are not loaded from a
+ * file but generated on the fly and shared with the other peers of a binary
+ * stick-table. Each entry's key is a whole ticket key (name, AES and HMAC
+ * keys) and its gpt0 is the generation the key is used for, which is the wall
+ * clock time divided by "tune.ssl.ticket-rotate". This way all the peers agree
+ * on the keys to use without any other coordination as long as their clocks
+ * are synchronized.
+ *
+ * The key of the next generation is created in advance by the peer for which
+ * a hash of its name and of the generation is the highest, so that it is known
+ * by all the peers when the generation starts. The other peers create it after
+ * a grace delay if it is still missing, in which case several keys may exist
+ * for a generation, and all the peers pick the smallest one. The keys are then
+ * installed in the ring in the order expected by the ticket callback : the
+ * current key used to encrypt the tickets, the next one, then the previous
+ * ones which are only used to decrypt them.
+ *
+ */
+
+#include <string.h>
+
+#include <import/xxhash.h>
+
+#include <haproxy/api.h>
+#include <haproxy/errors.h>
+#include <haproxy/global.h>
+#include <haproxy/openssl-compat.h>
+#include <haproxy/peers-t.h>
+#include <haproxy/ssl_sock.h>
+#include <haproxy/stick_table.h>
+#include <haproxy/task.h>
+#include <haproxy/ticks.h>
+#include <haproxy/time.h>
+#include <haproxy/tools.h>
+
+#if (defined SSL_CTRL_SET_TLSEXT_TICKET_KEY_CB && TLS_TICKETS_NO > 0)
+
+/* max delay before a peer which does not own a generation creates its key */
+#define TLS_TICKETS_GRACE 10
+
+/* the date the process started at, the peers being given the time to resync
+ * the table before any key is created.
+ */
+static time_t tls_tickets_start;
+
+/* Returns the delay in seconds a peer which does not own a generation waits
+ * for before creating its key.
+ */
+static inline unsigned int tls_tickets_grace()
+{
+	return MIN(global_ssl.ticket_rotate / 4, TLS_TICKETS_GRACE);
+}
+
+/* Returns non-zero if the local peer of table <t> is the one in charge of
+ * creating the key of generation <gen>.
+ */
+static int tls_tickets_owner(struct stktable *t, unsigned int gen)
+{
+	struct peers *peers = t->peers.p;
+	struct peer *peer;
+	unsigned int own, hash;
+
+	own = XXH32(&gen, sizeof(gen), XXH32(peers->local->id, strlen(peers->local->id), 0));
+	for (peer = peers->remote; peer; peer = peer->next) {
+		if (peer->local)
+			continue;
+		hash = XXH32(&gen, sizeof(gen), XXH32(peer->id, strlen(peer->id), 0));
+		if (hash > own || (hash == own && strcmp(peer->id, peers->local->id) > 0))
+			return 0;
+	}
+	return 1;
+}
+
+/* Creates a random key for generation <gen> in table <t> which will be sent to
+ * the peers, and copies it to <key>. Returns 0 on failure.
+ */
+static int tls_tickets_create(struct stktable *t, unsigned int gen, union tls_sess_key *key)
+{
+	struct stktable_key skey;
+	struct stksess *ts;
+	void *ptr;
+
+	if (RAND_bytes((unsigned char *)key, t->key_size) != 1)
+		return 0;
+
+	skey.key = key;
+	skey.key_len = t->key_size;
+	ts = stktable_get_entry(t, &skey);
+	if (!ts)
+		return 0;
+
+	HA_RWLOCK_WRLOCK(STK_SESS_LOCK, &ts->lock);
+	ptr = stktable_data_ptr(t, ts, STKTABLE_DT_GPT0);
+	if (ptr)
+		stktable_data_cast(ptr, gpt0) = gen;
+	HA_RWLOCK_WRUNLOCK(STK_SESS_LOCK, &ts->lock);
+	stktable_touch_local(t, ts, 1);
+	return 1;
+}
+
+/* Task looking up the keys of the current generation, of the next one and of
+ * the previous ones in the table of ticket keys reference <context>, creating
+ * the current and next ones when needed, and installing them when they
+ * changed. The ring is installed with the current key first, for encryption.
+ */
+static struct task *tls_tickets_process(struct task *task, void *context, unsigned int state)
+{
+	struct tls_keys_ref *ref = context;
+	struct stktable *t = ref->table;
+	union tls_sess_key keys[TLS_TICKETS_NO];
+	unsigned int gens[TLS_TICKETS_NO];
+	char found[TLS_TICKETS_NO];
+	unsigned int now_gen, gen, i;
+	struct ebmb_node *eb;
+	time_t ready;
+	struct stksess *ts;
+	void *ptr;
+
+	now_gen = date.tv_sec / global_ssl.ticket_rotate;
+
+	/* slot 0 is the current generation, 1 the next one, and the next ones
+	 * the previous generations, the oldest first.
+	 */
+	gens[0] = now_gen;
+	for (i = 1; i < TLS_TICKETS_NO; i++)
+		gens[i] = i == 1 ? now_gen + 1 : now_gen - (TLS_TICKETS_NO - i);
+	memset(found, 0, sizeof(found));
+
+	for (i = 0; i < t->nb_shards; i++) {
+		struct stktable_shard *shard = &t->shards[i];
+
+		HA_SPIN_LOCK(STK_TABLE_LOCK, &shard->lock);
+		for (eb = ebmb_first(&shard->keys); eb; eb = ebmb_next(eb)) {
+			unsigned int slot;
+
+			ts = ebmb_entry(eb, struct stksess, key);
+			if (t->expire && tick_is_expired(ts->expire, now_ms))
+				continue;
+
+			ptr = stktable_data_ptr(t, ts, STKTABLE_DT_GPT0);
+			if (!ptr)
+				continue;
+			gen = HA_ATOMIC_LOAD(&stktable_data_cast(ptr, gpt0));
+
+			for (slot = 0; slot < TLS_TICKETS_NO && gens[slot] != gen; slot++)
+				;
+			if (slot == TLS_TICKETS_NO)
+				continue;
+
+			/* several peers may have created a key for the same
+			 * generation, they all pick the smallest one.
+			 */
+			if (!found[slot] || memcmp(ts->key.key, &keys[slot], t->key_size) < 0) {
+				memcpy(&keys[slot], ts->key.key, t->key_size);
+				found[slot] = 1;
+			}
+		}
+		HA_SPIN_UNLOCK(STK_TABLE_LOCK, &shard->lock);
+	}
+
+	/* the table is given some time to resync, then the owners of the
+	 * generations are given some time to create their keys.
+	 */
+	ready = tls_tickets_start + tls_tickets_grace();
+	for (i = 0; i < TLS_TICKETS_NO && i < 2; i++) {
+		if (found[i] || date.tv_sec < ready)
+			continue;
+		if (!tls_tickets_owner(t, gens[i]) &&
+		    date.tv_sec < MAX(ready, (time_t)now_gen * global_ssl.ticket_rotate) + tls_tickets_grace())
+			continue;
+		found[i] = tls_tickets_create(t, gens[i], &keys[i]);
+	}
+
+	HA_RWLOCK_WRLOCK(TLSKEYS_REF_LOCK, &ref->lock);
+	for (i = 0; i < TLS_TICKETS_NO; i++) {
+		/* missing keys are left as they are, they either are random
+		 * keys which will not match any ticket or old valid keys.
+		 */
+		if (found[i])
+			memcpy(&ref->tlskeys[i], &keys[i], t->key_size);
+	}
+	ref->tls_ticket_enc_index = 0;
+	HA_RWLOCK_WRUNLOCK(TLSKEYS_REF_LOCK, &ref->lock);
+
+	task->expire = tick_add(now_ms, MS_TO_TICKS(1000));
+	return task;
+}
+
+/* Resolves the tables of the TLS ticket keys references using one, checks
+ * them and starts the tasks maintaining their keys. Returns an ERR_* code.
+ */
+static int tls_tickets_init()
+{
+	struct tls_keys_ref *ref;
+	struct stktable *t;
+	int i;
+
+	tls_tickets_start = date.tv_sec;
+
+	list_for_each_entry(ref, &tlskeys_reference, list) {
+		if (!ref->sync)
+			continue;
+
+		t = stktable_find_by_name(ref->filename);
+		if (!t) {
+			ha_alert("'tls-ticket-keys-table' refers to unknown table '%s'.\n", ref->filename);
+			return ERR_ALERT | ERR_FATAL;
+		}
+
+		if (t->type != SMP_T_BIN || !t->data_ofs[STKTABLE_DT_GPT0] ||
+		    (t->key_size != sizeof(struct tls_sess_key_128) && t->key_size != sizeof(struct tls_sess_key_256))) {
+			ha_alert("'tls-ticket-keys-table' table '%s' must be of type 'binary' with a length of %d "
+			         "(128 bits keys) or %d (256 bits keys), and store 'gpt0'.\n",
+			         t->id, (int)sizeof(struct tls_sess_key_128), (int)sizeof(struct tls_sess_key_256));
+			return ERR_ALERT | ERR_FATAL;
+		}
+
+		if (!t->peers.p || !t->peers.p->local) {
+			ha_alert("'tls-ticket-keys-table' table '%s' is not synchronized with peers.\n", t->id);
+			return ERR_ALERT | ERR_FATAL;
+		}
+
+		if (t->expire && t->expire / 1000 < (TLS_TICKETS_NO + 1) * global_ssl.ticket_rotate)
+			ha_warning("'tls-ticket-keys-table' table '%s' expires its entries before the last "
+			           "TLS ticket keys are rotated out, it should be at least %u seconds.\n",
+			           t->id, (TLS_TICKETS_NO + 1) * global_ssl.ticket_rotate);
+
+		ref->table = t;
+		ref->key_size_bits = t->key_size == sizeof(struct tls_sess_key_128) ? 128 : 256;
+
+		/* random keys are used until the table provides the real ones,
+		 * so that the tickets work at least locally.
+		 */
+		for (i = 0; i < TLS_TICKETS_NO; i++) {
+			if (RAND_bytes((unsigned char *)&ref->tlskeys[i], t->key_size) != 1) {
+				ha_alert("'tls-ticket-keys-table' : unable to generate TLS ticket keys.\n");
+				return ERR_ALERT | ERR_FATAL;
+			}
+		}
+
+		ref->task = task_new(task_class_threads(TASK_CLASS_CRYPTO));
+		if (!ref->task) {
+			ha_alert("'tls-ticket-keys-table' : out of memory.\n");
+			return ERR_ALERT | ERR_FATAL;
+		}
+		ref->task->process = tls_tickets_process;
+		ref->task->context = ref;
+		task_wakeup(ref->task, TASK_WOKEN_INIT);
+	}
+	return ERR_NONE;
+}
+
+REGISTER_POST_CHECK(tls_tickets_init);
+
+#endif /* SSL_CTRL_SET_TLSEXT_TICKET_KEY_CB */
+
+/*
+ * Local variables:
+ *  c-indent-level: 8
+ *  c-basic-offset: 8
+ * End:
+ */
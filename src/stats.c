@@ -33,6 +33,7 @@
 #include <haproxy/check.h>
 #include <haproxy/cli.h>
 #include <haproxy/compression.h>
+#include <haproxy/counters.h>
 #include <haproxy/debug.h>
 #include <haproxy/errors.h>
 #include <haproxy/fd.h>
@@ -55,6 +56,7 @@
 #include <haproxy/session.h>
 #include <haproxy/ssl_sock.h>
 #include <haproxy/stats.h>
+#include <haproxy/stick_table.h>
 #include <haproxy/stream.h>
 #include <haproxy/stream_interface.h>
 #include <haproxy/task.h>
@@ -257,6 +259,19 @@ const struct name_desc stat_fields[ST_F_TOTAL_FIELDS] = {
 	[ST_F_USED_CONN_CUR]                 = { .name = "used_conn_cur",               .desc = "Current number of connections in use"},
 	[ST_F_NEED_CONN_EST]                 = { .name = "need_conn_est",               .desc = "Estimated needed number of connections"},
 	[ST_F_UWEIGHT]                       = { .name = "uweight",                     .desc = "Server's user weight, or sum of active servers' user weights for a backend" },
+	[ST_F_QT_P99]                        = { .name = "qtime_p99",                   .desc = "99th percentile of the time spent in the queue, in milliseconds (backend/server)" },
+	[ST_F_CT_P99]                        = { .name = "ctime_p99",                   .desc = "99th percentile of the time spent waiting for a connection to complete, in milliseconds (backend/server)" },
+	[ST_F_RT_P99]                        = { .name = "rtime_p99",                   .desc = "99th percentile of the time spent waiting for a server response, in milliseconds (backend/server)" },
+	[ST_F_TT_P99]                        = { .name = "ttime_p99",                   .desc = "99th percentile of the total request+response time, in milliseconds (backend/server)" },
+	[ST_F_QT_HIST]                       = { .name = "qtime_hist",                  .desc = "Histogram of the time spent in the queue, as space-separated <upper bound in ms>:<count> pairs (backend/server)" },
+	[ST_F_CT_HIST]                       = { .name = "ctime_hist",                  .desc = "Histogram of the time spent waiting for a connection to complete, as space-separated <upper bound in ms>:<count> pairs (backend/server)" },
+	[ST_F_RT_HIST]                       = { .name = "rtime_hist",                  .desc = "Histogram of the time spent waiting for a server response, as space-separated <upper bound in ms>:<count> pairs (backend/server)" },
+	[ST_F_TT_HIST]                       = { .name = "ttime_hist",                  .desc = "Histogram of the total request+response time, as space-separated <upper bound in ms>:<count> pairs (backend/server)" },
+	[ST_F_CPU_TOT]                       = { .name = "cpu_tot",                     .desc = "Total CPU time spent processing the streams, in microseconds, when task profiling is enabled (backend)" },
+	[ST_F_CPU_CALLS]                     = { .name = "cpu_calls",                   .desc = "Total number of calls accounted in cpu_tot (backend)" },
+	[ST_F_MEM_STRM]                      = { .name = "mem_strm",                    .desc = "Memory used by the streams currently attached to this frontend/backend, in bytes, refreshed at most once per second" },
+	[ST_F_MEM_BUF]                       = { .name = "mem_buf",                     .desc = "Memory used by the buffers held by the streams currently attached to this frontend/backend, in bytes, refreshed at most once per second" },
+	[ST_F_MEM_TBL]                       = { .name = "mem_tbl",                     .desc = "Memory used by the entries of the stick-table declared in this frontend/backend, in bytes" },
 };
 
 /* one line of info */
@@ -1672,10 +1687,10 @@ int stats_fill_fe_stats(struct proxy *px, struct field *stats, int len,
 				metric = mkf_u64(FN_COUNTER, px->fe_counters.cum_sess);
 				break;
 			case ST_F_BIN:
-				metric = mkf_u64(FN_COUNTER, px->fe_counters.bytes_in);
+				metric = mkf_u64(FN_COUNTER, counters_get(px->fe_counters.shards, THR_CTR_BYTES_IN, &px->fe_counters.bytes_in));
 				break;
 			case ST_F_BOUT:
-				metric = mkf_u64(FN_COUNTER, px->fe_counters.bytes_out);
+				metric = mkf_u64(FN_COUNTER, counters_get(px->fe_counters.shards, THR_CTR_BYTES_OUT, &px->fe_counters.bytes_out));
 				break;
 			case ST_F_DREQ:
 				metric = mkf_u64(FN_COUNTER, px->fe_counters.denied_req);
@@ -1765,7 +1780,7 @@ int stats_fill_fe_stats(struct proxy *px, struct field *stats, int len,
 				metric = mkf_u32(FN_MAX, px->fe_counters.p.http.rps_max);
 				break;
 			case ST_F_REQ_TOT:
-				metric = mkf_u64(FN_COUNTER, px->fe_counters.p.http.cum_req);
+				metric = mkf_u64(FN_COUNTER, counters_get(px->fe_counters.shards, THR_CTR_CUM_REQ, &px->fe_counters.p.http.cum_req));
 				break;
 			case ST_F_COMP_IN:
 				metric = mkf_u64(FN_COUNTER, px->fe_counters.comp_in);
@@ -1788,6 +1803,15 @@ int stats_fill_fe_stats(struct proxy *px, struct field *stats, int len,
 			case ST_F_CONN_TOT:
 				metric = mkf_u64(FN_COUNTER, px->fe_counters.cum_conn);
 				break;
+			case ST_F_MEM_STRM:
+				metric = mkf_u64(0, px->mem.strm_bytes);
+				break;
+			case ST_F_MEM_BUF:
+				metric = mkf_u64(0, px->mem.buf_bytes);
+				break;
+			case ST_F_MEM_TBL:
+				metric = mkf_u64(0, px->table ? stktable_mem_usage(px->table) : 0);
+				break;
 			default:
 				/* not used for frontends. If a specific metric
 				 * is requested, return an error. Otherwise continue.
@@ -1887,10 +1911,10 @@ int stats_fill_li_stats(struct proxy *px, struct listener *l, int flags,
 				metric = mkf_u64(FN_COUNTER, l->counters->cum_conn);
 				break;
 			case ST_F_BIN:
-				metric = mkf_u64(FN_COUNTER, l->counters->bytes_in);
+				metric = mkf_u64(FN_COUNTER, counters_get(l->counters->shards, THR_CTR_BYTES_IN, &l->counters->bytes_in));
 				break;
 			case ST_F_BOUT:
-				metric = mkf_u64(FN_COUNTER, l->counters->bytes_out);
+				metric = mkf_u64(FN_COUNTER, counters_get(l->counters->shards, THR_CTR_BYTES_OUT, &l->counters->bytes_out));
 				break;
 			case ST_F_DREQ:
 				metric = mkf_u64(FN_COUNTER, l->counters->denied_req);
@@ -2080,6 +2104,31 @@ static void stats_fill_sv_stats_computestate(struct server *sv, struct server *r
 	}
 }
 
+/* Returns a string field describing the histogram of timer <t> from <hist>,
+ * built in <out>. Only the non-empty buckets are reported, as space-separated
+ * "<upper bound in ms>:<count>" pairs, the last bucket's bound being "inf".
+ */
+static struct field stats_time_hist_field(struct buffer *out, const struct time_hist *hist,
+                                          enum time_hist_timer t)
+{
+	unsigned long long cnt[TIME_HIST_BUCKETS];
+	struct field metric;
+	int idx, sep = 0;
+
+	metric = mkf_str(FN_OUTPUT, chunk_newstr(out));
+	time_hist_read(hist, t, cnt, NULL);
+	for (idx = 0; idx < TIME_HIST_BUCKETS; idx++) {
+		if (!cnt[idx])
+			continue;
+		if (idx < TIME_HIST_BUCKETS - 1)
+			chunk_appendf(out, "%s%u:%llu", sep ? " " : "", time_hist_bound(idx), cnt[idx]);
+		else
+			chunk_appendf(out, "%sinf:%llu", sep ? " " : "", cnt[idx]);
+		sep = 1;
+	}
+	return metric;
+}
+
 /* Fill <stats> with the backend statistics. <stats> is preallocated array of
  * length <len>. If <selected_field> is != NULL, only fill this one. The length
  * of the array must be at least ST_F_TOTAL_FIELDS. If this length is less than
@@ -2122,7 +2171,9 @@ int stats_fill_sv_stats(struct proxy *px, struct server *sv, int flags,
 	if (selected_field == NULL || *selected_field == ST_F_QTIME ||
 	    *selected_field == ST_F_CTIME || *selected_field == ST_F_RTIME ||
 	    *selected_field == ST_F_TTIME) {
-		srv_samples_counter = (px->mode == PR_MODE_HTTP) ? sv->counters.p.http.cum_req : sv->counters.cum_lbconn;
+		srv_samples_counter = (px->mode == PR_MODE_HTTP) ?
+			counters_get(sv->counters.shards, THR_CTR_CUM_REQ, &sv->counters.p.http.cum_req) :
+			sv->counters.cum_lbconn;
 		if (srv_samples_counter < TIME_STATS_SAMPLES && srv_samples_counter > 0)
 			srv_samples_window = srv_samples_counter;
 	}
@@ -2167,10 +2218,10 @@ int stats_fill_sv_stats(struct proxy *px, struct server *sv, int flags,
 				metric = mkf_u64(FN_COUNTER, sv->counters.cum_sess);
 				break;
 			case ST_F_BIN:
-				metric = mkf_u64(FN_COUNTER, sv->counters.bytes_in);
+				metric = mkf_u64(FN_COUNTER, counters_get(sv->counters.shards, THR_CTR_BYTES_IN, &sv->counters.bytes_in));
 				break;
 			case ST_F_BOUT:
-				metric = mkf_u64(FN_COUNTER, sv->counters.bytes_out);
+				metric = mkf_u64(FN_COUNTER, counters_get(sv->counters.shards, THR_CTR_BYTES_OUT, &sv->counters.bytes_out));
 				break;
 			case ST_F_DRESP:
 				metric = mkf_u64(FN_COUNTER, sv->counters.denied_resp);
@@ -2334,7 +2385,7 @@ int stats_fill_sv_stats(struct proxy *px, struct server *sv, int flags,
 				break;
 			case ST_F_REQ_TOT:
 				if (px->mode == PR_MODE_HTTP)
-					metric = mkf_u64(FN_COUNTER, sv->counters.p.http.cum_req);
+					metric = mkf_u64(FN_COUNTER, counters_get(sv->counters.shards, THR_CTR_CUM_REQ, &sv->counters.p.http.cum_req));
 				break;
 			case ST_F_HRSP_1XX:
 				if (px->mode == PR_MODE_HTTP)
@@ -2397,6 +2448,30 @@ int stats_fill_sv_stats(struct proxy *px, struct server *sv, int flags,
 			case ST_F_TT_MAX:
 				metric = mkf_u32(FN_MAX, sv->counters.ttime_max);
 				break;
+			case ST_F_QT_P99:
+				metric = mkf_u32(FN_AVG, time_hist_pct(sv->counters.hist, TIME_HIST_QUEUE, 99));
+				break;
+			case ST_F_CT_P99:
+				metric = mkf_u32(FN_AVG, time_hist_pct(sv->counters.hist, TIME_HIST_CONNECT, 99));
+				break;
+			case ST_F_RT_P99:
+				metric = mkf_u32(FN_AVG, time_hist_pct(sv->counters.hist, TIME_HIST_RESPONSE, 99));
+				break;
+			case ST_F_TT_P99:
+				metric = mkf_u32(FN_AVG, time_hist_pct(sv->counters.hist, TIME_HIST_TOTAL, 99));
+				break;
+			case ST_F_QT_HIST:
+				metric = stats_time_hist_field(out, sv->counters.hist, TIME_HIST_QUEUE);
+				break;
+			case ST_F_CT_HIST:
+				metric = stats_time_hist_field(out, sv->counters.hist, TIME_HIST_CONNECT);
+				break;
+			case ST_F_RT_HIST:
+				metric = stats_time_hist_field(out, sv->counters.hist, TIME_HIST_RESPONSE);
+				break;
+			case ST_F_TT_HIST:
+				metric = stats_time_hist_field(out, sv->counters.hist, TIME_HIST_TOTAL);
+				break;
 			case ST_F_ADDR:
 				if (flags & STAT_SHLGNDS) {
 					switch (addr_to_str(&sv->addr, str, sizeof(str))) {
@@ -2536,7 +2611,9 @@ int stats_fill_be_stats(struct proxy *px, int flags, struct field *stats, int le
 	if (selected_field == NULL || *selected_field == ST_F_QTIME ||
 	    *selected_field == ST_F_CTIME || *selected_field == ST_F_RTIME ||
 	    *selected_field == ST_F_TTIME) {
-		be_samples_counter = (px->mode == PR_MODE_HTTP) ? px->be_counters.p.http.cum_req : px->be_counters.cum_lbconn;
+		be_samples_counter = (px->mode == PR_MODE_HTTP) ?
+			counters_get(px->be_counters.shards, THR_CTR_CUM_REQ, &px->be_counters.p.http.cum_req) :
+			px->be_counters.cum_lbconn;
 		if (be_samples_counter < TIME_STATS_SAMPLES && be_samples_counter > 0)
 			be_samples_window = be_samples_counter;
 	}
@@ -2573,10 +2650,10 @@ int stats_fill_be_stats(struct proxy *px, int flags, struct field *stats, int le
 				metric = mkf_u64(FN_COUNTER, px->be_counters.cum_conn);
 				break;
 			case ST_F_BIN:
-				metric = mkf_u64(FN_COUNTER, px->be_counters.bytes_in);
+				metric = mkf_u64(FN_COUNTER, counters_get(px->be_counters.shards, THR_CTR_BYTES_IN, &px->be_counters.bytes_in));
 				break;
 			case ST_F_BOUT:
-				metric = mkf_u64(FN_COUNTER, px->be_counters.bytes_out);
+				metric = mkf_u64(FN_COUNTER, counters_get(px->be_counters.shards, THR_CTR_BYTES_OUT, &px->be_counters.bytes_out));
 				break;
 			case ST_F_DREQ:
 				metric = mkf_u64(FN_COUNTER, px->be_counters.denied_req);
@@ -2668,7 +2745,7 @@ int stats_fill_be_stats(struct proxy *px, int flags, struct field *stats, int le
 				break;
 			case ST_F_REQ_TOT:
 				if (px->mode == PR_MODE_HTTP)
-					metric = mkf_u64(FN_COUNTER, px->be_counters.p.http.cum_req);
+					metric = mkf_u64(FN_COUNTER, counters_get(px->be_counters.shards, THR_CTR_CUM_REQ, &px->be_counters.p.http.cum_req));
 				break;
 			case ST_F_HRSP_1XX:
 				if (px->mode == PR_MODE_HTTP)
@@ -2747,6 +2824,45 @@ int stats_fill_be_stats(struct proxy *px, int flags, struct field *stats, int le
 			case ST_F_TT_MAX:
 				metric = mkf_u32(FN_MAX, px->be_counters.ttime_max);
 				break;
+			case ST_F_QT_P99:
+				metric = mkf_u32(FN_AVG, time_hist_pct(px->be_counters.hist, TIME_HIST_QUEUE, 99));
+				break;
+			case ST_F_CT_P99:
+				metric = mkf_u32(FN_AVG, time_hist_pct(px->be_counters.hist, TIME_HIST_CONNECT, 99));
+				break;
+			case ST_F_RT_P99:
+				metric = mkf_u32(FN_AVG, time_hist_pct(px->be_counters.hist, TIME_HIST_RESPONSE, 99));
+				break;
+			case ST_F_TT_P99:
+				metric = mkf_u32(FN_AVG, time_hist_pct(px->be_counters.hist, TIME_HIST_TOTAL, 99));
+				break;
+			case ST_F_QT_HIST:
+				metric = stats_time_hist_field(out, px->be_counters.hist, TIME_HIST_QUEUE);
+				break;
+			case ST_F_CT_HIST:
+				metric = stats_time_hist_field(out, px->be_counters.hist, TIME_HIST_CONNECT);
+				break;
+			case ST_F_RT_HIST:
+				metric = stats_time_hist_field(out, px->be_counters.hist, TIME_HIST_RESPONSE);
+				break;
+			case ST_F_TT_HIST:
+				metric = stats_time_hist_field(out, px->be_counters.hist, TIME_HIST_TOTAL);
+				break;
+			case ST_F_CPU_TOT:
+				metric = mkf_u64(FN_COUNTER, px->be_counters.cpu_time / 1000);
+				break;
+			case ST_F_CPU_CALLS:
+				metric = mkf_u64(FN_COUNTER, px->be_counters.cpu_calls);
+				break;
+			case ST_F_MEM_STRM:
+				metric = mkf_u64(0, px->mem.strm_bytes);
+				break;
+			case ST_F_MEM_BUF:
+				metric = mkf_u64(0, px->mem.buf_bytes);
+				break;
+			case ST_F_MEM_TBL:
+				metric = mkf_u64(0, px->table ? stktable_mem_usage(px->table) : 0);
+				break;
 			default:
 				/* not used for backends. If a specific metric
 				 * is requested, return an error. Otherwise continue.
@@ -3025,7 +3141,8 @@ int stats_dump_proxy_to_buffer(struct stream_interface *si, struct htx *htx,
 
 	case STAT_PX_ST_FE:
 		/* print the frontend */
-		if (stats_dump_fe_stats(si, px)) {
+		if (stats_is_active(appctx, px->fe_counters.last_upd, px->last_change) &&
+		    stats_dump_fe_stats(si, px)) {
 			if (!stats_putchk(rep, htx, &trash))
 				goto full;
 		}
@@ -3050,6 +3167,9 @@ int stats_dump_proxy_to_buffer(struct stream_interface *si, struct htx *htx,
 			if (!l->counters)
 				continue;
 
+			if (!stats_is_active(appctx, l->counters->last_upd, 0))
+				continue;
+
 			if (appctx->ctx.stats.flags & STAT_BOUND) {
 				if (!(appctx->ctx.stats.type & (1 << STATS_TYPE_SO)))
 					break;
@@ -3091,6 +3211,10 @@ int stats_dump_proxy_to_buffer(struct stream_interface *si, struct htx *htx,
 					continue;
 			}
 
+			/* do not report servers which did not change since the requested date */
+			if (!stats_is_active(appctx, sv->counters.last_upd, sv->last_change))
+				continue;
+
 			/* do not report disabled servers */
 			if (appctx->ctx.stats.flags & STAT_HIDE_MAINT &&
 			    sv->cur_admin & SRV_ADMF_MAINT) {
@@ -3122,7 +3246,8 @@ int stats_dump_proxy_to_buffer(struct stream_interface *si, struct htx *htx,
 
 	case STAT_PX_ST_BE:
 		/* print the backend */
-		if (stats_dump_be_stats(si, px)) {
+		if (stats_is_active(appctx, px->be_counters.last_upd, px->last_change) &&
+		    stats_dump_be_stats(si, px)) {
 			if (!stats_putchk(rep, htx, &trash))
 				goto full;
 		}
@@ -3610,6 +3735,8 @@ static int stats_dump_stat_to_buffer(struct stream_interface *si, struct htx *ht
 
 	switch (appctx->st2) {
 	case STAT_ST_INIT:
+		if (domain == STATS_DOMAIN_PROXY)
+			proxy_update_mem_usage(0);
 		appctx->st2 = STAT_ST_HEAD; /* let's start producing data */
 		/* fall through */
 
@@ -4372,7 +4499,7 @@ int stats_fill_info(struct field *info, int len, uint flags)
 	info[INF_COMPRESS_BPS_IN]                = (flags & STAT_USE_FLOAT) ? mkf_flt(FN_RATE, read_freq_ctr_flt(&global.comp_bps_in)) : mkf_u32(FN_RATE, read_freq_ctr(&global.comp_bps_in));
 	info[INF_COMPRESS_BPS_OUT]               = (flags & STAT_USE_FLOAT) ? mkf_flt(FN_RATE, read_freq_ctr_flt(&global.comp_bps_out)) : mkf_u32(FN_RATE, read_freq_ctr(&global.comp_bps_out));
 	info[INF_COMPRESS_BPS_RATE_LIM]          = mkf_u32(FO_CONFIG|FN_LIMIT, global.comp_rate_lim);
-#ifdef USE_ZLIB
+#if defined(USE_ZLIB) || defined(USE_BROTLI) || defined(USE_ZSTD)
 	info[INF_ZLIB_MEM_USAGE]                 = mkf_u32(0, zlib_used_memory);
 	info[INF_MAX_ZLIB_MEM_USAGE]             = mkf_u32(FO_CONFIG|FN_LIMIT, global.maxzlibmem);
 #endif
@@ -4677,8 +4804,8 @@ static int cli_parse_clear_counters(char **args, char *payload, struct appctx *a
 
 	for (px = proxies_list; px; px = px->next) {
 		if (clrall) {
-			memset(&px->be_counters, 0, sizeof(px->be_counters));
-			memset(&px->fe_counters, 0, sizeof(px->fe_counters));
+			be_counters_clear(&px->be_counters);
+			fe_counters_clear(&px->fe_counters);
 		}
 		else {
 			px->be_counters.conn_max = 0;
@@ -4699,7 +4826,7 @@ static int cli_parse_clear_counters(char **args, char *payload, struct appctx *a
 
 		for (sv = px->srv; sv; sv = sv->next)
 			if (clrall)
-				memset(&sv->counters, 0, sizeof(sv->counters));
+				be_counters_clear(&sv->counters);
 			else {
 				sv->counters.cur_sess_max = 0;
 				sv->counters.nbpend_max = 0;
@@ -4713,7 +4840,7 @@ static int cli_parse_clear_counters(char **args, char *payload, struct appctx *a
 		list_for_each_entry(li, &px->conf.listeners, by_fe)
 			if (li->counters) {
 				if (clrall)
-					memset(li->counters, 0, sizeof(*li->counters));
+					fe_counters_clear(li->counters);
 				else
 					li->counters->conn_max = 0;
 			}
@@ -4796,6 +4923,23 @@ static int cli_parse_show_info(char **args, char *payload, struct appctx *appctx
 }
 
 
+/* Converts the wall-clock date <epoch> (in seconds since the epoch) provided by
+ * a client into the internal date the counters' activity is compared to. One
+ * second is removed to cover the updates performed during the second <epoch>
+ * was taken in. Returns 0, meaning that everything must be dumped, if <epoch>
+ * precedes the process' start.
+ */
+unsigned int stats_since_from_epoch(unsigned long long epoch)
+{
+	long long since;
+
+	if (epoch <= start_date.tv_sec)
+		return 0;
+
+	since = (long long)epoch - date.tv_sec + now.tv_sec - 1;
+	return since > 0 ? since : 1;
+}
+
 static int cli_parse_show_stat(char **args, char *payload, struct appctx *appctx, void *private)
 {
 	int arg = 2;
@@ -4852,6 +4996,17 @@ static int cli_parse_show_stat(char **args, char *payload, struct appctx *appctx
 			appctx->ctx.stats.flags |= STAT_HIDE_MAINT;
 		else if (strcmp(args[arg], "up") == 0)
 			appctx->ctx.stats.flags |= STAT_HIDE_DOWN;
+		else if (strcmp(args[arg], "since") == 0) {
+			char *error;
+			unsigned long long epoch;
+
+			if (!*args[arg+1])
+				return cli_err(appctx, "'since' expects a date in seconds since the epoch.\n");
+			epoch = strtoull(args[++arg], &error, 10);
+			if (*error)
+				return cli_err(appctx, "'since' expects a date in seconds since the epoch.\n");
+			appctx->ctx.stats.since = stats_since_from_epoch(epoch);
+		}
 		arg++;
 	}
 
@@ -4905,8 +5060,49 @@ int stats_allocate_proxy_counters_internal(struct extra_counters **counters,
 	return 0;
 }
 
+/* Allocates the per-thread parts of a set of counters into <shards>, which is
+ * left NULL when running with a single thread since there is nothing to save
+ * then. The counters' values are then the sum of their shared and per-thread
+ * parts (see counters.h). Returns 0 on allocation failure, otherwise 1.
+ */
+int stats_allocate_counters_shards(struct thr_counters **shards)
+{
+	void *ptr;
+
+	if (*shards || global.nbthread <= 1)
+		return 1;
+
+	if (posix_memalign(&ptr, sizeof(**shards), global.nbthread * sizeof(**shards)) != 0)
+		return 0;
+
+	memset(ptr, 0, global.nbthread * sizeof(**shards));
+	*shards = ptr;
+	return 1;
+}
+
+/* Allocates the per-thread time histograms <hist> of a backend or a server if
+ * not already done. Contrary to the counters shards, they are needed even with
+ * a single thread since they have no shared part. Returns 0 on allocation
+ * failure, otherwise 1.
+ */
+int stats_allocate_time_hist(struct time_hist **hist)
+{
+	void *ptr;
+
+	if (*hist)
+		return 1;
+
+	if (posix_memalign(&ptr, 64, global.nbthread * sizeof(**hist)) != 0)
+		return 0;
+
+	memset(ptr, 0, global.nbthread * sizeof(**hist));
+	*hist = ptr;
+	return 1;
+}
+
 /* Initialize and allocate all extra counters for a proxy and its attached
- * servers/listeners with all already registered stats module
+ * servers/listeners with all already registered stats module, as well as the
+ * per-thread parts of their counters and their time histograms.
  */
 int stats_allocate_proxy_counters(struct proxy *px)
 {
@@ -4919,6 +5115,8 @@ int stats_allocate_proxy_counters(struct proxy *px)
 		                                            STATS_PX_CAP_FE)) {
 			return 0;
 		}
+		if (!stats_allocate_counters_shards(&px->fe_counters.shards))
+			return 0;
 	}
 
 	if (px->cap & PR_CAP_BE) {
@@ -4927,6 +5125,9 @@ int stats_allocate_proxy_counters(struct proxy *px)
 		                                            STATS_PX_CAP_BE)) {
 			return 0;
 		}
+		if (!stats_allocate_counters_shards(&px->be_counters.shards) ||
+		    !stats_allocate_time_hist(&px->be_counters.hist))
+			return 0;
 	}
 
 	for (sv = px->srv; sv; sv = sv->next) {
@@ -4935,6 +5136,9 @@ int stats_allocate_proxy_counters(struct proxy *px)
 		                                            STATS_PX_CAP_SRV)) {
 			return 0;
 		}
+		if (!stats_allocate_counters_shards(&sv->counters.shards) ||
+		    !stats_allocate_time_hist(&sv->counters.hist))
+			return 0;
 	}
 
 	list_for_each_entry(li, &px->conf.listeners, by_fe) {
@@ -4943,6 +5147,8 @@ int stats_allocate_proxy_counters(struct proxy *px)
 		                                            STATS_PX_CAP_LI)) {
 			return 0;
 		}
+		if (li->counters && !stats_allocate_counters_shards(&li->counters->shards))
+			return 0;
 	}
 
 	return 1;
@@ -5114,7 +5320,7 @@ REGISTER_PER_THREAD_FREE(free_trash_counters);
 static struct cli_kw_list cli_kws = {{ },{
 	{ { "clear", "counters",  NULL },      "clear counters [all]                    : clear max statistics counters (or all counters)", cli_parse_clear_counters, NULL, NULL },
 	{ { "show", "info",  NULL },           "show info [desc|json|typed|float]*      : report information about the running process",    cli_parse_show_info, cli_io_handler_dump_info, NULL },
-	{ { "show", "stat",  NULL },           "show stat [desc|json|no-maint|typed|up]*: report counters for each proxy and server",       cli_parse_show_stat, cli_io_handler_dump_stat, NULL },
+	{ { "show", "stat",  NULL },           "show stat [desc|json|no-maint|typed|up|since <date>]*: report counters for each proxy and server", cli_parse_show_stat, cli_io_handler_dump_stat, NULL },
 	{ { "show", "schema",  "json", NULL }, "show schema json                        : report schema used for stats",                    NULL, cli_io_handler_dump_json_schema, NULL },
 	{{},}
 }};
@@ -11,15 +11,18 @@
  *
  */
 
+#include <ctype.h>
 #include <string.h>
 #include <errno.h>
 
 #include <import/ebmbtree.h>
 #include <import/ebsttree.h>
 #include <import/ebistree.h>
+#include <import/xxhash.h>
 
 #include <haproxy/api.h>
 #include <haproxy/arg.h>
+#include <haproxy/base64.h>
 #include <haproxy/cfgparse.h>
 #include <haproxy/cli.h>
 #include <haproxy/dict.h>
@@ -78,20 +81,92 @@ struct stktable *stktable_find_by_name(const char *name)
 	return NULL;
 }
 
+/*
+ * Returns the index of the shard of table <t> in charge of the <len> bytes of
+ * key <key>. Tables with a single shard do not hash anything.
+ */
+static inline unsigned int stktable_shard_idx(const struct stktable *t, const void *key, size_t len)
+{
+	if (t->nb_shards <= 1)
+		return 0;
+	return XXH32(key, len, 0) % t->nb_shards;
+}
+
+/*
+ * Returns the index of the shard of table <t> in charge of lookup key <key>.
+ * For strings, only the part which would be stored in the entry is hashed so
+ * that the result matches the one of stksess_shard().
+ */
+static inline unsigned int stktable_key_shard(const struct stktable *t, const struct stktable_key *key)
+{
+	size_t len = t->key_size;
+
+	if (t->type == SMP_T_STR) {
+		len = key->key_len + 1 < t->key_size ? key->key_len : t->key_size - 1;
+		len = strnlen(key->key, len);
+	}
+	return stktable_shard_idx(t, key->key, len);
+}
+
+/*
+ * Returns the index of the shard of table <t> in charge of the key already
+ * stored into entry <ts>.
+ */
+static inline unsigned int stksess_shard(const struct stktable *t, const struct stksess *ts)
+{
+	size_t len = t->key_size;
+
+	if (t->type == SMP_T_STR)
+		len = strlen((const char *)ts->key.key);
+	return stktable_shard_idx(t, ts->key.key, len);
+}
+
+/*
+ * Returns the index of the smallest key size class of table <t> able to hold
+ * lookup key <key>, which is the part stksess_setkey() would store for strings.
+ */
+static inline unsigned int stktable_key_class(const struct stktable *t, const struct stktable_key *key)
+{
+	unsigned int cls = 0;
+	size_t len;
+
+	if (t->nb_key_classes <= 1)
+		return 0;
+
+	len = key->key_len + 1 < t->key_size ? key->key_len : t->key_size - 1;
+	len = strnlen(key->key, len) + 1;
+	while (cls < t->nb_key_classes - 1 && len > t->key_classes[cls].size)
+		cls++;
+	return cls;
+}
+
+/* Returns the amount of memory in bytes currently used by the entries of table
+ * <t>, which is 0 for a table that was never initialized.
+ */
+unsigned long long stktable_mem_usage(const struct stktable *t)
+{
+	unsigned long long bytes = 0;
+	unsigned int i;
+
+	for (i = 0; i < t->nb_key_classes; i++)
+		bytes += (unsigned long long)HA_ATOMIC_LOAD(&t->key_classes[i].used) * t->key_classes[i].pool->size;
+	return bytes;
+}
+
 /*
  * Free an allocated sticky session <ts>, and decrease sticky sessions counter
  * in table <t>.
  */
 void __stksess_free(struct stktable *t, struct stksess *ts)
 {
-	t->current--;
-	pool_free(t->pool, (void *)ts - round_ptr_size(t->data_size));
+	HA_ATOMIC_DEC(&t->current);
+	HA_ATOMIC_DEC(&t->key_classes[ts->key_class].used);
+	pool_free(t->key_classes[ts->key_class].pool, (void *)ts - round_ptr_size(t->data_size));
 }
 
 /*
  * Free an allocated sticky session <ts>, and decrease sticky sessions counter
- * in table <t>.
- * This function locks the table
+ * in table <t>. The entry must not be attached to the table anymore.
  */
 void stksess_free(struct stktable *t, struct stksess *ts)
 {
@@ -101,21 +176,31 @@ void stksess_free(struct stktable *t, struct stksess *ts)
 		dict_entry_unref(&server_key_dict, stktable_data_cast(data, server_key));
 		stktable_data_cast(data, server_key) = NULL;
 	}
-	HA_SPIN_LOCK(STK_TABLE_LOCK, &t->lock);
 	__stksess_free(t, ts);
-	HA_SPIN_UNLOCK(STK_TABLE_LOCK, &t->lock);
 }
 
 /*
- * Kill an stksess (only if its ref_cnt is zero).
+ * Kill an stksess (only if its ref_cnt is zero). The lock of the entry's shard
+ * must be held. The table lock is taken to detach the entry from the updates
+ * tree, where the peers may still find it and grab a reference under this
+ * lock only, so the refcount has to be checked again there.
  */
 int __stksess_kill(struct stktable *t, struct stksess *ts)
 {
-	if (ts->ref_cnt)
+	if (HA_ATOMIC_LOAD(&ts->ref_cnt))
 		return 0;
 
+	if (ts->upd.node.leaf_p) {
+		HA_SPIN_LOCK(STK_TABLE_LOCK, &t->lock);
+		if (HA_ATOMIC_LOAD(&ts->ref_cnt)) {
+			HA_SPIN_UNLOCK(STK_TABLE_LOCK, &t->lock);
+			return 0;
+		}
+		eb32_delete(&ts->upd);
+		HA_SPIN_UNLOCK(STK_TABLE_LOCK, &t->lock);
+	}
+
 	eb32_delete(&ts->exp);
-	eb32_delete(&ts->upd);
 	ebmb_delete(&ts->key);
 	__stksess_free(t, ts);
 	return 1;
@@ -124,33 +209,38 @@ int __stksess_kill(struct stktable *t, struct stksess *ts)
 /*
  * Decrease the refcount if decrefcnt is not 0.
  * and try to kill the stksess
- * This function locks the table
+ * This function locks the entry's shard
  */
 int stksess_kill(struct stktable *t, struct stksess *ts, int decrefcnt)
 {
+	struct stktable_shard *shard = &t->shards[ts->shard];
 	int ret;
 
-	HA_SPIN_LOCK(STK_TABLE_LOCK, &t->lock);
+	HA_SPIN_LOCK(STK_TABLE_LOCK, &shard->lock);
 	if (decrefcnt)
-		ts->ref_cnt--;
+		HA_ATOMIC_DEC(&ts->ref_cnt);
 	ret = __stksess_kill(t, ts);
-	HA_SPIN_UNLOCK(STK_TABLE_LOCK, &t->lock);
+	HA_SPIN_UNLOCK(STK_TABLE_LOCK, &shard->lock);
 
 	return ret;
 }
 
 /*
  * Initialize or update the key in the sticky session <ts> present in table <t>
- * from the value present in <key>.
+ * from the value present in <key>. The shard the entry belongs to is updated.
+ * Strings are truncated to the room of the entry's key size class.
  */
 void stksess_setkey(struct stktable *t, struct stksess *ts, struct stktable_key *key)
 {
+	size_t room = t->key_classes[ts->key_class].size;
+
 	if (t->type != SMP_T_STR)
 		memcpy(ts->key.key, key->key, t->key_size);
 	else {
-		memcpy(ts->key.key, key->key, MIN(t->key_size - 1, key->key_len));
-		ts->key.key[MIN(t->key_size - 1, key->key_len)] = 0;
+		memcpy(ts->key.key, key->key, MIN(room - 1, key->key_len));
+		ts->key.key[MIN(room - 1, key->key_len)] = 0;
 	}
+	ts->shard = stksess_shard(t, ts);
 }
 
 
@@ -162,6 +252,8 @@ static struct stksess *__stksess_init(struct stktable *t, struct stksess * ts)
 {
 	memset((void *)ts - t->data_size, 0, t->data_size);
 	ts->ref_cnt = 0;
+	ts->shard = 0;
+	ts->relay_src = 0;
 	ts->key.node.leaf_p = NULL;
 	ts->exp.node.leaf_p = NULL;
 	ts->upd.node.leaf_p = NULL;
@@ -171,12 +263,13 @@ static struct stksess *__stksess_init(struct stktable *t, struct stksess * ts)
 }
 
 /*
- * Trash oldest <to_batch> sticky sessions from table <t>
+ * Trash oldest <to_batch> sticky sessions from shard <shard> of table <t>,
+ * whose lock must be held.
  * Returns number of trashed sticky sessions. It may actually trash less
  * than expected if finding these requires too long a search time (e.g.
  * most of them have ts->ref_cnt>0).
  */
-int __stktable_trash_oldest(struct stktable *t, int to_batch)
+static int __stktable_trash_oldest(struct stktable *t, struct stktable_shard *shard, int to_batch)
 {
 	struct stksess *ts;
 	struct eb32_node *eb;
@@ -184,7 +277,7 @@ int __stktable_trash_oldest(struct stktable *t, int to_batch)
 	int batched = 0;
 	int looped = 0;
 
-	eb = eb32_lookup_ge(&t->exps, now_ms - TIMER_LOOK_BACK);
+	eb = eb32_lookup_ge(&shard->exps, now_ms - TIMER_LOOK_BACK);
 
 	while (batched < to_batch) {
 
@@ -197,7 +290,7 @@ int __stktable_trash_oldest(struct stktable *t, int to_batch)
 			if (looped)
 				break;
 			looped = 1;
-			eb = eb32_first(&t->exps);
+			eb = eb32_first(&shard->exps);
 			if (likely(!eb))
 				break;
 		}
@@ -210,7 +303,7 @@ int __stktable_trash_oldest(struct stktable *t, int to_batch)
 		eb = eb32_next(eb);
 
 		/* don't delete an entry which is currently referenced */
-		if (ts->ref_cnt)
+		if (HA_ATOMIC_LOAD(&ts->ref_cnt))
 			continue;
 
 		eb32_delete(&ts->exp);
@@ -220,7 +313,7 @@ int __stktable_trash_oldest(struct stktable *t, int to_batch)
 				continue;
 
 			ts->exp.key = ts->expire;
-			eb32_insert(&t->exps, &ts->exp);
+			eb32_insert(&shard->exps, &ts->exp);
 
 			if (!eb || eb->key > ts->exp.key)
 				eb = &ts->exp;
@@ -228,10 +321,11 @@ int __stktable_trash_oldest(struct stktable *t, int to_batch)
 			continue;
 		}
 
-		/* session expired, trash it */
-		ebmb_delete(&ts->key);
-		eb32_delete(&ts->upd);
-		__stksess_free(t, ts);
+		/* session expired, trash it unless a peer just grabbed it */
+		if (!__stksess_kill(t, ts)) {
+			eb32_insert(&shard->exps, &ts->exp);
+			continue;
+		}
 		batched++;
 	}
 
@@ -241,45 +335,85 @@ int __stktable_trash_oldest(struct stktable *t, int to_batch)
 /*
  * Trash oldest <to_batch> sticky sessions from table <t>
  * Returns number of trashed sticky sessions.
- * This function locks the table
+ * This function locks the table's shards one at a time
  */
 int stktable_trash_oldest(struct stktable *t, int to_batch)
 {
-	int ret;
+	struct stktable_shard *shard;
+	int ret = 0;
+	int i;
 
-	HA_SPIN_LOCK(STK_TABLE_LOCK, &t->lock);
-	ret = __stktable_trash_oldest(t, to_batch);
-	HA_SPIN_UNLOCK(STK_TABLE_LOCK, &t->lock);
+	for (i = 0; i < t->nb_shards && ret < to_batch; i++) {
+		shard = &t->shards[i];
+		HA_SPIN_LOCK(STK_TABLE_LOCK, &shard->lock);
+		ret += __stktable_trash_oldest(t, shard, to_batch - ret);
+		HA_SPIN_UNLOCK(STK_TABLE_LOCK, &shard->lock);
+	}
 
 	return ret;
 }
+
+/*
+ * Trash up to <to_batch> sticky sessions from table <t> to make room for a
+ * new entry. If <idx> is not negative, the caller holds the lock of shard
+ * <idx>, which is tried first. Other shards are then only tried if nothing
+ * could be trashed there, and only when their lock is immediately available,
+ * so that the order in which shards are locked never matters.
+ * Returns number of trashed sticky sessions.
+ */
+static int stktable_make_room(struct stktable *t, int idx, int to_batch)
+{
+	struct stktable_shard *shard;
+	int ret, i;
+
+	if (idx < 0)
+		return stktable_trash_oldest(t, to_batch);
+
+	ret = __stktable_trash_oldest(t, &t->shards[idx], to_batch);
+	for (i = 0; !ret && i < t->nb_shards; i++) {
+		shard = &t->shards[i];
+		if (i == idx || HA_SPIN_TRYLOCK(STK_TABLE_LOCK, &shard->lock) != 0)
+			continue;
+		ret = __stktable_trash_oldest(t, shard, to_batch);
+		HA_SPIN_UNLOCK(STK_TABLE_LOCK, &shard->lock);
+	}
+	return ret;
+}
+
 /*
  * Allocate and initialise a new sticky session.
  * The new sticky session is returned or NULL in case of lack of memory.
  * Sticky sessions should only be allocated this way, and must be freed using
  * stksess_free(). Table <t>'s sticky session counter is increased. If <key>
- * is not NULL, it is assigned to the new session.
+ * is not NULL, it is assigned to the new session, and the lock of the shard
+ * in charge of this key must be held.
  */
 struct stksess *__stksess_new(struct stktable *t, struct stktable_key *key)
 {
 	struct stksess *ts;
+	unsigned int cls;
 
-	if (unlikely(t->current == t->size)) {
-		if ( t->nopurge )
-			return NULL;
-
-		if (!__stktable_trash_oldest(t, (t->size >> 8) + 1))
+	if (unlikely(HA_ATOMIC_FETCH_ADD(&t->current, 1) >= t->size)) {
+		if (t->nopurge ||
+		    !stktable_make_room(t, key ? stktable_key_shard(t, key) : -1, (t->size >> 8) + 1)) {
+			HA_ATOMIC_DEC(&t->current);
 			return NULL;
+		}
 	}
 
-	ts = pool_alloc(t->pool);
+	/* without a key, the entry must be able to hold the longest one */
+	cls = key ? stktable_key_class(t, key) : t->nb_key_classes - 1;
+	ts = pool_alloc(t->key_classes[cls].pool);
 	if (ts) {
-		t->current++;
+		HA_ATOMIC_INC(&t->key_classes[cls].used);
 		ts = (void *)ts + round_ptr_size(t->data_size);
 		__stksess_init(t, ts);
+		ts->key_class = cls;
 		if (key)
 			stksess_setkey(t, ts, key);
 	}
+	else
+		HA_ATOMIC_DEC(&t->current);
 
 	return ts;
 }
@@ -289,31 +423,37 @@ struct stksess *__stksess_new(struct stktable *t, struct stktable_key *key)
  * Sticky sessions should only be allocated this way, and must be freed using
  * stksess_free(). Table <t>'s sticky session counter is increased. If <key>
  * is not NULL, it is assigned to the new session.
- * This function locks the table
+ * This function locks the shard in charge of <key> if any
  */
 struct stksess *stksess_new(struct stktable *t, struct stktable_key *key)
 {
+	struct stktable_shard *shard;
 	struct stksess *ts;
 
-	HA_SPIN_LOCK(STK_TABLE_LOCK, &t->lock);
+	if (!key)
+		return __stksess_new(t, NULL);
+
+	shard = &t->shards[stktable_key_shard(t, key)];
+	HA_SPIN_LOCK(STK_TABLE_LOCK, &shard->lock);
 	ts = __stksess_new(t, key);
-	HA_SPIN_UNLOCK(STK_TABLE_LOCK, &t->lock);
+	HA_SPIN_UNLOCK(STK_TABLE_LOCK, &shard->lock);
 
 	return ts;
 }
 
 /*
- * Looks in table <t> for a sticky session matching key <key>.
+ * Looks in shard <shard> of table <t> for a sticky session matching key <key>.
  * Returns pointer on requested sticky session or NULL if none was found.
  */
-struct stksess *__stktable_lookup_key(struct stktable *t, struct stktable_key *key)
+static struct stksess *__stktable_lookup_key(struct stktable *t, struct stktable_shard *shard,
+                                             struct stktable_key *key)
 {
 	struct ebmb_node *eb;
 
 	if (t->type == SMP_T_STR)
-		eb = ebst_lookup_len(&t->keys, key->key, key->key_len+1 < t->key_size ? key->key_len : t->key_size-1);
+		eb = ebst_lookup_len(&shard->keys, key->key, key->key_len+1 < t->key_size ? key->key_len : t->key_size-1);
 	else
-		eb = ebmb_lookup(&t->keys, key->key, t->key_size);
+		eb = ebmb_lookup(&shard->keys, key->key, t->key_size);
 
 	if (unlikely(!eb)) {
 		/* no session found */
@@ -327,33 +467,35 @@ struct stksess *__stktable_lookup_key(struct stktable *t, struct stktable_key *k
  * Looks in table <t> for a sticky session matching key <key>.
  * Returns pointer on requested sticky session or NULL if none was found.
  * The refcount of the found entry is increased and this function
- * is protected using the table lock
+ * is protected using the lock of the key's shard
  */
 struct stksess *stktable_lookup_key(struct stktable *t, struct stktable_key *key)
 {
+	struct stktable_shard *shard = &t->shards[stktable_key_shard(t, key)];
 	struct stksess *ts;
 
-	HA_SPIN_LOCK(STK_TABLE_LOCK, &t->lock);
-	ts = __stktable_lookup_key(t, key);
+	HA_SPIN_LOCK(STK_TABLE_LOCK, &shard->lock);
+	ts = __stktable_lookup_key(t, shard, key);
 	if (ts)
-		ts->ref_cnt++;
-	HA_SPIN_UNLOCK(STK_TABLE_LOCK, &t->lock);
+		HA_ATOMIC_INC(&ts->ref_cnt);
+	HA_SPIN_UNLOCK(STK_TABLE_LOCK, &shard->lock);
 
 	return ts;
 }
 
 /*
- * Looks in table <t> for a sticky session with same key as <ts>.
- * Returns pointer on requested sticky session or NULL if none was found.
+ * Looks in shard <shard> of table <t> for a sticky session with same key as
+ * <ts>. Returns pointer on requested sticky session or NULL if none was found.
  */
-struct stksess *__stktable_lookup(struct stktable *t, struct stksess *ts)
+static struct stksess *__stktable_lookup(struct stktable *t, struct stktable_shard *shard,
+                                         struct stksess *ts)
 {
 	struct ebmb_node *eb;
 
 	if (t->type == SMP_T_STR)
-		eb = ebst_lookup(&(t->keys), (char *)ts->key.key);
+		eb = ebst_lookup(&(shard->keys), (char *)ts->key.key);
 	else
-		eb = ebmb_lookup(&(t->keys), ts->key.key, t->key_size);
+		eb = ebmb_lookup(&(shard->keys), ts->key.key, t->key_size);
 
 	if (unlikely(!eb))
 		return NULL;
@@ -365,43 +507,65 @@ struct stksess *__stktable_lookup(struct stktable *t, struct stksess *ts)
  * Looks in table <t> for a sticky session with same key as <ts>.
  * Returns pointer on requested sticky session or NULL if none was found.
  * The refcount of the found entry is increased and this function
- * is protected using the table lock
+ * is protected using the lock of the key's shard
  */
 struct stksess *stktable_lookup(struct stktable *t, struct stksess *ts)
 {
+	struct stktable_shard *shard = &t->shards[stksess_shard(t, ts)];
 	struct stksess *lts;
 
-	HA_SPIN_LOCK(STK_TABLE_LOCK, &t->lock);
-	lts = __stktable_lookup(t, ts);
+	HA_SPIN_LOCK(STK_TABLE_LOCK, &shard->lock);
+	lts = __stktable_lookup(t, shard, ts);
 	if (lts)
-		lts->ref_cnt++;
-	HA_SPIN_UNLOCK(STK_TABLE_LOCK, &t->lock);
+		HA_ATOMIC_INC(&lts->ref_cnt);
+	HA_SPIN_UNLOCK(STK_TABLE_LOCK, &shard->lock);
 
 	return lts;
 }
 
+/* Makes sure the expiration task of table <t> will run no later than
+ * <expire>. The task is only requeued when <expire> is before the currently
+ * planned date, which is rare since most entries are touched to expire later.
+ */
+static void stktable_requeue_exp(struct stktable *t, int expire)
+{
+	int old_exp = HA_ATOMIC_LOAD(&t->exp_next);
+	int new_exp;
+
+	do {
+		new_exp = tick_first(expire, old_exp);
+		if (new_exp == old_exp)
+			return;
+	} while (!HA_ATOMIC_CAS(&t->exp_next, &old_exp, new_exp) && __ha_cpu_relax());
+
+	task_schedule(t->exp_task, new_exp);
+}
+
 /* Update the expiration timer for <ts> but do not touch its expiration node.
  * The table's expiration timer is updated if set.
  * The node will be also inserted into the update tree if needed, at a position
- * depending if the update is a local or coming from a remote node
+ * depending if the update is a local or coming from a remote node. A local
+ * update may be relayed on behalf of the peer whose relay_id is <src>, or 0
+ * for a genuinely local one. The lock of the entry's shard must be held, the
+ * table lock is taken for the update tree.
  */
-void __stktable_touch_with_exp(struct stktable *t, struct stksess *ts, int local, int expire)
+void __stktable_touch_with_exp(struct stktable *t, struct stksess *ts, int local, unsigned int src, int expire)
 {
 	struct eb32_node * eb;
 	ts->expire = expire;
-	if (t->expire) {
-		t->exp_task->expire = t->exp_next = tick_first(ts->expire, t->exp_next);
-		task_queue(t->exp_task);
-	}
+	if (t->expire)
+		stktable_requeue_exp(t, ts->expire);
 
 	/* If sync is enabled */
 	if (t->sync_task) {
+		HA_SPIN_LOCK(STK_TABLE_LOCK, &t->lock);
 		if (local) {
 			/* If this entry is not in the tree
 			   or not scheduled for at least one peer */
 			if (!ts->upd.node.leaf_p
 			    || (int)(t->commitupdate - ts->upd.key) >= 0
 			    || (int)(ts->upd.key - t->localupdate) >= 0) {
+				ts->relay_src = src;
 				ts->upd.key = ++t->update;
 				t->localupdate = t->update;
 				eb32_delete(&ts->upd);
@@ -411,6 +575,12 @@ void __stktable_touch_with_exp(struct stktable *t, struct stksess *ts, int local
 					eb32_insert(&t->updates, &ts->upd);
 				}
 			}
+			else if (ts->relay_src != src) {
+				/* still pending but changed from elsewhere: all
+				 * peers must learn it.
+				 */
+				ts->relay_src = 0;
+			}
 			task_wakeup(t->sync_task, TASK_WOKEN_MSG);
 		}
 		else {
@@ -424,6 +594,7 @@ void __stktable_touch_with_exp(struct stktable *t, struct stksess *ts, int local
 				}
 			}
 		}
+		HA_SPIN_UNLOCK(STK_TABLE_LOCK, &t->lock);
 	}
 }
 
@@ -435,11 +606,13 @@ void __stktable_touch_with_exp(struct stktable *t, struct stksess *ts, int local
  */
 void stktable_touch_remote(struct stktable *t, struct stksess *ts, int decrefcnt)
 {
-	HA_SPIN_LOCK(STK_TABLE_LOCK, &t->lock);
-	__stktable_touch_with_exp(t, ts, 0, ts->expire);
+	struct stktable_shard *shard = &t->shards[ts->shard];
+
+	HA_SPIN_LOCK(STK_TABLE_LOCK, &shard->lock);
+	__stktable_touch_with_exp(t, ts, 0, 0, ts->expire);
 	if (decrefcnt)
-		ts->ref_cnt--;
-	HA_SPIN_UNLOCK(STK_TABLE_LOCK, &t->lock);
+		HA_ATOMIC_DEC(&ts->ref_cnt);
+	HA_SPIN_UNLOCK(STK_TABLE_LOCK, &shard->lock);
 }
 
 /* Update the expiration timer for <ts> but do not touch its expiration node.
@@ -450,52 +623,72 @@ void stktable_touch_remote(struct stktable *t, struct stksess *ts, int decrefcnt
  */
 void stktable_touch_local(struct stktable *t, struct stksess *ts, int decrefcnt)
 {
+	struct stktable_shard *shard = &t->shards[ts->shard];
 	int expire = tick_add(now_ms, MS_TO_TICKS(t->expire));
 
-	HA_SPIN_LOCK(STK_TABLE_LOCK, &t->lock);
-	__stktable_touch_with_exp(t, ts, 1, expire);
+	HA_SPIN_LOCK(STK_TABLE_LOCK, &shard->lock);
+	__stktable_touch_with_exp(t, ts, 1, 0, expire);
 	if (decrefcnt)
-		ts->ref_cnt--;
-	HA_SPIN_UNLOCK(STK_TABLE_LOCK, &t->lock);
+		HA_ATOMIC_DEC(&ts->ref_cnt);
+	HA_SPIN_UNLOCK(STK_TABLE_LOCK, &shard->lock);
 }
+
+/* Update the expiration timer for <ts> but do not touch its expiration node.
+ * The entry keeps its expiration date, which was learned from a remote node,
+ * but is scheduled as a local update so that it is taught to the other peers.
+ * <src> is the relay_id of the peer it was learned from, which is used to
+ * avoid sending the update back to it. This is used by the hubs to relay the
+ * updates between the other nodes.
+ */
+void stktable_touch_relay(struct stktable *t, struct stksess *ts, unsigned int src, int decrefcnt)
+{
+	struct stktable_shard *shard = &t->shards[ts->shard];
+
+	HA_SPIN_LOCK(STK_TABLE_LOCK, &shard->lock);
+	__stktable_touch_with_exp(t, ts, 1, src, ts->expire);
+	if (decrefcnt)
+		HA_ATOMIC_DEC(&ts->ref_cnt);
+	HA_SPIN_UNLOCK(STK_TABLE_LOCK, &shard->lock);
+}
+
 /* Just decrease the ref_cnt of the current session. Does nothing if <ts> is NULL */
 static void stktable_release(struct stktable *t, struct stksess *ts)
 {
 	if (!ts)
 		return;
-	HA_SPIN_LOCK(STK_TABLE_LOCK, &t->lock);
-	ts->ref_cnt--;
-	HA_SPIN_UNLOCK(STK_TABLE_LOCK, &t->lock);
+	HA_ATOMIC_DEC(&ts->ref_cnt);
 }
 
 /* Insert new sticky session <ts> in the table. It is assumed that it does not
- * yet exist (the caller must check this). The table's timeout is updated if it
- * is set. <ts> is returned.
+ * yet exist (the caller must check this) and that the lock of its shard is
+ * held. The table's timeout is updated if it is set. <ts> is returned.
  */
 void __stktable_store(struct stktable *t, struct stksess *ts)
 {
+	struct stktable_shard *shard = &t->shards[ts->shard];
 
-	ebmb_insert(&t->keys, &ts->key, t->key_size);
+	/* string keys may be stored in less than <key_size> bytes */
+	if (t->type == SMP_T_STR)
+		ebst_insert(&shard->keys, &ts->key);
+	else
+		ebmb_insert(&shard->keys, &ts->key, t->key_size);
 	ts->exp.key = ts->expire;
-	eb32_insert(&t->exps, &ts->exp);
-	if (t->expire) {
-		t->exp_task->expire = t->exp_next = tick_first(ts->expire, t->exp_next);
-		task_queue(t->exp_task);
-	}
+	eb32_insert(&shard->exps, &ts->exp);
+	if (t->expire)
+		stktable_requeue_exp(t, ts->expire);
 }
 
 /* Returns a valid or initialized stksess for the specified stktable_key in the
  * specified table, or NULL if the key was NULL, or if no entry was found nor
- * could be created. The entry's expiration is updated.
+ * could be created. The entry's expiration is updated. The lock of shard
+ * <shard>, in charge of <key>, must be held.
  */
-struct stksess *__stktable_get_entry(struct stktable *table, struct stktable_key *key)
+static struct stksess *__stktable_get_entry(struct stktable *table, struct stktable_shard *shard,
+                                            struct stktable_key *key)
 {
 	struct stksess *ts;
 
-	if (!key)
-		return NULL;
-
-	ts = __stktable_lookup_key(table, key);
+	ts = __stktable_lookup_key(table, shard, key);
 	if (ts == NULL) {
 		/* entry does not exist, initialize a new one */
 		ts = __stksess_new(table, key);
@@ -508,29 +701,36 @@ struct stksess *__stktable_get_entry(struct stktable *table, struct stktable_key
 /* Returns a valid or initialized stksess for the specified stktable_key in the
  * specified table, or NULL if the key was NULL, or if no entry was found nor
  * could be created. The entry's expiration is updated.
- * This function locks the table, and the refcount of the entry is increased.
+ * This function locks the key's shard, and the refcount of the entry is increased.
  */
 struct stksess *stktable_get_entry(struct stktable *table, struct stktable_key *key)
 {
+	struct stktable_shard *shard;
 	struct stksess *ts;
 
-	HA_SPIN_LOCK(STK_TABLE_LOCK, &table->lock);
-	ts = __stktable_get_entry(table, key);
+	if (!key)
+		return NULL;
+
+	shard = &table->shards[stktable_key_shard(table, key)];
+	HA_SPIN_LOCK(STK_TABLE_LOCK, &shard->lock);
+	ts = __stktable_get_entry(table, shard, key);
 	if (ts)
-		ts->ref_cnt++;
-	HA_SPIN_UNLOCK(STK_TABLE_LOCK, &table->lock);
+		HA_ATOMIC_INC(&ts->ref_cnt);
+	HA_SPIN_UNLOCK(STK_TABLE_LOCK, &shard->lock);
 
 	return ts;
 }
 
 /* Lookup for an entry with the same key and store the submitted
- * stksess if not found.
+ * stksess if not found. The lock of shard <shard>, in charge of the key of
+ * <nts>, must be held.
  */
-struct stksess *__stktable_set_entry(struct stktable *table, struct stksess *nts)
+static struct stksess *__stktable_set_entry(struct stktable *table, struct stktable_shard *shard,
+                                            struct stksess *nts)
 {
 	struct stksess *ts;
 
-	ts = __stktable_lookup(table, nts);
+	ts = __stktable_lookup(table, shard, nts);
 	if (ts == NULL) {
 		ts = nts;
 		__stktable_store(table, ts);
@@ -539,32 +739,43 @@ struct stksess *__stktable_set_entry(struct stktable *table, struct stksess *nts
 }
 
 /* Lookup for an entry with the same key and store the submitted
- * stksess if not found.
- * This function locks the table, and the refcount of the entry is increased.
+ * stksess if not found. The key of <nts> may have been filled by the caller,
+ * so the shard it belongs to is computed again here.
+ * This function locks the key's shard, and the refcount of the entry is increased.
  */
 struct stksess *stktable_set_entry(struct stktable *table, struct stksess *nts)
 {
+	struct stktable_shard *shard;
 	struct stksess *ts;
 
-	HA_SPIN_LOCK(STK_TABLE_LOCK, &table->lock);
-	ts = __stktable_set_entry(table, nts);
-	ts->ref_cnt++;
-	HA_SPIN_UNLOCK(STK_TABLE_LOCK, &table->lock);
+	nts->shard = stksess_shard(table, nts);
+	shard = &table->shards[nts->shard];
+	HA_SPIN_LOCK(STK_TABLE_LOCK, &shard->lock);
+	ts = __stktable_set_entry(table, shard, nts);
+	HA_ATOMIC_INC(&ts->ref_cnt);
+	HA_SPIN_UNLOCK(STK_TABLE_LOCK, &shard->lock);
 
 	return ts;
 }
 /*
- * Trash expired sticky sessions from table <t>. The next expiration date is
- * returned.
+ * Trash expired sticky sessions from shard <shard> of table <t>, visiting at
+ * most <*budget> expired nodes, which is decremented accordingly. The next
+ * expiration date in this shard is returned, which is the current date if the
+ * budget was exhausted before all expired entries were processed.
  */
-static int stktable_trash_expired(struct stktable *t)
+static int stktable_trash_expired_shard(struct stktable *t, struct stktable_shard *shard,
+                                        unsigned int *budget)
 {
 	struct stksess *ts;
 	struct eb32_node *eb;
+	int exp_next = TICK_ETERNITY;
 	int looped = 0;
+	uint64_t start;
+	unsigned int held;
 
-	HA_SPIN_LOCK(STK_TABLE_LOCK, &t->lock);
-	eb = eb32_lookup_ge(&t->exps, now_ms - TIMER_LOOK_BACK);
+	HA_SPIN_LOCK(STK_TABLE_LOCK, &shard->lock);
+	start = now_mono_time();
+	eb = eb32_lookup_ge(&shard->exps, now_ms - TIMER_LOOK_BACK);
 
 	while (1) {
 		if (unlikely(!eb)) {
@@ -576,23 +787,30 @@ static int stktable_trash_expired(struct stktable *t)
 			if (looped)
 				break;
 			looped = 1;
-			eb = eb32_first(&t->exps);
+			eb = eb32_first(&shard->exps);
 			if (likely(!eb))
 				break;
 		}
 
 		if (likely(tick_is_lt(now_ms, eb->key))) {
 			/* timer not expired yet, revisit it later */
-			t->exp_next = eb->key;
-			goto out_unlock;
+			exp_next = eb->key;
+			break;
 		}
 
+		if (!*budget) {
+			/* let the caller yield, more work is pending */
+			exp_next = tick_add(now_ms, 0);
+			break;
+		}
+		(*budget)--;
+
 		/* timer looks expired, detach it from the queue */
 		ts = eb32_entry(eb, struct stksess, exp);
 		eb = eb32_next(eb);
 
 		/* don't delete an entry which is currently referenced */
-		if (ts->ref_cnt)
+		if (HA_ATOMIC_LOAD(&ts->ref_cnt))
 			continue;
 
 		eb32_delete(&ts->exp);
@@ -602,24 +820,68 @@ static int stktable_trash_expired(struct stktable *t)
 				continue;
 
 			ts->exp.key = ts->expire;
-			eb32_insert(&t->exps, &ts->exp);
+			eb32_insert(&shard->exps, &ts->exp);
 
 			if (!eb || eb->key > ts->exp.key)
 				eb = &ts->exp;
 			continue;
 		}
 
-		/* session expired, trash it */
-		ebmb_delete(&ts->key);
-		eb32_delete(&ts->upd);
-		__stksess_free(t, ts);
+		/* session expired, trash it unless a peer just grabbed it */
+		if (!__stksess_kill(t, ts))
+			eb32_insert(&shard->exps, &ts->exp);
+		else
+			t->exp_stats.last++;
+	}
+
+	held = (now_mono_time() - start) / 1000;
+	HA_SPIN_UNLOCK(STK_TABLE_LOCK, &shard->lock);
+
+	if (held > t->exp_stats.lock_last)
+		t->exp_stats.lock_last = held;
+	return exp_next;
+}
+
+/*
+ * Trash expired sticky sessions from table <t>. The next expiration date is
+ * returned. The planned date is reset first so that entries stored into
+ * shards which were already visited still get their date accounted for. At
+ * most STKTABLE_EXPIRE_BATCH expired entries are visited per call. When this
+ * is not enough, the current date is returned so that the task yields and is
+ * called again, starting from the shard where it stopped.
+ */
+static int stktable_trash_expired(struct stktable *t)
+{
+	unsigned int budget = STKTABLE_EXPIRE_BATCH;
+	int exp_next = TICK_ETERNITY;
+	int old_exp;
+	unsigned int i;
+
+	t->exp_stats.last = 0;
+	t->exp_stats.lock_last = 0;
+
+	HA_ATOMIC_STORE(&t->exp_next, TICK_ETERNITY);
+	for (i = 0; i < t->nb_shards; i++) {
+		unsigned int shard = (t->exp_shard + i) % t->nb_shards;
+
+		exp_next = tick_first(exp_next, stktable_trash_expired_shard(t, &t->shards[shard], &budget));
+		if (!budget) {
+			/* the shards not visited yet may hold expired entries */
+			t->exp_shard = shard;
+			exp_next = tick_add(now_ms, 0);
+			break;
+		}
 	}
 
-	/* We have found no task to expire in any tree */
-	t->exp_next = TICK_ETERNITY;
-out_unlock:
-	HA_SPIN_UNLOCK(STK_TABLE_LOCK, &t->lock);
-	return t->exp_next;
+	t->exp_stats.total += t->exp_stats.last;
+	if (t->exp_stats.lock_last > t->exp_stats.lock_max)
+		t->exp_stats.lock_max = t->exp_stats.lock_last;
+
+	old_exp = HA_ATOMIC_LOAD(&t->exp_next);
+	while (!HA_ATOMIC_CAS(&t->exp_next, &old_exp, tick_first(exp_next, old_exp)))
+		__ha_cpu_relax();
+
+	return tick_first(exp_next, old_exp);
 }
 
 /*
@@ -634,21 +896,500 @@ struct task *process_table_expire(struct task *task, void *context, unsigned int
 	return task;
 }
 
+/* Snapshot files start with this magic, followed by the table's key type and
+ * size, the list of stored data types and the date of the dump. Each entry is
+ * then saved as its key, its remaining lifetime and its data in the order of
+ * the list. All numbers are in network byte order.
+ */
+#define STKTABLE_SNAP_MAGIC     "HAPSTKT1"
+#define STKTABLE_SNAP_MAGIC_LEN 8
+
+/* default delay between two snapshots of a table (milliseconds) */
+#define STKTABLE_SNAP_INTERVAL  60000
+
+/* Returns the current wall clock date in milliseconds. */
+static inline unsigned long long stktable_snapshot_date(void)
+{
+	return (unsigned long long)date.tv_sec * 1000 + date.tv_usec / 1000;
+}
+
+/* Appends the header of a snapshot of table <t> to <out>. */
+static void stktable_snapshot_encode_header(struct stktable *t, struct buffer *out)
+{
+	char *p = out->area + out->data;
+	char *nb_fields;
+	unsigned int fields = 0;
+	int type;
+
+	memcpy(p, STKTABLE_SNAP_MAGIC, STKTABLE_SNAP_MAGIC_LEN);
+	p += STKTABLE_SNAP_MAGIC_LEN;
+	write_n32(p, t->type);
+	p += 4;
+	write_n32(p, t->key_size);
+	p += 4;
+
+	nb_fields = p;
+	p += 4;
+	for (type = 0; type < STKTABLE_DATA_TYPES; type++) {
+		if (!t->data_ofs[type])
+			continue;
+		write_n16(p, type);
+		write_n16(p + 2, stktable_data_types[type].std_type);
+		write_n32(p + 4, t->data_arg[type].u);
+		p += 8;
+		fields++;
+	}
+	write_n32(nb_fields, fields);
+
+	write_n64(p, stktable_snapshot_date());
+	p += 8;
+	out->data = p - out->area;
+}
+
+/* Appends entry <ts> of table <t> to <out>. The caller must hold a reference
+ * on <ts> and its read lock.
+ */
+static void stktable_snapshot_encode(struct stktable *t, struct stksess *ts, struct buffer *out)
+{
+	char *p = out->area + out->data;
+	unsigned int len;
+	int type;
+
+	len = (t->type == SMP_T_STR) ? strlen((char *)ts->key.key) : t->key_size;
+	write_n16(p, len);
+	memcpy(p + 2, ts->key.key, len);
+	p += 2 + len;
+	write_n32(p, t->expire ? tick_remain(now_ms, ts->expire) : 0);
+	p += 4;
+
+	for (type = 0; type < STKTABLE_DATA_TYPES; type++) {
+		void *ptr = stktable_data_ptr(t, ts, type);
+
+		if (!ptr)
+			continue;
+
+		switch (stktable_data_types[type].std_type) {
+		case STD_T_SINT:
+			write_n32(p, stktable_data_cast(ptr, std_t_sint));
+			p += 4;
+			break;
+		case STD_T_UINT:
+			write_n32(p, stktable_data_cast(ptr, std_t_uint));
+			p += 4;
+			break;
+		case STD_T_ULL:
+			write_n64(p, stktable_data_cast(ptr, std_t_ull));
+			p += 8;
+			break;
+		case STD_T_FRQP: {
+			struct freq_ctr *frqp = &stktable_data_cast(ptr, std_t_frqp);
+			int age;
+
+			/* the age of the current period, the lowest bit of
+			 * the tick being reserved for the lock. It may have
+			 * been rotated by another thread since the date was
+			 * read.
+			 */
+			age = global_now_ms - (frqp->curr_tick & ~0x1);
+			write_n32(p, MAX(age, 0));
+			write_n32(p + 4, frqp->curr_ctr);
+			write_n32(p + 8, frqp->prev_ctr);
+			p += 12;
+			break;
+		}
+		case STD_T_DICT: {
+			struct dict_entry *de = stktable_data_cast(ptr, std_t_dict);
+
+			len = de ? de->len : 0;
+			write_n16(p, len);
+			if (len)
+				memcpy(p + 2, de->value.key, len);
+			p += 2 + len;
+			break;
+		}
+		}
+	}
+	out->data = p - out->area;
+}
+
+/* Saves all the valid entries of table <t> into its snapshot file. They are
+ * first written into a temporary file which then replaces the previous one,
+ * so that a failed dump never leaves a truncated snapshot behind. Note that
+ * this uses blocking I/O. Returns 1 on success, 0 on failure.
+ */
+int stktable_snapshot_dump(struct stktable *t)
+{
+	struct buffer *path, *out;
+	struct ebmb_node *eb;
+	struct stksess *ts;
+	FILE *f = NULL;
+	int i, ok = 0;
+
+	path = alloc_trash_chunk();
+	out = alloc_trash_chunk();
+	if (!path || !out) {
+		errno = ENOMEM;
+		goto end;
+	}
+
+	chunk_printf(path, "%s.%d.tmp", t->snapshot.file, (int)getpid());
+	f = fopen(path->area, "w");
+	if (!f)
+		goto end;
+
+	stktable_snapshot_encode_header(t, out);
+	if (fwrite(out->area, out->data, 1, f) != 1)
+		goto end;
+
+	for (i = 0; i < t->nb_shards; i++) {
+		struct stktable_shard *shard = &t->shards[i];
+
+		HA_SPIN_LOCK(STK_TABLE_LOCK, &shard->lock);
+		eb = ebmb_first(&shard->keys);
+		while (eb) {
+			ts = ebmb_entry(eb, struct stksess, key);
+			if (t->expire && tick_is_expired(ts->expire, now_ms)) {
+				eb = ebmb_next(eb);
+				continue;
+			}
+
+			/* the reference keeps the entry in the tree while the
+			 * shard is unlocked.
+			 */
+			HA_ATOMIC_INC(&ts->ref_cnt);
+			HA_SPIN_UNLOCK(STK_TABLE_LOCK, &shard->lock);
+
+			out->data = 0;
+			HA_RWLOCK_RDLOCK(STK_SESS_LOCK, &ts->lock);
+			stktable_snapshot_encode(t, ts, out);
+			HA_RWLOCK_RDUNLOCK(STK_SESS_LOCK, &ts->lock);
+			ok = fwrite(out->area, out->data, 1, f) == 1;
+
+			HA_SPIN_LOCK(STK_TABLE_LOCK, &shard->lock);
+			HA_ATOMIC_DEC(&ts->ref_cnt);
+			if (!ok) {
+				HA_SPIN_UNLOCK(STK_TABLE_LOCK, &shard->lock);
+				goto end;
+			}
+			eb = ebmb_next(eb);
+		}
+		HA_SPIN_UNLOCK(STK_TABLE_LOCK, &shard->lock);
+	}
+
+	ok = 0;
+	i = fclose(f);
+	f = NULL;
+	if (i != 0 || rename(path->area, t->snapshot.file) < 0)
+		goto end;
+	ok = 1;
+
+ end:
+	if (!ok) {
+		ha_warning("stick-table '%s': failed to save the entries to '%s' (%s).\n",
+			   t->id, t->snapshot.file, strerror(errno));
+		send_log(NULL, LOG_WARNING, "stick-table '%s': failed to save the entries to '%s' (%s).\n",
+			 t->id, t->snapshot.file, strerror(errno));
+		if (f)
+			fclose(f);
+		if (path && path->data)
+			unlink(path->area);
+	}
+	free_trash_chunk(path);
+	free_trash_chunk(out);
+	return ok;
+}
+
+/* Source of snapshot data, either a file or a memory area */
+struct stktable_snap_src {
+	FILE *f;               /* file to read from, or NULL */
+	const char *area;      /* otherwise, the data left to read */
+	size_t len;            /* and its length */
+};
+
+/* Reads exactly <len> bytes from <src> into <dst>. Returns 1 on success or 0
+ * on error or end of data.
+ */
+static inline int stktable_snapshot_read(struct stktable_snap_src *src, void *dst, size_t len)
+{
+	if (!len)
+		return 1;
+
+	if (src->f)
+		return fread(dst, len, 1, src->f) == 1;
+
+	if (len > src->len)
+		return 0;
+	memcpy(dst, src->area, len);
+	src->area += len;
+	src->len -= len;
+	return 1;
+}
+
+/* Inserts into table <t> the entries of the snapshot read from <src>. The
+ * lifetime of the entries and the periods of their frequency counters are
+ * shifted by the time elapsed since the dump. The data types absent from the
+ * table are skipped, and the entries whose key is already present are left
+ * untouched. If <local> is set, the entries are then reported to the peers as
+ * local updates, otherwise they are only taught during full resyncs so that
+ * they never override fresher remote ones. The number of entries inserted is
+ * stored into <loaded>. Returns 1 if the whole snapshot was valid, or 0 if it
+ * was invalid, truncated or the table got full.
+ */
+static int stktable_snapshot_import(struct stktable *t, struct stktable_snap_src *src,
+                                    int local, unsigned int *loaded)
+{
+	struct {
+		int keep;      /* non-zero if stored in the table */
+		int type;      /* data type */
+		int std_type;  /* its standard type */
+	} fields[STKTABLE_DATA_TYPES];
+	unsigned long long elapsed, snap_date;
+	struct buffer *key = NULL, *val = NULL;
+	unsigned int nb_fields;
+	struct stksess *ts;
+	char hdr[STKTABLE_SNAP_MAGIC_LEN + 12];
+	char num[12];
+	int i, ret = 0;
+
+	*loaded = 0;
+	key = alloc_trash_chunk();
+	val = alloc_trash_chunk();
+	if (!key || !val)
+		goto invalid;
+
+	if (!stktable_snapshot_read(src, hdr, sizeof(hdr)) ||
+	    memcmp(hdr, STKTABLE_SNAP_MAGIC, STKTABLE_SNAP_MAGIC_LEN) != 0 ||
+	    read_n32(hdr + STKTABLE_SNAP_MAGIC_LEN) != t->type ||
+	    (t->type != SMP_T_STR && read_n32(hdr + STKTABLE_SNAP_MAGIC_LEN + 4) != t->key_size))
+		goto invalid;
+
+	nb_fields = read_n32(hdr + STKTABLE_SNAP_MAGIC_LEN + 8);
+	if (nb_fields > STKTABLE_DATA_TYPES)
+		goto invalid;
+
+	for (i = 0; i < nb_fields; i++) {
+		if (!stktable_snapshot_read(src, num, 8))
+			goto invalid;
+
+		fields[i].type = read_n16(num);
+		fields[i].std_type = read_n16(num + 2);
+		if (fields[i].std_type > STD_T_DICT)
+			goto invalid;
+
+		fields[i].keep = fields[i].type < STKTABLE_DATA_TYPES &&
+			t->data_ofs[fields[i].type] &&
+			stktable_data_types[fields[i].type].std_type == fields[i].std_type &&
+			(fields[i].std_type != STD_T_FRQP ||
+			 t->data_arg[fields[i].type].u == read_n32(num + 4));
+	}
+
+	if (!stktable_snapshot_read(src, num, 8))
+		goto invalid;
+	snap_date = read_n64(num);
+	elapsed = stktable_snapshot_date();
+	elapsed = (elapsed > snap_date) ? elapsed - snap_date : 0;
+
+	while (1) {
+		struct stktable_key skey;
+		struct stksess *ets;
+		unsigned int len, exp;
+
+		if (!stktable_snapshot_read(src, num, 2))
+			break; /* end of file */
+
+		len = read_n16(num);
+		if (len > key->size - 1 || (t->type != SMP_T_STR && len != t->key_size) ||
+		    !stktable_snapshot_read(src, key->area, len) ||
+		    !stktable_snapshot_read(src, num, 4))
+			goto invalid;
+
+		key->area[len] = 0;
+		skey.key = key->area;
+		skey.key_len = len;
+		exp = read_n32(num);
+
+		ts = stksess_new(t, &skey);
+		if (!ts)
+			goto invalid; /* table full */
+
+		for (i = 0; i < nb_fields; i++) {
+			void *ptr = fields[i].keep ? stktable_data_ptr(t, ts, fields[i].type) : NULL;
+
+			switch (fields[i].std_type) {
+			case STD_T_SINT:
+				if (!stktable_snapshot_read(src, num, 4))
+					goto invalid_ts;
+				if (ptr)
+					stktable_data_cast(ptr, std_t_sint) = read_n32(num);
+				break;
+			case STD_T_UINT:
+				if (!stktable_snapshot_read(src, num, 4))
+					goto invalid_ts;
+				if (ptr)
+					stktable_data_cast(ptr, std_t_uint) = read_n32(num);
+				break;
+			case STD_T_ULL:
+				if (!stktable_snapshot_read(src, num, 8))
+					goto invalid_ts;
+				if (ptr)
+					stktable_data_cast(ptr, std_t_ull) = read_n64(num);
+				break;
+			case STD_T_FRQP: {
+				struct freq_ctr *frqp;
+				unsigned long long age;
+				unsigned int period;
+
+				if (!stktable_snapshot_read(src, num, 12))
+					goto invalid_ts;
+				if (!ptr)
+					break;
+
+				frqp = &stktable_data_cast(ptr, std_t_frqp);
+				period = t->data_arg[fields[i].type].u;
+				age = read_n32(num) + elapsed;
+				if (age >= 2ULL * period) {
+					/* both periods are over */
+					frqp->curr_tick = global_now_ms & ~0x1;
+					frqp->curr_ctr = frqp->prev_ctr = 0;
+				}
+				else {
+					frqp->curr_tick = (global_now_ms - (unsigned int)age) & ~0x1;
+					frqp->curr_ctr = read_n32(num + 4);
+					frqp->prev_ctr = read_n32(num + 8);
+				}
+				break;
+			}
+			case STD_T_DICT:
+				if (!stktable_snapshot_read(src, num, 2))
+					goto invalid_ts;
+				len = read_n16(num);
+				if (len > val->size - 1 ||
+				    (len && !stktable_snapshot_read(src, val->area, len)))
+					goto invalid_ts;
+				val->area[len] = 0;
+				if (ptr && len)
+					stktable_data_cast(ptr, std_t_dict) = dict_insert(&server_key_dict, val->area);
+				break;
+			}
+		}
+
+		if (t->expire) {
+			if (exp <= elapsed) {
+				stksess_free(t, ts);
+				continue;
+			}
+			exp = MIN(exp - elapsed, t->expire);
+			ts->expire = tick_add(now_ms, MS_TO_TICKS(exp));
+		}
+
+		ets = stktable_set_entry(t, ts);
+		if (ets != ts) {
+			/* duplicate key, keep the first one */
+			stksess_free(t, ts);
+			HA_ATOMIC_DEC(&ets->ref_cnt);
+			continue;
+		}
+		if (local)
+			stktable_touch_local(t, ts, 1);
+		else
+			stktable_touch_remote(t, ts, 1);
+		(*loaded)++;
+	}
+	ret = 1;
+	goto end;
+
+ invalid_ts:
+	stksess_free(t, ts);
+ invalid:
+ end:
+	free_trash_chunk(key);
+	free_trash_chunk(val);
+	return ret;
+}
+
+/* Restores the entries of table <t> saved into its snapshot file, if any.
+ * Problems are only reported as warnings, since a table may always start
+ * empty.
+ */
+static void stktable_snapshot_load(struct stktable *t)
+{
+	struct stktable_snap_src src = { };
+	unsigned int loaded;
+
+	src.f = fopen(t->snapshot.file, "r");
+	if (!src.f) {
+		if (errno != ENOENT)
+			ha_warning("stick-table '%s': cannot open '%s' (%s), starting empty.\n",
+				   t->id, t->snapshot.file, strerror(errno));
+		return;
+	}
+
+	if (!stktable_snapshot_import(t, &src, 0, &loaded))
+		ha_warning("stick-table '%s': '%s' is not a valid snapshot of this table or the table is full, only %u entries restored.\n",
+			   t->id, t->snapshot.file, loaded);
+	fclose(src.f);
+}
+
+/*
+ * Task function periodically saving the entries of a stick table. A pointer
+ * to the task itself is returned since it never dies.
+ */
+struct task *process_table_snapshot(struct task *task, void *context, unsigned int state)
+{
+	struct stktable *t = context;
+
+	/* the master only holds what was loaded at boot */
+	if (master) {
+		task->expire = TICK_ETERNITY;
+		return task;
+	}
+
+	stktable_snapshot_dump(t);
+	task->expire = tick_add(now_ms, MS_TO_TICKS(t->snapshot.interval));
+	return task;
+}
+
 /* Perform minimal stick table intializations, report 0 in case of error, 1 if OK. */
 int stktable_init(struct stktable *t)
 {
 	int peers_retval = 0;
+	int i;
+
 	if (t->size) {
-		t->keys = EB_ROOT_UNIQUE;
-		memset(&t->exps, 0, sizeof(t->exps));
+		if (!t->nb_shards)
+			t->nb_shards = 1;
+		t->shards = calloc(t->nb_shards, sizeof(*t->shards));
+		if (!t->shards)
+			return 0;
+		for (i = 0; i < t->nb_shards; i++) {
+			t->shards[i].keys = EB_ROOT_UNIQUE;
+			memset(&t->shards[i].exps, 0, sizeof(t->shards[i].exps));
+			HA_SPIN_INIT(&t->shards[i].lock);
+		}
 		t->updates = EB_ROOT_UNIQUE;
 		HA_SPIN_INIT(&t->lock);
 
-		t->pool = create_pool("sticktables", sizeof(struct stksess) + round_ptr_size(t->data_size) + t->key_size, MEM_F_SHARED);
+		/* string keys get several size classes, the largest one
+		 * always being the full key size.
+		 */
+		t->nb_key_classes = 1;
+		if (t->type == SMP_T_STR) {
+			while (t->nb_key_classes < STKTABLE_KEY_CLASSES &&
+			       (t->key_size >> t->nb_key_classes) >= STKTABLE_KEY_CLASS_MIN)
+				t->nb_key_classes++;
+		}
+		for (i = 0; i < t->nb_key_classes; i++) {
+			t->key_classes[i].size = t->key_size >> (t->nb_key_classes - 1 - i);
+			t->key_classes[i].pool = create_pool("sticktables",
+			                                     sizeof(struct stksess) + round_ptr_size(t->data_size) + t->key_classes[i].size,
+			                                     MEM_F_SHARED);
+			if (!t->key_classes[i].pool)
+				return 0;
+		}
 
 		t->exp_next = TICK_ETERNITY;
 		if ( t->expire ) {
-			t->exp_task = task_new(MAX_THREADS_MASK);
+			t->exp_task = task_new(task_class_threads(TASK_CLASS_BULK));
 			if (!t->exp_task)
 				return 0;
 			t->exp_task->process = process_table_expire;
@@ -658,7 +1399,20 @@ int stktable_init(struct stktable *t)
 			peers_retval = peers_register_table(t->peers.p, t);
 		}
 
-		return (t->pool != NULL) && !peers_retval;
+		if (t->snapshot.file) {
+			stktable_snapshot_load(t);
+			if (t->snapshot.interval) {
+				t->snapshot.task = task_new(task_class_threads(TASK_CLASS_BULK));
+				if (!t->snapshot.task)
+					return 0;
+				t->snapshot.task->process = process_table_snapshot;
+				t->snapshot.task->context = (void *)t;
+				t->snapshot.task->expire = tick_add(now_ms, MS_TO_TICKS(t->snapshot.interval));
+				task_queue(t->snapshot.task);
+			}
+		}
+
+		return !peers_retval;
 	}
 	return 1;
 }
@@ -744,6 +1498,11 @@ int stktable_alloc_data_type(struct stktable *t, int type, const char *sa)
 	}
 
 	t->data_size      += stktable_type_size(stktable_data_types[type].std_type);
+	/* counters are updated using atomic operations which must not cross a
+	 * cache line, so 64-bit ones are aligned like pointers.
+	 */
+	if (stktable_data_types[type].std_type == STD_T_ULL)
+		t->data_size = round_ptr_size(t->data_size);
 	t->data_ofs[type]  = -t->data_size;
 	return PE_NONE;
 }
@@ -783,6 +1542,7 @@ int parse_stick_table(const char *file, int linenum, char **args,
 	t->type = (unsigned int)-1;
 	t->conf.file = file;
 	t->conf.line = linenum;
+	t->snapshot.interval = STKTABLE_SNAP_INTERVAL;
 
 	while (*args[idx]) {
 		const char *err;
@@ -848,6 +1608,65 @@ int parse_stick_table(const char *file, int linenum, char **args,
 			t->nopurge = 1;
 			idx++;
 		}
+		else if (strcmp(args[idx], "shards") == 0) {
+			idx++;
+			if (!*(args[idx])) {
+				ha_alert("parsing [%s:%d] : %s: missing argument after '%s'.\n",
+					 file, linenum, args[0], args[idx-1]);
+				err_code |= ERR_ALERT | ERR_FATAL;
+				goto out;
+			}
+			val = atoi(args[idx]);
+			if (val < 1 || val > MAX_THREADS) {
+				ha_alert("parsing [%s:%d] : %s: '%s' expects a number of shards between 1 and %d, got '%s'.\n",
+					 file, linenum, args[0], args[idx-1], MAX_THREADS, args[idx]);
+				err_code |= ERR_ALERT | ERR_FATAL;
+				goto out;
+			}
+			t->nb_shards = val;
+			idx++;
+		}
+		else if (strcmp(args[idx], "snapshot") == 0) {
+			idx++;
+			if (!*(args[idx])) {
+				ha_alert("parsing [%s:%d] : %s: missing file name after '%s'.\n",
+					 file, linenum, args[0], args[idx-1]);
+				err_code |= ERR_ALERT | ERR_FATAL;
+				goto out;
+			}
+			free(t->snapshot.file);
+			t->snapshot.file = strdup(args[idx++]);
+		}
+		else if (strcmp(args[idx], "snapshot-interval") == 0) {
+			idx++;
+			if (!*(args[idx])) {
+				ha_alert("parsing [%s:%d] : %s: missing argument after '%s'.\n",
+					 file, linenum, args[0], args[idx-1]);
+				err_code |= ERR_ALERT | ERR_FATAL;
+				goto out;
+			}
+			err = parse_time_err(args[idx], &val, TIME_UNIT_MS);
+			if (err == PARSE_TIME_OVER) {
+				ha_alert("parsing [%s:%d]: %s: timer overflow in argument <%s> to <%s>, maximum value is 2147483647 ms (~24.8 days).\n",
+					 file, linenum, args[0], args[idx], args[idx-1]);
+				err_code |= ERR_ALERT | ERR_FATAL;
+				goto out;
+			}
+			else if (err == PARSE_TIME_UNDER) {
+				ha_alert("parsing [%s:%d]: %s: timer underflow in argument <%s> to <%s>, minimum non-null value is 1 ms.\n",
+					 file, linenum, args[0], args[idx], args[idx-1]);
+				err_code |= ERR_ALERT | ERR_FATAL;
+				goto out;
+			}
+			else if (err) {
+				ha_alert("parsing [%s:%d] : %s: unexpected character '%c' in argument of '%s'.\n",
+					 file, linenum, args[0], *err, args[idx-1]);
+				err_code |= ERR_ALERT | ERR_FATAL;
+				goto out;
+			}
+			t->snapshot.interval = val;
+			idx++;
+		}
 		else if (strcmp(args[idx], "type") == 0) {
 			idx++;
 			if (stktable_parse_type(args, &idx, &t->type, &t->key_size) != 0) {
@@ -2017,16 +2836,12 @@ static enum act_return action_inc_gpc0(struct act_rule *rule, struct proxy *px,
 		ptr1 = stktable_data_ptr(stkctr->table, ts, STKTABLE_DT_GPC0_RATE);
 		ptr2 = stktable_data_ptr(stkctr->table, ts, STKTABLE_DT_GPC0);
 		if (ptr1 || ptr2) {
-			HA_RWLOCK_WRLOCK(STK_SESS_LOCK, &ts->lock);
-
 			if (ptr1)
 				update_freq_ctr_period(&stktable_data_cast(ptr1, gpc0_rate),
 					       stkctr->table->data_arg[STKTABLE_DT_GPC0_RATE].u, 1);
 
 			if (ptr2)
-				stktable_data_cast(ptr2, gpc0)++;
-
-			HA_RWLOCK_WRUNLOCK(STK_SESS_LOCK, &ts->lock);
+				HA_ATOMIC_INC(&stktable_data_cast(ptr2, gpc0));
 
 			/* If data was modified, we need to touch to re-schedule sync */
 			stktable_touch_local(stkctr->table, ts, 0);
@@ -2099,16 +2914,12 @@ static enum act_return action_inc_gpc1(struct act_rule *rule, struct proxy *px,
 		ptr1 = stktable_data_ptr(stkctr->table, ts, STKTABLE_DT_GPC1_RATE);
 		ptr2 = stktable_data_ptr(stkctr->table, ts, STKTABLE_DT_GPC1);
 		if (ptr1 || ptr2) {
-			HA_RWLOCK_WRLOCK(STK_SESS_LOCK, &ts->lock);
-
 			if (ptr1)
 				update_freq_ctr_period(&stktable_data_cast(ptr1, gpc1_rate),
 					       stkctr->table->data_arg[STKTABLE_DT_GPC1_RATE].u, 1);
 
 			if (ptr2)
-				stktable_data_cast(ptr2, gpc1)++;
-
-			HA_RWLOCK_WRUNLOCK(STK_SESS_LOCK, &ts->lock);
+				HA_ATOMIC_INC(&stktable_data_cast(ptr2, gpc1));
 
 			/* If data was modified, we need to touch to re-schedule sync */
 			stktable_touch_local(stkctr->table, ts, 0);
@@ -2211,11 +3022,7 @@ static enum act_return action_set_gpt0(struct act_rule *rule, struct proxy *px,
 			value = (unsigned int)(smp->data.u.sint);
 		}
 
-		HA_RWLOCK_WRLOCK(STK_SESS_LOCK, &ts->lock);
-
-		stktable_data_cast(ptr, gpt0) = value;
-
-		HA_RWLOCK_WRUNLOCK(STK_SESS_LOCK, &ts->lock);
+		HA_ATOMIC_STORE(&stktable_data_cast(ptr, gpt0), value);
 
 		stktable_touch_local(stkctr->table, ts, 0);
 	}
@@ -2492,12 +3299,8 @@ smp_fetch_sc_get_gpt0(const struct arg *args, struct sample *smp, const char *kw
 			return 0; /* parameter not stored */
 		}
 
-		HA_RWLOCK_RDLOCK(STK_SESS_LOCK, &stkctr_entry(stkctr)->lock);
-
 		smp->data.u.sint = stktable_data_cast(ptr, gpt0);
 
-		HA_RWLOCK_RDUNLOCK(STK_SESS_LOCK, &stkctr_entry(stkctr)->lock);
-
 		if (stkctr == &tmpstkctr)
 			stktable_release(stkctr->table, stkctr_entry(stkctr));
 	}
@@ -2533,12 +3336,8 @@ smp_fetch_sc_get_gpc0(const struct arg *args, struct sample *smp, const char *kw
 			return 0; /* parameter not stored */
 		}
 
-		HA_RWLOCK_RDLOCK(STK_SESS_LOCK, &stkctr_entry(stkctr)->lock);
-
 		smp->data.u.sint = stktable_data_cast(ptr, gpc0);
 
-		HA_RWLOCK_RDUNLOCK(STK_SESS_LOCK, &stkctr_entry(stkctr)->lock);
-
 		if (stkctr == &tmpstkctr)
 			stktable_release(stkctr->table, stkctr_entry(stkctr));
 	}
@@ -2574,12 +3373,8 @@ smp_fetch_sc_get_gpc1(const struct arg *args, struct sample *smp, const char *kw
 			return 0; /* parameter not stored */
 		}
 
-		HA_RWLOCK_RDLOCK(STK_SESS_LOCK, &stkctr_entry(stkctr)->lock);
-
 		smp->data.u.sint = stktable_data_cast(ptr, gpc1);
 
-		HA_RWLOCK_RDUNLOCK(STK_SESS_LOCK, &stkctr_entry(stkctr)->lock);
-
 		if (stkctr == &tmpstkctr)
 			stktable_release(stkctr->table, stkctr_entry(stkctr));
 	}
@@ -2614,13 +3409,9 @@ smp_fetch_sc_gpc0_rate(const struct arg *args, struct sample *smp, const char *k
 			return 0; /* parameter not stored */
 		}
 
-		HA_RWLOCK_RDLOCK(STK_SESS_LOCK, &stkctr_entry(stkctr)->lock);
-
 		smp->data.u.sint = read_freq_ctr_period(&stktable_data_cast(ptr, gpc0_rate),
 		                  stkctr->table->data_arg[STKTABLE_DT_GPC0_RATE].u);
 
-		HA_RWLOCK_RDUNLOCK(STK_SESS_LOCK, &stkctr_entry(stkctr)->lock);
-
 		if (stkctr == &tmpstkctr)
 			stktable_release(stkctr->table, stkctr_entry(stkctr));
 	}
@@ -2655,13 +3446,9 @@ smp_fetch_sc_gpc1_rate(const struct arg *args, struct sample *smp, const char *k
 			return 0; /* parameter not stored */
 		}
 
-		HA_RWLOCK_RDLOCK(STK_SESS_LOCK, &stkctr_entry(stkctr)->lock);
-
 		smp->data.u.sint = read_freq_ctr_period(&stktable_data_cast(ptr, gpc1_rate),
 		                  stkctr->table->data_arg[STKTABLE_DT_GPC1_RATE].u);
 
-		HA_RWLOCK_RDUNLOCK(STK_SESS_LOCK, &stkctr_entry(stkctr)->lock);
-
 		if (stkctr == &tmpstkctr)
 			stktable_release(stkctr->table, stkctr_entry(stkctr));
 	}
@@ -2699,18 +3486,12 @@ smp_fetch_sc_inc_gpc0(const struct arg *args, struct sample *smp, const char *kw
 		ptr1 = stktable_data_ptr(stkctr->table, stkctr_entry(stkctr), STKTABLE_DT_GPC0_RATE);
 		ptr2 = stktable_data_ptr(stkctr->table, stkctr_entry(stkctr), STKTABLE_DT_GPC0);
 		if (ptr1 || ptr2) {
-			HA_RWLOCK_WRLOCK(STK_SESS_LOCK, &stkctr_entry(stkctr)->lock);
-
-			if (ptr1) {
-				update_freq_ctr_period(&stktable_data_cast(ptr1, gpc0_rate),
-						       stkctr->table->data_arg[STKTABLE_DT_GPC0_RATE].u, 1);
-				smp->data.u.sint = (&stktable_data_cast(ptr1, gpc0_rate))->curr_ctr;
-			}
+			if (ptr1)
+				smp->data.u.sint = update_freq_ctr_period(&stktable_data_cast(ptr1, gpc0_rate),
+				                                          stkctr->table->data_arg[STKTABLE_DT_GPC0_RATE].u, 1);
 
 			if (ptr2)
-				smp->data.u.sint = ++stktable_data_cast(ptr2, gpc0);
-
-			HA_RWLOCK_WRUNLOCK(STK_SESS_LOCK, &stkctr_entry(stkctr)->lock);
+				smp->data.u.sint = HA_ATOMIC_ADD_FETCH(&stktable_data_cast(ptr2, gpc0), 1);
 
 			/* If data was modified, we need to touch to re-schedule sync */
 			stktable_touch_local(stkctr->table, stkctr_entry(stkctr), (stkctr == &tmpstkctr) ? 1 : 0);
@@ -2752,18 +3533,12 @@ smp_fetch_sc_inc_gpc1(const struct arg *args, struct sample *smp, const char *kw
 		ptr1 = stktable_data_ptr(stkctr->table, stkctr_entry(stkctr), STKTABLE_DT_GPC1_RATE);
 		ptr2 = stktable_data_ptr(stkctr->table, stkctr_entry(stkctr), STKTABLE_DT_GPC1);
 		if (ptr1 || ptr2) {
-			HA_RWLOCK_WRLOCK(STK_SESS_LOCK, &stkctr_entry(stkctr)->lock);
-
-			if (ptr1) {
-				update_freq_ctr_period(&stktable_data_cast(ptr1, gpc1_rate),
-						       stkctr->table->data_arg[STKTABLE_DT_GPC1_RATE].u, 1);
-				smp->data.u.sint = (&stktable_data_cast(ptr1, gpc1_rate))->curr_ctr;
-			}
+			if (ptr1)
+				smp->data.u.sint = update_freq_ctr_period(&stktable_data_cast(ptr1, gpc1_rate),
+				                                          stkctr->table->data_arg[STKTABLE_DT_GPC1_RATE].u, 1);
 
 			if (ptr2)
-				smp->data.u.sint = ++stktable_data_cast(ptr2, gpc1);
-
-			HA_RWLOCK_WRUNLOCK(STK_SESS_LOCK, &stkctr_entry(stkctr)->lock);
+				smp->data.u.sint = HA_ATOMIC_ADD_FETCH(&stktable_data_cast(ptr2, gpc1), 1);
 
 			/* If data was modified, we need to touch to re-schedule sync */
 			stktable_touch_local(stkctr->table, stkctr_entry(stkctr), (stkctr == &tmpstkctr) ? 1 : 0);
@@ -2805,12 +3580,7 @@ smp_fetch_sc_clr_gpc0(const struct arg *args, struct sample *smp, const char *kw
 			return 0; /* parameter not stored */
 		}
 
-		HA_RWLOCK_WRLOCK(STK_SESS_LOCK, &stkctr_entry(stkctr)->lock);
-
-		smp->data.u.sint = stktable_data_cast(ptr, gpc0);
-		stktable_data_cast(ptr, gpc0) = 0;
-
-		HA_RWLOCK_WRUNLOCK(STK_SESS_LOCK, &stkctr_entry(stkctr)->lock);
+		smp->data.u.sint = HA_ATOMIC_XCHG(&stktable_data_cast(ptr, gpc0), 0);
 
 		/* If data was modified, we need to touch to re-schedule sync */
 		stktable_touch_local(stkctr->table, stkctr_entry(stkctr), (stkctr == &tmpstkctr) ? 1 : 0);
@@ -2849,12 +3619,7 @@ smp_fetch_sc_clr_gpc1(const struct arg *args, struct sample *smp, const char *kw
 			return 0; /* parameter not stored */
 		}
 
-		HA_RWLOCK_WRLOCK(STK_SESS_LOCK, &stkctr_entry(stkctr)->lock);
-
-		smp->data.u.sint = stktable_data_cast(ptr, gpc1);
-		stktable_data_cast(ptr, gpc1) = 0;
-
-		HA_RWLOCK_WRUNLOCK(STK_SESS_LOCK, &stkctr_entry(stkctr)->lock);
+		smp->data.u.sint = HA_ATOMIC_XCHG(&stktable_data_cast(ptr, gpc1), 0);
 
 		/* If data was modified, we need to touch to re-schedule sync */
 		stktable_touch_local(stkctr->table, stkctr_entry(stkctr), (stkctr == &tmpstkctr) ? 1 : 0);
@@ -2889,12 +3654,8 @@ smp_fetch_sc_conn_cnt(const struct arg *args, struct sample *smp, const char *kw
 			return 0; /* parameter not stored */
 		}
 
-		HA_RWLOCK_RDLOCK(STK_SESS_LOCK, &stkctr_entry(stkctr)->lock);
-
 		smp->data.u.sint = stktable_data_cast(ptr, conn_cnt);
 
-		HA_RWLOCK_RDUNLOCK(STK_SESS_LOCK, &stkctr_entry(stkctr)->lock);
-
 		if (stkctr == &tmpstkctr)
 			stktable_release(stkctr->table, stkctr_entry(stkctr));
 
@@ -2930,13 +3691,9 @@ smp_fetch_sc_conn_rate(const struct arg *args, struct sample *smp, const char *k
 			return 0; /* parameter not stored */
 		}
 
-		HA_RWLOCK_RDLOCK(STK_SESS_LOCK, &stkctr_entry(stkctr)->lock);
-
 		smp->data.u.sint = read_freq_ctr_period(&stktable_data_cast(ptr, conn_rate),
 					       stkctr->table->data_arg[STKTABLE_DT_CONN_RATE].u);
 
-		HA_RWLOCK_RDUNLOCK(STK_SESS_LOCK, &stkctr_entry(stkctr)->lock);
-
 		if (stkctr == &tmpstkctr)
 			stktable_release(stkctr->table, stkctr_entry(stkctr));
 	}
@@ -2981,11 +3738,7 @@ smp_fetch_src_updt_conn_cnt(const struct arg *args, struct sample *smp, const ch
 
 	smp->data.type = SMP_T_SINT;
 
-	HA_RWLOCK_WRLOCK(STK_SESS_LOCK, &ts->lock);
-
-	smp->data.u.sint = ++stktable_data_cast(ptr, conn_cnt);
-
-	HA_RWLOCK_WRUNLOCK(STK_SESS_LOCK, &ts->lock);
+	smp->data.u.sint = HA_ATOMIC_ADD_FETCH(&stktable_data_cast(ptr, conn_cnt), 1);
 
 	smp->flags = SMP_F_VOL_TEST;
 
@@ -3022,12 +3775,8 @@ smp_fetch_sc_conn_cur(const struct arg *args, struct sample *smp, const char *kw
 			return 0; /* parameter not stored */
 		}
 
-		HA_RWLOCK_RDLOCK(STK_SESS_LOCK, &stkctr_entry(stkctr)->lock);
-
 		smp->data.u.sint = stktable_data_cast(ptr, conn_cur);
 
-		HA_RWLOCK_RDUNLOCK(STK_SESS_LOCK, &stkctr_entry(stkctr)->lock);
-
 		if (stkctr == &tmpstkctr)
 			stktable_release(stkctr->table, stkctr_entry(stkctr));
 	}
@@ -3061,12 +3810,8 @@ smp_fetch_sc_sess_cnt(const struct arg *args, struct sample *smp, const char *kw
 			return 0; /* parameter not stored */
 		}
 
-		HA_RWLOCK_RDLOCK(STK_SESS_LOCK, &stkctr_entry(stkctr)->lock);
-
 		smp->data.u.sint = stktable_data_cast(ptr, sess_cnt);
 
-		HA_RWLOCK_RDUNLOCK(STK_SESS_LOCK, &stkctr_entry(stkctr)->lock);
-
 		if (stkctr == &tmpstkctr)
 			stktable_release(stkctr->table, stkctr_entry(stkctr));
 	}
@@ -3099,13 +3844,9 @@ smp_fetch_sc_sess_rate(const struct arg *args, struct sample *smp, const char *k
 			return 0; /* parameter not stored */
 		}
 
-		HA_RWLOCK_RDLOCK(STK_SESS_LOCK, &stkctr_entry(stkctr)->lock);
-
 		smp->data.u.sint = read_freq_ctr_period(&stktable_data_cast(ptr, sess_rate),
 					       stkctr->table->data_arg[STKTABLE_DT_SESS_RATE].u);
 
-		HA_RWLOCK_RDUNLOCK(STK_SESS_LOCK, &stkctr_entry(stkctr)->lock);
-
 		if (stkctr == &tmpstkctr)
 			stktable_release(stkctr->table, stkctr_entry(stkctr));
 	}
@@ -3139,12 +3880,8 @@ smp_fetch_sc_http_req_cnt(const struct arg *args, struct sample *smp, const char
 			return 0; /* parameter not stored */
 		}
 
-		HA_RWLOCK_RDLOCK(STK_SESS_LOCK, &stkctr_entry(stkctr)->lock);
-
 		smp->data.u.sint = stktable_data_cast(ptr, http_req_cnt);
 
-		HA_RWLOCK_RDUNLOCK(STK_SESS_LOCK, &stkctr_entry(stkctr)->lock);
-
 		if (stkctr == &tmpstkctr)
 			stktable_release(stkctr->table, stkctr_entry(stkctr));
 	}
@@ -3178,13 +3915,9 @@ smp_fetch_sc_http_req_rate(const struct arg *args, struct sample *smp, const cha
 			return 0; /* parameter not stored */
 		}
 
-		HA_RWLOCK_RDLOCK(STK_SESS_LOCK, &stkctr_entry(stkctr)->lock);
-
 		smp->data.u.sint = read_freq_ctr_period(&stktable_data_cast(ptr, http_req_rate),
 					       stkctr->table->data_arg[STKTABLE_DT_HTTP_REQ_RATE].u);
 
-		HA_RWLOCK_RDUNLOCK(STK_SESS_LOCK, &stkctr_entry(stkctr)->lock);
-
 		if (stkctr == &tmpstkctr)
 			stktable_release(stkctr->table, stkctr_entry(stkctr));
 	}
@@ -3218,12 +3951,8 @@ smp_fetch_sc_http_err_cnt(const struct arg *args, struct sample *smp, const char
 			return 0; /* parameter not stored */
 		}
 
-		HA_RWLOCK_RDLOCK(STK_SESS_LOCK, &stkctr_entry(stkctr)->lock);
-
 		smp->data.u.sint = stktable_data_cast(ptr, http_err_cnt);
 
-		HA_RWLOCK_RDUNLOCK(STK_SESS_LOCK, &stkctr_entry(stkctr)->lock);
-
 		if (stkctr == &tmpstkctr)
 			stktable_release(stkctr->table, stkctr_entry(stkctr));
 	}
@@ -3257,13 +3986,9 @@ smp_fetch_sc_http_err_rate(const struct arg *args, struct sample *smp, const cha
 			return 0; /* parameter not stored */
 		}
 
-		HA_RWLOCK_RDLOCK(STK_SESS_LOCK, &stkctr_entry(stkctr)->lock);
-
 		smp->data.u.sint = read_freq_ctr_period(&stktable_data_cast(ptr, http_err_rate),
 					       stkctr->table->data_arg[STKTABLE_DT_HTTP_ERR_RATE].u);
 
-		HA_RWLOCK_RDUNLOCK(STK_SESS_LOCK, &stkctr_entry(stkctr)->lock);
-
 		if (stkctr == &tmpstkctr)
 			stktable_release(stkctr->table, stkctr_entry(stkctr));
 	}
@@ -3297,12 +4022,8 @@ smp_fetch_sc_http_fail_cnt(const struct arg *args, struct sample *smp, const cha
 			return 0; /* parameter not stored */
 		}
 
-		HA_RWLOCK_RDLOCK(STK_SESS_LOCK, &stkctr_entry(stkctr)->lock);
-
 		smp->data.u.sint = stktable_data_cast(ptr, http_fail_cnt);
 
-		HA_RWLOCK_RDUNLOCK(STK_SESS_LOCK, &stkctr_entry(stkctr)->lock);
-
 		if (stkctr == &tmpstkctr)
 			stktable_release(stkctr->table, stkctr_entry(stkctr));
 	}
@@ -3336,13 +4057,9 @@ smp_fetch_sc_http_fail_rate(const struct arg *args, struct sample *smp, const ch
 			return 0; /* parameter not stored */
 		}
 
-		HA_RWLOCK_RDLOCK(STK_SESS_LOCK, &stkctr_entry(stkctr)->lock);
-
 		smp->data.u.sint = read_freq_ctr_period(&stktable_data_cast(ptr, http_fail_rate),
 					       stkctr->table->data_arg[STKTABLE_DT_HTTP_FAIL_RATE].u);
 
-		HA_RWLOCK_RDUNLOCK(STK_SESS_LOCK, &stkctr_entry(stkctr)->lock);
-
 		if (stkctr == &tmpstkctr)
 			stktable_release(stkctr->table, stkctr_entry(stkctr));
 	}
@@ -3376,12 +4093,8 @@ smp_fetch_sc_kbytes_in(const struct arg *args, struct sample *smp, const char *k
 			return 0; /* parameter not stored */
 		}
 
-		HA_RWLOCK_RDLOCK(STK_SESS_LOCK, &stkctr_entry(stkctr)->lock);
-
 		smp->data.u.sint = stktable_data_cast(ptr, bytes_in_cnt) >> 10;
 
-		HA_RWLOCK_RDUNLOCK(STK_SESS_LOCK, &stkctr_entry(stkctr)->lock);
-
 		if (stkctr == &tmpstkctr)
 			stktable_release(stkctr->table, stkctr_entry(stkctr));
 	}
@@ -3415,13 +4128,9 @@ smp_fetch_sc_bytes_in_rate(const struct arg *args, struct sample *smp, const cha
 			return 0; /* parameter not stored */
 		}
 
-		HA_RWLOCK_RDLOCK(STK_SESS_LOCK, &stkctr_entry(stkctr)->lock);
-
 		smp->data.u.sint = read_freq_ctr_period(&stktable_data_cast(ptr, bytes_in_rate),
 					       stkctr->table->data_arg[STKTABLE_DT_BYTES_IN_RATE].u);
 
-		HA_RWLOCK_RDUNLOCK(STK_SESS_LOCK, &stkctr_entry(stkctr)->lock);
-
 		if (stkctr == &tmpstkctr)
 			stktable_release(stkctr->table, stkctr_entry(stkctr));
 	}
@@ -3455,12 +4164,8 @@ smp_fetch_sc_kbytes_out(const struct arg *args, struct sample *smp, const char *
 			return 0; /* parameter not stored */
 		}
 
-		HA_RWLOCK_RDLOCK(STK_SESS_LOCK, &stkctr_entry(stkctr)->lock);
-
 		smp->data.u.sint = stktable_data_cast(ptr, bytes_out_cnt) >> 10;
 
-		HA_RWLOCK_RDUNLOCK(STK_SESS_LOCK, &stkctr_entry(stkctr)->lock);
-
 		if (stkctr == &tmpstkctr)
 			stktable_release(stkctr->table, stkctr_entry(stkctr));
 	}
@@ -3494,13 +4199,9 @@ smp_fetch_sc_bytes_out_rate(const struct arg *args, struct sample *smp, const ch
 			return 0; /* parameter not stored */
 		}
 
-		HA_RWLOCK_RDLOCK(STK_SESS_LOCK, &stkctr_entry(stkctr)->lock);
-
 		smp->data.u.sint = read_freq_ctr_period(&stktable_data_cast(ptr, bytes_out_rate),
 					       stkctr->table->data_arg[STKTABLE_DT_BYTES_OUT_RATE].u);
 
-		HA_RWLOCK_RDUNLOCK(STK_SESS_LOCK, &stkctr_entry(stkctr)->lock);
-
 		if (stkctr == &tmpstkctr)
 			stktable_release(stkctr->table, stkctr_entry(stkctr));
 	}
@@ -3557,9 +4258,16 @@ static int table_dump_head_to_buffer(struct buffer *msg,
 {
 	struct stream *s = si_strm(si);
 
-	chunk_appendf(msg, "# table: %s, type: %s, size:%d, used:%d\n",
+	chunk_appendf(msg, "# table: %s, type: %s, size:%d, used:%d",
 		     t->id, stktable_types[t->type].kw, t->size, t->current);
 
+	/* expiration statistics are only reported in the summary of all tables */
+	if (!target)
+		chunk_appendf(msg, ", exp_last:%u, exp_total:%llu, exp_lock_last:%uus, exp_lock_max:%uus",
+		              t->exp_stats.last, t->exp_stats.total,
+		              t->exp_stats.lock_last, t->exp_stats.lock_max);
+	chunk_appendf(msg, "\n");
+
 	/* any other information should be dumped here */
 
 	if (target && (strm_li(s)->bind_conf->level & ACCESS_LVL_MASK) < ACCESS_LVL_OPER)
@@ -3653,6 +4361,36 @@ static int table_dump_entry_to_buffer(struct buffer *msg,
 	return 1;
 }
 
+/* Dumps the header of a binary snapshot of table <t> to a stream interface's
+ * read buffer. It returns 0 if the output buffer is full and needs to be
+ * called again, otherwise non-zero.
+ */
+static int table_dump_snapshot_head(struct buffer *msg, struct stream_interface *si,
+                                    struct stktable *t)
+{
+	stktable_snapshot_encode_header(t, msg);
+	if (ci_putchk(si_ic(si), msg) == -1) {
+		si_rx_room_blk(si);
+		return 0;
+	}
+	return 1;
+}
+
+/* Dumps entry <entry> of table <t> in the binary snapshot format to a stream
+ * interface's read buffer. The caller must hold the entry's read lock. It
+ * returns 0 if the output buffer is full and needs to be called again,
+ * otherwise non-zero.
+ */
+static int table_dump_snapshot_entry(struct buffer *msg, struct stream_interface *si,
+                                     struct stktable *t, struct stksess *entry)
+{
+	stktable_snapshot_encode(t, entry, msg);
+	if (ci_putchk(si_ic(si), msg) == -1) {
+		si_rx_room_blk(si);
+		return 0;
+	}
+	return 1;
+}
 
 /* Processes a single table entry matching a specific key passed in argument.
  * returns 0 if wants to be called again, 1 if has ended processing.
@@ -3873,6 +4611,7 @@ static int cli_parse_table_req(char **args, char *payload, struct appctx *appctx
 	appctx->ctx.table.target = NULL;
 	appctx->ctx.table.entry = NULL;
 	appctx->ctx.table.action = (long)private; // keyword argument, one of STK_CLI_ACT_*
+	appctx->ctx.table.binary = 0;
 
 	if (*args[2]) {
 		appctx->ctx.table.target = stktable_find_by_name(args[2]);
@@ -3885,6 +4624,18 @@ static int cli_parse_table_req(char **args, char *payload, struct appctx *appctx
 		return 0;
 	}
 
+	if (appctx->ctx.table.action == STK_CLI_ACT_SHOW && strcmp(args[3], "format") == 0) {
+		if (strcmp(args[4], "binary") != 0)
+			return cli_err(appctx, "Only the \"binary\" format is supported\n");
+		if (!cli_has_level(appctx, ACCESS_LVL_OPER))
+			return 1;
+		appctx->ctx.table.binary = 1;
+		/* the filters, if any, follow the format */
+		args += 2;
+		if (strcmp(args[3], "key") == 0)
+			return cli_err(appctx, "The binary format does not support the key filter\n");
+	}
+
 	if (strcmp(args[3], "key") == 0)
 		return table_process_entry_per_key(appctx, args);
 	else if (strncmp(args[3], "data.", 5) == 0)
@@ -3911,10 +4662,34 @@ static int cli_parse_table_req(char **args, char *payload, struct appctx *appctx
  * on the action stored in appctx->private). It returns 0 if the output buffer is
  * full and it needs to be called again, otherwise non-zero.
  */
+/* Returns the first entry of table <t> found in the shards starting at
+ * <*shard>, after having grabbed a reference on it, or NULL if there is none
+ * left. <*shard> is updated to designate the shard holding the entry.
+ */
+static struct stksess *table_dump_first_entry(struct stktable *t, unsigned int *shard)
+{
+	struct stksess *ts = NULL;
+	struct ebmb_node *eb;
+
+	for (; *shard < t->nb_shards; (*shard)++) {
+		HA_SPIN_LOCK(STK_TABLE_LOCK, &t->shards[*shard].lock);
+		eb = ebmb_first(&t->shards[*shard].keys);
+		if (eb) {
+			ts = ebmb_entry(eb, struct stksess, key);
+			HA_ATOMIC_INC(&ts->ref_cnt);
+		}
+		HA_SPIN_UNLOCK(STK_TABLE_LOCK, &t->shards[*shard].lock);
+		if (ts)
+			break;
+	}
+	return ts;
+}
+
 static int cli_io_handler_table(struct appctx *appctx)
 {
 	struct stream_interface *si = appctx->owner;
 	struct stream *s = si_strm(si);
+	struct stktable_shard *shard;
 	struct ebmb_node *eb;
 	int skip_entry;
 	int show = appctx->ctx.table.action == STK_CLI_ACT_SHOW;
@@ -3961,22 +4736,22 @@ static int cli_io_handler_table(struct appctx *appctx)
 			}
 
 			if (appctx->ctx.table.t->size) {
-				if (show && !table_dump_head_to_buffer(&trash, si, appctx->ctx.table.t, appctx->ctx.table.target))
+				if (show && appctx->ctx.table.binary) {
+					if (!table_dump_snapshot_head(&trash, si, appctx->ctx.table.t))
+						return 0;
+				}
+				else if (show && !table_dump_head_to_buffer(&trash, si, appctx->ctx.table.t, appctx->ctx.table.target))
 					return 0;
 
 				if (appctx->ctx.table.target &&
 				    (strm_li(s)->bind_conf->level & ACCESS_LVL_MASK) >= ACCESS_LVL_OPER) {
 					/* dump entries only if table explicitly requested */
-					HA_SPIN_LOCK(STK_TABLE_LOCK, &appctx->ctx.table.t->lock);
-					eb = ebmb_first(&appctx->ctx.table.t->keys);
-					if (eb) {
-						appctx->ctx.table.entry = ebmb_entry(eb, struct stksess, key);
-						appctx->ctx.table.entry->ref_cnt++;
+					appctx->ctx.table.shard = 0;
+					appctx->ctx.table.entry = table_dump_first_entry(appctx->ctx.table.t, &appctx->ctx.table.shard);
+					if (appctx->ctx.table.entry) {
 						appctx->st2 = STAT_ST_LIST;
-						HA_SPIN_UNLOCK(STK_TABLE_LOCK, &appctx->ctx.table.t->lock);
 						break;
 					}
-					HA_SPIN_UNLOCK(STK_TABLE_LOCK, &appctx->ctx.table.t->lock);
 				}
 			}
 			appctx->ctx.table.t = appctx->ctx.table.t->next;
@@ -4037,15 +4812,19 @@ static int cli_io_handler_table(struct appctx *appctx)
 			}
 
 			if (show && !skip_entry &&
-			    !table_dump_entry_to_buffer(&trash, si, appctx->ctx.table.t, appctx->ctx.table.entry)) {
+			    ((appctx->ctx.table.binary &&
+			      !table_dump_snapshot_entry(&trash, si, appctx->ctx.table.t, appctx->ctx.table.entry)) ||
+			     (!appctx->ctx.table.binary &&
+			      !table_dump_entry_to_buffer(&trash, si, appctx->ctx.table.t, appctx->ctx.table.entry)))) {
 				HA_RWLOCK_RDUNLOCK(STK_SESS_LOCK, &appctx->ctx.table.entry->lock);
 				return 0;
 			}
 
 			HA_RWLOCK_RDUNLOCK(STK_SESS_LOCK, &appctx->ctx.table.entry->lock);
 
-			HA_SPIN_LOCK(STK_TABLE_LOCK, &appctx->ctx.table.t->lock);
-			appctx->ctx.table.entry->ref_cnt--;
+			shard = &appctx->ctx.table.t->shards[appctx->ctx.table.shard];
+			HA_SPIN_LOCK(STK_TABLE_LOCK, &shard->lock);
+			HA_ATOMIC_DEC(&appctx->ctx.table.entry->ref_cnt);
 
 			eb = ebmb_next(&appctx->ctx.table.entry->key);
 			if (eb) {
@@ -4055,8 +4834,8 @@ static int cli_io_handler_table(struct appctx *appctx)
 					__stksess_kill_if_expired(appctx->ctx.table.t, old);
 				else if (!skip_entry && !appctx->ctx.table.entry->ref_cnt)
 					__stksess_kill(appctx->ctx.table.t, old);
-				appctx->ctx.table.entry->ref_cnt++;
-				HA_SPIN_UNLOCK(STK_TABLE_LOCK, &appctx->ctx.table.t->lock);
+				HA_ATOMIC_INC(&appctx->ctx.table.entry->ref_cnt);
+				HA_SPIN_UNLOCK(STK_TABLE_LOCK, &shard->lock);
 				break;
 			}
 
@@ -4066,7 +4845,13 @@ static int cli_io_handler_table(struct appctx *appctx)
 			else if (!skip_entry && !appctx->ctx.table.entry->ref_cnt)
 				__stksess_kill(appctx->ctx.table.t, appctx->ctx.table.entry);
 
-			HA_SPIN_UNLOCK(STK_TABLE_LOCK, &appctx->ctx.table.t->lock);
+			HA_SPIN_UNLOCK(STK_TABLE_LOCK, &shard->lock);
+
+			/* continue with the next shard of the same table, if any */
+			appctx->ctx.table.shard++;
+			appctx->ctx.table.entry = table_dump_first_entry(appctx->ctx.table.t, &appctx->ctx.table.shard);
+			if (appctx->ctx.table.entry)
+				break;
 
 			appctx->ctx.table.t = appctx->ctx.table.t->next;
 			appctx->st2 = STAT_ST_INFO;
@@ -4087,6 +4872,60 @@ static void cli_release_show_table(struct appctx *appctx)
 	}
 }
 
+/* Parses "add table <table>" and inserts into the table the entries of the
+ * binary dump passed base64-encoded in the payload. The entries already
+ * present are left untouched, the new ones are propagated to the peers.
+ * Returns 1 as it has always ended processing.
+ */
+static int cli_parse_add_table(char **args, char *payload, struct appctx *appctx, void *private)
+{
+	struct stktable_snap_src src = { };
+	struct stktable *t;
+	struct buffer *bin;
+	unsigned int loaded;
+	char *err = NULL;
+	char *p, *q;
+	int len, ret;
+
+	if (!cli_has_level(appctx, ACCESS_LVL_ADMIN))
+		return 1;
+
+	if (!*args[2])
+		return cli_err(appctx, "Required arguments: <table> and a base64-encoded binary dump as payload\n");
+
+	t = stktable_find_by_name(args[2]);
+	if (!t)
+		return cli_err(appctx, "No such table\n");
+
+	if (!payload || !*payload)
+		return cli_err(appctx, "Missing payload\n");
+
+	/* the encoded dump may be split over several lines */
+	for (p = q = payload; *p; p++) {
+		if (!isspace((unsigned char)*p))
+			*q++ = *p;
+	}
+
+	bin = alloc_trash_chunk();
+	if (!bin)
+		return cli_err(appctx, "Out of memory\n");
+
+	len = base64dec(payload, q - payload, bin->area, bin->size);
+	if (len < 0) {
+		free_trash_chunk(bin);
+		return cli_err(appctx, "Invalid base64 payload\n");
+	}
+
+	src.area = bin->area;
+	src.len = len;
+	ret = stktable_snapshot_import(t, &src, 1, &loaded);
+	free_trash_chunk(bin);
+
+	if (!ret)
+		return cli_dynerr(appctx, memprintf(&err, "Invalid dump or table full, only %u entries added\n", loaded));
+	return cli_dynmsg(appctx, LOG_INFO, memprintf(&err, "%u entries added\n", loaded));
+}
+
 static void stkt_late_init(void)
 {
 	struct sample_fetch *f;
@@ -4098,11 +4937,30 @@ static void stkt_late_init(void)
 
 INITCALL0(STG_INIT, stkt_late_init);
 
+/* saves the tables having a snapshot file when the process quits after a
+ * soft-stop.
+ */
+static void stkt_snapshot_deinit(void)
+{
+	struct stktable *t;
+
+	if (master || (global.mode & MODE_CHECK))
+		return;
+
+	for (t = stktables_list; t; t = t->next) {
+		if (t->snapshot.file)
+			stktable_snapshot_dump(t);
+	}
+}
+
+REGISTER_POST_DEINIT(stkt_snapshot_deinit);
+
 /* register cli keywords */
 static struct cli_kw_list cli_kws = {{ },{
+	{ { "add",   "table", NULL }, "add table <table> <<                     : insert entries from a base64-encoded binary dump",                         cli_parse_add_table, NULL, NULL },
 	{ { "clear", "table", NULL }, "clear table <table> [<filter>]*         : remove an entry from a table (filter: data/key)",                           cli_parse_table_req, cli_io_handler_table, cli_release_show_table, (void *)STK_CLI_ACT_CLR },
 	{ { "set",   "table", NULL }, "set table <table> key <k> [data.* <v>]* : update or create a table entry's data",                                     cli_parse_table_req, cli_io_handler_table, NULL, (void *)STK_CLI_ACT_SET },
-	{ { "show",  "table", NULL }, "show table <table> [<filter>]*          : report table usage stats or dump this table's contents (filter: data/key)", cli_parse_table_req, cli_io_handler_table, cli_release_show_table, (void *)STK_CLI_ACT_SHOW },
+	{ { "show",  "table", NULL }, "show table <table> [<filter>]*          : report table usage stats or dump this table's contents (filter: data/key, format binary)", cli_parse_table_req, cli_io_handler_table, cli_release_show_table, (void *)STK_CLI_ACT_SHOW },
 	{{},}
 }};
 
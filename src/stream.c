@@ -10,11 +10,14 @@
  *
  */
 
+#include <ctype.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include <fcntl.h>
 
 #include <import/ebistree.h>
+#include <import/ebsttree.h>
+#include <import/xxhash.h>
 
 #include <haproxy/acl.h>
 #include <haproxy/action.h>
@@ -42,14 +45,17 @@
 #include <haproxy/htx.h>
 #include <haproxy/istbuf.h>
 #include <haproxy/log.h>
+#include <haproxy/pattern.h>
 #include <haproxy/pipe.h>
 #include <haproxy/pool.h>
 #include <haproxy/proxy.h>
 #include <haproxy/queue.h>
 #include <haproxy/server.h>
 #include <haproxy/resolvers.h>
+#include <haproxy/rmtree.h>
 #include <haproxy/sample.h>
 #include <haproxy/session.h>
+#include <haproxy/sockmap.h>
 #include <haproxy/stats-t.h>
 #include <haproxy/stick_table.h>
 #include <haproxy/stream.h>
@@ -58,11 +64,31 @@
 #include <haproxy/tcp_rules.h>
 #include <haproxy/thread.h>
 #include <haproxy/trace.h>
+#include <haproxy/usdt.h>
 #include <haproxy/vars.h>
 
 
 DECLARE_POOL(pool_head_stream, "stream", sizeof(struct stream));
 DECLARE_POOL(pool_head_uniqueid, "uniqueid", UNIQUEID_LEN);
+DECLARE_STATIC_POOL(pool_head_strm_store, "strm_store", STRM_MAX_STORE * sizeof(struct strm_store));
+
+/* A stream and the front conn_stream it is created for, allocated at once by
+ * cs_new_with_stream() to save one allocation per stream on multiplexed
+ * connections. The area is released once both of them are released.
+ */
+struct strm_cs {
+	struct stream strm;
+	struct conn_stream cs;
+	unsigned int users;     /* 1 for the conn_stream, +1 once the stream is created */
+};
+
+DECLARE_STATIC_POOL(pool_head_strm_cs, "strm_cs", sizeof(struct strm_cs));
+
+/* make sure the stream's hot part keeps its cache footprint, see stream-t.h */
+BUILD_ASSERT(offsetof(struct stream, priority_class) <= STRM_HOT_SIZE,
+	     "the hot part of struct stream exceeds STRM_HOT_SIZE");
+BUILD_ASSERT(sizeof(struct stream) <= STRM_MAX_SIZE,
+	     "struct stream exceeds STRM_MAX_SIZE");
 
 /* incremented by each "show sess" to fix a delimiter between streams */
 unsigned stream_epoch = 0;
@@ -266,6 +292,49 @@ static void strm_trace(enum trace_level level, uint64_t mask, const struct trace
 	}
 }
 
+/* Drops one user of the area <sc>, and releases it if it was the last one */
+static inline void strm_cs_release(struct strm_cs *sc)
+{
+	if (!--sc->users)
+		pool_free(pool_head_strm_cs, sc);
+}
+
+/* Allocates a conn_stream for frontend connection <conn> in the same area as
+ * the stream that stream_create_from_cs() will create for it, and initializes
+ * it like cs_new() does. It must be released using cs_free(). Returns NULL on
+ * allocation failure.
+ */
+struct conn_stream *cs_new_with_stream(struct connection *conn)
+{
+	struct strm_cs *sc;
+
+	sc = pool_alloc(pool_head_strm_cs);
+	if (unlikely(!sc))
+		return NULL;
+
+	sc->users = 1;
+	cs_init(&sc->cs, conn);
+	sc->cs.flags |= CS_FL_WITH_STREAM;
+	return &sc->cs;
+}
+
+/* Releases conn_stream <cs> allocated by cs_new_with_stream(). Its area is
+ * only freed once its stream is released as well. Use cs_free() instead.
+ */
+void cs_free_with_stream(struct conn_stream *cs)
+{
+	strm_cs_release(container_of(cs, struct strm_cs, cs));
+}
+
+/* Releases the area of stream <s>, which may be shared with its conn_stream */
+static inline void stream_release_area(struct stream *s)
+{
+	if (s->flags & SF_WITH_CS)
+		strm_cs_release(container_of(s, struct strm_cs, strm));
+	else
+		pool_free(pool_head_stream, s);
+}
+
 /* Create a new stream for connection <conn>. Return < 0 on error. This is only
  * valid right after the handshake, before the connection's data layer is
  * initialized, because it relies on the session to be in conn->owner. On
@@ -362,7 +431,17 @@ struct stream *stream_new(struct session *sess, enum obj_type *origin, struct bu
 	struct appctx *appctx   = objt_appctx(origin);
 
 	DBG_TRACE_ENTER(STRM_EV_STRM_NEW);
-	if (unlikely((s = pool_alloc(pool_head_stream)) == NULL))
+	if (cs && (cs->flags & CS_FL_WITH_STREAM)) {
+		/* the area was allocated with the conn_stream */
+		struct strm_cs *sc = container_of(cs, struct strm_cs, cs);
+
+		sc->users++;
+		s = &sc->strm;
+		s->flags = SF_WITH_CS;
+	}
+	else if (likely((s = pool_alloc(pool_head_stream)) != NULL))
+		s->flags = 0;
+	else
 		goto out_fail_alloc;
 
 	/* minimum stream initialization required for an embryonic stream is
@@ -371,7 +450,6 @@ struct stream *stream_new(struct session *sess, enum obj_type *origin, struct bu
 	 *  - flags
 	 *  - stick-entry tracking
 	 */
-	s->flags = 0;
 	s->logs.logwait = sess->fe->to_log;
 	s->logs.level = 0;
 	tv_zero(&s->logs.tv_request);
@@ -400,6 +478,7 @@ struct stream *stream_new(struct session *sess, enum obj_type *origin, struct bu
 	 */
 	s->current_rule_list = NULL;
 	s->current_rule = NULL;
+	s->acl_cache = NULL;
 	s->rules_exp = TICK_ETERNITY;
 
 	/* Copy SC counters for the stream. We don't touch refcounts because
@@ -415,6 +494,7 @@ struct stream *stream_new(struct session *sess, enum obj_type *origin, struct bu
 	s->si[1].flags = SI_FL_ISBACK;
 
 	s->stream_epoch = _HA_ATOMIC_LOAD(&stream_epoch);
+	s->cpu_time = 0;
 	s->uniq_id = _HA_ATOMIC_FETCH_ADD(&global.req_count, 1);
 
 	/* OK, we're keeping the stream, so let's properly initialize the stream */
@@ -499,6 +579,7 @@ struct stream *stream_new(struct session *sess, enum obj_type *origin, struct bu
 
 	/* init store persistence */
 	s->store_count = 0;
+	s->store = NULL;
 
 	channel_init(&s->req);
 	s->req.flags |= CF_READ_ATTACHED; /* the producer is already connected */
@@ -578,6 +659,7 @@ struct stream *stream_new(struct session *sess, enum obj_type *origin, struct bu
 	 * stream is fully initialized before calling task_wakeup. So
 	 * the caller must handle the task_wakeup
 	 */
+	HA_USDT(stream_new, s->uniq_id, s, sess->fe->uuid);
 	DBG_TRACE_LEAVE(STRM_EV_STRM_NEW, s);
 	return s;
 
@@ -590,7 +672,8 @@ struct stream *stream_new(struct session *sess, enum obj_type *origin, struct bu
 out_fail_alloc_si1:
 	tasklet_free(s->si[0].wait_event.tasklet);
  out_fail_alloc:
-	pool_free(pool_head_stream, s);
+	if (s)
+		stream_release_area(s);
 	DBG_TRACE_DEVEL("leaving on error", STRM_EV_STRM_NEW|STRM_EV_STRM_ERR);
 	return NULL;
 }
@@ -608,6 +691,8 @@ static void stream_free(struct stream *s)
 	int i;
 
 	DBG_TRACE_POINT(STRM_EV_STRM_FREE, s);
+	HA_USDT(stream_end, s->uniq_id, s, s->be->uuid,
+	        objt_server(s->target) ? __objt_server(s->target)->puid : 0, s->flags);
 
 	/* detach the stream from its own task before even releasing it so
 	 * that walking over a task list never exhibits a dying stream.
@@ -670,6 +755,7 @@ static void stream_free(struct stream *s)
 		stksess_free(s->store[i].table, s->store[i].ts);
 		s->store[i].ts = NULL;
 	}
+	pool_free(pool_head_strm_store, s->store);
 
 	if (s->resolv_ctx.requester) {
 		__decl_thread(struct resolvers *resolvers = s->resolv_ctx.parent->arg.resolv.resolvers);
@@ -705,9 +791,9 @@ static void stream_free(struct stream *s)
 	}
 
 	/* Cleanup all variable contexts. */
-	if (!LIST_ISEMPTY(&s->vars_txn.head))
+	if (!vars_is_empty(&s->vars_txn))
 		vars_prune(&s->vars_txn, s->sess, s);
-	if (!LIST_ISEMPTY(&s->vars_reqres.head))
+	if (!vars_is_empty(&s->vars_reqres))
 		vars_prune(&s->vars_reqres, s->sess, s);
 
 	stream_store_counters(s);
@@ -734,6 +820,14 @@ static void stream_free(struct stream *s)
 	si_release_endpoint(&s->si[1]);
 	si_release_endpoint(&s->si[0]);
 
+	if (s->be->cap & PR_CAP_BE) {
+		unsigned int calls;
+		uint64_t cpu = stream_cpu_time(s, &calls);
+
+		_HA_ATOMIC_ADD(&s->be->be_counters.cpu_time, cpu);
+		_HA_ATOMIC_ADD(&s->be->be_counters.cpu_calls, calls);
+	}
+
 	tasklet_free(s->si[0].wait_event.tasklet);
 	tasklet_free(s->si[1].wait_event.tasklet);
 
@@ -744,7 +838,7 @@ static void stream_free(struct stream *s)
 	}
 
 	sockaddr_free(&s->target_addr);
-	pool_free(pool_head_stream, s);
+	stream_release_area(s);
 
 	/* We may want to free the maximum amount of pools if the proxy is stopping */
 	if (fe && unlikely(fe->disabled)) {
@@ -778,7 +872,7 @@ static int stream_alloc_work_buffer(struct stream *s)
 	if (b_alloc(&s->res.buf))
 		return 1;
 
-	LIST_APPEND(&ti->buffer_wq, &s->buffer_wait.list);
+	b_queue(DB_CRIT_RES, &s->buffer_wait);
 	return 0;
 }
 
@@ -814,17 +908,27 @@ void stream_process_counters(struct stream *s)
 	unsigned long long bytes;
 	int i;
 
+	/* the counters below may also have changed since the last call */
+	counters_touch(&sess->fe->fe_counters.last_upd);
+	counters_touch(&s->be->be_counters.last_upd);
+	if (objt_server(s->target))
+		counters_touch(&__objt_server(s->target)->counters.last_upd);
+	if (sess->listener && sess->listener->counters)
+		counters_touch(&sess->listener->counters->last_upd);
+
 	bytes = s->req.total - s->logs.bytes_in;
 	s->logs.bytes_in = s->req.total;
 	if (bytes) {
-		_HA_ATOMIC_ADD(&sess->fe->fe_counters.bytes_in, bytes);
-		_HA_ATOMIC_ADD(&s->be->be_counters.bytes_in,    bytes);
+		counters_add(sess->fe->fe_counters.shards, THR_CTR_BYTES_IN, &sess->fe->fe_counters.bytes_in, bytes);
+		counters_add(s->be->be_counters.shards,    THR_CTR_BYTES_IN, &s->be->be_counters.bytes_in,    bytes);
 
 		if (objt_server(s->target))
-			_HA_ATOMIC_ADD(&objt_server(s->target)->counters.bytes_in, bytes);
+			counters_add(__objt_server(s->target)->counters.shards, THR_CTR_BYTES_IN,
+				     &__objt_server(s->target)->counters.bytes_in, bytes);
 
 		if (sess->listener && sess->listener->counters)
-			_HA_ATOMIC_ADD(&sess->listener->counters->bytes_in, bytes);
+			counters_add(sess->listener->counters->shards, THR_CTR_BYTES_IN,
+				     &sess->listener->counters->bytes_in, bytes);
 
 		for (i = 0; i < MAX_SESS_STKCTR; i++) {
 			if (!stkctr_inc_bytes_in_ctr(&s->stkctr[i], bytes))
@@ -835,14 +939,16 @@ void stream_process_counters(struct stream *s)
 	bytes = s->res.total - s->logs.bytes_out;
 	s->logs.bytes_out = s->res.total;
 	if (bytes) {
-		_HA_ATOMIC_ADD(&sess->fe->fe_counters.bytes_out, bytes);
-		_HA_ATOMIC_ADD(&s->be->be_counters.bytes_out,    bytes);
+		counters_add(sess->fe->fe_counters.shards, THR_CTR_BYTES_OUT, &sess->fe->fe_counters.bytes_out, bytes);
+		counters_add(s->be->be_counters.shards,    THR_CTR_BYTES_OUT, &s->be->be_counters.bytes_out,    bytes);
 
 		if (objt_server(s->target))
-			_HA_ATOMIC_ADD(&objt_server(s->target)->counters.bytes_out, bytes);
+			counters_add(__objt_server(s->target)->counters.shards, THR_CTR_BYTES_OUT,
+				     &__objt_server(s->target)->counters.bytes_out, bytes);
 
 		if (sess->listener && sess->listener->counters)
-			_HA_ATOMIC_ADD(&sess->listener->counters->bytes_out, bytes);
+			counters_add(sess->listener->counters->shards, THR_CTR_BYTES_OUT,
+				     &sess->listener->counters->bytes_out, bytes);
 
 		for (i = 0; i < MAX_SESS_STKCTR; i++) {
 			if (!stkctr_inc_bytes_out_ctr(&s->stkctr[i], bytes))
@@ -1041,6 +1147,76 @@ enum act_return process_use_service(struct act_rule *rule, struct proxy *px,
 	return ACT_RET_STOP;
 }
 
+/* Per-thread cache of the backends resolved by the dynamic switching rules,
+ * indexed on a hash of their name.
+ */
+static THREAD_LOCAL struct proxy *switching_be_cache[SWITCHING_BE_CACHE_SIZE];
+
+/* Returns the backend named <name> of length <len>, or NULL if not found. It is
+ * the same as proxy_be_by_name() except that the recently used names are
+ * looked up in the thread's cache first.
+ */
+static inline struct proxy *switching_be_by_name(const char *name, size_t len)
+{
+	struct proxy **ent;
+	struct proxy *be;
+
+	if (*name == '#')
+		return proxy_be_by_name(name);
+
+	ent = &switching_be_cache[XXH3(name, len, 0) & (SWITCHING_BE_CACHE_SIZE - 1)];
+	be = *ent;
+	if (be && strcmp(be->id, name) == 0)
+		return be;
+
+	be = proxy_be_by_name(name);
+	if (be)
+		*ent = be;
+	return be;
+}
+
+/* Looks up the values of the Host header of the request of stream <s> in index
+ * <idx> of a run of switching rules, and sets <match> to the first rule of the
+ * run matching any of them, or NULL if none matches. Returns 0 on memory
+ * allocation error, otherwise non-zero.
+ */
+static int switching_idx_lookup(struct switching_idx *idx, struct stream *s, struct switching_rule **match)
+{
+	struct switching_rule *best = NULL;
+	struct ebmb_node *node;
+	struct buffer *tmp;
+	struct sample smp;
+	size_t i;
+
+	tmp = alloc_trash_chunk();
+	if (!tmp)
+		return 0;
+
+	memset(&smp, 0, sizeof(smp));
+	while (sample_process(s->sess->fe, s->sess, s, SMP_OPT_DIR_REQ|SMP_OPT_FINAL|SMP_OPT_ITERATE, idx->smp, &smp)) {
+		if (smp.data.type == SMP_T_STR && smp.data.u.str.data < tmp->size) {
+			for (i = 0; i < smp.data.u.str.data; i++)
+				tmp->area[i] = tolower((unsigned char)smp.data.u.str.area[i]);
+			tmp->area[i] = 0;
+
+			node = ebst_lookup(&idx->hosts, tmp->area);
+			if (node) {
+				struct switching_rule *rule = container_of(node, struct switching_host, node)->rule;
+
+				if (!best || rule->rank < best->rank)
+					best = rule;
+			}
+		}
+
+		if (!(smp.flags & SMP_F_NOT_LAST) || (best && !best->rank))
+			break;
+	}
+
+	free_trash_chunk(tmp);
+	*match = best;
+	return 1;
+}
+
 /* This stream analyser checks the switching rules and changes the backend
  * if appropriate. The default_backend rule is also considered, then the
  * target backend's forced persistence rules are also evaluated last if any.
@@ -1065,7 +1241,20 @@ static int process_switching_rules(struct stream *s, struct channel *req, int an
 		list_for_each_entry(rule, &fe->switching_rules, list) {
 			int ret = 1;
 
-			if (rule->cond) {
+			if (rule->idx && rule->idx->rev == HA_ATOMIC_LOAD(&pat_ref_indexed_rev)) {
+				/* a single lookup tells which rule of the run matches */
+				struct switching_rule *match;
+
+				if (!switching_idx_lookup(rule->idx, s, &match))
+					goto sw_failed;
+
+				if (!match) {
+					rule = rule->idx->last;
+					continue;
+				}
+				rule = match;
+			}
+			else if (rule->cond) {
 				ret = acl_exec_cond(rule->cond, fe, sess, s, SMP_OPT_DIR_REQ|SMP_OPT_FINAL);
 				ret = acl_pass(ret);
 				if (rule->cond->pol == ACL_COND_UNLESS)
@@ -1081,13 +1270,15 @@ static int process_switching_rules(struct stream *s, struct channel *req, int an
 
 				if (rule->dynamic) {
 					struct buffer *tmp;
+					int len;
 
 					tmp = alloc_trash_chunk();
 					if (!tmp)
 						goto sw_failed;
 
-					if (build_logline(s, tmp->area, tmp->size, &rule->be.expr))
-						backend = proxy_be_by_name(tmp->area);
+					len = build_logline(s, tmp->area, tmp->size, &rule->be.expr);
+					if (len)
+						backend = switching_be_by_name(tmp->area, len);
 
 					free_trash_chunk(tmp);
 					tmp = NULL;
@@ -1258,13 +1449,9 @@ static inline void sticking_rule_find_target(struct stream *s,
 				goto found;
 			}
 		} else if (t->server_key_type == STKTABLE_SRV_ADDR) {
-			HA_RWLOCK_RDLOCK(PROXY_LOCK, &px->lock);
-			node = ebis_lookup(&px->used_server_addr, de->value.key);
-			HA_RWLOCK_RDUNLOCK(PROXY_LOCK, &px->lock);
-			if (node) {
-				srv = container_of(node, struct server, addr_node);
+			srv = rmtree_lookup(&px->used_server_addr, de->value.key);
+			if (srv)
 				goto found;
-			}
 		}
 	}
 
@@ -1286,6 +1473,27 @@ static inline void sticking_rule_find_target(struct stream *s,
 	}
 }
 
+/* Adds an entry for key <key> in table <t> to the stickiness values stream <s>
+ * will store once the server is known. The entries are allocated on first use.
+ * Nothing is done if all entries are already used or on memory shortage.
+ */
+static void stream_add_store(struct stream *s, struct stktable *t, struct stktable_key *key)
+{
+	struct stksess *ts;
+
+	if (s->store_count >= STRM_MAX_STORE)
+		return;
+
+	if (!s->store && (s->store = pool_alloc(pool_head_strm_store)) == NULL)
+		return;
+
+	ts = stksess_new(t, key);
+	if (ts) {
+		s->store[s->store_count].table = t;
+		s->store[s->store_count++].ts = ts;
+	}
+}
+
 /* This stream analyser works on a request. It applies all sticking rules on
  * it then returns 1. The data must already be present in the buffer otherwise
  * they won't match. It always returns 1.
@@ -1342,17 +1550,8 @@ static int process_sticking_rules(struct stream *s, struct channel *req, int an_
 					stktable_touch_local(rule->table.t, ts, 1);
 				}
 			}
-			if (rule->flags & STK_IS_STORE) {
-				if (s->store_count < (sizeof(s->store) / sizeof(s->store[0]))) {
-					struct stksess *ts;
-
-					ts = stksess_new(rule->table.t, key);
-					if (ts) {
-						s->store[s->store_count].table = rule->table.t;
-						s->store[s->store_count++].ts = ts;
-					}
-				}
-			}
+			if (rule->flags & STK_IS_STORE)
+				stream_add_store(s, rule->table.t, key);
 		}
 	}
 
@@ -1414,15 +1613,7 @@ static int process_store_rules(struct stream *s, struct channel *rep, int an_bit
 			if (!key)
 				continue;
 
-			if (s->store_count < (sizeof(s->store) / sizeof(s->store[0]))) {
-				struct stksess *ts;
-
-				ts = stksess_new(rule->table.t, key);
-				if (ts) {
-					s->store[s->store_count].table = rule->table.t;
-					s->store[s->store_count++].ts = ts;
-				}
-			}
+			stream_add_store(s, rule->table.t, key);
 		}
 	}
 
@@ -1573,6 +1764,8 @@ int stream_set_http_mode(struct stream *s, const struct mux_proto_list *mux_prot
 				if (!fun((strm), (chn), (flag), ##__VA_ARGS__))	\
 					break;					\
 			}							\
+			HA_USDT(ana_done, (strm)->uniq_id, (strm),		\
+				(chn) == &(strm)->res, (flag));			\
 			UPDATE_ANALYSERS((chn)->analysers, (list),		\
 					 (back), (flag));			\
 		}								\
@@ -1583,11 +1776,133 @@ int stream_set_http_mode(struct stream *s, const struct mux_proto_list *mux_prot
 		if ((list) & (flag)) {					\
 			if (!fun((strm), (chn), (flag), ##__VA_ARGS__))	\
 				break;					\
+			HA_USDT(ana_done, (strm)->uniq_id, (strm),	\
+				(chn) == &(strm)->res, (flag));		\
 			UPDATE_ANALYSERS((chn)->analysers, (list),	\
 					 (back), (flag));		\
 		}							\
 	}
 
+#ifdef USE_SOCKMAP
+/* Returns the FD of the plain TCP socket attached to stream interface <si>,
+ * provided it is still open, otherwise -1. If <fresh> is non-zero, the socket
+ * must also not have been shut nor have reported any error.
+ */
+static int stream_sockmap_fd(const struct stream_interface *si, int fresh)
+{
+	const struct conn_stream *cs = objt_cs(si->end);
+	const struct connection *conn = cs ? cs->conn : NULL;
+
+	if (!conn || !conn_ctrl_ready(conn) ||
+	    conn->xprt != xprt_get(XPRT_RAW) ||
+	    conn->ctrl->ctrl_type != SOCK_STREAM ||
+	    (conn->ctrl->fam->sock_family != AF_INET &&
+	     conn->ctrl->fam->sock_family != AF_INET6))
+		return -1;
+
+	if (fresh && (conn->flags & (CO_FL_WAIT_XPRT|CO_FL_ERROR|CO_FL_SOCK_RD_SH|CO_FL_SOCK_WR_SH)))
+		return -1;
+	return conn->handle.fd;
+}
+
+/* Tries to let the kernel forward the data in both directions between the two
+ * sockets of stream <s>. This is only possible once nothing remains to be
+ * analysed nor buffered on either side, and everything else is to be forwarded
+ * as-is. Sets SF_SOCKMAP on success.
+ */
+static void stream_sockmap_link(struct stream *s)
+{
+	struct channel *req = &s->req;
+	struct channel *res = &s->res;
+	int fd_f, fd_b;
+
+	if (!sockmap_ready || IS_HTX_STRM(s) ||
+	    req->analysers || res->analysers ||
+	    req->to_forward != CHN_INFINITE_FORWARD ||
+	    res->to_forward != CHN_INFINITE_FORWARD ||
+	    !(req->flags & res->flags & CF_AUTO_CLOSE) ||
+	    ((req->flags | res->flags) & (CF_MASK_STATIC|CF_READ_ERROR|CF_WRITE_ERROR)) ||
+	    !channel_is_empty(req) || !channel_is_empty(res) ||
+	    ci_data(req) || ci_data(res) || req->pipe || res->pipe ||
+	    s->si[0].state != SI_ST_EST || s->si[1].state != SI_ST_EST)
+		return;
+
+	fd_f = stream_sockmap_fd(&s->si[0], 1);
+	fd_b = stream_sockmap_fd(&s->si[1], 1);
+	if (fd_f < 0 || fd_b < 0)
+		return;
+
+	if (sockmap_link(fd_f, fd_b) < 0)
+		return;
+
+	/* shutdowns must not be forwarded before the kernel is done with the
+	 * data, see stream_sockmap_hold().
+	 */
+	req->flags &= ~CF_AUTO_CLOSE;
+	res->flags &= ~CF_AUTO_CLOSE;
+	s->flags |= SF_SOCKMAP;
+}
+
+/* Accounts the data the kernel forwarded on behalf of stream <s> since the last
+ * call, and refreshes the read timeouts of the channels which saw some activity.
+ * This must also be called before one side is closed so that the last bytes it
+ * received are accounted as well.
+ */
+void stream_sockmap_sync(struct stream *s)
+{
+	struct channel *req = &s->req;
+	struct channel *res = &s->res;
+	long long ret;
+	int fd;
+
+	fd = stream_sockmap_fd(&s->si[0], 0);
+	if (fd >= 0 && (ret = sockmap_take_rcvd(fd)) > 0) {
+		req->total += ret;
+		if (!(req->flags & CF_SHUTR))
+			req->rex = tick_add_ifset(now_ms, req->rto);
+	}
+
+	fd = stream_sockmap_fd(&s->si[1], 0);
+	if (fd >= 0 && (ret = sockmap_take_rcvd(fd)) > 0) {
+		res->total += ret;
+		if (!(res->flags & CF_SHUTR))
+			res->rex = tick_add_ifset(now_ms, res->rto);
+	}
+}
+
+/* Returns non-zero if the shutdown of channel <chn> of stream <s>, whose
+ * CF_AUTO_CLOSE flag was removed when linking the sockets, must not be
+ * forwarded yet because the kernel still has data to write on the consumer's
+ * side. The wait is bounded by the channel's write timeout, which is tracked
+ * in its analyse_exp since there are no analysers anymore, and task <t> is
+ * scheduled to check again shortly.
+ */
+static int stream_sockmap_hold(struct stream *s, struct channel *chn, struct task *t)
+{
+	int fd;
+
+	if (!(s->flags & SF_SOCKMAP) || (chn->flags & (CF_READ_ERROR|CF_WRITE_ERROR)))
+		goto release;
+
+	fd = stream_sockmap_fd(chn_cons(chn), 0);
+	if (fd < 0 || sockmap_pending(fd) <= 0)
+		goto release;
+
+	if (!tick_isset(chn->analyse_exp))
+		chn->analyse_exp = tick_add_ifset(now_ms, chn->wto);
+	else if (tick_is_expired(chn->analyse_exp, now_ms))
+		goto release;
+
+	/* any earlier date is already expired */
+	t->expire = tick_add(now_ms, 1);
+	return 1;
+
+ release:
+	chn->analyse_exp = TICK_ETERNITY;
+	return 0;
+}
+#endif /* USE_SOCKMAP */
+
 /* Processes the client, server, request and response jobs of a stream task,
  * then puts it back to the wait queue in a clean state, or cleans up its
  * resources if it must be deleted. Returns in <next> the date the task wants
@@ -1623,6 +1938,11 @@ struct task *process_stream(struct task *t, void *context, unsigned int state)
 	si_sync_recv(si_f);
 	si_sync_recv(si_b);
 
+#ifdef USE_SOCKMAP
+	if (s->flags & SF_SOCKMAP)
+		stream_sockmap_sync(s);
+#endif
+
 	rate = update_freq_ctr(&s->call_rate, 1);
 	if (rate >= 100000 && s->call_rate.prev_ctr) { // make sure to wait at least a full second
 		stream_dump_and_crash(&s->obj_type, read_freq_ctr(&s->call_rate));
@@ -1847,7 +2167,8 @@ struct task *process_stream(struct task *t, void *context, unsigned int state)
 			 */
 			channel_auto_read(req);
 			channel_auto_connect(req);
-			channel_auto_close(req);
+			if (!(s->flags & SF_SOCKMAP))
+				channel_auto_close(req);
 
 			/* We will call all analysers for which a bit is set in
 			 * req->analysers, following the bit order from LSB
@@ -1947,7 +2268,8 @@ struct task *process_stream(struct task *t, void *context, unsigned int state)
 			 * in similar conditions.
 			 */
 			channel_auto_read(res);
-			channel_auto_close(res);
+			if (!(s->flags & SF_SOCKMAP))
+				channel_auto_close(res);
 
 			/* We will call all analysers for which a bit is set in
 			 * res->analysers, following the bit order from LSB
@@ -2150,9 +2472,9 @@ struct task *process_stream(struct task *t, void *context, unsigned int state)
 	if (!(req->flags & (CF_KERN_SPLICING|CF_SHUTR)) &&
 	    req->to_forward &&
 	    (global.tune.options & GTUNE_USE_SPLICE) &&
-	    (objt_cs(si_f->end) && __objt_cs(si_f->end)->conn->xprt && __objt_cs(si_f->end)->conn->xprt->rcv_pipe &&
+	    (objt_cs(si_f->end) && conn_xprt_may_rcv_pipe(__objt_cs(si_f->end)->conn) &&
 	     __objt_cs(si_f->end)->conn->mux && __objt_cs(si_f->end)->conn->mux->rcv_pipe) &&
-	    (objt_cs(si_b->end) && __objt_cs(si_b->end)->conn->xprt && __objt_cs(si_b->end)->conn->xprt->snd_pipe &&
+	    (objt_cs(si_b->end) && conn_xprt_may_snd_pipe(__objt_cs(si_b->end)->conn) &&
 	     __objt_cs(si_b->end)->conn->mux && __objt_cs(si_b->end)->conn->mux->snd_pipe) &&
 	    (pipes_used < global.maxpipes) &&
 	    (((sess->fe->options2|s->be->options2) & PR_O2_SPLIC_REQ) ||
@@ -2178,7 +2500,7 @@ struct task *process_stream(struct task *t, void *context, unsigned int state)
 				 */
 				si_b->state = SI_ST_REQ; /* new connection requested */
 				si_b->conn_retries = s->be->conn_retries;
-				if ((s->be->retry_type &~ PR_RE_CONN_FAILED) &&
+				if (((s->be->retry_type &~ PR_RE_CONN_FAILED) || tick_isset(s->be->timeout.hedge)) &&
 				    (s->be->mode == PR_MODE_HTTP) &&
 				    !(si_b->flags & SI_FL_D_L7_RETRY))
 					si_b->flags |= SI_FL_L7_RETRY;
@@ -2199,7 +2521,7 @@ struct task *process_stream(struct task *t, void *context, unsigned int state)
 	if (si_state_in(si_b->state, SI_SB_REQ|SI_SB_QUE|SI_SB_TAR|SI_SB_ASS)) {
 		/* prune the request variables and swap to the response variables. */
 		if (s->vars_reqres.scope != SCOPE_RES) {
-			if (!LIST_ISEMPTY(&s->vars_reqres.head))
+			if (!vars_is_empty(&s->vars_reqres))
 				vars_prune(&s->vars_reqres, s->sess, s);
 			vars_init(&s->vars_reqres, SCOPE_RES);
 		}
@@ -2242,6 +2564,13 @@ struct task *process_stream(struct task *t, void *context, unsigned int state)
 	 * once the server has begun to respond. If a half-closed timeout is set, we adjust
 	 * the other side's timeout as well.
 	 */
+#ifdef USE_SOCKMAP
+	/* with sockmap, the shutdown is only forwarded once the kernel is done */
+	if (unlikely((req->flags & (CF_SHUTW|CF_SHUTW_NOW|CF_AUTO_CLOSE|CF_SHUTR)) == CF_SHUTR) &&
+	    (s->flags & SF_SOCKMAP) && !stream_sockmap_hold(s, req, t))
+		req->flags |= CF_AUTO_CLOSE;
+#endif
+
 	if (unlikely((req->flags & (CF_SHUTW|CF_SHUTW_NOW|CF_AUTO_CLOSE|CF_SHUTR)) ==
 		     (CF_AUTO_CLOSE|CF_SHUTR))) {
 		channel_shutw_now(req);
@@ -2343,9 +2672,9 @@ struct task *process_stream(struct task *t, void *context, unsigned int state)
 	if (!(res->flags & (CF_KERN_SPLICING|CF_SHUTR)) &&
 	    res->to_forward &&
 	    (global.tune.options & GTUNE_USE_SPLICE) &&
-	    (objt_cs(si_f->end) && __objt_cs(si_f->end)->conn->xprt && __objt_cs(si_f->end)->conn->xprt->snd_pipe &&
+	    (objt_cs(si_f->end) && conn_xprt_may_snd_pipe(__objt_cs(si_f->end)->conn) &&
 	     __objt_cs(si_f->end)->conn->mux && __objt_cs(si_f->end)->conn->mux->snd_pipe) &&
-	    (objt_cs(si_b->end) && __objt_cs(si_b->end)->conn->xprt && __objt_cs(si_b->end)->conn->xprt->rcv_pipe &&
+	    (objt_cs(si_b->end) && conn_xprt_may_rcv_pipe(__objt_cs(si_b->end)->conn) &&
 	     __objt_cs(si_b->end)->conn->mux && __objt_cs(si_b->end)->conn->mux->rcv_pipe) &&
 	    (pipes_used < global.maxpipes) &&
 	    (((sess->fe->options2|s->be->options2) & PR_O2_SPLIC_RTR) ||
@@ -2354,6 +2683,13 @@ struct task *process_stream(struct task *t, void *context, unsigned int state)
 		res->flags |= CF_KERN_SPLICING;
 	}
 
+#ifdef USE_SOCKMAP
+	/* check if the kernel may now forward the data in both directions */
+	if (unlikely((sess->fe->options2|s->be->options2) & PR_O2_SOCKMAP) &&
+	    !(s->flags & SF_SOCKMAP))
+		stream_sockmap_link(s);
+#endif
+
 	/* reflect what the L7 analysers have seen last */
 	rpf_last = res->flags;
 
@@ -2369,6 +2705,13 @@ struct task *process_stream(struct task *t, void *context, unsigned int state)
 	 */
 
 	/* first, let's check if the response buffer needs to shutdown(write) */
+#ifdef USE_SOCKMAP
+	/* with sockmap, the shutdown is only forwarded once the kernel is done */
+	if (unlikely((res->flags & (CF_SHUTW|CF_SHUTW_NOW|CF_AUTO_CLOSE|CF_SHUTR)) == CF_SHUTR) &&
+	    (s->flags & SF_SOCKMAP) && !stream_sockmap_hold(s, res, t))
+		res->flags |= CF_AUTO_CLOSE;
+#endif
+
 	if (unlikely((res->flags & (CF_SHUTW|CF_SHUTW_NOW|CF_AUTO_CLOSE|CF_SHUTR)) ==
 		     (CF_AUTO_CLOSE|CF_SHUTR))) {
 		channel_shutw_now(res);
@@ -2452,7 +2795,7 @@ struct task *process_stream(struct task *t, void *context, unsigned int state)
 		 * request timeout is set and the server has not yet sent a response.
 		 */
 
-		if ((res->flags & (CF_AUTO_CLOSE|CF_SHUTR)) == 0 &&
+		if ((res->flags & (CF_AUTO_CLOSE|CF_SHUTR)) == 0 && !(s->flags & SF_SOCKMAP) &&
 		    (tick_isset(req->wex) || tick_isset(res->rex))) {
 			req->flags |= CF_READ_NOEXP;
 			req->rex = TICK_ETERNITY;
@@ -2466,7 +2809,7 @@ struct task *process_stream(struct task *t, void *context, unsigned int state)
 		t->expire = tick_first((tick_is_expired(t->expire, now_ms) ? 0 : t->expire),
 				       tick_first(tick_first(req->rex, req->wex),
 						  tick_first(res->rex, res->wex)));
-		if (!req->analysers)
+		if (!req->analysers && !(s->flags & SF_SOCKMAP))
 			req->analyse_exp = TICK_ETERNITY;
 
 		if ((sess->fe->options & PR_O_CONTSTATS) && (s->flags & SF_BE_ASSIGNED) &&
@@ -2522,7 +2865,7 @@ struct task *process_stream(struct task *t, void *context, unsigned int state)
 			if ((s->flags & SF_BE_ASSIGNED) &&
 			    (s->be->mode == PR_MODE_HTTP)) {
 				_HA_ATOMIC_INC(&s->be->be_counters.p.http.rsp[n]);
-				_HA_ATOMIC_INC(&s->be->be_counters.p.http.cum_req);
+				counters_add(s->be->be_counters.shards, THR_CTR_CUM_REQ, &s->be->be_counters.p.http.cum_req, 1);
 			}
 		}
 
@@ -2545,6 +2888,23 @@ struct task *process_stream(struct task *t, void *context, unsigned int state)
 	return NULL;
 }
 
+/* Returns the CPU time in nanoseconds spent processing stream <s> so far, and
+ * sets <calls> to the number of calls this represents. This covers the
+ * stream's task, its I/O callbacks, and the mux and transport layers of its
+ * connections as long as they are not multiplexed. Except for the number of
+ * wakeups of the task and I/O callbacks, it is only measured while task
+ * profiling is enabled.
+ */
+uint64_t stream_cpu_time(struct stream *s, unsigned int *calls)
+{
+	uint64_t cpu = s->task->cpu_time + s->cpu_time;
+
+	*calls = s->task->calls + s->si[0].wait_event.tasklet->calls + s->si[1].wait_event.tasklet->calls;
+	cpu += si_conn_cpu(&s->si[0]);
+	cpu += si_conn_cpu(&s->si[1]);
+	return cpu;
+}
+
 /* Update the stream's backend and server time stats */
 void stream_update_time_stats(struct stream *s)
 {
@@ -2577,8 +2937,9 @@ void stream_update_time_stats(struct stream *s)
 
 	srv = objt_server(s->target);
 	if (srv) {
-		samples_window = (((s->be->mode == PR_MODE_HTTP) ?
-			srv->counters.p.http.cum_req : srv->counters.cum_lbconn) > TIME_STATS_SAMPLES) ? TIME_STATS_SAMPLES : 0;
+		samples_window = ((s->be->mode == PR_MODE_HTTP) ?
+			counters_above(srv->counters.shards, THR_CTR_CUM_REQ, &srv->counters.p.http.cum_req, TIME_STATS_SAMPLES) :
+			srv->counters.cum_lbconn > TIME_STATS_SAMPLES) ? TIME_STATS_SAMPLES : 0;
 		swrate_add_dynamic(&srv->counters.q_time, samples_window, t_queue);
 		swrate_add_dynamic(&srv->counters.c_time, samples_window, t_connect);
 		swrate_add_dynamic(&srv->counters.d_time, samples_window, t_data);
@@ -2587,9 +2948,16 @@ void stream_update_time_stats(struct stream *s)
 		HA_ATOMIC_UPDATE_MAX(&srv->counters.ctime_max, t_connect);
 		HA_ATOMIC_UPDATE_MAX(&srv->counters.dtime_max, t_data);
 		HA_ATOMIC_UPDATE_MAX(&srv->counters.ttime_max, t_close);
+		time_hist_add(srv->counters.hist, TIME_HIST_QUEUE, t_queue);
+		time_hist_add(srv->counters.hist, TIME_HIST_CONNECT, t_connect);
+		time_hist_add(srv->counters.hist, TIME_HIST_RESPONSE, t_data);
+		time_hist_add(srv->counters.hist, TIME_HIST_TOTAL, t_close);
+		if ((s->be->lbprm.algo & BE_LB_ALGO) == BE_LB_ALGO_EWMA)
+			lb_ewma_update(srv, t_connect + t_data);
 	}
-	samples_window = (((s->be->mode == PR_MODE_HTTP) ?
-		s->be->be_counters.p.http.cum_req : s->be->be_counters.cum_lbconn) > TIME_STATS_SAMPLES) ? TIME_STATS_SAMPLES : 0;
+	samples_window = ((s->be->mode == PR_MODE_HTTP) ?
+		counters_above(s->be->be_counters.shards, THR_CTR_CUM_REQ, &s->be->be_counters.p.http.cum_req, TIME_STATS_SAMPLES) :
+		s->be->be_counters.cum_lbconn > TIME_STATS_SAMPLES) ? TIME_STATS_SAMPLES : 0;
 	swrate_add_dynamic(&s->be->be_counters.q_time, samples_window, t_queue);
 	swrate_add_dynamic(&s->be->be_counters.c_time, samples_window, t_connect);
 	swrate_add_dynamic(&s->be->be_counters.d_time, samples_window, t_data);
@@ -2598,6 +2966,10 @@ void stream_update_time_stats(struct stream *s)
 	HA_ATOMIC_UPDATE_MAX(&s->be->be_counters.ctime_max, t_connect);
 	HA_ATOMIC_UPDATE_MAX(&s->be->be_counters.dtime_max, t_data);
 	HA_ATOMIC_UPDATE_MAX(&s->be->be_counters.ttime_max, t_close);
+	time_hist_add(s->be->be_counters.hist, TIME_HIST_QUEUE, t_queue);
+	time_hist_add(s->be->be_counters.hist, TIME_HIST_CONNECT, t_connect);
+	time_hist_add(s->be->be_counters.hist, TIME_HIST_RESPONSE, t_data);
+	time_hist_add(s->be->be_counters.hist, TIME_HIST_TOTAL, t_close);
 }
 
 /*
@@ -3217,7 +3589,7 @@ static int stats_dump_full_strm_to_buffer(struct stream_interface *si, struct st
 			              conn->flags,
 			              conn->handle.fd,
 			              conn->handle.fd >= 0 ? fdtab[conn->handle.fd].state : 0,
-			              conn->handle.fd >= 0 ? !!(fdtab[conn->handle.fd].update_mask & tid_bit) : 0,
+			              conn->handle.fd >= 0 ? !!(fdupd[conn->handle.fd].update_mask & tid_bit) : 0,
 				      conn->handle.fd >= 0 ? fdtab[conn->handle.fd].thread_mask: 0);
 
 			chunk_appendf(&trash, "      cs=%p csf=0x%08x ctx=%p\n", cs, cs->flags, cs->ctx);
@@ -3253,7 +3625,7 @@ static int stats_dump_full_strm_to_buffer(struct stream_interface *si, struct st
 			              conn->flags,
 			              conn->handle.fd,
 			              conn->handle.fd >= 0 ? fdtab[conn->handle.fd].state : 0,
-			              conn->handle.fd >= 0 ? !!(fdtab[conn->handle.fd].update_mask & tid_bit) : 0,
+			              conn->handle.fd >= 0 ? !!(fdupd[conn->handle.fd].update_mask & tid_bit) : 0,
 				      conn->handle.fd >= 0 ? fdtab[conn->handle.fd].thread_mask: 0);
 
 			chunk_appendf(&trash, "      cs=%p csf=0x%08x ctx=%p\n", cs, cs->flags, cs->ctx);
@@ -3742,12 +4114,43 @@ static int smp_fetch_cur_tunnel_timeout(const struct arg *args, struct sample *s
 	return 1;
 }
 
+/* returns the CPU time spent processing the stream so far, in nanoseconds */
+static int smp_fetch_txn_cpu_time(const struct arg *args, struct sample *smp, const char *km, void *private)
+{
+	unsigned int calls;
+
+	if (!smp->strm)
+		return 0;
+
+	smp->flags = SMP_F_VOL_TEST;
+	smp->data.type = SMP_T_SINT;
+	smp->data.u.sint = stream_cpu_time(smp->strm, &calls);
+	return 1;
+}
+
+/* returns the number of calls accounted in txn.cpu_time */
+static int smp_fetch_txn_cpu_calls(const struct arg *args, struct sample *smp, const char *km, void *private)
+{
+	unsigned int calls;
+
+	if (!smp->strm)
+		return 0;
+
+	smp->flags = SMP_F_VOL_TEST;
+	smp->data.type = SMP_T_SINT;
+	stream_cpu_time(smp->strm, &calls);
+	smp->data.u.sint = calls;
+	return 1;
+}
+
 /* Note: must not be declared <const> as its list will be overwritten.
  * Please take care of keeping this list alphabetically sorted.
  */
 static struct sample_fetch_kw_list smp_kws = {ILH, {
 	{ "cur_server_timeout", smp_fetch_cur_server_timeout, 0, NULL, SMP_T_SINT, SMP_USE_BKEND, },
 	{ "cur_tunnel_timeout", smp_fetch_cur_tunnel_timeout, 0, NULL, SMP_T_SINT, SMP_USE_BKEND, },
+	{ "txn.cpu_calls",      smp_fetch_txn_cpu_calls,      0, NULL, SMP_T_SINT, SMP_USE_INTRN, },
+	{ "txn.cpu_time",       smp_fetch_txn_cpu_time,       0, NULL, SMP_T_SINT, SMP_USE_INTRN, },
 	{ NULL, NULL, 0, 0, 0 },
 }};
 
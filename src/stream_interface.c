@@ -29,6 +29,7 @@
 #include <haproxy/pipe.h>
 #include <haproxy/proxy.h>
 #include <haproxy/stream-t.h>
+#include <haproxy/stream.h>
 #include <haproxy/stream_interface.h>
 #include <haproxy/task.h>
 #include <haproxy/ticks.h>
@@ -515,7 +516,12 @@ static void stream_int_notify(struct stream_interface *si)
 			ic->rex = tick_add_ifset(now_ms, ic->rto);
 	}
 
-	/* wake the task up only when needed */
+	/* wake the task up only when needed. Once a stream has no analyser
+	 * left and forwards everything in both directions (e.g. plain TCP
+	 * proxying), the data are only moved between both sides above, and
+	 * process_stream() is not called anymore until a shutdown, an error
+	 * or a timeout needs to be handled.
+	 */
 	if (/* changes on the production side */
 	    (ic->flags & (CF_READ_NULL|CF_READ_ERROR)) ||
 	    !si_state_in(si->state, SI_SB_CON|SI_SB_RDY|SI_SB_EST) ||
@@ -798,11 +804,14 @@ struct task *si_cs_io_cb(struct task *t, void *ctx, unsigned int state)
 {
 	struct stream_interface *si = ctx;
 	struct conn_stream *cs = objt_cs(si->end);
+	struct stream *strm = si_strm(si);
+	uint64_t cpu_start;
 	int ret = 0;
 
 	if (!cs)
 		return t;
 
+	cpu_start = conn_cpu_start();
 	if (!(si->wait_event.events & SUB_RETRY_SEND) && !channel_is_empty(si_oc(si)))
 		ret = si_cs_send(cs);
 	if (!(si->wait_event.events & SUB_RETRY_RECV))
@@ -810,7 +819,9 @@ struct task *si_cs_io_cb(struct task *t, void *ctx, unsigned int state)
 	if (ret != 0)
 		si_cs_process(cs);
 
-	stream_release_buffers(si_strm(si));
+	stream_release_buffers(strm);
+	if (unlikely(cpu_start))
+		strm->cpu_time += now_mono_time() - cpu_start;
 	return t;
 }
 
@@ -1265,6 +1276,10 @@ int si_cs_recv(struct conn_stream *cs)
 		ic->xfer_small = 0;
 		ic->xfer_large = 0;
 		ic->flags &= ~(CF_STREAMER | CF_STREAMER_FAST);
+
+		/* and go back to a regular buffer */
+		if (b_is_large(&ic->buf) && c_empty(ic))
+			b_free(&ic->buf);
 	}
 
 	/* First, let's see if we may splice data across the channel without
@@ -1421,8 +1436,13 @@ int si_cs_recv(struct conn_stream *cs)
 
  done_recv:
 	if (cur_read) {
+		/* a large buffer is only kept as long as the reads fill at
+		 * least a regular one.
+		 */
+		size_t size = b_is_large(&ic->buf) ? global.tune.bufsize : ic->buf.size;
+
 		if ((ic->flags & (CF_STREAMER | CF_STREAMER_FAST)) &&
-		    (cur_read <= ic->buf.size / 2)) {
+		    (cur_read <= size / 2)) {
 			ic->xfer_large = 0;
 			ic->xfer_small++;
 			if (ic->xfer_small >= 3) {
@@ -1441,7 +1461,7 @@ int si_cs_recv(struct conn_stream *cs)
 			}
 		}
 		else if (!(ic->flags & CF_STREAMER_FAST) &&
-			 (cur_read >= ic->buf.size - global.tune.maxrewrite)) {
+			 (cur_read >= size - global.tune.maxrewrite)) {
 			/* we read a full buffer at once */
 			ic->xfer_small = 0;
 			ic->xfer_large++;
@@ -1457,6 +1477,10 @@ int si_cs_recv(struct conn_stream *cs)
 			ic->xfer_large = 0;
 		}
 		ic->last_read = now_ms;
+
+		/* bulk transfers read faster into large buffers */
+		if (channel_is_bulk(ic) && !b_is_large(&ic->buf))
+			b_grow_large(&ic->buf);
 	}
 
  end_recv:
@@ -1513,6 +1537,14 @@ static void stream_int_read0(struct stream_interface *si)
 	if (!si_state_in(si->state, SI_SB_CON|SI_SB_RDY|SI_SB_EST))
 		return;
 
+#ifdef USE_SOCKMAP
+	/* the last bytes redirected by the kernel must be accounted before
+	 * the socket may be closed.
+	 */
+	if (si_strm(si)->flags & SF_SOCKMAP)
+		stream_sockmap_sync(si_strm(si));
+#endif
+
 	if (oc->flags & CF_SHUTW)
 		goto do_close;
 
@@ -15,6 +15,7 @@
 #include <import/eb32sctree.h>
 #include <import/eb32tree.h>
 
+#include <haproxy/activity.h>
 #include <haproxy/api.h>
 #include <haproxy/cfgparse.h>
 #include <haproxy/fd.h>
@@ -33,23 +34,29 @@ DECLARE_POOL(pool_head_tasklet, "tasklet", sizeof(struct tasklet));
  */
 DECLARE_POOL(pool_head_notification, "notification", sizeof(struct notification));
 
-volatile unsigned long global_tasks_mask = 0; /* Mask of threads with tasks in the global runqueue */
 unsigned int niced_tasks = 0;      /* number of niced tasks in the run queue */
 
 THREAD_LOCAL struct task_per_thread *sched = &task_per_thread[0]; /* scheduler context for the current thread */
 
-__decl_aligned_spinlock(rq_lock); /* spin lock related to run queue */
 __decl_aligned_rwlock(wq_lock);   /* RW lock related to the wait queue */
 
 #ifdef USE_THREAD
 struct eb_root timers;      /* sorted timers tree, global, accessed under wq_lock */
-struct eb_root rqueue;      /* tree constituting the global run queue, accessed under rq_lock */
-unsigned int grq_total;     /* total number of entries in the global run queue, atomic */
-static unsigned int global_rqueue_ticks;  /* insertion count in the grq, use rq_lock */
+unsigned int grq_total;     /* total number of entries in the groups' run queues, atomic */
 #endif
 
 
 struct task_per_thread task_per_thread[MAX_THREADS];
+struct task_per_tgroup task_per_tgroup[MAX_TGROUPS];
+
+/* threads of each task class set by "task-class", 0 for all threads */
+unsigned long task_class_mask[TASK_CLASSES] = { };
+
+const char *task_class_names[TASK_CLASSES] = {
+	[TASK_CLASS_IO]     = "io",
+	[TASK_CLASS_BULK]   = "bulk",
+	[TASK_CLASS_CRYPTO] = "crypto",
+};
 
 
 /* Flags the task <t> for immediate destruction and puts it into its first
@@ -156,16 +163,28 @@ void __tasklet_wakeup_on(struct tasklet *tl, int thr)
 void __task_wakeup(struct task *t)
 {
 	struct eb_root *root = &sched->rqueue;
-
 #ifdef USE_THREAD
+	struct task_per_tgroup *tgs = NULL;
+	unsigned long grp_mask = 0;
+
 	if (t->thread_mask != tid_bit && global.nbthread != 1) {
-		root = &rqueue;
+		/* the task goes to the current thread's group if it may run
+		 * there, otherwise to the group of the first eligible thread.
+		 */
+		t->rq_tgrp = ti->tgrp;
+		grp_mask = t->thread_mask & ha_tgroup_info[t->rq_tgrp].threads_mask;
+		if (!grp_mask && (t->thread_mask & all_threads_mask)) {
+			t->rq_tgrp = ha_thread_info[my_ffsl(t->thread_mask & all_threads_mask) - 1].tgrp;
+			grp_mask = t->thread_mask & ha_tgroup_info[t->rq_tgrp].threads_mask;
+		}
+		tgs = &task_per_tgroup[t->rq_tgrp];
+		root = &tgs->rqueue;
 
 		_HA_ATOMIC_INC(&grq_total);
-		HA_SPIN_LOCK(TASK_RQ_LOCK, &rq_lock);
+		HA_SPIN_LOCK(TASK_RQ_LOCK, &tgs->rq_lock);
 
-		global_tasks_mask |= t->thread_mask;
-		t->rq.key = ++global_rqueue_ticks;
+		tgs->tasks_mask |= grp_mask;
+		t->rq.key = ++tgs->rqueue_ticks;
 		__ha_barrier_store();
 	} else
 #endif
@@ -188,26 +207,155 @@ void __task_wakeup(struct task *t)
 	eb32sc_insert(root, &t->rq, t->thread_mask);
 
 #ifdef USE_THREAD
-	if (root == &rqueue) {
+	if (tgs) {
 		_HA_ATOMIC_OR(&t->state, TASK_GLOBAL);
-		HA_SPIN_UNLOCK(TASK_RQ_LOCK, &rq_lock);
+		HA_SPIN_UNLOCK(TASK_RQ_LOCK, &tgs->rq_lock);
 
-		/* If all threads that are supposed to handle this task are sleeping,
-		 * wake one.
+		/* If all threads of the group that are supposed to handle this
+		 * task are sleeping, wake one. With work stealing, if the current
+		 * thread is already overloaded, also wake one of the sleeping ones
+		 * so that it picks the task instead of us.
 		 */
-		if ((((t->thread_mask & all_threads_mask) & sleeping_thread_mask) ==
-		     (t->thread_mask & all_threads_mask))) {
-			unsigned long m = (t->thread_mask & all_threads_mask) &~ tid_bit;
+		if ((grp_mask & sleeping_thread_mask) == grp_mask) {
+			unsigned long m = grp_mask & ~tid_bit;
 
 			m = (m & (m - 1)) ^ m; // keep lowest bit set
 			_HA_ATOMIC_AND(&sleeping_thread_mask, ~m);
 			wake_thread(my_ffsl(m) - 1);
 		}
+		else if (unlikely(global.tune.options & GTUNE_SCHED_WORK_STEALING) &&
+			 sched->rq_total > global.tune.runqueue_depth) {
+			unsigned long m = grp_mask & sleeping_thread_mask & ~tid_bit;
+
+			if (m) {
+				m = (m & (m - 1)) ^ m; // keep lowest bit set
+				_HA_ATOMIC_AND(&sleeping_thread_mask, ~m);
+				wake_thread(my_ffsl(m) - 1);
+			}
+		}
 	}
 #endif
 	return;
 }
 
+#ifdef USE_TIMER_WHEEL
+/* Thread-local timer wheels: a task is placed at the level corresponding to
+ * the highest group of TW_SLOT_BITS bits which differs between its key and
+ * the wheel's date, in the slot designated by this group of bits in the key.
+ * Keys in the past are placed into the current slot of the first level. When
+ * the wheel's date reaches a slot of an upper level, its tasks are moved down
+ * to lower levels, and the tasks of a first level slot are expired when the
+ * date reaches it. So queuing and unlinking a task are O(1), and a task is
+ * moved at most TW_LEVELS times. Since postponed tasks are left in place by
+ * task_queue() until their slot is reached, pushing a timeout forward costs
+ * nothing. Ordering is only exact within a millisecond, which is the precision
+ * of the ticks anyway.
+ */
+
+/* Places task <t> into wheel <w> according to its key */
+static void tw_insert(struct timer_wheel *w, struct task *t)
+{
+	unsigned int key = t->wq.key;
+	unsigned int diff;
+	int lvl, idx;
+
+	if (tick_is_le(key, w->date))
+		key = w->date;
+
+	diff = key ^ w->date;
+	lvl = diff ? (my_flsl(diff) - 1) / TW_SLOT_BITS : 0;
+	idx = (key >> (lvl * TW_SLOT_BITS)) & (TW_SLOTS - 1);
+	LIST_APPEND(&w->slot[lvl][idx], &t->wl);
+	w->used[lvl] |= 1UL << idx;
+}
+
+/* Looks up the next slot to be processed in wheel <w>. Returns 0 if the wheel
+ * is empty, otherwise fills <date> with the date at which the slot must be
+ * processed, and <level> and <index> with its position. Note that the date
+ * may be in the past if the wheel was not advanced for a while. Slots found
+ * empty because their tasks were unlinked are marked unused on the fly.
+ */
+static int tw_next_slot(struct timer_wheel *w, unsigned int *date, int *level, int *index)
+{
+	int lvl, idx;
+
+	for (lvl = 0; lvl < TW_LEVELS; lvl++) {
+		unsigned int shift = lvl * TW_SLOT_BITS;
+		unsigned int cur = (w->date >> shift) & (TW_SLOTS - 1);
+		unsigned long m;
+
+		while (w->used[lvl]) {
+			/* the upper level may have wrapped with the ticks */
+			m = w->used[lvl] & (~0UL << cur);
+			if (!m)
+				m = w->used[lvl];
+
+			idx = my_ffsl(m) - 1;
+			if (LIST_ISEMPTY(&w->slot[lvl][idx])) {
+				w->used[lvl] &= ~(1UL << idx);
+				continue;
+			}
+
+			*date = (unsigned int)idx << shift;
+			if (shift + TW_SLOT_BITS < 32)
+				*date |= w->date & ~((1U << (shift + TW_SLOT_BITS)) - 1);
+			*level = lvl;
+			*index = idx;
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/* Advances the wheel of the current thread's scheduler <tt> up to <now_ms>,
+ * waking up at most <*budget> expired tasks, and decrements <*budget>
+ * accordingly.
+ */
+static void tw_wake_expired(struct task_per_thread *tt, int *budget)
+{
+	struct timer_wheel *w = &tt->wheel;
+	struct list *slot;
+	struct task *task;
+	unsigned int date;
+	int lvl, idx;
+
+	while (tw_next_slot(w, &date, &lvl, &idx) && !tick_is_lt(now_ms, date)) {
+		w->date = date;
+		slot = &w->slot[lvl][idx];
+
+		if (lvl) {
+			/* move the tasks down */
+			w->used[lvl] &= ~(1UL << idx);
+			while (!LIST_ISEMPTY(slot)) {
+				task = LIST_ELEM(slot->n, struct task *, wl);
+				LIST_DEL_INIT(&task->wl);
+				tw_insert(w, task);
+			}
+			continue;
+		}
+
+		while (!LIST_ISEMPTY(slot)) {
+			if (*budget <= 0)
+				return;
+			(*budget)--;
+
+			/* the task may have been postponed or its timer disabled
+			 * since it was queued, see wake_expired_tasks().
+			 */
+			task = LIST_ELEM(slot->n, struct task *, wl);
+			__task_unlink_wq(task);
+			if (tick_is_expired(task->expire, now_ms))
+				task_wakeup(task, TASK_WOKEN_TIMER);
+			else if (tick_isset(task->expire))
+				__task_queue(task, &tt->timers);
+		}
+	}
+
+	if (tick_is_lt(w->date, now_ms))
+		w->date = now_ms;
+}
+#endif /* USE_TIMER_WHEEL */
+
 /*
  * __task_queue()
  *
@@ -242,6 +390,16 @@ void __task_queue(struct task *task, struct eb_root *wq)
 		return;
 #endif
 
+#ifdef USE_TIMER_WHEEL
+	if (wq == &sched->timers) {
+		struct timer_wheel *w = &sched->wheel;
+
+		if (!thread_has_timers(sched))
+			w->date = now_ms;
+		tw_insert(w, task);
+		return;
+	}
+#endif
 	eb32_insert(wq, &task->wq);
 }
 
@@ -257,6 +415,9 @@ void wake_expired_tasks()
 	struct eb32_node *eb;
 	__decl_thread(int key);
 
+#ifdef USE_TIMER_WHEEL
+	tw_wake_expired(tt, &max_processed);
+#else
 	while (max_processed-- > 0) {
   lookup_next_local:
 		eb = eb32_lookup_ge(&tt->timers, now_ms - TIMER_LOOK_BACK);
@@ -307,6 +468,7 @@ void wake_expired_tasks()
 			break;
 		}
 	}
+#endif /* USE_TIMER_WHEEL */
 
 #ifdef USE_THREAD
 	if (eb_is_empty(&timers))
@@ -396,6 +558,20 @@ int next_timer_expiry()
 	__decl_thread(int key = TICK_ETERNITY);
 
 	/* first check in the thread-local timers */
+#ifdef USE_TIMER_WHEEL
+	{
+		unsigned int date;
+		int lvl, idx;
+
+		/* this is the date of the next slot to process, which may be
+		 * before the first real expiration date if the tasks have to
+		 * be moved down. 0 is reserved for TICK_ETERNITY.
+		 */
+		eb = NULL;
+		if (tw_next_slot(&tt->wheel, &date, &lvl, &idx))
+			ret = date ? date : date - 1;
+	}
+#else
 	eb = eb32_lookup_ge(&tt->timers, now_ms - TIMER_LOOK_BACK);
 	if (!eb) {
 		/* we might have reached the end of the tree, typically because
@@ -407,6 +583,7 @@ int next_timer_expiry()
 
 	if (eb)
 		ret = eb->key;
+#endif
 
 #ifdef USE_THREAD
 	if (!eb_is_empty(&timers)) {
@@ -436,6 +613,7 @@ unsigned int run_tasks_from_lists(unsigned int budgets[])
 	struct task *t;
 	uint8_t budget_mask = (1 << TL_CLASSES) - 1;
 	struct sched_activity *profile_entry = NULL;
+	unsigned long long stall_start;
 	unsigned int done = 0;
 	unsigned int queue;
 	unsigned int state;
@@ -465,7 +643,7 @@ unsigned int run_tasks_from_lists(unsigned int budgets[])
 			if (unlikely(queue > TL_NORMAL &&
 				     budget_mask & (1 << TL_NORMAL) &&
 				     (!eb_is_empty(&sched->rqueue) ||
-				      (global_tasks_mask & tid_bit)))) {
+				      (task_per_tgroup[ti->tgrp].tasks_mask & tid_bit)))) {
 				/* a task was woken up by a bulk tasklet or another thread */
 				break;
 			}
@@ -505,22 +683,28 @@ unsigned int run_tasks_from_lists(unsigned int budgets[])
 			if (unlikely(task_profiling_mask & tid_bit)) {
 				profile_entry = sched_activity_entry(sched_activity, t->process);
 				before = now_mono_time();
-#ifdef DEBUG_TASK
 				if (((struct tasklet *)t)->call_date) {
-					HA_ATOMIC_ADD(&profile_entry->lat_time, before - ((struct tasklet *)t)->call_date);
+					sched_activity_add_lat(profile_entry, before - ((struct tasklet *)t)->call_date);
 					((struct tasklet *)t)->call_date = 0;
 				}
-#endif
 			}
 
 			state = _HA_ATOMIC_XCHG(&t->state, state);
 			__ha_barrier_atomic_store();
 
+			stall_start = unlikely(stall_threshold) ? now_mono_time() : 0;
+
 			process(t, ctx, state);
 
+			if (unlikely(stall_start)) {
+				stall_start = now_mono_time() - stall_start;
+				if (stall_start >= stall_threshold)
+					sched_report_stall(NULL, process, stall_start);
+			}
+
 			if (unlikely(task_profiling_mask & tid_bit)) {
 				HA_ATOMIC_INC(&profile_entry->calls);
-				HA_ATOMIC_ADD(&profile_entry->cpu_time, now_mono_time() - before);
+				sched_activity_add_cpu(profile_entry, now_mono_time() - before);
 			}
 
 			done++;
@@ -544,7 +728,7 @@ unsigned int run_tasks_from_lists(unsigned int budgets[])
 			t->lat_time += lat;
 			t->call_date = now_ns;
 			profile_entry = sched_activity_entry(sched_activity, t->process);
-			HA_ATOMIC_ADD(&profile_entry->lat_time, lat);
+			sched_activity_add_lat(profile_entry, lat);
 			HA_ATOMIC_INC(&profile_entry->calls);
 		}
 
@@ -554,6 +738,8 @@ unsigned int run_tasks_from_lists(unsigned int budgets[])
 		 * directly free the task. Otherwise it will be seen after processing and
 		 * it's freed on the exit path.
 		 */
+		stall_start = unlikely(stall_threshold) ? now_mono_time() : 0;
+
 		if (likely(!(state & TASK_KILLED) && process == process_stream))
 			t = process_stream(t, ctx, state);
 		else if (!(state & TASK_KILLED) && process != NULL)
@@ -571,6 +757,13 @@ unsigned int run_tasks_from_lists(unsigned int budgets[])
 		}
 		sched->current = NULL;
 		__ha_barrier_store();
+
+		if (unlikely(stall_start)) {
+			stall_start = now_mono_time() - stall_start;
+			if (stall_start >= stall_threshold)
+				sched_report_stall(t, process, stall_start);
+		}
+
 		/* If there is a pending state  we have to wake up the task
 		 * immediately, else we defer it into wait queue
 		 */
@@ -580,7 +773,7 @@ unsigned int run_tasks_from_lists(unsigned int budgets[])
 
 				t->cpu_time += cpu;
 				t->call_date = 0;
-				HA_ATOMIC_ADD(&profile_entry->cpu_time, cpu);
+				sched_activity_add_cpu(profile_entry, cpu);
 			}
 
 			state = _HA_ATOMIC_AND_FETCH(&t->state, ~TASK_RUNNING);
@@ -600,6 +793,71 @@ unsigned int run_tasks_from_lists(unsigned int budgets[])
 	return done;
 }
 
+#ifdef USE_THREAD
+/* Work stealing (tune.sched.work-stealing): when the current thread has more
+ * work than it can process in one round, the tasks it picked from the run
+ * queues which may also run on sleeping threads are handed over to these
+ * threads' shared tasklet lists, starting with the least urgent ones, and the
+ * threads are woken up. Tasklets and tasks bound to the current thread only
+ * are never moved since they are attached to the thread owning their FD. The
+ * number of moved tasks is limited to the excess over <budget>. Returns the
+ * number of tasks that were handed over.
+ */
+static int sched_give_tasks(struct task_per_thread *tt, int budget)
+{
+	struct tasklet *tl, *back;
+	unsigned long idle, left;
+	int excess = tt->rq_total - budget;
+	int given = 0;
+
+	idle = sleeping_thread_mask & all_threads_mask & ~tid_bit;
+	if (!idle || excess <= 0)
+		return 0;
+
+	left = idle;
+	list_for_each_entry_safe_rev(tl, back, &tt->tasklets[TL_NORMAL], list) {
+		struct task *t = (struct task *)tl;
+		unsigned long m;
+		int thr;
+
+		if (given >= excess)
+			break;
+
+		if (tl->state & (TASK_F_TASKLET|TASK_KILLED))
+			continue;
+
+		/* spread the tasks over all idle threads */
+		m = t->thread_mask & left;
+		if (!m) {
+			left = idle;
+			m = t->thread_mask & left;
+			if (!m)
+				continue;
+		}
+
+		thr = my_ffsl(m) - 1;
+		left &= ~(1UL << thr);
+
+		LIST_DEL_INIT(&tl->list);
+		_HA_ATOMIC_DEC(&tt->rq_total);
+		_HA_ATOMIC_DEC(&tt->tasks_in_list);
+
+		MT_LIST_APPEND(&task_per_thread[thr].shared_tasklet_list, (struct mt_list *)&tl->list);
+		_HA_ATOMIC_INC(&task_per_thread[thr].rq_total);
+		_HA_ATOMIC_INC(&task_per_thread[thr].tasks_in_list);
+		_HA_ATOMIC_INC(&activity[thr].tasks_stolen);
+		if (sleeping_thread_mask & (1UL << thr)) {
+			_HA_ATOMIC_AND(&sleeping_thread_mask, ~(1UL << thr));
+			wake_thread(thr);
+		}
+		given++;
+	}
+
+	activity[tid].tasks_given += given;
+	return given;
+}
+#endif
+
 /* The run queue is chronologically sorted in a tree. An insertion counter is
  * used to assign a position to each task. This counter may be combined with
  * other variables (eg: nice value) to set the final position in the tree. The
@@ -616,8 +874,9 @@ unsigned int run_tasks_from_lists(unsigned int budgets[])
 void process_runnable_tasks()
 {
 	struct task_per_thread * const tt = sched;
+	struct task_per_tgroup * const tgs = &task_per_tgroup[ti->tgrp];
 	struct eb32sc_node *lrq; // next local run queue entry
-	struct eb32sc_node *grq; // next global run queue entry
+	struct eb32sc_node *grq; // next group run queue entry
 	struct task *t;
 	const unsigned int default_weights[TL_CLASSES] = {
 		[TL_URGENT] = 64, // ~50% of CPU bandwidth for I/O
@@ -636,6 +895,9 @@ void process_runnable_tasks()
 
 	ti->flags &= ~TI_FL_STUCK; // this thread is still running
 
+	if (unlikely(ti->stall_period != stall_threshold))
+		sched_update_stall_sampler();
+
 	if (!thread_has_tasks()) {
 		activity[tid].empty_rq++;
 		return;
@@ -663,7 +925,7 @@ void process_runnable_tasks()
 
 	/* normal tasklets list gets a default weight of ~37% */
 	if ((tt->tl_class_mask & (1 << TL_NORMAL)) ||
-	    !eb_is_empty(&sched->rqueue) || (global_tasks_mask & tid_bit))
+	    !eb_is_empty(&sched->rqueue) || (tgs->tasks_mask & tid_bit))
 		max[TL_NORMAL] = default_weights[TL_NORMAL];
 
 	/* bulk tasklets list gets a default weight of ~13% */
@@ -710,15 +972,15 @@ void process_runnable_tasks()
 	lpicked = gpicked = 0;
 	budget = max[TL_NORMAL] - tt->tasks_in_list;
 	while (lpicked + gpicked < budget) {
-		if ((global_tasks_mask & tid_bit) && !grq) {
+		if ((tgs->tasks_mask & tid_bit) && !grq) {
 #ifdef USE_THREAD
-			HA_SPIN_LOCK(TASK_RQ_LOCK, &rq_lock);
-			grq = eb32sc_lookup_ge(&rqueue, global_rqueue_ticks - TIMER_LOOK_BACK, tid_bit);
+			HA_SPIN_LOCK(TASK_RQ_LOCK, &tgs->rq_lock);
+			grq = eb32sc_lookup_ge(&tgs->rqueue, tgs->rqueue_ticks - TIMER_LOOK_BACK, tid_bit);
 			if (unlikely(!grq)) {
-				grq = eb32sc_first(&rqueue, tid_bit);
+				grq = eb32sc_first(&tgs->rqueue, tid_bit);
 				if (!grq) {
-					global_tasks_mask &= ~tid_bit;
-					HA_SPIN_UNLOCK(TASK_RQ_LOCK, &rq_lock);
+					tgs->tasks_mask &= ~tid_bit;
+					HA_SPIN_UNLOCK(TASK_RQ_LOCK, &tgs->rq_lock);
 				}
 			}
 #endif
@@ -751,10 +1013,10 @@ void process_runnable_tasks()
 			eb32sc_delete(&t->rq);
 
 			if (unlikely(!grq)) {
-				grq = eb32sc_first(&rqueue, tid_bit);
+				grq = eb32sc_first(&tgs->rqueue, tid_bit);
 				if (!grq) {
-					global_tasks_mask &= ~tid_bit;
-					HA_SPIN_UNLOCK(TASK_RQ_LOCK, &rq_lock);
+					tgs->tasks_mask &= ~tid_bit;
+					HA_SPIN_UNLOCK(TASK_RQ_LOCK, &tgs->rq_lock);
 				}
 			}
 			gpicked++;
@@ -769,7 +1031,7 @@ void process_runnable_tasks()
 
 	/* release the rqueue lock */
 	if (grq) {
-		HA_SPIN_UNLOCK(TASK_RQ_LOCK, &rq_lock);
+		HA_SPIN_UNLOCK(TASK_RQ_LOCK, &tgs->rq_lock);
 		grq = NULL;
 	}
 
@@ -785,6 +1047,12 @@ void process_runnable_tasks()
 		activity[tid].tasksw += lpicked + gpicked;
 	}
 
+#ifdef USE_THREAD
+	/* hand the tasks we won't have time for over to idle threads */
+	if (unlikely(global.tune.options & GTUNE_SCHED_WORK_STEALING) && gpicked)
+		sched_give_tasks(tt, max_processed);
+#endif
+
 	/* Merge the list of tasklets waken up by other threads to the
 	 * main list.
 	 */
@@ -862,12 +1130,14 @@ void mworker_cleantasks()
 	struct eb32sc_node *tmp_rq = NULL;
 
 #ifdef USE_THREAD
-	/* cleanup the global run queue */
-	tmp_rq = eb32sc_first(&rqueue, MAX_THREADS_MASK);
-	while (tmp_rq) {
-		t = eb32sc_entry(tmp_rq, struct task, rq);
-		tmp_rq = eb32sc_next(tmp_rq, MAX_THREADS_MASK);
-		task_destroy(t);
+	/* cleanup the groups' run queues */
+	for (i = 0; i < MAX_TGROUPS; i++) {
+		tmp_rq = eb32sc_first(&task_per_tgroup[i].rqueue, MAX_THREADS_MASK);
+		while (tmp_rq) {
+			t = eb32sc_entry(tmp_rq, struct task, rq);
+			tmp_rq = eb32sc_next(tmp_rq, MAX_THREADS_MASK);
+			task_destroy(t);
+		}
 	}
 	/* cleanup the timers queue */
 	tmp_wq = eb32_first(&timers);
@@ -886,6 +1156,22 @@ void mworker_cleantasks()
 			task_destroy(t);
 		}
 		/* cleanup the per thread timers queue */
+#ifdef USE_TIMER_WHEEL
+		{
+			struct timer_wheel *w = &task_per_thread[i].wheel;
+			int lvl, idx;
+
+			for (lvl = 0; lvl < TW_LEVELS; lvl++) {
+				for (idx = 0; idx < TW_SLOTS; idx++) {
+					while (!LIST_ISEMPTY(&w->slot[lvl][idx])) {
+						t = LIST_ELEM(w->slot[lvl][idx].n, struct task *, wl);
+						task_destroy(t);
+					}
+				}
+				w->used[lvl] = 0;
+			}
+		}
+#endif
 		tmp_wq = eb32_first(&task_per_thread[i].timers);
 		while (tmp_wq) {
 			t = eb32_entry(tmp_wq, struct task, wq);
@@ -902,13 +1188,19 @@ static void init_task()
 
 #ifdef USE_THREAD
 	memset(&timers, 0, sizeof(timers));
-	memset(&rqueue, 0, sizeof(rqueue));
 #endif
+	memset(&task_per_tgroup, 0, sizeof(task_per_tgroup));
+	for (i = 0; i < MAX_TGROUPS; i++)
+		HA_SPIN_INIT(&task_per_tgroup[i].rq_lock);
 	memset(&task_per_thread, 0, sizeof(task_per_thread));
 	for (i = 0; i < MAX_THREADS; i++) {
 		for (q = 0; q < TL_CLASSES; q++)
 			LIST_INIT(&task_per_thread[i].tasklets[q]);
 		MT_LIST_INIT(&task_per_thread[i].shared_tasklet_list);
+#ifdef USE_TIMER_WHEEL
+		for (q = 0; q < TW_LEVELS * TW_SLOTS; q++)
+			LIST_INIT(&task_per_thread[i].wheel.slot[q / TW_SLOTS][q % TW_SLOTS]);
+#endif
 	}
 }
 
@@ -931,9 +1223,29 @@ static int cfg_parse_tune_sched_low_latency(char **args, int section_type, struc
 	return 0;
 }
 
+/* config parser for global "tune.sched.work-stealing", accepts "on" or "off" */
+static int cfg_parse_tune_sched_work_stealing(char **args, int section_type, struct proxy *curpx,
+                                              const struct proxy *defpx, const char *file, int line,
+                                              char **err)
+{
+	if (too_many_args(1, args, err, NULL))
+		return -1;
+
+	if (strcmp(args[1], "on") == 0)
+		global.tune.options |= GTUNE_SCHED_WORK_STEALING;
+	else if (strcmp(args[1], "off") == 0)
+		global.tune.options &= ~GTUNE_SCHED_WORK_STEALING;
+	else {
+		memprintf(err, "'%s' expects either 'on' or 'off' but got '%s'.", args[0], args[1]);
+		return -1;
+	}
+	return 0;
+}
+
 /* config keyword parsers */
 static struct cfg_kw_list cfg_kws = {ILH, {
 	{ CFG_GLOBAL, "tune.sched.low-latency", cfg_parse_tune_sched_low_latency },
+	{ CFG_GLOBAL, "tune.sched.work-stealing", cfg_parse_tune_sched_work_stealing },
 	{ 0, NULL, NULL }
 }};
 
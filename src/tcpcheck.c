@@ -997,6 +997,57 @@ enum tcpcheck_eval_ret tcpcheck_agent_expect_reply(struct check *check, struct t
 	goto out;
 }
 
+/* Returns a new conn_stream attached to the connection kept alive in the
+ * session of check <check> by its previous run, or NULL if there is none. The
+ * connection is released if the server closed it or if it failed meanwhile,
+ * and a new one must then be established.
+ */
+static struct conn_stream *tcpcheck_reuse_conn(struct check *check)
+{
+	struct session *sess = check->sess;
+	struct sess_srv_list *srv_list;
+	struct connection *conn = NULL;
+	struct conn_stream *cs;
+	char c;
+	int ret;
+
+	list_for_each_entry(srv_list, &sess->srv_list, srv_list) {
+		if (!LIST_ISEMPTY(&srv_list->conn_list)) {
+			conn = LIST_ELEM(srv_list->conn_list.n, struct connection *, session_list);
+			break;
+		}
+	}
+	if (!conn)
+		return NULL;
+
+	if (conn->flags & CO_FL_SESS_IDLE) {
+		conn->flags &= ~CO_FL_SESS_IDLE;
+		sess->idle_conns--;
+	}
+
+	if ((conn->flags & (CO_FL_ERROR|CO_FL_SOCK_RD_SH|CO_FL_SOCK_WR_SH|CO_FL_WAIT_XPRT)) ||
+	    !conn_ctrl_ready(conn) || conn->mux->avail_streams(conn) <= 0)
+		goto release;
+
+	/* the mux may not have noticed yet that the server closed the
+	 * connection, so let's peek at the socket.
+	 */
+	ret = recv(conn->handle.fd, &c, 1, MSG_PEEK | MSG_DONTWAIT);
+	if (ret == 0 || (ret < 0 && errno != EAGAIN && errno != EWOULDBLOCK))
+		goto release;
+
+	cs = conn->mux->attach(conn, sess);
+	if (cs)
+		return cs;
+
+  release:
+	TRACE_DEVEL("kept connection not reusable", CHK_EV_TCPCHK_CONN, check);
+	session_unown_conn(sess, conn);
+	conn->owner = NULL;
+	conn->mux->destroy(conn->ctx);
+	return NULL;
+}
+
 /* Evaluates a TCPCHK_ACT_CONNECT rule. Returns TCPCHK_EVAL_WAIT to wait the
  * connection establishment, TCPCHK_EVAL_CONTINUE to evaluate the next rule or
  * TCPCHK_EVAL_STOP if an error occurred.
@@ -1041,6 +1092,17 @@ enum tcpcheck_eval_ret tcpcheck_eval_connect(struct check *check, struct tcpchec
 	check_release_buf(check, &check->bi);
 	check_release_buf(check, &check->bo);
 
+	/* Reuse the connection kept alive by the previous run if possible */
+	if ((check->state & CHK_ST_KEEPALIVE) && (cs = tcpcheck_reuse_conn(check)) != NULL) {
+		TRACE_DEVEL("reuse kept connection", CHK_EV_TCPCHK_CONN, check);
+		tasklet_set_tid(check->wait_list.tasklet, tid);
+		check->cs = cs;
+		check->wait_list.events = 0;
+		cs_attach(cs, check, &check_conn_cb);
+		t->expire = tick_add(now_ms, MS_TO_TICKS(check->inter));
+		goto out;
+	}
+
 	/* No connection, prepare a new one */
 	cs = cs_new(NULL, (s ? &s->obj_type : &proxy->obj_type));
 	if (!cs) {
@@ -1415,7 +1477,8 @@ enum tcpcheck_eval_ret tcpcheck_eval_send(struct check *check, struct tcpcheck_r
 			body = send->http.body;
 		clen = ist((!istlen(body) ? "0" : ultoa(istlen(body))));
 
-		if ((!connection_hdr && !htx_add_header(htx, ist("Connection"), ist("close"))) ||
+		if ((!connection_hdr && !(check->state & CHK_ST_KEEPALIVE) &&
+		     !htx_add_header(htx, ist("Connection"), ist("close"))) ||
 		    !htx_add_header(htx, ist("Content-length"), clen))
 			goto error_htx;
 
@@ -1610,6 +1673,14 @@ enum tcpcheck_eval_ret tcpcheck_eval_expect_http(struct check *check, struct tcp
 		goto error;
 	}
 
+	/* a connection kept alive must be reusable, so the whole response
+	 * must be received first.
+	 */
+	if ((check->state & CHK_ST_KEEPALIVE) && !last_read) {
+		TRACE_DEVEL("waiting for the end of the response", CHK_EV_TCPCHK_EXP, check);
+		goto wait_more_data;
+	}
+
 	if (htx_is_empty(htx)) {
 		if (last_read) {
 			TRACE_ERROR("empty response received", CHK_EV_TCPCHK_EXP|CHK_EV_TCPCHK_ERR, check);
@@ -2107,8 +2178,11 @@ int tcpcheck_main(struct check *check)
         else {
 		struct tcpcheck_var *var;
 
-		/* First evaluation, create a session */
-		check->sess = session_new(&checks_fe, NULL, &check->obj_type);
+		/* First evaluation, create a session unless the previous run
+		 * kept it along with its connection.
+		 */
+		if (!check->sess)
+			check->sess = session_new(&checks_fe, NULL, &check->obj_type);
 		if (!check->sess) {
 			chunk_printf(&trash, "TCPCHK error allocating check session");
 			TRACE_ERROR("session allocation failure", CHK_EV_TCPCHK_EVAL|CHK_EV_TCPCHK_ERR, check);
@@ -2261,6 +2335,12 @@ int tcpcheck_main(struct check *check)
 		chk_report_conn_err(check, errno, 0);
 	}
 
+	/* the connection may only be kept alive once the whole response was
+	 * received.
+	 */
+	if (cs && IS_HTX_CS(cs) && (htxbuf(&check->bi)->flags & HTX_FL_EOM))
+		check->state |= CHK_ST_RES_EOM;
+
 	/* the tcpcheck is finished, release in/out buffer now */
 	check_release_buf(check, &check->bi);
 	check_release_buf(check, &check->bo);
@@ -24,12 +24,16 @@
 #endif
 
 #include <haproxy/cfgparse.h>
+#include <haproxy/chunk.h>
+#include <haproxy/errors.h>
 #include <haproxy/fd.h>
 #include <haproxy/global.h>
 #include <haproxy/log.h>
 #include <haproxy/thread.h>
+#include <haproxy/time.h>
 #include <haproxy/tools.h>
 
+struct tgroup_info ha_tgroup_info[MAX_TGROUPS] = { { .threads_mask = 1, .count = 1 } };
 struct thread_info ha_thread_info[MAX_THREADS] = { };
 THREAD_LOCAL struct thread_info *ti = &ha_thread_info[0];
 
@@ -46,6 +50,196 @@ int thread_cpus_enabled_at_boot          = 1;
 
 #if defined(DEBUG_THREAD) || defined(DEBUG_FULL)
 struct lock_stat lock_stats[LOCK_LABELS];
+#else
+int lock_profiling = 0;
+struct lock_prof_stat lock_prof_stats[MAX_THREADS][LOCK_LABELS];
+struct lock_prof_caller lock_prof_callers[LOCK_PROF_CALLERS];
+
+/* generation of the sampled locks, bumped on each reset so that locks taken
+ * during a previous profiling session are never accounted for.
+ */
+static unsigned int lock_prof_gen;
+
+/* the sampled locks currently held by the thread */
+static THREAD_LOCAL struct {
+	unsigned long *lock;
+	const void *caller;
+	uint64_t date;
+	unsigned int label;
+	unsigned int gen;
+} lock_prof_held[LOCK_PROF_HELD];
+static THREAD_LOCAL unsigned int lock_prof_nheld;
+static THREAD_LOCAL unsigned int lock_prof_ctr;
+
+/* resets all lock profiling statistics */
+void lock_prof_reset()
+{
+	int thr, i;
+
+	for (thr = 0; thr < MAX_THREADS; thr++)
+		for (i = 0; i < LOCK_LABELS; i++)
+			memset(&lock_prof_stats[thr][i], 0, sizeof(lock_prof_stats[thr][i]));
+
+	for (i = 0; i < LOCK_PROF_CALLERS; i++) {
+		HA_ATOMIC_STORE(&lock_prof_callers[i].contended, 0);
+		HA_ATOMIC_STORE(&lock_prof_callers[i].wait_time, 0);
+		HA_ATOMIC_STORE(&lock_prof_callers[i].hold_samples, 0);
+		HA_ATOMIC_STORE(&lock_prof_callers[i].hold_time, 0);
+		HA_ATOMIC_STORE(&lock_prof_callers[i].caller, NULL);
+	}
+	HA_ATOMIC_INC(&lock_prof_gen);
+}
+
+/* returns the per-caller entry for <caller>, allocating it if needed. Entry
+ * zero collects all callers which collide with another one.
+ */
+static struct lock_prof_caller *lock_prof_caller_entry(const void *caller, enum lock_label lbl)
+{
+	struct lock_prof_caller *entry;
+	const void *old = NULL;
+	unsigned int hash;
+
+	hash = (unsigned int)(((uint64_t)(size_t)caller * 0x9E3779B97F4A7C15ULL) >> 56) % LOCK_PROF_CALLERS;
+	entry = &lock_prof_callers[hash];
+	if (likely(entry->caller == caller))
+		return entry;
+
+	if (HA_ATOMIC_CAS(&entry->caller, &old, caller)) {
+		entry->label = lbl;
+		return entry;
+	}
+	return &lock_prof_callers[0];
+}
+
+/* tries to take lock <l> for operation <op>, returns non-zero on success */
+static inline int lock_prof_try_op(unsigned long *l, enum lock_prof_op op)
+{
+	switch (op) {
+	case LOCK_PROF_W: return !!pl_try_w(l);
+	case LOCK_PROF_R: return !!pl_try_r(l);
+	default:          return !!pl_try_s(l);
+	}
+}
+
+/* takes note that lock <l> was just acquired from <caller>, one time in
+ * LOCK_PROF_SAMPLING, so that its hold time gets measured.
+ */
+static inline void lock_prof_hold(unsigned long *l, enum lock_label lbl, const void *caller)
+{
+	unsigned int gen = HA_ATOMIC_LOAD(&lock_prof_gen);
+	unsigned int i;
+
+	if (++lock_prof_ctr % LOCK_PROF_SAMPLING)
+		return;
+
+	if (lock_prof_nheld >= LOCK_PROF_HELD) {
+		/* purge entries left by a former profiling session */
+		for (i = 0; i < lock_prof_nheld; ) {
+			if (lock_prof_held[i].gen != gen)
+				lock_prof_held[i] = lock_prof_held[--lock_prof_nheld];
+			else
+				i++;
+		}
+		/* locks released by another thread may never be seen
+		 * again, better lose a few samples than stop sampling.
+		 */
+		if (lock_prof_nheld >= LOCK_PROF_HELD)
+			lock_prof_nheld = 0;
+	}
+
+	i = lock_prof_nheld++;
+	lock_prof_held[i].lock   = l;
+	lock_prof_held[i].caller = caller;
+	lock_prof_held[i].label  = lbl;
+	lock_prof_held[i].gen    = gen;
+	lock_prof_held[i].date   = now_mono_time();
+}
+
+/* Takes lock <l> of label <lbl> for operation <op> while profiling is enabled.
+ * The wait time is only measured when the lock is already held.
+ */
+void __attribute__((noinline)) __lock_prof_take(enum lock_label lbl, unsigned long *l, enum lock_prof_op op)
+{
+	struct lock_prof_stat *st = &lock_prof_stats[tid][lbl];
+	const void *caller = __builtin_return_address(0);
+	struct lock_prof_caller *entry;
+	uint64_t start, wait;
+
+	st->calls++;
+	if (unlikely(!lock_prof_try_op(l, op))) {
+		start = now_mono_time();
+		switch (op) {
+		case LOCK_PROF_W: pl_take_w(l); break;
+		case LOCK_PROF_R: pl_take_r(l); break;
+		default:          pl_take_s(l); break;
+		}
+		wait = now_mono_time() - start;
+
+		st->contended++;
+		st->wait_time += wait;
+		if (wait > st->max_wait)
+			st->max_wait = wait;
+
+		entry = lock_prof_caller_entry(caller, lbl);
+		_HA_ATOMIC_INC(&entry->contended);
+		_HA_ATOMIC_ADD(&entry->wait_time, wait);
+	}
+	lock_prof_hold(l, lbl, caller);
+}
+
+/* Tries to take lock <l> of label <lbl> for operation <op> while profiling is
+ * enabled. Returns 0 on success like the HA_*_TRY* macros, non-zero on failure.
+ */
+int __attribute__((noinline)) __lock_prof_try(enum lock_label lbl, unsigned long *l, enum lock_prof_op op)
+{
+	if (!lock_prof_try_op(l, op))
+		return 1;
+
+	lock_prof_stats[tid][lbl].calls++;
+	lock_prof_hold(l, lbl, __builtin_return_address(0));
+	return 0;
+}
+
+/* Releases lock <l> taken for operation <op> while profiling is enabled, and
+ * accounts for its hold time if it was sampled.
+ */
+void __attribute__((noinline)) __lock_prof_drop(unsigned long *l, enum lock_prof_op op)
+{
+	struct lock_prof_caller *entry;
+	struct lock_prof_stat *st;
+	uint64_t hold = 0;
+	int i;
+
+	for (i = lock_prof_nheld - 1; i >= 0; i--) {
+		if (lock_prof_held[i].lock == l)
+			break;
+	}
+
+	if (i >= 0) {
+		if (lock_prof_held[i].gen == HA_ATOMIC_LOAD(&lock_prof_gen))
+			hold = now_mono_time() - lock_prof_held[i].date;
+	}
+
+	switch (op) {
+	case LOCK_PROF_W: pl_drop_w(l); break;
+	case LOCK_PROF_R: pl_drop_r(l); break;
+	default:          pl_drop_s(l); break;
+	}
+
+	if (i < 0)
+		return;
+
+	if (hold) {
+		st = &lock_prof_stats[tid][lock_prof_held[i].label];
+		st->hold_samples++;
+		st->hold_time += hold;
+
+		entry = lock_prof_caller_entry(lock_prof_held[i].caller, lock_prof_held[i].label);
+		_HA_ATOMIC_INC(&entry->hold_samples);
+		_HA_ATOMIC_ADD(&entry->hold_time, hold);
+	}
+	lock_prof_held[i] = lock_prof_held[--lock_prof_nheld];
+}
 #endif
 
 /* Marks the thread as harmless until the last thread using the rendez-vous
@@ -260,6 +454,210 @@ REGISTER_BUILD_OPTS("Built without multi-threading support (USE_THREAD not set).
 #endif // USE_THREAD
 
 
+/* Epoch-based reclamation. Objects which may still be accessed without any
+ * lock by readers running on other threads are passed to thread_retire() once
+ * they are not reachable anymore. Each thread records the current epoch once
+ * per polling loop in thread_quiescent(), at a moment where it cannot hold
+ * such a reference. An object retired at epoch E is released once all other
+ * threads have recorded an epoch >= E or are harmless. This implies that such
+ * references must never be kept across a polling loop nor thread_isolate().
+ */
+struct retired_obj {
+	struct retired_obj *next;
+	void (*release)(void *);
+	void *ptr;
+	unsigned int epoch;
+};
+
+static unsigned int retire_epoch = 1;             /* bumped on each retirement */
+static unsigned int thread_epoch[MAX_THREADS];    /* last epoch seen per thread */
+static struct retired_obj *retired_objs;          /* most recent first */
+__decl_spinlock(retire_lock);
+
+/* Schedules the call to <release>(<ptr>) once no other thread may reference
+ * <ptr> anymore, which must already have been made unreachable. If memory is
+ * lacking, <ptr> is leaked, which is preferable to waiting for other threads
+ * while the caller possibly holds some locks.
+ */
+void thread_retire(void *ptr, void (*release)(void *))
+{
+	struct retired_obj *obj;
+
+	obj = malloc(sizeof(*obj));
+	if (!obj)
+		return;
+
+	obj->release = release;
+	obj->ptr = ptr;
+	HA_SPIN_LOCK(OTHER_LOCK, &retire_lock);
+	obj->epoch = HA_ATOMIC_ADD_FETCH(&retire_epoch, 1);
+	obj->next = retired_objs;
+	retired_objs = obj;
+	HA_SPIN_UNLOCK(OTHER_LOCK, &retire_lock);
+}
+
+/* releases the retired objects that no thread may reference anymore */
+static void thread_reclaim(void)
+{
+	struct retired_obj *obj, **prev, *done = NULL;
+	unsigned long mask;
+	unsigned int min, e;
+	int thr;
+
+	/* the current thread and the harmless ones hold no reference */
+	min = HA_ATOMIC_LOAD(&retire_epoch);
+	mask = all_threads_mask & ~threads_harmless_mask & ~tid_bit;
+	for (thr = 0; mask; thr++, mask >>= 1) {
+		if (!(mask & 1))
+			continue;
+		e = HA_ATOMIC_LOAD(&thread_epoch[thr]);
+		if ((int)(e - min) < 0)
+			min = e;
+	}
+
+	HA_SPIN_LOCK(OTHER_LOCK, &retire_lock);
+	for (prev = &retired_objs; (obj = *prev); ) {
+		if ((int)(min - obj->epoch) >= 0) {
+			*prev = obj->next;
+			obj->next = done;
+			done = obj;
+		}
+		else
+			prev = &obj->next;
+	}
+	HA_SPIN_UNLOCK(OTHER_LOCK, &retire_lock);
+
+	while ((obj = done)) {
+		done = obj->next;
+		obj->release(obj->ptr);
+		free(obj);
+	}
+}
+
+/* Called by each thread once per polling loop, when it holds no reference to
+ * any object subject to thread_retire(). Also releases the retired objects
+ * which are not referenced anymore.
+ */
+void thread_quiescent(void)
+{
+	HA_ATOMIC_STORE(&thread_epoch[tid], HA_ATOMIC_LOAD(&retire_epoch));
+	if (HA_ATOMIC_LOAD(&retired_objs))
+		thread_reclaim();
+}
+
+/* releases all remaining retired objects on exit */
+static void thread_retire_deinit(void)
+{
+	struct retired_obj *obj;
+
+	while ((obj = retired_objs)) {
+		retired_objs = obj->next;
+		obj->release(obj->ptr);
+		free(obj);
+	}
+}
+
+REGISTER_POST_DEINIT(thread_retire_deinit);
+
+
+/* Jobs queued while checking the configuration, which are independent from each
+ * other and are run in parallel on the configured threads by startup_work_run().
+ */
+struct startup_work {
+	int (*fct)(void *arg);
+	void *arg;
+};
+
+static struct startup_work *startup_works = NULL;
+static unsigned int startup_works_nb = 0;
+static unsigned int startup_works_next = 0;
+static int startup_works_err = 0;
+
+/* Queues the call of <fct> on <arg> for startup_work_run(). Such a job must not
+ * depend on any other one nor modify anything shared without locking. Among the
+ * per-thread resources, it may only rely on the trash and the user messages
+ * context. <fct> must return the number of errors it reported. If the job
+ * cannot be queued, it is run right away. Returns the number of errors already
+ * reported, hence 0 when the job is queued.
+ */
+int startup_work_add(int (*fct)(void *arg), void *arg)
+{
+	struct startup_work *new;
+
+	new = realloc(startup_works, (startup_works_nb + 1) * sizeof(*new));
+	if (!new)
+		return fct(arg);
+
+	startup_works = new;
+	startup_works[startup_works_nb].fct = fct;
+	startup_works[startup_works_nb].arg = arg;
+	startup_works_nb++;
+	return 0;
+}
+
+/* Runs queued startup jobs until there is none left */
+static void startup_work_process()
+{
+	unsigned int idx;
+	int err;
+
+	while ((idx = _HA_ATOMIC_FETCH_ADD(&startup_works_next, 1)) < startup_works_nb) {
+		err = startup_works[idx].fct(startup_works[idx].arg);
+		if (err)
+			_HA_ATOMIC_ADD(&startup_works_err, err);
+	}
+}
+
+#ifdef USE_THREAD
+/* Entry point of the threads started by startup_work_run() */
+static void *startup_work_thread(void *data)
+{
+	/* the other threads will do the work if we can't */
+	if (alloc_trash_buffers_per_thread())
+		startup_work_process();
+	free_trash_buffers_per_thread();
+	return NULL;
+}
+#endif
+
+/* Runs all the jobs queued by startup_work_add() on up to "nbthread" threads,
+ * the calling one included, and waits for their completion. The number of jobs
+ * and of threads used are returned in <jobs> and <threads>. Returns the total
+ * number of errors reported by the jobs.
+ */
+int startup_work_run(unsigned int *jobs, int *threads)
+{
+	int nbthr = 0;
+	int err;
+#ifdef USE_THREAD
+	pthread_t *thr = NULL;
+	int i;
+
+	if (global.nbthread > 1 && startup_works_nb > 1)
+		thr = calloc(MIN(global.nbthread, startup_works_nb) - 1, sizeof(*thr));
+
+	while (thr && nbthr < MIN(global.nbthread, startup_works_nb) - 1 &&
+	       pthread_create(&thr[nbthr], NULL, startup_work_thread, NULL) == 0)
+		nbthr++;
+#endif
+
+	startup_work_process();
+
+#ifdef USE_THREAD
+	for (i = 0; i < nbthr; i++)
+		pthread_join(thr[i], NULL);
+	free(thr);
+#endif
+	*jobs = startup_works_nb;
+	*threads = nbthr + 1;
+	err = startup_works_err;
+
+	ha_free(&startup_works);
+	startup_works_nb = startup_works_next = 0;
+	startup_works_err = 0;
+	return err;
+}
+
 /* Parse the number of threads in argument <arg>, returns it and adjusts a few
  * internal variables accordingly, or fails and returns zero with an error
  * reason in <errmsg>. May be called multiple times while parsing.
@@ -290,3 +688,53 @@ int parse_nbthread(const char *arg, char **err)
 #endif
 	return nbthread;
 }
+
+/* Parses the "thread-groups" value <arg>, and returns it on success, or fails
+ * and returns zero with an error reason in <err>.
+ */
+int parse_nbtgroups(const char *arg, char **err)
+{
+	long nbtgroups;
+	char *errptr;
+
+	nbtgroups = strtol(arg, &errptr, 10);
+	if (!*arg || *errptr) {
+		memprintf(err, "passed a missing or unparsable integer value in '%s'", arg);
+		return 0;
+	}
+
+	if (nbtgroups < 1 || nbtgroups > MAX_TGROUPS) {
+		memprintf(err, "value must be between 1 and %d (was %ld)", MAX_TGROUPS, nbtgroups);
+		return 0;
+	}
+	return nbtgroups;
+}
+
+/* Splits the global.nbthread threads into global.nbtgroups groups of contiguous
+ * threads of nearly equal sizes, and fills ha_tgroup_info[] and the threads'
+ * group accordingly. Must be called once the number of threads is known. The
+ * number of groups is reduced to the number of threads if larger.
+ */
+void thread_map_to_groups()
+{
+	unsigned int thr, grp;
+
+	if (!global.nbtgroups)
+		global.nbtgroups = 1;
+
+	if (global.nbtgroups > global.nbthread) {
+		ha_warning("'thread-groups' (%d) is larger than the number of threads (%d), only %d group(s) will be used.\n",
+		           global.nbtgroups, global.nbthread, global.nbthread);
+		global.nbtgroups = global.nbthread;
+	}
+
+	memset(ha_tgroup_info, 0, sizeof(ha_tgroup_info));
+	for (thr = 0; thr < global.nbthread; thr++) {
+		grp = thr * global.nbtgroups / global.nbthread;
+		if (!ha_tgroup_info[grp].count)
+			ha_tgroup_info[grp].base = thr;
+		ha_tgroup_info[grp].count++;
+		ha_tgroup_info[grp].threads_mask |= 1UL << thr;
+		ha_thread_info[thr].tgrp = grp;
+	}
+}
@@ -84,6 +84,83 @@ THREAD_LOCAL int quoted_idx = 0;
  */
 THREAD_LOCAL unsigned int statistical_prng_state = 2463534242U;
 
+/* The 100 two-digit decimal numbers "00" to "99" concatenated, so that
+ * integers may be emitted two digits per division.
+ */
+const char dec_pairs[200] =
+	"0001020304050607080910111213141516171819"
+	"2021222324252627282930313233343536373839"
+	"4041424344454647484950515253545556575859"
+	"6061626364656667686970717273747576777879"
+	"8081828384858687888990919293949596979899";
+
+/* The dotted form of each byte of an IPv4 address, see ipv4_to_str() */
+static const char ipv4_bytes[256][4] = {
+	"0.", "1.", "2.", "3.", "4.", "5.", "6.", "7.",
+	"8.", "9.", "10.", "11.", "12.", "13.", "14.", "15.",
+	"16.", "17.", "18.", "19.", "20.", "21.", "22.", "23.",
+	"24.", "25.", "26.", "27.", "28.", "29.", "30.", "31.",
+	"32.", "33.", "34.", "35.", "36.", "37.", "38.", "39.",
+	"40.", "41.", "42.", "43.", "44.", "45.", "46.", "47.",
+	"48.", "49.", "50.", "51.", "52.", "53.", "54.", "55.",
+	"56.", "57.", "58.", "59.", "60.", "61.", "62.", "63.",
+	"64.", "65.", "66.", "67.", "68.", "69.", "70.", "71.",
+	"72.", "73.", "74.", "75.", "76.", "77.", "78.", "79.",
+	"80.", "81.", "82.", "83.", "84.", "85.", "86.", "87.",
+	"88.", "89.", "90.", "91.", "92.", "93.", "94.", "95.",
+	"96.", "97.", "98.", "99.", "100.", "101.", "102.", "103.",
+	"104.", "105.", "106.", "107.", "108.", "109.", "110.", "111.",
+	"112.", "113.", "114.", "115.", "116.", "117.", "118.", "119.",
+	"120.", "121.", "122.", "123.", "124.", "125.", "126.", "127.",
+	"128.", "129.", "130.", "131.", "132.", "133.", "134.", "135.",
+	"136.", "137.", "138.", "139.", "140.", "141.", "142.", "143.",
+	"144.", "145.", "146.", "147.", "148.", "149.", "150.", "151.",
+	"152.", "153.", "154.", "155.", "156.", "157.", "158.", "159.",
+	"160.", "161.", "162.", "163.", "164.", "165.", "166.", "167.",
+	"168.", "169.", "170.", "171.", "172.", "173.", "174.", "175.",
+	"176.", "177.", "178.", "179.", "180.", "181.", "182.", "183.",
+	"184.", "185.", "186.", "187.", "188.", "189.", "190.", "191.",
+	"192.", "193.", "194.", "195.", "196.", "197.", "198.", "199.",
+	"200.", "201.", "202.", "203.", "204.", "205.", "206.", "207.",
+	"208.", "209.", "210.", "211.", "212.", "213.", "214.", "215.",
+	"216.", "217.", "218.", "219.", "220.", "221.", "222.", "223.",
+	"224.", "225.", "226.", "227.", "228.", "229.", "230.", "231.",
+	"232.", "233.", "234.", "235.", "236.", "237.", "238.", "239.",
+	"240.", "241.", "242.", "243.", "244.", "245.", "246.", "247.",
+	"248.", "249.", "250.", "251.", "252.", "253.", "254.", "255."
+};
+
+/* per-thread cache of the last conversions made by get_localtime() and
+ * get_gmtime(), see tools.h.
+ */
+THREAD_LOCAL struct tm_cache localtime_cache = { };
+THREAD_LOCAL struct tm_cache gmtime_cache = { };
+
+/* Writes the decimal representation of <n> backwards so that it ends just
+ * before <end>, and returns a pointer to its first char. Two digits are
+ * produced per division. The caller must ensure that there is enough room
+ * before <end> (up to 20 chars).
+ */
+static inline char *ulltoa_rev(unsigned long long n, char *end)
+{
+	unsigned int r;
+
+	while (n >= 100) {
+		r = n % 100;
+		n /= 100;
+		end -= 2;
+		memcpy(end, &dec_pairs[2 * r], 2);
+	}
+
+	if (n >= 10) {
+		end -= 2;
+		memcpy(end, &dec_pairs[2 * n], 2);
+	}
+	else
+		*--end = '0' + n;
+	return end;
+}
+
 /*
  * unsigned long long ASCII representation
  *
@@ -180,10 +257,7 @@ char *ulltoa(unsigned long long n, char *dst, size_t size)
 		return NULL;  // too long
 	res = dst + i + 1;
 	*res = '\0';
-	for (; i >= 0; i--) {
-		dst[i] = n % 10ULL + '0';
-		n /= 10ULL;
-	}
+	ulltoa_rev(n, res);
 	return res;
 }
 
@@ -292,10 +366,7 @@ char *ultoa_o(unsigned long n, char *dst, size_t size)
 		return NULL;  // too long
 	res = dst + i + 1;
 	*res = '\0';
-	for (; i >= 0; i--) {
-		dst[i] = n % 10U + '0';
-		n /= 10U;
-	}
+	ulltoa_rev(n, res);
 	return res;
 }
 
@@ -351,7 +422,7 @@ char *lltoa(long long n, char *dst, size_t size)
 char *utoa_pad(unsigned int n, char *dst, size_t size)
 {
 	int i = 0;
-	char *ret;
+	char *ret, *pos;
 
 	switch(n) {
 		case 0U ... 9U:
@@ -401,10 +472,8 @@ char *utoa_pad(unsigned int n, char *dst, size_t size)
 
 	ret = dst + i + 1;
 	*ret = '\0';
-	for (; i >= 0; i--) {
-		dst[i] = n % 10U + '0';
-		n /= 10U;
-	}
+	for (pos = ulltoa_rev(n, ret); pos > dst; )
+		*--pos = '0';
 	return ret;
 }
 
@@ -437,7 +506,10 @@ char *ultoa_r(unsigned long n, char *buffer, int size)
 	
 	pos = buffer + size - 1;
 	*pos-- = '\0';
-	
+
+	if (likely(size > 20))
+		return ulltoa_rev(n, pos + 1);
+
 	do {
 		*pos-- = '0' + n % 10;
 		n /= 10;
@@ -465,6 +537,13 @@ char *lltoa_r(long long int in, char *buffer, int size)
 	else
 		n = in;
 
+	if (likely(size > 21)) {
+		pos = ulltoa_rev(n, pos + 1);
+		if (neg)
+			*--pos = '-';
+		return pos;
+	}
+
 	do {
 		*pos-- = '0' + n % 10;
 		n /= 10;
@@ -1754,6 +1833,10 @@ int addr_to_str(const struct sockaddr_storage *addr, char *str, int size)
 	switch (addr->ss_family) {
 	case AF_INET:
 		ptr = &((struct sockaddr_in *)addr)->sin_addr;
+		if (size >= INET_ADDRSTRLEN) {
+			ipv4_to_str(ptr, str);
+			return AF_INET;
+		}
 		break;
 	case AF_INET6:
 		ptr = &((struct sockaddr_in6 *)addr)->sin6_addr;
@@ -1772,6 +1855,24 @@ int addr_to_str(const struct sockaddr_storage *addr, char *str, int size)
 	return -1;
 }
 
+/* Writes the dotted form of IPv4 address <addr> (in network byte order) to
+ * <dst>, which must have room for INET_ADDRSTRLEN (16) chars, and returns a
+ * pointer to the trailing zero. Each byte is copied with its dot from a
+ * precomputed table, which is much faster than inet_ntop().
+ */
+char *ipv4_to_str(const void *addr, char *dst)
+{
+	const unsigned char *a = addr;
+	unsigned int i;
+
+	for (i = 0; i < 4; i++) {
+		memcpy(dst, ipv4_bytes[a[i]], 4);
+		dst += 2 + (a[i] >= 10) + (a[i] >= 100);
+	}
+	*--dst = '\0';
+	return dst;
+}
+
 /* Tries to convert a sockaddr_storage port to text form. Upon success, the
  * address family is returned so that it's easy for the caller to adapt to the
  * output format. Zero is returned if the address family is not supported. -1
@@ -2051,11 +2152,23 @@ const char *csv_enc_append(const char *str, int quote, struct buffer *output)
 int url_decode(char *string, int in_form)
 {
 	char *in, *out;
+	size_t len;
 	int ret = -1;
 
 	in = string;
 	out = string;
 	while (*in) {
+		/* skip or move the plain chars at once, libc's strcspn() is
+		 * usually much faster than a per-char switch.
+		 */
+		len = strcspn(in, "%+?");
+		if (out != in)
+			memmove(out, in, len);
+		in += len;
+		out += len;
+		if (!*in)
+			break;
+
 		switch (*in) {
 		case '+' :
 			*out++ = in_form ? ' ' : *in;
@@ -3300,6 +3413,29 @@ const char *monthname[12] = {
 	"Jul", "Aug", "Sep", "Oct", "Nov", "Dec"
 };
 
+/* Writes the date <tm> in the format "%02d/%s/%04d:%02d:%02d:%02d" to <dst>,
+ * which must have room for 20 chars, and returns a pointer past the last char.
+ * The fields are emitted two digits at a time.
+ */
+static inline char *tm2str_log(char *dst, const struct tm *tm)
+{
+	unsigned int year = (unsigned int)tm->tm_year + 1900;
+
+	memcpy(dst, &dec_pairs[2 * tm->tm_mday], 2);       // day
+	dst[2] = '/';
+	memcpy(dst + 3, monthname[tm->tm_mon], 3);         // month
+	dst[6] = '/';
+	memcpy(dst + 7, &dec_pairs[2 * (year / 100 % 100)], 2); // year
+	memcpy(dst + 9, &dec_pairs[2 * (year % 100)], 2);
+	dst[11] = ':';
+	memcpy(dst + 12, &dec_pairs[2 * tm->tm_hour], 2);  // hour
+	dst[14] = ':';
+	memcpy(dst + 15, &dec_pairs[2 * tm->tm_min], 2);   // minutes
+	dst[17] = ':';
+	memcpy(dst + 18, &dec_pairs[2 * tm->tm_sec], 2);   // seconds
+	return dst + 20;
+}
+
 /* date2str_log: write a date in the format :
  * 	sprintf(str, "%02d/%s/%04d:%02d:%02d:%02d.%03d",
  *		tm.tm_mday, monthname[tm.tm_mon], tm.tm_year+1900,
@@ -3310,42 +3446,18 @@ const char *monthname[12] = {
  */
 char *date2str_log(char *dst, const struct tm *tm, const struct timeval *date, size_t size)
 {
+	unsigned int ms;
 
 	if (size < 25) /* the size is fixed: 24 chars + \0 */
 		return NULL;
 
-	dst = utoa_pad((unsigned int)tm->tm_mday, dst, 3); // day
-	if (!dst)
-		return NULL;
-	*dst++ = '/';
-
-	memcpy(dst, monthname[tm->tm_mon], 3); // month
-	dst += 3;
-	*dst++ = '/';
-
-	dst = utoa_pad((unsigned int)tm->tm_year+1900, dst, 5); // year
-	if (!dst)
-		return NULL;
-	*dst++ = ':';
-
-	dst = utoa_pad((unsigned int)tm->tm_hour, dst, 3); // hour
-	if (!dst)
-		return NULL;
-	*dst++ = ':';
-
-	dst = utoa_pad((unsigned int)tm->tm_min, dst, 3); // minutes
-	if (!dst)
-		return NULL;
-	*dst++ = ':';
-
-	dst = utoa_pad((unsigned int)tm->tm_sec, dst, 3); // secondes
-	if (!dst)
-		return NULL;
+	dst = tm2str_log(dst, tm);
 	*dst++ = '.';
 
-	dst = utoa_pad((unsigned int)(date->tv_usec/1000)%1000, dst, 4); // milliseconds
-	if (!dst)
-		return NULL;
+	ms = (unsigned int)(date->tv_usec / 1000) % 1000; // milliseconds
+	*dst++ = '0' + ms / 100;
+	memcpy(dst, &dec_pairs[2 * (ms % 100)], 2);
+	dst += 2;
 	*dst = '\0';
 
 	return dst;
@@ -3426,42 +3538,9 @@ char *gmt2str_log(char *dst, struct tm *tm, size_t size)
 	if (size < 27) /* the size is fixed: 26 chars + \0 */
 		return NULL;
 
-	dst = utoa_pad((unsigned int)tm->tm_mday, dst, 3); // day
-	if (!dst)
-		return NULL;
-	*dst++ = '/';
-
-	memcpy(dst, monthname[tm->tm_mon], 3); // month
-	dst += 3;
-	*dst++ = '/';
-
-	dst = utoa_pad((unsigned int)tm->tm_year+1900, dst, 5); // year
-	if (!dst)
-		return NULL;
-	*dst++ = ':';
-
-	dst = utoa_pad((unsigned int)tm->tm_hour, dst, 3); // hour
-	if (!dst)
-		return NULL;
-	*dst++ = ':';
-
-	dst = utoa_pad((unsigned int)tm->tm_min, dst, 3); // minutes
-	if (!dst)
-		return NULL;
-	*dst++ = ':';
-
-	dst = utoa_pad((unsigned int)tm->tm_sec, dst, 3); // secondes
-	if (!dst)
-		return NULL;
-	*dst++ = ' ';
-	*dst++ = '+';
-	*dst++ = '0';
-	*dst++ = '0';
-	*dst++ = '0';
-	*dst++ = '0';
-	*dst = '\0';
-
-	return dst;
+	dst = tm2str_log(dst, tm);
+	memcpy(dst, " +0000", 7);
+	return dst + 6;
 }
 
 /* localdate2str_log: write a date in the format :
@@ -3478,33 +3557,7 @@ char *localdate2str_log(char *dst, time_t t, struct tm *tm, size_t size)
 
 	gmt_offset = get_gmt_offset(t, tm);
 
-	dst = utoa_pad((unsigned int)tm->tm_mday, dst, 3); // day
-	if (!dst)
-		return NULL;
-	*dst++ = '/';
-
-	memcpy(dst, monthname[tm->tm_mon], 3); // month
-	dst += 3;
-	*dst++ = '/';
-
-	dst = utoa_pad((unsigned int)tm->tm_year+1900, dst, 5); // year
-	if (!dst)
-		return NULL;
-	*dst++ = ':';
-
-	dst = utoa_pad((unsigned int)tm->tm_hour, dst, 3); // hour
-	if (!dst)
-		return NULL;
-	*dst++ = ':';
-
-	dst = utoa_pad((unsigned int)tm->tm_min, dst, 3); // minutes
-	if (!dst)
-		return NULL;
-	*dst++ = ':';
-
-	dst = utoa_pad((unsigned int)tm->tm_sec, dst, 3); // secondes
-	if (!dst)
-		return NULL;
+	dst = tm2str_log(dst, tm);
 	*dst++ = ' ';
 
 	memcpy(dst, gmt_offset, 5); // Offset from local time to GMT
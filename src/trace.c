@@ -21,17 +21,23 @@
 #include <import/ist.h>
 #include <haproxy/api.h>
 #include <haproxy/buf.h>
+#include <haproxy/channel.h>
 #include <haproxy/cli.h>
 #include <haproxy/errors.h>
 #include <haproxy/istbuf.h>
 #include <haproxy/list.h>
 #include <haproxy/log.h>
 #include <haproxy/sink.h>
+#include <haproxy/stream_interface.h>
+#include <haproxy/time.h>
 #include <haproxy/trace.h>
 
 struct list trace_sources = LIST_HEAD_INIT(trace_sources);
 THREAD_LOCAL struct buffer trace_buf = { };
 
+/* per-thread binary records, used by sources whose sink is "record" */
+static struct trace_recorder trace_recorders[MAX_THREADS];
+
 /* allocates the trace buffers. Returns 0 in case of failure. It is safe to
  * call to call this function multiple times if the size changes.
  */
@@ -49,6 +55,70 @@ static void free_trace_buffers_per_thread()
 REGISTER_PER_THREAD_ALLOC(alloc_trace_buffers_per_thread);
 REGISTER_PER_THREAD_FREE(free_trace_buffers_per_thread);
 
+/* allocates the records of all threads if not already done. This is only
+ * performed from the CLI when a source is switched to the "record" sink, so
+ * that the emission path never has to allocate anything. Returns 0 on failure.
+ */
+static int alloc_trace_recorders()
+{
+	struct trace_record *rec;
+	int thr;
+
+	for (thr = 0; thr < global.nbthread; thr++) {
+		if (trace_recorders[thr].rec)
+			continue;
+		rec = calloc(TRACE_RECORDS, sizeof(*rec));
+		if (!rec)
+			return 0;
+		HA_ATOMIC_STORE(&trace_recorders[thr].rec, rec);
+	}
+	return 1;
+}
+
+static void free_trace_recorders()
+{
+	int thr;
+
+	for (thr = 0; thr < MAX_THREADS; thr++)
+		ha_free(&trace_recorders[thr].rec);
+}
+
+REGISTER_POST_DEINIT(free_trace_recorders);
+
+/* stores the raw event into the current thread's records. Nothing is formatted
+ * nor dereferenced and no lock is taken, the slot is simply overwritten. The
+ * head is only updated once the entry is complete so that readers can tell if
+ * the entry they've just read was being overwritten.
+ */
+static inline void trace_record(enum trace_level level, uint64_t mask, const struct trace_source *src,
+                                const struct ist where, const char *func,
+                                const void *a1, const void *a2, const void *a3, const void *a4,
+                                const struct ist msg)
+{
+	struct trace_recorder *rc = &trace_recorders[tid];
+	struct trace_record *rec;
+
+	if (unlikely(!rc->rec))
+		return;
+
+	/* the slot must not be seen modified before the previous head update */
+	__ha_barrier_store();
+	rec = &rc->rec[rc->head & (TRACE_RECORDS - 1)];
+	rec->date    = now_mono_time();
+	rec->mask    = mask;
+	rec->src     = src;
+	rec->where   = where.ptr;
+	rec->func    = func;
+	rec->msg     = msg;
+	rec->args[0] = a1;
+	rec->args[1] = a2;
+	rec->args[2] = a3;
+	rec->args[3] = a4;
+	rec->level   = level;
+	__ha_barrier_store();
+	HA_ATOMIC_STORE(&rc->head, rc->head + 1);
+}
+
 /* pick the lowest non-null argument with a non-null arg_def mask */
 static inline const void *trace_pick_arg(uint32_t arg_def, const void *a1, const void *a2, const void *a3, const void *a4)
 {
@@ -99,54 +169,58 @@ void __trace(enum trace_level level, uint64_t mask, struct trace_source *src,
 	if (((src->report_events | src->start_events | src->pause_events | src->stop_events) & mask) == 0)
 		return;
 
-	/* retrieve available information from the caller's arguments */
-	if (src->arg_def & TRC_ARGS_CONN)
-		conn = trace_pick_arg(src->arg_def & TRC_ARGS_CONN, a1, a2, a3, a4);
+	/* retrieve available information from the caller's arguments. These
+	 * are only needed to lock on an object.
+	 */
+	if (src->lockon != TRACE_LOCKON_NOTHING) {
+		if (src->arg_def & TRC_ARGS_CONN)
+			conn = trace_pick_arg(src->arg_def & TRC_ARGS_CONN, a1, a2, a3, a4);
 
-	if (src->arg_def & TRC_ARGS_SESS)
-		sess = trace_pick_arg(src->arg_def & TRC_ARGS_SESS, a1, a2, a3, a4);
+		if (src->arg_def & TRC_ARGS_SESS)
+			sess = trace_pick_arg(src->arg_def & TRC_ARGS_SESS, a1, a2, a3, a4);
 
-	if (src->arg_def & TRC_ARGS_STRM)
-		strm = trace_pick_arg(src->arg_def & TRC_ARGS_STRM, a1, a2, a3, a4);
+		if (src->arg_def & TRC_ARGS_STRM)
+			strm = trace_pick_arg(src->arg_def & TRC_ARGS_STRM, a1, a2, a3, a4);
 
-	if (src->arg_def & TRC_ARGS_CHK)
-		check = trace_pick_arg(src->arg_def & TRC_ARGS_CHK, a1, a2, a3, a4);
+		if (src->arg_def & TRC_ARGS_CHK)
+			check = trace_pick_arg(src->arg_def & TRC_ARGS_CHK, a1, a2, a3, a4);
 
-	if (!sess && strm)
-		sess = strm->sess;
-	else if (!sess && conn)
-		sess = conn->owner;
-	else if (!sess && check)
-		sess = check->sess;
+		if (!sess && strm)
+			sess = strm->sess;
+		else if (!sess && conn)
+			sess = conn->owner;
+		else if (!sess && check)
+			sess = check->sess;
 
-	if (sess) {
-		fe = sess->fe;
-		li = sess->listener;
-	}
+		if (sess) {
+			fe = sess->fe;
+			li = sess->listener;
+		}
 
-	if (!li && conn)
-		li = objt_listener(conn->target);
+		if (!li && conn)
+			li = objt_listener(conn->target);
 
-	if (li && !fe)
-		fe = li->bind_conf->frontend;
+		if (li && !fe)
+			fe = li->bind_conf->frontend;
 
-	if (strm) {
-		be = strm->be;
-		srv = strm->srv_conn;
-	}
-	if (check) {
-		srv = check->server;
-		be = srv->proxy;
-	}
+		if (strm) {
+			be = strm->be;
+			srv = strm->srv_conn;
+		}
+		if (check) {
+			srv = check->server;
+			be = srv->proxy;
+		}
 
-	if (!srv && conn)
-		srv = objt_server(conn->target);
+		if (!srv && conn)
+			srv = objt_server(conn->target);
 
-	if (srv && !be)
-		be = srv->proxy;
+		if (srv && !be)
+			be = srv->proxy;
 
-	if (!be && conn)
-		be = objt_proxy(conn->target);
+		if (!be && conn)
+			be = objt_proxy(conn->target);
+	}
 
 	/* TODO: add handling of filters here, return if no match (not even update states) */
 
@@ -190,6 +264,12 @@ void __trace(enum trace_level level, uint64_t mask, struct trace_source *src,
 	if ((src->report_events & mask) == 0 || level > src->level)
 		goto end;
 
+	if (src->record) {
+		/* binary recording, formatting is deferred to the dump */
+		trace_record(level, mask, src, where, func, a1, a2, a3, a4, msg);
+		goto end;
+	}
+
 	/* log the logging location truncated to 10 chars from the right so that
 	 * the line number and the end of the file name are there.
 	 */
@@ -393,7 +473,9 @@ static int cli_parse_trace(char **args, char *payload, struct appctx *appctx, vo
 
 		if (!*name) {
 			chunk_printf(&trash, "Supported sinks for source %s (*=current):\n", src->name.ptr);
-			chunk_appendf(&trash, "  %c none       : no sink\n", src->sink ? ' ' : '*');
+			chunk_appendf(&trash, "  %c none       : no sink\n", (src->sink || src->record) ? ' ' : '*');
+			chunk_appendf(&trash, "  %c record     : raw events in per-thread buffers (see \"show trace records\")\n",
+				      src->record ? '*' : ' ');
 			list_for_each_entry(sink, &sink_list, sink_list) {
 				chunk_appendf(&trash, "  %c %-10s : %s\n",
 					      src->sink == sink ? '*' : ' ',
@@ -403,6 +485,14 @@ static int cli_parse_trace(char **args, char *payload, struct appctx *appctx, vo
 			return cli_msg(appctx, LOG_WARNING, trash.area);
 		}
 
+		if (strcmp(name, "record") == 0) {
+			if (!alloc_trace_recorders())
+				return cli_err(appctx, "Out of memory while allocating the trace records");
+			HA_ATOMIC_STORE(&src->sink, NULL);
+			HA_ATOMIC_STORE(&src->record, 1);
+			return 0;
+		}
+
 		if (strcmp(name, "none") == 0)
 			sink = NULL;
 		else {
@@ -412,6 +502,7 @@ static int cli_parse_trace(char **args, char *payload, struct appctx *appctx, vo
 		}
 
 		HA_ATOMIC_STORE(&src->sink, sink);
+		HA_ATOMIC_STORE(&src->record, 0);
 	}
 	else if (strcmp(args[2], "level") == 0) {
 		const char *name = args[3];
@@ -628,6 +719,26 @@ static int cli_parse_show_trace(char **args, char *payload, struct appctx *appct
 
 	args++; // make args[1] the 1st arg
 
+	if (strcmp(args[1], "records") == 0 || strcmp(args[2], "records") == 0) {
+		if (!cli_has_level(appctx, ACCESS_LVL_OPER))
+			return 1;
+
+		src = NULL;
+		if (strcmp(args[1], "records") != 0) {
+			src = trace_find_source(args[1]);
+			if (!src)
+				return cli_err(appctx, "No such trace source");
+		}
+
+		/* p0: source or NULL, i0: thread, i1: 1 once o0/o1 are set,
+		 * o0: next record, o1: end of the dump for this thread.
+		 */
+		appctx->ctx.cli.p0 = src;
+		appctx->ctx.cli.i0 = 0;
+		appctx->ctx.cli.i1 = 0;
+		return 0;
+	}
+
 	if (!*args[1]) {
 		/* no arg => report the list of supported sources */
 		chunk_printf(&trash,
@@ -638,7 +749,7 @@ static int cli_parse_show_trace(char **args, char *payload, struct appctx *appct
 			sink = src->sink;
 			chunk_appendf(&trash, " [%c] %-10s -> %s [drp %u]  [%s]\n",
 				      trace_state_char(src->state), src->name.ptr,
-				      sink ? sink->name : "none",
+				      sink ? sink->name : src->record ? "record" : "none",
 				      sink ? sink->ctx.dropped : 0,
 				      src->desc);
 		}
@@ -657,7 +768,7 @@ static int cli_parse_show_trace(char **args, char *payload, struct appctx *appct
 	sink = src->sink;
 	chunk_printf(&trash, "Trace status for %s:\n", src->name.ptr);
 	chunk_appendf(&trash, "  - sink: %s [%u dropped]\n",
-		      sink ? sink->name : "none", sink ? sink->ctx.dropped : 0);
+		      sink ? sink->name : src->record ? "record" : "none", sink ? sink->ctx.dropped : 0);
 
 	chunk_appendf(&trash, "  - event name   :     report    start    stop    pause\n");
 	for (i = 0; src->known_events && src->known_events[i].mask; i++) {
@@ -673,9 +784,79 @@ static int cli_parse_show_trace(char **args, char *payload, struct appctx *appct
 	return cli_msg(appctx, LOG_WARNING, trash.area);
 }
 
+/* dumps the records of each thread in chronological order, one thread after
+ * the other, optionally only for the source in ctx.cli.p0. Entries which have
+ * been overwritten while being dumped are skipped. Returns 0 if the output
+ * buffer is full and it needs to be called again, otherwise non-zero.
+ */
+static int cli_io_handler_show_trace_records(struct appctx *appctx)
+{
+	const struct trace_source *src = appctx->ctx.cli.p0;
+	struct stream_interface *si = appctx->owner;
+	struct trace_recorder *rc;
+	struct trace_record rec;
+	unsigned int head, pos;
+	int i;
+
+	if (unlikely(si_ic(si)->flags & (CF_WRITE_ERROR|CF_SHUTW)))
+		return 1;
+
+	for (; appctx->ctx.cli.i0 < global.nbthread; appctx->ctx.cli.i0++, appctx->ctx.cli.i1 = 0) {
+		rc = &trace_recorders[appctx->ctx.cli.i0];
+		if (!HA_ATOMIC_LOAD(&rc->rec))
+			continue;
+
+		head = HA_ATOMIC_LOAD(&rc->head);
+		if (!appctx->ctx.cli.i1) {
+			/* first visit: dump from the oldest record to the last
+			 * one present at this instant.
+			 */
+			appctx->ctx.cli.o0 = head > TRACE_RECORDS ? head - TRACE_RECORDS : 0;
+			appctx->ctx.cli.o1 = head;
+			appctx->ctx.cli.i1 = 1;
+		}
+
+		for (; (pos = appctx->ctx.cli.o0) != (unsigned int)appctx->ctx.cli.o1; appctx->ctx.cli.o0++) {
+			if (head - pos >= TRACE_RECORDS)
+				continue; // already overwritten
+
+			__ha_barrier_load();
+			rec = rc->rec[pos & (TRACE_RECORDS - 1)];
+			__ha_barrier_load();
+			head = HA_ATOMIC_LOAD(&rc->head);
+			if (head - pos >= TRACE_RECORDS)
+				continue; // overwritten while we were reading it
+
+			if (src && rec.src != src)
+				continue;
+
+			chunk_reset(&trash);
+			chunk_appendf(&trash, "%llu.%06llu [%02d|%s|%d|%s] ",
+				      (ullong)(rec.date / 1000000000ULL),
+				      (ullong)(rec.date % 1000000000ULL) / 1000ULL,
+				      appctx->ctx.cli.i0 + 1, rec.src->name.ptr, rec.level, rec.where);
+			if (rec.func)
+				chunk_appendf(&trash, "%s(): ", rec.func);
+			chunk_istcat(&trash, rec.msg);
+			for (i = 0; i < 4; i++) {
+				if (rec.args[i])
+					chunk_appendf(&trash, " a%d=%p", i + 1, rec.args[i]);
+			}
+			chunk_appendf(&trash, "\n");
+
+			if (ci_putchk(si_ic(si), &trash) == -1) {
+				/* failed, try again */
+				si_rx_room_blk(si);
+				return 0;
+			}
+		}
+	}
+	return 1;
+}
+
 static struct cli_kw_list cli_kws = {{ },{
 	{ { "trace", NULL },         "trace [<module>|0] [cmd [args...]]      : manage live tracing (empty to list, 0 to stop all)", cli_parse_trace, NULL, NULL },
-	{ { "show", "trace", NULL }, "show trace [<module>]                   : show live tracing state",                            cli_parse_show_trace, NULL, NULL },
+	{ { "show", "trace", NULL }, "show trace [<module>] [records]         : show live tracing state or recorded events",         cli_parse_show_trace, cli_io_handler_show_trace_records, NULL },
 	{{},}
 }};
 
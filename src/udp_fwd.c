@@ -0,0 +1,740 @@
+/*
+ * Forwarding of UDP datagrams by "mode udp" proxies.
+ *
+ * Copyright (C) 2021 HAProxy Technologies
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ *
+ * Datagrams received on the listeners of a "mode udp" frontend are read in
+ * batches and forwarded to a server of its default backend. By default each
+ * client gets a flow, which owns a socket connected to the server it was
+ * assigned to. This socket is polled by the thread which created the flow to
+ * bring the server's responses back to the client from the listener's address.
+ * The flow disappears once idle for the frontend's "timeout client", or when
+ * its server goes down. With "option udp-stateless", a server is picked for
+ * each datagram and responses are not forwarded.
+ */
+
+#define _GNU_SOURCE  /* for recvmmsg() and sendmmsg() */
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+
+#include <import/ebmbtree.h>
+#include <haproxy/api.h>
+#include <haproxy/backend.h>
+#include <haproxy/counters.h>
+#include <haproxy/errors.h>
+#include <haproxy/fd.h>
+#include <haproxy/global.h>
+#include <haproxy/listener.h>
+#include <haproxy/obj_type.h>
+#include <haproxy/pool.h>
+#include <haproxy/proxy.h>
+#include <haproxy/server.h>
+#include <haproxy/task.h>
+#include <haproxy/thread.h>
+#include <haproxy/ticks.h>
+#include <haproxy/tools.h>
+#include <haproxy/udp_fwd.h>
+
+#if !defined(__linux__)
+/* Other systems do not always have the batched socket calls, so these are
+ * emulated with one call per datagram using the same layout.
+ */
+struct udp_fwd_mmsghdr {
+	struct msghdr msg_hdr;
+	unsigned int  msg_len;
+};
+#define mmsghdr udp_fwd_mmsghdr
+#endif
+
+/* per-thread area holding the datagrams being forwarded */
+struct udp_fwd_batch {
+	struct mmsghdr msgs[UDP_FWD_BATCH];
+	struct iovec iov[UDP_FWD_BATCH];
+	struct sockaddr_storage addr[UDP_FWD_BATCH];
+	char *area;                    /* UDP_FWD_BATCH buffers of tune.bufsize bytes */
+};
+
+DECLARE_STATIC_POOL(pool_head_udp_flow, "udp_flow", sizeof(struct udp_flow));
+
+static THREAD_LOCAL struct udp_fwd_batch *udp_fwd_batch;
+
+/* unconnected IPv4 and IPv6 sockets used to send stateless datagrams */
+static THREAD_LOCAL int udp_fwd_stls_fd[2] = { -1, -1 };
+
+static void udp_fwd_srv_fd_handler(int fd);
+static struct task *udp_flow_expire(struct task *t, void *context, unsigned int state);
+
+/* Returns the calling thread's batch, prepared to receive <max> datagrams, or
+ * NULL if it could not be allocated.
+ */
+static struct udp_fwd_batch *udp_fwd_get_batch(int max)
+{
+	struct udp_fwd_batch *b = udp_fwd_batch;
+	int i;
+
+	if (unlikely(!b)) {
+		b = calloc(1, sizeof(*b));
+		if (!b)
+			return NULL;
+		b->area = malloc((size_t)UDP_FWD_BATCH * global.tune.bufsize);
+		if (!b->area) {
+			free(b);
+			return NULL;
+		}
+		udp_fwd_batch = b;
+	}
+
+	for (i = 0; i < max; i++) {
+		b->iov[i].iov_base = b->area + (size_t)i * global.tune.bufsize;
+		b->iov[i].iov_len  = global.tune.bufsize;
+		memset(&b->msgs[i], 0, sizeof(b->msgs[i]));
+		b->msgs[i].msg_hdr.msg_name    = &b->addr[i];
+		b->msgs[i].msg_hdr.msg_namelen = sizeof(b->addr[i]);
+		b->msgs[i].msg_hdr.msg_iov     = &b->iov[i];
+		b->msgs[i].msg_hdr.msg_iovlen  = 1;
+	}
+	return b;
+}
+
+/* Receives up to <max> datagrams from socket <fd> into batch <b>. Truncated
+ * datagrams are dropped and counted in <drops>. The iovecs are adjusted to the
+ * size of the datagrams so that they may directly be sent. Returns the number
+ * of datagrams kept, or -1 on error with errno set.
+ */
+static int udp_fwd_recv(int fd, struct udp_fwd_batch *b, int max, unsigned int *drops)
+{
+	int ret, i, n;
+
+#if defined(__linux__)
+	do {
+		ret = recvmmsg(fd, b->msgs, max, MSG_DONTWAIT, NULL);
+	} while (ret < 0 && errno == EINTR);
+#else
+	for (ret = 0; ret < max; ret++) {
+		n = recvmsg(fd, &b->msgs[ret].msg_hdr, MSG_DONTWAIT);
+		if (n < 0) {
+			if (errno == EINTR) {
+				ret--;
+				continue;
+			}
+			break;
+		}
+		b->msgs[ret].msg_len = n;
+	}
+	if (!ret)
+		return -1;
+#endif
+	if (ret <= 0)
+		return ret;
+
+	/* The messages only point to their own iovec and address, which are
+	 * not touched anymore, so they can simply be moved to fill the holes.
+	 */
+	for (i = n = 0; i < ret; i++) {
+		if (b->msgs[i].msg_hdr.msg_flags & MSG_TRUNC) {
+			(*drops)++;
+			continue;
+		}
+		b->iov[i].iov_len = b->msgs[i].msg_len;
+		if (n != i)
+			b->msgs[n] = b->msgs[i];
+		n++;
+	}
+	return n;
+}
+
+/* Sends the <count> datagrams of <msgs> on socket <fd>, using a single syscall
+ * when possible. Those which cannot be sent are dropped and counted in
+ * <drops>. Returns the number of bytes sent.
+ */
+static size_t udp_fwd_send(int fd, struct mmsghdr *msgs, int count, unsigned int *drops)
+{
+	size_t bytes = 0;
+	int sent = 0;
+	int ret, i;
+
+	while (sent < count) {
+#if defined(__linux__)
+		ret = sendmmsg(fd, msgs + sent, count - sent, MSG_DONTWAIT | MSG_NOSIGNAL);
+#else
+		ret = sendmsg(fd, &msgs[sent].msg_hdr, MSG_DONTWAIT | MSG_NOSIGNAL);
+		if (ret >= 0) {
+			msgs[sent].msg_len = ret;
+			ret = 1;
+		}
+#endif
+		if (ret > 0) {
+			for (i = sent; i < sent + ret; i++)
+				bytes += msgs[i].msg_len;
+			sent += ret;
+			continue;
+		}
+
+		if (errno == EINTR)
+			continue;
+
+		if (errno == EAGAIN) {
+			/* the next ones would fail as well */
+			*drops += count - sent;
+			break;
+		}
+
+		/* the error may only concern this datagram, such as a refused
+		 * port reported by an ICMP message.
+		 */
+		(*drops)++;
+		sent++;
+	}
+	return bytes;
+}
+
+/* Sets <addr> to the address and port of server <srv> for a datagram received
+ * on listener <li>. Returns 0 on success or -1 if the server has no address.
+ */
+static int udp_fwd_srv_addr(struct server *srv, struct listener *li, struct sockaddr_storage *addr)
+{
+	int port = srv->svc_port;
+
+	if (!is_addr(&srv->addr))
+		return -1;
+
+	*addr = srv->addr;
+	if (srv->flags & SRV_F_MAPPORTS)
+		port += get_host_port(&li->rx.addr);
+	set_host_port(addr, port);
+	return 0;
+}
+
+/* Fills flow key <key> for a client at <addr> talking to listener <li> */
+static void udp_flow_make_key(struct udp_flow_key *key, struct listener *li, const struct sockaddr_storage *addr)
+{
+	memset(key, 0, sizeof(*key));
+	key->li = li;
+	if (addr->ss_family == AF_INET) {
+		key->port = ((struct sockaddr_in *)addr)->sin_port;
+		memcpy(key->addr, &((struct sockaddr_in *)addr)->sin_addr, 4);
+	}
+	else if (addr->ss_family == AF_INET6) {
+		key->port = ((struct sockaddr_in6 *)addr)->sin6_port;
+		memcpy(key->addr, &((struct sockaddr_in6 *)addr)->sin6_addr, 16);
+	}
+}
+
+/* Returns true if flow <flow> may not forward datagrams anymore */
+static inline int udp_flow_unusable(const struct udp_flow *flow)
+{
+	return flow->srv->cur_state == SRV_ST_STOPPED || (flow->srv->cur_admin & SRV_ADMF_MAINT);
+}
+
+/* Creates a flow for client <cli> whose key is <key>, and inserts it into the
+ * tree of <fwd>. The flow is owned by the calling thread. The write lock must
+ * be held. Returns the flow, or NULL if no server could take it or if the
+ * limits are reached.
+ */
+static struct udp_flow *udp_flow_new(struct udp_fwd *fwd, const struct udp_flow_key *key,
+                                     const struct sockaddr_storage *cli)
+{
+	struct proxy *fe = fwd->fe;
+	struct proxy *be = fwd->be;
+	struct sockaddr_storage addr;
+	struct udp_flow *flow = NULL;
+	struct task *t = NULL;
+	struct server *srv;
+	int fd = -1;
+	int count;
+
+	if ((fe->maxconn && fe->feconn >= fe->maxconn) || actconn >= global.maxconn)
+		return NULL;
+
+	srv = assign_server_by_addr(be, cli);
+	if (!srv || udp_fwd_srv_addr(srv, key->li, &addr) < 0)
+		return NULL;
+
+	fd = socket(addr.ss_family, SOCK_DGRAM, IPPROTO_UDP);
+	if (fd < 0 || fd >= global.maxsock)
+		goto fail;
+
+	fcntl(fd, F_SETFL, O_NONBLOCK);
+	fcntl(fd, F_SETFD, FD_CLOEXEC);
+	if (connect(fd, (struct sockaddr *)&addr, get_addr_len(&addr)) < 0)
+		goto fail;
+
+	flow = pool_alloc(pool_head_udp_flow);
+	t = task_new(tid_bit);
+	if (!flow || !t)
+		goto fail;
+
+	flow->fwd  = fwd;
+	flow->srv  = srv;
+	flow->task = t;
+	flow->cli  = *cli;
+	flow->last = now_ms;
+	flow->dead = 0;
+	flow->fd   = fd;
+	memcpy(&flow->key, key, sizeof(*key));
+	ebmb_insert(&fwd->flows, &flow->node, sizeof(*key));
+
+	_HA_ATOMIC_INC(&actconn);
+	count = _HA_ATOMIC_ADD_FETCH(&fe->feconn, 1);
+	HA_ATOMIC_UPDATE_MAX(&fe->fe_counters.conn_max, count);
+	proxy_inc_fe_conn_ctr(key->li, fe);
+	proxy_inc_fe_sess_ctr(key->li, fe);
+
+	count = _HA_ATOMIC_ADD_FETCH(&be->beconn, 1);
+	HA_ATOMIC_UPDATE_MAX(&be->be_counters.conn_max, count);
+	proxy_inc_be_ctr(be);
+
+	count = _HA_ATOMIC_ADD_FETCH(&srv->cur_sess, 1);
+	HA_ATOMIC_UPDATE_MAX(&srv->counters.cur_sess_max, count);
+	srv_inc_sess_ctr(srv);
+	srv_set_sess_last(srv);
+
+	_HA_ATOMIC_INC(&srv->served);
+	_HA_ATOMIC_INC(&srv->proxy->served);
+	__ha_barrier_atomic_store();
+	if (srv->proxy->lbprm.server_take_conn)
+		srv->proxy->lbprm.server_take_conn(srv, 0);
+
+	fd_insert(fd, flow, udp_fwd_srv_fd_handler, tid_bit);
+	fd_want_recv(fd);
+
+	t->process = udp_flow_expire;
+	t->context = flow;
+	t->expire  = tick_add(now_ms, fwd->timeout);
+	task_queue(t);
+	return flow;
+
+ fail:
+	if (t)
+		task_destroy(t);
+	pool_free(pool_head_udp_flow, flow);
+	if (fd >= 0)
+		close(fd);
+	_HA_ATOMIC_INC(&srv->counters.failed_conns);
+	_HA_ATOMIC_INC(&be->be_counters.failed_conns);
+	return NULL;
+}
+
+/* Returns the usable flow of key <key> for client <cli>, after creating it if
+ * needed. A flow whose server is not usable anymore is removed and left to its
+ * task to be released. The write lock must be held. Returns NULL if no flow
+ * could be created.
+ */
+static struct udp_flow *udp_flow_get(struct udp_fwd *fwd, const struct udp_flow_key *key,
+                                     const struct sockaddr_storage *cli)
+{
+	struct ebmb_node *node;
+	struct udp_flow *flow;
+
+	node = ebmb_lookup(&fwd->flows, key, sizeof(*key));
+	if (node) {
+		flow = ebmb_entry(node, struct udp_flow, node);
+		if (!udp_flow_unusable(flow))
+			return flow;
+
+		ebmb_delete(&flow->node);
+		flow->dead = 1;
+		task_wakeup(flow->task, TASK_WOKEN_OTHER);
+	}
+	return udp_flow_new(fwd, key, cli);
+}
+
+/* Releases flow <flow> which must not be in the tree anymore, as well as its
+ * socket and the resources it held on the proxies and server. Must be called
+ * by the flow's thread.
+ */
+static void udp_flow_free(struct udp_flow *flow)
+{
+	struct udp_fwd *fwd = flow->fwd;
+	struct server *srv = flow->srv;
+
+	fd_delete(flow->fd);
+
+	_HA_ATOMIC_DEC(&srv->served);
+	_HA_ATOMIC_DEC(&srv->proxy->served);
+	__ha_barrier_atomic_store();
+	if (srv->proxy->lbprm.server_drop_conn)
+		srv->proxy->lbprm.server_drop_conn(srv, 0);
+
+	_HA_ATOMIC_DEC(&srv->cur_sess);
+	_HA_ATOMIC_DEC(&fwd->be->beconn);
+	_HA_ATOMIC_DEC(&fwd->fe->feconn);
+	_HA_ATOMIC_DEC(&actconn);
+
+	pool_free(pool_head_udp_flow, flow);
+}
+
+/* Task handler of a flow: releases it once idle for the timeout, or once it
+ * was removed from the tree.
+ */
+static struct task *udp_flow_expire(struct task *t, void *context, unsigned int state)
+{
+	struct udp_flow *flow = context;
+	struct udp_fwd *fwd = flow->fwd;
+
+	if (!HA_ATOMIC_LOAD(&flow->dead)) {
+		t->expire = tick_add(HA_ATOMIC_LOAD(&flow->last), fwd->timeout);
+		if (!tick_is_expired(t->expire, now_ms))
+			return t;
+
+		HA_RWLOCK_WRLOCK(UDP_FWD_LOCK, &fwd->lock);
+		if (!flow->dead)
+			ebmb_delete(&flow->node);
+		HA_RWLOCK_WRUNLOCK(UDP_FWD_LOCK, &fwd->lock);
+	}
+
+	udp_flow_free(flow);
+	task_destroy(t);
+	return NULL;
+}
+
+/* Forwards the <n> datagrams of batch <b> received on listener <li> to the
+ * servers of their clients' flows. Consecutive datagrams from the same client
+ * are sent at once.
+ */
+static void udp_fwd_stateful(struct udp_fwd *fwd, struct listener *li, struct udp_fwd_batch *b,
+                             int n, unsigned int *drops)
+{
+	struct udp_flow_key key, next;
+	struct ebmb_node *node;
+	struct udp_flow *flow;
+	struct server *srv;
+	size_t bytes;
+	int i, j, k, wr;
+
+	for (i = 0; i < n; i = j) {
+		udp_flow_make_key(&key, li, b->msgs[i].msg_hdr.msg_name);
+		for (j = i + 1; j < n; j++) {
+			udp_flow_make_key(&next, li, b->msgs[j].msg_hdr.msg_name);
+			if (memcmp(&key, &next, sizeof(key)) != 0)
+				break;
+		}
+
+		/* the flow cannot be released while we hold the lock */
+		wr = 0;
+		HA_RWLOCK_RDLOCK(UDP_FWD_LOCK, &fwd->lock);
+		node = ebmb_lookup(&fwd->flows, &key, sizeof(key));
+		flow = node ? ebmb_entry(node, struct udp_flow, node) : NULL;
+		if (!flow || udp_flow_unusable(flow)) {
+			HA_RWLOCK_RDUNLOCK(UDP_FWD_LOCK, &fwd->lock);
+			HA_RWLOCK_WRLOCK(UDP_FWD_LOCK, &fwd->lock);
+			wr = 1;
+			flow = udp_flow_get(fwd, &key, b->msgs[i].msg_hdr.msg_name);
+		}
+
+		bytes = 0;
+		srv = NULL;
+		if (flow) {
+			for (k = i; k < j; k++) {
+				b->msgs[k].msg_hdr.msg_name    = NULL;
+				b->msgs[k].msg_hdr.msg_namelen = 0;
+			}
+			bytes = udp_fwd_send(flow->fd, b->msgs + i, j - i, drops);
+			HA_ATOMIC_STORE(&flow->last, now_ms);
+			srv = flow->srv;
+		}
+		else
+			*drops += j - i;
+
+		if (wr)
+			HA_RWLOCK_WRUNLOCK(UDP_FWD_LOCK, &fwd->lock);
+		else
+			HA_RWLOCK_RDUNLOCK(UDP_FWD_LOCK, &fwd->lock);
+
+		if (bytes) {
+			counters_add(fwd->be->be_counters.shards, THR_CTR_BYTES_IN, &fwd->be->be_counters.bytes_in, bytes);
+			counters_add(srv->counters.shards, THR_CTR_BYTES_IN, &srv->counters.bytes_in, bytes);
+		}
+	}
+}
+
+/* Returns the calling thread's unconnected socket for address family <family>,
+ * or -1 if it could not be created.
+ */
+static int udp_fwd_stls_sock(int family)
+{
+	static const int zero = 0;
+	int *fd = &udp_fwd_stls_fd[family == AF_INET6];
+
+	if (unlikely(*fd < 0)) {
+		*fd = socket(family, SOCK_DGRAM, IPPROTO_UDP);
+		if (*fd < 0)
+			return -1;
+		/* we don't want to receive anything on this socket */
+		setsockopt(*fd, SOL_SOCKET, SO_RCVBUF, &zero, sizeof(zero));
+		shutdown(*fd, SHUT_RD);
+		fcntl(*fd, F_SETFL, O_NONBLOCK);
+		fcntl(*fd, F_SETFD, FD_CLOEXEC);
+	}
+	return *fd;
+}
+
+/* Forwards each of the <n> datagrams of batch <b> received on listener <li> to
+ * the server the LB algorithm picks for it. Each datagram counts as a session.
+ */
+static void udp_fwd_stateless(struct udp_fwd *fwd, struct listener *li, struct udp_fwd_batch *b,
+                              int n, unsigned int *drops)
+{
+	struct proxy *be = fwd->be;
+	struct sockaddr_storage *addr;
+	struct server *srv;
+	size_t bytes = 0;
+	int i, j, k, fd;
+
+	for (i = j = 0; i < n; i++) {
+		/* the client's address is replaced with the server's one */
+		addr = b->msgs[i].msg_hdr.msg_name;
+		srv = assign_server_by_addr(be, addr);
+		if (!srv || udp_fwd_srv_addr(srv, li, addr) < 0) {
+			(*drops)++;
+			continue;
+		}
+		b->msgs[i].msg_hdr.msg_namelen = get_addr_len(addr);
+
+		proxy_inc_fe_sess_ctr(li, fwd->fe);
+		proxy_inc_be_ctr(be);
+		srv_inc_sess_ctr(srv);
+		srv_set_sess_last(srv);
+		counters_add(srv->counters.shards, THR_CTR_BYTES_IN, &srv->counters.bytes_in,
+			     b->msgs[i].msg_hdr.msg_iov->iov_len);
+
+		if (j != i)
+			b->msgs[j] = b->msgs[i];
+		j++;
+	}
+
+	for (i = 0; i < j; i = k) {
+		int family = ((struct sockaddr_storage *)b->msgs[i].msg_hdr.msg_name)->ss_family;
+
+		for (k = i + 1; k < j; k++)
+			if (((struct sockaddr_storage *)b->msgs[k].msg_hdr.msg_name)->ss_family != family)
+				break;
+
+		fd = udp_fwd_stls_sock(family);
+		if (fd < 0)
+			*drops += k - i;
+		else
+			bytes += udp_fwd_send(fd, b->msgs + i, k - i, drops);
+	}
+
+	if (bytes)
+		counters_add(be->be_counters.shards, THR_CTR_BYTES_IN, &be->be_counters.bytes_in, bytes);
+}
+
+/* I/O callback of the listeners of "mode udp" frontends: reads a batch of
+ * datagrams and forwards them to the servers.
+ */
+void udp_fwd_fd_handler(int fd)
+{
+	struct listener *l = objt_listener(fdtab[fd].owner);
+	struct udp_fwd_batch *b;
+	unsigned int drops = 0;
+	struct proxy *fe;
+	size_t bytes = 0;
+	int max, n, i;
+
+	if (!l)
+		ABORT_NOW();
+
+	if (!(fdtab[fd].state & FD_POLL_IN) || !fd_recv_ready(fd))
+		return;
+
+	max = l->maxaccept ? l->maxaccept : 1;
+	if ((unsigned int)max > UDP_FWD_BATCH)
+		max = UDP_FWD_BATCH;
+
+	b = udp_fwd_get_batch(max);
+	if (!b)
+		return;
+
+	n = udp_fwd_recv(fd, b, max, &drops);
+	if (n < 0) {
+		if (errno == EAGAIN)
+			fd_cant_recv(fd);
+		return;
+	}
+
+	fe = l->bind_conf->frontend;
+	for (i = 0; i < n; i++) {
+		proxy_inc_fe_req_ctr(l, fe);
+		bytes += b->iov[i].iov_len;
+	}
+
+	if (bytes) {
+		counters_add(fe->fe_counters.shards, THR_CTR_BYTES_IN, &fe->fe_counters.bytes_in, bytes);
+		if (l->counters)
+			counters_add(l->counters->shards, THR_CTR_BYTES_IN, &l->counters->bytes_in, bytes);
+	}
+
+	if (fe->options2 & PR_O2_UDP_STLS)
+		udp_fwd_stateless(fe->udp_fwd, l, b, n, &drops);
+	else
+		udp_fwd_stateful(fe->udp_fwd, l, b, n, &drops);
+
+	if (drops)
+		_HA_ATOMIC_ADD(&fe->fe_counters.failed_req, drops);
+}
+
+/* I/O callback of the sockets connected to the servers: reads a batch of
+ * responses and forwards them to the flow's client from the listener's socket.
+ */
+static void udp_fwd_srv_fd_handler(int fd)
+{
+	struct udp_flow *flow = fdtab[fd].owner;
+	struct listener *li = flow->key.li;
+	struct proxy *fe = flow->fwd->fe;
+	struct proxy *be = flow->fwd->be;
+	struct server *srv = flow->srv;
+	struct udp_fwd_batch *b;
+	unsigned int drops = 0;
+	size_t bytes = 0;
+	int n, i;
+
+	/* errors such as refused ports are reported on the next recv() */
+	if (!fd_recv_ready(fd))
+		return;
+
+	b = udp_fwd_get_batch(UDP_FWD_BATCH);
+	if (!b)
+		return;
+
+	n = udp_fwd_recv(fd, b, UDP_FWD_BATCH, &drops);
+	if (n < 0) {
+		if (errno == EAGAIN)
+			fd_cant_recv(fd);
+		return;
+	}
+
+	HA_ATOMIC_STORE(&flow->last, now_ms);
+	for (i = 0; i < n; i++) {
+		b->msgs[i].msg_hdr.msg_name    = &flow->cli;
+		b->msgs[i].msg_hdr.msg_namelen = get_addr_len(&flow->cli);
+	}
+
+	if (li->rx.fd < 0)
+		drops += n;
+	else if (n)
+		bytes = udp_fwd_send(li->rx.fd, b->msgs, n, &drops);
+
+	if (bytes) {
+		counters_add(fe->fe_counters.shards, THR_CTR_BYTES_OUT, &fe->fe_counters.bytes_out, bytes);
+		counters_add(be->be_counters.shards, THR_CTR_BYTES_OUT, &be->be_counters.bytes_out, bytes);
+		counters_add(srv->counters.shards, THR_CTR_BYTES_OUT, &srv->counters.bytes_out, bytes);
+		if (li->counters)
+			counters_add(li->counters->shards, THR_CTR_BYTES_OUT, &li->counters->bytes_out, bytes);
+	}
+
+	if (drops)
+		_HA_ATOMIC_ADD(&srv->counters.failed_resp, drops);
+}
+
+/* Checks a "mode udp" frontend and sets up its forwarding context. Returns a
+ * combination of ERR_* flags.
+ */
+static int udp_fwd_check(struct proxy *px)
+{
+	struct udp_fwd *fwd;
+	struct listener *l;
+	struct proxy *be;
+	int err = ERR_NONE;
+
+	if (px->mode != PR_MODE_UDP || !(px->cap & PR_CAP_FE) || LIST_ISEMPTY(&px->conf.listeners))
+		return ERR_NONE;
+
+	list_for_each_entry(l, &px->conf.listeners, by_fe) {
+		if (l->rx.proto->sock_type != SOCK_DGRAM ||
+		    (l->rx.addr.ss_family != AF_INET && l->rx.addr.ss_family != AF_INET6)) {
+			ha_alert("%s '%s': 'bind %s' at [%s:%d] is not a UDP address (note that 'mode udp' must be set before 'bind').\n",
+				 proxy_type_str(px), px->id, l->bind_conf->arg, l->bind_conf->file, l->bind_conf->line);
+			err |= ERR_ALERT | ERR_FATAL;
+			continue;
+		}
+		l->rx.iocb = udp_fwd_fd_handler;
+	}
+
+	be = px->defbe.be ? px->defbe.be : px;
+	if (!(be->cap & PR_CAP_BE) || !be->srv) {
+		ha_alert("%s '%s' in 'mode udp' has no server to forward datagrams to.\n",
+			 proxy_type_str(px), px->id);
+		err |= ERR_ALERT | ERR_FATAL;
+	}
+
+	if (!LIST_ISEMPTY(&px->switching_rules))
+		ha_warning("%s '%s': 'use_backend' rules are ignored in 'mode udp', only the default backend is used.\n",
+			   proxy_type_str(px), px->id);
+
+	if (err & ERR_CODE)
+		return err;
+
+	fwd = calloc(1, sizeof(*fwd));
+	if (!fwd) {
+		ha_alert("%s '%s': out of memory while setting up 'mode udp'.\n", proxy_type_str(px), px->id);
+		return err | ERR_ALERT | ERR_FATAL;
+	}
+
+	fwd->fe = px;
+	fwd->be = be;
+	fwd->flows = EB_ROOT_UNIQUE;
+	fwd->timeout = tick_isset(px->timeout.client) ? px->timeout.client : UDP_FWD_DEF_TIMEOUT;
+	HA_RWLOCK_INIT(&fwd->lock);
+	px->udp_fwd = fwd;
+	return err;
+}
+
+/* Releases the forwarding context of proxy <px> and its remaining flows */
+static void udp_fwd_deinit(struct proxy *px)
+{
+	struct udp_fwd *fwd = px->udp_fwd;
+	struct ebmb_node *node, *next;
+
+	if (!fwd)
+		return;
+
+	node = ebmb_first(&fwd->flows);
+	while (node) {
+		next = ebmb_next(node);
+		ebmb_delete(node);
+		pool_free(pool_head_udp_flow, ebmb_entry(node, struct udp_flow, node));
+		node = next;
+	}
+	HA_RWLOCK_DESTROY(&fwd->lock);
+	ha_free(&px->udp_fwd);
+}
+
+static void udp_fwd_free_per_thread()
+{
+	int i;
+
+	if (udp_fwd_batch) {
+		free(udp_fwd_batch->area);
+		ha_free(&udp_fwd_batch);
+	}
+
+	for (i = 0; i < 2; i++) {
+		if (udp_fwd_stls_fd[i] >= 0) {
+			close(udp_fwd_stls_fd[i]);
+			udp_fwd_stls_fd[i] = -1;
+		}
+	}
+}
+
+REGISTER_POST_PROXY_CHECK(udp_fwd_check);
+REGISTER_PROXY_DEINIT(udp_fwd_deinit);
+REGISTER_PER_THREAD_FREE(udp_fwd_free_per_thread);
+
+/*
+ * Local variables:
+ *  c-indent-level: 8
+ *  c-basic-offset: 8
+ * End:
+ */
@@ -1,5 +1,7 @@
 #include <ctype.h>
 
+#include <import/ebsttree.h>
+
 #include <haproxy/api.h>
 #include <haproxy/arg.h>
 #include <haproxy/buf.h>
@@ -25,13 +27,29 @@ DECLARE_STATIC_POOL(var_pool, "vars", sizeof(struct var));
 /* list of variables for the process scope. */
 struct vars proc_vars THREAD_ALIGNED(64);
 
-/* This array contain all the names of all the HAProxy vars.
- * This permits to identify two variables name with
- * only one pointer. It permits to not using  strdup() for
- * each variable name used during the runtime.
+/* A variable name, stored once in the var_names tree so that two variables
+ * names may be identified by a single pointer, and so that strdup() is not
+ * needed for each variable name used during the runtime. <slot> contains for
+ * each scope the index of the variable in the slots of this scope, or -1. The
+ * name is stored in <node>'s key.
+ */
+struct var_name {
+	int slot[SCOPE_CHECK + 1];
+	struct ebmb_node node;
+};
+
+/* This tree contains all the names of all the HAProxy vars. */
+static struct eb_root var_names = EB_ROOT_UNIQUE;
+
+/* Names registered from the configuration are given a slot in each scope they
+ * are used in, so that these variables are stored at a known place in a table
+ * allocated at once for each <struct vars>, and looked up without walking the
+ * list. Names registered later (Lua, SPOE, CLI) only use the list. Slots are
+ * only used once vars_freeze() has allocated the pools for these tables.
  */
-static char **var_names = NULL;
-static int var_names_nb = 0;
+static int var_slots_nb[SCOPE_CHECK + 1];
+static struct pool_head *var_slots_pool[SCOPE_CHECK + 1];
+static int vars_frozen = 0;
 
 /* This array of int contains the system limits per context. */
 static unsigned int var_global_limit = 0;
@@ -155,11 +173,25 @@ unsigned int var_clear(struct var *var)
 		size += var->data.u.meth.str.data;
 	}
 	LIST_DELETE(&var->l);
-	pool_free(var_pool, var);
+	if (var->slot >= 0)
+		var->name = NULL;
+	else
+		pool_free(var_pool, var);
 	size += sizeof(struct var);
 	return size;
 }
 
+/* Releases the slots of <vars> if any. All its variables must have been
+ * cleared.
+ */
+static inline void vars_free_slots(struct vars *vars)
+{
+	if (vars->slots) {
+		pool_free(var_slots_pool[vars->scope], vars->slots);
+		vars->slots = NULL;
+	}
+}
+
 /* This function free all the memory used by all the variables
  * in the list.
  */
@@ -172,6 +204,7 @@ void vars_prune(struct vars *vars, struct session *sess, struct stream *strm)
 	list_for_each_entry_safe(var, tmp, &vars->head, l) {
 		size += var_clear(var);
 	}
+	vars_free_slots(vars);
 	HA_RWLOCK_WRUNLOCK(VARS_LOCK, &vars->rwlock);
 	var_accounting_diff(vars, sess, strm, -size);
 }
@@ -188,6 +221,7 @@ void vars_prune_per_sess(struct vars *vars)
 	list_for_each_entry_safe(var, tmp, &vars->head, l) {
 		size += var_clear(var);
 	}
+	vars_free_slots(vars);
 	HA_RWLOCK_WRUNLOCK(VARS_LOCK, &vars->rwlock);
 
 	_HA_ATOMIC_SUB(&vars->size, size);
@@ -199,6 +233,7 @@ void vars_prune_per_sess(struct vars *vars)
 void vars_init(struct vars *vars, enum vars_scope scope)
 {
 	LIST_INIT(&vars->head);
+	vars->slots = NULL;
 	vars->scope = scope;
 	vars->size = 0;
 	HA_RWLOCK_INIT(&vars->rwlock);
@@ -206,7 +241,9 @@ void vars_init(struct vars *vars, enum vars_scope scope)
 
 /* This function declares a new variable name. It returns a pointer
  * on the string identifying the name. This function assures that
- * the same name exists only once.
+ * the same name exists only once. If <slot> is not NULL, it is set to
+ * the index of the variable's slot in its scope, or -1. A slot is given
+ * to names declared (<alloc> set) before vars_freeze() is called.
  *
  * This function check if the variable name is acceptable.
  *
@@ -216,10 +253,11 @@ void vars_init(struct vars *vars, enum vars_scope scope)
  * name.
  */
 static char *register_name(const char *name, int len, enum vars_scope *scope,
-			   int alloc, char **err)
+			   int *slot, int alloc, char **err)
 {
 	int i;
-	char **var_names2;
+	struct ebmb_node *node;
+	struct var_name *vn;
 	const char *tmp;
 	char *res = NULL;
 
@@ -273,46 +311,41 @@ static char *register_name(const char *name, int len, enum vars_scope *scope,
 
 
 	/* Look for existing variable name. */
-	for (i = 0; i < var_names_nb; i++)
-		if (strncmp(var_names[i], name, len) == 0 && var_names[i][len] == '\0') {
-			res = var_names[i];
-			goto end;
-		}
-
-	if (!alloc) {
-		res = NULL;
-		goto end;
+	node = ebst_lookup_len(&var_names, name, len);
+	if (node) {
+		vn = container_of(node, struct var_name, node);
+		goto found;
 	}
 
-	/* Store variable name. If realloc fails, var_names remains valid */
-	var_names2 = realloc(var_names, (var_names_nb + 1) * sizeof(*var_names));
-	if (!var_names2) {
-		memprintf(err, "out of memory error");
-		res = NULL;
-		goto end;
-	}
-	var_names_nb++;
-	var_names = var_names2;
-	var_names[var_names_nb - 1] = malloc(len + 1);
-	if (!var_names[var_names_nb - 1]) {
-		memprintf(err, "out of memory error");
-		res = NULL;
+	if (!alloc)
 		goto end;
-	}
-	memcpy(var_names[var_names_nb - 1], name, len);
-	var_names[var_names_nb - 1][len] = '\0';
 
 	/* Check variable name syntax. */
-	tmp = var_names[var_names_nb - 1];
-	while (*tmp) {
+	for (tmp = name; tmp < name + len; tmp++) {
 		if (!isalnum((unsigned char)*tmp) && *tmp != '_' && *tmp != '.') {
-			memprintf(err, "invalid syntax at char '%s'", tmp);
-			res = NULL;
+			memprintf(err, "invalid syntax at char '%.*s'", (int)(name + len - tmp), tmp);
 			goto end;
 		}
-		tmp++;
 	}
-	res = var_names[var_names_nb - 1];
+
+	/* Store variable name. */
+	vn = calloc(1, sizeof(*vn) + len + 1);
+	if (!vn) {
+		memprintf(err, "out of memory error");
+		goto end;
+	}
+	for (i = 0; i <= SCOPE_CHECK; i++)
+		vn->slot[i] = -1;
+	memcpy(vn->node.key, name, len);
+	vn->node.key[len] = '\0';
+	ebst_insert(&var_names, &vn->node);
+
+  found:
+	if (alloc && !vars_frozen && vn->slot[*scope] < 0)
+		vn->slot[*scope] = var_slots_nb[*scope]++;
+	if (slot)
+		*slot = vn->slot[*scope];
+	res = (char *)vn->node.key;
 
   end:
 	if (alloc)
@@ -323,11 +356,19 @@ static char *register_name(const char *name, int len, enum vars_scope *scope,
 	return res;
 }
 
-/* This function returns an existing variable or returns NULL. */
-static inline struct var *var_get(struct vars *vars, const char *name)
+/* This function returns an existing variable or returns NULL. <slot> is the
+ * variable's slot in the scope of <vars>, or -1.
+ */
+static inline struct var *var_get(struct vars *vars, const char *name, int slot)
 {
 	struct var *var;
 
+	if (slot >= 0 && vars_frozen) {
+		if (!vars->slots || !vars->slots[slot].name)
+			return NULL;
+		return &vars->slots[slot];
+	}
+
 	list_for_each_entry(var, &vars->head, l)
 		if (var->name == name)
 			return var;
@@ -343,16 +384,16 @@ static int smp_fetch_var(const struct arg *args, struct sample *smp, const char
 }
 
 /* This function search in the <head> a variable with the same
- * pointer value that the <name>. If the variable doesn't exists,
- * create it. The function stores a copy of smp> if the variable.
- * It returns 0 if fails, else returns 1.
+ * pointer value that the <name>, or in its <slot> if not negative.
+ * If the variable doesn't exists, create it. The function stores a
+ * copy of smp> if the variable. It returns 0 if fails, else returns 1.
  */
-static int sample_store(struct vars *vars, const char *name, struct sample *smp)
+static int sample_store(struct vars *vars, const char *name, int slot, struct sample *smp)
 {
 	struct var *var;
 
 	/* Look for existing variable name. */
-	var = var_get(vars, name);
+	var = var_get(vars, name, slot);
 
 	if (var) {
 		/* free its used memory. */
@@ -374,11 +415,23 @@ static int sample_store(struct vars *vars, const char *name, struct sample *smp)
 			return 0;
 
 		/* Create new entry. */
-		var = pool_alloc(var_pool);
-		if (!var)
-			return 0;
+		if (slot >= 0 && vars_frozen) {
+			if (!vars->slots) {
+				vars->slots = pool_zalloc(var_slots_pool[vars->scope]);
+				if (!vars->slots)
+					return 0;
+			}
+			var = &vars->slots[slot];
+		}
+		else {
+			var = pool_alloc(var_pool);
+			if (!var)
+				return 0;
+			slot = -1;
+		}
 		LIST_APPEND(&vars->head, &var->l);
 		var->name = name;
+		var->slot = slot;
 	}
 
 	/* Set type. */
@@ -439,7 +492,7 @@ static int sample_store(struct vars *vars, const char *name, struct sample *smp)
 }
 
 /* Returns 0 if fails, else returns 1. Note that stream may be null for SCOPE_SESS. */
-static inline int sample_store_stream(const char *name, enum vars_scope scope, struct sample *smp)
+static inline int sample_store_stream(const char *name, enum vars_scope scope, int slot, struct sample *smp)
 {
 	struct vars *vars;
 	int ret;
@@ -449,13 +502,13 @@ static inline int sample_store_stream(const char *name, enum vars_scope scope, s
 		return 0;
 
 	HA_RWLOCK_WRLOCK(VARS_LOCK, &vars->rwlock);
-	ret = sample_store(vars, name, smp);
+	ret = sample_store(vars, name, slot, smp);
 	HA_RWLOCK_WRUNLOCK(VARS_LOCK, &vars->rwlock);
 	return ret;
 }
 
 /* Returns 0 if fails, else returns 1. Note that stream may be null for SCOPE_SESS. */
-static inline int sample_clear_stream(const char *name, enum vars_scope scope, struct sample *smp)
+static inline int sample_clear_stream(const char *name, enum vars_scope scope, int slot, struct sample *smp)
 {
 	struct vars *vars;
 	struct var  *var;
@@ -467,7 +520,7 @@ static inline int sample_clear_stream(const char *name, enum vars_scope scope, s
 
 	/* Look for existing variable name. */
 	HA_RWLOCK_WRLOCK(VARS_LOCK, &vars->rwlock);
-	var = var_get(vars, name);
+	var = var_get(vars, name, slot);
 	if (var) {
 		size = var_clear(var);
 		var_accounting_diff(vars, smp->sess, smp->strm, -size);
@@ -479,13 +532,13 @@ static inline int sample_clear_stream(const char *name, enum vars_scope scope, s
 /* Returns 0 if fails, else returns 1. */
 static int smp_conv_store(const struct arg *args, struct sample *smp, void *private)
 {
-	return sample_store_stream(args[0].data.var.name, args[0].data.var.scope, smp);
+	return sample_store_stream(args[0].data.var.name, args[0].data.var.scope, args[0].data.var.slot, smp);
 }
 
 /* Returns 0 if fails, else returns 1. */
 static int smp_conv_clear(const struct arg *args, struct sample *smp, void *private)
 {
-	return sample_clear_stream(args[0].data.var.name, args[0].data.var.scope, smp);
+	return sample_clear_stream(args[0].data.var.name, args[0].data.var.scope, args[0].data.var.slot, smp);
 }
 
 /* This functions check an argument entry and fill it with a variable
@@ -496,6 +549,7 @@ int vars_check_arg(struct arg *arg, char **err)
 {
 	char *name;
 	enum vars_scope scope;
+	int slot;
 
 	/* Check arg type. */
 	if (arg->type != ARGT_STR) {
@@ -505,8 +559,7 @@ int vars_check_arg(struct arg *arg, char **err)
 
 	/* Register new variable name. */
 	name = register_name(arg->data.str.area, arg->data.str.data, &scope,
-			     1,
-			     err);
+			     &slot, 1, err);
 	if (!name)
 		return 0;
 
@@ -517,6 +570,7 @@ int vars_check_arg(struct arg *arg, char **err)
 	arg->type = ARGT_VAR;
 	arg->data.var.name = name;
 	arg->data.var.scope = scope;
+	arg->data.var.slot = slot;
 	return 1;
 }
 
@@ -527,13 +581,14 @@ int vars_check_arg(struct arg *arg, char **err)
 int vars_set_by_name_ifexist(const char *name, size_t len, struct sample *smp)
 {
 	enum vars_scope scope;
+	int slot;
 
 	/* Resolve name and scope. */
-	name = register_name(name, len, &scope, 0, NULL);
+	name = register_name(name, len, &scope, &slot, 0, NULL);
 	if (!name)
 		return 0;
 
-	return sample_store_stream(name, scope, smp);
+	return sample_store_stream(name, scope, slot, smp);
 }
 
 
@@ -543,13 +598,14 @@ int vars_set_by_name_ifexist(const char *name, size_t len, struct sample *smp)
 int vars_set_by_name(const char *name, size_t len, struct sample *smp)
 {
 	enum vars_scope scope;
+	int slot;
 
 	/* Resolve name and scope. */
-	name = register_name(name, len, &scope, 1, NULL);
+	name = register_name(name, len, &scope, &slot, 1, NULL);
 	if (!name)
 		return 0;
 
-	return sample_store_stream(name, scope, smp);
+	return sample_store_stream(name, scope, slot, smp);
 }
 
 /* This function unset a variable if it was already defined.
@@ -558,13 +614,14 @@ int vars_set_by_name(const char *name, size_t len, struct sample *smp)
 int vars_unset_by_name_ifexist(const char *name, size_t len, struct sample *smp)
 {
 	enum vars_scope scope;
+	int slot;
 
 	/* Resolve name and scope. */
-	name = register_name(name, len, &scope, 0, NULL);
+	name = register_name(name, len, &scope, &slot, 0, NULL);
 	if (!name)
 		return 0;
 
-	return sample_clear_stream(name, scope, smp);
+	return sample_clear_stream(name, scope, slot, smp);
 }
 
 
@@ -581,9 +638,10 @@ int vars_get_by_name(const char *name, size_t len, struct sample *smp)
 	struct vars *vars;
 	struct var *var;
 	enum vars_scope scope;
+	int slot;
 
 	/* Resolve name and scope. */
-	name = register_name(name, len, &scope, 0, NULL);
+	name = register_name(name, len, &scope, &slot, 0, NULL);
 	if (!name)
 		return 0;
 
@@ -594,7 +652,7 @@ int vars_get_by_name(const char *name, size_t len, struct sample *smp)
 
 	/* Get the variable entry. */
 	HA_RWLOCK_RDLOCK(VARS_LOCK, &vars->rwlock);
-	var = var_get(vars, name);
+	var = var_get(vars, name, slot);
 	if (!var) {
 		HA_RWLOCK_RDUNLOCK(VARS_LOCK, &vars->rwlock);
 		return 0;
@@ -631,7 +689,7 @@ int vars_get_by_desc(const struct var_desc *var_desc, struct sample *smp)
 
 	/* Get the variable entry. */
 	HA_RWLOCK_RDLOCK(VARS_LOCK, &vars->rwlock);
-	var = var_get(vars, var_desc->name);
+	var = var_get(vars, var_desc->name, var_desc->slot);
 	if (!var) {
 		HA_RWLOCK_RDUNLOCK(VARS_LOCK, &vars->rwlock);
 		return 0;
@@ -675,7 +733,7 @@ static enum act_return action_store(struct act_rule *rule, struct proxy *px,
 		return ACT_RET_CONT;
 
 	/* Store the sample, and ignore errors. */
-	sample_store_stream(rule->arg.vars.name, rule->arg.vars.scope, &smp);
+	sample_store_stream(rule->arg.vars.name, rule->arg.vars.scope, rule->arg.vars.slot, &smp);
 	return ACT_RET_CONT;
 }
 
@@ -689,7 +747,7 @@ static enum act_return action_clear(struct act_rule *rule, struct proxy *px,
 	smp_set_owner(&smp, px, sess, s, SMP_OPT_FINAL);
 
 	/* Clear the variable using the sample context, and ignore errors. */
-	sample_clear_stream(rule->arg.vars.name, rule->arg.vars.scope, &smp);
+	sample_clear_stream(rule->arg.vars.name, rule->arg.vars.scope, rule->arg.vars.slot, &smp);
 	return ACT_RET_CONT;
 }
 
@@ -759,7 +817,8 @@ static enum act_parse_ret parse_store(const char **args, int *arg, struct proxy
 		return ACT_RET_PRS_ERR;
 	}
 
-	rule->arg.vars.name = register_name(var_name, var_len, &rule->arg.vars.scope, 1, err);
+	rule->arg.vars.name = register_name(var_name, var_len, &rule->arg.vars.scope,
+	                                    &rule->arg.vars.slot, 1, err);
 	if (!rule->arg.vars.name)
 		return ACT_RET_PRS_ERR;
 
@@ -1034,11 +1093,70 @@ static int vars_max_size_check(char **args, int section_type, struct proxy *curp
 	return vars_max_size(args, section_type, curpx, defpx, file, line, err, &var_check_limit);
 }
 
+/* Creates the pools of slots for all scopes once the configuration is parsed,
+ * and moves the process-wide variables which were set while parsing it to
+ * their slots. Names registered after this do not get a slot anymore.
+ */
+static int vars_freeze()
+{
+	static char *pool_names[SCOPE_CHECK + 1] = {
+		[SCOPE_SESS]  = "vars_sess",
+		[SCOPE_TXN]   = "vars_txn",
+		[SCOPE_REQ]   = "vars_req",
+		[SCOPE_RES]   = "vars_res",
+		[SCOPE_PROC]  = "vars_proc",
+		[SCOPE_CHECK] = "vars_check",
+	};
+	struct var_name *vn;
+	struct var *var, *tmp, *new;
+	int scope, slot;
+
+	for (scope = 0; scope <= SCOPE_CHECK; scope++) {
+		if (!var_slots_nb[scope])
+			continue;
+		var_slots_pool[scope] = create_pool(pool_names[scope], var_slots_nb[scope] * sizeof(struct var), MEM_F_SHARED);
+		if (!var_slots_pool[scope]) {
+			ha_alert("Vars: out of memory while allocating the variables pools.\n");
+			return ERR_ALERT | ERR_FATAL;
+		}
+	}
+	vars_frozen = 1;
+
+	list_for_each_entry_safe(var, tmp, &proc_vars.head, l) {
+		vn = container_of(var->name, struct var_name, node.key);
+		slot = vn->slot[SCOPE_PROC];
+		if (var->slot >= 0 || slot < 0)
+			continue;
+
+		if (!proc_vars.slots) {
+			proc_vars.slots = pool_zalloc(var_slots_pool[SCOPE_PROC]);
+			if (!proc_vars.slots) {
+				ha_alert("Vars: out of memory while allocating the process-wide variables.\n");
+				return ERR_ALERT | ERR_FATAL;
+			}
+		}
+		new = &proc_vars.slots[slot];
+		new->name = var->name;
+		new->slot = slot;
+		new->data = var->data;
+		LIST_APPEND(&proc_vars.head, &new->l);
+		LIST_DELETE(&var->l);
+		pool_free(var_pool, var);
+	}
+	return ERR_NONE;
+}
+
+REGISTER_POST_CHECK(vars_freeze);
+
 static void vars_deinit()
 {
-	while (var_names_nb-- > 0)
-		free(var_names[var_names_nb]);
-	free(var_names);
+	struct ebmb_node *node, *next;
+
+	for (node = ebmb_first(&var_names); node; node = next) {
+		next = ebmb_next(node);
+		ebmb_delete(node);
+		free(container_of(node, struct var_name, node));
+	}
 }
 
 REGISTER_POST_DEINIT(vars_deinit);
@@ -11,7 +11,9 @@
 
 #include <signal.h>
 #include <time.h>
+#include <sys/syscall.h>
 
+#include <haproxy/activity.h>
 #include <haproxy/api.h>
 #include <haproxy/debug.h>
 #include <haproxy/errors.h>
@@ -27,6 +29,9 @@
  */
 #if defined(USE_RT) && (_POSIX_TIMERS > 0) && defined(_POSIX_THREAD_CPUTIME)
 
+/* set in the timer's value for the stall sampling timers */
+#define WDT_STALL_TIMER 0x10000
+
 /* Setup (or ping) the watchdog timer for thread <thr>. Returns non-zero on
  * success, zero on failure. It interrupts once per second of CPU time. It
  * happens that timers based on the CPU time are not automatically re-armed
@@ -57,6 +62,13 @@ void wdt_handler(int sig, siginfo_t *si, void *arg)
 		 */
 		thr = si->si_value.sival_int;
 
+		/* the stall sampling timers are delivered to their own thread */
+		if (thr & WDT_STALL_TIMER) {
+			if ((thr & ~WDT_STALL_TIMER) == tid)
+				sched_sample_stall();
+			return;
+		}
+
 		/* cannot happen unless an unknown timer tries to play with our
 		 * nerves. Let's die for now if this happens.
 		 */
@@ -124,11 +136,48 @@ void wdt_handler(int sig, siginfo_t *si, void *arg)
 	wdt_ping(thr);
 }
 
+/* Sets the period of the current thread's stall sampling timer to <ns>
+ * nanoseconds of CPU time, or stops it if <ns> is zero. The timer is created
+ * upon first use. Since its signal must interrupt the thread it samples, this
+ * requires SIGEV_THREAD_ID. Returns non-zero on success.
+ */
+int wdt_set_stall_period(unsigned long long ns)
+{
+#ifdef SIGEV_THREAD_ID
+	struct itimerspec its;
+
+	if (ti->stall_timer == TIMER_INVALID) {
+		struct sigevent sev = { };
+
+		if (!ns)
+			return 1;
+
+		sev.sigev_notify           = SIGEV_THREAD_ID;
+		sev.sigev_signo            = WDTSIG;
+		sev.sigev_value.sival_int  = tid | WDT_STALL_TIMER;
+		sev.sigev_notify_thread_id = syscall(SYS_gettid);
+		if (timer_create(ti->clock_id, &sev, &ti->stall_timer) == -1) {
+			ti->stall_timer = TIMER_INVALID;
+			return 0;
+		}
+	}
+
+	its.it_value.tv_sec  = ns / 1000000000ULL;
+	its.it_value.tv_nsec = ns % 1000000000ULL;
+	its.it_interval      = its.it_value;
+	return timer_settime(ti->stall_timer, 0, &its, NULL) == 0;
+#else
+	return 0;
+#endif
+}
+
 int init_wdt_per_thread()
 {
 	struct sigevent sev = { };
 	sigset_t set;
 
+	ti->stall_timer = TIMER_INVALID;
+
 	/* unblock the WDTSIG signal we intend to use */
 	sigemptyset(&set);
 	sigaddset(&set, WDTSIG);
@@ -161,6 +210,8 @@ void deinit_wdt_per_thread()
 {
 	if (ti->wd_timer != TIMER_INVALID)
 		timer_delete(ti->wd_timer);
+	if (ti->stall_timer != TIMER_INVALID)
+		timer_delete(ti->stall_timer);
 }
 
 /* registers the watchdog signal handler and returns 0. This sets up the signal
@@ -181,4 +232,12 @@ int init_wdt()
 REGISTER_POST_CHECK(init_wdt);
 REGISTER_PER_THREAD_INIT(init_wdt_per_thread);
 REGISTER_PER_THREAD_DEINIT(deinit_wdt_per_thread);
+
+#else /* no thread CPU time timers */
+
+int wdt_set_stall_period(unsigned long long ns)
+{
+	return 0;
+}
+
 #endif
@@ -0,0 +1,413 @@
+/*
+ * Early drop of blocked sources using an XDP program
+ *
+ * Copyright 2021 HAProxy Technologies
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ *
+ * The "xdp-drop" action rejects a connection and adds its source address to
+ * a BPF hash map, with an expiration date. An XDP program attached to the
+ * interfaces the frontend's listeners are bound to looks up the source of
+ * each incoming IPv4 or IPv6 packet in this map, and drops it if it was found
+ * and did not expire. Blocked sources thus do not cost any accept, session or
+ * rule evaluation anymore, while the decision to block them remains in the
+ * configuration, typically based on stick table counters. The map is an LRU
+ * one, so that the least recently blocked sources are evicted first when it
+ * is full. As for sockmap.c, the program is hand-assembled and loaded with
+ * the raw bpf() syscall, and it is attached using rtnetlink.
+ *
+ * Attaching the program replaces any XDP program already attached to the
+ * interface, which allows a new process to take over upon reload. Upon exit,
+ * the program is only detached if it was not replaced meanwhile. Sources are
+ * keyed as IPv6 addresses, with IPv4 ones mapped into ::ffff:0:0/96. Only
+ * packets without VLAN tags are inspected.
+ */
+
+#include <errno.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <net/if.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <linux/bpf.h>
+#include <linux/if_ether.h>
+#include <linux/if_link.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+
+#include <haproxy/action.h>
+#include <haproxy/api.h>
+#include <haproxy/connection.h>
+#include <haproxy/errors.h>
+#include <haproxy/list.h>
+#include <haproxy/listener-t.h>
+#include <haproxy/proxy.h>
+#include <haproxy/session-t.h>
+#include <haproxy/tcp_rules.h>
+#include <haproxy/tools.h>
+
+/* an interface the program must be attached to */
+struct xdp_if {
+	struct list list;
+	char *name;
+	int ifindex;                       /* 0 until attached */
+};
+
+static struct list xdp_ifs = LIST_HEAD_INIT(xdp_ifs);
+static int xdp_map = -1;                 /* blocked sources */
+static int xdp_prog = -1;                /* the XDP program */
+
+#define XDP_INSN(c, d, s, o, i) \
+	((struct bpf_insn){ .code = (c), .dst_reg = (d), .src_reg = (s), .off = (o), .imm = (i) })
+
+static int xdp_bpf(int cmd, union bpf_attr *attr)
+{
+	return syscall(__NR_bpf, cmd, attr, sizeof(*attr));
+}
+
+/* Sends RTM_SETLINK request to attach program <fd> to interface <ifindex>, or
+ * to detach the current one if <fd> is -1. If <expected> is not -1, the change
+ * only happens if this program is the one currently attached. Returns 0 on
+ * success, otherwise -1 with errno set.
+ */
+static int xdp_set_link(int ifindex, int fd, int expected)
+{
+	struct {
+		struct nlmsghdr nh;
+		struct ifinfomsg ifi;
+		char attrs[64];
+	} req;
+	struct {
+		struct nlmsghdr nh;
+		struct nlmsgerr err;
+		char pad[64];
+	} ack;
+	struct nlattr *nest, *nla;
+	uint32_t flags = XDP_FLAGS_REPLACE;
+	int sock, ret;
+
+	memset(&req, 0, sizeof(req));
+	req.nh.nlmsg_len   = NLMSG_LENGTH(sizeof(req.ifi));
+	req.nh.nlmsg_type  = RTM_SETLINK;
+	req.nh.nlmsg_flags = NLM_F_REQUEST | NLM_F_ACK;
+	req.ifi.ifi_family = AF_UNSPEC;
+	req.ifi.ifi_index  = ifindex;
+
+	nest = (struct nlattr *)((char *)&req + NLMSG_ALIGN(req.nh.nlmsg_len));
+	nest->nla_type = NLA_F_NESTED | IFLA_XDP;
+	nest->nla_len  = NLA_HDRLEN;
+
+	nla = (struct nlattr *)((char *)nest + nest->nla_len);
+	nla->nla_type = IFLA_XDP_FD;
+	nla->nla_len  = NLA_HDRLEN + sizeof(fd);
+	memcpy((char *)nla + NLA_HDRLEN, &fd, sizeof(fd));
+	nest->nla_len += NLA_ALIGN(nla->nla_len);
+
+	if (expected != -1) {
+		nla = (struct nlattr *)((char *)nest + nest->nla_len);
+		nla->nla_type = IFLA_XDP_FLAGS;
+		nla->nla_len  = NLA_HDRLEN + sizeof(flags);
+		memcpy((char *)nla + NLA_HDRLEN, &flags, sizeof(flags));
+		nest->nla_len += NLA_ALIGN(nla->nla_len);
+
+		nla = (struct nlattr *)((char *)nest + nest->nla_len);
+		nla->nla_type = IFLA_XDP_EXPECTED_FD;
+		nla->nla_len  = NLA_HDRLEN + sizeof(expected);
+		memcpy((char *)nla + NLA_HDRLEN, &expected, sizeof(expected));
+		nest->nla_len += NLA_ALIGN(nla->nla_len);
+	}
+	req.nh.nlmsg_len = NLMSG_ALIGN(req.nh.nlmsg_len) + nest->nla_len;
+
+	sock = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
+	if (sock < 0)
+		return -1;
+
+	ret = -1;
+	if (send(sock, &req, req.nh.nlmsg_len, 0) < 0)
+		goto end;
+
+	if (recv(sock, &ack, sizeof(ack), 0) < (int)NLMSG_LENGTH(sizeof(ack.err)))
+		goto end;
+
+	if (ack.nh.nlmsg_type != NLMSG_ERROR) {
+		errno = EPROTO;
+		goto end;
+	}
+
+	if (ack.err.error) {
+		errno = -ack.err.error;
+		goto end;
+	}
+	ret = 0;
+ end:
+	close(sock);
+	return ret;
+}
+
+/* Creates the map and loads the program. Returns 0 on success, otherwise -1
+ * with errno set.
+ */
+static int xdp_load()
+{
+	/* if the packet is long enough for an Ethernet and an IPv6 header,
+	 * build the key from the IPv6 or the IPv4 source address, look it up,
+	 * and drop the packet if the entry found did not expire yet.
+	 */
+	struct bpf_insn prog[] = {
+		/* 0 */  XDP_INSN(BPF_LDX | BPF_MEM | BPF_W, BPF_REG_2, BPF_REG_1, offsetof(struct xdp_md, data), 0),
+		/* 1 */  XDP_INSN(BPF_LDX | BPF_MEM | BPF_W, BPF_REG_3, BPF_REG_1, offsetof(struct xdp_md, data_end), 0),
+		/* 2 */  XDP_INSN(BPF_ALU64 | BPF_MOV | BPF_X, BPF_REG_4, BPF_REG_2, 0, 0),
+		/* 3 */  XDP_INSN(BPF_ALU64 | BPF_ADD | BPF_K, BPF_REG_4, 0, 0, ETH_HLEN + 40),
+		/* 4 */  XDP_INSN(BPF_JMP | BPF_JGT | BPF_X, BPF_REG_4, BPF_REG_3, 24, 0),   // -> 29
+		/* 5 */  XDP_INSN(BPF_LDX | BPF_MEM | BPF_H, BPF_REG_4, BPF_REG_2, 12, 0),
+		/* 6 */  XDP_INSN(BPF_JMP | BPF_JEQ | BPF_K, BPF_REG_4, 0, 6, htons(ETH_P_IP)),     // -> 13
+		/* 7 */  XDP_INSN(BPF_JMP | BPF_JNE | BPF_K, BPF_REG_4, 0, 21, htons(ETH_P_IPV6)),  // -> 29
+		/* IPv6: copy the 16 bytes of the source address */
+		/* 8 */  XDP_INSN(BPF_LDX | BPF_MEM | BPF_DW, BPF_REG_4, BPF_REG_2, ETH_HLEN + 8, 0),
+		/* 9 */  XDP_INSN(BPF_STX | BPF_MEM | BPF_DW, BPF_REG_10, BPF_REG_4, -16, 0),
+		/* 10 */ XDP_INSN(BPF_LDX | BPF_MEM | BPF_DW, BPF_REG_4, BPF_REG_2, ETH_HLEN + 16, 0),
+		/* 11 */ XDP_INSN(BPF_STX | BPF_MEM | BPF_DW, BPF_REG_10, BPF_REG_4, -8, 0),
+		/* 12 */ XDP_INSN(BPF_JMP | BPF_JA, 0, 0, 5, 0),                               // -> 18
+		/* IPv4: build ::ffff:<addr> */
+		/* 13 */ XDP_INSN(BPF_ALU64 | BPF_MOV | BPF_K, BPF_REG_4, 0, 0, 0),
+		/* 14 */ XDP_INSN(BPF_STX | BPF_MEM | BPF_DW, BPF_REG_10, BPF_REG_4, -16, 0),
+		/* 15 */ XDP_INSN(BPF_ST | BPF_MEM | BPF_W, BPF_REG_10, 0, -8, htonl(0xffff)),
+		/* 16 */ XDP_INSN(BPF_LDX | BPF_MEM | BPF_W, BPF_REG_4, BPF_REG_2, ETH_HLEN + 12, 0),
+		/* 17 */ XDP_INSN(BPF_STX | BPF_MEM | BPF_W, BPF_REG_10, BPF_REG_4, -4, 0),
+		/* lookup */
+		/* 18 */ XDP_INSN(BPF_LD | BPF_DW | BPF_IMM, BPF_REG_1, BPF_PSEUDO_MAP_FD, 0, 0), // map, set below
+		/* 19 */ XDP_INSN(0, 0, 0, 0, 0),
+		/* 20 */ XDP_INSN(BPF_ALU64 | BPF_MOV | BPF_X, BPF_REG_2, BPF_REG_10, 0, 0),
+		/* 21 */ XDP_INSN(BPF_ALU64 | BPF_ADD | BPF_K, BPF_REG_2, 0, 0, -16),
+		/* 22 */ XDP_INSN(BPF_JMP | BPF_CALL, 0, 0, 0, BPF_FUNC_map_lookup_elem),
+		/* 23 */ XDP_INSN(BPF_JMP | BPF_JEQ | BPF_K, BPF_REG_0, 0, 5, 0),              // -> 29
+		/* 24 */ XDP_INSN(BPF_LDX | BPF_MEM | BPF_DW, BPF_REG_6, BPF_REG_0, 0, 0),
+		/* 25 */ XDP_INSN(BPF_JMP | BPF_CALL, 0, 0, 0, BPF_FUNC_ktime_get_ns),
+		/* 26 */ XDP_INSN(BPF_JMP | BPF_JGT | BPF_X, BPF_REG_0, BPF_REG_6, 2, 0),      // -> 29
+		/* 27 */ XDP_INSN(BPF_ALU64 | BPF_MOV | BPF_K, BPF_REG_0, 0, 0, XDP_DROP),
+		/* 28 */ XDP_INSN(BPF_JMP | BPF_EXIT, 0, 0, 0, 0),
+		/* 29 */ XDP_INSN(BPF_ALU64 | BPF_MOV | BPF_K, BPF_REG_0, 0, 0, XDP_PASS),
+		/* 30 */ XDP_INSN(BPF_JMP | BPF_EXIT, 0, 0, 0, 0),
+	};
+	union bpf_attr attr;
+
+	memset(&attr, 0, sizeof(attr));
+	attr.map_type    = BPF_MAP_TYPE_LRU_HASH;
+	attr.key_size    = 16;
+	attr.value_size  = sizeof(uint64_t);
+	attr.max_entries = XDP_DROP_MAX_ENTRIES;
+	xdp_map = xdp_bpf(BPF_MAP_CREATE, &attr);
+	if (xdp_map < 0)
+		return -1;
+
+	prog[18].imm = xdp_map;
+	memset(&attr, 0, sizeof(attr));
+	attr.prog_type = BPF_PROG_TYPE_XDP;
+	attr.insns     = (uintptr_t)prog;
+	attr.insn_cnt  = sizeof(prog) / sizeof(*prog);
+	attr.license   = (uintptr_t)"GPL";
+	strlcpy2(attr.prog_name, "haproxy_drop", sizeof(attr.prog_name));
+	xdp_prog = xdp_bpf(BPF_PROG_LOAD, &attr);
+	if (xdp_prog < 0) {
+		close(xdp_map);
+		xdp_map = -1;
+		return -1;
+	}
+	return 0;
+}
+
+/* Loads the program and attaches it to all registered interfaces. Failures
+ * are only reported as warnings, and the "xdp-drop" action then only rejects
+ * the connections.
+ */
+static int xdp_init()
+{
+	struct xdp_if *xif;
+	int ifindex;
+
+	if (LIST_ISEMPTY(&xdp_ifs))
+		return 0;
+
+	if (xdp_load() < 0) {
+		ha_warning("'xdp-drop' will only reject connections: failed to load the XDP program (%s).\n",
+			   strerror(errno));
+		return 0;
+	}
+
+	list_for_each_entry(xif, &xdp_ifs, list) {
+		ifindex = if_nametoindex(xif->name);
+		if (!ifindex || xdp_set_link(ifindex, xdp_prog, -1) < 0) {
+			ha_warning("'xdp-drop' will only reject connections on interface '%s': failed to attach the XDP program (%s).\n",
+				   xif->name, strerror(errno));
+			continue;
+		}
+		xif->ifindex = ifindex;
+	}
+	return 0;
+}
+
+/* Detaches the program from the interfaces it is still attached to, and
+ * releases everything.
+ */
+static void xdp_deinit()
+{
+	struct xdp_if *xif, *back;
+
+	list_for_each_entry_safe(xif, back, &xdp_ifs, list) {
+		if (xif->ifindex)
+			xdp_set_link(xif->ifindex, -1, xdp_prog);
+		LIST_DELETE(&xif->list);
+		free(xif->name);
+		free(xif);
+	}
+
+	if (xdp_prog >= 0)
+		close(xdp_prog);
+	if (xdp_map >= 0)
+		close(xdp_map);
+	xdp_prog = xdp_map = -1;
+}
+
+REGISTER_POST_CHECK(xdp_init);
+REGISTER_POST_DEINIT(xdp_deinit);
+
+/* Adds the source of the connection to the XDP drop list for the configured
+ * time, then rejects the connection.
+ */
+static enum act_return xdp_action_drop(struct act_rule *rule, struct proxy *px,
+                                       struct session *sess, struct stream *s, int flags)
+{
+	struct connection *conn = objt_conn(sess->origin);
+	union bpf_attr attr;
+	unsigned char key[16];
+	struct timespec ts;
+	uint64_t exp;
+
+	if (xdp_map < 0 || !conn || !conn_get_src(conn))
+		goto reject;
+
+	if (conn->src->ss_family == AF_INET) {
+		memset(key, 0, 10);
+		key[10] = key[11] = 0xff;
+		memcpy(key + 12, &((struct sockaddr_in *)conn->src)->sin_addr, 4);
+	}
+	else if (conn->src->ss_family == AF_INET6)
+		memcpy(key, &((struct sockaddr_in6 *)conn->src)->sin6_addr, 16);
+	else
+		goto reject;
+
+	/* the program compares it with bpf_ktime_get_ns() */
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	exp = ts.tv_sec * 1000000000ULL + ts.tv_nsec + rule->arg.timeout.value * 1000000ULL;
+
+	memset(&attr, 0, sizeof(attr));
+	attr.map_fd = xdp_map;
+	attr.key    = (uintptr_t)key;
+	attr.value  = (uintptr_t)&exp;
+	attr.flags  = BPF_ANY;
+	xdp_bpf(BPF_MAP_UPDATE_ELEM, &attr);
+
+ reject:
+	if (rule->from == ACT_F_TCP_REQ_CON) {
+		_HA_ATOMIC_INC(&sess->fe->fe_counters.denied_conn);
+		if (sess->listener && sess->listener->counters)
+			_HA_ATOMIC_INC(&sess->listener->counters->denied_conn);
+	}
+	else {
+		_HA_ATOMIC_INC(&sess->fe->fe_counters.denied_sess);
+		if (sess->listener && sess->listener->counters)
+			_HA_ATOMIC_INC(&sess->listener->counters->denied_sess);
+	}
+	return ACT_RET_DENY;
+}
+
+/* Registers the interfaces of the listeners of the rule's proxy. Returns 1 on
+ * success, or 0 on error with <err> filled.
+ */
+static int xdp_check_drop(struct act_rule *rule, struct proxy *px, char **err)
+{
+	struct bind_conf *bind_conf;
+	struct xdp_if *xif;
+	int found = 0;
+
+	list_for_each_entry(bind_conf, &px->conf.bind, by_fe) {
+		if (!bind_conf->settings.interface)
+			continue;
+		found = 1;
+
+		list_for_each_entry(xif, &xdp_ifs, list) {
+			if (strcmp(xif->name, bind_conf->settings.interface) == 0)
+				break;
+		}
+		if (&xif->list != &xdp_ifs)
+			continue;
+
+		xif = calloc(1, sizeof(*xif));
+		if (!xif || (xif->name = strdup(bind_conf->settings.interface)) == NULL) {
+			free(xif);
+			memprintf(err, "out of memory");
+			return 0;
+		}
+		LIST_APPEND(&xdp_ifs, &xif->list);
+	}
+
+	if (!found)
+		ha_warning("config : %s '%s' : 'xdp-drop' will only reject connections since no 'bind' line specifies an 'interface'.\n",
+			   proxy_type_str(px), px->id);
+	return 1;
+}
+
+/* Parses "xdp-drop [<time>]". Returns ACT_RET_PRS_OK on success, ACT_RET_PRS_ERR
+ * on error with <err> filled.
+ */
+static enum act_parse_ret xdp_parse_drop(const char **args, int *orig_arg, struct proxy *px,
+                                         struct act_rule *rule, char **err)
+{
+	int cur_arg = *orig_arg;
+	unsigned int timeout = XDP_DROP_DEFAULT_TIME;
+	const char *res;
+
+	if (*args[cur_arg] && strcmp(args[cur_arg], "if") != 0 && strcmp(args[cur_arg], "unless") != 0) {
+		res = parse_time_err(args[cur_arg], &timeout, TIME_UNIT_MS);
+		if (res == PARSE_TIME_OVER || res == PARSE_TIME_UNDER || res || !timeout) {
+			memprintf(err, "expects a non-null duration as optional argument, got '%s'", args[cur_arg]);
+			return ACT_RET_PRS_ERR;
+		}
+		cur_arg++;
+	}
+
+	*orig_arg = cur_arg;
+	rule->arg.timeout.value = timeout;
+	rule->action = ACT_CUSTOM;
+	rule->action_ptr = xdp_action_drop;
+	rule->check_ptr = xdp_check_drop;
+	return ACT_RET_PRS_OK;
+}
+
+static struct action_kw_list tcp_req_conn_actions = { { }, {
+	{ "xdp-drop", xdp_parse_drop, 0 },
+	{ /* END */ }
+}};
+
+INITCALL1(STG_REGISTER, tcp_req_conn_keywords_register, &tcp_req_conn_actions);
+
+static struct action_kw_list tcp_req_sess_actions = { { }, {
+	{ "xdp-drop", xdp_parse_drop, 0 },
+	{ /* END */ }
+}};
+
+INITCALL1(STG_REGISTER, tcp_req_sess_keywords_register, &tcp_req_sess_actions);
+
+/*
+ * Local variables:
+ *  c-indent-level: 8
+ *  c-basic-offset: 8
+ * End:
+ */
@@ -22,9 +22,12 @@
 
 #include <netinet/tcp.h>
 
+#include <openssl/hmac.h>
+
 #include <haproxy/buf-t.h>
 #include <haproxy/compat.h>
 #include <haproxy/api.h>
+#include <haproxy/cfgparse.h>
 #include <haproxy/debug.h>
 #include <haproxy/tools.h>
 #include <haproxy/ticks.h>
@@ -40,7 +43,9 @@
 #include <haproxy/quic_cc.h>
 #include <haproxy/quic_frame.h>
 #include <haproxy/quic_loss.h>
+#include <haproxy/quic_sock.h>
 #include <haproxy/quic_tls.h>
+#include <haproxy/shctx.h>
 #include <haproxy/ssl_sock.h>
 #include <haproxy/stream_interface.h>
 #include <haproxy/task.h>
@@ -149,6 +154,12 @@ DECLARE_POOL(pool_head_quic_connection_id,
 
 DECLARE_POOL(pool_head_quic_rx_packet, "quic_rx_packet_pool", sizeof(struct quic_rx_packet));
 
+DECLARE_POOL(pool_head_quic_rxbuf, "quic_rxbuf_pool", sizeof(struct quic_rxbuf));
+
+DECLARE_STATIC_POOL(pool_head_quic_dgram, "quic_dgram_pool", sizeof(struct quic_dgram));
+
+DECLARE_POOL(pool_head_quic_tx_dgram, "quic_tx_dgram_pool", QUIC_CONN_TX_BUF_SZ);
+
 DECLARE_POOL(pool_head_quic_tx_packet, "quic_tx_packet_pool", sizeof(struct quic_tx_packet));
 
 DECLARE_STATIC_POOL(pool_head_quic_rx_crypto_frm, "quic_rx_crypto_frm_pool", sizeof(struct quic_rx_crypto_frm));
@@ -159,7 +170,32 @@ DECLARE_STATIC_POOL(pool_head_quic_crypto_buf, "quic_crypto_buf_pool", sizeof(st
 
 DECLARE_STATIC_POOL(pool_head_quic_frame, "quic_frame_pool", sizeof(struct quic_frame));
 
-DECLARE_STATIC_POOL(pool_head_quic_arng, "quic_arng_pool", sizeof(struct quic_arng_node));
+/* Number of QUIC connections to listeners whose handshake is not complete. */
+static unsigned int quic_half_open_conns;
+/* Number of half-open connections from which the clients must prove they own
+ * their address with a Retry token before anything is allocated for them.
+ */
+static unsigned int quic_retry_threshold = QUIC_DFLT_RETRY_THRESHOLD;
+/* Secret used to authenticate the Retry tokens, randomly generated at boot. */
+static unsigned char quic_retry_secret[32];
+/* Number of entries of the 0-RTT anti-replay cache. */
+static unsigned int quic_0rtt_cache_size = QUIC_DFLT_0RTT_CACHE_SIZE;
+/* Cache of the ClientHellos whose early data were accepted, shared by all
+ * the QUIC listeners accepting 0-RTT.
+ */
+static struct shared_context *quic_0rtt_shctx;
+
+/* Accounts for the completion of the handshake of <qc> QUIC connection if it
+ * was half-open.
+ */
+static inline void qc_half_open_release(struct quic_conn *qc)
+{
+	if (qc->flags & QUIC_FL_CONN_HALF_OPEN) {
+		qc->flags &= ~QUIC_FL_CONN_HALF_OPEN;
+		HA_ATOMIC_DEC(&quic_half_open_conns);
+	}
+}
+
 
 static ssize_t qc_build_hdshk_pkt(struct q_buf *buf, struct quic_conn *qc, int pkt_type,
                                   struct quic_enc_level *qel);
@@ -665,21 +701,38 @@ int ha_quic_set_encryption_secrets(SSL *ssl, enum ssl_encryption_level_t level,
 	tls_ctx->rx.md   = tls_ctx->tx.md   = tls_md(cipher);
 	tls_ctx->rx.hp   = tls_ctx->tx.hp   = tls_hp(cipher);
 
+	/* Only one direction is used for the early data. */
+	if (!read_secret)
+		goto write;
+
 	if (!quic_tls_derive_keys(tls_ctx->rx.aead, tls_ctx->rx.hp, tls_ctx->rx.md,
 	                          tls_ctx->rx.key, sizeof tls_ctx->rx.key,
 	                          tls_ctx->rx.iv, sizeof tls_ctx->rx.iv,
 	                          tls_ctx->rx.hp_key, sizeof tls_ctx->rx.hp_key,
-	                          read_secret, secret_len)) {
+	                          read_secret, secret_len) ||
+	    !quic_tls_secrets_ctx_init(&tls_ctx->rx, 0)) {
 		TRACE_DEVEL("RX key derivation failed", QUIC_EV_CONN_RWSEC, conn);
 		return 0;
 	}
 
 	tls_ctx->rx.flags |= QUIC_FL_TLS_SECRETS_SET;
+	if (level == ssl_encryption_early_data && objt_listener(conn->target)) {
+		/* The early data were accepted, they are processed before
+		 * the handshake completes.
+		 */
+		conn->flags |= CO_FL_EARLY_DATA | CO_FL_EARLY_SSL_HS;
+	}
+
+ write:
+	if (!write_secret)
+		goto out;
+
 	if (!quic_tls_derive_keys(tls_ctx->tx.aead, tls_ctx->tx.hp, tls_ctx->tx.md,
 	                          tls_ctx->tx.key, sizeof tls_ctx->tx.key,
 	                          tls_ctx->tx.iv, sizeof tls_ctx->tx.iv,
 	                          tls_ctx->tx.hp_key, sizeof tls_ctx->tx.hp_key,
-	                          write_secret, secret_len)) {
+	                          write_secret, secret_len) ||
+	    !quic_tls_secrets_ctx_init(&tls_ctx->tx, 1)) {
 		TRACE_DEVEL("TX key derivation failed", QUIC_EV_CONN_RWSEC, conn);
 		return 0;
 	}
@@ -696,6 +749,7 @@ int ha_quic_set_encryption_secrets(SSL *ssl, enum ssl_encryption_level_t level,
 		if (!quic_transport_params_store(conn->qc, 1, buf, buf + buflen))
 			return 0;
 	}
+ out:
 	TRACE_LEAVE(QUIC_EV_CONN_RWSEC, conn, &level);
 
 	return 1;
@@ -722,7 +776,8 @@ int ha_set_rsec(SSL *ssl, enum ssl_encryption_level_t level,
 	                          tls_ctx->rx.key, sizeof tls_ctx->rx.key,
 	                          tls_ctx->rx.iv, sizeof tls_ctx->rx.iv,
 	                          tls_ctx->rx.hp_key, sizeof tls_ctx->rx.hp_key,
-	                          secret, secret_len)) {
+	                          secret, secret_len) ||
+	    !quic_tls_secrets_ctx_init(&tls_ctx->rx, 0)) {
 		TRACE_DEVEL("RX key derivation failed", QUIC_EV_CONN_RSEC, conn);
 		goto err;
 	}
@@ -770,7 +825,8 @@ int ha_set_wsec(SSL *ssl, enum ssl_encryption_level_t level,
 	                          tls_ctx->tx.key, sizeof tls_ctx->tx.key,
 	                          tls_ctx->tx.iv, sizeof tls_ctx->tx.iv,
 	                          tls_ctx->tx.hp_key, sizeof tls_ctx->tx.hp_key,
-	                          secret, secret_len)) {
+	                          secret, secret_len) ||
+	    !quic_tls_secrets_ctx_init(&tls_ctx->tx, 1)) {
 		TRACE_DEVEL("TX key derivation failed", QUIC_EV_CONN_WSEC, conn);
 		goto err;
 	}
@@ -930,6 +986,98 @@ static SSL_QUIC_METHOD ha_quic_method = {
 	.send_alert             = ha_quic_send_alert,
 };
 
+#ifndef OPENSSL_IS_BORINGSSL
+/* Returns the extra area of the 0-RTT anti-replay cache. */
+static inline struct quic_0rtt_cache *quic_0rtt_cache()
+{
+	return (struct quic_0rtt_cache *)quic_0rtt_shctx->data;
+}
+
+/* Releases the anti-replay cache entry stored in the row starting at <first>
+ * when it is reused, remembering the date of the most recent evicted one.
+ */
+static void quic_0rtt_free_block(struct shared_block *first, struct shared_block *block)
+{
+	struct quic_0rtt_cache *cache = quic_0rtt_cache();
+	struct quic_0rtt_entry *entry;
+
+	if (first != block)
+		return;
+
+	entry = (struct quic_0rtt_entry *)first->data;
+	ebmb_delete(&entry->node);
+	if ((int)(entry->date - cache->evicted) > 0)
+		cache->evicted = entry->date;
+}
+
+/* Allocates the 0-RTT anti-replay cache if not already done.
+ * Returns 1 if succeeded, 0 if not.
+ */
+static int quic_0rtt_cache_init()
+{
+	if (quic_0rtt_shctx)
+		return 1;
+
+	if (shctx_init(&quic_0rtt_shctx, quic_0rtt_cache_size, sizeof(struct quic_0rtt_entry), -1,
+	               sizeof(struct quic_0rtt_cache), (global.nbthread > 1)) <= 0)
+		return 0;
+
+	quic_0rtt_shctx->free_block = quic_0rtt_free_block;
+	quic_0rtt_cache()->tree = EB_ROOT_UNIQUE;
+	quic_0rtt_cache()->evicted = 0;
+	return 1;
+}
+
+/* Callback deciding if the early data of the ClientHello being processed on
+ * <ssl> for <arg> QUIC connection may be accepted. A replayed ClientHello is
+ * identical to the original one, so its random is looked up in the shared
+ * anti-replay cache. This cache only has to remember the ClientHellos for the
+ * ticket age tolerance: the early data of the ClientHellos replayed later are
+ * rejected by the TLS stack. If an entry younger than this was evicted, a
+ * replay may not be detected, so the early data are rejected until the cache
+ * only evicts older entries.
+ * Returns 1 if the early data may be accepted, 0 if not.
+ */
+static int quic_0rtt_allow_cb(SSL *ssl, void *arg)
+{
+	struct connection *conn = arg;
+	struct quic_0rtt_entry *entry;
+	struct shared_block *first;
+	unsigned char key[sizeof(entry->key)];
+	int ret = 0;
+
+	TRACE_ENTER(QUIC_EV_CONN_HDSHK, conn);
+	if (!quic_0rtt_shctx || SSL_get_client_random(ssl, key, sizeof key) != sizeof key)
+		goto out;
+
+	shctx_lock(quic_0rtt_shctx);
+	first = shctx_row_reserve_hot(quic_0rtt_shctx, NULL, sizeof(*entry));
+	if (first) {
+		entry = (struct quic_0rtt_entry *)first->data;
+		entry->date = date.tv_sec;
+		memcpy(entry->key, key, sizeof key);
+		if (ebmb_insert(&quic_0rtt_cache()->tree, &entry->node, sizeof key) != &entry->node) {
+			/* Replayed ClientHello: the row is left unused. */
+			first->len = 0;
+		}
+		else {
+			first->len = sizeof(*entry);
+			ret = (int)(entry->date - quic_0rtt_cache()->evicted) >= QUIC_0RTT_REPLAY_WINDOW;
+		}
+		shctx_row_dec_hot(quic_0rtt_shctx, first);
+	}
+	shctx_unlock(quic_0rtt_shctx);
+
+ out:
+	if (ret)
+		TRACE_PROTO("0-RTT accepted", QUIC_EV_CONN_HDSHK, conn);
+	else
+		TRACE_PROTO("0-RTT rejected", QUIC_EV_CONN_HDSHK, conn);
+	TRACE_LEAVE(QUIC_EV_CONN_HDSHK, conn);
+	return ret;
+}
+#endif
+
 /* Initialize the TLS context of a listener with <bind_conf> as configuration.
  * Returns an error count.
  */
@@ -987,8 +1135,16 @@ int ssl_quic_initial_ctx(struct bind_conf *bind_conf)
 	SSL_CTX_set_tlsext_servername_callback(ctx, ssl_sock_switchctx_err_cbk);
 #elif (HA_OPENSSL_VERSION_NUMBER >= 0x10101000L)
 	if (bind_conf->ssl_conf.early_data) {
+		/* The early data are enabled for each connection, and the
+		 * replays are detected by quic_0rtt_allow_cb().
+		 */
 		SSL_CTX_set_options(ctx, SSL_OP_NO_ANTI_REPLAY);
-		SSL_CTX_set_max_early_data(ctx, global.tune.bufsize - global.tune.maxrewrite);
+		if (!quic_0rtt_cache_init()) {
+			ha_alert("Proxy '%s': unable to allocate the QUIC 0-RTT anti-replay cache "
+			         "for bind '%s' at [%s:%d].\n",
+			         curproxy->id, bind_conf->arg, bind_conf->file, bind_conf->line);
+			cfgerr++;
+		}
 	}
 	SSL_CTX_set_client_hello_cb(ctx, ssl_sock_switchctx_cbk, NULL);
 	SSL_CTX_set_tlsext_servername_callback(ctx, ssl_sock_switchctx_err_cbk);
@@ -1029,48 +1185,17 @@ static uint64_t decode_packet_number(uint64_t largest_pn,
 	return candidate_pn;
 }
 
-/* Remove the header protection of <pkt> QUIC packet using <tls_ctx> as QUIC TLS
- * cryptographic context.
+/* Remove the header protection of <pkt> QUIC packet with <mask> as header
+ * protection mask.
  * <largest_pn> is the largest received packet number and <pn> the address of
  * the packet number field for this packet with <byte0> address of its first byte.
- * <end> points to one byte past the end of this packet.
- * Returns 1 if succeeded, 0 if not.
  */
-static int qc_do_rm_hp(struct quic_rx_packet *pkt, struct quic_tls_ctx *tls_ctx,
-                       int64_t largest_pn, unsigned char *pn,
-                       unsigned char *byte0, const unsigned char *end,
-                       struct quic_conn_ctx *ctx)
+static void qc_rm_hp_mask(struct quic_rx_packet *pkt, const unsigned char *mask,
+                          int64_t largest_pn, unsigned char *pn, unsigned char *byte0)
 {
-	int ret, outlen, i, pnlen;
+	int i, pnlen;
 	uint64_t packet_number;
 	uint32_t truncated_pn = 0;
-	unsigned char mask[5] = {0};
-	unsigned char *sample;
-	EVP_CIPHER_CTX *cctx;
-	unsigned char *hp_key;
-
-	/* Check there is enough data in this packet. */
-	if (end - pn < QUIC_PACKET_PN_MAXLEN + sizeof mask) {
-		TRACE_DEVEL("too short packet", QUIC_EV_CONN_RMHP, ctx->conn, pkt);
-		return 0;
-	}
-
-	cctx = EVP_CIPHER_CTX_new();
-	if (!cctx) {
-		TRACE_DEVEL("memory allocation failed", QUIC_EV_CONN_RMHP, ctx->conn, pkt);
-		return 0;
-	}
-
-	ret = 0;
-	sample = pn + QUIC_PACKET_PN_MAXLEN;
-
-	hp_key = tls_ctx->rx.hp_key;
-	if (!EVP_DecryptInit_ex(cctx, tls_ctx->rx.hp, NULL, hp_key, sample) ||
-	    !EVP_DecryptUpdate(cctx, mask, &outlen, mask, sizeof mask) ||
-	    !EVP_DecryptFinal_ex(cctx, mask, &outlen)) {
-		TRACE_DEVEL("decryption failed", QUIC_EV_CONN_RMHP, ctx->conn, pkt);
-	    goto out;
-	}
 
 	*byte0 ^= mask[0] & (*byte0 & QUIC_PACKET_LONG_HEADER_BIT ? 0xf : 0x1f);
 	pnlen = (*byte0 & QUIC_PACKET_PNL_BITMASK) + 1;
@@ -1083,13 +1208,35 @@ static int qc_do_rm_hp(struct quic_rx_packet *pkt, struct quic_tls_ctx *tls_ctx,
 	/* Store remaining information for this unprotected header */
 	pkt->pn = packet_number;
 	pkt->pnl = pnlen;
+}
 
-	ret = 1;
+/* Remove the header protection of <pkt> QUIC packet using <tls_ctx> as QUIC TLS
+ * cryptographic context.
+ * <largest_pn> is the largest received packet number and <pn> the address of
+ * the packet number field for this packet with <byte0> address of its first byte.
+ * <end> points to one byte past the end of this packet.
+ * Returns 1 if succeeded, 0 if not.
+ */
+static int qc_do_rm_hp(struct quic_rx_packet *pkt, struct quic_tls_ctx *tls_ctx,
+                       int64_t largest_pn, unsigned char *pn,
+                       unsigned char *byte0, const unsigned char *end,
+                       struct quic_conn_ctx *ctx)
+{
+	unsigned char mask[QUIC_TLS_HP_SAMPLE_LEN];
 
- out:
-	EVP_CIPHER_CTX_free(cctx);
+	/* Check there is enough data in this packet. */
+	if (end - pn < QUIC_PACKET_PN_MAXLEN + QUIC_TLS_HP_SAMPLE_LEN) {
+		TRACE_DEVEL("too short packet", QUIC_EV_CONN_RMHP, ctx->conn, pkt);
+		return 0;
+	}
 
-	return ret;
+	if (!quic_tls_hp_masks(tls_ctx->rx.hp_ctx, pn + QUIC_PACKET_PN_MAXLEN, mask, 1)) {
+		TRACE_DEVEL("decryption failed", QUIC_EV_CONN_RMHP, ctx->conn, pkt);
+		return 0;
+	}
+
+	qc_rm_hp_mask(pkt, mask, largest_pn, pn, byte0);
+	return 1;
 }
 
 /* Encrypt the payload of a QUIC packet with <pn> as number found at <payload>
@@ -1113,7 +1260,7 @@ static int quic_packet_encrypt(unsigned char *payload, size_t payload_len,
 	}
 
 	if (!quic_tls_encrypt(payload, payload_len, aad, aad_len,
-	                      tls_ctx->tx.aead, tls_ctx->tx.key, iv)) {
+	                      tls_ctx->tx.ctx, iv)) {
 		TRACE_DEVEL("QUIC packet encryption failed", QUIC_EV_CONN_HPKT, conn);
 		goto err;
 	}
@@ -1141,7 +1288,7 @@ static int qc_pkt_decrypt(struct quic_rx_packet *pkt, struct quic_tls_ctx *tls_c
 
 	ret = quic_tls_decrypt(pkt->data + pkt->aad_len, pkt->len - pkt->aad_len,
 	                       pkt->data, pkt->aad_len,
-	                       tls_ctx->rx.aead, tls_ctx->rx.key, iv);
+	                       tls_ctx->rx.ctx, iv);
 	if (!ret)
 		return 0;
 
@@ -1537,6 +1684,8 @@ static inline int qc_provide_cdata(struct quic_enc_level *el,
 		}
 
 		TRACE_PROTO("SSL handshake OK", QUIC_EV_CONN_HDSHK, ctx->conn, &ctx->state);
+		qc_half_open_release(ctx->conn->qc);
+		ctx->conn->flags &= ~CO_FL_EARLY_SSL_HS;
 		if (objt_listener(ctx->conn->target))
 			ctx->state = QUIC_HS_ST_CONFIRMED;
 		else
@@ -1589,6 +1738,14 @@ static int qc_parse_pkt_frms(struct quic_rx_packet *pkt, struct quic_conn_ctx *c
 		if (!qc_parse_frm(&frm, pkt, &pos, end, conn))
 			goto err;
 
+		/* These frames are not allowed in 0-RTT packets. */
+		if (pkt->type == QUIC_PACKET_TYPE_0RTT &&
+		    (frm.type == QUIC_FT_ACK || frm.type == QUIC_FT_CRYPTO ||
+		     frm.type == QUIC_FT_HANDSHAKE_DONE)) {
+			TRACE_DEVEL("frame not allowed in 0-RTT packets", QUIC_EV_CONN_PRSHPKT, ctx->conn, pkt);
+			goto err;
+		}
+
 		switch (frm.type) {
 		case QUIC_FT_PADDING:
 			if (pos != end) {
@@ -1814,31 +1971,125 @@ static int qc_prep_hdshk_pkts(struct quic_conn_ctx *ctx)
 	return 0;
 }
 
+/* Updates the pacing credit of <qc> for the time elapsed since its last update,
+ * at a rate of 5/4 of the congestion window per smoothed RTT, without exceeding
+ * a burst of QUIC_PACING_BURST datagrams, and returns it.
+ */
+static size_t qc_pacing_credit(struct quic_conn *qc)
+{
+	struct quic_path *path = qc->path;
+	unsigned int srtt = QUIC_MAX(path->loss.srtt >> 3, 1U);
+	unsigned int elapsed = now_ms - qc->tx.pacing_ts;
+	size_t burst = QUIC_PACING_BURST * path->mtu;
+	uint64_t credit;
+
+	if (elapsed >= srtt)
+		credit = burst;
+	else
+		credit = qc->tx.pacing_credit + path->cwnd * 5 * elapsed / (4 * srtt);
+	qc->tx.pacing_credit = QUIC_MIN(credit, burst);
+	qc->tx.pacing_ts = now_ms;
+	return qc->tx.pacing_credit;
+}
+
+/* Returns the delay in ms before <qc> earns <missing> more bytes of pacing
+ * credit.
+ */
+static unsigned int qc_pacing_delay(struct quic_conn *qc, size_t missing)
+{
+	struct quic_path *path = qc->path;
+	unsigned int srtt = QUIC_MAX(path->loss.srtt >> 3, 1U);
+
+	return missing * 4 * srtt / (5 * path->cwnd) + 1;
+}
+
+/* Callback called when <qc> may send its paced datagrams. */
+static struct task *qc_pacing_process(struct task *task, void *ctx, unsigned int state)
+{
+	struct quic_conn_ctx *conn_ctx = ctx;
+
+	task->expire = TICK_ETERNITY;
+	tasklet_wakeup(conn_ctx->wait_event.tasklet);
+	return task;
+}
+
 /* Send the QUIC packets which have been prepared for QUIC connections
- * with <ctx> as I/O handler context.
+ * with <ctx> as I/O handler context. All the prepared datagrams are sent
+ * at once using a single syscall when the platform supports it. Once the
+ * handshake is complete, the datagrams are paced: only those the pacing
+ * credit allows are sent, the next ones being sent when the pacing task
+ * expires.
  */
 int qc_send_ppkts(struct quic_conn_ctx *ctx)
 {
 	struct quic_conn *qc;
-	struct buffer tmpbuf = { };
+	struct connection *conn = ctx->conn;
+	struct iovec iov[QUIC_CONN_TX_BUFS_NB];
 	struct q_buf *rbuf;
+	int nb, sent, i;
+	size_t done;
 
-	qc = ctx->conn->qc;
-	for (rbuf = q_rbuf(qc); !q_buf_empty(rbuf) ; rbuf = q_next_rbuf(qc)) {
+	qc = conn->qc;
+	if (!conn_ctrl_ready(conn) || !fd_send_ready(conn->handle.fd))
+		return 1;
+
+	/* Collect all the prepared datagrams so that they are sent using a
+	 * single syscall. They are stored in consecutive buffers starting
+	 * from the current read buffer.
+	 */
+	nb = 0;
+	for (i = qc->tx.rbuf; nb < QUIC_CONN_TX_BUFS_NB; i = (i + 1) & (QUIC_CONN_TX_BUFS_NB - 1)) {
+		rbuf = &qc->tx.bufs[i];
+		if (q_buf_empty(rbuf))
+			break;
+		iov[nb].iov_base = rbuf->area;
+		iov[nb].iov_len  = rbuf->data;
+		nb++;
+	}
+
+	if (!nb)
+		return 1;
+
+	if (qc->pacing_task && ctx->state >= QUIC_HS_ST_COMPLETE) {
+		size_t credit = qc_pacing_credit(qc);
+
+		for (i = 0; i < nb && iov[i].iov_len <= credit; i++)
+			credit -= iov[i].iov_len;
+
+		if (i < nb) {
+			task_schedule(qc->pacing_task,
+			              tick_add(now_ms, qc_pacing_delay(qc, iov[i].iov_len - credit)));
+			nb = i;
+			if (!nb)
+				return 1;
+		}
+	}
+
+	TRACE_PROTO("to send", QUIC_EV_CONN_SPPKTS, conn);
+	sent = quic_sock_send_dgrams(conn->handle.fd, conn->dst, iov, nb);
+	if (sent < 0) {
+		conn->flags |= CO_FL_ERROR | CO_FL_SOCK_RD_SH | CO_FL_SOCK_WR_SH;
+		return 1;
+	}
+
+	if (sent) {
+		/* A send succeeded, so we can consider ourself connected */
+		conn->flags |= CO_FL_WAIT_L4L6;
+		conn->flags &= ~CO_FL_WAIT_L4_CONN;
+	}
+
+	done = 0;
+	for (rbuf = q_rbuf(qc); sent-- > 0; rbuf = q_next_rbuf(qc)) {
 		struct quic_tx_packet *p, *q;
 		unsigned int time_sent;
 
-		tmpbuf.area = (char *)rbuf->area;
-		tmpbuf.size = tmpbuf.data = rbuf->data;
-		TRACE_PROTO("to send", QUIC_EV_CONN_SPPKTS, ctx->conn);
-	    if (ctx->xprt->snd_buf(qc->conn, qc->conn->xprt_ctx,
-	                           &tmpbuf, tmpbuf.data, 0) <= 0)
-		    break;
-
-		qc->tx.bytes += tmpbuf.data;
+		done += rbuf->data;
+		qc->tx.bytes += rbuf->data;
 		time_sent = now_ms;
-		/* Reset this buffer to make it available for the next packet to prepare. */
-		q_buf_reset(rbuf);
+		/* Its data are not needed anymore, the lost frames being
+		 * rebuilt into new packets.
+		 */
+		q_buf_release(rbuf);
 		/* Remove from <rbuf> the packets which have just been sent. */
 		list_for_each_entry_safe(p, q, &rbuf->pkts, list) {
 			p->time_sent = time_sent;
@@ -1855,6 +2106,13 @@ int qc_send_ppkts(struct quic_conn_ctx *ctx)
 		}
 	}
 
+	if (done) {
+		qc->tx.pacing_credit -= QUIC_MIN(done, qc->tx.pacing_credit);
+		/* same accounting as for the other transport layers */
+		_HA_ATOMIC_ADD(&global.out_bytes, done);
+		update_freq_ctr(&global.out_32bps, (done + 16) / 32);
+	}
+
 	return 1;
 }
 
@@ -1897,103 +2155,110 @@ static int quic_build_post_handshake_frames(struct quic_conn *conn)
 	return 0;
 }
 
-/* Deallocate <l> list of ACK ranges. */
-void free_quic_arngs(struct quic_arngs *arngs)
-{
-	struct eb64_node *n;
-	struct quic_arng_node *ar;
-
-	n = eb64_first(&arngs->root);
-	while (n) {
-		struct eb64_node *next;
-
-		ar = eb64_entry(&n->node, struct quic_arng_node, first);
-		next = eb64_next(n);
-		eb64_delete(n);
-		free(ar);
-		n = next;
-	}
-}
-
 /* Return the gap value between <p> and <q> ACK ranges where <q> follows <p> in
  * descending order.
  */
-static inline size_t sack_gap(struct quic_arng_node *p,
-                              struct quic_arng_node *q)
+static inline size_t sack_gap(struct quic_arng *p, struct quic_arng *q)
 {
-	return p->first.key - q->last - 2;
+	return p->first - q->last - 2;
 }
 
-
-/* Remove the last elements of <ack_ranges> list of ack range updating its
- * encoded size until it goes below <limit>.
- * Returns 1 if succeeded, 0 if not (no more element to remove).
+/* Returns the number of bytes required to encode the <i>th range of <arngs> in
+ * an ACK frame, which depends on the previous range, or 0 if there is no such
+ * range. For the first range, this includes the largest acknowledged packet
+ * number.
  */
-static int quic_rm_last_ack_ranges(struct quic_arngs *arngs, size_t limit)
+static inline size_t quic_arng_enc_sz(struct quic_arngs *arngs, size_t i)
 {
-	struct eb64_node *last, *prev;
+	struct quic_arng *ar;
 
-	last = eb64_last(&arngs->root);
-	while (last && arngs->enc_sz > limit) {
-		struct quic_arng_node *last_node, *prev_node;
+	if (i >= arngs->sz)
+		return 0;
 
-		prev = eb64_prev(last);
-		if (!prev)
-			return 0;
+	ar = quic_arng_at(arngs, i);
+	if (!i)
+		return quic_int_getsize(ar->last) + quic_int_getsize(ar->last - ar->first);
 
-		last_node = eb64_entry(&last->node, struct quic_arng_node, first);
-		prev_node = eb64_entry(&prev->node, struct quic_arng_node, first);
-		arngs->enc_sz -= quic_int_getsize(last_node->last - last_node->first.key);
-		arngs->enc_sz -= quic_int_getsize(sack_gap(prev_node, last_node));
-		arngs->enc_sz -= quic_decint_size_diff(arngs->sz);
-		--arngs->sz;
-		eb64_delete(last);
-		pool_free(pool_head_quic_arng, last);
-		last = prev;
-	}
+	return quic_int_getsize(sack_gap(quic_arng_at(arngs, i - 1), ar)) +
+		quic_int_getsize(ar->last - ar->first);
+}
 
-	return 1;
+/* Returns the number of bytes required to encode the number of ranges of
+ * <arngs> in an ACK frame.
+ */
+static inline size_t quic_arngs_cnt_enc_sz(struct quic_arngs *arngs)
+{
+	return arngs->sz ? quic_int_getsize(arngs->sz - 1) : 0;
 }
 
-/* Set the encoded size of <arngs> QUIC ack ranges. */
-static void quic_arngs_set_enc_sz(struct quic_arngs *arngs)
+/* Inserts <ar> range at position <i> into <arngs> ring of ACK ranges which
+ * must not be full, updating its encoded size.
+ */
+static void quic_arngs_insert(struct quic_arngs *arngs, size_t i, struct quic_arng *ar)
 {
-	struct eb64_node *node, *next;
-	struct quic_arng_node *ar, *ar_next;
+	size_t j;
 
-	node = eb64_last(&arngs->root);
-	if (!node)
-		return;
+	arngs->enc_sz -= quic_arng_enc_sz(arngs, i) + quic_arngs_cnt_enc_sz(arngs);
+	if (!i) {
+		arngs->head = (arngs->head - 1) & (QUIC_MAX_ACK_RANGES - 1);
+	}
+	else {
+		for (j = arngs->sz; j > i; j--)
+			*quic_arng_at(arngs, j) = *quic_arng_at(arngs, j - 1);
+	}
+	*quic_arng_at(arngs, i) = *ar;
+	arngs->sz++;
+	arngs->enc_sz += quic_arng_enc_sz(arngs, i) + quic_arng_enc_sz(arngs, i + 1) +
+		quic_arngs_cnt_enc_sz(arngs);
+}
 
-	ar = eb64_entry(&node->node, struct quic_arng_node, first);
-	arngs->enc_sz = quic_int_getsize(ar->last) +
-		quic_int_getsize(ar->last - ar->first.key) + quic_int_getsize(arngs->sz - 1);
+/* Removes the range at position <i> from <arngs> ring of ACK ranges without
+ * updating its encoded size.
+ */
+static void quic_arngs_delete(struct quic_arngs *arngs, size_t i)
+{
+	size_t j;
 
-	while ((next = eb64_prev(node))) {
-		ar_next = eb64_entry(&next->node, struct quic_arng_node, first);
-		arngs->enc_sz += quic_int_getsize(sack_gap(ar, ar_next)) +
-			quic_int_getsize(ar_next->last - ar_next->first.key);
-		node = next;
-		ar = eb64_entry(&node->node, struct quic_arng_node, first);
+	if (!i) {
+		arngs->head = (arngs->head + 1) & (QUIC_MAX_ACK_RANGES - 1);
+	}
+	else {
+		for (j = i; j + 1 < arngs->sz; j++)
+			*quic_arng_at(arngs, j) = *quic_arng_at(arngs, j + 1);
 	}
+	arngs->sz--;
 }
 
-/* Insert in <root> ebtree <node> node with <ar> as range value.
- * Returns the ebtree node which has been inserted.
+/* Removes the range at position <i> from <arngs> ring of ACK ranges, updating
+ * its encoded size.
  */
-static inline
-struct eb64_node *quic_insert_new_range(struct eb_root *root,
-                                        struct quic_arng_node *node,
-                                        struct quic_arng *ar)
+static void quic_arngs_remove(struct quic_arngs *arngs, size_t i)
 {
-	node->first.key = ar->first;
-	node->last = ar->last;
-	return eb64_insert(root, &node->first);
+	arngs->enc_sz -= quic_arng_enc_sz(arngs, i) + quic_arng_enc_sz(arngs, i + 1) +
+		quic_arngs_cnt_enc_sz(arngs);
+	quic_arngs_delete(arngs, i);
+	arngs->enc_sz += quic_arng_enc_sz(arngs, i) + quic_arngs_cnt_enc_sz(arngs);
 }
 
-/* Update <arngs> tree of ACK ranges with <ar> as new ACK range value.
- * Note that this function computes the number of bytes required to encode
- * this tree of ACK ranges in descending order.
+/* Remove the oldest ranges of <arngs> ACK ranges updating its encoded size
+ * until it goes below <limit>.
+ * Returns 1 if succeeded, 0 if not (no more element to remove).
+ */
+static int quic_rm_last_ack_ranges(struct quic_arngs *arngs, size_t limit)
+{
+	while (arngs->enc_sz > limit) {
+		if (arngs->sz <= 1)
+			return 0;
+		quic_arngs_remove(arngs, arngs->sz - 1);
+	}
+
+	return 1;
+}
+
+/* Update <arngs> ring of ACK ranges with <ar> as new ACK range value.
+ * Note that this function maintains the number of bytes required to encode
+ * these ACK ranges in descending order, only the ranges which are modified
+ * being accounted for again.
  *
  *    Descending order
  *    ------------->
@@ -2012,90 +2277,60 @@ struct eb64_node *quic_insert_new_range(struct eb_root *root,
  *       diff2 = last2 - first2
  *       gap12 = first1 - last2 - 2 (>= 0)
  *
+ * When the ring is full, the oldest range is forgotten. Never fails.
  */
 int quic_update_ack_ranges_list(struct quic_arngs *arngs,
                                 struct quic_arng *ar)
 {
-	struct eb64_node *le;
-	struct quic_arng_node *new_node;
-	struct eb64_node *new;
-
-	new = NULL;
-	if (eb_is_empty(&arngs->root)) {
-		/* First range insertion. */
-		new_node = pool_alloc(pool_head_quic_arng);
-		if (!new_node)
-			return 0;
+	struct quic_arng *cur, *next;
+	size_t i;
 
-		quic_insert_new_range(&arngs->root, new_node, ar);
-		/* Increment the size of these ranges. */
-		arngs->sz++;
-		goto out;
-	}
-
-	le = eb64_lookup_le(&arngs->root, ar->first);
-	if (!le) {
-		/* New insertion */
-		new_node = pool_alloc(pool_head_quic_arng);
-		if (!new_node)
-			return 0;
-
-		new = quic_insert_new_range(&arngs->root, new_node, ar);
-		/* Increment the size of these ranges. */
-		arngs->sz++;
+	/* Skip the ranges above <ar> which cannot be merged with it. */
+	for (i = 0; i < arngs->sz; i++) {
+		cur = quic_arng_at(arngs, i);
+		if (cur->first <= ar->last + 1)
+			break;
 	}
-	else {
-		struct quic_arng_node *le_ar =
-			eb64_entry(&le->node, struct quic_arng_node, first);
 
+	if (i < arngs->sz && cur->last + 1 >= ar->first) {
 		/* Already existing range */
-		if (le_ar->first.key <= ar->first && le_ar->last >= ar->last)
+		if (cur->first <= ar->first && cur->last >= ar->last)
 			return 1;
 
-		if (le_ar->last + 1 >= ar->first) {
-			le_ar->last = ar->last;
-			new = le;
-			new_node = le_ar;
-		}
-		else {
-			/* New insertion */
-			new_node = pool_alloc(pool_head_quic_arng);
-			if (!new_node)
-				return 0;
-
-			new = quic_insert_new_range(&arngs->root, new_node, ar);
-			/* Increment the size of these ranges. */
-			arngs->sz++;
+		/* Merge <ar> into this range */
+		arngs->enc_sz -= quic_arng_enc_sz(arngs, i) + quic_arng_enc_sz(arngs, i + 1);
+		if (ar->first < cur->first)
+			cur->first = ar->first;
+		if (ar->last > cur->last)
+			cur->last = ar->last;
+		arngs->enc_sz += quic_arng_enc_sz(arngs, i) + quic_arng_enc_sz(arngs, i + 1);
+	}
+	else {
+		if (arngs->sz == QUIC_MAX_ACK_RANGES) {
+			/* This range would be the oldest one. */
+			if (i == arngs->sz)
+				return 1;
+			quic_arngs_remove(arngs, arngs->sz - 1);
 		}
+		quic_arngs_insert(arngs, i, ar);
+		cur = quic_arng_at(arngs, i);
 	}
 
-	/* Verify that the new inserted node does not overlap the nodes
-	 * which follow it.
-	 */
-	if (new) {
-		uint64_t new_node_last;
-		struct eb64_node *next;
-		struct quic_arng_node *next_node;
-
-		new_node_last = new_node->last;
-		while ((next = eb64_next(new))) {
-			next_node =
-				eb64_entry(&next->node, struct quic_arng_node, first);
-			if (new_node_last + 1 < next_node->first.key)
-				break;
+	/* Merge the following ranges which now overlap this one. */
+	while (i + 1 < arngs->sz) {
+		next = quic_arng_at(arngs, i + 1);
+		if (next->last + 1 < cur->first)
+			break;
 
-			if (next_node->last > new_node->last)
-				new_node->last = next_node->last;
-			eb64_delete(next);
-			free(next_node);
-			/* Decrement the size of these ranges. */
-			arngs->sz--;
-		}
+		arngs->enc_sz -= quic_arng_enc_sz(arngs, i) + quic_arng_enc_sz(arngs, i + 1) +
+			quic_arng_enc_sz(arngs, i + 2) + quic_arngs_cnt_enc_sz(arngs);
+		if (next->first < cur->first)
+			cur->first = next->first;
+		quic_arngs_delete(arngs, i + 1);
+		arngs->enc_sz += quic_arng_enc_sz(arngs, i) + quic_arng_enc_sz(arngs, i + 1) +
+			quic_arngs_cnt_enc_sz(arngs);
 	}
 
-	quic_arngs_set_enc_sz(arngs);
-
- out:
 	return 1;
 }
 /* Remove the header protection of packets at <el> encryption level.
@@ -2116,22 +2351,49 @@ static inline void qc_rm_hp_pkts(struct quic_enc_level *el, struct quic_conn_ctx
 		goto out;
 	}
 	tls_ctx = &el->tls_ctx;
-	list_for_each_entry_safe(pqpkt, qqpkt, &el->rx.pqpkts, list) {
-		if (!qc_do_rm_hp(pqpkt, tls_ctx, el->pktns->rx.largest_pn,
-		                 pqpkt->data + pqpkt->pn_offset,
-		                 pqpkt->data, pqpkt->data + pqpkt->len, ctx)) {
-			TRACE_PROTO("hp removing error", QUIC_EV_CONN_ELRMHP, ctx->conn);
-			/* XXX TO DO XXX */
+	while (!LIST_ISEMPTY(&el->rx.pqpkts)) {
+		/* The masks of a batch of packets are computed at once */
+		struct quic_rx_packet *batch[QUIC_HP_BATCH];
+		unsigned char samples[QUIC_HP_BATCH * QUIC_TLS_HP_SAMPLE_LEN];
+		unsigned char masks[QUIC_HP_BATCH * QUIC_TLS_HP_SAMPLE_LEN];
+		int i, nb = 0, ok;
+
+		list_for_each_entry_safe(pqpkt, qqpkt, &el->rx.pqpkts, list) {
+			if (nb == QUIC_HP_BATCH)
+				break;
+			if (pqpkt->len < pqpkt->pn_offset + QUIC_PACKET_PN_MAXLEN + QUIC_TLS_HP_SAMPLE_LEN) {
+				TRACE_PROTO("hp removing error (too short packet)", QUIC_EV_CONN_ELRMHP, ctx->conn);
+				/* XXX TO DO XXX */
+				quic_rx_packet_list_del(pqpkt);
+				continue;
+			}
+			memcpy(samples + nb * QUIC_TLS_HP_SAMPLE_LEN,
+			       pqpkt->data + pqpkt->pn_offset + QUIC_PACKET_PN_MAXLEN,
+			       QUIC_TLS_HP_SAMPLE_LEN);
+			batch[nb++] = pqpkt;
 		}
-		else {
+
+		ok = nb && quic_tls_hp_masks(tls_ctx->rx.hp_ctx, samples, masks, nb);
+		for (i = 0; i < nb; i++) {
+			pqpkt = batch[i];
+			if (!ok) {
+				TRACE_PROTO("hp removing error", QUIC_EV_CONN_ELRMHP, ctx->conn);
+				/* XXX TO DO XXX */
+				quic_rx_packet_list_del(pqpkt);
+				continue;
+			}
+
+			qc_rm_hp_mask(pqpkt, masks + i * QUIC_TLS_HP_SAMPLE_LEN,
+			              el->pktns->rx.largest_pn,
+			              pqpkt->data + pqpkt->pn_offset, pqpkt->data);
 			/* The AAD includes the packet number field */
 			pqpkt->aad_len = pqpkt->pn_offset + pqpkt->pnl;
 			/* Store the packet into the tree of packets to decrypt. */
 			pqpkt->pn_node.key = pqpkt->pn;
 			quic_rx_packet_eb64_insert(&el->rx.pkts, &pqpkt->pn_node);
 			TRACE_PROTO("hp removed", QUIC_EV_CONN_ELRMHP, ctx->conn, pqpkt);
+			quic_rx_packet_list_del(pqpkt);
 		}
-		quic_rx_packet_list_del(pqpkt);
 	}
 
   out:
@@ -2254,7 +2516,8 @@ int qc_do_hdshk(struct quic_conn_ctx *ctx)
 	int ssl_err;
 	struct quic_conn *quic_conn;
 	enum quic_tls_enc_level tel, next_tel;
-	struct quic_enc_level *qel, *next_qel;
+	struct quic_enc_level *qel, *next_qel, *eqel;
+	struct quic_rx_packet *pkt, *pktback;
 	struct quic_tls_ctx *tls_ctx;
 
 	TRACE_ENTER(QUIC_EV_CONN_HDSHK, ctx->conn, &ctx->state);
@@ -2266,6 +2529,7 @@ int qc_do_hdshk(struct quic_conn_ctx *ctx)
 
 	qel = &quic_conn->els[tel];
 	next_qel = &quic_conn->els[next_tel];
+	eqel = &quic_conn->els[QUIC_TLS_ENC_LEVEL_EARLY_DATA];
 
  next_level:
 	tls_ctx = &qel->tls_ctx;
@@ -2281,6 +2545,19 @@ int qc_do_hdshk(struct quic_conn_ctx *ctx)
 		!qc_treat_rx_pkts(qel, ctx))
 		goto err;
 
+	/* The 0-RTT packets are processed as soon as the early data have been
+	 * accepted, which happens when the ClientHello is processed.
+	 */
+	if ((eqel->tls_ctx.rx.flags & (QUIC_FL_TLS_SECRETS_SET | QUIC_FL_TLS_SECRETS_DCD)) ==
+	    QUIC_FL_TLS_SECRETS_SET) {
+		if (!LIST_ISEMPTY(&eqel->rx.pqpkts))
+			qc_rm_hp_pkts(eqel, ctx);
+
+		if (!eb_is_empty(&eqel->rx.pkts) &&
+		    !qc_treat_rx_pkts(eqel, ctx))
+			goto err;
+	}
+
 	if (!qc_prep_hdshk_pkts(ctx))
 		goto err;
 
@@ -2299,6 +2576,13 @@ int qc_do_hdshk(struct quic_conn_ctx *ctx)
 	if (ctx->state < QUIC_HS_ST_COMPLETE)
 		goto out;
 
+	/* Discard the 0-RTT keys and the 0-RTT packets which could not be
+	 * processed, the next ones being 1-RTT packets.
+	 */
+	quic_tls_discard_keys(eqel);
+	list_for_each_entry_safe(pkt, pktback, &eqel->rx.pqpkts, list)
+		quic_rx_packet_list_del(pkt);
+
 	/* Discard the Handshake keys. */
 	quic_tls_discard_keys(&quic_conn->els[QUIC_TLS_ENC_LEVEL_HANDSHAKE]);
 	quic_pktns_discard(quic_conn->els[QUIC_TLS_ENC_LEVEL_HANDSHAKE].pktns, quic_conn);
@@ -2335,6 +2619,9 @@ static void quic_conn_enc_level_uninit(struct quic_enc_level *qel)
 {
 	int i;
 
+	quic_tls_secrets_ctx_free(&qel->tls_ctx.rx);
+	quic_tls_secrets_ctx_free(&qel->tls_ctx.tx);
+
 	for (i = 0; i < qel->tx.crypto.nb_buf; i++) {
 		if (qel->tx.crypto.bufs[i]) {
 			pool_free(pool_head_quic_crypto_buf, qel->tx.crypto.bufs[i]);
@@ -2358,6 +2645,8 @@ static int quic_conn_enc_level_init(struct quic_conn *qc,
 	qel->tls_ctx.rx.aead = qel->tls_ctx.tx.aead = NULL;
 	qel->tls_ctx.rx.md   = qel->tls_ctx.tx.md = NULL;
 	qel->tls_ctx.rx.hp   = qel->tls_ctx.tx.hp = NULL;
+	qel->tls_ctx.rx.ctx  = qel->tls_ctx.tx.ctx = NULL;
+	qel->tls_ctx.rx.hp_ctx = qel->tls_ctx.tx.hp_ctx = NULL;
 	qel->tls_ctx.rx.flags = 0;
 	qel->tls_ctx.tx.flags = 0;
 
@@ -2386,77 +2675,21 @@ static int quic_conn_enc_level_init(struct quic_conn *qc,
 	return 0;
 }
 
-/* Release the memory allocated for <buf> array of buffers, with <nb> as size.
- * Never fails.
- */
-static inline void free_quic_conn_tx_bufs(struct q_buf **bufs, size_t nb)
-{
-	struct q_buf **p;
-
-	if (!bufs)
-		return;
-
-	p = bufs;
-	while (--nb) {
-		if (!*p) {
-			p++;
-			continue;
-		}
-		ha_free(&(*p)->area);
-		ha_free(p);
-		p++;
-	}
-	free(bufs);
-}
-
-/* Allocate an array or <nb> buffers of <sz> bytes each.
- * Return this array if succeeded, NULL if failed.
- */
-static inline struct q_buf **quic_conn_tx_bufs_alloc(size_t nb, size_t sz)
-{
-	int i;
-	struct q_buf **bufs, **p;
-
-	bufs = calloc(nb, sizeof *bufs);
-	if (!bufs)
-		return NULL;
-
-	i = 0;
-	p = bufs;
-	while (i++ < nb) {
-		*p = calloc(1, sizeof **p);
-		if (!*p)
-			goto err;
-
-		(*p)->area = malloc(sz);
-		if (!(*p)->area)
-		    goto err;
-
-		(*p)->pos = (*p)->area;
-		(*p)->end = (*p)->area + sz;
-		(*p)->data = 0;
-		LIST_INIT(&(*p)->pkts);
-		p++;
-	}
-
-	return bufs;
-
- err:
-	free_quic_conn_tx_bufs(bufs, nb);
-	return NULL;
-}
-
 /* Release all the memory allocated for <conn> QUIC connection. */
 static void quic_conn_free(struct quic_conn *conn)
 {
 	int i;
 
+	qc_half_open_release(conn);
 	free_quic_conn_cids(conn);
 	for (i = 0; i < QUIC_TLS_ENC_LEVEL_MAX; i++)
 		quic_conn_enc_level_uninit(&conn->els[i]);
-	free_quic_conn_tx_bufs(conn->tx.bufs, conn->tx.nb_buf);
+	for (i = 0; i < QUIC_CONN_TX_BUFS_NB; i++)
+		q_buf_release(&conn->tx.bufs[i]);
 	if (conn->timer_task)
 		task_destroy(conn->timer_task);
+	if (conn->pacing_task)
+		task_destroy(conn->pacing_task);
 	pool_free(pool_head_quic_conn, conn);
 }
 
@@ -2523,8 +2756,13 @@ int qc_new_conn_init(struct quic_conn *qc, int ipv4,
 	int i;
 	/* Initial CID. */
 	struct quic_connection_id *icid;
+	struct quic_cc_algo *cc_algo = default_quic_cc_algo;
+	struct listener *l;
 
 	TRACE_ENTER(QUIC_EV_CONN_INIT, qc->conn);
+	l = objt_listener(qc->conn->target);
+	if (l && l->bind_conf->quic_cc_algo)
+		cc_algo = l->bind_conf->quic_cc_algo;
 	qc->cids = EB_ROOT;
 	/* QUIC Server (or listener). */
 	if (objt_listener(qc->conn->target)) {
@@ -2545,9 +2783,6 @@ int qc_new_conn_init(struct quic_conn *qc, int ipv4,
 		qc->dcid.len = dcid_len;
 	}
 
-	/* Initialize the output buffer */
-	qc->obuf.pos = qc->obuf.data;
-
 	icid = new_quic_cid(&qc->cids, 0);
 	if (!icid)
 		return 0;
@@ -2575,11 +2810,13 @@ int qc_new_conn_init(struct quic_conn *qc, int ipv4,
 
 	/* TX part. */
 	LIST_INIT(&qc->tx.frms_to_send);
-	qc->tx.bufs = quic_conn_tx_bufs_alloc(QUIC_CONN_TX_BUFS_NB, QUIC_CONN_TX_BUF_SZ);
-	if (!qc->tx.bufs)
-		goto err;
-
-	qc->tx.nb_buf = QUIC_CONN_TX_BUFS_NB;
+	/* The buffers are allocated only when there are packets to build. */
+	for (i = 0; i < QUIC_CONN_TX_BUFS_NB; i++) {
+		qc->tx.bufs[i].area = qc->tx.bufs[i].pos = NULL;
+		qc->tx.bufs[i].end = NULL;
+		qc->tx.bufs[i].data = 0;
+		LIST_INIT(&qc->tx.bufs[i].pkts);
+	}
 	qc->tx.wbuf = qc->tx.rbuf = 0;
 	qc->tx.bytes = 0;
 	qc->tx.nb_pto_dgrams = 0;
@@ -2588,7 +2825,9 @@ int qc_new_conn_init(struct quic_conn *qc, int ipv4,
 
 	/* XXX TO DO: Only one path at this time. */
 	qc->path = &qc->paths[0];
-	quic_path_init(qc->path, ipv4, default_quic_cc_algo, qc);
+	quic_path_init(qc->path, ipv4, cc_algo, qc);
+	qc->tx.pacing_credit = QUIC_PACING_BURST * qc->path->mtu;
+	qc->tx.pacing_ts = now_ms;
 
 	TRACE_LEAVE(QUIC_EV_CONN_INIT, qc->conn);
 
@@ -2600,12 +2839,12 @@ int qc_new_conn_init(struct quic_conn *qc, int ipv4,
 	return 0;
 }
 
-/* Initialize the timer task of <qc> QUIC connection.
+/* Initialize the timer task and the pacing task of <qc> QUIC connection.
  * Returns 1 if succeeded, 0 if not.
  */
 static int quic_conn_init_timer(struct quic_conn *qc)
 {
-	qc->timer_task = task_new(MAX_THREADS_MASK);
+	qc->timer_task = task_new(tid_bit);
 	if (!qc->timer_task)
 		return 0;
 
@@ -2613,6 +2852,13 @@ static int quic_conn_init_timer(struct quic_conn *qc)
 	qc->timer_task->process = process_timer;
 	qc->timer_task->context = qc->conn->xprt_ctx;
 
+	qc->pacing_task = task_new(tid_bit);
+	if (!qc->pacing_task)
+		return 0;
+
+	qc->pacing_task->process = qc_pacing_process;
+	qc->pacing_task->context = qc->conn->xprt_ctx;
+
 	return 1;
 }
 
@@ -2727,7 +2973,8 @@ static inline int qc_try_rm_hp(struct quic_rx_packet *pkt,
 		quic_rx_packet_list_addq(&qel->rx.pqpkts, pkt);
 	}
 
-	memcpy(pkt->data, beg, pkt->len);
+	/* The packet is decrypted in place in its receive buffer. */
+	pkt->data = beg;
 	/* Updtate the offset of <*buf> for the next QUIC packet. */
 	*buf = beg + pkt->len;
 
@@ -2872,7 +3119,7 @@ static ssize_t qc_srv_pkt_rcv(unsigned char **buf, const unsigned char *end,
 		goto err;
 	}
 
-	if (pkt->len > sizeof pkt->data) {
+	if (pkt->len > QUIC_PACKET_MAXLEN) {
 		TRACE_PROTO("Too big packet", QUIC_EV_CONN_SPKT, qc->conn, pkt, &pkt->len);
 		goto err;
 	}
@@ -2893,6 +3140,117 @@ static ssize_t qc_srv_pkt_rcv(unsigned char **buf, const unsigned char *end,
 	return -1;
 }
 
+/* Computes into <mac> the QUIC_RETRY_TOKEN_MAC_LEN bytes long MAC of the <len>
+ * bytes long Retry token <token> (without its MAC) for <cid>, the Retry SCID
+ * concatenated to the client address. Returns 1 if succeeded, 0 if not.
+ */
+static int quic_retry_token_mac(const unsigned char *token, size_t len,
+                                const struct quic_cid *cid, unsigned char *mac)
+{
+	unsigned char buf[QUIC_RETRY_TOKEN_MAXLEN + sizeof cid->data];
+	unsigned char md[EVP_MAX_MD_SIZE];
+	unsigned int md_len;
+
+	memcpy(buf, token, len);
+	memcpy(buf + len, cid->data, cid->len);
+	if (!HMAC(EVP_sha256(), quic_retry_secret, sizeof quic_retry_secret,
+	          buf, len + cid->len, md, &md_len))
+		return 0;
+
+	memcpy(mac, md, QUIC_RETRY_TOKEN_MAC_LEN);
+	return 1;
+}
+
+/* Sends a Retry packet on the socket of <l> listener to the client which sent
+ * <pkt> Initial packet with <odcid_len> bytes as DCID length from <saddr>.
+ * Nothing is allocated: everything needed to create the connection when the
+ * client sends its Initial packet again is found in the token, which is only
+ * valid for this client address and for the new random SCID of the Retry
+ * packet, designating the current thread. Returns 1 if succeeded, 0 if not.
+ */
+static int quic_send_retry(struct listener *l, struct quic_rx_packet *pkt,
+                           size_t odcid_len, struct sockaddr_storage *saddr)
+{
+	unsigned char buf[1 + 4 + 2 * (1 + QUIC_CID_MAXLEN) + QUIC_RETRY_TOKEN_MAXLEN + QUIC_TLS_TAG_LEN];
+	unsigned char *pos = buf, *end = buf + sizeof buf, *token;
+	struct quic_cid rscid, odcid;
+	struct iovec iov;
+
+	rscid.len = QUIC_CID_LEN;
+	if (RAND_bytes(rscid.data, rscid.len) != 1)
+		return 0;
+
+	quic_pin_cid_to_tid(rscid.data, tid);
+	*pos++ = QUIC_PACKET_FIXED_BIT | QUIC_PACKET_LONG_HEADER_BIT |
+		(QUIC_PACKET_TYPE_RETRY << QUIC_PACKET_TYPE_SHIFT);
+	quic_write_uint32(&pos, end, pkt->version);
+	*pos++ = pkt->scid.len;
+	memcpy(pos, pkt->scid.data, pkt->scid.len);
+	pos += pkt->scid.len;
+	*pos++ = rscid.len;
+	memcpy(pos, rscid.data, rscid.len);
+	pos += rscid.len;
+
+	/* Retry token */
+	token = pos;
+	*pos++ = QUIC_TOKEN_FMT_RETRY;
+	quic_write_uint32(&pos, end, date.tv_sec);
+	*pos++ = odcid_len;
+	memcpy(pos, pkt->dcid.data, odcid_len);
+	pos += odcid_len;
+	quic_cid_saddr_cat(&rscid, saddr);
+	if (!quic_retry_token_mac(token, pos - token, &rscid, pos))
+		return 0;
+	pos += QUIC_RETRY_TOKEN_MAC_LEN;
+
+	memcpy(odcid.data, pkt->dcid.data, odcid_len);
+	odcid.len = odcid_len;
+	if (!quic_tls_generate_retry_integrity_tag(&odcid, buf, pos - buf))
+		return 0;
+	pos += QUIC_TLS_TAG_LEN;
+
+	iov.iov_base = buf;
+	iov.iov_len = pos - buf;
+	return quic_sock_send_dgrams(l->rx.fd, saddr, &iov, 1) == 1;
+}
+
+/* Checks the <len> bytes long <token> of <pkt> Initial packet whose DCID has
+ * been concatenated to the client address. If this is a Retry token sent to
+ * this address less than QUIC_RETRY_TOKEN_LIFETIME seconds ago with this DCID
+ * as Retry SCID, the client ODCID it carries is copied to <pkt> which is
+ * flagged with QUIC_FL_RX_PACKET_VALIDATED. Returns 1 if the token is valid,
+ * 0 if not.
+ */
+static int quic_retry_token_check(const unsigned char *token, size_t len,
+                                  struct quic_rx_packet *pkt)
+{
+	const unsigned char *pos = token, *end = token + len;
+	unsigned char mac[QUIC_RETRY_TOKEN_MAC_LEN];
+	unsigned char odcid_len;
+	uint32_t ts;
+
+	if (len < 1 + 4 + 1 + QUIC_RETRY_TOKEN_MAC_LEN || *pos++ != QUIC_TOKEN_FMT_RETRY)
+		return 0;
+
+	quic_read_uint32(&ts, &pos, end);
+	odcid_len = *pos++;
+	if (odcid_len > QUIC_CID_MAXLEN || end - pos != odcid_len + QUIC_RETRY_TOKEN_MAC_LEN)
+		return 0;
+
+	/* this also rejects the tokens from the future */
+	if ((uint32_t)date.tv_sec - ts > QUIC_RETRY_TOKEN_LIFETIME)
+		return 0;
+
+	if (!quic_retry_token_mac(token, pos + odcid_len - token, &pkt->dcid, mac) ||
+	    CRYPTO_memcmp(mac, pos + odcid_len, sizeof mac) != 0)
+		return 0;
+
+	memcpy(pkt->token_odcid.data, pos, odcid_len);
+	pkt->token_odcid.len = odcid_len;
+	pkt->flags |= QUIC_FL_RX_PACKET_VALIDATED;
+	return 1;
+}
+
 static ssize_t qc_lstnr_pkt_rcv(unsigned char **buf, const unsigned char *end,
                                 struct quic_rx_packet *pkt,
                                 struct quic_dgram_ctx *dgram_ctx,
@@ -2904,6 +3262,7 @@ static ssize_t qc_lstnr_pkt_rcv(unsigned char **buf, const unsigned char *end,
 	struct eb_root *cids;
 	struct ebmb_node *node;
 	struct listener *l;
+	struct quic_rx_thr *qrx;
 	struct quic_conn_ctx *conn_ctx;
 	int long_header = 0;
 
@@ -2920,6 +3279,8 @@ static ssize_t qc_lstnr_pkt_rcv(unsigned char **buf, const unsigned char *end,
 	}
 
 	l = dgram_ctx->owner;
+	/* the datagrams are processed by the thread owning their connection */
+	qrx = &l->rx.quic_thr[tid];
 	beg = *buf;
 	/* Header form */
 	qc_parse_hd_form(pkt, *(*buf)++, &long_header);
@@ -2940,7 +3301,7 @@ static ssize_t qc_lstnr_pkt_rcv(unsigned char **buf, const unsigned char *end,
 			 * Let's distinguish them concatenating the socket addresses to the DCIDs.
 			 */
 			quic_cid_saddr_cat(&pkt->dcid, saddr);
-			cids = &l->rx.odcids;
+			cids = &qrx->odcids;
 		}
 		else {
 			if (pkt->dcid.len != QUIC_CID_LEN) {
@@ -2948,14 +3309,14 @@ static ssize_t qc_lstnr_pkt_rcv(unsigned char **buf, const unsigned char *end,
 				goto err;
 			}
 
-			cids = &l->rx.cids;
+			cids = &qrx->cids;
 		}
 
 		node = ebmb_lookup(cids, pkt->dcid.data, pkt->dcid.len);
 		if (!node && pkt->type == QUIC_PACKET_TYPE_INITIAL && dcid_len == QUIC_CID_LEN &&
-		    cids == &l->rx.odcids) {
+		    cids == &qrx->odcids) {
 			/* Switch to the definitive tree ->cids containing the final CIDs. */
-			node = ebmb_lookup(&l->rx.cids, pkt->dcid.data, dcid_len);
+			node = ebmb_lookup(&qrx->cids, pkt->dcid.data, dcid_len);
 			if (node) {
 				/* If found, signal this with NULL as special value for <cids>. */
 				pkt->dcid.len = dcid_len;
@@ -2964,11 +3325,38 @@ static ssize_t qc_lstnr_pkt_rcv(unsigned char **buf, const unsigned char *end,
 		}
 
 		if (!node) {
+			const unsigned char *token;
+			uint64_t token_len;
+
 			if (pkt->type != QUIC_PACKET_TYPE_INITIAL) {
 				TRACE_PROTO("Non Initiial packet", QUIC_EV_CONN_LPKT);
 				goto err;
 			}
 
+			/* Peek at the token to know if the client address is
+			 * validated before allocating anything.
+			 */
+			token = *buf;
+			if (!quic_dec_int(&token_len, &token, end) || end - token < token_len) {
+				TRACE_PROTO("Packet dropped", QUIC_EV_CONN_LPKT);
+				goto err;
+			}
+
+			if (token_len)
+				quic_retry_token_check(token, token_len, pkt);
+
+			if (!(pkt->flags & QUIC_FL_RX_PACKET_VALIDATED) &&
+			    HA_ATOMIC_LOAD(&quic_half_open_conns) >= quic_retry_threshold) {
+				/* Only the clients without token are sent a Retry
+				 * packet, the other ones have either been sent one
+				 * too long ago or are forging their token.
+				 */
+				if (!token_len && !quic_send_retry(l, pkt, dcid_len, saddr))
+					TRACE_PROTO("Retry not sent", QUIC_EV_CONN_LPKT);
+				TRACE_PROTO("Initial packet with address not validated dropped", QUIC_EV_CONN_LPKT);
+				goto err;
+			}
+
 			qc = new_quic_conn(pkt->version);
 			if (!qc) {
 				TRACE_PROTO("Non allocated new connection", QUIC_EV_CONN_LPKT);
@@ -2982,7 +3370,7 @@ static ssize_t qc_lstnr_pkt_rcv(unsigned char **buf, const unsigned char *end,
 			 */
 			pkt->odcid_len = dcid_len;
 			/* Enqueue this packet. */
-			LIST_APPEND(&l->rx.qpkts, &pkt->rx_list);
+			LIST_APPEND(&qrx->qpkts, &pkt->rx_list);
 			/* Try to accept a new connection. */
 			listener_accept(l);
 			if (!qc->conn) {
@@ -2990,6 +3378,10 @@ static ssize_t qc_lstnr_pkt_rcv(unsigned char **buf, const unsigned char *end,
 				goto err;
 			}
 
+			/* The connection is half-open until its handshake completes. */
+			qc->flags |= QUIC_FL_CONN_HALF_OPEN;
+			HA_ATOMIC_INC(&quic_half_open_conns);
+
 			if (!quic_conn_init_timer(qc)) {
 				TRACE_PROTO("Non initialized timer", QUIC_EV_CONN_LPKT, qc->conn);
 				goto err;
@@ -3002,7 +3394,7 @@ static ssize_t qc_lstnr_pkt_rcv(unsigned char **buf, const unsigned char *end,
 			                              qc->enc_params, qc->enc_params_len);
 		}
 		else {
-			if (pkt->type == QUIC_PACKET_TYPE_INITIAL && cids == &l->rx.odcids)
+			if (pkt->type == QUIC_PACKET_TYPE_INITIAL && cids == &qrx->odcids)
 				qc = ebmb_entry(node, struct quic_conn, odcid_node);
 			else
 				qc = ebmb_entry(node, struct quic_conn, scid_node);
@@ -3043,7 +3435,7 @@ static ssize_t qc_lstnr_pkt_rcv(unsigned char **buf, const unsigned char *end,
 			goto err;
 		}
 
-		cids = &l->rx.cids;
+		cids = &qrx->cids;
 		node = ebmb_lookup(cids, *buf, QUIC_CID_LEN);
 		if (!node) {
 			TRACE_PROTO("Packet dropped", QUIC_EV_CONN_LPKT);
@@ -3090,7 +3482,7 @@ static ssize_t qc_lstnr_pkt_rcv(unsigned char **buf, const unsigned char *end,
 		goto err;
 	}
 
-	if (pkt->len > sizeof pkt->data) {
+	if (pkt->len > QUIC_PACKET_MAXLEN) {
 		TRACE_PROTO("Too big packet", QUIC_EV_CONN_LPKT, qc->conn, pkt, &pkt->len);
 		goto err;
 	}
@@ -3166,39 +3558,23 @@ static int quic_build_packet_short_header(unsigned char **buf, const unsigned ch
 
 /* Apply QUIC header protection to the packet with <buf> as first byte address,
  * <pn> as address of the Packet number field, <pnlen> being this field length
- * with <aead> as AEAD cipher and <key> as secret key.
+ * with <hp_ctx> as header protection cipher context.
  * Returns 1 if succeeded or 0 if failed.
  */
 static int quic_apply_header_protection(unsigned char *buf, unsigned char *pn, size_t pnlen,
-                                        const EVP_CIPHER *aead, const unsigned char *key)
+                                        EVP_CIPHER_CTX *hp_ctx)
 {
-	int i, ret, outlen;
-	EVP_CIPHER_CTX *ctx;
-	/* We need an IV of at least 5 bytes: one byte for bytes #0
-	 * and at most 4 bytes for the packet number
-	 */
-	unsigned char mask[5] = {0};
+	int i;
+	unsigned char mask[QUIC_TLS_HP_SAMPLE_LEN];
 
-	ret = 0;
-	ctx = EVP_CIPHER_CTX_new();
-	if (!ctx)
+	if (!quic_tls_hp_masks(hp_ctx, pn + QUIC_PACKET_PN_MAXLEN, mask, 1))
 		return 0;
 
-	if (!EVP_EncryptInit_ex(ctx, aead, NULL, key, pn + QUIC_PACKET_PN_MAXLEN) ||
-	    !EVP_EncryptUpdate(ctx, mask, &outlen, mask, sizeof mask) ||
-	    !EVP_EncryptFinal_ex(ctx, mask, &outlen))
-		goto out;
-
 	*buf ^= mask[0] & (*buf & QUIC_PACKET_LONG_HEADER_BIT ? 0xf : 0x1f);
 	for (i = 0; i < pnlen; i++)
 		pn[i] ^= mask[i + 1];
 
-	ret = 1;
-
- out:
-	EVP_CIPHER_CTX_free(ctx);
-
-	return ret;
+	return 1;
 }
 
 /* Reduce the encoded size of <ack_frm> ACK frame removing the last
@@ -3382,7 +3758,7 @@ static ssize_t qc_do_build_hdshk_pkt(struct q_buf *wbuf,
 	/* Build an ACK frame if required. */
 	ack_frm_len = 0;
 	if ((qel->pktns->flags & QUIC_FL_PKTNS_ACK_REQUIRED) &&
-	    !eb_is_empty(&qel->pktns->rx.arngs.root)) {
+	    qel->pktns->rx.arngs.sz) {
 		ack_frm.tx_ack.ack_delay = 0;
 		ack_frm.tx_ack.arngs = &qel->pktns->rx.arngs;
 		ack_frm_len = quic_ack_frm_reduce_sz(&ack_frm, end - pos);
@@ -3543,8 +3919,9 @@ static ssize_t qc_build_hdshk_pkt(struct q_buf *buf, struct quic_conn *qc, int p
 
 	TRACE_ENTER(QUIC_EV_CONN_HPKT, qc->conn, NULL, qel);
 	pkt = pool_alloc(pool_head_quic_tx_packet);
-	if (!pkt) {
+	if (!pkt || !q_buf_alloc(buf)) {
 		TRACE_DEVEL("Not enough memory for a new packet", QUIC_EV_CONN_HPKT, qc->conn);
+		pool_free(pool_head_quic_tx_packet, pkt);
 		return -2;
 	}
 
@@ -3556,6 +3933,8 @@ static ssize_t qc_build_hdshk_pkt(struct q_buf *buf, struct quic_conn *qc, int p
 	pkt_len = qc_do_build_hdshk_pkt(buf, pkt, pkt_type, pn, &pn_len, &buf_pn, qel, qc);
 	if (pkt_len <= 0) {
 		free_quic_tx_packet(pkt);
+		if (q_buf_empty(buf))
+			q_buf_release(buf);
 		return pkt_len;
 	}
 
@@ -3571,7 +3950,7 @@ static ssize_t qc_build_hdshk_pkt(struct q_buf *buf, struct quic_conn *qc, int p
 	end += QUIC_TLS_TAG_LEN;
 	pkt_len += QUIC_TLS_TAG_LEN;
 	if (!quic_apply_header_protection(beg, buf_pn, pn_len,
-	                                  tls_ctx->tx.hp, tls_ctx->tx.hp_key)) {
+	                                  tls_ctx->tx.hp_ctx)) {
 		TRACE_DEVEL("Could not apply the header protection", QUIC_EV_CONN_HPKT, qc->conn);
 		goto err;
 	}
@@ -3601,6 +3980,8 @@ static ssize_t qc_build_hdshk_pkt(struct q_buf *buf, struct quic_conn *qc, int p
 
  err:
 	free_quic_tx_packet(pkt);
+	if (q_buf_empty(buf))
+		q_buf_release(buf);
 	TRACE_DEVEL("leaving in error", QUIC_EV_CONN_HPKT, qc->conn);
 	return -2;
 }
@@ -3657,7 +4038,7 @@ static ssize_t qc_do_build_phdshk_apkt(struct q_buf *wbuf,
 	/* Build an ACK frame if required. */
 	ack_frm_len = 0;
 	if ((qel->pktns->flags & QUIC_FL_PKTNS_ACK_REQUIRED) &&
-	    !eb_is_empty(&qel->pktns->rx.arngs.root)) {
+	    qel->pktns->rx.arngs.sz) {
 		ack_frm.tx_ack.ack_delay = 0;
 		ack_frm.tx_ack.arngs = &qel->pktns->rx.arngs;
 		ack_frm_len = quic_ack_frm_reduce_sz(&ack_frm, end - pos);
@@ -3745,8 +4126,9 @@ static ssize_t qc_build_phdshk_apkt(struct q_buf *wbuf, struct quic_conn *qc)
 
 	TRACE_ENTER(QUIC_EV_CONN_PAPKT, qc->conn);
 	pkt = pool_alloc(pool_head_quic_tx_packet);
-	if (!pkt) {
+	if (!pkt || !q_buf_alloc(wbuf)) {
 		TRACE_DEVEL("Not enough memory for a new packet", QUIC_EV_CONN_PAPKT, qc->conn);
+		pool_free(pool_head_quic_tx_packet, pkt);
 		return -2;
 	}
 
@@ -3759,6 +4141,8 @@ static ssize_t qc_build_phdshk_apkt(struct q_buf *wbuf, struct quic_conn *qc)
 	pkt_len = qc_do_build_phdshk_apkt(wbuf, pkt, pn, &pn_len, &buf_pn, qel, qc);
 	if (pkt_len <= 0) {
 		free_quic_tx_packet(pkt);
+		if (q_buf_empty(wbuf))
+			q_buf_release(wbuf);
 		return pkt_len;
 	}
 
@@ -3774,7 +4158,7 @@ static ssize_t qc_build_phdshk_apkt(struct q_buf *wbuf, struct quic_conn *qc)
 	end += QUIC_TLS_TAG_LEN;
 	pkt_len += QUIC_TLS_TAG_LEN;
 	if (!quic_apply_header_protection(beg, buf_pn, pn_len,
-	                                  tls_ctx->tx.hp, tls_ctx->tx.hp_key))
+	                                  tls_ctx->tx.hp_ctx))
 		goto err;
 
 	q_buf_setpos(wbuf, end);
@@ -3800,6 +4184,8 @@ static ssize_t qc_build_phdshk_apkt(struct q_buf *wbuf, struct quic_conn *qc)
 
  err:
 	free_quic_tx_packet(pkt);
+	if (q_buf_empty(wbuf))
+		q_buf_release(wbuf);
 	TRACE_DEVEL("leaving in error", QUIC_EV_CONN_PAPKT, qc->conn);
 	return -2;
 }
@@ -4148,6 +4534,12 @@ static int qc_conn_init(struct connection *conn, void **xprt_ctx)
 		                          &ctx->ssl, &ctx->bio, ha_quic_meth, ctx) == -1)
 			goto err;
 
+#if !defined(OPENSSL_IS_BORINGSSL) && (HA_OPENSSL_VERSION_NUMBER >= 0x10101000L)
+		if (bc->ssl_conf.early_data) {
+			SSL_set_quic_early_data_enabled(ctx->ssl, 1);
+			SSL_set_allow_early_data_cb(ctx->ssl, quic_0rtt_allow_cb, conn);
+		}
+#endif
 		SSL_set_accept_state(ctx->ssl);
 	}
 
@@ -4196,11 +4588,13 @@ static void __quic_conn_deinit(void)
 
 /* Read all the QUIC packets found in <buf> with <len> as length (typically a UDP
  * datagram), <ctx> being the QUIC I/O handler context, from QUIC connections,
- * calling <func> function;
+ * calling <func> function. <buf> is found in <rxbuf> receive buffer which each
+ * packet references until it is released.
  * Return the number of bytes read if succeeded, -1 if not.
  */
 static ssize_t quic_dgram_read(char *buf, size_t len, void *owner,
-                               struct sockaddr_storage *saddr, qpkt_read_func *func)
+                               struct sockaddr_storage *saddr, struct quic_rxbuf *rxbuf,
+                               qpkt_read_func *func)
 {
 	unsigned char *pos;
 	const unsigned char *end;
@@ -4221,6 +4615,8 @@ static ssize_t quic_dgram_read(char *buf, size_t len, void *owner,
 			goto err;
 
 		quic_rx_packet_refinc(pkt);
+		pkt->rxbuf = rxbuf;
+		quic_rxbuf_refinc(rxbuf);
 		ret = func(&pos, end, pkt, &dgram_ctx, saddr);
 		if (ret == -1) {
 			size_t pkt_len;
@@ -4245,71 +4641,215 @@ static ssize_t quic_dgram_read(char *buf, size_t len, void *owner,
 	return -1;
 }
 
-ssize_t quic_lstnr_dgram_read(char *buf, size_t len, void *owner,
-                              struct sockaddr_storage *saddr)
+/* The datagrams handed to each thread by the other ones */
+static struct {
+	struct mt_list dgrams;        /* datagrams to be processed by this thread */
+	struct tasklet *tasklet;      /* tasklet processing the list above */
+} quic_dghdlrs[MAX_THREADS];
+
+/* Retrieves the destination connection ID of the first packet of <len> bytes
+ * long datagram <buf> into <dcid>. Returns its length, or 0 if not found.
+ */
+static size_t quic_get_dgram_dcid(const unsigned char *buf, size_t len,
+                                  const unsigned char **dcid)
 {
-	return quic_dgram_read(buf, len, owner, saddr, qc_lstnr_pkt_rcv);
+	size_t dcid_len;
+
+	if (!len)
+		return 0;
+
+	if (*buf & QUIC_PACKET_LONG_HEADER_BIT) {
+		/* first byte, version, DCID length */
+		if (len < 6)
+			return 0;
+		dcid_len = buf[5];
+		*dcid = buf + 6;
+	}
+	else {
+		dcid_len = QUIC_CID_LEN;
+		*dcid = buf + 1;
+	}
+
+	if (dcid_len > QUIC_CID_MAXLEN || *dcid + dcid_len > buf + len)
+		return 0;
+	return dcid_len;
 }
 
-ssize_t quic_srv_dgram_read(char *buf, size_t len, void *owner,
-                            struct sockaddr_storage *saddr)
+/* Tasklet processing the datagrams handed to its thread by the other ones */
+static struct task *quic_dgrams_process(struct task *t, void *ctx, unsigned int state)
 {
-	return quic_dgram_read(buf, len, owner, saddr, qc_srv_pkt_rcv);
+	struct mt_list *dgrams = ctx;
+	struct quic_dgram *dgram;
+	int budget = global.tune.maxpollevents;
+
+	while (budget-- && (dgram = MT_LIST_POP(dgrams, typeof(dgram), list))) {
+		quic_dgram_read((char *)dgram->buf, dgram->len, dgram->owner,
+		                &dgram->saddr, dgram->rxbuf, qc_lstnr_pkt_rcv);
+		quic_rxbuf_refdec(dgram->rxbuf);
+		pool_free(pool_head_quic_dgram, dgram);
+	}
+
+	if (!MT_LIST_ISEMPTY(dgrams))
+		tasklet_wakeup((struct tasklet *)t);
+	return t;
 }
 
-/* QUIC I/O handler for connection to local listeners or remove servers
- * depending on <listener> boolean value, with <fd> as socket file
- * descriptor and <ctx> as context.
+/* Processes the datagram <buf> of <len> bytes received by listener <owner> from
+ * <saddr>. Since the connection IDs we generate designate the thread owning
+ * their connection, the datagrams are handed to this thread when it is not the
+ * current one, so that all the packets of a connection and its timers are
+ * always processed by the same thread. The datagrams starting a new connection
+ * are processed by the thread designated by the client's DCID, and the
+ * connection IDs then generated for the connection designate this thread.
+ * The datagram is not copied, the owner thread is only given a reference to
+ * the <rxbuf> receive buffer it was received in.
+ * Returns the number of bytes consumed or -1 if the datagram was dropped.
  */
-static size_t quic_conn_handler(int fd, void *ctx, qpkt_read_func *func)
+ssize_t quic_lstnr_dgram_read(char *buf, size_t len, void *owner,
+                              struct sockaddr_storage *saddr, struct quic_rxbuf *rxbuf)
 {
-	ssize_t ret;
-	size_t done = 0;
-	struct buffer *buf = get_trash_chunk();
-	/* Source address */
-	struct sockaddr_storage saddr = {0};
-	socklen_t saddrlen = sizeof saddr;
+	const unsigned char *dcid;
+	struct quic_dgram *dgram;
+	unsigned int thr;
+
+	if (global.nbthread == 1 || !quic_get_dgram_dcid((unsigned char *)buf, len, &dcid))
+		goto local;
+
+	thr = quic_get_cid_tid(dcid);
+	if (thr == tid)
+		goto local;
+
+	dgram = pool_alloc(pool_head_quic_dgram);
+	if (!dgram)
+		return -1;
+
+	dgram->owner = owner;
+	dgram->saddr = *saddr;
+	dgram->rxbuf = rxbuf;
+	quic_rxbuf_refinc(rxbuf);
+	dgram->buf = (unsigned char *)buf;
+	dgram->len = len;
+	MT_LIST_APPEND(&quic_dghdlrs[thr].dgrams, &dgram->list);
+	tasklet_wakeup(quic_dghdlrs[thr].tasklet);
+	return len;
+
+ local:
+	return quic_dgram_read(buf, len, owner, saddr, rxbuf, qc_lstnr_pkt_rcv);
+}
+
+/* Allocates the tasklet processing the datagrams handed to the current thread */
+static int quic_dghdlrs_init_per_thread()
+{
+	struct tasklet *tl;
 
-	if (!fd_recv_ready(fd))
+	tl = tasklet_new();
+	if (!tl)
 		return 0;
+	tl->process = quic_dgrams_process;
+	tl->context = &quic_dghdlrs[tid].dgrams;
+	tl->tid     = tid;
+	MT_LIST_INIT(&quic_dghdlrs[tid].dgrams);
+	quic_dghdlrs[tid].tasklet = tl;
+	return 1;
+}
 
-	do {
-		ret = recvfrom(fd, buf->area, buf->size, 0,
-		               (struct sockaddr *)&saddr, &saddrlen);
-		if (ret < 0) {
-			if (errno == EINTR)
-				continue;
-			if (errno == EAGAIN)
-				fd_cant_recv(fd);
-			goto out;
-		}
-	} while (0);
+/* Releases the tasklet and the pending datagrams of the current thread */
+static void quic_dghdlrs_deinit_per_thread()
+{
+	struct quic_dgram *dgram;
 
-	done = buf->data = ret;
-	quic_dgram_read(buf->area, buf->data, ctx, &saddr, func);
+	if (!quic_dghdlrs[tid].tasklet)
+		return;
 
- out:
-	return done;
+	while ((dgram = MT_LIST_POP(&quic_dghdlrs[tid].dgrams, typeof(dgram), list))) {
+		quic_rxbuf_refdec(dgram->rxbuf);
+		pool_free(pool_head_quic_dgram, dgram);
+	}
+	tasklet_free(quic_dghdlrs[tid].tasklet);
+	quic_dghdlrs[tid].tasklet = NULL;
+}
+
+REGISTER_PER_THREAD_INIT(quic_dghdlrs_init_per_thread);
+REGISTER_PER_THREAD_DEINIT(quic_dghdlrs_deinit_per_thread);
+
+ssize_t quic_srv_dgram_read(char *buf, size_t len, void *owner,
+                            struct sockaddr_storage *saddr, struct quic_rxbuf *rxbuf)
+{
+	return quic_dgram_read(buf, len, owner, saddr, rxbuf, qc_srv_pkt_rcv);
 }
 
 /* QUIC I/O handler for connections to local listeners with <fd> as socket
- * file descriptor.
+ * file descriptor. All the pending datagrams are read by batches.
  */
 void quic_fd_handler(int fd)
 {
 	if (fdtab[fd].state & FD_POLL_IN)
-		quic_conn_handler(fd, fdtab[fd].owner, &qc_lstnr_pkt_rcv);
+		quic_sock_recv_dgrams(fd, fdtab[fd].owner, quic_lstnr_dgram_read);
 }
 
 /* QUIC I/O handler for connections to remote servers with <fd> as socket
- * file descriptor.
+ * file descriptor. All the pending datagrams are read by batches.
  */
 void quic_conn_fd_handler(int fd)
 {
 	if (fdtab[fd].state & FD_POLL_IN)
-		quic_conn_handler(fd, fdtab[fd].owner, &qc_srv_pkt_rcv);
+		quic_sock_recv_dgrams(fd, fdtab[fd].owner, quic_srv_dgram_read);
+}
+
+/* config parser for global "tune.quic.retry-threshold" */
+static int quic_parse_retry_threshold(char **args, int section_type, struct proxy *curpx,
+                                      const struct proxy *defpx, const char *file, int line,
+                                      char **err)
+{
+	if (too_many_args(1, args, err, NULL))
+		return -1;
+
+	if (!*args[1] || *args[1] == '-') {
+		memprintf(err, "'%s' expects a positive numeric value.", args[0]);
+		return -1;
+	}
+
+	quic_retry_threshold = atoi(args[1]);
+	return 0;
 }
 
+/* config parser for global "tune.quic.0rtt-cache-size" */
+static int quic_parse_0rtt_cache_size(char **args, int section_type, struct proxy *curpx,
+                                      const struct proxy *defpx, const char *file, int line,
+                                      char **err)
+{
+	if (too_many_args(1, args, err, NULL))
+		return -1;
+
+	if (!*args[1] || *args[1] == '-' || atoi(args[1]) <= 0) {
+		memprintf(err, "'%s' expects a strictly positive numeric value.", args[0]);
+		return -1;
+	}
+
+	quic_0rtt_cache_size = atoi(args[1]);
+	return 0;
+}
+
+static struct cfg_kw_list cfg_kws = {ILH, {
+	{ CFG_GLOBAL, "tune.quic.0rtt-cache-size", quic_parse_0rtt_cache_size },
+	{ CFG_GLOBAL, "tune.quic.retry-threshold", quic_parse_retry_threshold },
+	{ 0, NULL, NULL }
+}};
+
+INITCALL1(STG_REGISTER, cfg_register_keywords, &cfg_kws);
+
+/* Generates the secret authenticating the Retry tokens. Returns an ERR_* code. */
+static int quic_retry_init()
+{
+	if (RAND_bytes(quic_retry_secret, sizeof quic_retry_secret) != 1) {
+		ha_alert("QUIC: unable to generate the Retry token secret.\n");
+		return ERR_ALERT | ERR_FATAL;
+	}
+	return ERR_NONE;
+}
+
+REGISTER_POST_CHECK(quic_retry_init);
+
 /*
  * Local variables:
  *  c-indent-level: 8
@@ -0,0 +1,618 @@
+/*
+ * Shared-memory transport layer over UNIX sockets, for local agents.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ *
+ * The connection is established over a UNIX stream socket as usual. Once it
+ * is connected, a memory area holding two rings (one per direction) and two
+ * eventfds (one per side) are passed to the peer, and from this point, the
+ * data only flow through the rings. A side only writes to the other side's
+ * eventfd when this one reported that it was waiting for it, so that no
+ * system call is needed while both sides are busy. The socket is only watched
+ * to detect the closing of the peer. See xprt_shm-t.h for the layout.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+
+#include <haproxy/api.h>
+#include <haproxy/buf.h>
+#include <haproxy/connection.h>
+#include <haproxy/fd.h>
+#include <haproxy/global.h>
+#include <haproxy/pool.h>
+#include <haproxy/task.h>
+#include <haproxy/tools.h>
+#include <haproxy/xprt_shm-t.h>
+
+/* flags for xprt_shm_ctx->flags */
+#define XPRT_SHM_FL_READY      0x00000001  /* the area was passed to the peer */
+#define XPRT_SHM_FL_PEER_SHUT  0x00000002  /* the peer closed the socket */
+#define XPRT_SHM_FL_EFD_POLLED 0x00000004  /* <efd_hap> is registered in the poller */
+
+struct xprt_shm_ctx {
+	struct connection *conn;
+	struct wait_event *subs;           /* upper layer's subscriptions */
+	struct wait_event wait_event;      /* our subscriptions to the socket */
+	const struct xprt_ops *xprt;       /* underlying transport, raw_sock */
+	void *xprt_ctx;
+	struct xprt_shm_area *area;        /* shared area, <map_size> bytes */
+	char *tx;                          /* ring HAProxy writes to */
+	char *rx;                          /* ring the agent writes to */
+	size_t map_size;
+	uint32_t size;                     /* size of each ring */
+	int memfd;                         /* area's fd until it is passed */
+	int efd_agent;                     /* eventfd to wake the agent up */
+	int efd_hap;                       /* eventfd to be woken up by the agent */
+	unsigned int flags;                /* XPRT_SHM_FL_* */
+};
+
+DECLARE_STATIC_POOL(xprt_shm_ctx_pool, "xprt_shm_ctx_pool", sizeof(struct xprt_shm_ctx));
+
+/* Returns the number of bytes that may be read from the agent's ring */
+static inline uint32_t xprt_shm_rx_data(const struct xprt_shm_ctx *ctx)
+{
+	uint32_t head = HA_ATOMIC_LOAD(&ctx->area->agent.head);
+
+	__ha_barrier_load();
+	return head - ctx->area->hap.tail;
+}
+
+/* Returns the number of bytes that may be written into HAProxy's ring */
+static inline uint32_t xprt_shm_tx_room(const struct xprt_shm_ctx *ctx)
+{
+	uint32_t tail = HA_ATOMIC_LOAD(&ctx->area->agent.tail);
+
+	__ha_barrier_load();
+	return ctx->size - (ctx->area->hap.head - tail);
+}
+
+/* Wakes the agent up if it is waiting for its eventfd, after data were
+ * produced or consumed.
+ */
+static inline void xprt_shm_notify(struct xprt_shm_ctx *ctx)
+{
+	uint64_t one = 1;
+
+	__ha_barrier_full();
+	if (HA_ATOMIC_LOAD(&ctx->area->agent.sleeping))
+		DISGUISE(write(ctx->efd_agent, &one, sizeof(one)));
+}
+
+/* Wakes the upper layer's subscribers for events <event_type> */
+static inline void xprt_shm_wake_subs(struct xprt_shm_ctx *ctx, int event_type)
+{
+	if (!ctx->subs || !(ctx->subs->events & event_type))
+		return;
+
+	tasklet_wakeup(ctx->subs->tasklet);
+	ctx->subs->events &= ~event_type;
+	if (!ctx->subs->events)
+		ctx->subs = NULL;
+}
+
+/* Returns the events among the upper layer's subscriptions that may be
+ * reported now.
+ */
+static inline int xprt_shm_ready_events(struct xprt_shm_ctx *ctx)
+{
+	int events = ctx->subs ? ctx->subs->events : 0;
+	int ready = 0;
+
+	if (!(ctx->flags & XPRT_SHM_FL_READY))
+		return (ctx->conn->flags & CO_FL_ERROR) ? events : 0;
+
+	if ((ctx->conn->flags & CO_FL_ERROR) || (ctx->flags & XPRT_SHM_FL_PEER_SHUT))
+		return events;
+
+	if ((events & SUB_RETRY_RECV) && xprt_shm_rx_data(ctx))
+		ready |= SUB_RETRY_RECV;
+	if ((events & SUB_RETRY_SEND) && xprt_shm_tx_room(ctx))
+		ready |= SUB_RETRY_SEND;
+	return ready;
+}
+
+/* Called by the poller when the agent writes to HAProxy's eventfd */
+static void xprt_shm_efd_iocb(int fd)
+{
+	struct xprt_shm_ctx *ctx = fdtab[fd].owner;
+	uint64_t cnt;
+
+	DISGUISE(read(fd, &cnt, sizeof(cnt)));
+	fd_cant_recv(fd);
+	tasklet_wakeup(ctx->wait_event.tasklet);
+}
+
+/* Allocates the shared area and the eventfds of <ctx>. Returns 0 on success,
+ * otherwise -1 with the connection's error code set.
+ */
+static int xprt_shm_alloc(struct xprt_shm_ctx *ctx)
+{
+	struct connection *conn = ctx->conn;
+
+	ctx->size = 1U << my_flsl(2 * global.tune.bufsize - 1);
+	ctx->map_size = sizeof(struct xprt_shm_area) + 2 * (size_t)ctx->size;
+
+	ctx->memfd = memfd_create("haproxy-shm-xprt", MFD_CLOEXEC);
+	if (ctx->memfd < 0)
+		goto fail_fd;
+
+	if (ftruncate(ctx->memfd, ctx->map_size) < 0)
+		goto fail_mem;
+
+	ctx->area = mmap(NULL, ctx->map_size, PROT_READ | PROT_WRITE, MAP_SHARED, ctx->memfd, 0);
+	if (ctx->area == MAP_FAILED) {
+		ctx->area = NULL;
+		goto fail_mem;
+	}
+	ctx->tx = ctx->area->rings;
+	ctx->rx = ctx->area->rings + ctx->size;
+
+	ctx->efd_agent = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (ctx->efd_agent < 0)
+		goto fail_fd;
+
+	ctx->efd_hap = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (ctx->efd_hap < 0)
+		goto fail_fd;
+
+	if (ctx->efd_hap >= global.maxsock)
+		goto fail_fd;
+
+	fd_insert(ctx->efd_hap, ctx, xprt_shm_efd_iocb, tid_bit);
+	fd_want_recv(ctx->efd_hap);
+	ctx->flags |= XPRT_SHM_FL_EFD_POLLED;
+	return 0;
+
+ fail_fd:
+	conn->err_code = CO_ER_SYS_FDLIM;
+	return -1;
+ fail_mem:
+	conn->err_code = CO_ER_SYS_MEMLIM;
+	return -1;
+}
+
+/* Releases the shared area and the eventfds of <ctx>, if any */
+static void xprt_shm_release(struct xprt_shm_ctx *ctx)
+{
+	if (ctx->flags & XPRT_SHM_FL_EFD_POLLED)
+		fd_delete(ctx->efd_hap);
+	else if (ctx->efd_hap >= 0)
+		close(ctx->efd_hap);
+	if (ctx->efd_agent >= 0)
+		close(ctx->efd_agent);
+	if (ctx->memfd >= 0)
+		close(ctx->memfd);
+	if (ctx->area)
+		munmap(ctx->area, ctx->map_size);
+	tasklet_free(ctx->wait_event.tasklet);
+	pool_free(xprt_shm_ctx_pool, ctx);
+}
+
+/* Passes the shared area and the eventfds to the agent once the socket is
+ * connected. Returns 1 once done, 0 if it must be retried later, in which case
+ * we are subscribed to the socket, or -1 on error.
+ */
+static int xprt_shm_send_hello(struct xprt_shm_ctx *ctx)
+{
+	struct connection *conn = ctx->conn;
+	struct xprt_shm_hello hello;
+	char cbuf[CMSG_SPACE(3 * sizeof(int))];
+	struct cmsghdr *cmsg;
+	struct msghdr msg;
+	struct iovec iov;
+	int fds[3];
+	ssize_t ret;
+
+	if (!conn_ctrl_ready(conn))
+		return 0;
+
+	if (conn->flags & CO_FL_WAIT_L4_CONN) {
+		ctx->xprt->subscribe(conn, ctx->xprt_ctx, SUB_RETRY_SEND, &ctx->wait_event);
+		return 0;
+	}
+
+	memset(&hello, 0, sizeof(hello));
+	memcpy(hello.magic, XPRT_SHM_MAGIC, sizeof(hello.magic));
+	hello.size = ctx->size;
+
+	fds[0] = ctx->memfd;
+	fds[1] = ctx->efd_agent;
+	fds[2] = ctx->efd_hap;
+
+	memset(&msg, 0, sizeof(msg));
+	memset(cbuf, 0, sizeof(cbuf));
+	iov.iov_base = &hello;
+	iov.iov_len  = sizeof(hello);
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = cbuf;
+	msg.msg_controllen = sizeof(cbuf);
+	cmsg = CMSG_FIRSTHDR(&msg);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type  = SCM_RIGHTS;
+	cmsg->cmsg_len   = CMSG_LEN(sizeof(fds));
+	memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+	do {
+		ret = sendmsg(conn->handle.fd, &msg, MSG_DONTWAIT | MSG_NOSIGNAL);
+	} while (ret < 0 && errno == EINTR);
+
+	if (ret < 0 && (errno == EAGAIN || errno == ENOTCONN)) {
+		fd_cant_send(conn->handle.fd);
+		ctx->xprt->subscribe(conn, ctx->xprt_ctx, SUB_RETRY_SEND, &ctx->wait_event);
+		return 0;
+	}
+
+	if (ret != sizeof(hello)) {
+		conn->flags |= CO_FL_ERROR | CO_FL_SOCK_RD_SH | CO_FL_SOCK_WR_SH;
+		conn->err_code = CO_ER_SOCK_ERR;
+		return -1;
+	}
+
+	/* the agent now holds its own reference on the area */
+	close(ctx->memfd);
+	ctx->memfd = -1;
+	ctx->flags |= XPRT_SHM_FL_READY;
+	return 1;
+}
+
+/* Checks the socket for a close or an error from the peer. Nothing else is
+ * expected on it, so any data are dropped. We stay subscribed to the socket
+ * until something happens.
+ */
+static void xprt_shm_check_sock(struct xprt_shm_ctx *ctx)
+{
+	struct connection *conn = ctx->conn;
+	char drop[64];
+	ssize_t ret;
+
+	while (1) {
+		ret = recv(conn->handle.fd, drop, sizeof(drop), MSG_DONTWAIT);
+		if (ret > 0)
+			continue;
+		if (ret == 0) {
+			ctx->flags |= XPRT_SHM_FL_PEER_SHUT;
+			return;
+		}
+		if (errno == EINTR)
+			continue;
+		if (errno == EAGAIN || errno == ENOTCONN)
+			break;
+		conn->flags |= CO_FL_ERROR | CO_FL_SOCK_RD_SH | CO_FL_SOCK_WR_SH;
+		return;
+	}
+	fd_cant_recv(conn->handle.fd);
+	ctx->xprt->subscribe(conn, ctx->xprt_ctx, SUB_RETRY_RECV, &ctx->wait_event);
+}
+
+/* Reports to the agent whether we wait for the eventfd, depending on the upper
+ * layer's subscriptions, and wakes the subscribers whose events may already be
+ * reported.
+ */
+static void xprt_shm_update_sleep(struct xprt_shm_ctx *ctx)
+{
+	int ready;
+
+	while (1) {
+		ready = xprt_shm_ready_events(ctx);
+		if (ready)
+			xprt_shm_wake_subs(ctx, ready);
+
+		if (!(ctx->flags & XPRT_SHM_FL_READY))
+			return;
+
+		if (!ctx->subs) {
+			HA_ATOMIC_STORE(&ctx->area->hap.sleeping, 0);
+			return;
+		}
+
+		/* check again after announcing that we sleep, since the agent
+		 * may have done something in the mean time without seeing it.
+		 */
+		HA_ATOMIC_STORE(&ctx->area->hap.sleeping, 1);
+		__ha_barrier_full();
+		if (!xprt_shm_ready_events(ctx))
+			return;
+	}
+}
+
+/* xprt_shm_io_cb is exported to see it resolved in "show fd" */
+struct task *xprt_shm_io_cb(struct task *t, void *context, unsigned int state)
+{
+	struct xprt_shm_ctx *ctx = context;
+	struct connection *conn = ctx->conn;
+
+	if (!(ctx->flags & XPRT_SHM_FL_READY) && !(conn->flags & CO_FL_ERROR)) {
+		if (!xprt_shm_send_hello(ctx))
+			return t;
+	}
+
+	/* only look at the socket when it woke us up */
+	if ((ctx->flags & XPRT_SHM_FL_READY) &&
+	    !(ctx->flags & XPRT_SHM_FL_PEER_SHUT) &&
+	    !(conn->flags & CO_FL_ERROR) &&
+	    !(ctx->wait_event.events & SUB_RETRY_RECV))
+		xprt_shm_check_sock(ctx);
+
+	/* if nobody waits for an event, let the mux know about the errors
+	 * and the closing of the peer. It may release the connection.
+	 */
+	if (!ctx->subs && ((conn->flags & CO_FL_ERROR) || (ctx->flags & XPRT_SHM_FL_PEER_SHUT)) &&
+	    conn->xprt_ctx == ctx && conn->mux && conn->mux->wake) {
+		conn->mux->wake(conn);
+		return t;
+	}
+
+	xprt_shm_update_sleep(ctx);
+	return t;
+}
+
+/* Sends up to <count> bytes from <buf> by copying them into the ring. Returns
+ * the number of bytes sent.
+ */
+static size_t xprt_shm_from_buf(struct connection *conn, void *xprt_ctx, const struct buffer *buf, size_t count, int flags)
+{
+	struct xprt_shm_ctx *ctx = xprt_ctx;
+	uint32_t head, room, ofs, len;
+	size_t try, done = 0;
+
+	if (!(ctx->flags & XPRT_SHM_FL_READY))
+		return 0;
+
+	if ((conn->flags & CO_FL_SOCK_WR_SH) || (ctx->flags & XPRT_SHM_FL_PEER_SHUT)) {
+		/* it's already closed */
+		conn->flags |= CO_FL_ERROR | CO_FL_SOCK_RD_SH;
+		errno = EPIPE;
+		return 0;
+	}
+
+	head = ctx->area->hap.head;
+	room = xprt_shm_tx_room(ctx);
+	while (count && room) {
+		try = b_contig_data(buf, done);
+		if (try > count)
+			try = count;
+		if (try > room)
+			try = room;
+
+		ofs = head & (ctx->size - 1);
+		len = MIN(try, ctx->size - ofs);
+		memcpy(ctx->tx + ofs, b_peek(buf, done), len);
+		memcpy(ctx->tx, b_peek(buf, done + len), try - len);
+
+		head  += try;
+		done  += try;
+		count -= try;
+		room  -= try;
+	}
+
+	if (done) {
+		__ha_barrier_store();
+		HA_ATOMIC_STORE(&ctx->area->hap.head, head);
+		xprt_shm_notify(ctx);
+	}
+	return done;
+}
+
+/* Receives up to <count> bytes from the ring into <buf>. Returns the number of
+ * bytes received. The read shutdown is only reported once the ring is empty.
+ */
+static size_t xprt_shm_to_buf(struct connection *conn, void *xprt_ctx, struct buffer *buf, size_t count, int flags)
+{
+	struct xprt_shm_ctx *ctx = xprt_ctx;
+	uint32_t tail, data, ofs, len;
+	size_t try, done = 0;
+
+	if (!(ctx->flags & XPRT_SHM_FL_READY))
+		return 0;
+
+	conn->flags &= ~CO_FL_WAIT_ROOM;
+	tail = ctx->area->hap.tail;
+	data = xprt_shm_rx_data(ctx);
+	while (count && data) {
+		try = b_contig_space(buf);
+		if (!try)
+			break;
+		if (try > count)
+			try = count;
+		if (try > data)
+			try = data;
+
+		ofs = tail & (ctx->size - 1);
+		len = MIN(try, ctx->size - ofs);
+		memcpy(b_tail(buf), ctx->rx + ofs, len);
+		memcpy(b_tail(buf) + len, ctx->rx, try - len);
+		b_add(buf, try);
+
+		tail  += try;
+		done  += try;
+		count -= try;
+		data  -= try;
+	}
+
+	if (done) {
+		__ha_barrier_full();
+		HA_ATOMIC_STORE(&ctx->area->hap.tail, tail);
+		xprt_shm_notify(ctx);
+	}
+	else if (!data && (ctx->flags & XPRT_SHM_FL_PEER_SHUT))
+		conn_sock_read0(conn);
+
+	return done;
+}
+
+/* Called from the upper layer, to subscribe <es> to events <event_type>. The
+ * event subscriber <es> is not allowed to change from a previous call as long
+ * as at least one event is still subscribed. The <event_type> must only be a
+ * combination of SUB_RETRY_RECV and SUB_RETRY_SEND. It always returns 0.
+ */
+static int xprt_shm_subscribe(struct connection *conn, void *xprt_ctx, int event_type, struct wait_event *es)
+{
+	struct xprt_shm_ctx *ctx = xprt_ctx;
+
+	BUG_ON(event_type & ~(SUB_RETRY_SEND|SUB_RETRY_RECV));
+	BUG_ON(ctx->subs && ctx->subs != es);
+
+	ctx->subs = es;
+	es->events |= event_type;
+	xprt_shm_update_sleep(ctx);
+	return 0;
+}
+
+/* Called from the upper layer, to unsubscribe <es> from events <event_type>.
+ * The <es> pointer is not allowed to differ from the one passed to the
+ * subscribe() call. It always returns zero.
+ */
+static int xprt_shm_unsubscribe(struct connection *conn, void *xprt_ctx, int event_type, struct wait_event *es)
+{
+	struct xprt_shm_ctx *ctx = xprt_ctx;
+
+	BUG_ON(event_type & ~(SUB_RETRY_SEND|SUB_RETRY_RECV));
+	BUG_ON(ctx->subs && ctx->subs != es);
+
+	es->events &= ~event_type;
+	if (!es->events) {
+		ctx->subs = NULL;
+		if (ctx->flags & XPRT_SHM_FL_READY)
+			HA_ATOMIC_STORE(&ctx->area->hap.sleeping, 0);
+	}
+	return 0;
+}
+
+static int xprt_shm_init(struct connection *conn, void **xprt_ctx)
+{
+	struct xprt_shm_ctx *ctx;
+
+	/* already initialized */
+	if (*xprt_ctx)
+		return 0;
+
+	ctx = pool_alloc(xprt_shm_ctx_pool);
+	if (!ctx) {
+		conn->err_code = CO_ER_SYS_MEMLIM;
+		return -1;
+	}
+	ctx->conn = conn;
+	ctx->subs = NULL;
+	ctx->area = NULL;
+	ctx->memfd = ctx->efd_agent = ctx->efd_hap = -1;
+	ctx->flags = 0;
+	ctx->wait_event.tasklet = tasklet_new();
+	if (!ctx->wait_event.tasklet) {
+		conn->err_code = CO_ER_SYS_MEMLIM;
+		pool_free(xprt_shm_ctx_pool, ctx);
+		return -1;
+	}
+	ctx->wait_event.tasklet->process = xprt_shm_io_cb;
+	ctx->wait_event.tasklet->context = ctx;
+	ctx->wait_event.events = 0;
+
+	ctx->xprt = xprt_get(XPRT_RAW);
+	ctx->xprt_ctx = NULL;
+	if (xprt_shm_alloc(ctx) < 0) {
+		xprt_shm_release(ctx);
+		return -1;
+	}
+	*xprt_ctx = ctx;
+	return 0;
+}
+
+static int xprt_shm_start(struct connection *conn, void *xprt_ctx)
+{
+	struct xprt_shm_ctx *ctx = xprt_ctx;
+
+	tasklet_wakeup(ctx->wait_event.tasklet);
+	return 0;
+}
+
+static void xprt_shm_close(struct connection *conn, void *xprt_ctx)
+{
+	struct xprt_shm_ctx *ctx = xprt_ctx;
+
+	if (!ctx)
+		return;
+
+	if (ctx->wait_event.events != 0)
+		ctx->xprt->unsubscribe(conn, ctx->xprt_ctx, ctx->wait_event.events, &ctx->wait_event);
+	if (ctx->subs) {
+		ctx->subs->events = 0;
+		tasklet_wakeup(ctx->subs->tasklet);
+	}
+	if (ctx->xprt->close)
+		ctx->xprt->close(conn, ctx->xprt_ctx);
+	xprt_shm_release(ctx);
+}
+
+/* Use the provided XPRT as an underlying XPRT, and provide the old one.
+ * Returns 0 on success, and non-zero on failure.
+ */
+static int xprt_shm_add_xprt(struct connection *conn, void *xprt_ctx, void *toadd_ctx, const struct xprt_ops *toadd_ops, void **oldxprt_ctx, const struct xprt_ops **oldxprt_ops)
+{
+	struct xprt_shm_ctx *ctx = xprt_ctx;
+
+	if (oldxprt_ops != NULL)
+		*oldxprt_ops = ctx->xprt;
+	if (oldxprt_ctx != NULL)
+		*oldxprt_ctx = ctx->xprt_ctx;
+	ctx->xprt = toadd_ops;
+	ctx->xprt_ctx = toadd_ctx;
+	return 0;
+}
+
+/* Remove the specified xprt. If if it our underlying XPRT, remove it and
+ * return 0, otherwise just call the remove_xprt method from the underlying
+ * XPRT.
+ */
+static int xprt_shm_remove_xprt(struct connection *conn, void *xprt_ctx, void *toremove_ctx, const struct xprt_ops *newops, void *newctx)
+{
+	struct xprt_shm_ctx *ctx = xprt_ctx;
+
+	if (ctx->xprt_ctx == toremove_ctx) {
+		ctx->xprt_ctx = newctx;
+		ctx->xprt = newops;
+		return 0;
+	}
+	return (ctx->xprt->remove_xprt(conn, ctx->xprt_ctx, toremove_ctx, newops, newctx));
+}
+
+/* transport-layer operations for shared-memory connections */
+static struct xprt_ops xprt_shm = {
+	.snd_buf     = xprt_shm_from_buf,
+	.rcv_buf     = xprt_shm_to_buf,
+	.subscribe   = xprt_shm_subscribe,
+	.unsubscribe = xprt_shm_unsubscribe,
+	.remove_xprt = xprt_shm_remove_xprt,
+	.add_xprt    = xprt_shm_add_xprt,
+	.init        = xprt_shm_init,
+	.start       = xprt_shm_start,
+	.close       = xprt_shm_close,
+	.rcv_pipe    = NULL,
+	.snd_pipe    = NULL,
+	.shutr       = NULL,
+	.shutw       = NULL,
+	.name        = "SHM",
+};
+
+__attribute__((constructor))
+static void __xprt_shm_init(void)
+{
+	xprt_register(XPRT_SHM, &xprt_shm);
+}
+
+/*
+ * Local variables:
+ *  c-indent-level: 8
+ *  c-basic-offset: 8
+ * End:
+ */